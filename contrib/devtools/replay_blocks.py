@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The LitecoinZ Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+'''
+Replay a stored range of blocks against a copy of a chainstate snapshot, and
+report blocks/s, a per-phase time breakdown and chainstate flush stalls.
+
+The snapshot is a datadir (chainstate/, blocks/index/ and the blk/rev files
+they refer to) of a node stopped at the height just below the replayed range.
+It is copied first, so the same snapshot can be replayed again with other
+settings. The blocks are imported with -loadblock, which runs them through
+the usual block acceptance and ConnectTip path, with -debug=bench so that
+ConnectBlock logs its timings.
+'''
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+# "    - Verify 12 txins: 1.23ms (0.100ms/txin) [4.56s (7.89ms/blk)]"
+BENCH_LINE = re.compile(r'^\S+ +(- .+?): ([0-9.]+)ms')
+UPDATE_TIP = re.compile(r'UpdateTip: new best=\S+ height=(\d+)')
+# The numbers in a phase name differ from block to block.
+PHASE_NUMBERS = re.compile(r' \d+ ')
+
+def parse_debug_log(path, stall_ms):
+    phases = {}
+    order = []
+    blocks = 0
+    first_height = None
+    last_height = None
+    stalls = []
+    with open(path, encoding='utf8', errors='replace') as f:
+        for line in f:
+            m = UPDATE_TIP.search(line)
+            if m:
+                blocks += 1
+                last_height = int(m.group(1))
+                if first_height is None:
+                    first_height = last_height
+                continue
+            m = BENCH_LINE.match(line)
+            if not m:
+                continue
+            name = PHASE_NUMBERS.sub(' ', m.group(1)).strip()
+            ms = float(m.group(2))
+            if name not in phases:
+                phases[name] = 0.0
+                order.append(name)
+            phases[name] += ms
+            if name == '- Writing chainstate' and ms >= stall_ms:
+                stalls.append(ms)
+    return blocks, first_height, last_height, [(name, phases[name]) for name in order], stalls
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--litecoinzd', default='src/litecoinzd', help='path of the node binary (default: %(default)s)')
+    parser.add_argument('--snapshot', required=True, help='datadir to replay on top of; it is copied, not modified')
+    parser.add_argument('--dbcache', type=int, default=450, help='-dbcache for the run, in MiB (default: %(default)s)')
+    parser.add_argument('--par', type=int, default=0, help='-par for the run (default: %(default)s)')
+    parser.add_argument('--stall-ms', type=float, default=100, help='chainstate writes taking at least this long count as flush stalls (default: %(default)s)')
+    parser.add_argument('--workdir', help='where to copy the snapshot (default: a temporary directory, removed afterwards)')
+    parser.add_argument('--arg', action='append', default=[], help='extra argument for the node, may be repeated')
+    parser.add_argument('blockfiles', nargs='+', help='blk*.dat files holding the blocks to replay')
+    args = parser.parse_args()
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix='replay_blocks_')
+    datadir = os.path.join(workdir, 'datadir')
+    try:
+        if os.path.exists(datadir):
+            print('{} already exists'.format(datadir), file=sys.stderr)
+            return 1
+        shutil.copytree(args.snapshot, datadir)
+        debug_log = os.path.join(datadir, 'debug.log')
+        if os.path.exists(debug_log):
+            os.remove(debug_log)
+
+        cmd = [args.litecoinzd, '-datadir=' + datadir,
+               '-dbcache={}'.format(args.dbcache), '-par={}'.format(args.par),
+               '-connect=0', '-listen=0', '-dnsseed=0', '-server=0',
+               '-debug=bench', '-printtoconsole=0', '-stopafterblockimport']
+        cmd += ['-loadblock=' + os.path.abspath(f) for f in args.blockfiles]
+        cmd += args.arg
+
+        start = time.time()
+        subprocess.check_call(cmd)
+        elapsed = time.time() - start
+
+        blocks, first_height, last_height, phases, stalls = parse_debug_log(debug_log, args.stall_ms)
+    finally:
+        if not args.workdir:
+            shutil.rmtree(workdir)
+
+    if blocks == 0:
+        print('No blocks were connected; does the snapshot end just below the replayed range?', file=sys.stderr)
+        return 1
+
+    print('dbcache={} par={}'.format(args.dbcache, args.par))
+    print('{} blocks (height {} to {}) in {:.1f}s, {:.2f} blocks/s including startup and shutdown'.format(
+        blocks, first_height, last_height, elapsed, blocks / elapsed))
+    print()
+    print('{:<40} {:>12} {:>12}'.format('phase', 'total (s)', 'ms/blk'))
+    for name, ms in phases:
+        print('{:<40} {:>12.2f} {:>12.3f}'.format(name, ms / 1000, ms / blocks))
+    print()
+    if stalls:
+        print('{} flush stalls of at least {}ms: {:.2f}s total, {:.2f}s longest'.format(
+            len(stalls), args.stall_ms, sum(stalls) / 1000, max(stalls) / 1000))
+    else:
+        print('no flush stalls of at least {}ms'.format(args.stall_ms))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
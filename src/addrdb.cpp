@@ -16,17 +16,20 @@
 
 namespace {
 
-template <typename Stream, typename Data>
-bool SerializeDB(Stream& stream, const Data& data)
+/** Peer and ban files are read into memory whole, up to this size. */
+constexpr uint64_t MAX_DB_FILE_SIZE = 256 * 1024 * 1024;
+
+template <typename Data>
+bool SerializeDB(CDataStream& stream, const Data& data)
 {
-    // Write and commit header, data
+    // Serialize header and data into memory, so that the data is only
+    // locked while it is serialized and not during the disk writes, and so
+    // that the checksum is computed over exactly what is written
     try {
-        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
         stream << Params().MessageStart() << data;
-        hasher << Params().MessageStart() << data;
-        stream << hasher.GetHash();
+        stream << Hash(stream.begin(), stream.end());
     } catch (const std::exception& e) {
-        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+        return error("%s: Serialize error - %s", __func__, e.what());
     }
 
     return true;
@@ -35,6 +38,11 @@ bool SerializeDB(Stream& stream, const Data& data)
 template <typename Data>
 bool SerializeFileDB(const std::string& prefix, const fs::path& path, const Data& data)
 {
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    if (!SerializeDB(ss, data)) {
+        return false;
+    }
+
     // Generate random temporary filename
     unsigned short randv = 0;
     GetRandBytes((unsigned char*)&randv, sizeof(randv));
@@ -50,11 +58,13 @@ bool SerializeFileDB(const std::string& prefix, const fs::path& path, const Data
         return error("%s: Failed to open file %s", __func__, pathTmp.string());
     }
 
-    // Serialize
-    if (!SerializeDB(fileout, data)) {
+    // Write the whole buffer at once
+    try {
+        fileout.write(ss.data(), ss.size());
+    } catch (const std::exception& e) {
         fileout.fclose();
         remove(pathTmp);
-        return false;
+        return error("%s: I/O error - %s", __func__, e.what());
     }
     if (!FileCommit(fileout.Get())) {
         fileout.fclose();
@@ -112,7 +122,22 @@ bool DeserializeFileDB(const fs::path& path, Data& data)
     if (filein.IsNull())
         return error("%s: Failed to open file %s", __func__, path.string());
 
-    return DeserializeDB(filein, data);
+    // Read the whole file with one call and deserialize it from memory,
+    // instead of reading each field of each entry from the file
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    try {
+        const int64_t size = fs::file_size(path);
+        if (size > (int64_t)MAX_DB_FILE_SIZE) {
+            return error("%s: File %s is too large", __func__, path.string());
+        }
+        ss.resize(size);
+        filein.read(ss.data(), ss.size());
+    } catch (const std::exception& e) {
+        return error("%s: I/O error - %s", __func__, e.what());
+    }
+    filein.fclose();
+
+    return DeserializeDB(ss, data);
 }
 
 }
@@ -68,9 +68,25 @@ double CAddrInfo::GetChance(int64_t nNow) const
     // deprioritize 66% after each failed attempt, but at most 1/28th to avoid the search taking forever or overly penalizing outages.
     fChance *= pow(0.66, std::min(nAttempts, 8));
 
+    fChance *= GetPerformanceFactor();
+
     return fChance;
 }
 
+double CAddrInfo::GetPerformanceFactor() const
+{
+    // prefer addresses that answered and sent blocks fast before, but within
+    // bounds, so that which addresses we connect to stays unpredictable
+    double fFactor = 1.0;
+    if (nPingUsec > 0) {
+        fFactor *= std::max(std::min(double(ADDRMAN_REFERENCE_PING_USEC) / nPingUsec, ADDRMAN_MAX_PERFORMANCE_FACTOR), 1 / ADDRMAN_MAX_PERFORMANCE_FACTOR);
+    }
+    if (nBlockDownloadUsec > 0) {
+        fFactor *= std::max(std::min(double(ADDRMAN_REFERENCE_BLOCK_USEC) / nBlockDownloadUsec, ADDRMAN_MAX_PERFORMANCE_FACTOR), 1 / ADDRMAN_MAX_PERFORMANCE_FACTOR);
+    }
+    return fFactor;
+}
+
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
     std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
@@ -520,6 +536,27 @@ void CAddrMan::Connected_(const CService& addr, int64_t nTime)
         info.nTime = nTime;
 }
 
+void CAddrMan::SetPerformance_(const CService& addr, int64_t nPingUsec, int64_t nBlockDownloadUsec)
+{
+    CAddrInfo* pinfo = Find(addr);
+
+    // if not found, bail out
+    if (!pinfo)
+        return;
+
+    CAddrInfo& info = *pinfo;
+
+    // check whether we are talking about the exact same CService (including same port)
+    if (info != addr)
+        return;
+
+    // update info
+    if (nPingUsec > 0)
+        info.nPingUsec = info.nPingUsec == 0 ? nPingUsec : (info.nPingUsec * 7 + nPingUsec) / 8;
+    if (nBlockDownloadUsec > 0)
+        info.nBlockDownloadUsec = info.nBlockDownloadUsec == 0 ? nBlockDownloadUsec : (info.nBlockDownloadUsec * 7 + nBlockDownloadUsec) / 8;
+}
+
 void CAddrMan::SetServices_(const CService& addr, ServiceFlags nServices)
 {
     CAddrInfo* pinfo = Find(addr);
@@ -54,6 +54,12 @@ private:
     //! position in vRandom
     int nRandomPos{-1};
 
+    //! moving average of the ping times of our connections to it, in microseconds, 0 if unknown
+    int64_t nPingUsec{0};
+
+    //! moving average of the time it took per block it sent us, in microseconds, 0 if unknown
+    int64_t nBlockDownloadUsec{0};
+
     friend class CAddrMan;
 
 public:
@@ -92,6 +98,9 @@ public:
 
     //! Calculate the relative chance this entry should be given when selecting nodes to connect to
     double GetChance(int64_t nNow = GetAdjustedTime()) const;
+
+    //! Calculate the factor the chance is scaled by for the ping and block download times measured before
+    double GetPerformanceFactor() const;
 };
 
 /** Stochastic address manager
@@ -170,6 +179,15 @@ public:
 //! the maximum time we'll spend trying to resolve a tried table collision, in seconds
 static const int64_t ADDRMAN_TEST_WINDOW = 40*60; // 40 minutes
 
+//! the ping time of an address that the performance factor leaves its chance unchanged at, in microseconds
+#define ADDRMAN_REFERENCE_PING_USEC 200000
+
+//! the time per block of an address that the performance factor leaves its chance unchanged at, in microseconds
+#define ADDRMAN_REFERENCE_BLOCK_USEC 2000000
+
+//! fast addresses are at most this many times as likely to be selected per measurement, and slow ones as unlikely
+#define ADDRMAN_MAX_PERFORMANCE_FACTOR 2.0
+
 /**
  * Stochastical (IP) address manager
  */
@@ -269,6 +287,9 @@ protected:
     //! Update an entry's service bits.
     void SetServices_(const CService &addr, ServiceFlags nServices) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Add a ping time and a block download time measured on a connection to an entry, 0 for none.
+    void SetPerformance_(const CService &addr, int64_t nPingUsec, int64_t nBlockDownloadUsec) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
 public:
     // Compressed IP->ASN mapping, loaded from a file when a node starts.
     // Should be always empty if no file was provided.
@@ -302,6 +323,9 @@ public:
      * * for each bucket:
      *   * number of elements
      *   * for each element: index
+     * * asmap version (from version 2 on)
+     * * for all nNew addrinfos and all nTried addrinfos, in the same order: nPingUsec and
+     *   nBlockDownloadUsec (from version 3 on)
      *
      * 2**30 is xorred with the number of buckets to make addrman deserializer v0 detect it
      * as incompatible. This is necessary because it did not check the version number on
@@ -324,7 +348,7 @@ public:
     {
         LOCK(cs);
 
-        unsigned char nVersion = 2;
+        unsigned char nVersion = 3;
         s << nVersion;
         s << ((unsigned char)32);
         s << nKey;
@@ -374,6 +398,16 @@ public:
             asmap_version = SerializeHash(m_asmap);
         }
         s << asmap_version;
+
+        // Store the measured performance last, as it is not essential
+        for (const auto& entry : mapInfo) {
+            const CAddrInfo &info = entry.second;
+            if (info.nRefCount) s << info.nPingUsec << info.nBlockDownloadUsec;
+        }
+        for (const auto& entry : mapInfo) {
+            const CAddrInfo &info = entry.second;
+            if (info.fInTried) s << info.nPingUsec << info.nBlockDownloadUsec;
+        }
     }
 
     template<typename Stream>
@@ -416,6 +450,7 @@ public:
 
         // Deserialize entries from the tried table.
         int nLost = 0;
+        std::vector<int> vTriedIds; // The id of each tried entry, or -1 if it was lost
         for (int n = 0; n < nTried; n++) {
             CAddrInfo info;
             s >> info;
@@ -428,8 +463,10 @@ public:
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
                 vvTried[nKBucket][nKBucketPos] = nIdCount;
+                vTriedIds.push_back(nIdCount);
                 nIdCount++;
             } else {
+                vTriedIds.push_back(-1);
                 nLost++;
             }
         }
@@ -459,6 +496,21 @@ public:
             s >> serialized_asmap_version;
         }
 
+        if (nVersion > 2) {
+            int64_t nPingUsec, nBlockDownloadUsec;
+            for (int n = 0; n < nNew; n++) {
+                s >> nPingUsec >> nBlockDownloadUsec;
+                mapInfo[n].nPingUsec = std::max<int64_t>(nPingUsec, 0);
+                mapInfo[n].nBlockDownloadUsec = std::max<int64_t>(nBlockDownloadUsec, 0);
+            }
+            for (int nId : vTriedIds) {
+                s >> nPingUsec >> nBlockDownloadUsec;
+                if (nId == -1) continue;
+                mapInfo[nId].nPingUsec = std::max<int64_t>(nPingUsec, 0);
+                mapInfo[nId].nBlockDownloadUsec = std::max<int64_t>(nBlockDownloadUsec, 0);
+            }
+        }
+
         for (int n = 0; n < nNew; n++) {
             CAddrInfo &info = mapInfo[n];
             int bucket = entryToBucket[n];
@@ -667,6 +719,24 @@ public:
         Check();
     }
 
+    //! Update the ping and block download times of an entry, skipping those that are 0.
+    void SetPerformance(const CService &addr, int64_t nPingUsec, int64_t nBlockDownloadUsec)
+    {
+        LOCK(cs);
+        Check();
+        SetPerformance_(addr, nPingUsec, nBlockDownloadUsec);
+        Check();
+    }
+
+    //! Get the block download time measured on earlier connections to an address, or 0.
+    int64_t GetBlockDownloadTime(const CService &addr)
+    {
+        LOCK(cs);
+        const CAddrInfo* pinfo = Find(addr);
+        if (!pinfo || *pinfo != addr) return 0;
+        return pinfo->nBlockDownloadUsec;
+    }
+
 };
 
 #endif // BITCOIN_ADDRMAN_H
@@ -5,6 +5,7 @@
 #include <base58.h>
 
 #include <hash.h>
+#include <prevector.h>
 #include <uint256.h>
 #include <util/strencodings.h>
 #include <util/string.h>
@@ -35,6 +36,18 @@ static const int8_t mapBase58[256] = {
     -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
 };
 
+/** 58^5, the base of the limbs EncodeBase58 works in: the largest power of 58 whose limbs, shifted by 32 bits, still fit in 64 */
+static const uint32_t BASE58_LIMB = 58 * 58 * 58 * 58 * 58;
+
+/** The number of bytes of a little-endian number of 32 bit limbs, the last of which is not zero */
+static size_t SignificantBytes(const prevector<32, uint32_t>& limbs)
+{
+    if (limbs.empty()) return 0;
+    size_t bytes = 4 * (limbs.size() - 1);
+    for (uint32_t top = limbs.back(); top != 0; top >>= 8) ++bytes;
+    return bytes;
+}
+
 bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch, int max_ret_len)
 {
     // Skip leading spaces.
@@ -42,45 +55,50 @@ bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch, int max_ret_
         psz++;
     // Skip and count leading '1's.
     int zeroes = 0;
-    int length = 0;
     while (*psz == '1') {
         zeroes++;
         if (zeroes > max_ret_len) return false;
         psz++;
     }
-    // Allocate enough space in big-endian base256 representation.
-    int size = strlen(psz) * 733 /1000 + 1; // log(58) / log(256), rounded up.
-    std::vector<unsigned char> b256(size);
-    // Process the characters.
+    // The number in little-endian 32 bit limbs, which fit the longest keys without allocating.
+    prevector<32, uint32_t> limbs;
+    // Process the characters, up to 5 at a time.
     static_assert(sizeof(mapBase58)/sizeof(mapBase58[0]) == 256, "mapBase58.size() should be 256"); // guarantee not out of range
     while (*psz && !IsSpace(*psz)) {
-        // Decode base58 character
-        int carry = mapBase58[(uint8_t)*psz];
-        if (carry == -1)  // Invalid b58 character
-            return false;
-        int i = 0;
-        for (std::vector<unsigned char>::reverse_iterator it = b256.rbegin(); (carry != 0 || i < length) && (it != b256.rend()); ++it, ++i) {
-            carry += 58 * (*it);
-            *it = carry % 256;
-            carry /= 256;
+        uint64_t chunk = 0;
+        uint64_t mul = 1;
+        for (int i = 0; i < 5 && *psz && !IsSpace(*psz); ++i, ++psz) {
+            // Decode base58 character
+            int digit = mapBase58[(uint8_t)*psz];
+            if (digit == -1)  // Invalid b58 character
+                return false;
+            chunk = chunk * 58 + digit;
+            mul *= 58;
         }
-        assert(carry == 0);
-        length = i;
-        if (length + zeroes > max_ret_len) return false;
-        psz++;
+        // Apply "limbs = limbs * mul + chunk".
+        uint64_t carry = chunk;
+        for (uint32_t& limb : limbs) {
+            carry += limb * mul;
+            limb = (uint32_t)carry;
+            carry >>= 32;
+        }
+        if (carry != 0) limbs.push_back((uint32_t)carry);
+        if (SignificantBytes(limbs) + zeroes > (size_t)max_ret_len) return false;
     }
     // Skip trailing spaces.
     while (IsSpace(*psz))
         psz++;
     if (*psz != 0)
         return false;
-    // Skip leading zeroes in b256.
-    std::vector<unsigned char>::iterator it = b256.begin() + (size - length);
-    // Copy result into output vector.
-    vch.reserve(zeroes + (b256.end() - it));
+    // Copy result into output vector, skipping the leading zeroes of the top limb.
+    const size_t length = SignificantBytes(limbs);
+    vch.reserve(zeroes + length);
     vch.assign(zeroes, 0x00);
-    while (it != b256.end())
-        vch.push_back(*(it++));
+    for (size_t i = limbs.size(); i-- > 0;) {
+        for (int shift = (i == limbs.size() - 1 ? 8 * ((length - 1) % 4) : 24); shift >= 0; shift -= 8) {
+            vch.push_back(limbs[i] >> shift);
+        }
+    }
     return true;
 }
 
@@ -88,39 +106,50 @@ std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
 {
     // Skip & count leading zeroes.
     int zeroes = 0;
-    int length = 0;
     while (pbegin != pend && *pbegin == 0) {
         pbegin++;
         zeroes++;
     }
-    // Allocate enough space in big-endian base58 representation.
-    int size = (pend - pbegin) * 138 / 100 + 1; // log(256) / log(58), rounded up.
-    std::vector<unsigned char> b58(size);
-    // Process the bytes.
+    // The number in little-endian limbs of 5 base58 digits each.
+    prevector<32, uint32_t> limbs;
+    // Process the bytes, up to 4 at a time, all of them from then on.
+    size_t chunk = (pend - pbegin) % 4;
+    if (chunk == 0) chunk = 4;
     while (pbegin != pend) {
-        int carry = *pbegin;
-        int i = 0;
-        // Apply "b58 = b58 * 256 + ch".
-        for (std::vector<unsigned char>::reverse_iterator it = b58.rbegin(); (carry != 0 || i < length) && (it != b58.rend()); it++, i++) {
-            carry += 256 * (*it);
-            *it = carry % 58;
-            carry /= 58;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < chunk; ++i) {
+            carry = (carry << 8) | *pbegin++;
         }
-
-        assert(carry == 0);
-        length = i;
-        pbegin++;
+        // Apply "limbs = limbs * 256^chunk + bytes".
+        const unsigned shift = 8 * chunk;
+        for (uint32_t& limb : limbs) {
+            carry += (uint64_t)limb << shift;
+            limb = carry % BASE58_LIMB;
+            carry /= BASE58_LIMB;
+        }
+        while (carry != 0) {
+            limbs.push_back(carry % BASE58_LIMB);
+            carry /= BASE58_LIMB;
+        }
+        chunk = 4;
     }
-    // Skip leading zeroes in base58 result.
-    std::vector<unsigned char>::iterator it = b58.begin() + (size - length);
-    while (it != b58.end() && *it == 0)
-        it++;
-    // Translate the result into a string.
+    // Translate the result into a string, skipping the leading zeroes of the top limb.
     std::string str;
-    str.reserve(zeroes + (b58.end() - it));
+    str.reserve(zeroes + limbs.size() * 5);
     str.assign(zeroes, '1');
-    while (it != b58.end())
-        str += pszBase58[*(it++)];
+    char digits[5];
+    for (size_t i = limbs.size(); i-- > 0;) {
+        uint32_t limb = limbs[i];
+        for (int d = 4; d >= 0; --d) {
+            digits[d] = pszBase58[limb % 58];
+            limb /= 58;
+        }
+        int first = 0;
+        if (i == limbs.size() - 1) {
+            while (first < 4 && digits[first] == '1') ++first;
+        }
+        str.append(digits + first, 5 - first);
+    }
     return str;
 }
 
@@ -137,13 +166,28 @@ bool DecodeBase58(const std::string& str, std::vector<unsigned char>& vchRet, in
     return DecodeBase58(str.c_str(), vchRet, max_ret_len);
 }
 
-std::string EncodeBase58Check(const std::vector<unsigned char>& vchIn)
+std::string EncodeBase58Check(Span<const unsigned char> input)
 {
     // add 4-byte hash check to the end
-    std::vector<unsigned char> vch(vchIn);
-    uint256 hash = Hash(vch.begin(), vch.end());
-    vch.insert(vch.end(), (unsigned char*)&hash, (unsigned char*)&hash + 4);
-    return EncodeBase58(vch);
+    prevector<128, unsigned char> vch(input.begin(), input.end());
+    uint256 hash = Hash(input.begin(), input.end());
+    vch.insert(vch.end(), hash.begin(), hash.begin() + 4);
+    return EncodeBase58(vch.data(), vch.data() + vch.size());
+}
+
+std::string EncodeBase58Check(const std::vector<unsigned char>& vchIn)
+{
+    return EncodeBase58Check(MakeSpan(vchIn));
+}
+
+std::vector<std::string> EncodeBase58CheckBatch(const std::vector<std::vector<unsigned char>>& inputs)
+{
+    std::vector<std::string> ret;
+    ret.reserve(inputs.size());
+    for (const std::vector<unsigned char>& input : inputs) {
+        ret.push_back(EncodeBase58Check(MakeSpan(input)));
+    }
+    return ret;
 }
 
 bool DecodeBase58Check(const char* psz, std::vector<unsigned char>& vchRet, int max_ret_len)
@@ -170,3 +214,16 @@ bool DecodeBase58Check(const std::string& str, std::vector<unsigned char>& vchRe
     }
     return DecodeBase58Check(str.c_str(), vchRet, max_ret);
 }
+
+bool DecodeBase58CheckBatch(const std::vector<std::string>& strs, std::vector<std::vector<unsigned char>>& ret, int max_ret_len)
+{
+    ret.resize(strs.size());
+    bool all = true;
+    for (size_t i = 0; i < strs.size(); ++i) {
+        if (!DecodeBase58Check(strs[i], ret[i], max_ret_len)) {
+            ret[i].clear();
+            all = false;
+        }
+    }
+    return all;
+}
@@ -15,6 +15,7 @@
 #define BITCOIN_BASE58_H
 
 #include <attributes.h>
+#include <span.h>
 
 #include <string>
 #include <vector>
@@ -47,6 +48,12 @@ NODISCARD bool DecodeBase58(const std::string& str, std::vector<unsigned char>&
  * Encode a byte vector into a base58-encoded string, including checksum
  */
 std::string EncodeBase58Check(const std::vector<unsigned char>& vchIn);
+std::string EncodeBase58Check(Span<const unsigned char> input);
+
+/**
+ * Encode each of inputs as EncodeBase58Check does
+ */
+std::vector<std::string> EncodeBase58CheckBatch(const std::vector<std::vector<unsigned char>>& inputs);
 
 /**
  * Decode a base58-encoded string (psz) that includes a checksum into a byte
@@ -60,4 +67,11 @@ NODISCARD bool DecodeBase58Check(const char* psz, std::vector<unsigned char>& vc
  */
 NODISCARD bool DecodeBase58Check(const std::string& str, std::vector<unsigned char>& vchRet, int max_ret_len);
 
+/**
+ * Decode each of strs as DecodeBase58Check does into ret, reusing the buffers
+ * ret already has. Those that fail to decode are left empty; return true if
+ * none did.
+ */
+NODISCARD bool DecodeBase58CheckBatch(const std::vector<std::string>& strs, std::vector<std::vector<unsigned char>>& ret, int max_ret_len);
+
 #endif // BITCOIN_BASE58_H
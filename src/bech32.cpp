@@ -3,7 +3,6 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bech32.h>
-#include <util/vector.h>
 
 #include <assert.h>
 
@@ -29,8 +28,9 @@ const int8_t CHARSET_REV[128] = {
 
 /** This function will compute what 6 5-bit values to XOR into the last 6 input values, in order to
  *  make the checksum 0. These 6 values are packed together in a single 30-bit integer. The higher
- *  bits correspond to earlier values. */
-uint32_t PolyMod(const data& v)
+ *  bits correspond to earlier values. It continues from c, the result for the values before
+ *  [begin, end), or 1 for none, so that the HRP and the data need not be put together first. */
+uint32_t PolyMod(uint32_t c, const uint8_t* begin, const uint8_t* end)
 {
     // The input is interpreted as a list of coefficients of a polynomial over F = GF(32), with an
     // implicit 1 in front. If the input is [v0,v1,v2,v3,v4], that polynomial is v(x) =
@@ -57,8 +57,8 @@ uint32_t PolyMod(const data& v)
     // the above example, `c` initially corresponds to 1 mod g(x), and after processing 2 inputs of
     // v, it corresponds to x^2 + v0*x + v1 mod g(x). As 1 mod g(x) = 1, that is the starting value
     // for `c`.
-    uint32_t c = 1;
-    for (const auto v_i : v) {
+    for (const uint8_t* it = begin; it != end; ++it) {
+        const uint8_t v_i = *it;
         // We want to update `c` to correspond to a polynomial with one extra term. If the initial
         // value of `c` consists of the coefficients of c(x) = f(x) mod g(x), we modify it to
         // correspond to c'(x) = (f(x) * x + v_i) mod g(x), where v_i is the next input to
@@ -95,43 +95,40 @@ inline unsigned char LowerCase(unsigned char c)
     return (c >= 'A' && c <= 'Z') ? (c - 'A') + 'a' : c;
 }
 
-/** Expand a HRP for use in checksum computation. */
-data ExpandHRP(const std::string& hrp)
+/** PolyMod of the expansion of a HRP for use in checksum computation: the high bits of its
+ *  characters, a 0, then their low bits. */
+uint32_t PolyModHRP(const std::string& hrp)
 {
-    data ret;
-    ret.reserve(hrp.size() + 90);
-    ret.resize(hrp.size() * 2 + 1);
-    for (size_t i = 0; i < hrp.size(); ++i) {
-        unsigned char c = hrp[i];
-        ret[i] = c >> 5;
-        ret[i + hrp.size() + 1] = c & 0x1f;
+    uint32_t c = 1;
+    for (const unsigned char ch : hrp) {
+        const uint8_t high = ch >> 5;
+        c = PolyMod(c, &high, &high + 1);
     }
-    ret[hrp.size()] = 0;
-    return ret;
+    const uint8_t separator = 0;
+    c = PolyMod(c, &separator, &separator + 1);
+    for (const unsigned char ch : hrp) {
+        const uint8_t low = ch & 0x1f;
+        c = PolyMod(c, &low, &low + 1);
+    }
+    return c;
 }
 
 /** Verify a checksum. */
-bool VerifyChecksum(const std::string& hrp, const data& values)
+bool VerifyChecksum(const std::string& hrp, const uint8_t* begin, const uint8_t* end)
 {
     // PolyMod computes what value to xor into the final values to make the checksum 0. However,
     // if we required that the checksum was 0, it would be the case that appending a 0 to a valid
     // list of values would result in a new valid list. For that reason, Bech32 requires the
     // resulting checksum to be 1 instead.
-    return PolyMod(Cat(ExpandHRP(hrp), values)) == 1;
+    return PolyMod(PolyModHRP(hrp), begin, end) == 1;
 }
 
-/** Create a checksum. */
-data CreateChecksum(const std::string& hrp, const data& values)
+/** Create a checksum, as the 6 5-bit groups of the result. */
+uint32_t CreateChecksum(const std::string& hrp, const uint8_t* begin, const uint8_t* end)
 {
-    data enc = Cat(ExpandHRP(hrp), values);
-    enc.resize(enc.size() + 6); // Append 6 zeroes
-    uint32_t mod = PolyMod(enc) ^ 1; // Determine what to XOR into those 6 zeroes.
-    data ret(6);
-    for (size_t i = 0; i < 6; ++i) {
-        // Convert the 5-bit groups in mod to checksum values.
-        ret[i] = (mod >> (5 * (5 - i))) & 31;
-    }
-    return ret;
+    static const uint8_t zeroes[6] = {};
+    // Determine what to XOR into 6 zeroes appended to the values.
+    return PolyMod(PolyMod(PolyModHRP(hrp), begin, end), zeroes, zeroes + 6) ^ 1;
 }
 
 } // namespace
@@ -140,53 +137,79 @@ namespace bech32
 {
 
 /** Encode a Bech32 string. */
-std::string Encode(const std::string& hrp, const data& values) {
+void Encode(const std::string& hrp, Span<const uint8_t> values, std::string& out) {
     // First ensure that the HRP is all lowercase. BIP-173 requires an encoder
     // to return a lowercase Bech32 string, but if given an uppercase HRP, the
     // result will always be invalid.
     for (const char& c : hrp) assert(c < 'A' || c > 'Z');
-    data checksum = CreateChecksum(hrp, values);
-    data combined = Cat(values, checksum);
-    std::string ret = hrp + '1';
-    ret.reserve(ret.size() + combined.size());
-    for (const auto c : combined) {
-        ret += CHARSET[c];
+    const uint32_t checksum = CreateChecksum(hrp, values.begin(), values.end());
+    out.clear();
+    out.reserve(hrp.size() + 1 + values.size() + 6);
+    out += hrp;
+    out += '1';
+    for (const auto c : values) {
+        out += CHARSET[c];
+    }
+    for (size_t i = 0; i < 6; ++i) {
+        // Convert the 5-bit groups in checksum to characters.
+        out += CHARSET[(checksum >> (5 * (5 - i))) & 31];
     }
+}
+
+std::string Encode(const std::string& hrp, Span<const uint8_t> values) {
+    std::string ret;
+    Encode(hrp, values, ret);
     return ret;
 }
 
+std::string Encode(const std::string& hrp, const data& values) {
+    return Encode(hrp, MakeSpan(values));
+}
+
 /** Decode a Bech32 string. */
-std::pair<std::string, data> Decode(const std::string& str) {
+bool Decode(const std::string& str, std::string& hrp, data& values) {
+    hrp.clear();
+    values.clear();
     bool lower = false, upper = false;
     for (size_t i = 0; i < str.size(); ++i) {
         unsigned char c = str[i];
         if (c >= 'a' && c <= 'z') lower = true;
         else if (c >= 'A' && c <= 'Z') upper = true;
-        else if (c < 33 || c > 126) return {};
+        else if (c < 33 || c > 126) return false;
     }
-    if (lower && upper) return {};
+    if (lower && upper) return false;
     size_t pos = str.rfind('1');
-    if (str.size() > 90 || pos == str.npos || pos == 0 || pos + 7 > str.size()) {
-        return {};
+    if (str.size() > MAX_LENGTH || pos == str.npos || pos == 0 || pos + 7 > str.size()) {
+        return false;
     }
-    data values(str.size() - 1 - pos);
+    values.resize(str.size() - 1 - pos);
     for (size_t i = 0; i < str.size() - 1 - pos; ++i) {
         unsigned char c = str[i + pos + 1];
         int8_t rev = CHARSET_REV[c];
 
         if (rev == -1) {
-            return {};
+            values.clear();
+            return false;
         }
         values[i] = rev;
     }
-    std::string hrp;
+    hrp.reserve(pos);
     for (size_t i = 0; i < pos; ++i) {
         hrp += LowerCase(str[i]);
     }
-    if (!VerifyChecksum(hrp, values)) {
-        return {};
+    if (!VerifyChecksum(hrp, values.data(), values.data() + values.size())) {
+        hrp.clear();
+        values.clear();
+        return false;
     }
-    return {hrp, data(values.begin(), values.end() - 6)};
+    values.resize(values.size() - 6);
+    return true;
+}
+
+std::pair<std::string, data> Decode(const std::string& str) {
+    std::pair<std::string, data> ret;
+    if (!Decode(str, ret.first, ret.second)) return {};
+    return ret;
 }
 
 } // namespace bech32
@@ -12,6 +12,8 @@
 #ifndef BITCOIN_BECH32_H
 #define BITCOIN_BECH32_H
 
+#include <span.h>
+
 #include <stdint.h>
 #include <string>
 #include <vector>
@@ -19,11 +21,19 @@
 namespace bech32
 {
 
+/** The longest Bech32 string */
+static const size_t MAX_LENGTH = 90;
+
 /** Encode a Bech32 string. If hrp contains uppercase characters, this will cause an assertion error. */
 std::string Encode(const std::string& hrp, const std::vector<uint8_t>& values);
+std::string Encode(const std::string& hrp, Span<const uint8_t> values);
+/** Encode a Bech32 string into out, reusing its buffer. Allocates nothing once out is large enough. */
+void Encode(const std::string& hrp, Span<const uint8_t> values, std::string& out);
 
 /** Decode a Bech32 string. Returns (hrp, data). Empty hrp means failure. */
 std::pair<std::string, std::vector<uint8_t>> Decode(const std::string& str);
+/** Decode a Bech32 string into hrp and values, reusing their buffers. Both are left empty on failure. */
+bool Decode(const std::string& str, std::string& hrp, std::vector<uint8_t>& values);
 
 } // namespace bech32
 
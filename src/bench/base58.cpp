@@ -7,6 +7,7 @@
 #include <base58.h>
 
 #include <array>
+#include <string>
 #include <vector>
 
 
@@ -52,6 +53,36 @@ static void Base58Decode(benchmark::State& state)
 }
 
 
+static void Base58CheckEncodeBatch(benchmark::State& state)
+{
+    // The payloads of 100 addresses, as a transaction with as many outputs has
+    std::vector<std::vector<unsigned char>> inputs(100, std::vector<unsigned char>(21));
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        for (size_t j = 1; j < inputs[i].size(); ++j) {
+            inputs[i][j] = i * 31 + j * 7;
+        }
+    }
+    while (state.KeepRunning()) {
+        EncodeBase58CheckBatch(inputs);
+    }
+}
+
+
+static void Base58CheckDecodeExtKey(benchmark::State& state)
+{
+    // An extended key, the longest input key_io decodes
+    std::vector<unsigned char> key(78);
+    for (size_t i = 0; i < key.size(); ++i) key[i] = i * 13 + 1;
+    const std::string str = EncodeBase58Check(key);
+    std::vector<unsigned char> vch;
+    while (state.KeepRunning()) {
+        (void) DecodeBase58Check(str, vch, 78);
+    }
+}
+
+
 BENCHMARK(Base58Encode, 470 * 1000);
 BENCHMARK(Base58CheckEncode, 320 * 1000);
 BENCHMARK(Base58Decode, 800 * 1000);
+BENCHMARK(Base58CheckEncodeBatch, 3000);
+BENCHMARK(Base58CheckDecodeExtKey, 200 * 1000);
@@ -32,5 +32,31 @@ static void Bech32Decode(benchmark::State& state)
 }
 
 
+static void Bech32EncodeReuse(benchmark::State& state)
+{
+    std::vector<uint8_t> v = ParseHex("c97f5a67ec381b760aeaf67573bc164845ff39a3bb26a1cee401ac67243b48db");
+    std::vector<unsigned char> tmp = {0};
+    tmp.reserve(1 + 32 * 8 / 5);
+    ConvertBits<8, 5, true>([&](unsigned char c) { tmp.push_back(c); }, v.begin(), v.end());
+    std::string out;
+    while (state.KeepRunning()) {
+        bech32::Encode("bc", MakeSpan(tmp), out);
+    }
+}
+
+
+static void Bech32DecodeReuse(benchmark::State& state)
+{
+    std::string addr = "bc1qkallence7tjawwvy0dwt4twc62qjgaw8f4vlhyd006d99f09";
+    std::string hrp;
+    std::vector<uint8_t> values;
+    while (state.KeepRunning()) {
+        bech32::Decode(addr, hrp, values);
+    }
+}
+
+
 BENCHMARK(Bech32Encode, 800 * 1000);
 BENCHMARK(Bech32Decode, 800 * 1000);
+BENCHMARK(Bech32EncodeReuse, 800 * 1000);
+BENCHMARK(Bech32DecodeReuse, 800 * 1000);
@@ -10,14 +10,129 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <new>
 #include <numeric>
 #include <regex>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 const RegTestingSetup* g_testing_setup = nullptr;
 const std::function<void(const std::string&)> G_TEST_LOG_FUN{};
 
+static std::atomic<uint64_t> g_allocations{0};
+
+// Count every allocation of the bench binary, so that results can report
+// allocations per iteration.
+void* operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+#ifdef __cpp_sized_deallocation
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#endif
+
+uint64_t benchmark::GetAllocationCount()
+{
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+#ifdef __linux__
+static int OpenPerfCounter(uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+benchmark::PerfCounters::PerfCounters()
+    : m_instructions_fd(OpenPerfCounter(PERF_COUNT_HW_INSTRUCTIONS)), m_cycles_fd(OpenPerfCounter(PERF_COUNT_HW_CPU_CYCLES))
+{
+}
+
+benchmark::PerfCounters::~PerfCounters()
+{
+    if (m_instructions_fd >= 0) close(m_instructions_fd);
+    if (m_cycles_fd >= 0) close(m_cycles_fd);
+}
+
+void benchmark::PerfCounters::Reset()
+{
+    if (!IsAvailable()) return;
+    ioctl(m_instructions_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(m_cycles_fd, PERF_EVENT_IOC_RESET, 0);
+}
+
+bool benchmark::PerfCounters::Read(uint64_t& instructions, uint64_t& cycles) const
+{
+    if (!IsAvailable()) return false;
+    return read(m_instructions_fd, &instructions, sizeof(instructions)) == sizeof(instructions) &&
+           read(m_cycles_fd, &cycles, sizeof(cycles)) == sizeof(cycles);
+}
+#else
+benchmark::PerfCounters::PerfCounters() : m_instructions_fd(-1), m_cycles_fd(-1) {}
+benchmark::PerfCounters::~PerfCounters() {}
+void benchmark::PerfCounters::Reset() {}
+bool benchmark::PerfCounters::Read(uint64_t& instructions, uint64_t& cycles) const { return false; }
+#endif
+
+namespace {
+std::vector<double> Sorted(std::vector<double> results)
+{
+    std::sort(results.begin(), results.end());
+    return results;
+}
+
+double Median(const std::vector<double>& sorted)
+{
+    if (sorted.empty()) return 0;
+    size_t mid = sorted.size() / 2;
+    if (0 == sorted.size() % 2) {
+        return (sorted[mid - 1] + sorted[mid]) / 2;
+    }
+    return sorted[mid];
+}
+
+//! Nearest-rank percentile, so with few evaluations the high ones are the maximum.
+double Percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(std::ceil(p / 100 * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+} // namespace
+
 void benchmark::ConsolePrinter::header()
 {
     std::cout << "# Benchmark, evals, iterations, total, min, max, median" << std::endl;
@@ -25,24 +140,17 @@ void benchmark::ConsolePrinter::header()
 
 void benchmark::ConsolePrinter::result(const State& state)
 {
-    auto results = state.m_elapsed_results;
-    std::sort(results.begin(), results.end());
+    auto results = Sorted(state.m_elapsed_results);
 
     double total = state.m_num_iters * std::accumulate(results.begin(), results.end(), 0.0);
 
     double front = 0;
     double back = 0;
-    double median = 0;
+    double median = Median(results);
 
     if (!results.empty()) {
         front = results.front();
         back = results.back();
-
-        size_t mid = results.size() / 2;
-        median = results[mid];
-        if (0 == results.size() % 2) {
-            median = (results[mid] + results[mid + 1]) / 2;
-        }
     }
 
     std::cout << std::setprecision(6);
@@ -50,6 +158,77 @@ void benchmark::ConsolePrinter::result(const State& state)
 }
 
 void benchmark::ConsolePrinter::footer() {}
+
+void benchmark::JsonPrinter::header() {}
+
+void benchmark::JsonPrinter::result(const State& state)
+{
+    auto results = Sorted(state.m_elapsed_results);
+
+    UniValue entry(UniValue::VOBJ);
+    entry.pushKV("name", state.m_name);
+    entry.pushKV("evals", (uint64_t)state.m_num_evals);
+    entry.pushKV("iterations", (uint64_t)state.m_num_iters);
+    entry.pushKV("total", state.m_num_iters * std::accumulate(results.begin(), results.end(), 0.0));
+    entry.pushKV("min", results.empty() ? 0 : results.front());
+    entry.pushKV("max", results.empty() ? 0 : results.back());
+    entry.pushKV("median", Median(results));
+    entry.pushKV("p50", Percentile(results, 50));
+    entry.pushKV("p90", Percentile(results, 90));
+    entry.pushKV("p99", Percentile(results, 99));
+    entry.pushKV("allocations", Median(Sorted(state.m_allocation_results)));
+    if (!state.m_instruction_results.empty()) {
+        entry.pushKV("instructions", Median(Sorted(state.m_instruction_results)));
+        entry.pushKV("cycles", Median(Sorted(state.m_cycle_results)));
+    }
+    m_results.push_back(entry);
+}
+
+void benchmark::JsonPrinter::footer()
+{
+    UniValue doc(UniValue::VOBJ);
+    doc.pushKV("benchmarks", m_results);
+    std::cout << doc.write(2) << std::endl;
+}
+
+benchmark::ComparePrinter::ComparePrinter(Printer& printer, const UniValue& baseline, double threshold)
+    : m_printer(printer), m_threshold(threshold)
+{
+    const UniValue& benchmarks = find_value(baseline, "benchmarks");
+    if (!benchmarks.isArray()) return;
+    for (const UniValue& entry : benchmarks.getValues()) {
+        const UniValue& name = find_value(entry, "name");
+        const UniValue& median = find_value(entry, "median");
+        if (name.isStr() && median.isNum()) {
+            m_baseline[name.get_str()] = median.get_real();
+        }
+    }
+}
+
+void benchmark::ComparePrinter::header()
+{
+    m_printer.header();
+}
+
+void benchmark::ComparePrinter::result(const State& state)
+{
+    m_printer.result(state);
+
+    auto it = m_baseline.find(state.m_name);
+    if (it == m_baseline.end() || it->second <= 0 || state.m_elapsed_results.empty()) return;
+    double median = Median(Sorted(state.m_elapsed_results));
+    if (median > it->second * (1 + m_threshold)) {
+        ++m_regressions;
+        std::cerr << std::setprecision(6) << "REGRESSION: " << state.m_name << " median " << median << " vs baseline "
+                  << it->second << " (+" << std::setprecision(3) << (median / it->second - 1) * 100 << "%)" << std::endl;
+    }
+}
+
+void benchmark::ComparePrinter::footer()
+{
+    m_printer.footer();
+    std::cerr << m_regressions << " regression(s) against " << m_baseline.size() << " baseline benchmark(s)" << std::endl;
+}
 benchmark::PlotlyPrinter::PlotlyPrinter(std::string plotly_url, int64_t width, int64_t height)
     : m_plotly_url(plotly_url), m_width(width), m_height(height)
 {
@@ -111,6 +290,7 @@ void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double
 
     std::regex reFilter(filter);
     std::smatch baseMatch;
+    PerfCounters perf;
 
     printer.header();
 
@@ -134,7 +314,7 @@ void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double
         if (0 == num_iters) {
             num_iters = 1;
         }
-        State state(p.first, num_evals, num_iters, printer);
+        State state(p.first, num_evals, num_iters, printer, &perf);
         if (!is_list_only) {
             p.second.func(state);
         }
@@ -150,6 +330,12 @@ bool benchmark::State::UpdateTimer(const benchmark::time_point current_time)
     if (m_start_time != time_point()) {
         std::chrono::duration<double> diff = current_time - m_start_time;
         m_elapsed_results.push_back(diff.count() / m_num_iters);
+        m_allocation_results.push_back(double(GetAllocationCount() - m_start_allocations) / m_num_iters);
+        uint64_t instructions, cycles;
+        if (m_perf && m_perf->Read(instructions, cycles)) {
+            m_instruction_results.push_back(double(instructions) / m_num_iters);
+            m_cycle_results.push_back(double(cycles) / m_num_iters);
+        }
 
         if (m_elapsed_results.size() == m_num_evals) {
             return false;
@@ -157,5 +343,7 @@ bool benchmark::State::UpdateTimer(const benchmark::time_point current_time)
     }
 
     m_num_iters_left = m_num_iters - 1;
+    m_start_allocations = GetAllocationCount();
+    if (m_perf) m_perf->Reset();
     return true;
 }
@@ -14,6 +14,8 @@
 #include <boost/preprocessor/cat.hpp>
 #include <boost/preprocessor/stringize.hpp>
 
+#include <univalue.h>
+
 struct RegTestingSetup;
 extern const RegTestingSetup* g_testing_setup; //!< A pointer to the current testing setup
 
@@ -53,6 +55,31 @@ using duration = clock::duration;
 
 class Printer;
 
+//! Number of heap allocations made through operator new so far, by any thread.
+uint64_t GetAllocationCount();
+
+/**
+ * Instructions and cycles retired by the calling thread and the threads it
+ * creates, through perf_event_open. Unavailable on other platforms, and where
+ * the kernel does not allow unprivileged counters.
+ */
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool IsAvailable() const { return m_instructions_fd >= 0 && m_cycles_fd >= 0; }
+    void Reset();
+    bool Read(uint64_t& instructions, uint64_t& cycles) const;
+
+private:
+    int m_instructions_fd;
+    int m_cycles_fd;
+};
+
 class State
 {
 public:
@@ -60,12 +87,19 @@ public:
     uint64_t m_num_iters_left;
     const uint64_t m_num_iters;
     const uint64_t m_num_evals;
+    //! Per-iteration results of each evaluation
     std::vector<double> m_elapsed_results;
+    std::vector<double> m_allocation_results;
+    //! Empty when perf counters are unavailable
+    std::vector<double> m_instruction_results;
+    std::vector<double> m_cycle_results;
     time_point m_start_time;
+    uint64_t m_start_allocations;
+    PerfCounters* m_perf;
 
     bool UpdateTimer(time_point finish_time);
 
-    State(std::string name, uint64_t num_evals, double num_iters, Printer& printer) : m_name(name), m_num_iters_left(0), m_num_iters(num_iters), m_num_evals(num_evals)
+    State(std::string name, uint64_t num_evals, double num_iters, Printer& printer, PerfCounters* perf = nullptr) : m_name(name), m_num_iters_left(0), m_num_iters(num_iters), m_num_evals(num_evals), m_start_allocations(0), m_perf(perf)
     {
     }
 
@@ -118,6 +152,39 @@ public:
     void footer() override;
 };
 
+// prints one JSON document with percentiles, perf counters and allocations,
+// which -compare reads back as a baseline.
+class JsonPrinter : public Printer
+{
+public:
+    void header() override;
+    void result(const State& state) override;
+    void footer() override;
+
+private:
+    UniValue m_results{UniValue::VARR};
+};
+
+// forwards to another printer, and reports to stderr each benchmark whose
+// median time per iteration is more than threshold (a fraction) above the
+// one in a JsonPrinter baseline.
+class ComparePrinter : public Printer
+{
+public:
+    ComparePrinter(Printer& printer, const UniValue& baseline, double threshold);
+    void header() override;
+    void result(const State& state) override;
+    void footer() override;
+
+    size_t NumRegressions() const { return m_regressions; }
+
+private:
+    Printer& m_printer;
+    std::map<std::string, double> m_baseline;
+    double m_threshold;
+    size_t m_regressions{0};
+};
+
 // creates box plot with plotly.js
 class PlotlyPrinter : public Printer
 {
@@ -4,10 +4,13 @@
 
 #include <bench/bench.h>
 
+#include <fs.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 
+#include <fstream>
 #include <memory>
+#include <sstream>
 
 static const int64_t DEFAULT_BENCH_EVALUATIONS = 5;
 static const char* DEFAULT_BENCH_FILTER = ".*";
@@ -16,6 +19,7 @@ static const char* DEFAULT_BENCH_PRINTER = "console";
 static const char* DEFAULT_PLOT_PLOTLYURL = "https://cdn.plot.ly/plotly-latest.min.js";
 static const int64_t DEFAULT_PLOT_WIDTH = 1024;
 static const int64_t DEFAULT_PLOT_HEIGHT = 768;
+static const char* DEFAULT_COMPARE_THRESHOLD = "10";
 
 static void SetupBenchArgs()
 {
@@ -25,7 +29,10 @@ static void SetupBenchArgs()
     gArgs.AddArg("-evals=<n>", strprintf("Number of measurement evaluations to perform. (default: %u)", DEFAULT_BENCH_EVALUATIONS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-filter=<regex>", strprintf("Regular expression filter to select benchmark by name (default: %s)", DEFAULT_BENCH_FILTER), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-scaling=<n>", strprintf("Scaling factor for benchmark's runtime (default: %u)", DEFAULT_BENCH_SCALING), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-printer=(console|plot)", strprintf("Choose printer format. console: print data to console. plot: Print results as HTML graph (default: %s)", DEFAULT_BENCH_PRINTER), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-printer=(console|plot|json)", strprintf("Choose printer format. console: print data to console. plot: Print results as HTML graph. json: Print results, percentiles, allocations and perf counters as JSON (default: %s)", DEFAULT_BENCH_PRINTER), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-compare=<file>", "Compare median times with the JSON output of an earlier run, and exit with an error if any benchmark regressed", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-compare-threshold=<pct>", strprintf("Percentage slowdown against the -compare baseline that counts as a regression (default: %s)", DEFAULT_COMPARE_THRESHOLD), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-fuzzcorpus=<dir>", "Also time the ParseCost* benchmarks on the slow inputs the parse_cost_* fuzz targets saved under <dir> (see FUZZ_SLOW_INPUT_DIR in doc/fuzzing.md)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-plot-plotlyurl=<uri>", strprintf("URL to use for plotly.js (default: %s)", DEFAULT_PLOT_PLOTLYURL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-plot-width=<x>", strprintf("Plot width in pixel (default: %u)", DEFAULT_PLOT_WIDTH), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-plot-height=<x>", strprintf("Plot height in pixel (default: %u)", DEFAULT_PLOT_HEIGHT), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -71,6 +78,30 @@ int main(int argc, char** argv)
             gArgs.GetArg("-plot-plotlyurl", DEFAULT_PLOT_PLOTLYURL),
             gArgs.GetArg("-plot-width", DEFAULT_PLOT_WIDTH),
             gArgs.GetArg("-plot-height", DEFAULT_PLOT_HEIGHT)));
+    } else if ("json" == printer_arg) {
+        printer.reset(new benchmark::JsonPrinter());
+    }
+
+    if (gArgs.IsArgSet("-compare")) {
+        const std::string compare_path = gArgs.GetArg("-compare", "");
+        fsbridge::ifstream file(compare_path);
+        std::stringstream contents;
+        if (file.is_open()) contents << file.rdbuf();
+        UniValue baseline;
+        if (!file.is_open() || !baseline.read(contents.str())) {
+            tfm::format(std::cerr, "Error reading baseline file: %s\n", compare_path);
+            return EXIT_FAILURE;
+        }
+        double threshold;
+        std::string threshold_str = gArgs.GetArg("-compare-threshold", DEFAULT_COMPARE_THRESHOLD);
+        if (!ParseDouble(threshold_str, &threshold) || threshold < 0) {
+            tfm::format(std::cerr, "Error parsing compare threshold: %s\n", threshold_str);
+            return EXIT_FAILURE;
+        }
+
+        benchmark::ComparePrinter compare(*printer, baseline, threshold / 100);
+        benchmark::BenchRunner::RunAll(compare, evaluations, scaling_factor, regex_filter, is_list_only);
+        return compare.NumRegressions() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
     benchmark::BenchRunner::RunAll(*printer, evaluations, scaling_factor, regex_filter, is_list_only);
@@ -5,9 +5,11 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <script/signingprovider.h>
 #include <test/util/transaction_utils.h>
 
+#include <unordered_map>
 #include <vector>
 
 // Microbenchmark for simple accesses to a CCoinsViewCache database. Note from
@@ -50,3 +52,73 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+static const size_t LARGE_CACHE_COINS = 1 << 20;
+
+static std::vector<COutPoint> RandomOutpoints(size_t count)
+{
+    FastRandomContext rng(true);
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        outpoints.emplace_back(rng.rand256(), rng.randrange(4));
+    }
+    return outpoints;
+}
+
+// A cache far larger than the CPU caches, so that nearly every access to
+// cacheCoins misses them, as it does during a sync with a large -dbcache.
+// Spends a coin and adds it back, as connecting a block does, and checks for
+// another one.
+static void CCoinsCachingLarge(benchmark::State& state)
+{
+    const std::vector<COutPoint> outpoints = RandomOutpoints(LARGE_CACHE_COINS);
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    for (const COutPoint& outpoint : outpoints) {
+        coins.AddCoin(outpoint, Coin(CTxOut(COIN, CScript() << OP_TRUE), 1, false), false);
+    }
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const COutPoint& outpoint = outpoints[i++ % LARGE_CACHE_COINS];
+        Coin coin;
+        bool spent = coins.SpendCoin(outpoint, &coin);
+        assert(spent);
+        coins.AddCoin(outpoint, std::move(coin), false);
+        bool have = coins.HaveCoinInCache(outpoints[(i * 7919) % LARGE_CACHE_COINS]);
+        assert(have);
+    }
+}
+
+// Lookups in a large map of coins cache entries, to compare CCoinsMap with the
+// std::unordered_map it replaced.
+template <typename Map>
+static void CoinsMapLookup(benchmark::State& state)
+{
+    const std::vector<COutPoint> outpoints = RandomOutpoints(LARGE_CACHE_COINS);
+    Map map;
+    for (const COutPoint& outpoint : outpoints) {
+        map.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::tuple<>());
+    }
+
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        bool found = map.find(outpoints[(i++ * 7919) % LARGE_CACHE_COINS]) != map.end();
+        assert(found);
+    }
+}
+
+static void CCoinsMapLookup(benchmark::State& state)
+{
+    CoinsMapLookup<CCoinsMap>(state);
+}
+
+static void UnorderedCoinsMapLookup(benchmark::State& state)
+{
+    CoinsMapLookup<std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>>(state);
+}
+
+BENCHMARK(CCoinsCachingLarge, 2 * 1000 * 1000);
+BENCHMARK(CCoinsMapLookup, 5 * 1000 * 1000);
+BENCHMARK(UnorderedCoinsMapLookup, 5 * 1000 * 1000);
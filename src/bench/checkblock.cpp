@@ -48,5 +48,30 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
     }
 }
 
+// A Sapling transaction with 10 spends and 10 outputs, most of which is
+// ciphertexts and proofs.
+static void DeserializeShieldedTransaction(benchmark::State& state)
+{
+    CMutableTransaction mtx;
+    mtx.fOverwintered = true;
+    mtx.nVersion = SAPLING_TX_VERSION;
+    mtx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    mtx.vShieldedSpend.resize(10);
+    mtx.vShieldedOutput.resize(10);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << mtx;
+    const size_t size = stream.size();
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CMutableTransaction tx;
+        stream >> tx;
+        bool rewound = stream.Rewind(size);
+        assert(rewound);
+    }
+}
+
 BENCHMARK(DeserializeBlockTest, 130);
 BENCHMARK(DeserializeAndCheckBlockTest, 160);
+BENCHMARK(DeserializeShieldedTransaction, 20 * 1000);
@@ -62,6 +62,53 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+// Selection from a pool of many small coins, with the retries of
+// CWallet::SelectCoins sharing one sort of the pool. The target is more than
+// any coin, so the knapsack search goes through the whole pool.
+static void CoinSelectionLarge(benchmark::State& state, int num_coins)
+{
+    NodeContext node;
+    auto chain = interfaces::MakeChain(node);
+    CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    wallet.SetupLegacyScriptPubKeyMan();
+    LOCK(wallet.cs_wallet);
+
+    FastRandomContext rand(true /* deterministic */);
+    CMutableTransaction tx;
+    tx.vout.resize(num_coins);
+    for (CTxOut& txout : tx.vout) {
+        txout.nValue = COIN / 100 + rand.randrange(COIN / 100);
+    }
+    const CWalletTx wtx(&wallet, MakeTransactionRef(std::move(tx)));
+
+    std::vector<OutputGroup> groups;
+    groups.reserve(num_coins);
+    for (int i = 0; i < num_coins; ++i) {
+        COutput output(&wtx, i, 6 * 24 /* nDepthIn */, true /* spendable */, true /* solvable */, true /* safe */);
+        groups.emplace_back(output.GetInputCoin(), 6 * 24, false, 0, 0);
+    }
+
+    const CoinEligibilityFilter filter_standard(1, 6, 0);
+    const CoinEligibilityFilter filter_confirmed(1, 1, 0);
+    const CoinSelectionParams coin_selection_params(false, 34, 148, CFeeRate(0), 0);
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool bnb_used;
+        SortOutputGroups(groups);
+        // Nothing is eligible for the first filter, as in a wallet of coins received from others
+        bool success = wallet.SelectCoinsMinConf(10 * COIN, CoinEligibilityFilter(1, 1000, 0), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used, true) ||
+            wallet.SelectCoinsMinConf(10 * COIN, filter_standard, groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used, true) ||
+            wallet.SelectCoinsMinConf(10 * COIN, filter_confirmed, groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used, true);
+        assert(success);
+        assert(nValueRet >= 10 * COIN);
+    }
+}
+
+static void CoinSelection10k(benchmark::State& state) { CoinSelectionLarge(state, 10000); }
+static void CoinSelection100k(benchmark::State& state) { CoinSelectionLarge(state, 100000); }
+static void CoinSelection1M(benchmark::State& state) { CoinSelectionLarge(state, 1000000); }
+
 typedef std::set<CInputCoin> CoinSet;
 static NodeContext testNode;
 static auto testChain = interfaces::MakeChain(testNode);
@@ -113,3 +160,6 @@ static void BnBExhaustion(benchmark::State& state)
 
 BENCHMARK(CoinSelection, 650);
 BENCHMARK(BnBExhaustion, 650);
+BENCHMARK(CoinSelection10k, 20);
+BENCHMARK(CoinSelection100k, 2);
+BENCHMARK(CoinSelection1M, 1);
@@ -7,6 +7,7 @@
 #include <hash.h>
 #include <random.h>
 #include <uint256.h>
+#include <crypto/blake2b.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -58,6 +59,43 @@ static void SHA256D64_1024(benchmark::State& state)
     }
 }
 
+static void SHA256DMulti_1024(benchmark::State& state)
+{
+    // Transaction sized inputs of 250 bytes
+    std::vector<uint8_t> in(250 * 1024, 0);
+    std::vector<uint8_t> out(32 * 1024);
+    std::vector<const unsigned char*> inputs;
+    for (size_t i = 0; i < 1024; ++i) inputs.push_back(in.data() + 250 * i);
+    const std::vector<size_t> lengths(1024, 250);
+    while (state.KeepRunning()) {
+        SHA256DMulti(out.data(), inputs.data(), lengths.data(), 1024);
+    }
+}
+
+static void BLAKE2b(benchmark::State& state)
+{
+    BLAKE2bAutoDetect();
+    uint8_t hash[CBLAKE2b::MAX_OUTPUT_SIZE];
+    std::vector<uint8_t> in(BUFFER_SIZE,0);
+    while (state.KeepRunning())
+        CBLAKE2b().Write(in.data(), in.size()).Finalize(hash);
+}
+
+static void BLAKE2bMulti_512(benchmark::State& state)
+{
+    // Equihash 200,9 leaf hashes: a 140-byte header, then a 4-byte index each
+    BLAKE2bAutoDetect();
+    static const unsigned char personal[CBLAKE2b::PERSONAL_SIZE] = {'Z', 'c', 'a', 's', 'h', 'P', 'o', 'W', 200, 0, 0, 0, 9, 0, 0, 0};
+    std::vector<uint8_t> header(140, 0);
+    CBLAKE2b base(50, personal);
+    base.Write(header.data(), header.size());
+    std::vector<uint8_t> in(4 * 512, 0);
+    std::vector<uint8_t> out(50 * 512);
+    while (state.KeepRunning()) {
+        BLAKE2bMulti(base, in.data(), 4, 512, out.data());
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -75,6 +113,17 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+static void SipHashMulti_32b_1024(benchmark::State& state)
+{
+    SipHashAutoDetect();
+    std::vector<uint256> in(1024);
+    std::vector<uint64_t> out(1024);
+    uint64_t k1 = 0;
+    while (state.KeepRunning()) {
+        SipHashUint256Multi(0, ++k1, in.data(), in.size(), out.data());
+    }
+}
+
 static void FastRandom_32bit(benchmark::State& state)
 {
     FastRandomContext rng(true);
@@ -95,9 +144,13 @@ BENCHMARK(RIPEMD160, 440);
 BENCHMARK(SHA1, 570);
 BENCHMARK(SHA256, 340);
 BENCHMARK(SHA512, 330);
+BENCHMARK(BLAKE2b, 400);
 
 BENCHMARK(SHA256_32b, 4700 * 1000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
+BENCHMARK(SipHashMulti_32b_1024, 40 * 1000);
 BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(SHA256DMulti_1024, 1000);
+BENCHMARK(BLAKE2bMulti_512, 3000);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
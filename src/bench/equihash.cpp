@@ -0,0 +1,114 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <crypto/blake2b.h>
+#include <crypto/equihash.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <streams.h>
+
+// Only the genesis blocks carry solutions for 200/9, so the other parameter
+// sets are measured with a well-formed but invalid solution. Every index is
+// still expanded and hashed before the first collision check rejects it, which
+// is where most of the verification time goes.
+
+static void EquihashVerifyGenesis(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const CBlockHeader header = chainParams->GenesisBlock().GetBlockHeader();
+
+    while (state.KeepRunning()) {
+        bool valid = CheckEquihashSolution(&header);
+        assert(valid);
+    }
+}
+
+static void EquihashVerify(benchmark::State& state, unsigned int n, unsigned int k)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    CBlockHeader header = chainParams->GenesisBlock().GetBlockHeader();
+    header.nSolution.assign(((size_t{1} << k) * (n / (k + 1) + 1)) / 8, 0);
+
+    while (state.KeepRunning()) {
+        bool valid = CheckEquihashSolution(&header);
+        assert(!valid);
+    }
+}
+
+static eh_HashState GenesisHashState()
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const CBlockHeader header = chainParams->GenesisBlock().GetBlockHeader();
+
+    eh_HashState state;
+    Eh200_9.InitialiseState(state);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CEquihashInput{header} << header.nNonce;
+    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+    return state;
+}
+
+static CBLAKE2b GenesisBatchHashState()
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const CBlockHeader header = chainParams->GenesisBlock().GetBlockHeader();
+
+    CBLAKE2b state;
+    Eh200_9.InitialiseState(state);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CEquihashInput{header} << header.nNonce;
+    state.Write((unsigned char*)&ss[0], ss.size());
+    return state;
+}
+
+static void EquihashBasicVerifier(benchmark::State& state)
+{
+    const eh_HashState base_state = GenesisHashState();
+    const std::vector<unsigned char> soln = CreateChainParams(CBaseChainParams::MAIN)->GenesisBlock().nSolution;
+
+    while (state.KeepRunning()) {
+        bool valid = Eh200_9.BasicIsValidSolution(base_state, soln);
+        assert(valid);
+    }
+}
+
+static void EquihashFixedVerifier(benchmark::State& state)
+{
+    const eh_HashState base_state = GenesisHashState();
+    const std::vector<unsigned char> soln = CreateChainParams(CBaseChainParams::MAIN)->GenesisBlock().nSolution;
+
+    while (state.KeepRunning()) {
+        bool valid = Eh200_9.FixedIsValidSolution(base_state, soln);
+        assert(valid);
+    }
+}
+
+static void EquihashBatchLeafVerifier(benchmark::State& state)
+{
+    BLAKE2bAutoDetect();
+    const CBLAKE2b base_state = GenesisBatchHashState();
+    const std::vector<unsigned char> soln = CreateChainParams(CBaseChainParams::MAIN)->GenesisBlock().nSolution;
+
+    while (state.KeepRunning()) {
+        bool valid = Eh200_9.FixedIsValidSolution(base_state, soln);
+        assert(valid);
+    }
+}
+
+static void EquihashVerify200_9(benchmark::State& state) { EquihashVerify(state, 200, 9); }
+static void EquihashVerify192_7(benchmark::State& state) { EquihashVerify(state, 192, 7); }
+static void EquihashVerify144_5(benchmark::State& state) { EquihashVerify(state, 144, 5); }
+static void EquihashVerify96_5(benchmark::State& state) { EquihashVerify(state, 96, 5); }
+
+BENCHMARK(EquihashVerifyGenesis, 100);
+BENCHMARK(EquihashBasicVerifier, 100);
+BENCHMARK(EquihashFixedVerifier, 100);
+BENCHMARK(EquihashBatchLeafVerifier, 100);
+BENCHMARK(EquihashVerify200_9, 100);
+BENCHMARK(EquihashVerify192_7, 1000);
+BENCHMARK(EquihashVerify144_5, 5000);
+BENCHMARK(EquihashVerify96_5, 5000);
@@ -5,15 +5,22 @@
 #include <bench/bench.h>
 #include <blockfilter.h>
 
-static void ConstructGCSFilter(benchmark::State& state)
+static GCSFilter::ElementSet GenerateGCSTestElements(int count, unsigned char tag = 0)
 {
     GCSFilter::ElementSet elements;
-    for (int i = 0; i < 10000; ++i) {
+    for (int i = 0; i < count; ++i) {
         GCSFilter::Element element(32);
         element[0] = static_cast<unsigned char>(i);
         element[1] = static_cast<unsigned char>(i >> 8);
+        element[2] = tag;
         elements.insert(std::move(element));
     }
+    return elements;
+}
+
+static void ConstructGCSFilter(benchmark::State& state)
+{
+    GCSFilter::ElementSet elements = GenerateGCSTestElements(10000);
 
     uint64_t siphash_k0 = 0;
     while (state.KeepRunning()) {
@@ -23,21 +30,74 @@ static void ConstructGCSFilter(benchmark::State& state)
     }
 }
 
+static void ConstructGCSFilterSmall(benchmark::State& state)
+{
+    // About the elements of an average block
+    GCSFilter::ElementSet elements = GenerateGCSTestElements(300);
+
+    uint64_t siphash_k0 = 0;
+    while (state.KeepRunning()) {
+        GCSFilter filter({siphash_k0, 0, BASIC_FILTER_P, BASIC_FILTER_M}, elements);
+
+        siphash_k0++;
+    }
+}
+
+static void DecodeGCSFilter(benchmark::State& state)
+{
+    GCSFilter filter({0, 0, 20, 1 << 20}, GenerateGCSTestElements(10000));
+    const std::vector<unsigned char>& encoded = filter.GetEncoded();
+
+    while (state.KeepRunning()) {
+        GCSFilter decoded(filter.GetParams(), encoded);
+    }
+}
+
 static void MatchGCSFilter(benchmark::State& state)
 {
-    GCSFilter::ElementSet elements;
-    for (int i = 0; i < 10000; ++i) {
-        GCSFilter::Element element(32);
-        element[0] = static_cast<unsigned char>(i);
-        element[1] = static_cast<unsigned char>(i >> 8);
-        elements.insert(std::move(element));
+    GCSFilter filter({0, 0, 20, 1 << 20}, GenerateGCSTestElements(10000));
+
+    while (state.KeepRunning()) {
+        filter.Match(GCSFilter::Element());
     }
-    GCSFilter filter({0, 0, 20, 1 << 20}, elements);
+}
+
+static void MatchGCSFilterCached(benchmark::State& state)
+{
+    GCSFilter filter({0, 0, 20, 1 << 20}, GenerateGCSTestElements(10000));
+    filter.CacheDecoded();
 
     while (state.KeepRunning()) {
         filter.Match(GCSFilter::Element());
     }
 }
 
+static void MatchAnyGCSFilterWallet(benchmark::State& state)
+{
+    // A wallet's scripts, none of which the filter of a block holds
+    GCSFilter filter({0, 0, BASIC_FILTER_P, BASIC_FILTER_M}, GenerateGCSTestElements(300));
+    const GCSFilter::ElementSet scripts = GenerateGCSTestElements(5000, 1);
+
+    while (state.KeepRunning()) {
+        filter.MatchAny(scripts);
+    }
+}
+
+static void MatchAnyGCSFilterWalletCached(benchmark::State& state)
+{
+    GCSFilter filter({0, 0, BASIC_FILTER_P, BASIC_FILTER_M}, GenerateGCSTestElements(300));
+    filter.CacheDecoded();
+    const GCSFilter::ElementSet scripts = GenerateGCSTestElements(5000, 1);
+
+    while (state.KeepRunning()) {
+        filter.MatchAny(scripts);
+    }
+}
+
 BENCHMARK(ConstructGCSFilter, 1000);
+BENCHMARK(ConstructGCSFilterSmall, 20 * 1000);
+BENCHMARK(DecodeGCSFilter, 1000);
 BENCHMARK(MatchGCSFilter, 50 * 1000);
+BENCHMARK(MatchGCSFilterCached, 50 * 1000);
+BENCHMARK(MatchAnyGCSFilterWallet, 1000);
+BENCHMARK(MatchAnyGCSFilterWalletCached, 1000);
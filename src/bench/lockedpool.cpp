@@ -42,4 +42,34 @@ static void BenchLockedPool(benchmark::State& state)
     addr.clear();
 }
 
+/** Allocations of key sizes only, as deriving many keys and signing do */
+static void BenchLockedPoolKeySizes(benchmark::State& state)
+{
+    void *synth_base = reinterpret_cast<void*>(0x08000000);
+    const size_t synth_size = 1024*1024;
+    Arena b(synth_base, synth_size, 16);
+
+    static const size_t sizes[] = {32, 64, 96};
+    std::vector<void*> addr(ASIZE, nullptr);
+    uint32_t s = 0x12345678;
+    while (state.KeepRunning()) {
+        for (int x=0; x<BITER; ++x) {
+            int idx = s & (addr.size()-1);
+            if (addr[idx]) {
+                b.free(addr[idx]);
+                addr[idx] = nullptr;
+            } else {
+                addr[idx] = b.alloc(sizes[(s >> 16) % 3]);
+            }
+            bool lsb = s & 1;
+            s >>= 1;
+            if (lsb)
+                s ^= 0xf00f00f0; // LFSR period 0xf7ffffe0
+        }
+    }
+    for (void *ptr: addr)
+        b.free(ptr);
+}
+
 BENCHMARK(BenchLockedPool, 1300);
+BENCHMARK(BenchLockedPoolKeySizes, 1300);
@@ -7,12 +7,16 @@
 #include <uint256.h>
 #include <random.h>
 #include <consensus/merkle.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
 
-static void MerkleRoot(benchmark::State& state)
+#include <assert.h>
+
+static void MerkleRootLeaves(benchmark::State& state, size_t count)
 {
     FastRandomContext rng(true);
     std::vector<uint256> leaves;
-    leaves.resize(9001);
+    leaves.resize(count);
     for (auto& item : leaves) {
         item = rng.rand256();
     }
@@ -23,4 +27,48 @@ static void MerkleRoot(benchmark::State& state)
     }
 }
 
+static void MerkleRoot(benchmark::State& state) { MerkleRootLeaves(state, 9001); }
+static void MerkleRootLarge(benchmark::State& state) { MerkleRootLeaves(state, 50000); }
+
+//! A block of count transactions with witnesses, whose hashes are cached
+static CBlock LargeBlock(size_t count)
+{
+    CBlock block;
+    block.vtx.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        CMutableTransaction mtx;
+        mtx.nLockTime = i;
+        mtx.vin.resize(1);
+        mtx.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(1, i & 0xff));
+        block.vtx[i] = MakeTransactionRef(std::move(mtx));
+    }
+    return block;
+}
+
+static void BlockMerkleRootsLarge(benchmark::State& state)
+{
+    const CBlock block = LargeBlock(12000);
+    while (state.KeepRunning()) {
+        bool mutated;
+        uint256 witness_root;
+        uint256 root = BlockMerkleRoots(block, witness_root, &mutated);
+        assert(!mutated && root != witness_root);
+    }
+}
+
+//! What CheckBlock and ContextualCheckBlock hashed before both roots were computed together
+static void BlockMerkleRootsSeparateLarge(benchmark::State& state)
+{
+    const CBlock block = LargeBlock(12000);
+    while (state.KeepRunning()) {
+        bool mutated;
+        uint256 root = BlockMerkleRoot(block, &mutated);
+        uint256 witness_root = BlockWitnessMerkleRoot(block);
+        assert(!mutated && root != witness_root);
+    }
+}
+
 BENCHMARK(MerkleRoot, 800);
+BENCHMARK(MerkleRootLarge, 100);
+BENCHMARK(BlockMerkleRootsLarge, 100);
+BENCHMARK(BlockMerkleRootsSeparateLarge, 100);
@@ -0,0 +1,174 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/data.h>
+
+#include <base58.h>
+#include <bech32.h>
+#include <fs.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <util/system.h>
+#include <version.h>
+
+#include <univalue.h>
+
+#include <ios>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Each benchmark parses a few inputs known to be expensive, and the slow
+// inputs the parse_cost_* fuzz targets saved under -fuzzcorpus, so that an
+// input found to be slow once keeps being timed. The parsing matches the
+// fuzz target of the same name in src/test/fuzz/parse_cost.cpp.
+
+typedef std::vector<std::vector<uint8_t>> Inputs;
+
+static std::vector<uint8_t> Bytes(const std::string& str)
+{
+    return std::vector<uint8_t>(str.begin(), str.end());
+}
+
+static Inputs WithSavedInputs(Inputs inputs, const std::string& target)
+{
+    const std::string corpus = gArgs.GetArg("-fuzzcorpus", "");
+    if (corpus.empty()) return inputs;
+    const fs::path dir = fs::path(corpus) / target;
+    if (!fs::is_directory(dir)) return inputs;
+    for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it) {
+        if (!fs::is_regular_file(it->status())) continue;
+        fsbridge::ifstream file(it->path(), std::ios::binary);
+        inputs.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    return inputs;
+}
+
+static void ParseCostBlock(benchmark::State& state)
+{
+    const Inputs inputs = WithSavedInputs({benchmark::data::block200}, "parse_cost_block");
+    while (state.KeepRunning()) {
+        for (const std::vector<uint8_t>& input : inputs) {
+            CDataStream ds(input, SER_NETWORK, PROTOCOL_VERSION);
+            CBlock block;
+            try {
+                ds >> block;
+            } catch (const std::ios_base::failure&) {
+            }
+        }
+    }
+}
+
+static void ParseCostTransaction(benchmark::State& state)
+{
+    // A Sapling transaction with 100 spends and 100 outputs
+    CMutableTransaction mtx;
+    mtx.fOverwintered = true;
+    mtx.nVersion = SAPLING_TX_VERSION;
+    mtx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    mtx.vShieldedSpend.resize(100);
+    mtx.vShieldedOutput.resize(100);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << mtx;
+
+    const Inputs inputs = WithSavedInputs({std::vector<uint8_t>(stream.begin(), stream.end())}, "parse_cost_transaction");
+    while (state.KeepRunning()) {
+        for (const std::vector<uint8_t>& input : inputs) {
+            CDataStream ds(input, SER_NETWORK, PROTOCOL_VERSION);
+            try {
+                const CTransaction tx(deserialize, ds);
+                (void)tx.GetHash();
+            } catch (const std::ios_base::failure&) {
+            }
+        }
+    }
+}
+
+static void ParseCostEquihash(benchmark::State& state)
+{
+    // The header of the bench block, and the same with its solution zeroed
+    CDataStream stream(benchmark::data::block200, SER_NETWORK, PROTOCOL_VERSION);
+    CBlockHeader header;
+    stream >> header;
+    CDataStream valid(SER_NETWORK, PROTOCOL_VERSION);
+    valid << header;
+    header.nSolution.assign(header.nSolution.size(), 0);
+    CDataStream invalid(SER_NETWORK, PROTOCOL_VERSION);
+    invalid << header;
+
+    const Inputs inputs = WithSavedInputs({std::vector<uint8_t>(valid.begin(), valid.end()), std::vector<uint8_t>(invalid.begin(), invalid.end())}, "parse_cost_equihash");
+    while (state.KeepRunning()) {
+        for (const std::vector<uint8_t>& input : inputs) {
+            CDataStream ds(input, SER_NETWORK, PROTOCOL_VERSION);
+            CBlockHeader parsed;
+            try {
+                ds >> parsed;
+            } catch (const std::ios_base::failure&) {
+                continue;
+            }
+            (void)CheckEquihashSolution(&parsed);
+        }
+    }
+}
+
+static void ParseCostUniValue(benchmark::State& state)
+{
+    std::string escapes = "\"";
+    for (int i = 0; i < 10000; ++i) escapes += "\\u00e9";
+    escapes += "\"";
+    std::string numbers = "[";
+    for (int i = 0; i < 10000; ++i) numbers += "1.5e300,";
+    numbers += "0]";
+
+    const Inputs inputs = WithSavedInputs({
+        Bytes(std::string(10000, '[') + std::string(10000, ']')),
+        Bytes(escapes),
+        Bytes(numbers),
+    }, "parse_cost_univalue");
+    while (state.KeepRunning()) {
+        for (const std::vector<uint8_t>& input : inputs) {
+            UniValue value;
+            (void)value.read(std::string(input.begin(), input.end()));
+        }
+    }
+}
+
+static void ParseCostBase58Check(benchmark::State& state)
+{
+    const Inputs inputs = WithSavedInputs({
+        Bytes(std::string(10000, '1')),
+        Bytes(std::string(200, 'z')),
+        Bytes(std::string(10000, ' ') + "z"),
+    }, "parse_cost_base58check");
+    while (state.KeepRunning()) {
+        for (const std::vector<uint8_t>& input : inputs) {
+            std::vector<unsigned char> decoded;
+            (void)DecodeBase58Check(std::string(input.begin(), input.end()), decoded, 78);
+        }
+    }
+}
+
+static void ParseCostBech32(benchmark::State& state)
+{
+    const Inputs inputs = WithSavedInputs({
+        Bytes("a1" + std::string(88, 'q')),
+        Bytes(std::string(89, '1') + "q"),
+        Bytes(std::string(10000, 'q')),
+    }, "parse_cost_bech32");
+    while (state.KeepRunning()) {
+        for (const std::vector<uint8_t>& input : inputs) {
+            (void)bech32::Decode(std::string(input.begin(), input.end()));
+        }
+    }
+}
+
+BENCHMARK(ParseCostBlock, 100);
+BENCHMARK(ParseCostTransaction, 1000);
+BENCHMARK(ParseCostEquihash, 20);
+BENCHMARK(ParseCostUniValue, 50);
+BENCHMARK(ParseCostBase58Check, 100);
+BENCHMARK(ParseCostBech32, 10000);
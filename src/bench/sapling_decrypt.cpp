@@ -0,0 +1,52 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <zcash/Note.hpp>
+#include <zcash/address/sapling.hpp>
+
+#include <assert.h>
+
+struct TrialOutput {
+    libzcash::SaplingEncCiphertext ciphertext;
+    uint256 epk;
+    uint256 cmu;
+};
+
+// 100 outputs, every tenth of them to the first of ten viewing keys.
+static void SaplingTrialDecrypt(benchmark::State& state, int nThreads)
+{
+    std::vector<libzcash::SaplingIncomingViewingKey> ivks;
+    std::vector<libzcash::SaplingPaymentAddress> addresses;
+    for (int i = 0; i < 10; i++) {
+        libzcash::SaplingSpendingKey sk = libzcash::SaplingSpendingKey::random();
+        ivks.push_back(sk.full_viewing_key().in_viewing_key());
+        addresses.push_back(sk.default_address());
+    }
+
+    std::vector<TrialOutput> outputs;
+    for (int i = 0; i < 100; i++) {
+        libzcash::SaplingNote note(addresses[i % 10 == 0 ? 0 : 1 + i % 9], 1000 + i);
+        libzcash::SaplingNotePlaintext pt(note, {{0xF6}});
+        auto enc = pt.encrypt(note.pk_d);
+        assert(enc);
+        outputs.push_back({enc->first, enc->second.get_epk(), note.cm().get()});
+    }
+    std::vector<libzcash::SaplingTrialOutput> refs;
+    for (const TrialOutput& output : outputs) {
+        refs.push_back({&output.ciphertext, &output.epk, &output.cmu});
+    }
+
+    while (state.KeepRunning()) {
+        auto found = libzcash::TrialDecryptSaplingOutputs(refs, ivks, nThreads);
+        assert(found.size() == 10);
+    }
+}
+
+static void SaplingTrialDecryptSingleThread(benchmark::State& state) { SaplingTrialDecrypt(state, 1); }
+static void SaplingTrialDecryptAllThreads(benchmark::State& state) { SaplingTrialDecrypt(state, 0); }
+
+BENCHMARK(SaplingTrialDecryptSingleThread, 1);
+BENCHMARK(SaplingTrialDecryptAllThreads, 1);
@@ -0,0 +1,109 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <random.h>
+#include <zcash/IncrementalMerkleTree.hpp>
+
+static std::vector<libzcash::PedersenHash> RandomCommitments(size_t count)
+{
+    FastRandomContext rng(true);
+    std::vector<libzcash::PedersenHash> commitments;
+    commitments.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        uint256 cm = rng.rand256();
+        // Keep the commitments below the BLS12-381 scalar field modulus.
+        *(cm.end() - 1) &= 0x3f;
+        commitments.emplace_back(cm);
+    }
+    return commitments;
+}
+
+static void SaplingTreeAppend(benchmark::State& state, size_t count)
+{
+    const std::vector<libzcash::PedersenHash> commitments = RandomCommitments(count);
+    while (state.KeepRunning()) {
+        SaplingMerkleTree tree;
+        for (const libzcash::PedersenHash& cm : commitments) {
+            tree.append(cm);
+        }
+    }
+}
+
+static void SaplingTreeAppendBatch(benchmark::State& state, size_t count)
+{
+    const std::vector<libzcash::PedersenHash> commitments = RandomCommitments(count);
+    while (state.KeepRunning()) {
+        SaplingMerkleTree tree;
+        tree.append_batch(commitments);
+    }
+}
+
+// A tree with a witness for each of its `count` leaves, as a wallet tracking
+// that many notes would have.
+static void SetupWitnesses(size_t count, SaplingMerkleTree& tree, std::vector<SaplingWitness>& witnesses)
+{
+    witnesses.reserve(count);
+    std::vector<SaplingWitness*> tracked;
+    for (const libzcash::PedersenHash& cm : RandomCommitments(count)) {
+        SaplingWitness::append_batch(tree, {cm}, tracked);
+        witnesses.push_back(tree.witness());
+        tracked.clear();
+        for (SaplingWitness& witness : witnesses) {
+            tracked.push_back(&witness);
+        }
+    }
+}
+
+// Each iteration advances the tree and every witness by a block of 100
+// commitments.
+static void SaplingWitnessAppend(benchmark::State& state, size_t count)
+{
+    SaplingMerkleTree tree;
+    std::vector<SaplingWitness> witnesses;
+    SetupWitnesses(count, tree, witnesses);
+    const std::vector<libzcash::PedersenHash> block = RandomCommitments(100);
+    while (state.KeepRunning()) {
+        for (const libzcash::PedersenHash& cm : block) {
+            tree.append(cm);
+            for (SaplingWitness& witness : witnesses) {
+                witness.append(cm);
+            }
+        }
+    }
+}
+
+static void SaplingWitnessAppendBatch(benchmark::State& state, size_t count)
+{
+    SaplingMerkleTree tree;
+    std::vector<SaplingWitness> witnesses;
+    SetupWitnesses(count, tree, witnesses);
+    std::vector<SaplingWitness*> tracked;
+    for (SaplingWitness& witness : witnesses) {
+        tracked.push_back(&witness);
+    }
+    const std::vector<libzcash::PedersenHash> block = RandomCommitments(100);
+    while (state.KeepRunning()) {
+        SaplingWitness::append_batch(tree, block, tracked);
+    }
+}
+
+static void SaplingTreeAppend1000(benchmark::State& state) { SaplingTreeAppend(state, 1000); }
+static void SaplingTreeAppend10000(benchmark::State& state) { SaplingTreeAppend(state, 10000); }
+static void SaplingTreeAppendBatch1000(benchmark::State& state) { SaplingTreeAppendBatch(state, 1000); }
+static void SaplingTreeAppendBatch10000(benchmark::State& state) { SaplingTreeAppendBatch(state, 10000); }
+static void SaplingWitnessAppend1000(benchmark::State& state) { SaplingWitnessAppend(state, 1000); }
+static void SaplingWitnessAppend10000(benchmark::State& state) { SaplingWitnessAppend(state, 10000); }
+static void SaplingWitnessAppendBatch1000(benchmark::State& state) { SaplingWitnessAppendBatch(state, 1000); }
+static void SaplingWitnessAppendBatch10000(benchmark::State& state) { SaplingWitnessAppendBatch(state, 10000); }
+
+BENCHMARK(SaplingTreeAppend1000, 10);
+BENCHMARK(SaplingTreeAppend10000, 1);
+BENCHMARK(SaplingTreeAppendBatch1000, 10);
+BENCHMARK(SaplingTreeAppendBatch10000, 1);
+BENCHMARK(SaplingWitnessAppend1000, 1);
+BENCHMARK(SaplingWitnessAppend10000, 1);
+BENCHMARK(SaplingWitnessAppendBatch1000, 10);
+BENCHMARK(SaplingWitnessAppendBatch10000, 10);
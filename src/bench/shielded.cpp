@@ -0,0 +1,110 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <consensus/consensus.h>
+#include <consensus/merkle.h>
+#include <consensus/tx_check.h>
+#include <consensus/validation.h>
+#include <random.h>
+#include <validation.h>
+#include <zcash/Note.hpp>
+#include <zcash/address/sapling.hpp>
+
+#include <assert.h>
+
+// The context-free part of shielded validation. Proof and signature checks
+// need the zk-SNARK parameters, which the benchmarks do not load, so the
+// descriptions below carry random nullifiers and empty proofs.
+
+// A Sapling transaction with nSpends spends and nOutputs outputs.
+static CMutableTransaction CreateShieldedTransaction(size_t nSpends, size_t nOutputs)
+{
+    CMutableTransaction mtx;
+    mtx.fOverwintered = true;
+    mtx.nVersion = SAPLING_TX_VERSION;
+    mtx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    mtx.vShieldedSpend.resize(nSpends);
+    for (SpendDescription& spend : mtx.vShieldedSpend) {
+        spend.nullifier = GetRandHash();
+    }
+    mtx.vShieldedOutput.resize(nOutputs);
+    for (OutputDescription& output : mtx.vShieldedOutput) {
+        output.cm = GetRandHash();
+    }
+    return mtx;
+}
+
+static void SaplingNoteEncrypt(benchmark::State& state)
+{
+    libzcash::SaplingPaymentAddress address = libzcash::SaplingSpendingKey::random().default_address();
+    libzcash::SaplingNote note(address, 1000);
+    libzcash::SaplingNotePlaintext pt(note, {{0xF6}});
+
+    while (state.KeepRunning()) {
+        auto enc = pt.encrypt(note.pk_d);
+        assert(enc);
+    }
+}
+
+static void SaplingNoteDecrypt(benchmark::State& state)
+{
+    libzcash::SaplingSpendingKey sk = libzcash::SaplingSpendingKey::random();
+    uint256 ivk = sk.full_viewing_key().in_viewing_key();
+    libzcash::SaplingNote note(sk.default_address(), 1000);
+    libzcash::SaplingNotePlaintext pt(note, {{0xF6}});
+    auto enc = pt.encrypt(note.pk_d);
+    assert(enc);
+    const uint256 epk = enc->second.get_epk();
+    const uint256 cmu = note.cm().get();
+
+    while (state.KeepRunning()) {
+        auto decrypted = libzcash::SaplingNotePlaintext::decrypt(enc->first, ivk, epk, cmu);
+        assert(decrypted);
+    }
+}
+
+static void CheckShieldedTransaction(benchmark::State& state)
+{
+    const CTransaction tx(CreateShieldedTransaction(10, 10));
+
+    while (state.KeepRunning()) {
+        TxValidationState validationState;
+        bool checked = CheckTransaction(tx, validationState);
+        assert(checked);
+    }
+}
+
+// A block of 100 shielded transactions after a coinbase, about the size of a
+// busy shielded block.
+static void CheckShieldedBlock(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+
+    CBlock block;
+    block.nVersion = MIN_BLOCK_VERSION;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_1;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 1;
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    for (int i = 0; i < 100; i++) {
+        block.vtx.push_back(MakeTransactionRef(CreateShieldedTransaction(2, 2)));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    while (state.KeepRunning()) {
+        BlockValidationState validationState;
+        bool checked = CheckBlock(block, validationState, chainParams->GetConsensus(), false);
+        assert(checked);
+    }
+}
+
+BENCHMARK(SaplingNoteEncrypt, 2000);
+BENCHMARK(SaplingNoteDecrypt, 2000);
+BENCHMARK(CheckShieldedTransaction, 100 * 1000);
+BENCHMARK(CheckShieldedBlock, 200);
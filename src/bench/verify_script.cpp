@@ -71,6 +71,55 @@ static void VerifyScriptBench(benchmark::State& state)
     }
 }
 
+// Microbenchmark for verification of every input of a transaction spending many
+// P2PKH outputs, whose legacy signature hashes each cover the whole transaction.
+static void VerifyScriptP2PKHInputs(benchmark::State& state)
+{
+    const int flags = SCRIPT_VERIFY_P2SH;
+    const unsigned int inputs = 500;
+
+    CKey key;
+    static const std::array<unsigned char, 32> vchKey = {
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+        }
+    };
+    key.Set(vchKey.begin(), vchKey.end(), false);
+    CPubKey pubkey = key.GetPubKey();
+    const CScript scriptPubKey = GetScriptForDestination(PKHash(pubkey));
+
+    CMutableTransaction txSpend;
+    txSpend.nVersion = 1;
+    for (unsigned int i = 0; i < inputs; ++i) {
+        txSpend.vin.emplace_back(COutPoint(uint256S("0x01"), i));
+    }
+    txSpend.vout.emplace_back(inputs, scriptPubKey);
+    for (unsigned int i = 0; i < inputs; ++i) {
+        std::vector<unsigned char> sig;
+        key.Sign(SignatureHash(scriptPubKey, txSpend, i, SIGHASH_ALL, 0, SigVersion::BASE), sig);
+        sig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+        txSpend.vin[i].scriptSig = CScript() << sig << ToByteVector(pubkey);
+    }
+    const CTransaction tx(txSpend);
+
+    // Benchmark.
+    while (state.KeepRunning()) {
+        const PrecomputedTransactionData txdata(tx);
+        for (unsigned int i = 0; i < inputs; ++i) {
+            ScriptError err;
+            bool success = VerifyScript(
+                tx.vin[i].scriptSig,
+                scriptPubKey,
+                &tx.vin[i].scriptWitness,
+                flags,
+                TransactionSignatureChecker(&tx, i, 0, txdata),
+                &err);
+            assert(err == SCRIPT_ERR_OK);
+            assert(success);
+        }
+    }
+}
+
 static void VerifyNestedIfScript(benchmark::State& state) {
     std::vector<std::vector<unsigned char>> stack;
     CScript script;
@@ -93,5 +142,6 @@ static void VerifyNestedIfScript(benchmark::State& state) {
 
 
 BENCHMARK(VerifyScriptBench, 6300);
+BENCHMARK(VerifyScriptP2PKHInputs, 5);
 
 BENCHMARK(VerifyNestedIfScript, 100);
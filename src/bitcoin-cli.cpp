@@ -16,8 +16,11 @@
 #include <util/system.h>
 #include <util/translation.h>
 
+#include <algorithm>
 #include <functional>
+#include <iterator>
 #include <memory>
+#include <sstream>
 #include <stdio.h>
 #include <tuple>
 
@@ -33,6 +36,7 @@ const std::function<std::string(const char*)> G_TRANSLATION_FUN = nullptr;
 static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT=900;
 static const bool DEFAULT_NAMED=false;
+static const int DEFAULT_BATCH_SIZE=1000;
 static const int CONTINUE_EXECUTION=-1;
 
 static void SetupCliArgs()
@@ -44,6 +48,8 @@ static void SetupCliArgs()
     const auto regtestBaseParams = CreateBaseChainParams(CBaseChainParams::REGTEST);
 
     gArgs.AddArg("-version", "Print version and exit", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-batch", "Read commands from standard input, one per line as a method followed by its arguments separated by whitespace, send them in JSON-RPC batches over one connection, and print the reply object of each on a line of its own", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-batchsize=<n>", strprintf("Number of commands sent together with -batch (default: %d)", DEFAULT_BATCH_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-conf=<file>", strprintf("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-getinfo", "Get general information from the remote server. Note that unlike server-side RPC calls, the results of -getinfo is the result of multiple non-atomic requests. Some entries in the result may represent results from different states (e.g. wallet balance may be as of a different block from the chain state reported)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -114,6 +120,7 @@ static int AppInitRPC(int argc, char* argv[])
             strUsage += "\n"
                 "Usage:  litecoinz-cli [options] <command> [params]  Send command to " PACKAGE_NAME "\n"
                 "or:     litecoinz-cli [options] -named <command> [name=value]...  Send command to " PACKAGE_NAME " (with named arguments)\n"
+                "or:     litecoinz-cli [options] -batch < commands   Send commands read from standard input in batches\n"
                 "or:     litecoinz-cli [options] help                List commands\n"
                 "or:     litecoinz-cli [options] help <command>      Get help for a command\n";
             strUsage += "\n" + gArgs.GetHelpMessage();
@@ -153,6 +160,8 @@ struct HTTPReply
     int status;
     int error;
     std::string body;
+    //! Set for a connection kept open, whose idle events would keep event_base_dispatch running
+    struct event_base* base{nullptr};
 };
 
 static const char *http_errorstring(int code)
@@ -180,6 +189,7 @@ static const char *http_errorstring(int code)
 static void http_request_done(struct evhttp_request *req, void *ctx)
 {
     HTTPReply *reply = static_cast<HTTPReply*>(ctx);
+    if (reply->base) event_base_loopbreak(reply->base);
 
     if (req == nullptr) {
         /* If req is nullptr, it means an error occurred while connecting: the
@@ -298,120 +308,197 @@ public:
     }
 };
 
-static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, const std::vector<std::string>& args)
+/** A connection to the RPC server, over which requests are sent one after the other. */
+class RPCConnection
 {
-    std::string host;
-    // In preference order, we choose the following for the port:
-    //     1. -rpcport
-    //     2. port in -rpcconnect (ie following : in ipv4 or ]: in ipv6)
-    //     3. default port for chain
-    int port = BaseParams().RPCPort();
-    SplitHostPort(gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT), port, host);
-    port = gArgs.GetArg("-rpcport", port);
-
-    // Obtain event base
-    raii_event_base base = obtain_event_base();
-
-    // Synchronously look up hostname
-    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), host, port);
-
-    // Set connection timeout
+public:
+    /** With keep_alive, the connection is kept open between requests, as -batch needs */
+    explicit RPCConnection(bool keep_alive) : m_keep_alive(keep_alive)
     {
-        const int timeout = gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT);
-        if (timeout > 0) {
-            evhttp_connection_set_timeout(evcon.get(), timeout);
+        // In preference order, we choose the following for the port:
+        //     1. -rpcport
+        //     2. port in -rpcconnect (ie following : in ipv4 or ]: in ipv6)
+        //     3. default port for chain
+        m_port = BaseParams().RPCPort();
+        SplitHostPort(gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT), m_port, m_host);
+        m_port = gArgs.GetArg("-rpcport", m_port);
+
+        // Obtain event base
+        m_base = obtain_event_base();
+
+        // Synchronously look up hostname
+        m_evcon = obtain_evhttp_connection_base(m_base.get(), m_host, m_port);
+
+        // Set connection timeout
+        {
+            const int timeout = gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT);
+            if (timeout > 0) {
+                evhttp_connection_set_timeout(m_evcon.get(), timeout);
+            } else {
+                // Indefinite request timeouts are not possible in libevent-http, so we
+                // set the timeout to a very long time period instead.
+
+                constexpr int YEAR_IN_SECONDS = 31556952; // Average length of year in Gregorian calendar
+                evhttp_connection_set_timeout(m_evcon.get(), 5 * YEAR_IN_SECONDS);
+            }
+        }
+
+        // Get credentials
+        if (gArgs.GetArg("-rpcpassword", "") == "") {
+            // Try fall back to cookie-based authentication if no password is provided
+            if (!GetAuthCookie(&m_rpc_user_colon_pass)) {
+                m_failed_to_get_auth_cookie = true;
+            }
         } else {
-            // Indefinite request timeouts are not possible in libevent-http, so we
-            // set the timeout to a very long time period instead.
+            m_rpc_user_colon_pass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
+        }
 
-            constexpr int YEAR_IN_SECONDS = 31556952; // Average length of year in Gregorian calendar
-            evhttp_connection_set_timeout(evcon.get(), 5 * YEAR_IN_SECONDS);
+        // check if we should use a special wallet endpoint
+        if (!gArgs.GetArgs("-rpcwallet").empty()) {
+            std::string walletName = gArgs.GetArg("-rpcwallet", "");
+            char *encodedURI = evhttp_uriencode(walletName.data(), walletName.size(), false);
+            if (encodedURI) {
+                m_endpoint = "/wallet/"+ std::string(encodedURI);
+                free(encodedURI);
+            }
+            else {
+                throw CConnectionFailed("uri-encode failed");
+            }
         }
     }
 
-    HTTPReply response;
-    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
-    if (req == nullptr)
-        throw std::runtime_error("create http request failed");
+    /** Send a request, or a batch of them, and return the parsed reply */
+    UniValue Send(const UniValue& request)
+    {
+        HTTPReply response;
+        if (m_keep_alive) response.base = m_base.get();
+        raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
+        if (req == nullptr)
+            throw std::runtime_error("create http request failed");
 #if LIBEVENT_VERSION_NUMBER >= 0x02010300
-    evhttp_request_set_error_cb(req.get(), http_error_cb);
+        evhttp_request_set_error_cb(req.get(), http_error_cb);
 #endif
 
-    // Get credentials
-    std::string strRPCUserColonPass;
-    bool failedToGetAuthCookie = false;
-    if (gArgs.GetArg("-rpcpassword", "") == "") {
-        // Try fall back to cookie-based authentication if no password is provided
-        if (!GetAuthCookie(&strRPCUserColonPass)) {
-            failedToGetAuthCookie = true;
+        struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
+        assert(output_headers);
+        evhttp_add_header(output_headers, "Host", m_host.c_str());
+        if (!m_keep_alive) evhttp_add_header(output_headers, "Connection", "close");
+        evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(m_rpc_user_colon_pass)).c_str());
+
+        // Attach request data
+        std::string strRequest = request.write() + "\n";
+        struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
+        assert(output_buffer);
+        evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
+
+        int r = evhttp_make_request(m_evcon.get(), req.get(), EVHTTP_REQ_POST, m_endpoint.c_str());
+        req.release(); // ownership moved to evcon in above call
+        if (r != 0) {
+            throw CConnectionFailed("send http request failed");
         }
-    } else {
-        strRPCUserColonPass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
-    }
 
-    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
-    assert(output_headers);
-    evhttp_add_header(output_headers, "Host", host.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
-    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
-
-    // Attach request data
-    std::string strRequest = rh->PrepareRequest(strMethod, args).write() + "\n";
-    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
-    assert(output_buffer);
-    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
-
-    // check if we should use a special wallet endpoint
-    std::string endpoint = "/";
-    if (!gArgs.GetArgs("-rpcwallet").empty()) {
-        std::string walletName = gArgs.GetArg("-rpcwallet", "");
-        char *encodedURI = evhttp_uriencode(walletName.data(), walletName.size(), false);
-        if (encodedURI) {
-            endpoint = "/wallet/"+ std::string(encodedURI);
-            free(encodedURI);
-        }
-        else {
-            throw CConnectionFailed("uri-encode failed");
-        }
-    }
-    int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, endpoint.c_str());
-    req.release(); // ownership moved to evcon in above call
-    if (r != 0) {
-        throw CConnectionFailed("send http request failed");
+        event_base_dispatch(m_base.get());
+
+        if (response.status == 0) {
+            std::string responseErrorMessage;
+            if (response.error != -1) {
+                responseErrorMessage = strprintf(" (error code %d - \"%s\")", response.error, http_errorstring(response.error));
+            }
+            throw CConnectionFailed(strprintf("Could not connect to the server %s:%d%s\n\nMake sure the litecoinzd server is running and that you are connecting to the correct RPC port.", m_host, m_port, responseErrorMessage));
+        } else if (response.status == HTTP_UNAUTHORIZED) {
+            if (m_failed_to_get_auth_cookie) {
+                throw std::runtime_error(strprintf(
+                    "Could not locate RPC credentials. No authentication cookie could be found, and RPC password is not set.  See -rpcpassword and -stdinrpcpass.  Configuration file: (%s)",
+                    GetConfigFile(gArgs.GetArg("-conf", BITCOIN_CONF_FILENAME)).string()));
+            } else {
+                throw std::runtime_error("Authorization failed: Incorrect rpcuser or rpcpassword");
+            }
+        } else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
+            throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
+        else if (response.body.empty())
+            throw std::runtime_error("no response from server");
+
+        // Parse reply
+        UniValue valReply(UniValue::VSTR);
+        if (!valReply.read(response.body))
+            throw std::runtime_error("couldn't parse reply from server");
+        return valReply;
     }
 
-    event_base_dispatch(base.get());
+private:
+    const bool m_keep_alive;
+    std::string m_host;
+    int m_port;
+    raii_event_base m_base;
+    raii_evhttp_connection m_evcon;
+    std::string m_rpc_user_colon_pass;
+    bool m_failed_to_get_auth_cookie{false};
+    std::string m_endpoint{"/"};
+};
 
-    if (response.status == 0) {
-        std::string responseErrorMessage;
-        if (response.error != -1) {
-            responseErrorMessage = strprintf(" (error code %d - \"%s\")", response.error, http_errorstring(response.error));
-        }
-        throw CConnectionFailed(strprintf("Could not connect to the server %s:%d%s\n\nMake sure the litecoinzd server is running and that you are connecting to the correct RPC port.", host, port, responseErrorMessage));
-    } else if (response.status == HTTP_UNAUTHORIZED) {
-        if (failedToGetAuthCookie) {
-            throw std::runtime_error(strprintf(
-                "Could not locate RPC credentials. No authentication cookie could be found, and RPC password is not set.  See -rpcpassword and -stdinrpcpass.  Configuration file: (%s)",
-                GetConfigFile(gArgs.GetArg("-conf", BITCOIN_CONF_FILENAME)).string()));
-        } else {
-            throw std::runtime_error("Authorization failed: Incorrect rpcuser or rpcpassword");
-        }
-    } else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
-        throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
-    else if (response.body.empty())
-        throw std::runtime_error("no response from server");
-
-    // Parse reply
-    UniValue valReply(UniValue::VSTR);
-    if (!valReply.read(response.body))
-        throw std::runtime_error("couldn't parse reply from server");
-    const UniValue reply = rh->ProcessReply(valReply);
+static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, const std::vector<std::string>& args)
+{
+    RPCConnection connection(/* keep_alive */ false);
+    const UniValue reply = rh->ProcessReply(connection.Send(rh->PrepareRequest(strMethod, args)));
     if (reply.empty())
         throw std::runtime_error("expected reply to have result, error and id properties");
 
     return reply;
 }
 
+/**
+ * Send the commands read from standard input, one per line as a method
+ * followed by its arguments separated by whitespace, in JSON-RPC batches of
+ * -batchsize over a single connection. Prints the reply object of each
+ * command on a line of its own, in order. Returns whether all succeeded.
+ */
+static bool BatchRPC()
+{
+    const size_t batch_size = std::max<int64_t>(1, gArgs.GetArg("-batchsize", DEFAULT_BATCH_SIZE));
+    const bool named = gArgs.GetBoolArg("-named", DEFAULT_NAMED);
+    RPCConnection connection(/* keep_alive */ true);
+    bool all_ok = true;
+    bool eof = false;
+    while (!eof) {
+        // The reply of each command, errors converting its arguments filled
+        // in here, and the others from the server, matched by id.
+        std::vector<UniValue> replies;
+        UniValue batch(UniValue::VARR);
+        std::string line;
+        while (replies.size() < batch_size) {
+            if (!std::getline(std::cin, line)) {
+                eof = true;
+                break;
+            }
+            std::istringstream words(line);
+            std::vector<std::string> args{std::istream_iterator<std::string>(words), std::istream_iterator<std::string>()};
+            if (args.empty()) continue;
+            const std::string method = args[0];
+            args.erase(args.begin());
+            const int id = replies.size();
+            replies.emplace_back();
+            try {
+                batch.push_back(JSONRPCRequestObj(method, named ? RPCConvertNamedValues(method, args) : RPCConvertValues(method, args), id));
+            } catch (const std::exception& e) {
+                replies.back() = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_INVALID_PARAMETER, e.what()), id);
+            }
+        }
+        if (!batch.empty()) {
+            const std::vector<UniValue> server_replies = JSONRPCProcessBatchReply(connection.Send(batch), replies.size());
+            for (size_t i = 0; i < replies.size(); ++i) {
+                if (replies[i].isNull()) replies[i] = server_replies[i];
+            }
+        }
+        for (const UniValue& reply : replies) {
+            if (reply.isNull()) throw std::runtime_error("expected a reply to every command of the batch");
+            if (!find_value(reply, "error").isNull()) all_ok = false;
+            tfm::format(std::cout, "%s\n", reply.write());
+        }
+        std::cout.flush();
+    }
+    return all_ok;
+}
+
 static int CommandLineRPC(int argc, char *argv[])
 {
     std::string strPrint;
@@ -438,6 +525,12 @@ static int CommandLineRPC(int argc, char *argv[])
             gArgs.ForceSetArg("-rpcpassword", rpcPass);
         }
         std::vector<std::string> args = std::vector<std::string>(&argv[1], &argv[argc]);
+        if (gArgs.GetBoolArg("-batch", false)) {
+            if (!args.empty() || gArgs.GetBoolArg("-getinfo", false) || gArgs.GetBoolArg("-stdin", false) || gArgs.GetBoolArg("-stdinwalletpassphrase", false)) {
+                throw std::runtime_error("-batch reads all commands from standard input");
+            }
+            return BatchRPC() ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
         if (gArgs.GetBoolArg("-stdinwalletpassphrase", false)) {
             NO_STDIN_ECHO();
             std::string walletPass;
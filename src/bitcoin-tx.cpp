@@ -24,15 +24,21 @@
 #include <util/system.h>
 #include <util/translation.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <stdio.h>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 
 static bool fCreateBlank;
 static std::map<std::string,UniValue> registers;
 static const int CONTINUE_EXECUTION=-1;
+//! Default for -streamthreads, 0 for one per core
+static const int DEFAULT_STREAM_THREADS=0;
+//! Transactions read and processed together with -stream
+static const size_t STREAM_CHUNK_SIZE=4096;
 
 const std::function<std::string(const char*)> G_TRANSLATION_FUN = nullptr;
 
@@ -42,6 +48,8 @@ static void SetupBitcoinTxArgs()
 
     gArgs.AddArg("-create", "Create new, empty TX.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-json", "Select JSON output", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-stream", "Read hex-encoded transactions from standard input, one per line, apply the commands to each, and write the results one per line in the same order, \"error: <message>\" for those that failed. With -json, each transaction is written on one line.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-streamthreads=<n>", strprintf("Number of threads applying the commands with -stream, 0 for one per core (default: %d)", DEFAULT_STREAM_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-txid", "Output only the hex-encoded transaction id of the resultant transaction.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     SetupChainParamsBaseOptions();
 
@@ -103,6 +111,7 @@ static int AppInitRawTx(int argc, char* argv[])
         std::string strUsage = PACKAGE_NAME " litecoinz-tx utility version " + FormatFullVersion() + "\n\n" +
             "Usage:  litecoinz-tx [options] <hex-tx> [commands]  Update hex-encoded litecoinz transaction\n" +
             "or:     litecoinz-tx [options] -create [commands]   Create hex-encoded litecoinz transaction\n" +
+            "or:     litecoinz-tx [options] -stream [commands]   Update hex-encoded litecoinz transactions read one per line\n" +
             "\n";
         strUsage += gArgs.GetHelpMessage();
 
@@ -560,7 +569,7 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
     if (!registers.count("privatekeys"))
         throw std::runtime_error("privatekeys register variable must be set.");
     FillableSigningProvider tempKeystore;
-    UniValue keysObj = registers["privatekeys"];
+    const UniValue& keysObj = registers.at("privatekeys");
 
     for (unsigned int kidx = 0; kidx < keysObj.size(); kidx++) {
         if (!keysObj[kidx].isStr())
@@ -575,7 +584,7 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
     // Add previous txouts given in the RPC call:
     if (!registers.count("prevtxs"))
         throw std::runtime_error("prevtxs register variable must be set.");
-    UniValue prevtxsObj = registers["prevtxs"];
+    const UniValue& prevtxsObj = registers.at("prevtxs");
     {
         for (unsigned int previdx = 0; previdx < prevtxsObj.size(); previdx++) {
             UniValue prevOut = prevtxsObj[previdx];
@@ -671,6 +680,14 @@ public:
     }
 };
 
+//! Started once for all threads with -stream, instead of by each command
+static std::unique_ptr<Secp256k1Init> g_stream_ecc;
+
+static void StartECC(std::unique_ptr<Secp256k1Init>& ecc)
+{
+    if (!g_stream_ecc) ecc.reset(new Secp256k1Init());
+}
+
 static void MutateTx(CMutableTransaction& tx, const std::string& command,
                      const std::string& commandVal)
 {
@@ -694,10 +711,10 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
     else if (command == "outaddr")
         MutateTxAddOutAddr(tx, commandVal);
     else if (command == "outpubkey") {
-        ecc.reset(new Secp256k1Init());
+        StartECC(ecc);
         MutateTxAddOutPubKey(tx, commandVal);
     } else if (command == "outmultisig") {
-        ecc.reset(new Secp256k1Init());
+        StartECC(ecc);
         MutateTxAddOutMultiSig(tx, commandVal);
     } else if (command == "outscript")
         MutateTxAddOutScript(tx, commandVal);
@@ -705,7 +722,7 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
         MutateTxAddOutData(tx, commandVal);
 
     else if (command == "sign") {
-        ecc.reset(new Secp256k1Init());
+        StartECC(ecc);
         MutateTxSign(tx, commandVal);
     }
 
@@ -752,6 +769,98 @@ static void OutputTx(const CTransaction& tx)
         OutputTxHex(tx);
 }
 
+/** The line written for tx with -stream: as OutputTx, but JSON on one line */
+static std::string StreamTxLine(const CTransaction& tx, bool json, bool txid)
+{
+    if (json) {
+        UniValue entry(UniValue::VOBJ);
+        TxToUniv(tx, uint256(), entry);
+        return entry.write();
+    } else if (txid) {
+        return tx.GetHash().GetHex();
+    }
+    return EncodeHexTx(tx);
+}
+
+static void SplitCommand(const std::string& arg, std::string& key, std::string& value)
+{
+    size_t eqpos = arg.find('=');
+    if (eqpos == std::string::npos)
+        key = arg;
+    else {
+        key = arg.substr(0, eqpos);
+        value = arg.substr(eqpos + 1);
+    }
+}
+
+/**
+ * Apply commands to each transaction read from standard input with -stream,
+ * on -streamthreads threads, STREAM_CHUNK_SIZE transactions at a time. The
+ * register commands are run once, before any transaction.
+ */
+static int StreamRawTx(const std::vector<std::pair<std::string, std::string>>& commands)
+{
+    std::vector<std::pair<std::string, std::string>> tx_commands;
+    for (const auto& command : commands) {
+        if (command.first == "load")
+            RegisterLoad(command.second);
+        else if (command.first == "set")
+            RegisterSet(command.second);
+        else
+            tx_commands.push_back(command);
+    }
+    int threads = gArgs.GetArg("-streamthreads", DEFAULT_STREAM_THREADS);
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    const bool json = gArgs.GetBoolArg("-json", false);
+    const bool txid = gArgs.GetBoolArg("-txid", false);
+
+    g_stream_ecc.reset(new Secp256k1Init());
+    bool all_ok = true;
+    std::vector<std::string> lines;
+    std::string line;
+    do {
+        lines.clear();
+        while (lines.size() < STREAM_CHUNK_SIZE && std::getline(std::cin, line)) {
+            boost::algorithm::trim(line);
+            if (!line.empty()) lines.push_back(line);
+        }
+        std::vector<std::string> results(lines.size());
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        auto process = [&] {
+            for (size_t i = next++; i < lines.size(); i = next++) {
+                try {
+                    CMutableTransaction tx;
+                    if (!DecodeHexTx(tx, lines[i], true))
+                        throw std::runtime_error("invalid transaction encoding");
+                    for (const auto& command : tx_commands) {
+                        MutateTx(tx, command.first, command.second);
+                    }
+                    results[i] = StreamTxLine(CTransaction(tx), json, txid);
+                } catch (const std::exception& e) {
+                    results[i] = std::string("error: ") + e.what();
+                    failed = true;
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int t = 1; t < threads && (size_t)t < lines.size(); ++t) {
+            workers.emplace_back(process);
+        }
+        process();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        for (const std::string& result : results) {
+            tfm::format(std::cout, "%s\n", result);
+        }
+        std::cout.flush();
+        if (failed) all_ok = false;
+    } while (!lines.empty());
+    g_stream_ecc.reset();
+    return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 static std::string readStdin()
 {
     char buf[4096];
@@ -784,6 +893,18 @@ static int CommandLineRawTx(int argc, char* argv[])
             argv++;
         }
 
+        if (gArgs.GetBoolArg("-stream", false)) {
+            if (fCreateBlank)
+                throw std::runtime_error("-stream and -create cannot be combined");
+            std::vector<std::pair<std::string, std::string>> commands;
+            for (int i = 1; i < argc; i++) {
+                std::string key, value;
+                SplitCommand(argv[i], key, value);
+                commands.emplace_back(key, value);
+            }
+            return StreamRawTx(commands);
+        }
+
         CMutableTransaction tx;
         int startArg;
 
@@ -805,15 +926,8 @@ static int CommandLineRawTx(int argc, char* argv[])
             startArg = 1;
 
         for (int i = startArg; i < argc; i++) {
-            std::string arg = argv[i];
             std::string key, value;
-            size_t eqpos = arg.find('=');
-            if (eqpos == std::string::npos)
-                key = arg;
-            else {
-                key = arg.substr(0, eqpos);
-                value = arg.substr(eqpos + 1);
-            }
+            SplitCommand(argv[i], key, value);
 
             MutateTx(tx, key, value);
         }
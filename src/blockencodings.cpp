@@ -16,15 +16,32 @@
 
 #include <unordered_map>
 
-CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
+static bool IsShieldedTx(const CTransaction& tx)
+{
+    return !tx.vShieldedSpend.empty() || !tx.vShieldedOutput.empty() || !tx.vJoinSplit.empty();
+}
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const CTxMemPool* pool) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-        shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
+        prefilledtxn(1), header(block) {
     FillShortTxIDSelector();
-    //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
     prefilledtxn[0] = {0, block.vtx[0]};
+    shorttxids.reserve(block.vtx.size() - 1);
+    size_t prefilled_size = 0;
+    size_t last_prefilled = 0;
     for (size_t i = 1; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
+        if (pool && IsShieldedTx(tx) && !pool->exists(tx.GetHash())) {
+            const size_t tx_size = tx.GetTotalSize();
+            if (prefilled_size + tx_size <= MAX_PREFILLED_SHIELDED_SIZE) {
+                // Indexes are stored as the offset from the previous prefilled transaction
+                prefilledtxn.push_back({static_cast<uint16_t>(i - last_prefilled - 1), block.vtx[i]});
+                prefilled_size += tx_size;
+                last_prefilled = i;
+                continue;
+            }
+        }
+        shorttxids.push_back(GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash()));
     }
 }
 
@@ -39,6 +56,11 @@ void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
     shorttxidk1 = shorttxidhash.GetUint64(1);
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256* txhashes, size_t count, uint64_t* shortids) const {
+    SipHashUint256Multi(shorttxidk0, shorttxidk1, txhashes, count, shortids);
+    for (size_t i = 0; i < count; i++) shortids[i] &= 0xffffffffffffL;
+}
+
 uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
@@ -55,6 +77,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     assert(header.IsNull() && txn_available.empty());
     header = cmpctblock.header;
     txn_available.resize(cmpctblock.BlockTxCount());
+    txn_from_mempool.assign(txn_available.size(), false);
 
     int32_t lastprefilledindex = -1;
     for (size_t i = 0; i < cmpctblock.prefilledtxn.size(); i++) {
@@ -106,12 +129,23 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     {
     LOCK(pool->cs);
     const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
+    // The short IDs are computed a batch at a time, which is faster than one by one
+    static const size_t SHORTID_BATCH_SIZE = 64;
+    uint256 batch_hashes[SHORTID_BATCH_SIZE];
+    uint64_t batch_shortids[SHORTID_BATCH_SIZE];
     for (size_t i = 0; i < vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
+        const size_t batch_pos = i % SHORTID_BATCH_SIZE;
+        if (batch_pos == 0) {
+            const size_t count = std::min(SHORTID_BATCH_SIZE, vTxHashes.size() - i);
+            for (size_t j = 0; j < count; j++) batch_hashes[j] = vTxHashes[i + j].first;
+            cmpctblock.GetShortIDs(batch_hashes, count, batch_shortids);
+        }
+        uint64_t shortid = batch_shortids[batch_pos];
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
                 txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
+                txn_from_mempool[idit->second] = true;
                 have_txn[idit->second]  = true;
                 mempool_count++;
             } else {
@@ -120,6 +154,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
                 // but eating a round-trip due to FillBlock failure would be annoying
                 if (txn_available[idit->second]) {
                     txn_available[idit->second].reset();
+                    txn_from_mempool[idit->second] = false;
                     mempool_count--;
                 }
             }
@@ -133,6 +168,8 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     }
 
     for (size_t i = 0; i < extra_txn.size(); i++) {
+        if (!extra_txn[i].second)
+            continue;
         uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
@@ -151,6 +188,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
                 if (txn_available[idit->second] &&
                         txn_available[idit->second]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
                     txn_available[idit->second].reset();
+                    txn_from_mempool[idit->second] = false;
                     mempool_count--;
                     extra_count--;
                 }
@@ -179,6 +217,8 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
     uint256 hash = header.GetHash();
     block = header;
     block.vtx.resize(txn_available.size());
+    // The transactions from the mempool passed CheckTransaction on acceptance
+    std::vector<bool> tx_checked(txn_available.size(), false);
 
     size_t tx_missing_offset = 0;
     for (size_t i = 0; i < txn_available.size(); i++) {
@@ -186,19 +226,22 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(CBlock& block, const std::vector<
             if (vtx_missing.size() <= tx_missing_offset)
                 return READ_STATUS_INVALID;
             block.vtx[i] = vtx_missing[tx_missing_offset++];
-        } else
+        } else {
             block.vtx[i] = std::move(txn_available[i]);
+            tx_checked[i] = txn_from_mempool[i];
+        }
     }
 
     // Make sure we can't call FillBlock again.
     header.SetNull();
     txn_available.clear();
+    txn_from_mempool.clear();
 
     if (vtx_missing.size() != tx_missing_offset)
         return READ_STATUS_INVALID;
 
     BlockValidationState state;
-    if (!CheckBlock(block, state, Params().GetConsensus())) {
+    if (!CheckBlock(block, state, Params().GetConsensus(), true, true, &tx_checked)) {
         // TODO: We really want to just check merkle tree manually here,
         // but that is expensive, and CheckBlock caches a block's
         // "checked-status" (in the CBlock?). CBlock should be able to
@@ -10,6 +10,9 @@
 
 class CTxMemPool;
 
+//! Upper bound on the size of the shielded transactions prefilled in a compact block
+static const size_t MAX_PREFILLED_SHIELDED_SIZE = 100000;
+
 // Transaction compression schemes for compact block relay can be introduced by writing
 // an actual formatter here.
 using TransactionCompression = DefaultFormatter;
@@ -103,9 +106,18 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    /**
+     * When pool is given, shielded transactions that are not in it are
+     * prefilled, up to MAX_PREFILLED_SHIELDED_SIZE: a peer is unlikely to
+     * have what never reached our mempool, and fetching a large shielded
+     * transaction costs the receiver a GETBLOCKTXN round trip. Only pass
+     * the pool before the block is connected.
+     */
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const CTxMemPool* pool = nullptr);
 
     uint64_t GetShortID(const uint256& txhash) const;
+    /** GetShortID of count txhashes at once, into shortids */
+    void GetShortIDs(const uint256* txhashes, size_t count, uint64_t* shortids) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
@@ -124,6 +136,8 @@ public:
 class PartiallyDownloadedBlock {
 protected:
     std::vector<CTransactionRef> txn_available;
+    //! Whether the transaction at each position came from the mempool, so passed CheckTransaction already
+    std::vector<bool> txn_from_mempool;
     size_t prefilled_count = 0, mempool_count = 0, extra_count = 0;
     CTxMemPool* pool;
 public:
@@ -21,6 +21,7 @@ static constexpr int GCS_SER_VERSION = 0;
 
 static const std::map<BlockFilterType, std::string> g_filter_types = {
     {BlockFilterType::BASIC, "basic"},
+    {BlockFilterType::SHIELDED, "shielded"},
 };
 
 template <typename OStream>
@@ -44,10 +45,7 @@ template <typename IStream>
 static uint64_t GolombRiceDecode(BitStreamReader<IStream>& bitreader, uint8_t P)
 {
     // Read unary-encoded quotient: q 1's followed by one 0.
-    uint64_t q = 0;
-    while (bitreader.Read(1) == 1) {
-        ++q;
-    }
+    uint64_t q = bitreader.ReadUnary();
 
     uint64_t r = bitreader.Read(P);
 
@@ -93,14 +91,44 @@ uint64_t GCSFilter::HashToRange(const Element& element) const
     return MapIntoRange(hash, m_F);
 }
 
+/// Below this many values, std::sort beats the passes of SortHashes over all of them.
+static constexpr size_t RADIX_SORT_MIN_SIZE = 512;
+
+/// Sort values that are below range, with an LSD radix sort on the bytes
+/// range spans for larger sets: a filter of 10000 elements takes 5 passes.
+static void SortHashes(std::vector<uint64_t>& values, uint64_t range)
+{
+    if (values.size() < RADIX_SORT_MIN_SIZE) {
+        std::sort(values.begin(), values.end());
+        return;
+    }
+    std::vector<uint64_t> scratch(values.size());
+    for (int shift = 0; shift < 64 && ((range - 1) >> shift) != 0; shift += 8) {
+        // Where the values with each byte go
+        size_t positions[257] = {0};
+        for (uint64_t value : values) {
+            ++positions[((value >> shift) & 0xff) + 1];
+        }
+        for (int byte = 1; byte < 257; ++byte) {
+            positions[byte] += positions[byte - 1];
+        }
+        for (uint64_t value : values) {
+            scratch[positions[(value >> shift) & 0xff]++] = value;
+        }
+        values.swap(scratch);
+    }
+}
+
 std::vector<uint64_t> GCSFilter::BuildHashedSet(const ElementSet& elements) const
 {
     std::vector<uint64_t> hashed_elements;
     hashed_elements.reserve(elements.size());
+    // Only the state after the keys is copied for each element.
+    const CSipHasher hasher(m_params.m_siphash_k0, m_params.m_siphash_k1);
     for (const Element& element : elements) {
-        hashed_elements.push_back(HashToRange(element));
+        hashed_elements.push_back(MapIntoRange(CSipHasher(hasher).Write(element.data(), element.size()).Finalize(), m_F));
     }
-    std::sort(hashed_elements.begin(), hashed_elements.end());
+    SortHashes(hashed_elements, m_F);
     return hashed_elements;
 }
 
@@ -163,6 +191,16 @@ GCSFilter::GCSFilter(const Params& params, const ElementSet& elements)
 
 bool GCSFilter::MatchInternal(const uint64_t* element_hashes, size_t size) const
 {
+    if (m_decoded) {
+        // Merge the queries into the hashes, skipping ahead with a binary search.
+        auto it = m_decoded->begin();
+        for (size_t i = 0; i < size && it != m_decoded->end(); ++i) {
+            it = std::lower_bound(it, m_decoded->end(), element_hashes[i]);
+            if (it != m_decoded->end() && *it == element_hashes[i]) return true;
+        }
+        return false;
+    }
+
     VectorReader stream(GCS_SER_TYPE, GCS_SER_VERSION, m_encoded, 0);
 
     // Seek forward by size of N
@@ -199,8 +237,48 @@ bool GCSFilter::Match(const Element& element) const
     return MatchInternal(&query, 1);
 }
 
+std::vector<uint64_t> GCSFilter::DecodeHashes() const
+{
+    VectorReader stream(GCS_SER_TYPE, GCS_SER_VERSION, m_encoded, 0);
+
+    // Seek forward by size of N
+    uint64_t N = ReadCompactSize(stream);
+    assert(N == m_N);
+
+    BitStreamReader<VectorReader> bitreader(stream);
+
+    std::vector<uint64_t> hashes;
+    hashes.reserve(m_N);
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < m_N; ++i) {
+        value += GolombRiceDecode(bitreader, m_params.m_P);
+        hashes.push_back(value);
+    }
+    return hashes;
+}
+
+void GCSFilter::CacheDecoded()
+{
+    if (!m_decoded) m_decoded = std::make_shared<const std::vector<uint64_t>>(DecodeHashes());
+}
+
 bool GCSFilter::MatchAny(const ElementSet& elements) const
 {
+    if (m_N == 0) return false;
+    if (elements.size() > m_N) {
+        // With more elements than the filter holds, as when a wallet checks
+        // all of its scripts, looking each one up in the decoded filter
+        // avoids sorting them all and stops at the first match.
+        std::vector<uint64_t> decoded;
+        if (!m_decoded) decoded = DecodeHashes();
+        const std::vector<uint64_t>& hashes = m_decoded ? *m_decoded : decoded;
+        const CSipHasher hasher(m_params.m_siphash_k0, m_params.m_siphash_k1);
+        for (const Element& element : elements) {
+            const uint64_t query = MapIntoRange(CSipHasher(hasher).Write(element.data(), element.size()).Finalize(), m_F);
+            if (std::binary_search(hashes.begin(), hashes.end(), query)) return true;
+        }
+        return false;
+    }
     const std::vector<uint64_t> queries = BuildHashedSet(elements);
     return MatchInternal(queries.data(), queries.size());
 }
@@ -279,6 +357,35 @@ static GCSFilter::ElementSet BasicFilterElements(const CBlock& block,
     return elements;
 }
 
+/**
+ * The shielded filter lets a light wallet find the blocks that spend one of
+ * its notes, by nullifier, and the blocks with a note it knows the commitment
+ * of, such as one it sent, without the transparent scripts of the basic filter.
+ */
+static GCSFilter::ElementSet ShieldedFilterElements(const CBlock& block)
+{
+    GCSFilter::ElementSet elements;
+
+    for (const CTransactionRef& tx : block.vtx) {
+        for (const SpendDescription& spend : tx->vShieldedSpend) {
+            elements.emplace(spend.nullifier.begin(), spend.nullifier.end());
+        }
+        for (const OutputDescription& output : tx->vShieldedOutput) {
+            elements.emplace(output.cm.begin(), output.cm.end());
+        }
+        for (const JSDescription& joinsplit : tx->vJoinSplit) {
+            for (const uint256& nullifier : joinsplit.nullifiers) {
+                elements.emplace(nullifier.begin(), nullifier.end());
+            }
+            for (const uint256& commitment : joinsplit.commitments) {
+                elements.emplace(commitment.begin(), commitment.end());
+            }
+        }
+    }
+
+    return elements;
+}
+
 BlockFilter::BlockFilter(BlockFilterType filter_type, const uint256& block_hash,
                          std::vector<unsigned char> filter)
     : m_filter_type(filter_type), m_block_hash(block_hash)
@@ -297,7 +404,11 @@ BlockFilter::BlockFilter(BlockFilterType filter_type, const CBlock& block, const
     if (!BuildParams(params)) {
         throw std::invalid_argument("unknown filter_type");
     }
-    m_filter = GCSFilter(params, BasicFilterElements(block, block_undo));
+    if (m_filter_type == BlockFilterType::SHIELDED) {
+        m_filter = GCSFilter(params, ShieldedFilterElements(block));
+    } else {
+        m_filter = GCSFilter(params, BasicFilterElements(block, block_undo));
+    }
 }
 
 bool BlockFilter::BuildParams(GCSFilter::Params& params) const
@@ -309,6 +420,12 @@ bool BlockFilter::BuildParams(GCSFilter::Params& params) const
         params.m_P = BASIC_FILTER_P;
         params.m_M = BASIC_FILTER_M;
         return true;
+    case BlockFilterType::SHIELDED:
+        params.m_siphash_k0 = m_block_hash.GetUint64(0);
+        params.m_siphash_k1 = m_block_hash.GetUint64(1);
+        params.m_P = SHIELDED_FILTER_P;
+        params.m_M = SHIELDED_FILTER_M;
+        return true;
     case BlockFilterType::INVALID:
         return false;
     }
@@ -5,6 +5,7 @@
 #include <bloom.h>
 
 #include <primitives/transaction.h>
+#include <crypto/siphash.h>
 #include <hash.h>
 #include <script/script.h>
 #include <script/standard.h>
@@ -19,6 +20,43 @@
 #define LN2SQUARED 0.4804530139182014246671025263266649717305529515945455
 #define LN2 0.6931471805599453094172321214581765680755001343602552
 
+//! The non-empty data pushes of script, up to its first invalid opcode
+static std::vector<std::vector<unsigned char>> ScriptDataElements(const CScript& script, size_t& usage)
+{
+    std::vector<std::vector<unsigned char>> elements;
+    CScript::const_iterator pc = script.begin();
+    std::vector<unsigned char> data;
+    while (pc < script.end())
+    {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data))
+            break;
+        if (data.size() != 0) {
+            usage += data.size();
+            elements.push_back(data);
+        }
+    }
+    return elements;
+}
+
+CBloomTxElements::CBloomTxElements(const CTransactionRef& txIn) : tx(txIn), vHash(tx->GetHash().begin(), tx->GetHash().end()), nUsage(0)
+{
+    vOutputData.reserve(tx->vout.size());
+    for (const CTxOut& txout : tx->vout) {
+        vOutputData.push_back(ScriptDataElements(txout.scriptPubKey, nUsage));
+    }
+    vPrevouts.reserve(tx->vin.size());
+    vInputData.reserve(tx->vin.size());
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    for (const CTxIn& txin : tx->vin) {
+        stream.clear();
+        stream << txin.prevout;
+        vPrevouts.emplace_back(stream.begin(), stream.end());
+        nUsage += stream.size();
+        vInputData.push_back(ScriptDataElements(txin.scriptSig, nUsage));
+    }
+}
+
 CBloomFilter::CBloomFilter(const unsigned int nElements, const double nFPRate, const unsigned int nTweakIn, unsigned char nFlagsIn) :
     /**
      * The ideal size for a bloom filter with a given number of elements and false positive rate is:
@@ -190,6 +228,57 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     return false;
 }
 
+bool CBloomFilter::IsRelevantAndUpdate(const CBloomTxElements& elements)
+{
+    // The same matching as above, in the same order, as an outpoint inserted
+    // for a matched output may match a later one.
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    bool fFound = contains(elements.vHash);
+    const CTransaction& tx = *elements.tx;
+    const uint256& hash = tx.GetHash();
+
+    for (unsigned int i = 0; i < elements.vOutputData.size(); i++)
+    {
+        for (const std::vector<unsigned char>& data : elements.vOutputData[i])
+        {
+            if (contains(data))
+            {
+                fFound = true;
+                if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
+                    insert(COutPoint(hash, i));
+                else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY)
+                {
+                    std::vector<std::vector<unsigned char> > vSolutions;
+                    txnouttype type = Solver(tx.vout[i].scriptPubKey, vSolutions);
+                    if (type == TX_PUBKEY || type == TX_MULTISIG) {
+                        insert(COutPoint(hash, i));
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    if (fFound)
+        return true;
+
+    for (unsigned int i = 0; i < elements.vPrevouts.size(); i++)
+    {
+        if (contains(elements.vPrevouts[i]))
+            return true;
+        for (const std::vector<unsigned char>& data : elements.vInputData[i])
+        {
+            if (contains(data))
+                return true;
+        }
+    }
+
+    return false;
+}
+
 void CBloomFilter::UpdateEmptyFull()
 {
     bool full = true;
@@ -307,3 +396,51 @@ void CRollingBloomFilter::reset()
     nGeneration = 1;
     std::fill(data.begin(), data.end(), 0);
 }
+
+CNullifierFilter::CNullifierFilter(uint64_t nCapacityIn) :
+    k0(GetRand(std::numeric_limits<uint64_t>::max())),
+    k1(GetRand(std::numeric_limits<uint64_t>::max())),
+    nCapacity(std::max<uint64_t>(nCapacityIn, 1)),
+    nElements(0)
+{
+    // See CBloomFilter for the ideal size and number of hash functions.
+    uint64_t nFilterBits = (uint64_t)ceil(-1 / LN2SQUARED * nCapacity * log(NULLIFIER_FILTER_FP_RATE));
+    data.assign((nFilterBits + 63) / 64, 0);
+    nHashFuncs = std::max(1, std::min((int)round(data.size() * 64 * LN2 / nCapacity), 32));
+}
+
+/* Both hashes come from a salted SipHash, and the i-th bit of an element is
+ * h1 + i * h2 as in double hashing. */
+void CNullifierFilter::insert(const uint256& nullifier)
+{
+    if (data.empty()) return;
+    const uint64_t nFilterBits = data.size() * 64;
+    const uint64_t h1 = SipHashUint256(k0, k1, nullifier);
+    const uint64_t h2 = SipHashUint256Extra(k0, k1, nullifier, 1) | 1;
+    for (uint32_t i = 0; i < nHashFuncs; i++) {
+        uint64_t bit = (h1 + i * h2) % nFilterBits;
+        data[bit >> 6] |= uint64_t{1} << (bit & 63);
+    }
+    nElements++;
+}
+
+bool CNullifierFilter::contains(const uint256& nullifier) const
+{
+    if (data.empty()) return true;
+    const uint64_t nFilterBits = data.size() * 64;
+    const uint64_t h1 = SipHashUint256(k0, k1, nullifier);
+    const uint64_t h2 = SipHashUint256Extra(k0, k1, nullifier, 1) | 1;
+    for (uint32_t i = 0; i < nHashFuncs; i++) {
+        uint64_t bit = (h1 + i * h2) % nFilterBits;
+        if (!(data[bit >> 6] & (uint64_t{1} << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+double CNullifierFilter::GetFalsePositiveRate() const
+{
+    if (data.empty()) return 1.0;
+    return pow(1.0 - exp(-1.0 * nHashFuncs * nElements / (data.size() * 64)), nHashFuncs);
+}
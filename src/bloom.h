@@ -5,12 +5,11 @@
 #ifndef BITCOIN_BLOOM_H
 #define BITCOIN_BLOOM_H
 
+#include <primitives/transaction.h>
 #include <serialize.h>
 
 #include <vector>
 
-class COutPoint;
-class CTransaction;
 class uint256;
 
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
@@ -30,6 +29,33 @@ enum bloomflags
     BLOOM_UPDATE_MASK = 3,
 };
 
+/**
+ * The data elements of a transaction that CBloomFilter::IsRelevantAndUpdate
+ * matches against: its hash, the data pushes of its scripts and the outpoints
+ * it spends, serialized. Relaying a transaction to many filtered peers parses
+ * its scripts and serializes its outpoints once rather than once per peer.
+ */
+class CBloomTxElements
+{
+public:
+    explicit CBloomTxElements(const CTransactionRef& txIn);
+
+    CTransactionRef tx;
+    std::vector<unsigned char> vHash;
+    //! The non-empty data pushes of each scriptPubKey, up to its first invalid opcode
+    std::vector<std::vector<std::vector<unsigned char>>> vOutputData;
+    //! The serialized outpoint each input spends
+    std::vector<std::vector<unsigned char>> vPrevouts;
+    //! The non-empty data pushes of each scriptSig, up to its first invalid opcode
+    std::vector<std::vector<std::vector<unsigned char>>> vInputData;
+
+    //! The bytes of data held, roughly
+    size_t DynamicUsage() const { return nUsage; }
+
+private:
+    size_t nUsage;
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide
  * so that we can filter the transactions we send them.
@@ -93,6 +119,10 @@ public:
 
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
+    //! The same for a transaction whose data elements are extracted already
+    bool IsRelevantAndUpdate(const CBloomTxElements& elements);
+    //! Whether IsRelevantAndUpdate matches every transaction or none, whatever its data elements
+    bool IsFullOrEmpty() const { return isFull || isEmpty; }
 
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
@@ -133,4 +163,53 @@ private:
     int nHashFuncs;
 };
 
+/**
+ * NullifierFilter is a bloom filter over the spent Sapling nullifiers of the
+ * chainstate, so that looking up a nullifier that was never spent needs no
+ * database read. It is sized for nCapacity elements at NULLIFIER_FILTER_FP_RATE
+ * and has to be rebuilt larger once it holds more than that. Elements can not
+ * be removed: a nullifier unspent again by a reorg stays in as a false
+ * positive until the next rebuild.
+ */
+class CNullifierFilter
+{
+public:
+    //! The false positive rate a filter is sized for
+    static constexpr double NULLIFIER_FILTER_FP_RATE = 0.01;
+
+    //! An empty filter that contains everything, for when none is loaded
+    CNullifierFilter() : k0(0), k1(0), nCapacity(0), nElements(0), nHashFuncs(0) {}
+    explicit CNullifierFilter(uint64_t nCapacityIn);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(k0);
+        READWRITE(k1);
+        READWRITE(nCapacity);
+        READWRITE(nElements);
+        READWRITE(nHashFuncs);
+        READWRITE(data);
+    }
+
+    void insert(const uint256& nullifier);
+    bool contains(const uint256& nullifier) const;
+
+    uint64_t GetCapacity() const { return nCapacity; }
+    uint64_t GetElements() const { return nElements; }
+    size_t GetSize() const { return data.size() * sizeof(uint64_t); }
+    //! Whether it holds more elements than it was sized for
+    bool IsFull() const { return nElements > nCapacity; }
+    //! The false positive rate expected at the current number of elements
+    double GetFalsePositiveRate() const;
+
+private:
+    uint64_t k0, k1;
+    uint64_t nCapacity;
+    uint64_t nElements;
+    uint32_t nHashFuncs;
+    std::vector<uint64_t> data;
+};
+
 #endif // BITCOIN_BLOOM_H
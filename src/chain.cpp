@@ -5,21 +5,146 @@
 
 #include <chain.h>
 
+#include <memusage.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+/** Solutions recently read back from the block tree DB. A getheaders reply is up to 2000 headers. */
+constexpr size_t BLOCK_SOLUTION_CACHE_SIZE = 2000;
+
+struct BlockSolutions {
+    //! Guards the solutions of all block indexes and the fields below
+    std::mutex mutex;
+    std::list<std::pair<uint256, std::vector<unsigned char>>> cache; //!< Most recently used first
+    std::map<uint256, decltype(cache)::iterator> cache_index;
+    BlockSolutionStats stats;
+};
+
+BlockSolutions g_block_solutions;
+} // namespace
+
+std::vector<unsigned char> CBlockIndex::GetSolution() const
+{
+    const uint256 hash = GetBlockHash();
+    {
+        std::lock_guard<std::mutex> lock(g_block_solutions.mutex);
+        if (!m_solution_trimmed) return nSolution;
+        auto it = g_block_solutions.cache_index.find(hash);
+        if (it != g_block_solutions.cache_index.end()) {
+            g_block_solutions.cache.splice(g_block_solutions.cache.begin(), g_block_solutions.cache, it->second);
+            ++g_block_solutions.stats.cache_hits;
+            return it->second->second;
+        }
+        ++g_block_solutions.stats.cache_misses;
+    }
+
+    std::vector<unsigned char> solution;
+    if (!pblocktree || !pblocktree->ReadBlockSolution(hash, solution)) {
+        throw std::runtime_error(strprintf("%s: failed to read the solution of block %s", __func__, hash.ToString()));
+    }
+
+    std::lock_guard<std::mutex> lock(g_block_solutions.mutex);
+    if (g_block_solutions.cache_index.count(hash) == 0) {
+        g_block_solutions.cache.emplace_front(hash, solution);
+        g_block_solutions.cache_index.emplace(hash, g_block_solutions.cache.begin());
+        if (g_block_solutions.cache.size() > BLOCK_SOLUTION_CACHE_SIZE) {
+            g_block_solutions.cache_index.erase(g_block_solutions.cache.back().first);
+            g_block_solutions.cache.pop_back();
+        }
+    }
+    return solution;
+}
+
+void CBlockIndex::SetSolution(std::vector<unsigned char>&& solution)
+{
+    std::lock_guard<std::mutex> lock(g_block_solutions.mutex);
+    if (m_solution_trimmed) {
+        --g_block_solutions.stats.trimmed;
+        g_block_solutions.stats.trimmed_bytes -= std::min<uint64_t>(g_block_solutions.stats.trimmed_bytes, memusage::DynamicUsage(solution));
+        m_solution_trimmed = false;
+    }
+    nSolution = std::move(solution);
+}
+
+void CBlockIndex::TrimSolution()
+{
+    std::lock_guard<std::mutex> lock(g_block_solutions.mutex);
+    if (m_solution_trimmed) return;
+    ++g_block_solutions.stats.trimmed;
+    g_block_solutions.stats.trimmed_bytes += memusage::DynamicUsage(nSolution);
+    std::vector<unsigned char>().swap(nSolution);
+    m_solution_trimmed = true;
+}
+
+BlockSolutionStats GetBlockSolutionStats()
+{
+    std::lock_guard<std::mutex> lock(g_block_solutions.mutex);
+    BlockSolutionStats stats = g_block_solutions.stats;
+    stats.cache_entries = g_block_solutions.cache.size();
+    return stats;
+}
+
 /**
  * CChain implementation
  */
 void CChain::SetTip(CBlockIndex *pindex) {
+    if (!m_defer_tip_snapshot) m_tip_snapshot.store(pindex, std::memory_order_release);
     if (pindex == nullptr) {
         vChain.clear();
+        m_time_max.clear();
         return;
     }
     vChain.resize(pindex->nHeight + 1);
+    m_time_max.resize(pindex->nHeight + 1);
     while (pindex && vChain[pindex->nHeight] != pindex) {
         vChain[pindex->nHeight] = pindex;
+        m_time_max[pindex->nHeight] = pindex->nTimeMax;
         pindex = pindex->pprev;
     }
 }
 
+/**
+ * The highest of pindex and its ancestors that pred holds for, or nullptr if
+ * none, given that pred holds for every ancestor of one it holds for. Steps
+ * back exponentially further through the skip list and then bisects, taking
+ * O(log^2 n) pointer hops however far back the answer is, where walking
+ * pprev takes one per block.
+ */
+template <typename Pred>
+static const CBlockIndex* LastAncestorWhere(const CBlockIndex* pindex, Pred pred)
+{
+    if (pindex == nullptr || pred(pindex)) return pindex;
+    // pred holds for good and not for bad
+    const CBlockIndex* bad = pindex;
+    const CBlockIndex* good = nullptr;
+    for (int step = 1; good == nullptr; step *= 2) {
+        const CBlockIndex* ancestor = pindex->GetAncestor(std::max(pindex->nHeight - step, 0));
+        if (pred(ancestor)) {
+            good = ancestor;
+        } else if (ancestor->nHeight == 0) {
+            return nullptr;
+        } else {
+            bad = ancestor;
+        }
+    }
+    while (bad->nHeight - good->nHeight > 1) {
+        const CBlockIndex* mid = bad->GetAncestor(good->nHeight + (bad->nHeight - good->nHeight) / 2);
+        if (pred(mid)) {
+            good = mid;
+        } else {
+            bad = mid;
+        }
+    }
+    return good;
+}
+
 CBlockLocator CChain::GetLocator(const CBlockIndex *pindex) const {
     int nStep = 1;
     std::vector<uint256> vHave;
@@ -54,17 +179,17 @@ const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const {
     }
     if (pindex->nHeight > Height())
         pindex = pindex->GetAncestor(Height());
-    while (pindex && !Contains(pindex))
-        pindex = pindex->pprev;
-    return pindex;
+    return LastAncestorWhere(pindex, [this](const CBlockIndex* ancestor) { return Contains(ancestor); });
 }
 
 CBlockIndex* CChain::FindEarliestAtLeast(int64_t nTime, int height) const
 {
-    std::pair<int64_t, int> blockparams = std::make_pair(nTime, height);
-    std::vector<CBlockIndex*>::const_iterator lower = std::lower_bound(vChain.begin(), vChain.end(), blockparams,
-        [](CBlockIndex* pBlock, const std::pair<int64_t, int>& blockparams) -> bool { return pBlock->GetBlockTimeMax() < blockparams.first || pBlock->nHeight < blockparams.second; });
-    return (lower == vChain.end() ? nullptr : *lower);
+    // nTimeMax never decreases along the chain
+    const size_t first = std::max(height, 0);
+    if (first >= m_time_max.size()) return nullptr;
+    std::vector<unsigned int>::const_iterator lower = std::lower_bound(m_time_max.begin() + first, m_time_max.end(), nTime,
+        [](unsigned int time_max, int64_t time) { return (int64_t)time_max < time; });
+    return (lower == m_time_max.end() ? nullptr : vChain[lower - m_time_max.begin()]);
 }
 
 /** Turn the lowest '1' bit in the binary representation of a number into a '0'. */
@@ -160,12 +285,21 @@ const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex*
         pb = pb->GetAncestor(pa->nHeight);
     }
 
-    while (pa != pb && pa && pb) {
-        pa = pa->pprev;
-        pb = pb->pprev;
+    // Eventually all chain branches meet at the genesis block.
+    return LastAncestorWhere(pa, [pb](const CBlockIndex* ancestor) { return ancestor == pb->GetAncestor(ancestor->nHeight); });
+}
+
+CBlockIndex* CBlockIndexArena::Allocate()
+{
+    if (m_chunk_used == CHUNK_SIZE) {
+        m_chunks.emplace_back(new CBlockIndex[CHUNK_SIZE]);
+        m_chunk_used = 0;
     }
+    return &m_chunks.back()[m_chunk_used++];
+}
 
-    // Eventually all chain branches meet at the genesis block.
-    assert(pa == pb);
-    return pa;
+void CBlockIndexArena::Clear()
+{
+    m_chunks.clear();
+    m_chunk_used = CHUNK_SIZE;
 }
@@ -10,9 +10,12 @@
 #include <consensus/params.h>
 #include <flatfile.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <tinyformat.h>
 #include <uint256.h>
 
+#include <atomic>
+#include <memory>
 #include <vector>
 
 /**
@@ -133,6 +136,10 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_SAPLING        =   128, //!< block data in blk*.data was received with a sapling-enforcing client
+
+    BLOCK_HAVE_SAPLING_ROOT  =   256, //!< hashFinalSaplingRoot is set
+
+    BLOCK_HAVE_SHIELDED_COUNTS = 512, //!< the shielded note and nullifier counts are set
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -208,6 +215,27 @@ public:
     //! Will be boost::none if nChainTx is zero.
     Optional<CAmount> nChainSaplingValue{nullopt};
 
+    //! Notes created and nullifiers revealed in this block, per shielded pool.
+    //! Only valid if nStatus has BLOCK_HAVE_SHIELDED_COUNTS.
+    uint32_t nSproutNotes{0};
+    uint32_t nSproutNullifiers{0};
+    uint32_t nSaplingNotes{0};
+    uint32_t nSaplingNullifiers{0};
+
+    //! (memory only) The counts above summed up to and including this block.
+    //! Will be boost::none if nChainTx is zero, or if some block before this
+    //! one does not have its counts set.
+    Optional<uint64_t> nChainSproutNotes{nullopt};
+    Optional<uint64_t> nChainSproutNullifiers{nullopt};
+    Optional<uint64_t> nChainSaplingNotes{nullopt};
+    Optional<uint64_t> nChainSaplingNullifiers{nullopt};
+
+    //! Root of the Sapling note commitment tree at the end of this block, as
+    //! computed when the block was connected. Only valid if nStatus has
+    //! BLOCK_HAVE_SAPLING_ROOT; unlike the header's hashSaplingRoot it is not
+    //! chosen by the miner.
+    uint256 hashFinalSaplingRoot{};
+
     //! block header
     int32_t nVersion{0};
     uint256 hashMerkleRoot{};
@@ -215,8 +243,15 @@ public:
     uint32_t nTime{0};
     uint32_t nBits{0};
     uint256 nNonce{};
+
+protected:
+    //! Empty once trimmed, see TrimSolution. Guarded, with m_solution_trimmed,
+    //! by a mutex in chain.cpp, as headers are served without cs_main.
     std::vector<unsigned char> nSolution{};
+    //! (memory only) Whether nSolution was dropped and is only in the block tree DB
+    bool m_solution_trimmed{false};
 
+public:
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId{0};
 
@@ -259,6 +294,19 @@ public:
         return ret;
     }
 
+    /**
+     * The Equihash solution. Once trimmed it is read back from the block tree
+     * DB, through a cache of the most recently read ones; throws if it cannot
+     * be.
+     */
+    std::vector<unsigned char> GetSolution() const;
+    void SetSolution(std::vector<unsigned char>&& solution);
+    /**
+     * Drop the in-memory copy of the solution, which only serving headers
+     * needs. The index must already be written to the block tree DB.
+     */
+    void TrimSolution();
+
     CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
@@ -270,7 +318,7 @@ public:
         block.nTime           = nTime;
         block.nBits           = nBits;
         block.nNonce          = nNonce;
-        block.nSolution       = nSolution;
+        block.nSolution       = GetSolution();
         return block;
     }
 
@@ -358,12 +406,44 @@ public:
     const CBlockIndex* GetAncestor(int height) const;
 };
 
+struct BlockSolutionStats {
+    //! Block indexes whose solution is only in the block tree DB
+    uint64_t trimmed{0};
+    //! Memory those solutions took up before they were trimmed
+    uint64_t trimmed_bytes{0};
+    uint64_t cache_entries{0};
+    uint64_t cache_hits{0};
+    uint64_t cache_misses{0};
+};
+
+BlockSolutionStats GetBlockSolutionStats();
+
 arith_uint256 GetBlockProof(const CBlockIndex& block);
 /** Return the time it would take to redo the work difference between from and to, assuming the current hashrate corresponds to the difficulty at tip, in seconds. */
 int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::Params&);
 /** Find the forking point between two chain tips. */
 const CBlockIndex* LastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb);
 
+/**
+ * Owns block index entries, allocated in chunks so that entries allocated one
+ * after another sit next to each other in memory. Entries are only freed all
+ * together, by Clear() or destruction.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t CHUNK_SIZE = 4096;
+    std::vector<std::unique_ptr<CBlockIndex[]>> m_chunks;
+    //! Entries handed out from the last chunk
+    size_t m_chunk_used{CHUNK_SIZE};
+
+public:
+    /** Returns a default constructed entry */
+    CBlockIndex* Allocate();
+    size_t Size() const { return m_chunks.empty() ? 0 : (m_chunks.size() - 1) * CHUNK_SIZE + m_chunk_used; }
+    void Clear();
+};
+
 
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
@@ -377,8 +457,16 @@ public:
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        // Never write an index without its solution
+        if (m_solution_trimmed) {
+            nSolution = pindex->GetSolution();
+            m_solution_trimmed = false;
+        }
     }
 
+    //! The solution read from disk, for LoadBlockIndexGuts to hand to the in-memory index
+    std::vector<unsigned char>& Solution() { return nSolution; }
+
     SERIALIZE_METHODS(CDiskBlockIndex, obj)
     {
         int _nVersion = s.GetVersion();
@@ -415,6 +503,18 @@ public:
         if ((s.GetType() & SER_DISK) && (obj.nVersion >= SAPLING_VALUE_VERSION)) {
             READWRITE(obj.nSaplingValue);
         }
+
+        // Appended last so that older clients, which do not know the flag,
+        // simply ignore it.
+        if ((s.GetType() & SER_DISK) && (obj.nStatus & BLOCK_HAVE_SAPLING_ROOT)) {
+            READWRITE(obj.hashFinalSaplingRoot);
+        }
+        if ((s.GetType() & SER_DISK) && (obj.nStatus & BLOCK_HAVE_SHIELDED_COUNTS)) {
+            READWRITE(VARINT(obj.nSproutNotes));
+            READWRITE(VARINT(obj.nSproutNullifiers));
+            READWRITE(VARINT(obj.nSaplingNotes));
+            READWRITE(VARINT(obj.nSaplingNullifiers));
+        }
     }
 
     uint256 GetBlockHash() const
@@ -443,10 +543,25 @@ public:
     }
 };
 
+extern RecursiveMutex cs_main;
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
     std::vector<CBlockIndex*> vChain;
+    //! nTimeMax of each entry of vChain, so that searches by time stay in one array
+    std::vector<unsigned int> m_time_max;
+    //! Copy of the tip for readers that do not hold cs_main
+    std::atomic<CBlockIndex*> m_tip_snapshot{nullptr};
+    //! While set, SetTip() leaves m_tip_snapshot at the tip it had
+    bool m_defer_tip_snapshot GUARDED_BY(::cs_main){false};
+
+    friend class DeferredTipSnapshot;
+    /** See DeferredTipSnapshot */
+    void DeferTipSnapshot(bool defer) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
+        m_defer_tip_snapshot = defer;
+        if (!defer) m_tip_snapshot.store(Tip(), std::memory_order_release);
+    }
 
 public:
     /** Returns the index entry for the genesis block of this chain, or nullptr if none. */
@@ -459,6 +574,16 @@ public:
         return vChain.size() > 0 ? vChain[vChain.size() - 1] : nullptr;
     }
 
+    /**
+     * Returns the tip without requiring the lock that guards the chain. It may
+     * be replaced right after; use only fields of CBlockIndex that do not
+     * change once it is in the block index, and walk the chain it ends with
+     * GetAncestor(). Entries are not freed while the node runs.
+     */
+    CBlockIndex *TipSnapshot() const {
+        return m_tip_snapshot.load(std::memory_order_acquire);
+    }
+
     /** Returns the index entry at a particular height in this chain, or nullptr if no such height exists. */
     CBlockIndex *operator[](int nHeight) const {
         if (nHeight < 0 || nHeight >= (int)vChain.size())
@@ -491,7 +616,7 @@ public:
     }
 
     /** Set/initialize a chain with a given tip. */
-    void SetTip(CBlockIndex *pindex);
+    void SetTip(CBlockIndex *pindex) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
     /** Return a CBlockLocator that refers to a block in this chain (by default the tip). */
     CBlockLocator GetLocator(const CBlockIndex *pindex = nullptr) const;
@@ -503,4 +628,23 @@ public:
     CBlockIndex* FindEarliestAtLeast(int64_t nTime, int height) const;
 };
 
+/**
+ * Keeps TipSnapshot() of a chain at its current tip while the chain goes
+ * through several steps, such as the disconnects and connects of a reorg,
+ * and publishes the tip reached when it goes out of scope, also if a step
+ * throws. cs_main is to be held for its whole lifetime.
+ */
+class DeferredTipSnapshot
+{
+public:
+    explicit DeferredTipSnapshot(CChain& chain) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) : m_chain(chain) { m_chain.DeferTipSnapshot(true); }
+    ~DeferredTipSnapshot() EXCLUSIVE_LOCKS_REQUIRED(::cs_main) { m_chain.DeferTipSnapshot(false); }
+
+    DeferredTipSnapshot(const DeferredTipSnapshot&) = delete;
+    DeferredTipSnapshot& operator=(const DeferredTipSnapshot&) = delete;
+
+private:
+    CChain& m_chain;
+};
+
 #endif // BITCOIN_CHAIN_H
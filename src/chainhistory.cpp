@@ -0,0 +1,292 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainhistory.h>
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <consensus/params.h>
+#include <crypto/common.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+
+#include <librustzcash.h>
+
+#include <algorithm>
+#include <assert.h>
+
+namespace {
+
+/** Positions and altitudes of the peaks of a tree of length nodes, from the highest on */
+std::vector<std::pair<HistoryIndex, uint32_t>> PeaksOf(HistoryIndex length)
+{
+    std::vector<std::pair<HistoryIndex, uint32_t>> peaks;
+    if (length == 0) return peaks;
+    // The highest peak roots the largest perfect tree that fits, of
+    // altitude h and 2^(h+1) - 1 nodes. Positions here are one based.
+    uint32_t h = 0;
+    while ((uint64_t{1} << (h + 2)) - 1 <= length) ++h;
+    uint64_t p = (uint64_t{1} << (h + 1)) - 1;
+    while (true) {
+        if (p > length) {
+            // Not there: go down to its left child
+            p -= uint64_t{1} << h;
+            --h;
+        }
+        if (p <= length) {
+            peaks.emplace_back(p - 1, h);
+            // The next peak roots the tree right of this one
+            p += (uint64_t{1} << (h + 1)) - 1;
+        }
+        if (h == 0) break;
+    }
+    return peaks;
+}
+
+HistoryEntry ToEntry(const HistoryNode& node, HistoryIndex pos, uint32_t alt)
+{
+    HistoryEntry entry{};
+    unsigned char* out = entry.data();
+    if (alt == 0) {
+        *out++ = 1;
+    } else {
+        *out++ = 0;
+        WriteLE32(out, pos - (HistoryIndex{1} << alt));
+        WriteLE32(out + 4, pos - 1);
+        out += 8;
+    }
+    std::copy(node.begin(), node.end(), out);
+    return entry;
+}
+
+} // namespace
+
+uint64_t CountSaplingTransactions(const CBlock& block)
+{
+    return std::count_if(block.vtx.begin(), block.vtx.end(), [](const CTransactionRef& tx) {
+        return !tx->vShieldedSpend.empty() || !tx->vShieldedOutput.empty();
+    });
+}
+
+HistoryNode NewHistoryLeaf(const CBlockIndex& index, uint64_t sapling_tx_count)
+{
+    const uint256 work = ArithToUint256(GetBlockProof(index));
+    const uint32_t time = index.nTime;
+    const uint32_t bits = index.nBits;
+    const uint64_t height = index.nHeight;
+
+    // A leaf is a subtree of one block, from which it starts and at which it ends.
+    CDataStream stream(SER_DISK, 0);
+    stream << index.GetBlockHash();
+    stream << time << time;
+    stream << bits << bits;
+    stream << index.hashFinalSaplingRoot << index.hashFinalSaplingRoot;
+    stream << work;
+    stream << COMPACTSIZE(height) << COMPACTSIZE(height);
+    stream << COMPACTSIZE(sapling_tx_count);
+    assert(stream.size() <= HISTORY_NODE_SIZE);
+
+    HistoryNode leaf{};
+    std::copy(stream.begin(), stream.end(), leaf.begin());
+    return leaf;
+}
+
+HistoryIndex HistoryLength(uint64_t leaves)
+{
+    // Each leaf after the first adds the parents it completes, as a binary
+    // counter carries.
+    uint32_t ones = 0;
+    for (uint64_t n = leaves; n != 0; n &= n - 1) ++ones;
+    return leaves * 2 - ones;
+}
+
+bool ChainHistory::Load(const HistoryState& state, HistoryNodeReader read_node, bool enabled)
+{
+    m_read_node = std::move(read_node);
+    m_enabled = enabled;
+    m_state = state;
+    m_nodes.clear();
+    m_written_length = m_dirty_from = Length();
+    if (!m_enabled) return true;
+
+    for (HistoryIndex peak : Peaks()) {
+        if (!m_read_node(peak, m_nodes[peak])) return false;
+    }
+    return true;
+}
+
+uint256 ChainHistory::TipHash() const
+{
+    uint256 hash;
+    HistoryNode leaf;
+    if (m_state.leaves > 0 && GetNode(HistoryLength(m_state.leaves - 1), leaf)) {
+        std::copy(leaf.begin(), leaf.begin() + hash.size(), hash.begin());
+    }
+    return hash;
+}
+
+std::vector<HistoryIndex> ChainHistory::Peaks() const
+{
+    std::vector<HistoryIndex> peaks;
+    for (const auto& peak : PeaksOf(Length())) peaks.push_back(peak.first);
+    return peaks;
+}
+
+bool ChainHistory::GetNode(HistoryIndex index, HistoryNode& node) const
+{
+    if (index >= Length()) return false;
+    auto it = m_nodes.find(index);
+    if (it != m_nodes.end()) {
+        node = it->second;
+        return true;
+    }
+    // Nodes from m_dirty_from on are all in memory.
+    return m_read_node && m_read_node(index, node);
+}
+
+bool ChainHistory::LoadEntries(std::vector<uint32_t>& indices, std::vector<HistoryEntry>& entries, bool slope)
+{
+    const std::vector<std::pair<HistoryIndex, uint32_t>> peaks = PeaksOf(Length());
+    auto add = [&](HistoryIndex pos, uint32_t alt) {
+        auto it = m_nodes.find(pos);
+        if (it == m_nodes.end()) {
+            HistoryNode node;
+            if (!GetNode(pos, node)) return false;
+            it = m_nodes.emplace(pos, node).first;
+        }
+        indices.push_back(pos);
+        entries.push_back(ToEntry(it->second, pos, alt));
+        return true;
+    };
+    for (const auto& peak : peaks) {
+        if (!add(peak.first, peak.second)) return false;
+    }
+    if (slope) {
+        // Removing a leaf splits the last peak up into the peaks below it
+        // on its right slope, so librustzcash needs both children of each
+        // node on it.
+        HistoryIndex pos = peaks.back().first;
+        uint32_t alt = peaks.back().second;
+        while (alt != 0) {
+            const HistoryIndex left = pos - (HistoryIndex{1} << alt);
+            const HistoryIndex right = pos - 1;
+            --alt;
+            if (!add(left, alt) || !add(right, alt)) return false;
+            pos = right;
+        }
+    }
+    return true;
+}
+
+bool ChainHistory::Push(const HistoryNode& leaf)
+{
+    if (!m_enabled) return true;
+    const HistoryIndex length = Length();
+    if (m_state.leaves == 0) {
+        uint256 root;
+        if (librustzcash_mmr_hash_node(SAPLING_BRANCH_ID, leaf.data(), root.begin()) != 0) return false;
+        m_nodes[0] = leaf;
+        m_state.root = root;
+    } else {
+        std::vector<uint32_t> indices;
+        std::vector<HistoryEntry> entries;
+        if (!LoadEntries(indices, entries, false)) return false;
+        // A leaf completes at most one parent for each peak.
+        std::array<HistoryNode, 33> appended;
+        uint256 root;
+        const uint32_t count = librustzcash_mmr_append(SAPLING_BRANCH_ID, length, indices.data(), entries.data()->data(), entries.size(),
+            leaf.data(), root.begin(), appended.data()->data());
+        if (count == 0 || length + count != HistoryLength(m_state.leaves + 1)) return false;
+        for (uint32_t i = 0; i < count; ++i) {
+            m_nodes[length + i] = appended[i];
+        }
+        m_state.root = root;
+    }
+    ++m_state.leaves;
+    m_dirty_from = std::min(m_dirty_from, length);
+    return true;
+}
+
+bool ChainHistory::Pop()
+{
+    if (!m_enabled) return true;
+    if (m_state.leaves == 0) return false;
+    if (m_state.leaves == 1) {
+        m_state = HistoryState();
+        Shorten(0);
+        return true;
+    }
+    uint256 root;
+    if (m_state.leaves == 2) {
+        // What is left is the first leaf, a tree of one node.
+        HistoryNode first;
+        if (!GetNode(0, first) || librustzcash_mmr_hash_node(SAPLING_BRANCH_ID, first.data(), root.begin()) != 0) return false;
+    } else {
+        std::vector<uint32_t> indices;
+        std::vector<HistoryEntry> entries;
+        if (!LoadEntries(indices, entries, true)) return false;
+        const size_t peak_count = PeaksOf(Length()).size();
+        const uint32_t deleted = librustzcash_mmr_delete(SAPLING_BRANCH_ID, Length(), indices.data(), entries.data()->data(),
+            peak_count, entries.size() - peak_count, root.begin());
+        if (deleted == 0 || Length() - deleted != HistoryLength(m_state.leaves - 1)) return false;
+    }
+    --m_state.leaves;
+    m_state.root = root;
+    Shorten(Length());
+    return true;
+}
+
+bool ChainHistory::Truncate(uint64_t leaves)
+{
+    if (!m_enabled || leaves >= m_state.leaves) return true;
+    if (leaves == 0) {
+        m_state = HistoryState();
+        Shorten(0);
+        return true;
+    }
+    // The nodes of the first leaves + 1 leaves come first; drop the rest
+    // and remove the last of those leaves the usual way, which sets the root.
+    m_state.leaves = leaves + 1;
+    Shorten(Length());
+    return Pop();
+}
+
+void ChainHistory::Rewind(const HistoryState& checkpoint)
+{
+    assert(checkpoint.leaves <= m_state.leaves);
+    m_state = checkpoint;
+    Shorten(Length());
+}
+
+bool ChainHistory::GetChanges(HistoryChanges& changes) const
+{
+    const HistoryIndex length = Length();
+    if (!m_enabled || (m_dirty_from == length && m_written_length == length)) return false;
+    changes.state = m_state;
+    changes.nodes.clear();
+    for (auto it = m_nodes.lower_bound(m_dirty_from); it != m_nodes.end(); ++it) {
+        changes.nodes.emplace_back(it->first, &it->second);
+    }
+    changes.erase_begin = length;
+    changes.erase_end = std::max(length, m_written_length);
+    return true;
+}
+
+void ChainHistory::MarkWritten()
+{
+    m_written_length = m_dirty_from = Length();
+    std::map<HistoryIndex, HistoryNode> peaks;
+    for (HistoryIndex peak : Peaks()) {
+        auto it = m_nodes.find(peak);
+        if (it != m_nodes.end()) peaks.insert(*it);
+    }
+    m_nodes.swap(peaks);
+}
+
+void ChainHistory::Shorten(HistoryIndex length)
+{
+    m_nodes.erase(m_nodes.lower_bound(length), m_nodes.end());
+    m_dirty_from = std::min(m_dirty_from, length);
+}
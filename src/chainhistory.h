@@ -0,0 +1,129 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CHAINHISTORY_H
+#define BITCOIN_CHAINHISTORY_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <array>
+#include <functional>
+#include <map>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+
+/** The size of the data of a ZIP 221 node, zero padded (MAX_NODE_DATA_SIZE of librustzcash) */
+static const size_t HISTORY_NODE_SIZE = 171;
+/** The size of a node with the positions of its children (MAX_ENTRY_SIZE of librustzcash) */
+static const size_t HISTORY_ENTRY_SIZE = 1 + 4 + 4 + HISTORY_NODE_SIZE;
+//! Default for -chainhistory
+static const bool DEFAULT_CHAIN_HISTORY = false;
+
+typedef std::array<unsigned char, HISTORY_NODE_SIZE> HistoryNode;
+typedef std::array<unsigned char, HISTORY_ENTRY_SIZE> HistoryEntry;
+//! The position of a node in the tree, in the order nodes are appended
+typedef uint32_t HistoryIndex;
+//! Reads a node that was written, see CBlockTreeDB::ReadHistoryNode
+typedef std::function<bool(HistoryIndex, HistoryNode&)> HistoryNodeReader;
+
+/** The number of transactions of block with Sapling spends or outputs */
+uint64_t CountSaplingTransactions(const CBlock& block);
+/** The leaf of a connected block, which commits to its hash, time, target, Sapling root and work */
+HistoryNode NewHistoryLeaf(const CBlockIndex& index, uint64_t sapling_tx_count);
+/** The number of nodes of a tree of leaves leaves */
+HistoryIndex HistoryLength(uint64_t leaves);
+
+/** What the block tree database holds about the history tree besides its nodes */
+struct HistoryState {
+    uint64_t leaves{0};
+    uint256 root;
+
+    SERIALIZE_METHODS(HistoryState, obj) { READWRITE(obj.leaves, obj.root); }
+};
+
+/** The changes of the history tree since it was written last, for CBlockTreeDB::WriteBatchSync */
+struct HistoryChanges {
+    HistoryState state;
+    //! Nodes to write, in order
+    std::vector<std::pair<HistoryIndex, const HistoryNode*>> nodes;
+    //! Nodes to erase: those in [erase_begin, erase_end)
+    HistoryIndex erase_begin{0};
+    HistoryIndex erase_end{0};
+};
+
+/**
+ * The ZIP 221 history tree of the active chain: a Merkle mountain range with
+ * a leaf for each block from Sapling activation on, whose root commits to
+ * the chain so far. Light clients can check a block is in the chain against
+ * the root with a path of logarithmic length, see getchainhistory.
+ *
+ * Nodes are only ever appended and removed at the end. Appending a leaf or
+ * removing the last one only touches the peaks and the nodes on the right
+ * slope of the last peak, so nodes are kept in memory until they are written
+ * with the block index, and after that only the peaks are.
+ */
+class ChainHistory
+{
+public:
+    /**
+     * Start from the tree written last, of which state was read, and whose
+     * nodes that are not in memory are read with read_node. A disabled tree
+     * ignores Push and Pop, and has no changes to write.
+     */
+    bool Load(const HistoryState& state, HistoryNodeReader read_node, bool enabled);
+    bool IsEnabled() const { return m_enabled; }
+
+    uint64_t Leaves() const { return m_state.leaves; }
+    HistoryIndex Length() const { return HistoryLength(m_state.leaves); }
+    const uint256& Root() const { return m_state.root; }
+    /** The hash of the block of the last leaf, null if there is none */
+    uint256 TipHash() const;
+    /** The positions of the peaks, from the highest (leftmost) one on */
+    std::vector<HistoryIndex> Peaks() const;
+    bool GetNode(HistoryIndex index, HistoryNode& node) const;
+
+    /** Append the leaf of the block after the one of the last leaf */
+    bool Push(const HistoryNode& leaf);
+    /** Remove the last leaf */
+    bool Pop();
+    /** Remove leaves from the end until leaves are left */
+    bool Truncate(uint64_t leaves);
+
+    /** The state to go back to with Rewind, as long as no leaf is removed or the tree written in between */
+    HistoryState Checkpoint() const { return m_state; }
+    /** Undo the pushes since checkpoint was taken */
+    void Rewind(const HistoryState& checkpoint);
+
+    /** Whether there are changes to write, and what they are. They refer to nodes in memory. */
+    bool GetChanges(HistoryChanges& changes) const;
+    /** Record that the changes were written, and forget the nodes that are not needed any more */
+    void MarkWritten();
+
+private:
+    HistoryNodeReader m_read_node;
+    bool m_enabled{false};
+    HistoryState m_state;
+    //! Nodes not written yet, and those read or kept for the next changes
+    std::map<HistoryIndex, HistoryNode> m_nodes;
+    //! The length of the tree in the database
+    HistoryIndex m_written_length{0};
+    //! Nodes from this position on differ from those in the database
+    HistoryIndex m_dirty_from{0};
+
+    /**
+     * The peaks as librustzcash takes them, followed with the nodes on the
+     * right slope of the last peak if slope is set. Nodes read from the
+     * database are kept in memory, as they are likely needed again.
+     */
+    bool LoadEntries(std::vector<uint32_t>& indices, std::vector<HistoryEntry>& entries, bool slope);
+    //! Drop the nodes from length on, after the tree was shortened to length
+    void Shorten(HistoryIndex length);
+};
+
+#endif // BITCOIN_CHAINHISTORY_H
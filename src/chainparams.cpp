@@ -150,6 +150,8 @@ public:
         base58Prefixes[EXT_SECRET_KEY] = {0x04, 0x88, 0xAD, 0xE4};
 
         bech32_hrp = "ltz";
+        sapling_payment_address_hrp = "zs";
+        bip44_coin_type = 221;
 
         vFixedSeeds = std::vector<SeedSpec6>(pnSeed6_main, pnSeed6_main + ARRAYLEN(pnSeed6_main));
 
@@ -184,6 +186,8 @@ public:
             /* nTxCount */ 95703,
             /* dTxRate  */ 1600,
         };
+
+        m_assumeutxo_data = {};
     }
 };
 
@@ -273,6 +277,8 @@ public:
         base58Prefixes[EXT_SECRET_KEY] = {0x04, 0x35, 0x83, 0x94};
 
         bech32_hrp = "tltz";
+        sapling_payment_address_hrp = "ztestsapling";
+        bip44_coin_type = 1;
 
         vFixedSeeds = std::vector<SeedSpec6>(pnSeed6_test, pnSeed6_test + ARRAYLEN(pnSeed6_test));
 
@@ -294,6 +300,8 @@ public:
             /* nTxCount */ 8492,
             /* dTxRate  */ 0.0001216201489260297,
         };
+
+        m_assumeutxo_data = {};
     }
 };
 
@@ -390,6 +398,8 @@ public:
             0
         };
 
+        m_assumeutxo_data = {};
+
         // guarantees the first 2 characters, when base58 encoded, are "T1"
         base58Prefixes[PUBKEY_ADDRESS] = {0x0E, 0xA4};
         // guarantees the first 2 characters, when base58 encoded, are "T3"
@@ -400,6 +410,8 @@ public:
         base58Prefixes[EXT_SECRET_KEY] = {0x04, 0x35, 0x83, 0x94};
 
         bech32_hrp = "rltz";
+        sapling_payment_address_hrp = "zregsapling";
+        bip44_coin_type = 1;
     }
 
     /**
@@ -442,6 +454,20 @@ void CRegTestParams::UpdateActivationParametersFromArgs(const ArgsManager& args)
         consensus.SaplingHeight = static_cast<int>(height);
     }
 
+    for (const std::string& strSnapshot : args.GetArgs("-assumeutxo")) {
+        std::vector<std::string> vSnapshotParams;
+        boost::split(vSnapshotParams, strSnapshot, boost::is_any_of(":"));
+        int height;
+        int64_t nChainTx;
+        if (vSnapshotParams.size() != 5 || !ParseInt32(vSnapshotParams[0], &height) || height < 0 ||
+            !IsHex(vSnapshotParams[1]) || vSnapshotParams[1].size() != 64 || !IsHex(vSnapshotParams[2]) || vSnapshotParams[2].size() != 64 ||
+            !IsHex(vSnapshotParams[3]) || vSnapshotParams[3].size() != 64 ||
+            !ParseInt64(vSnapshotParams[4], &nChainTx) || nChainTx <= 0 || nChainTx > std::numeric_limits<unsigned int>::max()) {
+            throw std::runtime_error(strprintf("Invalid -assumeutxo (%s), expecting height:blockhash:muhash:shieldedhash:nchaintx", strSnapshot));
+        }
+        m_assumeutxo_data[height] = AssumeutxoData{uint256S(vSnapshotParams[1]), uint256S(vSnapshotParams[2]), uint256S(vSnapshotParams[3]), (unsigned int)nChainTx};
+    }
+
     if (!args.IsArgSet("-vbparams")) return;
 
     for (const std::string& strDeployment : args.GetArgs("-vbparams")) {
@@ -12,6 +12,7 @@
 #include <primitives/block.h>
 #include <protocol.h>
 
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -26,6 +27,23 @@ struct CCheckpointData {
     MapCheckpoints mapCheckpoints;
 };
 
+/**
+ * A UTXO snapshot that loadtxoutset accepts: the block it was taken at, the MuHash3072
+ * of its coins, the hash of its Sapling nullifiers and anchors (see HashShieldedState)
+ * and the number of transactions up to its base.
+ *
+ * See also: CChainParams::Assumeutxo, ActivateSnapshot.
+ */
+struct AssumeutxoData {
+    uint256 blockhash;
+    uint256 muhash;
+    uint256 shielded_hash;
+    unsigned int nChainTx;
+};
+
+//! The snapshots accepted, by the height of their base.
+typedef std::map<int, AssumeutxoData> MapAssumeutxo;
+
 /**
  * Holds various statistics on transactions within a chain. Used to estimate
  * verification progress during chain sync.
@@ -84,9 +102,13 @@ public:
     const std::vector<std::string>& DNSSeeds() const { return vSeeds; }
     const std::vector<unsigned char>& Base58Prefix(Base58Type type) const { return base58Prefixes[type]; }
     const std::string& Bech32HRP() const { return bech32_hrp; }
+    const std::string& SaplingPaymentAddressHRP() const { return sapling_payment_address_hrp; }
+    //! The coin type of ZIP 32 (and BIP 44) derivation paths
+    uint32_t BIP44CoinType() const { return bip44_coin_type; }
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
     const ChainTxData& TxData() const { return chainTxData; }
+    const MapAssumeutxo& Assumeutxo() const { return m_assumeutxo_data; }
 
     unsigned int EquihashSolutionWidth(int height) const;
     uint64_t EquihashForkHeight() const { return consensus.nEquihashForkHeight; };
@@ -102,6 +124,8 @@ protected:
     std::vector<std::string> vSeeds;
     std::vector<unsigned char> base58Prefixes[MAX_BASE58_TYPES];
     std::string bech32_hrp;
+    std::string sapling_payment_address_hrp;
+    uint32_t bip44_coin_type;
     std::string strNetworkID;
     CBlock genesis;
     std::vector<SeedSpec6> vFixedSeeds;
@@ -111,6 +135,7 @@ protected:
     bool m_is_mockable_chain;
     CCheckpointData checkpointData;
     ChainTxData chainTxData;
+    MapAssumeutxo m_assumeutxo_data;
 };
 
 /**
@@ -6,8 +6,12 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <sync.h>
+#include <util/time.h>
 
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,6 +20,33 @@
 template <typename T>
 class CCheckQueueControl;
 
+/**
+ * Run a batch of verifications taken from the queue, stopping at the first
+ * one that fails. Types whose verifications can share work within a batch
+ * provide an overload, which is found when the queue is instantiated.
+ */
+template <typename T>
+bool RunCheckBatch(std::vector<T>& vChecks)
+{
+    for (T& check : vChecks)
+        if (!check())
+            return false;
+    return true;
+}
+
+/** How much a CCheckQueue was used since it was created */
+struct CheckQueueStats {
+    int threads{0};
+    uint64_t checks{0};
+    //! Time the worker threads and the master spent running checks, in microseconds
+    int64_t worker_busy_us{0};
+    int64_t master_busy_us{0};
+};
+
+//! The number of deques a CCheckQueue spreads its checks over, one for each
+//! thread at MAX_SCRIPTCHECK_THREADS plus the master
+static const int CHECKQUEUE_DEQUES = 16;
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,12 +56,31 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * The checks are spread over deques, each owned by a thread (the master
+  * owns the first), so that threads taking work rarely contend for the same
+  * lock. A thread takes batches from the back of its own deque, and when it
+  * is empty steals from the front of the others. Completion is counted with
+  * atomics; the mutex is only taken by threads going idle, and by those
+  * waking them up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! The checks of a thread, those before front already taken by others.
+    //! The storage is kept for the next blocks.
+    struct CheckDeque {
+        std::mutex mutex;
+        std::vector<T> checks;
+        size_t front{0};
+        //! The number of checks left, to skip empty deques without locking them
+        std::atomic<unsigned int> size{0};
+    };
+
+    CheckDeque deques[CHECKQUEUE_DEQUES];
+
+    //! Mutex for idle threads to wait with
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,86 +89,118 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker threads started; worker i owns deque i % CHECKQUEUE_DEQUES.
+    std::atomic<int> nThreads{0};
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of workers that are idle, or about to be.
+    std::atomic<int> nIdle{0};
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! The number of verifications in the deques.
+    std::atomic<unsigned int> nQueued{0};
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo{0};
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk{true};
+
+    //! The deque the next checks are added to, only used by the master
+    int nNextDeque{0};
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! For GetStats(), counted as batches complete
+    std::atomic<uint64_t> m_checks_run{0};
+    std::atomic<int64_t> m_worker_busy_us{0};
+    std::atomic<int64_t> m_master_busy_us{0};
+
+    /**
+     * Move a batch of checks into vChecks, from deque own if it has any, else
+     * from the first other one that does. Returns false if all were empty.
+     */
+    bool Take(int own, std::vector<T>& vChecks)
+    {
+        for (int i = 0; i < CHECKQUEUE_DEQUES; ++i) {
+            CheckDeque& deque = deques[(own + i) % CHECKQUEUE_DEQUES];
+            if (deque.size.load(std::memory_order_relaxed) == 0) continue;
+            std::lock_guard<std::mutex> lock(deque.mutex);
+            const size_t nLeft = deque.checks.size() - deque.front;
+            if (nLeft == 0) continue;
+            // Take half of what is left, so that the threads that help out
+            // find some of it and all of them finish at about the same time.
+            const unsigned int nNow = std::max<size_t>(1, std::min<size_t>(nBatchSize, (nLeft + 1) / 2));
+            vChecks.resize(nNow);
+            for (unsigned int j = 0; j < nNow; ++j) {
+                // Swap jobs out of the deque instead of copying.
+                if (i == 0) {
+                    vChecks[j].swap(deque.checks.back());
+                    deque.checks.pop_back();
+                } else {
+                    vChecks[j].swap(deque.checks[deque.front++]);
+                }
+            }
+            if (deque.front == deque.checks.size()) {
+                deque.checks.clear();
+                deque.front = 0;
+            }
+            deque.size.store(deque.checks.size() - deque.front, std::memory_order_relaxed);
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        const int own = fMaster ? 0 : ++nThreads % CHECKQUEUE_DEQUES;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            if (Take(own, vChecks)) {
+                const unsigned int nNow = vChecks.size();
+                // Check whether we need to do work at all
+                bool fOk = fAllOk;
+                if (fOk) {
+                    const int64_t nStart = GetTimeMicros();
+                    fOk = RunCheckBatch(vChecks);
+                    (fMaster ? m_master_busy_us : m_worker_busy_us) += GetTimeMicros() - nStart;
+                    m_checks_run += nNow;
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+                vChecks.clear();
+                if (!fOk)
+                    fAllOk = false;
+                if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                while (nQueued == 0 && nTodo != 0)
+                    condMaster.wait(lock);
+                if (nTodo == 0) {
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+            } else {
+                // Add checks nIdle after adding to nQueued, and we check
+                // nQueued after adding to nIdle, so one of us sees the other.
+                nIdle++;
+                while (nQueued == 0)
+                    condWorker.wait(lock); // wait
+                nIdle--;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
@@ -127,7 +209,7 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -144,16 +226,44 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty()) return;
+        // Count the checks before any thread can complete them.
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        // Spread them over the deques of the threads there are, in runs of
+        // at least a batch so small additions touch a single deque.
+        const size_t nDeques = std::min<size_t>(CHECKQUEUE_DEQUES, nThreads + 1);
+        const size_t nParts = std::max<size_t>(1, std::min<size_t>(nDeques, vChecks.size() / nBatchSize));
+        auto it = vChecks.begin();
+        for (size_t part = 0; part < nParts; ++part) {
+            CheckDeque& deque = deques[nNextDeque];
+            nNextDeque = (nNextDeque + 1) % nDeques;
+            const auto end = it + (vChecks.end() - it) / (nParts - part);
+            std::lock_guard<std::mutex> lock(deque.mutex);
+            for (; it != end; ++it) {
+                deque.checks.emplace_back();
+                it->swap(deque.checks.back());
+            }
+            deque.size.store(deque.checks.size() - deque.front, std::memory_order_relaxed);
+        }
+        nQueued += vChecks.size();
+        // Wake a worker for each batch there is to take, as they would only
+        // steal smaller ones from each other otherwise.
+        int nWake = std::min<size_t>(nIdle, (vChecks.size() + nBatchSize - 1) / nBatchSize);
+        if (nWake > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (nWake-- > 0)
+                condWorker.notify_one();
+        }
+    }
+
+    CheckQueueStats GetStats() const
+    {
+        CheckQueueStats stats;
+        stats.threads = nThreads;
+        stats.checks = m_checks_run;
+        stats.worker_busy_us = m_worker_busy_us;
+        stats.master_busy_us = m_master_busy_us;
+        return stats;
     }
 
     ~CCheckQueue()
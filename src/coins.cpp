@@ -10,10 +10,12 @@
 #include <version.h>
 
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
-bool CCoinsView::GetNote(const uint256 &nullifier, Note &note) const { return false; }
+bool CCoinsView::GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const { return false; }
+bool CCoinsView::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
+uint256 CCoinsView::GetBestAnchor() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, CNullifiersMap &mapSaplingNullifiers, CAnchorsSaplingMap &mapSaplingAnchors, const uint256 &hashSaplingAnchor, bool erase) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
 
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
@@ -22,44 +24,126 @@ bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
     return GetCoin(outpoint, coin);
 }
 
-bool CCoinsView::HaveNote(const uint256 &nullifier) const
+bool CCoinsView::HaveNullifier(const uint256 &nullifier) const
 {
-    Note note;
-    return GetNote(nullifier, note);
+    uint32_t nHeight;
+    return GetNullifier(nullifier, nHeight);
 }
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 bool CCoinsViewBacked::GetCoin(const COutPoint &outpoint, Coin &coin) const { return base->GetCoin(outpoint, coin); }
-bool CCoinsViewBacked::GetNote(const uint256 &nullifier, Note &note) const { return base->GetNote(nullifier, note); }
+bool CCoinsViewBacked::GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const { return base->GetNullifier(nullifier, nHeight); }
 bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->HaveCoin(outpoint); }
-bool CCoinsViewBacked::HaveNote(const uint256 &nullifier) const { return base->HaveNote(nullifier); }
+bool CCoinsViewBacked::HaveNullifier(const uint256 &nullifier) const { return base->HaveNullifier(nullifier); }
+bool CCoinsViewBacked::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const { return base->GetSaplingAnchorAt(rt, tree); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
+uint256 CCoinsViewBacked::GetBestAnchor() const { return base->GetBestAnchor(); }
 std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, CNullifiersMap &mapSaplingNullifiers, CAnchorsSaplingMap &mapSaplingAnchors, const uint256 &hashSaplingAnchor, bool erase) { return base->BatchWrite(mapCoins, hashBlock, mapSaplingNullifiers, mapSaplingAnchors, hashSaplingAnchor, erase); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 SaltedNullifierHasher::SaltedNullifierHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), cachedNotesUsage(0) {}
+size_t CNullifiersMap::Position(const uint256& nullifier) const {
+    if (m_slots.empty()) return 0;
+    for (size_t i = Home(nullifier); m_used[i]; i = (i + 1) & (m_slots.size() - 1)) {
+        if (m_slots[i].first == nullifier) return i;
+    }
+    return m_slots.size();
+}
+
+CNullifiersCacheEntry* CNullifiersMap::find(const uint256& nullifier) {
+    size_t i = Position(nullifier);
+    return i < m_slots.size() ? &m_slots[i].second : nullptr;
+}
+
+const CNullifiersCacheEntry* CNullifiersMap::find(const uint256& nullifier) const {
+    size_t i = Position(nullifier);
+    return i < m_slots.size() ? &m_slots[i].second : nullptr;
+}
+
+std::pair<CNullifiersCacheEntry*, bool> CNullifiersMap::emplace(const uint256& nullifier) {
+    // Keep the table at most 3/4 full, so that probe sequences stay short.
+    if ((m_size + 1) * 4 > m_slots.size() * 3) {
+        Rehash(std::max<size_t>(16, m_slots.size() * 2));
+    }
+    size_t i = Home(nullifier);
+    for (; m_used[i]; i = (i + 1) & (m_slots.size() - 1)) {
+        if (m_slots[i].first == nullifier) return std::make_pair(&m_slots[i].second, false);
+    }
+    m_slots[i] = value_type(nullifier, CNullifiersCacheEntry());
+    m_used[i] = true;
+    m_size++;
+    return std::make_pair(&m_slots[i].second, true);
+}
+
+void CNullifiersMap::erase(const uint256& nullifier) {
+    size_t hole = Position(nullifier);
+    if (hole >= m_slots.size()) return;
+    const size_t mask = m_slots.size() - 1;
+    m_used[hole] = false;
+    m_size--;
+    // Move back the entries after the hole that would no longer be found
+    // from their home slot, so that no tombstones are needed.
+    for (size_t i = (hole + 1) & mask; m_used[i]; i = (i + 1) & mask) {
+        const size_t home = Home(m_slots[i].first);
+        const bool reachable = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (reachable) continue;
+        m_slots[hole] = m_slots[i];
+        m_used[hole] = true;
+        m_used[i] = false;
+        hole = i;
+    }
+}
+
+void CNullifiersMap::clear() {
+    std::vector<value_type>().swap(m_slots);
+    std::vector<bool>().swap(m_used);
+    m_size = 0;
+}
+
+size_t CNullifiersMap::DynamicMemoryUsage() const {
+    return memusage::DynamicUsage(m_slots) + memusage::MallocUsage((m_used.capacity() + 7) / 8);
+}
+
+void CNullifiersMap::Rehash(size_t capacity) {
+    std::vector<value_type> slots(capacity);
+    std::vector<bool> used(capacity, false);
+    slots.swap(m_slots);
+    used.swap(m_used);
+    for (size_t j = 0; j < slots.size(); j++) {
+        if (!used[j]) continue;
+        size_t i = Home(slots[j].first);
+        while (m_used[i]) i = (i + 1) & (capacity - 1);
+        m_slots[i] = slots[j];
+        m_used[i] = true;
+    }
+}
+
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), cachedSaplingAnchorsUsage(0), m_access_epoch(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) +
-           memusage::DynamicUsage(cacheNotes) +
+           cacheSaplingNullifiers.DynamicMemoryUsage() +
+           memusage::DynamicUsage(cacheSaplingAnchors) +
            cachedCoinsUsage +
-           cachedNotesUsage;
+           cachedSaplingAnchorsUsage;
 }
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.last_access = m_access_epoch;
         return it;
+    }
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(tmp))).first;
+    ret->second.last_access = m_access_epoch;
     if (ret->second.coin.IsSpent()) {
         // The parent only has an empty entry for this outpoint; we can consider our
         // version as fresh.
@@ -69,20 +153,30 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
     return ret;
 }
 
-CNotesMap::iterator CCoinsViewCache::FetchNote(const uint256 &nullifier) const {
-    CNotesMap::iterator it = cacheNotes.find(nullifier);
-    if (it != cacheNotes.end())
+CNullifiersCacheEntry* CCoinsViewCache::FetchNullifier(const uint256 &nullifier) const {
+    CNullifiersCacheEntry* entry = cacheSaplingNullifiers.find(nullifier);
+    if (entry)
+        return entry;
+    uint32_t nHeight;
+    if (!base->GetNullifier(nullifier, nHeight))
+        return nullptr;
+    entry = cacheSaplingNullifiers.emplace(nullifier).first;
+    entry->entered = true;
+    entry->nHeight = nHeight;
+    return entry;
+}
+
+CAnchorsSaplingMap::iterator CCoinsViewCache::FetchSaplingAnchor(const uint256 &rt) const {
+    CAnchorsSaplingMap::iterator it = cacheSaplingAnchors.find(rt);
+    if (it != cacheSaplingAnchors.end())
         return it;
-    Note tmp;
-    if (!base->GetNote(nullifier, tmp))
-        return cacheNotes.end();
-    CNotesMap::iterator ret = cacheNotes.emplace(std::piecewise_construct, std::forward_as_tuple(nullifier), std::forward_as_tuple(std::move(tmp))).first;
-    if (ret->second.note.IsNoteSpent()) {
-        // The parent only has an empty entry for this outpoint; we can consider our
-        // version as fresh.
-        ret->second.flags = CNotesCacheEntry::FRESH;
-    }
-    cachedNotesUsage += ret->second.note.DynamicMemoryUsage();
+    SaplingMerkleTree tree;
+    if (!base->GetSaplingAnchorAt(rt, tree))
+        return cacheSaplingAnchors.end();
+    CAnchorsSaplingMap::iterator ret = cacheSaplingAnchors.emplace(rt, CAnchorsSaplingCacheEntry()).first;
+    ret->second.entered = true;
+    ret->second.tree = tree;
+    cachedSaplingAnchorsUsage += ret->second.tree.DynamicMemoryUsage();
     return ret;
 }
 
@@ -95,15 +189,28 @@ bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return false;
 }
 
-bool CCoinsViewCache::GetNote(const uint256 &nullifier, Note &note) const {
-    CNotesMap::const_iterator it = FetchNote(nullifier);
-    if (it != cacheNotes.end()) {
-        note = it->second.note;
-        return !note.IsNoteSpent();
+bool CCoinsViewCache::GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const {
+    const CNullifiersCacheEntry* entry = FetchNullifier(nullifier);
+    if (entry && entry->entered) {
+        nHeight = entry->nHeight;
+        return true;
     }
     return false;
 }
 
+bool CCoinsViewCache::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const {
+    if (rt == SaplingMerkleTree::empty_root()) {
+        tree = SaplingMerkleTree();
+        return true;
+    }
+    CAnchorsSaplingMap::const_iterator it = FetchSaplingAnchor(rt);
+    if (it == cacheSaplingAnchors.end() || !it->second.entered) {
+        return false;
+    }
+    tree = it->second.tree;
+    return true;
+}
+
 void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possible_overwrite) {
     assert(!coin.IsSpent());
     if (coin.out.scriptPubKey.IsUnspendable()) return;
@@ -122,27 +229,31 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
     }
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    it->second.last_access = m_access_epoch;
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
-void CCoinsViewCache::AddNote(const uint256 &nullifier, Note&& note, bool possible_overwrite) {
-    assert(!note.IsNoteSpent());
-    CNotesMap::iterator it;
-    bool inserted;
-    std::tie(it, inserted) = cacheNotes.emplace(std::piecewise_construct, std::forward_as_tuple(nullifier), std::tuple<>());
-    bool fresh = false;
-    if (!inserted) {
-        cachedNotesUsage -= it->second.note.DynamicMemoryUsage();
+void CCoinsViewCache::AddNullifier(const uint256 &nullifier, uint32_t nHeight) {
+    CNullifiersCacheEntry* entry = FetchNullifier(nullifier);
+    if (!entry) {
+        entry = cacheSaplingNullifiers.emplace(nullifier).first;
+        entry->flags = CNullifiersCacheEntry::FRESH;
     }
-    if (!possible_overwrite) {
-        if (!it->second.note.IsNoteSpent()) {
-            throw std::logic_error("Adding new note that replaces non-pruned entry");
-        }
-        fresh = !(it->second.flags & CNotesCacheEntry::DIRTY);
+    entry->entered = true;
+    entry->nHeight = nHeight;
+    entry->flags |= CNullifiersCacheEntry::DIRTY;
+}
+
+bool CCoinsViewCache::RemoveNullifier(const uint256 &nullifier) {
+    CNullifiersCacheEntry* entry = FetchNullifier(nullifier);
+    if (!entry || !entry->entered) return false;
+    if (entry->flags & CNullifiersCacheEntry::FRESH) {
+        cacheSaplingNullifiers.erase(nullifier);
+    } else {
+        entry->entered = false;
+        entry->flags |= CNullifiersCacheEntry::DIRTY;
     }
-    it->second.note = std::move(note);
-    it->second.flags |= CNotesCacheEntry::DIRTY | (fresh ? CNotesCacheEntry::FRESH : 0);
-    cachedNotesUsage += it->second.note.DynamicMemoryUsage();
+    return true;
 }
 
 void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool check) {
@@ -156,14 +267,13 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool
     }
 }
 
-void AddNotes(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool check) {
-    bool fCoinbase = tx.IsCoinBase();
-    const uint256& txid = tx.GetHash();
-    for (size_t i = 0; i < tx.vShieldedOutput.size(); ++i) {
-        bool overwrite = check ? cache.HaveNote(txid) : fCoinbase;
-        // Always set the possible_overwrite flag to AddCoin for coinbase txn, in order to correctly
-        // deal with the pre-BIP30 occurrences of duplicate coinbase transactions.
-        cache.AddNote(txid, Note(tx.vShieldedOutput[i], nHeight), overwrite);
+void UpdateNullifiers(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool spent) {
+    for (const SpendDescription& spend : tx.vShieldedSpend) {
+        if (spent) {
+            cache.AddNullifier(spend.nullifier, nHeight);
+        } else {
+            cache.RemoveNullifier(spend.nullifier);
+        }
     }
 }
 
@@ -183,24 +293,7 @@ bool CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout) {
     return true;
 }
 
-bool CCoinsViewCache::SpendNote(const uint256 &nullifier, Note* moveout) {
-    CNotesMap::iterator it = FetchNote(nullifier);
-    if (it == cacheNotes.end()) return false;
-    cachedNotesUsage -= it->second.note.DynamicMemoryUsage();
-    if (moveout) {
-        *moveout = std::move(it->second.note);
-    }
-    if (it->second.flags & CNotesCacheEntry::FRESH) {
-        cacheNotes.erase(it);
-    } else {
-        it->second.flags |= CNotesCacheEntry::DIRTY;
-        it->second.note.Clear();
-    }
-    return true;
-}
-
 static const Coin coinEmpty;
-static const Note noteEmpty;
 
 const Coin& CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
@@ -211,23 +304,31 @@ const Coin& CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const {
     }
 }
 
-const Note& CCoinsViewCache::AccessNote(const uint256 &nullifier) const {
-    CNotesMap::const_iterator it = FetchNote(nullifier);
-    if (it == cacheNotes.end()) {
-        return noteEmpty;
-    } else {
-        return it->second.note;
-    }
-}
-
 bool CCoinsViewCache::HaveCoin(const COutPoint &outpoint) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     return (it != cacheCoins.end() && !it->second.coin.IsSpent());
 }
 
-bool CCoinsViewCache::HaveNote(const uint256 &nullifier) const {
-    CNotesMap::const_iterator it = FetchNote(nullifier);
-    return (it != cacheNotes.end() && !it->second.note.IsNoteSpent());
+bool CCoinsViewCache::HaveNullifier(const uint256 &nullifier) const {
+    const CNullifiersCacheEntry* entry = FetchNullifier(nullifier);
+    return entry && entry->entered;
+}
+
+void CCoinsViewCache::AddFetchedCoin(const COutPoint& outpoint, Coin&& coin) {
+    auto inserted = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+    if (!inserted.second) return;
+    if (inserted.first->second.coin.IsSpent()) {
+        inserted.first->second.flags = CCoinsCacheEntry::FRESH;
+    }
+    inserted.first->second.last_access = m_access_epoch;
+    cachedCoinsUsage += inserted.first->second.coin.DynamicMemoryUsage();
+}
+
+void CCoinsViewCache::AddFetchedNullifier(const uint256 &nullifier, uint32_t nHeight) {
+    auto inserted = cacheSaplingNullifiers.emplace(nullifier);
+    if (!inserted.second) return;
+    inserted.first->entered = true;
+    inserted.first->nHeight = nHeight;
 }
 
 bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
@@ -235,23 +336,65 @@ bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     return (it != cacheCoins.end() && !it->second.coin.IsSpent());
 }
 
-bool CCoinsViewCache::HaveNoteInCache(const uint256 &nullifier) const {
-    CNotesMap::const_iterator it = cacheNotes.find(nullifier);
-    return (it != cacheNotes.end() && !it->second.note.IsNoteSpent());
-}
-
 uint256 CCoinsViewCache::GetBestBlock() const {
     if (hashBlock.IsNull())
         hashBlock = base->GetBestBlock();
     return hashBlock;
 }
 
+uint256 CCoinsViewCache::GetBestAnchor() const {
+    if (hashSaplingAnchor.IsNull())
+        hashSaplingAnchor = base->GetBestAnchor();
+    return hashSaplingAnchor;
+}
+
 void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn) {
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
+void CCoinsViewCache::PushSaplingAnchor(const SaplingMerkleTree &tree) {
+    const uint256 newrt = tree.root();
+    // Blocks without Sapling outputs keep the tree of their parent; there is
+    // nothing to record, and popping must not remove the shared entry.
+    if (GetBestAnchor() == newrt) return;
+    hashSaplingAnchor = newrt;
+    // The empty tree is known to every view and needs no entry.
+    if (newrt == SaplingMerkleTree::empty_root()) return;
+
+    CAnchorsSaplingMap::iterator it = FetchSaplingAnchor(newrt);
+    if (it == cacheSaplingAnchors.end()) {
+        it = cacheSaplingAnchors.emplace(newrt, CAnchorsSaplingCacheEntry()).first;
+        it->second.flags = CAnchorsSaplingCacheEntry::FRESH;
+    } else {
+        cachedSaplingAnchorsUsage -= it->second.tree.DynamicMemoryUsage();
+    }
+    it->second.entered = true;
+    it->second.tree = tree;
+    it->second.flags |= CAnchorsSaplingCacheEntry::DIRTY;
+    cachedSaplingAnchorsUsage += it->second.tree.DynamicMemoryUsage();
+}
+
+void CCoinsViewCache::PopSaplingAnchor(const uint256 &newrt) {
+    const uint256 currentRoot = GetBestAnchor();
+    // See PushSaplingAnchor: the disconnected block did not change the tree.
+    if (currentRoot == newrt) return;
+
+    CAnchorsSaplingMap::iterator it = FetchSaplingAnchor(currentRoot);
+    if (it != cacheSaplingAnchors.end()) {
+        if (it->second.flags & CAnchorsSaplingCacheEntry::FRESH) {
+            cachedSaplingAnchorsUsage -= it->second.tree.DynamicMemoryUsage();
+            cacheSaplingAnchors.erase(it);
+        } else {
+            it->second.entered = false;
+            it->second.flags |= CAnchorsSaplingCacheEntry::DIRTY;
+        }
+    }
+    hashSaplingAnchor = newrt;
+}
+
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn, CNullifiersMap &mapSaplingNullifiers, CAnchorsSaplingMap &mapSaplingAnchors, const uint256 &hashSaplingAnchorIn, bool erase) {
+    m_access_epoch++;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
         // Ignore non-dirty entries (optimization).
         if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
             continue;
@@ -264,9 +407,14 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 // Otherwise we will need to create it in the parent
                 // and move the data up and mark it as dirty
                 CCoinsCacheEntry& entry = cacheCoins[it->first];
-                entry.coin = std::move(it->second.coin);
+                if (erase) {
+                    entry.coin = std::move(it->second.coin);
+                } else {
+                    entry.coin = it->second.coin;
+                }
                 cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                 entry.flags = CCoinsCacheEntry::DIRTY;
+                entry.last_access = m_access_epoch;
                 // We can mark it FRESH in the parent if it was FRESH in the child
                 // Otherwise it might have just been flushed from the parent's cache
                 // and already exist in the grandparent
@@ -293,9 +441,14 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
             } else {
                 // A normal modification.
                 cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
-                itUs->second.coin = std::move(it->second.coin);
+                if (erase) {
+                    itUs->second.coin = std::move(it->second.coin);
+                } else {
+                    itUs->second.coin = it->second.coin;
+                }
                 cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                 itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                itUs->second.last_access = m_access_epoch;
                 // NOTE: It is possible the child has a FRESH flag here in
                 // the event the entry we found in the parent is pruned. But
                 // we must not copy that FRESH flag to the parent as that
@@ -304,16 +457,134 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
             }
         }
     }
+    for (const CNullifiersMap::value_type& child : mapSaplingNullifiers) {
+        // Ignore non-dirty entries (optimization).
+        if (!(child.second.flags & CNullifiersCacheEntry::DIRTY)) {
+            continue;
+        }
+        CNullifiersCacheEntry* entry = cacheSaplingNullifiers.find(child.first);
+        if (!entry) {
+            // We can ignore it if it's both FRESH and removed in the child
+            if (!(child.second.flags & CNullifiersCacheEntry::FRESH && !child.second.entered)) {
+                entry = cacheSaplingNullifiers.emplace(child.first).first;
+                entry->entered = child.second.entered;
+                entry->nHeight = child.second.nHeight;
+                entry->flags = CNullifiersCacheEntry::DIRTY | (child.second.flags & CNullifiersCacheEntry::FRESH);
+            }
+        } else if ((entry->flags & CNullifiersCacheEntry::FRESH) && !child.second.entered) {
+            // The grandparent does not have the nullifier and the child
+            // removed it again, so the parent can just forget about it.
+            cacheSaplingNullifiers.erase(child.first);
+        } else {
+            entry->entered = child.second.entered;
+            entry->nHeight = child.second.nHeight;
+            entry->flags |= CNullifiersCacheEntry::DIRTY;
+        }
+    }
+    if (erase) mapSaplingNullifiers.clear();
+    for (CAnchorsSaplingMap::iterator it = mapSaplingAnchors.begin(); it != mapSaplingAnchors.end(); it = erase ? mapSaplingAnchors.erase(it) : std::next(it)) {
+        // Ignore non-dirty entries (optimization).
+        if (!(it->second.flags & CAnchorsSaplingCacheEntry::DIRTY)) {
+            continue;
+        }
+        CAnchorsSaplingMap::iterator itUs = cacheSaplingAnchors.find(it->first);
+        if (itUs == cacheSaplingAnchors.end()) {
+            // We can ignore it if it's both FRESH and removed in the child
+            if (!(it->second.flags & CAnchorsSaplingCacheEntry::FRESH && !it->second.entered)) {
+                CAnchorsSaplingCacheEntry& entry = cacheSaplingAnchors[it->first];
+                entry.entered = it->second.entered;
+                entry.tree = it->second.tree;
+                cachedSaplingAnchorsUsage += entry.tree.DynamicMemoryUsage();
+                entry.flags = CAnchorsSaplingCacheEntry::DIRTY;
+                if (it->second.flags & CAnchorsSaplingCacheEntry::FRESH) {
+                    entry.flags |= CAnchorsSaplingCacheEntry::FRESH;
+                }
+            }
+        } else if ((itUs->second.flags & CAnchorsSaplingCacheEntry::FRESH) && !it->second.entered) {
+            // The grandparent does not have the anchor and the child removed
+            // it again, so the parent can just forget about it.
+            cachedSaplingAnchorsUsage -= itUs->second.tree.DynamicMemoryUsage();
+            cacheSaplingAnchors.erase(itUs);
+        } else {
+            cachedSaplingAnchorsUsage -= itUs->second.tree.DynamicMemoryUsage();
+            itUs->second.entered = it->second.entered;
+            itUs->second.tree = it->second.tree;
+            cachedSaplingAnchorsUsage += itUs->second.tree.DynamicMemoryUsage();
+            itUs->second.flags |= CAnchorsSaplingCacheEntry::DIRTY;
+        }
+    }
     hashBlock = hashBlockIn;
+    hashSaplingAnchor = hashSaplingAnchorIn;
     return true;
 }
 
 bool CCoinsViewCache::Flush() {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, cacheSaplingNullifiers, cacheSaplingAnchors, hashSaplingAnchor, true);
     cacheCoins.clear();
-    cacheNotes.clear();
+    cacheSaplingNullifiers.clear();
+    cacheSaplingAnchors.clear();
     cachedCoinsUsage = 0;
-    cachedNotesUsage = 0;
+    cachedSaplingAnchorsUsage = 0;
+    return fOk;
+}
+
+bool CCoinsViewCache::FlushAndEvict(size_t target_usage) {
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, cacheSaplingNullifiers, cacheSaplingAnchors, hashSaplingAnchor, false);
+    // The base has every change now, so the unspent coins can stay as clean
+    // entries. Spent ones, nullifiers and anchors are not worth keeping.
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.coin.IsSpent()) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+        } else {
+            it->second.flags = 0;
+            ++it;
+        }
+    }
+    cacheSaplingNullifiers.clear();
+    cacheSaplingAnchors.clear();
+    cachedSaplingAnchorsUsage = 0;
+    cacheCoins.shrink_to_fit();
+
+    // The map's share of a coin is an average, and the pool only shrinks in
+    // whole arrays, so a pass may not free quite enough; make another then.
+    for (int pass = 0; pass < 4; pass++) {
+        const size_t usage = DynamicMemoryUsage();
+        if (usage <= target_usage || cacheCoins.empty()) break;
+        // Charge every coin its share of the map on top of its own memory,
+        // and add up what could be freed by the age of the last access, with
+        // everything older than the last bucket counted together.
+        static const size_t AGE_BUCKETS = 1024;
+        const size_t entry_usage = memusage::DynamicUsage(cacheCoins) / cacheCoins.size();
+        std::vector<size_t> usage_by_age(AGE_BUCKETS, 0);
+        auto age_of = [this](const CCoinsCacheEntry& entry) {
+            return std::min<size_t>(m_access_epoch - entry.last_access, AGE_BUCKETS - 1);
+        };
+        for (const auto& entry : cacheCoins) {
+            usage_by_age[age_of(entry.second)] += entry_usage + entry.second.coin.DynamicMemoryUsage();
+        }
+        // Evict whole buckets from the oldest one, and from the youngest one
+        // needed only as much as it takes.
+        size_t excess = usage - target_usage;
+        size_t cutoff = AGE_BUCKETS;
+        while (excess > 0 && cutoff > 0) {
+            cutoff--;
+            if (usage_by_age[cutoff] >= excess) break;
+            excess -= usage_by_age[cutoff];
+        }
+        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+            const size_t age = age_of(it->second);
+            if (age > cutoff || (age == cutoff && excess > 0)) {
+                const size_t coin_usage = it->second.coin.DynamicMemoryUsage();
+                if (age == cutoff) excess -= std::min(excess, entry_usage + coin_usage);
+                cachedCoinsUsage -= coin_usage;
+                it = cacheCoins.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        cacheCoins.shrink_to_fit();
+    }
     return fOk;
 }
 
@@ -326,23 +597,10 @@ void CCoinsViewCache::UncacheCoin(const COutPoint& hash)
     }
 }
 
-void CCoinsViewCache::UncacheNote(const uint256& nullifier)
-{
-    CNotesMap::iterator it = cacheNotes.find(nullifier);
-    if (it != cacheNotes.end() && it->second.flags == 0) {
-        cachedNotesUsage -= it->second.note.DynamicMemoryUsage();
-        cacheNotes.erase(it);
-    }
-}
-
 unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
 
-unsigned int CCoinsViewCache::GetNotesCacheSize() const {
-    return cacheNotes.size();
-}
-
 CAmount CCoinsViewCache::GetValueIn(const CTransaction& tx) const
 {
     if (tx.IsCoinBase())
@@ -363,8 +621,12 @@ bool CCoinsViewCache::HaveInputs(const CTransaction& tx) const
                 return false;
             }
         }
-        for (unsigned int i = 0; i < tx.vShieldedSpend.size(); i++) {
-            if (!HaveNote(tx.vShieldedSpend[i].nullifier)) {
+        SaplingMerkleTree tree;
+        for (const SpendDescription& spend : tx.vShieldedSpend) {
+            if (HaveNullifier(spend.nullifier)) {
+                return false;
+            }
+            if (!GetSaplingAnchorAt(spend.anchor, tree)) {
                 return false;
             }
         }
@@ -386,13 +648,6 @@ const Coin& AccessByTxid(const CCoinsViewCache& view, const uint256& txid)
     return coinEmpty;
 }
 
-const Note& AccessByNullifier(const CCoinsViewCache& view, const uint256& nullifier)
-{
-    const Note& alternate = view.AccessNote(nullifier);
-    if (!alternate.IsNoteSpent()) return alternate;
-    return noteEmpty;
-}
-
 bool CCoinsViewErrorCatcher::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     try {
         return CCoinsViewBacked::GetCoin(outpoint, coin);
@@ -409,18 +664,28 @@ bool CCoinsViewErrorCatcher::GetCoin(const COutPoint &outpoint, Coin &coin) cons
     }
 }
 
-bool CCoinsViewErrorCatcher::GetNote(const uint256 &nullifier, Note &note) const {
+bool CCoinsViewErrorCatcher::GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const {
     try {
-        return CCoinsViewBacked::GetNote(nullifier, note);
+        return CCoinsViewBacked::GetNullifier(nullifier, nHeight);
     } catch(const std::runtime_error& e) {
         for (auto f : m_err_callbacks) {
             f();
         }
         LogPrintf("Error reading from database: %s\n", e.what());
-        // Starting the shutdown sequence and returning false to the caller would be
-        // interpreted as 'entry not found' (as opposed to unable to read data), and
-        // could lead to invalid interpretation. Just exit immediately, as we can't
-        // continue anyway, and all writes should be atomic.
+        // See GetCoin above.
+        std::abort();
+    }
+}
+
+bool CCoinsViewErrorCatcher::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const {
+    try {
+        return CCoinsViewBacked::GetSaplingAnchorAt(rt, tree);
+    } catch(const std::runtime_error& e) {
+        for (auto f : m_err_callbacks) {
+            f();
+        }
+        LogPrintf("Error reading from database: %s\n", e.what());
+        // See GetCoin above.
         std::abort();
     }
 }
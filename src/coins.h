@@ -10,9 +10,11 @@
 #include <compressor.h>
 #include <core_memusage.h>
 #include <crypto/siphash.h>
+#include <flatmap.h>
 #include <memusage.h>
 #include <serialize.h>
 #include <uint256.h>
+#include <zcash/IncrementalMerkleTree.hpp>
 
 #include <assert.h>
 #include <stdint.h>
@@ -26,6 +28,10 @@
  * Serialized format:
  * - VARINT((coinbase ? 1 : 0) | (height << 1))
  * - the non-spent CTxOut (via CTxOutCompressor)
+ *
+ * In memory the output is kept as is. The P2PKH, P2SH and P2WPKH scripts fit
+ * into the inline storage of CScript, so unlike on disk, storing them as a
+ * template tag and hash would not make a cached coin any smaller.
  */
 class Coin
 {
@@ -82,54 +88,6 @@ public:
     }
 };
 
-class Note
-{
-public:
-    //! unspent transaction output
-    OutputDescription out;
-
-    //! at which height this containing transaction was included in the active block chain
-    uint32_t nHeight : 31;
-
-    //! construct a Note from a OutputDescription information.
-    Note(OutputDescription&& outIn, int nHeightIn) : out(std::move(outIn)), nHeight(nHeightIn) {}
-    Note(const OutputDescription& outIn, int nHeightIn) : out(outIn), nHeight(nHeightIn) {}
-
-    void Clear() {
-        out.SetNull();
-        nHeight = 0;
-    }
-
-    //! empty constructor
-    Note() : nHeight(0) { }
-
-    template<typename Stream>
-    void Serialize(Stream &s) const {
-        assert(!IsNoteSpent());
-        uint32_t code = nHeight * uint32_t{2};
-        ::Serialize(s, VARINT(code));
-        ::Serialize(s, out);
-    }
-
-    template<typename Stream>
-    void Unserialize(Stream &s) {
-        uint32_t code = 0;
-        ::Unserialize(s, VARINT(code));
-        nHeight = code >> 1;
-        ::Unserialize(s, out);
-    }
-
-    bool IsNoteSpent() const {
-        return out.IsNull();
-    }
-
-    size_t DynamicMemoryUsage() const {
-        return memusage::DynamicUsage(out.cv) +
-               memusage::DynamicUsage(out.cm) +
-               memusage::DynamicUsage(out.ephemeralKey);
-    }
-};
-
 class SaltedOutpointHasher
 {
 private:
@@ -188,6 +146,7 @@ struct CCoinsCacheEntry
 {
     Coin coin; // The actual cached data.
     unsigned char flags;
+    uint32_t last_access; // Access epoch of the owning cache when the entry was last used.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
@@ -199,31 +158,105 @@ struct CCoinsCacheEntry
          */
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
+    CCoinsCacheEntry() : flags(0), last_access(0) {}
+    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0), last_access(0) {}
 };
 
-struct CNotesCacheEntry
+struct CAnchorsSaplingCacheEntry
 {
-    Note note; // The actual cached data.
+    bool entered; // False if the anchor was removed from the view (its block was disconnected).
+    SaplingMerkleTree tree; // The Sapling note commitment tree whose root is the key.
     unsigned char flags;
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
-        FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
-        /* Note that FRESH is a performance optimization with which we can
-         * erase notes that are fully spent if we know we do not need to
-         * flush the changes to the parent cache.  It is always safe to
-         * not mark FRESH if that condition is not guaranteed.
+        FRESH = (1 << 1), // The parent view does not have this entry (or it is not entered).
+        /* As for coins, FRESH lets an anchor that is pushed and popped again
+         * within the same cache be dropped without flushing it to the parent.
          */
     };
 
-    CNotesCacheEntry() : flags(0) {}
-    explicit CNotesCacheEntry(Note&& note_) : note(std::move(note_)), flags(0) {}
+    CAnchorsSaplingCacheEntry() : entered(false), flags(0) {}
+};
+
+typedef flatmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+typedef std::unordered_map<uint256, CAnchorsSaplingCacheEntry, SaltedNullifierHasher> CAnchorsSaplingMap;
+
+struct CNullifiersCacheEntry
+{
+    uint32_t nHeight; // Height of the block that spent the nullifier.
+    bool entered; // False if the nullifier was removed from the view (its block was disconnected).
+    unsigned char flags;
+
+    enum Flags {
+        DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
+        FRESH = (1 << 1), // The parent view does not have this entry (or it is not entered).
+    };
+
+    CNullifiersCacheEntry() : nHeight(0), entered(false), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
-typedef std::unordered_map<uint256, CNotesCacheEntry, SaltedNullifierHasher> CNotesMap;
+/**
+ * The spent Sapling nullifiers held by a CCoinsViewCache. A nullifier is all
+ * a double-spend check needs, so this keeps 40 byte slots inline in a single
+ * open addressing table with linear probing, rather than one allocation per
+ * entry as an unordered_map would.
+ *
+ * Pointers returned by find() and emplace() are invalidated by any insertion
+ * or removal.
+ */
+class CNullifiersMap
+{
+public:
+    typedef std::pair<uint256, CNullifiersCacheEntry> value_type;
+
+    class const_iterator
+    {
+    public:
+        const_iterator(const CNullifiersMap& map, size_t pos) : m_map(map), m_pos(pos) { Skip(); }
+        const value_type& operator*() const { return m_map.m_slots[m_pos]; }
+        const value_type* operator->() const { return &m_map.m_slots[m_pos]; }
+        const_iterator& operator++() { m_pos++; Skip(); return *this; }
+        bool operator!=(const const_iterator& other) const { return m_pos != other.m_pos; }
+
+    private:
+        const CNullifiersMap& m_map;
+        size_t m_pos;
+        void Skip() { while (m_pos < m_map.m_slots.size() && !m_map.m_used[m_pos]) m_pos++; }
+    };
+
+    const_iterator begin() const { return const_iterator(*this, 0); }
+    const_iterator end() const { return const_iterator(*this, m_slots.size()); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    CNullifiersCacheEntry* find(const uint256& nullifier);
+    const CNullifiersCacheEntry* find(const uint256& nullifier) const;
+
+    //! Look up nullifier, inserting an empty entry if it is missing. The bool
+    //! is true if the entry was inserted.
+    std::pair<CNullifiersCacheEntry*, bool> emplace(const uint256& nullifier);
+
+    void erase(const uint256& nullifier);
+
+    //! Remove all entries and release the table.
+    void clear();
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    std::vector<value_type> m_slots;
+    std::vector<bool> m_used;
+    size_t m_size = 0;
+    SaltedNullifierHasher m_hasher;
+
+    //! Slot where a lookup for nullifier starts.
+    size_t Home(const uint256& nullifier) const { return m_hasher(nullifier) & (m_slots.size() - 1); }
+    //! Slot holding nullifier, or m_slots.size() if there is none.
+    size_t Position(const uint256& nullifier) const;
+    void Rehash(size_t capacity);
+};
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -255,30 +288,44 @@ public:
      */
     virtual bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
 
-    /** Retrieve the Note (unspent transaction output) for a given nullifier.
-     *  Returns true only when an unspent note was found, which is returned in note.
-     *  When false is returned, note's value is unspecified.
+    /** Retrieve the height of the block that spent a Sapling nullifier.
+     *  Returns true only when the nullifier has been spent.
+     *  When false is returned, nHeight's value is unspecified.
      */
-    virtual bool GetNote(const uint256 &nullifier, Note &note) const;
+    virtual bool GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const;
 
     //! Just check whether a given outpoint is unspent.
     virtual bool HaveCoin(const COutPoint &outpoint) const;
 
-    //! Just check whether a given note outpoint is unspent.
-    virtual bool HaveNote(const uint256 &nullifier) const;
+    //! Just check whether a given Sapling nullifier has been spent.
+    virtual bool HaveNullifier(const uint256 &nullifier) const;
+
+    //! Retrieve the Sapling note commitment tree whose root is rt, if it is
+    //! the tree at the end of some block of this view's chain.
+    virtual bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const;
 
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
+    //! Retrieve the root of the Sapling note commitment tree at the end of the
+    //! best block, or null if this view has not recorded one.
+    virtual uint256 GetBestAnchor() const;
+
     //! Retrieve the range of blocks that may have been only partially written.
     //! If the database is in a consistent state, the result is the empty vector.
     //! Otherwise, a two-element vector is returned consisting of the new and
     //! the old block hash, in that order.
     virtual std::vector<uint256> GetHeadBlocks() const;
 
-    //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! Do a bulk modification (multiple Coin, Sapling nullifier and Sapling
+    //! anchor changes + BestBlock and BestAnchor change).
+    //! If erase is true, the passed mapCoins, mapSaplingNullifiers and
+    //! mapSaplingAnchors can be modified and emptied; otherwise they are left
+    //! as they are.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                            CNullifiersMap &mapSaplingNullifiers,
+                            CAnchorsSaplingMap &mapSaplingAnchors, const uint256 &hashSaplingAnchor,
+                            bool erase);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -300,13 +347,18 @@ protected:
 public:
     CCoinsViewBacked(CCoinsView *viewIn);
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
-    bool GetNote(const uint256 &nullifier, Note &note) const override;
+    bool GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
-    bool HaveNote(const uint256 &nullifier) const override;
+    bool HaveNullifier(const uint256 &nullifier) const override;
+    bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const override;
     uint256 GetBestBlock() const override;
+    uint256 GetBestAnchor() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    CNullifiersMap &mapSaplingNullifiers,
+                    CAnchorsSaplingMap &mapSaplingAnchors, const uint256 &hashSaplingAnchor,
+                    bool erase) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -321,12 +373,19 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    mutable uint256 hashSaplingAnchor;
     mutable CCoinsMap cacheCoins;
-    mutable CNotesMap cacheNotes;
+    mutable CNullifiersMap cacheSaplingNullifiers;
+    mutable CAnchorsSaplingMap cacheSaplingAnchors;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
-    mutable size_t cachedNotesUsage;
+    mutable size_t cachedSaplingAnchorsUsage;
+
+    /* Advances with every BatchWrite into this cache, i.e. with every block
+     * connected or disconnected on top of it. Coins record it on access, so
+     * that FlushAndEvict can tell cold entries from hot ones. */
+    uint32_t m_access_epoch;
 
 public:
     CCoinsViewCache(CCoinsView *baseIn);
@@ -338,12 +397,17 @@ public:
 
     // Standard CCoinsView methods
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
-    bool GetNote(const uint256 &nullifier, Note &note) const override;
+    bool GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
-    bool HaveNote(const uint256 &nullifier) const override;
+    bool HaveNullifier(const uint256 &nullifier) const override;
+    bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const override;
     uint256 GetBestBlock() const override;
+    uint256 GetBestAnchor() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    CNullifiersMap &mapSaplingNullifiers,
+                    CAnchorsSaplingMap &mapSaplingAnchors, const uint256 &hashSaplingAnchor,
+                    bool erase) override;
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -355,13 +419,6 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
-    /**
-     * Check if we have the given utxo already loaded in this cache.
-     * The semantics are the same as HaveNote(), but no calls to
-     * the backing CCoinsView are made.
-     */
-    bool HaveNoteInCache(const uint256 &nullifier) const;
-
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -375,16 +432,14 @@ public:
     const Coin& AccessCoin(const COutPoint &output) const;
 
     /**
-     * Return a reference to Note in the cache, or a pruned one if not found. This is
-     * more efficient than GetNote.
-     *
-     * Generally, do not hold the reference returned for more than a short scope.
-     * While the current implementation allows for modifications to the contents
-     * of the cache while holding the reference, this behavior should not be relied
-     * on! To be safe, best to not hold the returned reference through any other
-     * calls to this cache.
+     * Cache a coin that was read from the backing view by someone else, e.g.
+     * a prefetch thread, as a lookup through this cache would have. Has no
+     * effect if the outpoint is already cached.
      */
-    const Note& AccessNote(const uint256 &nullifier) const;
+    void AddFetchedCoin(const COutPoint& outpoint, Coin&& coin);
+
+    /** Cache a spent nullifier read from the backing view, like AddFetchedCoin. */
+    void AddFetchedNullifier(const uint256 &nullifier, uint32_t nHeight);
 
     /**
      * Add a coin. Set potential_overwrite to true if a non-pruned version may
@@ -392,12 +447,6 @@ public:
      */
     void AddCoin(const COutPoint& outpoint, Coin&& coin, bool potential_overwrite);
 
-    /**
-     * Add a note. Set potential_overwrite to true if a non-pruned version may
-     * already exist.
-     */
-    void AddNote(const uint256 &nullifier, Note&& note, bool potential_overwrite);
-
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -406,11 +455,30 @@ public:
     bool SpendCoin(const COutPoint &outpoint, Coin* moveto = nullptr);
 
     /**
-     * Spend a note. Pass moveto in order to get the deleted data.
-     * If no unspent output exists for the passed nullifier, this call
-     * has no effect.
+     * Mark a Sapling nullifier as spent by the block at nHeight. Spending it
+     * again only updates the height, as replaying a block may do.
+     */
+    void AddNullifier(const uint256 &nullifier, uint32_t nHeight);
+
+    /**
+     * Unspend a Sapling nullifier when disconnecting the block that spent it.
+     * Returns false if the nullifier was not spent.
+     */
+    bool RemoveNullifier(const uint256 &nullifier);
+
+    /**
+     * Record tree as the Sapling note commitment tree at the end of the best
+     * block and make its root the best anchor. Blocks without Sapling outputs
+     * leave the root unchanged, in which case this is a no-op.
+     */
+    void PushSaplingAnchor(const SaplingMerkleTree &tree);
+
+    /**
+     * Undo the last PushSaplingAnchor when disconnecting a block: remove the
+     * current best anchor from the view and make newrt, the root at the end
+     * of the previous block, the best anchor again.
      */
-    bool SpendNote(const uint256 &nullifier, Note* moveto = nullptr);
+    void PopSaplingAnchor(const uint256 &newrt);
 
     /**
      * Push the modifications applied to this cache to its base.
@@ -420,23 +488,24 @@ public:
     bool Flush();
 
     /**
-     * Removes the UTXO with the given outpoint from the cache, if it is
-     * not modified.
+     * Push the modifications applied to this cache to its base like Flush(),
+     * but keep the unspent coins cached afterwards, as they are now. Then
+     * evict the least recently used of them until DynamicMemoryUsage() is at
+     * most target_usage, so that a cache that had to be written because it
+     * got too large does not start over cold. Invalidates references to
+     * cached coins.
      */
-    void UncacheCoin(const COutPoint &outpoint);
+    bool FlushAndEvict(size_t target_usage);
 
-   /**
-     * Removes the UTXO with the given nullifier from the cache, if it is
+    /**
+     * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
      */
-    void UncacheNote(const uint256 &nullifier);
+    void UncacheCoin(const COutPoint &outpoint);
 
     //! Calculate the size of the cache (in number of transaction outputs)
     unsigned int GetCacheSize() const;
 
-    //! Calculate the size of the note's cache (in number of transaction nullifiers)
-    unsigned int GetNotesCacheSize() const;
-
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
@@ -450,7 +519,8 @@ public:
      */
     CAmount GetValueIn(const CTransaction& tx) const;
 
-    //! Check whether all prevouts of the transaction are present in the UTXO set represented by this view
+    //! Check whether all prevouts of the transaction are present in the UTXO set represented by this view,
+    //! none of its Sapling nullifiers is spent yet and all of its Sapling anchors are known
     bool HaveInputs(const CTransaction& tx) const;
 
 private:
@@ -460,10 +530,15 @@ private:
      */
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
     /**
-     * @note this is marked const, but may actually append to `cacheNotes`, increasing
-     * memory usage.
+     * @note this is marked const, but may actually append to `cacheSaplingNullifiers`,
+     * increasing memory usage. Returns nullptr if no view has the nullifier.
+     */
+    CNullifiersCacheEntry* FetchNullifier(const uint256 &nullifier) const;
+    /**
+     * @note this is marked const, but may actually append to `cacheSaplingAnchors`,
+     * increasing memory usage.
      */
-    CNotesMap::iterator FetchNote(const uint256 &nullifier) const;
+    CAnchorsSaplingMap::iterator FetchSaplingAnchor(const uint256 &rt) const;
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
@@ -474,13 +549,9 @@ private:
 // (pre-BIP34) cases.
 void AddCoins(CCoinsViewCache& cache, const CTransaction& tx, int nHeight, bool check = false);
 
-//! Utility function to add all of a transaction's nullifiers to a cache.
-//! When check is false, this assumes that overwrites are only possible for coinbase transactions.
-//! When check is true, the underlying view may be queried to determine whether an addition is
-//! an overwrite.
-// TODO: pass in a boolean to limit these possible overwrites to known
-// (pre-BIP34) cases.
-void AddNotes(CCoinsViewCache& cache, const CTransaction& tx, int nHeight, bool check = false);
+//! Utility function to mark all of a transaction's Sapling nullifiers as spent
+//! (spent = true) or unspent again (spent = false) in a cache.
+void UpdateNullifiers(CCoinsViewCache& cache, const CTransaction& tx, int nHeight, bool spent);
 
 //! Utility function to find any unspent output with a given txid.
 //! This function can be quite expensive because in the event of a transaction
@@ -488,12 +559,6 @@ void AddNotes(CCoinsViewCache& cache, const CTransaction& tx, int nHeight, bool
 //! lookups to database, so it should be used with care.
 const Coin& AccessByTxid(const CCoinsViewCache& cache, const uint256& txid);
 
-//! Utility function to find any unspent note with a given nullifier.
-//! This function can be quite expensive because in the event of a nullifier
-//! which is not found in the cache, it can cause lookup to database, so it
-//! should be used with care.
-const Note& AccessByNullifier(const CCoinsViewCache& cache, const uint256& nullifier);
-
 /**
  * This is a minimally invasive approach to shutdown on LevelDB read errors from the
  * chainstate, while keeping user interface out of the common library, which is shared
@@ -511,7 +576,8 @@ public:
     }
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
-    bool GetNote(const uint256 &nullifier, Note &note) const override;
+    bool GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const override;
+    bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const override;
 
 private:
     /** A list of callbacks to execute upon leveldb read error. */
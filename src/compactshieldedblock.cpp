@@ -0,0 +1,31 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <compactshieldedblock.h>
+
+#include <algorithm>
+
+CCompactShieldedBlock::CCompactShieldedBlock(const CBlock& block, int height) :
+    nHeight(height), hash(block.GetHash()), hashPrevBlock(block.hashPrevBlock), nTime(block.nTime)
+{
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty()) continue;
+
+        CCompactShieldedTx ctx;
+        ctx.index = i;
+        ctx.hash = tx.GetHash();
+        for (const SpendDescription& spend : tx.vShieldedSpend) {
+            ctx.spends.push_back({spend.nullifier});
+        }
+        for (const OutputDescription& output : tx.vShieldedOutput) {
+            CCompactSaplingOutput coutput;
+            coutput.cmu = output.cm;
+            coutput.epk = output.ephemeralKey;
+            std::copy(output.encCiphertext.begin(), output.encCiphertext.begin() + COMPACT_NOTE_CIPHERTEXT_SIZE, coutput.ciphertext.begin());
+            ctx.outputs.push_back(coutput);
+        }
+        vtx.push_back(std::move(ctx));
+    }
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_COMPACTSHIELDEDBLOCK_H
+#define LITECOINZ_COMPACTSHIELDEDBLOCK_H
+
+#include <primitives/block.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+/** Bytes of the note ciphertext a light client needs to trial-decrypt an output */
+static const size_t COMPACT_NOTE_CIPHERTEXT_SIZE = 52;
+
+/** The nullifier of a Sapling spend */
+struct CCompactSaplingSpend
+{
+    uint256 nullifier;
+
+    SERIALIZE_METHODS(CCompactSaplingSpend, obj) { READWRITE(obj.nullifier); }
+};
+
+/**
+ * A Sapling output without its proof, value commitment and outgoing
+ * ciphertext. The ciphertext is cut after the note plaintext's lead byte,
+ * diversifier, value and rcm, which is all that is needed to detect and
+ * check an incoming note.
+ */
+struct CCompactSaplingOutput
+{
+    uint256 cmu;
+    uint256 epk;
+    std::array<unsigned char, COMPACT_NOTE_CIPHERTEXT_SIZE> ciphertext;
+
+    SERIALIZE_METHODS(CCompactSaplingOutput, obj) { READWRITE(obj.cmu, obj.epk, obj.ciphertext); }
+};
+
+/** The shielded parts of one transaction of a block */
+struct CCompactShieldedTx
+{
+    //! Position of the transaction in its block
+    uint32_t index;
+    uint256 hash;
+    std::vector<CCompactSaplingSpend> spends;
+    std::vector<CCompactSaplingOutput> outputs;
+
+    SERIALIZE_METHODS(CCompactShieldedTx, obj) { READWRITE(VARINT(obj.index), obj.hash, obj.spends, obj.outputs); }
+};
+
+/**
+ * What a light wallet needs of a block to scan it, after ZIP 307: the block
+ * identity and, for every transaction with Sapling spends or outputs, their
+ * nullifiers and compact outputs. Transactions without any are left out.
+ */
+class CCompactShieldedBlock
+{
+public:
+    int32_t nHeight{0};
+    uint256 hash;
+    uint256 hashPrevBlock;
+    uint32_t nTime{0};
+    std::vector<CCompactShieldedTx> vtx;
+
+    CCompactShieldedBlock() {}
+    CCompactShieldedBlock(const CBlock& block, int height);
+
+    SERIALIZE_METHODS(CCompactShieldedBlock, obj) { READWRITE(obj.nHeight, obj.hash, obj.hashPrevBlock, obj.nTime, obj.vtx); }
+};
+
+#endif // LITECOINZ_COMPACTSHIELDEDBLOCK_H
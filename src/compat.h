@@ -95,6 +95,14 @@ typedef char* sockopt_arg_type;
 #define USE_POLL
 #endif
 
+// Event queues that keep sockets registered between waits, see CConnman::SocketEventsFromQueue.
+// CConnman falls back to poll or select when the queue cannot be created.
+#if defined(__linux__)
+#define USE_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__)
+#define USE_KQUEUE
+#endif
+
 bool static inline IsSelectableSocket(const SOCKET& s) {
 #if defined(USE_POLL) || defined(WIN32)
     return true;
@@ -5,6 +5,10 @@
 #include <consensus/merkle.h>
 #include <hash.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 /*     WARNING! If you're reading this because you're learning about crypto
        and/or designing a new system that will use merkle trees, keep in mind
        that the following merkle tree algorithm has a serious flaw related to
@@ -42,21 +46,70 @@
 */
 
 
-uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated) {
+namespace {
+
+/** The number of pairs of hashes a thread takes at a time, a multiple of what SHA256D64 hashes at once */
+static const size_t MERKLE_PAIRS_PER_CHUNK = 256;
+
+/** Replace each of levels, of 2 * pairs hashes, with the level above it */
+void HashLevels(const std::vector<std::vector<uint256>*>& levels, size_t pairs)
+{
+    const size_t total = pairs * levels.size();
+    const size_t threads = std::min<size_t>(std::max(1u, std::min(std::thread::hardware_concurrency(), MAX_MERKLE_THREADS)), total / MERKLE_PAIRS_PER_THREAD + 1);
+    if (threads == 1) {
+        for (std::vector<uint256>* level : levels) {
+            SHA256D64((*level)[0].begin(), (*level)[0].begin(), pairs);
+            level->resize(pairs);
+        }
+        return;
+    }
+
+    // The threads can't hash in place, as one would overwrite what another
+    // has still to read.
+    std::vector<std::vector<uint256>> parents(levels.size(), std::vector<uint256>(pairs));
+    const size_t chunks_per_level = (pairs + MERKLE_PAIRS_PER_CHUNK - 1) / MERKLE_PAIRS_PER_CHUNK;
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t chunk = next++; chunk < chunks_per_level * levels.size(); chunk = next++) {
+            const size_t tree = chunk / chunks_per_level;
+            const size_t begin = (chunk % chunks_per_level) * MERKLE_PAIRS_PER_CHUNK;
+            const size_t end = std::min(pairs, begin + MERKLE_PAIRS_PER_CHUNK);
+            SHA256D64(parents[tree][begin].begin(), (*levels[tree])[2 * begin].begin(), end - begin);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) workers.emplace_back(worker);
+    worker();
+    for (std::thread& thread : workers) thread.join();
+    for (size_t tree = 0; tree < levels.size(); ++tree) levels[tree]->swap(parents[tree]);
+}
+
+/**
+ * Replace the leaves of trees that have as many leaves each with their roots,
+ * hashing the levels of all of them together. *mutated is about the first tree.
+ */
+void ComputeMerkleRoots(const std::vector<std::vector<uint256>*>& trees, bool* mutated)
+{
     bool mutation = false;
-    while (hashes.size() > 1) {
+    std::vector<uint256>& first = *trees[0];
+    while (first.size() > 1) {
         if (mutated) {
-            for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2) {
-                if (hashes[pos] == hashes[pos + 1]) mutation = true;
+            for (size_t pos = 0; pos + 1 < first.size(); pos += 2) {
+                if (first[pos] == first[pos + 1]) mutation = true;
             }
         }
-        if (hashes.size() & 1) {
-            hashes.push_back(hashes.back());
+        if (first.size() & 1) {
+            for (std::vector<uint256>* hashes : trees) hashes->push_back(hashes->back());
         }
-        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
-        hashes.resize(hashes.size() / 2);
+        HashLevels(trees, first.size() / 2);
     }
     if (mutated) *mutated = mutation;
+}
+
+} // namespace
+
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated) {
+    ComputeMerkleRoots({&hashes}, mutated);
     if (hashes.size() == 0) return uint256();
     return hashes[0];
 }
@@ -72,6 +125,24 @@ uint256 BlockMerkleRoot(const CBlock& block, bool* mutated)
     return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
+uint256 BlockMerkleRoots(const CBlock& block, uint256& witness_root, bool* mutated)
+{
+    std::vector<uint256> leaves(block.vtx.size());
+    std::vector<uint256> witness_leaves(block.vtx.size());
+    for (size_t s = 0; s < block.vtx.size(); s++) {
+        leaves[s] = block.vtx[s]->GetHash();
+        // The witness hash of the coinbase is 0.
+        if (s > 0) witness_leaves[s] = block.vtx[s]->GetWitnessHash();
+    }
+    ComputeMerkleRoots({&leaves, &witness_leaves}, mutated);
+    if (leaves.size() == 0) {
+        witness_root.SetNull();
+        return uint256();
+    }
+    witness_root = witness_leaves[0];
+    return leaves[0];
+}
+
 uint256 BlockWitnessMerkleRoot(const CBlock& block, bool* mutated)
 {
     std::vector<uint256> leaves;
@@ -10,6 +10,11 @@
 #include <primitives/block.h>
 #include <uint256.h>
 
+/** Levels of the tree with at least this many pairs of hashes to hash are split across threads */
+static const size_t MERKLE_PAIRS_PER_THREAD = 2048;
+/** Maximum number of threads hashing a level of the tree */
+static const unsigned int MAX_MERKLE_THREADS = 8;
+
 uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated = nullptr);
 
 /*
@@ -18,6 +23,14 @@ uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated = nullptr);
  */
 uint256 BlockMerkleRoot(const CBlock& block, bool* mutated = nullptr);
 
+/*
+ * Compute the Merkle roots of the transactions and of the witness transactions
+ * of a block in one pass over them, hashing the levels of both trees together.
+ * Returns the first and sets witness_root to the second.
+ * *mutated is set to true if a duplicated subtree was found in the first.
+ */
+uint256 BlockMerkleRoots(const CBlock& block, uint256& witness_root, bool* mutated = nullptr);
+
 /*
  * Compute the Merkle root of the witness transactions in a block.
  * *mutated is set to true if a duplicated subtree was found.
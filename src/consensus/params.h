@@ -9,6 +9,12 @@
 #include <uint256.h>
 #include <limits>
 
+#include <stdint.h>
+
+/** Consensus branch IDs (ZIP 200), committed to by the shielded signature hash */
+static constexpr uint32_t SPROUT_BRANCH_ID = 0;
+static constexpr uint32_t SAPLING_BRANCH_ID = 0x76b809bb;
+
 namespace Consensus {
 
 enum DeploymentPos
@@ -61,6 +67,11 @@ struct Params {
     int SegwitHeight;
     /** Block height at which Sapling becomes active. */
     int SaplingHeight;
+    /** The consensus branch ID of the epoch a block at the given height is in */
+    uint32_t BranchId(int height) const
+    {
+        return height >= SaplingHeight ? SAPLING_BRANCH_ID : SPROUT_BRANCH_ID;
+    }
     /** Don't warn about unknown BIP 9 activations below this height.
      * This prevents us from warning about the CSV and segwit activations. */
     int MinBIP9WarningHeight;
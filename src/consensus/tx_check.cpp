@@ -6,6 +6,27 @@
 
 #include <primitives/transaction.h>
 #include <consensus/validation.h>
+#include <prevector.h>
+
+#include <algorithm>
+
+namespace {
+/**
+ * Values to check for duplicates. Up to N of them are kept on the stack, so
+ * that the usual transaction needs no allocation for the check.
+ */
+template <typename T, unsigned int N = 16>
+using DuplicateCheckBuffer = prevector<N, T>;
+
+/** Whether any two of values are equal. Sorts values. */
+template <typename T, unsigned int N>
+bool HasDuplicates(DuplicateCheckBuffer<T, N>& values)
+{
+    if (values.size() < 2) return false;
+    std::sort(values.begin(), values.end());
+    return std::adjacent_find(values.begin(), values.end()) != values.end();
+}
+} // namespace
 
 bool CheckTransaction(const CTransaction& tx, TxValidationState& state)
 {
@@ -97,27 +118,33 @@ bool CheckTransaction(const CTransaction& tx, TxValidationState& state)
     // of a tx as spent, it does not check if the tx has duplicate inputs.
     // Failure to run this check will result in either a crash or an inflation bug, depending on the implementation of
     // the underlying coins database.
-    std::set<COutPoint> vInOutPoints;
+    DuplicateCheckBuffer<COutPoint> vInOutPoints;
+    vInOutPoints.reserve(tx.vin.size());
     for (const auto& txin : tx.vin) {
-        if (!vInOutPoints.insert(txin.prevout).second)
-            return state.Invalid(TxValidationResult::TX_CONSENSUS, "bad-txns-inputs-duplicate");
+        vInOutPoints.push_back(txin.prevout);
     }
+    if (HasDuplicates(vInOutPoints))
+        return state.Invalid(TxValidationResult::TX_CONSENSUS, "bad-txns-inputs-duplicate");
 
     // Check for duplicate joinsplit nullifiers in this transaction
-    std::set<uint256> vInSproutNullifiers;
+    DuplicateCheckBuffer<uint256> vInSproutNullifiers;
+    vInSproutNullifiers.reserve(tx.vJoinSplit.size() * ZC_NUM_JS_INPUTS);
     for (const auto& joinsplit : tx.vJoinSplit) {
         for (const uint256& nf : joinsplit.nullifiers) {
-            if (!vInSproutNullifiers.insert(nf).second)
-                return state.Invalid(TxValidationResult::TX_CONSENSUS, "bad-joinsplits-nullifiers-duplicate");
+            vInSproutNullifiers.push_back(nf);
         }
     }
+    if (HasDuplicates(vInSproutNullifiers))
+        return state.Invalid(TxValidationResult::TX_CONSENSUS, "bad-joinsplits-nullifiers-duplicate");
 
     // Check for duplicate sapling nullifiers in this transaction
-    std::set<uint256> vInSaplingNullifiers;
+    DuplicateCheckBuffer<uint256> vInSaplingNullifiers;
+    vInSaplingNullifiers.reserve(tx.vShieldedSpend.size());
     for (const auto& spend_desc : tx.vShieldedSpend) {
-        if (!vInSaplingNullifiers.insert(spend_desc.nullifier).second)
-            return state.Invalid(TxValidationResult::TX_CONSENSUS, "bad-spend-description-nullifiers-duplicate");
+        vInSaplingNullifiers.push_back(spend_desc.nullifier);
     }
+    if (HasDuplicates(vInSaplingNullifiers))
+        return state.Invalid(TxValidationResult::TX_CONSENSUS, "bad-spend-description-nullifiers-duplicate");
 
     if (tx.IsCoinBase())
     {
@@ -31,6 +31,8 @@ static inline size_t RecursiveDynamicUsage(const CTxOut& out) {
 
 static inline size_t RecursiveDynamicUsage(const CTransaction& tx) {
     size_t mem = memusage::DynamicUsage(tx.vin) + memusage::DynamicUsage(tx.vout);
+    // The shielded descriptions hold no further heap memory
+    mem += memusage::DynamicUsage(tx.vShieldedSpend) + memusage::DynamicUsage(tx.vShieldedOutput) + memusage::DynamicUsage(tx.vJoinSplit);
     for (std::vector<CTxIn>::const_iterator it = tx.vin.begin(); it != tx.vin.end(); it++) {
         mem += RecursiveDynamicUsage(*it);
     }
@@ -42,6 +44,7 @@ static inline size_t RecursiveDynamicUsage(const CTransaction& tx) {
 
 static inline size_t RecursiveDynamicUsage(const CMutableTransaction& tx) {
     size_t mem = memusage::DynamicUsage(tx.vin) + memusage::DynamicUsage(tx.vout);
+    mem += memusage::DynamicUsage(tx.vShieldedSpend) + memusage::DynamicUsage(tx.vShieldedOutput) + memusage::DynamicUsage(tx.vJoinSplit);
     for (std::vector<CTxIn>::const_iterator it = tx.vin.begin(); it != tx.vin.end(); it++) {
         mem += RecursiveDynamicUsage(*it);
     }
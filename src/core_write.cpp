@@ -169,8 +169,8 @@ void ScriptPubKeyToUniv(const CScript& scriptPubKey,
     out.pushKV("type", GetTxnOutputType(type));
 
     UniValue a(UniValue::VARR);
-    for (const CTxDestination& addr : addresses) {
-        a.push_back(EncodeDestination(addr));
+    for (const std::string& addr : EncodeDestinations(addresses)) {
+        a.push_back(addr);
     }
     out.pushKV("addresses", a);
 }
@@ -0,0 +1,244 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/blake2b.h>
+#include <crypto/common.h>
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+#include <compat/cpuid.h>
+
+namespace blake2b_avx2
+{
+void Compress_4way(uint64_t* h, const unsigned char* const* blocks, uint64_t t, bool last);
+}
+
+// Internal implementation code.
+namespace
+{
+/// Internal BLAKE2b implementation.
+namespace blake2b
+{
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull,
+};
+
+const uint8_t SIGMA[12][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+};
+
+uint64_t inline Rotr(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+void inline G(uint64_t* v, int a, int b, int c, int d, uint64_t x, uint64_t y)
+{
+    v[a] = v[a] + v[b] + x;
+    v[d] = Rotr(v[d] ^ v[a], 32);
+    v[c] = v[c] + v[d];
+    v[b] = Rotr(v[b] ^ v[c], 24);
+    v[a] = v[a] + v[b] + y;
+    v[d] = Rotr(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = Rotr(v[b] ^ v[c], 63);
+}
+
+/** Compress one block into h, t being the number of bytes hashed including the block. */
+void Compress(uint64_t* h, const unsigned char* block, uint64_t t, bool last)
+{
+    uint64_t m[16];
+    uint64_t v[16];
+    for (int i = 0; i < 16; ++i) m[i] = ReadLE64(block + 8 * i);
+    for (int i = 0; i < 8; ++i) {
+        v[i] = h[i];
+        v[i + 8] = IV[i];
+    }
+    // Messages are shorter than 2^64 bytes, so the high word of the counter is zero.
+    v[12] ^= t;
+    if (last) v[14] = ~v[14];
+
+    for (int r = 0; r < 12; ++r) {
+        const uint8_t* s = SIGMA[r];
+        G(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+        G(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+        G(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+        G(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+        G(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+        G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        G(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+        G(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; ++i) h[i] ^= v[i] ^ v[i + 8];
+}
+
+} // namespace blake2b
+
+typedef void (*Compress4wayType)(uint64_t*, const unsigned char* const*, uint64_t, bool);
+
+Compress4wayType Compress_4way = nullptr;
+
+/** Fill block with the bytes from 128*k on of the message made of the buffered bytes and then the input, zero padded. */
+void FillBlock(unsigned char* block, const unsigned char* buf, size_t bufsize, const unsigned char* input, size_t len, size_t k)
+{
+    memset(block, 0, 128);
+    size_t pos = 128 * k;
+    size_t filled = 0;
+    if (pos < bufsize) {
+        filled = std::min<size_t>(128, bufsize - pos);
+        memcpy(block, buf + pos, filled);
+        pos += filled;
+    }
+    pos -= bufsize;
+    if (filled < 128 && pos < len) {
+        memcpy(block + filled, input + pos, std::min(128 - filled, len - pos));
+    }
+}
+
+bool SelfTest()
+{
+    // BLAKE2b-512("abc") from RFC 7693
+    static const unsigned char abc_hash[64] = {
+        0xba, 0x80, 0xa5, 0x3f, 0x98, 0x1c, 0x4d, 0x0d, 0x6a, 0x27, 0x97, 0xb6, 0x9f, 0x12, 0xf6, 0xe9,
+        0x4c, 0x21, 0x2f, 0x14, 0x68, 0x5a, 0xc4, 0xb7, 0x4b, 0x12, 0xbb, 0x6f, 0xdb, 0xff, 0xa2, 0xd1,
+        0x7d, 0x87, 0xc5, 0x39, 0x2a, 0xab, 0x79, 0x2d, 0xc2, 0x52, 0xd5, 0xde, 0x45, 0x33, 0xcc, 0x95,
+        0x18, 0xd3, 0x8a, 0xa8, 0xdb, 0xf1, 0x92, 0x5a, 0xb9, 0x23, 0x86, 0xed, 0xd4, 0x00, 0x99, 0x23,
+    };
+    unsigned char out[64];
+    CBLAKE2b().Write((const unsigned char*)"abc", 3).Finalize(out);
+    if (!std::equal(out, out + 64, abc_hash)) return false;
+
+    // The multi-way implementation must agree with the one above, in the shape of Equihash leaf hashes.
+    static const unsigned char personal[CBLAKE2b::PERSONAL_SIZE] = {'Z', 'c', 'a', 's', 'h', 'P', 'o', 'W', 200, 0, 0, 0, 9, 0, 0, 0};
+    unsigned char header[140];
+    for (size_t i = 0; i < sizeof(header); ++i) header[i] = i;
+    CBLAKE2b base(50, personal);
+    base.Write(header, sizeof(header));
+    unsigned char inputs[9 * 4];
+    for (size_t i = 0; i < sizeof(inputs); ++i) inputs[i] = i * 7;
+    unsigned char multi[9 * 50];
+    BLAKE2bMulti(base, inputs, 4, 9, multi);
+    for (size_t i = 0; i < 9; ++i) {
+        CBLAKE2b(base).Write(inputs + 4 * i, 4).Finalize(out);
+        if (!std::equal(out, out + 50, multi + 50 * i)) return false;
+    }
+    return true;
+}
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+} // namespace
+
+CBLAKE2b::CBLAKE2b(size_t outlen_in, const unsigned char* personal) : bytes(0), bufsize(0), outlen(outlen_in)
+{
+    assert(outlen >= 1 && outlen <= MAX_OUTPUT_SIZE);
+    std::copy(blake2b::IV, blake2b::IV + 8, h);
+    // Parameter block: digest length, no key, fanout and depth of 1
+    h[0] ^= 0x01010000 ^ outlen;
+    if (personal) {
+        h[6] ^= ReadLE64(personal);
+        h[7] ^= ReadLE64(personal + 8);
+    }
+}
+
+CBLAKE2b& CBLAKE2b::Write(const unsigned char* data, size_t len)
+{
+    while (len > 0) {
+        if (bufsize == 128) {
+            bytes += 128;
+            blake2b::Compress(h, buf, bytes, false);
+            bufsize = 0;
+        }
+        // Whole blocks that are not the last one are compressed in place.
+        while (bufsize == 0 && len > 128) {
+            bytes += 128;
+            blake2b::Compress(h, data, bytes, false);
+            data += 128;
+            len -= 128;
+        }
+        const size_t n = std::min(len, 128 - bufsize);
+        memcpy(buf + bufsize, data, n);
+        bufsize += n;
+        data += n;
+        len -= n;
+    }
+    return *this;
+}
+
+void CBLAKE2b::Finalize(unsigned char* hash)
+{
+    memset(buf + bufsize, 0, 128 - bufsize);
+    blake2b::Compress(h, buf, bytes + bufsize, true);
+    unsigned char out[MAX_OUTPUT_SIZE];
+    for (int i = 0; i < 8; ++i) WriteLE64(out + 8 * i, h[i]);
+    memcpy(hash, out, outlen);
+}
+
+void BLAKE2bMulti(const CBLAKE2b& base, const unsigned char* inputs, size_t len, size_t count, unsigned char* outputs)
+{
+    size_t i = 0;
+    if (Compress_4way) {
+        // All hashes go through the same number of blocks, with the same counters.
+        const size_t tail = base.bufsize + len;
+        const size_t blocks = std::max<size_t>(1, (tail + 127) / 128);
+        unsigned char block[4][128];
+        const unsigned char* chunks[4] = {block[0], block[1], block[2], block[3]};
+        for (; i + 4 <= count; i += 4) {
+            uint64_t h[32];
+            for (size_t j = 0; j < 4; ++j) std::copy(base.h, base.h + 8, h + 8 * j);
+            for (size_t k = 0; k < blocks; ++k) {
+                for (size_t j = 0; j < 4; ++j) FillBlock(block[j], base.buf, base.bufsize, inputs + (i + j) * len, len, k);
+                Compress_4way(h, chunks, base.bytes + std::min(128 * (k + 1), tail), k + 1 == blocks);
+            }
+            for (size_t j = 0; j < 4; ++j) {
+                unsigned char out[CBLAKE2b::MAX_OUTPUT_SIZE];
+                for (int w = 0; w < 8; ++w) WriteLE64(out + 8 * w, h[8 * j + w]);
+                memcpy(outputs + (i + j) * base.outlen, out, base.outlen);
+            }
+        }
+    }
+    for (; i < count; ++i) {
+        CBLAKE2b(base).Write(inputs + i * len, len).Finalize(outputs + i * base.outlen);
+    }
+}
+
+std::string BLAKE2bAutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_xsave = (ecx >> 27) & 1;
+    const bool have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx && AVXEnabled()) {
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        if ((ebx >> 5) & 1) {
+            Compress_4way = blake2b_avx2::Compress_4way;
+            ret += ",avx2(4way)";
+        }
+    }
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
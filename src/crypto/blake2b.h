@@ -0,0 +1,53 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_CRYPTO_BLAKE2B_H
+#define LITECOINZ_CRYPTO_BLAKE2B_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** A hasher class for unkeyed BLAKE2b, with an optional personalisation. */
+class CBLAKE2b
+{
+public:
+    static const size_t MAX_OUTPUT_SIZE = 64;
+    static const size_t PERSONAL_SIZE = 16;
+
+    /** A hasher with outlen bytes of output, and personal pointing to PERSONAL_SIZE bytes if not null */
+    explicit CBLAKE2b(size_t outlen = MAX_OUTPUT_SIZE, const unsigned char* personal = nullptr);
+    CBLAKE2b& Write(const unsigned char* data, size_t len);
+    /** Write OutputSize() bytes to hash. */
+    void Finalize(unsigned char* hash);
+    size_t OutputSize() const { return outlen; }
+
+private:
+    uint64_t h[8];
+    //! The bytes compressed so far, without the ones in buf
+    uint64_t bytes;
+    //! The last block is only compressed in Finalize, so it is kept here even when full
+    unsigned char buf[128];
+    size_t bufsize;
+    size_t outlen;
+
+    friend void BLAKE2bMulti(const CBLAKE2b& base, const unsigned char* inputs, size_t len, size_t count, unsigned char* outputs);
+};
+
+/** Autodetect the best available BLAKE2b implementation.
+ *  Returns the name of the implementation.
+ */
+std::string BLAKE2bAutoDetect();
+
+/** Compute multiple BLAKE2b's that continue from the same state, several at a
+ *  time when a multi-way implementation is available.
+ *  base:    the state that all hashes start from, which is not changed
+ *  inputs:  pointer to a count*len byte input buffer
+ *  len:     the length written to each hash
+ *  count:   the number of hashes to compute
+ *  outputs: pointer to a count*base.OutputSize() byte output buffer.
+ */
+void BLAKE2bMulti(const CBLAKE2b& base, const unsigned char* inputs, size_t len, size_t count, unsigned char* outputs);
+
+#endif // LITECOINZ_CRYPTO_BLAKE2B_H
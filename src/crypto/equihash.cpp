@@ -33,6 +33,11 @@
 
 static EhSolverCancelledException solver_cancelled;
 
+/** Whether IsValidSolution uses the fixed-size verifier, set by EquihashAutoDetect. */
+static bool use_fixed_verifier = false;
+/** Whether the fixed-size verifier also works from CBLAKE2b states, set by EquihashAutoDetect. */
+static bool use_batch_verifier = false;
+
 template<unsigned int N, unsigned int K>
 int Equihash<N,K>::InitialiseState(eh_HashState& base_state)
 {
@@ -49,6 +54,18 @@ int Equihash<N,K>::InitialiseState(eh_HashState& base_state)
                                                          personalization);
 }
 
+template<unsigned int N, unsigned int K>
+void Equihash<N,K>::InitialiseState(CBLAKE2b& base_state)
+{
+    uint32_t le_N = htole32(N);
+    uint32_t le_K = htole32(K);
+    unsigned char personalization[CBLAKE2b::PERSONAL_SIZE] = {};
+    memcpy(personalization, "ZcashPoW", 8);
+    memcpy(personalization+8,  &le_N, 4);
+    memcpy(personalization+12, &le_K, 4);
+    base_state = CBLAKE2b((512/N)*N/8, personalization);
+}
+
 void GenerateHash(const eh_HashState& base_state, eh_index g,
                   unsigned char* hash, size_t hLen)
 {
@@ -724,6 +741,15 @@ invalidsolution:
 
 template<unsigned int N, unsigned int K>
 bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln)
+{
+    if (use_fixed_verifier) {
+        return FixedIsValidSolution(base_state, soln);
+    }
+    return BasicIsValidSolution(base_state, soln);
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln)
 {
     if (soln.size() != SolutionWidth) {
         LogPrint(BCLog::POW, "Invalid solution length: %d (expected %d)\n",
@@ -770,8 +796,117 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
     return X[0].IsZero(hashLen);
 }
 
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::FixedIsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln)
+{
+    return FixedIsValidSolution(soln, [&base_state](const eh_index* leaves, size_t count, unsigned char* hashes) {
+        for (size_t i = 0; i < count; i++) {
+            GenerateHash(base_state, leaves[i], hashes + i*HashOutput, HashOutput);
+        }
+    });
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::FixedIsValidSolution(const CBLAKE2b& base_state, const std::vector<unsigned char>& soln)
+{
+    return FixedIsValidSolution(soln, [&base_state](const eh_index* leaves, size_t count, unsigned char* hashes) {
+        unsigned char inputs[(1 << K)*sizeof(eh_index)];
+        for (size_t i = 0; i < count; i++) {
+            eh_index lei = htole32(leaves[i]);
+            memcpy(inputs + i*sizeof(eh_index), &lei, sizeof(eh_index));
+        }
+        BLAKE2bMulti(base_state, inputs, sizeof(eh_index), count, hashes);
+    });
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::FixedIsValidSolution(const std::vector<unsigned char>& soln,
+                                         const std::function<void(const eh_index*, size_t, unsigned char*)>& hash_leaves)
+{
+    enum : size_t { SolutionIndices=1 << K };
+    enum : size_t { IndexBytes=(CollisionBitLength+1+7)/8 };
+
+    if (soln.size() != SolutionWidth) {
+        LogPrint(BCLog::POW, "Invalid solution length: %d (expected %d)\n",
+                 soln.size(), SolutionWidth);
+        return false;
+    }
+
+    // Unpack the minimal encoding into big-endian indices.
+    unsigned char array[SolutionIndices*sizeof(eh_index)];
+    ExpandArray(soln.data(), SolutionWidth, array, sizeof(array),
+                CollisionBitLength+1, sizeof(eh_index)-IndexBytes);
+    eh_index indices[SolutionIndices];
+    for (size_t i = 0; i < SolutionIndices; i++) {
+        indices[i] = ArrayToEhIndex(array+(i*sizeof(eh_index)));
+    }
+
+    // The reference verifier checks distinctness pair by pair while merging
+    // subtrees, which amounts to all indices being distinct. Checking it up
+    // front rejects such solutions before any hashing.
+    eh_index sorted[SolutionIndices];
+    std::copy(indices, indices+SolutionIndices, sorted);
+    std::sort(sorted, sorted+SolutionIndices);
+    if (std::adjacent_find(sorted, sorted+SolutionIndices) != sorted+SolutionIndices) {
+        LogPrint(BCLog::POW, "Invalid solution: duplicate indices\n");
+        return false;
+    }
+
+    // Expanded leaf rows. Consecutive indices often share a hash output, in
+    // which case it is only computed once. The hash outputs are independent
+    // of each other, so they are all computed in one go.
+    eh_index leaves[SolutionIndices];
+    size_t leaf_of[SolutionIndices];
+    size_t leaf_count = 0;
+    for (size_t i = 0; i < SolutionIndices; i++) {
+        eh_index g = indices[i]/IndicesPerHashOutput;
+        if (i == 0 || g != indices[i-1]/IndicesPerHashOutput) {
+            leaves[leaf_count++] = g;
+        }
+        leaf_of[i] = leaf_count - 1;
+    }
+    unsigned char hashes[SolutionIndices][HashOutput];
+    hash_leaves(leaves, leaf_count, hashes[0]);
+
+    unsigned char rows[SolutionIndices][HashLength];
+    for (size_t i = 0; i < SolutionIndices; i++) {
+        ExpandArray(hashes[leaf_of[i]]+((indices[i] % IndicesPerHashOutput) * N/8), N/8,
+                    rows[i], HashLength, CollisionBitLength);
+    }
+
+    // Merge the tree in place: after round r, the row at the start of each
+    // subtree of 2^(r+1) leaves holds the XOR of all of its leaves.
+    for (size_t r = 0; r < K; r++) {
+        size_t width = size_t{1} << r;
+        size_t offset = r*CollisionByteLength;
+        for (size_t left = 0; left < SolutionIndices; left += 2*width) {
+            size_t right = left + width;
+            if (indices[right] < indices[left]) {
+                LogPrint(BCLog::POW, "Invalid solution: Index tree incorrectly ordered\n");
+                return false;
+            }
+            for (size_t j = offset; j < HashLength; j++) {
+                rows[left][j] ^= rows[right][j];
+            }
+            for (size_t j = offset; j < offset+CollisionByteLength; j++) {
+                if (rows[left][j] != 0) {
+                    LogPrint(BCLog::POW, "Invalid solution: invalid collision length between StepRows\n");
+                    return false;
+                }
+            }
+        }
+    }
+
+    for (size_t j = K*CollisionByteLength; j < HashLength; j++) {
+        if (rows[0][j] != 0)
+            return false;
+    }
+    return true;
+}
+
 // Explicit instantiations for Equihash<96,3>
 template int Equihash<96,3>::InitialiseState(eh_HashState& base_state);
+template void Equihash<96,3>::InitialiseState(CBLAKE2b& base_state);
 template bool Equihash<96,3>::BasicSolve(const eh_HashState& base_state,
                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
                                          const std::function<bool(EhSolverCancelCheck)> cancelled);
@@ -779,9 +914,13 @@ template bool Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,3>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,3>::FixedIsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+template bool Equihash<96,3>::FixedIsValidSolution(const CBLAKE2b& base_state, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<200,9>
 template int Equihash<200,9>::InitialiseState(eh_HashState& base_state);
+template void Equihash<200,9>::InitialiseState(CBLAKE2b& base_state);
 template bool Equihash<200,9>::BasicSolve(const eh_HashState& base_state,
                                           const std::function<bool(std::vector<unsigned char>)> validBlock,
                                           const std::function<bool(EhSolverCancelCheck)> cancelled);
@@ -789,9 +928,13 @@ template bool Equihash<200,9>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<200,9>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<200,9>::FixedIsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+template bool Equihash<200,9>::FixedIsValidSolution(const CBLAKE2b& base_state, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<96,5>
 template int Equihash<96,5>::InitialiseState(eh_HashState& base_state);
+template void Equihash<96,5>::InitialiseState(CBLAKE2b& base_state);
 template bool Equihash<96,5>::BasicSolve(const eh_HashState& base_state,
                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
                                          const std::function<bool(EhSolverCancelCheck)> cancelled);
@@ -799,9 +942,13 @@ template bool Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,5>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,5>::FixedIsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+template bool Equihash<96,5>::FixedIsValidSolution(const CBLAKE2b& base_state, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<48,5>::InitialiseState(eh_HashState& base_state);
+template void Equihash<48,5>::InitialiseState(CBLAKE2b& base_state);
 template bool Equihash<48,5>::BasicSolve(const eh_HashState& base_state,
                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
                                          const std::function<bool(EhSolverCancelCheck)> cancelled);
@@ -809,9 +956,13 @@ template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<48,5>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<48,5>::FixedIsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+template bool Equihash<48,5>::FixedIsValidSolution(const CBLAKE2b& base_state, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<144,5>
 template int Equihash<144,5>::InitialiseState(eh_HashState& base_state);
+template void Equihash<144,5>::InitialiseState(CBLAKE2b& base_state);
 template bool Equihash<144,5>::BasicSolve(const eh_HashState& base_state,
                                           const std::function<bool(std::vector<unsigned char>)> validBlock,
                                           const std::function<bool(EhSolverCancelCheck)> cancelled);
@@ -819,9 +970,13 @@ template bool Equihash<144,5>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<144,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<144,5>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<144,5>::FixedIsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+template bool Equihash<144,5>::FixedIsValidSolution(const CBLAKE2b& base_state, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<192,7>
 template int Equihash<192,7>::InitialiseState(eh_HashState& base_state);
+template void Equihash<192,7>::InitialiseState(CBLAKE2b& base_state);
 template bool Equihash<192,7>::BasicSolve(const eh_HashState& base_state,
                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
                                          const std::function<bool(EhSolverCancelCheck)> cancelled);
@@ -829,3 +984,70 @@ template bool Equihash<192,7>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<192,7>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<192,7>::BasicIsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<192,7>::FixedIsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+template bool Equihash<192,7>::FixedIsValidSolution(const CBLAKE2b& base_state, const std::vector<unsigned char>& soln);
+
+/** Check that the fixed-size verifier agrees with the reference one on freshly solved 48,5 instances.
+ *  batch_ok is set to whether it also agrees when working from a CBLAKE2b state. */
+static bool VerifierSelfTest(bool& batch_ok)
+{
+    eh_HashState base_state;
+    Eh48_5.InitialiseState(base_state);
+    CBLAKE2b batch_base_state;
+    Eh48_5.InitialiseState(batch_base_state);
+    batch_ok = true;
+
+    for (uint32_t nonce = 0; nonce < 16; nonce++) {
+        eh_HashState state = base_state;
+        uint32_t le_nonce = htole32(nonce);
+        crypto_generichash_blake2b_update(&state, (const unsigned char*) &le_nonce, sizeof(le_nonce));
+        CBLAKE2b batch_state = batch_base_state;
+        batch_state.Write((const unsigned char*) &le_nonce, sizeof(le_nonce));
+
+        std::vector<std::vector<unsigned char>> solutions;
+        Eh48_5.BasicSolve(state, [&solutions](std::vector<unsigned char> soln) {
+            solutions.push_back(soln);
+            return false;
+        }, [](EhSolverCancelCheck pos) { return false; });
+
+        for (std::vector<unsigned char>& soln : solutions) {
+            if (!Eh48_5.BasicIsValidSolution(state, soln) || !Eh48_5.FixedIsValidSolution(state, soln)) {
+                return false;
+            }
+            batch_ok = batch_ok && Eh48_5.FixedIsValidSolution(batch_state, soln);
+            for (size_t i = 0; i < soln.size(); i++) {
+                soln[i] ^= 1;
+                const bool valid = Eh48_5.BasicIsValidSolution(state, soln);
+                if (valid != Eh48_5.FixedIsValidSolution(state, soln)) {
+                    return false;
+                }
+                batch_ok = batch_ok && valid == Eh48_5.FixedIsValidSolution(batch_state, soln);
+                soln[i] ^= 1;
+            }
+        }
+        if (!solutions.empty()) {
+            return true;
+        }
+    }
+    batch_ok = false;
+    return false;
+}
+
+std::string EquihashAutoDetect()
+{
+    use_fixed_verifier = false;
+    use_batch_verifier = false;
+    bool batch_ok;
+    if (VerifierSelfTest(batch_ok)) {
+        use_fixed_verifier = true;
+        use_batch_verifier = batch_ok;
+        return batch_ok ? "fixed,batch" : "fixed";
+    }
+    return "basic";
+}
+
+bool EquihashBatchVerifier()
+{
+    return use_batch_verifier;
+}
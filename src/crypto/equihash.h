@@ -7,6 +7,7 @@
 #ifndef BITCOIN_EQUIHASH_H
 #define BITCOIN_EQUIHASH_H
 
+#include <crypto/blake2b.h>
 #include <crypto/sha256.h>
 #include <util/strencodings.h>
 
@@ -17,6 +18,7 @@
 #include <functional>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 typedef crypto_generichash_blake2b_state eh_HashState;
@@ -181,6 +183,8 @@ public:
     Equihash() { }
 
     int InitialiseState(eh_HashState& base_state);
+    /** The same personalised state for the in-tree BLAKE2b. */
+    void InitialiseState(CBLAKE2b& base_state);
     bool BasicSolve(const eh_HashState& base_state,
                     const std::function<bool(std::vector<unsigned char>)> validBlock,
                     const std::function<bool(EhSolverCancelCheck)> cancelled);
@@ -188,8 +192,27 @@ public:
                         const std::function<bool(std::vector<unsigned char>)> validBlock,
                         const std::function<bool(EhSolverCancelCheck)> cancelled);
     bool IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+    /** Reference verifier built on FullStepRow. */
+    bool BasicIsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+    /** Verifier working on fixed-size stack buffers, without per-row allocations. */
+    bool FixedIsValidSolution(const eh_HashState& base_state, const std::vector<unsigned char>& soln);
+    /** The fixed-size verifier, hashing the leaves of the solution together with BLAKE2bMulti. */
+    bool FixedIsValidSolution(const CBLAKE2b& base_state, const std::vector<unsigned char>& soln);
+
+private:
+    /** The fixed-size verifier, with hash_leaves(indices, count, hashes) writing the hash outputs of count indices to hashes. */
+    bool FixedIsValidSolution(const std::vector<unsigned char>& soln,
+                              const std::function<void(const eh_index*, size_t, unsigned char*)>& hash_leaves);
 };
 
+/** Autodetect the best available Equihash verifier.
+ *  Returns the name of the implementation.
+ */
+std::string EquihashAutoDetect();
+
+/** Whether EquihashAutoDetect found the in-tree BLAKE2b to agree with libsodium, so CBLAKE2b states can be verified with EhBatchIsValidSolution. */
+bool EquihashBatchVerifier();
+
 #include "equihash.tcc"
 
 static Equihash<96,3> Eh96_3;
@@ -272,6 +295,25 @@ inline bool EhOptimisedSolveUncancellable(unsigned int n, unsigned int k, const
                             [](EhSolverCancelCheck pos) { return false; });
 }
 
+inline bool EhBatchIsValidSolution(unsigned int n, unsigned int k, const CBLAKE2b& base_state, const std::vector<unsigned char>& soln)
+{
+    if (n == 96 && k == 3) {
+        return Eh96_3.FixedIsValidSolution(base_state, soln);
+    } else if (n == 200 && k == 9) {
+        return Eh200_9.FixedIsValidSolution(base_state, soln);
+    } else if (n == 96 && k == 5) {
+        return Eh96_5.FixedIsValidSolution(base_state, soln);
+    } else if (n == 48 && k == 5) {
+        return Eh48_5.FixedIsValidSolution(base_state, soln);
+    } else if (n == 144 && k == 5) {
+        return Eh144_5.FixedIsValidSolution(base_state, soln);
+    } else if (n == 192 && k == 7) {
+        return Eh192_7.FixedIsValidSolution(base_state, soln);
+    } else {
+        throw std::invalid_argument("Unsupported Equihash parameters");
+    }
+}
+
 #define EhIsValidSolution(n, k, base_state, soln, ret)   \
     if (n == 96 && k == 3) {                             \
         ret = Eh96_3.IsValidSolution(base_state, soln);  \
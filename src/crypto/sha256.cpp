@@ -8,9 +8,20 @@
 #include <assert.h>
 #include <string.h>
 #include <stdexcept>
+#include <vector>
 
 #include <compat/cpuid.h>
 
+#if defined(__linux__) && defined(ENABLE_ARM_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#if defined(MAC_OSX) && defined(ENABLE_ARM_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#endif
+
 #if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
 #if defined(USE_ASM)
 namespace sha256_sse4
@@ -25,11 +36,21 @@ namespace sha256d64_sse41
 void Transform_4way(unsigned char* out, const unsigned char* in);
 }
 
+namespace sha256_sse41
+{
+void Transform_4way(uint32_t* s, const unsigned char* const* chunks);
+}
+
 namespace sha256d64_avx2
 {
 void Transform_8way(unsigned char* out, const unsigned char* in);
 }
 
+namespace sha256_avx2
+{
+void Transform_8way(uint32_t* s, const unsigned char* const* chunks);
+}
+
 namespace sha256d64_shani
 {
 void Transform_2way(unsigned char* out, const unsigned char* in);
@@ -40,6 +61,16 @@ namespace sha256_shani
 void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 }
 
+namespace sha256_arm_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+
+namespace sha256d64_arm_shani
+{
+void Transform_2way(unsigned char* out, const unsigned char* in);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -417,6 +448,7 @@ void TransformD64(unsigned char* out, const unsigned char* in)
 
 typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
 typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+typedef void (*TransformMultiType)(uint32_t*, const unsigned char* const*);
 
 template<TransformType tr>
 void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
@@ -462,6 +494,8 @@ TransformD64Type TransformD64 = sha256::TransformD64;
 TransformD64Type TransformD64_2way = nullptr;
 TransformD64Type TransformD64_4way = nullptr;
 TransformD64Type TransformD64_8way = nullptr;
+TransformMultiType TransformMulti_4way = nullptr;
+TransformMultiType TransformMulti_8way = nullptr;
 
 bool SelfTest() {
     // Input state (equal to the initial SHA256 state)
@@ -545,9 +579,108 @@ bool SelfTest() {
         if (!std::equal(out, out + 256, result_d64)) return false;
     }
 
+    // Test TransformMulti_4way and TransformMulti_8way, if available, with lane i going from state i to i+1.
+    for (TransformMultiType multi : {TransformMulti_4way, TransformMulti_8way}) {
+        if (!multi) continue;
+        const size_t ways = multi == TransformMulti_8way ? 8 : 4;
+        uint32_t states[64];
+        const unsigned char* chunks[8];
+        for (size_t i = 0; i < ways; ++i) {
+            std::copy(result[i], result[i] + 8, states + 8 * i);
+            chunks[i] = data + 1 + 64 * i;
+        }
+        multi(states, chunks);
+        for (size_t i = 0; i < ways; ++i) {
+            if (!std::equal(states + 8 * i, states + 8 * i + 8, result[i + 1])) return false;
+        }
+    }
+
     return true;
 }
 
+/** A message being hashed in one lane of a multi-way transform. */
+struct HashLane
+{
+    size_t index;               //!< Which of the messages this is
+    const unsigned char* data;  //!< Its whole blocks not hashed yet
+    size_t blocks;              //!< How many of them there are
+    unsigned char tail[128];    //!< The rest of the message and the padding
+    size_t tail_pos;            //!< The next block of tail to hash
+    size_t tail_blocks;         //!< How many blocks of tail there are
+
+    void Start(size_t i, const unsigned char* in, size_t len)
+    {
+        index = i;
+        data = in;
+        blocks = len / 64;
+        const size_t rest = len % 64;
+        tail_pos = 0;
+        tail_blocks = rest < 56 ? 1 : 2;
+        memset(tail, 0, sizeof(tail));
+        memcpy(tail, in + 64 * blocks, rest);
+        tail[rest] = 0x80;
+        WriteBE64(tail + 64 * tail_blocks - 8, uint64_t{len} << 3);
+    }
+
+    bool Done() const { return blocks == 0 && tail_pos == tail_blocks; }
+
+    /** The next block to hash, which is then counted as hashed */
+    const unsigned char* Next()
+    {
+        if (blocks) {
+            --blocks;
+            data += 64;
+            return data - 64;
+        }
+        return tail + 64 * tail_pos++;
+    }
+};
+
+void WriteState(unsigned char* out, const uint32_t* s)
+{
+    for (int i = 0; i < 8; ++i) WriteBE32(out + 4 * i, s[i]);
+}
+
+/** Compute the SHA256 of each message, keeping the lanes of a multi-way transform busy with the next message as long as there is one. */
+void SHA256Lanes(unsigned char* out, const unsigned char* const* inputs, const size_t* lengths, size_t count, size_t ways, TransformMultiType multi)
+{
+    uint32_t states[64];
+    const unsigned char* chunks[8];
+    HashLane lanes[8];
+    bool busy[8] = {};
+    size_t next = 0;
+    while (true) {
+        size_t busy_lanes = 0;
+        for (size_t i = 0; i < ways; ++i) {
+            if (!busy[i] && next < count) {
+                lanes[i].Start(next, inputs[next], lengths[next]);
+                sha256::Initialize(states + 8 * i);
+                busy[i] = true;
+                ++next;
+            }
+            busy_lanes += busy[i];
+        }
+        if (busy_lanes < ways) break;
+        for (size_t i = 0; i < ways; ++i) chunks[i] = lanes[i].Next();
+        multi(states, chunks);
+        for (size_t i = 0; i < ways; ++i) {
+            if (lanes[i].Done()) {
+                WriteState(out + 32 * lanes[i].index, states + 8 * i);
+                busy[i] = false;
+            }
+        }
+    }
+
+    // The messages left once there are too few to fill the lanes are finished one at a time.
+    for (size_t i = 0; i < ways; ++i) {
+        if (!busy[i]) continue;
+        HashLane& lane = lanes[i];
+        Transform(states + 8 * i, lane.data, lane.blocks);
+        Transform(states + 8 * i, lane.tail + 64 * lane.tail_pos, lane.tail_blocks - lane.tail_pos);
+        WriteState(out + 32 * lane.index, states + 8 * i);
+    }
+}
+
 #if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
 /** Check whether the OS has enabled AVX registers. */
 bool AVXEnabled()
@@ -612,6 +745,7 @@ std::string SHA256AutoDetect()
 #endif
 #if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
         TransformD64_4way = sha256d64_sse41::Transform_4way;
+        TransformMulti_4way = sha256_sse41::Transform_4way;
         ret += ",sse41(4way)";
 #endif
     }
@@ -619,11 +753,44 @@ std::string SHA256AutoDetect()
 #if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
     if (have_avx2 && have_avx && enabled_avx) {
         TransformD64_8way = sha256d64_avx2::Transform_8way;
+        TransformMulti_8way = sha256_avx2::Transform_8way;
         ret += ",avx2(8way)";
     }
 #endif
 #endif
 
+#if defined(ENABLE_ARM_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+    bool have_arm_shani = false;
+
+#if defined(__linux__)
+#if defined(__arm__) // 32-bit
+    if (getauxval(AT_HWCAP2) & HWCAP2_SHA2) {
+        have_arm_shani = true;
+    }
+#endif
+#if defined(__aarch64__) // 64-bit
+    if (getauxval(AT_HWCAP) & HWCAP_SHA2) {
+        have_arm_shani = true;
+    }
+#endif
+#endif
+
+#if defined(MAC_OSX)
+    int val = 0;
+    size_t len = sizeof(val);
+    if (sysctlbyname("hw.optional.arm.FEAT_SHA256", &val, &len, nullptr, 0) == 0) {
+        have_arm_shani = val != 0;
+    }
+#endif
+
+    if (have_arm_shani) {
+        Transform = sha256_arm_shani::Transform;
+        TransformD64 = TransformD64Wrapper<sha256_arm_shani::Transform>;
+        TransformD64_2way = sha256d64_arm_shani::Transform_2way;
+        ret = "arm_shani(1way,2way)";
+    }
+#endif
+
     assert(SelfTest());
     return ret;
 }
@@ -694,6 +861,29 @@ CSHA256& CSHA256::Reset()
     return *this;
 }
 
+void SHA256DMulti(unsigned char* output, const unsigned char* const* inputs, const size_t* lengths, size_t count)
+{
+    const TransformMultiType multi = TransformMulti_8way ? TransformMulti_8way : TransformMulti_4way;
+    const size_t ways = TransformMulti_8way ? 8 : 4;
+    if (!multi || count < ways) {
+        for (size_t i = 0; i < count; ++i) {
+            unsigned char inner[CSHA256::OUTPUT_SIZE];
+            CSHA256().Write(inputs[i], lengths[i]).Finalize(inner);
+            CSHA256().Write(inner, sizeof(inner)).Finalize(output + 32 * i);
+        }
+        return;
+    }
+
+    std::vector<unsigned char> inner(32 * count);
+    SHA256Lanes(inner.data(), inputs, lengths, count, ways, multi);
+
+    // The second hashes are of 32 bytes each, a single block.
+    std::vector<const unsigned char*> inner_inputs(count);
+    for (size_t i = 0; i < count; ++i) inner_inputs[i] = inner.data() + 32 * i;
+    const std::vector<size_t> inner_lengths(count, 32);
+    SHA256Lanes(output, inner_inputs.data(), inner_lengths.data(), count, ways, multi);
+}
+
 void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
 {
     if (TransformD64_8way) {
@@ -43,4 +43,13 @@ std::string SHA256AutoDetect();
  */
 void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
 
+/** Compute the double-SHA256's of many blobs of any length, several at a time
+ *  when a multi-way implementation is available.
+ *  output:  pointer to a count*32 byte output buffer
+ *  inputs:  pointers to the count inputs
+ *  lengths: the lengths of the count inputs
+ *  count:   the number of hashes to compute.
+ */
+void SHA256DMulti(unsigned char* output, const unsigned char* const* inputs, const size_t* lengths, size_t count);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,126 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Based on https://github.com/noloader/SHA-Intrinsics/blob/master/sha256-arm.c,
+// Written and placed in public domain by Jeffrey Walton.
+// Variant for two 64-byte inputs after sha256_shani.cpp.
+
+#ifdef ENABLE_ARM_SHANI
+
+#include <stddef.h>
+#include <stdint.h>
+#include <arm_acle.h>
+#include <arm_neon.h>
+
+namespace {
+
+alignas(uint32x4_t) const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+alignas(uint32x4_t) const uint32_t INIT[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+/** The message words of the second block of a 64-byte input, and of the block holding a 32-byte one. */
+alignas(uint32x4_t) const uint32_t PAD_FIRST[4] = {0x80000000, 0, 0, 0};
+alignas(uint32x4_t) const uint32_t PAD_LENGTH_64[4] = {0, 0, 0, 0x200};
+alignas(uint32x4_t) const uint32_t PAD_LENGTH_32[4] = {0, 0, 0, 0x100};
+
+/** Four rounds on the state (a,b,c,d) and (e,f,g,h), with the message words plus the constants. */
+void inline __attribute__((always_inline)) QuadRound(uint32x4_t& state0, uint32x4_t& state1, uint32x4_t msg_k)
+{
+    const uint32x4_t abcd = state0;
+    state0 = vsha256hq_u32(state0, state1, msg_k);
+    state1 = vsha256h2q_u32(state1, abcd, msg_k);
+}
+
+/** Replace the message words m0 with the ones sixteen words later. */
+void inline __attribute__((always_inline)) ShiftMessage(uint32x4_t& m0, uint32x4_t m1, uint32x4_t m2, uint32x4_t m3)
+{
+    m0 = vsha256su1q_u32(vsha256su0q_u32(m0, m1), m2, m3);
+}
+
+/** The 64 rounds of a block, whose message words are m0 to m3, and the feed-forward. */
+void inline __attribute__((always_inline)) Compress(uint32x4_t& state0, uint32x4_t& state1, uint32x4_t m0, uint32x4_t m1, uint32x4_t m2, uint32x4_t m3)
+{
+    const uint32x4_t abcd_save = state0;
+    const uint32x4_t efgh_save = state1;
+    for (int i = 0; i < 64; i += 16) {
+        QuadRound(state0, state1, vaddq_u32(m0, vld1q_u32(&K[i])));
+        if (i < 48) ShiftMessage(m0, m1, m2, m3);
+        QuadRound(state0, state1, vaddq_u32(m1, vld1q_u32(&K[i + 4])));
+        if (i < 48) ShiftMessage(m1, m2, m3, m0);
+        QuadRound(state0, state1, vaddq_u32(m2, vld1q_u32(&K[i + 8])));
+        if (i < 48) ShiftMessage(m2, m3, m0, m1);
+        QuadRound(state0, state1, vaddq_u32(m3, vld1q_u32(&K[i + 12])));
+        if (i < 48) ShiftMessage(m3, m0, m1, m2);
+    }
+    state0 = vaddq_u32(state0, abcd_save);
+    state1 = vaddq_u32(state1, efgh_save);
+}
+
+/** Load four big endian words. */
+uint32x4_t inline __attribute__((always_inline)) Load(const unsigned char* in)
+{
+    return vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(in)));
+}
+
+/** Store four words big endian. */
+void inline __attribute__((always_inline)) Save(unsigned char* out, uint32x4_t s)
+{
+    vst1q_u8(out, vrev32q_u8(vreinterpretq_u8_u32(s)));
+}
+
+/** The double SHA256 of a 64-byte input, written to out. */
+void inline __attribute__((always_inline)) Transform64(unsigned char* out, const unsigned char* in)
+{
+    // Transform the input, then the padding block after it
+    uint32x4_t state0 = vld1q_u32(&INIT[0]);
+    uint32x4_t state1 = vld1q_u32(&INIT[4]);
+    Compress(state0, state1, Load(in), Load(in + 16), Load(in + 32), Load(in + 48));
+    const uint32x4_t zero = vdupq_n_u32(0);
+    Compress(state0, state1, vld1q_u32(PAD_FIRST), zero, zero, vld1q_u32(PAD_LENGTH_64));
+
+    // Hash the 32-byte result, whose words are the state
+    uint32x4_t hash0 = vld1q_u32(&INIT[0]);
+    uint32x4_t hash1 = vld1q_u32(&INIT[4]);
+    Compress(hash0, hash1, state0, state1, vld1q_u32(PAD_FIRST), vld1q_u32(PAD_LENGTH_32));
+    Save(out, hash0);
+    Save(out + 16, hash1);
+}
+
+} // namespace
+
+namespace sha256_arm_shani {
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    uint32x4_t state0 = vld1q_u32(&s[0]);
+    uint32x4_t state1 = vld1q_u32(&s[4]);
+    while (blocks--) {
+        Compress(state0, state1, Load(chunk), Load(chunk + 16), Load(chunk + 32), Load(chunk + 48));
+        chunk += 64;
+    }
+    vst1q_u32(&s[0], state0);
+    vst1q_u32(&s[4], state1);
+}
+}
+
+namespace sha256d64_arm_shani {
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    // The two inputs are independent, so their instructions interleave
+    Transform64(out, in);
+    Transform64(out + 32, in + 64);
+}
+}
+
+#endif
@@ -325,4 +325,66 @@ void Transform_8way(unsigned char* out, const unsigned char* in)
 
 }
 
+namespace sha256_avx2 {
+using namespace sha256d64_avx2;
+
+namespace {
+
+const uint32_t ROUND_CONSTANTS[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+/** The message word plus constant of round i, extending the schedule w from round 16 on. */
+__m256i inline __attribute__((always_inline)) Schedule(__m256i* w, int i)
+{
+    if (i >= 16) Inc(w[i & 15], sigma1(w[(i + 14) & 15]), w[(i + 9) & 15], sigma0(w[(i + 1) & 15]));
+    return Add(K(ROUND_CONSTANTS[i]), w[i & 15]);
+}
+
+}
+
+void Transform_8way(uint32_t* s, const unsigned char* const* chunks)
+{
+    // Lane j has its state in s[8 * j] to s[8 * j + 7], and its block in chunks[j]
+    __m256i state[8];
+    for (int i = 0; i < 8; ++i) state[i] = _mm256_set_epi32(s[56 + i], s[48 + i], s[40 + i], s[32 + i], s[24 + i], s[16 + i], s[8 + i], s[i]);
+    __m256i w[16];
+    for (int i = 0; i < 16; ++i) w[i] = _mm256_set_epi32(ReadBE32(chunks[7] + 4 * i), ReadBE32(chunks[6] + 4 * i), ReadBE32(chunks[5] + 4 * i), ReadBE32(chunks[4] + 4 * i), ReadBE32(chunks[3] + 4 * i), ReadBE32(chunks[2] + 4 * i), ReadBE32(chunks[1] + 4 * i), ReadBE32(chunks[0] + 4 * i));
+
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i += 8) {
+        Round(a, b, c, d, e, f, g, h, Schedule(w, i));
+        Round(h, a, b, c, d, e, f, g, Schedule(w, i + 1));
+        Round(g, h, a, b, c, d, e, f, Schedule(w, i + 2));
+        Round(f, g, h, a, b, c, d, e, Schedule(w, i + 3));
+        Round(e, f, g, h, a, b, c, d, Schedule(w, i + 4));
+        Round(d, e, f, g, h, a, b, c, Schedule(w, i + 5));
+        Round(c, d, e, f, g, h, a, b, Schedule(w, i + 6));
+        Round(b, c, d, e, f, g, h, a, Schedule(w, i + 7));
+    }
+    Inc(state[0], a);
+    Inc(state[1], b);
+    Inc(state[2], c);
+    Inc(state[3], d);
+    Inc(state[4], e);
+    Inc(state[5], f);
+    Inc(state[6], g);
+    Inc(state[7], h);
+
+    uint32_t lanes[8];
+    for (int i = 0; i < 8; ++i) {
+        _mm256_storeu_si256((__m256i*)lanes, state[i]);
+        for (int j = 0; j < 8; ++j) s[8 * j + i] = lanes[j];
+    }
+}
+
+}
+
 #endif
@@ -4,6 +4,15 @@
 
 #include <crypto/siphash.h>
 
+#include <assert.h>
+
+#include <compat/cpuid.h>
+
+namespace siphash_avx2
+{
+void Uint256_8way(uint64_t* out, uint64_t k0, uint64_t k1, const unsigned char* in);
+}
+
 #define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
 
 #define SIPROUND do { \
@@ -171,3 +180,69 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+namespace {
+
+typedef void (*Uint2568wayType)(uint64_t*, uint64_t, uint64_t, const unsigned char*);
+
+Uint2568wayType Uint256_8way = nullptr;
+
+bool SelfTest()
+{
+    uint256 vals[8];
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 32; ++j) vals[i].begin()[j] = i * 32 + j;
+    }
+    uint64_t out[8];
+    SipHashUint256Multi(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, vals, 8, out);
+    for (int i = 0; i < 8; ++i) {
+        if (out[i] != SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, vals[i])) return false;
+    }
+    return true;
+}
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+} // namespace
+
+void SipHashUint256Multi(uint64_t k0, uint64_t k1, const uint256* vals, size_t count, uint64_t* outputs)
+{
+    static_assert(sizeof(uint256) == 32, "uint256 values must be contiguous");
+    size_t i = 0;
+    if (Uint256_8way) {
+        for (; i + 8 <= count; i += 8) {
+            Uint256_8way(outputs + i, k0, k1, vals[i].begin());
+        }
+    }
+    for (; i < count; ++i) {
+        outputs[i] = SipHashUint256(k0, k1, vals[i]);
+    }
+}
+
+std::string SipHashAutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_xsave = (ecx >> 27) & 1;
+    const bool have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx && AVXEnabled()) {
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        if ((ebx >> 5) & 1) {
+            Uint256_8way = siphash_avx2::Uint256_8way;
+            ret += ",avx2(8way)";
+        }
+    }
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
@@ -6,6 +6,7 @@
 #define BITCOIN_CRYPTO_SIPHASH_H
 
 #include <stdint.h>
+#include <string>
 
 #include <uint256.h>
 
@@ -44,4 +45,14 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** Compute SipHashUint256(k0, k1, vals[i]) into outputs[i] for count values,
+ *  several at a time when a multi-way implementation is available.
+ */
+void SipHashUint256Multi(uint64_t k0, uint64_t k1, const uint256* vals, size_t count, uint64_t* outputs);
+
+/** Autodetect the best available SipHash implementation.
+ *  Returns the name of the implementation.
+ */
+std::string SipHashAutoDetect();
+
 #endif // BITCOIN_CRYPTO_SIPHASH_H
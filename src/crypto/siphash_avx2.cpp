@@ -0,0 +1,93 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace siphash_avx2 {
+namespace {
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+
+template <int n>
+__m256i inline Rotl(__m256i x) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+__m256i inline Rotl16(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_setr_epi8(6, 7, 0, 1, 2, 3, 4, 5, 14, 15, 8, 9, 10, 11, 12, 13, 6, 7, 0, 1, 2, 3, 4, 5, 14, 15, 8, 9, 10, 11, 12, 13)); }
+__m256i inline Rotl32(__m256i x) { return _mm256_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)); }
+
+/** Two SipRounds on two groups of four lanes, which interleave to hide the latency of each. */
+void inline __attribute__((always_inline)) SipRounds(__m256i* v0, __m256i* v1, __m256i* v2, __m256i* v3)
+{
+    for (int r = 0; r < 2; ++r) {
+        for (int g = 0; g < 2; ++g) {
+            v0[g] = Add(v0[g], v1[g]); v1[g] = Rotl<13>(v1[g]); v1[g] = Xor(v1[g], v0[g]);
+            v0[g] = Rotl32(v0[g]);
+            v2[g] = Add(v2[g], v3[g]); v3[g] = Rotl16(v3[g]); v3[g] = Xor(v3[g], v2[g]);
+            v0[g] = Add(v0[g], v3[g]); v3[g] = Rotl<21>(v3[g]); v3[g] = Xor(v3[g], v0[g]);
+            v2[g] = Add(v2[g], v1[g]); v1[g] = Rotl<17>(v1[g]); v1[g] = Xor(v1[g], v2[g]);
+            v2[g] = Rotl32(v2[g]);
+        }
+    }
+}
+
+/** Load the four 64-bit words of four consecutive 32-byte values, word w of all of them in d[w]. */
+void inline Load4(__m256i* d, const unsigned char* in)
+{
+    __m256i r0 = _mm256_loadu_si256((const __m256i*)in);
+    __m256i r1 = _mm256_loadu_si256((const __m256i*)(in + 32));
+    __m256i r2 = _mm256_loadu_si256((const __m256i*)(in + 64));
+    __m256i r3 = _mm256_loadu_si256((const __m256i*)(in + 96));
+    __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+    __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+    __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+    __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+    d[0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+    d[1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+    d[2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+    d[3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+}
+
+}
+
+void Uint256_8way(uint64_t* out, uint64_t k0, uint64_t k1, const unsigned char* in)
+{
+    // Group g has lanes 4 * g to 4 * g + 3, the values at in + 128 * g
+    __m256i d[2][4];
+    Load4(d[0], in);
+    Load4(d[1], in + 128);
+
+    __m256i v0[2], v1[2], v2[2], v3[2];
+    for (int g = 0; g < 2; ++g) {
+        v0[g] = K(0x736f6d6570736575ULL ^ k0);
+        v1[g] = K(0x646f72616e646f6dULL ^ k1);
+        v2[g] = K(0x6c7967656e657261ULL ^ k0);
+        v3[g] = K(0x7465646279746573ULL ^ k1);
+    }
+
+    for (int w = 0; w < 4; ++w) {
+        for (int g = 0; g < 2; ++g) v3[g] = Xor(v3[g], d[g][w]);
+        SipRounds(v0, v1, v2, v3);
+        for (int g = 0; g < 2; ++g) v0[g] = Xor(v0[g], d[g][w]);
+    }
+    for (int g = 0; g < 2; ++g) v3[g] = Xor(v3[g], K(((uint64_t)4) << 59));
+    SipRounds(v0, v1, v2, v3);
+    for (int g = 0; g < 2; ++g) {
+        v0[g] = Xor(v0[g], K(((uint64_t)4) << 59));
+        v2[g] = Xor(v2[g], K(0xFF));
+    }
+    SipRounds(v0, v1, v2, v3);
+    SipRounds(v0, v1, v2, v3);
+
+    for (int g = 0; g < 2; ++g) {
+        _mm256_storeu_si256((__m256i*)(out + 4 * g), Xor(Xor(v0[g], v1[g]), Xor(v2[g], v3[g])));
+    }
+}
+
+}
+
+#endif
@@ -14,6 +14,9 @@
 #include <utility>
 #include <vector>
 
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
 
 /** High-performance cache primitives.
  *
@@ -23,6 +26,9 @@
  *
  * 2. @ref cache is a cache which is performant in memory usage and lookup speed. It
  * is lockfree for erase operations. Elements are lazily erased on the next insert.
+ *
+ * 3. @ref sharded_cache splits a cache into independently locked segments, and
+ * counts how it is used.
  */
 namespace CuckooCache
 {
@@ -284,12 +290,15 @@ private:
      * scan succeeds, the epochs are aged and old elements are allow_erased. The
      * cheap heuristic is reset to retrigger after the worst case growth of the
      * current epoch's elements would exceed the epoch_size.
+     *
+     * @returns the number of elements that were allow_erased by aging
      */
-    void epoch_check()
+    uint32_t epoch_check()
     {
+        uint32_t aged = 0;
         if (epoch_heuristic_counter != 0) {
             --epoch_heuristic_counter;
-            return;
+            return aged;
         }
         // count the number of elements from the latest epoch which
         // have not been erased.
@@ -305,8 +314,10 @@ private:
             for (uint32_t i = 0; i < size; ++i)
                 if (epoch_flags[i])
                     epoch_flags[i] = false;
-                else
+                else if (!collection_flags.bit_is_set(i)) {
                     allow_erase(i);
+                    ++aged;
+                }
             epoch_heuristic_counter = epoch_size;
         } else
             // reset the epoch_heuristic_counter to next do a scan when worst
@@ -317,6 +328,7 @@ private:
             // < epoch_size` in this branch
             epoch_heuristic_counter = std::max(1u, std::max(epoch_size / 16,
                         epoch_size - epoch_unused_count));
+        return aged;
     }
 
 public:
@@ -388,10 +400,12 @@ public:
      * @post one of the following: All previously inserted elements and e are
      * now in the table, one previously inserted element is evicted from the
      * table, the entry attempted to be inserted is evicted.
+     * @returns the number of elements given up: the ones of the old epoch if
+     * this insert aged it, plus one if an element was dropped
      */
-    inline void insert(Element e)
+    inline uint32_t insert(Element e)
     {
-        epoch_check();
+        const uint32_t aged = epoch_check();
         uint32_t last_loc = invalid();
         bool last_epoch = true;
         std::array<uint32_t, 8> locs = compute_hashes(e);
@@ -401,7 +415,7 @@ public:
             if (table[loc] == e) {
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                return aged;
             }
         for (uint8_t depth = 0; depth < depth_limit; ++depth) {
             // First try to insert to an empty slot, if one exists
@@ -411,7 +425,7 @@ public:
                 table[loc] = std::move(e);
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                return aged;
             }
             /** Swap with the element at the location that was
             * not the last one looked at. Example:
@@ -437,6 +451,7 @@ public:
             // Recompute the locs -- unfortunately happens one too many times!
             locs = compute_hashes(e);
         }
+        return aged + 1;
     }
 
     /** contains iterates through the hash locations for a given element
@@ -477,6 +492,137 @@ public:
             }
         return false;
     }
+
+    /** collect appends the elements that are not marked for garbage
+     * collection to elements, for example to save the contents of the cache.
+     *
+     * Elements may be evicted later on insert, so after
+     * ```
+     * for (const Element& e : collected) fresh.insert(e);
+     * ```
+     * fresh contains at most the collected elements.
+     *
+     * @param elements the vector to append the elements to
+     */
+    void collect(std::vector<Element>& elements) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                elements.push_back(table[i]);
+    }
+};
+
+/** Usage counters of a @ref sharded_cache, since it was constructed. */
+struct cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t inserts;
+    //! Elements given up on insert to make room, as their epoch aged or as no slot was left for them
+    uint64_t evictions;
+    uint32_t max_elements;
+};
+
+/** @ref sharded_cache is a @ref cache split into Shards segments, each with
+ * its own lock, so that lookups and inserts from several threads mostly do not
+ * wait for each other. Unlike @ref cache it needs no external synchronization
+ * besides setup, which must happen before any other use.
+ *
+ * An element lives in the segment picked by the low bits of its first hash.
+ * The segment picks its locations from the high bits of the same hashes, so
+ * the segments are filled evenly and work as well as one table of their total
+ * size would.
+ *
+ * @tparam Shards the number of segments, a power of two
+ */
+template <typename Element, typename Hash, uint32_t Shards = 64>
+class sharded_cache
+{
+    static_assert(Shards > 0 && (Shards & (Shards - 1)) == 0, "Shards must be a power of two");
+
+    struct shard {
+        cache<Element, Hash> table;
+        mutable boost::shared_mutex mutex;
+        // The counters are kept per segment, so that threads using different
+        // segments do not write to the same memory
+        mutable std::atomic<uint64_t> hits{0};
+        mutable std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> inserts{0};
+        std::atomic<uint64_t> evictions{0};
+    };
+
+    std::unique_ptr<shard[]> shards;
+    uint32_t max_elements;
+    const Hash hash_function;
+
+    shard& shard_for(const Element& e) const
+    {
+        return shards[hash_function.template operator()<0>(e) & (Shards - 1)];
+    }
+
+public:
+    sharded_cache() : shards(new shard[Shards]), max_elements(0), hash_function() {}
+
+    /** setup_bytes sets up each segment with an equal part of bytes.
+     *
+     * @param bytes the approximate number of bytes to use for all segments
+     * @returns the maximum number of elements storable in all segments
+     */
+    uint32_t setup_bytes(size_t bytes)
+    {
+        max_elements = 0;
+        for (uint32_t i = 0; i < Shards; ++i) {
+            boost::unique_lock<boost::shared_mutex> lock(shards[i].mutex);
+            max_elements += shards[i].table.setup_bytes(bytes / Shards);
+        }
+        return max_elements;
+    }
+
+    /** insert inserts e into its segment, see @ref cache::insert */
+    void insert(Element e)
+    {
+        shard& s = shard_for(e);
+        uint32_t evicted;
+        {
+            boost::unique_lock<boost::shared_mutex> lock(s.mutex);
+            evicted = s.table.insert(std::move(e));
+        }
+        s.inserts.fetch_add(1, std::memory_order_relaxed);
+        if (evicted) s.evictions.fetch_add(evicted, std::memory_order_relaxed);
+    }
+
+    /** contains looks e up in its segment, see @ref cache::contains */
+    bool contains(const Element& e, const bool erase) const
+    {
+        const shard& s = shard_for(e);
+        bool found;
+        {
+            boost::shared_lock<boost::shared_mutex> lock(s.mutex);
+            found = s.table.contains(e, erase);
+        }
+        (found ? s.hits : s.misses).fetch_add(1, std::memory_order_relaxed);
+        return found;
+    }
+
+    /** collect appends the elements of all segments, see @ref cache::collect */
+    void collect(std::vector<Element>& elements) const
+    {
+        for (uint32_t i = 0; i < Shards; ++i) {
+            boost::shared_lock<boost::shared_mutex> lock(shards[i].mutex);
+            shards[i].table.collect(elements);
+        }
+    }
+
+    cache_stats stats() const
+    {
+        cache_stats ret{0, 0, 0, 0, max_elements};
+        for (uint32_t i = 0; i < Shards; ++i) {
+            ret.hits += shards[i].hits.load(std::memory_order_relaxed);
+            ret.misses += shards[i].misses.load(std::memory_order_relaxed);
+            ret.inserts += shards[i].inserts.load(std::memory_order_relaxed);
+            ret.evictions += shards[i].evictions.load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
 };
 } // namespace CuckooCache
 
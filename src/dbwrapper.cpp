@@ -6,13 +6,17 @@
 
 #include <memory>
 #include <random.h>
+#include <sync.h>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
 #include <memenv.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <algorithm>
+#include <set>
+#include <sstream>
 
 class CBitcoinLevelDBLogger : public leveldb::Logger {
 public:
@@ -72,6 +76,69 @@ public:
     }
 };
 
+namespace {
+/** Block cache that counts its hits and misses */
+class CountingCache : public leveldb::Cache
+{
+public:
+    explicit CountingCache(size_t capacity) : m_cache(leveldb::NewLRUCache(capacity)) {}
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge, void (*deleter)(const leveldb::Slice& key, void* value)) override
+    {
+        return m_cache->Insert(key, value, charge, deleter);
+    }
+    Handle* Lookup(const leveldb::Slice& key) override
+    {
+        Handle* handle = m_cache->Lookup(key);
+        (handle ? m_hits : m_misses)++;
+        return handle;
+    }
+    void Release(Handle* handle) override { m_cache->Release(handle); }
+    void* Value(Handle* handle) override { return m_cache->Value(handle); }
+    void Erase(const leveldb::Slice& key) override { m_cache->Erase(key); }
+    uint64_t NewId() override { return m_cache->NewId(); }
+    void Prune() override { m_cache->Prune(); }
+    size_t TotalCharge() const override { return m_cache->TotalCharge(); }
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+
+private:
+    const std::unique_ptr<leveldb::Cache> m_cache;
+};
+
+/** Bloom filter policy that counts the reads it saved. Filters do not
+ *  depend on the wrapper, so databases written without it read the same. */
+class CountingFilterPolicy : public leveldb::FilterPolicy
+{
+public:
+    explicit CountingFilterPolicy(int bits_per_key) : m_policy(leveldb::NewBloomFilterPolicy(bits_per_key)) {}
+
+    const char* Name() const override { return m_policy->Name(); }
+    void CreateFilter(const leveldb::Slice* keys, int n, std::string* dst) const override
+    {
+        m_policy->CreateFilter(keys, n, dst);
+    }
+    bool KeyMayMatch(const leveldb::Slice& key, const leveldb::Slice& filter) const override
+    {
+        m_checks++;
+        if (m_policy->KeyMayMatch(key, filter)) return true;
+        m_useful++;
+        return false;
+    }
+
+    mutable std::atomic<uint64_t> m_checks{0};
+    mutable std::atomic<uint64_t> m_useful{0};
+
+private:
+    const std::unique_ptr<const leveldb::FilterPolicy> m_policy;
+};
+
+//! All open databases, for GetAllDBStats
+Mutex g_dbwrappers_mutex;
+std::set<const CDBWrapper*> g_dbwrappers GUARDED_BY(g_dbwrappers_mutex);
+} // namespace
+
 static void SetMaxOpenFiles(leveldb::Options *options) {
     // On most platforms the default setting of max_open_files (which is 1000)
     // is optimal. On Windows using a large file count is OK because the handles
@@ -97,12 +164,12 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static leveldb::Options GetOptions(size_t nCacheSize, const DBTuning& tuning)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.block_cache = new CountingCache(nCacheSize / 100 * tuning.block_cache_percent);
+    options.write_buffer_size = nCacheSize / 200 * (100 - tuning.block_cache_percent); // up to two write buffers may be held in memory simultaneously
+    options.filter_policy = tuning.bloom_bits > 0 ? new CountingFilterPolicy(tuning.bloom_bits) : nullptr;
     options.compression = leveldb::kNoCompression;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -114,7 +181,7 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const DBTuning& tuning)
     : m_name{path.stem().string()}
 {
     penv = nullptr;
@@ -122,7 +189,8 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, tuning);
+    m_cache_size = nCacheSize / 100 * tuning.block_cache_percent;
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -164,10 +232,17 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     }
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(), HexStr(obfuscate_key));
+
+    LOCK(g_dbwrappers_mutex);
+    g_dbwrappers.insert(this);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    {
+        LOCK(g_dbwrappers_mutex);
+        g_dbwrappers.erase(this);
+    }
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -189,6 +264,7 @@ bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
     }
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     dbwrapper_private::HandleError(status);
+    m_bytes_written += batch.SizeEstimate();
     if (log_memory) {
         double mem_after = DynamicMemoryUsage() / 1024.0 / 1024;
         LogPrint(BCLog::LEVELDB, "WriteBatch memory usage: db=%s, before=%.1fMiB, after=%.1fMiB\n",
@@ -206,6 +282,53 @@ size_t CDBWrapper::DynamicMemoryUsage() const {
     return stoul(memory);
 }
 
+DBStats CDBWrapper::GetStats() const
+{
+    DBStats stats;
+    stats.name = m_name;
+    stats.reads = m_reads;
+    stats.bytes_read = m_bytes_read;
+    stats.bytes_written = m_bytes_written;
+    const CountingCache* cache = static_cast<const CountingCache*>(options.block_cache);
+    stats.cache_size = m_cache_size;
+    stats.cache_usage = cache->TotalCharge();
+    stats.cache_hits = cache->m_hits;
+    stats.cache_misses = cache->m_misses;
+    if (options.filter_policy) {
+        const CountingFilterPolicy* policy = static_cast<const CountingFilterPolicy*>(options.filter_policy);
+        stats.bloom_checks = policy->m_checks;
+        stats.bloom_useful = policy->m_useful;
+    }
+    stats.memory_usage = DynamicMemoryUsage();
+
+    // Skip the three header lines of the table, then read one row per level.
+    std::string table;
+    if (pdb->GetProperty("leveldb.stats", &table)) {
+        std::istringstream lines(table);
+        std::string line;
+        for (int header = 0; header < 3 && std::getline(lines, line); header++) {}
+        while (std::getline(lines, line)) {
+            DBStats::Level level;
+            if (sscanf(line.c_str(), "%d %d %lf %lf %lf %lf", &level.level, &level.files, &level.size_mb,
+                       &level.compaction_seconds, &level.compaction_read_mb, &level.compaction_write_mb) == 6) {
+                stats.levels.push_back(level);
+            }
+        }
+    }
+    return stats;
+}
+
+std::vector<DBStats> GetAllDBStats()
+{
+    std::vector<DBStats> all;
+    LOCK(g_dbwrappers_mutex);
+    for (const CDBWrapper* db : g_dbwrappers) {
+        all.push_back(db->GetStats());
+    }
+    std::sort(all.begin(), all.end(), [](const DBStats& a, const DBStats& b) { return a.name < b.name; });
+    return all;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
@@ -255,4 +378,20 @@ const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w)
     return w.obfuscate_key;
 }
 
+void Xor(Span<unsigned char> data, const std::vector<unsigned char>& key)
+{
+    if (std::all_of(key.begin(), key.end(), [](unsigned char c) { return c == 0; })) {
+        return;
+    }
+    for (std::ptrdiff_t i = 0, j = 0; i != data.size(); i++) {
+        data[i] ^= key[j++];
+        if (j == (std::ptrdiff_t)key.size()) j = 0;
+    }
+}
+
+bool IsObfuscated(const CDBWrapper &w)
+{
+    return !std::all_of(w.obfuscate_key.begin(), w.obfuscate_key.end(), [](unsigned char c) { return c == 0; });
+}
+
 } // namespace dbwrapper_private
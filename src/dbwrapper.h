@@ -12,6 +12,10 @@
 #include <util/system.h>
 #include <util/strencodings.h>
 
+#include <atomic>
+#include <string>
+#include <vector>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -40,6 +44,14 @@ void HandleError(const leveldb::Status& status);
  */
 const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w);
 
+/** Deobfuscate a value read from the database in place. A no-op for databases
+ * created without obfuscation, whose key is all zeros.
+ */
+void Xor(Span<unsigned char> data, const std::vector<unsigned char>& key);
+
+/** Whether values read from the database have to be deobfuscated. */
+bool IsObfuscated(const CDBWrapper &w);
+
 };
 
 /** Batch of changes queued to be written to a CDBWrapper */
@@ -118,6 +130,9 @@ class CDBIterator
 private:
     const CDBWrapper &parent;
     leveldb::Iterator *piter;
+    const bool obfuscated;
+    //! Reused to deobfuscate values
+    std::vector<unsigned char> m_value;
 
 public:
 
@@ -126,7 +141,7 @@ public:
      * @param[in] _piter           The original leveldb iterator.
      */
     CDBIterator(const CDBWrapper &_parent, leveldb::Iterator *_piter) :
-        parent(_parent), piter(_piter) { };
+        parent(_parent), piter(_piter), obfuscated(dbwrapper_private::IsObfuscated(_parent)) { };
     ~CDBIterator();
 
     bool Valid() const;
@@ -156,25 +171,79 @@ public:
 
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
+        const unsigned char* begin = reinterpret_cast<const unsigned char*>(slValue.data());
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
-            ssValue >> value;
+            if (!obfuscated) {
+                // The slice stays valid until the iterator moves, so read it in place.
+                SpanReader(SER_DISK, CLIENT_VERSION, Span<const unsigned char>(begin, slValue.size())) >> value;
+            } else {
+                // Deobfuscate into a buffer whose capacity is kept across entries.
+                m_value.assign(begin, begin + slValue.size());
+                dbwrapper_private::Xor(MakeSpan(m_value), dbwrapper_private::GetObfuscateKey(parent));
+                SpanReader(SER_DISK, CLIENT_VERSION, Span<const unsigned char>(m_value.data(), m_value.size())) >> value;
+            }
         } catch (const std::exception&) {
             return false;
         }
         return true;
     }
 
+    /** Copy out the deobfuscated value, to be deserialized later and elsewhere. */
+    void GetValueBytes(std::vector<unsigned char>& bytes) {
+        leveldb::Slice slValue = piter->value();
+        const unsigned char* begin = reinterpret_cast<const unsigned char*>(slValue.data());
+        bytes.assign(begin, begin + slValue.size());
+        if (obfuscated) dbwrapper_private::Xor(MakeSpan(bytes), dbwrapper_private::GetObfuscateKey(parent));
+    }
+
     unsigned int GetValueSize() {
         return piter->value().size();
     }
 
 };
 
+/** How a database divides its cache between reads and writes, and how it filters reads */
+struct DBTuning {
+    //! Percentage of the cache size used as block cache. The rest is split
+    //! between the two write buffers LevelDB may hold at a time.
+    int block_cache_percent{50};
+    //! Bloom filter bits per key, or 0 for no filter
+    int bloom_bits{10};
+};
+
+/** Counters and LevelDB statistics of one database, for getdbstats */
+struct DBStats {
+    std::string name;
+    //! Reads and writes through CDBWrapper, with the size of their values
+    uint64_t reads{0};
+    uint64_t bytes_read{0};
+    uint64_t bytes_written{0};
+    //! Block cache capacity, charge and lookups
+    uint64_t cache_size{0};
+    uint64_t cache_usage{0};
+    uint64_t cache_hits{0};
+    uint64_t cache_misses{0};
+    //! Bloom filter checks, and those that saved reading a block
+    uint64_t bloom_checks{0};
+    uint64_t bloom_useful{0};
+    size_t memory_usage{0};
+
+    /** One level of the LSM tree, from "leveldb.stats" */
+    struct Level {
+        int level{0};
+        int files{0};
+        double size_mb{0};
+        double compaction_seconds{0};
+        double compaction_read_mb{0};
+        double compaction_write_mb{0};
+    };
+    std::vector<Level> levels;
+};
+
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend bool dbwrapper_private::IsObfuscated(const CDBWrapper &w);
 private:
     //! custom environment this database is using (may be nullptr in case of default environment)
     leveldb::Env* penv;
@@ -211,6 +280,14 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! Reads and writes through this wrapper, see DBStats
+    mutable std::atomic<uint64_t> m_reads{0};
+    mutable std::atomic<uint64_t> m_bytes_read{0};
+    std::atomic<uint64_t> m_bytes_written{0};
+
+    //! Block cache capacity given to LevelDB
+    size_t m_cache_size{0};
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -219,8 +296,9 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] tuning      How to divide nCacheSize, and the bloom filter to use.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const DBTuning& tuning = {});
     ~CDBWrapper();
 
     CDBWrapper(const CDBWrapper&) = delete;
@@ -236,16 +314,20 @@ public:
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        m_reads++;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             dbwrapper_private::HandleError(status);
         }
+        m_bytes_read += strValue.size();
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(obfuscate_key);
-            ssValue >> value;
+            // LevelDB has already copied the value out, so deobfuscate and
+            // deserialize it where it is rather than copying it into a stream.
+            unsigned char* data = reinterpret_cast<unsigned char*>(&strValue[0]);
+            dbwrapper_private::Xor(Span<unsigned char>(data, strValue.size()), obfuscate_key);
+            SpanReader(SER_DISK, CLIENT_VERSION, Span<const unsigned char>(data, strValue.size())) >> value;
         } catch (const std::exception&) {
             return false;
         }
@@ -270,12 +352,14 @@ public:
 
         std::string strValue;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        m_reads++;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             dbwrapper_private::HandleError(status);
         }
+        m_bytes_read += strValue.size();
         return true;
     }
 
@@ -292,6 +376,9 @@ public:
     // Get an estimate of LevelDB memory usage (in bytes).
     size_t DynamicMemoryUsage() const;
 
+    //! Counters and LevelDB statistics of this database.
+    DBStats GetStats() const;
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush()
     {
@@ -348,4 +435,7 @@ public:
 
 };
 
+//! Statistics of all open databases.
+std::vector<DBStats> GetAllDBStats();
+
 #endif // BITCOIN_DBWRAPPER_H
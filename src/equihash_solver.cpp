@@ -0,0 +1,309 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <equihash_solver.h>
+
+#include <compat/endian.h>
+#include <support/allocators/hugepage.h>
+#include <util/memory.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <utility>
+
+namespace {
+
+/** The reference solver, one std::vector per row. */
+class BasicEquihashSolver : public EquihashSolver
+{
+public:
+    std::string GetName() const override { return "basic"; }
+
+    bool Solve(unsigned int n, unsigned int k, const eh_HashState& base_state,
+               const std::function<bool(std::vector<unsigned char>)> validBlock,
+               const std::function<bool(EhSolverCancelCheck)> cancelled) const override
+    {
+        return EhBasicSolve(n, k, base_state, validBlock, cancelled);
+    }
+};
+
+/** The reference solver working on truncated indices. */
+class OptimisedEquihashSolver : public EquihashSolver
+{
+public:
+    std::string GetName() const override { return "optimised"; }
+
+    bool Solve(unsigned int n, unsigned int k, const eh_HashState& base_state,
+               const std::function<bool(std::vector<unsigned char>)> validBlock,
+               const std::function<bool(EhSolverCancelCheck)> cancelled) const override
+    {
+        return EhOptimisedSolve(n, k, base_state, validBlock, cancelled);
+    }
+};
+
+/**
+ * Wagner's algorithm on flat tables. Each round keeps the remaining hash
+ * bytes of a row in one contiguous buffer and remembers the two rows of the
+ * previous round it was made of, instead of carrying the growing index list
+ * along. Rows are bucketed on the leading bits of the next collision with a
+ * counting sort, and the buckets are split across worker threads. The number
+ * of rows a round may produce is capped, which bounds memory at a small
+ * multiple of the initial list.
+ */
+class BucketEquihashSolver : public EquihashSolver
+{
+private:
+    //! Leading collision bits used to pick a bucket
+    static const size_t BUCKET_BITS = 12;
+    //! Rows a round may produce, as a multiple of the initial list size
+    static const size_t MAX_ROWS_FACTOR = 2;
+
+    // The tables are what the solver spends its memory on, and are
+    // accessed at random, so they are backed by huge pages if enabled.
+    typedef std::vector<unsigned char, hugepage_allocator<unsigned char>> HashVector;
+    typedef std::vector<std::pair<uint32_t, uint32_t>, hugepage_allocator<std::pair<uint32_t, uint32_t>>> ParentVector;
+
+    struct Table {
+        //! Hash bytes still to be collided, per row
+        size_t width;
+        //! width bytes per row
+        HashVector hashes;
+        //! Rows of the previous table this row was made of; empty for the leaves
+        ParentVector parents;
+
+        size_t size() const { return hashes.size() / width; }
+    };
+
+    struct Output {
+        std::vector<unsigned char> hashes;
+        std::vector<std::pair<uint32_t, uint32_t>> parents;
+    };
+
+    const int m_threads;
+
+    static uint64_t ReadKey(const unsigned char* p, size_t len)
+    {
+        uint64_t key = 0;
+        for (size_t i = 0; i < len; i++) {
+            key = (key << 8) | p[i];
+        }
+        return key;
+    }
+
+    /** Run f(t) for t in [0, nThreads), the first one on the calling thread. */
+    static void RunThreads(int nThreads, const std::function<void(int)>& f)
+    {
+        std::vector<std::thread> threads;
+        for (int t = 1; t < nThreads; t++) {
+            threads.emplace_back(f, t);
+        }
+        f(0);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /** Append the leaf indices below row of tables[round], ordered as a solution requires. */
+    static void CollectIndices(const std::vector<Table>& tables, size_t round, uint32_t row, std::vector<eh_index>& out)
+    {
+        if (round == 0) {
+            out.push_back(row);
+            return;
+        }
+        const std::pair<uint32_t, uint32_t>& parent = tables[round].parents[row];
+        MergeIndices(tables, round - 1, parent.first, parent.second, out);
+    }
+
+    static void MergeIndices(const std::vector<Table>& tables, size_t round, uint32_t a, uint32_t b, std::vector<eh_index>& out)
+    {
+        size_t first = out.size();
+        CollectIndices(tables, round, a, out);
+        size_t second = out.size();
+        CollectIndices(tables, round, b, out);
+        if (out[second] < out[first]) {
+            std::rotate(out.begin() + first, out.begin() + second, out.end());
+        }
+    }
+
+public:
+    explicit BucketEquihashSolver(int nThreads) : m_threads(nThreads > 0 ? nThreads : std::max(1, GetNumCores())) {}
+
+    std::string GetName() const override { return "bucket"; }
+
+    bool Solve(unsigned int n, unsigned int k, const eh_HashState& base_state,
+               const std::function<bool(std::vector<unsigned char>)> validBlock,
+               const std::function<bool(EhSolverCancelCheck)> cancelled) const override
+    {
+        // Throws std::invalid_argument for unsupported parameters.
+        EhSolutionWidth(n, k);
+
+        const size_t collision_bits = n / (k + 1);
+        const size_t collision_bytes = (collision_bits + 7) / 8;
+        const size_t hash_length = (k + 1) * collision_bytes;
+        const size_t indices_per_hash = 512 / n;
+        const size_t hash_output = indices_per_hash * n / 8;
+        const size_t init_size = size_t{1} << (collision_bits + 1);
+        const size_t bucket_bits = std::min(collision_bits, BUCKET_BITS);
+        const size_t buckets = size_t{1} << bucket_bits;
+        const size_t max_rows_per_thread = MAX_ROWS_FACTOR * init_size / m_threads + 1;
+
+        std::vector<Table> tables(k);
+
+        // 1) Generate the leaves. Row i is index i.
+        tables[0].width = hash_length;
+        tables[0].hashes.resize(init_size * hash_length);
+        RunThreads(m_threads, [&](int t) {
+            size_t begin = init_size * t / m_threads;
+            size_t end = init_size * (t + 1) / m_threads;
+            std::vector<unsigned char> tmp_hash(hash_output);
+            for (size_t i = begin; i < end; i++) {
+                if (i == begin || i % indices_per_hash == 0) {
+                    eh_HashState state = base_state;
+                    eh_index lei = htole32(i / indices_per_hash);
+                    crypto_generichash_blake2b_update(&state, (const unsigned char*) &lei, sizeof(eh_index));
+                    crypto_generichash_blake2b_final(&state, tmp_hash.data(), hash_output);
+                }
+                ExpandArray(tmp_hash.data() + (i % indices_per_hash) * n / 8, n / 8,
+                            tables[0].hashes.data() + i * hash_length, hash_length, collision_bits);
+            }
+        });
+        if (cancelled(ListGeneration)) throw EhSolverCancelledException();
+
+        std::vector<std::pair<uint32_t, uint32_t>> candidates;
+        for (size_t r = 0; r < k; r++) {
+            const bool final_round = r + 1 == k;
+            Table& table = tables[r];
+            const size_t rows = table.size();
+            // The last round collides on everything that is left.
+            const size_t key_bytes = final_round ? 2 * collision_bytes : collision_bytes;
+            const size_t shift = collision_bits - bucket_bits;
+
+            // 2) Counting sort on the leading collision bits.
+            std::vector<size_t> bucket_start(buckets + 1, 0);
+            for (size_t i = 0; i < rows; i++) {
+                bucket_start[1 + (ReadKey(&table.hashes[i * table.width], collision_bytes) >> shift)]++;
+            }
+            for (size_t b = 0; b < buckets; b++) {
+                bucket_start[b + 1] += bucket_start[b];
+            }
+            std::vector<std::pair<uint64_t, uint32_t>, hugepage_allocator<std::pair<uint64_t, uint32_t>>> sorted(rows);
+            {
+                std::vector<size_t> next(bucket_start.begin(), bucket_start.end() - 1);
+                for (size_t i = 0; i < rows; i++) {
+                    const unsigned char* hash = &table.hashes[i * table.width];
+                    uint64_t key = ReadKey(hash, key_bytes);
+                    sorted[next[ReadKey(hash, collision_bytes) >> shift]++] = std::make_pair(key, (uint32_t)i);
+                }
+            }
+            if (cancelled(final_round ? FinalSorting : ListSorting)) throw EhSolverCancelledException();
+
+            // 3) Collide within each bucket. Buckets are split statically so
+            // that the output does not depend on thread scheduling.
+            const size_t out_width = table.width - collision_bytes;
+            std::vector<Output> outputs(m_threads);
+            std::vector<std::vector<std::pair<uint32_t, uint32_t>>> thread_candidates(m_threads);
+            RunThreads(m_threads, [&](int t) {
+                Output& out = outputs[t];
+                size_t produced = 0;
+                std::vector<unsigned char> xored(out_width);
+                for (size_t b = buckets * t / m_threads; b < buckets * (t + 1) / m_threads; b++) {
+                    auto begin = sorted.begin() + bucket_start[b];
+                    auto end = sorted.begin() + bucket_start[b + 1];
+                    std::sort(begin, end);
+                    for (auto run = begin; run != end;) {
+                        auto run_end = run + 1;
+                        while (run_end != end && run_end->first == run->first) ++run_end;
+                        for (auto x = run; x != run_end; ++x) {
+                            for (auto y = x + 1; y != run_end; ++y) {
+                                if (final_round) {
+                                    thread_candidates[t].emplace_back(x->second, y->second);
+                                    continue;
+                                }
+                                if (produced >= max_rows_per_thread) continue;
+                                const unsigned char* a = &table.hashes[x->second * table.width];
+                                const unsigned char* c = &table.hashes[y->second * table.width];
+                                bool zero = true;
+                                for (size_t j = 0; j < out_width; j++) {
+                                    xored[j] = a[collision_bytes + j] ^ c[collision_bytes + j];
+                                    zero &= xored[j] == 0;
+                                }
+                                // Rows that cancel out completely are built
+                                // from the same leaves.
+                                if (zero) continue;
+                                out.hashes.insert(out.hashes.end(), xored.begin(), xored.end());
+                                out.parents.emplace_back(x->second, y->second);
+                                produced++;
+                            }
+                        }
+                        run = run_end;
+                    }
+                }
+            });
+
+            // The hashes of this round are no longer needed, only the parents.
+            HashVector().swap(table.hashes);
+
+            if (final_round) {
+                for (const auto& c : thread_candidates) {
+                    candidates.insert(candidates.end(), c.begin(), c.end());
+                }
+                if (cancelled(FinalColliding)) throw EhSolverCancelledException();
+                break;
+            }
+
+            Table& next = tables[r + 1];
+            next.width = out_width;
+            size_t total = 0;
+            for (const Output& out : outputs) total += out.parents.size();
+            next.hashes.reserve(total * out_width);
+            next.parents.reserve(total);
+            for (Output& out : outputs) {
+                next.hashes.insert(next.hashes.end(), out.hashes.begin(), out.hashes.end());
+                next.parents.insert(next.parents.end(), out.parents.begin(), out.parents.end());
+                std::vector<unsigned char>().swap(out.hashes);
+            }
+            if (cancelled(ListColliding)) throw EhSolverCancelledException();
+            if (cancelled(RoundEnd)) throw EhSolverCancelledException();
+        }
+
+        // 4) Rebuild the index lists and hand over the valid ones.
+        std::set<std::vector<eh_index>> seen;
+        for (const auto& candidate : candidates) {
+            std::vector<eh_index> indices;
+            indices.reserve(size_t{1} << k);
+            MergeIndices(tables, k - 1, candidate.first, candidate.second, indices);
+
+            std::vector<eh_index> sorted_indices(indices);
+            std::sort(sorted_indices.begin(), sorted_indices.end());
+            if (std::adjacent_find(sorted_indices.begin(), sorted_indices.end()) != sorted_indices.end()) continue;
+            if (!seen.insert(sorted_indices).second) continue;
+
+            std::vector<unsigned char> soln = GetMinimalFromIndices(indices, collision_bits);
+            bool valid;
+            EhIsValidSolution(n, k, base_state, soln, valid);
+            if (valid && validBlock(soln)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+} // namespace
+
+std::unique_ptr<EquihashSolver> MakeEquihashSolver(const std::string& name, int nThreads)
+{
+    if (name == "basic") return MakeUnique<BasicEquihashSolver>();
+    if (name == "optimised") return MakeUnique<OptimisedEquihashSolver>();
+    if (name == "bucket") return MakeUnique<BucketEquihashSolver>(nThreads);
+    return nullptr;
+}
+
+std::string EquihashSolverNames()
+{
+    return "basic, optimised, bucket";
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_EQUIHASH_SOLVER_H
+#define LITECOINZ_EQUIHASH_SOLVER_H
+
+#include <crypto/equihash.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** Solver used by the mining RPCs unless -equihashsolver says otherwise */
+static const char* const DEFAULT_EQUIHASH_SOLVER = "bucket";
+
+/**
+ * An Equihash solver back end. Implementations are selected by name with
+ * -equihashsolver and must be safe to call from several threads at once.
+ */
+class EquihashSolver
+{
+public:
+    virtual ~EquihashSolver() {}
+
+    /** Name accepted by -equihashsolver. */
+    virtual std::string GetName() const = 0;
+
+    /**
+     * Search for solutions of the (n, k) instance described by base_state.
+     * validBlock is called for every solution found and ends the search by
+     * returning true. cancelled is polled between phases; when it returns true
+     * EhSolverCancelledException is thrown.
+     *
+     * @return true if validBlock accepted a solution.
+     */
+    virtual bool Solve(unsigned int n, unsigned int k, const eh_HashState& base_state,
+                       const std::function<bool(std::vector<unsigned char>)> validBlock,
+                       const std::function<bool(EhSolverCancelCheck)> cancelled) const = 0;
+};
+
+/**
+ * Create the solver called name, using up to nThreads worker threads (0 means
+ * one per core; not every solver is threaded). Returns nullptr if no solver
+ * has that name.
+ */
+std::unique_ptr<EquihashSolver> MakeEquihashSolver(const std::string& name, int nThreads = 0);
+
+/** Comma-separated list of the names MakeEquihashSolver accepts. */
+std::string EquihashSolverNames();
+
+#endif // LITECOINZ_EQUIHASH_SOLVER_H
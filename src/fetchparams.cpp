@@ -17,6 +17,10 @@
 #include <string>
 #include <sodium.h>
 
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
+
 #include <curl/curl.h>
 
 #include <boost/thread.hpp>
@@ -24,8 +28,55 @@
 std::string filename;
 int reportDone;
 
-bool VerifyParams(const fs::path& path, std::string sha256expected)
+/** Sidecar file holding the stamp of the last successful check of path */
+static fs::path VerifiedStampPath(const fs::path& path)
+{
+    return path.parent_path() / (path.filename().string() + ".verified");
+}
+
+/** Size, modification time and inode of path, plus the hash it was checked against */
+static std::string VerifiedStamp(const fs::path& path, const std::string& sha256expected)
+{
+    uint64_t inode = 0;
+#ifndef WIN32
+    struct stat st;
+    if (stat(path.string().c_str(), &st) == 0) {
+        inode = st.st_ino;
+    }
+#endif
+    return strprintf("%u %d %u %s", (uint64_t)fs::file_size(path), (int64_t)fs::last_write_time(path), inode, sha256expected);
+}
+
+static bool IsVerifiedStampCurrent(const fs::path& path, const std::string& sha256expected)
+{
+    fsbridge::ifstream file(VerifiedStampPath(path));
+    std::string stamp;
+    if (!file.good() || !std::getline(file, stamp)) {
+        return false;
+    }
+    return stamp == VerifiedStamp(path, sha256expected);
+}
+
+static void WriteVerifiedStamp(const fs::path& path, const std::string& sha256expected)
+{
+    fsbridge::ofstream file(VerifiedStampPath(path));
+    file << VerifiedStamp(path, sha256expected) << "\n";
+    if (!file.good()) {
+        LogPrintf("Warning: Could not record the check of %s\n", path.string());
+    }
+}
+
+bool VerifyParams(const fs::path& path, std::string sha256expected, bool fFullCheck)
 {
+    try {
+        if (!fFullCheck && IsVerifiedStampCurrent(path, sha256expected)) {
+            LogPrintf("Skipping verification of %s, unchanged since its last check\n", path.string());
+            return true;
+        }
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("Warning: Could not stat %s: %s\n", path.string(), e.what());
+    }
+
     FILE *file = fsbridge::fopen(path, "rb");
     filename = path.filename().string();
 
@@ -68,8 +119,15 @@ bool VerifyParams(const fs::path& path, std::string sha256expected)
 
         if (!(sha256expected.compare(oss.str()) == 0)) {
             fs::remove(path);
+            fs::remove(VerifiedStampPath(path));
             return error("VerifyParams(): sha256 checksum mismatch %s", oss.str());
         }
+
+        try {
+            WriteVerifiedStamp(path, sha256expected);
+        } catch (const fs::filesystem_error& e) {
+            LogPrintf("Warning: Could not record the check of %s: %s\n", path.string(), e.what());
+        }
     } else {
         LogPrintf("Warning: Could not open file %s\n", path.string());
         return false;
@@ -12,7 +12,12 @@
 
 #include <string>
 
-bool VerifyParams(const fs::path& path, std::string sha256expected);
+/**
+ * Check the SHA256 of a parameter file. After a successful check the file's
+ * size, modification time and inode are recorded next to it, and later calls
+ * skip hashing a file that still matches them unless fFullCheck is set.
+ */
+bool VerifyParams(const fs::path& path, std::string sha256expected, bool fFullCheck = false);
 bool FetchParams(std::string url, const fs::path& path);
 
 #endif // LITECOINZ_FETCHPARAMS_H
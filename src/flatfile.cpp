@@ -10,6 +10,13 @@
 #include <tinyformat.h>
 #include <util/system.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 FlatFileSeq::FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size) :
     m_dir(std::move(dir)),
     m_prefix(prefix),
@@ -96,3 +103,67 @@ bool FlatFileSeq::Flush(const FlatFilePos& pos, bool finalize)
     fclose(file);
     return true;
 }
+
+std::unique_ptr<MappedFile> MappedFile::Open(const fs::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // The map stays valid after the descriptor is closed.
+    close(fd);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    return std::unique_ptr<MappedFile>(new MappedFile(static_cast<const unsigned char*>(data), st.st_size));
+#else
+    return nullptr;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const MappedFile> FlatFileMapCache::Get(const FlatFileSeq& seq, const FlatFilePos& pos, size_t length)
+{
+    if (m_max_files == 0 || pos.IsNull()) {
+        return nullptr;
+    }
+    const size_t end = (size_t)pos.nPos + length;
+
+    LOCK(m_mutex);
+    auto it = m_maps.begin();
+    while (it != m_maps.end() && it->first != pos.nFile) ++it;
+    if (it != m_maps.end()) {
+        if ((size_t)it->second->Data().size() >= end) {
+            m_maps.splice(m_maps.begin(), m_maps, it);
+            return it->second;
+        }
+        // The file has grown since it was mapped.
+        m_maps.erase(it);
+    }
+
+    std::shared_ptr<const MappedFile> map = MappedFile::Open(seq.FileName(pos));
+    if (!map || (size_t)map->Data().size() < end) {
+        return nullptr;
+    }
+    m_maps.emplace_front(pos.nFile, map);
+    if (m_maps.size() > m_max_files) m_maps.pop_back();
+    return map;
+}
+
+void FlatFileMapCache::Invalidate(int nFile)
+{
+    LOCK(m_mutex);
+    m_maps.remove_if([nFile](const std::pair<int, std::shared_ptr<const MappedFile>>& entry) { return entry.first == nFile; });
+}
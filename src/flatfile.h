@@ -6,10 +6,14 @@
 #ifndef BITCOIN_FLATFILE_H
 #define BITCOIN_FLATFILE_H
 
+#include <list>
+#include <memory>
 #include <string>
 
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
+#include <sync.h>
 
 struct FlatFilePos
 {
@@ -48,6 +52,11 @@ struct FlatFilePos
 /**
  * FlatFileSeq represents a sequence of numbered files storing raw data. This class facilitates
  * access to and efficient management of these files.
+ *
+ * The data is stored uncompressed, so that a FlatFilePos is a plain file offset that other
+ * versions, -reindex, external tools and FlatFileMapCache can use directly. Compression would
+ * gain little on block and undo files: most of a shielded transaction is note ciphertexts,
+ * proofs and signatures, which do not compress.
  */
 class FlatFileSeq
 {
@@ -93,4 +102,52 @@ public:
     bool Flush(const FlatFilePos& pos, bool finalize = false);
 };
 
+/** A read-only memory map of a whole file. */
+class MappedFile
+{
+private:
+    const unsigned char* m_data;
+    size_t m_size;
+
+    MappedFile(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+
+public:
+    /** Map the file at path, or return nullptr when it cannot be mapped. */
+    static std::unique_ptr<MappedFile> Open(const fs::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    Span<const unsigned char> Data() const { return Span<const unsigned char>(m_data, m_size); }
+};
+
+/**
+ * A bounded cache of memory maps of the files of a FlatFileSeq, so that reads
+ * need not open, seek and copy the file each time. The least recently used
+ * maps are dropped first; readers keep the map they got alive.
+ */
+class FlatFileMapCache
+{
+private:
+    const size_t m_max_files;
+
+    Mutex m_mutex;
+    //! Most recently used first
+    std::list<std::pair<int, std::shared_ptr<const MappedFile>>> m_maps GUARDED_BY(m_mutex);
+
+public:
+    explicit FlatFileMapCache(size_t max_files) : m_max_files(max_files) {}
+
+    /**
+     * Get a map of the file at pos that holds at least length bytes from pos,
+     * remapping the file if it has grown. Returns nullptr when the file cannot
+     * be mapped or is too short, in which case the caller reads it instead.
+     */
+    std::shared_ptr<const MappedFile> Get(const FlatFileSeq& seq, const FlatFilePos& pos, size_t length);
+
+    /** Drop the map of a file, before it is truncated or removed. */
+    void Invalidate(int nFile);
+};
+
 #endif // BITCOIN_FLATFILE_H
@@ -0,0 +1,438 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATMAP_H
+#define BITCOIN_FLATMAP_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memusage.h>
+#include <support/allocators/hugepage.h>
+
+#include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash map for large numbers of small entries, used for the coins cache.
+ *
+ * Entries live in a pool of arrays that grow geometrically, so there is no
+ * allocation (nor allocator overhead) per entry, and an entry never moves
+ * once it is inserted. The table itself uses open addressing with linear
+ * probing: one byte of control data per slot, holding 7 bits of the hash of
+ * the entry in that slot, and a 32 bit index of the entry in the pool, so
+ * five bytes per slot. A lookup scans the control bytes and only visits an
+ * entry whose hash bits match, so a miss rarely touches more than one cache
+ * line of the table besides the index.
+ * Removal leaves a tombstone, which keeps iterators to other entries valid.
+ *
+ * Like std::unordered_map, references to entries stay valid until the entry
+ * is erased, and iterators are invalidated by an insertion that grows the
+ * table. Unlike std::unordered_map, clear() releases all memory, and memory of
+ * erased entries is reused for later insertions rather than returned.
+ */
+template <typename K, typename T, typename Hash>
+class flatmap
+{
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<const K, T> value_type;
+    typedef size_t size_type;
+
+private:
+    //! Control byte of a slot that never held an entry.
+    static const uint8_t CTRL_EMPTY = 0;
+    //! Control byte of a slot whose entry was erased.
+    static const uint8_t CTRL_DELETED = 1;
+    //! Set in the control byte of a slot holding an entry, with 7 bits of its hash.
+    static const uint8_t CTRL_FULL = 0x80;
+
+    static const size_t MIN_CAPACITY = 8;
+    //! Entries in the first pool array; each next one is twice as large,
+    //! until RAMP_CHUNKS arrays are allocated. All later ones hold MAX_CHUNK.
+    static const size_t MIN_CHUNK = 4;
+    static const size_t RAMP_CHUNKS = 10;
+    static const size_t MAX_CHUNK = MIN_CHUNK << RAMP_CHUNKS;
+    //! Entries in the first RAMP_CHUNKS arrays.
+    static const size_t RAMP_NODES = MAX_CHUNK - MIN_CHUNK;
+    //! Free list terminator.
+    static const uint32_t NO_NODE = 0xffffffff;
+
+    //! Storage for one entry; holds the free list link while it is unused.
+    union Node {
+        value_type value;
+        uint32_t next_free;
+        Node() : next_free(NO_NODE) {}
+        ~Node() {}
+    };
+
+    typedef std::vector<uint8_t, hugepage_allocator<uint8_t>> CtrlVector;
+    typedef std::vector<uint32_t, hugepage_allocator<uint32_t>> SlotVector;
+
+    CtrlVector m_ctrl;
+    SlotVector m_slots;
+    size_t m_size = 0;
+    size_t m_deleted = 0;
+
+    //! Frees a pool array, to the huge page arena if it came from there.
+    struct ChunkDeleter {
+        size_t size;
+        explicit ChunkDeleter(size_t size_in = 0) : size(size_in) {}
+        void operator()(Node* nodes) const
+        {
+            for (size_t i = 0; i < size; i++) nodes[i].~Node();
+            if (!HugePageArena::Instance().Free(nodes, size * sizeof(Node))) ::operator delete(nodes);
+        }
+    };
+    typedef std::unique_ptr<Node[], ChunkDeleter> Chunk;
+
+    std::vector<Chunk> m_chunks;
+    //! Entries handed out from the pool, including erased ones.
+    size_t m_nodes = 0;
+    //! Entries the pool has room for.
+    size_t m_pool_capacity = 0;
+    uint32_t m_free = NO_NODE;
+    //! Memory allocated for m_chunks, as memusage::MallocUsage counts it.
+    size_t m_pool_usage = 0;
+
+    Hash m_hasher;
+
+    static size_t ChunkSize(size_t chunk)
+    {
+        return chunk >= RAMP_CHUNKS ? size_t(MAX_CHUNK) : size_t(MIN_CHUNK) << chunk;
+    }
+
+    static uint8_t Tag(size_t hash) { return CTRL_FULL | (hash >> (sizeof(size_t) * 8 - 7)); }
+
+    Node& NodeAt(uint32_t index) const
+    {
+        if (index >= RAMP_NODES) {
+            index -= RAMP_NODES;
+            return m_chunks[RAMP_CHUNKS + index / MAX_CHUNK][index % MAX_CHUNK];
+        }
+        size_t chunk = 0;
+        while (index >= ChunkSize(chunk)) index -= ChunkSize(chunk++);
+        return m_chunks[chunk][index];
+    }
+
+    uint32_t AllocateNode();
+    void FreeNode(uint32_t index);
+
+    //! Slot holding key, or m_slots.size() if there is none.
+    size_t Position(const K& key) const;
+    //! Put node in the first free slot of its probe sequence, and return that slot.
+    size_t Insert(uint32_t node, size_t hash);
+    void Rehash(size_t capacity);
+
+public:
+    template <bool is_const>
+    class iterator_base
+    {
+        friend class flatmap;
+        typedef typename std::conditional<is_const, const flatmap, flatmap>::type map_type;
+
+        map_type* m_map;
+        size_t m_pos;
+
+        void Skip() { while (m_pos < m_map->m_ctrl.size() && !(m_map->m_ctrl[m_pos] & CTRL_FULL)) m_pos++; }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename flatmap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef typename std::conditional<is_const, const value_type*, value_type*>::type pointer;
+        typedef typename std::conditional<is_const, const value_type&, value_type&>::type reference;
+
+        iterator_base() : m_map(nullptr), m_pos(0) {}
+        iterator_base(map_type* map, size_t pos) : m_map(map), m_pos(pos) { Skip(); }
+        //! Allow conversion from iterator to const_iterator.
+        template <bool other_const, typename = typename std::enable_if<is_const && !other_const>::type>
+        iterator_base(const iterator_base<other_const>& other) : m_map(other.m_map), m_pos(other.m_pos) {}
+
+        reference operator*() const { return m_map->NodeAt(m_map->m_slots[m_pos]).value; }
+        pointer operator->() const { return &m_map->NodeAt(m_map->m_slots[m_pos]).value; }
+        iterator_base& operator++() { m_pos++; Skip(); return *this; }
+        iterator_base operator++(int) { iterator_base copy(*this); ++*this; return copy; }
+        bool operator==(const iterator_base& other) const { return m_pos == other.m_pos; }
+        bool operator!=(const iterator_base& other) const { return m_pos != other.m_pos; }
+
+        template <bool> friend class iterator_base;
+    };
+
+    typedef iterator_base<false> iterator;
+    typedef iterator_base<true> const_iterator;
+
+    flatmap() {}
+    ~flatmap() { clear(); }
+    flatmap(const flatmap&) = delete;
+    flatmap& operator=(const flatmap&) = delete;
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, m_slots.size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_slots.size()); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    //! Number of slots in the table.
+    size_t bucket_count() const { return m_slots.size(); }
+
+    iterator find(const K& key) { return iterator(this, Position(key)); }
+    const_iterator find(const K& key) const { return const_iterator(this, Position(key)); }
+    size_t count(const K& key) const { return Position(key) < m_slots.size() ? 1 : 0; }
+
+    /** Construct an entry from args, unless one with the same key exists. */
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+
+    T& operator[](const K& key)
+    {
+        return emplace(std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>()).first->second;
+    }
+
+    //! Remove the entry at it, returning an iterator to the entry after it.
+    iterator erase(const_iterator it);
+    size_t erase(const K& key);
+
+    //! Remove all entries and release all memory.
+    void clear();
+
+    //! Make room for n entries without growing the table.
+    void reserve(size_t n);
+
+    /**
+     * Release the memory of erased entries and shrink the table to the size
+     * it would have grown to for the entries left. Unlike other operations,
+     * this moves entries, so it invalidates references to them.
+     */
+    void shrink_to_fit();
+
+    //! Memory allocated by the map, as memusage::MallocUsage counts it.
+    size_t DynamicMemoryUsage() const;
+};
+
+template <typename K, typename T, typename Hash>
+uint32_t flatmap<K, T, Hash>::AllocateNode()
+{
+    if (m_free != NO_NODE) {
+        const uint32_t index = m_free;
+        m_free = NodeAt(index).next_free;
+        return index;
+    }
+    if (m_nodes == m_pool_capacity) {
+        const size_t size = ChunkSize(m_chunks.size());
+        assert(m_pool_capacity + size <= NO_NODE);
+        // The large arrays, of which most of a big map consists, are backed
+        // by huge pages if they are enabled.
+        void* memory = HugePageArena::Instance().Allocate(size * sizeof(Node));
+        if (memory == nullptr) memory = ::operator new(size * sizeof(Node));
+        Node* nodes = static_cast<Node*>(memory);
+        for (size_t i = 0; i < size; i++) new (&nodes[i]) Node();
+        Chunk chunk(nodes, ChunkDeleter(size));
+        m_chunks.push_back(std::move(chunk));
+        m_pool_capacity += size;
+        m_pool_usage += memusage::MallocUsage(size * sizeof(Node));
+    }
+    return m_nodes++;
+}
+
+template <typename K, typename T, typename Hash>
+void flatmap<K, T, Hash>::FreeNode(uint32_t index)
+{
+    NodeAt(index).next_free = m_free;
+    m_free = index;
+}
+
+template <typename K, typename T, typename Hash>
+size_t flatmap<K, T, Hash>::Position(const K& key) const
+{
+    if (m_size == 0) return m_slots.size();
+    const size_t hash = m_hasher(key);
+    const uint8_t tag = Tag(hash);
+    const size_t mask = m_slots.size() - 1;
+    for (size_t i = hash & mask; m_ctrl[i] != CTRL_EMPTY; i = (i + 1) & mask) {
+        if (m_ctrl[i] == tag && NodeAt(m_slots[i]).value.first == key) return i;
+    }
+    return m_slots.size();
+}
+
+template <typename K, typename T, typename Hash>
+size_t flatmap<K, T, Hash>::Insert(uint32_t node, size_t hash)
+{
+    const size_t mask = m_slots.size() - 1;
+    size_t i = hash & mask;
+    while (m_ctrl[i] & CTRL_FULL) i = (i + 1) & mask;
+    if (m_ctrl[i] == CTRL_DELETED) m_deleted--;
+    m_ctrl[i] = Tag(hash);
+    m_slots[i] = node;
+    m_size++;
+    return i;
+}
+
+template <typename K, typename T, typename Hash>
+void flatmap<K, T, Hash>::Rehash(size_t capacity)
+{
+    CtrlVector ctrl(capacity, uint8_t(CTRL_EMPTY));
+    SlotVector slots(capacity, 0);
+    ctrl.swap(m_ctrl);
+    slots.swap(m_slots);
+    m_size = 0;
+    m_deleted = 0;
+    for (size_t j = 0; j < slots.size(); j++) {
+        if (ctrl[j] & CTRL_FULL) Insert(slots[j], m_hasher(NodeAt(slots[j]).value.first));
+    }
+}
+
+template <typename K, typename T, typename Hash>
+template <typename... Args>
+std::pair<typename flatmap<K, T, Hash>::iterator, bool> flatmap<K, T, Hash>::emplace(Args&&... args)
+{
+    const uint32_t index = AllocateNode();
+    Node& node = NodeAt(index);
+    try {
+        new (&node.value) value_type(std::forward<Args>(args)...);
+    } catch (...) {
+        FreeNode(index);
+        throw;
+    }
+    const size_t existing = Position(node.value.first);
+    if (existing < m_slots.size()) {
+        node.value.~value_type();
+        FreeNode(index);
+        return std::make_pair(iterator(this, existing), false);
+    }
+    // Keep live entries and tombstones below 7/8 of the table. Only grow it if
+    // the live entries alone would fill 3/4 of it; otherwise dropping the
+    // tombstones makes enough room.
+    if ((m_size + m_deleted + 1) * 8 > m_slots.size() * 7) {
+        const size_t capacity = m_slots.empty() ? size_t(MIN_CAPACITY) :
+            (m_size + 1) * 4 > m_slots.size() * 3 ? m_slots.size() * 2 : m_slots.size();
+        try {
+            Rehash(capacity);
+        } catch (...) {
+            node.value.~value_type();
+            FreeNode(index);
+            throw;
+        }
+    }
+    return std::make_pair(iterator(this, Insert(index, m_hasher(node.value.first))), true);
+}
+
+template <typename K, typename T, typename Hash>
+typename flatmap<K, T, Hash>::iterator flatmap<K, T, Hash>::erase(const_iterator it)
+{
+    const size_t i = it.m_pos;
+    assert(i < m_slots.size() && (m_ctrl[i] & CTRL_FULL));
+    NodeAt(m_slots[i]).value.~value_type();
+    FreeNode(m_slots[i]);
+    m_size--;
+    // A slot followed by an empty one ends no probe sequence but its own, so
+    // it can become empty again instead of a tombstone.
+    if (m_ctrl[(i + 1) & (m_slots.size() - 1)] == CTRL_EMPTY) {
+        m_ctrl[i] = CTRL_EMPTY;
+    } else {
+        m_ctrl[i] = CTRL_DELETED;
+        m_deleted++;
+    }
+    return iterator(this, i + 1);
+}
+
+template <typename K, typename T, typename Hash>
+size_t flatmap<K, T, Hash>::erase(const K& key)
+{
+    const size_t i = Position(key);
+    if (i >= m_slots.size()) return 0;
+    erase(const_iterator(this, i));
+    return 1;
+}
+
+template <typename K, typename T, typename Hash>
+void flatmap<K, T, Hash>::clear()
+{
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        if (m_ctrl[i] & CTRL_FULL) NodeAt(m_slots[i]).value.~value_type();
+    }
+    CtrlVector().swap(m_ctrl);
+    SlotVector().swap(m_slots);
+    std::vector<Chunk>().swap(m_chunks);
+    m_size = 0;
+    m_deleted = 0;
+    m_nodes = 0;
+    m_pool_capacity = 0;
+    m_free = NO_NODE;
+    m_pool_usage = 0;
+}
+
+template <typename K, typename T, typename Hash>
+void flatmap<K, T, Hash>::reserve(size_t n)
+{
+    size_t capacity = m_slots.empty() ? size_t(MIN_CAPACITY) : m_slots.size();
+    while (n * 8 > capacity * 7) capacity *= 2;
+    if (capacity > m_slots.size()) Rehash(capacity);
+}
+
+template <typename K, typename T, typename Hash>
+void flatmap<K, T, Hash>::shrink_to_fit()
+{
+    if (m_size == 0) {
+        clear();
+        return;
+    }
+
+    // Keep the smallest prefix of the pool arrays that has room for all
+    // entries. All of it was handed out already, as the arrays after it were
+    // only allocated once it was.
+    size_t keep_chunks = 0;
+    size_t keep_capacity = 0;
+    while (keep_capacity < m_size) keep_capacity += ChunkSize(keep_chunks++);
+    if (keep_chunks < m_chunks.size()) {
+        std::vector<uint32_t> free_nodes;
+        for (uint32_t index = m_free; index != NO_NODE; index = NodeAt(index).next_free) {
+            if (index < keep_capacity) free_nodes.push_back(index);
+        }
+        // There are at least as many free entries in the kept arrays as live
+        // ones after them.
+        for (size_t i = 0; i < m_slots.size(); i++) {
+            if (!(m_ctrl[i] & CTRL_FULL) || m_slots[i] < keep_capacity) continue;
+            assert(!free_nodes.empty());
+            const uint32_t index = free_nodes.back();
+            free_nodes.pop_back();
+            Node& node = NodeAt(m_slots[i]);
+            new (&NodeAt(index).value) value_type(std::move(node.value));
+            node.value.~value_type();
+            m_slots[i] = index;
+        }
+        m_chunks.resize(keep_chunks);
+        m_chunks.shrink_to_fit();
+        m_nodes = m_pool_capacity = keep_capacity;
+        m_pool_usage = 0;
+        for (size_t chunk = 0; chunk < keep_chunks; chunk++) {
+            m_pool_usage += memusage::MallocUsage(ChunkSize(chunk) * sizeof(Node));
+        }
+        m_free = NO_NODE;
+        for (uint32_t index : free_nodes) FreeNode(index);
+    }
+
+    size_t capacity = MIN_CAPACITY;
+    while (m_size * 4 > capacity * 3 && capacity < m_slots.size()) capacity *= 2;
+    if (capacity < m_slots.size() || m_deleted > 0) Rehash(capacity);
+}
+
+template <typename K, typename T, typename Hash>
+size_t flatmap<K, T, Hash>::DynamicMemoryUsage() const
+{
+    return memusage::MallocUsage(m_ctrl.capacity()) +
+           memusage::MallocUsage(m_slots.capacity() * sizeof(uint32_t)) +
+           memusage::MallocUsage(m_chunks.capacity() * sizeof(Chunk)) +
+           m_pool_usage;
+}
+
+#endif // BITCOIN_FLATMAP_H
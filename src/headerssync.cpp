@@ -0,0 +1,326 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <headerssync.h>
+
+#include <chain.h>
+#include <consensus/consensus.h>
+#include <pow.h>
+#include <random.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <iterator>
+#include <limits>
+
+HeadersRangeSync::HeadersRangeSync(const MapCheckpoints& checkpoints, int from_height)
+{
+    auto start = checkpoints.lower_bound(from_height);
+    if (start == checkpoints.end()) return;
+    for (auto end = std::next(start); end != checkpoints.end(); start = end++) {
+        Range range;
+        range.start_height = start->first;
+        range.start_hash = start->second;
+        range.end_height = end->first;
+        range.end_hash = end->second;
+        m_ranges.push_back(std::move(range));
+    }
+}
+
+size_t HeadersRangeSync::Downloading() const
+{
+    size_t count = 0;
+    for (const Range& range : m_ranges) {
+        if (range.peer != -1 && !range.complete) count++;
+    }
+    return count;
+}
+
+bool HeadersRangeSync::IsDownloading(NodeId peer) const
+{
+    for (const Range& range : m_ranges) {
+        if (range.peer == peer && !range.complete) return true;
+    }
+    return false;
+}
+
+bool HeadersRangeSync::HasStalled(NodeId peer, std::chrono::microseconds deadline) const
+{
+    for (const Range& range : m_ranges) {
+        if (range.peer == peer && !range.complete) return range.request_time < deadline;
+    }
+    return false;
+}
+
+bool HeadersRangeSync::Assign(NodeId peer, int peer_height, std::chrono::microseconds now, uint256& locator, uint256& stop)
+{
+    size_t buffered = 0;
+    for (Range& range : m_ranges) {
+        // The lowest range is always allowed, as connecting it frees the buffer
+        buffered += size_t(range.end_height - range.start_height);
+        if (&range != &m_ranges.front() && buffered > MAX_HEADERS_SYNC_BUFFERED) return false;
+        if (range.peer != -1 || range.complete || range.end_height > peer_height) continue;
+        range.peer = peer;
+        range.request_time = now;
+        locator = range.start_hash;
+        stop = range.end_hash;
+        return true;
+    }
+    return false;
+}
+
+HeadersRangeSync::Result HeadersRangeSync::ReceiveHeaders(NodeId peer, const std::vector<CBlockHeader>& headers, std::chrono::microseconds now, uint256& locator, uint256& stop)
+{
+    auto it = std::find_if(m_ranges.begin(), m_ranges.end(), [peer](const Range& range) { return range.peer == peer && !range.complete; });
+    if (it == m_ranges.end()) return Result::UNEXPECTED;
+    Range& range = *it;
+
+    if (headers.empty()) {
+        Release(peer);
+        return Result::EMPTY;
+    }
+    // Headers that do not follow the range answer another GETHEADERS
+    const uint256 prev = range.headers.empty() ? range.start_hash : range.headers.back().GetHash();
+    if (headers[0].hashPrevBlock != prev) return Result::UNEXPECTED;
+
+    const size_t missing = size_t(range.end_height - range.start_height) - range.headers.size();
+    if (headers.size() > missing) {
+        Release(peer);
+        return Result::INVALID;
+    }
+    uint256 hash_last = prev;
+    for (const CBlockHeader& header : headers) {
+        if (header.hashPrevBlock != hash_last) {
+            Release(peer);
+            return Result::INVALID;
+        }
+        hash_last = header.GetHash();
+    }
+
+    if (headers.size() == missing) {
+        if (hash_last != range.end_hash) {
+            Release(peer);
+            return Result::INVALID;
+        }
+        range.headers.insert(range.headers.end(), headers.begin(), headers.end());
+        range.complete = true;
+        return Result::COMPLETE;
+    }
+    if (headers.size() < MAX_HEADERS_RESULTS) {
+        // The peer stopped short of the checkpoint
+        Release(peer);
+        return Result::EMPTY;
+    }
+    range.headers.insert(range.headers.end(), headers.begin(), headers.end());
+    range.request_time = now;
+    locator = hash_last;
+    stop = range.end_hash;
+    return Result::MORE;
+}
+
+const HeadersRangeSync::Range* HeadersRangeSync::Next() const
+{
+    if (m_ranges.empty() || !m_ranges.front().complete) return nullptr;
+    return &m_ranges.front();
+}
+
+std::vector<CBlockHeader> HeadersRangeSync::TakeNext(NodeId& from)
+{
+    assert(Next() != nullptr);
+    from = m_ranges.front().peer;
+    std::vector<CBlockHeader> headers = std::move(m_ranges.front().headers);
+    m_ranges.pop_front();
+    return headers;
+}
+
+void HeadersRangeSync::Release(NodeId peer)
+{
+    for (Range& range : m_ranges) {
+        if (range.peer == peer && !range.complete) {
+            range.peer = -1;
+            range.headers.clear();
+            range.headers.shrink_to_fit();
+        }
+    }
+}
+
+void HeadersRangeSync::Prune(int best_header_height)
+{
+    while (!m_ranges.empty() && m_ranges.front().end_height <= best_header_height) {
+        m_ranges.pop_front();
+    }
+}
+
+static arith_uint256 HeaderProof(const CBlockHeader& header)
+{
+    CBlockIndex index;
+    index.nBits = header.nBits;
+    return GetBlockProof(index);
+}
+
+arith_uint256 CalculateHeadersWork(const std::vector<CBlockHeader>& headers)
+{
+    arith_uint256 work = 0;
+    for (const CBlockHeader& header : headers) {
+        work += HeaderProof(header);
+    }
+    return work;
+}
+
+HeadersPresync::HeadersPresync(const Consensus::Params& params, const CBlockIndex* chain_start, const CBlockLocator& chain_start_locator,
+                               const arith_uint256& minimum_work, int64_t now)
+    : m_params(params),
+      m_chain_start(chain_start),
+      m_chain_start_hash(chain_start->GetBlockHash()),
+      m_chain_start_height(chain_start->nHeight),
+      m_chain_start_work(chain_start->nChainWork),
+      m_chain_start_locator(chain_start_locator.vHave),
+      m_minimum_work(minimum_work),
+      m_hasher(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max())),
+      m_commit_offset(GetRand(HEADERS_PRESYNC_COMMITMENT_PERIOD)),
+      // Each block must be later than the median time of the 11 before it,
+      // so no more than 6 blocks a second can follow chain_start.
+      m_max_commitments(6 * std::max<int64_t>(0, now + MAX_FUTURE_BLOCK_TIME - chain_start->GetMedianTimePast()) / HEADERS_PRESYNC_COMMITMENT_PERIOD),
+      m_presync_last_hash(m_chain_start_hash),
+      m_presync_height(m_chain_start_height),
+      m_presync_work(m_chain_start_work),
+      m_redownload_last_hash(m_chain_start_hash),
+      m_redownload_height(m_chain_start_height),
+      m_redownload_work(m_chain_start_work)
+{
+}
+
+bool HeadersPresync::Commitment(const uint256& hash) const
+{
+    return CSipHasher(m_hasher).Write(hash.begin(), hash.size()).Finalize() & 1;
+}
+
+bool HeadersPresync::IsContinuation(const std::vector<CBlockHeader>& headers) const
+{
+    if (headers.empty()) return false;
+    switch (m_phase) {
+    case Phase::PRESYNC:
+        return headers[0].hashPrevBlock == m_presync_last_hash;
+    case Phase::REDOWNLOAD:
+        return headers[0].hashPrevBlock == m_redownload_last_hash;
+    case Phase::FINAL:
+        break;
+    }
+    return false;
+}
+
+bool HeadersPresync::PresyncHeader(const CBlockHeader& header)
+{
+    const uint256 hash = header.GetHash();
+    if (header.hashPrevBlock != m_presync_last_hash || header.nVersion < MIN_BLOCK_VERSION ||
+        !CheckProofOfWork(hash, header.nBits, m_params)) {
+        return false;
+    }
+    // The difficulty has to be the one the headers before require, as
+    // ContextualCheckBlockHeader checks it once they are stored.
+    const CBlockIndex* prev = m_presync_window.empty() ? m_chain_start : &m_presync_window.back();
+    if (header.nBits != GetNextWorkRequired(prev, &header, m_params)) {
+        return false;
+    }
+    m_presync_window.emplace_back();
+    CBlockIndex& index = m_presync_window.back();
+    // Only read through, as GetNextWorkRequired walks back from the window.
+    index.pprev = const_cast<CBlockIndex*>(prev);
+    index.nHeight = m_presync_height + 1;
+    index.nTime = header.nTime;
+    index.nBits = header.nBits;
+    // Digishield needs the median time before its window, LWMA the block before its window.
+    const size_t window_size = std::max<int64_t>(m_params.nDigishieldAveragingWindow + 11, m_params.nLwmaAveragingWindow + 1) + 1;
+    while (m_presync_window.size() > window_size) {
+        m_presync_window.pop_front();
+        m_presync_window.front().pprev = nullptr;
+    }
+    m_presync_last_hash = hash;
+    m_presync_work += HeaderProof(header);
+    if (++m_presync_height % HEADERS_PRESYNC_COMMITMENT_PERIOD == m_commit_offset) {
+        m_commitments.push_back(Commitment(hash));
+        // The chain cannot be that long
+        if (m_commitments.size() > m_max_commitments) return false;
+    }
+    return true;
+}
+
+bool HeadersPresync::RedownloadHeader(const CBlockHeader& header)
+{
+    const uint256 hash = header.GetHash();
+    if (header.hashPrevBlock != m_redownload_last_hash || header.nVersion < MIN_BLOCK_VERSION ||
+        !CheckProofOfWork(hash, header.nBits, m_params)) {
+        return false;
+    }
+    m_redownload_last_hash = hash;
+    m_redownload_work += HeaderProof(header);
+    if (++m_redownload_height % HEADERS_PRESYNC_COMMITMENT_PERIOD == m_commit_offset && !m_release_all) {
+        // More headers than the presync went through without reaching the work
+        if (m_commitments.empty()) return false;
+        if (m_commitments.front() != Commitment(hash)) return false;
+        m_commitments.pop_front();
+    }
+    m_redownload_buffer.push_back(header);
+    if (m_redownload_work >= m_minimum_work) m_release_all = true;
+    return true;
+}
+
+HeadersPresync::Result HeadersPresync::Fail()
+{
+    m_phase = Phase::FINAL;
+    m_commitments.clear();
+    m_redownload_buffer.clear();
+    Result result;
+    result.success = false;
+    return result;
+}
+
+HeadersPresync::Result HeadersPresync::ProcessHeaders(const std::vector<CBlockHeader>& headers, bool full_message)
+{
+    assert(m_phase != Phase::FINAL);
+    Result result;
+
+    if (m_phase == Phase::PRESYNC) {
+        for (const CBlockHeader& header : headers) {
+            if (!PresyncHeader(header)) return Fail();
+        }
+        if (m_presync_work >= m_minimum_work) {
+            // Download the headers again from chain_start
+            m_phase = Phase::REDOWNLOAD;
+        } else if (!full_message) {
+            // The peer has no more headers, and they do not have the work
+            return Fail();
+        }
+        result.request_more = true;
+        return result;
+    }
+
+    for (const CBlockHeader& header : headers) {
+        if (!RedownloadHeader(header)) return Fail();
+    }
+    while (!m_redownload_buffer.empty() && (m_release_all || m_redownload_buffer.size() > HEADERS_REDOWNLOAD_BUFFER_SIZE)) {
+        result.headers.push_back(std::move(m_redownload_buffer.front()));
+        m_redownload_buffer.pop_front();
+    }
+    if (m_release_all) {
+        // The headers left are downloaded by the normal headers sync
+        m_phase = Phase::FINAL;
+        m_commitments.clear();
+    } else if (!full_message) {
+        return Fail();
+    } else {
+        result.request_more = true;
+    }
+    return result;
+}
+
+CBlockLocator HeadersPresync::NextLocator() const
+{
+    const uint256& last = m_phase == Phase::PRESYNC ? m_presync_last_hash : m_redownload_last_hash;
+    std::vector<uint256> locator;
+    if (last != m_chain_start_hash) locator.push_back(last);
+    locator.insert(locator.end(), m_chain_start_locator.begin(), m_chain_start_locator.end());
+    return CBlockLocator(locator);
+}
@@ -0,0 +1,211 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_HEADERSSYNC_H
+#define LITECOINZ_HEADERSSYNC_H
+
+#include <arith_uint256.h>
+#include <chainparams.h>
+#include <crypto/siphash.h>
+#include <net.h>
+#include <primitives/block.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+class CBlockIndex;
+
+/** Default for -headerssyncpeers */
+static const unsigned int DEFAULT_HEADERS_SYNC_PEERS = 4;
+/** Headers of the ranges ahead of the connected headers, at most. A header takes about 1.5 kB. */
+static const unsigned int MAX_HEADERS_SYNC_BUFFERED = 16 * 2000;
+/** A presync keeps one bit of commitment for this many headers */
+static const unsigned int HEADERS_PRESYNC_COMMITMENT_PERIOD = 250;
+/** Redownloaded headers held back until this many have been checked after them, about 6 MB per peer */
+static const unsigned int HEADERS_REDOWNLOAD_BUFFER_SIZE = 4000;
+
+/**
+ * Downloads the headers between checkpoints from several peers at once.
+ * Headers can only be requested after a hash we know, so the headers above
+ * the best header are split into ranges from one checkpoint to the next,
+ * each downloaded by one peer with GETHEADERS messages stopping at the
+ * checkpoint. Complete ranges are buffered and connected in order, once
+ * the normal headers sync or the range before has connected their start.
+ */
+class HeadersRangeSync
+{
+public:
+    struct Range {
+        //! The checkpoint the range follows
+        int start_height;
+        uint256 start_hash;
+        //! The checkpoint the range ends with
+        int end_height;
+        uint256 end_hash;
+        //! The headers received, from start_height + 1 on
+        std::vector<CBlockHeader> headers;
+        //! The peer downloading the range, or the one that sent it once complete
+        NodeId peer{-1};
+        bool complete{false};
+        //! When the last GETHEADERS of the range was sent
+        std::chrono::microseconds request_time{0};
+    };
+
+    enum class Result {
+        UNEXPECTED, //!< Not the headers of a range downloaded from the peer
+        EMPTY,      //!< The peer does not have the rest of its range, which is given up
+        INVALID,    //!< The headers do not lead to the end of the range
+        MORE,       //!< Ask for more headers of the range
+        COMPLETE,   //!< The range is complete
+    };
+
+    /** Split the headers above from_height between checkpoints. */
+    HeadersRangeSync(const MapCheckpoints& checkpoints, int from_height);
+
+    bool Done() const { return m_ranges.empty(); }
+
+    /** The number of peers downloading a range */
+    size_t Downloading() const;
+
+    bool IsDownloading(NodeId peer) const;
+
+    /** Whether the range of the peer has had no answer since deadline. */
+    bool HasStalled(NodeId peer, std::chrono::microseconds deadline) const;
+
+    /**
+     * Give the lowest range the peer has, and that fits in the buffer, to
+     * the peer. Returns false when there is none, otherwise the GETHEADERS
+     * to send is set in locator and stop.
+     */
+    bool Assign(NodeId peer, int peer_height, std::chrono::microseconds now, uint256& locator, uint256& stop);
+
+    /**
+     * Append the headers a peer sent to its range. On Result::MORE, the
+     * next GETHEADERS to send is set in locator and stop. The range is given
+     * up on anything but Result::MORE and Result::COMPLETE.
+     */
+    Result ReceiveHeaders(NodeId peer, const std::vector<CBlockHeader>& headers, std::chrono::microseconds now, uint256& locator, uint256& stop);
+
+    /** The lowest range if it is complete, or nullptr. */
+    const Range* Next() const;
+
+    /** Remove the lowest range, which must be complete, returning its headers and their sender. */
+    std::vector<CBlockHeader> TakeNext(NodeId& from);
+
+    /** Give up the range of a peer, which may be disconnecting. */
+    void Release(NodeId peer);
+
+    /** Drop the ranges the normal headers sync went past. */
+    void Prune(int best_header_height);
+
+private:
+    //! From the lowest to the highest
+    std::deque<Range> m_ranges;
+};
+
+/** The work of headers, from the targets they claim */
+arith_uint256 CalculateHeadersWork(const std::vector<CBlockHeader>& headers);
+
+/**
+ * Downloads the headers chain of a peer that is not known to have enough
+ * work twice, so that headers are only stored once they lead to
+ * the minimum chain work. In the presync, only the hash and work of the
+ * last header and a salted bit of commitment every
+ * HEADERS_PRESYNC_COMMITMENT_PERIOD headers are kept. When the work is
+ * reached, the headers are downloaded again from the start and checked
+ * against the commitments, and they are released to be stored once
+ * HEADERS_REDOWNLOAD_BUFFER_SIZE headers after them matched, or all of them
+ * once the work is reached again. Peers can thus not make us store a
+ * low-work chain of headers, and a peer that sends other headers the second
+ * time is caught before it gets far.
+ *
+ * Only the cheap checks of the proof of work are done here. The Equihash
+ * solutions are checked as the released headers are stored.
+ */
+class HeadersPresync
+{
+public:
+    enum class Phase {
+        PRESYNC,    //!< Following the headers for their work
+        REDOWNLOAD, //!< Checking the headers downloaded again against the commitments
+        FINAL,      //!< All the headers needed were released, or the sync failed
+    };
+
+    struct Result {
+        //! Checked headers to store, in order
+        std::vector<CBlockHeader> headers;
+        //! Whether the headers received were valid and matched the commitments
+        bool success{true};
+        //! Whether to send a GETHEADERS for NextLocator()
+        bool request_more{false};
+    };
+
+    /** Start a presync of the headers following chain_start, whose locator is given. */
+    HeadersPresync(const Consensus::Params& params, const CBlockIndex* chain_start, const CBlockLocator& chain_start_locator,
+                   const arith_uint256& minimum_work, int64_t now);
+
+    HeadersPresync(const HeadersPresync&) = delete;
+    HeadersPresync& operator=(const HeadersPresync&) = delete;
+
+    Phase GetPhase() const { return m_phase; }
+    int StartHeight() const { return m_chain_start_height; }
+    int PresyncHeight() const { return m_presync_height; }
+    const arith_uint256& PresyncWork() const { return m_presync_work; }
+
+    /** Whether headers follow the last ones received, so that they are for the presync */
+    bool IsContinuation(const std::vector<CBlockHeader>& headers) const;
+
+    /**
+     * Process the headers of a message, which must be a continuation.
+     * full_message tells whether the peer may have more headers. Once
+     * success is false, the sync is over and the peer is to be treated as
+     * having a low-work chain.
+     */
+    Result ProcessHeaders(const std::vector<CBlockHeader>& headers, bool full_message);
+
+    /** The locator of the next GETHEADERS to send */
+    CBlockLocator NextLocator() const;
+
+private:
+    const Consensus::Params& m_params;
+    const CBlockIndex* const m_chain_start;
+    const uint256 m_chain_start_hash;
+    const int m_chain_start_height;
+    const arith_uint256 m_chain_start_work;
+    const std::vector<uint256> m_chain_start_locator;
+    const arith_uint256 m_minimum_work;
+    //! Salt of the commitments, so that a peer cannot tell which headers they are for
+    const CSipHasher m_hasher;
+    //! Which height a commitment is kept for within each period
+    const unsigned int m_commit_offset;
+    //! Commitments the headers can lead to, at most, given how fast time can move on between them
+    const size_t m_max_commitments;
+    Phase m_phase{Phase::PRESYNC};
+
+    uint256 m_presync_last_hash;
+    int m_presync_height;
+    arith_uint256 m_presync_work;
+    //! The last headers of the presync, linked to chain_start, as many as the
+    //! difficulty of the next one depends on
+    std::deque<CBlockIndex> m_presync_window;
+    //! Oldest first
+    std::deque<bool> m_commitments;
+
+    uint256 m_redownload_last_hash;
+    int m_redownload_height;
+    arith_uint256 m_redownload_work;
+    //! Headers downloaded again that are not released yet
+    std::deque<CBlockHeader> m_redownload_buffer;
+    //! Whether the headers downloaded again reached the minimum work, so that none are held back
+    bool m_release_all{false};
+
+    bool Commitment(const uint256& hash) const;
+    bool PresyncHeader(const CBlockHeader& header);
+    bool RedownloadHeader(const CBlockHeader& header);
+    Result Fail();
+};
+
+#endif // LITECOINZ_HEADERSSYNC_H
@@ -7,6 +7,7 @@
 #include <chainparams.h>
 #include <crypto/hmac_sha256.h>
 #include <httpserver.h>
+#include <rpc/jsonstream.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
 #include <ui_interface.h>
@@ -27,6 +28,8 @@
 
 /** WWW-Authenticate to present with 401 Unauthorized response */
 static const char* WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
+/** Wait for a client that has more than this of a streamed result to take */
+static const size_t RPC_STREAM_MAX_QUEUED = 16 * JSON_STREAM_CHUNK_SIZE;
 
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wallet.
@@ -181,6 +184,17 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         return false;
     }
 
+    // A single call may write its result as it goes, sent in chunks, as
+    // fast as the client takes them
+    bool reply_started = false;
+    JSONStreamWriter stream([req, &reply_started](const std::string& chunk) {
+        if (!reply_started) req->WriteHeader("Content-Type", "application/json");
+        reply_started = true;
+        req->WriteReplyChunk(chunk);
+        if (!req->WaitForChunksSent(RPC_STREAM_MAX_QUEUED)) {
+            throw std::runtime_error("client went away or shutting down");
+        }
+    });
     try {
         // Parse request
         UniValue valRequest;
@@ -205,8 +219,17 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
                 req->WriteReply(HTTP_FORBIDDEN);
                 return false;
             }
+            stream.Raw("{\"result\":");
+            jreq.stream = &stream;
             UniValue result = tableRPC.execute(jreq);
 
+            if (stream.Started()) {
+                stream.Raw(",\"error\":null,\"id\":" + jreq.id.write() + "}\n");
+                stream.Flush();
+                req->EndChunkedReply();
+                return true;
+            }
+
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
 
@@ -236,9 +259,22 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strReply);
     } catch (const UniValue& objError) {
+        // Until a chunk is sent, what the call wrote is only buffered and is
+        // dropped for an error reply.
+        if (reply_started) {
+            // Part of the result is already sent: all that can be done is to cut it short
+            LogPrintf("RPC %s failed while writing its result: %s\n", jreq.strMethod, find_value(objError, "message").getValStr());
+            req->EndChunkedReply();
+            return false;
+        }
         JSONErrorReply(req, objError, jreq.id);
         return false;
     } catch (const std::exception& e) {
+        if (reply_started) {
+            LogPrintf("RPC %s failed while writing its result: %s\n", jreq.strMethod, e.what());
+            req->EndChunkedReply();
+            return false;
+        }
         JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
         return false;
     }
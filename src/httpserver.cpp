@@ -15,6 +15,7 @@
 #include <sync.h>
 #include <ui_interface.h>
 
+#include <condition_variable>
 #include <deque>
 #include <memory>
 #include <stdio.h>
@@ -27,6 +28,7 @@
 #include <event2/thread.h>
 #include <event2/buffer.h>
 #include <event2/bufferevent.h>
+#include <event2/listener.h>
 #include <event2/util.h>
 #include <event2/keyvalq_struct.h>
 
@@ -41,6 +43,8 @@
 
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
+/** Requests that may wait beyond a full work queue, per request of its depth, before new ones are rejected */
+static const size_t HTTP_WORKQUEUE_BACKLOG_FACTOR = 16;
 
 /** HTTP request work item */
 class HTTPWorkItem final : public HTTPClosure
@@ -75,10 +79,12 @@ private:
     std::deque<std::unique_ptr<WorkItem>> queue;
     bool running;
     size_t maxDepth;
+    size_t maxBacklog;
 
 public:
-    explicit WorkQueue(size_t _maxDepth) : running(true),
-                                 maxDepth(_maxDepth)
+    WorkQueue(size_t _maxDepth, size_t _maxBacklog) : running(true),
+                                 maxDepth(_maxDepth),
+                                 maxBacklog(_maxBacklog)
     {
     }
     /** Precondition: worker threads have all stopped (they have been joined).
@@ -86,13 +92,19 @@ public:
     ~WorkQueue()
     {
     }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    /** Enqueue a work item. Beyond the depth of the queue, up to maxBacklog
+     * more items are taken, calling on_backlog first so that the caller
+     * slows down; only then are items rejected.
+     */
+    bool Enqueue(WorkItem* item, const std::function<void()>& on_backlog)
     {
         LOCK(cs);
-        if (queue.size() >= maxDepth) {
+        if (queue.size() >= maxDepth + maxBacklog) {
             return false;
         }
+        if (queue.size() >= maxDepth) {
+            on_backlog();
+        }
         queue.emplace_back(std::unique_ptr<WorkItem>(item));
         cond.notify_one();
         return true;
@@ -134,20 +146,29 @@ struct HTTPPathHandler
     HTTPRequestHandler handler;
 };
 
+/** A libevent event loop with its own HTTP server and listening sockets.
+ * With several loops, each listens on the same addresses with SO_REUSEPORT,
+ * and the kernel spreads the connections over them.
+ */
+struct HTTPEventLoop
+{
+    struct event_base* base = nullptr;
+    struct evhttp* http = nullptr;
+    //! Bound listening sockets
+    std::vector<evhttp_bound_socket *> boundSockets;
+    std::thread thread;
+};
+
 /** HTTP module state */
 
-//! libevent event loop
-static struct event_base* eventBase = nullptr;
-//! HTTP server
-static struct evhttp* eventHTTP = nullptr;
+//! libevent event loops; the first one is returned by EventBase()
+static std::vector<std::unique_ptr<HTTPEventLoop>> eventLoops;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = nullptr;
 //! Handlers for (sub)paths
 static std::vector<HTTPPathHandler> pathHandlers;
-//! Bound listening sockets
-static std::vector<evhttp_bound_socket *> boundSockets;
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -264,7 +285,10 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
     if (i != iend) {
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
         assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        HTTPRequest* queued_req = item->req.get();
+        // A request that has to wait for room pushes back on the client instead
+        // of failing: nothing more is read from the connection until the reply.
+        if (workQueue->Enqueue(item.get(), [queued_req] { queued_req->PauseReading(); }))
             item.release(); /* if true, queue took ownership */
         else {
             LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
@@ -279,13 +303,15 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 static void http_reject_request_cb(struct evhttp_request* req, void*)
 {
     LogPrint(BCLog::HTTP, "Rejecting request while shutting down\n");
-    evhttp_send_error(req, HTTP_SERVUNAVAIL, nullptr);
+    // Let those waiting for the node to stop see how far it got
+    const std::string phase = GetShutdownPhase();
+    evhttp_send_error(req, HTTP_SERVUNAVAIL, phase.empty() ? nullptr : ("Shutting down: " + phase).c_str());
 }
 
 /** Event dispatcher thread */
-static bool ThreadHTTP(struct event_base* base)
+static bool ThreadHTTP(struct event_base* base, int loop_num)
 {
-    util::ThreadRename("http");
+    util::ThreadRename(loop_num == 0 ? std::string("http") : strprintf("http.%i", loop_num));
     LogPrint(BCLog::HTTP, "Entering http event loop\n");
     event_base_dispatch(base);
     // Event loop will be interrupted by InterruptHTTPServer()
@@ -293,8 +319,8 @@ static bool ThreadHTTP(struct event_base* base)
     return event_base_got_break(base) == 0;
 }
 
-/** Bind HTTP server to specified addresses */
-static bool HTTPBindAddresses(struct evhttp* http)
+/** Determine the addresses to bind the HTTP server to */
+static std::vector<std::pair<std::string, uint16_t> > HTTPBindEndpoints()
 {
     int http_port = gArgs.GetArg("-rpcport", BaseParams().RPCPort());
     std::vector<std::pair<std::string, uint16_t> > endpoints;
@@ -317,22 +343,53 @@ static bool HTTPBindAddresses(struct evhttp* http)
             endpoints.push_back(std::make_pair(host, port));
         }
     }
+    return endpoints;
+}
+
+#ifdef LEV_OPT_REUSEABLE_PORT
+/** Bind an address with SO_REUSEPORT, so that several event loops can listen on it */
+static evhttp_bound_socket* HTTPBindReusePort(struct HTTPEventLoop& loop, const std::string& host, uint16_t port)
+{
+    CService addr;
+    if (!Lookup(host.empty() ? "0.0.0.0" : host.c_str(), addr, port, false)) return nullptr;
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addr.GetSockAddr((struct sockaddr*)&sockaddr, &len)) return nullptr;
+    struct evconnlistener* listener = evconnlistener_new_bind(loop.base, nullptr, nullptr,
+        LEV_OPT_REUSEABLE | LEV_OPT_REUSEABLE_PORT | LEV_OPT_CLOSE_ON_EXEC | LEV_OPT_CLOSE_ON_FREE, -1,
+        (struct sockaddr*)&sockaddr, len);
+    if (!listener) return nullptr;
+    evhttp_bound_socket* bind_handle = evhttp_bind_listener(loop.http, listener);
+    if (!bind_handle) evconnlistener_free(listener);
+    return bind_handle;
+}
+#endif
 
-    // Bind addresses
-    for (std::vector<std::pair<std::string, uint16_t> >::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
+/** Bind the HTTP server of an event loop to the specified addresses */
+static bool HTTPBindAddresses(struct HTTPEventLoop& loop, const std::vector<std::pair<std::string, uint16_t> >& endpoints, bool reuse_port)
+{
+    for (std::vector<std::pair<std::string, uint16_t> >::const_iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
         LogPrint(BCLog::HTTP, "Binding RPC on address %s port %i\n", i->first, i->second);
-        evhttp_bound_socket *bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? nullptr : i->first.c_str(), i->second);
+        evhttp_bound_socket *bind_handle = nullptr;
+#ifdef LEV_OPT_REUSEABLE_PORT
+        if (reuse_port) {
+            bind_handle = HTTPBindReusePort(loop, i->first, i->second);
+        } else
+#endif
+        {
+            bind_handle = evhttp_bind_socket_with_handle(loop.http, i->first.empty() ? nullptr : i->first.c_str(), i->second);
+        }
         if (bind_handle) {
             CNetAddr addr;
-            if (i->first.empty() || (LookupHost(i->first, addr, false) && addr.IsBindAny())) {
+            if (&loop == eventLoops[0].get() && (i->first.empty() || (LookupHost(i->first, addr, false) && addr.IsBindAny()))) {
                 LogPrintf("WARNING: the RPC server is not safe to expose to untrusted networks such as the public internet\n");
             }
-            boundSockets.push_back(bind_handle);
+            loop.boundSockets.push_back(bind_handle);
         } else {
             LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
         }
     }
-    return !boundSockets.empty();
+    return !loop.boundSockets.empty();
 }
 
 /** Simple wrapper to set thread name and run work queue */
@@ -375,34 +432,47 @@ bool InitHTTPServer()
     evthread_use_pthreads();
 #endif
 
-    raii_event_base base_ctr = obtain_event_base();
-
-    /* Create a new evhttp object to handle requests. */
-    raii_evhttp http_ctr = obtain_evhttp(base_ctr.get());
-    struct evhttp* http = http_ctr.get();
-    if (!http) {
-        LogPrintf("couldn't create evhttp. Exiting.\n");
-        return false;
+    int eventThreads = std::max((long)gArgs.GetArg("-rpceventthreads", DEFAULT_HTTP_EVENT_THREADS), 1L);
+#ifndef LEV_OPT_REUSEABLE_PORT
+    if (eventThreads > 1) {
+        LogPrintf("WARNING: -rpceventthreads needs SO_REUSEPORT support in libevent 2.1 or later, using one event thread\n");
+        eventThreads = 1;
     }
+#endif
 
-    evhttp_set_timeout(http, gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
-    evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
-    evhttp_set_max_body_size(http, MAX_SIZE);
-    evhttp_set_gencb(http, http_request_cb, nullptr);
+    const std::vector<std::pair<std::string, uint16_t> > endpoints = HTTPBindEndpoints();
+    for (int n = 0; n < eventThreads; n++) {
+        raii_event_base base_ctr = obtain_event_base();
 
-    if (!HTTPBindAddresses(http)) {
-        LogPrintf("Unable to bind any endpoint for RPC server\n");
-        return false;
+        /* Create a new evhttp object to handle requests. */
+        raii_evhttp http_ctr = obtain_evhttp(base_ctr.get());
+        struct evhttp* http = http_ctr.get();
+        if (!http) {
+            LogPrintf("couldn't create evhttp. Exiting.\n");
+            return false;
+        }
+
+        evhttp_set_timeout(http, gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+        evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
+        evhttp_set_max_body_size(http, MAX_SIZE);
+        evhttp_set_gencb(http, http_request_cb, nullptr);
+
+        // transfer ownership to the event loop via .release()
+        std::unique_ptr<HTTPEventLoop> loop(new HTTPEventLoop());
+        loop->base = base_ctr.release();
+        loop->http = http_ctr.release();
+        eventLoops.push_back(std::move(loop));
+        if (!HTTPBindAddresses(*eventLoops.back(), endpoints, eventThreads > 1)) {
+            LogPrintf("Unable to bind any endpoint for RPC server\n");
+            return false;
+        }
     }
 
     LogPrint(BCLog::HTTP, "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)gArgs.GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
-    // transfer ownership to eventBase/HTTP via .release()
-    eventBase = base_ctr.release();
-    eventHTTP = http_ctr.release();
+    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth, workQueueDepth * HTTP_WORKQUEUE_BACKLOG_FACTOR);
     return true;
 }
 
@@ -420,15 +490,16 @@ bool UpdateHTTPServerLogging(bool enable) {
 #endif
 }
 
-static std::thread threadHTTP;
 static std::vector<std::thread> g_thread_http_workers;
 
 void StartHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Starting HTTP server\n");
     int rpcThreads = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
-    threadHTTP = std::thread(ThreadHTTP, eventBase);
+    LogPrintf("HTTP: starting %d worker threads and %d event threads\n", rpcThreads, eventLoops.size());
+    for (size_t n = 0; n < eventLoops.size(); n++) {
+        eventLoops[n]->thread = std::thread(ThreadHTTP, eventLoops[n]->base, n);
+    }
 
     for (int i = 0; i < rpcThreads; i++) {
         g_thread_http_workers.emplace_back(HTTPWorkQueueRun, workQueue, i);
@@ -438,17 +509,16 @@ void StartHTTPServer()
 void InterruptHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Interrupting HTTP server\n");
-    if (eventHTTP) {
+    for (const auto& loop : eventLoops) {
         // Reject requests on current connections
-        evhttp_set_gencb(eventHTTP, http_reject_request_cb, nullptr);
+        evhttp_set_gencb(loop->http, http_reject_request_cb, nullptr);
     }
     if (workQueue)
         workQueue->Interrupt();
 }
 
-void StopHTTPServer()
+void StopHTTPWorkers()
 {
-    LogPrint(BCLog::HTTP, "Stopping HTTP server\n");
     if (workQueue) {
         LogPrint(BCLog::HTTP, "Waiting for HTTP worker threads to exit\n");
         for (auto& thread: g_thread_http_workers) {
@@ -458,30 +528,35 @@ void StopHTTPServer()
         delete workQueue;
         workQueue = nullptr;
     }
+}
+
+void StopHTTPServer()
+{
+    LogPrint(BCLog::HTTP, "Stopping HTTP server\n");
+    StopHTTPWorkers();
     // Unlisten sockets, these are what make the event loop running, which means
     // that after this and all connections are closed the event loop will quit.
-    for (evhttp_bound_socket *socket : boundSockets) {
-        evhttp_del_accept_socket(eventHTTP, socket);
-    }
-    boundSockets.clear();
-    if (eventBase) {
-        LogPrint(BCLog::HTTP, "Waiting for HTTP event thread to exit\n");
-        threadHTTP.join();
+    for (const auto& loop : eventLoops) {
+        for (evhttp_bound_socket *socket : loop->boundSockets) {
+            evhttp_del_accept_socket(loop->http, socket);
+        }
+        loop->boundSockets.clear();
     }
-    if (eventHTTP) {
-        evhttp_free(eventHTTP);
-        eventHTTP = nullptr;
+    if (!eventLoops.empty()) {
+        LogPrint(BCLog::HTTP, "Waiting for HTTP event threads to exit\n");
     }
-    if (eventBase) {
-        event_base_free(eventBase);
-        eventBase = nullptr;
+    for (const auto& loop : eventLoops) {
+        if (loop->thread.joinable()) loop->thread.join();
+        evhttp_free(loop->http);
+        event_base_free(loop->base);
     }
+    eventLoops.clear();
     LogPrint(BCLog::HTTP, "Stopped HTTP server\n");
 }
 
 struct event_base* EventBase()
 {
-    return eventBase;
+    return eventLoops.empty() ? nullptr : eventLoops[0]->base;
 }
 
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
@@ -514,9 +589,26 @@ HTTPRequest::HTTPRequest(struct evhttp_request* _req, bool _replySent) : req(_re
 {
 }
 
+void HTTPRequest::PauseReading()
+{
+    assert(!replySent && req);
+    evhttp_connection* conn = evhttp_request_get_connection(req);
+    if (conn) {
+        bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+        if (bev) {
+            bufferevent_disable(bev, EV_READ);
+            readPaused = true;
+        }
+    }
+}
+
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (!replySent && chunkedReply) {
+        // A reply in chunks can only be cut short
+        LogPrintf("%s: Unfinished reply\n", __func__);
+        EndChunkedReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL_SERVER_ERROR, "Unhandled request");
@@ -562,6 +654,63 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+/** The event loop the connection of a request belongs to, which has to send its reply */
+static struct event_base* RequestEventBase(struct evhttp_request* req)
+{
+    evhttp_connection* conn = evhttp_request_get_connection(req);
+    return conn ? evhttp_connection_get_base(conn) : EventBase();
+}
+
+/** Re-enable reading from the connection of a request after its reply. This
+ * is the second part of the libevent workaround in http_request_cb, and ends
+ * the pause of a request that had to wait for room in the work queue.
+ */
+static void ResumeReading(struct evhttp_request* req, bool read_paused)
+{
+    if (read_paused || (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001)) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
+/** The chunks of a reply the client has yet to take, shared between the
+ * worker thread writing them and the event loop sending them.
+ */
+struct HTTPReplyFlow
+{
+    Mutex cs;
+    std::condition_variable cond;
+    //! Bytes written that have not left the output buffer of the connection
+    size_t queued GUARDED_BY(cs){0};
+    //! Of those, the bytes handed to libevent
+    size_t buffered GUARDED_BY(cs){0};
+    bool closed GUARDED_BY(cs){false};
+};
+
+/** Called by libevent when the output buffer of a connection is empty */
+static void http_reply_drained_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPReplyFlow* flow = static_cast<HTTPReplyFlow*>(arg);
+    LOCK(flow->cs);
+    flow->queued -= flow->buffered;
+    flow->buffered = 0;
+    flow->cond.notify_all();
+}
+
+/** Called by libevent when the connection of a reply in chunks goes away */
+static void http_reply_close_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPReplyFlow* flow = static_cast<HTTPReplyFlow*>(arg);
+    LOCK(flow->cs);
+    flow->closed = true;
+    flow->cond.notify_all();
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -569,7 +718,7 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  */
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && req && !chunkedReply);
     if (ShutdownRequested()) {
         WriteHeader("Connection", "close");
     }
@@ -578,25 +727,93 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
     auto req_copy = req;
-    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+    const bool read_paused = readPaused;
+    HTTPEvent* ev = new HTTPEvent(RequestEventBase(req), true, [req_copy, nStatus, read_paused]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
-            }
+        ResumeReading(req_copy, read_paused);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& chunk)
+{
+    assert(!replySent && req);
+    if (!chunkedReply && ShutdownRequested()) {
+        WriteHeader("Connection", "close");
+    }
+    auto req_copy = req;
+    const bool start = !chunkedReply;
+    if (start) replyFlow = std::make_shared<HTTPReplyFlow>();
+    std::shared_ptr<HTTPReplyFlow> flow = replyFlow;
+    {
+        LOCK(flow->cs);
+        flow->queued += chunk.size();
+    }
+    // The events of a loop run in the order they were triggered, so the chunks stay in order
+    HTTPEvent* ev = new HTTPEvent(RequestEventBase(req), true, [req_copy, start, chunk, flow]{
+        // libevent detaches the request from a connection that went away
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (!conn) {
+            http_reply_close_cb(nullptr, flow.get());
+            return;
         }
+        if (start) {
+            evhttp_send_reply_start(req_copy, HTTP_OK, nullptr);
+            evhttp_connection_set_closecb(conn, http_reply_close_cb, flow.get());
+        }
+        struct evbuffer* buf = evbuffer_new();
+        assert(buf);
+        evbuffer_add(buf, chunk.data(), chunk.size());
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+        evhttp_send_reply_chunk_with_cb(req_copy, buf, http_reply_drained_cb, flow.get());
+        LOCK(flow->cs);
+        flow->buffered += chunk.size();
+#else
+        // Without a callback, count the chunk as sent once libevent has it
+        evhttp_send_reply_chunk(req_copy, buf);
+        LOCK(flow->cs);
+        flow->queued -= chunk.size();
+        flow->cond.notify_all();
+#endif
+        evbuffer_free(buf);
+    });
+    ev->trigger(nullptr);
+    chunkedReply = true;
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(!replySent && req && chunkedReply);
+    auto req_copy = req;
+    const bool read_paused = readPaused;
+    std::shared_ptr<HTTPReplyFlow> flow = replyFlow;
+    HTTPEvent* ev = new HTTPEvent(RequestEventBase(req), true, [req_copy, read_paused, flow]{
+        // The connection may outlive the reply; ending it replaces the drained callback
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn) evhttp_connection_set_closecb(conn, nullptr, nullptr);
+        evhttp_send_reply_end(req_copy);
+        if (conn) ResumeReading(req_copy, read_paused);
     });
     ev->trigger(nullptr);
     replySent = true;
     req = nullptr; // transferred back to main thread
 }
 
+bool HTTPRequest::WaitForChunksSent(size_t max_queued)
+{
+    assert(!replySent && req);
+    if (!replyFlow) return true;
+    WAIT_LOCK(replyFlow->cs, lock);
+    while (!replyFlow->closed && replyFlow->queued > max_queued) {
+        // libevent closes a connection that takes nothing for -rpcservertimeout
+        if (ShutdownRequested()) return false;
+        replyFlow->cond.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    return !replyFlow->closed;
+}
+
 CService HTTPRequest::GetPeer() const
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -7,15 +7,18 @@
 
 #include <string>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
+static const int DEFAULT_HTTP_EVENT_THREADS=1;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
 struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPReplyFlow;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -28,6 +31,11 @@ bool InitHTTPServer();
 void StartHTTPServer();
 /** Interrupt HTTP server threads */
 void InterruptHTTPServer();
+/**
+ * Wait for the requests being handled, after which the server only rejects
+ * requests, with the phase of the shutdown.
+ */
+void StopHTTPWorkers();
 /** Stop HTTP server */
 void StopHTTPServer();
 
@@ -58,11 +66,22 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    //! Whether reading from the connection stopped until the reply
+    bool readPaused{false};
+    //! Whether a reply in chunks was started
+    bool chunkedReply{false};
+    //! What is left to send of a reply in chunks
+    std::shared_ptr<HTTPReplyFlow> replyFlow;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req, bool replySent = false);
     ~HTTPRequest();
 
+    /** Stop reading from the connection of the request until the reply is sent.
+     * Call this from the event loop thread of the request only.
+     */
+    void PauseReading();
+
     enum RequestMethod {
         UNKNOWN,
         GET,
@@ -113,6 +132,28 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Write a part of a HTTP 200 reply sent in chunks, as the parts are
+     * produced. The first call sends the headers.
+     *
+     * @note Finish with EndChunkedReply instead of WriteReply.
+     */
+    void WriteReplyChunk(const std::string& chunk);
+
+    /**
+     * Wait until at most max_queued bytes of the chunks written so far are
+     * still to be sent to the client, so that a long reply does not pile up
+     * in memory. Returns false if the client went away or the node is
+     * shutting down, in which case the reply is to be ended.
+     */
+    bool WaitForChunksSent(size_t max_queued);
+
+    /**
+     * Finish a reply started with WriteReplyChunk. Like WriteReply, this gives
+     * the request back to the main thread.
+     */
+    void EndChunkedReply();
 };
 
 /** Event handler closure.
@@ -0,0 +1,308 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <crypto/sha256.h>
+#include <dbwrapper.h>
+#include <index/addressindex.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The database stores the balance changes of each script under keys sorted by
+ * script, height, txid and input or output, so that the history of a script in
+ * a range of heights is one cursor walk. The coins a script holds are stored
+ * by script and outpoint.
+ *
+ * Scripts are keyed by their SHA256. Heights and indexes are big-endian so
+ * that keys sort numerically.
+ *
+ * Keys have the types [DB_ADDRESS_DELTA, uint256, int, uint256, uint32_t, bool]
+ * with a CAmount value, and [DB_ADDRESS_UNSPENT, uint256, uint256, uint32_t]
+ * with a Coin value.
+ */
+constexpr char DB_ADDRESS_DELTA = 'd';
+constexpr char DB_ADDRESS_UNSPENT = 'u';
+
+namespace {
+
+struct DBDeltaKey {
+    uint256 script_hash;
+    int height;
+    uint256 txid;
+    uint32_t index;
+    bool spending;
+
+    DBDeltaKey() : height(0), index(0), spending(false) {}
+    DBDeltaKey(const uint256& script_hash_in, int height_in, const uint256& txid_in = uint256(),
+               uint32_t index_in = 0, bool spending_in = false) :
+        script_hash(script_hash_in), height(height_in), txid(txid_in), index(index_in), spending(spending_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_ADDRESS_DELTA);
+        s << script_hash;
+        ser_writedata32be(s, height);
+        s << txid;
+        ser_writedata32be(s, index);
+        ser_writedata8(s, spending);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_ADDRESS_DELTA) {
+            throw std::ios_base::failure("Invalid format for address index DB delta key");
+        }
+        s >> script_hash;
+        height = ser_readdata32be(s);
+        s >> txid;
+        index = ser_readdata32be(s);
+        spending = ser_readdata8(s);
+    }
+};
+
+struct DBUnspentKey {
+    uint256 script_hash;
+    COutPoint outpoint;
+
+    DBUnspentKey() {}
+    DBUnspentKey(const uint256& script_hash_in, const COutPoint& outpoint_in) :
+        script_hash(script_hash_in), outpoint(outpoint_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_ADDRESS_UNSPENT);
+        s << script_hash << outpoint.hash;
+        ser_writedata32be(s, outpoint.n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_ADDRESS_UNSPENT) {
+            throw std::ios_base::failure("Invalid format for address index DB unspent key");
+        }
+        s >> script_hash >> outpoint.hash;
+        outpoint.n = ser_readdata32be(s);
+    }
+};
+
+} // namespace
+
+std::unique_ptr<AddressIndex> g_address_index;
+
+static uint256 GetScriptKey(const CScript& script)
+{
+    uint256 hash;
+    CSHA256().Write(script.data(), script.size()).Finalize(hash.begin());
+    return hash;
+}
+
+//! Whether the index keeps the balance changes of an output
+static bool IsIndexed(const CTxOut& out)
+{
+    return !out.scriptPubKey.IsUnspendable();
+}
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "address";
+    fs::create_directories(path);
+
+    m_db = MakeUnique<BaseIndex::DB>(path, n_cache_size, f_memory, f_wipe);
+}
+
+bool AddressIndex::Init()
+{
+    // The best indexed block may have been reorganized out of the active chain
+    // while the node was shut down. The coins of the index are not valid on
+    // the active chain then, so disconnect back to the fork point, as
+    // BaseIndex does on a reorg, before BaseIndex resumes from there.
+    CBlockLocator locator;
+    if (m_db->ReadBestBlock(locator) && !locator.IsNull()) {
+        const CBlockIndex* indexed_tip;
+        const CBlockIndex* fork;
+        {
+            LOCK(cs_main);
+            indexed_tip = LookupBlockIndex(locator.vHave.front());
+            if (!indexed_tip) {
+                return error("%s: best block %s of %s not found, the index has to be rebuilt with -reindex",
+                             __func__, locator.vHave.front().ToString(), GetName());
+            }
+            fork = ::ChainActive().FindFork(indexed_tip);
+        }
+        if (fork != indexed_tip) {
+            LogPrintf("%s: disconnecting %d stale blocks from %s\n",
+                      GetName(), indexed_tip->nHeight - fork->nHeight, indexed_tip->GetBlockHash().ToString());
+            CDBBatch batch(*m_db);
+            if (!DisconnectBlocks(batch, indexed_tip, fork)) return false;
+            WriteBestBlock(batch, fork);
+            if (!m_db->WriteBatch(batch)) {
+                return error("%s: Failed to disconnect stale blocks from %s", __func__, GetName());
+            }
+        }
+    }
+
+    return BaseIndex::Init();
+}
+
+void AddressIndex::WriteBestBlock(CDBBatch& batch, const CBlockIndex* pindex) const
+{
+    LOCK(cs_main);
+    m_db->WriteBestBlock(batch, ::ChainActive().GetLocator(pindex));
+}
+
+bool AddressIndex::AppendBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) const
+{
+    // The outputs of the genesis block are not in the UTXO set, so there is
+    // nothing the scripts they pay could spend.
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& tx_undo = block_undo.vtxundo.at(i - 1);
+            for (uint32_t j = 0; j < tx.vin.size(); j++) {
+                const Coin& prev = tx_undo.vprevout.at(j);
+                if (!IsIndexed(prev.out)) continue;
+                const uint256 script_key = GetScriptKey(prev.out.scriptPubKey);
+                batch.Write(DBDeltaKey(script_key, pindex->nHeight, txid, j, true), -prev.out.nValue);
+                batch.Erase(DBUnspentKey(script_key, tx.vin[j].prevout));
+            }
+        }
+        for (uint32_t j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& out = tx.vout[j];
+            if (!IsIndexed(out)) continue;
+            const uint256 script_key = GetScriptKey(out.scriptPubKey);
+            batch.Write(DBDeltaKey(script_key, pindex->nHeight, txid, j, false), out.nValue);
+            batch.Write(DBUnspentKey(script_key, COutPoint(txid, j)), Coin(out, pindex->nHeight, tx.IsCoinBase()));
+        }
+    }
+    return true;
+}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDBBatch batch(*m_db);
+    if (!AppendBlock(batch, block, pindex)) return false;
+    WriteBestBlock(batch, pindex);
+    return m_db->WriteBatch(batch);
+}
+
+bool AddressIndex::WriteBlocks(const std::vector<std::shared_ptr<const CBlock>>& blocks,
+                               const std::vector<const CBlockIndex*>& pindexes)
+{
+    if (blocks.empty()) return true;
+
+    CDBBatch batch(*m_db);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (!AppendBlock(batch, *blocks[i], pindexes[i])) return false;
+    }
+    WriteBestBlock(batch, pindexes.back());
+    return m_db->WriteBatch(batch);
+}
+
+bool AddressIndex::DisconnectBlocks(CDBBatch& batch, const CBlockIndex* current_tip, const CBlockIndex* new_tip) const
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!::ReadBlockFromDisk(block, pindex, consensus_params) || !UndoReadFromDisk(block_undo, pindex)) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+
+        // Undo the transactions in reverse, so that coins created and spent
+        // within the block end up erased.
+        for (size_t i = block.vtx.size(); i-- > 0;) {
+            const CTransaction& tx = *block.vtx[i];
+            const uint256& txid = tx.GetHash();
+            for (uint32_t j = 0; j < tx.vout.size(); j++) {
+                const CTxOut& out = tx.vout[j];
+                if (!IsIndexed(out)) continue;
+                const uint256 script_key = GetScriptKey(out.scriptPubKey);
+                batch.Erase(DBDeltaKey(script_key, pindex->nHeight, txid, j, false));
+                batch.Erase(DBUnspentKey(script_key, COutPoint(txid, j)));
+            }
+            if (tx.IsCoinBase()) continue;
+            const CTxUndo& tx_undo = block_undo.vtxundo.at(i - 1);
+            for (uint32_t j = 0; j < tx.vin.size(); j++) {
+                const Coin& prev = tx_undo.vprevout.at(j);
+                if (!IsIndexed(prev.out)) continue;
+                const uint256 script_key = GetScriptKey(prev.out.scriptPubKey);
+                batch.Erase(DBDeltaKey(script_key, pindex->nHeight, txid, j, true));
+                batch.Write(DBUnspentKey(script_key, tx.vin[j].prevout), prev);
+            }
+        }
+    }
+    return true;
+}
+
+bool AddressIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    CDBBatch batch(*m_db);
+    if (!DisconnectBlocks(batch, current_tip, new_tip)) return false;
+    WriteBestBlock(batch, new_tip);
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool AddressIndex::FindDeltas(const CScript& script, int start_height, int end_height, std::vector<AddressDelta>& deltas) const
+{
+    const uint256 script_key = GetScriptKey(script);
+
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    db_it->Seek(DBDeltaKey(script_key, start_height));
+    for (; db_it->Valid(); db_it->Next()) {
+        DBDeltaKey key;
+        if (!db_it->GetKey(key) || key.script_hash != script_key || key.height > end_height) break;
+
+        AddressDelta delta;
+        delta.nHeight = key.height;
+        delta.txid = key.txid;
+        delta.nIndex = key.index;
+        delta.fSpending = key.spending;
+        if (!db_it->GetValue(delta.nAmount)) {
+            return error("%s: unable to read value in %s at key (%c, %s, %d)",
+                         __func__, GetName(), DB_ADDRESS_DELTA, script_key.ToString(), key.height);
+        }
+        deltas.push_back(delta);
+    }
+    return true;
+}
+
+bool AddressIndex::FindUnspent(const CScript& script, std::vector<std::pair<COutPoint, Coin>>& unspent) const
+{
+    const uint256 script_key = GetScriptKey(script);
+
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    db_it->Seek(DBUnspentKey(script_key, COutPoint(uint256(), 0)));
+    for (; db_it->Valid(); db_it->Next()) {
+        DBUnspentKey key;
+        if (!db_it->GetKey(key) || key.script_hash != script_key) break;
+
+        Coin coin;
+        if (!db_it->GetValue(coin)) {
+            return error("%s: unable to read value in %s at key (%c, %s)",
+                         __func__, GetName(), DB_ADDRESS_UNSPENT, key.outpoint.ToString());
+        }
+        unspent.emplace_back(key.outpoint, std::move(coin));
+    }
+    return true;
+}
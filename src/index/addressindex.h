@@ -0,0 +1,85 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_INDEX_ADDRESSINDEX_H
+#define LITECOINZ_INDEX_ADDRESSINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <coins.h>
+#include <index/base.h>
+#include <script/script.h>
+#include <uint256.h>
+
+static constexpr bool DEFAULT_ADDRESSINDEX = false;
+
+/** A change of the transparent balance of a script by a transaction. */
+struct AddressDelta {
+    int nHeight;
+    uint256 txid;
+    uint32_t nIndex;   //!< The input or output of txid
+    bool fSpending;    //!< Whether nIndex is an input spending a coin of the script
+    CAmount nAmount;   //!< Negative for spends
+};
+
+/**
+ * AddressIndex stores, for every transparent scriptPubKey, the history of the
+ * coins it received and spent ordered by height, and the coins it still holds,
+ * so that the balance and history of an address can be looked up without
+ * rescanning the UTXO set or the block chain.
+ */
+class AddressIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+    bool AppendBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) const;
+
+    /** Undo the entries of the blocks from current_tip back to new_tip. */
+    bool DisconnectBlocks(CDBBatch& batch, const CBlockIndex* current_tip, const CBlockIndex* new_tip) const;
+
+    /**
+     * Write the best block of the index with its entries, so that the
+     * locator is never behind them and a restart can disconnect them.
+     */
+    void WriteBestBlock(CDBBatch& batch, const CBlockIndex* pindex) const;
+
+protected:
+    bool Init() override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool WriteBlocks(const std::vector<std::shared_ptr<const CBlock>>& blocks,
+                     const std::vector<const CBlockIndex*>& pindexes) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "addressindex"; }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /**
+     * Look up the balance changes of a script in blocks from start_height to
+     * end_height inclusive, ordered by height.
+     *
+     * @return false if the index could not be read.
+     */
+    bool FindDeltas(const CScript& script, int start_height, int end_height, std::vector<AddressDelta>& deltas) const;
+
+    /**
+     * Look up the coins a script holds as of the best indexed block.
+     *
+     * @return false if the index could not be read.
+     */
+    bool FindUnspent(const CScript& script, std::vector<std::pair<COutPoint, Coin>>& unspent) const;
+};
+
+/** The global address index. May be null. */
+extern std::unique_ptr<AddressIndex> g_address_index;
+
+#endif // LITECOINZ_INDEX_ADDRESSINDEX_H
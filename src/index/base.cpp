@@ -11,10 +11,14 @@
 #include <validation.h>
 #include <warnings.h>
 
+#include <algorithm>
+#include <thread>
+
 constexpr char DB_BEST_BLOCK = 'B';
 
 constexpr int64_t SYNC_LOG_INTERVAL = 30; // seconds
 constexpr int64_t SYNC_LOCATOR_WRITE_INTERVAL = 30; // seconds
+constexpr size_t SYNC_BATCH_SIZE = 32; // blocks read ahead and written together
 
 template<typename... Args>
 static void FatalError(const char* fmt, const Args&... args)
@@ -85,6 +89,42 @@ static const CBlockIndex* NextSyncBlock(const CBlockIndex* pindex_prev) EXCLUSIV
     return ::ChainActive().Next(::ChainActive().FindFork(pindex_prev));
 }
 
+/// Read the blocks of a sync batch. Each read also checks the Equihash solution,
+/// so the batch is split over several threads, each of which reads its share
+/// of the blocks at once. Returns the position of the first block that could
+/// not be read, or pindexes.size().
+static size_t ReadSyncBlocks(const std::vector<const CBlockIndex*>& pindexes,
+                             std::vector<std::shared_ptr<const CBlock>>& blocks,
+                             const Consensus::Params& consensus_params)
+{
+    blocks.assign(pindexes.size(), nullptr);
+    if (pindexes.empty()) return 0;
+    const size_t max_threads = std::min<size_t>(pindexes.size(), std::max(1, GetNumCores()));
+    const size_t share = (pindexes.size() + max_threads - 1) / max_threads;
+    const size_t n_threads = (pindexes.size() + share - 1) / share;
+    auto read = [&](size_t begin) {
+        const size_t end = std::min(begin + share, pindexes.size());
+        std::vector<const CBlockIndex*> thread_pindexes(pindexes.begin() + begin, pindexes.begin() + end);
+        std::vector<std::shared_ptr<CBlock>> thread_blocks;
+        ReadBlocksFromDisk(thread_blocks, thread_pindexes, consensus_params);
+        std::move(thread_blocks.begin(), thread_blocks.end(), blocks.begin() + begin);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < n_threads; i++) {
+        threads.emplace_back(read, i * share);
+    }
+    read(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (!blocks[i]) return i;
+    }
+    return blocks.size();
+}
+
 void BaseIndex::ThreadSync()
 {
     const CBlockIndex* pindex = m_best_block_index.load();
@@ -93,6 +133,8 @@ void BaseIndex::ThreadSync()
 
         int64_t last_log_time = 0;
         int64_t last_locator_write_time = 0;
+        std::vector<const CBlockIndex*> pindexes;
+        std::vector<std::shared_ptr<const CBlock>> blocks;
         while (true) {
             if (m_interrupt) {
                 m_best_block_index = pindex;
@@ -103,6 +145,7 @@ void BaseIndex::ThreadSync()
                 return;
             }
 
+            pindexes.clear();
             {
                 LOCK(cs_main);
                 const CBlockIndex* pindex_next = NextSyncBlock(pindex);
@@ -118,34 +161,40 @@ void BaseIndex::ThreadSync()
                                __func__, GetName());
                     return;
                 }
-                pindex = pindex_next;
+                // Read ahead along the active chain, which pindex_next is on.
+                while (pindex_next && pindexes.size() < SYNC_BATCH_SIZE) {
+                    pindexes.push_back(pindex_next);
+                    pindex_next = ::ChainActive().Next(pindex_next);
+                }
             }
 
             int64_t current_time = GetTime();
             if (last_log_time + SYNC_LOG_INTERVAL < current_time) {
                 LogPrintf("Syncing %s with block chain from height %d\n",
-                          GetName(), pindex->nHeight);
+                          GetName(), pindexes.front()->nHeight);
                 last_log_time = current_time;
             }
 
+            size_t n_read = ReadSyncBlocks(pindexes, blocks, consensus_params);
+            if (n_read < pindexes.size()) {
+                FatalError("%s: Failed to read block %s from disk",
+                           __func__, pindexes[n_read]->GetBlockHash().ToString());
+                return;
+            }
+            if (!WriteBlocks(blocks, pindexes)) {
+                FatalError("%s: Failed to write blocks %s to %s to index database",
+                           __func__, pindexes.front()->GetBlockHash().ToString(),
+                           pindexes.back()->GetBlockHash().ToString());
+                return;
+            }
+            pindex = pindexes.back();
+
             if (last_locator_write_time + SYNC_LOCATOR_WRITE_INTERVAL < current_time) {
                 m_best_block_index = pindex;
                 last_locator_write_time = current_time;
                 // No need to handle errors in Commit. See rationale above.
                 Commit();
             }
-
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
-                FatalError("%s: Failed to read block %s from disk",
-                           __func__, pindex->GetBlockHash().ToString());
-                return;
-            }
-            if (!WriteBlock(block, pindex)) {
-                FatalError("%s: Failed to write block %s to index database",
-                           __func__, pindex->GetBlockHash().ToString());
-                return;
-            }
         }
     }
 
@@ -156,6 +205,15 @@ void BaseIndex::ThreadSync()
     }
 }
 
+bool BaseIndex::WriteBlocks(const std::vector<std::shared_ptr<const CBlock>>& blocks,
+                            const std::vector<const CBlockIndex*>& pindexes)
+{
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (!WriteBlock(*blocks[i], pindexes[i])) return false;
+    }
+    return true;
+}
+
 bool BaseIndex::Commit()
 {
     CDBBatch batch(GetDB());
@@ -289,7 +347,8 @@ bool BaseIndex::BlockUntilSyncedToCurrentChain() const
     }
 
     LogPrintf("%s: %s is catching up on block notifications\n", __func__, GetName());
-    SyncWithValidationInterfaceQueue();
+    // Only this index's callbacks matter, however far behind other subscribers are
+    SyncWithValidationInterfaceQueue(*this);
     return true;
 }
 
@@ -302,7 +361,7 @@ void BaseIndex::Start()
 {
     // Need to register this ValidationInterface before running Init(), so that
     // callbacks are not missed if Init sets m_synced to true.
-    RegisterValidationInterface(this);
+    RegisterValidationInterface(this, GetName());
     if (!Init()) {
         FatalError("%s: %s failed to initialize", __func__, GetName());
         return;
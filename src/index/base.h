@@ -74,6 +74,12 @@ protected:
     /// Write update index entries for a newly connected block.
     virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) { return true; }
 
+    /// Write update index entries for a run of consecutive blocks read by the
+    /// sync thread. The default writes them one at a time with WriteBlock;
+    /// indices can override it to write the whole run in one batch.
+    virtual bool WriteBlocks(const std::vector<std::shared_ptr<const CBlock>>& blocks,
+                             const std::vector<const CBlockIndex*>& pindexes);
+
     /// Virtual method called internally by Commit that can be overridden to atomically
     /// commit more index state.
     virtual bool CommitInternal(CDBBatch& batch);
@@ -84,6 +90,9 @@ protected:
 
     virtual DB& GetDB() const = 0;
 
+    /// The last block in the chain that the index is in sync with.
+    const CBlockIndex* CurrentIndex() const { return m_best_block_index.load(); }
+
     /// Get the name of the index for display in logs.
     virtual const char* GetName() const = 0;
 
@@ -166,6 +166,49 @@ bool BlockFilterIndex::ReadFilterFromDisk(const FlatFilePos& pos, BlockFilter& f
     return true;
 }
 
+static uint64_t FilterCacheKey(const FlatFilePos& pos)
+{
+    return (static_cast<uint64_t>(pos.nFile) << 32) | pos.nPos;
+}
+
+void BlockFilterIndex::CacheFilter(const FlatFilePos& pos, const BlockFilter& filter)
+{
+    auto it = m_filter_cache_index.find(FilterCacheKey(pos));
+    if (it != m_filter_cache_index.end()) {
+        m_filter_cache.splice(m_filter_cache.begin(), m_filter_cache, it->second);
+        return;
+    }
+
+    m_filter_cache.emplace_front(pos, filter);
+    m_filter_cache_index.emplace(FilterCacheKey(pos), m_filter_cache.begin());
+    if (m_filter_cache.size() > FILTER_CACHE_SIZE) {
+        m_filter_cache_index.erase(FilterCacheKey(m_filter_cache.back().first));
+        m_filter_cache.pop_back();
+    }
+}
+
+bool BlockFilterIndex::ReadFilter(const FlatFilePos& pos, BlockFilter& filter)
+{
+    {
+        LOCK(m_cs_cache);
+        auto it = m_filter_cache_index.find(FilterCacheKey(pos));
+        if (it != m_filter_cache_index.end()) {
+            m_filter_cache.splice(m_filter_cache.begin(), m_filter_cache, it->second);
+            // A filter served twice is likely to be matched again, as when a
+            // rescan checks it against several script sets.
+            it->second->second.CacheDecodedFilter();
+            filter = it->second->second;
+            return true;
+        }
+    }
+
+    if (!ReadFilterFromDisk(pos, filter)) return false;
+
+    LOCK(m_cs_cache);
+    CacheFilter(pos, filter);
+    return true;
+}
+
 size_t BlockFilterIndex::WriteFilterToDisk(FlatFilePos& pos, const BlockFilter& filter)
 {
     assert(filter.GetFilterType() == GetFilterType());
@@ -251,6 +294,12 @@ bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex
         return false;
     }
 
+    // Light clients ask for the filters of new blocks first.
+    {
+        LOCK(m_cs_cache);
+        CacheFilter(m_next_filter_pos, filter);
+    }
+
     m_next_filter_pos.nPos += bytes_written;
     return true;
 }
@@ -377,29 +426,46 @@ static bool LookupRange(CDBWrapper& db, const std::string& index_name, int start
     return true;
 }
 
-bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
+bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out)
 {
     DBVal entry;
     if (!LookupOne(*m_db, block_index, entry)) {
         return false;
     }
 
-    return ReadFilterFromDisk(entry.pos, filter_out);
+    return ReadFilter(entry.pos, filter_out);
 }
 
-bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
+bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out)
 {
+    // Checkpoint headers are requested by every syncing light client, so keep them in memory.
+    const bool is_checkpoint{block_index->nHeight % CFCHECKPT_INTERVAL == 0};
+
+    if (is_checkpoint) {
+        LOCK(m_cs_cache);
+        auto header = m_headers_cache.find(block_index->GetBlockHash());
+        if (header != m_headers_cache.end()) {
+            header_out = header->second;
+            return true;
+        }
+    }
+
     DBVal entry;
     if (!LookupOne(*m_db, block_index, entry)) {
         return false;
     }
 
+    if (is_checkpoint) {
+        LOCK(m_cs_cache);
+        m_headers_cache.emplace(block_index->GetBlockHash(), entry.header);
+    }
+
     header_out = entry.header;
     return true;
 }
 
 bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* stop_index,
-                                         std::vector<BlockFilter>& filters_out) const
+                                         std::vector<BlockFilter>& filters_out)
 {
     std::vector<DBVal> entries;
     if (!LookupRange(*m_db, m_name, start_height, stop_index, entries)) {
@@ -409,7 +475,7 @@ bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* st
     filters_out.resize(entries.size());
     auto filter_pos_it = filters_out.begin();
     for (const auto& entry : entries) {
-        if (!ReadFilterFromDisk(entry.pos, *filter_pos_it)) {
+        if (!ReadFilter(entry.pos, *filter_pos_it)) {
             return false;
         }
         ++filter_pos_it;
@@ -7,8 +7,24 @@
 
 #include <blockfilter.h>
 #include <chain.h>
+#include <crypto/common.h>
 #include <flatfile.h>
 #include <index/base.h>
+#include <sync.h>
+
+#include <list>
+#include <unordered_map>
+
+/** Interval between compact filter checkpoints. See BIP 157. */
+static constexpr int CFCHECKPT_INTERVAL = 1000;
+
+/** Number of recently served or written filters kept in memory by each index. */
+static constexpr size_t FILTER_CACHE_SIZE = 2000;
+
+struct FilterHeaderHasher
+{
+    size_t operator()(const uint256& hash) const { return ReadLE64(hash.begin()); }
+};
 
 /**
  * BlockFilterIndex is used to store and retrieve block filters, hashes, and headers for a range of
@@ -30,6 +46,22 @@ private:
     bool ReadFilterFromDisk(const FlatFilePos& pos, BlockFilter& filter) const;
     size_t WriteFilterToDisk(FlatFilePos& pos, const BlockFilter& filter);
 
+    Mutex m_cs_cache;
+
+    /** Headers of the blocks at multiples of CFCHECKPT_INTERVAL, by block hash. */
+    std::unordered_map<uint256, uint256, FilterHeaderHasher> m_headers_cache GUARDED_BY(m_cs_cache);
+
+    /**
+     * Recently served or written filters, most recent first, with an index by their position in
+     * the filter files. Positions are never reused, so entries are never stale.
+     */
+    std::list<std::pair<FlatFilePos, BlockFilter>> m_filter_cache GUARDED_BY(m_cs_cache);
+    std::unordered_map<uint64_t, std::list<std::pair<FlatFilePos, BlockFilter>>::iterator> m_filter_cache_index GUARDED_BY(m_cs_cache);
+
+    /** Read a filter from the cache, or else from disk. */
+    bool ReadFilter(const FlatFilePos& pos, BlockFilter& filter);
+    void CacheFilter(const FlatFilePos& pos, const BlockFilter& filter) EXCLUSIVE_LOCKS_REQUIRED(m_cs_cache);
+
 protected:
     bool Init() override;
 
@@ -51,14 +83,14 @@ public:
     BlockFilterType GetFilterType() const { return m_filter_type; }
 
     /** Get a single filter by block. */
-    bool LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const;
+    bool LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out);
 
     /** Get a single filter header by block. */
-    bool LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const;
+    bool LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out);
 
     /** Get a range of filters between two heights on a chain. */
     bool LookupFilterRange(int start_height, const CBlockIndex* stop_index,
-                           std::vector<BlockFilter>& filters_out) const;
+                           std::vector<BlockFilter>& filters_out);
 
     /** Get a range of filter hashes between two heights on a chain. */
     bool LookupFilterHashRange(int start_height, const CBlockIndex* stop_index,
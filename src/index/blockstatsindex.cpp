@@ -0,0 +1,43 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dbwrapper.h>
+#include <index/blockstatsindex.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The database stores the statistics of each indexed block by block hash, so
+ * that those of blocks that were reorganized out of the active chain are still
+ * there if it comes back, and rewinding the index has nothing to undo.
+ *
+ * Keys have the type [DB_BLOCK_HASH, uint256].
+ */
+constexpr char DB_BLOCK_HASH = 's';
+
+std::unique_ptr<BlockStatsIndex> g_block_stats_index;
+
+BlockStatsIndex::BlockStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "blockstats";
+    fs::create_directories(path);
+
+    m_db = MakeUnique<BaseIndex::DB>(path, n_cache_size, f_memory, f_wipe);
+}
+
+bool BlockStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block has no undo data, and its coinbase spends nothing.
+    CBlockUndo block_undo;
+    if (pindex->nHeight > 0 && !UndoReadFromDisk(block_undo, pindex)) {
+        return false;
+    }
+
+    return m_db->Write(std::make_pair(DB_BLOCK_HASH, pindex->GetBlockHash()), ComputeBlockStats(block, block_undo));
+}
+
+bool BlockStatsIndex::LookUpStats(const CBlockIndex* block_index, CBlockStats& stats) const
+{
+    return m_db->Read(std::make_pair(DB_BLOCK_HASH, block_index->GetBlockHash()), stats);
+}
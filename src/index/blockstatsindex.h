@@ -0,0 +1,42 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_INDEX_BLOCKSTATSINDEX_H
+#define LITECOINZ_INDEX_BLOCKSTATSINDEX_H
+
+#include <chain.h>
+#include <index/base.h>
+#include <node/blockstats.h>
+
+static constexpr bool DEFAULT_BLOCKSTATSINDEX = false;
+
+/**
+ * BlockStatsIndex stores the statistics of getblockstats for every indexed
+ * block, so that they are read back rather than computed from the block and
+ * its undo data each time.
+ */
+class BlockStatsIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "blockstatsindex"; }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit BlockStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /** Look up the statistics of the block of block_index, if it was indexed. */
+    bool LookUpStats(const CBlockIndex* block_index, CBlockStats& stats) const;
+};
+
+/** The global block stats index. May be null. */
+extern std::unique_ptr<BlockStatsIndex> g_block_stats_index;
+
+#endif // LITECOINZ_INDEX_BLOCKSTATSINDEX_H
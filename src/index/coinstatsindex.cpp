@@ -0,0 +1,235 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <coins.h>
+#include <dbwrapper.h>
+#include <index/coinstatsindex.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The database stores the statistics of the UTXO set after each indexed block
+ * by block hash, so that those of blocks that were reorganized out of the
+ * active chain are still there if it comes back. The MuHash3072 itself, which
+ * only the finalized hash of is stored with the statistics, is stored for the
+ * block the index was committed at, along with the hash of that block.
+ *
+ * Keys have the types [DB_BLOCK_HASH, uint256] and DB_MUHASH.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_MUHASH = 'M';
+
+namespace {
+
+struct DBVal {
+    uint256 muhash;
+    uint64_t transaction_output_count;
+    uint64_t bogo_size;
+    CAmount total_amount;
+
+    SERIALIZE_METHODS(DBVal, obj)
+    {
+        READWRITE(obj.muhash, obj.transaction_output_count, obj.bogo_size, obj.total_amount);
+    }
+};
+
+uint64_t GetBogoSize(const CScript& script_pub_key)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + script_pub_key.size() /* scriptPubKey */;
+}
+
+} // namespace
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "coinstats";
+    fs::create_directories(path);
+
+    m_db = MakeUnique<BaseIndex::DB>(path, n_cache_size, f_memory, f_wipe);
+}
+
+bool CoinStatsIndex::Init()
+{
+    if (!BaseIndex::Init()) return false;
+
+    const CBlockIndex* best_block_index = CurrentIndex();
+    if (!best_block_index) return true;
+
+    std::pair<uint256, MuHash3072> muhash;
+    if (!m_db->Read(DB_MUHASH, muhash)) {
+        return error("%s: Cannot read current %s state; index may be corrupted",
+                     __func__, GetName());
+    }
+    m_muhash = muhash.second;
+
+    DBVal value;
+    if (!m_db->Read(std::make_pair(DB_BLOCK_HASH, muhash.first), value)) {
+        return error("%s: Cannot read current %s state; index may be corrupted",
+                     __func__, GetName());
+    }
+    m_transaction_output_count = value.transaction_output_count;
+    m_bogo_size = value.bogo_size;
+    m_total_amount = value.total_amount;
+
+    // The index was committed at a block that was reorganized out of the
+    // active chain while the node was shut down: go back to where it forked.
+    const CBlockIndex* pindex = WITH_LOCK(cs_main, return LookupBlockIndex(muhash.first));
+    if (!pindex || pindex->GetAncestor(best_block_index->nHeight) != best_block_index) {
+        return error("%s: %s was committed at unknown block %s",
+                     __func__, GetName(), muhash.first.ToString());
+    }
+    for (; pindex != best_block_index; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()) || !ReverseBlock(block, pindex)) {
+            return error("%s: Failed to rewind %s at block %s",
+                         __func__, GetName(), pindex->GetBlockHash().ToString());
+        }
+    }
+
+    uint256 out;
+    MuHash3072(m_muhash).Finalize(out);
+    if (!m_db->Read(std::make_pair(DB_BLOCK_HASH, best_block_index->GetBlockHash()), value) || value.muhash != out) {
+        return error("%s: Cannot read current %s state; index may be corrupted",
+                     __func__, GetName());
+    }
+    return true;
+}
+
+bool CoinStatsIndex::CommitInternal(CDBBatch& batch)
+{
+    const CBlockIndex* best_block_index = CurrentIndex();
+    if (best_block_index) {
+        batch.Write(DB_MUHASH, std::make_pair(best_block_index->GetBlockHash(), m_muhash));
+    }
+    return BaseIndex::CommitInternal(batch);
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The outputs of the genesis block are not spendable and not in the UTXO set.
+    if (pindex->nHeight > 0) {
+        CBlockUndo block_undo;
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+
+        for (size_t i = 0; i < block.vtx.size(); ++i) {
+            const CTransactionRef& tx = block.vtx[i];
+            for (uint32_t j = 0; j < tx->vout.size(); ++j) {
+                const CTxOut& out = tx->vout[j];
+                if (out.scriptPubKey.IsUnspendable()) continue;
+                ApplyCoinHash(m_muhash, COutPoint(tx->GetHash(), j), Coin(out, pindex->nHeight, tx->IsCoinBase()));
+                ++m_transaction_output_count;
+                m_bogo_size += GetBogoSize(out.scriptPubKey);
+                m_total_amount += out.nValue;
+            }
+
+            if (tx->IsCoinBase()) continue;
+            const CTxUndo& tx_undo = block_undo.vtxundo.at(i - 1);
+            for (size_t j = 0; j < tx->vin.size(); ++j) {
+                const Coin& coin = tx_undo.vprevout.at(j);
+                RemoveCoinHash(m_muhash, tx->vin[j].prevout, coin);
+                --m_transaction_output_count;
+                m_bogo_size -= GetBogoSize(coin.out.scriptPubKey);
+                m_total_amount -= coin.out.nValue;
+            }
+        }
+    }
+
+    DBVal value;
+    MuHash3072(m_muhash).Finalize(value.muhash);
+    value.transaction_output_count = m_transaction_output_count;
+    value.bogo_size = m_bogo_size;
+    value.total_amount = m_total_amount;
+    return m_db->Write(std::make_pair(DB_BLOCK_HASH, pindex->GetBlockHash()), value);
+}
+
+bool CoinStatsIndex::ReverseBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    if (pindex->nHeight == 0) {
+        m_muhash = MuHash3072();
+        m_transaction_output_count = m_bogo_size = m_total_amount = 0;
+        return true;
+    }
+
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransactionRef& tx = block.vtx[i];
+        for (uint32_t j = 0; j < tx->vout.size(); ++j) {
+            const CTxOut& out = tx->vout[j];
+            if (out.scriptPubKey.IsUnspendable()) continue;
+            RemoveCoinHash(m_muhash, COutPoint(tx->GetHash(), j), Coin(out, pindex->nHeight, tx->IsCoinBase()));
+            --m_transaction_output_count;
+            m_bogo_size -= GetBogoSize(out.scriptPubKey);
+            m_total_amount -= out.nValue;
+        }
+
+        if (tx->IsCoinBase()) continue;
+        const CTxUndo& tx_undo = block_undo.vtxundo.at(i - 1);
+        for (size_t j = 0; j < tx->vin.size(); ++j) {
+            const Coin& coin = tx_undo.vprevout.at(j);
+            ApplyCoinHash(m_muhash, tx->vin[j].prevout, coin);
+            ++m_transaction_output_count;
+            m_bogo_size += GetBogoSize(coin.out.scriptPubKey);
+            m_total_amount += coin.out.nValue;
+        }
+    }
+    return true;
+}
+
+bool CoinStatsIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!::ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!ReverseBlock(block, pindex)) {
+            return error("%s: Failed to read undo data of block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+    }
+
+    // The statistics after new_tip were stored when it was connected.
+    DBVal value;
+    if (!m_db->Read(std::make_pair(DB_BLOCK_HASH, new_tip->GetBlockHash()), value)) {
+        return error("%s: unable to read value in %s at key (%c, %s)",
+                     __func__, GetName(), DB_BLOCK_HASH, new_tip->GetBlockHash().ToString());
+    }
+    uint256 out;
+    MuHash3072(m_muhash).Finalize(out);
+    if (value.muhash != out || value.transaction_output_count != m_transaction_output_count ||
+        value.bogo_size != m_bogo_size || value.total_amount != m_total_amount) {
+        return error("%s: %s rewound to unexpected stats at block %s",
+                     __func__, GetName(), new_tip->GetBlockHash().ToString());
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex* block_index, CCoinsStats& coins_stats) const
+{
+    DBVal value;
+    if (!m_db->Read(std::make_pair(DB_BLOCK_HASH, block_index->GetBlockHash()), value)) {
+        return false;
+    }
+
+    coins_stats.muhash = value.muhash;
+    coins_stats.nTransactionOutputs = value.transaction_output_count;
+    coins_stats.coins_count = value.transaction_output_count;
+    coins_stats.nBogoSize = value.bogo_size;
+    coins_stats.nTotalAmount = value.total_amount;
+    return true;
+}
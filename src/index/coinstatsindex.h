@@ -0,0 +1,60 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_INDEX_COINSTATSINDEX_H
+#define LITECOINZ_INDEX_COINSTATSINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <crypto/muhash.h>
+#include <index/base.h>
+#include <node/coinstats.h>
+
+static constexpr bool DEFAULT_COINSTATSINDEX = false;
+
+/**
+ * CoinStatsIndex keeps the MuHash3072 of the UTXO set up to date as blocks
+ * are connected and disconnected, along with the other statistics of
+ * gettxoutsetinfo, and stores them for every indexed block, so that they are
+ * known for any height without scanning the set.
+ */
+class CoinStatsIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+    //! The multiset hash and statistics of the UTXO set after the best indexed block
+    MuHash3072 m_muhash;
+    uint64_t m_transaction_output_count{0};
+    uint64_t m_bogo_size{0};
+    CAmount m_total_amount{0};
+
+    //! Undo the changes of the block at the tip from m_muhash and the counts
+    bool ReverseBlock(const CBlock& block, const CBlockIndex* pindex);
+
+protected:
+    bool Init() override;
+
+    bool CommitInternal(CDBBatch& batch) override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "coinstatsindex"; }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /** Fill in the muhash and statistics of the UTXO set after block_index, if it was indexed. */
+    bool LookUpStats(const CBlockIndex* block_index, CCoinsStats& coins_stats) const;
+};
+
+/** The global coin stats index. May be null. */
+extern std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+#endif // LITECOINZ_INDEX_COINSTATSINDEX_H
@@ -0,0 +1,314 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dbwrapper.h>
+#include <index/compactshieldedblockindex.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* As in the block filter index, the database stores the disk location of the
+ * compact block of every block, by height for blocks on the active chain and
+ * by block hash for blocks that have been reorganized out of it. The disk
+ * location of the next compact block to be written is stored under the
+ * DB_BLOCK_POS key.
+ *
+ * Keys for the height index have the type [DB_BLOCK_HEIGHT, uint32 (BE)], so
+ * that reading a range of blocks by height is a sequential scan.
+ * Keys for the hash index have the type [DB_BLOCK_HASH, uint256].
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+constexpr char DB_BLOCK_POS = 'P';
+
+constexpr unsigned int MAX_CMP_FILE_SIZE = 0x8000000; // 128 MiB
+/** The pre-allocation chunk size for cmp?????.dat files */
+constexpr unsigned int CMP_FILE_CHUNK_SIZE = 0x100000; // 1 MiB
+
+std::unique_ptr<CompactShieldedBlockIndex> g_compact_block_index;
+
+namespace {
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for compact block index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    explicit DBHashKey(const uint256& hash_in) : hash(hash_in) {}
+
+    SERIALIZE_METHODS(DBHashKey, obj) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure("Invalid format for compact block index DB hash key");
+        }
+
+        READWRITE(obj.hash);
+    }
+};
+
+}; // namespace
+
+CompactShieldedBlockIndex::CompactShieldedBlockIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "compactblocks";
+    fs::create_directories(path);
+
+    m_db = MakeUnique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe);
+    m_block_fileseq = MakeUnique<FlatFileSeq>(GetBlocksDir(), "cmp", CMP_FILE_CHUNK_SIZE);
+}
+
+bool CompactShieldedBlockIndex::Init()
+{
+    if (!m_db->Read(DB_BLOCK_POS, m_next_block_pos)) {
+        // Any other cause than a missing key means the index is corrupted.
+        if (m_db->Exists(DB_BLOCK_POS)) {
+            return error("%s: Cannot read current %s state; index may be corrupted",
+                         __func__, GetName());
+        }
+
+        m_next_block_pos.nFile = 0;
+        m_next_block_pos.nPos = 0;
+    }
+    if (!BaseIndex::Init()) return false;
+
+    // With -prune, the blocks the index has yet to process must still be on
+    // disk, and are kept from then on.
+    LOCK(cs_main);
+    const CBlockIndex* pindex = CurrentIndex();
+    if (fHavePruned) {
+        const CBlockIndex* next = pindex ? ::ChainActive().Next(::ChainActive().FindFork(pindex)) : ::ChainActive().Genesis();
+        for (; next; next = ::ChainActive().Next(next)) {
+            if (!(next->nStatus & BLOCK_HAVE_DATA)) {
+                return error("%s: %s needs block %s, which is pruned; reindex, or start without -compactblockindex",
+                             __func__, GetName(), next->GetBlockHash().ToString());
+            }
+        }
+    }
+    SetPruneLock(GetName(), pindex ? pindex->nHeight : -1);
+    return true;
+}
+
+bool CompactShieldedBlockIndex::CommitInternal(CDBBatch& batch)
+{
+    const FlatFilePos& pos = m_next_block_pos;
+
+    // Flush current compact block file to disk.
+    CAutoFile file(m_block_fileseq->Open(pos), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return error("%s: Failed to open compact block file %d", __func__, pos.nFile);
+    }
+    if (!FileCommit(file.Get())) {
+        return error("%s: Failed to commit compact block file %d", __func__, pos.nFile);
+    }
+
+    batch.Write(DB_BLOCK_POS, pos);
+    if (!BaseIndex::CommitInternal(batch)) return false;
+
+    // After a restart the index resumes from the block committed here.
+    const CBlockIndex* pindex = CurrentIndex();
+    SetPruneLock(GetName(), pindex ? pindex->nHeight : -1);
+    return true;
+}
+
+bool CompactShieldedBlockIndex::ReadBlockFromDisk(const FlatFilePos& pos, CCompactShieldedBlock& block) const
+{
+    CAutoFile filein(m_block_fileseq->Open(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return false;
+    }
+
+    try {
+        filein >> block;
+    } catch (const std::exception& e) {
+        return error("%s: Failed to deserialize compact block from disk: %s", __func__, e.what());
+    }
+
+    return true;
+}
+
+size_t CompactShieldedBlockIndex::WriteBlockToDisk(FlatFilePos& pos, const CCompactShieldedBlock& block)
+{
+    size_t data_size = GetSerializeSize(block, CLIENT_VERSION);
+
+    // If writing the block would overflow the file, flush and move to the next one.
+    if (pos.nPos + data_size > MAX_CMP_FILE_SIZE) {
+        CAutoFile last_file(m_block_fileseq->Open(pos), SER_DISK, CLIENT_VERSION);
+        if (last_file.IsNull()) {
+            LogPrintf("%s: Failed to open compact block file %d\n", __func__, pos.nFile);
+            return 0;
+        }
+        if (!TruncateFile(last_file.Get(), pos.nPos)) {
+            LogPrintf("%s: Failed to truncate compact block file %d\n", __func__, pos.nFile);
+            return 0;
+        }
+        if (!FileCommit(last_file.Get())) {
+            LogPrintf("%s: Failed to commit compact block file %d\n", __func__, pos.nFile);
+            return 0;
+        }
+
+        pos.nFile++;
+        pos.nPos = 0;
+    }
+
+    bool out_of_space;
+    m_block_fileseq->Allocate(pos, data_size, out_of_space);
+    if (out_of_space) {
+        LogPrintf("%s: out of disk space\n", __func__);
+        return 0;
+    }
+
+    CAutoFile fileout(m_block_fileseq->Open(pos), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        LogPrintf("%s: Failed to open compact block file %d\n", __func__, pos.nFile);
+        return 0;
+    }
+
+    fileout << block;
+    return data_size;
+}
+
+bool CompactShieldedBlockIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CCompactShieldedBlock compact(block, pindex->nHeight);
+
+    size_t bytes_written = WriteBlockToDisk(m_next_block_pos, compact);
+    if (bytes_written == 0) return false;
+
+    std::pair<uint256, FlatFilePos> value(pindex->GetBlockHash(), m_next_block_pos);
+    if (!m_db->Write(DBHeightKey(pindex->nHeight), value)) {
+        return false;
+    }
+
+    m_next_block_pos.nPos += bytes_written;
+    return true;
+}
+
+bool CompactShieldedBlockIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    CDBBatch batch(*m_db);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+
+    // Keep the blocks being disconnected reachable by hash once their height
+    // index entries are overwritten.
+    DBHeightKey key(new_tip->nHeight);
+    db_it->Seek(key);
+    for (int height = new_tip->nHeight; height <= current_tip->nHeight; ++height) {
+        if (!db_it->GetKey(key) || key.height != height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, GetName(), DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, FlatFilePos> value;
+        if (!db_it->GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, GetName(), DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), value.second);
+
+        db_it->Next();
+    }
+
+    // Written along with the new references, in case Commit fails.
+    batch.Write(DB_BLOCK_POS, m_next_block_pos);
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool CompactShieldedBlockIndex::LookupBlock(const CBlockIndex* block_index, CCompactShieldedBlock& block_out) const
+{
+    // Blocks on the active chain are found by height, others by hash.
+    std::pair<uint256, FlatFilePos> read_out;
+    if (!m_db->Read(DBHeightKey(block_index->nHeight), read_out)) {
+        return false;
+    }
+    FlatFilePos pos = read_out.second;
+    if (read_out.first != block_index->GetBlockHash() &&
+        !m_db->Read(DBHashKey(block_index->GetBlockHash()), pos)) {
+        return false;
+    }
+
+    return ReadBlockFromDisk(pos, block_out);
+}
+
+bool CompactShieldedBlockIndex::LookupBlockRange(int start_height, const CBlockIndex* stop_index,
+                                                 std::vector<CCompactShieldedBlock>& blocks_out) const
+{
+    if (start_height < 0) {
+        return error("%s: start height (%d) is negative", __func__, start_height);
+    }
+    if (start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) is greater than stop height (%d)",
+                     __func__, start_height, stop_index->nHeight);
+    }
+
+    size_t results_size = static_cast<size_t>(stop_index->nHeight - start_height + 1);
+    std::vector<std::pair<uint256, FlatFilePos>> values(results_size);
+
+    DBHeightKey key(start_height);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    db_it->Seek(DBHeightKey(start_height));
+    for (int height = start_height; height <= stop_index->nHeight; ++height) {
+        if (!db_it->Valid() || !db_it->GetKey(key) || key.height != height) {
+            return false;
+        }
+
+        size_t i = static_cast<size_t>(height - start_height);
+        if (!db_it->GetValue(values[i])) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, GetName(), DB_BLOCK_HEIGHT, height);
+        }
+
+        db_it->Next();
+    }
+
+    // Walk back from stop_index to look up blocks that are not on the
+    // active chain by hash.
+    for (const CBlockIndex* block_index = stop_index;
+         block_index && block_index->nHeight >= start_height;
+         block_index = block_index->pprev) {
+        uint256 block_hash = block_index->GetBlockHash();
+
+        size_t i = static_cast<size_t>(block_index->nHeight - start_height);
+        if (block_hash != values[i].first &&
+            !m_db->Read(DBHashKey(block_hash), values[i].second)) {
+            return error("%s: unable to read value in %s at key (%c, %s)",
+                         __func__, GetName(), DB_BLOCK_HASH, block_hash.ToString());
+        }
+    }
+
+    blocks_out.resize(results_size);
+    for (size_t i = 0; i < results_size; i++) {
+        if (!ReadBlockFromDisk(values[i].second, blocks_out[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_INDEX_COMPACTSHIELDEDBLOCKINDEX_H
+#define LITECOINZ_INDEX_COMPACTSHIELDEDBLOCKINDEX_H
+
+#include <chain.h>
+#include <compactshieldedblock.h>
+#include <flatfile.h>
+#include <index/base.h>
+
+static constexpr bool DEFAULT_COMPACTBLOCKINDEX = false;
+
+/**
+ * CompactShieldedBlockIndex stores the compact shielded form of every block,
+ * to serve light wallets ranges of blocks by height without reading and
+ * stripping the full blocks. The compact blocks are kept in cmp?????.dat
+ * flat files in the blocks directory, next to the blocks they were made of.
+ */
+class CompactShieldedBlockIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+    FlatFilePos m_next_block_pos;
+    std::unique_ptr<FlatFileSeq> m_block_fileseq;
+
+    bool ReadBlockFromDisk(const FlatFilePos& pos, CCompactShieldedBlock& block) const;
+    size_t WriteBlockToDisk(FlatFilePos& pos, const CCompactShieldedBlock& block);
+
+protected:
+    bool Init() override;
+
+    bool CommitInternal(CDBBatch& batch) override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "compactblockindex"; }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit CompactShieldedBlockIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /** Get the compact form of a single block. */
+    bool LookupBlock(const CBlockIndex* block_index, CCompactShieldedBlock& block_out) const;
+
+    /** Get the compact form of a range of blocks between two heights on a chain. */
+    bool LookupBlockRange(int start_height, const CBlockIndex* stop_index,
+                          std::vector<CCompactShieldedBlock>& blocks_out) const;
+};
+
+/** The global compact shielded block index. May be null. */
+extern std::unique_ptr<CompactShieldedBlockIndex> g_compact_block_index;
+
+#endif // LITECOINZ_INDEX_COMPACTSHIELDEDBLOCKINDEX_H
@@ -0,0 +1,165 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <dbwrapper.h>
+#include <index/nullifierindex.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The database maps each nullifier to a NullifierLocation and each note
+ * commitment to a CommitmentLocation. The size of the note commitment tree
+ * after each indexed block is stored by block hash, so that the position of
+ * the next commitment is known again after a restart or a reorg.
+ *
+ * Keys have the types [DB_NULLIFIER, uint256], [DB_COMMITMENT, uint256] and
+ * [DB_TREE_SIZE, uint256].
+ */
+constexpr char DB_NULLIFIER = 'n';
+constexpr char DB_COMMITMENT = 'c';
+constexpr char DB_TREE_SIZE = 'S';
+
+std::unique_ptr<NullifierIndex> g_nullifier_index;
+
+NullifierIndex::NullifierIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "nullifiers";
+    fs::create_directories(path);
+
+    m_db = MakeUnique<BaseIndex::DB>(path, n_cache_size, f_memory, f_wipe);
+}
+
+bool NullifierIndex::Init()
+{
+    if (!BaseIndex::Init()) return false;
+
+    const CBlockIndex* best_block_index = CurrentIndex();
+    if (best_block_index && !m_db->Read(std::make_pair(DB_TREE_SIZE, best_block_index->GetBlockHash()), m_tree_size)) {
+        return error("%s: Cannot read current %s state; index may be corrupted",
+                     __func__, GetName());
+    }
+    return true;
+}
+
+bool NullifierIndex::AppendBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex, uint64_t& tree_size) const
+{
+    for (const auto& tx : block.vtx) {
+        const uint256& txid = tx->GetHash();
+        for (uint32_t i = 0; i < tx->vShieldedSpend.size(); i++) {
+            NullifierLocation location;
+            location.nHeight = pindex->nHeight;
+            location.hashBlock = pindex->GetBlockHash();
+            location.txid = txid;
+            location.nSpend = i;
+            batch.Write(std::make_pair(DB_NULLIFIER, tx->vShieldedSpend[i].nullifier), location);
+        }
+        for (const OutputDescription& output : tx->vShieldedOutput) {
+            CommitmentLocation location;
+            location.nHeight = pindex->nHeight;
+            location.hashBlock = pindex->GetBlockHash();
+            location.nPosition = tree_size++;
+            batch.Write(std::make_pair(DB_COMMITMENT, output.cm), location);
+        }
+    }
+    batch.Write(std::make_pair(DB_TREE_SIZE, pindex->GetBlockHash()), tree_size);
+    return true;
+}
+
+bool NullifierIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDBBatch batch(*m_db);
+    uint64_t tree_size = m_tree_size;
+    if (!AppendBlock(batch, block, pindex, tree_size) || !m_db->WriteBatch(batch)) {
+        return false;
+    }
+    m_tree_size = tree_size;
+    return true;
+}
+
+bool NullifierIndex::WriteBlocks(const std::vector<std::shared_ptr<const CBlock>>& blocks,
+                                 const std::vector<const CBlockIndex*>& pindexes)
+{
+    CDBBatch batch(*m_db);
+    uint64_t tree_size = m_tree_size;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (!AppendBlock(batch, *blocks[i], pindexes[i], tree_size)) return false;
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+    m_tree_size = tree_size;
+    return true;
+}
+
+bool NullifierIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // Nullifiers and note commitments are unique on a chain, so the entries
+    // of the disconnected blocks can simply be erased.
+    CDBBatch batch(*m_db);
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!::ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+        for (const auto& tx : block.vtx) {
+            for (const SpendDescription& spend : tx->vShieldedSpend) {
+                batch.Erase(std::make_pair(DB_NULLIFIER, spend.nullifier));
+            }
+            for (const OutputDescription& output : tx->vShieldedOutput) {
+                batch.Erase(std::make_pair(DB_COMMITMENT, output.cm));
+            }
+        }
+    }
+
+    uint64_t tree_size;
+    if (!m_db->Read(std::make_pair(DB_TREE_SIZE, new_tip->GetBlockHash()), tree_size)) {
+        return error("%s: unable to read value in %s at key (%c, %s)",
+                     __func__, GetName(), DB_TREE_SIZE, new_tip->GetBlockHash().ToString());
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+    m_tree_size = tree_size;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+//! Whether an index entry is for a block of the active chain.
+template <typename Location>
+static bool IsOnActiveChain(const Location& location) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const CBlockIndex* pindex = ::ChainActive()[location.nHeight];
+    return pindex && pindex->GetBlockHash() == location.hashBlock;
+}
+
+void NullifierIndex::FindNullifiers(const std::vector<uint256>& nullifiers, std::vector<Optional<NullifierLocation>>& locations) const
+{
+    locations.assign(nullifiers.size(), nullopt);
+    for (size_t i = 0; i < nullifiers.size(); i++) {
+        NullifierLocation location;
+        if (m_db->Read(std::make_pair(DB_NULLIFIER, nullifiers[i]), location)) {
+            locations[i] = location;
+        }
+    }
+
+    LOCK(cs_main);
+    for (Optional<NullifierLocation>& location : locations) {
+        if (location && !IsOnActiveChain(*location)) location = nullopt;
+    }
+}
+
+void NullifierIndex::FindCommitments(const std::vector<uint256>& cmus, std::vector<Optional<CommitmentLocation>>& locations) const
+{
+    locations.assign(cmus.size(), nullopt);
+    for (size_t i = 0; i < cmus.size(); i++) {
+        CommitmentLocation location;
+        if (m_db->Read(std::make_pair(DB_COMMITMENT, cmus[i]), location)) {
+            locations[i] = location;
+        }
+    }
+
+    LOCK(cs_main);
+    for (Optional<CommitmentLocation>& location : locations) {
+        if (location && !IsOnActiveChain(*location)) location = nullopt;
+    }
+}
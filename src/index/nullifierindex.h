@@ -0,0 +1,89 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_INDEX_NULLIFIERINDEX_H
+#define LITECOINZ_INDEX_NULLIFIERINDEX_H
+
+#include <chain.h>
+#include <index/base.h>
+#include <optional.h>
+#include <serialize.h>
+#include <uint256.h>
+
+static constexpr bool DEFAULT_NULLIFIERINDEX = false;
+
+/** Where a Sapling nullifier was revealed on the active chain. */
+struct NullifierLocation {
+    int nHeight{-1};
+    uint256 hashBlock;
+    uint256 txid;
+    uint32_t nSpend{0}; //!< The position of the spend in vShieldedSpend
+
+    SERIALIZE_METHODS(NullifierLocation, obj)
+    {
+        READWRITE(VARINT_MODE(obj.nHeight, VarIntMode::NONNEGATIVE_SIGNED), obj.hashBlock, obj.txid, VARINT(obj.nSpend));
+    }
+};
+
+/** Where a Sapling note commitment was appended to the note commitment tree. */
+struct CommitmentLocation {
+    int nHeight{-1};
+    uint256 hashBlock;
+    uint64_t nPosition{0}; //!< The position of the note in the tree
+
+    SERIALIZE_METHODS(CommitmentLocation, obj)
+    {
+        READWRITE(VARINT_MODE(obj.nHeight, VarIntMode::NONNEGATIVE_SIGNED), obj.hashBlock, VARINT(obj.nPosition));
+    }
+};
+
+/**
+ * NullifierIndex maps every Sapling nullifier revealed on the active chain to
+ * the spend that revealed it, and every note commitment to its block and its
+ * position in the note commitment tree, so that services can check the spent
+ * status of many notes without scanning blocks.
+ */
+class NullifierIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+    //! The number of note commitments in the tree after the best indexed block
+    uint64_t m_tree_size{0};
+
+    bool AppendBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex, uint64_t& tree_size) const;
+
+protected:
+    bool Init() override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool WriteBlocks(const std::vector<std::shared_ptr<const CBlock>>& blocks,
+                     const std::vector<const CBlockIndex*>& pindexes) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "nullifierindex"; }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit NullifierIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /**
+     * Look up a batch of nullifiers. Those not revealed on the active chain are
+     * left unset, including ones left over from blocks reorganized out of it
+     * while the node was shut down.
+     */
+    void FindNullifiers(const std::vector<uint256>& nullifiers, std::vector<Optional<NullifierLocation>>& locations) const;
+
+    /** Look up a batch of note commitments, the same way as FindNullifiers. */
+    void FindCommitments(const std::vector<uint256>& cmus, std::vector<Optional<CommitmentLocation>>& locations) const;
+};
+
+/** The global nullifier index. May be null. */
+extern std::unique_ptr<NullifierIndex> g_nullifier_index;
+
+#endif // LITECOINZ_INDEX_NULLIFIERINDEX_H
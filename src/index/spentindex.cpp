@@ -0,0 +1,101 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <dbwrapper.h>
+#include <index/spentindex.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The database maps each spent outpoint to a SpentLocation.
+ *
+ * Keys have the type [DB_SPENT, COutPoint].
+ */
+constexpr char DB_SPENT = 's';
+
+std::unique_ptr<SpentIndex> g_spent_index;
+
+SpentIndex::SpentIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "spent";
+    fs::create_directories(path);
+
+    m_db = MakeUnique<BaseIndex::DB>(path, n_cache_size, f_memory, f_wipe);
+}
+
+void SpentIndex::AppendBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) const
+{
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) continue;
+        const uint256& txid = tx->GetHash();
+        for (uint32_t i = 0; i < tx->vin.size(); i++) {
+            SpentLocation location;
+            location.nHeight = pindex->nHeight;
+            location.hashBlock = pindex->GetBlockHash();
+            location.txid = txid;
+            location.nInput = i;
+            batch.Write(std::make_pair(DB_SPENT, tx->vin[i].prevout), location);
+        }
+    }
+}
+
+bool SpentIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDBBatch batch(*m_db);
+    AppendBlock(batch, block, pindex);
+    return m_db->WriteBatch(batch);
+}
+
+bool SpentIndex::WriteBlocks(const std::vector<std::shared_ptr<const CBlock>>& blocks,
+                             const std::vector<const CBlockIndex*>& pindexes)
+{
+    CDBBatch batch(*m_db);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        AppendBlock(batch, *blocks[i], pindexes[i]);
+    }
+    return m_db->WriteBatch(batch);
+}
+
+bool SpentIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // An output is spent at most once on a chain, so the entries of the
+    // disconnected blocks can simply be erased.
+    CDBBatch batch(*m_db);
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!::ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+        for (const auto& tx : block.vtx) {
+            if (tx->IsCoinBase()) continue;
+            for (const CTxIn& txin : tx->vin) {
+                batch.Erase(std::make_pair(DB_SPENT, txin.prevout));
+            }
+        }
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+void SpentIndex::FindSpends(const std::vector<COutPoint>& outpoints, std::vector<Optional<SpentLocation>>& locations) const
+{
+    locations.assign(outpoints.size(), nullopt);
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        SpentLocation location;
+        if (m_db->Read(std::make_pair(DB_SPENT, outpoints[i]), location)) {
+            locations[i] = location;
+        }
+    }
+
+    LOCK(cs_main);
+    for (Optional<SpentLocation>& location : locations) {
+        if (!location) continue;
+        const CBlockIndex* pindex = ::ChainActive()[location->nHeight];
+        if (!pindex || pindex->GetBlockHash() != location->hashBlock) location = nullopt;
+    }
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_INDEX_SPENTINDEX_H
+#define LITECOINZ_INDEX_SPENTINDEX_H
+
+#include <chain.h>
+#include <index/base.h>
+#include <optional.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <uint256.h>
+
+static constexpr bool DEFAULT_SPENTINDEX = false;
+
+/** Which input of the active chain spent a transparent output. */
+struct SpentLocation {
+    int nHeight{-1};
+    uint256 hashBlock;
+    uint256 txid;
+    uint32_t nInput{0}; //!< The position of the input in vin
+
+    SERIALIZE_METHODS(SpentLocation, obj)
+    {
+        READWRITE(VARINT_MODE(obj.nHeight, VarIntMode::NONNEGATIVE_SIGNED), obj.hashBlock, obj.txid, VARINT(obj.nInput));
+    }
+};
+
+/**
+ * SpentIndex maps every transparent output spent on the active chain to the
+ * input that spent it, so that the spender of an outpoint is found without
+ * scanning the blocks after it.
+ */
+class SpentIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+    void AppendBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex) const;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool WriteBlocks(const std::vector<std::shared_ptr<const CBlock>>& blocks,
+                     const std::vector<const CBlockIndex*>& pindexes) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "spentindex"; }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit SpentIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /**
+     * Look up the spenders of a batch of outpoints. Those not spent on the
+     * active chain are left unset, including ones left over from blocks
+     * reorganized out of it while the node was shut down.
+     */
+    void FindSpends(const std::vector<COutPoint>& outpoints, std::vector<Optional<SpentLocation>>& locations) const;
+};
+
+/** The global spent index. May be null. */
+extern std::unique_ptr<SpentIndex> g_spent_index;
+
+#endif // LITECOINZ_INDEX_SPENTINDEX_H
@@ -244,19 +244,35 @@ bool TxIndex::Init()
     return BaseIndex::Init();
 }
 
-bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+static void AppendTxPositions(std::vector<std::pair<uint256, CDiskTxPos>>& vPos, const CBlock& block, const CBlockIndex* pindex)
 {
     // Exclude genesis block transaction because outputs are not spendable.
-    if (pindex->nHeight == 0) return true;
+    if (pindex->nHeight == 0) return;
 
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
-    vPos.reserve(block.vtx.size());
     for (const auto& tx : block.vtx) {
         vPos.emplace_back(tx->GetHash(), pos);
         pos.nTxOffset += ::GetSerializeSize(*tx, CLIENT_VERSION);
     }
-    return m_db->WriteTxs(vPos);
+}
+
+bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    vPos.reserve(block.vtx.size());
+    AppendTxPositions(vPos, block, pindex);
+    return vPos.empty() || m_db->WriteTxs(vPos);
+}
+
+bool TxIndex::WriteBlocks(const std::vector<std::shared_ptr<const CBlock>>& blocks,
+                          const std::vector<const CBlockIndex*>& pindexes)
+{
+    // One database batch for the whole run.
+    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        AppendTxPositions(vPos, *blocks[i], pindexes[i]);
+    }
+    return vPos.empty() || m_db->WriteTxs(vPos);
 }
 
 BaseIndex::DB& TxIndex::GetDB() const { return *m_db; }
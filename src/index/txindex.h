@@ -28,6 +28,9 @@ protected:
 
     bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
 
+    bool WriteBlocks(const std::vector<std::shared_ptr<const CBlock>>& blocks,
+                     const std::vector<const CBlockIndex*>& pindexes) override;
+
     BaseIndex::DB& GetDB() const override;
 
     const char* GetName() const override { return "txindex"; }
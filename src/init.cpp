@@ -17,24 +17,40 @@
 #include <chainparams.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/blake2b.h>
+#include <crypto/equihash.h>
+#include <crypto/siphash.h>
+#include <equihash_solver.h>
 #include <fs.h>
 #include <fetchparams.h>
+#include <headerssync.h>
 #include <httprpc.h>
 #include <httpserver.h>
+#include <index/addressindex.h>
 #include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
+#include <index/coinstatsindex.h>
+#include <index/compactshieldedblockindex.h>
+#include <index/nullifierindex.h>
+#include <index/spentindex.h>
 #include <index/txindex.h>
 #include <interfaces/chain.h>
 #include <key.h>
+#include <metrics.h>
 #include <miner.h>
 #include <net.h>
 #include <net_permissions.h>
 #include <net_processing.h>
 #include <netbase.h>
 #include <node/context.h>
+#include <node/dbcache.h>
 #include <policy/feerate.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
+#include <proof_verifier.h>
+#include <proofcache.h>
+#include <rpc/blockcache.h>
 #include <rpc/blockchain.h>
 #include <rpc/register.h>
 #include <rpc/server.h>
@@ -43,13 +59,17 @@
 #include <script/sigcache.h>
 #include <script/standard.h>
 #include <shutdown.h>
+#include <support/hugepages.h>
 #include <timedata.h>
+#include <stratum.h>
 #include <torcontrol.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
 #include <ui_interface.h>
 #include <util/asmap.h>
 #include <util/moneystr.h>
+#include <util/notify.h>
 #include <util/system.h>
 #include <util/threadnames.h>
 #include <util/translation.h>
@@ -61,7 +81,10 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <functional>
 #include <set>
+#include <thread>
+#include <vector>
 
 #ifndef WIN32
 #include <attributes.h>
@@ -87,6 +110,7 @@
 static bool fFeeEstimatesInitialized = false;
 static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
+static const bool DEFAULT_METRICS_ENABLE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 
 #ifdef WIN32
@@ -163,6 +187,7 @@ void Interrupt(NodeContext& node)
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptStratumServer();
     InterruptMapPort();
     if (node.connman)
         node.connman->Interrupt();
@@ -170,6 +195,56 @@ void Interrupt(NodeContext& node)
         g_txindex->Interrupt();
     }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Interrupt(); });
+    if (g_compact_block_index) {
+        g_compact_block_index->Interrupt();
+    }
+    if (g_nullifier_index) {
+        g_nullifier_index->Interrupt();
+    }
+    if (g_address_index) {
+        g_address_index->Interrupt();
+    }
+    if (g_spent_index) {
+        g_spent_index->Interrupt();
+    }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Interrupt();
+    }
+    if (g_block_stats_index) {
+        g_block_stats_index->Interrupt();
+    }
+    InterruptSnapshotValidation();
+}
+
+/**
+ * Run the independent persistence tasks of a shutdown together, the first on
+ * the calling thread and each other one on a thread of its own, and wait for
+ * all of them.
+ */
+static void RunShutdownTasks(const std::vector<std::function<void()>>& tasks)
+{
+    // A task that throws must not keep the others from finishing, nor leave
+    // a thread unjoined.
+    auto run = [&tasks](size_t i) {
+        try {
+            tasks[i]();
+        } catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "shutoff");
+        } catch (...) {
+            PrintExceptionContinue(nullptr, "shutoff");
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < tasks.size(); ++i) {
+        threads.emplace_back([&run, i] {
+            util::ThreadRename(strprintf("shutoff.%i", i));
+            run(i);
+        });
+    }
+    if (!tasks.empty()) run(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
 }
 
 void Shutdown(NodeContext& node)
@@ -187,10 +262,14 @@ void Shutdown(NodeContext& node)
     util::ThreadRename("shutoff");
     mempool.AddTransactionsUpdated(1);
 
+    SetShutdownPhase("stopping RPC and network");
     StopHTTPRPC();
     StopREST();
+    StopMetrics();
     StopRPC();
-    StopHTTPServer();
+    // The HTTP server keeps answering requests with the shutdown phase until
+    // StopHTTPServer() at the end.
+    StopHTTPWorkers();
     for (const auto& client : node.chain_clients) {
         client->flush();
     }
@@ -199,6 +278,8 @@ void Shutdown(NodeContext& node)
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
     if (node.peer_logic) UnregisterValidationInterface(node.peer_logic.get());
+    if (node.template_cache) UnregisterValidationInterface(node.template_cache.get());
+    if (node.block_cache) UnregisterValidationInterface(node.block_cache.get());
     // Follow the lock order requirements:
     // * CheckForStaleTipAndEvictPeers locks cs_main before indirectly calling GetExtraOutboundCount
     //   which locks cs_vNodes.
@@ -218,54 +299,123 @@ void Shutdown(NodeContext& node)
 
     // After everything has been shut down, but before things get flushed, stop the
     // CScheduler/checkqueue threadGroup
+    SetShutdownPhase("stopping threads");
     if (node.scheduler) node.scheduler->stop();
     threadGroup.interrupt_all();
     threadGroup.join_all();
 
+    // The Stratum server gets validation interface callbacks from the scheduler.
+    StopStratumServer();
+
+    // Nothing changes the mempool, the fee estimates, the peers or the coins
+    // any more, so they are written out together. With -dbasyncflush the
+    // coins flush only hands the changes to the background writer, which
+    // writes them while the indexes are stopped below.
+    SetShutdownPhase("writing mempool, fee estimates, peers and coins");
+    RunShutdownTasks({
+        [] {
+            // The background chainstate of a UTXO snapshot is flushed with the active one below.
+            StopSnapshotValidation();
+
+            // FlushStateToDisk generates a ChainStateFlushed callback, which we should avoid missing
+            //
+            // g_chainstate is referenced here directly (instead of ::ChainstateActive()) because it
+            // may not have been initialized yet.
+            LOCK(cs_main);
+            if (g_chainstate && g_chainstate->CanFlushToDisk()) {
+                g_chainstate->ForceFlushStateToDisk();
+            }
+        },
+        [] {
+            if (::mempool.IsLoaded() && gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+                DumpMempool(::mempool);
+                DumpValidationCaches();
+            }
+        },
+        [] {
+            if (fFeeEstimatesInitialized)
+            {
+                ::feeEstimator.FlushUnconfirmed();
+                fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
+                CAutoFile est_fileout(fsbridge::fopen(est_path, "wb"), SER_DISK, CLIENT_VERSION);
+                if (!est_fileout.IsNull())
+                    ::feeEstimator.Write(est_fileout);
+                else
+                    LogPrintf("Shutdown: Failed to write fee estimates to %s\n", est_path.string());
+                fFeeEstimatesInitialized = false;
+            }
+        },
+        [&node] {
+            if (node.connman) node.connman->FlushAddresses();
+        },
+    });
+
+    // After there are no more peers/RPC left to give us new data which may generate
+    // CValidationInterface callbacks, flush them. This stops the callback threads,
+    // which are not part of threadGroup, so none of them runs a callback of the
+    // objects reset below any more.
+    GetMainSignals().FlushBackgroundCallbacks();
+
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
     node.peer_logic.reset();
+    node.template_cache.reset();
+    node.block_cache.reset();
     node.connman.reset();
     node.banman.reset();
 
-    if (::mempool.IsLoaded() && gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
-        DumpMempool(::mempool);
-    }
-
-    if (fFeeEstimatesInitialized)
-    {
-        ::feeEstimator.FlushUnconfirmed();
-        fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
-        CAutoFile est_fileout(fsbridge::fopen(est_path, "wb"), SER_DISK, CLIENT_VERSION);
-        if (!est_fileout.IsNull())
-            ::feeEstimator.Write(est_fileout);
-        else
-            LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
-        fFeeEstimatesInitialized = false;
-    }
-
-    // FlushStateToDisk generates a ChainStateFlushed callback, which we should avoid missing
-    //
-    // g_chainstate is referenced here directly (instead of ::ChainstateActive()) because it
-    // may not have been initialized yet.
-    {
-        LOCK(cs_main);
-        if (g_chainstate && g_chainstate->CanFlushToDisk()) {
-            g_chainstate->ForceFlushStateToDisk();
-        }
-    }
-
-    // After there are no more peers/RPC left to give us new data which may generate
-    // CValidationInterface callbacks, flush them...
-    GetMainSignals().FlushBackgroundCallbacks();
-
     // Stop and delete all indexes only after flushing background callbacks.
-    if (g_txindex) {
-        g_txindex->Stop();
-        g_txindex.reset();
-    }
-    ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
-    DestroyAllBlockFilterIndexes();
+    // They have committed their state on the callbacks, and close their
+    // databases independently.
+    SetShutdownPhase("stopping indexes");
+    RunShutdownTasks({
+        [] {
+            ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
+            DestroyAllBlockFilterIndexes();
+        },
+        [] {
+            if (g_txindex) {
+                g_txindex->Stop();
+                g_txindex.reset();
+            }
+        },
+        [] {
+            if (g_compact_block_index) {
+                g_compact_block_index->Stop();
+                g_compact_block_index.reset();
+            }
+        },
+        [] {
+            if (g_nullifier_index) {
+                g_nullifier_index->Stop();
+                g_nullifier_index.reset();
+            }
+        },
+        [] {
+            if (g_address_index) {
+                g_address_index->Stop();
+                g_address_index.reset();
+            }
+        },
+        [] {
+            if (g_spent_index) {
+                g_spent_index->Stop();
+                g_spent_index.reset();
+            }
+        },
+        [] {
+            if (g_coin_stats_index) {
+                g_coin_stats_index->Stop();
+                g_coin_stats_index.reset();
+            }
+        },
+        [] {
+            if (g_block_stats_index) {
+                g_block_stats_index->Stop();
+                g_block_stats_index.reset();
+            }
+        },
+    });
 
     // Any future callbacks will be dropped. This should absolutely be safe - if
     // missing a callback results in an unrecoverable situation, unclean shutdown
@@ -273,17 +423,31 @@ void Shutdown(NodeContext& node)
     // up with our current chain to avoid any strange pruning edge cases and make
     // next startup faster by avoiding rescan.
 
-    {
-        LOCK(cs_main);
-        if (g_chainstate && g_chainstate->CanFlushToDisk()) {
-            g_chainstate->ForceFlushStateToDisk();
-            g_chainstate->ResetCoinsViews();
-        }
-        pblocktree.reset();
-    }
-    for (const auto& client : node.chain_clients) {
-        client->stop();
-    }
+    // The wallets do not wait for the chainstate, so they are flushed while
+    // the coins still being written are waited for.
+    SetShutdownPhase("final flush of coins and wallets");
+    RunShutdownTasks({
+        [] {
+            LOCK(cs_main);
+            if (g_chainstate && g_chainstate->CanFlushToDisk()) {
+                g_chainstate->ForceFlushStateToDisk();
+                g_chainstate->ResetCoinsViews();
+            }
+            if (g_background_chainstate && g_background_chainstate->CanFlushToDisk()) {
+                g_background_chainstate->ForceFlushStateToDisk();
+                g_background_chainstate->ResetCoinsViews();
+            }
+            StopUnlinkingPrunedFiles();
+            pblocktree.reset();
+        },
+        [&node] {
+            for (const auto& client : node.chain_clients) {
+                client->stop();
+            }
+        },
+    });
+    SetShutdownPhase("releasing resources");
+    StopNotifications();
 
 #if ENABLE_ZMQ
     if (g_zmq_notification_interface) {
@@ -300,6 +464,7 @@ void Shutdown(NodeContext& node)
     ECC_Stop();
     if (node.mempool) node.mempool = nullptr;
     node.scheduler.reset();
+    StopHTTPServer();
 
     try {
         if (!fs::remove(GetPidFile())) {
@@ -310,6 +475,7 @@ void Shutdown(NodeContext& node)
     }
 
     LogPrintf("%s: done\n", __func__);
+    LogInstance().StopAsync();
 }
 
 /**
@@ -383,29 +549,47 @@ void SetupServerArgs()
 #if HAVE_SYSTEM
     gArgs.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
-    gArgs.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script and shielded proof verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #if HAVE_SYSTEM
     gArgs.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
     gArgs.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockreconstructionextrashieldedtxn=<n>", strprintf("Extra shielded transactions to keep in memory for compact block reconstructions, in addition to -blockreconstructionextratxn (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_SHIELDED_TXN), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksonly", strprintf("Whether to reject transactions from network peers. Automatic broadcast and rebroadcast of any transactions from inbound peers is disabled, unless '-whitelistforcerelay' is '1', in which case whitelisted peers' transactions will be relayed. RPC transactions are not affected. (default: %u)", DEFAULT_BLOCKSONLY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-schedulerthreads=<n>", strprintf("Set the number of threads that run the scheduled tasks, such as database flushes and peer eviction checks (1 to %d, default: %d)", MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-callbackthreads=<n>", strprintf("Set the number of threads that run the validation callbacks of the wallets, indexes and other subscribers, each subscriber's in order (0 to %d, 0 = run them on the scheduler thread, default: %d)", MAX_CALLBACK_THREADS, DEFAULT_CALLBACK_THREADS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-checkparams=<mode>", "How to check the circuit parameter files at startup: 'cached' only hashes files that changed since their last successful check, 'full' hashes them all (default: cached)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-conf=<file>", strprintf("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbasyncflush", strprintf("Write the coins cache to disk in the background, except on shutdown (default: %u)", DEFAULT_DB_ASYNC_FLUSH), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-dbcache=<n>", strprintf("Maximum database cache size <n> MiB (%d to %d, default: %d). In addition, unused mempool memory is shared for this cache (see -maxmempool).", nMinDbCache, nMaxDbCache, nDefaultDbCache), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbblockcache=<n>", strprintf("Percentage of the chainstate database cache used to cache reads, the rest buffers writes (10 to 90, default: %d)", DBTuning().block_cache_percent), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbbloombits=<n>", strprintf("Bloom filter bits per key of the chainstate database, 0 for none (0 to 30, default: %d)", DBTuning().bloom_bits), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbcache=<n>", strprintf("Maximum database cache size <n> MiB (%d to %d, default: %d). In addition, unused mempool memory is shared for this cache (see -maxmempool). With \"auto\", start at %d%% of the memory limit of the cgroup or machine, grow the coins cache into free memory during initial block download, shrink it under memory pressure and return to the starting size once synced", nMinDbCache, nMaxDbCache, nDefaultDbCache, DBCACHE_AUTO_PERCENT), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbflushkeep=<n>", strprintf("Percentage of -dbcache to keep filled with the most recently used coins after writing them to disk, except on shutdown (0 to 100, 0 empties the cache, default: %d)", DEFAULT_DB_FLUSH_KEEP), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-hugepages", strprintf("Back the coins cache and the Equihash solver tables with 2 MiB pages, reserved ones if the system has them and transparent huge pages otherwise, to reduce TLB misses. Memory of the coins cache is then kept for reuse after it is written out (default: %u)", DEFAULT_HUGE_PAGES), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-loadblock=<file>", "Imports blocks from external file on startup", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-maxmempool=<n>", strprintf("Keep the transaction memory pool below <n> megabytes (default: %u)", DEFAULT_MAX_MEMPOOL_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-maxorphantx=<n>", strprintf("Keep at most <n> unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_TRANSACTIONS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-maxorphansize=<n>", strprintf("Keep at most <n> kilobytes of unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-mempoolexpiry=<n>", strprintf("Do not keep transactions in the mempool longer than <n> hours (default: %u)", DEFAULT_MEMPOOL_EXPIRY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+#ifndef WIN32
+    gArgs.AddArg("-notifysocket=<path>", "Listen on a Unix socket at <path> and write a line to each client when the best block changes (\"block <hash>\"), a wallet transaction changes (\"wallet <txid> <wallet name>\") or an alert is raised (\"alert <message>\"). Relative paths will be prefixed by a net-specific datadir location.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+#endif
+#if HAVE_SYSTEM
+    gArgs.AddArg("-notifythreads=<n>", strprintf("Set the number of threads that run the -blocknotify, -walletnotify and -alertnotify commands (1 to %d, default: %d). Of the commands queued while one of -blocknotify is running only the last is run", MAX_NOTIFY_THREADS, DEFAULT_NOTIFY_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+#endif
     gArgs.AddArg("-paramsdir=<dir>", "Specify LitecoinZ circuit parameters directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
+    gArgs.AddArg("-par=<n>", strprintf("Set the number of script and shielded proof verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-proofthreads=<n>", strprintf("Set the number of shielded proof verification threads, which then no longer follows -par (%u to %d, 0 = as many as -par, <0 = leave that many cores free, default: %d). The proofs are verified on these threads only, so the script verification threads and these can be sized to share the cores",
+        -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_PROOFCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool and the signature caches on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", BITCOIN_PID_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
@@ -417,11 +601,20 @@ void SetupServerArgs()
 #else
     hidden_args.emplace_back("-sysperms");
 #endif
+    gArgs.AddArg("-threadaffinity=<pool>:<cpus>", "Run the threads of pool, such as scriptch, httpworker, msghand or net, on the CPUs listed like 0-3,8 only, so that they stay on the NUMA node of the memory they allocate (Linux only). This option can be specified multiple times for different pools.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-trustblockindex", strprintf("Take the block index entries up to the -assumevalid block as written, without hashing their headers again at startup (default: %u)", DEFAULT_TRUST_BLOCK_INDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-chainhistory", strprintf("Maintain the ZIP 221 history tree of the active chain, used by the getchainhistory rpc call (default: %u)", DEFAULT_CHAIN_HISTORY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockfilterindex=<type>",
                  strprintf("Maintain an index of compact filters by block (default: %s, values: %s).", DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
                  " If <type> is not supplied or if <type> = 1, indexes for all known types are enabled.",
                  ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-compactblockindex", strprintf("Maintain an index of compact shielded blocks for light wallets, used by the getcompactblocks rpc call and the compactblocks REST endpoint. With -prune, the compact blocks are kept, and blocks are only pruned once they are in the index (default: %u)", DEFAULT_COMPACTBLOCKINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-nullifierindex", strprintf("Maintain an index of Sapling nullifiers and note commitments, used by the findnullifiers and findnotecommitments rpc calls (default: %u)", DEFAULT_NULLIFIERINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-addressindex", strprintf("Maintain an index of the transparent balance changes and coins of every address, used by the getaddressdeltas, getaddressbalance and getaddressutxos rpc calls (default: %u)", DEFAULT_ADDRESSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-spentindex", strprintf("Maintain an index of the inputs that spent every transparent output, used by the findspends rpc call and getrawtransaction (default: %u)", DEFAULT_SPENTINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockstatsindex", strprintf("Maintain the statistics of getblockstats for every block, so that getblockstats and getblockstatsrange read them rather than the blocks and their undo data (default: %u)", DEFAULT_BLOCKSTATSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinstatsindex", strprintf("Maintain the MuHash of the UTXO set and its statistics for every block, used by the gettxoutsetinfo rpc call (default: %u)", DEFAULT_COINSTATSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 
     gArgs.AddArg("-addnode=<ip>", "Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info). This option can be specified multiple times to add multiple nodes.", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-asmap=<file>", strprintf("Specify asn mapping used for bucketing of the peers (default: %s). Relative paths will be prefixed by the net-specific datadir location.", DEFAULT_ASMAP_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
@@ -434,6 +627,7 @@ void SetupServerArgs()
     gArgs.AddArg("-dnsseed", "Query for peer addresses via DNS lookup, if low on addresses (default: 1 unless -connect used)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-externalip=<ip>", "Specify your own public address", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-forcednsseed", strprintf("Always query for peer addresses via DNS lookup (default: %u)", DEFAULT_FORCEDNSSEED), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-headerssyncpeers=<n>", strprintf("While syncing headers below the last checkpoint, download ranges between checkpoints from up to <n> outbound peers in parallel, 0 to disable (default: %u)", DEFAULT_HEADERS_SYNC_PEERS), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-listen", "Accept connections from outside (default: 1 if no -proxy or -connect)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-listenonion", strprintf("Automatically create Tor hidden service (default: %d)", DEFAULT_LISTEN_ONION), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-maxconnections=<n>", strprintf("Maintain at most <n> connections to peers (default: %u)", DEFAULT_MAX_PEER_CONNECTIONS), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
@@ -441,8 +635,10 @@ void SetupServerArgs()
     gArgs.AddArg("-maxsendbuffer=<n>", strprintf("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)", DEFAULT_MAXSENDBUFFER), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-maxtimeadjustment", strprintf("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)", DEFAULT_MAX_TIME_ADJUSTMENT), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-maxuploadtarget=<n>", strprintf("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)", DEFAULT_MAX_UPLOAD_TARGET), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-netthreads=<n>", strprintf("Share out the sockets of peers to <n> network threads, which read, deserialize and send messages (1 to %d, default: %d). Needs epoll or kqueue", MAX_NET_THREADS, DEFAULT_NET_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onion=<ip:port>", "Use separate SOCKS5 proxy to reach peers via Tor hidden services, set -noonion to disable (default: -proxy)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onlynet=<net>", "Make outgoing connections only through network <net> (ipv4, ipv6 or onion). Incoming connections are not affected by this option. This option can be specified multiple times to allow multiple networks.", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-peerblockfilters", strprintf("Serve compact block filters to peers per BIP 157 (default: %u)", DEFAULT_PEERBLOCKFILTERS), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-peerbloomfilters", strprintf("Support filtering of blocks and transaction with bloom filters (default: %u)", DEFAULT_PEERBLOOMFILTERS), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-permitbaremultisig", strprintf("Relay non-P2SH multisig (default: %u)", DEFAULT_PERMIT_BAREMULTISIG), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-port=<port>", strprintf("Listen for connections on <port> (default: %u, testnet: %u, regtest: %u)", defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort(), regtestChainParams->GetDefaultPort()), ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
@@ -452,7 +648,9 @@ void SetupServerArgs()
     gArgs.AddArg("-timeout=<n>", strprintf("Specify connection timeout in milliseconds (minimum: 1, default: %d)", DEFAULT_CONNECT_TIMEOUT), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-peertimeout=<n>", strprintf("Specify p2p connection timeout in seconds. This option determines the amount of time a peer may be inactive before the connection to it is dropped. (minimum: 1, default: %d)", DEFAULT_PEER_CONNECT_TIMEOUT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-torcontrol=<ip>:<port>", strprintf("Tor control port to use if onion listening enabled (default: %s)", DEFAULT_TOR_CONTROL), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-torkeeponion", strprintf("Keep the Tor hidden service up while disconnected from the Tor control port or shut down, so that it is reachable right after reconnecting or restarting (default: %u)", DEFAULT_TOR_KEEP_ONION), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-torpassword=<pass>", "Tor control port password (default: empty)", ArgsManager::ALLOW_ANY | ArgsManager::SENSITIVE, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-txreconciliation", strprintf("Offer peers to reconcile transaction sets instead of announcing each transaction (default: %u)", DEFAULT_TXRECONCILIATION), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
 #ifdef USE_UPNP
 #if USE_UPNP
     gArgs.AddArg("-upnp", "Use UPnP to map the listening port (default: 1 when listening and no -proxy)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
@@ -481,19 +679,23 @@ void SetupServerArgs()
     gArgs.AddArg("-zmqpubhashtx=<address>", "Enable publish hash transaction in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblock=<address>", "Enable publish raw block in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtx=<address>", "Enable publish raw transaction in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubsequence=<address>", "Enable publish hash block and tx sequence in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashblockhwm=<n>", strprintf("Set publish hash block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashtxhwm=<n>", strprintf("Set publish hash transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblockhwm=<n>", strprintf("Set publish raw block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtxhwm=<n>", strprintf("Set publish raw transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubsequencehwm=<n>", strprintf("Set publish hash sequence message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
 #else
     hidden_args.emplace_back("-zmqpubhashblock=<address>");
     hidden_args.emplace_back("-zmqpubhashtx=<address>");
     hidden_args.emplace_back("-zmqpubrawblock=<address>");
     hidden_args.emplace_back("-zmqpubrawtx=<address>");
+    hidden_args.emplace_back("-zmqpubsequence=<address>");
     hidden_args.emplace_back("-zmqpubhashblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubhashtxhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawtxhwm=<n>");
+    hidden_args.emplace_back("-zmqpubsequencehwm=<n>");
 #endif
 
     gArgs.AddArg("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
@@ -516,11 +718,15 @@ void SetupServerArgs()
     gArgs.AddArg("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-lockholdtimes", "Measure how long locks are held, for getlockstats (default: 0)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-addrmantest", "Allows to test address relay on localhost", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-debug=<category>", "Output debugging information (default: -nodebug, supplying <category> is optional). "
         "If <category> is not supplied or if <category> = 1, output all debugging information. <category> can be: " + ListLogCategories() + ".", ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-debugexclude=<category>", strprintf("Exclude debugging information for a category. Can be used in conjunction with -debug=1 to output debug logs for all categories except one or more specified categories."), ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-logasync", strprintf("Write debug output on a separate thread, dropping messages rather than waiting when it falls behind (default: %u)", DEFAULT_LOGASYNC), ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-logasyncqueue=<n>", strprintf("Number of messages -logasync holds before dropping new ones (default: %u)", DEFAULT_LOGASYNC_QUEUE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-logips", strprintf("Include IP addresses in debug output (default: %u)", DEFAULT_LOGIPS), ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-logratelimit=<n>", strprintf("Log at most <n> messages per second for each -debug category, 0 for no limit (default: %u)", DEFAULT_LOGRATELIMIT), ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-logtimestamps", strprintf("Prepend debug output with timestamp (default: %u)", DEFAULT_LOGTIMESTAMPS), ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
 #ifdef HAVE_THREAD_LOCAL
     gArgs.AddArg("-logthreadnames", strprintf("Prepend debug output with name of the originating thread (only available on platforms supporting thread_local) (default: %u)", DEFAULT_LOGTHREADNAMES), ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
@@ -529,6 +735,7 @@ void SetupServerArgs()
 #endif
     gArgs.AddArg("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-mocktime=<n>", "Replace actual time with " + UNIX_EPOCH_TIME + " (default: 0)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-maxproofcachesize=<n>", strprintf("Limit size of the shielded proof cache to <n> MiB (default: %u)", DEFAULT_MAX_PROOF_CACHE_SIZE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-printpriority", strprintf("Log transaction fee per kB when mining blocks (default: %u)", DEFAULT_PRINTPRIORITY), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
@@ -552,17 +759,27 @@ void SetupServerArgs()
 
     gArgs.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-equihashsolver=<name>", strprintf("Equihash solver used to generate blocks (%s; default: %s)", EquihashSolverNames(), DEFAULT_EQUIHASH_SOLVER), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-genproclimit=<n>", strprintf("Number of threads searching nonces when generating blocks, -1 for one per core. Every thread runs its own solver instance (default: %d)", DEFAULT_GENERATE_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stratum", strprintf("Serve Stratum (ZIP 301) mining jobs paying to -stratumaddress (default: %u)", DEFAULT_STRATUM), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stratumaddress=<addr>", "Transparent address the coinbase of Stratum jobs pays to", ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stratumbind=<addr>[:port]", "Bind the Stratum server to the given address. Use [host]:port notation for IPv6. This option can be specified multiple times (default: 127.0.0.1)", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stratumport=<port>", strprintf("Listen for Stratum connections on <port> (default: %u)", DEFAULT_STRATUM_PORT), ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::BLOCK_CREATION);
 
     gArgs.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
+    gArgs.AddArg("-metrics", strprintf("Serve unauthenticated Prometheus metrics at /metrics on the RPC port (default: %u)", DEFAULT_METRICS_ENABLE), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcallowip=<ip>", "Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times", ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcauth=<userpw>", "Username and HMAC-SHA-256 hashed password for JSON-RPC connections. The field <userpw> comes in the format: <USERNAME>:<SALT>$<HASH>. A canonical python script is included in share/rpcauth. The client then connects normally using the rpcuser=<USERNAME>/rpcpassword=<PASSWORD> pair of arguments. This option can be specified multiple times", ArgsManager::ALLOW_ANY | ArgsManager::SENSITIVE, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcbatchthreads=<n>", strprintf("Set the number of threads that run the read-only calls (getblock, getrawtransaction, gettxout) of a JSON-RPC batch at the same time, or 0 to run batches one call after another (default: %d)", DEFAULT_RPC_BATCH_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcbind=<addr>[:port]", "Bind to given address to listen for JSON-RPC connections. Do not expose the RPC server to untrusted networks such as the public internet! This option is ignored unless -rpcallowip is also passed. Port is optional and overrides -rpcport. Use [host]:port notation for IPv6. This option can be specified multiple times (default: 127.0.0.1 and ::1 i.e., localhost)", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY | ArgsManager::SENSITIVE, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcblockcache=<n>", strprintf("Keep up to <n> MiB of recently requested blocks, serialized and as JSON, to answer getblock and REST block requests from, or 0 to not keep any (default: %d)", DEFAULT_RPC_BLOCK_CACHE), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpccookiefile=<loc>", "Location of the auth cookie. Relative paths will be prefixed by a net-specific datadir location. (default: data dir)", ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcpassword=<pw>", "Password for JSON-RPC connections", ArgsManager::ALLOW_ANY | ArgsManager::SENSITIVE, OptionsCategory::RPC);
     gArgs.AddArg("-rpcport=<port>", strprintf("Listen for JSON-RPC connections on <port> (default: %u, testnet: %u, regtest: %u)", defaultBaseParams->RPCPort(), testnetBaseParams->RPCPort(), regtestBaseParams->RPCPort()), ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcserialversion", strprintf("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)", DEFAULT_RPC_SERIALIZE_VERSION), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::RPC);
+    gArgs.AddArg("-rpceventthreads=<n>", strprintf("Set the number of threads that accept RPC connections and parse requests, which needs SO_REUSEPORT support (default: %d)", DEFAULT_HTTP_EVENT_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcthreads=<n>", strprintf("Set the number of threads to service RPC calls (default: %d)", DEFAULT_HTTP_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcuser=<user>", "Username for JSON-RPC connections", ArgsManager::ALLOW_ANY | ArgsManager::SENSITIVE, OptionsCategory::RPC);
     gArgs.AddArg("-rpcwhitelist=<whitelist>", "Set a whitelist to filter incoming RPC calls for a specific user. The field <whitelist> comes in the format: <USERNAME>:<rpc 1>,<rpc 2>,...,<rpc n>. If multiple whitelists are set for a given user, they are set-intersected. See -rpcwhitelistdefault documentation for information on default whitelist behavior.", ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
@@ -599,20 +816,22 @@ std::string LicenseInfo()
            "\n";
 }
 
-#if HAVE_SYSTEM
 static void BlockNotifyCallback(bool initialSync, const CBlockIndex *pBlockIndex)
 {
     if (initialSync || !pBlockIndex)
         return;
 
+    const std::string hash = pBlockIndex->GetBlockHash().GetHex();
+    SendNotification("block " + hash);
+#if HAVE_SYSTEM
     std::string strCmd = gArgs.GetArg("-blocknotify", "");
     if (!strCmd.empty()) {
-        boost::replace_all(strCmd, "%s", pBlockIndex->GetBlockHash().GetHex());
-        std::thread t(runCommand, strCmd);
-        t.detach(); // thread runs free
+        boost::replace_all(strCmd, "%s", hash);
+        // Of the tips connected while the command runs only the last is reported
+        QueueNotifyCommand(strCmd, "blocknotify");
     }
-}
 #endif
+}
 
 static bool fHaveGenesis = false;
 static Mutex g_genesis_wait_mutex;
@@ -767,11 +986,45 @@ static bool InitSanityCheck()
     return true;
 }
 
-static bool LoadParams()
+static void ThreadLoadParams(const fs::path& sapling_spend, const fs::path& sapling_output, const fs::path& sprout_groth16)
 {
+    util::ThreadRename("loadparams");
+
     struct timeval tv_start, tv_end;
     float elapsed;
 
+    auto sapling_spend_str = sapling_spend.native();
+    auto sapling_output_str = sapling_output.native();
+    auto sprout_groth16_str = sprout_groth16.native();
+
+    LogPrintf("Loading Sapling (Spend) parameters from %s\n", sapling_spend.string().c_str());
+    LogPrintf("Loading Sapling (Output) parameters from %s\n", sapling_output.string().c_str());
+    LogPrintf("Loading Sapling (Sprout Groth16) parameters from %s\n", sprout_groth16.string().c_str());
+    gettimeofday(&tv_start, 0);
+
+    librustzcash_init_zksnark_params(
+        reinterpret_cast<const codeunit*>(sapling_spend_str.c_str()),
+        sapling_spend_str.length(),
+        "8270785a1a0d0bc77196f000ee6d221c9c9894f55307bd9357c3f0105d31ca63991ab91324160d8f53e2bbd3c2633a6eb8bdf5205d822e7f3f73edac51b2b70c",
+        reinterpret_cast<const codeunit*>(sapling_output_str.c_str()),
+        sapling_output_str.length(),
+        "657e3d38dbb5cb5e7dd2970e8b03d69b4787dd907285b5a7f0790dcc8072f60bf593b32cc2d1c030e00ff5ae64bf84c5c3beb84ddc841d48264b4a171744d028",
+        reinterpret_cast<const codeunit*>(sprout_groth16_str.c_str()),
+        sprout_groth16_str.length(),
+        "e9b238411bd6c0ec4791e9d04245ec350c9c5744f5610dfcce4365d5ca49dfefd5054e371842b3f88fa1b9d7e8e075249b3ebabd167fa8b0f3161292d36c180a"
+    );
+
+    gettimeofday(&tv_end, 0);
+    elapsed = float(tv_end.tv_sec-tv_start.tv_sec) + (tv_end.tv_usec-tv_start.tv_usec)/float(1000000);
+    LogPrintf("Loaded verifying key in %fs seconds.\n", elapsed);
+
+    SetZKSnarkParamsLoaded();
+}
+
+static bool LoadParams()
+{
+    const bool fFullCheck = gArgs.GetArg("-checkparams", "cached") == "full";
+
     boost::filesystem::path sapling_spend = GetParamsDir() / "sapling-spend.params";
     boost::filesystem::path sapling_output = GetParamsDir() / "sapling-output.params";
     boost::filesystem::path sprout_groth16 = GetParamsDir() / "sprout-groth16.params";
@@ -783,7 +1036,7 @@ static bool LoadParams()
     }
 
     // Verify the 'sapling-spend.params' file
-    if (!(VerifyParams(sapling_spend.string(), "8e48ffd23abb3a5fd9c5589204f32d9c31285a04b78096ba40a79b75677efc13"))) {
+    if (!(VerifyParams(sapling_spend.string(), "8e48ffd23abb3a5fd9c5589204f32d9c31285a04b78096ba40a79b75677efc13", fFullCheck))) {
         return false;
     }
 
@@ -794,7 +1047,7 @@ static bool LoadParams()
     }
 
     // Verify the 'sapling-output.params' file
-    if (!(VerifyParams(sapling_output.string(), "2f0ebbcbb9bb0bcffe95a397e7eba89c29eb4dde6191c339db88570e3f3fb0e4"))) {
+    if (!(VerifyParams(sapling_output.string(), "2f0ebbcbb9bb0bcffe95a397e7eba89c29eb4dde6191c339db88570e3f3fb0e4", fFullCheck))) {
         return false;
     }
 
@@ -805,34 +1058,15 @@ static bool LoadParams()
     }
 
     // Verify the 'sprout-groth16.params' file
-    if (!(VerifyParams(sprout_groth16.string(), "b685d700c60328498fbde589c8c7c484c722b788b265b72af448a5bf0ee55b50"))) {
+    if (!(VerifyParams(sprout_groth16.string(), "b685d700c60328498fbde589c8c7c484c722b788b265b72af448a5bf0ee55b50", fFullCheck))) {
         return false;
     }
 
-    auto sapling_spend_str = sapling_spend.native();
-    auto sapling_output_str = sapling_output.native();
-    auto sprout_groth16_str = sprout_groth16.native();
-
-    LogPrintf("Loading Sapling (Spend) parameters from %s\n", sapling_spend.string().c_str());
-    LogPrintf("Loading Sapling (Output) parameters from %s\n", sapling_output.string().c_str());
-    LogPrintf("Loading Sapling (Sprout Groth16) parameters from %s\n", sprout_groth16.string().c_str());
-    gettimeofday(&tv_start, 0);
-
-    librustzcash_init_zksnark_params(
-        reinterpret_cast<const codeunit*>(sapling_spend_str.c_str()),
-        sapling_spend_str.length(),
-        "8270785a1a0d0bc77196f000ee6d221c9c9894f55307bd9357c3f0105d31ca63991ab91324160d8f53e2bbd3c2633a6eb8bdf5205d822e7f3f73edac51b2b70c",
-        reinterpret_cast<const codeunit*>(sapling_output_str.c_str()),
-        sapling_output_str.length(),
-        "657e3d38dbb5cb5e7dd2970e8b03d69b4787dd907285b5a7f0790dcc8072f60bf593b32cc2d1c030e00ff5ae64bf84c5c3beb84ddc841d48264b4a171744d028",
-        reinterpret_cast<const codeunit*>(sprout_groth16_str.c_str()),
-        sprout_groth16_str.length(),
-        "e9b238411bd6c0ec4791e9d04245ec350c9c5744f5610dfcce4365d5ca49dfefd5054e371842b3f88fa1b9d7e8e075249b3ebabd167fa8b0f3161292d36c180a"
-    );
-
-    gettimeofday(&tv_end, 0);
-    elapsed = float(tv_end.tv_sec-tv_start.tv_sec) + (tv_end.tv_usec-tv_start.tv_usec)/float(1000000);
-    LogPrintf("Loaded verifying key in %fs seconds.\n", elapsed);
+    // Deserializing the parameters takes a while and they are only needed
+    // once a shielded proof has to be checked, so do it in the background.
+    // Proof verification waits for this thread.
+    SetZKSnarkParamsLoading();
+    threadGroup.create_thread(std::bind(&ThreadLoadParams, sapling_spend, sapling_output, sprout_groth16));
 
     return true;
 }
@@ -847,6 +1081,7 @@ static bool AppInitServers()
     if (!StartHTTPRPC())
         return false;
     if (gArgs.GetBoolArg("-rest", DEFAULT_REST_ENABLE)) StartREST();
+    if (gArgs.GetBoolArg("-metrics", DEFAULT_METRICS_ENABLE)) StartMetrics();
     StartHTTPServer();
     return true;
 }
@@ -931,6 +1166,7 @@ void InitLogging()
 #ifdef HAVE_THREAD_LOCAL
     LogInstance().m_log_threadnames = gArgs.GetBoolArg("-logthreadnames", DEFAULT_LOGTHREADNAMES);
 #endif
+    LogInstance().m_rate_limit = std::max<int64_t>(0, gArgs.GetArg("-logratelimit", DEFAULT_LOGRATELIMIT));
 
     fLogIPs = gArgs.GetBoolArg("-logips", DEFAULT_LOGIPS);
 
@@ -1047,6 +1283,16 @@ bool AppInitParameterInteraction()
         }
     }
 
+    // The basic filters index must be enabled to serve compact filters. Shielded filters
+    // are served too when their index is enabled.
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (g_enabled_filter_types.count(BlockFilterType::BASIC) != 1) {
+            return InitError(_("Cannot set -peerblockfilters without -blockfilterindex.").translated);
+        }
+
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     // if using block pruning, then disallow txindex
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
@@ -1054,6 +1300,21 @@ bool AppInitParameterInteraction()
         if (!g_enabled_filter_types.empty()) {
             return InitError(_("Prune mode is incompatible with -blockfilterindex.").translated);
         }
+        if (gArgs.GetBoolArg("-nullifierindex", DEFAULT_NULLIFIERINDEX)) {
+            return InitError(_("Prune mode is incompatible with -nullifierindex.").translated);
+        }
+        if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+            return InitError(_("Prune mode is incompatible with -addressindex.").translated);
+        }
+        if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+            return InitError(_("Prune mode is incompatible with -spentindex.").translated);
+        }
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+            return InitError(_("Prune mode is incompatible with -coinstatsindex.").translated);
+        }
+        if (gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX)) {
+            return InitError(_("Prune mode is incompatible with -blockstatsindex.").translated);
+        }
     }
 
     // -bind and -whitebind can't be set when not listening
@@ -1112,8 +1373,10 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    g_lock_hold_times = gArgs.GetBoolArg("-lockholdtimes", false);
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
+    fTrustBlockIndex = gArgs.GetBoolArg("-trustblockindex", DEFAULT_TRUST_BLOCK_INDEX);
     if (!hashAssumeValid.IsNull())
         LogPrintf("Assuming ancestors of block %s have valid signatures.\n", hashAssumeValid.GetHex());
     else
@@ -1198,6 +1461,15 @@ bool AppInitParameterInteraction()
             return InitError(AmountErrMsg("blockmintxfee", gArgs.GetArg("-blockmintxfee", "")).translated);
     }
 
+    const std::string check_params = gArgs.GetArg("-checkparams", "cached");
+    if (check_params != "cached" && check_params != "full") {
+        return InitError(strprintf(_("Unknown -checkparams mode '%s' (expected cached or full)").translated, check_params));
+    }
+
+    if (!MakeEquihashSolver(gArgs.GetArg("-equihashsolver", DEFAULT_EQUIHASH_SOLVER))) {
+        return InitError(strprintf(_("Unknown Equihash solver: '%s' (expected one of %s)").translated, gArgs.GetArg("-equihashsolver", ""), EquihashSolverNames()));
+    }
+
     // Feerate used to define dust.  Shouldn't be changed lightly as old
     // implementations may inadvertently create non-standard transactions
     if (gArgs.IsArgSet("-dustrelayfee"))
@@ -1262,6 +1534,12 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string blake2b_algo = BLAKE2bAutoDetect();
+    LogPrintf("Using the '%s' BLAKE2b implementation\n", blake2b_algo);
+    std::string siphash_algo = SipHashAutoDetect();
+    LogPrintf("Using the '%s' SipHash implementation\n", siphash_algo);
+    std::string equihash_algo = EquihashAutoDetect();
+    LogPrintf("Using the '%s' Equihash verifier\n", equihash_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1307,6 +1585,9 @@ bool AppInitMain(NodeContext& node)
             return InitError(strprintf("Could not open debug log file %s",
                 LogInstance().m_file_path.string()));
     }
+    if (gArgs.GetBoolArg("-logasync", DEFAULT_LOGASYNC)) {
+        LogInstance().StartAsync(std::max<int64_t>(1, gArgs.GetArg("-logasyncqueue", DEFAULT_LOGASYNC_QUEUE)));
+    }
 
     if (!LogInstance().m_log_timestamps)
         LogPrintf("Startup time: %s\n", FormatISO8601DateTime(GetTime()));
@@ -1347,43 +1628,89 @@ bool AppInitMain(NodeContext& node)
             gArgs.GetArg("-paramsdir", ""), fs::current_path().string());
     }
 
+    // Before the coins cache is first filled
+    if (gArgs.GetBoolArg("-hugepages", DEFAULT_HUGE_PAGES) && !HugePageArena::Instance().Enable()) {
+        InitWarning(_("-hugepages is not supported on this platform and is ignored").translated);
+    }
+
     InitSignatureCache();
     InitScriptExecutionCache();
-
-    int script_threads = gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
-    if (script_threads <= 0) {
-        // -par=0 means autodetect (number of cores - 1 script threads)
-        // -par=-n means "leave n cores free" (number of cores - n - 1 script threads)
-        script_threads += GetNumCores();
+    InitProofCache();
+    if (gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        // Before any script is checked, so that the cached entries use the loaded nonces
+        LoadValidationCaches();
     }
 
-    // Subtract 1 because the main thread counts towards the par threads
-    script_threads = std::max(script_threads - 1, 0);
-
-    // Number of script-checking threads <= MAX_SCRIPTCHECK_THREADS
-    script_threads = std::min(script_threads, MAX_SCRIPTCHECK_THREADS);
+    // Before the pools are started, as threads are pinned when they name themselves
+    for (const std::string& strAffinity : gArgs.GetArgs("-threadaffinity")) {
+        const size_t colon = strAffinity.find(':');
+        std::vector<int> cpus;
+        if (colon == 0 || colon == std::string::npos || !util::ParseCpuList(strAffinity.substr(colon + 1), cpus)) {
+            return InitError(strprintf(_("Invalid -threadaffinity '%s', expected <pool>:<cpus>").translated, strAffinity));
+        }
+        if (!util::ThreadSetPoolAffinity(strAffinity.substr(0, colon), cpus)) {
+            InitWarning(_("-threadaffinity is not supported on this platform and is ignored").translated);
+            break;
+        }
+    }
 
-    LogPrintf("Script verification uses %d additional threads\n", script_threads);
-    if (script_threads >= 1) {
+    // Number of additional verification threads, for -par and -proofthreads
+    auto verify_threads = [](int threads) {
+        if (threads <= 0) {
+            // 0 means autodetect (number of cores - 1 additional threads)
+            // -n means "leave n cores free" (number of cores - n - 1 additional threads)
+            threads += GetNumCores();
+        }
+        // Subtract 1 because the main thread counts towards the threads,
+        // and keep the number <= MAX_SCRIPTCHECK_THREADS
+        return std::min(std::max(threads - 1, 0), MAX_SCRIPTCHECK_THREADS);
+    };
+    const int script_threads = verify_threads(gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS));
+    const int proof_threads = gArgs.GetArg("-proofthreads", DEFAULT_PROOFCHECK_THREADS) == 0 ? script_threads : verify_threads(gArgs.GetArg("-proofthreads", DEFAULT_PROOFCHECK_THREADS));
+
+    LogPrintf("Script verification uses %d additional threads, shielded proof verification %d\n", script_threads, proof_threads);
+    if (script_threads >= 1 || proof_threads >= 1) {
         g_parallel_script_checks = true;
+        for (int i = 0; i < proof_threads; ++i) {
+            threadGroup.create_thread([i]() { return ThreadProofCheck(i); });
+        }
         for (int i = 0; i < script_threads; ++i) {
             threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
+            threadGroup.create_thread([i]() { return ThreadHeaderCheck(i); });
+            threadGroup.create_thread([i]() { return ThreadCoinsPrefetch(i); });
+            threadGroup.create_thread([i]() { return ThreadTxCheck(i); });
+            threadGroup.create_thread([i]() { return ThreadTxPreValidation(i); });
         }
     }
 
     assert(!node.scheduler);
     node.scheduler = MakeUnique<CScheduler>();
 
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads. With more than one, a long
+    // task no longer holds up the others.
+    const int scheduler_threads = std::max(1, std::min<int>(gArgs.GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS), MAX_SCHEDULER_THREADS));
     CScheduler::Function serviceLoop = [&node]{ node.scheduler->serviceQueue(); };
-    threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    for (int i = 0; i < scheduler_threads; ++i) {
+        threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    }
 
     // Gather some entropy once per minute.
     node.scheduler->scheduleEvery([]{
         RandAddPeriodic();
     }, std::chrono::minutes{1});
 
-    GetMainSignals().RegisterBackgroundSignalScheduler(*node.scheduler);
+    // Run the validation callbacks on threads of their own, so that a slow
+    // subscriber neither holds up the others nor the scheduler's tasks
+    const int callback_threads = std::max(0, std::min<int>(gArgs.GetArg("-callbackthreads", DEFAULT_CALLBACK_THREADS), MAX_CALLBACK_THREADS));
+    GetMainSignals().RegisterBackgroundSignalScheduler(*node.scheduler, callback_threads);
+
+    // Run the notification commands on a few threads of their own, rather
+    // than on a new thread each
+    const int notify_threads = std::max(1, std::min<int>(gArgs.GetArg("-notifythreads", DEFAULT_NOTIFY_THREADS), MAX_NOTIFY_THREADS));
+    std::string notify_error;
+    if (!StartNotifications(notify_threads, gArgs.IsArgSet("-notifysocket") ? AbsPathForConfigVal(gArgs.GetArg("-notifysocket", "")) : fs::path(), notify_error)) {
+        return InitError(notify_error);
+    }
 
     // Create client interfaces for wallets that are supposed to be loaded
     // according to -wallet and -disablewallet options. This only constructs
@@ -1442,7 +1769,16 @@ bool AppInitMain(NodeContext& node)
     node.mempool = &::mempool;
 
     node.peer_logic.reset(new PeerLogicValidation(node.connman.get(), node.banman.get(), *node.scheduler, *node.mempool));
-    RegisterValidationInterface(node.peer_logic.get());
+    RegisterValidationInterface(node.peer_logic.get(), "net");
+
+    node.template_cache = MakeUnique<BlockTemplateCache>(*node.mempool, chainparams, *node.scheduler);
+    RegisterValidationInterface(node.template_cache.get(), "blocktemplate");
+
+    const int64_t block_cache_size = gArgs.GetArg("-rpcblockcache", DEFAULT_RPC_BLOCK_CACHE);
+    if (block_cache_size > 0) {
+        node.block_cache = MakeUnique<BlockCache>(block_cache_size << 20);
+        RegisterValidationInterface(node.block_cache.get(), "blockcache");
+    }
 
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
@@ -1559,7 +1895,7 @@ bool AppInitMain(NodeContext& node)
     g_zmq_notification_interface = CZMQNotificationInterface::Create();
 
     if (g_zmq_notification_interface) {
-        RegisterValidationInterface(g_zmq_notification_interface);
+        RegisterValidationInterface(g_zmq_notification_interface, "zmq");
     }
 #endif
     uint64_t nMaxOutboundLimit = 0; //unlimited unless -maxuploadtarget is set
@@ -1575,7 +1911,14 @@ bool AppInitMain(NodeContext& node)
     bool fReindexChainState = gArgs.GetBoolArg("-reindex-chainstate", false);
 
     // cache size calculations
+    // -dbcache=auto sizes the caches to the memory the node may use, and adjusts
+    // the coins cache to it while running.
+    const bool dbcache_auto = gArgs.GetArg("-dbcache", "") == "auto";
     int64_t nTotalCache = (gArgs.GetArg("-dbcache", nDefaultDbCache) << 20);
+    if (dbcache_auto) {
+        MemoryStatus memory;
+        nTotalCache = ReadMemoryStatus(memory) ? memory.limit / 100 * DBCACHE_AUTO_PERCENT : nDefaultDbCache << 20;
+    }
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greater than nMaxDbcache
     int64_t nBlockTreeDBCache = std::min(nTotalCache / 8, nMaxBlockDBCache << 20);
@@ -1589,6 +1932,14 @@ bool AppInitMain(NodeContext& node)
         filter_index_cache = max_cache / n_indexes;
         nTotalCache -= filter_index_cache * n_indexes;
     }
+    int64_t compact_block_index_cache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-compactblockindex", DEFAULT_COMPACTBLOCKINDEX) ? max_compact_block_index_cache << 20 : 0);
+    nTotalCache -= compact_block_index_cache;
+    int64_t nullifier_index_cache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-nullifierindex", DEFAULT_NULLIFIERINDEX) ? max_nullifier_index_cache << 20 : 0);
+    nTotalCache -= nullifier_index_cache;
+    int64_t address_index_cache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) ? max_address_index_cache << 20 : 0);
+    nTotalCache -= address_index_cache;
+    int64_t spent_index_cache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) ? max_spent_index_cache << 20 : 0);
+    nTotalCache -= spent_index_cache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1603,13 +1954,27 @@ bool AppInitMain(NodeContext& node)
         LogPrintf("* Using %.1f MiB for %s block filter index database\n",
                   filter_index_cache * (1.0 / 1024 / 1024), BlockFilterTypeName(filter_type));
     }
+    if (gArgs.GetBoolArg("-compactblockindex", DEFAULT_COMPACTBLOCKINDEX)) {
+        LogPrintf("* Using %.1f MiB for compact shielded block index database\n", compact_block_index_cache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-nullifierindex", DEFAULT_NULLIFIERINDEX)) {
+        LogPrintf("* Using %.1f MiB for nullifier index database\n", nullifier_index_cache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        LogPrintf("* Using %.1f MiB for address index database\n", address_index_cache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+        LogPrintf("* Using %.1f MiB for spent index database\n", spent_index_cache * (1.0 / 1024 / 1024));
+    }
     LogPrintf("* Using %.1f MiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
-    LogPrintf("* Using %.1f MiB for in-memory UTXO set (plus up to %.1f MiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1f MiB for in-memory UTXO set (plus up to %.1f MiB of unused mempool space)%s\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024), dbcache_auto ? ", adjusted to the memory available" : "");
+    const size_t synced_coin_cache_usage = nCoinCacheUsage;
 
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
         bool fReset = fReindex;
         std::string strLoadError;
+        bool rebuild_chainstate = false;
 
         uiInterface.InitMessage(_("Loading block index...").translated);
 
@@ -1636,6 +2001,14 @@ bool AppInitMain(NodeContext& node)
 
                 if (ShutdownRequested()) break;
 
+                // What an earlier run left of a UTXO snapshot chainstate is dealt with
+                // before the block index gives the base block of the snapshot its
+                // transaction count.
+                if (!CleanUpSnapshotChainstate(fReset || fReindexChainState)) {
+                    strLoadError = _("Error removing the UTXO snapshot chainstate").translated;
+                    break;
+                }
+
                 // LoadBlockIndex will load fHavePruned if we've ever removed a
                 // block file from disk.
                 // Note that it also sets fReindex based on the disk flag!
@@ -1677,6 +2050,26 @@ bool AppInitMain(NodeContext& node)
                     /* in_memory */ false,
                     /* should_wipe */ fReset || fReindexChainState);
 
+                // Chainstates written before the Sapling note commitment tree
+                // was kept alongside the coins cannot be extended, so they are
+                // rebuilt from the blocks as with -reindex-chainstate. A
+                // database without a best block, as in a fresh datadir, has
+                // nothing to rebuild.
+                if (!fReset && !fReindexChainState &&
+                        !::ChainstateActive().CoinsDB().GetBestBlock().IsNull() &&
+                        ::ChainstateActive().CoinsDB().GetBestAnchor().IsNull()) {
+                    LogPrintf("The chainstate database at block %s has no Sapling note commitment tree\n",
+                              ::ChainstateActive().CoinsDB().GetBestBlock().ToString());
+                    if (fHavePruned) {
+                        strLoadError = _("The chainstate database does not contain the Sapling note commitment tree. You need to rebuild the database using -reindex.").translated;
+                        break;
+                    }
+                    LogPrintf("Rebuilding the chainstate database from the blocks on disk\n");
+                    fReindexChainState = true;
+                    rebuild_chainstate = true;
+                    break;
+                }
+
                 ::ChainstateActive().CoinsErrorCatcher().AddReadErrCallback([]() {
                     uiInterface.ThreadSafeMessageBox(
                         _("Error reading from database, shutting down.").translated,
@@ -1699,6 +2092,7 @@ bool AppInitMain(NodeContext& node)
                 // The on-disk coinsdb is now in a good state, create the cache
                 ::ChainstateActive().InitCoinsCache();
                 assert(::ChainstateActive().CanFlushToDisk());
+                ::ChainstateActive().CoinsDB().SetBackgroundWrites(gArgs.GetBoolArg("-dbasyncflush", DEFAULT_DB_ASYNC_FLUSH));
 
                 is_coinsview_empty = fReset || fReindexChainState ||
                     ::ChainstateActive().CoinsTip().GetBestBlock().IsNull();
@@ -1751,6 +2145,26 @@ bool AppInitMain(NodeContext& node)
                         break;
                     }
                 }
+
+                if (!::ChainstateActive().LoadChainHistory(chainparams, gArgs.GetBoolArg("-chainhistory", DEFAULT_CHAIN_HISTORY))) {
+                    strLoadError = _("Error loading the chain history").translated;
+                    break;
+                }
+
+                // The chainstate loaded from a UTXO snapshot that is still being validated
+                // becomes the active one again, and the one above validates it.
+                if (GetSnapshotBaseBlock()) {
+                    const bool indexes = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) || !g_enabled_filter_types.empty() ||
+                        gArgs.GetBoolArg("-compactblockindex", DEFAULT_COMPACTBLOCKINDEX) || gArgs.GetBoolArg("-nullifierindex", DEFAULT_NULLIFIERINDEX) ||
+                        gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) ||
+                        gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX) || gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX);
+                    if (fPruneMode || ::ChainstateActive().m_history.IsEnabled() || indexes) {
+                        return InitError(_("A UTXO snapshot is being validated. Prune mode, -chainhistory and the indexes cannot be used until that completes.").translated);
+                    }
+                    if (!LoadSnapshotChainstate(chainparams, strLoadError)) {
+                        break;
+                    }
+                }
             } catch (const std::exception& e) {
                 LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database").translated;
@@ -1761,6 +2175,9 @@ bool AppInitMain(NodeContext& node)
             LogPrintf(" block index %15dms\n", GetTimeMillis() - load_block_index_start_time);
         } while(false);
 
+        // Load everything again, wiping the chainstate database this time
+        if (rebuild_chainstate) continue;
+
         if (!fLoaded && !ShutdownRequested()) {
             // first suggest a reindex
             if (!fReset) {
@@ -1789,6 +2206,10 @@ bool AppInitMain(NodeContext& node)
         return false;
     }
 
+    if (dbcache_auto) {
+        ScheduleCoinCacheTuning(*node.scheduler, synced_coin_cache_usage);
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1807,6 +2228,41 @@ bool AppInitMain(NodeContext& node)
         GetBlockFilterIndex(filter_type)->Start();
     }
 
+    if (gArgs.GetBoolArg("-compactblockindex", DEFAULT_COMPACTBLOCKINDEX)) {
+        g_compact_block_index = MakeUnique<CompactShieldedBlockIndex>(compact_block_index_cache, false, fReindex);
+        g_compact_block_index->Start();
+    }
+
+    if (gArgs.GetBoolArg("-nullifierindex", DEFAULT_NULLIFIERINDEX)) {
+        g_nullifier_index = MakeUnique<NullifierIndex>(nullifier_index_cache, false, fReindex);
+        g_nullifier_index->Start();
+    }
+
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        g_address_index = MakeUnique<AddressIndex>(address_index_cache, false, fReindex);
+        g_address_index->Start();
+    }
+
+    if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+        g_spent_index = MakeUnique<SpentIndex>(spent_index_cache, false, fReindex);
+        g_spent_index->Start();
+    }
+
+    // The index holds a few dozen bytes per block, so it does without a cache of its own.
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        g_coin_stats_index = MakeUnique<CoinStatsIndex>(0, false, fReindex);
+        g_coin_stats_index->Start();
+    }
+
+    // As the coin stats index, it holds about a hundred bytes per block.
+    if (gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX)) {
+        g_block_stats_index = MakeUnique<BlockStatsIndex>(0, false, fReindex);
+        g_block_stats_index->Start();
+    }
+
+    // The validation of a UTXO snapshot goes on from where it was left.
+    StartSnapshotValidation(chainparams);
+
     // ********************************************************* Step 9: load wallet
     for (const auto& client : node.chain_clients) {
         if (!client->load()) {
@@ -1853,10 +2309,8 @@ bool AppInitMain(NodeContext& node)
         fHaveGenesis = true;
     }
 
-#if HAVE_SYSTEM
-    if (gArgs.IsArgSet("-blocknotify"))
+    if (gArgs.IsArgSet("-blocknotify") || gArgs.IsArgSet("-notifysocket"))
         uiInterface.NotifyBlockTip_connect(BlockNotifyCallback);
-#endif
 
     std::vector<fs::path> vImportFiles;
     for (const std::string& strFile : gArgs.GetArgs("-loadblock")) {
@@ -1921,6 +2375,7 @@ bool AppInitMain(NodeContext& node)
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
     connOptions.m_peer_connect_timeout = peer_connect_timeout;
+    connOptions.m_net_threads = gArgs.GetArg("-netthreads", DEFAULT_NET_THREADS);
 
     for (const std::string& strBind : gArgs.GetArgs("-bind")) {
         CService addrBind;
@@ -1957,6 +2412,10 @@ bool AppInitMain(NodeContext& node)
         return false;
     }
 
+    if (!StartStratumServer(node)) {
+        return false;
+    }
+
     // ********************************************************* Step 13: finished
 
     SetRPCWarmupFinished();
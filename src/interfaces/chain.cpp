@@ -6,6 +6,7 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <index/blockfilterindex.h>
 #include <interfaces/handler.h>
 #include <interfaces/wallet.h>
 #include <net.h>
@@ -154,11 +155,11 @@ public:
     explicit NotificationsProxy(std::shared_ptr<Chain::Notifications> notifications)
         : m_notifications(std::move(notifications)) {}
     virtual ~NotificationsProxy() = default;
-    void TransactionAddedToMempool(const CTransactionRef& tx) override
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override
     {
         m_notifications->transactionAddedToMempool(tx);
     }
-    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) override
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) override
     {
         m_notifications->transactionRemovedFromMempool(tx, reason);
     }
@@ -184,7 +185,7 @@ public:
     explicit NotificationsHandlerImpl(std::shared_ptr<Chain::Notifications> notifications)
         : m_proxy(std::make_shared<NotificationsProxy>(std::move(notifications)))
     {
-        RegisterSharedValidationInterface(m_proxy);
+        RegisterSharedValidationInterface(m_proxy, "wallet");
     }
     ~NotificationsHandlerImpl() override { disconnect(); }
     void disconnect() override
@@ -268,6 +269,31 @@ public:
         }
         return true;
     }
+    bool getSaplingTree(const uint256& block_hash, SaplingMerkleTree& tree) override
+    {
+        LOCK(cs_main);
+        const CBlockIndex* block_index = LookupBlockIndex(block_hash);
+        if (!block_index || !(block_index->nStatus & BLOCK_HAVE_SAPLING_ROOT)) return false;
+        return ::ChainstateActive().CoinsTip().GetSaplingAnchorAt(block_index->hashFinalSaplingRoot, tree);
+    }
+    bool hasBlockFilterIndex(BlockFilterType filter_type) override
+    {
+        return GetBlockFilterIndex(filter_type) != nullptr;
+    }
+    Optional<bool> blockFilterMatchesAny(BlockFilterType filter_type, const uint256& block_hash, const GCSFilter::ElementSet& filter_set) override
+    {
+        BlockFilterIndex* index = GetBlockFilterIndex(filter_type);
+        if (!index) return nullopt;
+        const CBlockIndex* block_index;
+        {
+            LOCK(cs_main);
+            block_index = LookupBlockIndex(block_hash);
+            if (!block_index) return nullopt;
+        }
+        BlockFilter filter;
+        if (!index->LookupFilter(block_index, filter)) return nullopt;
+        return filter.GetFilter().MatchAny(filter_set);
+    }
     void findCoins(std::map<COutPoint, Coin>& coins) override { return FindCoins(m_node, coins); }
     double guessVerificationProgress(const uint256& block_hash) override
     {
@@ -5,8 +5,10 @@
 #ifndef BITCOIN_INTERFACES_CHAIN_H
 #define BITCOIN_INTERFACES_CHAIN_H
 
+#include <blockfilter.h>           // For BlockFilterType and GCSFilter::ElementSet
 #include <optional.h>               // For Optional and nullopt
 #include <primitives/transaction.h> // For CTransactionRef
+#include <zcash/IncrementalMerkleTree.hpp> // For SaplingMerkleTree
 
 #include <memory>
 #include <stddef.h>
@@ -137,6 +139,18 @@ public:
         int64_t* time = nullptr,
         int64_t* max_time = nullptr) = 0;
 
+    //! Return whether the node has a block filter index of this type, which
+    //! blockFilterMatchesAny() can check blocks against.
+    virtual bool hasBlockFilterIndex(BlockFilterType filter_type) = 0;
+
+    //! Return whether any of the elements match the filter of the block, or
+    //! nullopt if the index has no filter for it (yet).
+    virtual Optional<bool> blockFilterMatchesAny(BlockFilterType filter_type, const uint256& block_hash, const GCSFilter::ElementSet& filter_set) = 0;
+
+    //! Get the Sapling note commitment tree at the end of a block. Returns
+    //! false if the block is unknown or its tree is no longer kept.
+    virtual bool getSaplingTree(const uint256& block_hash, SaplingMerkleTree& tree) = 0;
+
     //! Look up unspent output information. Returns coins in the mempool and in
     //! the current chain UTXO set. Iterates through all the keys in the map and
     //! populates the values.
@@ -301,6 +301,17 @@ public:
         }
         return result;
     }
+    std::vector<WalletTx> getWalletTxsAfter(const uint256& after, size_t max_count) override
+    {
+        auto locked_chain = m_wallet->chain().lock();
+        LOCK(m_wallet->cs_wallet);
+        std::vector<WalletTx> result;
+        auto it = after.IsNull() ? m_wallet->mapWallet.begin() : m_wallet->mapWallet.upper_bound(after);
+        for (; it != m_wallet->mapWallet.end() && result.size() < max_count; ++it) {
+            result.emplace_back(MakeWalletTx(*m_wallet, it->second));
+        }
+        return result;
+    }
     bool tryGetTxStatus(const uint256& txid,
         interfaces::WalletTxStatus& tx_status,
         int& num_blocks,
@@ -371,14 +382,21 @@ public:
     }
     bool tryGetBalances(WalletBalances& balances, int& num_blocks, bool force, int cached_num_blocks) override
     {
+        // The height the wallet last processed tells whether anything changed
+        // without trying cs_main, which the GUI polls on every new block.
+        {
+            TRY_LOCK(m_wallet->cs_wallet, locked_wallet);
+            if (!locked_wallet) return false;
+            num_blocks = m_wallet->GetLastBlockHeight();
+        }
+        if (!force && num_blocks == cached_num_blocks) return false;
         auto locked_chain = m_wallet->chain().lock(true /* try_lock */);
         if (!locked_chain) return false;
-        num_blocks = locked_chain->getHeight().get_value_or(-1);
-        if (!force && num_blocks == cached_num_blocks) return false;
         TRY_LOCK(m_wallet->cs_wallet, locked_wallet);
         if (!locked_wallet) {
             return false;
         }
+        num_blocks = m_wallet->GetLastBlockHeight();
         balances = getBalances();
         return true;
     }
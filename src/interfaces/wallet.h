@@ -178,6 +178,10 @@ public:
     //! Get list of all wallet transactions.
     virtual std::vector<WalletTx> getWalletTxs() = 0;
 
+    //! Get up to max_count wallet transactions in txid order, starting after
+    //! the txid after, or from the first one if it is null.
+    virtual std::vector<WalletTx> getWalletTxsAfter(const uint256& after, size_t max_count) = 0;
+
     //! Try to get updated status for a particular transaction, if possible without blocking.
     virtual bool tryGetTxStatus(const uint256& txid,
         WalletTxStatus& tx_status,
@@ -201,7 +205,9 @@ public:
     //! Get balances.
     virtual WalletBalances getBalances() = 0;
 
-    //! Get balances if possible without waiting for chain and wallet locks.
+    //! Get balances if possible without waiting for chain and wallet locks,
+    //! and num_blocks, the height the wallet last processed. Only tries the
+    //! chain lock when num_blocks differs from cached_num_blocks, or force.
     virtual bool tryGetBalances(WalletBalances& balances,
         int& num_blocks,
         bool force,
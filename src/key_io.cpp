@@ -6,7 +6,10 @@
 
 #include <base58.h>
 #include <bech32.h>
+#include <prevector.h>
+#include <streams.h>
 #include <util/strencodings.h>
+#include <version.h>
 
 #include <boost/variant/apply_visitor.hpp>
 #include <boost/variant/static_visitor.hpp>
@@ -17,42 +20,51 @@
 
 namespace
 {
+//! Big enough for the payload of any address, so that encoding one allocates only its string
+typedef prevector<72, unsigned char> AddressData;
+
 class DestinationEncoder : public boost::static_visitor<std::string>
 {
 private:
     const CChainParams& m_params;
 
+    std::string EncodeHash(CChainParams::Base58Type type, const unsigned char* begin, const unsigned char* end) const
+    {
+        const std::vector<unsigned char>& prefix = m_params.Base58Prefix(type);
+        AddressData data(prefix.begin(), prefix.end());
+        data.insert(data.end(), begin, end);
+        return EncodeBase58Check(MakeSpan(data));
+    }
+
+    std::string EncodeWitness(unsigned char version, const unsigned char* begin, const unsigned char* end) const
+    {
+        AddressData data;
+        data.push_back(version);
+        ConvertBits<8, 5, true>([&](unsigned char c) { data.push_back(c); }, begin, end);
+        return bech32::Encode(m_params.Bech32HRP(), MakeSpan(data));
+    }
+
 public:
     explicit DestinationEncoder(const CChainParams& params) : m_params(params) {}
 
     std::string operator()(const PKHash& id) const
     {
-        std::vector<unsigned char> data = m_params.Base58Prefix(CChainParams::PUBKEY_ADDRESS);
-        data.insert(data.end(), id.begin(), id.end());
-        return EncodeBase58Check(data);
+        return EncodeHash(CChainParams::PUBKEY_ADDRESS, id.begin(), id.end());
     }
 
     std::string operator()(const ScriptHash& id) const
     {
-        std::vector<unsigned char> data = m_params.Base58Prefix(CChainParams::SCRIPT_ADDRESS);
-        data.insert(data.end(), id.begin(), id.end());
-        return EncodeBase58Check(data);
+        return EncodeHash(CChainParams::SCRIPT_ADDRESS, id.begin(), id.end());
     }
 
     std::string operator()(const WitnessV0KeyHash& id) const
     {
-        std::vector<unsigned char> data = {0};
-        data.reserve(33);
-        ConvertBits<8, 5, true>([&](unsigned char c) { data.push_back(c); }, id.begin(), id.end());
-        return bech32::Encode(m_params.Bech32HRP(), data);
+        return EncodeWitness(0, id.begin(), id.end());
     }
 
     std::string operator()(const WitnessV0ScriptHash& id) const
     {
-        std::vector<unsigned char> data = {0};
-        data.reserve(53);
-        ConvertBits<8, 5, true>([&](unsigned char c) { data.push_back(c); }, id.begin(), id.end());
-        return bech32::Encode(m_params.Bech32HRP(), data);
+        return EncodeWitness(0, id.begin(), id.end());
     }
 
     std::string operator()(const WitnessUnknown& id) const
@@ -60,10 +72,7 @@ public:
         if (id.version < 1 || id.version > 16 || id.length < 2 || id.length > 40) {
             return {};
         }
-        std::vector<unsigned char> data = {(unsigned char)id.version};
-        data.reserve(1 + (id.length * 8 + 4) / 5);
-        ConvertBits<8, 5, true>([&](unsigned char c) { data.push_back(c); }, id.program, id.program + id.length);
-        return bech32::Encode(m_params.Bech32HRP(), data);
+        return EncodeWitness(id.version, id.program, id.program + id.length);
     }
 
     std::string operator()(const CNoDestination& no) const { return {}; }
@@ -91,7 +100,8 @@ CTxDestination DecodeDestination(const std::string& str, const CChainParams& par
         }
     }
     data.clear();
-    auto bech = bech32::Decode(str);
+    std::pair<std::string, std::vector<uint8_t>> bech;
+    bech32::Decode(str, bech.first, bech.second);
     if (bech.second.size() > 0 && bech.first == params.Bech32HRP()) {
         // Bech32 decoding
         int version = bech.second[0]; // The first 5 bit symbol is the witness version (0-16)
@@ -212,6 +222,17 @@ std::string EncodeDestination(const CTxDestination& dest)
     return boost::apply_visitor(DestinationEncoder(Params()), dest);
 }
 
+std::vector<std::string> EncodeDestinations(const std::vector<CTxDestination>& dests)
+{
+    const DestinationEncoder encoder(Params());
+    std::vector<std::string> ret;
+    ret.reserve(dests.size());
+    for (const CTxDestination& dest : dests) {
+        ret.push_back(boost::apply_visitor(encoder, dest));
+    }
+    return ret;
+}
+
 CTxDestination DecodeDestination(const std::string& str)
 {
     return DecodeDestination(str, Params());
@@ -226,3 +247,29 @@ bool IsValidDestinationString(const std::string& str)
 {
     return IsValidDestinationString(str, Params());
 }
+
+//! A serialized Sapling payment address: its diversifier and pk_d
+static const size_t SAPLING_PAYMENT_ADDRESS_SIZE = 43;
+
+std::string EncodePaymentAddress(const libzcash::SaplingPaymentAddress& address)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << address;
+    AddressData data;
+    ConvertBits<8, 5, true>([&](unsigned char c) { data.push_back(c); }, ss.begin(), ss.end());
+    return bech32::Encode(Params().SaplingPaymentAddressHRP(), MakeSpan(data));
+}
+
+Optional<libzcash::SaplingPaymentAddress> DecodeSaplingPaymentAddress(const std::string& str)
+{
+    auto bech = bech32::Decode(str);
+    if (bech.first != Params().SaplingPaymentAddressHRP()) return nullopt;
+    std::vector<unsigned char> data;
+    data.reserve((bech.second.size() * 5) / 8);
+    if (!ConvertBits<5, 8, false>([&](unsigned char c) { data.push_back(c); }, bech.second.begin(), bech.second.end())) return nullopt;
+    if (data.size() != SAPLING_PAYMENT_ADDRESS_SIZE) return nullopt;
+    CDataStream ss(data, SER_NETWORK, PROTOCOL_VERSION);
+    libzcash::SaplingPaymentAddress address;
+    ss >> address;
+    return address;
+}
@@ -8,10 +8,13 @@
 
 #include <chainparams.h>
 #include <key.h>
+#include <optional.h>
 #include <pubkey.h>
 #include <script/standard.h>
+#include <zcash/address/sapling.hpp>
 
 #include <string>
+#include <vector>
 
 CKey DecodeSecret(const std::string& str);
 std::string EncodeSecret(const CKey& key);
@@ -22,8 +25,13 @@ CExtPubKey DecodeExtPubKey(const std::string& str);
 std::string EncodeExtPubKey(const CExtPubKey& extpubkey);
 
 std::string EncodeDestination(const CTxDestination& dest);
+/** Encode each of dests as EncodeDestination does, looking the chain parameters up once */
+std::vector<std::string> EncodeDestinations(const std::vector<CTxDestination>& dests);
 CTxDestination DecodeDestination(const std::string& str);
 bool IsValidDestinationString(const std::string& str);
 bool IsValidDestinationString(const std::string& str, const CChainParams& params);
 
+std::string EncodePaymentAddress(const libzcash::SaplingPaymentAddress& address);
+Optional<libzcash::SaplingPaymentAddress> DecodeSaplingPaymentAddress(const std::string& str);
+
 #endif // BITCOIN_KEY_IO_H
@@ -7,7 +7,10 @@
 #include <util/threadnames.h>
 #include <util/time.h>
 
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <thread>
 
 const char * const DEFAULT_DEBUGLOGFILE = "debug.log";
 
@@ -80,6 +83,7 @@ bool BCLog::Logger::StartLogging()
 
 void BCLog::Logger::DisconnectTestLogger()
 {
+    StopAsync();
     std::lock_guard<std::mutex> scoped_lock(m_cs);
     m_buffering = true;
     if (m_fileout != nullptr) fclose(m_fileout);
@@ -164,6 +168,7 @@ const CLogCategoryDesc LogCategories[] =
     {BCLog::LEVELDB, "leveldb"},
     {BCLog::VALIDATION, "validation"},
     {BCLog::POW, "pow"},
+    {BCLog::STRATUM, "stratum"},
     {BCLog::ALL, "1"},
     {BCLog::ALL, "all"},
 };
@@ -213,7 +218,7 @@ std::vector<CLogCategoryActive> ListActiveLogCategories()
     return ret;
 }
 
-std::string BCLog::Logger::LogTimestampStr(const std::string& str)
+std::string BCLog::Logger::LogTimestampStr(const std::string& str, int64_t nTimeMicros, int64_t mocktime)
 {
     std::string strStamped;
 
@@ -221,13 +226,11 @@ std::string BCLog::Logger::LogTimestampStr(const std::string& str)
         return str;
 
     if (m_started_new_line) {
-        int64_t nTimeMicros = GetTimeMicros();
         strStamped = FormatISO8601DateTime(nTimeMicros/1000000);
         if (m_log_time_micros) {
             strStamped.pop_back();
             strStamped += strprintf(".%06dZ", nTimeMicros%1000000);
         }
-        int64_t mocktime = GetMockTime();
         if (mocktime) {
             strStamped += " (mocktime: " + FormatISO8601DateTime(mocktime) + ")";
         }
@@ -260,16 +263,222 @@ namespace BCLog {
     }
 }
 
+namespace {
+/** A message handed to the writer thread, with what LogPrintStr would have prefixed it with */
+struct QueuedMessage {
+    std::string str;
+    std::string thread_name;
+    int64_t time_micros{0};
+    int64_t mocktime{0};
+};
+
+/**
+ * Bounded queue that any number of threads push to and pop from without
+ * taking a lock (Dmitry Vyukov's bounded MPMC queue). Each cell carries a
+ * sequence number telling whether it is free for the push at a position, or
+ * holds the message for the pop at a position.
+ */
+class MessageQueue
+{
+    struct Cell {
+        std::atomic<size_t> seq;
+        QueuedMessage msg;
+    };
+    const size_t m_mask;
+    const std::unique_ptr<Cell[]> m_cells;
+    std::atomic<size_t> m_push_pos{0};
+    std::atomic<size_t> m_pop_pos{0};
+
+    static size_t RoundUpToPowerOfTwo(size_t size)
+    {
+        size_t rounded = 2;
+        while (rounded < size) rounded <<= 1;
+        return rounded;
+    }
+
+public:
+    explicit MessageQueue(size_t size) : m_mask(RoundUpToPowerOfTwo(size) - 1), m_cells(new Cell[m_mask + 1])
+    {
+        for (size_t i = 0; i <= m_mask; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /** Add msg to the queue, or return false if it is full */
+    bool Push(QueuedMessage&& msg)
+    {
+        size_t pos = m_push_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            const size_t seq = cell.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.msg = std::move(msg);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_push_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Take the oldest message off the queue, or return false if it is empty */
+    bool Pop(QueuedMessage& msg)
+    {
+        size_t pos = m_pop_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[pos & m_mask];
+            const size_t seq = cell.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    msg = std::move(cell.msg);
+                    cell.seq.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_pop_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+} // namespace
+
+struct BCLog::Logger::AsyncWriter {
+    explicit AsyncWriter(size_t queue_size) : queue(queue_size) {}
+
+    MessageQueue queue;
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> stop{false};
+    //! Only used to sleep on while the queue is empty
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::thread thread;
+};
+
+void BCLog::Logger::StartAsync(size_t queue_size)
+{
+    assert(m_async.load() == nullptr);
+    AsyncWriter* async = new AsyncWriter(queue_size);
+    async->thread = std::thread([this, async] {
+        util::ThreadRename("logger");
+        QueuedMessage msg;
+        uint64_t reported_dropped = 0;
+        for (;;) {
+            const bool stopping = async->stop.load(std::memory_order_acquire);
+            bool wrote = false;
+            while (async->queue.Pop(msg)) {
+                std::lock_guard<std::mutex> scoped_lock(m_cs);
+                WriteStr(msg.str, msg.thread_name, msg.time_micros, msg.mocktime);
+                wrote = true;
+            }
+            const uint64_t dropped = async->dropped.load(std::memory_order_relaxed);
+            if (dropped != reported_dropped) {
+                std::lock_guard<std::mutex> scoped_lock(m_cs);
+                WriteStr(strprintf("Dropped %u log messages, the -logasync queue was full\n", dropped - reported_dropped), util::ThreadGetInternalName(), GetTimeMicros(), GetMockTime());
+                reported_dropped = dropped;
+            }
+            if (stopping) break;
+            if (!wrote) {
+                // Producers notify without taking wake_mutex, so a wakeup can
+                // be missed; the timeout bounds how long a message then waits.
+                std::unique_lock<std::mutex> lock(async->wake_mutex);
+                async->wake.wait_for(lock, std::chrono::milliseconds(20));
+            }
+        }
+    });
+    m_async.store(async, std::memory_order_release);
+}
+
+void BCLog::Logger::StopAsync()
+{
+    AsyncWriter* async = m_async.exchange(nullptr);
+    if (async == nullptr) return;
+    async->stop.store(true, std::memory_order_release);
+    async->wake.notify_one();
+    async->thread.join();
+    // A message pushed by a thread that saw m_async just before it was reset
+    // may still be in the queue.
+    QueuedMessage msg;
+    std::lock_guard<std::mutex> scoped_lock(m_cs);
+    while (async->queue.Pop(msg)) {
+        WriteStr(msg.str, msg.thread_name, msg.time_micros, msg.mocktime);
+    }
+    // async is leaked, as a thread may still be about to push to it.
+}
+
+BCLog::Logger::DropStats BCLog::Logger::GetDropStats() const
+{
+    DropStats stats;
+    const AsyncWriter* async = m_async.load();
+    if (async) stats.queue_full = async->dropped.load(std::memory_order_relaxed);
+    stats.rate_limited = m_rate_limited.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool BCLog::Logger::WithinRateLimit(BCLog::LogFlags category)
+{
+    const uint32_t limit = m_rate_limit.load(std::memory_order_relaxed);
+    if (limit == 0 || category == BCLog::NONE || category == BCLog::ALL) return true;
+
+    int index = 0;
+    while (((uint32_t)category >> index & 1) == 0) ++index;
+    RateWindow& window = m_rate_windows[index];
+
+    // Not mockable: the limit is about how fast the log grows.
+    const int64_t now = GetTimeMicros() / 1000000;
+    int64_t second = window.second.load(std::memory_order_relaxed);
+    if (second != now && window.second.compare_exchange_strong(second, now, std::memory_order_relaxed)) {
+        const uint32_t previous = window.count.exchange(0, std::memory_order_relaxed);
+        if (previous > limit) {
+            std::string name;
+            for (const CLogCategoryDesc& category_desc : LogCategories) {
+                if (category_desc.flag == category) name = category_desc.category;
+            }
+            LogPrintf("Suppressed %u %s log messages over -logratelimit=%u\n", previous - limit, name, limit);
+        }
+    }
+    if (window.count.fetch_add(1, std::memory_order_relaxed) < limit) return true;
+    m_rate_limited.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
 void BCLog::Logger::LogPrintStr(const std::string& str)
 {
+    AsyncWriter* async = m_async.load(std::memory_order_acquire);
+    if (async) {
+        QueuedMessage msg;
+        msg.str = str;
+        if (m_log_threadnames) msg.thread_name = util::ThreadGetInternalName();
+        msg.time_micros = GetTimeMicros();
+        msg.mocktime = GetMockTime();
+        if (!async->queue.Push(std::move(msg))) {
+            async->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        async->wake.notify_one();
+        return;
+    }
+
     std::lock_guard<std::mutex> scoped_lock(m_cs);
+    WriteStr(str, m_log_threadnames ? util::ThreadGetInternalName() : std::string(), GetTimeMicros(), GetMockTime());
+}
+
+void BCLog::Logger::WriteStr(const std::string& str, const std::string& thread_name, int64_t time_micros, int64_t mocktime)
+{
     std::string str_prefixed = LogEscapeMessage(str);
 
     if (m_log_threadnames && m_started_new_line) {
-        str_prefixed.insert(0, "[" + util::ThreadGetInternalName() + "] ");
+        str_prefixed.insert(0, "[" + thread_name + "] ");
     }
 
-    str_prefixed = LogTimestampStr(str_prefixed);
+    str_prefixed = LogTimestampStr(str_prefixed, time_micros, mocktime);
 
     m_started_new_line = !str.empty() && str[str.size()-1] == '\n';
 
@@ -20,6 +20,11 @@ static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
 static const bool DEFAULT_LOGTHREADNAMES = false;
+static const bool DEFAULT_LOGASYNC = false;
+//! Messages the -logasync queue holds before new ones are dropped
+static const unsigned int DEFAULT_LOGASYNC_QUEUE = 8192;
+//! Messages per second logged for each debug category, 0 for no limit
+static const unsigned int DEFAULT_LOGRATELIMIT = 0;
 extern const char * const DEFAULT_DEBUGLOGFILE;
 
 extern bool fLogIPs;
@@ -56,12 +61,15 @@ namespace BCLog {
         LEVELDB     = (1 << 20),
         VALIDATION  = (1 << 21),
         POW         = (1 << 22),
+        STRATUM     = (1 << 23),
         ALL         = ~(uint32_t)0,
     };
 
     class Logger
     {
     private:
+        struct AsyncWriter;
+
         mutable std::mutex m_cs;                   // Can not use Mutex from sync.h because in debug mode it would cause a deadlock when a potential deadlock was detected
         FILE* m_fileout = nullptr;                 // GUARDED_BY(m_cs)
         std::list<std::string> m_msgs_before_open; // GUARDED_BY(m_cs)
@@ -77,7 +85,21 @@ namespace BCLog {
         /** Log categories bitfield. */
         std::atomic<uint32_t> m_categories{0};
 
-        std::string LogTimestampStr(const std::string& str);
+        /** The writer thread messages are handed to, or nullptr to write them on the calling thread. Leaked like the logger. */
+        std::atomic<AsyncWriter*> m_async{nullptr};
+
+        /** Per-category message counts in the current second, for -logratelimit */
+        struct RateWindow {
+            std::atomic<int64_t> second{0};
+            std::atomic<uint32_t> count{0};
+        };
+        RateWindow m_rate_windows[32];
+        std::atomic<uint64_t> m_rate_limited{0};
+
+        std::string LogTimestampStr(const std::string& str, int64_t time_micros, int64_t mocktime);
+
+        /** Prefix str and write it to every output, or buffer it if logging has not started. Requires m_cs. */
+        void WriteStr(const std::string& str, const std::string& thread_name, int64_t time_micros, int64_t mocktime);
 
         /** Slots that connect to the print signal */
         std::list<std::function<void(const std::string&)>> m_print_callbacks /* GUARDED_BY(m_cs) */ {};
@@ -93,9 +115,31 @@ namespace BCLog {
         fs::path m_file_path;
         std::atomic<bool> m_reopen_file{false};
 
+        /** Messages per second logged for each category, 0 for no limit. Uncategorized messages are not limited. */
+        std::atomic<uint32_t> m_rate_limit{DEFAULT_LOGRATELIMIT};
+
         /** Send a string to the log output */
         void LogPrintStr(const std::string& str);
 
+        /** Whether another message of category fits in -logratelimit. Counts it if so, and counts a drop if not. */
+        bool WithinRateLimit(LogFlags category);
+
+        /**
+         * Hand messages to a writer thread from now on, through a lock-free
+         * queue of queue_size messages. When the queue is full, messages are
+         * dropped and counted rather than waited for, and the writer reports
+         * the drops in the log.
+         */
+        void StartAsync(size_t queue_size);
+        /** Write out the queued messages and stop the writer thread. Later messages are written on the calling thread. */
+        void StopAsync();
+
+        struct DropStats {
+            uint64_t queue_full{0};   //!< Messages dropped as the -logasync queue was full
+            uint64_t rate_limited{0}; //!< Messages dropped by -logratelimit
+        };
+        DropStats GetDropStats() const;
+
         /** Returns whether logs will be written to any output */
         bool Enabled() const
         {
@@ -147,6 +191,12 @@ static inline bool LogAcceptCategory(BCLog::LogFlags category)
     return LogInstance().WillLogCategory(category);
 }
 
+/** Return true if one more message of category is within -logratelimit */
+static inline bool LogWithinRateLimit(BCLog::LogFlags category)
+{
+    return LogInstance().m_rate_limit.load(std::memory_order_relaxed) == 0 || LogInstance().WithinRateLimit(category);
+}
+
 /** Returns a string with the log categories. */
 std::string ListLogCategories();
 
@@ -176,12 +226,13 @@ static inline void LogPrintf(const char* fmt, const Args&... args)
 }
 
 // Use a macro instead of a function for conditional logging to prevent
-// evaluating arguments when logging for the category is not enabled.
-#define LogPrint(category, ...)              \
-    do {                                     \
-        if (LogAcceptCategory((category))) { \
-            LogPrintf(__VA_ARGS__);          \
-        }                                    \
+// evaluating arguments when logging for the category is not enabled, or
+// when the category is over its rate limit.
+#define LogPrint(category, ...)                                                  \
+    do {                                                                         \
+        if (LogAcceptCategory((category)) && LogWithinRateLimit((category))) {    \
+            LogPrintf(__VA_ARGS__);                                              \
+        }                                                                        \
     } while (0)
 
 #endif // BITCOIN_LOGGING_H
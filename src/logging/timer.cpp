@@ -0,0 +1,143 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <logging/timer.h>
+
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace {
+
+struct ScopeHistogram {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total_us{0};
+    std::array<std::atomic<uint64_t>, BCLog::METRIC_SCOPE_BOUNDS.size() + 1> buckets{};
+};
+
+//! The histograms a thread records into
+struct ThreadScopes {
+    ScopeHistogram scopes[BCLog::MAX_METRIC_SCOPES];
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::map<std::string, int> ids;          // GUARDED_BY(mutex)
+    std::vector<std::string> names{"other"}; // GUARDED_BY(mutex)
+    std::set<const ThreadScopes*> threads;   // GUARDED_BY(mutex)
+    //! What exited threads recorded, or all threads without thread_local
+    ThreadScopes shared;
+};
+
+//! Leaked, like the logger, as threads may record after static destructors ran.
+Registry& GetRegistry()
+{
+    static Registry* g_registry{new Registry()};
+    return *g_registry;
+}
+
+//! Only the owning thread writes its histograms, so a plain load and store is
+//! enough for readers to see whole values.
+void Add(std::atomic<uint64_t>& counter, uint64_t value)
+{
+#if defined(HAVE_THREAD_LOCAL)
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+#else
+    counter.fetch_add(value, std::memory_order_relaxed);
+#endif
+}
+
+#if defined(HAVE_THREAD_LOCAL)
+/** Registers the calling thread's histograms on first use, and folds them into Registry::shared when it exits. */
+struct ThreadScopesHolder {
+    ThreadScopes* scopes{nullptr};
+
+    ~ThreadScopesHolder()
+    {
+        if (scopes == nullptr) return;
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (int id = 0; id < BCLog::MAX_METRIC_SCOPES; ++id) {
+            const ScopeHistogram& from = scopes->scopes[id];
+            ScopeHistogram& to = registry.shared.scopes[id];
+            to.count.fetch_add(from.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            to.total_us.fetch_add(from.total_us.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            for (size_t b = 0; b < from.buckets.size(); ++b) {
+                to.buckets[b].fetch_add(from.buckets[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+        }
+        registry.threads.erase(scopes);
+        delete scopes;
+    }
+};
+
+thread_local ThreadScopesHolder g_thread_scopes;
+
+ThreadScopes& LocalScopes()
+{
+    if (g_thread_scopes.scopes == nullptr) {
+        ThreadScopes* scopes = new ThreadScopes();
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.threads.insert(scopes);
+        g_thread_scopes.scopes = scopes;
+    }
+    return *g_thread_scopes.scopes;
+}
+#else
+ThreadScopes& LocalScopes() { return GetRegistry().shared; }
+#endif
+
+} // namespace
+
+int BCLog::MetricScopeId(const std::string& name)
+{
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto it = registry.ids.find(name);
+    if (it != registry.ids.end()) return it->second;
+    if ((int)registry.names.size() == MAX_METRIC_SCOPES) return 0;
+    const int id = registry.names.size();
+    registry.names.push_back(name);
+    registry.ids.emplace(name, id);
+    return id;
+}
+
+void BCLog::RecordMetricScope(int id, int64_t micros)
+{
+    ScopeHistogram& histogram = LocalScopes().scopes[id];
+    size_t bucket = 0;
+    while (bucket < METRIC_SCOPE_BOUNDS.size() && micros > METRIC_SCOPE_BOUNDS[bucket]) ++bucket;
+    Add(histogram.count, 1);
+    Add(histogram.total_us, micros);
+    Add(histogram.buckets[bucket], 1);
+}
+
+std::vector<BCLog::MetricScopeStats> BCLog::GetMetricScopeStats()
+{
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<const ThreadScopes*> blocks(registry.threads.begin(), registry.threads.end());
+    blocks.push_back(&registry.shared);
+
+    std::vector<MetricScopeStats> result;
+    for (size_t id = 0; id < registry.names.size(); ++id) {
+        MetricScopeStats stats;
+        stats.name = registry.names[id];
+        for (const ThreadScopes* block : blocks) {
+            const ScopeHistogram& histogram = block->scopes[id];
+            stats.count += histogram.count.load(std::memory_order_relaxed);
+            stats.total_us += histogram.total_us.load(std::memory_order_relaxed);
+            for (size_t b = 0; b < stats.histogram.size(); ++b) {
+                stats.histogram[b] += histogram.buckets[b].load(std::memory_order_relaxed);
+            }
+        }
+        if (stats.count > 0) result.push_back(std::move(stats));
+    }
+    return result;
+}
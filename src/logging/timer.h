@@ -10,8 +10,11 @@
 #include <util/macros.h>
 #include <util/time.h>
 
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <string>
+#include <vector>
 
 
 namespace BCLog {
@@ -90,8 +93,61 @@ private:
 
 };
 
+//! Upper bounds, in microseconds, of the METRIC_SCOPE histogram buckets. A last bucket counts the rest.
+static constexpr std::array<int64_t, 12> METRIC_SCOPE_BOUNDS{{100, 250, 1000, 2500, 10000, 25000, 100000, 250000, 1000000, 2500000, 10000000, 25000000}};
+//! Most distinct METRIC_SCOPE names; later names are recorded as "other".
+static constexpr int MAX_METRIC_SCOPES = 256;
+
+struct MetricScopeStats {
+    std::string name;
+    uint64_t count{0};
+    uint64_t total_us{0};
+    //! Per METRIC_SCOPE_BOUNDS bucket, and a last one above them, not cumulative
+    std::array<uint64_t, METRIC_SCOPE_BOUNDS.size() + 1> histogram{};
+};
+
+/** The id METRIC_SCOPE records name under, registering it the first time. */
+int MetricScopeId(const std::string& name);
+
+/** Record a duration of scope id for the calling thread. */
+void RecordMetricScope(int id, int64_t micros);
+
+/**
+ * Sum the durations recorded by every thread, including exited ones, for
+ * each scope that has been recorded.
+ */
+std::vector<MetricScopeStats> GetMetricScopeStats();
+
+//! RAII-style object that records how long it lived, under a METRIC_SCOPE name.
+class MetricScope
+{
+public:
+    explicit MetricScope(int id) : m_id(id), m_start(std::chrono::steady_clock::now()) {}
+    ~MetricScope()
+    {
+        RecordMetricScope(m_id, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count());
+    }
+
+private:
+    const int m_id;
+    const std::chrono::steady_clock::time_point m_start;
+};
+
 } // namespace BCLog
 
+/**
+ * Record the time until the end of the enclosing scope under name, in
+ * per-thread histograms that GetMetricScopeStats adds up. name is looked up
+ * once per call site, so it must not change between calls; use
+ * METRIC_SCOPE_NAMED where it does, and keep the set of names it can take
+ * small and fixed.
+ */
+#define METRIC_SCOPE(name)                                                           \
+    static const int PASTE2(metric_scope_id, __LINE__) = BCLog::MetricScopeId(name); \
+    BCLog::MetricScope PASTE2(metric_scope, __LINE__)(PASTE2(metric_scope_id, __LINE__))
+#define METRIC_SCOPE_NAMED(name) \
+    BCLog::MetricScope PASTE2(metric_scope, __LINE__)(BCLog::MetricScopeId(name))
+
 
 #define LOG_TIME_MICROS(end_msg, ...) \
     BCLog::Timer<std::chrono::microseconds> PASTE2(logging_timer, __COUNTER__)(__func__, end_msg, ## __VA_ARGS__)
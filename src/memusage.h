@@ -18,6 +18,7 @@
 #include <unordered_map>
 #include <unordered_set>
 
+template <typename K, typename T, typename Hash> class flatmap;
 
 namespace memusage
 {
@@ -168,6 +169,12 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const flatmap<X, Y, Z>& m)
+{
+    return m.DynamicMemoryUsage();
+}
+
 }
 
 #endif // BITCOIN_MEMUSAGE_H
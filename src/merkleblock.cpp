@@ -36,6 +36,33 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std:
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+CMerkleBlock::CMerkleBlock(const CFilterableBlock& block, CBloomFilter& filter) : header(block.header)
+{
+    std::vector<bool> vMatch;
+    vMatch.reserve(block.vTxElements.size());
+
+    for (unsigned int i = 0; i < block.vTxElements.size(); i++)
+    {
+        const bool fMatch = filter.IsRelevantAndUpdate(block.vTxElements[i]);
+        if (fMatch) vMatchedTxn.emplace_back(i, block.vLevels[0][i]);
+        vMatch.push_back(fMatch);
+    }
+
+    txn = CPartialMerkleTree(block.vLevels, vMatch);
+}
+
+CFilterableBlock::CFilterableBlock(const CBlock& block) : header(block.GetBlockHeader()), hash(header.GetHash())
+{
+    std::vector<uint256> vTxid;
+    vTxid.reserve(block.vtx.size());
+    vTxElements.reserve(block.vtx.size());
+    for (const CTransactionRef& tx : block.vtx) {
+        vTxid.push_back(tx->GetHash());
+        vTxElements.emplace_back(tx);
+    }
+    vLevels = CPartialMerkleTree::CalcLevels(vTxid);
+}
+
 uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid) {
     //we can never have zero txs in a merkle block, we always need the coinbase tx
     //if we do not have this assert, we can hit a memory access violation when indexing into vTxid
@@ -74,6 +101,20 @@ void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const st
     }
 }
 
+void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<std::vector<uint256>> &vLevels, const std::vector<bool> &vMatch) {
+    bool fParentOfMatch = false;
+    for (unsigned int p = pos << height; p < (pos+1) << height && p < nTransactions; p++)
+        fParentOfMatch |= vMatch[p];
+    vBits.push_back(fParentOfMatch);
+    if (height==0 || !fParentOfMatch) {
+        vHash.push_back(vLevels[height][pos]);
+    } else {
+        TraverseAndBuild(height-1, pos*2, vLevels, vMatch);
+        if (pos*2+1 < CalcTreeWidth(height-1))
+            TraverseAndBuild(height-1, pos*2+1, vLevels, vMatch);
+    }
+}
+
 uint256 CPartialMerkleTree::TraverseAndExtract(int height, unsigned int pos, unsigned int &nBitsUsed, unsigned int &nHashUsed, std::vector<uint256> &vMatch, std::vector<unsigned int> &vnIndex) {
     if (nBitsUsed >= vBits.size()) {
         // overflowed the bits array - failure
@@ -126,8 +167,32 @@ CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const
     TraverseAndBuild(nHeight, 0, vTxid, vMatch);
 }
 
+CPartialMerkleTree::CPartialMerkleTree(const std::vector<std::vector<uint256>> &vLevels, const std::vector<bool> &vMatch) : nTransactions(vLevels.at(0).size()), fBad(false) {
+    // the last level is the root
+    TraverseAndBuild(vLevels.size() - 1, 0, vLevels, vMatch);
+}
+
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
 
+std::vector<std::vector<uint256>> CPartialMerkleTree::CalcLevels(const std::vector<uint256> &vTxid) {
+    // as in CalcHash, a block always has at least the coinbase tx
+    assert(vTxid.size() != 0);
+    std::vector<std::vector<uint256>> vLevels{vTxid};
+    while (vLevels.back().size() > 1) {
+        const std::vector<uint256>& below = vLevels.back();
+        std::vector<uint256> level;
+        level.reserve((below.size() + 1) / 2);
+        for (size_t pos = 0; pos < below.size(); pos += 2) {
+            // copy the left hash if the right one is beyond the end
+            const uint256& left = below[pos];
+            const uint256& right = pos + 1 < below.size() ? below[pos + 1] : left;
+            level.push_back(Hash(left.begin(), left.end(), right.begin(), right.end()));
+        }
+        vLevels.push_back(std::move(level));
+    }
+    return vLevels;
+}
+
 uint256 CPartialMerkleTree::ExtractMatches(std::vector<uint256> &vMatch, std::vector<unsigned int> &vnIndex) {
     vMatch.clear();
     // An empty set will not work
@@ -73,6 +73,9 @@ protected:
     /** recursive function that traverses tree nodes, storing the data as bits and hashes */
     void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /** the same, taking the hashes of nodes from the levels of the tree (see CalcLevels) */
+    void TraverseAndBuild(int height, unsigned int pos, const std::vector<std::vector<uint256>> &vLevels, const std::vector<bool> &vMatch);
+
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
      * it returns the hash of the respective node and its respective index.
@@ -107,8 +110,14 @@ public:
     /** Construct a partial merkle tree from a list of transaction ids, and a mask that selects a subset of them */
     CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /** The same from all the levels of the merkle tree of the txids, which hashes nothing */
+    CPartialMerkleTree(const std::vector<std::vector<uint256>> &vLevels, const std::vector<bool> &vMatch);
+
     CPartialMerkleTree();
 
+    /** The hashes of the nodes at each height of the merkle tree of a list of transaction ids, from the txids themselves up to the root */
+    static std::vector<std::vector<uint256>> CalcLevels(const std::vector<uint256> &vTxid);
+
     /**
      * extract the matching txid's represented by this partial merkle tree
      * and their respective indices within the partial tree.
@@ -124,6 +133,23 @@ public:
 };
 
 
+/**
+ * What the merkleblocks of a block have in common whatever filter they are
+ * for: the header, the data elements of its transactions and the levels of
+ * its merkle tree. Building a merkleblock for a filter from it only matches
+ * the filter, so it pays off once a few filtered peers ask for the block.
+ */
+class CFilterableBlock
+{
+public:
+    explicit CFilterableBlock(const CBlock& block);
+
+    CBlockHeader header;
+    uint256 hash;
+    std::vector<CBloomTxElements> vTxElements;
+    std::vector<std::vector<uint256>> vLevels;
+};
+
 /**
  * Used to relay blocks as header + vector<merkle branch>
  * to filtered nodes.
@@ -152,6 +178,9 @@ public:
      */
     CMerkleBlock(const CBlock& block, CBloomFilter& filter) : CMerkleBlock(block, &filter, nullptr) { }
 
+    /** The same from a block prepared for filtering, which gives the same result */
+    CMerkleBlock(const CFilterableBlock& block, CBloomFilter& filter);
+
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids) : CMerkleBlock(block, nullptr, &txids) { }
 
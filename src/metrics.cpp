@@ -0,0 +1,294 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <metrics.h>
+
+#include <chain.h>
+#include <httpserver.h>
+#include <logging/timer.h>
+#include <net.h>
+#include <node/context.h>
+#include <proofcache.h>
+#include <protocol.h>
+#include <rpc/blockchain.h>
+#include <rpc/protocol.h>
+#include <rpc/server.h>
+#include <script/sigcache.h>
+#include <sync.h>
+#include <tinyformat.h>
+#include <txmempool.h>
+#include <validation.h>
+
+LabeledCounter::LabeledCounter(std::vector<std::string> labels)
+    : m_labels(std::move(labels)), m_counts(new std::atomic<uint64_t>[m_labels.size()])
+{
+    assert(!m_labels.empty());
+    for (size_t i = 0; i < m_labels.size(); i++) {
+        m_index.emplace(m_labels[i], i);
+        m_counts[i] = 0;
+    }
+}
+
+void LabeledCounter::Add(const std::string& label, uint64_t n)
+{
+    auto it = m_index.find(label);
+    const size_t i = it == m_index.end() ? m_labels.size() - 1 : it->second;
+    m_counts[i].fetch_add(n, std::memory_order_relaxed);
+}
+
+std::vector<std::pair<std::string, uint64_t>> LabeledCounter::Get() const
+{
+    std::vector<std::pair<std::string, uint64_t>> counts;
+    counts.reserve(m_labels.size());
+    for (size_t i = 0; i < m_labels.size(); i++) {
+        counts.emplace_back(m_labels[i], m_counts[i].load(std::memory_order_relaxed));
+    }
+    return counts;
+}
+
+static std::vector<std::string> MsgTypeLabels()
+{
+    std::vector<std::string> labels = getAllNetMessageTypes();
+    labels.push_back(NET_MESSAGE_COMMAND_OTHER);
+    return labels;
+}
+
+LabeledCounter& NetBytesSentPerMsgType()
+{
+    static LabeledCounter counter(MsgTypeLabels());
+    return counter;
+}
+
+LabeledCounter& NetBytesReceivedPerMsgType()
+{
+    static LabeledCounter counter(MsgTypeLabels());
+    return counter;
+}
+
+namespace {
+class MetricsWriter
+{
+public:
+    void Family(const std::string& name, const char* type, const std::string& help)
+    {
+        m_out += strprintf("# HELP litecoinz_%s %s\n# TYPE litecoinz_%s %s\n", name, help, name, type);
+    }
+
+    void Sample(const std::string& name, double value, const std::string& labels = "")
+    {
+        m_out += strprintf("litecoinz_%s%s %s\n", name, labels.empty() ? "" : "{" + labels + "}", FormatValue(value));
+    }
+
+    static std::string Label(const std::string& key, const std::string& value)
+    {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '\\' || c == '"') escaped += '\\';
+            if (c == '\n') {
+                escaped += "\\n";
+                continue;
+            }
+            escaped += c;
+        }
+        return key + "=\"" + escaped + "\"";
+    }
+
+    std::string& Text() { return m_out; }
+
+private:
+    static std::string FormatValue(double value)
+    {
+        return strprintf("%.17g", value);
+    }
+
+    std::string m_out;
+};
+
+void WriteNetMetrics(MetricsWriter& w)
+{
+    w.Family("net_sent_bytes_total", "counter", "Bytes sent, per message type");
+    for (const auto& count : NetBytesSentPerMsgType().Get()) {
+        w.Sample("net_sent_bytes_total", count.second, MetricsWriter::Label("type", count.first));
+    }
+    w.Family("net_received_bytes_total", "counter", "Bytes received, per message type");
+    for (const auto& count : NetBytesReceivedPerMsgType().Get()) {
+        w.Sample("net_received_bytes_total", count.second, MetricsWriter::Label("type", count.first));
+    }
+    if (g_rpc_node && g_rpc_node->connman) {
+        w.Family("peers", "gauge", "Connected peers");
+        w.Sample("peers", g_rpc_node->connman->GetNodeCount(CConnman::CONNECTIONS_IN), MetricsWriter::Label("direction", "inbound"));
+        w.Sample("peers", g_rpc_node->connman->GetNodeCount(CConnman::CONNECTIONS_OUT), MetricsWriter::Label("direction", "outbound"));
+    }
+}
+
+void WriteChainMetrics(MetricsWriter& w)
+{
+    const CBlockIndex* tip = ::ChainActive().TipSnapshot();
+    w.Family("blocks", "gauge", "Height of the active chain tip");
+    w.Sample("blocks", tip ? tip->nHeight : -1);
+}
+
+void WriteMempoolMetrics(MetricsWriter& w)
+{
+    if (!g_rpc_node || !g_rpc_node->mempool) return;
+    const CTxMemPool& pool = *g_rpc_node->mempool;
+    size_t size, bytes, usage;
+    {
+        LOCK(pool.cs);
+        size = pool.size();
+        bytes = pool.GetTotalTxSize();
+        usage = pool.DynamicMemoryUsage();
+    }
+    w.Family("mempool_transactions", "gauge", "Transactions in the mempool");
+    w.Sample("mempool_transactions", size);
+    w.Family("mempool_bytes", "gauge", "Serialized size of the mempool transactions");
+    w.Sample("mempool_bytes", bytes);
+    w.Family("mempool_usage_bytes", "gauge", "Memory used by the mempool");
+    w.Sample("mempool_usage_bytes", usage);
+}
+
+void WriteCacheMetrics(MetricsWriter& w)
+{
+    const std::vector<std::pair<std::string, CuckooCache::cache_stats>> caches{
+        {"signatures", GetSignatureCacheStats()},
+        {"scripts", GetScriptExecutionCacheStats()},
+        {"proofs", GetProofCacheStats()},
+    };
+    w.Family("cache_hits_total", "counter", "Lookups that found their entry, per validation cache");
+    for (const auto& cache : caches) {
+        w.Sample("cache_hits_total", cache.second.hits, MetricsWriter::Label("cache", cache.first));
+    }
+    w.Family("cache_misses_total", "counter", "Lookups that did not find their entry, per validation cache");
+    for (const auto& cache : caches) {
+        w.Sample("cache_misses_total", cache.second.misses, MetricsWriter::Label("cache", cache.first));
+    }
+    w.Family("cache_evictions_total", "counter", "Entries given up to make room, per validation cache");
+    for (const auto& cache : caches) {
+        w.Sample("cache_evictions_total", cache.second.evictions, MetricsWriter::Label("cache", cache.first));
+    }
+    w.Family("cache_max_elements", "gauge", "Capacity of each validation cache");
+    for (const auto& cache : caches) {
+        w.Sample("cache_max_elements", cache.second.max_elements, MetricsWriter::Label("cache", cache.first));
+    }
+}
+
+void WriteValidationMetrics(MetricsWriter& w)
+{
+    w.Family("validation_seconds", "histogram", "Time taken by each step of block validation");
+    for (size_t i = 0; i < size_t(ValidationPhase::COUNT); i++) {
+        const ValidationPhase phase = ValidationPhase(i);
+        const ValidationTimingStats stats = GetValidationTimingStats(phase);
+        const std::string phase_label = MetricsWriter::Label("phase", ValidationPhaseName(phase));
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < VALIDATION_TIMING_BOUNDS.size(); b++) {
+            cumulative += stats.histogram[b];
+            w.Sample("validation_seconds_bucket", cumulative, phase_label + "," + MetricsWriter::Label("le", strprintf("%g", VALIDATION_TIMING_BOUNDS[b] / 1e6)));
+        }
+        w.Sample("validation_seconds_bucket", stats.count, phase_label + "," + MetricsWriter::Label("le", "+Inf"));
+        w.Sample("validation_seconds_sum", stats.total_us / 1e6, phase_label);
+        w.Sample("validation_seconds_count", stats.count, phase_label);
+    }
+}
+
+void WriteScopeMetrics(MetricsWriter& w)
+{
+    w.Family("scope_seconds", "histogram", "Time spent in each METRIC_SCOPE");
+    for (const BCLog::MetricScopeStats& stats : BCLog::GetMetricScopeStats()) {
+        const std::string scope_label = MetricsWriter::Label("scope", stats.name);
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < BCLog::METRIC_SCOPE_BOUNDS.size(); b++) {
+            cumulative += stats.histogram[b];
+            w.Sample("scope_seconds_bucket", cumulative, scope_label + "," + MetricsWriter::Label("le", strprintf("%g", BCLog::METRIC_SCOPE_BOUNDS[b] / 1e6)));
+        }
+        w.Sample("scope_seconds_bucket", stats.count, scope_label + "," + MetricsWriter::Label("le", "+Inf"));
+        w.Sample("scope_seconds_sum", stats.total_us / 1e6, scope_label);
+        w.Sample("scope_seconds_count", stats.count, scope_label);
+    }
+}
+
+void WriteRPCMetrics(MetricsWriter& w)
+{
+    const std::map<std::string, RPCMethodStats> methods = GetRPCMethodStats();
+    w.Family("rpc_calls_total", "counter", "RPC calls of each method");
+    for (const auto& method : methods) {
+        w.Sample("rpc_calls_total", method.second.calls, MetricsWriter::Label("method", method.first));
+    }
+    w.Family("rpc_errors_total", "counter", "RPC calls of each method that returned an error");
+    for (const auto& method : methods) {
+        w.Sample("rpc_errors_total", method.second.errors, MetricsWriter::Label("method", method.first));
+    }
+    w.Family("rpc_in_flight", "gauge", "RPC calls of each method running now");
+    for (const auto& method : methods) {
+        w.Sample("rpc_in_flight", method.second.in_flight, MetricsWriter::Label("method", method.first));
+    }
+    w.Family("rpc_seconds", "histogram", "Duration of finished RPC calls of each method");
+    for (const auto& method : methods) {
+        const RPCMethodStats& stats = method.second;
+        const std::string method_label = MetricsWriter::Label("method", method.first);
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < BCLog::METRIC_SCOPE_BOUNDS.size(); b++) {
+            cumulative += stats.histogram[b];
+            w.Sample("rpc_seconds_bucket", cumulative, method_label + "," + MetricsWriter::Label("le", strprintf("%g", BCLog::METRIC_SCOPE_BOUNDS[b] / 1e6)));
+        }
+        w.Sample("rpc_seconds_bucket", stats.calls - stats.in_flight, method_label + "," + MetricsWriter::Label("le", "+Inf"));
+        w.Sample("rpc_seconds_sum", stats.total_us / 1e6, method_label);
+        w.Sample("rpc_seconds_count", stats.calls - stats.in_flight, method_label);
+    }
+}
+
+void WriteLockMetrics(MetricsWriter& w)
+{
+    const std::vector<LockSiteStats> sites = GetLockStats();
+    auto site_label = [](const LockSiteStats& site) {
+        return MetricsWriter::Label("lock", site.name) + "," + MetricsWriter::Label("site", strprintf("%s:%d", site.file, site.line));
+    };
+    w.Family("lock_acquisitions_total", "counter", "Acquisitions per lock site");
+    for (const LockSiteStats& site : sites) {
+        w.Sample("lock_acquisitions_total", site.acquisitions, site_label(site));
+    }
+    w.Family("lock_contentions_total", "counter", "Acquisitions that had to wait, per lock site");
+    for (const LockSiteStats& site : sites) {
+        w.Sample("lock_contentions_total", site.contentions, site_label(site));
+    }
+    w.Family("lock_wait_seconds_total", "counter", "Time spent waiting for the lock, per lock site");
+    for (const LockSiteStats& site : sites) {
+        w.Sample("lock_wait_seconds_total", site.wait_ns / 1e9, site_label(site));
+    }
+}
+
+bool HTTPReq_Metrics(HTTPRequest* req, const std::string&)
+{
+    if (req->GetRequestMethod() != HTTPRequest::GET) {
+        req->WriteReply(HTTP_BAD_METHOD, "Only GET requests are supported\r\n");
+        return false;
+    }
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+    req->WriteReply(HTTP_OK, GetMetricsText());
+    return true;
+}
+} // namespace
+
+std::string GetMetricsText()
+{
+    MetricsWriter w;
+    WriteNetMetrics(w);
+    WriteChainMetrics(w);
+    WriteMempoolMetrics(w);
+    WriteCacheMetrics(w);
+    WriteValidationMetrics(w);
+    WriteScopeMetrics(w);
+    WriteRPCMetrics(w);
+    WriteLockMetrics(w);
+    return std::move(w.Text());
+}
+
+void StartMetrics()
+{
+    RegisterHTTPHandler("/metrics", true, HTTPReq_Metrics);
+}
+
+void StopMetrics()
+{
+    UnregisterHTTPHandler("/metrics", true);
+}
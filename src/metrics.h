@@ -0,0 +1,50 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_METRICS_H
+#define BITCOIN_METRICS_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Counters for a fixed set of label values, e.g. bytes per message type. The
+ * set is known at construction, so Add is a lookup in a map that never
+ * changes and a relaxed atomic increment, and readers take no lock. Values
+ * outside the set are counted under the last one.
+ */
+class LabeledCounter
+{
+public:
+    explicit LabeledCounter(std::vector<std::string> labels);
+    LabeledCounter(const LabeledCounter&) = delete;
+    LabeledCounter& operator=(const LabeledCounter&) = delete;
+
+    void Add(const std::string& label, uint64_t n);
+    std::vector<std::pair<std::string, uint64_t>> Get() const;
+
+private:
+    const std::vector<std::string> m_labels;
+    std::map<std::string, size_t> m_index;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_counts;
+};
+
+/** Bytes sent and received per message type, over all peers since startup */
+LabeledCounter& NetBytesSentPerMsgType();
+LabeledCounter& NetBytesReceivedPerMsgType();
+
+/** Render all metrics in the Prometheus text exposition format. */
+std::string GetMetricsText();
+
+/** Start serving /metrics on the HTTP server */
+void StartMetrics();
+/** Stop serving /metrics */
+void StopMetrics();
+
+#endif // BITCOIN_METRICS_H
@@ -17,6 +17,7 @@
 #include <policy/policy.h>
 #include <pow.h>
 #include <primitives/transaction.h>
+#include <scheduler.h>
 #include <timedata.h>
 #include <util/moneystr.h>
 #include <util/system.h>
@@ -110,6 +111,13 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     assert(pindexPrev != nullptr);
     nHeight = pindexPrev->nHeight + 1;
 
+    // Start from the tip's Sapling note commitment tree; the outputs of the
+    // selected transactions are appended once the block is filled.
+    const CCoinsViewCache& coins_tip = ::ChainstateActive().CoinsTip();
+    if (!coins_tip.GetSaplingAnchorAt(coins_tip.GetBestAnchor(), sapling_tree)) {
+        throw std::runtime_error(strprintf("%s: Sapling note commitment tree of the tip not found", __func__));
+    }
+
     if (nHeight >= chainparams.GetConsensus().CSVHeight)
         pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
     else
@@ -141,6 +149,15 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     int nDescendantsUpdated = 0;
     addPackageTxs(nPackagesSelected, nDescendantsUpdated);
 
+    std::vector<libzcash::PedersenHash> sapling_commitments;
+    for (const CTransactionRef& tx : pblock->vtx) {
+        if (!tx) continue; // The coinbase is added below.
+        for (const OutputDescription& output : tx->vShieldedOutput) {
+            sapling_commitments.push_back(output.cm);
+        }
+    }
+    sapling_tree.append_batch(sapling_commitments);
+
     int64_t nTime1 = GetTimeMicros();
 
     m_last_block_num_txs = nBlockTx;
@@ -453,3 +470,79 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+/** How long the template cache keeps building templates after the last request */
+static constexpr int64_t TEMPLATE_CACHE_IDLE_TIMEOUT = 60;
+/** How long a rebuild waits after a mempool change, so bursts are coalesced */
+static constexpr std::chrono::milliseconds TEMPLATE_CACHE_MEMPOOL_DELAY{500};
+
+bool BlockTemplateCache::IsInUse() const
+{
+    return GetTime() - m_last_request < TEMPLATE_CACHE_IDLE_TIMEOUT;
+}
+
+void BlockTemplateCache::ScheduleUpdate(std::chrono::milliseconds delay)
+{
+    {
+        LOCK(m_mutex);
+        if (m_update_scheduled) return;
+        m_update_scheduled = true;
+    }
+    m_scheduler.scheduleFromNow([this] { Update(); }, delay);
+}
+
+void BlockTemplateCache::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload || !IsInUse()) return;
+    Update();
+}
+
+void BlockTemplateCache::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence)
+{
+    if (!IsInUse()) return;
+    ScheduleUpdate(TEMPLATE_CACHE_MEMPOOL_DELAY);
+}
+
+std::shared_ptr<const CBlockTemplate> BlockTemplateCache::Get(const CBlockIndex* tip, unsigned int& transactions_updated)
+{
+    m_last_request = GetTime();
+
+    std::shared_ptr<const CBlockTemplate> block_template;
+    {
+        LOCK(m_mutex);
+        if (m_template && m_template->block.hashPrevBlock == tip->GetBlockHash()) {
+            block_template = m_template;
+            transactions_updated = m_transactions_updated;
+        }
+    }
+    if (!block_template) {
+        ScheduleUpdate(std::chrono::milliseconds{0});
+    } else if (transactions_updated != m_mempool.GetTransactionsUpdated()) {
+        ScheduleUpdate(TEMPLATE_CACHE_MEMPOOL_DELAY);
+    }
+    return block_template;
+}
+
+void BlockTemplateCache::Update()
+{
+    {
+        LOCK(m_mutex);
+        m_update_scheduled = false;
+    }
+
+    // Read the counter first, so that changes made while the block is being
+    // assembled make the template look outdated rather than current.
+    const unsigned int transactions_updated = m_mempool.GetTransactionsUpdated();
+    std::shared_ptr<const CBlockTemplate> block_template;
+    try {
+        block_template = BlockAssembler(m_mempool, m_chainparams).CreateNewBlock(CScript() << OP_TRUE);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: failed to create a block template: %s\n", __func__, e.what());
+        return;
+    }
+    if (!block_template) return;
+
+    LOCK(m_mutex);
+    m_template = std::move(block_template);
+    m_transactions_updated = transactions_updated;
+}
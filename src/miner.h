@@ -8,9 +8,13 @@
 
 #include <optional.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <stdint.h>
 
@@ -19,11 +23,14 @@
 
 class CBlockIndex;
 class CChainParams;
+class CScheduler;
 class CScript;
 
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Threads searching nonces when generating blocks, -1 means one per core */
+static const int DEFAULT_GENERATE_THREADS = -1;
 
 struct CBlockTemplate
 {
@@ -200,6 +207,51 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 };
 
+/**
+ * Keeps a block template for the active tip up to date in the background, so
+ * that getblocktemplate can answer from it instead of assembling a block on
+ * every call. Templates are only built while getblocktemplate is being used:
+ * a new tip triggers an immediate rebuild, and mempool additions a rebuild
+ * that is delayed so bursts of transactions are coalesced.
+ */
+class BlockTemplateCache final : public CValidationInterface
+{
+private:
+    const CTxMemPool& m_mempool;
+    const CChainParams& m_chainparams;
+    CScheduler& m_scheduler;
+
+    Mutex m_mutex;
+    std::shared_ptr<const CBlockTemplate> m_template GUARDED_BY(m_mutex);
+    //! The mempool's transactions updated counter when m_template was started
+    unsigned int m_transactions_updated GUARDED_BY(m_mutex){0};
+    bool m_update_scheduled GUARDED_BY(m_mutex){false};
+
+    //! When a template was last asked for, in seconds
+    std::atomic<int64_t> m_last_request{0};
+
+    bool IsInUse() const;
+    void ScheduleUpdate(std::chrono::milliseconds delay);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override;
+
+public:
+    BlockTemplateCache(const CTxMemPool& mempool, const CChainParams& chainparams, CScheduler& scheduler)
+        : m_mempool(mempool), m_chainparams(chainparams), m_scheduler(scheduler) {}
+
+    /**
+     * Get the template built on tip, or nullptr if there is none yet, along
+     * with the transactions updated counter it reflects. Marks the cache as
+     * in use and schedules a rebuild if the template is missing or outdated.
+     */
+    std::shared_ptr<const CBlockTemplate> Get(const CBlockIndex* tip, unsigned int& transactions_updated);
+
+    /** Build a template on the current tip now. */
+    void Update();
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -13,25 +13,39 @@
 #include <chainparams.h>
 #include <clientversion.h>
 #include <consensus/consensus.h>
+#include <metrics.h>
+#include <pow.h>
+#include <primitives/block.h>
 #include <crypto/sha256.h>
 #include <netbase.h>
 #include <net_permissions.h>
 #include <random.h>
 #include <scheduler.h>
 #include <ui_interface.h>
+#include <util/asmap.h>
 #include <util/strencodings.h>
+#include <util/trace.h>
 #include <util/translation.h>
 
 #ifdef WIN32
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#ifdef USE_KQUEUE
+#include <sys/event.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/upnpcommands.h>
@@ -75,6 +89,20 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+// Sockets wake the event queue themselves, so its timeout only bounds how
+// late DisconnectNodes and InactivityCheck run
+static const int SOCKET_EVENTS_TIMEOUT_MILLISECONDS = 250;
+
+/** Most queued buffers handed to the socket in one sendmsg call. IOV_MAX is 1024 on Linux and the BSDs. */
+static const size_t MAX_SEND_IOVECS = 64;
+
+/** Most events taken from the socket event queue at once. */
+static const int MAX_SOCKET_EVENTS = 256;
+
+/** Socket event queue tags of the sockets that do not belong to a node. */
+static constexpr NodeId SOCKET_EVENT_LISTEN = -1;
+static constexpr NodeId SOCKET_EVENT_WAKEUP = -2;
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -191,7 +219,7 @@ void AdvertiseLocal(CNode *pnode)
         // If discovery is enabled, sometimes give our peer the address it
         // tells us that it sees us as in case it has a better idea of our
         // address than we do.
-        FastRandomContext rng;
+        FastRandomContext& rng = GetThreadRandomContext();
         if (IsPeerAddrLocalGood(pnode) && (!addrLocal.IsRoutable() ||
              rng.randbits((GetnScore(addrLocal) > LOCAL_MANUAL) ? 3 : 1) == 0))
         {
@@ -591,6 +619,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
                 i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
             assert(i != mapRecvBytesPerMsgCmd.end());
             i->second += msg.m_raw_message_size;
+            NetBytesReceivedPerMsgType().Add(i->first, msg.m_raw_message_size);
 
             // push the message to the process queue,
             vRecvMsg.push_back(std::move(msg));
@@ -628,6 +657,69 @@ int CNode::GetSendVersion() const
     return nSendVersion;
 }
 
+/**
+ * Receive buffers kept for reuse, so that relaying many transactions does not
+ * allocate, wipe and free a buffer for every message. A payload of up to
+ * 256 KiB takes a buffer of the smallest size class that holds it; larger
+ * ones, i.e. blocks, grow their own as their bytes arrive.
+ */
+class RecvBufferPool
+{
+private:
+    struct SizeClass {
+        const size_t size;
+        //! Bounds the memory the pool holds on to
+        const size_t max_buffers;
+        std::vector<CSerializeData> buffers;
+    };
+
+    Mutex m_mutex;
+    SizeClass m_classes[3] GUARDED_BY(m_mutex) = {{4 * 1024, 256, {}}, {32 * 1024, 64, {}}, {256 * 1024, 8, {}}};
+
+public:
+    /** Get a buffer with room for size bytes, or an empty one when size is above the largest class. */
+    CSerializeData Get(size_t size)
+    {
+        CSerializeData buffer;
+        LOCK(m_mutex);
+        for (SizeClass& size_class : m_classes) {
+            if (size > size_class.size) continue;
+            if (size_class.buffers.empty()) {
+                buffer.reserve(size_class.size);
+            } else {
+                buffer.swap(size_class.buffers.back());
+                size_class.buffers.pop_back();
+            }
+            break;
+        }
+        return buffer;
+    }
+
+    /** Keep a buffer that was taken from the pool, if there is room for it. */
+    void Put(CSerializeData&& buffer)
+    {
+        if (buffer.capacity() == 0) return;
+        LOCK(m_mutex);
+        for (SizeClass& size_class : m_classes) {
+            if (buffer.capacity() != size_class.size) continue;
+            if (size_class.buffers.size() < size_class.max_buffers) {
+                buffer.clear();
+                size_class.buffers.push_back(std::move(buffer));
+            }
+            break;
+        }
+    }
+};
+
+static RecvBufferPool g_recv_buffer_pool;
+
+CNetMessage::~CNetMessage()
+{
+    CSerializeData buffer;
+    m_recv.SwapBuffer(buffer);
+    g_recv_buffer_pool.Put(std::move(buffer));
+}
+
 int V1TransportDeserializer::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -654,8 +746,17 @@ int V1TransportDeserializer::readHeader(const char *pch, unsigned int nBytes)
         return -1;
     }
 
+    // take a buffer for the message data, giving back the one of a message
+    // that failed to parse
+    if (hdr.nMessageSize > 0) {
+        CSerializeData buffer = g_recv_buffer_pool.Get(hdr.nMessageSize);
+        vRecv.SwapBuffer(buffer);
+        g_recv_buffer_pool.Put(std::move(buffer));
+    }
+
     // switch state to reading message data
     in_data = true;
+    check_block_header = (hdr.GetCommand() == NetMsgType::BLOCK);
 
     return nCopy;
 }
@@ -674,9 +775,45 @@ int V1TransportDeserializer::readData(const char *pch, unsigned int nBytes)
     memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
+    if (check_block_header && !checkBlockHeader())
+        return -1;
+
     return nCopy;
 }
 
+bool V1TransportDeserializer::checkBlockHeader()
+{
+    // Wait for the header with the longest Equihash solution, or for the whole
+    // message if it is shorter than that
+    const CChainParams& chainparams = Params();
+    const size_t old_width = chainparams.EquihashSolutionWidth(chainparams.EquihashForkHeight() - 1);
+    const size_t new_width = chainparams.EquihashSolutionWidth(chainparams.EquihashForkHeight());
+    const size_t max_width = std::max(old_width, new_width);
+    const size_t max_size = CBlockHeader::HEADER_SIZE + GetSizeOfCompactSize(max_width) + max_width;
+    if (nDataPos < std::min<size_t>(max_size, hdr.nMessageSize))
+        return true;
+    check_block_header = false;
+
+    CBlockHeader header;
+    try {
+        CDataStream s(&vRecv[0], &vRecv[0] + std::min<size_t>(max_size, nDataPos), vRecv.GetType(), vRecv.GetVersion());
+        s >> header;
+    } catch (const std::exception&) {
+        // leave a malformed block to message processing
+        return true;
+    }
+
+    // Same proof of work checks as CheckBlockHeader, so that a peer sending a
+    // large block without valid work is dropped before the rest of it arrives
+    const size_t sol_size = header.nSolution.size();
+    if ((sol_size != old_width && sol_size != new_width) || !CheckEquihashSolution(&header) ||
+        !CheckProofOfWork(header.GetHash(), header.nBits, chainparams.GetConsensus())) {
+        LogPrint(BCLog::NET, "block %s has invalid proof of work, rejecting message of %u bytes\n", header.GetHash().ToString(), hdr.nMessageSize);
+        return false;
+    }
+    return true;
+}
+
 const uint256& V1TransportDeserializer::GetMessageHash() const
 {
     assert(Complete());
@@ -718,12 +855,17 @@ CNetMessage V1TransportDeserializer::GetMessage(const CMessageHeader::MessageSta
     return msg;
 }
 
+CSharedNetPayload::CSharedNetPayload(std::vector<unsigned char>&& data_in)
+    : data(std::move(data_in)), hash(Hash(data.begin(), data.end()))
+{
+}
+
 void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
-    // create dbl-sha256 checksum
-    uint256 hash = Hash(msg.data.begin(), msg.data.end());
+    // create dbl-sha256 checksum, which a shared payload has computed once
+    uint256 hash = msg.shared_payload ? msg.shared_payload->hash : Hash(msg.data.begin(), msg.data.end());
 
     // create header
-    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.PayloadSize());
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     // serialize header
@@ -737,27 +879,53 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert(it->size() > pnode->nSendOffset);
         int nBytes = 0;
+        size_t nAttempted = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            nAttempted = it->size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(it->data()) + pnode->nSendOffset, nAttempted, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Hand as many of the queued buffers as fit in one call to the socket
+            struct iovec iov[MAX_SEND_IOVECS];
+            size_t nIov = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (auto it_iov = it; it_iov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; ++it_iov, ++nIov) {
+                iov[nIov].iov_base = const_cast<unsigned char*>(it_iov->data()) + nOffset;
+                iov[nIov].iov_len = it_iov->size() - nOffset;
+                nAttempted += iov[nIov].iov_len;
+                nOffset = 0;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Drop the buffers that were sent completely
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                const size_t nRemaining = it->size() - pnode->nSendOffset;
+                if (nLeft < nRemaining) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= it->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nAttempted) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -1045,6 +1213,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        RegisterSocket(pnode);
     }
 
     // We received a new connection, harvest entropy from the time (and our peer count)
@@ -1324,9 +1493,226 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
-void CConnman::SocketHandler()
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+/**
+ * Add a socket to the event queue, with the tag of the node it belongs to.
+ * Nodes are watched edge-triggered for reads and writes, listen sockets and
+ * the wakeup pipe level-triggered for reads only.
+ */
+static bool AddSocketEvents(int event_fd, SOCKET hSocket, NodeId tag)
+{
+    const bool is_node = tag >= 0;
+#ifdef USE_EPOLL
+    struct epoll_event ev;
+    ev.events = is_node ? (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) : EPOLLIN;
+    ev.data.u64 = static_cast<uint64_t>(tag);
+    return epoll_ctl(event_fd, EPOLL_CTL_ADD, hSocket, &ev) == 0;
+#else
+    struct kevent changes[2];
+    void* udata = reinterpret_cast<void*>(static_cast<intptr_t>(tag));
+    EV_SET(&changes[0], hSocket, EVFILT_READ, is_node ? (EV_ADD | EV_CLEAR) : EV_ADD, 0, 0, udata);
+    EV_SET(&changes[1], hSocket, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, udata);
+    return kevent(event_fd, changes, is_node ? 2 : 1, nullptr, 0, nullptr) == 0;
+#endif
+}
+
+void CConnman::SocketEventsFromQueue(SocketShard& shard, std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+    // Nodes are reported edge-triggered, so whether their socket can be read
+    // or written is remembered in the node until a call would block. Only wait
+    // for new events if none of them could make progress last time.
+    const int timeout = shard.m_work_pending ? 0 : SOCKET_EVENTS_TIMEOUT_MILLISECONDS;
+#ifdef USE_EPOLL
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    int nEvents = epoll_wait(shard.m_event_fd, events, MAX_SOCKET_EVENTS, timeout);
+#else
+    struct kevent events[MAX_SOCKET_EVENTS];
+    struct timespec ts;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+    int nEvents = kevent(shard.m_event_fd, nullptr, 0, events, MAX_SOCKET_EVENTS, &ts);
+#endif
+
+    if (interruptNet) return;
+
+    if (nEvents < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket event queue error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+            return;
+        }
+        nEvents = 0;
+    }
+
+    std::set<NodeId> readable, writable;
+    bool listen_ready = false;
+    for (int i = 0; i < nEvents; i++) {
+#ifdef USE_EPOLL
+        const NodeId tag = static_cast<NodeId>(events[i].data.u64);
+        const bool can_read = (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) != 0;
+        const bool can_write = (events[i].events & EPOLLOUT) != 0;
+#else
+        const NodeId tag = static_cast<NodeId>(reinterpret_cast<intptr_t>(events[i].udata));
+        const bool can_read = events[i].filter == EVFILT_READ || (events[i].flags & EV_ERROR) != 0;
+        const bool can_write = events[i].filter == EVFILT_WRITE;
+#endif
+        if (tag == SOCKET_EVENT_WAKEUP) {
+            char buf[64];
+            while (read(shard.m_wakeup_pipe[0], buf, sizeof(buf)) > 0) {}
+        } else if (tag == SOCKET_EVENT_LISTEN) {
+            listen_ready = true;
+        } else {
+            // Tags of nodes that are gone are never matched, as node ids are not reused
+            if (can_read) readable.insert(tag);
+            if (can_write) writable.insert(tag);
+        }
+    }
+
+    if (listen_ready) {
+        // Listen sockets are level-triggered, and a socket without a pending
+        // connection just fails the accept with WSAEWOULDBLOCK
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            recv_set.insert(hListenSocket.socket);
+        }
+    }
+
+    bool work_pending = false;
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            if (&GetSocketShard(pnode) != &shard) continue;
+            if (readable.count(pnode->GetId())) pnode->m_sock_readable = true;
+            if (writable.count(pnode->GetId())) pnode->m_sock_writable = true;
+            if (!pnode->m_sock_readable && !pnode->m_sock_writable) continue;
+
+            // The same logic as in GenerateSelectSet: drain the send buffer
+            // before receiving more.
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            if (select_send) {
+                if (pnode->m_sock_writable) {
+                    send_set.insert(pnode->hSocket);
+                    work_pending = true;
+                }
+                continue;
+            }
+            if (!pnode->fPauseRecv && pnode->m_sock_readable) {
+                recv_set.insert(pnode->hSocket);
+                work_pending = true;
+            }
+        }
+    }
+    shard.m_work_pending = work_pending;
+}
+#endif
+
+void CConnman::StartSocketEvents()
+{
+    m_socket_shards.resize(1);
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    bool fSuccess = true;
+    m_socket_shards.resize(m_net_threads);
+    for (size_t i = 0; i < m_socket_shards.size() && fSuccess; i++) {
+        SocketShard& shard = m_socket_shards[i];
+#ifdef USE_EPOLL
+        shard.m_event_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+        shard.m_event_fd = kqueue();
+#endif
+        fSuccess = shard.m_event_fd != -1 &&
+            pipe(shard.m_wakeup_pipe) == 0 &&
+            fcntl(shard.m_wakeup_pipe[0], F_SETFL, O_NONBLOCK) != -1 &&
+            fcntl(shard.m_wakeup_pipe[1], F_SETFL, O_NONBLOCK) != -1 &&
+            AddSocketEvents(shard.m_event_fd, shard.m_wakeup_pipe[0], SOCKET_EVENT_WAKEUP);
+    }
+    // Only the first shard accepts connections
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        fSuccess = fSuccess && AddSocketEvents(m_socket_shards[0].m_event_fd, hListenSocket.socket, SOCKET_EVENT_LISTEN);
+    }
+    if (!fSuccess) {
+        LogPrintf("Failed to set up socket event queue, polling sockets instead: %s\n", NetworkErrorString(WSAGetLastError()));
+        StopSocketEvents();
+        m_socket_shards.resize(1);
+    }
+#endif
+    if (m_socket_shards.size() < (size_t)m_net_threads) {
+        LogPrintf("Sockets can only be shared out to several threads with a socket event queue, using one network thread\n");
+    }
+    for (size_t i = 0; i < m_socket_shards.size(); i++) {
+        m_socket_shards[i].m_thread_name = i == 0 ? "net" : strprintf("net.%d", i);
+    }
+}
+
+void CConnman::StopSocketEvents()
+{
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    for (SocketShard& shard : m_socket_shards) {
+        for (int fd : shard.m_wakeup_pipe) {
+            if (fd != -1) close(fd);
+        }
+        if (shard.m_event_fd != -1) close(shard.m_event_fd);
+    }
+#endif
+    m_socket_shards.clear();
+}
+
+CConnman::SocketShard& CConnman::GetSocketShard(const CNode* pnode)
+{
+    return m_socket_shards[pnode->GetId() % m_socket_shards.size()];
+}
+
+void CConnman::RegisterSocket(CNode* pnode)
+{
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    // Called once the node is in vNodes, so that SocketEventsFromQueue finds
+    // it for the first events of its socket
+    if (m_socket_shards.empty()) return;
+    const SocketShard& shard = GetSocketShard(pnode);
+    if (shard.m_event_fd == -1) return;
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET) return;
+    if (!AddSocketEvents(shard.m_event_fd, pnode->hSocket, pnode->GetId())) {
+        LogPrintf("Failed to register socket of peer=%d: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
+void CConnman::WakeSocketShard(const SocketShard& shard)
+{
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    if (shard.m_wakeup_pipe[1] == -1) return;
+    const char c = 0;
+    if (write(shard.m_wakeup_pipe[1], &c, 1) < 0) {
+        // The pipe is full, so the socket handler wakes up anyway
+    }
+#endif
+}
+
+void CConnman::WakeSocketHandler(const CNode* pnode)
+{
+    if (m_socket_shards.empty()) return;
+    WakeSocketShard(GetSocketShard(pnode));
+}
+
+void CConnman::SocketHandler(SocketShard& shard)
 {
     std::set<SOCKET> recv_set, send_set, error_set;
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    if (shard.m_event_fd != -1) {
+        SocketEventsFromQueue(shard, recv_set, send_set, error_set);
+    } else
+#endif
     SocketEvents(recv_set, send_set, error_set);
 
     if (interruptNet) return;
@@ -1348,9 +1734,11 @@ void CConnman::SocketHandler()
     std::vector<CNode*> vNodesCopy;
     {
         LOCK(cs_vNodes);
-        vNodesCopy = vNodes;
-        for (CNode* pnode : vNodesCopy)
+        for (CNode* pnode : vNodes) {
+            if (&GetSocketShard(pnode) != &shard) continue;
+            vNodesCopy.push_back(pnode);
             pnode->AddRef();
+        }
     }
     for (CNode* pnode : vNodesCopy)
     {
@@ -1417,6 +1805,10 @@ void CConnman::SocketHandler()
             {
                 // error
                 int nErr = WSAGetLastError();
+                if (nErr == WSAEWOULDBLOCK) {
+                    // Nothing left to read until the socket event queue reports more
+                    pnode->m_sock_readable = false;
+                }
                 if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                 {
                     if (!pnode->fDisconnect) {
@@ -1437,6 +1829,10 @@ void CConnman::SocketHandler()
             if (nBytes) {
                 RecordBytesSent(nBytes);
             }
+            // What is left did not fit in the socket buffer
+            if (!pnode->vSendMsg.empty()) {
+                pnode->m_sock_writable = false;
+            }
         }
 
         InactivityCheck(pnode);
@@ -1448,13 +1844,17 @@ void CConnman::SocketHandler()
     }
 }
 
-void CConnman::ThreadSocketHandler()
+void CConnman::ThreadSocketHandler(SocketShard& shard)
 {
+    // The first shard also keeps vNodes and the connection count up to date
+    const bool fFirst = &shard == &m_socket_shards[0];
     while (!interruptNet)
     {
-        DisconnectNodes();
-        NotifyNumConnectionsChanged();
-        SocketHandler();
+        if (fFirst) {
+            DisconnectNodes();
+            NotifyNumConnectionsChanged();
+        }
+        SocketHandler(shard);
     }
 }
 
@@ -2018,6 +2418,7 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        RegisterSocket(pnode);
     }
 }
 
@@ -2325,7 +2726,10 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     }
 
     // Send and receive from sockets, accept connections
-    threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
+    StartSocketEvents();
+    for (SocketShard& shard : m_socket_shards) {
+        shard.m_thread = std::thread(&TraceThread<std::function<void()> >, shard.m_thread_name.c_str(), std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this, std::ref(shard))));
+    }
 
     if (!gArgs.GetBoolArg("-dnsseed", true))
         LogPrintf("DNS seeding disabled\n");
@@ -2379,6 +2783,9 @@ void CConnman::Interrupt()
     condMsgProc.notify_all();
 
     interruptNet();
+    for (const SocketShard& shard : m_socket_shards) {
+        WakeSocketShard(shard);
+    }
     InterruptSocks5(true);
 
     if (semOutbound) {
@@ -2404,17 +2811,22 @@ void CConnman::StopThreads()
         threadOpenAddedConnections.join();
     if (threadDNSAddressSeed.joinable())
         threadDNSAddressSeed.join();
-    if (threadSocketHandler.joinable())
-        threadSocketHandler.join();
+    for (SocketShard& shard : m_socket_shards) {
+        if (shard.m_thread.joinable())
+            shard.m_thread.join();
+    }
 }
 
-void CConnman::StopNodes()
+void CConnman::FlushAddresses()
 {
     if (fAddressesInitialized) {
         DumpAddresses();
         fAddressesInitialized = false;
     }
+}
 
+void CConnman::StopNodes()
+{
     // Close sockets
     LOCK(cs_vNodes);
     for (CNode* pnode : vNodes)
@@ -2434,6 +2846,7 @@ void CConnman::StopNodes()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+    StopSocketEvents();
     semOutbound.reset();
     semAddnode.reset();
 }
@@ -2453,6 +2866,20 @@ CConnman::~CConnman()
 {
     Interrupt();
     Stop();
+    ReleaseDecodedAsmap(addrman.m_asmap);
+}
+
+void CConnman::SetAsmap(std::vector<bool> asmap)
+{
+    ReleaseDecodedAsmap(addrman.m_asmap);
+    addrman.m_asmap = std::move(asmap);
+    if (addrman.m_asmap.empty()) return;
+    const int64_t start = GetTimeMillis();
+    if (UseDecodedAsmap(addrman.m_asmap)) {
+        LogPrint(BCLog::NET, "Decoded asmap for lookups %dms\n", GetTimeMillis() - start);
+    } else {
+        LogPrintf("Could not decode asmap for faster lookups, interpreting it instead\n");
+    }
 }
 
 size_t CConnman::GetAddressCount() const
@@ -2465,6 +2892,16 @@ void CConnman::SetServices(const CService &addr, ServiceFlags nServices)
     addrman.SetServices(addr, nServices);
 }
 
+void CConnman::SetAddressPerformance(const CService& addr, int64_t ping_usec, int64_t block_download_usec)
+{
+    addrman.SetPerformance(addr, ping_usec, block_download_usec);
+}
+
+int64_t CConnman::GetAddressBlockDownloadTime(const CService& addr)
+{
+    return addrman.GetBlockDownloadTime(addr);
+}
+
 void CConnman::MarkAddressGood(const CAddress& addr)
 {
     addrman.Good(addr);
@@ -2743,13 +3180,18 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    size_t nMessageSize = msg.PayloadSize();
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command), nMessageSize, pnode->GetId());
 
     // make sure we use the appropriate network transport format
     std::vector<unsigned char> serializedHeader;
     pnode->m_serializer->prepareForTransport(msg, serializedHeader);
     size_t nTotalSize = nMessageSize + serializedHeader.size();
+    NetBytesSentPerMsgType().Add(msg.command, nTotalSize);
+    TRACE3(net, outbound_message,
+           pnode->GetId(),
+           msg.command.c_str(),
+           nTotalSize);
 
     size_t nBytesSent = 0;
     {
@@ -2762,9 +3204,14 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.emplace_back(std::move(serializedHeader));
+        if (nMessageSize) {
+            if (msg.shared_payload) {
+                pnode->vSendMsg.emplace_back(std::move(msg.shared_payload));
+            } else {
+                pnode->vSendMsg.emplace_back(std::move(msg.data));
+            }
+        }
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -2800,7 +3247,7 @@ int64_t CConnman::PoissonNextSendInbound(int64_t now, int average_interval_secon
 
 int64_t PoissonNextSend(int64_t now, int average_interval_seconds)
 {
-    return now + (int64_t)(log1p(GetRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) * average_interval_seconds * -1000000.0 + 0.5);
+    return now + (int64_t)(log1p(GetFastRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) * average_interval_seconds * -1000000.0 + 0.5);
 }
 
 CSipHasher CConnman::GetDeterministicRandomizer(uint64_t id) const
@@ -85,6 +85,10 @@ static const uint64_t MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
 static const bool DEFAULT_BLOCKSONLY = false;
 /** -peertimeout default */
 static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
+/** -netthreads default */
+static const int DEFAULT_NET_THREADS = 1;
+/** Maximum number of socket handler threads */
+static const int MAX_NET_THREADS = 16;
 
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
@@ -103,6 +107,19 @@ struct AddedNodeInfo
 class CNodeStats;
 class CClientUIInterface;
 
+/**
+ * A message payload serialized once, so that it can be queued to many peers
+ * without copying it, e.g. a block or a compact block.
+ */
+struct CSharedNetPayload
+{
+    const std::vector<unsigned char> data;
+    //! The double-SHA256 of data, which the message checksum is taken from
+    const uint256 hash;
+
+    explicit CSharedNetPayload(std::vector<unsigned char>&& data_in);
+};
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -112,8 +129,28 @@ struct CSerializedNetMsg
     CSerializedNetMsg(const CSerializedNetMsg& msg) = delete;
     CSerializedNetMsg& operator=(const CSerializedNetMsg&) = delete;
 
+    CSerializedNetMsg(std::string command_in, std::shared_ptr<const CSharedNetPayload> payload)
+        : command(std::move(command_in)), shared_payload(std::move(payload)) {}
+
     std::vector<unsigned char> data;
     std::string command;
+    //! When set, the payload of the message instead of data
+    std::shared_ptr<const CSharedNetPayload> shared_payload;
+
+    size_t PayloadSize() const { return shared_payload ? shared_payload->data.size() : data.size(); }
+};
+
+/** Bytes queued for sending to a peer: owned by the queue, or a payload shared with other peers. */
+struct CSendBuffer
+{
+    std::vector<unsigned char> owned;
+    std::shared_ptr<const CSharedNetPayload> shared;
+
+    explicit CSendBuffer(std::vector<unsigned char>&& data) : owned(std::move(data)) {}
+    explicit CSendBuffer(std::shared_ptr<const CSharedNetPayload> payload) : shared(std::move(payload)) {}
+
+    const unsigned char* data() const { return shared ? shared->data.data() : owned.data(); }
+    size_t size() const { return shared ? shared->data.size() : owned.size(); }
 };
 
 
@@ -146,6 +183,7 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        int m_net_threads = DEFAULT_NET_THREADS;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
         std::vector<NetWhitebindPermissions> vWhiteBinds;
@@ -172,6 +210,7 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_net_threads = std::max(1, std::min(connOptions.m_net_threads, MAX_NET_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -190,10 +229,13 @@ public:
 
     void StopThreads();
     void StopNodes();
+    //! Write peers.dat a last time, once the nodes are stopped
+    void FlushAddresses();
     void Stop()
     {
         StopThreads();
         StopNodes();
+        FlushAddresses();
     };
 
     void Interrupt();
@@ -252,6 +294,8 @@ public:
     // Addrman functions
     size_t GetAddressCount() const;
     void SetServices(const CService &addr, ServiceFlags nServices);
+    void SetAddressPerformance(const CService& addr, int64_t ping_usec, int64_t block_download_usec);
+    int64_t GetAddressBlockDownloadTime(const CService& addr);
     void MarkAddressGood(const CAddress& addr);
     void AddNewAddresses(const std::vector<CAddress>& vAddr, const CAddress& addrFrom, int64_t nTimePenalty = 0);
     std::vector<CAddress> GetAddresses();
@@ -322,15 +366,33 @@ public:
 
     void WakeMessageHandler();
 
+    /** Wake the socket handler of a node from its socket event queue, e.g. when the node is no longer paused. */
+    void WakeSocketHandler(const CNode* pnode);
+
     /** Attempts to obfuscate tx time through exponentially distributed emitting.
         Works assuming that a single interval is used.
         Variable intervals will result in privacy decrease.
     */
     int64_t PoissonNextSendInbound(int64_t now, int average_interval_seconds);
 
-    void SetAsmap(std::vector<bool> asmap) { addrman.m_asmap = std::move(asmap); }
+    void SetAsmap(std::vector<bool> asmap);
 
 private:
+    /** A socket handler thread, with the event queue of the nodes it serves. */
+    struct SocketShard {
+        std::string m_thread_name;
+        std::thread m_thread;
+        /**
+         * The epoll or kqueue instance the sockets stay registered with, or -1
+         * when SocketEvents polls them instead.
+         */
+        int m_event_fd{-1};
+        //! Pipe whose read end wakes SocketEventsFromQueue
+        int m_wakeup_pipe[2]{-1, -1};
+        //! Whether a node could be read or written after the last SocketEventsFromQueue
+        bool m_work_pending{false};
+    };
+
     struct ListenSocket {
     public:
         SOCKET socket;
@@ -354,8 +416,16 @@ private:
     void InactivityCheck(CNode *pnode);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
-    void SocketHandler();
-    void ThreadSocketHandler();
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    void SocketEventsFromQueue(SocketShard& shard, std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#endif
+    void StartSocketEvents();
+    void StopSocketEvents();
+    SocketShard& GetSocketShard(const CNode* pnode);
+    void RegisterSocket(CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_vNodes);
+    void WakeSocketShard(const SocketShard& shard);
+    void SocketHandler(SocketShard& shard);
+    void ThreadSocketHandler(SocketShard& shard);
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
@@ -465,8 +535,16 @@ private:
 
     CThreadInterrupt interruptNet;
 
+    //! The number of socket handler threads the nodes are shared out to
+    int m_net_threads{DEFAULT_NET_THREADS};
+
+    /**
+     * Socket handler threads, each serving the nodes whose id modulo the
+     * number of threads is its index. Fixed while the threads run.
+     */
+    std::vector<SocketShard> m_socket_shards;
+
     std::thread threadDNSAddressSeed;
-    std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
@@ -625,6 +703,10 @@ public:
     std::string m_command;
 
     CNetMessage(CDataStream&& recv_in) : m_recv(std::move(recv_in)) {}
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+    //! Gives the payload buffer back for reuse by later messages
+    ~CNetMessage();
 
     void SetVersion(int nVersionIn)
     {
@@ -660,10 +742,12 @@ private:
     CDataStream vRecv;              // received message data
     unsigned int nHdrPos;
     unsigned int nDataPos;
+    bool check_block_header;        // block message whose header is yet to be checked
 
     const uint256& GetMessageHash() const;
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+    bool checkBlockHeader();
 
     void Reset() {
         vRecv.clear();
@@ -672,6 +756,7 @@ private:
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
+        check_block_header = false;
         data_hash.SetNull();
         hasher.Reset();
     }
@@ -731,7 +816,7 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<CSendBuffer> vSendMsg GUARDED_BY(cs_vSend);
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -784,6 +869,10 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
+    // Whether the socket can be read or written, as last reported by the
+    // edge-triggered socket event queue. Only used by the socket handler.
+    bool m_sock_readable{true};
+    bool m_sock_writable{true};
 
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -889,7 +978,7 @@ private:
     const int nMyStartingHeight;
     int nSendVersion{0};
     NetPermissionFlags m_permissionFlags{ PF_NONE };
-    std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
+    std::list<CNetMessage> vRecvMsg;  // Used only by the SocketHandler thread of the node
 
     mutable RecursiveMutex cs_addrName;
     std::string addrName GUARDED_BY(cs_addrName);
@@ -8,9 +8,13 @@
 #include <addrman.h>
 #include <banman.h>
 #include <blockencodings.h>
+#include <blockfilter.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
+#include <headerssync.h>
+#include <index/blockfilterindex.h>
+#include <logging/timer.h>
 #include <validation.h>
 #include <merkleblock.h>
 #include <netmessagemaker.h>
@@ -24,11 +28,20 @@
 #include <scheduler.h>
 #include <tinyformat.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
 #include <util/system.h>
 #include <util/strencodings.h>
+#include <util/threadnames.h>
+#include <util/trace.h>
 
+#include <deque>
+#include <functional>
 #include <memory>
 #include <typeinfo>
+#include <unordered_map>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
 #if defined(NDEBUG)
 # error "LitecoinZ cannot be compiled without assertions."
@@ -44,6 +57,8 @@ static constexpr std::chrono::seconds RELAY_TX_CACHE_TIME{15 * 60};
  *  Timeout = base + per_header * (expected number of headers) */
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER = 1000; // 1ms/header
+/** A peer downloading a range of headers that does not answer a GETHEADERS this long gets no more ranges. */
+static constexpr std::chrono::seconds HEADERS_RANGE_TIMEOUT{60};
 /** Protect at least this many outbound peers from disconnection due to slow/
  * behind headers chain.
  */
@@ -80,6 +95,15 @@ static_assert(INBOUND_PEER_TX_DELAY >= MAX_GETDATA_RANDOM_DELAY,
 "To preserve security, MAX_GETDATA_RANDOM_DELAY should not exceed INBOUND_PEER_DELAY");
 /** Limit to avoid sending big packets. Not used in processing incoming GETDATA for compatibility */
 static const unsigned int MAX_GETDATA_SZ = 1000;
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static constexpr uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static constexpr uint32_t MAX_GETCFHEADERS_SIZE = 2000;
+/** How long the blocks in flight from a peer should take it to deliver, once its download speed is measured. */
+static constexpr int64_t BLOCK_DOWNLOAD_TARGET_TIME = 4 * 1000000; // 4 seconds
+/** Fewest and most blocks in flight from a peer whose download speed is measured. */
+static constexpr int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static constexpr int MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER = 64;
 
 
 struct COrphanTx {
@@ -88,14 +112,17 @@ struct COrphanTx {
     NodeId fromPeer;
     int64_t nTimeExpire;
     size_t list_pos;
+    //! The serialized size of tx, which counts against -maxorphansize
+    unsigned int tx_size;
 };
+typedef std::unordered_map<uint256, COrphanTx, SaltedTxidHasher> OrphanMap;
 RecursiveMutex g_cs_orphans;
-std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
+OrphanMap mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 
 void EraseOrphansFor(NodeId peer);
 
 /** Increase a node's misbehavior score. */
-void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="") EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="");
 
 /** Average delay between local address broadcasts */
 static constexpr std::chrono::hours AVG_LOCAL_ADDRESS_BROADCAST_INTERVAL{24};
@@ -107,16 +134,31 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static constexpr unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Average delay between the rounds of transaction reconciliation an initiator starts with a peer. */
+static constexpr std::chrono::seconds RECON_REQUEST_INTERVAL{4};
+/** How long an initiator waits for the sketch of a round before giving up on it. */
+static constexpr std::chrono::seconds RECON_RESPONSE_TIMEOUT{60};
 /** Average delay between feefilter broadcasts in seconds. */
 static constexpr unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
 static constexpr unsigned int MAX_FEEFILTER_CHANGE_DELAY = 5 * 60;
+/** Most bytes of data elements of relayed transactions kept for matching against the bloom filters of peers. */
+static constexpr size_t MAX_BLOOM_TX_ELEMENTS_USAGE = 4 * 1024 * 1024;
+/** Number of recently requested blocks kept prepared for building the merkleblocks of filtered peers. */
+static constexpr size_t MAX_FILTERABLE_BLOCKS = 4;
 
 // Internal stuff
 namespace {
     /** Number of nodes with fSyncStarted. */
     int nSyncStarted GUARDED_BY(cs_main) = 0;
 
+    /** The parallel download of the headers between checkpoints, while in progress. */
+    std::unique_ptr<HeadersRangeSync> g_headers_range_sync GUARDED_BY(cs_main);
+    /** Whether the parallel headers download was started, which happens once. */
+    bool g_headers_range_sync_started GUARDED_BY(cs_main) = false;
+    /** The number of peers downloading ranges of headers at once, at most. */
+    unsigned int g_max_headers_sync_peers GUARDED_BY(cs_main) = 0;
+
     /**
      * Sources of received blocks, saved to be able punish them when processing
      * happens afterwards.
@@ -144,8 +186,8 @@ namespace {
      *
      * Memory used: 1.3 MB
      */
-    std::unique_ptr<CRollingBloomFilter> recentRejects GUARDED_BY(cs_main);
-    uint256 hashRecentRejectsChainTip GUARDED_BY(cs_main);
+    Mutex g_cs_recent_rejects;
+    std::unique_ptr<CRollingBloomFilter> recentRejects GUARDED_BY(g_cs_recent_rejects);
 
     /*
      * Filter for transactions that have been recently confirmed.
@@ -161,6 +203,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        bool fRerequested;                                       //!< Whether this block was taken over from a stalling peer.
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight GUARDED_BY(cs_main);
 
@@ -185,22 +228,97 @@ namespace {
     /** Expiration-time ordered list of (expire time, relay map entry) pairs. */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration GUARDED_BY(cs_main);
 
-    struct IteratorComparator
+    // The entries of mapOrphanTransactions are referred to by pointer, which
+    // unlike its iterators stay valid when it is rehashed.
+    std::unordered_multimap<COutPoint, OrphanMap::value_type*, SaltedOutpointHasher> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
+
+    std::vector<OrphanMap::value_type*> g_orphan_list GUARDED_BY(g_cs_orphans); //! For random eviction
+    //! The sum of the sizes of the orphan transactions
+    size_t g_orphan_bytes GUARDED_BY(g_cs_orphans) = 0;
+
+    static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
+    //! Shielded txn are kept after the others in vExtraTxnForCompact
+    static size_t vExtraShieldedTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
+    static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(g_cs_orphans);
+
+    /** A transaction received from a peer, queued for or done with pre-validation. */
+    struct TxPreValidation {
+        const CTransactionRef m_tx;
+        //! The result of PreCheckTransaction(), only to be read once m_done is set
+        TxValidationState m_state;
+        std::atomic<bool> m_done{false};
+
+        explicit TxPreValidation(const CTransactionRef& tx) : m_tx(tx) {}
+    };
+
+    /**
+     * Queue of the transactions with shielded proofs received from peers, for
+     * the pre-validation threads to verify the proofs in. Only the peer that
+     * sent a transaction waits for its proofs, not every peer, as it would if
+     * the message handler verified them.
+     */
+    class TxPreValidationQueue
     {
-        template<typename I>
-        bool operator()(const I& a, const I& b) const
+    private:
+        boost::mutex m_mutex;
+        boost::condition_variable m_cond;
+        std::deque<std::shared_ptr<TxPreValidation>> m_queue;
+        //! The number of running threads. Without any, the message handler
+        //! verifies the proofs itself.
+        int m_workers{0};
+        //! Called whenever a pre-validation is done
+        std::function<void()> m_notify;
+
+    public:
+        void SetNotify(std::function<void()> notify)
         {
-            return &(*a) < &(*b);
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            m_notify = std::move(notify);
         }
-    };
-    std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
 
-    std::vector<std::map<uint256, COrphanTx>::iterator> g_orphan_list GUARDED_BY(g_cs_orphans); //! For random eviction
+        /** Queue a transaction, or return nullptr when there are no threads. */
+        std::shared_ptr<TxPreValidation> Submit(const CTransactionRef& tx)
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            if (m_workers == 0) return nullptr;
+            auto prevalidation = std::make_shared<TxPreValidation>(tx);
+            m_queue.push_back(prevalidation);
+            m_cond.notify_one();
+            return prevalidation;
+        }
 
-    static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
-    static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(g_cs_orphans);
+        void Thread()
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+            m_workers++;
+            try {
+                while (true) {
+                    while (m_queue.empty()) {
+                        m_cond.wait(lock);
+                    }
+                    std::shared_ptr<TxPreValidation> prevalidation = std::move(m_queue.front());
+                    m_queue.pop_front();
+                    lock.unlock();
+                    PreCheckTransaction(*prevalidation->m_tx, prevalidation->m_state);
+                    prevalidation->m_done = true;
+                    lock.lock();
+                    if (m_notify) m_notify();
+                }
+            } catch (const boost::thread_interrupted&) {
+                m_workers--;
+                throw;
+            }
+        }
+    };
+    TxPreValidationQueue g_tx_prevalidation_queue;
 } // namespace
 
+void ThreadTxPreValidation(int worker_num)
+{
+    util::ThreadRename(strprintf("txprecheck.%i", worker_num));
+    g_tx_prevalidation_queue.Thread();
+}
+
 namespace {
 /**
  * Maintain validation-specific state about nodes, protected by cs_main, instead
@@ -213,10 +331,6 @@ struct CNodeState {
     const CService address;
     //! Whether we have a fully established connection.
     bool fCurrentlyConnected;
-    //! Accumulated misbehaviour score for this peer.
-    int nMisbehavior;
-    //! Whether this peer should be disconnected and marked as discouraged (unless whitelisted with noban).
-    bool m_should_discourage;
     //! String name of this peer (debugging/logging purposes).
     const std::string name;
     //! The best known block we know this peer has announced.
@@ -231,6 +345,10 @@ struct CNodeState {
     int nUnconnectingHeaders;
     //! Whether we've started headers synchronization with this peer.
     bool fSyncStarted;
+    //! Whether this peer failed to send a range of headers, and gets no more.
+    bool m_headers_range_failed;
+    //! The presync of the headers chain of this peer, while it is not known to have enough work to be stored.
+    std::unique_ptr<HeadersPresync> m_headers_presync;
     //! When to potentially disconnect peer for stalling headers download
     int64_t nHeadersSyncTimeout;
     //! Since when we're stalling block download progress (in microseconds), or 0.
@@ -240,8 +358,21 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Moving average of the time this peer takes per block (in microseconds), or 0 before the first block.
+    int64_t m_block_download_time;
+    //! Compact blocks from this peer that we tried to reconstruct, and how many of those needed no round trip.
+    uint64_t m_cmpctblocks_received;
+    uint64_t m_cmpctblocks_reconstructed;
+    //! Transactions in those compact blocks, and how many of them we had to request.
+    uint64_t m_cmpctblock_txn;
+    uint64_t m_cmpctblock_txn_missing;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether we sent SENDRECON, with m_recon_salt, to this peer.
+    bool m_recon_offered;
+    uint64_t m_recon_salt;
+    //! Reconciliation state, once both sides sent SENDRECON.
+    std::unique_ptr<TxReconciliationState> m_recon;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
     bool fPreferHeaders;
     //! Whether this peer wants invs or cmpctblocks (when possible) for block announcements.
@@ -292,13 +423,78 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement;
 
+    //! Whether this peer is an inbound connection
+    bool m_is_inbound;
+
+    //! Whether this peer is a manual connection
+    bool m_is_manual_connection;
+
+    CNodeState(CAddress addrIn, std::string addrNameIn, bool is_inbound, bool is_manual) :
+        address(addrIn), name(std::move(addrNameIn)), m_is_inbound(is_inbound),
+        m_is_manual_connection (is_manual)
+    {
+        fCurrentlyConnected = false;
+        pindexBestKnownBlock = nullptr;
+        hashLastUnknownBlock.SetNull();
+        pindexLastCommonBlock = nullptr;
+        pindexBestHeaderSent = nullptr;
+        nUnconnectingHeaders = 0;
+        fSyncStarted = false;
+        m_headers_range_failed = false;
+        nHeadersSyncTimeout = 0;
+        nStallingSince = 0;
+        nDownloadingSince = 0;
+        nBlocksInFlight = 0;
+        nBlocksInFlightValidHeaders = 0;
+        m_block_download_time = 0;
+        m_cmpctblocks_received = 0;
+        m_cmpctblocks_reconstructed = 0;
+        m_cmpctblock_txn = 0;
+        m_cmpctblock_txn_missing = 0;
+        fPreferredDownload = false;
+        m_recon_offered = false;
+        m_recon_salt = 0;
+        fPreferHeaders = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
+        fHaveWitness = false;
+        fWantsCmpctWitness = false;
+        fSupportsDesiredCmpctVersion = false;
+        m_chain_sync = { 0, nullptr, false, false };
+        m_last_block_announcement = 0;
+    }
+};
+
+/**
+ * The state of a peer that the handling of messages unrelated to validation
+ * needs. Unlike CNodeState it is not protected by cs_main: each part has its
+ * own lock, so that PING, ADDR and transaction INV messages do not contend
+ * with validation for cs_main.
+ *
+ * Peers are kept by NodeId, like CNodeState, as misbehaviour is also reported
+ * for peers that sent a block once validation is done with it. Lookups only
+ * take g_peer_mutex briefly, and the shared pointer keeps the Peer alive for
+ * as long as the caller uses it.
+ */
+struct Peer {
+    const NodeId m_id;
+
+    Mutex m_misbehavior_mutex;
+    //! Accumulated misbehaviour score for this peer.
+    int m_misbehavior_score GUARDED_BY(m_misbehavior_mutex){0};
+    //! Whether this peer should be disconnected and marked as discouraged (unless whitelisted with noban).
+    bool m_should_discourage GUARDED_BY(m_misbehavior_mutex){false};
+
+    //! A copy of CNodeState::fPreferredDownload.
+    std::atomic<bool> m_preferred_download{false};
+
     /*
      * State associated with transaction download.
      *
      * Tx download algorithm:
      *
      *   When inv comes in, queue up (process_time, txid) inside the peer's
-     *   CNodeState (m_tx_process_time) as long as m_tx_announced for the peer
+     *   Peer (m_tx_process_time) as long as m_tx_announced for the peer
      *   isn't too big (MAX_PEER_TX_ANNOUNCEMENTS).
      *
      *   The process_time for a transaction is set to nNow for outbound peers,
@@ -353,46 +549,34 @@ struct CNodeState {
         std::chrono::microseconds m_check_expiry_timer{0};
     };
 
-    TxDownloadState m_tx_download;
+    //! Taken after g_cs_orphans, and before the locks AlreadyHave() takes.
+    Mutex m_tx_download_mutex;
+    TxDownloadState m_tx_download GUARDED_BY(m_tx_download_mutex);
 
-    //! Whether this peer is an inbound connection
-    bool m_is_inbound;
+    Mutex m_tx_prevalidation_mutex;
+    //! The last transaction from this peer, while its proofs are verified.
+    //! The peer's next messages are processed after it.
+    std::shared_ptr<TxPreValidation> m_tx_prevalidation GUARDED_BY(m_tx_prevalidation_mutex);
 
-    //! Whether this peer is a manual connection
-    bool m_is_manual_connection;
-
-    CNodeState(CAddress addrIn, std::string addrNameIn, bool is_inbound, bool is_manual) :
-        address(addrIn), name(std::move(addrNameIn)), m_is_inbound(is_inbound),
-        m_is_manual_connection (is_manual)
-    {
-        fCurrentlyConnected = false;
-        nMisbehavior = 0;
-        m_should_discourage = false;
-        pindexBestKnownBlock = nullptr;
-        hashLastUnknownBlock.SetNull();
-        pindexLastCommonBlock = nullptr;
-        pindexBestHeaderSent = nullptr;
-        nUnconnectingHeaders = 0;
-        fSyncStarted = false;
-        nHeadersSyncTimeout = 0;
-        nStallingSince = 0;
-        nDownloadingSince = 0;
-        nBlocksInFlight = 0;
-        nBlocksInFlightValidHeaders = 0;
-        fPreferredDownload = false;
-        fPreferHeaders = false;
-        fPreferHeaderAndIDs = false;
-        fProvidesHeaderAndIDs = false;
-        fHaveWitness = false;
-        fWantsCmpctWitness = false;
-        fSupportsDesiredCmpctVersion = false;
-        m_chain_sync = { 0, nullptr, false, false };
-        m_last_block_announcement = 0;
-    }
+    explicit Peer(NodeId id) : m_id(id) {}
 };
 
+using PeerRef = std::shared_ptr<Peer>;
+
+Mutex g_peer_mutex;
+/** Map maintaining the Peer of each node. */
+std::map<NodeId, PeerRef> g_peer_map GUARDED_BY(g_peer_mutex);
+
+static PeerRef GetPeerRef(NodeId id)
+{
+    LOCK(g_peer_mutex);
+    auto it = g_peer_map.find(id);
+    return it != g_peer_map.end() ? it->second : nullptr;
+}
+
 // Keeps track of the time (in microseconds) when transactions were requested last time
-limitedmap<uint256, std::chrono::microseconds> g_already_asked_for GUARDED_BY(cs_main)(MAX_INV_SZ);
+Mutex g_cs_already_asked_for;
+limitedmap<uint256, std::chrono::microseconds> g_already_asked_for GUARDED_BY(g_cs_already_asked_for)(MAX_INV_SZ);
 
 /** Map maintaining per-node state. */
 static std::map<NodeId, CNodeState> mapNodeState GUARDED_BY(cs_main);
@@ -404,12 +588,13 @@ static CNodeState *State(NodeId pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     return &it->second;
 }
 
-static void UpdatePreferredDownload(CNode* node, CNodeState* state) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+static void UpdatePreferredDownload(CNode* node, CNodeState* state, Peer& peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     nPreferredDownload -= state->fPreferredDownload;
 
     // Whether this node should be marked as a preferred download node.
     state->fPreferredDownload = (!node->fInbound || node->HasPermission(PF_NOBAN)) && !node->fOneShot && !node->fClient;
+    peer.m_preferred_download = state->fPreferredDownload;
 
     nPreferredDownload += state->fPreferredDownload;
 }
@@ -463,6 +648,69 @@ static bool MarkBlockAsReceived(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs
     return false;
 }
 
+/**
+ * Measure how long a peer took to deliver a block it was asked for. Only the
+ * front of its queue is measured, which nDownloadingSince is the start of:
+ * the time since its request, or since the previous block when the peer had
+ * more in flight. Returns the time measured, or 0.
+ */
+static int64_t RecordBlockDownloadTime(NodeId nodeid, const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid) return 0;
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    if (state->vBlocksInFlight.begin() != itInFlight->second.second) return 0;
+    const int64_t nTime = std::max<int64_t>(GetTimeMicros() - state->nDownloadingSince, 1);
+    state->m_block_download_time = state->m_block_download_time == 0 ? nTime : (state->m_block_download_time * 7 + nTime) / 8;
+    return nTime;
+}
+
+/** Announce the transactions a round of reconciliation found a peer lacks, or all of a round that failed. */
+static void AnnounceReconciledTxs(CNode* pto, const std::vector<uint256>& txids, const CTxMemPool& mempool, CConnman* connman)
+{
+    const CNetMsgMaker msgMaker(pto->GetSendVersion());
+    std::vector<CInv> vInv;
+    for (const uint256& txid : txids) {
+        if (!mempool.exists(txid)) continue;
+        vInv.push_back(CInv(MSG_TX, txid));
+        if (vInv.size() == MAX_INV_SZ) {
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+            vInv.clear();
+        }
+    }
+    if (!vInv.empty())
+        connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+}
+
+/** Count a compact block from a peer, of txn_count transactions of which txn_missing were neither prefilled nor known to us. */
+static void RecordCompactBlockReconstruction(CNodeState* state, size_t txn_count, size_t txn_missing) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    state->m_cmpctblocks_received++;
+    if (txn_missing == 0) state->m_cmpctblocks_reconstructed++;
+    state->m_cmpctblock_txn += txn_count;
+    state->m_cmpctblock_txn_missing += txn_missing;
+}
+
+/** How many blocks to keep in flight from a peer: as many as it takes BLOCK_DOWNLOAD_TARGET_TIME to deliver. */
+static int GetBlocksInFlightTarget(const CNodeState& state)
+{
+    if (state.m_block_download_time == 0) return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    const int64_t target = BLOCK_DOWNLOAD_TARGET_TIME / state.m_block_download_time;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(target, MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER));
+}
+
+/**
+ * Whether a peer should take over the block that holds back the download
+ * window from the staller it is in flight from: when the peer is measured to
+ * be more than twice as fast, or the staller has been downloading for twice
+ * as long as the peer takes per block.
+ */
+static bool ShouldTakeOverStalledBlock(const CNodeState& state, const CNodeState& staller, int64_t nNow)
+{
+    if (state.m_block_download_time == 0) return false;
+    if (staller.m_block_download_time > 2 * state.m_block_download_time) return true;
+    return nNow - staller.nDownloadingSince > 2 * state.m_block_download_time;
+}
+
 // returns false, still setting pit, if the block was already in flight from the same peer
 // pit will only be valid as long as the same cs_main lock is being held
 static bool MarkBlockAsInFlight(CTxMemPool& mempool, NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr, std::list<QueuedBlock>::iterator** pit = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
@@ -482,7 +730,7 @@ static bool MarkBlockAsInFlight(CTxMemPool& mempool, NodeId nodeid, const uint25
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), false});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -599,8 +847,9 @@ static bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex) EXCLUSIV
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+ *  at most count entries. If the window is full, set nodeStaller and pindexStalled to the peer and
+ *  the block that hold it back. */
+static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const CBlockIndex*& pindexStalled, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     if (count == 0)
         return;
@@ -637,6 +886,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex* pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -672,6 +922,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalled = pindexWaitingFor;
                     }
                     return;
                 }
@@ -682,18 +933,46 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
 }
 
-void EraseTxRequest(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+/** Add not-in-flight blocks the background chainstate of a UTXO snapshot needs, from just after its tip on towards the
+ *  snapshot base, to vBlocks, until it has at most count entries. Only the peer's blocks within the download window of
+ *  the background tip are asked for, as that is where it connects them. */
+static void FindNextBackgroundBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
+    if (!g_background_chainstate || vBlocks.size() >= count)
+        return;
+
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    const CBlockIndex* base = GetSnapshotBaseBlock();
+    if (state->pindexBestKnownBlock == nullptr || state->pindexBestKnownBlock->GetAncestor(base->nHeight) != base)
+        return;
+
+    const CBlockIndex* pindexFork = LastCommonAncestor(g_background_chainstate->m_chain.Tip(), base);
+    const int nMaxHeight = std::min<int>(base->nHeight, pindexFork->nHeight + BLOCK_DOWNLOAD_WINDOW);
+    for (int nHeight = pindexFork->nHeight + 1; nHeight <= nMaxHeight && vBlocks.size() < count; nHeight++) {
+        const CBlockIndex* pindex = base->GetAncestor(nHeight);
+        if (!State(nodeid)->fHaveWitness && IsWitnessEnabled(pindex->pprev, consensusParams))
+            return;
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) && mapBlocksInFlight.count(pindex->GetBlockHash()) == 0)
+            vBlocks.push_back(pindex);
+    }
+}
+
+void EraseTxRequest(const uint256& txid)
+{
+    LOCK(g_cs_already_asked_for);
     g_already_asked_for.erase(txid);
 }
 
-std::chrono::microseconds GetTxRequestTime(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+std::chrono::microseconds GetTxRequestTime(const uint256& txid)
 {
+    LOCK(g_cs_already_asked_for);
     auto it = g_already_asked_for.find(txid);
     if (it != g_already_asked_for.end()) {
         return it->second;
@@ -701,8 +980,9 @@ std::chrono::microseconds GetTxRequestTime(const uint256& txid) EXCLUSIVE_LOCKS_
     return {};
 }
 
-void UpdateTxRequestTime(const uint256& txid, std::chrono::microseconds request_time) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+void UpdateTxRequestTime(const uint256& txid, std::chrono::microseconds request_time)
 {
+    LOCK(g_cs_already_asked_for);
     auto it = g_already_asked_for.find(txid);
     if (it == g_already_asked_for.end()) {
         g_already_asked_for.insert(std::make_pair(txid, request_time));
@@ -711,7 +991,7 @@ void UpdateTxRequestTime(const uint256& txid, std::chrono::microseconds request_
     }
 }
 
-std::chrono::microseconds CalculateTxGetDataTime(const uint256& txid, std::chrono::microseconds current_time, bool use_inbound_delay) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+std::chrono::microseconds CalculateTxGetDataTime(const uint256& txid, std::chrono::microseconds current_time, bool use_inbound_delay)
 {
     std::chrono::microseconds process_time;
     const auto last_request_time = GetTxRequestTime(txid);
@@ -721,7 +1001,7 @@ std::chrono::microseconds CalculateTxGetDataTime(const uint256& txid, std::chron
     } else {
         // Randomize the delay to avoid biasing some peers over others (such as due to
         // fixed ordering of peer processing in ThreadMessageHandler)
-        process_time = last_request_time + GETDATA_TX_INTERVAL + GetRandMicros(MAX_GETDATA_RANDOM_DELAY);
+        process_time = last_request_time + GETDATA_TX_INTERVAL + GetFastRandMicros(MAX_GETDATA_RANDOM_DELAY);
     }
 
     // We delay processing announcements from inbound peers
@@ -730,9 +1010,10 @@ std::chrono::microseconds CalculateTxGetDataTime(const uint256& txid, std::chron
     return process_time;
 }
 
-void RequestTx(CNodeState* state, const uint256& txid, std::chrono::microseconds current_time) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+void RequestTx(Peer& peer, const uint256& txid, std::chrono::microseconds current_time)
 {
-    CNodeState::TxDownloadState& peer_download_state = state->m_tx_download;
+    LOCK(peer.m_tx_download_mutex);
+    Peer::TxDownloadState& peer_download_state = peer.m_tx_download;
     if (peer_download_state.m_tx_announced.size() >= MAX_PEER_TX_ANNOUNCEMENTS ||
             peer_download_state.m_tx_process_time.size() >= MAX_PEER_TX_ANNOUNCEMENTS ||
             peer_download_state.m_tx_announced.count(txid)) {
@@ -744,7 +1025,7 @@ void RequestTx(CNodeState* state, const uint256& txid, std::chrono::microseconds
 
     // Calculate the time to try requesting this transaction. Use
     // fPreferredDownload as a proxy for outbound peers.
-    const auto process_time = CalculateTxGetDataTime(txid, current_time, !state->fPreferredDownload);
+    const auto process_time = CalculateTxGetDataTime(txid, current_time, !peer.m_preferred_download);
 
     peer_download_state.m_tx_process_time.emplace(process_time, txid);
 }
@@ -773,7 +1054,14 @@ void PeerLogicValidation::InitializeNode(CNode *pnode) {
     NodeId nodeid = pnode->GetId();
     {
         LOCK(cs_main);
-        mapNodeState.emplace_hint(mapNodeState.end(), std::piecewise_construct, std::forward_as_tuple(nodeid), std::forward_as_tuple(addr, std::move(addrName), pnode->fInbound, pnode->m_manual_connection));
+        auto it = mapNodeState.emplace_hint(mapNodeState.end(), std::piecewise_construct, std::forward_as_tuple(nodeid), std::forward_as_tuple(addr, std::move(addrName), pnode->fInbound, pnode->m_manual_connection));
+        // Size the block download window of an address we downloaded from
+        // before by the speed it had then, until it is measured again
+        if (!pnode->fInbound) it->second.m_block_download_time = connman->GetAddressBlockDownloadTime(addr);
+    }
+    {
+        LOCK(g_peer_mutex);
+        g_peer_map.emplace_hint(g_peer_map.end(), nodeid, std::make_shared<Peer>(nodeid));
     }
     if(!pnode->fInbound)
         PushNodeVersion(pnode, connman, GetTime());
@@ -781,6 +1069,18 @@ void PeerLogicValidation::InitializeNode(CNode *pnode) {
 
 void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
     fUpdateConnectionTime = false;
+    int misbehavior{0};
+    {
+        PeerRef peer = GetPeerRef(nodeid);
+        assert(peer != nullptr);
+        LOCK(peer->m_misbehavior_mutex);
+        misbehavior = peer->m_misbehavior_score;
+    }
+    {
+        LOCK(g_peer_mutex);
+        g_peer_map.erase(nodeid);
+    }
+
     LOCK(cs_main);
     CNodeState *state = State(nodeid);
     assert(state != nullptr);
@@ -788,7 +1088,9 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     if (state->fSyncStarted)
         nSyncStarted--;
 
-    if (state->nMisbehavior == 0 && state->fCurrentlyConnected) {
+    if (g_headers_range_sync) g_headers_range_sync->Release(nodeid);
+
+    if (misbehavior == 0 && state->fCurrentlyConnected) {
         fUpdateConnectionTime = true;
     }
 
@@ -815,17 +1117,27 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
 }
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
+    {
+        PeerRef peer = GetPeerRef(nodeid);
+        if (peer == nullptr)
+            return false;
+        LOCK(peer->m_misbehavior_mutex);
+        stats.nMisbehavior = peer->m_misbehavior_score;
+    }
     LOCK(cs_main);
     CNodeState *state = State(nodeid);
     if (state == nullptr)
         return false;
-    stats.nMisbehavior = state->nMisbehavior;
     stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
     stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
     for (const QueuedBlock& queue : state->vBlocksInFlight) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.m_cmpctblocks_received = state->m_cmpctblocks_received;
+    stats.m_cmpctblocks_reconstructed = state->m_cmpctblocks_reconstructed;
+    stats.m_cmpctblock_txn = state->m_cmpctblock_txn;
+    stats.m_cmpctblock_txn_missing = state->m_cmpctblock_txn_missing;
     return true;
 }
 
@@ -836,13 +1148,23 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
 
 static void AddToCompactExtraTransactions(const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
 {
-    size_t max_extra_txn = gArgs.GetArg("-blockreconstructionextratxn", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN);
-    if (max_extra_txn <= 0)
-        return;
+    size_t max_extra_txn = std::max<int64_t>(0, gArgs.GetArg("-blockreconstructionextratxn", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
+    size_t max_extra_shielded_txn = std::max<int64_t>(0, gArgs.GetArg("-blockreconstructionextrashieldedtxn", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_SHIELDED_TXN));
     if (!vExtraTxnForCompact.size())
-        vExtraTxnForCompact.resize(max_extra_txn);
-    vExtraTxnForCompact[vExtraTxnForCompactIt] = std::make_pair(tx->GetWitnessHash(), tx);
-    vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
+        vExtraTxnForCompact.resize(max_extra_txn + max_extra_shielded_txn);
+    // A stream of small transparent txn must not push out the shielded ones,
+    // which would each cost a block reconstruction a GETBLOCKTXN round trip.
+    if (!tx->vShieldedSpend.empty() || !tx->vShieldedOutput.empty() || !tx->vJoinSplit.empty()) {
+        if (max_extra_shielded_txn <= 0)
+            return;
+        vExtraTxnForCompact[max_extra_txn + vExtraShieldedTxnForCompactIt] = std::make_pair(tx->GetWitnessHash(), tx);
+        vExtraShieldedTxnForCompactIt = (vExtraShieldedTxnForCompactIt + 1) % max_extra_shielded_txn;
+    } else {
+        if (max_extra_txn <= 0)
+            return;
+        vExtraTxnForCompact[vExtraTxnForCompactIt] = std::make_pair(tx->GetWitnessHash(), tx);
+        vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
+    }
 }
 
 bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
@@ -856,8 +1178,7 @@ bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRE
     // large transaction with a missing parent then we assume
     // it will rebroadcast it later, after the parent transaction(s)
     // have been mined or received.
-    // 100 orphans, each of which is at most 100,000 bytes big is
-    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
+    // The orphans are further bounded in total size by -maxorphansize.
     unsigned int sz = GetTransactionWeight(*tx);
     if (sz > MAX_STANDARD_TX_WEIGHT)
     {
@@ -865,37 +1186,40 @@ bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRE
         return false;
     }
 
-    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, g_orphan_list.size()});
+    const unsigned int tx_size = tx->GetTotalSize();
+    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, g_orphan_list.size(), tx_size});
     assert(ret.second);
-    g_orphan_list.push_back(ret.first);
+    g_orphan_list.push_back(&*ret.first);
+    g_orphan_bytes += tx_size;
     for (const CTxIn& txin : tx->vin) {
-        mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
+        mapOrphanTransactionsByPrev.emplace(txin.prevout, &*ret.first);
     }
 
     AddToCompactExtraTransactions(tx);
 
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u, %u bytes)\n", hash.ToString(),
+             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size(), g_orphan_bytes);
     return true;
 }
 
 int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
 {
-    std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
+    OrphanMap::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return 0;
     for (const CTxIn& txin : it->second.tx->vin)
     {
-        auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
-            continue;
-        itPrev->second.erase(it);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
+        auto range = mapOrphanTransactionsByPrev.equal_range(txin.prevout);
+        for (auto itPrev = range.first; itPrev != range.second; ++itPrev) {
+            if (itPrev->second == &*it) {
+                mapOrphanTransactionsByPrev.erase(itPrev);
+                break;
+            }
+        }
     }
 
     size_t old_pos = it->second.list_pos;
-    assert(g_orphan_list[old_pos] == it);
+    assert(g_orphan_list[old_pos] == &*it);
     if (old_pos + 1 != g_orphan_list.size()) {
         // Unless we're deleting the last entry in g_orphan_list, move the last
         // entry to the position we're deleting.
@@ -905,6 +1229,7 @@ int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
     }
     g_orphan_list.pop_back();
 
+    g_orphan_bytes -= it->second.tx_size;
     mapOrphanTransactions.erase(it);
     return 1;
 }
@@ -913,10 +1238,10 @@ void EraseOrphansFor(NodeId peer)
 {
     LOCK(g_cs_orphans);
     int nErased = 0;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
+    OrphanMap::iterator iter = mapOrphanTransactions.begin();
     while (iter != mapOrphanTransactions.end())
     {
-        std::map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
+        OrphanMap::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
         if (maybeErase->second.fromPeer == peer)
         {
             nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
@@ -926,7 +1251,7 @@ void EraseOrphansFor(NodeId peer)
 }
 
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t max_orphan_bytes)
 {
     LOCK(g_cs_orphans);
 
@@ -937,10 +1262,10 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
         // Sweep out expired orphan pool entries:
         int nErased = 0;
         int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
-        std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
+        OrphanMap::iterator iter = mapOrphanTransactions.begin();
         while (iter != mapOrphanTransactions.end())
         {
-            std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
+            OrphanMap::iterator maybeErase = iter++;
             if (maybeErase->second.nTimeExpire <= nNow) {
                 nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
             } else {
@@ -951,8 +1276,8 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
         nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
         if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
     }
-    FastRandomContext rng;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
+    FastRandomContext& rng = GetThreadRandomContext();
+    while (mapOrphanTransactions.size() > nMaxOrphans || g_orphan_bytes > max_orphan_bytes)
     {
         // Evict a random orphan:
         size_t randompos = rng.randrange(g_orphan_list.size());
@@ -965,24 +1290,25 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
 /**
  * Increment peer's misbehavior score. If the new value surpasses banscore (specified on startup or by default), mark node to be discouraged, meaning the peer might be disconnected & added to the discouragement filter.
  */
-void Misbehaving(NodeId pnode, int howmuch, const std::string& message) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+void Misbehaving(NodeId pnode, int howmuch, const std::string& message)
 {
     if (howmuch == 0)
         return;
 
-    CNodeState *state = State(pnode);
-    if (state == nullptr)
+    PeerRef peer = GetPeerRef(pnode);
+    if (peer == nullptr)
         return;
 
-    state->nMisbehavior += howmuch;
+    LOCK(peer->m_misbehavior_mutex);
+    peer->m_misbehavior_score += howmuch;
     int banscore = gArgs.GetArg("-banscore", DEFAULT_BANSCORE_THRESHOLD);
     std::string message_prefixed = message.empty() ? "" : (": " + message);
-    if (state->nMisbehavior >= banscore && state->nMisbehavior - howmuch < banscore)
+    if (peer->m_misbehavior_score >= banscore && peer->m_misbehavior_score - howmuch < banscore)
     {
-        LogPrint(BCLog::NET, "%s: %s peer=%d (%d -> %d) DISCOURAGE THRESHOLD EXCEEDED%s\n", __func__, state->name, pnode, state->nMisbehavior-howmuch, state->nMisbehavior, message_prefixed);
-        state->m_should_discourage = true;
+        LogPrint(BCLog::NET, "%s: peer=%d (%d -> %d) DISCOURAGE THRESHOLD EXCEEDED%s\n", __func__, pnode, peer->m_misbehavior_score-howmuch, peer->m_misbehavior_score, message_prefixed);
+        peer->m_should_discourage = true;
     } else
-        LogPrint(BCLog::NET, "%s: %s peer=%d (%d -> %d)%s\n", __func__, state->name, pnode, state->nMisbehavior-howmuch, state->nMisbehavior, message_prefixed);
+        LogPrint(BCLog::NET, "%s: peer=%d (%d -> %d)%s\n", __func__, pnode, peer->m_misbehavior_score-howmuch, peer->m_misbehavior_score, message_prefixed);
 }
 
 /**
@@ -1003,7 +1329,6 @@ static bool MaybePunishNodeForBlock(NodeId nodeid, const BlockValidationState& s
     case BlockValidationResult::BLOCK_CONSENSUS:
     case BlockValidationResult::BLOCK_MUTATED:
         if (!via_compact_block) {
-            LOCK(cs_main);
             Misbehaving(nodeid, 100, message);
             return true;
         }
@@ -1028,7 +1353,6 @@ static bool MaybePunishNodeForBlock(NodeId nodeid, const BlockValidationState& s
     case BlockValidationResult::BLOCK_CHECKPOINT:
     case BlockValidationResult::BLOCK_INVALID_PREV:
         {
-            LOCK(cs_main);
             Misbehaving(nodeid, 100, message);
         }
         return true;
@@ -1036,7 +1360,6 @@ static bool MaybePunishNodeForBlock(NodeId nodeid, const BlockValidationState& s
     case BlockValidationResult::BLOCK_MISSING_PREV:
         {
             // TODO: Handle this much more gracefully (10 DoS points is super arbitrary)
-            LOCK(cs_main);
             Misbehaving(nodeid, 10, message);
         }
         return true;
@@ -1063,7 +1386,6 @@ static bool MaybePunishNodeForTx(NodeId nodeid, const TxValidationState& state,
     // The node is providing invalid data:
     case TxValidationResult::TX_CONSENSUS:
         {
-            LOCK(cs_main);
             Misbehaving(nodeid, 100, message);
             return true;
         }
@@ -1110,7 +1432,10 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
       m_stale_tip_check_time(0)
 {
     // Initialize global variables that cannot be constructed at startup.
-    recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    {
+        LOCK(g_cs_recent_rejects);
+        recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    }
 
     // Blocks don't typically have more than 4000 transactions, so this should
     // be at least six blocks (~1 hr) worth of transactions that we can store.
@@ -1122,6 +1447,9 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
     // same probability that we have in the reject filter).
     g_recent_confirmed_transactions.reset(new CRollingBloomFilter(24000, 0.000001));
 
+    // The pre-validation threads are stopped before connman is destroyed.
+    g_tx_prevalidation_queue.SetNotify([connmanIn] { connmanIn->WakeMessageHandler(); });
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
     // don't want them to get out of sync due to drift in the scheduler, so we
@@ -1147,12 +1475,9 @@ void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pb
 
             // Which orphan pool entries must we evict?
             for (const auto& txin : tx.vin) {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-                if (itByPrev == mapOrphanTransactionsByPrev.end()) continue;
-                for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
-                    const CTransaction& orphanTx = *(*mi)->second.tx;
-                    const uint256& orphanHash = orphanTx.GetHash();
-                    vOrphanErase.push_back(orphanHash);
+                auto range = mapOrphanTransactionsByPrev.equal_range(txin.prevout);
+                for (auto mi = range.first; mi != range.second; ++mi) {
+                    vOrphanErase.push_back(mi->second->first);
                 }
             }
         }
@@ -1196,13 +1521,71 @@ static std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
+//! The BLOCK message payloads of most_recent_block with and without witness, built when first requested
+static std::shared_ptr<const CSharedNetPayload> most_recent_block_payload[2] GUARDED_BY(cs_most_recent_block);
+
+// The data elements of recently relayed transactions and the recently requested
+// filtered blocks, prepared once for the bloom filters (BIP 37) of all peers.
+// Taken after cs_filter of a peer.
+static Mutex cs_bloom_elements;
+static std::map<uint256, std::shared_ptr<const CBloomTxElements>> g_bloom_tx_elements GUARDED_BY(cs_bloom_elements);
+static std::deque<uint256> g_bloom_tx_elements_order GUARDED_BY(cs_bloom_elements);
+static size_t g_bloom_tx_elements_usage GUARDED_BY(cs_bloom_elements) = 0;
+static std::deque<std::shared_ptr<const CFilterableBlock>> g_filterable_blocks GUARDED_BY(cs_bloom_elements);
+
+static std::shared_ptr<const CBloomTxElements> GetBloomTxElements(const CTransactionRef& tx) LOCKS_EXCLUDED(cs_bloom_elements)
+{
+    const uint256& hash = tx->GetHash();
+    {
+        LOCK(cs_bloom_elements);
+        auto it = g_bloom_tx_elements.find(hash);
+        if (it != g_bloom_tx_elements.end()) return it->second;
+    }
+    std::shared_ptr<const CBloomTxElements> elements = std::make_shared<const CBloomTxElements>(tx);
+    LOCK(cs_bloom_elements);
+    if (g_bloom_tx_elements.emplace(hash, elements).second) {
+        g_bloom_tx_elements_order.push_back(hash);
+        g_bloom_tx_elements_usage += elements->DynamicUsage();
+        // Evict the oldest, but keep the one just added however large it is
+        while (g_bloom_tx_elements_usage > MAX_BLOOM_TX_ELEMENTS_USAGE && g_bloom_tx_elements_order.size() > 1) {
+            auto oldest = g_bloom_tx_elements.find(g_bloom_tx_elements_order.front());
+            g_bloom_tx_elements_usage -= oldest->second->DynamicUsage();
+            g_bloom_tx_elements.erase(oldest);
+            g_bloom_tx_elements_order.pop_front();
+        }
+    }
+    return elements;
+}
+
+static std::shared_ptr<const CFilterableBlock> GetFilterableBlock(const CBlock& block) LOCKS_EXCLUDED(cs_bloom_elements)
+{
+    const uint256 hash = block.GetHash();
+    {
+        LOCK(cs_bloom_elements);
+        for (const std::shared_ptr<const CFilterableBlock>& filterable : g_filterable_blocks) {
+            if (filterable->hash == hash) return filterable;
+        }
+    }
+    std::shared_ptr<const CFilterableBlock> filterable = std::make_shared<const CFilterableBlock>(block);
+    LOCK(cs_bloom_elements);
+    g_filterable_blocks.push_back(filterable);
+    if (g_filterable_blocks.size() > MAX_FILTERABLE_BLOCKS) g_filterable_blocks.pop_front();
+    return filterable;
+}
+
+/** IsRelevantAndUpdate, with the data elements of tx shared by the peers it is relayed to */
+static bool IsRelevantToFilter(CBloomFilter& filter, const CTransactionRef& tx) LOCKS_EXCLUDED(cs_bloom_elements)
+{
+    if (filter.IsFullOrEmpty()) return filter.IsRelevantAndUpdate(*tx);
+    return filter.IsRelevantAndUpdate(*GetBloomTxElements(tx));
+}
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
  * to compatible peers.
  */
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
-    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
+    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true, &m_mempool);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
@@ -1221,12 +1604,16 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
+        most_recent_block_payload[0].reset();
+        most_recent_block_payload[1].reset();
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
+    // Serialized once when first announced, then shared by the messages to all peers
+    std::shared_ptr<const CSharedNetPayload> cmpctblock_payload;
+
+    connman->ForEachNode([this, &pcmpctblock, &cmpctblock_payload, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -1238,7 +1625,10 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            if (!cmpctblock_payload) {
+                cmpctblock_payload = std::make_shared<const CSharedNetPayload>(msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock).data);
+            }
+            connman->PushMessage(pnode, CSerializedNetMsg(NetMsgType::CMPCTBLOCK, cmpctblock_payload));
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1252,6 +1642,14 @@ void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex *pindexNew, const CB
     const int nNewHeight = pindexNew->nHeight;
     connman->SetBestHeight(nNewHeight);
 
+    {
+        // Previously rejected transactions might be valid on the new tip,
+        // e.g. due to a nLockTime'd tx becoming valid, or a double-spend.
+        // Reset the rejects filter and give those txs a second chance.
+        LOCK(g_cs_recent_rejects);
+        recentRejects->reset();
+    }
+
     SetServiceFlagsIBDCache(!fInitialDownload);
     if (!fInitialDownload) {
         // Find the hashes of all blocks that weren't previously in the best chain.
@@ -1318,24 +1716,13 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const BlockValidatio
 //
 
 
-bool static AlreadyHave(const CInv& inv, const CTxMemPool& mempool) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool static AlreadyHave(const CInv& inv, const CTxMemPool& mempool)
 {
     switch (inv.type)
     {
     case MSG_TX:
     case MSG_WITNESS_TX:
         {
-            assert(recentRejects);
-            if (::ChainActive().Tip()->GetBlockHash() != hashRecentRejectsChainTip)
-            {
-                // If the chain tip has changed previously rejected transactions
-                // might be now valid, e.g. due to a nLockTime'd tx becoming valid,
-                // or a double-spend. Reset the rejects filter and give those
-                // txs a second chance.
-                hashRecentRejectsChainTip = ::ChainActive().Tip()->GetBlockHash();
-                recentRejects->reset();
-            }
-
             {
                 LOCK(g_cs_orphans);
                 if (mapOrphanTransactions.count(inv.hash)) return true;
@@ -1346,12 +1733,20 @@ bool static AlreadyHave(const CInv& inv, const CTxMemPool& mempool) EXCLUSIVE_LO
                 if (g_recent_confirmed_transactions->contains(inv.hash)) return true;
             }
 
-            return recentRejects->contains(inv.hash) ||
-                   mempool.exists(inv.hash);
+            {
+                LOCK(g_cs_recent_rejects);
+                assert(recentRejects);
+                if (recentRejects->contains(inv.hash)) return true;
+            }
+
+            return mempool.exists(inv.hash);
         }
     case MSG_BLOCK:
     case MSG_WITNESS_BLOCK:
-        return LookupBlockIndex(inv.hash) != nullptr;
+        {
+            LOCK(cs_main);
+            return LookupBlockIndex(inv.hash) != nullptr;
+        }
     }
     // Don't know what it is, just say we already got one
     return true;
@@ -1375,7 +1770,7 @@ static void RelayAddress(const CAddress& addr, bool fReachable, const CConnman&
     // at a time so the m_addr_knowns of the chosen nodes prevent repeats
     uint64_t hashAddr = addr.GetHash();
     const CSipHasher hasher = connman.GetDeterministicRandomizer(RANDOMIZER_ID_ADDRESS_RELAY).Write(hashAddr << 32).Write((GetTime() + hashAddr) / (24 * 60 * 60));
-    FastRandomContext insecure_rand;
+    FastRandomContext& insecure_rand = GetThreadRandomContext();
 
     std::array<std::pair<uint64_t, CNode*>,2> best{{{0, nullptr}, {0, nullptr}}};
     assert(nRelayNodes <= best.size());
@@ -1402,6 +1797,26 @@ static void RelayAddress(const CAddress& addr, bool fReachable, const CConnman&
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/**
+ * Make the BLOCK message for a block. The payload of the most recent block,
+ * which many peers request at once, is serialized once and shared by all of
+ * them. Blocks serialize the same for all protocol versions.
+ */
+static CSerializedNetMsg MakeBlockMsg(const CNetMsgMaker& msgMaker, int nSendFlags, const std::shared_ptr<const CBlock>& pblock)
+{
+    {
+        LOCK(cs_most_recent_block);
+        if (pblock == most_recent_block) {
+            std::shared_ptr<const CSharedNetPayload>& payload = most_recent_block_payload[nSendFlags == 0 ? 0 : 1];
+            if (!payload) {
+                payload = std::make_shared<const CSharedNetPayload>(msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock).data);
+            }
+            return CSerializedNetMsg(NetMsgType::BLOCK, payload);
+        }
+    }
+    return msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock);
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, const CInv& inv, CConnman* connman)
 {
     bool send = false;
@@ -1472,17 +1887,30 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
     // it's available before trying to send.
     if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
     {
+        // Work out whether the reply is the full block in the format on disk.
+        // Old compact block requests are answered with the full block too.
+        // Blocks before segwit activation hold no witness data, so their
+        // serialization without witness is the format on disk as well.
+        bool fFullBlock = inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK;
+        bool fWitness = inv.type == MSG_WITNESS_BLOCK;
+        if (inv.type == MSG_CMPCT_BLOCK && !(CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH)) {
+            fFullBlock = true;
+            fWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+        }
+        const bool fDiskFormat = fFullBlock && (fWitness || !IsWitnessEnabled(pindex->pprev, consensusParams));
+
         std::shared_ptr<const CBlock> pblock;
         if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
             pblock = a_recent_block;
-        } else if (inv.type == MSG_WITNESS_BLOCK) {
-            // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
+        } else if (fDiskFormat) {
+            // Fast-path: the network format matches the format on disk, so the
+            // block bytes are read straight into the message and sent as they are
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            if (!ReadRawBlockFromDisk(msg.data, pindex, chainparams.MessageStart())) {
                 assert(!"cannot load block from disk");
             }
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
+            connman->PushMessage(pfrom, std::move(msg));
             // Don't set pblock as we've sent the block
         } else {
             // Send block from disk
@@ -1493,9 +1921,9 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
         }
         if (pblock) {
             if (inv.type == MSG_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
+                connman->PushMessage(pfrom, MakeBlockMsg(msgMaker, SERIALIZE_TRANSACTION_NO_WITNESS, pblock));
             else if (inv.type == MSG_WITNESS_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+                connman->PushMessage(pfrom, MakeBlockMsg(msgMaker, 0, pblock));
             else if (inv.type == MSG_FILTERED_BLOCK)
             {
                 bool sendMerkleBlock = false;
@@ -1504,7 +1932,14 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
                     LOCK(pfrom->m_tx_relay->cs_filter);
                     if (pfrom->m_tx_relay->pfilter) {
                         sendMerkleBlock = true;
-                        merkleBlock = CMerkleBlock(*pblock, *pfrom->m_tx_relay->pfilter);
+                        CBloomFilter& filter = *pfrom->m_tx_relay->pfilter;
+                        // Blocks are typically asked for by many filtered peers at
+                        // once, which then share the parsing and hashing
+                        if (filter.IsFullOrEmpty()) {
+                            merkleBlock = CMerkleBlock(*pblock, filter);
+                        } else {
+                            merkleBlock = CMerkleBlock(*GetFilterableBlock(*pblock), filter);
+                        }
                     }
                 }
                 if (sendMerkleBlock) {
@@ -1538,7 +1973,7 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
                         connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                     }
                 } else {
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                    connman->PushMessage(pfrom, MakeBlockMsg(msgMaker, nSendFlags, pblock));
                 }
             }
         }
@@ -1650,9 +2085,9 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
     }
 }
 
-static uint32_t GetFetchFlags(CNode* pfrom) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+static uint32_t GetFetchFlags(CNode* pfrom) {
     uint32_t nFetchFlags = 0;
-    if ((pfrom->GetLocalServices() & NODE_WITNESS) && State(pfrom->GetId())->fHaveWitness) {
+    if ((pfrom->GetLocalServices() & NODE_WITNESS) && (pfrom->nServices & NODE_WITNESS)) {
         nFetchFlags |= MSG_WITNESS_FLAG;
     }
     return nFetchFlags;
@@ -1662,7 +2097,6 @@ inline void static SendBlockTransactions(const CBlock& block, const BlockTransac
     BlockTransactions resp(req);
     for (size_t i = 0; i < req.indexes.size(); i++) {
         if (req.indexes[i] >= block.vtx.size()) {
-            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 100, strprintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->GetId()));
             return;
         }
@@ -1674,7 +2108,134 @@ inline void static SendBlockTransactions(const CBlock& block, const BlockTransac
     connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
 }
 
-bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, CTxMemPool& mempool, const std::vector<CBlockHeader>& headers, const CChainParams& chainparams, bool via_compact_block)
+/**
+ * Connect the complete ranges of the parallel headers download that follow
+ * headers we have, in order. The proof of work of each range is verified
+ * on the script check threads by ProcessNewBlockHeaders().
+ */
+static void ConnectHeadersRanges(const CChainParams& chainparams) LOCKS_EXCLUDED(cs_main)
+{
+    while (true) {
+        std::vector<CBlockHeader> headers;
+        NodeId from;
+        {
+            LOCK(cs_main);
+            if (!g_headers_range_sync) return;
+            g_headers_range_sync->Prune(pindexBestHeader->nHeight);
+            if (g_headers_range_sync->Done()) {
+                LogPrint(BCLog::NET, "parallel headers download finished at height %d\n", pindexBestHeader->nHeight);
+                g_headers_range_sync.reset();
+                return;
+            }
+            const HeadersRangeSync::Range* range = g_headers_range_sync->Next();
+            if (range == nullptr || !LookupBlockIndex(range->start_hash)) return;
+            headers = g_headers_range_sync->TakeNext(from);
+        }
+
+        // A range that fails to connect is left to the normal headers sync
+        BlockValidationState state;
+        const CBlockIndex* pindexLast = nullptr;
+        if (!ProcessNewBlockHeaders(headers, state, chainparams, &pindexLast)) {
+            if (state.IsInvalid()) {
+                MaybePunishNodeForBlock(from, state, /*via_compact_block=*/ false, "invalid headers range received");
+            }
+            continue;
+        }
+        LOCK(cs_main);
+        if (State(from) != nullptr) {
+            UpdateBlockAvailability(from, pindexLast->GetBlockHash());
+        }
+    }
+}
+
+/**
+ * Hand the headers a peer sent to the range it downloads, if they are for
+ * it. Returns whether they were.
+ */
+static bool ProcessHeadersRange(CNode* pfrom, CConnman* connman, const std::vector<CBlockHeader>& headers, const CChainParams& chainparams)
+{
+    {
+        LOCK(cs_main);
+        if (!g_headers_range_sync) return false;
+        uint256 locator, stop;
+        switch (g_headers_range_sync->ReceiveHeaders(pfrom->GetId(), headers, GetTime<std::chrono::microseconds>(), locator, stop)) {
+        case HeadersRangeSync::Result::UNEXPECTED:
+            return false;
+        case HeadersRangeSync::Result::EMPTY:
+            LogPrint(BCLog::NET, "peer=%d does not have its range of headers\n", pfrom->GetId());
+            State(pfrom->GetId())->m_headers_range_failed = true;
+            return true;
+        case HeadersRangeSync::Result::INVALID:
+            State(pfrom->GetId())->m_headers_range_failed = true;
+            Misbehaving(pfrom->GetId(), 20, "headers do not lead to the checkpoint of their range");
+            return true;
+        case HeadersRangeSync::Result::MORE:
+            LogPrint(BCLog::NET, "more getheaders of range to %s to peer=%d\n", stop.ToString(), pfrom->GetId());
+            connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::GETHEADERS, CBlockLocator(std::vector<uint256>{locator}), stop));
+            return true;
+        case HeadersRangeSync::Result::COMPLETE:
+            LogPrint(BCLog::NET, "received range of headers to %s from peer=%d\n", stop.ToString(), pfrom->GetId());
+            break;
+        }
+    }
+    ConnectHeadersRanges(chainparams);
+    return true;
+}
+
+/**
+ * The work a chain of headers needs to be stored: the minimum chain work, and
+ * close to the work of the tip once that is more, so that headers of forks
+ * far below the tip are not stored either.
+ */
+static arith_uint256 GetAntiDoSWorkThreshold() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    arith_uint256 near_tip_work = 0;
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    if (tip != nullptr) {
+        near_tip_work = tip->nChainWork - std::min<arith_uint256>(144 * GetBlockProof(*tip), tip->nChainWork);
+    }
+    return std::max(near_tip_work, nMinimumChainWork);
+}
+
+/**
+ * Hand the headers of a message to the presync of the peer, replacing them
+ * with the headers it releases to be stored, and ask for the next ones if it
+ * needs them. The presync is dropped once it is over.
+ */
+static void ProcessPresyncHeaders(CNode* pfrom, CConnman* connman, CNodeState& nodestate, std::vector<CBlockHeader>& headers, bool full_message, bool& requested) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    HeadersPresync& presync = *nodestate.m_headers_presync;
+    const HeadersPresync::Phase phase = presync.GetPhase();
+    HeadersPresync::Result result = presync.ProcessHeaders(headers, full_message);
+    headers = std::move(result.headers);
+
+    if (!result.success) {
+        LogPrint(BCLog::NET, "headers presync with peer=%d ended at height %d without enough work\n", pfrom->GetId(), presync.PresyncHeight());
+        nodestate.m_headers_presync.reset();
+        // As for a peer whose stored headers have too little work, see ProcessHeadersMessage()
+        if (::ChainstateActive().IsInitialBlockDownload() && IsOutboundDisconnectionCandidate(pfrom)) {
+            LogPrintf("Disconnecting outbound peer %d -- headers chain has insufficient work\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+        }
+        return;
+    }
+    if (phase == HeadersPresync::Phase::PRESYNC && presync.GetPhase() == HeadersPresync::Phase::REDOWNLOAD) {
+        LogPrint(BCLog::NET, "headers presync with peer=%d reached enough work at height %d, downloading the headers again\n", pfrom->GetId(), presync.PresyncHeight());
+        // The headers are downloaded twice, so allow twice the time for them
+        if (nodestate.nHeadersSyncTimeout < std::numeric_limits<int64_t>::max()) {
+            nodestate.nHeadersSyncTimeout += HEADERS_DOWNLOAD_TIMEOUT_PER_HEADER * (presync.PresyncHeight() - presync.StartHeight());
+        }
+    }
+    if (result.request_more) {
+        connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::GETHEADERS, presync.NextLocator(), uint256()));
+        requested = true;
+    }
+    if (presync.GetPhase() == HeadersPresync::Phase::FINAL) {
+        nodestate.m_headers_presync.reset();
+    }
+}
+
+bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, CTxMemPool& mempool, std::vector<CBlockHeader> headers, const CChainParams& chainparams, bool via_compact_block)
 {
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
     size_t nCount = headers.size();
@@ -1685,11 +2246,20 @@ bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, CTxMemPool& m
     }
 
     bool received_new_header = false;
+    //! Whether the headers were released by the presync, which then asked for more itself if it needs them
+    bool presynced = false;
+    bool presync_requested = false;
     const CBlockIndex *pindexLast = nullptr;
     {
         LOCK(cs_main);
         CNodeState *nodestate = State(pfrom->GetId());
 
+        if (nodestate->m_headers_presync && nodestate->m_headers_presync->IsContinuation(headers)) {
+            ProcessPresyncHeaders(pfrom, connman, *nodestate, headers, nCount == MAX_HEADERS_RESULTS, presync_requested);
+            if (headers.empty()) return true;
+            presynced = true;
+        }
+
         // If this looks like it could be a block announcement (nCount <
         // MAX_BLOCKS_TO_ANNOUNCE), use special logic for handling headers that
         // don't connect:
@@ -1731,11 +2301,32 @@ bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, CTxMemPool& m
         if (!LookupBlockIndex(hashLastBlock)) {
             received_new_header = true;
         }
+
+        // Headers of a chain without enough work are not stored, so that
+        // they cannot fill our memory. If the peer may have more of them,
+        // they are followed in a presync until they have the work.
+        const CBlockIndex* chain_start = LookupBlockIndex(headers[0].hashPrevBlock);
+        if (!presynced && chain_start) {
+            const arith_uint256 threshold = GetAntiDoSWorkThreshold();
+            if (chain_start->nChainWork + CalculateHeadersWork(headers) < threshold) {
+                if (nCount != MAX_HEADERS_RESULTS) {
+                    LogPrint(BCLog::NET, "ignoring low-work chain of headers from peer=%d\n", pfrom->GetId());
+                    return true;
+                }
+                LogPrint(BCLog::NET, "starting headers presync from height %d with peer=%d\n", chain_start->nHeight, pfrom->GetId());
+                nodestate->m_headers_presync = MakeUnique<HeadersPresync>(chainparams.GetConsensus(), chain_start, ::ChainActive().GetLocator(chain_start), threshold, GetAdjustedTime());
+                ProcessPresyncHeaders(pfrom, connman, *nodestate, headers, /*full_message=*/true, presync_requested);
+                // Nothing can be released before the headers are downloaded again
+                assert(headers.empty());
+                return true;
+            }
+        }
     }
 
     BlockValidationState state;
     if (!ProcessNewBlockHeaders(headers, state, chainparams, &pindexLast)) {
         if (state.IsInvalid()) {
+            if (presynced) WITH_LOCK(cs_main, State(pfrom->GetId())->m_headers_presync.reset());
             MaybePunishNodeForBlock(pfrom->GetId(), state, via_compact_block, "invalid header received");
             return false;
         }
@@ -1760,12 +2351,17 @@ bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, CTxMemPool& m
             nodestate->m_last_block_announcement = GetTime();
         }
 
-        if (nCount == MAX_HEADERS_RESULTS) {
+        if (nCount == MAX_HEADERS_RESULTS && !presync_requested) {
             // Headers message had its maximum size; the peer may have more headers.
-            // TODO: optimize: if pindexLast is an ancestor of ::ChainActive().Tip or pindexBestHeader, continue
-            // from there instead.
-            LogPrint(BCLog::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexLast), uint256()));
+            // If pindexLast is an ancestor of pindexBestHeader, as when ranges
+            // of headers downloaded in parallel were connected above it,
+            // continue from there instead.
+            const CBlockIndex* pindexContinue = pindexLast;
+            if (pindexBestHeader->GetAncestor(pindexLast->nHeight) == pindexLast) {
+                pindexContinue = pindexBestHeader;
+            }
+            LogPrint(BCLog::NET, "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexContinue->nHeight, pfrom->GetId(), pfrom->nStartingHeight);
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexContinue), uint256()));
         }
 
         bool fCanDirectFetch = CanDirectFetch(chainparams.GetConsensus());
@@ -1840,90 +2436,554 @@ bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, CTxMemPool& m
             }
         }
 
-        if (!pfrom->fDisconnect && IsOutboundDisconnectionCandidate(pfrom) && nodestate->pindexBestKnownBlock != nullptr && pfrom->m_tx_relay != nullptr) {
-            // If this is an outbound full-relay peer, check to see if we should protect
-            // it from the bad/lagging chain logic.
-            // Note that block-relay-only peers are already implicitly protected, so we
-            // only consider setting m_protect for the full-relay peers.
-            if (g_outbound_peers_with_protect_from_disconnect < MAX_OUTBOUND_PEERS_TO_PROTECT_FROM_DISCONNECT && nodestate->pindexBestKnownBlock->nChainWork >= ::ChainActive().Tip()->nChainWork && !nodestate->m_chain_sync.m_protect) {
-                LogPrint(BCLog::NET, "Protecting outbound peer=%d from eviction\n", pfrom->GetId());
-                nodestate->m_chain_sync.m_protect = true;
-                ++g_outbound_peers_with_protect_from_disconnect;
-            }
+        if (!pfrom->fDisconnect && IsOutboundDisconnectionCandidate(pfrom) && nodestate->pindexBestKnownBlock != nullptr && pfrom->m_tx_relay != nullptr) {
+            // If this is an outbound full-relay peer, check to see if we should protect
+            // it from the bad/lagging chain logic.
+            // Note that block-relay-only peers are already implicitly protected, so we
+            // only consider setting m_protect for the full-relay peers.
+            if (g_outbound_peers_with_protect_from_disconnect < MAX_OUTBOUND_PEERS_TO_PROTECT_FROM_DISCONNECT && nodestate->pindexBestKnownBlock->nChainWork >= ::ChainActive().Tip()->nChainWork && !nodestate->m_chain_sync.m_protect) {
+                LogPrint(BCLog::NET, "Protecting outbound peer=%d from eviction\n", pfrom->GetId());
+                nodestate->m_chain_sync.m_protect = true;
+                ++g_outbound_peers_with_protect_from_disconnect;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Try to accept the orphans in orphan_work_set, along with the orphans spending
+ * them, to the mempool as one package, so that a child can pay for a parent
+ * that would not be accepted on its own. Returns whether they were accepted;
+ * if not, ProcessOrphanTx goes through them one at a time.
+ */
+bool ProcessOrphanPackage(CConnman* connman, CTxMemPool& mempool, std::set<uint256>& orphan_work_set) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans)
+{
+    // Gather the orphans to resolve, followed by the orphans spending them.
+    std::vector<CTransactionRef> txns;
+    std::set<uint256> in_package;
+    std::deque<uint256> to_visit(orphan_work_set.begin(), orphan_work_set.end());
+    while (!to_visit.empty() && txns.size() < MAX_PACKAGE_COUNT) {
+        const uint256 hash = to_visit.front();
+        to_visit.pop_front();
+        auto orphan_it = mapOrphanTransactions.find(hash);
+        if (orphan_it == mapOrphanTransactions.end() || !in_package.insert(hash).second) continue;
+        txns.push_back(orphan_it->second.tx);
+        for (unsigned int i = 0; i < orphan_it->second.tx->vout.size(); i++) {
+            auto range = mapOrphanTransactionsByPrev.equal_range(COutPoint(hash, i));
+            for (auto it_by_prev = range.first; it_by_prev != range.second; ++it_by_prev) {
+                to_visit.push_back(it_by_prev->second->first);
+            }
+        }
+    }
+    if (txns.size() < 2) return false;
+
+    // Put the parents before their children: count the inputs each orphan
+    // takes from the others and release it once they have all been placed.
+    std::map<uint256, size_t> parent_count;
+    std::deque<CTransactionRef> ready;
+    for (const CTransactionRef& tx : txns) {
+        size_t& count = parent_count[tx->GetHash()];
+        for (const CTxIn& txin : tx->vin) {
+            count += in_package.count(txin.prevout.hash);
+        }
+        if (count == 0) ready.push_back(tx);
+    }
+    std::vector<CTransactionRef> package;
+    while (!ready.empty()) {
+        const CTransactionRef tx = ready.front();
+        ready.pop_front();
+        package.push_back(tx);
+        for (unsigned int i = 0; i < tx->vout.size(); i++) {
+            auto range = mapOrphanTransactionsByPrev.equal_range(COutPoint(tx->GetHash(), i));
+            for (auto it_by_prev = range.first; it_by_prev != range.second; ++it_by_prev) {
+                auto child = parent_count.find(it_by_prev->second->first);
+                if (child != parent_count.end() && --child->second == 0) {
+                    ready.push_back(it_by_prev->second->second.tx);
+                }
+            }
+        }
+    }
+    // An orphan spending an output that another one in the package does not
+    // have is never placed. It cannot be accepted along with the others, so
+    // they are left for ProcessOrphanTx to go through one at a time.
+    if (package.size() != txns.size()) {
+        LogPrint(BCLog::MEMPOOL, "   orphan package of %u txs spends missing outputs of its orphans\n", txns.size());
+        return false;
+    }
+
+    TxValidationState package_state;
+    std::vector<TxValidationState> tx_states;
+    if (!AcceptPackageToMemoryPool(mempool, package_state, tx_states, package, CFeeRate(0) /* max_fee_rate */)) {
+        LogPrint(BCLog::MEMPOOL, "   orphan package of %u txs not accepted: %s\n", package.size(), package_state.ToString());
+        return false;
+    }
+
+    for (const CTransactionRef& tx : package) {
+        const uint256& orphanHash = tx->GetHash();
+        // Those trimmed by the mempool size limit are given up on.
+        if (mempool.exists(orphanHash)) {
+            LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
+            RelayTransaction(orphanHash, *connman);
+            for (unsigned int i = 0; i < tx->vout.size(); i++) {
+                auto range = mapOrphanTransactionsByPrev.equal_range(COutPoint(orphanHash, i));
+                for (auto it_by_prev = range.first; it_by_prev != range.second; ++it_by_prev) {
+                    orphan_work_set.insert(it_by_prev->second->first);
+                }
+            }
+        }
+        EraseOrphanTx(orphanHash);
+        orphan_work_set.erase(orphanHash);
+    }
+    mempool.check(&::ChainstateActive().CoinsTip());
+    return true;
+}
+
+void static ProcessOrphanTx(CConnman* connman, CTxMemPool& mempool, std::set<uint256>& orphan_work_set, std::list<CTransactionRef>& removed_txn) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(g_cs_orphans);
+    if (ProcessOrphanPackage(connman, mempool, orphan_work_set)) return;
+
+    std::set<NodeId> setMisbehaving;
+    bool done = false;
+    while (!done && !orphan_work_set.empty()) {
+        const uint256 orphanHash = *orphan_work_set.begin();
+        orphan_work_set.erase(orphan_work_set.begin());
+
+        auto orphan_it = mapOrphanTransactions.find(orphanHash);
+        if (orphan_it == mapOrphanTransactions.end()) continue;
+
+        const CTransactionRef porphanTx = orphan_it->second.tx;
+        const CTransaction& orphanTx = *porphanTx;
+        NodeId fromPeer = orphan_it->second.fromPeer;
+        // Use a new TxValidationState because orphans come from different peers (and we call
+        // MaybePunishNodeForTx based on the source peer from the orphan map, not based on the peer
+        // that relayed the previous transaction).
+        TxValidationState orphan_state;
+
+        if (setMisbehaving.count(fromPeer)) continue;
+        if (AcceptToMemoryPool(mempool, orphan_state, porphanTx, &removed_txn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
+            LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
+            RelayTransaction(orphanHash, *connman);
+            for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
+                auto range = mapOrphanTransactionsByPrev.equal_range(COutPoint(orphanHash, i));
+                for (auto it_by_prev = range.first; it_by_prev != range.second; ++it_by_prev) {
+                    orphan_work_set.insert(it_by_prev->second->first);
+                }
+            }
+            EraseOrphanTx(orphanHash);
+            done = true;
+        } else if (orphan_state.GetResult() != TxValidationResult::TX_MISSING_INPUTS) {
+            if (orphan_state.IsInvalid()) {
+                // Punish peer that gave us an invalid orphan tx
+                if (MaybePunishNodeForTx(fromPeer, orphan_state)) {
+                    setMisbehaving.insert(fromPeer);
+                }
+                LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
+            }
+            // Has inputs but not accepted to mempool
+            // Probably non-standard or insufficient fee
+            LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
+            if ((!orphanTx.HasWitness() && orphan_state.GetResult() != TxValidationResult::TX_WITNESS_MUTATED) ||
+                    orphan_state.GetResult() == TxValidationResult::TX_INPUTS_NOT_STANDARD) {
+                // Do not use rejection cache for witness transactions or
+                // witness-stripped transactions, as they can have been malleated.
+                // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
+                // However, if the transaction failed for TX_INPUTS_NOT_STANDARD,
+                // then we know that the witness was irrelevant to the policy
+                // failure, since this check depends only on the txid
+                // (the scriptPubKey being spent is covered by the txid).
+                LOCK(g_cs_recent_rejects);
+                assert(recentRejects);
+                recentRejects->insert(orphanHash);
+            }
+            EraseOrphanTx(orphanHash);
+            done = true;
+        }
+        mempool.check(&::ChainstateActive().CoinsTip());
+    }
+}
+
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   filter_type     The filter type the request is for. Must be basic or shielded filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced.
+ * @param[out]  filter_index    The filter index, if the request can be serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, const CChainParams& chain_params,
+                                      BlockFilterType filter_type, uint32_t start_height,
+                                      const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index,
+                                      BlockFilterIndex*& filter_index)
+{
+    const bool supported_filter_type =
+        ((filter_type == BlockFilterType::BASIC || filter_type == BlockFilterType::SHIELDED) &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        stop_index = LookupBlockIndex(stop_hash);
+
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (!stop_index || !BlockRequestAllowed(stop_index, chain_params.GetConsensus())) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with " /* Continued */
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a cfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                               CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    // The whole range is read in one pass, most of it from the filter cache
+    // when clients sync from the tip.
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    // The fields are sent in the BIP 157 order, which is not the one filters are stored in.
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const auto& filter : filters) {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER,
+                                                  static_cast<uint8_t>(filter.GetFilterType()),
+                                                  filter.GetBlockHash(),
+                                                  filter.GetEncodedFilter()));
+    }
+}
+
+/**
+ * Handle a cfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                                CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion())
+                                    .Make(NetMsgType::CFHEADERS,
+                                          filter_type_ser,
+                                          stop_index->GetBlockHash(),
+                                          prev_header,
+                                          filter_hashes));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                                CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
         }
     }
 
-    return true;
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion())
+                                    .Make(NetMsgType::CFCHECKPT,
+                                          filter_type_ser,
+                                          stop_index->GetBlockHash(),
+                                          headers));
 }
 
-void static ProcessOrphanTx(CConnman* connman, CTxMemPool& mempool, std::set<uint256>& orphan_work_set, std::list<CTransactionRef>& removed_txn) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans)
+/**
+ * Try to accept a transaction received from pfrom to the mempool, relay it and
+ * deal with its orphans, or keep track of why it was rejected. state holds the
+ * result of its pre-validation, if any.
+ */
+static void ProcessTransaction(CNode* pfrom, const CTransactionRef& ptx, TxValidationState state, CConnman* connman, CTxMemPool& mempool)
 {
-    AssertLockHeld(cs_main);
-    AssertLockHeld(g_cs_orphans);
-    std::set<NodeId> setMisbehaving;
-    bool done = false;
-    while (!done && !orphan_work_set.empty()) {
-        const uint256 orphanHash = *orphan_work_set.begin();
-        orphan_work_set.erase(orphan_work_set.begin());
+    const CTransaction& tx = *ptx;
+    CInv inv(MSG_TX, tx.GetHash());
 
-        auto orphan_it = mapOrphanTransactions.find(orphanHash);
-        if (orphan_it == mapOrphanTransactions.end()) continue;
+    LOCK2(cs_main, g_cs_orphans);
 
-        const CTransactionRef porphanTx = orphan_it->second.tx;
-        const CTransaction& orphanTx = *porphanTx;
-        NodeId fromPeer = orphan_it->second.fromPeer;
-        // Use a new TxValidationState because orphans come from different peers (and we call
-        // MaybePunishNodeForTx based on the source peer from the orphan map, not based on the peer
-        // that relayed the previous transaction).
-        TxValidationState orphan_state;
+    std::list<CTransactionRef> lRemovedTxn;
 
-        if (setMisbehaving.count(fromPeer)) continue;
-        if (AcceptToMemoryPool(mempool, orphan_state, porphanTx, &removed_txn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
-            LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
-            RelayTransaction(orphanHash, *connman);
-            for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(orphanHash, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto& elem : it_by_prev->second) {
-                        orphan_work_set.insert(elem->first);
-                    }
-                }
+    if (state.IsValid() && !AlreadyHave(inv, mempool) &&
+        AcceptToMemoryPool(mempool, state, ptx, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
+        mempool.check(&::ChainstateActive().CoinsTip());
+        RelayTransaction(tx.GetHash(), *connman);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            auto range = mapOrphanTransactionsByPrev.equal_range(COutPoint(inv.hash, i));
+            for (auto it_by_prev = range.first; it_by_prev != range.second; ++it_by_prev) {
+                pfrom->orphan_work_set.insert(it_by_prev->second->first);
             }
-            EraseOrphanTx(orphanHash);
-            done = true;
-        } else if (orphan_state.GetResult() != TxValidationResult::TX_MISSING_INPUTS) {
-            if (orphan_state.IsInvalid()) {
-                // Punish peer that gave us an invalid orphan tx
-                if (MaybePunishNodeForTx(fromPeer, orphan_state)) {
-                    setMisbehaving.insert(fromPeer);
+        }
+
+        pfrom->nLastTXTime = GetTime();
+
+        LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
+            pfrom->GetId(),
+            tx.GetHash().ToString(),
+            mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+
+        // Recursively process any orphan transactions that depended on this one
+        ProcessOrphanTx(connman, mempool, pfrom->orphan_work_set, lRemovedTxn);
+    }
+    else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS)
+    {
+        bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
+        {
+            LOCK(g_cs_recent_rejects);
+            for (const CTxIn& txin : tx.vin) {
+                if (recentRejects->contains(txin.prevout.hash)) {
+                    fRejectedParents = true;
+                    break;
                 }
-                LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
             }
-            // Has inputs but not accepted to mempool
-            // Probably non-standard or insufficient fee
-            LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
-            if ((!orphanTx.HasWitness() && orphan_state.GetResult() != TxValidationResult::TX_WITNESS_MUTATED) ||
-                    orphan_state.GetResult() == TxValidationResult::TX_INPUTS_NOT_STANDARD) {
-                // Do not use rejection cache for witness transactions or
-                // witness-stripped transactions, as they can have been malleated.
-                // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                // However, if the transaction failed for TX_INPUTS_NOT_STANDARD,
-                // then we know that the witness was irrelevant to the policy
-                // failure, since this check depends only on the txid
-                // (the scriptPubKey being spent is covered by the txid).
+        }
+        if (!fRejectedParents) {
+            uint32_t nFetchFlags = GetFetchFlags(pfrom);
+            const auto current_time = GetTime<std::chrono::microseconds>();
+            PeerRef peer = GetPeerRef(pfrom->GetId());
+
+            for (const CTxIn& txin : tx.vin) {
+                CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
+                pfrom->AddInventoryKnown(_inv);
+                if (peer && !AlreadyHave(_inv, mempool)) RequestTx(*peer, _inv.hash, current_time);
+            }
+            AddOrphanTx(ptx, pfrom->GetId());
+
+            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (see CVE-2012-3789)
+            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            size_t nMaxOrphanSize = (size_t)std::max((int64_t)0, gArgs.GetArg("-maxorphansize", DEFAULT_MAX_ORPHAN_SIZE)) * 1000;
+            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx, nMaxOrphanSize);
+            if (nEvicted > 0) {
+                LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+            }
+        } else {
+            LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
+            // We will continue to reject this tx since it has rejected
+            // parents so avoid re-requesting it from other peers.
+            LOCK(g_cs_recent_rejects);
+            recentRejects->insert(tx.GetHash());
+        }
+    } else {
+        if ((!tx.HasWitness() && state.GetResult() != TxValidationResult::TX_WITNESS_MUTATED) ||
+                state.GetResult() == TxValidationResult::TX_INPUTS_NOT_STANDARD) {
+            // Do not use rejection cache for witness transactions or
+            // witness-stripped transactions, as they can have been malleated.
+            // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
+            // However, if the transaction failed for TX_INPUTS_NOT_STANDARD,
+            // then we know that the witness was irrelevant to the policy
+            // failure, since this check depends only on the txid
+            // (the scriptPubKey being spent is covered by the txid).
+            {
+                LOCK(g_cs_recent_rejects);
                 assert(recentRejects);
-                recentRejects->insert(orphanHash);
+                recentRejects->insert(tx.GetHash());
             }
-            EraseOrphanTx(orphanHash);
-            done = true;
+            if (RecursiveDynamicUsage(*ptx) < 100000) {
+                AddToCompactExtraTransactions(ptx);
+            }
+        } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
+            AddToCompactExtraTransactions(ptx);
         }
-        mempool.check(&::ChainstateActive().CoinsTip());
+
+        if (pfrom->HasPermission(PF_FORCERELAY)) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were already in the mempool,
+            // allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            if (!mempool.exists(tx.GetHash())) {
+                LogPrintf("Not relaying non-mempool transaction %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
+            } else {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
+                RelayTransaction(tx.GetHash(), *connman);
+            }
+        }
+    }
+
+    for (const CTransactionRef& removedTx : lRemovedTxn)
+        AddToCompactExtraTransactions(removedTx);
+
+    // If a tx has been detected by recentRejects, we will have reached
+    // this point and the tx will have been ignored. Because we haven't run
+    // the tx through AcceptToMemoryPool, we won't have computed a DoS
+    // score for it or determined exactly why we consider it invalid.
+    //
+    // This means we won't penalize any peer subsequently relaying a DoSy
+    // tx (even if we penalized the first peer who gave it to us) because
+    // we have to account for recentRejects showing false positives. In
+    // other words, we shouldn't penalize a peer if we aren't *sure* they
+    // submitted a DoSy tx.
+    //
+    // Note that recentRejects doesn't just record DoSy or invalid
+    // transactions, but any tx not accepted by the mempool, which may be
+    // due to node policy (vs. consensus). So we can't blanket penalize a
+    // peer simply for relaying a tx that our recentRejects has caught,
+    // regardless of false positives.
+
+    if (state.IsInvalid())
+    {
+        LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
+            pfrom->GetId(),
+            state.ToString());
+        MaybePunishNodeForTx(pfrom->GetId(), state);
     }
 }
 
+/** The METRIC_SCOPE id for processing msg_type. Unknown types share one, so that peers cannot add names. */
+static int ProcessMessageScopeId(const std::string& msg_type)
+{
+    static const std::map<std::string, int> ids = [] {
+        std::map<std::string, int> ids;
+        for (const std::string& type : getAllNetMessageTypes()) {
+            ids.emplace(type, BCLog::MetricScopeId("ProcessMessage/" + type));
+        }
+        return ids;
+    }();
+    static const int other = BCLog::MetricScopeId("ProcessMessage/other");
+    auto it = ids.find(msg_type);
+    return it != ids.end() ? it->second : other;
+}
+
 bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CTxMemPool& mempool, CConnman* connman, BanMan* banman, const std::atomic<bool>& interruptMsgProc)
 {
+    BCLog::MetricScope metric_scope(ProcessMessageScopeId(msg_type));
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(msg_type), vRecv.size(), pfrom->GetId());
+    PeerRef peer = GetPeerRef(pfrom->GetId());
+    if (peer == nullptr) return false;
     if (gArgs.IsArgSet("-dropmessagestest") && GetRand(gArgs.GetArg("-dropmessagestest", 0)) == 0)
     {
         LogPrintf("dropmessagestest DROPPING RECV MESSAGE\n");
@@ -1936,7 +2996,6 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                msg_type == NetMsgType::FILTERADD))
     {
         if (pfrom->nVersion >= NO_BLOOM_VERSION) {
-            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 100);
             return false;
         } else {
@@ -1949,7 +3008,6 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         // Each connection can only send one version message
         if (pfrom->nVersion != 0)
         {
-            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 1);
             return false;
         }
@@ -2050,7 +3108,7 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         // Potentially mark this peer as a preferred download peer.
         {
         LOCK(cs_main);
-        UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
+        UpdatePreferredDownload(pfrom, State(pfrom->GetId()), *peer);
         }
 
         if (!pfrom->fInbound && pfrom->IsAddrRelayPeer())
@@ -2059,7 +3117,7 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
             if (fListen && !::ChainstateActive().IsInitialBlockDownload())
             {
                 CAddress addr = GetLocalAddress(&pfrom->addr, pfrom->GetLocalServices());
-                FastRandomContext insecure_rand;
+                FastRandomContext& insecure_rand = GetThreadRandomContext();
                 if (addr.IsRoutable())
                 {
                     LogPrint(BCLog::NET, "ProcessMessages: advertising address %s\n", addr.ToString());
@@ -2109,7 +3167,6 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
 
     if (pfrom->nVersion == 0) {
         // Must have a version message before anything else
-        LOCK(cs_main);
         Misbehaving(pfrom->GetId(), 1);
         return false;
     }
@@ -2153,13 +3210,23 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
             nCMPCTBLOCKVersion = 1;
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
         }
+        if (pfrom->m_tx_relay != nullptr && gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION)) {
+            // Offer to reconcile transaction sets instead of announcing each
+            // transaction; peers that do not know SENDRECON ignore it.
+            const uint64_t salt = GetRand(std::numeric_limits<uint64_t>::max());
+            {
+                LOCK(cs_main);
+                State(pfrom->GetId())->m_recon_offered = true;
+                State(pfrom->GetId())->m_recon_salt = salt;
+            }
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDRECON, TXRECONCILIATION_VERSION, salt));
+        }
         pfrom->fSuccessfullyConnected = true;
         return true;
     }
 
     if (!pfrom->fSuccessfullyConnected) {
         // Must have a verack message before anything else
-        LOCK(cs_main);
         Misbehaving(pfrom->GetId(), 1);
         return false;
     }
@@ -2176,7 +3243,6 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         }
         if (vAddr.size() > 1000)
         {
-            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20, strprintf("message addr size() = %u", vAddr.size()));
             return false;
         }
@@ -2248,12 +3314,88 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         return true;
     }
 
+    if (msg_type == NetMsgType::SENDRECON) {
+        uint32_t version;
+        uint64_t remote_salt;
+        vRecv >> version >> remote_salt;
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
+        if (!nodestate->m_recon_offered || nodestate->m_recon || version < TXRECONCILIATION_VERSION) return true;
+        // The side that made the connection starts the rounds
+        nodestate->m_recon = MakeUnique<TxReconciliationState>(!pfrom->fInbound, nodestate->m_recon_salt, remote_salt);
+        LogPrint(BCLog::NET, "peer=%d reconciles transactions with us as %s\n", pfrom->GetId(), pfrom->fInbound ? "responder" : "initiator");
+        return true;
+    }
+
+    if (msg_type == NetMsgType::REQRECON) {
+        uint32_t remote_size;
+        uint16_t remote_q;
+        vRecv >> remote_size >> remote_q;
+        std::vector<uint256> abandoned;
+        TxReconSketch sketch;
+        {
+            LOCK(cs_main);
+            TxReconciliationState* recon = State(pfrom->GetId())->m_recon.get();
+            if (!recon || recon->m_initiator) return true;
+            // A round the initiator gave up on ends without reconciling
+            abandoned = recon->TakeSnapshot();
+            recon->Snapshot();
+            sketch = recon->SnapshotSketch(EstimateSketchCells(recon->m_snapshot.size(), remote_size, remote_q / RECONCILIATION_Q_SCALE));
+        }
+        AnnounceReconciledTxs(pfrom, abandoned, mempool, connman);
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, sketch));
+        return true;
+    }
+
+    if (msg_type == NetMsgType::SKETCH) {
+        TxReconSketch sketch;
+        vRecv >> sketch;
+        std::vector<uint256> announce;
+        std::vector<uint32_t> request;
+        bool success;
+        {
+            LOCK(cs_main);
+            TxReconciliationState* recon = State(pfrom->GetId())->m_recon.get();
+            if (!recon || !recon->m_initiator || recon->m_request_time.count() == 0) return true;
+            if (!sketch.IsWellFormed()) {
+                Misbehaving(pfrom->GetId(), 20, strprintf("sketch of %u cells", sketch.Cells()));
+                return false;
+            }
+            recon->m_request_time = std::chrono::microseconds{0};
+            success = recon->ProcessSketch(sketch, announce, request);
+            if (!success) announce = recon->TakeSnapshot();
+        }
+        LogPrint(BCLog::NET, "reconciliation with peer=%d %s: %u txn to announce, %u requested\n", pfrom->GetId(),
+            success ? "succeeded" : "failed", announce.size(), request.size());
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, success, request));
+        AnnounceReconciledTxs(pfrom, announce, mempool, connman);
+        return true;
+    }
+
+    if (msg_type == NetMsgType::RECONCILDIFF) {
+        bool success;
+        std::vector<uint32_t> request;
+        vRecv >> success >> request;
+        std::vector<uint256> announce;
+        {
+            LOCK(cs_main);
+            TxReconciliationState* recon = State(pfrom->GetId())->m_recon.get();
+            if (!recon || recon->m_initiator) return true;
+            if (request.size() > MAX_SKETCH_CELLS) {
+                Misbehaving(pfrom->GetId(), 20, strprintf("reconcildiff of %u txn", request.size()));
+                return false;
+            }
+            announce = success ? recon->TakeRequested(request) : recon->TakeSnapshot();
+        }
+        AnnounceReconciledTxs(pfrom, announce, mempool, connman);
+        return true;
+    }
+
     if (msg_type == NetMsgType::INV) {
         std::vector<CInv> vInv;
         vRecv >> vInv;
         if (vInv.size() > MAX_INV_SZ)
         {
-            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20, strprintf("message inv size() = %u", vInv.size()));
             return false;
         }
@@ -2266,10 +3408,12 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         if (pfrom->HasPermission(PF_RELAY))
             fBlocksOnly = false;
 
-        LOCK(cs_main);
-
+        // Only block announcements need cs_main; the transactions are
+        // looked up and queued for download under their own locks. The
+        // active chainstate is looked up under cs_main once for all of them.
         uint32_t nFetchFlags = GetFetchFlags(pfrom);
         const auto current_time = GetTime<std::chrono::microseconds>();
+        const bool initial_download = WITH_LOCK(cs_main, return ::ChainstateActive().IsInitialBlockDownload());
         uint256* best_block{nullptr};
 
         for (CInv &inv : vInv)
@@ -2285,6 +3429,7 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
             }
 
             if (inv.type == MSG_BLOCK) {
+                LOCK(cs_main);
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
                     // Headers-first is the primary method of announcement on
@@ -2300,13 +3445,14 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                     LogPrint(BCLog::NET, "transaction (%s) inv sent in violation of protocol, disconnecting peer=%d\n", inv.hash.ToString(), pfrom->GetId());
                     pfrom->fDisconnect = true;
                     return true;
-                } else if (!fAlreadyHave && !fImporting && !fReindex && !::ChainstateActive().IsInitialBlockDownload()) {
-                    RequestTx(State(pfrom->GetId()), inv.hash, current_time);
+                } else if (!fAlreadyHave && !fImporting && !fReindex && !initial_download) {
+                    RequestTx(*peer, inv.hash, current_time);
                 }
             }
         }
 
         if (best_block != nullptr) {
+            LOCK(cs_main);
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexBestHeader), *best_block));
             LogPrint(BCLog::NET, "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, best_block->ToString(), pfrom->GetId());
         }
@@ -2319,7 +3465,6 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         vRecv >> vInv;
         if (vInv.size() > MAX_INV_SZ)
         {
-            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20, strprintf("message getdata size() = %u", vInv.size()));
             return false;
         }
@@ -2537,132 +3682,25 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK2(cs_main, g_cs_orphans);
-
-        TxValidationState state;
-
-        CNodeState* nodestate = State(pfrom->GetId());
-        nodestate->m_tx_download.m_tx_announced.erase(inv.hash);
-        nodestate->m_tx_download.m_tx_in_flight.erase(inv.hash);
-        EraseTxRequest(inv.hash);
-
-        std::list<CTransactionRef> lRemovedTxn;
-
-        if (!AlreadyHave(inv, mempool) &&
-            AcceptToMemoryPool(mempool, state, ptx, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
-            mempool.check(&::ChainstateActive().CoinsTip());
-            RelayTransaction(tx.GetHash(), *connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(inv.hash, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto& elem : it_by_prev->second) {
-                        pfrom->orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
-
-            pfrom->nLastTXTime = GetTime();
-
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
-                pfrom->GetId(),
-                tx.GetHash().ToString(),
-                mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this one
-            ProcessOrphanTx(connman, mempool, pfrom->orphan_work_set, lRemovedTxn);
-        }
-        else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS)
         {
-            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
-            for (const CTxIn& txin : tx.vin) {
-                if (recentRejects->contains(txin.prevout.hash)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                uint32_t nFetchFlags = GetFetchFlags(pfrom);
-                const auto current_time = GetTime<std::chrono::microseconds>();
-
-                for (const CTxIn& txin : tx.vin) {
-                    CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
-                    pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv, mempool)) RequestTx(State(pfrom->GetId()), _inv.hash, current_time);
-                }
-                AddOrphanTx(ptx, pfrom->GetId());
-
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (see CVE-2012-3789)
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
-                }
-            } else {
-                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                recentRejects->insert(tx.GetHash());
-            }
-        } else {
-            if ((!tx.HasWitness() && state.GetResult() != TxValidationResult::TX_WITNESS_MUTATED) ||
-                    state.GetResult() == TxValidationResult::TX_INPUTS_NOT_STANDARD) {
-                // Do not use rejection cache for witness transactions or
-                // witness-stripped transactions, as they can have been malleated.
-                // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                // However, if the transaction failed for TX_INPUTS_NOT_STANDARD,
-                // then we know that the witness was irrelevant to the policy
-                // failure, since this check depends only on the txid
-                // (the scriptPubKey being spent is covered by the txid).
-                assert(recentRejects);
-                recentRejects->insert(tx.GetHash());
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-            } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
-                AddToCompactExtraTransactions(ptx);
-            }
-
-            if (pfrom->HasPermission(PF_FORCERELAY)) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were already in the mempool,
-                // allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                if (!mempool.exists(tx.GetHash())) {
-                    LogPrintf("Not relaying non-mempool transaction %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
-                } else {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
-                    RelayTransaction(tx.GetHash(), *connman);
-                }
-            }
+            LOCK(peer->m_tx_download_mutex);
+            peer->m_tx_download.m_tx_announced.erase(inv.hash);
+            peer->m_tx_download.m_tx_in_flight.erase(inv.hash);
         }
+        EraseTxRequest(inv.hash);
 
-        for (const CTransactionRef& removedTx : lRemovedTxn)
-            AddToCompactExtraTransactions(removedTx);
-
-        // If a tx has been detected by recentRejects, we will have reached
-        // this point and the tx will have been ignored. Because we haven't run
-        // the tx through AcceptToMemoryPool, we won't have computed a DoS
-        // score for it or determined exactly why we consider it invalid.
-        //
-        // This means we won't penalize any peer subsequently relaying a DoSy
-        // tx (even if we penalized the first peer who gave it to us) because
-        // we have to account for recentRejects showing false positives. In
-        // other words, we shouldn't penalize a peer if we aren't *sure* they
-        // submitted a DoSy tx.
-        //
-        // Note that recentRejects doesn't just record DoSy or invalid
-        // transactions, but any tx not accepted by the mempool, which may be
-        // due to node policy (vs. consensus). So we can't blanket penalize a
-        // peer simply for relaying a tx that our recentRejects has caught,
-        // regardless of false positives.
-
-        if (state.IsInvalid())
-        {
-            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
-                pfrom->GetId(),
-                state.ToString());
-            MaybePunishNodeForTx(pfrom->GetId(), state);
+        // Verify shielded proofs, which are slow, on the pre-validation
+        // threads. ProcessMessages() goes on with the transaction, and
+        // with the next messages from this peer, once they are done.
+        // Transactions we have or rejected already skip the queue, as
+        // ProcessTransaction does not validate them again.
+        if ((!tx.vJoinSplit.empty() || !tx.vShieldedSpend.empty() || !tx.vShieldedOutput.empty()) && !AlreadyHave(inv, mempool)) {
+            LOCK(peer->m_tx_prevalidation_mutex);
+            peer->m_tx_prevalidation = g_tx_prevalidation_queue.Submit(ptx);
+            if (peer->m_tx_prevalidation) return true;
         }
+
+        ProcessTransaction(pfrom, ptx, TxValidationState(), connman, mempool);
         return true;
     }
 
@@ -2682,13 +3720,20 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         {
         LOCK(cs_main);
 
-        if (!LookupBlockIndex(cmpctblock.header.hashPrevBlock)) {
+        const CBlockIndex* prev_block = LookupBlockIndex(cmpctblock.header.hashPrevBlock);
+        if (!prev_block) {
             // Doesn't connect (or is genesis), instead of DoSing in AcceptBlockHeader, request deeper headers
             if (!::ChainstateActive().IsInitialBlockDownload())
                 connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexBestHeader), uint256()));
             return true;
         }
 
+        // As in ProcessHeadersMessage(), the header of a low-work chain is not stored
+        if (prev_block->nChainWork + CalculateHeadersWork({cmpctblock.header}) < GetAntiDoSWorkThreshold()) {
+            LogPrint(BCLog::NET, "ignoring low-work compact block from peer=%d\n", pfrom->GetId());
+            return true;
+        }
+
         if (!LookupBlockIndex(cmpctblock.header.GetHash())) {
             received_new_header = true;
         }
@@ -2796,6 +3841,7 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                     if (!partialBlock.IsTxAvailable(i))
                         req.indexes.push_back(i);
                 }
+                RecordCompactBlockReconstruction(nodestate, cmpctblock.BlockTxCount(), req.indexes.size());
                 if (req.indexes.empty()) {
                     // Dirty hack to jump to BLOCKTXN code (TODO: move message handling into their own functions)
                     BlockTransactions txn;
@@ -2818,6 +3864,12 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                     // TODO: don't ignore failures
                     return true;
                 }
+                size_t txn_missing = 0;
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!tempBlock.IsTxAvailable(i))
+                        txn_missing++;
+                }
+                RecordCompactBlockReconstruction(nodestate, cmpctblock.BlockTxCount(), txn_missing);
                 std::vector<CTransactionRef> dummy;
                 status = tempBlock.FillBlock(*pblock, dummy);
                 if (status == READ_STATUS_OK) {
@@ -2982,7 +4034,6 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
         unsigned int nCount = ReadCompactSize(vRecv);
         if (nCount > MAX_HEADERS_RESULTS) {
-            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20, strprintf("headers message size = %u", nCount));
             return false;
         }
@@ -2992,7 +4043,12 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        return ProcessHeadersMessage(pfrom, connman, mempool, headers, chainparams, /*via_compact_block=*/false);
+        if (ProcessHeadersRange(pfrom, connman, headers, chainparams)) return true;
+
+        const bool ret = ProcessHeadersMessage(pfrom, connman, mempool, std::move(headers), chainparams, /*via_compact_block=*/false);
+        // The headers may have connected the start of a buffered range
+        ConnectHeadersRanges(chainparams);
+        return ret;
     }
 
     if (msg_type == NetMsgType::BLOCK)
@@ -3010,16 +4066,28 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
 
         bool forceProcessing = false;
         const uint256 hash(pblock->GetHash());
+        int64_t nDownloadTime;
         {
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
+            nDownloadTime = RecordBlockDownloadTime(pfrom->GetId(), hash);
             forceProcessing |= MarkBlockAsReceived(hash);
+            // As in ProcessHeadersMessage(), the header of an unrequested block
+            // is only stored when it leads to a chain of enough work.
+            if (!forceProcessing) {
+                const CBlockIndex* prev_block = LookupBlockIndex(pblock->hashPrevBlock);
+                if (!prev_block || prev_block->nChainWork + CalculateHeadersWork({pblock->GetBlockHeader()}) < GetAntiDoSWorkThreshold()) {
+                    LogPrint(BCLog::NET, "ignoring low-work unrequested block %s from peer=%d\n", hash.ToString(), pfrom->GetId());
+                    return true;
+                }
+            }
             // mapBlockSource is only used for punishing peers and setting
             // which peers send us compact blocks, so the race between here and
             // cs_main in ProcessNewBlock is fine.
             mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
         }
+        if (nDownloadTime > 0 && !pfrom->fInbound) connman->SetAddressPerformance(pfrom->addr, 0, nDownloadTime);
         bool fNewBlock = false;
         ProcessNewBlock(chainparams, pblock, forceProcessing, &fNewBlock);
         if (fNewBlock) {
@@ -3056,7 +4124,7 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
 
         pfrom->vAddrToSend.clear();
         std::vector<CAddress> vAddr = connman->GetAddresses();
-        FastRandomContext insecure_rand;
+        FastRandomContext& insecure_rand = GetThreadRandomContext();
         for (const CAddress &addr : vAddr) {
             if (!banman->IsDiscouraged(addr) && !banman->IsBanned(addr)) {
                 pfrom->PushAddress(addr, insecure_rand);
@@ -3134,6 +4202,9 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                         // Successful ping time measurement, replace previous
                         pfrom->nPingUsecTime = pingUsecTime;
                         pfrom->nMinPingUsecTime = std::min(pfrom->nMinPingUsecTime.load(), pingUsecTime);
+                        // Remember it, to prefer addresses that answer fast
+                        // when making outbound connections later
+                        if (!pfrom->fInbound) connman->SetAddressPerformance(pfrom->addr, pingUsecTime, 0);
                     } else {
                         // This should never happen
                         sProblem = "Timing mishap";
@@ -3177,7 +4248,6 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         if (!filter.IsWithinSizeConstraints())
         {
             // There is no excuse for sending a too-large filter
-            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 100);
         }
         else if (pfrom->m_tx_relay != nullptr)
@@ -3208,7 +4278,6 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
             }
         }
         if (bad) {
-            LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 100);
         }
         return true;
@@ -3239,25 +4308,39 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         return true;
     }
 
+    if (msg_type == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
+    if (msg_type == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
+    if (msg_type == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
     if (msg_type == NetMsgType::NOTFOUND) {
         // Remove the NOTFOUND transactions from the peer
-        LOCK(cs_main);
-        CNodeState *state = State(pfrom->GetId());
         std::vector<CInv> vInv;
         vRecv >> vInv;
+        LOCK(peer->m_tx_download_mutex);
         if (vInv.size() <= MAX_PEER_TX_IN_FLIGHT + MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
             for (CInv &inv : vInv) {
                 if (inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) {
                     // If we receive a NOTFOUND message for a txid we requested, erase
                     // it from our data structures for this peer.
-                    auto in_flight_it = state->m_tx_download.m_tx_in_flight.find(inv.hash);
-                    if (in_flight_it == state->m_tx_download.m_tx_in_flight.end()) {
+                    auto in_flight_it = peer->m_tx_download.m_tx_in_flight.find(inv.hash);
+                    if (in_flight_it == peer->m_tx_download.m_tx_in_flight.end()) {
                         // Skip any further work if this is a spurious NOTFOUND
                         // message.
                         continue;
                     }
-                    state->m_tx_download.m_tx_in_flight.erase(in_flight_it);
-                    state->m_tx_download.m_tx_announced.erase(inv.hash);
+                    peer->m_tx_download.m_tx_in_flight.erase(in_flight_it);
+                    peer->m_tx_download.m_tx_announced.erase(inv.hash);
                 }
             }
         }
@@ -3271,30 +4354,31 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
 
 bool PeerLogicValidation::MaybeDiscourageAndDisconnect(CNode* pnode)
 {
-    AssertLockHeld(cs_main);
-    CNodeState &state = *State(pnode->GetId());
-
-    if (state.m_should_discourage) {
-        state.m_should_discourage = false;
-        if (pnode->HasPermission(PF_NOBAN)) {
-            LogPrintf("Warning: not punishing whitelisted peer %s!\n", pnode->addr.ToString());
-        } else if (pnode->m_manual_connection) {
-            LogPrintf("Warning: not punishing manually-connected peer %s!\n", pnode->addr.ToString());
-        } else if (pnode->addr.IsLocal()) {
-            // Disconnect but don't discourage this local node
-            LogPrintf("Warning: disconnecting but not discouraging local peer %s!\n", pnode->addr.ToString());
-            pnode->fDisconnect = true;
-        } else {
-            // Disconnect and discourage all nodes sharing the address
-            LogPrintf("Disconnecting and discouraging peer %s!\n", pnode->addr.ToString());
-            if (m_banman) {
-                m_banman->Discourage(pnode->addr);
-            }
-            connman->DisconnectNode(pnode->addr);
+    PeerRef peer = GetPeerRef(pnode->GetId());
+    if (peer == nullptr) return false;
+    {
+        LOCK(peer->m_misbehavior_mutex);
+        if (!peer->m_should_discourage) return false;
+        peer->m_should_discourage = false;
+    }
+
+    if (pnode->HasPermission(PF_NOBAN)) {
+        LogPrintf("Warning: not punishing whitelisted peer %s!\n", pnode->addr.ToString());
+    } else if (pnode->m_manual_connection) {
+        LogPrintf("Warning: not punishing manually-connected peer %s!\n", pnode->addr.ToString());
+    } else if (pnode->addr.IsLocal()) {
+        // Disconnect but don't discourage this local node
+        LogPrintf("Warning: disconnecting but not discouraging local peer %s!\n", pnode->addr.ToString());
+        pnode->fDisconnect = true;
+    } else {
+        // Disconnect and discourage all nodes sharing the address
+        LogPrintf("Disconnecting and discouraging peer %s!\n", pnode->addr.ToString());
+        if (m_banman) {
+            m_banman->Discourage(pnode->addr);
         }
-        return true;
+        connman->DisconnectNode(pnode->addr);
     }
-    return false;
+    return true;
 }
 
 bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
@@ -3313,6 +4397,24 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom, chainparams, connman, m_mempool, interruptMsgProc);
 
+    // The next messages of the peer may depend on its last transaction, so
+    // wait for the pre-validation of that to finish. The pre-validation
+    // threads wake us up again.
+    PeerRef peer = GetPeerRef(pfrom->GetId());
+    if (peer == nullptr) return false;
+    std::shared_ptr<TxPreValidation> prevalidation;
+    {
+        LOCK(peer->m_tx_prevalidation_mutex);
+        prevalidation = std::move(peer->m_tx_prevalidation);
+        if (prevalidation && !prevalidation->m_done) {
+            peer->m_tx_prevalidation = std::move(prevalidation);
+            return false;
+        }
+    }
+    if (prevalidation) {
+        ProcessTransaction(pfrom, prevalidation->m_tx, prevalidation->m_state, connman, m_mempool);
+    }
+
     if (!pfrom->orphan_work_set.empty()) {
         std::list<CTransactionRef> removed_txn;
         LOCK2(cs_main, g_cs_orphans);
@@ -3342,8 +4444,11 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().m_raw_message_size;
+        const bool was_paused = pfrom->fPauseRecv;
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
         fMoreWork = !pfrom->vProcessMsg.empty();
+        // The socket handler does not read from paused peers, so it has to be told
+        if (was_paused && !pfrom->fPauseRecv) connman->WakeSocketHandler(pfrom);
     }
     CNetMessage& msg(msgs.front());
 
@@ -3375,6 +4480,11 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return fMoreWork;
     }
 
+    TRACE3(net, inbound_message,
+           pfrom->GetId(),
+           msg_type.c_str(),
+           msg.m_raw_message_size);
+
     // Process message
     bool fRet = false;
     try
@@ -3394,7 +4504,6 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         LogPrint(BCLog::NET, "%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(msg_type), nMessageSize, pfrom->GetId());
     }
 
-    LOCK(cs_main);
     MaybeDiscourageAndDisconnect(pfrom);
 
     return fMoreWork;
@@ -3594,12 +4703,15 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             }
         }
 
+        if (MaybeDiscourageAndDisconnect(pto)) return true;
+
+        PeerRef peer = GetPeerRef(pto->GetId());
+        if (peer == nullptr) return true;
+
         TRY_LOCK(cs_main, lockMain);
         if (!lockMain)
             return true;
 
-        if (MaybeDiscourageAndDisconnect(pto)) return true;
-
         CNodeState &state = *State(pto->GetId());
 
         // Address refresh broadcast
@@ -3645,7 +4757,8 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         if (pindexBestHeader == nullptr)
             pindexBestHeader = ::ChainActive().Tip();
         bool fFetch = state.fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot); // Download if this is a nice peer, or we have no nice peers and this one might do.
-        if (!state.fSyncStarted && !pto->fClient && !fImporting && !fReindex) {
+        const bool fRangeSync = g_headers_range_sync && g_headers_range_sync->IsDownloading(pto->GetId());
+        if (!state.fSyncStarted && !fRangeSync && !pto->fClient && !fImporting && !fReindex) {
             // Only actively request headers from a single peer, unless we're close to today.
             if ((nSyncStarted == 0 && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 24 * 60 * 60) {
                 state.fSyncStarted = true;
@@ -3666,6 +4779,31 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             }
         }
 
+        // Download the headers between checkpoints from other outbound
+        // peers in parallel, while the peer above syncs from the best header
+        if (!g_headers_range_sync_started && !fImporting && !fReindex && ::ChainstateActive().IsInitialBlockDownload()) {
+            g_headers_range_sync_started = true;
+            g_max_headers_sync_peers = gArgs.GetArg("-headerssyncpeers", DEFAULT_HEADERS_SYNC_PEERS);
+            if (g_max_headers_sync_peers > 0) {
+                g_headers_range_sync = MakeUnique<HeadersRangeSync>(Params().Checkpoints().mapCheckpoints, pindexBestHeader->nHeight);
+                if (g_headers_range_sync->Done()) g_headers_range_sync.reset();
+            }
+        }
+        if (g_headers_range_sync && g_headers_range_sync->HasStalled(pto->GetId(), current_time - HEADERS_RANGE_TIMEOUT)) {
+            LogPrint(BCLog::NET, "range of headers from peer=%d timed out\n", pto->GetId());
+            g_headers_range_sync->Release(pto->GetId());
+            state.m_headers_range_failed = true;
+        }
+        if (g_headers_range_sync && !state.fSyncStarted && !fRangeSync && state.fPreferredDownload && !state.m_headers_range_failed &&
+                !pto->fClient && g_headers_range_sync->Downloading() < g_max_headers_sync_peers) {
+            g_headers_range_sync->Prune(pindexBestHeader->nHeight);
+            uint256 locator, stop;
+            if (g_headers_range_sync->Assign(pto->GetId(), pto->nStartingHeight, current_time, locator, stop)) {
+                LogPrint(BCLog::NET, "getheaders range %s to %s to peer=%d (startheight:%d)\n", locator.ToString(), stop.ToString(), pto->GetId(), pto->nStartingHeight);
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, CBlockLocator(std::vector<uint256>{locator}), stop));
+            }
+        }
+
         //
         // Try sending block announcements via headers
         //
@@ -3918,9 +5056,13 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         if (txinfo.fee < filterrate.GetFee(txinfo.vsize)) {
                             continue;
                         }
-                        if (pto->m_tx_relay->pfilter && !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
-                        // Send
-                        vInv.push_back(CInv(MSG_TX, hash));
+                        if (pto->m_tx_relay->pfilter && !IsRelevantToFilter(*pto->m_tx_relay->pfilter, txinfo.tx)) continue;
+                        // Send, or leave it to the next round of reconciliation
+                        if (state.m_recon && state.m_recon->m_local_set.size() < MAX_RECONCILIATION_SET_SIZE) {
+                            state.m_recon->m_local_set.insert(hash);
+                        } else {
+                            vInv.push_back(CInv(MSG_TX, hash));
+                        }
                         nRelayedTransactions++;
                         {
                             // Expire old relay messages
@@ -3947,6 +5089,24 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         if (!vInv.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        //
+        // Message: reqrecon
+        //
+        if (state.m_recon && state.m_recon->m_initiator) {
+            TxReconciliationState& recon = *state.m_recon;
+            if (recon.m_request_time.count() != 0 && recon.m_request_time + RECON_RESPONSE_TIMEOUT < current_time) {
+                // The peer did not answer; announce the round's transactions instead
+                recon.m_request_time = std::chrono::microseconds{0};
+                AnnounceReconciledTxs(pto, recon.TakeSnapshot(), m_mempool, connman);
+            }
+            if (recon.m_request_time.count() == 0 && recon.m_next_request < current_time) {
+                recon.Snapshot();
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::REQRECON, static_cast<uint32_t>(recon.m_snapshot.size()), static_cast<uint16_t>(recon.m_q * RECONCILIATION_Q_SCALE)));
+                recon.m_request_time = current_time;
+                recon.m_next_request = PoissonNextSend(current_time, RECON_REQUEST_INTERVAL);
+            }
+        }
+
         // Detect whether we're stalling
         current_time = GetTime<std::chrono::microseconds>();
         // nNow is the current system time (GetTimeMicros is not mockable) and
@@ -4015,10 +5175,29 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        // The number of blocks in flight follows the measured download speed of the peer
+        const int nBlocksInFlightTarget = GetBlocksInFlightTarget(state);
+        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < nBlocksInFlightTarget) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            const CBlockIndex* pindexStalled = nullptr;
+            bool fTakeOver = false;
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInFlightTarget - state.nBlocksInFlight, vToDownload, staller, pindexStalled, consensusParams);
+            if (vToDownload.empty() && pindexStalled != nullptr) {
+                // The window is held back by a block in flight from a slower peer, so
+                // ask this one for it too. Whichever delivers first is processed.
+                auto itInFlight = mapBlocksInFlight.find(pindexStalled->GetBlockHash());
+                if (itInFlight != mapBlocksInFlight.end() && !itInFlight->second.second->fRerequested &&
+                        ShouldTakeOverStalledBlock(state, *State(staller), nNow)) {
+                    LogPrint(BCLog::NET, "Taking over block %s (%d) stalled at peer=%d\n", pindexStalled->GetBlockHash().ToString(),
+                        pindexStalled->nHeight, staller);
+                    vToDownload.push_back(pindexStalled);
+                    fTakeOver = true;
+                    staller = -1;
+                }
+            }
+            // Slots the active chain leaves go to the blocks under a UTXO snapshot base.
+            FindNextBackgroundBlocksToDownload(pto->GetId(), nBlocksInFlightTarget - state.nBlocksInFlight, vToDownload, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -4026,6 +5205,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                 LogPrint(BCLog::NET, "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                     pindex->nHeight, pto->GetId());
             }
+            if (fTakeOver) {
+                mapBlocksInFlight[pindexStalled->GetBlockHash()].second->fRerequested = true;
+            }
             if (state.nBlocksInFlight == 0 && staller != -1) {
                 if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
@@ -4043,23 +5225,26 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // were unresponsive in the past.
         // Eventually we should consider disconnecting peers, but this is
         // conservative.
-        if (state.m_tx_download.m_check_expiry_timer <= current_time) {
-            for (auto it=state.m_tx_download.m_tx_in_flight.begin(); it != state.m_tx_download.m_tx_in_flight.end();) {
+        // AlreadyHave() takes g_cs_orphans, which is taken before the
+        // download state of a peer when orphans request their parents.
+        LOCK2(g_cs_orphans, peer->m_tx_download_mutex);
+        if (peer->m_tx_download.m_check_expiry_timer <= current_time) {
+            for (auto it=peer->m_tx_download.m_tx_in_flight.begin(); it != peer->m_tx_download.m_tx_in_flight.end();) {
                 if (it->second <= current_time - TX_EXPIRY_INTERVAL) {
                     LogPrint(BCLog::NET, "timeout of inflight tx %s from peer=%d\n", it->first.ToString(), pto->GetId());
-                    state.m_tx_download.m_tx_announced.erase(it->first);
-                    state.m_tx_download.m_tx_in_flight.erase(it++);
+                    peer->m_tx_download.m_tx_announced.erase(it->first);
+                    peer->m_tx_download.m_tx_in_flight.erase(it++);
                 } else {
                     ++it;
                 }
             }
             // On average, we do this check every TX_EXPIRY_INTERVAL. Randomize
             // so that we're not doing this for all peers at the same time.
-            state.m_tx_download.m_check_expiry_timer = current_time + TX_EXPIRY_INTERVAL / 2 + GetRandMicros(TX_EXPIRY_INTERVAL);
+            peer->m_tx_download.m_check_expiry_timer = current_time + TX_EXPIRY_INTERVAL / 2 + GetFastRandMicros(TX_EXPIRY_INTERVAL);
         }
 
-        auto& tx_process_time = state.m_tx_download.m_tx_process_time;
-        while (!tx_process_time.empty() && tx_process_time.begin()->first <= current_time && state.m_tx_download.m_tx_in_flight.size() < MAX_PEER_TX_IN_FLIGHT) {
+        auto& tx_process_time = peer->m_tx_download.m_tx_process_time;
+        while (!tx_process_time.empty() && tx_process_time.begin()->first <= current_time && peer->m_tx_download.m_tx_in_flight.size() < MAX_PEER_TX_IN_FLIGHT) {
             const uint256 txid = tx_process_time.begin()->second;
             // Erase this entry from tx_process_time (it may be added back for
             // processing at a later time, see below)
@@ -4077,7 +5262,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         vGetData.clear();
                     }
                     UpdateTxRequestTime(inv.hash, current_time);
-                    state.m_tx_download.m_tx_in_flight.emplace(inv.hash, current_time);
+                    peer->m_tx_download.m_tx_in_flight.emplace(inv.hash, current_time);
                 } else {
                     // This transaction is in flight from someone else; queue
                     // up processing to happen after the download times out
@@ -4088,8 +5273,8 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                 }
             } else {
                 // We have already seen this transaction, no need to download.
-                state.m_tx_download.m_tx_announced.erase(inv.hash);
-                state.m_tx_download.m_tx_in_flight.erase(inv.hash);
+                peer->m_tx_download.m_tx_announced.erase(inv.hash);
+                peer->m_tx_download.m_tx_in_flight.erase(inv.hash);
             }
         }
 
@@ -4121,7 +5306,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             // until scheduled broadcast, then move the broadcast to within MAX_FEEFILTER_CHANGE_DELAY.
             else if (timeNow + MAX_FEEFILTER_CHANGE_DELAY * 1000000 < pto->m_tx_relay->nextSendTimeFeeFilter &&
                      (currentFilter < 3 * pto->m_tx_relay->lastSentFeeFilter / 4 || currentFilter > 4 * pto->m_tx_relay->lastSentFeeFilter / 3)) {
-                pto->m_tx_relay->nextSendTimeFeeFilter = timeNow + GetRandInt(MAX_FEEFILTER_CHANGE_DELAY) * 1000000;
+                pto->m_tx_relay->nextSendTimeFeeFilter = timeNow + GetFastRand(MAX_FEEFILTER_CHANGE_DELAY) * 1000000;
             }
         }
     }
@@ -4136,6 +5321,8 @@ public:
         // orphan transactions
         mapOrphanTransactions.clear();
         mapOrphanTransactionsByPrev.clear();
+        g_orphan_list.clear();
+        g_orphan_bytes = 0;
     }
 };
 static CNetProcessingCleanup instance_of_cnetprocessingcleanup;
@@ -18,9 +18,14 @@ extern RecursiveMutex g_cs_orphans;
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxorphansize, maximum size of the orphan transactions kept in memory, in kilobytes */
+static const unsigned int DEFAULT_MAX_ORPHAN_SIZE = 5000;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** Default number of those txn that are kept apart for shielded ones, which are large and costly to fetch again */
+static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_SHIELDED_TXN = 100;
 static const bool DEFAULT_PEERBLOOMFILTERS = false;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 
 class PeerLogicValidation final : public CValidationInterface, public NetEventsInterface {
 private:
@@ -28,7 +33,7 @@ private:
     BanMan* const m_banman;
     CTxMemPool& m_mempool;
 
-    bool MaybeDiscourageAndDisconnect(CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    bool MaybeDiscourageAndDisconnect(CNode* pnode);
 
 public:
     PeerLogicValidation(CConnman* connman, BanMan* banman, CScheduler& scheduler, CTxMemPool& pool);
@@ -86,6 +91,10 @@ struct CNodeStateStats {
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    uint64_t m_cmpctblocks_received = 0;
+    uint64_t m_cmpctblocks_reconstructed = 0;
+    uint64_t m_cmpctblock_txn = 0;
+    uint64_t m_cmpctblock_txn_missing = 0;
 };
 
 /** Get statistics from node state */
@@ -94,4 +103,7 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Relay transaction to every node */
 void RelayTransaction(const uint256&, const CConnman& connman);
 
+/** Run an instance of the thread verifying the shielded proofs of transactions from peers */
+void ThreadTxPreValidation(int worker_num);
+
 #endif // BITCOIN_NET_PROCESSING_H
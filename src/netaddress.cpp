@@ -842,6 +842,19 @@ static inline int NetmaskBits(uint8_t x)
     }
 }
 
+int CSubNet::GetPrefixLength() const
+{
+    int n = 0;
+    for (; n < 16 && netmask[n] == 0xff; ++n);
+    if (n == 16) return 128;
+    const int bits = NetmaskBits(netmask[n]);
+    if (bits < 0) return -1;
+    for (int x = n + 1; x < 16; ++x)
+        if (netmask[x] != 0x00)
+            return -1;
+    return n * 8 + bits;
+}
+
 std::string CSubNet::ToString() const
 {
     /* Parse binary 1{n}0{N-n} to see if mask can be represented as /n */
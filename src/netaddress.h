@@ -133,6 +133,10 @@ class CSubNet
         std::string ToString() const;
         bool IsValid() const;
 
+        //! The number of leading 1-bits of the netmask over all 128 bits, or -1 if the rest is not all 0-bits
+        int GetPrefixLength() const;
+        const CNetAddr& GetNetworkAddress() const { return network; }
+
         friend bool operator==(const CSubNet& a, const CSubNet& b);
         friend bool operator!=(const CSubNet& a, const CSubNet& b) { return !(a == b); }
         friend bool operator<(const CSubNet& a, const CSubNet& b);
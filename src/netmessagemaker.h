@@ -19,6 +19,10 @@ public:
     {
         CSerializedNetMsg msg;
         msg.command = std::move(sCommand);
+        // Size the payload first, so that writing it never reallocates
+        CSizeComputer size(SER_NETWORK, nFlags | nVersion);
+        ::SerializeMany(size, args...);
+        msg.data.reserve(size.size());
         CVectorWriter{ SER_NETWORK, nFlags | nVersion, msg.data, 0, std::forward<Args>(args)... };
         return msg;
     }
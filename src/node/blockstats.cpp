@@ -0,0 +1,153 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockstats.h>
+
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <primitives/block.h>
+#include <undo.h>
+#include <util/check.h>
+
+#include <algorithm>
+
+//! The memory a coin takes in the UTXO set besides its serialized output
+static constexpr size_t PER_UTXO_OVERHEAD = sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
+
+template<typename T>
+static T CalculateTruncatedMedian(std::vector<T>& scores)
+{
+    size_t size = scores.size();
+    if (size == 0) {
+        return 0;
+    }
+
+    std::sort(scores.begin(), scores.end());
+    if (size % 2 == 0) {
+        return (scores[size / 2 - 1] + scores[size / 2]) / 2;
+    } else {
+        return scores[size / 2];
+    }
+}
+
+void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight)
+{
+    if (scores.empty()) {
+        return;
+    }
+
+    std::sort(scores.begin(), scores.end());
+
+    // 10th, 25th, 50th, 75th, and 90th percentile weight units.
+    const double weights[NUM_GETBLOCKSTATS_PERCENTILES] = {
+        total_weight / 10.0, total_weight / 4.0, total_weight / 2.0, (total_weight * 3.0) / 4.0, (total_weight * 9.0) / 10.0
+    };
+
+    int64_t next_percentile_index = 0;
+    int64_t cumulative_weight = 0;
+    for (const auto& element : scores) {
+        cumulative_weight += element.second;
+        while (next_percentile_index < NUM_GETBLOCKSTATS_PERCENTILES && cumulative_weight >= weights[next_percentile_index]) {
+            result[next_percentile_index] = element.first;
+            ++next_percentile_index;
+        }
+    }
+
+    // Fill any remaining percentiles with the last value.
+    for (int64_t i = next_percentile_index; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
+        result[i] = scores.back().first;
+    }
+}
+
+CBlockStats ComputeBlockStats(const CBlock& block, const CBlockUndo& block_undo)
+{
+    CBlockStats stats;
+    stats.txs = block.vtx.size();
+    stats.min_fee = MAX_MONEY;
+    stats.min_feerate = MAX_MONEY;
+    stats.min_tx_size = MAX_BLOCK_SERIALIZED_SIZE;
+
+    std::vector<CAmount> fee_array;
+    std::vector<std::pair<CAmount, int64_t>> feerate_array;
+    std::vector<int64_t> txsize_array;
+
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const auto& tx = block.vtx.at(i);
+        stats.outs += tx->vout.size();
+
+        // Value taken from the shielded pools goes in with the inputs, and
+        // value put into them goes out with the outputs.
+        CAmount shielded_out = 0;
+        for (const JSDescription& joinsplit : tx->vJoinSplit) {
+            shielded_out += joinsplit.vpub_old;
+            stats.sprout_value_delta += joinsplit.vpub_old - joinsplit.vpub_new;
+        }
+        if (tx->valueBalance < 0) shielded_out -= tx->valueBalance;
+        stats.sapling_value_delta -= tx->valueBalance;
+        if (!tx->vShieldedSpend.empty() || !tx->vShieldedOutput.empty() || !tx->vJoinSplit.empty()) {
+            ++stats.shielded_txs;
+            stats.sapling_spends += tx->vShieldedSpend.size();
+            stats.sapling_outputs += tx->vShieldedOutput.size();
+            stats.joinsplits += tx->vJoinSplit.size();
+        }
+
+        CAmount tx_total_out = 0;
+        for (const CTxOut& out : tx->vout) {
+            tx_total_out += out.nValue;
+            stats.utxo_size_inc += GetSerializeSize(out, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
+        }
+
+        if (tx->IsCoinBase()) {
+            continue;
+        }
+
+        stats.ins += tx->vin.size(); // Don't count coinbase's fake input
+        stats.total_out += tx_total_out; // Don't count coinbase reward
+
+        const int64_t tx_size = tx->GetTotalSize();
+        txsize_array.push_back(tx_size);
+        stats.max_tx_size = std::max(stats.max_tx_size, tx_size);
+        stats.min_tx_size = std::min(stats.min_tx_size, tx_size);
+        stats.total_size += tx_size;
+
+        const int64_t weight = GetTransactionWeight(*tx);
+        stats.total_weight += weight;
+
+        if (tx->HasWitness()) {
+            ++stats.sw_txs;
+            stats.sw_total_size += tx_size;
+            stats.sw_total_weight += weight;
+        }
+
+        CAmount tx_total_in = tx->GetShieldedValueIn();
+        const auto& txundo = block_undo.vtxundo.at(i - 1);
+        for (const Coin& coin: txundo.vprevout) {
+            const CTxOut& prevoutput = coin.out;
+
+            tx_total_in += prevoutput.nValue;
+            stats.utxo_size_inc -= GetSerializeSize(prevoutput, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
+        }
+
+        CAmount txfee = tx_total_in - tx_total_out - shielded_out;
+        CHECK_NONFATAL(MoneyRange(txfee));
+        fee_array.push_back(txfee);
+        stats.max_fee = std::max(stats.max_fee, txfee);
+        stats.min_fee = std::min(stats.min_fee, txfee);
+        stats.total_fee += txfee;
+
+        // New feerate uses satoshis per virtual byte instead of per serialized byte
+        CAmount feerate = weight ? (txfee * WITNESS_SCALE_FACTOR) / weight : 0;
+        feerate_array.emplace_back(std::make_pair(feerate, weight));
+        stats.max_feerate = std::max(stats.max_feerate, feerate);
+        stats.min_feerate = std::min(stats.min_feerate, feerate);
+    }
+
+    CalculatePercentilesByWeight(stats.feerate_percentiles, feerate_array, stats.total_weight);
+    stats.median_fee = CalculateTruncatedMedian(fee_array);
+    stats.median_tx_size = CalculateTruncatedMedian(txsize_array);
+    if (stats.min_fee == MAX_MONEY) stats.min_fee = 0;
+    if (stats.min_feerate == MAX_MONEY) stats.min_feerate = 0;
+    if (stats.min_tx_size == MAX_BLOCK_SERIALIZED_SIZE) stats.min_tx_size = 0;
+    return stats;
+}
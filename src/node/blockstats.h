@@ -0,0 +1,81 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_NODE_BLOCKSTATS_H
+#define LITECOINZ_NODE_BLOCKSTATS_H
+
+#include <amount.h>
+#include <serialize.h>
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
+
+/**
+ * The statistics of a block that getblockstats reports and that take the
+ * block and its undo data to compute. The ones the block index already has,
+ * such as the height and times, are not in here.
+ */
+struct CBlockStats
+{
+    int64_t txs{0};
+    int64_t ins{0};
+    int64_t outs{0};
+    CAmount total_out{0};
+    int64_t total_size{0};
+    int64_t total_weight{0};
+    int64_t min_tx_size{0};
+    int64_t max_tx_size{0};
+    int64_t median_tx_size{0};
+    CAmount total_fee{0};
+    CAmount min_fee{0};
+    CAmount max_fee{0};
+    CAmount median_fee{0};
+    CAmount min_feerate{0};
+    CAmount max_feerate{0};
+    CAmount feerate_percentiles[NUM_GETBLOCKSTATS_PERCENTILES]{};
+    int64_t sw_txs{0};
+    int64_t sw_total_size{0};
+    int64_t sw_total_weight{0};
+    int64_t utxo_size_inc{0};
+
+    //! Transactions with any shielded component, and the components
+    int64_t shielded_txs{0};
+    int64_t sapling_spends{0};
+    int64_t sapling_outputs{0};
+    int64_t joinsplits{0};
+    //! What went into the Sapling and Sprout value pools less what left them
+    CAmount sapling_value_delta{0};
+    CAmount sprout_value_delta{0};
+
+    SERIALIZE_METHODS(CBlockStats, obj)
+    {
+        READWRITE(obj.txs, obj.ins, obj.outs, obj.total_out, obj.total_size, obj.total_weight);
+        READWRITE(obj.min_tx_size, obj.max_tx_size, obj.median_tx_size);
+        READWRITE(obj.total_fee, obj.min_fee, obj.max_fee, obj.median_fee, obj.min_feerate, obj.max_feerate);
+        for (auto& feerate : obj.feerate_percentiles) {
+            READWRITE(feerate);
+        }
+        READWRITE(obj.sw_txs, obj.sw_total_size, obj.sw_total_weight, obj.utxo_size_inc);
+        READWRITE(obj.shielded_txs, obj.sapling_spends, obj.sapling_outputs, obj.joinsplits);
+        READWRITE(obj.sapling_value_delta, obj.sprout_value_delta);
+    }
+};
+
+/** Used by getblockstats to get feerates at different percentiles by weight  */
+void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
+
+/**
+ * Compute the statistics of block, whose spent coins are in block_undo. The
+ * fee of a transaction counts the value it takes from and gives to the
+ * shielded pools, like its transparent inputs and outputs.
+ */
+CBlockStats ComputeBlockStats(const CBlock& block, const CBlockUndo& block_undo);
+
+#endif // LITECOINZ_NODE_BLOCKSTATS_H
@@ -6,7 +6,9 @@
 #include <node/coinstats.h>
 
 #include <coins.h>
+#include <crypto/muhash.h>
 #include <hash.h>
+#include <index/coinstatsindex.h>
 #include <serialize.h>
 #include <validation.h>
 #include <uint256.h>
@@ -14,38 +16,76 @@
 
 #include <map>
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+//! The serialization of a coin, of which the MuHash3072 of a set of coins is the multiset hash
+static void TxOutSer(CDataStream& ss, const COutPoint& outpoint, const Coin& coin)
+{
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 2 + coin.fCoinBase);
+    ss << coin.out;
+}
+
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    TxOutSer(ss, outpoint, coin);
+    muhash.Insert(Span<const unsigned char>(reinterpret_cast<const unsigned char*>(ss.data()), ss.size()));
+}
+
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    TxOutSer(ss, outpoint, coin);
+    muhash.Remove(Span<const unsigned char>(reinterpret_cast<const unsigned char*>(ss.data()), ss.size()));
+}
+
+static void PrepareHash(CHashWriter& ss, const CCoinsStats& stats) { ss << stats.hashBlock; }
+static void PrepareHash(MuHash3072& muhash, const CCoinsStats& stats) {}
+static void PrepareHash(std::nullptr_t, const CCoinsStats& stats) {}
+
+static void ApplyHash(CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
-    assert(!outputs.empty());
     ss << hash;
     ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
-    stats.nTransactions++;
     for (const auto& output : outputs) {
         ss << VARINT(output.first + 1);
         ss << output.second.out.scriptPubKey;
         ss << VARINT_MODE(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+    }
+    ss << VARINT(0u);
+}
+
+static void ApplyHash(MuHash3072& muhash, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    for (const auto& output : outputs) {
+        ApplyCoinHash(muhash, COutPoint(hash, output.first), output.second);
+    }
+}
+
+static void ApplyHash(std::nullptr_t, const uint256& hash, const std::map<uint32_t, Coin>& outputs) {}
+
+static void FinalizeHash(CHashWriter& ss, CCoinsStats& stats) { stats.hashSerialized = ss.GetHash(); }
+static void FinalizeHash(MuHash3072& muhash, CCoinsStats& stats) { muhash.Finalize(stats.muhash); }
+static void FinalizeHash(std::nullptr_t, CCoinsStats& stats) {}
+
+template <typename T>
+static void ApplyStats(CCoinsStats& stats, T& hash_obj, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ApplyHash(hash_obj, hash, outputs);
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
         stats.nTransactionOutputs++;
         stats.nTotalAmount += output.second.out.nValue;
         stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
                            2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
     }
-    ss << VARINT(0u);
 }
 
-//! Calculate statistics about the unspent transaction output set
-bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+//! Scan the unspent transaction output set, hashing it with hash_obj
+template <typename T>
+static bool ScanUTXOStats(CCoinsViewCursor* pcursor, CCoinsStats& stats, T hash_obj)
 {
-    stats = CCoinsStats();
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
-    }
-    ss << stats.hashBlock;
+    PrepareHash(hash_obj, stats);
     uint256 prevkey;
     std::map<uint32_t, Coin> outputs;
     while (pcursor->Valid()) {
@@ -53,7 +93,7 @@ bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         Coin coin;
         if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
             if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
+                ApplyStats(stats, hash_obj, prevkey, outputs);
                 outputs.clear();
             }
             prevkey = key.hash;
@@ -65,9 +105,42 @@ bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         pcursor->Next();
     }
     if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
+        ApplyStats(stats, hash_obj, prevkey, outputs);
     }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
+    FinalizeHash(hash_obj, stats);
     return true;
 }
+
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, CoinStatsHashType hash_type, const CBlockIndex* pindex)
+{
+    stats = CCoinsStats();
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    assert(pcursor);
+
+    if (!pindex) {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(pcursor->GetBestBlock());
+    }
+    stats.hashBlock = pindex->GetBlockHash();
+    stats.nHeight = pindex->nHeight;
+    stats.nDiskSize = view->EstimateSize();
+
+    // The index has everything but hash_serialized_2, for every block it has indexed.
+    if (hash_type != CoinStatsHashType::HASH_SERIALIZED && g_coin_stats_index && g_coin_stats_index->LookUpStats(pindex, stats)) {
+        stats.index_used = true;
+        return true;
+    }
+    if (stats.hashBlock != pcursor->GetBestBlock()) {
+        return error("%s: no coin stats for block %s", __func__, stats.hashBlock.ToString());
+    }
+
+    switch (hash_type) {
+    case CoinStatsHashType::HASH_SERIALIZED:
+        return ScanUTXOStats(pcursor.get(), stats, CHashWriter(SER_GETHASH, PROTOCOL_VERSION));
+    case CoinStatsHashType::MUHASH:
+        return ScanUTXOStats(pcursor.get(), stats, MuHash3072());
+    case CoinStatsHashType::NONE:
+        return ScanUTXOStats(pcursor.get(), stats, nullptr);
+    }
+    assert(false);
+}
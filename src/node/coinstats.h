@@ -11,7 +11,20 @@
 
 #include <cstdint>
 
+class CBlockIndex;
 class CCoinsView;
+class Coin;
+class COutPoint;
+class MuHash3072;
+
+/** Which hash of the UTXO set GetUTXOStats computes */
+enum class CoinStatsHashType {
+    //! hash_serialized_2, which takes a scan of the whole set
+    HASH_SERIALIZED,
+    //! The MuHash3072 of the coins, which the coin stats index keeps for every block
+    MUHASH,
+    NONE,
+};
 
 struct CCoinsStats
 {
@@ -21,14 +34,27 @@ struct CCoinsStats
     uint64_t nTransactionOutputs{0};
     uint64_t nBogoSize{0};
     uint256 hashSerialized{};
+    uint256 muhash{};
     uint64_t nDiskSize{0};
     CAmount nTotalAmount{0};
 
     //! The number of coins contained.
     uint64_t coins_count{0};
+
+    //! Whether the stats were read from the coin stats index, which does not count nTransactions.
+    bool index_used{false};
 };
 
-//! Calculate statistics about the unspent transaction output set
-bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats);
+/** Add a coin to, or remove it from, the MuHash3072 of the set it is in */
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+/**
+ * Calculate statistics about the unspent transaction output set, after pindex
+ * or, if null, after the best block of view. They are read from the coin stats
+ * index when it has them and hash_type is not HASH_SERIALIZED; otherwise the
+ * set in view is scanned, which only works for its best block.
+ */
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED, const CBlockIndex* pindex = nullptr);
 
 #endif // BITCOIN_NODE_COINSTATS_H
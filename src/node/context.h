@@ -9,6 +9,8 @@
 #include <vector>
 
 class BanMan;
+class BlockCache;
+class BlockTemplateCache;
 class CConnman;
 class CScheduler;
 class CTxMemPool;
@@ -36,6 +38,8 @@ struct NodeContext {
     std::unique_ptr<interfaces::Chain> chain;
     std::vector<std::unique_ptr<interfaces::ChainClient>> chain_clients;
     std::unique_ptr<CScheduler> scheduler;
+    std::unique_ptr<BlockTemplateCache> template_cache;
+    std::unique_ptr<BlockCache> block_cache;
 
     //! Declare default constructor and destructor that are not inline, so code
     //! instantiating the NodeContext struct doesn't need to #include class
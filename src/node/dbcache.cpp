@@ -0,0 +1,183 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/dbcache.h>
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <logging.h>
+#include <scheduler.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+//! Read a small file into contents, as those under /proc and /sys are
+bool ReadSmallFile(const fs::path& path, std::string& contents)
+{
+    fsbridge::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return !file.bad();
+}
+
+//! Read a file holding a number of bytes, or "max" for no limit
+bool ReadBytes(const fs::path& path, int64_t& bytes)
+{
+    std::string contents;
+    if (!ReadSmallFile(path, contents)) return false;
+    if (contents.compare(0, 3, "max") == 0) {
+        bytes = std::numeric_limits<int64_t>::max();
+        return true;
+    }
+    std::istringstream stream(contents);
+    return static_cast<bool>(stream >> bytes);
+}
+
+//! Read the status of the whole machine out of /proc
+bool ReadMachineStatus(MemoryStatus& status)
+{
+    std::string meminfo;
+    int64_t total_kb, available_kb;
+    if (!ReadSmallFile("/proc/meminfo", meminfo) ||
+        !ParseMemoryStat(meminfo, "MemTotal:", total_kb) ||
+        !ParseMemoryStat(meminfo, "MemAvailable:", available_kb)) {
+        return false;
+    }
+    status.limit = total_kb * 1024;
+    status.usage = (total_kb - available_kb) * 1024;
+    return true;
+}
+
+} // namespace
+
+bool ParseMemoryPressure(const std::string& contents, double& pressure)
+{
+    std::istringstream stream(contents);
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (line.compare(0, 5, "some ") != 0) continue;
+        const size_t pos = line.find("avg10=");
+        if (pos == std::string::npos) return false;
+        std::istringstream value(line.substr(pos + 6));
+        return static_cast<bool>(value >> pressure);
+    }
+    return false;
+}
+
+bool ParseMemoryStat(const std::string& contents, const std::string& key, int64_t& value)
+{
+    std::istringstream stream(contents);
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (line.compare(0, key.size(), key) != 0 || line.size() == key.size() || !isspace(line[key.size()])) continue;
+        std::istringstream field(line.substr(key.size()));
+        return static_cast<bool>(field >> value);
+    }
+    return false;
+}
+
+bool ReadMemoryStatus(MemoryStatus& status, const fs::path& cgroup_dir)
+{
+    MemoryStatus machine;
+    const bool have_machine = ReadMachineStatus(machine);
+
+    // The usage of a cgroup counts the page cache, which the kernel takes back
+    // before anything stalls, so leave out the part nothing used lately.
+    int64_t limit, usage, inactive_file = 0;
+    std::string stat;
+    bool have_cgroup = false;
+    if (ReadBytes(cgroup_dir / "memory.max", limit) && ReadBytes(cgroup_dir / "memory.current", usage)) {
+        if (ReadSmallFile(cgroup_dir / "memory.stat", stat)) ParseMemoryStat(stat, "inactive_file", inactive_file);
+        have_cgroup = true;
+    } else if (ReadBytes(cgroup_dir / "memory" / "memory.limit_in_bytes", limit) &&
+               ReadBytes(cgroup_dir / "memory" / "memory.usage_in_bytes", usage)) {
+        if (ReadSmallFile(cgroup_dir / "memory" / "memory.stat", stat)) ParseMemoryStat(stat, "total_inactive_file", inactive_file);
+        have_cgroup = true;
+    }
+
+    // Without a limit of its own, cgroup v1 says a page short of 2^63.
+    if (have_cgroup && (!have_machine || limit < machine.limit)) {
+        status.limit = limit;
+        status.usage = std::max<int64_t>(0, usage - inactive_file);
+    } else if (have_machine) {
+        status.limit = machine.limit;
+        status.usage = machine.usage;
+    } else {
+        return false;
+    }
+
+    // Cgroup v1 has no pressure of its own; the machine's is the next best thing.
+    std::string pressure;
+    status.pressure = -1;
+    if ((ReadSmallFile(cgroup_dir / "memory.pressure", pressure) || ReadSmallFile("/proc/pressure/memory", pressure)) &&
+        !ParseMemoryPressure(pressure, status.pressure)) {
+        status.pressure = -1;
+    }
+    return true;
+}
+
+size_t AdjustCoinCacheUsage(const MemoryStatus& status, size_t current, size_t cache_usage, size_t synced_usage, bool initial_download)
+{
+    if (status.limit <= 0) return current;
+    const size_t min_usage = nMinDbCache << 20;
+    const size_t max_usage = nMaxDbCache << 20;
+
+    // Give memory back before the kernel has to reclaim it from under the node.
+    if (status.pressure >= DBCACHE_PRESSURE_HIGH || status.usage > status.limit / 10 * 9) {
+        return std::max(min_usage, std::min(current, current / 4 * 3));
+    }
+
+    // Only grow into the memory the part of the limit not filled yet leaves free.
+    const int64_t unused = current > cache_usage ? current - cache_usage : 0;
+    const int64_t headroom = status.limit / 4 * 3 - status.usage - unused;
+    const bool can_grow = status.pressure < DBCACHE_PRESSURE_LOW && headroom > 0;
+
+    if (!initial_download) {
+        if (current > synced_usage) return synced_usage;
+        if (current < synced_usage && can_grow) return std::min(synced_usage, current + static_cast<size_t>(headroom / 2));
+        return current;
+    }
+    if (!can_grow) return current;
+    return std::max(current, std::min(max_usage, current + static_cast<size_t>(headroom / 2)));
+}
+
+static void TuneCoinCache(size_t synced_usage)
+{
+    MemoryStatus status;
+    if (!ReadMemoryStatus(status)) return;
+
+    LOCK(cs_main);
+    CChainState& chainstate = ::ChainstateActive();
+    const size_t target = AdjustCoinCacheUsage(status, nCoinCacheUsage, chainstate.CoinsTip().DynamicMemoryUsage(),
+                                               synced_usage, chainstate.IsInitialBlockDownload());
+    if (target == nCoinCacheUsage) return;
+
+    LogPrint(BCLog::COINDB, "Coins cache limit %.1f MiB -> %.1f MiB (%.1f of %.1f MiB in use, memory pressure %.2f%%)\n",
+             nCoinCacheUsage * (1.0 / 1024 / 1024), target * (1.0 / 1024 / 1024),
+             status.usage * (1.0 / 1024 / 1024), status.limit * (1.0 / 1024 / 1024), status.pressure);
+    const bool shrunk = target < nCoinCacheUsage;
+    nCoinCacheUsage = target;
+
+    // A cache over its new limit writes out the coins it used least, as
+    // -dbflushkeep says, and keeps the others.
+    if (shrunk) {
+        BlockValidationState state;
+        if (!chainstate.FlushStateToDisk(Params(), state, FlushStateMode::IF_NEEDED)) {
+            LogPrintf("%s: failed to flush state (%s)\n", __func__, state.ToString());
+        }
+    }
+}
+
+void ScheduleCoinCacheTuning(CScheduler& scheduler, size_t synced_usage)
+{
+    scheduler.scheduleEvery([synced_usage] { TuneCoinCache(synced_usage); }, DBCACHE_AUTO_INTERVAL);
+}
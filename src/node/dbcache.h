@@ -0,0 +1,62 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_NODE_DBCACHE_H
+#define LITECOINZ_NODE_DBCACHE_H
+
+#include <fs.h>
+
+#include <chrono>
+#include <stdint.h>
+#include <string>
+
+class CScheduler;
+
+//! Share of the memory limit -dbcache=auto sizes the database caches to, in percent
+static constexpr int64_t DBCACHE_AUTO_PERCENT = 25;
+//! How often -dbcache=auto looks at the memory the node may use
+static constexpr std::chrono::seconds DBCACHE_AUTO_INTERVAL{10};
+//! Memory pressure (PSI "some avg10") at which the coins cache is shrunk, in percent
+static constexpr double DBCACHE_PRESSURE_HIGH = 10.0;
+//! Memory pressure below which the coins cache may grow, in percent
+static constexpr double DBCACHE_PRESSURE_LOW = 1.0;
+
+/** The memory the node may use and how much of it is in use. */
+struct MemoryStatus {
+    //! Bytes the node may use: the limit of its cgroup, or the physical memory without one
+    int64_t limit{0};
+    //! Bytes in use that cannot be reclaimed without writing them out, i.e.
+    //! without the inactive page cache
+    int64_t usage{0};
+    //! Share of the last 10 seconds in which some task stalled on memory, in
+    //! percent, or -1 if the kernel does not tell
+    double pressure{-1};
+};
+
+/**
+ * Read the memory limit, usage and pressure of the cgroup (v2, or else v1)
+ * under cgroup_dir, falling back on /proc/meminfo for the whole machine.
+ */
+bool ReadMemoryStatus(MemoryStatus& status, const fs::path& cgroup_dir = "/sys/fs/cgroup");
+
+/** Parse the "some avg10=" share out of a PSI file such as memory.pressure. */
+bool ParseMemoryPressure(const std::string& contents, double& pressure);
+
+/** Parse the value of the first line starting with key out of a file of "key value" lines. */
+bool ParseMemoryStat(const std::string& contents, const std::string& key, int64_t& value);
+
+/**
+ * The limit the coins cache should have for the memory status: it grows into
+ * the free memory during the initial block download, shrinks under memory
+ * pressure and comes back to synced_usage once the node has caught up, which
+ * leaves the rest of the memory to the mempool. cache_usage is what the
+ * coins cache holds now, as the part of current it does not use yet is not in
+ * the usage of the status.
+ */
+size_t AdjustCoinCacheUsage(const MemoryStatus& status, size_t current, size_t cache_usage, size_t synced_usage, bool initial_download);
+
+/** Adjust nCoinCacheUsage every DBCACHE_AUTO_INTERVAL, writing coins out when it shrinks. */
+void ScheduleCoinCacheTuning(CScheduler& scheduler, size_t synced_usage);
+
+#endif // LITECOINZ_NODE_DBCACHE_H
@@ -23,6 +23,16 @@ PSBTAnalysis AnalyzePSBT(PartiallySignedTransaction psbtx)
 
     result.inputs.resize(psbtx.tx->vin.size());
 
+    // Figure out what is missing from all inputs at once, of which only those
+    // with a UTXO that were not signed before use the result.
+    std::vector<bool> was_signed;
+    for (const PSBTInput& input : psbtx.inputs) {
+        was_signed.push_back(PSBTInputSigned(input));
+    }
+    std::vector<bool> complete;
+    std::vector<SignatureData> outdata;
+    SignPSBTInputs(DUMMY_SIGNING_PROVIDER, psbtx, 1, &complete, &outdata);
+
     for (unsigned int i = 0; i < psbtx.tx->vin.size(); ++i) {
         PSBTInput& input = psbtx.inputs[i];
         PSBTInputAnalysis& input_analysis = result.inputs[i];
@@ -56,22 +66,19 @@ PSBTAnalysis AnalyzePSBT(PartiallySignedTransaction psbtx)
         }
 
         // Check if it is final
-        if (!utxo.IsNull() && !PSBTInputSigned(input)) {
+        if (!utxo.IsNull() && !was_signed[i]) {
             input_analysis.is_final = false;
 
-            // Figure out what is missing
-            SignatureData outdata;
-            bool complete = SignPSBTInput(DUMMY_SIGNING_PROVIDER, psbtx, i, 1, &outdata);
-
             // Things are missing
-            if (!complete) {
-                input_analysis.missing_pubkeys = outdata.missing_pubkeys;
-                input_analysis.missing_redeem_script = outdata.missing_redeem_script;
-                input_analysis.missing_witness_script = outdata.missing_witness_script;
-                input_analysis.missing_sigs = outdata.missing_sigs;
+            if (!complete[i]) {
+                const SignatureData& missing = outdata[i];
+                input_analysis.missing_pubkeys = missing.missing_pubkeys;
+                input_analysis.missing_redeem_script = missing.missing_redeem_script;
+                input_analysis.missing_witness_script = missing.missing_witness_script;
+                input_analysis.missing_sigs = missing.missing_sigs;
 
                 // If we are only missing signatures and nothing else, then next is signer
-                if (outdata.missing_pubkeys.empty() && outdata.missing_redeem_script.IsNull() && outdata.missing_witness_script.IsNull() && !outdata.missing_sigs.empty()) {
+                if (missing.missing_pubkeys.empty() && missing.missing_redeem_script.IsNull() && missing.missing_witness_script.IsNull() && !missing.missing_sigs.empty()) {
                     input_analysis.next = PSBTRole::SIGNER;
                 } else {
                     input_analysis.next = PSBTRole::UPDATER;
@@ -116,12 +123,14 @@ PSBTAnalysis AnalyzePSBT(PartiallySignedTransaction psbtx)
         CCoinsView view_dummy;
         CCoinsViewCache view(&view_dummy);
         bool success = true;
+        std::vector<bool> dummy_complete;
+        SignPSBTInputs(DUMMY_SIGNING_PROVIDER, psbtx, 1, &dummy_complete, nullptr, true);
 
         for (unsigned int i = 0; i < psbtx.tx->vin.size(); ++i) {
             PSBTInput& input = psbtx.inputs[i];
             Coin newcoin;
 
-            if (!SignPSBTInput(DUMMY_SIGNING_PROVIDER, psbtx, i, 1, nullptr, true) || !psbtx.GetInputUTXO(newcoin.out, i)) {
+            if (!dummy_complete[i] || !psbtx.GetInputUTXO(newcoin.out, i)) {
                 success = false;
                 break;
             } else {
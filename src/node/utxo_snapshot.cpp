@@ -0,0 +1,236 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxo_snapshot.h>
+
+#include <coins.h>
+#include <hash.h>
+#include <logging.h>
+#include <streams.h>
+#include <sync.h>
+#include <tinyformat.h>
+#include <txdb.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//! Entries handed to the coins database at a time while loading a snapshot.
+static constexpr size_t SNAPSHOT_LOAD_CHUNK = 100000;
+//! Entries between calls to the interruption point while writing a snapshot.
+static constexpr uint64_t SNAPSHOT_INTERRUPT_INTERVAL = 5000;
+//! Bytes of serialized coins a dump thread hands over at a time.
+static constexpr size_t SNAPSHOT_DUMP_CHUNK_SIZE = 1 << 20;
+//! Chunks a dump thread may have waiting to be written.
+static constexpr size_t SNAPSHOT_DUMP_QUEUE_SIZE = 4;
+
+namespace {
+/** Coins serialized by one dump thread, waiting to be written in order */
+struct DumpRange {
+    std::deque<std::vector<unsigned char>> chunks;
+    bool done = false;
+};
+} // namespace
+
+/** Serialize the coins of all cursors in parallel, and write them out in cursor order. */
+static void WriteCoins(CAutoFile& file, const std::vector<std::unique_ptr<CCoinsViewCursor>>& cursors, const std::function<void()>& interruption_point)
+{
+    Mutex mutex;
+    std::condition_variable cv;
+    bool stop = false;
+    std::vector<DumpRange> ranges(cursors.size());
+
+    auto dump = [&](size_t t) {
+        CCoinsViewCursor& cursor = *cursors[t];
+        std::vector<unsigned char> chunk;
+        COutPoint key;
+        Coin coin;
+        while (true) {
+            const bool last = !cursor.Valid();
+            if (!last) {
+                if (cursor.GetKey(key) && cursor.GetValue(coin)) {
+                    CVectorWriter(file.GetType(), file.GetVersion(), chunk, chunk.size(), key, coin);
+                }
+                cursor.Next();
+                if (chunk.size() < SNAPSHOT_DUMP_CHUNK_SIZE) continue;
+            }
+            WAIT_LOCK(mutex, lock);
+            cv.wait(lock, [&] { return stop || ranges[t].chunks.size() < SNAPSHOT_DUMP_QUEUE_SIZE; });
+            if (stop) return;
+            if (!chunk.empty()) ranges[t].chunks.push_back(std::move(chunk));
+            chunk.clear();
+            if (last) ranges[t].done = true;
+            cv.notify_all();
+            if (last) return;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < cursors.size(); t++) {
+        threads.emplace_back(dump, t);
+    }
+    auto join = [&] {
+        {
+            LOCK(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        for (std::thread& thread : threads) thread.join();
+    };
+
+    try {
+        for (size_t t = 0; t < ranges.size(); t++) {
+            while (true) {
+                std::vector<unsigned char> chunk;
+                {
+                    WAIT_LOCK(mutex, lock);
+                    cv.wait(lock, [&] { return !ranges[t].chunks.empty() || ranges[t].done; });
+                    if (ranges[t].chunks.empty()) break;
+                    chunk = std::move(ranges[t].chunks.front());
+                    ranges[t].chunks.pop_front();
+                }
+                cv.notify_all();
+                interruption_point();
+                file.write((const char*)chunk.data(), chunk.size());
+            }
+        }
+    } catch (...) {
+        join();
+        throw;
+    }
+    join();
+}
+
+static uint64_t CountEntries(CCoinsViewDBShieldedCursor& cursor)
+{
+    uint64_t count = 0;
+    for (; cursor.Valid(); cursor.Next()) count++;
+    cursor.Rewind();
+    return count;
+}
+
+template <typename T>
+static void WriteShieldedEntries(CAutoFile& file, CCoinsViewDBShieldedCursor& cursor, uint64_t count, uint64_t& iter, const std::function<void()>& interruption_point)
+{
+    T value;
+    for (uint64_t written = 0; written < count; written++, cursor.Next()) {
+        if (iter++ % SNAPSHOT_INTERRUPT_INTERVAL == 0) interruption_point();
+        if (!cursor.Valid() || !cursor.GetValue(value)) {
+            throw std::runtime_error("Unable to read shielded state");
+        }
+        file << cursor.GetKey();
+        file << value;
+    }
+}
+
+template <typename T>
+static bool HashShieldedEntries(CHashWriter& ss, CCoinsViewDBShieldedCursor& cursor)
+{
+    T value;
+    for (; cursor.Valid(); cursor.Next()) {
+        if (!cursor.GetValue(value)) return false;
+        ss << cursor.GetKey();
+        ss << value;
+    }
+    cursor.Rewind();
+    return true;
+}
+
+bool HashShieldedState(CCoinsViewDBShieldedCursor& nullifiers, CCoinsViewDBShieldedCursor& anchors, const uint256& best_anchor, uint256& hash)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << best_anchor;
+    if (!HashShieldedEntries<uint32_t>(ss, nullifiers) || !HashShieldedEntries<SaplingMerkleTree>(ss, anchors)) {
+        return false;
+    }
+    hash = ss.GetHash();
+    return true;
+}
+
+void WriteUTXOSnapshot(CAutoFile& file, SnapshotMetadata& metadata, const std::vector<std::unique_ptr<CCoinsViewCursor>>& coins,
+                       CCoinsViewDBShieldedCursor& nullifiers, CCoinsViewDBShieldedCursor& anchors,
+                       const std::function<void()>& interruption_point)
+{
+    metadata.m_nullifiers_count = CountEntries(nullifiers);
+    metadata.m_anchors_count = CountEntries(anchors);
+    file << metadata;
+
+    WriteCoins(file, coins, interruption_point);
+    uint64_t iter{0};
+    WriteShieldedEntries<uint32_t>(file, nullifiers, metadata.m_nullifiers_count, iter, interruption_point);
+    WriteShieldedEntries<SaplingMerkleTree>(file, anchors, metadata.m_anchors_count, iter, interruption_point);
+}
+
+bool LoadUTXOSnapshot(CAutoFile& file, CCoinsViewDB& db, SnapshotMetadata& metadata, std::string& error)
+{
+    try {
+        file >> metadata;
+        if (metadata.m_base_blockhash.IsNull()) {
+            error = "Snapshot has no base block";
+            return false;
+        }
+        if (!db.BeginSnapshotLoad(metadata.m_base_blockhash)) {
+            error = "Coins database is not empty";
+            return false;
+        }
+        LogPrintf("Loading UTXO snapshot at %s: %u coins, %u nullifiers, %u anchors\n", metadata.m_base_blockhash.ToString(),
+            metadata.m_coins_count, metadata.m_nullifiers_count, metadata.m_anchors_count);
+
+        std::vector<std::pair<COutPoint, Coin>> coins;
+        coins.reserve(std::min<uint64_t>(metadata.m_coins_count, SNAPSHOT_LOAD_CHUNK));
+        for (uint64_t i = 0; i < metadata.m_coins_count; i++) {
+            coins.emplace_back();
+            file >> coins.back().first;
+            file >> coins.back().second;
+            if (coins.size() == SNAPSHOT_LOAD_CHUNK || i + 1 == metadata.m_coins_count) {
+                if (!db.WriteSnapshotChunk(coins, {}, {})) {
+                    error = "Failed to write to coin database";
+                    return false;
+                }
+                coins.clear();
+                LogPrint(BCLog::COINDB, "Loaded %u of %u snapshot coins\n", i + 1, metadata.m_coins_count);
+            }
+        }
+
+        std::vector<std::pair<uint256, uint32_t>> nullifiers;
+        for (uint64_t i = 0; i < metadata.m_nullifiers_count; i++) {
+            nullifiers.emplace_back();
+            file >> nullifiers.back().first;
+            file >> nullifiers.back().second;
+            if (nullifiers.size() == SNAPSHOT_LOAD_CHUNK || i + 1 == metadata.m_nullifiers_count) {
+                if (!db.WriteSnapshotChunk({}, nullifiers, {})) {
+                    error = "Failed to write to coin database";
+                    return false;
+                }
+                nullifiers.clear();
+            }
+        }
+
+        // Trees are much larger than coins, so they go in smaller chunks.
+        std::vector<std::pair<uint256, SaplingMerkleTree>> anchors;
+        for (uint64_t i = 0; i < metadata.m_anchors_count; i++) {
+            anchors.emplace_back();
+            file >> anchors.back().first;
+            file >> anchors.back().second;
+            if (anchors.size() == SNAPSHOT_LOAD_CHUNK / 100 || i + 1 == metadata.m_anchors_count) {
+                if (!db.WriteSnapshotChunk({}, {}, anchors)) {
+                    error = "Failed to write to coin database";
+                    return false;
+                }
+                anchors.clear();
+            }
+        }
+
+        if (!db.FinishSnapshotLoad(metadata.m_base_blockhash, metadata.m_sapling_anchor)) {
+            error = "Failed to write to coin database";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        error = strprintf("Unable to read snapshot: %s", e.what());
+        return false;
+    }
+    return true;
+}
@@ -9,6 +9,16 @@
 #include <uint256.h>
 #include <serialize.h>
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CAutoFile;
+class CCoinsViewCursor;
+class CCoinsViewDB;
+class CCoinsViewDBShieldedCursor;
+
 //! Metadata describing a serialized version of a UTXO set from which an
 //! assumeutxo CChainState can be constructed.
 class SnapshotMetadata
@@ -26,6 +36,12 @@ public:
     //! initial block download for the assumeutxo chainstate.
     unsigned int m_nchaintx = 0;
 
+    //! The best Sapling anchor, and the number of Sapling nullifiers and
+    //! anchors that follow the coins.
+    uint256 m_sapling_anchor;
+    uint64_t m_nullifiers_count = 0;
+    uint64_t m_anchors_count = 0;
+
     SnapshotMetadata() { }
     SnapshotMetadata(
         const uint256& base_blockhash,
@@ -43,8 +59,72 @@ public:
         READWRITE(m_base_blockhash);
         READWRITE(m_coins_count);
         READWRITE(m_nchaintx);
+        READWRITE(m_sapling_anchor);
+        READWRITE(m_nullifiers_count);
+        READWRITE(m_anchors_count);
     }
 
 };
 
+/**
+ * The UTXO snapshot the active chainstate was loaded from, kept in the block
+ * tree database while a background chainstate validates the blocks up to its
+ * base, and until the next start after that completed.
+ */
+class SnapshotRecord
+{
+public:
+    //! The background chainstate has not reached the base yet.
+    static constexpr uint8_t PENDING = 0;
+    //! The background chainstate arrived at the UTXO set of the snapshot.
+    static constexpr uint8_t VALID = 1;
+    //! The background chainstate arrived at a different UTXO set.
+    static constexpr uint8_t INVALID = 2;
+
+    SnapshotMetadata m_metadata;
+
+    //! The MuHash3072 of the coins loaded from the snapshot, which the
+    //! background chainstate has to arrive at.
+    uint256 m_muhash;
+
+    //! The HashShieldedState of the snapshot, which the background
+    //! chainstate has to arrive at as well.
+    uint256 m_shielded_hash;
+
+    uint8_t m_state = PENDING;
+
+    SERIALIZE_METHODS(SnapshotRecord, obj)
+    {
+        READWRITE(obj.m_metadata, obj.m_muhash, obj.m_shielded_hash, obj.m_state);
+    }
+};
+
+/**
+ * Write a UTXO snapshot: metadata, then the coins, Sapling nullifiers and
+ * anchors, each in database key order. The coins cursors cover consecutive
+ * ranges of the coins, which are read on a thread each and written in order.
+ * The shielded counts in metadata are filled in from the cursors.
+ * interruption_point is called every few thousand entries and may throw to
+ * stop.
+ */
+void WriteUTXOSnapshot(CAutoFile& file, SnapshotMetadata& metadata, const std::vector<std::unique_ptr<CCoinsViewCursor>>& coins,
+                       CCoinsViewDBShieldedCursor& nullifiers, CCoinsViewDBShieldedCursor& anchors,
+                       const std::function<void()>& interruption_point);
+
+/**
+ * Hash the Sapling state of a coins database: the best anchor, then the
+ * nullifiers with their heights and the anchors with their trees, in key
+ * order. Together with the MuHash3072 of the coins, this is what pins a
+ * snapshot. The cursors are rewound afterwards. Returns false if an entry
+ * cannot be read.
+ */
+bool HashShieldedState(CCoinsViewDBShieldedCursor& nullifiers, CCoinsViewDBShieldedCursor& anchors, const uint256& best_anchor, uint256& hash);
+
+/**
+ * Load a UTXO snapshot written by WriteUTXOSnapshot into the empty coins
+ * database db. The entries go straight into db in large sorted batches.
+ * Returns false and sets error if db is not empty or the snapshot is bad.
+ */
+bool LoadUTXOSnapshot(CAutoFile& file, CCoinsViewDB& db, SnapshotMetadata& metadata, std::string& error);
+
 #endif // BITCOIN_NODE_UTXO_SNAPSHOT_H
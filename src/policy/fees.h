@@ -223,6 +223,16 @@ public:
     unsigned int HighestTargetTracked(FeeEstimateHorizon horizon) const;
 
 private:
+    /**
+     * A copy of the confirmation statistics, taken after each block. Estimates
+     * are computed from the latest copy without taking m_cs_fee_estimator, so
+     * that wallets and RPC calls do not wait on mempool and block processing.
+     * Transactions added or removed since the last block are not reflected,
+     * they were too recent to count towards any target.
+     */
+    struct Estimates;
+    std::shared_ptr<const Estimates> m_estimates; // Only accessed through std::atomic_load and std::atomic_store
+
     mutable RecursiveMutex m_cs_fee_estimator;
 
     unsigned int nBestSeenHeight GUARDED_BY(m_cs_fee_estimator);
@@ -254,16 +264,9 @@ private:
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
-    /** Helper for estimateSmartFee */
-    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
-    /** Helper for estimateSmartFee */
-    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
-    /** Number of blocks of data recorded while fee estimates have been running */
-    unsigned int BlockSpan() const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
-    /** Number of blocks of recorded fee estimate data represented in saved data file */
-    unsigned int HistoricalBlockSpan() const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
-    /** Calculation of highest target that reasonable estimate can be provided for */
-    unsigned int MaxUsableEstimate() const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** Publish a copy of the current statistics for estimates */
+    void PublishEstimates() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    std::shared_ptr<const Estimates> GetEstimates() const;
 };
 
 class FeeFilterRounder
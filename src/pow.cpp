@@ -10,9 +10,10 @@
 #include <chainparams.h>
 #include <crypto/equihash.h>
 #include <primitives/block.h>
-#include <streams.h>
+#include <serialize.h>
 #include <uint256.h>
 #include <util/system.h>
+#include <version.h>
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
@@ -204,11 +205,134 @@ bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&
     return true;
 }
 
+namespace {
+
+void HashWrite(eh_HashState& state, const char* pch, size_t size)
+{
+    crypto_generichash_blake2b_update(&state, (const unsigned char*)pch, size);
+}
+
+void HashWrite(CBLAKE2b& state, const char* pch, size_t size)
+{
+    state.Write((const unsigned char*)pch, size);
+}
+
+/** Serialization sink that feeds written bytes straight into a BLAKE2b state, of libsodium or in-tree. */
+template<typename State>
+class CEquihashHashWriter
+{
+private:
+    State& m_state;
+
+public:
+    explicit CEquihashHashWriter(State& state) : m_state(state) {}
+
+    int GetType() const { return SER_NETWORK; }
+    int GetVersion() const { return PROTOCOL_VERSION; }
+
+    void write(const char* pch, size_t size)
+    {
+        HashWrite(m_state, pch, size);
+    }
+
+    template<typename T>
+    CEquihashHashWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+};
+
+/**
+ * BLAKE2b states already personalised for every supported (n, k). The
+ * personalisation only depends on the parameters, so it is done once and each
+ * check starts from a copy.
+ */
+class CEquihashBaseStates
+{
+private:
+    struct Entry {
+        unsigned int n;
+        unsigned int k;
+        eh_HashState state;
+        CBLAKE2b batch_state;
+    };
+
+    Entry m_entries[6];
+
+public:
+    CEquihashBaseStates()
+    {
+        static const unsigned int params[][2] = {{96, 3}, {200, 9}, {96, 5}, {48, 5}, {144, 5}, {192, 7}};
+        static_assert(sizeof(params) / sizeof(params[0]) == sizeof(m_entries) / sizeof(m_entries[0]), "one entry per parameter set");
+        for (size_t i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+            m_entries[i].n = params[i][0];
+            m_entries[i].k = params[i][1];
+            EhInitialiseState(m_entries[i].n, m_entries[i].k, m_entries[i].state);
+            EhInitialiseState(m_entries[i].n, m_entries[i].k, m_entries[i].batch_state);
+        }
+    }
+
+    const eh_HashState* Get(unsigned int n, unsigned int k) const
+    {
+        for (const Entry& entry : m_entries) {
+            if (entry.n == n && entry.k == k) return &entry.state;
+        }
+        return nullptr;
+    }
+
+    const CBLAKE2b* GetBatch(unsigned int n, unsigned int k) const
+    {
+        for (const Entry& entry : m_entries) {
+            if (entry.n == n && entry.k == k) return &entry.batch_state;
+        }
+        return nullptr;
+    }
+};
+
+const CEquihashBaseStates& EquihashBaseStates()
+{
+    static const CEquihashBaseStates states;
+    return states;
+}
+
+bool VerifyEquihashSolution(const CBlockHeader* pblock, unsigned int n, unsigned int k)
+{
+    LogPrint(BCLog::POW, "CheckEquihashSolution: selected n, k : %d, %d \n", n, k);
+
+    const eh_HashState* base_state = EquihashBaseStates().Get(n, k);
+    if (!base_state) {
+        return error("CheckEquihashSolution: Unsupported parameters n=%d, k=%d", n, k);
+    }
+
+    // The in-tree BLAKE2b hashes the leaves of the solution several at a time.
+    if (EquihashBatchVerifier()) {
+        CBLAKE2b state = *EquihashBaseStates().GetBatch(n, k);
+        CEquihashHashWriter<CBLAKE2b> hasher(state);
+        hasher << CEquihashInput{*pblock} << pblock->nNonce;
+        return EhBatchIsValidSolution(n, k, state, pblock->nSolution);
+    }
+
+    // Hash state
+    eh_HashState state = *base_state;
+
+    // H(I||V||...
+    // I = the block header minus nonce and solution.
+    CEquihashHashWriter<eh_HashState> hasher(state);
+    hasher << CEquihashInput{*pblock} << pblock->nNonce;
+
+    bool isValid;
+    EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
+
+    return isValid;
+}
+
+} // namespace
+
 bool CheckEquihashSolution(const CBlockHeader *pblock)
 {
     // Derive n, k from the solution size as the block header does not specify parameters used.
-    // In the future, we could pass in the block height and call EquihashN() and EquihashK()
-    // to perform a contextual check against the parameters in use at a given block height.
+    // Use the height-aware overload below when the block height is known.
     unsigned int n, k;
     size_t nSolSize = pblock->nSolution.size();
 
@@ -232,24 +356,10 @@ bool CheckEquihashSolution(const CBlockHeader *pblock)
         return error("CheckEquihashSolution: Unsupported solution size of %d", nSolSize);
     }
 
-    LogPrint(BCLog::POW, "CheckEquihashSolution: selected n, k : %d, %d \n", n, k);
-
-    // Hash state
-    crypto_generichash_blake2b_state state;
-    EhInitialiseState(n, k, state);
-
-    // I = the block header minus nonce and solution.
-    CEquihashInput I{*pblock};
-    // I||V
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << I;
-    ss << pblock->nNonce;
-
-    // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
-
-    bool isValid;
-    EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
+    return VerifyEquihashSolution(pblock, n, k);
+}
 
-    return isValid;
+bool CheckEquihashSolution(const CBlockHeader *pblock, int nHeight, const Consensus::Params& params)
+{
+    return VerifyEquihashSolution(pblock, params.EquihashN(nHeight), params.EquihashK(nHeight));
 }
@@ -33,4 +33,7 @@ bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&
 /** Check whether the Equihash solution in a block header is valid */
 bool CheckEquihashSolution(const CBlockHeader *pblock);
 
+/** Check the Equihash solution against the parameters in force at nHeight */
+bool CheckEquihashSolution(const CBlockHeader *pblock, int nHeight, const Consensus::Params& params);
+
 #endif // BITCOIN_POW_H
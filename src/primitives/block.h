@@ -84,7 +84,10 @@ public:
     std::vector<CTransactionRef> vtx;
 
     // memory only
+    // set by CheckBlock once the block passed it with its proof of work and merkle root checked
     mutable bool fChecked;
+    // the witness merkle root CheckBlock computed along with the merkle root, if null
+    mutable uint256 hashWitnessMerkleRoot;
 
     CBlock()
     {
@@ -102,7 +105,7 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITEAS(CBlockHeader, *this);
-        READWRITE(vtx);
+        SerReadWriteTransactions(s, vtx, ser_action);
     }
 
     void SetNull()
@@ -110,6 +113,7 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
+        hashWitnessMerkleRoot.SetNull();
     }
 
     CBlockHeader GetBlockHeader() const
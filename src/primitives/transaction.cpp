@@ -5,11 +5,13 @@
 
 #include <primitives/transaction.h>
 
+#include <crypto/sha256.h>
 #include <hash.h>
 #include <tinyformat.h>
 #include <util/strencodings.h>
 
 #include <assert.h>
+#include <string.h>
 
 std::string COutPoint::ToString() const
 {
@@ -79,8 +81,52 @@ uint256 CTransaction::ComputeWitnessHash() const
 
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
 CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), fOverwintered(false), nVersionGroupId(0), nLockTime(0), nExpiryHeight(0), valueBalance(0), vShieldedSpend(), vShieldedOutput(), vJoinSplit(), joinSplitPubKey(), joinSplitSig(), bindingSig(), hash{}, m_witness_hash{} {}
-CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), fOverwintered(tx.fOverwintered), nVersionGroupId(tx.nVersionGroupId), nLockTime(tx.nLockTime), nExpiryHeight(tx.nExpiryHeight), valueBalance(tx.valueBalance), vShieldedSpend(std::move(tx.vShieldedSpend)), vShieldedOutput(std::move(tx.vShieldedOutput)), vJoinSplit(std::move(tx.vJoinSplit)), joinSplitPubKey(std::move(tx.joinSplitPubKey)), joinSplitSig(std::move(tx.joinSplitSig)), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
-CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), fOverwintered(tx.fOverwintered), nVersionGroupId(tx.nVersionGroupId), nLockTime(tx.nLockTime), nExpiryHeight(tx.nExpiryHeight), valueBalance(tx.valueBalance), vShieldedSpend(tx.vShieldedSpend), vShieldedOutput(tx.vShieldedOutput), vJoinSplit(tx.vJoinSplit), joinSplitPubKey(tx.joinSplitPubKey), joinSplitSig(tx.joinSplitSig), bindingSig(tx.bindingSig), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), fOverwintered(tx.fOverwintered), nVersionGroupId(tx.nVersionGroupId), nLockTime(tx.nLockTime), nExpiryHeight(tx.nExpiryHeight), valueBalance(tx.valueBalance), vShieldedSpend(tx.vShieldedSpend), vShieldedOutput(tx.vShieldedOutput), vJoinSplit(tx.vJoinSplit), joinSplitPubKey(tx.joinSplitPubKey), joinSplitSig(tx.joinSplitSig), bindingSig(tx.bindingSig), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), fOverwintered(tx.fOverwintered), nVersionGroupId(tx.nVersionGroupId), nLockTime(tx.nLockTime), nExpiryHeight(tx.nExpiryHeight), valueBalance(tx.valueBalance), vShieldedSpend(std::move(tx.vShieldedSpend)), vShieldedOutput(std::move(tx.vShieldedOutput)), vJoinSplit(std::move(tx.vJoinSplit)), joinSplitPubKey(tx.joinSplitPubKey), joinSplitSig(tx.joinSplitSig), bindingSig(tx.bindingSig), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction(CMutableTransaction&& tx, const uint256& hash_in, const uint256& witness_hash_in) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), fOverwintered(tx.fOverwintered), nVersionGroupId(tx.nVersionGroupId), nLockTime(tx.nLockTime), nExpiryHeight(tx.nExpiryHeight), valueBalance(tx.valueBalance), vShieldedSpend(std::move(tx.vShieldedSpend)), vShieldedOutput(std::move(tx.vShieldedOutput)), vJoinSplit(std::move(tx.vJoinSplit)), joinSplitPubKey(tx.joinSplitPubKey), joinSplitSig(tx.joinSplitSig), bindingSig(tx.bindingSig), hash{hash_in}, m_witness_hash{witness_hash_in} {}
+
+std::vector<CTransactionRef> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs)
+{
+    // Serialize every transaction for its txid, and again with witness for its wtxid if it has one
+    std::vector<unsigned char> data;
+    std::vector<size_t> offsets;
+    std::vector<size_t> witness_index(txs.size(), 0);
+    offsets.reserve(txs.size() + 1);
+    for (const CMutableTransaction& tx : txs) {
+        offsets.push_back(data.size());
+        CVectorWriter(SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS, data, data.size(), tx);
+    }
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (!txs[i].HasWitness()) continue;
+        witness_index[i] = offsets.size();
+        offsets.push_back(data.size());
+        CVectorWriter(SER_GETHASH, 0, data, data.size(), txs[i]);
+    }
+    const size_t count = offsets.size();
+    offsets.push_back(data.size());
+
+    std::vector<const unsigned char*> inputs(count);
+    std::vector<size_t> lengths(count);
+    for (size_t i = 0; i < count; ++i) {
+        inputs[i] = data.data() + offsets[i];
+        lengths[i] = offsets[i + 1] - offsets[i];
+    }
+    std::vector<unsigned char> hashes(32 * count);
+    SHA256DMulti(hashes.data(), inputs.data(), lengths.data(), count);
+    const auto hash_at = [&hashes](size_t i) {
+        uint256 hash;
+        memcpy(hash.begin(), hashes.data() + 32 * i, 32);
+        return hash;
+    };
+
+    std::vector<CTransactionRef> vtx;
+    vtx.reserve(txs.size());
+    for (size_t i = 0; i < txs.size(); ++i) {
+        const uint256 hash = hash_at(i);
+        vtx.push_back(std::make_shared<const CTransaction>(std::move(txs[i]), hash, witness_index[i] ? hash_at(witness_index[i]) : hash));
+    }
+    return vtx;
+}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -694,6 +694,8 @@ public:
     /** Convert a CMutableTransaction into a CTransaction. */
     explicit CTransaction(const CMutableTransaction &tx);
     CTransaction(CMutableTransaction &&tx);
+    /** Convert a CMutableTransaction whose hashes were computed already, see MakeTransactionRefs. */
+    CTransaction(CMutableTransaction &&tx, const uint256& hash, const uint256& witness_hash);
 
     template <typename Stream>
     inline void Serialize(Stream& s) const {
@@ -848,4 +850,23 @@ typedef std::shared_ptr<const CTransaction> CTransactionRef;
 static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
 template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
 
+/** Convert many transactions, computing their txids and wtxids together with SHA256DMulti. */
+std::vector<CTransactionRef> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs);
+
+/** Serialize the transactions of a block. */
+template<typename Stream>
+inline void SerReadWriteTransactions(Stream& s, const std::vector<CTransactionRef>& vtx, CSerActionSerialize)
+{
+    s << vtx;
+}
+
+/** Unserialize the transactions of a block, hashing them in one batch once all are read. */
+template<typename Stream>
+inline void SerReadWriteTransactions(Stream& s, std::vector<CTransactionRef>& vtx, CSerActionUnserialize)
+{
+    std::vector<CMutableTransaction> txs;
+    s >> txs;
+    vtx = MakeTransactionRefs(std::move(txs));
+}
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
@@ -9,6 +9,35 @@
 #include <boost/variant.hpp>
 #include <librustzcash.h>
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+static std::mutex cs_zksnark_params;
+static std::condition_variable cond_zksnark_params;
+static bool fZKSnarkParamsLoading = false;
+
+void SetZKSnarkParamsLoading()
+{
+    std::lock_guard<std::mutex> lock(cs_zksnark_params);
+    fZKSnarkParamsLoading = true;
+}
+
+void SetZKSnarkParamsLoaded()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs_zksnark_params);
+        fZKSnarkParamsLoading = false;
+    }
+    cond_zksnark_params.notify_all();
+}
+
+void WaitForZKSnarkParams()
+{
+    std::unique_lock<std::mutex> lock(cs_zksnark_params);
+    cond_zksnark_params.wait(lock, [] { return !fZKSnarkParamsLoading; });
+}
+
 class SproutProofVerifier : public boost::static_visitor<bool>
 {
     ProofVerifier& verifier;
@@ -28,6 +57,8 @@ public:
 
     bool operator()(const libzcash::GrothProof& proof) const
     {
+        WaitForZKSnarkParams();
+
         uint256 h_sig = ZCJoinSplit::h_sig(jsdesc.randomSeed, jsdesc.nullifiers, joinSplitPubKey);
 
         return librustzcash_sprout_verify(
@@ -46,6 +77,15 @@ public:
     }
 };
 
+/** Owns a librustzcash Sapling verification context. */
+struct SaplingVerificationContextDeleter {
+    void operator()(void* ctx) const { librustzcash_sapling_verification_ctx_free(ctx); }
+};
+typedef std::unique_ptr<void, SaplingVerificationContextDeleter> SaplingVerificationContext;
+
+ProofVerifier::ProofVerifier(ProofVerifier&&) = default;
+ProofVerifier& ProofVerifier::operator=(ProofVerifier&&) = default;
+
 ProofVerifier ProofVerifier::Strict() {
     return ProofVerifier(true);
 }
@@ -62,3 +102,75 @@ bool ProofVerifier::VerifySprout(const JSDescription& jsdesc, const uint256& joi
     auto pv = SproutProofVerifier(*this, joinSplitPubKey, jsdesc);
     return boost::apply_visitor(pv, jsdesc.proof);
 }
+
+bool ProofVerifier::VerifySapling(const CTransaction& tx, const uint256& sighash) {
+    if (!perform_verification) {
+        return true;
+    }
+
+    if (tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty()) {
+        return true;
+    }
+
+    WaitForZKSnarkParams();
+
+    // The context accumulates the value commitments of the transaction
+    // for the binding signature check, so it cannot be shared between
+    // transactions.
+    SaplingVerificationContext ctx(librustzcash_sapling_verification_ctx_init());
+
+    for (const SpendDescription& spend : tx.vShieldedSpend) {
+        if (!librustzcash_sapling_check_spend(
+                ctx.get(),
+                spend.cv.begin(),
+                spend.anchor.begin(),
+                spend.nullifier.begin(),
+                spend.rk.begin(),
+                spend.zkproof.begin(),
+                spend.spendAuthSig.begin(),
+                sighash.begin())) {
+            return false;
+        }
+    }
+
+    for (const OutputDescription& output : tx.vShieldedOutput) {
+        if (!librustzcash_sapling_check_output(
+                ctx.get(),
+                output.cv.begin(),
+                output.cm.begin(),
+                output.ephemeralKey.begin(),
+                output.zkproof.begin())) {
+            return false;
+        }
+    }
+
+    return librustzcash_sapling_final_check(
+        ctx.get(),
+        tx.valueBalance,
+        tx.bindingSig.begin(),
+        sighash.begin());
+}
+
+void ProofVerifier::QueueSapling(const CTransactionRef& tx, const uint256& sighash) {
+    if (!perform_verification) {
+        return;
+    }
+
+    if (tx->vShieldedSpend.empty() && tx->vShieldedOutput.empty()) {
+        return;
+    }
+
+    sapling_batch.emplace_back(tx, sighash);
+}
+
+bool ProofVerifier::VerifySaplingBatch() {
+    std::vector<std::pair<CTransactionRef, uint256>> batch;
+    batch.swap(sapling_batch);
+
+    for (const auto& entry : batch) {
+        if (!VerifySapling(*entry.first, entry.second)) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -8,10 +8,25 @@
 #include <primitives/transaction.h>
 #include <uint256.h>
 
+#include <utility>
+#include <vector>
+
+// The zk-SNARK parameters are loaded by a background thread at startup.
+// SetZKSnarkParamsLoading() is called before that thread starts and
+// SetZKSnarkParamsLoaded() once it is done. Verifying a proof waits in
+// WaitForZKSnarkParams() until then; if loading never started, nothing
+// waits.
+void SetZKSnarkParamsLoading();
+void SetZKSnarkParamsLoaded();
+void WaitForZKSnarkParams();
+
 class ProofVerifier {
 private:
     bool perform_verification;
 
+    //! Sapling transactions queued for the batch check, with their sighash.
+    std::vector<std::pair<CTransactionRef, uint256>> sapling_batch;
+
     ProofVerifier(bool perform_verification) : perform_verification(perform_verification) { }
 
 public:
@@ -32,6 +47,20 @@ public:
 
     // Verifies that the JoinSplit proof is correct.
     bool VerifySprout(const JSDescription& jsdesc, const uint256& joinSplitPubKey);
+
+    // Verifies the Spend and Output descriptions and the binding
+    // signature of a single transaction against its shielded sighash.
+    bool VerifySapling(const CTransaction& tx, const uint256& sighash);
+
+    // Queues the Sapling descriptions of a transaction into the batch
+    // context of this verifier. Nothing is checked until
+    // VerifySaplingBatch() is called. Transactions without Spend or
+    // Output descriptions are ignored.
+    void QueueSapling(const CTransactionRef& tx, const uint256& sighash);
+
+    // Checks every queued Sapling transaction in one pass, stopping at
+    // the first failure. The batch is empty afterwards.
+    bool VerifySaplingBatch();
 };
 
 #endif // ZCASH_PROOF_VERIFIER_H
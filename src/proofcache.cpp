@@ -0,0 +1,97 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <proofcache.h>
+
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+#include <cuckoocache.h>
+#include <random.h>
+#include <script/sigcache.h>
+#include <util/system.h>
+
+namespace {
+/**
+ * Valid shielded proof cache, to avoid verifying expensive zk-SNARK proofs
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain)
+ */
+class CProofCache
+{
+private:
+    //! Entries are SHA256(nonce || txid || type || index):
+    uint256 nonce;
+    typedef CuckooCache::sharded_cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+
+public:
+    CProofCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void
+    ComputeEntry(uint256& entry, const uint256& txid, ShieldedProofType type, uint32_t index)
+    {
+        unsigned char buf[5];
+        buf[0] = static_cast<unsigned char>(type);
+        WriteLE32(buf + 1, index);
+        CSHA256().Write(nonce.begin(), 32).Write(txid.begin(), 32).Write(buf, sizeof(buf)).Finalize(entry.begin());
+    }
+
+    bool
+    Get(const uint256& entry, const bool erase)
+    {
+        return setValid.contains(entry, erase);
+    }
+
+    void Set(uint256& entry)
+    {
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+
+    CuckooCache::cache_stats GetStats()
+    {
+        return setValid.stats();
+    }
+};
+
+static CProofCache proofCache;
+} // namespace
+
+// To be called once in AppInitMain/BasicTestingSetup to initialize the
+// proofCache.
+void InitProofCache()
+{
+    // nMaxCacheSize is unsigned. If -maxproofcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxproofcachesize", DEFAULT_MAX_PROOF_CACHE_SIZE)), MAX_MAX_PROOF_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = proofCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for shielded proof cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+bool ProofCacheContains(const uint256& txid, ShieldedProofType type, uint32_t index, bool erase)
+{
+    uint256 entry;
+    proofCache.ComputeEntry(entry, txid, type, index);
+    return proofCache.Get(entry, erase);
+}
+
+void ProofCacheAdd(const uint256& txid, ShieldedProofType type, uint32_t index)
+{
+    uint256 entry;
+    proofCache.ComputeEntry(entry, txid, type, index);
+    proofCache.Set(entry);
+}
+
+CuckooCache::cache_stats GetProofCacheStats()
+{
+    return proofCache.GetStats();
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_PROOFCACHE_H
+#define LITECOINZ_PROOFCACHE_H
+
+#include <cuckoocache.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+// DoS prevention: limit cache size to 4MB (over 130000 entries on 64-bit
+// systems). Each entry covers a whole JoinSplit or a whole Sapling bundle.
+static const unsigned int DEFAULT_MAX_PROOF_CACHE_SIZE = 4;
+// Maximum proof cache size allowed
+static const int64_t MAX_MAX_PROOF_CACHE_SIZE = 1024;
+
+/** The kind of shielded proof check an entry of the proof cache stands for. */
+enum class ShieldedProofType : uint8_t {
+    SPROUT = 0,   //!< A single JoinSplit, identified by its index in vJoinSplit
+    SAPLING = 1,  //!< All Spend and Output descriptions plus the binding signature, identified by the consensus branch ID they were checked for
+};
+
+/**
+ * Look up a previously verified shielded proof check. The txid commits to all
+ * shielded data of a transaction, so (txid, type, index) identifies the proof
+ * and its signatures. If erase is true, a matching entry is removed.
+ */
+bool ProofCacheContains(const uint256& txid, ShieldedProofType type, uint32_t index, bool erase);
+
+/** Record a shielded proof check that verified successfully. */
+void ProofCacheAdd(const uint256& txid, ShieldedProofType type, uint32_t index);
+
+CuckooCache::cache_stats GetProofCacheStats();
+
+void InitProofCache();
+
+#endif // LITECOINZ_PROOFCACHE_H
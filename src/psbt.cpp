@@ -3,7 +3,116 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <psbt.h>
+#include <script/interpreter.h>
 #include <util/strencodings.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <thread>
+
+namespace {
+
+/**
+ * Stream that decodes base64 as it is read, so that decoding a PSBT holds
+ * no copy of its binary form. The string must outlive the reader.
+ */
+class Base64Reader
+{
+private:
+    const int m_type;
+    const int m_version;
+    const char* m_pos;
+    const char* m_end;
+    bool m_valid{false};
+    //! Decoded bytes left to read, those in m_group included
+    size_t m_remaining{0};
+    unsigned char m_group[3];
+    size_t m_group_pos{0};
+    size_t m_group_size{0};
+
+    void NextGroup()
+    {
+        uint32_t acc = 0;
+        size_t digits = 0;
+        for (; digits < 4 && m_pos != m_end; ++digits, ++m_pos) {
+            acc = (acc << 6) | Base64Digit(*m_pos);
+        }
+        // A group of n digits holds n - 1 bytes, left aligned.
+        acc <<= 6 * (4 - digits);
+        m_group[0] = acc >> 16;
+        m_group[1] = acc >> 8;
+        m_group[2] = acc;
+        m_group_pos = 0;
+        m_group_size = digits - 1;
+    }
+
+public:
+    /** Check str with the rules of DecodeBase64, see IsValid */
+    Base64Reader(int type, int version, const std::string& str) : m_type(type), m_version(version), m_pos(str.data()), m_end(str.data())
+    {
+        const char* const end = str.data() + str.size();
+        while (m_end != end && Base64Digit(*m_end) != -1) ++m_end;
+        const size_t digits = m_end - m_pos;
+        const char* p = m_end;
+        while (p != end && *p == '=') ++p;
+        if (p != end || (p - m_pos) % 4 != 0 || p - m_end >= 4) return;
+        // Trailing digits must not have bits set beyond the last byte.
+        if (digits % 4 == 1) return;
+        if (digits % 4 != 0 && (Base64Digit(m_end[-1]) & (digits % 4 == 2 ? 0xf : 0x3)) != 0) return;
+        m_valid = true;
+        m_remaining = digits * 3 / 4;
+    }
+
+    template <typename T>
+    Base64Reader& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj);
+        return *this;
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    bool IsValid() const { return m_valid; }
+    size_t size() const { return m_remaining; }
+    bool empty() const { return m_remaining == 0; }
+
+    void read(char* dst, size_t n)
+    {
+        if (n > m_remaining) {
+            throw std::ios_base::failure("Base64Reader::read(): end of data");
+        }
+        m_remaining -= n;
+        while (n > 0) {
+            if (m_group_pos == m_group_size) NextGroup();
+            const size_t chunk = std::min(n, m_group_size - m_group_pos);
+            memcpy(dst, m_group + m_group_pos, chunk);
+            m_group_pos += chunk;
+            dst += chunk;
+            n -= chunk;
+        }
+    }
+};
+
+template <typename Stream>
+bool UnserializePSBT(PartiallySignedTransaction& psbt, Stream& s, std::string& error)
+{
+    try {
+        s >> psbt;
+        if (!s.empty()) {
+            error = "extra data after PSBT";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        error = e.what();
+        return false;
+    }
+    return true;
+}
+
+} // namespace
 
 
 PartiallySignedTransaction::PartiallySignedTransaction(const CMutableTransaction& tx) : tx(tx)
@@ -213,7 +322,7 @@ void UpdatePSBTOutput(const SigningProvider& provider, PartiallySignedTransactio
     psbt_out.FromSignatureData(sigdata);
 }
 
-bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction& psbt, int index, int sighash, SignatureData* out_sigdata, bool use_dummy)
+bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction& psbt, int index, int sighash, SignatureData* out_sigdata, bool use_dummy, const PrecomputedTransactionData* txdata)
 {
     PSBTInput& input = psbt.inputs.at(index);
     const CMutableTransaction& tx = *psbt.tx;
@@ -256,7 +365,7 @@ bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction&
     if (use_dummy) {
         sig_complete = ProduceSignature(provider, DUMMY_SIGNATURE_CREATOR, utxo.scriptPubKey, sigdata);
     } else {
-        MutableTransactionSignatureCreator creator(&tx, index, utxo.nValue, sighash);
+        MutableTransactionSignatureCreator creator(&tx, index, utxo.nValue, sighash, txdata);
         sig_complete = ProduceSignature(provider, creator, utxo.scriptPubKey, sigdata);
     }
     // Verify that a witness signature was produced in case one was required.
@@ -281,18 +390,40 @@ bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction&
     return sig_complete;
 }
 
+bool SignPSBTInputs(const SigningProvider& provider, PartiallySignedTransaction& psbt, int sighash, std::vector<bool>* complete, std::vector<SignatureData>* out_sigdata, bool use_dummy)
+{
+    const size_t count = psbt.tx->vin.size();
+    // Dummy signatures hash nothing.
+    PrecomputedTransactionData txdata;
+    if (!use_dummy) txdata.Init(*psbt.tx, /* force */ true);
+    if (out_sigdata) out_sigdata->assign(count, SignatureData());
+
+    // Each input is only touched by the thread that signs it, and the
+    // transaction and txdata are only read.
+    std::vector<char> results(count);
+    std::atomic<size_t> next{0};
+    auto sign = [&] {
+        for (size_t i = next++; i < count; i = next++) {
+            results[i] = SignPSBTInput(provider, psbt, i, sighash, out_sigdata ? &(*out_sigdata)[i] : nullptr, use_dummy, &txdata);
+        }
+    };
+    const size_t threads = std::min<size_t>(std::max(1, std::min(GetNumCores(), MAX_PSBT_SIGNING_THREADS)), count / PSBT_INPUTS_PER_THREAD + 1);
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) workers.emplace_back(sign);
+    sign();
+    for (std::thread& worker : workers) worker.join();
+
+    if (complete) complete->assign(results.begin(), results.end());
+    return std::all_of(results.begin(), results.end(), [](char result) { return result != 0; });
+}
+
 bool FinalizePSBT(PartiallySignedTransaction& psbtx)
 {
     // Finalize input signatures -- in case we have partial signatures that add up to a complete
     //   signature, but have not combined them yet (e.g. because the combiner that created this
     //   PartiallySignedTransaction did not understand them), this will combine them into a final
     //   script.
-    bool complete = true;
-    for (unsigned int i = 0; i < psbtx.tx->vin.size(); ++i) {
-        complete &= SignPSBTInput(DUMMY_SIGNING_PROVIDER, psbtx, i, SIGHASH_ALL);
-    }
-
-    return complete;
+    return SignPSBTInputs(DUMMY_SIGNING_PROVIDER, psbtx, SIGHASH_ALL);
 }
 
 bool FinalizeAndExtractPSBT(PartiallySignedTransaction& psbtx, CMutableTransaction& result)
@@ -338,27 +469,16 @@ std::string PSBTRoleName(PSBTRole role) {
 
 bool DecodeBase64PSBT(PartiallySignedTransaction& psbt, const std::string& base64_tx, std::string& error)
 {
-    bool invalid;
-    std::string tx_data = DecodeBase64(base64_tx, &invalid);
-    if (invalid) {
+    Base64Reader reader(SER_NETWORK, PROTOCOL_VERSION, base64_tx);
+    if (!reader.IsValid()) {
         error = "invalid base64";
         return false;
     }
-    return DecodeRawPSBT(psbt, tx_data, error);
+    return UnserializePSBT(psbt, reader, error);
 }
 
 bool DecodeRawPSBT(PartiallySignedTransaction& psbt, const std::string& tx_data, std::string& error)
 {
     CDataStream ss_data(tx_data.data(), tx_data.data() + tx_data.size(), SER_NETWORK, PROTOCOL_VERSION);
-    try {
-        ss_data >> psbt;
-        if (!ss_data.empty()) {
-            error = "extra data after PSBT";
-            return false;
-        }
-    } catch (const std::exception& e) {
-        error = e.what();
-        return false;
-    }
-    return true;
+    return UnserializePSBT(psbt, ss_data, error);
 }
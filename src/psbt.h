@@ -17,6 +17,11 @@
 // Magic bytes
 static constexpr uint8_t PSBT_MAGIC_BYTES[5] = {'p', 's', 'b', 't', 0xff};
 
+/** The most threads SignPSBTInputs signs on */
+static const int MAX_PSBT_SIGNING_THREADS = 8;
+/** The inputs for each thread SignPSBTInputs adds, as signing one only takes tens of microseconds */
+static const size_t PSBT_INPUTS_PER_THREAD = 64;
+
 // Global types
 static constexpr uint8_t PSBT_GLOBAL_UNSIGNED_TX = 0x00;
 
@@ -519,12 +524,12 @@ struct PartiallySignedTransaction
         while (!s.empty() && i < tx->vin.size()) {
             PSBTInput input;
             s >> input;
-            inputs.push_back(input);
 
             // Make sure the non-witness utxo matches the outpoint
             if (input.non_witness_utxo && input.non_witness_utxo->GetHash() != tx->vin[i].prevout.hash) {
                 throw std::ios_base::failure("Non-witness UTXO does not match outpoint hash");
             }
+            inputs.push_back(std::move(input));
             ++i;
         }
         // Make sure that the number of inputs matches the number of inputs in the transaction
@@ -537,7 +542,7 @@ struct PartiallySignedTransaction
         while (!s.empty() && i < tx->vout.size()) {
             PSBTOutput output;
             s >> output;
-            outputs.push_back(output);
+            outputs.push_back(std::move(output));
             ++i;
         }
         // Make sure that the number of outputs matches the number of outputs in the transaction
@@ -565,8 +570,22 @@ std::string PSBTRoleName(PSBTRole role);
 /** Checks whether a PSBTInput is already signed. */
 bool PSBTInputSigned(const PSBTInput& input);
 
-/** Signs a PSBTInput, verifying that all provided data matches what is being signed. */
-bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction& psbt, int index, int sighash = SIGHASH_ALL, SignatureData* out_sigdata = nullptr, bool use_dummy = false);
+/**
+ * Signs a PSBTInput, verifying that all provided data matches what is being signed.
+ * txdata, if not null, must have been initialized from psbt.tx with force set.
+ */
+bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction& psbt, int index, int sighash = SIGHASH_ALL, SignatureData* out_sigdata = nullptr, bool use_dummy = false, const PrecomputedTransactionData* txdata = nullptr);
+
+/**
+ * Signs every PSBTInput as SignPSBTInput does, computing the sighash midstates of the
+ * transaction once for all of them. PSBTs with many inputs are signed on several threads,
+ * so provider must be safe to use from them, and the caller must not hold the locks it takes, such as
+ * cs_KeyStore of a ScriptPubKeyMan. If not null, complete and out_sigdata get the
+ * result of each input.
+ *
+ * @return True if every input is complete now
+ */
+bool SignPSBTInputs(const SigningProvider& provider, PartiallySignedTransaction& psbt, int sighash = SIGHASH_ALL, std::vector<bool>* complete = nullptr, std::vector<SignatureData>* out_sigdata = nullptr, bool use_dummy = false);
 
 /** Updates a PSBTOutput with information from provider.
  *
@@ -8,6 +8,9 @@
 #include <secp256k1.h>
 #include <secp256k1_recovery.h>
 
+#include <algorithm>
+#include <numeric>
+
 namespace
 {
 /* Global secp256k1_context object used for verification. */
@@ -33,6 +36,30 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchS
     return secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, hash.begin(), &pubkey);
 }
 
+void VerifySignatureBatch(std::vector<SignatureBatchEntry>& entries) {
+    assert(secp256k1_context_verify && "secp256k1_context_verify must be initialized to use CPubKey.");
+    // Visit the signatures grouped by public key, so that each key is parsed once
+    std::vector<size_t> order(entries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].pubkey < entries[b].pubkey; });
+    secp256k1_pubkey pubkey;
+    bool pubkey_valid = false;
+    for (size_t n = 0; n < order.size(); n++) {
+        SignatureBatchEntry& entry = entries[order[n]];
+        if (n == 0 || entries[order[n - 1]].pubkey != entry.pubkey) {
+            pubkey_valid = entry.pubkey.IsValid() && secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, entry.pubkey.data(), entry.pubkey.size());
+        }
+        // The same checks as CPubKey::Verify from here
+        secp256k1_ecdsa_signature sig;
+        entry.valid = false;
+        if (!pubkey_valid || !secp256k1_ecdsa_signature_parse_der(secp256k1_context_verify, &sig, entry.sig.data(), entry.sig.size())) {
+            continue;
+        }
+        secp256k1_ecdsa_signature_normalize(secp256k1_context_verify, &sig, &sig);
+        entry.valid = secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, entry.hash.begin(), &pubkey);
+    }
+}
+
 bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
     if (vchSig.size() != COMPACT_SIGNATURE_SIZE)
         return false;
@@ -224,6 +224,18 @@ struct CExtPubKey {
     bool Derive(CExtPubKey& out, unsigned int nChild) const;
 };
 
+/** A signature to verify with VerifySignatureBatch, and whether it is valid after that */
+struct SignatureBatchEntry
+{
+    CPubKey pubkey;
+    uint256 hash;
+    std::vector<unsigned char> sig;
+    bool valid;
+};
+
+/** Verify DER signatures like CPubKey::Verify, parsing every distinct public key once. */
+void VerifySignatureBatch(std::vector<SignatureBatchEntry>& entries);
+
 /** Users of this module must hold an ECCVerifyHandle. The constructor and
  *  destructor of these are not allowed to run in parallel, though. */
 class ECCVerifyHandle
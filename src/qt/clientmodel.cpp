@@ -19,12 +19,10 @@
 #include <stdint.h>
 
 #include <QDebug>
+#include <QMutexLocker>
 #include <QThread>
 #include <QTimer>
 
-static int64_t nLastHeaderTipUpdateNotification = 0;
-static int64_t nLastBlockTipUpdateNotification = 0;
-
 ClientModel::ClientModel(interfaces::Node& node, OptionsModel *_optionsModel, QObject *parent) :
     QObject(parent),
     m_node(node),
@@ -35,6 +33,9 @@ ClientModel::ClientModel(interfaces::Node& node, OptionsModel *_optionsModel, QO
 {
     cachedBestHeaderHeight = -1;
     cachedBestHeaderTime = -1;
+    m_tip_update_pending[0] = false;
+    m_tip_update_pending[1] = false;
+    setTip(false, m_node.getNumBlocks(), m_node.getLastBlockTime(), m_node.getVerificationProgress());
     peerTableModel = new PeerTableModel(m_node, this);
     banTableModel = new BanTableModel(m_node, this);
 
@@ -120,6 +121,51 @@ void ClientModel::updateAlert()
     Q_EMIT alertsChanged(getStatusBarWarnings());
 }
 
+int ClientModel::getNumBlocks() const
+{
+    return getTip(false).height;
+}
+
+int64_t ClientModel::getLastBlockTime() const
+{
+    return getTip(false).block_time;
+}
+
+double ClientModel::getVerificationProgress() const
+{
+    return getTip(false).verification_progress;
+}
+
+ClientModel::TipSnapshot ClientModel::getTip(bool header) const
+{
+    QMutexLocker locker(&m_tip_mutex);
+    return m_tips[header];
+}
+
+void ClientModel::setTip(bool header, int height, int64_t block_time, double verification_progress)
+{
+    QMutexLocker locker(&m_tip_mutex);
+    m_tips[header].height = height;
+    m_tips[header].block_time = block_time;
+    m_tips[header].verification_progress = verification_progress;
+}
+
+void ClientModel::updateTip(bool header, bool initial_sync)
+{
+    const int64_t now = GetTimeMillis();
+    const int64_t wait = MODEL_UPDATE_DELAY - (now - m_last_tip_update[header]);
+    if (initial_sync && wait > 0) {
+        // Still pending: later tips are shown by this update
+        QTimer::singleShot(wait, this, [this, header] { updateTip(header, false); });
+        return;
+    }
+    // Cleared before reading the tip, so that a newer one queues another update
+    m_tip_update_pending[header] = false;
+    m_last_tip_update[header] = now;
+    const TipSnapshot tip = getTip(header);
+    Q_EMIT numBlocksChanged(tip.height, QDateTime::fromTime_t(tip.block_time), tip.verification_progress, header);
+}
+
 enum BlockSource ClientModel::getBlockSource() const
 {
     if (m_node.getReindex())
@@ -226,33 +272,25 @@ static void BannedListChanged(ClientModel *clientmodel)
     assert(invoked);
 }
 
-static void BlockTipChanged(ClientModel *clientmodel, bool initialSync, int height, int64_t blockTime, double verificationProgress, bool fHeader)
+void BlockTipChanged(ClientModel *clientmodel, bool initialSync, int height, int64_t blockTime, double verificationProgress, bool fHeader)
 {
-    // lock free async UI updates in case we have a new block tip
-    // during initial sync, only update the UI if the last update
-    // was > 250ms (MODEL_UPDATE_DELAY) ago
-    int64_t now = 0;
-    if (initialSync)
-        now = GetTimeMillis();
-
-    int64_t& nLastUpdateNotification = fHeader ? nLastHeaderTipUpdateNotification : nLastBlockTipUpdateNotification;
-
+    // lock free async UI updates in case we have a new block tip: the tip is
+    // stored for the GUI to read, and an update is queued unless one already
+    // is. During initial sync, updates are shown at most every 250ms
+    // (MODEL_UPDATE_DELAY), so that the GUI does not slow the sync down.
     if (fHeader) {
         // cache best headers time and height to reduce future cs_main locks
         clientmodel->cachedBestHeaderHeight = height;
         clientmodel->cachedBestHeaderTime = blockTime;
     }
+    clientmodel->setTip(fHeader, height, blockTime, verificationProgress);
 
-    // During initial sync, block notifications, and header notifications from reindexing are both throttled.
-    if (!initialSync || (fHeader && !clientmodel->node().getReindex()) || now - nLastUpdateNotification > MODEL_UPDATE_DELAY) {
+    if (!clientmodel->m_tip_update_pending[fHeader].exchange(true)) {
         //pass an async signal to the UI thread
-        bool invoked = QMetaObject::invokeMethod(clientmodel, "numBlocksChanged", Qt::QueuedConnection,
-                                  Q_ARG(int, height),
-                                  Q_ARG(QDateTime, QDateTime::fromTime_t(blockTime)),
-                                  Q_ARG(double, verificationProgress),
-                                  Q_ARG(bool, fHeader));
+        bool invoked = QMetaObject::invokeMethod(clientmodel, "updateTip", Qt::QueuedConnection,
+                                  Q_ARG(bool, fHeader),
+                                  Q_ARG(bool, initialSync));
         assert(invoked);
-        nLastUpdateNotification = now;
     }
 }
 
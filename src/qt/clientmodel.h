@@ -7,6 +7,7 @@
 
 #include <QObject>
 #include <QDateTime>
+#include <QMutex>
 
 #include <atomic>
 #include <memory>
@@ -58,6 +59,10 @@ public:
     int getNumConnections(unsigned int flags = CONNECTIONS_ALL) const;
     int getHeaderTipHeight() const;
     int64_t getHeaderTipTime() const;
+    //! The active chain tip as last notified, read without locking cs_main
+    int getNumBlocks() const;
+    int64_t getLastBlockTime() const;
+    double getVerificationProgress() const;
 
     //! Returns enum BlockSource of the current importing/syncing state
     enum BlockSource getBlockSource() const;
@@ -93,6 +98,23 @@ private:
     //! A thread to interact with m_node asynchronously
     QThread* const m_thread;
 
+    //! A block (0) or header (1) tip, updated from the notification thread
+    struct TipSnapshot {
+        int height{-1};
+        int64_t block_time{0};
+        double verification_progress{0.0};
+    };
+    mutable QMutex m_tip_mutex;
+    TipSnapshot m_tips[2];
+    //! Whether an updateTip of each kind is queued, so that notifications coming faster than the GUI shows them are coalesced
+    std::atomic<bool> m_tip_update_pending[2];
+    //! When numBlocksChanged was last emitted for each kind, in milliseconds
+    int64_t m_last_tip_update[2]{0, 0};
+
+    TipSnapshot getTip(bool header) const;
+    void setTip(bool header, int height, int64_t block_time, double verification_progress);
+    friend void BlockTipChanged(ClientModel* clientmodel, bool initialSync, int height, int64_t blockTime, double verificationProgress, bool fHeader);
+
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
 
@@ -115,6 +137,8 @@ public Q_SLOTS:
     void updateNetworkActive(bool networkActive);
     void updateAlert();
     void updateBanlist();
+    /** Emit numBlocksChanged with the latest tip; during initial sync, at most every MODEL_UPDATE_DELAY */
+    void updateTip(bool header, bool initial_sync);
 };
 
 #endif // BITCOIN_QT_CLIENTMODEL_H
@@ -24,7 +24,12 @@
 #include <QDebug>
 #include <QIcon>
 #include <QList>
+#include <QThread>
 
+Q_DECLARE_METATYPE(QList<TransactionRecord>)
+
+//! Wallet transactions decoded at a time when loading the table
+static const size_t TRANSACTION_PAGE_SIZE = 1000;
 
 // Amount column is right-aligned it contains numbers
 static int column_alignments[] = {
@@ -53,6 +58,46 @@ struct TxLessThan
     }
 };
 
+/** Decodes the wallet transactions after the first page on a thread of its
+    own, handing the records to the model a page at a time.
+ */
+class TransactionTableLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    TransactionTableLoader(interfaces::Wallet& wallet, const uint256& after) : m_wallet(wallet), m_after(after) {}
+
+public Q_SLOTS:
+    void load();
+
+Q_SIGNALS:
+    void loaded(const QList<TransactionRecord>& records, bool done);
+
+private:
+    interfaces::Wallet& m_wallet;
+    uint256 m_after;
+};
+
+#include <qt/transactiontablemodel.moc>
+
+void TransactionTableLoader::load()
+{
+    while (!QThread::currentThread()->isInterruptionRequested()) {
+        const std::vector<interfaces::WalletTx> wtxs = m_wallet.getWalletTxsAfter(m_after, TRANSACTION_PAGE_SIZE);
+        QList<TransactionRecord> records;
+        for (const auto& wtx : wtxs) {
+            if (TransactionRecord::showTransaction()) {
+                records.append(TransactionRecord::decomposeTransaction(wtx));
+            }
+        }
+        if (!wtxs.empty()) m_after = wtxs.back().tx->GetHash();
+        const bool done = wtxs.size() < TRANSACTION_PAGE_SIZE;
+        Q_EMIT loaded(records, done);
+        if (done) return;
+    }
+}
+
 // Private implementation
 class TransactionTablePriv
 {
@@ -70,19 +115,64 @@ public:
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* Whether the rest of the wallet is still being loaded after the first
+     * page, and the updates received meanwhile, which are applied once it is
+     * done: until then cachedWallet only holds the transactions up to the
+     * last page, and new pages are appended to it.
+     */
+    bool loading{false};
+    struct PendingUpdate {
+        uint256 hash;
+        int status;
+        bool showTransaction;
+    };
+    std::vector<PendingUpdate> pendingUpdates;
+
+    /* Query the first page of the wallet anew from core. Returns the txid
+     * the loader should continue after, or null if there is no more.
      */
-    void refreshWallet(interfaces::Wallet& wallet)
+    uint256 refreshWallet(interfaces::Wallet& wallet)
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
         cachedWallet.clear();
-        {
-            for (const auto& wtx : wallet.getWalletTxs()) {
-                if (TransactionRecord::showTransaction()) {
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wtx));
-                }
+        const std::vector<interfaces::WalletTx> wtxs = wallet.getWalletTxsAfter(uint256(), TRANSACTION_PAGE_SIZE);
+        for (const auto& wtx : wtxs) {
+            if (TransactionRecord::showTransaction()) {
+                cachedWallet.append(TransactionRecord::decomposeTransaction(wtx));
             }
         }
+        loading = wtxs.size() == TRANSACTION_PAGE_SIZE;
+        return loading ? wtxs.back().tx->GetHash() : uint256();
+    }
+
+    /* Append a page of the loader, whose transactions all sort after the
+     * ones in the model.
+     */
+    void appendRecords(const QList<TransactionRecord>& records)
+    {
+        if (records.isEmpty()) return;
+        parent->beginInsertRows(QModelIndex(), cachedWallet.size(), cachedWallet.size() + records.size() - 1);
+        cachedWallet.append(records);
+        parent->endInsertRows();
+    }
+
+    /* Ranges of rows whose status may change with new blocks. A transaction
+     * that got all recommended confirmations, or whose coinbase matured, only
+     * changes when the wallet reports it with CT_UPDATED.
+     */
+    std::vector<std::pair<int, int>> unsettledRanges() const
+    {
+        std::vector<std::pair<int, int>> ranges;
+        for (int i = 0; i < cachedWallet.size(); ++i) {
+            const TransactionStatus& status = cachedWallet.at(i).status;
+            if (status.cur_num_blocks != -1 && !status.needsUpdate && status.status == TransactionStatus::Confirmed) continue;
+            if (!ranges.empty() && ranges.back().second == i - 1) {
+                ranges.back().second = i;
+            } else {
+                ranges.emplace_back(i, i);
+            }
+        }
+        return ranges;
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -93,6 +183,10 @@ public:
     void updateWallet(interfaces::Wallet& wallet, const uint256 &hash, int status, bool showTransaction)
     {
         qDebug() << "TransactionTablePriv::updateWallet: " + QString::fromStdString(hash.ToString()) + " " + QString::number(status);
+        if (loading) {
+            pendingUpdates.push_back({hash, status, showTransaction});
+            return;
+        }
 
         // Find bounds of this transaction in model
         QList<TransactionRecord>::iterator lower = std::lower_bound(
@@ -223,19 +317,50 @@ TransactionTableModel::TransactionTableModel(const PlatformStyle *_platformStyle
         platformStyle(_platformStyle)
 {
     columns << QString() << QString() << tr("Date") << tr("Type") << tr("Label") << BitcoinUnits::getAmountColumnTitle(walletModel->getOptionsModel()->getDisplayUnit());
-    priv->refreshWallet(walletModel->wallet());
+    const uint256 after = priv->refreshWallet(walletModel->wallet());
 
     connect(walletModel->getOptionsModel(), &OptionsModel::displayUnitChanged, this, &TransactionTableModel::updateDisplayUnit);
 
     subscribeToCoreSignals();
+
+    if (priv->loading) {
+        // Decode the rest of a large wallet without freezing the GUI
+        qRegisterMetaType<QList<TransactionRecord>>();
+        m_loader_thread = new QThread(this);
+        TransactionTableLoader* loader = new TransactionTableLoader(walletModel->wallet(), after);
+        loader->moveToThread(m_loader_thread);
+        connect(m_loader_thread, &QThread::started, loader, &TransactionTableLoader::load);
+        connect(loader, &TransactionTableLoader::loaded, this, [this](const QList<TransactionRecord>& records, bool done) { pageLoaded(records, done); });
+        // Make sure loader object is deleted in its own thread
+        connect(m_loader_thread, &QThread::finished, loader, &QObject::deleteLater);
+        m_loader_thread->start();
+    }
 }
 
 TransactionTableModel::~TransactionTableModel()
 {
+    if (m_loader_thread) {
+        m_loader_thread->requestInterruption();
+        m_loader_thread->quit();
+        m_loader_thread->wait();
+    }
     unsubscribeFromCoreSignals();
     delete priv;
 }
 
+void TransactionTableModel::pageLoaded(const QList<TransactionRecord>& records, bool done)
+{
+    priv->appendRecords(records);
+    if (!done) return;
+    priv->loading = false;
+    m_loader_thread->quit();
+    std::vector<TransactionTablePriv::PendingUpdate> updates;
+    updates.swap(priv->pendingUpdates);
+    for (const auto& update : updates) {
+        priv->updateWallet(walletModel->wallet(), update.hash, update.status, update.showTransaction);
+    }
+}
+
 /** Updates the column title to "Amount (DisplayUnit)" and emits headerDataChanged() signal for table headers to react. */
 void TransactionTableModel::updateAmountColumnTitle()
 {
@@ -255,10 +380,14 @@ void TransactionTableModel::updateConfirmations()
 {
     // Blocks came in since last poll.
     // Invalidate status (number of confirmations) and (possibly) description
-    //  for all rows. Qt is smart enough to only actually request the data for the
-    //  visible rows.
-    Q_EMIT dataChanged(index(0, Status), index(priv->size()-1, Status));
-    Q_EMIT dataChanged(index(0, ToAddress), index(priv->size()-1, ToAddress));
+    //  for the rows whose status can still change. Qt only requests the data
+    //  for the visible rows, but the filter proxy re-evaluates every row in
+    //  the range, so settled rows are left out: their status is refreshed
+    //  anyway when they are shown.
+    for (const auto& range : priv->unsettledRanges()) {
+        Q_EMIT dataChanged(index(range.first, Status), index(range.second, Status));
+        Q_EMIT dataChanged(index(range.first, ToAddress), index(range.second, ToAddress));
+    }
 }
 
 int TransactionTableModel::rowCount(const QModelIndex &parent) const
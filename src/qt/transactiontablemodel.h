@@ -8,6 +8,7 @@
 #include <qt/bitcoinunits.h>
 
 #include <QAbstractTableModel>
+#include <QList>
 #include <QStringList>
 
 #include <memory>
@@ -16,6 +17,10 @@ namespace interfaces {
 class Handler;
 }
 
+QT_BEGIN_NAMESPACE
+class QThread;
+QT_END_NAMESPACE
+
 class PlatformStyle;
 class TransactionRecord;
 class TransactionTablePriv;
@@ -91,6 +96,8 @@ private:
     TransactionTablePriv *priv;
     bool fProcessingQueuedTransactions;
     const PlatformStyle *platformStyle;
+    //! Loads the wallet transactions after the first page, if there are more
+    QThread *m_loader_thread{nullptr};
 
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
@@ -106,6 +113,8 @@ private:
     QVariant txStatusDecoration(const TransactionRecord *wtx) const;
     QVariant txWatchonlyDecoration(const TransactionRecord *wtx) const;
     QVariant txAddressDecoration(const TransactionRecord *wtx) const;
+    /* Add a page of transactions from the loader thread */
+    void pageLoaded(const QList<TransactionRecord>& records, bool done);
 
 public Q_SLOTS:
     /* New transaction, or transaction changed status */
@@ -18,6 +18,8 @@
 #include <util/time.h> // for GetTimeMicros()
 
 #include <stdlib.h>
+#include <map>
+#include <mutex>
 #include <thread>
 
 #include <randomenv.h>
@@ -597,6 +599,50 @@ int GetRandInt(int nMax) noexcept
     return GetRand(nMax);
 }
 
+namespace {
+struct ThreadRandomContext {
+    FastRandomContext rng;
+    unsigned int uses{0};
+
+    FastRandomContext& Take() noexcept
+    {
+        if (g_mock_deterministic_tests) {
+            rng = FastRandomContext(true);
+            // Make sure the next use outside of the mock reseeds it.
+            uses = THREAD_RANDOM_RESEED_USES;
+        } else if (++uses > THREAD_RANDOM_RESEED_USES) {
+            rng = FastRandomContext();
+            uses = 1;
+        }
+        return rng;
+    }
+};
+} // namespace
+
+FastRandomContext& GetThreadRandomContext() noexcept
+{
+#if defined(HAVE_THREAD_LOCAL)
+    static thread_local ThreadRandomContext g_thread_rng;
+    return g_thread_rng.Take();
+#else
+    // Contexts are leaked, as threads may use theirs after static destructors ran.
+    static std::mutex* g_thread_rng_mutex{new std::mutex()};
+    static std::map<std::thread::id, ThreadRandomContext>* g_thread_rngs{new std::map<std::thread::id, ThreadRandomContext>()};
+    std::lock_guard<std::mutex> lock(*g_thread_rng_mutex);
+    return (*g_thread_rngs)[std::this_thread::get_id()].Take();
+#endif
+}
+
+uint64_t GetFastRand(uint64_t nMax) noexcept
+{
+    return GetThreadRandomContext().randrange(nMax);
+}
+
+std::chrono::microseconds GetFastRandMicros(std::chrono::microseconds duration_max) noexcept
+{
+    return std::chrono::microseconds{GetFastRand(duration_max.count())};
+}
+
 uint256 GetRandHash() noexcept
 {
     uint256 hash;
@@ -227,6 +227,28 @@ void Shuffle(I first, I last, R&& rng)
     }
 }
 
+/** How many times GetThreadRandomContext hands out a thread's context before reseeding it */
+static const unsigned int THREAD_RANDOM_RESEED_USES = 10000;
+
+/**
+ * The FastRandomContext of the calling thread, for the hot paths that would
+ * otherwise construct one (or call GetRand) each time: constructing one takes
+ * the global RNG lock and hashes with SHA512 to seed it, which this does once
+ * per THREAD_RANDOM_RESEED_USES calls instead. Meant for randomness an attacker
+ * gains nothing from predicting only briefly, like shuffles and timers; keys,
+ * nonces and salts keep using GetRandBytes or GetStrongRandBytes.
+ *
+ * Use the returned reference right away, and do not keep it: the context is
+ * reseeded by a later call. With g_mock_deterministic_tests set, it returns a
+ * freshly deterministic context each time, as GetRand would use.
+ *
+ * Lock-free where thread_local is available.
+ */
+FastRandomContext& GetThreadRandomContext() noexcept;
+/** GetRand and GetRandMicros from GetThreadRandomContext, for those hot paths. */
+uint64_t GetFastRand(uint64_t nMax) noexcept;
+std::chrono::microseconds GetFastRandMicros(std::chrono::microseconds duration_max) noexcept;
+
 /* Number of random bytes returned by GetOSRand.
  * When changing this constant make sure to change all call sites, and make
  * sure that the underlying OS APIs for all platforms support the number.
@@ -7,10 +7,12 @@
 #include <chainparams.h>
 #include <core_io.h>
 #include <httpserver.h>
+#include <index/compactshieldedblockindex.h>
 #include <index/txindex.h>
 #include <node/context.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
+#include <rpc/blockcache.h>
 #include <rpc/blockchain.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
@@ -22,11 +24,16 @@
 #include <validation.h>
 #include <version.h>
 
+#include <functional>
+
 #include <boost/algorithm/string.hpp>
 
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const long MAX_REST_COMPACT_BLOCKS = 1000; //allow a max of 1000 compact blocks to be queried at once
+static const size_t REST_STREAM_CHUNK_SIZE = 1 << 20; //send range replies in chunks of about 1 MB
+static const size_t REST_STREAM_MAX_QUEUED = 16 * REST_STREAM_CHUNK_SIZE; //wait for a client that has more than this of a range reply to take
 
 enum class RetFormat {
     UNDEF,
@@ -134,6 +141,89 @@ static bool CheckWarmup(HTTPRequest* req)
     return true;
 }
 
+/**
+ * Parse the <start>/<count> of a range request into the start height and the
+ * last block of the active chain it covers. Set the HTTP error and return
+ * false if there are none.
+ */
+static bool ParseHeightRange(HTTPRequest* req, const std::string& start_str, const std::string& count_str, int32_t& start, const CBlockIndex*& stop_index)
+{
+    int32_t count;
+    if (!ParseInt32(start_str, &start) || start < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + SanitizeString(start_str));
+    if (!ParseInt32(count_str, &count) || count < 1)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Count out of range: " + SanitizeString(count_str));
+
+    LOCK(cs_main);
+    if (start > ::ChainActive().Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range");
+    stop_index = ::ChainActive()[start + std::min(count - 1, ::ChainActive().Height() - start)];
+    return true;
+}
+
+/**
+ * Send the items of the blocks from the one at height start up to stop_index
+ * one after the other as a binary reply, in chunks as they are read, waiting
+ * whenever the client falls behind. The blocks are the ancestors of
+ * stop_index, so a reorg while the reply is streamed does not mix branches.
+ * append_item returns false when the item of a block is not available, which
+ * is a 404 with the missing message for the first one; a reply already
+ * started ends early instead, for instance once the block is pruned.
+ */
+static bool StreamHeightRange(HTTPRequest* req, int32_t start, const CBlockIndex* stop_index,
+                              const std::function<bool(const CBlockIndex*, CDataStream&)>& append_item,
+                              const std::string& missing)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    bool chunked = false;
+    for (int32_t height = start; height <= stop_index->nHeight; height++) {
+        if (!append_item(stop_index->GetAncestor(height), ss)) {
+            if (height == start)
+                return RESTERR(req, HTTP_NOT_FOUND, missing);
+            break;
+        }
+        if (ss.size() >= REST_STREAM_CHUNK_SIZE) {
+            if (!chunked)
+                req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReplyChunk(ss.str());
+            ss.clear();
+            chunked = true;
+            if (!req->WaitForChunksSent(REST_STREAM_MAX_QUEUED)) {
+                // The client went away or the node is shutting down
+                req->EndChunkedReply();
+                return false;
+            }
+        }
+    }
+
+    if (!chunked) {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, ss.str());
+        return true;
+    }
+    if (!ss.empty())
+        req->WriteReplyChunk(ss.str());
+    req->EndChunkedReply();
+    return true;
+}
+
+static bool rest_headers_range(HTTPRequest* req, RetFormat rf, const std::vector<std::string>& path)
+{
+    if (rf != RetFormat::BINARY)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin)");
+
+    int32_t start;
+    const CBlockIndex* stop_index;
+    if (!ParseHeightRange(req, path[0], path[1], start, stop_index))
+        return false;
+
+    return StreamHeightRange(req, start, stop_index, [](const CBlockIndex* pindex, CDataStream& ss) -> bool {
+        LOCK(cs_main);
+        ss << pindex->GetBlockHeader();
+        return true;
+    }, "Block height out of range");
+}
+
 static bool rest_headers(HTTPRequest* req,
                          const std::string& strURIPart)
 {
@@ -147,6 +237,11 @@ static bool rest_headers(HTTPRequest* req,
     if (path.size() != 2)
         return RESTERR(req, HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
 
+    // A height and a count instead of a count and a hash ask for a range
+    int32_t range_count;
+    if (ParseInt32(path[1], &range_count))
+        return rest_headers_range(req, rf, path);
+
     long count = strtol(path[0].c_str(), nullptr, 10);
     if (count < 1 || count > 2000)
         return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[0]);
@@ -211,6 +306,158 @@ static bool rest_headers(HTTPRequest* req,
     }
 }
 
+static bool rest_compactblocks(HTTPRequest* req,
+                               const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block count specified. Use /rest/compactblocks/<count>/<height>.<ext>.");
+
+    long count = strtol(path[0].c_str(), nullptr, 10);
+    if (count < 1 || count > MAX_REST_COMPACT_BLOCKS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[0]);
+
+    int32_t start_height;
+    if (!ParseInt32(path[1], &start_height) || start_height < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + SanitizeString(path[1]));
+
+    if (!g_compact_block_index)
+        return RESTERR(req, HTTP_NOT_FOUND, "Compact block index is not enabled. Use -compactblockindex.");
+
+    const CBlockIndex* stop_index = nullptr;
+    {
+        LOCK(cs_main);
+        if (start_height > ::ChainActive().Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range");
+        stop_index = ::ChainActive()[std::min<long>(start_height + count - 1, ::ChainActive().Height())];
+    }
+
+    std::vector<CCompactShieldedBlock> blocks;
+    if (!g_compact_block_index->LookupBlockRange(start_height, stop_index, blocks))
+        return RESTERR(req, HTTP_NOT_FOUND, "Compact blocks not found; the index may still be syncing");
+
+    // The blocks are written one after the other, so that clients can
+    // process them as they are read.
+    switch (rf) {
+    case RetFormat::BINARY: {
+        CDataStream ssBlocks(SER_NETWORK, PROTOCOL_VERSION);
+        for (const CCompactShieldedBlock& block : blocks) {
+            ssBlocks << block;
+        }
+
+        std::string binaryBlocks = ssBlocks.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryBlocks);
+        return true;
+    }
+
+    case RetFormat::HEX: {
+        CDataStream ssBlocks(SER_NETWORK, PROTOCOL_VERSION);
+        for (const CCompactShieldedBlock& block : blocks) {
+            ssBlocks << block;
+        }
+
+        std::string strHex = HexStr(ssBlocks.begin(), ssBlocks.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RetFormat::JSON: {
+        UniValue jsonBlocks(UniValue::VARR);
+        for (const CCompactShieldedBlock& block : blocks) {
+            jsonBlocks.push_back(compactShieldedBlockToJSON(block));
+        }
+        std::string strJSON = jsonBlocks.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+static bool rest_compactblocks_range(HTTPRequest* req,
+                                     const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block range specified. Use /rest/compactblocks/range/<height>/<count>.bin.");
+    if (rf != RetFormat::BINARY)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin)");
+    if (!g_compact_block_index)
+        return RESTERR(req, HTTP_NOT_FOUND, "Compact block index is not enabled. Use -compactblockindex.");
+
+    int32_t start;
+    const CBlockIndex* stop_index;
+    if (!ParseHeightRange(req, path[0], path[1], start, stop_index))
+        return false;
+
+    // The index is read in batches as large as a single request may ask for
+    std::vector<CCompactShieldedBlock> batch;
+    int32_t batch_start = start;
+    return StreamHeightRange(req, start, stop_index, [&](const CBlockIndex* pindex, CDataStream& ss) -> bool {
+        const int32_t height = pindex->nHeight;
+        if (height - batch_start >= (int32_t)batch.size()) {
+            batch.clear();
+            batch_start = height;
+            const CBlockIndex* batch_stop = stop_index->GetAncestor(std::min<long>(stop_index->nHeight, height + MAX_REST_COMPACT_BLOCKS - 1));
+            if (!g_compact_block_index->LookupBlockRange(height, batch_stop, batch) || batch.empty())
+                return false;
+        }
+        ss << batch[height - batch_start];
+        return true;
+    }, "Compact blocks not found; the index may still be syncing");
+}
+
+static bool rest_blocks_range(HTTPRequest* req,
+                              const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block range specified. Use /rest/blocks/<height>/<count>.bin.");
+    if (rf != RetFormat::BINARY)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin)");
+
+    int32_t start;
+    const CBlockIndex* stop_index;
+    if (!ParseHeightRange(req, path[0], path[1], start, stop_index))
+        return false;
+
+    // The blocks are sent as they are stored on disk, without decoding them
+    return StreamHeightRange(req, start, stop_index, [](const CBlockIndex* pindex, CDataStream& ss) -> bool {
+        {
+            LOCK(cs_main);
+            if (IsBlockPruned(pindex))
+                return false;
+        }
+        std::vector<uint8_t> block;
+        if (!ReadRawBlockFromDisk(block, pindex, Params().MessageStart()))
+            return false;
+        ss.write((const char*)block.data(), block.size());
+        return true;
+    }, "Block not available (pruned data)");
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -224,6 +471,9 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
+    BlockCache* cache = g_rpc_node ? g_rpc_node->block_cache.get() : nullptr;
+    std::shared_ptr<const std::string> serialized;
+    std::shared_ptr<const BlockJSON> parts;
     CBlock block;
     CBlockIndex* pblockindex = nullptr;
     CBlockIndex* tip = nullptr;
@@ -238,31 +488,44 @@ static bool rest_block(HTTPRequest* req,
         if (IsBlockPruned(pblockindex))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if (cache) {
+            if (rf == RetFormat::JSON) {
+                parts = cache->GetJSON(hash, showTxDetails);
+            } else {
+                serialized = cache->GetSerialized(hash);
+            }
+        }
+        if (!serialized && !parts && !ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    switch (rf) {
-    case RetFormat::BINARY: {
+    if ((rf == RetFormat::BINARY || rf == RetFormat::HEX) && !serialized) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << block;
-        std::string binaryBlock = ssBlock.str();
+        serialized = std::make_shared<const std::string>(ssBlock.str());
+        if (cache) cache->PutSerialized(hash, serialized);
+    }
+
+    switch (rf) {
+    case RetFormat::BINARY: {
         req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryBlock);
+        req->WriteReply(HTTP_OK, *serialized);
         return true;
     }
 
     case RetFormat::HEX: {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::string strHex = HexStr(serialized->begin(), serialized->end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
     }
 
     case RetFormat::JSON: {
-        UniValue objBlock = blockToJSON(block, tip, pblockindex, showTxDetails);
+        if (!parts) {
+            parts = blockToJSONParts(block, pblockindex, showTxDetails);
+            if (cache) cache->PutJSON(hash, showTxDetails, parts);
+        }
+        UniValue objBlock = blockPartsToJSON(*parts, tip, pblockindex);
         std::string strJSON = objBlock.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
@@ -653,10 +916,13 @@ static const struct {
       {"/rest/tx/", rest_tx},
       {"/rest/block/notxdetails/", rest_block_notxdetails},
       {"/rest/block/", rest_block_extended},
+      {"/rest/blocks/", rest_blocks_range},
       {"/rest/chaininfo", rest_chaininfo},
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/compactblocks/range/", rest_compactblocks_range},
+      {"/rest/compactblocks/", rest_compactblocks},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/blockhashbyheight/", rest_blockhash_by_height},
 };
@@ -0,0 +1,112 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/blockcache.h>
+
+#include <chain.h>
+
+size_t UniValueUsage(const UniValue& value)
+{
+    size_t usage = value.getValStr().capacity();
+    for (const std::string& key : value.getKeys()) {
+        usage += sizeof(std::string) + key.capacity();
+    }
+    for (const UniValue& child : value.getValues()) {
+        usage += sizeof(UniValue) + UniValueUsage(child);
+    }
+    return usage;
+}
+
+const BlockCache::Entry* BlockCache::Lookup(const Key& key)
+{
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        ++m_misses;
+        return nullptr;
+    }
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return &*it->second;
+}
+
+void BlockCache::EraseEntry(std::map<Key, std::list<Entry>::iterator>::iterator it)
+{
+    m_usage -= it->second->usage;
+    m_entries.erase(it->second);
+    m_index.erase(it);
+}
+
+void BlockCache::Insert(Entry entry)
+{
+    if (entry.usage > m_max_usage) return;
+
+    auto it = m_index.find(entry.key);
+    if (it != m_index.end()) EraseEntry(it);
+    while (m_usage + entry.usage > m_max_usage) {
+        EraseEntry(m_index.find(m_entries.back().key));
+    }
+    m_usage += entry.usage;
+    m_entries.push_front(std::move(entry));
+    m_index.emplace(m_entries.front().key, m_entries.begin());
+}
+
+std::shared_ptr<const std::string> BlockCache::GetSerialized(const uint256& hash)
+{
+    LOCK(m_mutex);
+    const Entry* entry = Lookup(Key(hash, Format::SERIALIZED));
+    return entry ? entry->serialized : nullptr;
+}
+
+void BlockCache::PutSerialized(const uint256& hash, std::shared_ptr<const std::string> serialized)
+{
+    Entry entry;
+    entry.key = Key(hash, Format::SERIALIZED);
+    entry.usage = sizeof(Entry) + serialized->capacity();
+    entry.serialized = std::move(serialized);
+    LOCK(m_mutex);
+    Insert(std::move(entry));
+}
+
+std::shared_ptr<const BlockJSON> BlockCache::GetJSON(const uint256& hash, bool tx_details)
+{
+    LOCK(m_mutex);
+    const Entry* entry = Lookup(Key(hash, tx_details ? Format::JSON_TX_DETAILS : Format::JSON));
+    return entry ? entry->json : nullptr;
+}
+
+void BlockCache::PutJSON(const uint256& hash, bool tx_details, std::shared_ptr<const BlockJSON> json)
+{
+    Entry entry;
+    entry.key = Key(hash, tx_details ? Format::JSON_TX_DETAILS : Format::JSON);
+    entry.usage = sizeof(Entry) + sizeof(BlockJSON) + UniValueUsage(json->before_tx) + UniValueUsage(json->tx) + UniValueUsage(json->after_tx);
+    entry.json = std::move(json);
+    LOCK(m_mutex);
+    Insert(std::move(entry));
+}
+
+void BlockCache::Erase(const uint256& hash)
+{
+    LOCK(m_mutex);
+    for (Format format : {Format::SERIALIZED, Format::JSON, Format::JSON_TX_DETAILS}) {
+        auto it = m_index.find(Key(hash, format));
+        if (it != m_index.end()) EraseEntry(it);
+    }
+}
+
+BlockCache::Stats BlockCache::GetStats() const
+{
+    LOCK(m_mutex);
+    Stats stats;
+    stats.entries = m_entries.size();
+    stats.usage = m_usage;
+    stats.max_usage = m_max_usage;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    return stats;
+}
+
+void BlockCache::BlockDisconnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex)
+{
+    Erase(pindex->GetBlockHash());
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_RPC_BLOCKCACHE_H
+#define LITECOINZ_RPC_BLOCKCACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+#include <univalue.h>
+#include <validationinterface.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+//! Default for -rpcblockcache, in MiB
+static const int64_t DEFAULT_RPC_BLOCK_CACHE = 32;
+
+/**
+ * The parts of the JSON of a block that do not depend on the active chain.
+ * "confirmations" in before_tx is only a placeholder, and "nextblockhash" is
+ * left out of after_tx; they are filled in as the JSON is served.
+ */
+struct BlockJSON {
+    UniValue before_tx{UniValue::VOBJ};
+    UniValue tx{UniValue::VARR};
+    UniValue after_tx{UniValue::VOBJ};
+};
+
+/** Approximate memory usage of a UniValue, not counting the UniValue itself */
+size_t UniValueUsage(const UniValue& value);
+
+/**
+ * Least recently used cache of the serialized blocks and the JSON of them
+ * that getblock and the REST block endpoints return, so that explorers asking
+ * for the same recent blocks again get them without reading them from disk
+ * and converting them. Bounded by the memory its entries take up. The entries
+ * of a block are dropped when it is disconnected in a reorg, as it is then
+ * unlikely to be asked for again.
+ */
+class BlockCache final : public CValidationInterface
+{
+public:
+    enum class Format {
+        SERIALIZED,
+        JSON,
+        JSON_TX_DETAILS,
+    };
+
+    struct Stats {
+        size_t entries;
+        size_t usage;
+        size_t max_usage;
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    explicit BlockCache(size_t max_usage) : m_max_usage(max_usage) {}
+
+    /** The block serialized with the RPC serialization flags, or nullptr if it is not cached */
+    std::shared_ptr<const std::string> GetSerialized(const uint256& hash);
+    void PutSerialized(const uint256& hash, std::shared_ptr<const std::string> serialized);
+
+    /** The JSON of the block, with the transactions decoded if tx_details is set, or nullptr if it is not cached */
+    std::shared_ptr<const BlockJSON> GetJSON(const uint256& hash, bool tx_details);
+    void PutJSON(const uint256& hash, bool tx_details, std::shared_ptr<const BlockJSON> json);
+
+    /** Drop the entries of a block */
+    void Erase(const uint256& hash);
+
+    /** The most memory the entries may take up; a larger entry is not cached at all */
+    size_t MaxUsage() const { return m_max_usage; }
+
+    Stats GetStats() const;
+
+protected:
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex) override;
+
+private:
+    typedef std::pair<uint256, Format> Key;
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<const std::string> serialized;
+        std::shared_ptr<const BlockJSON> json;
+        size_t usage;
+    };
+
+    const size_t m_max_usage;
+
+    mutable Mutex m_mutex;
+    //! Most recently used first
+    std::list<Entry> m_entries GUARDED_BY(m_mutex);
+    std::map<Key, std::list<Entry>::iterator> m_index GUARDED_BY(m_mutex);
+    size_t m_usage GUARDED_BY(m_mutex){0};
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+
+    /** Move the entry of key to the front and return it, or nullptr if there is none */
+    const Entry* Lookup(const Key& key) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void Insert(Entry entry) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void EraseEntry(std::map<Key, std::list<Entry>::iterator>::iterator it) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+#endif // LITECOINZ_RPC_BLOCKCACHE_H
@@ -12,18 +12,33 @@
 #include <coins.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <dbwrapper.h>
+#include <crypto/siphash.h>
 #include <hash.h>
+#include <index/addressindex.h>
 #include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
+#include <index/coinstatsindex.h>
+#include <index/compactshieldedblockindex.h>
+#include <index/nullifierindex.h>
+#include <index/spentindex.h>
+#include <index/txindex.h>
+#include <key_io.h>
+#include <node/blockstats.h>
 #include <node/coinstats.h>
 #include <node/context.h>
 #include <node/utxo_snapshot.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
-#include <policy/rbf.h>
 #include <primitives/transaction.h>
+#include <proofcache.h>
+#include <random.h>
+#include <rpc/blockcache.h>
+#include <rpc/jsonstream.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
+#include <script/sigcache.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -40,8 +55,12 @@
 #include <univalue.h>
 
 #include <condition_variable>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <numeric>
+#include <thread>
+#include <unordered_set>
 
 struct CUpdatedBlock
 {
@@ -96,11 +115,48 @@ static int ComputeNextBlockAndDepth(const CBlockIndex* tip, const CBlockIndex* b
     return blockindex == tip ? 1 : -1;
 }
 
+//! The block of the active chain a hash_or_height parameter is for
+static CBlockIndex* ParseHashOrHeight(const UniValue& param) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (param.isNum()) {
+        const int height = param.get_int();
+        const int current_tip = ::ChainActive().Height();
+        if (height < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
+        }
+        if (height > current_tip) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
+        }
+
+        return ::ChainActive()[height];
+    }
+
+    const uint256 hash(ParseHashV(param, "hash_or_height"));
+    CBlockIndex* pindex = LookupBlockIndex(hash);
+    if (!pindex) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    }
+    if (!::ChainActive().Contains(pindex)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
+    }
+    return pindex;
+}
+
 UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex)
 {
     // Serialize passed information without accessing chain state of the active chain!
     AssertLockNotHeld(cs_main); // For performance reasons
 
+    // Unlike the header fields, these are set under cs_main when the block's
+    // transactions arrive, which may be after the entry was looked up.
+    unsigned int tx_count;
+    int64_t arrival_time;
+    {
+        LOCK(cs_main);
+        tx_count = blockindex->nTx;
+        arrival_time = blockindex->GetBlockArrivalTime();
+    }
+
     UniValue result(UniValue::VOBJ);
     result.pushKV("hash", blockindex->GetBlockHash().GetHex());
     const CBlockIndex* pnext;
@@ -114,12 +170,12 @@ UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex
     result.pushKV("time", (int64_t)blockindex->nTime);
     result.pushKV("mediantime", (int64_t)blockindex->GetMedianTimePast());
     result.pushKV("nonce", blockindex->nNonce.GetHex());
-    result.pushKV("solution", HexStr(blockindex->nSolution));
+    result.pushKV("solution", HexStr(blockindex->GetSolution()));
     result.pushKV("bits", strprintf("%08x", blockindex->nBits));
     result.pushKV("difficulty", GetDifficulty(blockindex));
     result.pushKV("chainwork", blockindex->nChainWork.GetHex());
-    result.pushKV("arrivaltime", blockindex->GetBlockArrivalTime());
-    result.pushKV("nTx", (uint64_t)blockindex->nTx);
+    result.pushKV("arrivaltime", arrival_time);
+    result.pushKV("nTx", (uint64_t)tx_count);
 
     if (blockindex->pprev)
         result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
@@ -128,16 +184,12 @@ UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails)
+/** The fields of blockToJSON before and after "tx" that do not depend on the active chain */
+static void BlockFieldsToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& result, UniValue& after_tx)
 {
-    // Serialize passed information without accessing chain state of the active chain!
-    AssertLockNotHeld(cs_main); // For performance reasons
-
-    UniValue result(UniValue::VOBJ);
     result.pushKV("hash", blockindex->GetBlockHash().GetHex());
-    const CBlockIndex* pnext;
-    int confirmations = ComputeNextBlockAndDepth(tip, blockindex, pnext);
-    result.pushKV("confirmations", confirmations);
+    // Replaced as the JSON is served, this only keeps the place of the field
+    result.pushKV("confirmations", 0);
     result.pushKV("strippedsize", (int)::GetSerializeSize(block, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
     result.pushKV("size", (int)::GetSerializeSize(block, PROTOCOL_VERSION));
     result.pushKV("weight", (int)::GetBlockWeight(block));
@@ -146,36 +198,111 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIn
     result.pushKV("versionHex", strprintf("%08x", block.nVersion));
     result.pushKV("merkleroot", block.hashMerkleRoot.GetHex());
     result.pushKV("saplingroot", block.hashSaplingRoot.GetHex());
-    UniValue txs(UniValue::VARR);
-    for(const auto& tx : block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags());
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx->GetHash().GetHex());
-    }
-    result.pushKV("tx", txs);
-    result.pushKV("time", block.GetBlockTime());
-    result.pushKV("mediantime", (int64_t)blockindex->GetMedianTimePast());
-    result.pushKV("nonce", block.nNonce.GetHex());
-    result.pushKV("solution", HexStr(block.nSolution));
-    result.pushKV("bits", strprintf("%08x", block.nBits));
-    result.pushKV("difficulty", GetDifficulty(blockindex));
-    result.pushKV("chainwork", blockindex->nChainWork.GetHex());
-    result.pushKV("arrivaltime", blockindex->GetBlockArrivalTime());
-    result.pushKV("nTx", (uint64_t)blockindex->nTx);
+    after_tx.pushKV("time", block.GetBlockTime());
+    after_tx.pushKV("mediantime", (int64_t)blockindex->GetMedianTimePast());
+    after_tx.pushKV("nonce", block.nNonce.GetHex());
+    after_tx.pushKV("solution", HexStr(block.nSolution));
+    after_tx.pushKV("bits", strprintf("%08x", block.nBits));
+    after_tx.pushKV("difficulty", GetDifficulty(blockindex));
+    after_tx.pushKV("chainwork", blockindex->nChainWork.GetHex());
+    after_tx.pushKV("arrivaltime", WITH_LOCK(cs_main, return blockindex->GetBlockArrivalTime()));
+    after_tx.pushKV("nTx", (uint64_t)block.vtx.size());
 
     if (blockindex->pprev)
-        result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
+        after_tx.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
+}
+
+static UniValue BlockTxToJSON(const CTransaction& tx, bool txDetails)
+{
+    if (!txDetails) return tx.GetHash().GetHex();
+    UniValue objTx(UniValue::VOBJ);
+    TxToUniv(tx, uint256(), objTx, true, RPCSerializationFlags());
+    return objTx;
+}
+
+std::shared_ptr<const BlockJSON> blockToJSONParts(const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+{
+    AssertLockNotHeld(cs_main);
+
+    auto parts = std::make_shared<BlockJSON>();
+    BlockFieldsToJSON(block, blockindex, parts->before_tx, parts->after_tx);
+    for (const auto& tx : block.vtx)
+        parts->tx.push_back(BlockTxToJSON(*tx, txDetails));
+    return parts;
+}
+
+UniValue blockPartsToJSON(const BlockJSON& parts, const CBlockIndex* tip, const CBlockIndex* blockindex)
+{
+    // Serialize passed information without accessing chain state of the active chain!
+    AssertLockNotHeld(cs_main); // For performance reasons
+
+    UniValue result = parts.before_tx;
+    const CBlockIndex* pnext;
+    result.pushKV("confirmations", ComputeNextBlockAndDepth(tip, blockindex, pnext));
+    result.pushKV("tx", parts.tx);
+    result.pushKVs(parts.after_tx);
     if (pnext)
         result.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
     return result;
 }
 
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails)
+{
+    return blockPartsToJSON(*blockToJSONParts(block, blockindex, txDetails), tip, blockindex);
+}
+
+/**
+ * Write what blockPartsToJSON returns. A block that is not cached is written
+ * one transaction at a time as it is converted, and its parts are kept for
+ * the cache as long as they fit into it.
+ */
+static void blockToJSONStream(JSONStreamWriter& stream, const BlockJSON* cached, const CBlock& block, const CBlockIndex* tip,
+                              const CBlockIndex* blockindex, bool txDetails, BlockCache* cache)
+{
+    AssertLockNotHeld(cs_main);
+
+    std::shared_ptr<BlockJSON> parts;
+    if (!cached) {
+        parts = std::make_shared<BlockJSON>();
+        BlockFieldsToJSON(block, blockindex, parts->before_tx, parts->after_tx);
+    }
+    const BlockJSON& fields = cached ? *cached : *parts;
+    bool keep = !cached && cache;
+    UniValue before_tx = fields.before_tx;
+    const CBlockIndex* pnext;
+    before_tx.pushKV("confirmations", ComputeNextBlockAndDepth(tip, blockindex, pnext));
+
+    stream.BeginObject();
+    stream.Fields(before_tx);
+    stream.Key("tx");
+    stream.BeginArray();
+    if (cached) {
+        for (const UniValue& tx : cached->tx.getValues())
+            stream.Value(tx);
+    } else {
+        size_t usage = 0;
+        for (const auto& tx : block.vtx) {
+            UniValue tx_json = BlockTxToJSON(*tx, txDetails);
+            stream.Value(tx_json);
+            if (!keep) continue;
+            usage += sizeof(UniValue) + UniValueUsage(tx_json);
+            if (usage > cache->MaxUsage()) {
+                keep = false;
+                parts->tx = UniValue(UniValue::VARR);
+                continue;
+            }
+            parts->tx.push_back(std::move(tx_json));
+        }
+    }
+    stream.EndArray();
+    stream.Fields(fields.after_tx);
+    if (pnext)
+        stream.KV("nextblockhash", pnext->GetBlockHash().GetHex());
+    stream.EndObject();
+
+    if (keep) cache->PutJSON(blockindex->GetBlockHash(), txDetails, std::move(parts));
+}
+
 static UniValue getblockcount(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getblockcount",
@@ -190,8 +317,7 @@ static UniValue getblockcount(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
-    return ::ChainActive().Height();
+    return ::ChainActive().TipSnapshot()->nHeight;
 }
 
 static UniValue getbestblockhash(const JSONRPCRequest& request)
@@ -207,8 +333,7 @@ static UniValue getbestblockhash(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
-    return ::ChainActive().Tip()->GetBlockHash().GetHex();
+    return ::ChainActive().TipSnapshot()->GetBlockHash().GetHex();
 }
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
@@ -362,6 +487,118 @@ static UniValue syncwithvalidationinterfacequeue(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue getvalidationqueueinfo(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"getvalidationqueueinfo",
+        "\nReturns the state of the validation callback queues of the wallets, indexes and other subscribers.\n",
+        {},
+        RPCResult{
+            RPCResult::Type::ARR, "", "",
+            {
+                {RPCResult::Type::OBJ, "", "",
+                {
+                    {RPCResult::Type::STR, "name", "the subscriber, e.g. wallet or txindex"},
+                    {RPCResult::Type::NUM, "pending", "the callbacks waiting to run"},
+                    {RPCResult::Type::NUM, "peak_pending", "the most callbacks that were waiting at once"},
+                    {RPCResult::Type::NUM, "callbacks", "the callbacks run since the subscriber registered"},
+                    {RPCResult::Type::NUM, "run_time", "the time spent running them, in seconds"},
+                }},
+            }
+        },
+        RPCExamples{
+            HelpExampleCli("getvalidationqueueinfo", "")
+            + HelpExampleRpc("getvalidationqueueinfo", "")
+        },
+    }.Check(request);
+
+    UniValue ret(UniValue::VARR);
+    for (const ValidationQueueInfo& info : GetMainSignals().GetQueueInfo()) {
+        UniValue queue(UniValue::VOBJ);
+        queue.pushKV("name", info.name);
+        queue.pushKV("pending", (uint64_t)info.pending);
+        queue.pushKV("peak_pending", (uint64_t)info.peak_pending);
+        queue.pushKV("callbacks", info.callbacks_run);
+        queue.pushKV("run_time", info.run_time.count() / 1e6);
+        ret.push_back(queue);
+    }
+    return ret;
+}
+
+static UniValue getvalidationstats(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"getvalidationstats",
+        "\nReturns how long each step of block validation took, since startup and over the most recent blocks.\n"
+        "Proof verification is summed over the verification threads, so it can exceed the time of the step it is part of.\n",
+        {},
+        RPCResult{
+            RPCResult::Type::OBJ, "", "",
+            {
+                {RPCResult::Type::ARR, "bucket_bounds_ms", "upper bounds of the histogram buckets, in milliseconds; a last bucket holds longer times",
+                    {{RPCResult::Type::NUM, "", ""}}},
+                {RPCResult::Type::OBJ_DYN, "phases", "",
+                {
+                    {RPCResult::Type::OBJ, "phase", "the step, e.g. connect_block, proof_verification or equihash",
+                    {
+                        {RPCResult::Type::NUM, "count", "the number of timings since startup"},
+                        {RPCResult::Type::NUM, "total", "their total, in seconds"},
+                        {RPCResult::Type::NUM, "mean_ms", "their mean, in milliseconds"},
+                        {RPCResult::Type::ARR, "histogram", "the number of timings in each bucket",
+                            {{RPCResult::Type::NUM, "", ""}}},
+                        {RPCResult::Type::OBJ, "recent", strprintf("the last %u timings", VALIDATION_TIMING_RECENT),
+                        {
+                            {RPCResult::Type::NUM, "count", "the number of timings"},
+                            {RPCResult::Type::NUM, "mean_ms", "their mean, in milliseconds"},
+                            {RPCResult::Type::NUM, "p90_ms", "their 90th percentile, in milliseconds"},
+                            {RPCResult::Type::NUM, "max_ms", "their maximum, in milliseconds"},
+                        }},
+                    }},
+                }},
+            }
+        },
+        RPCExamples{
+            HelpExampleCli("getvalidationstats", "")
+            + HelpExampleRpc("getvalidationstats", "")
+        },
+    }.Check(request);
+
+    UniValue bounds(UniValue::VARR);
+    for (int64_t bound : VALIDATION_TIMING_BOUNDS) {
+        bounds.push_back(bound / 1e3);
+    }
+
+    UniValue phases(UniValue::VOBJ);
+    for (size_t i = 0; i < size_t(ValidationPhase::COUNT); i++) {
+        const ValidationPhase phase = ValidationPhase(i);
+        ValidationTimingStats stats = GetValidationTimingStats(phase);
+
+        UniValue histogram(UniValue::VARR);
+        for (uint64_t count : stats.histogram) {
+            histogram.push_back(count);
+        }
+
+        UniValue recent(UniValue::VOBJ);
+        std::vector<int64_t>& recent_us = stats.recent_us;
+        std::sort(recent_us.begin(), recent_us.end());
+        recent.pushKV("count", (uint64_t)recent_us.size());
+        recent.pushKV("mean_ms", recent_us.empty() ? 0 : std::accumulate(recent_us.begin(), recent_us.end(), int64_t{0}) / 1e3 / recent_us.size());
+        recent.pushKV("p90_ms", recent_us.empty() ? 0 : recent_us[(recent_us.size() * 9 + 9) / 10 - 1] / 1e3);
+        recent.pushKV("max_ms", recent_us.empty() ? 0 : recent_us.back() / 1e3);
+
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("count", stats.count);
+        entry.pushKV("total", stats.total_us / 1e6);
+        entry.pushKV("mean_ms", stats.count == 0 ? 0 : stats.total_us / 1e3 / stats.count);
+        entry.pushKV("histogram", histogram);
+        entry.pushKV("recent", recent);
+        phases.pushKV(ValidationPhaseName(phase), entry);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("bucket_bounds_ms", bounds);
+    ret.pushKV("phases", phases);
+    return ret;
+}
+
 static UniValue getdifficulty(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getdifficulty",
@@ -375,8 +612,7 @@ static UniValue getdifficulty(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
-    return GetDifficulty(::ChainActive().Tip());
+    return GetDifficulty(::ChainActive().TipSnapshot());
 }
 
 static std::vector<RPCResult> MempoolEntryDescription() { return {
@@ -409,77 +645,74 @@ static std::vector<RPCResult> MempoolEntryDescription() { return {
     RPCResult{RPCResult::Type::BOOL, "bip125-replaceable", "Whether this transaction could be replaced due to BIP125 (replace-by-fee)"},
 };}
 
-static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPoolEntry& e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+static void entryToJSON(UniValue& info, const MempoolSnapshot::Entry& e)
 {
-    AssertLockHeld(pool.cs);
-
     UniValue fees(UniValue::VOBJ);
-    fees.pushKV("base", ValueFromAmount(e.GetFee()));
-    fees.pushKV("modified", ValueFromAmount(e.GetModifiedFee()));
-    fees.pushKV("ancestor", ValueFromAmount(e.GetModFeesWithAncestors()));
-    fees.pushKV("descendant", ValueFromAmount(e.GetModFeesWithDescendants()));
+    fees.pushKV("base", ValueFromAmount(e.fee));
+    fees.pushKV("modified", ValueFromAmount(e.modified_fee));
+    fees.pushKV("ancestor", ValueFromAmount(e.mod_fees_with_ancestors));
+    fees.pushKV("descendant", ValueFromAmount(e.mod_fees_with_descendants));
     info.pushKV("fees", fees);
 
-    info.pushKV("vsize", (int)e.GetTxSize());
-    if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.GetTxSize());
-    info.pushKV("weight", (int)e.GetTxWeight());
-    info.pushKV("fee", ValueFromAmount(e.GetFee()));
-    info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
-    info.pushKV("time", count_seconds(e.GetTime()));
-    info.pushKV("height", (int)e.GetHeight());
-    info.pushKV("descendantcount", e.GetCountWithDescendants());
-    info.pushKV("descendantsize", e.GetSizeWithDescendants());
-    info.pushKV("descendantfees", e.GetModFeesWithDescendants());
-    info.pushKV("ancestorcount", e.GetCountWithAncestors());
-    info.pushKV("ancestorsize", e.GetSizeWithAncestors());
-    info.pushKV("ancestorfees", e.GetModFeesWithAncestors());
-    info.pushKV("wtxid", pool.vTxHashes[e.vTxHashesIdx].first.ToString());
-    const CTransaction& tx = e.GetTx();
+    info.pushKV("vsize", (int)e.vsize);
+    if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.vsize);
+    info.pushKV("weight", (int)e.weight);
+    info.pushKV("fee", ValueFromAmount(e.fee));
+    info.pushKV("modifiedfee", ValueFromAmount(e.modified_fee));
+    info.pushKV("time", count_seconds(e.time));
+    info.pushKV("height", (int)e.height);
+    info.pushKV("descendantcount", e.count_with_descendants);
+    info.pushKV("descendantsize", e.size_with_descendants);
+    info.pushKV("descendantfees", e.mod_fees_with_descendants);
+    info.pushKV("ancestorcount", e.count_with_ancestors);
+    info.pushKV("ancestorsize", e.size_with_ancestors);
+    info.pushKV("ancestorfees", e.mod_fees_with_ancestors);
+    info.pushKV("wtxid", e.tx->GetWitnessHash().ToString());
+
     std::set<std::string> setDepends;
-    for (const CTxIn& txin : tx.vin)
-    {
-        if (pool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
+    for (const uint256& parent : e.parents) {
+        setDepends.insert(parent.ToString());
     }
-
     UniValue depends(UniValue::VARR);
-    for (const std::string& dep : setDepends)
-    {
+    for (const std::string& dep : setDepends) {
         depends.push_back(dep);
     }
-
     info.pushKV("depends", depends);
 
     UniValue spent(UniValue::VARR);
-    const CTxMemPool::txiter& it = pool.mapTx.find(tx.GetHash());
-    const CTxMemPool::setEntries& setChildren = pool.GetMemPoolChildren(it);
-    for (CTxMemPool::txiter childiter : setChildren) {
-        spent.push_back(childiter->GetTx().GetHash().ToString());
+    for (const uint256& child : e.children) {
+        spent.push_back(child.ToString());
     }
-
     info.pushKV("spentby", spent);
 
-    // Add opt-in RBF status
-    bool rbfStatus = false;
-    RBFTransactionState rbfState = IsRBFOptIn(tx, pool);
-    if (rbfState == RBFTransactionState::UNKNOWN) {
-        throw JSONRPCError(RPC_MISC_ERROR, "Transaction is not in mempool");
-    } else if (rbfState == RBFTransactionState::REPLACEABLE_BIP125) {
-        rbfStatus = true;
-    }
+    info.pushKV("bip125-replaceable", e.bip125_replaceable);
+}
 
-    info.pushKV("bip125-replaceable", rbfStatus);
+/** Write what MempoolToJSON returns when verbose, one entry at a time */
+static void MempoolToJSONStream(JSONStreamWriter& stream, const CTxMemPool& pool)
+{
+    const std::shared_ptr<const MempoolSnapshot> snapshot = pool.GetSnapshot();
+    stream.BeginObject();
+    for (const MempoolSnapshot::Entry& e : snapshot->entries) {
+        UniValue info(UniValue::VOBJ);
+        entryToJSON(info, e);
+        stream.KV(e.tx->GetHash().ToString(), info);
+    }
+    stream.EndObject();
 }
 
-UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose)
+UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose, bool include_mempool_sequence)
 {
     if (verbose) {
-        LOCK(pool.cs);
+        if (include_mempool_sequence) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
+        }
+        const std::shared_ptr<const MempoolSnapshot> snapshot = pool.GetSnapshot();
         UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry& e : pool.mapTx) {
-            const uint256& hash = e.GetTx().GetHash();
+        for (const MempoolSnapshot::Entry& e : snapshot->entries) {
+            const uint256& hash = e.tx->GetHash();
             UniValue info(UniValue::VOBJ);
-            entryToJSON(pool, info, e);
+            entryToJSON(info, e);
             // Mempool has unique entries so there is no advantage in using
             // UniValue::pushKV, which checks if the key already exists in O(N).
             // UniValue::__pushKV is used instead which currently is O(1).
@@ -487,14 +720,20 @@ UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose)
         }
         return o;
     } else {
-        std::vector<uint256> vtxid;
-        pool.queryHashes(vtxid);
+        const std::shared_ptr<const MempoolSnapshot> snapshot = pool.GetSnapshot();
 
         UniValue a(UniValue::VARR);
-        for (const uint256& hash : vtxid)
-            a.push_back(hash.ToString());
+        for (const MempoolSnapshot::Entry& e : snapshot->entries)
+            a.push_back(e.tx->GetHash().ToString());
 
-        return a;
+        if (!include_mempool_sequence) {
+            return a;
+        } else {
+            UniValue o(UniValue::VOBJ);
+            o.pushKV("txids", a);
+            o.pushKV("mempool_sequence", snapshot->sequence);
+            return o;
+        }
     }
 }
 
@@ -505,6 +744,7 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
                 "\nHint: use getmempoolentry to fetch a specific transaction from the mempool.\n",
                 {
                     {"verbose", RPCArg::Type::BOOL, /* default */ "false", "True for a json object, false for array of transaction ids"},
+                    {"mempool_sequence", RPCArg::Type::BOOL, /* default */ "false", "If verbose=false, returns a json object with transaction list and mempool sequence number attached."},
                 },
                 {
                     RPCResult{"for verbose = false",
@@ -517,6 +757,15 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
                         {
                             {RPCResult::Type::OBJ_DYN, "transactionid", "", MempoolEntryDescription()},
                         }},
+                    RPCResult{"for verbose = false and mempool_sequence = true",
+                        RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::ARR, "txids", "",
+                            {
+                                {RPCResult::Type::STR_HEX, "", "The transaction id"},
+                            }},
+                            {RPCResult::Type::NUM, "mempool_sequence", "The mempool sequence value."},
+                        }},
                 },
                 RPCExamples{
                     HelpExampleCli("getrawmempool", "true")
@@ -528,7 +777,16 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
-    return MempoolToJSON(EnsureMemPool(), fVerbose);
+    bool include_mempool_sequence = false;
+    if (!request.params[1].isNull()) {
+        include_mempool_sequence = request.params[1].get_bool();
+    }
+
+    if (fVerbose && !include_mempool_sequence && request.stream) {
+        MempoolToJSONStream(*request.stream, EnsureMemPool());
+        return NullUniValue;
+    }
+    return MempoolToJSON(EnsureMemPool(), fVerbose, include_mempool_sequence);
 }
 
 static UniValue getmempoolancestors(const JSONRPCRequest& request)
@@ -558,34 +816,28 @@ static UniValue getmempoolancestors(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    const CTxMemPool& mempool = EnsureMemPool();
-    LOCK(mempool.cs);
+    const std::shared_ptr<const MempoolSnapshot> snapshot = EnsureMemPool().GetSnapshot();
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    const MempoolSnapshot::Entry* entry = snapshot->Find(hash);
+    if (!entry) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    CTxMemPool::setEntries setAncestors;
-    uint64_t noLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
+    const std::vector<const MempoolSnapshot::Entry*> ancestors = snapshot->Ancestors(*entry);
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            o.push_back(ancestorIt->GetTx().GetHash().ToString());
+        for (const MempoolSnapshot::Entry* ancestor : ancestors) {
+            o.push_back(ancestor->tx->GetHash().ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            const CTxMemPoolEntry &e = *ancestorIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        for (const MempoolSnapshot::Entry* ancestor : ancestors) {
             UniValue info(UniValue::VOBJ);
-            entryToJSON(mempool, info, e);
-            o.pushKV(_hash.ToString(), info);
+            entryToJSON(info, *ancestor);
+            o.__pushKV(ancestor->tx->GetHash().ToString(), info);
         }
         return o;
     }
@@ -621,34 +873,28 @@ static UniValue getmempooldescendants(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    const CTxMemPool& mempool = EnsureMemPool();
-    LOCK(mempool.cs);
+    const std::shared_ptr<const MempoolSnapshot> snapshot = EnsureMemPool().GetSnapshot();
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    const MempoolSnapshot::Entry* entry = snapshot->Find(hash);
+    if (!entry) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    CTxMemPool::setEntries setDescendants;
-    mempool.CalculateDescendants(it, setDescendants);
-    // CTxMemPool::CalculateDescendants will include the given tx
-    setDescendants.erase(it);
+    const std::vector<const MempoolSnapshot::Entry*> descendants = snapshot->Descendants(*entry);
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            o.push_back(descendantIt->GetTx().GetHash().ToString());
+        for (const MempoolSnapshot::Entry* descendant : descendants) {
+            o.push_back(descendant->tx->GetHash().ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            const CTxMemPoolEntry &e = *descendantIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        for (const MempoolSnapshot::Entry* descendant : descendants) {
             UniValue info(UniValue::VOBJ);
-            entryToJSON(mempool, info, e);
-            o.pushKV(_hash.ToString(), info);
+            entryToJSON(info, *descendant);
+            o.__pushKV(descendant->tx->GetHash().ToString(), info);
         }
         return o;
     }
@@ -671,17 +917,15 @@ static UniValue getmempoolentry(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    const CTxMemPool& mempool = EnsureMemPool();
-    LOCK(mempool.cs);
+    const std::shared_ptr<const MempoolSnapshot> snapshot = EnsureMemPool().GetSnapshot();
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    const MempoolSnapshot::Entry* entry = snapshot->Find(hash);
+    if (!entry) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    const CTxMemPoolEntry &e = *it;
     UniValue info(UniValue::VOBJ);
-    entryToJSON(mempool, info, e);
+    entryToJSON(info, *entry);
     return info;
 }
 
@@ -700,13 +944,13 @@ static UniValue getblockhash(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
+    const CBlockIndex* tip = ::ChainActive().TipSnapshot();
 
     int nHeight = request.params[0].get_int();
-    if (nHeight < 0 || nHeight > ::ChainActive().Height())
+    if (nHeight < 0 || nHeight > tip->nHeight)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = ::ChainActive()[nHeight];
+    const CBlockIndex* pblockindex = tip->GetAncestor(nHeight);
     return pblockindex->GetBlockHash().GetHex();
 }
 
@@ -754,13 +998,10 @@ static UniValue getblockheader(const JSONRPCRequest& request)
     if (!request.params[1].isNull())
         fVerbose = request.params[1].get_bool();
 
-    const CBlockIndex* pblockindex;
-    const CBlockIndex* tip;
-    {
-        LOCK(cs_main);
-        pblockindex = LookupBlockIndex(hash);
-        tip = ::ChainActive().Tip();
-    }
+    // Neither needs cs_main, so that header lookups do not wait for validation.
+    // Only the transaction count and arrival time of the verbose result do.
+    const CBlockIndex* pblockindex = LookupBlockIndexShared(hash);
+    const CBlockIndex* tip = ::ChainActive().TipSnapshot();
 
     if (!pblockindex) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
@@ -877,6 +1118,9 @@ static UniValue getblock(const JSONRPCRequest& request)
             verbosity = request.params[1].get_bool() ? 1 : 0;
     }
 
+    BlockCache* cache = g_rpc_node ? g_rpc_node->block_cache.get() : nullptr;
+    std::shared_ptr<const std::string> serialized;
+    std::shared_ptr<const BlockJSON> parts;
     CBlock block;
     const CBlockIndex* pblockindex;
     const CBlockIndex* tip;
@@ -889,18 +1133,36 @@ static UniValue getblock(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
         }
 
-        block = GetBlockChecked(pblockindex);
+        if (cache) {
+            if (verbosity <= 0) {
+                serialized = cache->GetSerialized(hash);
+            } else {
+                parts = cache->GetJSON(hash, verbosity >= 2);
+            }
+        }
+        if (!serialized && !parts) block = GetBlockChecked(pblockindex);
     }
 
     if (verbosity <= 0)
     {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        if (!serialized) {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << block;
+            serialized = std::make_shared<const std::string>(ssBlock.str());
+            if (cache) cache->PutSerialized(hash, serialized);
+        }
+        return HexStr(serialized->begin(), serialized->end());
     }
 
-    return blockToJSON(block, tip, pblockindex, verbosity >= 2);
+    if (request.stream) {
+        blockToJSONStream(*request.stream, parts.get(), block, tip, pblockindex, verbosity >= 2, cache);
+        return NullUniValue;
+    }
+    if (!parts) {
+        parts = blockToJSONParts(block, pblockindex, verbosity >= 2);
+        if (cache) cache->PutJSON(hash, verbosity >= 2, parts);
+    }
+    return blockPartsToJSON(*parts, tip, pblockindex);
 }
 
 static UniValue pruneblockchain(const JSONRPCRequest& request)
@@ -962,44 +1224,107 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
             RPCHelpMan{"gettxoutsetinfo",
                 "\nReturns statistics about the unspent transaction output set.\n"
-                "Note this call may take some time.\n",
-                {},
+                "Note this call may take some time without -coinstatsindex, or with hash_type hash_serialized_2.\n",
+                {
+                    {"hash_type", RPCArg::Type::STR, /* default */ "hash_serialized_2", "Which UTXO set hash should be calculated. Options: 'hash_serialized_2' (the legacy algorithm), 'muhash', 'none'."},
+                    {"hash_or_height", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "The block hash or height of the target block, only available with -coinstatsindex", "", {"", "string or numeric"}},
+                },
                 RPCResult{
                     RPCResult::Type::OBJ, "", "",
                     {
-                        {RPCResult::Type::NUM, "height", "The current block height (index)"},
-                        {RPCResult::Type::STR_HEX, "bestblock", "The hash of the block at the tip of the chain"},
-                        {RPCResult::Type::NUM, "transactions", "The number of transactions with unspent outputs"},
+                        {RPCResult::Type::NUM, "height", "The block height (index) of the returned statistics"},
+                        {RPCResult::Type::STR_HEX, "bestblock", "The hash of the block at which these statistics are calculated"},
+                        {RPCResult::Type::NUM, "transactions", /* optional */ true, "The number of transactions with unspent outputs (not available when coinstatsindex is used)"},
                         {RPCResult::Type::NUM, "txouts", "The number of unspent transaction outputs"},
                         {RPCResult::Type::NUM, "bogosize", "A meaningless metric for UTXO set size"},
-                        {RPCResult::Type::STR_HEX, "hash_serialized_2", "The serialized hash"},
+                        {RPCResult::Type::STR_HEX, "hash_serialized_2", /* optional */ true, "The serialized hash (only present if 'hash_serialized_2' hash_type is chosen)"},
+                        {RPCResult::Type::STR_HEX, "muhash", /* optional */ true, "The serialized hash (only present if 'muhash' hash_type is chosen)"},
                         {RPCResult::Type::NUM, "disk_size", "The estimated size of the chainstate on disk"},
                         {RPCResult::Type::STR_AMOUNT, "total_amount", "The total amount"},
+                        {RPCResult::Type::OBJ, "nullifier_filter", "The in-memory filter of spent Sapling nullifiers",
+                            {
+                                {RPCResult::Type::NUM, "elements", "The number of nullifiers in the filter"},
+                                {RPCResult::Type::NUM, "capacity", "The number of nullifiers the filter is sized for"},
+                                {RPCResult::Type::NUM, "size", "The size of the filter in bytes"},
+                                {RPCResult::Type::NUM, "false_positive_rate", "The estimated false positive rate at the current number of elements"},
+                            }},
                     }},
                 RPCExamples{
                     HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"none\"")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\" 1000")
             + HelpExampleRpc("gettxoutsetinfo", "")
+            + HelpExampleRpc("gettxoutsetinfo", "\"muhash\", 1000")
                 },
             }.Check(request);
 
     UniValue ret(UniValue::VOBJ);
 
+    CoinStatsHashType hash_type{CoinStatsHashType::HASH_SERIALIZED};
+    if (!request.params[0].isNull()) {
+        const std::string hash_type_input = request.params[0].get_str();
+        if (hash_type_input == "hash_serialized_2") {
+            hash_type = CoinStatsHashType::HASH_SERIALIZED;
+        } else if (hash_type_input == "muhash") {
+            hash_type = CoinStatsHashType::MUHASH;
+        } else if (hash_type_input == "none") {
+            hash_type = CoinStatsHashType::NONE;
+        } else {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type_input));
+        }
+    }
+
+    CBlockIndex* pindex = nullptr;
+    if (!request.params[1].isNull()) {
+        if (!g_coin_stats_index) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Querying specific block heights requires -coinstatsindex");
+        }
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_serialized_2 hash type cannot be queried for a specific block");
+        }
+        LOCK(cs_main);
+        pindex = ParseHashOrHeight(request.params[1]);
+    }
+
     CCoinsStats stats;
-    ::ChainstateActive().ForceFlushStateToDisk();
+    // The index answers without the coins database.
+    if (pindex == nullptr || hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+        ::ChainstateActive().ForceFlushStateToDisk();
+    }
 
     CCoinsView* coins_view = WITH_LOCK(cs_main, return &ChainstateActive().CoinsDB());
-    if (GetUTXOStats(coins_view, stats)) {
+    if (GetUTXOStats(coins_view, stats, hash_type, pindex)) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
-        ret.pushKV("transactions", (int64_t)stats.nTransactions);
+        if (!stats.index_used) {
+            ret.pushKV("transactions", (int64_t)stats.nTransactions);
+        }
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
         ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
-        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        }
+        if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.muhash.GetHex());
+        }
         ret.pushKV("disk_size", stats.nDiskSize);
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+    } else if (pindex != nullptr) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("Block %s is not in the coin stats index yet", pindex->GetBlockHash().GetHex()));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
     }
+
+    UniValue filter(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        const CNullifierFilter& nullifier_filter = ::ChainstateActive().CoinsDB().GetNullifierFilter();
+        filter.pushKV("elements", nullifier_filter.GetElements());
+        filter.pushKV("capacity", nullifier_filter.GetCapacity());
+        filter.pushKV("size", (uint64_t)nullifier_filter.GetSize());
+        filter.pushKV("false_positive_rate", nullifier_filter.GetFalsePositiveRate());
+    }
+    ret.pushKV("nullifier_filter", filter);
     return ret;
 }
 
@@ -1106,6 +1431,20 @@ static UniValue verifychain(const JSONRPCRequest& request)
     return CVerifyDB().VerifyDB(Params(), &::ChainstateActive().CoinsTip(), check_level, check_depth);
 }
 
+static UniValue ValuePoolDesc(const std::string& name, const Optional<CAmount> chainValue, const Optional<uint64_t> chainNotes, const Optional<uint64_t> chainNullifiers)
+{
+    UniValue rv(UniValue::VOBJ);
+    rv.pushKV("id", name);
+    rv.pushKV("monitored", (bool)chainValue);
+    if (chainValue) {
+        rv.pushKV("chainValue", ValueFromAmount(*chainValue));
+        rv.pushKV("chainValueZat", *chainValue);
+    }
+    if (chainNotes) rv.pushKV("notes", *chainNotes);
+    if (chainNullifiers) rv.pushKV("nullifiers", *chainNullifiers);
+    return rv;
+}
+
 static void BuriedForkDescPushBack(UniValue& softforks, const std::string &name, int height) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     // For buried deployments.
@@ -1194,6 +1533,13 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM, "pruneheight", "lowest-height complete block stored (only present if pruning is enabled)"},
                         {RPCResult::Type::BOOL, "automatic_pruning", "whether automatic pruning is enabled (only present if pruning is enabled)"},
                         {RPCResult::Type::NUM, "prune_target_size", "the target size used by pruning (only present if automatic pruning is enabled)"},
+                        {RPCResult::Type::OBJ, "snapshot", "the UTXO snapshot the chain was loaded from with loadtxoutset (only present if it was, until the next start after it was validated)",
+                        {
+                            {RPCResult::Type::STR_HEX, "base_hash", "the hash of the base of the snapshot"},
+                            {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                            {RPCResult::Type::BOOL, "validated", "whether the fully validated chain arrived at the UTXO set of the snapshot"},
+                            {RPCResult::Type::NUM, "background_height", "the height the fully validated chain is at (only present until validated)"},
+                        }},
                         {RPCResult::Type::OBJ_DYN, "softforks", "status of softforks",
                         {
                             {RPCResult::Type::OBJ, "xxxx", "name of the softfork",
@@ -1219,6 +1565,18 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
                                 {RPCResult::Type::BOOL, "active", "true if the rules are enforced for the mempool and the next block"},
                             }},
                         }},
+                        {RPCResult::Type::ARR, "valuePools", "the shielded value pools, as of the current best block",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR, "id", "the pool, one of \"sprout\", \"sapling\""},
+                                {RPCResult::Type::BOOL, "monitored", "true if the value in the pool is known for the whole chain"},
+                                {RPCResult::Type::STR_AMOUNT, "chainValue", "total value held by the pool (only if monitored)"},
+                                {RPCResult::Type::NUM, "chainValueZat", "total value held by the pool in zatoshis (only if monitored)"},
+                                {RPCResult::Type::NUM, "notes", "the number of notes ever created in the pool (only if known for the whole chain)"},
+                                {RPCResult::Type::NUM, "nullifiers", "the number of nullifiers ever revealed in the pool (only if known for the whole chain)"},
+                            }},
+                        }},
                         {RPCResult::Type::STR, "warnings", "any network and blockchain warnings"},
                     }},
                 RPCExamples{
@@ -1258,6 +1616,16 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             obj.pushKV("prune_target_size",  nPruneTarget);
         }
     }
+    if (const CBlockIndex* base = GetSnapshotBaseBlock()) {
+        UniValue snapshot(UniValue::VOBJ);
+        snapshot.pushKV("base_hash", base->GetBlockHash().GetHex());
+        snapshot.pushKV("base_height", base->nHeight);
+        snapshot.pushKV("validated", !g_background_chainstate);
+        if (g_background_chainstate) {
+            snapshot.pushKV("background_height", g_background_chainstate->m_chain.Height());
+        }
+        obj.pushKV("snapshot", snapshot);
+    }
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
     UniValue softforks(UniValue::VOBJ);
@@ -1269,6 +1637,11 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     BIP9SoftForkDescPushBack(softforks, "testdummy", consensusParams, Consensus::DEPLOYMENT_TESTDUMMY);
     obj.pushKV("softforks",             softforks);
 
+    UniValue valuePools(UniValue::VARR);
+    valuePools.push_back(ValuePoolDesc("sprout", tip->nChainSproutValue, tip->nChainSproutNotes, tip->nChainSproutNullifiers));
+    valuePools.push_back(ValuePoolDesc("sapling", tip->nChainSaplingValue, tip->nChainSaplingNotes, tip->nChainSaplingNullifiers));
+    obj.pushKV("valuePools",            valuePools);
+
     obj.pushKV("warnings", GetWarnings(false));
     return obj;
 }
@@ -1387,18 +1760,35 @@ static UniValue getchaintips(const JSONRPCRequest& request)
 
 UniValue MempoolInfoToJSON(const CTxMemPool& pool)
 {
-    // Make sure this call is atomic in the pool.
-    LOCK(pool.cs);
+    // The counts are those of one snapshot; only the fee floor, which decays
+    // with time, is looked up in the pool itself.
+    const std::shared_ptr<const MempoolSnapshot> snapshot = pool.GetSnapshot();
     UniValue ret(UniValue::VOBJ);
     ret.pushKV("loaded", pool.IsLoaded());
-    ret.pushKV("size", (int64_t)pool.size());
-    ret.pushKV("bytes", (int64_t)pool.GetTotalTxSize());
-    ret.pushKV("usage", (int64_t)pool.DynamicMemoryUsage());
+    ret.pushKV("size", (int64_t)snapshot->entries.size());
+    ret.pushKV("bytes", (int64_t)snapshot->total_tx_size);
+    const MemPoolUsage& usage = snapshot->usage;
+    ret.pushKV("usage", (int64_t)usage.Total());
+    UniValue usage_breakdown(UniValue::VOBJ);
+    usage_breakdown.pushKV("entries", (int64_t)usage.entries);
+    usage_breakdown.pushKV("transactions", (int64_t)usage.transactions);
+    usage_breakdown.pushKV("links", (int64_t)usage.links);
+    usage_breakdown.pushKV("spends", (int64_t)usage.spends);
+    usage_breakdown.pushKV("nullifiers", (int64_t)usage.nullifiers);
+    usage_breakdown.pushKV("other", (int64_t)usage.other);
+    ret.pushKV("usage_breakdown", usage_breakdown);
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.pushKV("maxmempool", (int64_t) maxmempool);
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(pool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
 
+    const CuckooCache::cache_stats proof_cache = GetProofCacheStats();
+    UniValue proofcache(UniValue::VOBJ);
+    proofcache.pushKV("hits", proof_cache.hits);
+    proofcache.pushKV("misses", proof_cache.misses);
+    proofcache.pushKV("maxsize", (int64_t)proof_cache.max_elements);
+    ret.pushKV("proofcache", proofcache);
+
     return ret;
 }
 
@@ -1414,9 +1804,24 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM, "size", "Current tx count"},
                         {RPCResult::Type::NUM, "bytes", "Sum of all virtual transaction sizes as defined in BIP 141. Differs from actual serialized size because witness data is discounted"},
                         {RPCResult::Type::NUM, "usage", "Total memory usage for the mempool"},
+                        {RPCResult::Type::OBJ, "usage_breakdown", "The memory usage by what it is used for, in bytes",
+                        {
+                            {RPCResult::Type::NUM, "entries", "The entries and their index nodes"},
+                            {RPCResult::Type::NUM, "transactions", "The transactions"},
+                            {RPCResult::Type::NUM, "links", "The links between parents and children"},
+                            {RPCResult::Type::NUM, "spends", "The spent outpoints"},
+                            {RPCResult::Type::NUM, "nullifiers", "The revealed Sprout and Sapling nullifiers"},
+                            {RPCResult::Type::NUM, "other", "Fee deltas and witness hashes"},
+                        }},
                         {RPCResult::Type::NUM, "maxmempool", "Maximum memory usage for the mempool"},
                         {RPCResult::Type::STR_AMOUNT, "mempoolminfee", "Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee"},
                         {RPCResult::Type::STR_AMOUNT, "minrelaytxfee", "Current minimum relay fee for transactions"},
+                        {RPCResult::Type::OBJ, "proofcache", "Shielded proof cache statistics",
+                        {
+                            {RPCResult::Type::NUM, "hits", "Number of proof checks answered by the cache"},
+                            {RPCResult::Type::NUM, "misses", "Number of proof checks not found in the cache"},
+                            {RPCResult::Type::NUM, "maxsize", "Number of entries the cache can hold"},
+                        }},
                     }},
                 RPCExamples{
                     HelpExampleCli("getmempoolinfo", "")
@@ -1616,67 +2021,160 @@ static UniValue getchaintxstats(const JSONRPCRequest& request)
     return ret;
 }
 
-template<typename T>
-static T CalculateTruncatedMedian(std::vector<T>& scores)
+static UniValue getchainhistory(const JSONRPCRequest& request)
 {
-    size_t size = scores.size();
-    if (size == 0) {
-        return 0;
+            RPCHelpMan{"getchainhistory",
+                "\nReturns the ZIP 221 history tree of the active chain, which has a leaf for each block from Sapling activation on.\n"
+                "Requires -chainhistory. With index, returns the node at that position instead.\n",
+                {
+                    {"index", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "The position of a node, in the order nodes were appended"},
+                },
+                {
+                    RPCResult{"without index",
+                        RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::NUM, "leaves", "The number of leaves"},
+                            {RPCResult::Type::NUM, "length", "The number of nodes"},
+                            {RPCResult::Type::STR_HEX, "root", "The root, null for an empty tree"},
+                            {RPCResult::Type::STR_HEX, "tip", "The hash of the block of the last leaf, null for an empty tree"},
+                            {RPCResult::Type::ARR, "peaks", "The positions of the peaks, from the highest on",
+                                {{RPCResult::Type::NUM, "", "position"}}},
+                        }},
+                    RPCResult{"with index",
+                        RPCResult::Type::STR_HEX, "", "The serialized node data"},
+                },
+                RPCExamples{
+                    HelpExampleCli("getchainhistory", "")
+            + HelpExampleCli("getchainhistory", "0")
+            + HelpExampleRpc("getchainhistory", "0")
+                },
+            }.Check(request);
+
+    LOCK(cs_main);
+    const ChainHistory& history = ::ChainstateActive().m_history;
+    if (!history.IsEnabled()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "The chain history is not maintained; restart with -chainhistory to build it");
     }
 
-    std::sort(scores.begin(), scores.end());
-    if (size % 2 == 0) {
-        return (scores[size / 2 - 1] + scores[size / 2]) / 2;
-    } else {
-        return scores[size / 2];
+    if (!request.params[0].isNull()) {
+        const int64_t index = request.params[0].get_int64();
+        HistoryNode node;
+        if (index < 0 || index >= history.Length()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Node index out of range");
+        }
+        if (!history.GetNode(index, node)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the node");
+        }
+        return HexStr(node);
+    }
+
+    UniValue peaks(UniValue::VARR);
+    for (HistoryIndex peak : history.Peaks()) {
+        peaks.push_back((int64_t)peak);
     }
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("leaves", (uint64_t)history.Leaves());
+    ret.pushKV("length", (int64_t)history.Length());
+    ret.pushKV("root", history.Leaves() > 0 ? UniValue(history.Root().GetHex()) : NullUniValue);
+    ret.pushKV("tip", history.Leaves() > 0 ? UniValue(history.TipHash().GetHex()) : NullUniValue);
+    ret.pushKV("peaks", peaks);
+    return ret;
 }
 
-void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight)
+//! Parse the stats argument of getblockstats and getblockstatsrange
+static std::set<std::string> ParseSelectedStats(const UniValue& param)
 {
-    if (scores.empty()) {
-        return;
+    std::set<std::string> stats;
+    if (!param.isNull()) {
+        const UniValue stats_univalue = param.get_array();
+        for (unsigned int i = 0; i < stats_univalue.size(); i++) {
+            const std::string stat = stats_univalue[i].get_str();
+            stats.insert(stat);
+        }
     }
+    return stats;
+}
 
-    std::sort(scores.begin(), scores.end());
+//! The statistics of a block, from the block stats index when it has them
+static CBlockStats GetBlockStats(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    CBlockStats stats;
+    if (g_block_stats_index && g_block_stats_index->LookUpStats(pindex, stats)) {
+        return stats;
+    }
 
-    // 10th, 25th, 50th, 75th, and 90th percentile weight units.
-    const double weights[NUM_GETBLOCKSTATS_PERCENTILES] = {
-        total_weight / 10.0, total_weight / 4.0, total_weight / 2.0, (total_weight * 3.0) / 4.0, (total_weight * 9.0) / 10.0
-    };
+    const CBlock block = GetBlockChecked(pindex);
+    const CBlockUndo blockUndo = GetUndoChecked(pindex);
+    return ComputeBlockStats(block, blockUndo);
+}
 
-    int64_t next_percentile_index = 0;
-    int64_t cumulative_weight = 0;
-    for (const auto& element : scores) {
-        cumulative_weight += element.second;
-        while (next_percentile_index < NUM_GETBLOCKSTATS_PERCENTILES && cumulative_weight >= weights[next_percentile_index]) {
-            result[next_percentile_index] = element.first;
-            ++next_percentile_index;
-        }
+//! The statistics of a block as getblockstats returns them, only the selected ones unless there are none
+static UniValue BlockStatsToJSON(const CBlockIndex* pindex, const CBlockStats& stats, const std::set<std::string>& selected)
+{
+    UniValue feerates_res(UniValue::VARR);
+    for (int64_t i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
+        feerates_res.push_back(stats.feerate_percentiles[i]);
     }
 
-    // Fill any remaining percentiles with the last value.
-    for (int64_t i = next_percentile_index; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
-        result[i] = scores.back().first;
+    UniValue ret_all(UniValue::VOBJ);
+    ret_all.pushKV("avgfee", (stats.txs > 1) ? stats.total_fee / (stats.txs - 1) : 0);
+    ret_all.pushKV("avgfeerate", stats.total_weight ? (stats.total_fee * WITNESS_SCALE_FACTOR) / stats.total_weight : 0); // Unit: sat/vbyte
+    ret_all.pushKV("avgtxsize", (stats.txs > 1) ? stats.total_size / (stats.txs - 1) : 0);
+    ret_all.pushKV("blockhash", pindex->GetBlockHash().GetHex());
+    ret_all.pushKV("feerate_percentiles", feerates_res);
+    ret_all.pushKV("height", (int64_t)pindex->nHeight);
+    ret_all.pushKV("ins", stats.ins);
+    ret_all.pushKV("joinsplits", stats.joinsplits);
+    ret_all.pushKV("maxfee", stats.max_fee);
+    ret_all.pushKV("maxfeerate", stats.max_feerate);
+    ret_all.pushKV("maxtxsize", stats.max_tx_size);
+    ret_all.pushKV("medianfee", stats.median_fee);
+    ret_all.pushKV("mediantime", pindex->GetMedianTimePast());
+    ret_all.pushKV("mediantxsize", stats.median_tx_size);
+    ret_all.pushKV("minfee", stats.min_fee);
+    ret_all.pushKV("minfeerate", stats.min_feerate);
+    ret_all.pushKV("mintxsize", stats.min_tx_size);
+    ret_all.pushKV("outs", stats.outs);
+    ret_all.pushKV("sapling_outputs", stats.sapling_outputs);
+    ret_all.pushKV("sapling_spends", stats.sapling_spends);
+    ret_all.pushKV("sapling_value_delta", stats.sapling_value_delta);
+    ret_all.pushKV("shielded_txs", stats.shielded_txs);
+    ret_all.pushKV("sprout_value_delta", stats.sprout_value_delta);
+    ret_all.pushKV("subsidy", GetBlockSubsidy(pindex->nHeight, Params().GetConsensus()));
+    ret_all.pushKV("swtotal_size", stats.sw_total_size);
+    ret_all.pushKV("swtotal_weight", stats.sw_total_weight);
+    ret_all.pushKV("swtxs", stats.sw_txs);
+    ret_all.pushKV("time", pindex->GetBlockTime());
+    ret_all.pushKV("total_out", stats.total_out);
+    ret_all.pushKV("total_size", stats.total_size);
+    ret_all.pushKV("total_weight", stats.total_weight);
+    ret_all.pushKV("totalfee", stats.total_fee);
+    ret_all.pushKV("txs", stats.txs);
+    ret_all.pushKV("utxo_increase", stats.outs - stats.ins);
+    ret_all.pushKV("utxo_size_inc", stats.utxo_size_inc);
+
+    if (selected.empty()) {
+        return ret_all;
     }
-}
 
-template<typename T>
-static inline bool SetHasKeys(const std::set<T>& set) {return false;}
-template<typename T, typename Tk, typename... Args>
-static inline bool SetHasKeys(const std::set<T>& set, const Tk& key, const Args&... args)
-{
-    return (set.count(key) != 0) || SetHasKeys(set, args...);
+    UniValue ret(UniValue::VOBJ);
+    for (const std::string& stat : selected) {
+        const UniValue& value = ret_all[stat];
+        if (value.isNull()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
+        }
+        ret.pushKV(stat, value);
+    }
+    return ret;
 }
 
-// outpoint (needed for the utxo index) + nHeight + fCoinBase
-static constexpr size_t PER_UTXO_OVERHEAD = sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
-
 static UniValue getblockstats(const JSONRPCRequest& request)
 {
     RPCHelpMan{"getblockstats",
                 "\nCompute per block statistics for a given window. All amounts are in satoshis.\n"
-                "It won't work for some heights with pruning.\n",
+                "It won't work for some heights with pruning. With -blockstatsindex, the statistics are read from the index.\n"
+                "The fees and feerates count the value transactions take from and give to the shielded pools, so that they are\n"
+                "the actual fees of shielded transactions too. Earlier versions only counted the transparent inputs and outputs.\n",
                 {
                     {"hash_or_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The block hash or height of the target block", "", {"", "string or numeric"}},
                     {"stats", RPCArg::Type::ARR, /* default */ "all values", "Values to plot (see result below)",
@@ -1703,6 +2201,7 @@ static UniValue getblockstats(const JSONRPCRequest& request)
                 }},
                 {RPCResult::Type::NUM, "height", "The height of the block"},
                 {RPCResult::Type::NUM, "ins", "The number of inputs (excluding coinbase)"},
+                {RPCResult::Type::NUM, "joinsplits", "The number of Sprout joinsplits"},
                 {RPCResult::Type::NUM, "maxfee", "Maximum fee in the block"},
                 {RPCResult::Type::NUM, "maxfeerate", "Maximum feerate (in satoshis per virtual byte)"},
                 {RPCResult::Type::NUM, "maxtxsize", "Maximum transaction size"},
@@ -1713,6 +2212,11 @@ static UniValue getblockstats(const JSONRPCRequest& request)
                 {RPCResult::Type::NUM, "minfeerate", "Minimum feerate (in satoshis per virtual byte)"},
                 {RPCResult::Type::NUM, "mintxsize", "Minimum transaction size"},
                 {RPCResult::Type::NUM, "outs", "The number of outputs"},
+                {RPCResult::Type::NUM, "sapling_outputs", "The number of Sapling outputs"},
+                {RPCResult::Type::NUM, "sapling_spends", "The number of Sapling spends"},
+                {RPCResult::Type::NUM, "sapling_value_delta", "The change in value of the Sapling pool"},
+                {RPCResult::Type::NUM, "shielded_txs", "The number of transactions with Sapling spends or outputs or Sprout joinsplits"},
+                {RPCResult::Type::NUM, "sprout_value_delta", "The change in value of the Sprout pool"},
                 {RPCResult::Type::NUM, "subsidy", "The block subsidy"},
                 {RPCResult::Type::NUM, "swtotal_size", "Total size of all segwit transactions"},
                 {RPCResult::Type::NUM, "swtotal_weight", "Total weight of all segwit transactions divided by segwit scale factor (4)"},
@@ -1734,197 +2238,65 @@ static UniValue getblockstats(const JSONRPCRequest& request)
 
     LOCK(cs_main);
 
-    CBlockIndex* pindex;
-    if (request.params[0].isNum()) {
-        const int height = request.params[0].get_int();
-        const int current_tip = ::ChainActive().Height();
-        if (height < 0) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
-        }
-        if (height > current_tip) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
-        }
-
-        pindex = ::ChainActive()[height];
-    } else {
-        const uint256 hash(ParseHashV(request.params[0], "hash_or_height"));
-        pindex = LookupBlockIndex(hash);
-        if (!pindex) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        }
-        if (!::ChainActive().Contains(pindex)) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
-        }
-    }
-
+    CBlockIndex* pindex = ParseHashOrHeight(request.params[0]);
     CHECK_NONFATAL(pindex != nullptr);
 
-    std::set<std::string> stats;
-    if (!request.params[1].isNull()) {
-        const UniValue stats_univalue = request.params[1].get_array();
-        for (unsigned int i = 0; i < stats_univalue.size(); i++) {
-            const std::string stat = stats_univalue[i].get_str();
-            stats.insert(stat);
-        }
-    }
-
-    const CBlock block = GetBlockChecked(pindex);
-    const CBlockUndo blockUndo = GetUndoChecked(pindex);
-
-    const bool do_all = stats.size() == 0; // Calculate everything if nothing selected (default)
-    const bool do_mediantxsize = do_all || stats.count("mediantxsize") != 0;
-    const bool do_medianfee = do_all || stats.count("medianfee") != 0;
-    const bool do_feerate_percentiles = do_all || stats.count("feerate_percentiles") != 0;
-    const bool loop_inputs = do_all || do_medianfee || do_feerate_percentiles ||
-        SetHasKeys(stats, "utxo_size_inc", "totalfee", "avgfee", "avgfeerate", "minfee", "maxfee", "minfeerate", "maxfeerate");
-    const bool loop_outputs = do_all || loop_inputs || stats.count("total_out");
-    const bool do_calculate_size = do_mediantxsize ||
-        SetHasKeys(stats, "total_size", "avgtxsize", "mintxsize", "maxtxsize", "swtotal_size");
-    const bool do_calculate_weight = do_all || SetHasKeys(stats, "total_weight", "avgfeerate", "swtotal_weight", "avgfeerate", "feerate_percentiles", "minfeerate", "maxfeerate");
-    const bool do_calculate_sw = do_all || SetHasKeys(stats, "swtxs", "swtotal_size", "swtotal_weight");
-
-    CAmount maxfee = 0;
-    CAmount maxfeerate = 0;
-    CAmount minfee = MAX_MONEY;
-    CAmount minfeerate = MAX_MONEY;
-    CAmount total_out = 0;
-    CAmount totalfee = 0;
-    int64_t inputs = 0;
-    int64_t maxtxsize = 0;
-    int64_t mintxsize = MAX_BLOCK_SERIALIZED_SIZE;
-    int64_t outputs = 0;
-    int64_t swtotal_size = 0;
-    int64_t swtotal_weight = 0;
-    int64_t swtxs = 0;
-    int64_t total_size = 0;
-    int64_t total_weight = 0;
-    int64_t utxo_size_inc = 0;
-    std::vector<CAmount> fee_array;
-    std::vector<std::pair<CAmount, int64_t>> feerate_array;
-    std::vector<int64_t> txsize_array;
-
-    for (size_t i = 0; i < block.vtx.size(); ++i) {
-        const auto& tx = block.vtx.at(i);
-        outputs += tx->vout.size();
-
-        CAmount tx_total_out = 0;
-        if (loop_outputs) {
-            for (const CTxOut& out : tx->vout) {
-                tx_total_out += out.nValue;
-                utxo_size_inc += GetSerializeSize(out, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
-            }
-        }
-
-        if (tx->IsCoinBase()) {
-            continue;
-        }
-
-        inputs += tx->vin.size(); // Don't count coinbase's fake input
-        total_out += tx_total_out; // Don't count coinbase reward
-
-        int64_t tx_size = 0;
-        if (do_calculate_size) {
-
-            tx_size = tx->GetTotalSize();
-            if (do_mediantxsize) {
-                txsize_array.push_back(tx_size);
-            }
-            maxtxsize = std::max(maxtxsize, tx_size);
-            mintxsize = std::min(mintxsize, tx_size);
-            total_size += tx_size;
-        }
-
-        int64_t weight = 0;
-        if (do_calculate_weight) {
-            weight = GetTransactionWeight(*tx);
-            total_weight += weight;
-        }
+    const std::set<std::string> stats = ParseSelectedStats(request.params[1]);
+    return BlockStatsToJSON(pindex, GetBlockStats(pindex), stats);
+}
 
-        if (do_calculate_sw && tx->HasWitness()) {
-            ++swtxs;
-            swtotal_size += tx_size;
-            swtotal_weight += weight;
-        }
+//! Most blocks getblockstatsrange returns the statistics of at once
+static constexpr int MAX_BLOCKSTATS_RANGE = 10000;
 
-        if (loop_inputs) {
-            CAmount tx_total_in = 0;
-            const auto& txundo = blockUndo.vtxundo.at(i - 1);
-            for (const Coin& coin: txundo.vprevout) {
-                const CTxOut& prevoutput = coin.out;
+static UniValue getblockstatsrange(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"getblockstatsrange",
+                "\nCompute the per block statistics of getblockstats for a range of heights of the active chain, at most " + std::to_string(MAX_BLOCKSTATS_RANGE) + " blocks.\n"
+                "With -blockstatsindex, the statistics are read from the index rather than computed from the blocks and their undo data.\n",
+                {
+                    {"start_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The height of the first block"},
+                    {"end_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The height of the last block"},
+                    {"stats", RPCArg::Type::ARR, /* default */ "all values", "Values to plot (see getblockstats)",
+                        {
+                            {"height", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "Selected statistic"},
+                            {"time", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "Selected statistic"},
+                        },
+                        "stats"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "", "The statistics of a block, as getblockstats returns them, from start_height on",
+                        {
+                            {RPCResult::Type::ELISION, "", ""},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getblockstatsrange", "1000 1999 '[\"height\",\"avgfeerate\"]'")
+            + HelpExampleRpc("getblockstatsrange", "1000, 1999, [\"height\",\"avgfeerate\"]")
+                },
+    }.Check(request);
 
-                tx_total_in += prevoutput.nValue;
-                utxo_size_inc -= GetSerializeSize(prevoutput, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
-            }
+    const int start_height = request.params[0].get_int();
+    const int end_height = request.params[1].get_int();
+    const std::set<std::string> stats = ParseSelectedStats(request.params[2]);
 
-            CAmount txfee = tx_total_in - tx_total_out;
-            CHECK_NONFATAL(MoneyRange(txfee));
-            if (do_medianfee) {
-                fee_array.push_back(txfee);
-            }
-            maxfee = std::max(maxfee, txfee);
-            minfee = std::min(minfee, txfee);
-            totalfee += txfee;
-
-            // New feerate uses satoshis per virtual byte instead of per serialized byte
-            CAmount feerate = weight ? (txfee * WITNESS_SCALE_FACTOR) / weight : 0;
-            if (do_feerate_percentiles) {
-                feerate_array.emplace_back(std::make_pair(feerate, weight));
-            }
-            maxfeerate = std::max(maxfeerate, feerate);
-            minfeerate = std::min(minfeerate, feerate);
-        }
+    LOCK(cs_main);
+    const int tip_height = ::ChainActive().Height();
+    if (start_height < 0 || end_height < start_height) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid range %d to %d", start_height, end_height));
     }
-
-    CAmount feerate_percentiles[NUM_GETBLOCKSTATS_PERCENTILES] = { 0 };
-    CalculatePercentilesByWeight(feerate_percentiles, feerate_array, total_weight);
-
-    UniValue feerates_res(UniValue::VARR);
-    for (int64_t i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
-        feerates_res.push_back(feerate_percentiles[i]);
+    if (end_height > tip_height) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", end_height, tip_height));
     }
-
-    UniValue ret_all(UniValue::VOBJ);
-    ret_all.pushKV("avgfee", (block.vtx.size() > 1) ? totalfee / (block.vtx.size() - 1) : 0);
-    ret_all.pushKV("avgfeerate", total_weight ? (totalfee * WITNESS_SCALE_FACTOR) / total_weight : 0); // Unit: sat/vbyte
-    ret_all.pushKV("avgtxsize", (block.vtx.size() > 1) ? total_size / (block.vtx.size() - 1) : 0);
-    ret_all.pushKV("blockhash", pindex->GetBlockHash().GetHex());
-    ret_all.pushKV("feerate_percentiles", feerates_res);
-    ret_all.pushKV("height", (int64_t)pindex->nHeight);
-    ret_all.pushKV("ins", inputs);
-    ret_all.pushKV("maxfee", maxfee);
-    ret_all.pushKV("maxfeerate", maxfeerate);
-    ret_all.pushKV("maxtxsize", maxtxsize);
-    ret_all.pushKV("medianfee", CalculateTruncatedMedian(fee_array));
-    ret_all.pushKV("mediantime", pindex->GetMedianTimePast());
-    ret_all.pushKV("mediantxsize", CalculateTruncatedMedian(txsize_array));
-    ret_all.pushKV("minfee", (minfee == MAX_MONEY) ? 0 : minfee);
-    ret_all.pushKV("minfeerate", (minfeerate == MAX_MONEY) ? 0 : minfeerate);
-    ret_all.pushKV("mintxsize", mintxsize == MAX_BLOCK_SERIALIZED_SIZE ? 0 : mintxsize);
-    ret_all.pushKV("outs", outputs);
-    ret_all.pushKV("subsidy", GetBlockSubsidy(pindex->nHeight, Params().GetConsensus()));
-    ret_all.pushKV("swtotal_size", swtotal_size);
-    ret_all.pushKV("swtotal_weight", swtotal_weight);
-    ret_all.pushKV("swtxs", swtxs);
-    ret_all.pushKV("time", pindex->GetBlockTime());
-    ret_all.pushKV("total_out", total_out);
-    ret_all.pushKV("total_size", total_size);
-    ret_all.pushKV("total_weight", total_weight);
-    ret_all.pushKV("totalfee", totalfee);
-    ret_all.pushKV("txs", (int64_t)block.vtx.size());
-    ret_all.pushKV("utxo_increase", outputs - inputs);
-    ret_all.pushKV("utxo_size_inc", utxo_size_inc);
-
-    if (do_all) {
-        return ret_all;
+    if (end_height - start_height >= MAX_BLOCKSTATS_RANGE) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Range of %d blocks is more than %d", end_height - start_height + 1, MAX_BLOCKSTATS_RANGE));
     }
 
-    UniValue ret(UniValue::VOBJ);
-    for (const std::string& stat : stats) {
-        const UniValue& value = ret_all[stat];
-        if (value.isNull()) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
-        }
-        ret.pushKV(stat, value);
+    UniValue ret(UniValue::VARR);
+    for (int height = start_height; height <= end_height; ++height) {
+        const CBlockIndex* pindex = ::ChainActive()[height];
+        ret.push_back(BlockStatsToJSON(pindex, GetBlockStats(pindex), stats));
     }
     return ret;
 }
@@ -1954,32 +2326,97 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
-//! Search for a given set of pubkey scripts
-bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
+//! Threads scanning the UTXO set for scantxoutset and dumptxoutset at most
+static const int MAX_UTXO_SCAN_THREADS = 16;
+
+//! Split the coins database into ranges of first txid bytes, one per scanning thread.
+static std::vector<std::pair<uint8_t, uint8_t>> SplitCoinsKeyspace()
+{
+    const int parts = std::max(1, std::min(GetNumCores(), MAX_UTXO_SCAN_THREADS));
+    std::vector<std::pair<uint8_t, uint8_t>> ranges;
+    for (int i = 0; i < parts; i++) {
+        ranges.emplace_back(256 * i / parts, 256 * (i + 1) / parts - 1);
+    }
+    return ranges;
+}
+
+namespace {
+//! Hashes the scripts scantxoutset looks for, so that each coin is matched in constant time
+class SaltedScriptHasher
+{
+private:
+    const uint64_t k0, k1;
+
+public:
+    SaltedScriptHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const CScript& script) const noexcept
+    {
+        return CSipHasher(k0, k1).Write(script.data(), script.size()).Finalize();
+    }
+};
+} // namespace
+
+typedef std::unordered_set<CScript, SaltedScriptHasher> ScriptSet;
+
+//! Search for a given set of pubkey scripts, scanning each range with its own cursor and thread
+static bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, const std::vector<std::pair<uint8_t, uint8_t>>& ranges, const std::vector<std::unique_ptr<CCoinsViewCursor>>& cursors, const ScriptSet& needles, std::map<COutPoint, Coin>& out_results) {
     scan_progress = 0;
     count = 0;
-    while (cursor->Valid()) {
-        COutPoint key;
-        Coin coin;
-        if (!cursor->GetKey(key) || !cursor->GetValue(coin)) return false;
-        if (++count % 8192 == 0) {
-            if (should_abort) {
-                // allow to abort the scan via the abort reference
-                return false;
+    const size_t parts = cursors.size();
+    std::vector<int64_t> counts(parts, 0);
+    std::vector<std::map<COutPoint, Coin>> results(parts);
+    std::vector<char> completed(parts, false);
+    // Progress of each range, in 1/65536 of it
+    std::unique_ptr<std::atomic<uint32_t>[]> progress(new std::atomic<uint32_t>[parts]);
+    for (size_t t = 0; t < parts; t++) progress[t] = 0;
+
+    auto scan = [&](size_t t) {
+        CCoinsViewCursor* cursor = cursors[t].get();
+        const uint32_t range_begin = 0x100 * ranges[t].first;
+        const uint32_t range_size = 0x100 * (ranges[t].second - ranges[t].first + 1);
+        while (cursor->Valid()) {
+            COutPoint key;
+            Coin coin;
+            if (!cursor->GetKey(key) || !cursor->GetValue(coin)) return;
+            if (++counts[t] % 8192 == 0) {
+                if (should_abort) {
+                    // allow to abort the scan via the abort reference
+                    return;
+                }
             }
+            if (counts[t] % 256 == 0) {
+                // update progress reference every 256 item
+                uint32_t high = 0x100 * *key.hash.begin() + *(key.hash.begin() + 1);
+                progress[t] = (uint64_t)(high - range_begin) * 65536 / range_size;
+                uint64_t total = 0;
+                for (size_t i = 0; i < parts; i++) total += progress[i];
+                scan_progress = (int)(total * 100.0 / 65536.0 / parts + 0.5);
+            }
+            if (needles.count(coin.out.scriptPubKey)) {
+                results[t].emplace(key, coin);
+            }
+            cursor->Next();
         }
-        if (count % 256 == 0) {
-            // update progress reference every 256 item
-            uint32_t high = 0x100 * *key.hash.begin() + *(key.hash.begin() + 1);
-            scan_progress = (int)(high * 100.0 / 65536.0 + 0.5);
-        }
-        if (needles.count(coin.out.scriptPubKey)) {
-            out_results.emplace(key, coin);
-        }
-        cursor->Next();
+        completed[t] = true;
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < parts; t++) {
+        threads.emplace_back(scan, t);
+    }
+    scan(0);
+    for (std::thread& thread : threads) {
+        thread.join();
     }
-    scan_progress = 100;
-    return true;
+
+    bool ret = true;
+    for (size_t t = 0; t < parts; t++) {
+        count += counts[t];
+        ret = ret && completed[t];
+        out_results.insert(results[t].begin(), results[t].end());
+    }
+    if (ret) scan_progress = 100;
+    return ret;
 }
 
 /** RAII object to prevent concurrency issue when scanning the txout set */
@@ -2101,7 +2538,7 @@ UniValue scantxoutset(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_MISC_ERROR, "scanobjects argument is required for the start action");
         }
 
-        std::set<CScript> needles;
+        ScriptSet needles;
         std::map<CScript, std::string> descriptors;
         CAmount total_in = 0;
 
@@ -2123,17 +2560,21 @@ UniValue scantxoutset(const JSONRPCRequest& request)
         g_should_abort_scan = false;
         g_scan_progress = 0;
         int64_t count = 0;
-        std::unique_ptr<CCoinsViewCursor> pcursor;
+        const std::vector<std::pair<uint8_t, uint8_t>> ranges = SplitCoinsKeyspace();
+        std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
         CBlockIndex* tip;
         {
             LOCK(cs_main);
             ::ChainstateActive().ForceFlushStateToDisk();
-            pcursor = std::unique_ptr<CCoinsViewCursor>(::ChainstateActive().CoinsDB().Cursor());
-            CHECK_NONFATAL(pcursor);
+            // Cursors created together see the same UTXO set.
+            for (const auto& range : ranges) {
+                cursors.emplace_back(::ChainstateActive().CoinsDB().Cursor(range.first, range.second));
+                CHECK_NONFATAL(cursors.back());
+            }
             tip = ::ChainActive().Tip();
             CHECK_NONFATAL(tip);
         }
-        bool res = FindScriptPubKey(g_scan_progress, g_should_abort_scan, count, pcursor.get(), needles, coins);
+        bool res = FindScriptPubKey(g_scan_progress, g_should_abort_scan, count, ranges, cursors, needles, coins);
         result.pushKV("success", res);
         result.pushKV("txouts", count);
         result.pushKV("height", tip->nHeight);
@@ -2240,6 +2681,686 @@ static UniValue getblockfilter(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue compactShieldedBlockToJSON(const CCompactShieldedBlock& block)
+{
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("height", block.nHeight);
+    result.pushKV("hash", block.hash.GetHex());
+    result.pushKV("previousblockhash", block.hashPrevBlock.GetHex());
+    result.pushKV("time", (int64_t)block.nTime);
+    UniValue vtx(UniValue::VARR);
+    for (const CCompactShieldedTx& tx : block.vtx) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("index", (int64_t)tx.index);
+        entry.pushKV("txid", tx.hash.GetHex());
+        UniValue spends(UniValue::VARR);
+        for (const CCompactSaplingSpend& spend : tx.spends) {
+            spends.push_back(spend.nullifier.GetHex());
+        }
+        entry.pushKV("spends", spends);
+        UniValue outputs(UniValue::VARR);
+        for (const CCompactSaplingOutput& output : tx.outputs) {
+            UniValue out(UniValue::VOBJ);
+            out.pushKV("cmu", output.cmu.GetHex());
+            out.pushKV("epk", output.epk.GetHex());
+            out.pushKV("ciphertext", HexStr(output.ciphertext.begin(), output.ciphertext.end()));
+            outputs.push_back(out);
+        }
+        entry.pushKV("outputs", outputs);
+        vtx.push_back(entry);
+    }
+    result.pushKV("vtx", vtx);
+    return result;
+}
+
+//! Compact blocks a single getcompactblocks call returns at most
+static const int MAX_GETCOMPACTBLOCKS_RESULTS = 1000;
+
+static UniValue getcompactblocks(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getcompactblocks",
+                "\nReturns the compact shielded form of a range of blocks of the active chain, for light wallets.\n"
+                "Requires -compactblockindex.\n",
+                {
+                    {"height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The height of the first block"},
+                    {"count", RPCArg::Type::NUM, /* default */ "1", strprintf("The number of blocks, at most %d; fewer are returned if the chain ends first", MAX_GETCOMPACTBLOCKS_RESULTS)},
+                    {"verbose", RPCArg::Type::BOOL, /* default */ "true", "true for an array of json objects, false for an array of hex-encoded serialized blocks"},
+                },
+                {
+                    RPCResult{"for verbose = true",
+                        RPCResult::Type::ARR, "", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::NUM, "height", "The block height"},
+                                {RPCResult::Type::STR_HEX, "hash", "The block hash"},
+                                {RPCResult::Type::STR_HEX, "previousblockhash", "The hash of the previous block"},
+                                {RPCResult::Type::NUM_TIME, "time", "The block time expressed in " + UNIX_EPOCH_TIME},
+                                {RPCResult::Type::ARR, "vtx", "The transactions with Sapling spends or outputs",
+                                {
+                                    {RPCResult::Type::OBJ, "", "",
+                                    {
+                                        {RPCResult::Type::NUM, "index", "The position of the transaction in the block"},
+                                        {RPCResult::Type::STR_HEX, "txid", "The transaction id"},
+                                        {RPCResult::Type::ARR, "spends", "",
+                                            {{RPCResult::Type::STR_HEX, "nullifier", "The nullifier of the spend"}}},
+                                        {RPCResult::Type::ARR, "outputs", "",
+                                        {
+                                            {RPCResult::Type::OBJ, "", "",
+                                            {
+                                                {RPCResult::Type::STR_HEX, "cmu", "The note commitment"},
+                                                {RPCResult::Type::STR_HEX, "epk", "The ephemeral public key"},
+                                                {RPCResult::Type::STR_HEX, "ciphertext", strprintf("The first %d bytes of the note ciphertext", COMPACT_NOTE_CIPHERTEXT_SIZE)},
+                                            }},
+                                        }},
+                                    }},
+                                }},
+                            }},
+                        }},
+                    RPCResult{"for verbose = false",
+                        RPCResult::Type::ARR, "", "",
+                        {{RPCResult::Type::STR_HEX, "", "A serialized, hex-encoded compact block"}}},
+                },
+                RPCExamples{
+                    HelpExampleCli("getcompactblocks", "1000 100") +
+                    HelpExampleRpc("getcompactblocks", "1000, 100")
+                }
+            }.Check(request);
+
+    if (!g_compact_block_index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Compact block index is not enabled. Use -compactblockindex.");
+    }
+
+    int start_height = request.params[0].get_int();
+    int count = request.params[1].isNull() ? 1 : request.params[1].get_int();
+    bool verbose = request.params[2].isNull() ? true : request.params[2].get_bool();
+    if (count < 1 || count > MAX_GETCOMPACTBLOCKS_RESULTS) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Count must be between 1 and %d", MAX_GETCOMPACTBLOCKS_RESULTS));
+    }
+
+    const CBlockIndex* stop_index;
+    {
+        LOCK(cs_main);
+        if (start_height < 0 || start_height > ::ChainActive().Height()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        }
+        stop_index = ::ChainActive()[std::min(start_height + count - 1, ::ChainActive().Height())];
+    }
+
+    bool index_ready = g_compact_block_index->BlockUntilSyncedToCurrentChain();
+
+    std::vector<CCompactShieldedBlock> blocks;
+    if (!g_compact_block_index->LookupBlockRange(start_height, stop_index, blocks)) {
+        if (!index_ready) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Compact blocks not found. They are still in the process of being indexed.");
+        }
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Compact blocks not found. This error is unexpected and indicates index corruption.");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const CCompactShieldedBlock& block : blocks) {
+        if (verbose) {
+            ret.push_back(compactShieldedBlockToJSON(block));
+        } else {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << block;
+            ret.push_back(HexStr(ss.begin(), ss.end()));
+        }
+    }
+    return ret;
+}
+
+//! Nullifiers or note commitments a single findnullifiers or findnotecommitments call looks up at most
+static const size_t MAX_FIND_SHIELDED_RESULTS = 10000;
+
+//! The hashes of a findnullifiers or findnotecommitments request, once the index is in sync.
+static std::vector<uint256> ParseShieldedLookup(const UniValue& param, const std::string& name)
+{
+    if (!g_nullifier_index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Nullifier index is not enabled. Use -nullifierindex.");
+    }
+
+    const UniValue& hashes = param.get_array();
+    if (hashes.size() > MAX_FIND_SHIELDED_RESULTS) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %u %ss can be looked up at once", MAX_FIND_SHIELDED_RESULTS, name));
+    }
+    std::vector<uint256> ret;
+    ret.reserve(hashes.size());
+    for (size_t i = 0; i < hashes.size(); i++) {
+        ret.push_back(ParseHashV(hashes[i], name));
+    }
+
+    if (!g_nullifier_index->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "The nullifier index is still in the process of being built.");
+    }
+    return ret;
+}
+
+static UniValue findnullifiers(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"findnullifiers",
+                "\nReturns whether each of a batch of Sapling nullifiers has been revealed on the active chain, and by which spend.\n"
+                "Requires -nullifierindex.\n",
+                {
+                    {"nullifiers", RPCArg::Type::ARR, RPCArg::Optional::NO, strprintf("The nullifiers, at most %u", MAX_FIND_SHIELDED_RESULTS),
+                        {
+                            {"nullifier", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, "A nullifier"},
+                        },
+                    },
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "In the order of the request",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR_HEX, "nullifier", "The nullifier"},
+                            {RPCResult::Type::BOOL, "spent", "Whether the nullifier has been revealed, i.e. the note spent"},
+                            {RPCResult::Type::NUM, "height", /* optional */ true, "The height of the block of the spend"},
+                            {RPCResult::Type::STR_HEX, "blockhash", /* optional */ true, "The hash of the block of the spend"},
+                            {RPCResult::Type::STR_HEX, "txid", /* optional */ true, "The transaction of the spend"},
+                            {RPCResult::Type::NUM, "spend", /* optional */ true, "The position of the spend in the transaction"},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("findnullifiers", "'[\"nullifier\"]'") +
+                    HelpExampleRpc("findnullifiers", "[\"nullifier\"]")
+                }
+            }.Check(request);
+
+    const std::vector<uint256> nullifiers = ParseShieldedLookup(request.params[0], "nullifier");
+    std::vector<Optional<NullifierLocation>> locations;
+    g_nullifier_index->FindNullifiers(nullifiers, locations);
+
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < nullifiers.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("nullifier", nullifiers[i].GetHex());
+        entry.pushKV("spent", (bool)locations[i]);
+        if (locations[i]) {
+            entry.pushKV("height", locations[i]->nHeight);
+            entry.pushKV("blockhash", locations[i]->hashBlock.GetHex());
+            entry.pushKV("txid", locations[i]->txid.GetHex());
+            entry.pushKV("spend", (uint64_t)locations[i]->nSpend);
+        }
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
+static UniValue findnotecommitments(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"findnotecommitments",
+                "\nReturns the block and the position in the note commitment tree of each of a batch of Sapling note commitments.\n"
+                "Requires -nullifierindex.\n",
+                {
+                    {"cmus", RPCArg::Type::ARR, RPCArg::Optional::NO, strprintf("The note commitments, at most %u", MAX_FIND_SHIELDED_RESULTS),
+                        {
+                            {"cmu", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, "A note commitment"},
+                        },
+                    },
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "In the order of the request",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR_HEX, "cmu", "The note commitment"},
+                            {RPCResult::Type::BOOL, "found", "Whether the note commitment is on the active chain"},
+                            {RPCResult::Type::NUM, "height", /* optional */ true, "The height of the block of the note"},
+                            {RPCResult::Type::STR_HEX, "blockhash", /* optional */ true, "The hash of the block of the note"},
+                            {RPCResult::Type::NUM, "position", /* optional */ true, "The position of the note in the note commitment tree"},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("findnotecommitments", "'[\"cmu\"]'") +
+                    HelpExampleRpc("findnotecommitments", "[\"cmu\"]")
+                }
+            }.Check(request);
+
+    const std::vector<uint256> cmus = ParseShieldedLookup(request.params[0], "cmu");
+    std::vector<Optional<CommitmentLocation>> locations;
+    g_nullifier_index->FindCommitments(cmus, locations);
+
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < cmus.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("cmu", cmus[i].GetHex());
+        entry.pushKV("found", (bool)locations[i]);
+        if (locations[i]) {
+            entry.pushKV("height", locations[i]->nHeight);
+            entry.pushKV("blockhash", locations[i]->hashBlock.GetHex());
+            entry.pushKV("position", locations[i]->nPosition);
+        }
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
+//! The scripts of the addresses of a getaddress* request, once the address index is in sync.
+static std::vector<std::pair<std::string, CScript>> ParseAddressLookup(const UniValue& param)
+{
+    if (!g_address_index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index is not enabled. Use -addressindex.");
+    }
+
+    const UniValue& addresses = param.get_array();
+    std::vector<std::pair<std::string, CScript>> ret;
+    for (size_t i = 0; i < addresses.size(); i++) {
+        const std::string& address = addresses[i].get_str();
+        CTxDestination dest = DecodeDestination(address);
+        if (!IsValidDestination(dest)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + address);
+        }
+        ret.emplace_back(address, GetScriptForDestination(dest));
+    }
+
+    if (!g_address_index->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "The address index is still in the process of being built.");
+    }
+    return ret;
+}
+
+static UniValue getaddressdeltas(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getaddressdeltas",
+                "\nReturns the transparent balance changes of addresses in a range of blocks, ordered by height.\n"
+                "Requires -addressindex.\n",
+                {
+                    {"addresses", RPCArg::Type::ARR, RPCArg::Optional::NO, "The addresses",
+                        {
+                            {"address", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "An address"},
+                        },
+                    },
+                    {"start", RPCArg::Type::NUM, /* default */ "0", "The height of the first block"},
+                    {"end", RPCArg::Type::NUM, /* default */ "the tip", "The height of the last block"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR, "address", "The address"},
+                            {RPCResult::Type::NUM, "height", "The height of the block"},
+                            {RPCResult::Type::STR_HEX, "txid", "The transaction"},
+                            {RPCResult::Type::NUM, "index", "The input or output of the transaction"},
+                            {RPCResult::Type::BOOL, "spending", "Whether index is an input spending a coin of the address"},
+                            {RPCResult::Type::STR_AMOUNT, "amount", "The change of the balance, negative for spends"},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getaddressdeltas", "'[\"address\"]' 1000 2000") +
+                    HelpExampleRpc("getaddressdeltas", "[\"address\"], 1000, 2000")
+                }
+            }.Check(request);
+
+    const std::vector<std::pair<std::string, CScript>> scripts = ParseAddressLookup(request.params[0]);
+
+    int start_height = 0;
+    if (!request.params[1].isNull()) {
+        start_height = request.params[1].get_int();
+    }
+    int end_height;
+    if (!request.params[2].isNull()) {
+        end_height = request.params[2].get_int();
+    } else {
+        LOCK(cs_main);
+        end_height = ::ChainActive().Height();
+    }
+    if (start_height < 0 || end_height < start_height) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block range");
+    }
+
+    std::vector<std::pair<const std::string*, AddressDelta>> deltas;
+    for (const auto& script : scripts) {
+        std::vector<AddressDelta> script_deltas;
+        if (!g_address_index->FindDeltas(script.second, start_height, end_height, script_deltas)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+        }
+        for (const AddressDelta& delta : script_deltas) {
+            deltas.emplace_back(&script.first, delta);
+        }
+    }
+    std::stable_sort(deltas.begin(), deltas.end(), [](const std::pair<const std::string*, AddressDelta>& a, const std::pair<const std::string*, AddressDelta>& b) {
+        return a.second.nHeight < b.second.nHeight;
+    });
+
+    UniValue ret(UniValue::VARR);
+    for (const auto& delta : deltas) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("address", *delta.first);
+        entry.pushKV("height", delta.second.nHeight);
+        entry.pushKV("txid", delta.second.txid.GetHex());
+        entry.pushKV("index", (uint64_t)delta.second.nIndex);
+        entry.pushKV("spending", delta.second.fSpending);
+        entry.pushKV("amount", ValueFromAmount(delta.second.nAmount));
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
+static UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getaddressbalance",
+                "\nReturns the transparent balance of addresses, and the total they received.\n"
+                "Requires -addressindex.\n",
+                {
+                    {"addresses", RPCArg::Type::ARR, RPCArg::Optional::NO, "The addresses",
+                        {
+                            {"address", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "An address"},
+                        },
+                    },
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::STR_AMOUNT, "balance", "The current balance, including immature coinbase outputs"},
+                        {RPCResult::Type::STR_AMOUNT, "received", "The total received"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getaddressbalance", "'[\"address\"]'") +
+                    HelpExampleRpc("getaddressbalance", "[\"address\"]")
+                }
+            }.Check(request);
+
+    const std::vector<std::pair<std::string, CScript>> scripts = ParseAddressLookup(request.params[0]);
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (const auto& script : scripts) {
+        std::vector<AddressDelta> deltas;
+        if (!g_address_index->FindDeltas(script.second, 0, std::numeric_limits<int>::max(), deltas)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+        }
+        for (const AddressDelta& delta : deltas) {
+            balance += delta.nAmount;
+            if (!delta.fSpending) received += delta.nAmount;
+        }
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("balance", ValueFromAmount(balance));
+    ret.pushKV("received", ValueFromAmount(received));
+    return ret;
+}
+
+static UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getaddressutxos",
+                "\nReturns the unspent transparent outputs of addresses.\n"
+                "Requires -addressindex.\n",
+                {
+                    {"addresses", RPCArg::Type::ARR, RPCArg::Optional::NO, "The addresses",
+                        {
+                            {"address", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "An address"},
+                        },
+                    },
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR, "address", "The address"},
+                            {RPCResult::Type::STR_HEX, "txid", "The transaction id"},
+                            {RPCResult::Type::NUM, "vout", "The vout value"},
+                            {RPCResult::Type::STR_HEX, "scriptPubKey", "The script key"},
+                            {RPCResult::Type::STR_AMOUNT, "amount", "The transaction output amount in " + CURRENCY_UNIT},
+                            {RPCResult::Type::NUM, "height", "The height of the block of the output"},
+                            {RPCResult::Type::BOOL, "coinbase", "Whether the output is of a coinbase transaction"},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getaddressutxos", "'[\"address\"]'") +
+                    HelpExampleRpc("getaddressutxos", "[\"address\"]")
+                }
+            }.Check(request);
+
+    const std::vector<std::pair<std::string, CScript>> scripts = ParseAddressLookup(request.params[0]);
+
+    UniValue ret(UniValue::VARR);
+    for (const auto& script : scripts) {
+        std::vector<std::pair<COutPoint, Coin>> unspent;
+        if (!g_address_index->FindUnspent(script.second, unspent)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+        }
+        for (const auto& coin : unspent) {
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("address", script.first);
+            entry.pushKV("txid", coin.first.hash.GetHex());
+            entry.pushKV("vout", (int32_t)coin.first.n);
+            entry.pushKV("scriptPubKey", HexStr(coin.second.out.scriptPubKey.begin(), coin.second.out.scriptPubKey.end()));
+            entry.pushKV("amount", ValueFromAmount(coin.second.out.nValue));
+            entry.pushKV("height", (int32_t)coin.second.nHeight);
+            entry.pushKV("coinbase", coin.second.IsCoinBase());
+            ret.push_back(entry);
+        }
+    }
+    return ret;
+}
+
+//! Outpoints a single findspends call looks up at most
+static const size_t MAX_FIND_SPENDS_RESULTS = 10000;
+
+static UniValue findspends(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"findspends",
+                "\nReturns which input of the active chain, if any, spent each of a batch of transparent outputs.\n"
+                "Requires -spentindex.\n",
+                {
+                    {"outpoints", RPCArg::Type::ARR, RPCArg::Optional::NO, strprintf("The outputs, at most %u", MAX_FIND_SPENDS_RESULTS),
+                        {
+                            {"", RPCArg::Type::OBJ, RPCArg::Optional::OMITTED, "",
+                                {
+                                    {"txid", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The transaction id"},
+                                    {"vout", RPCArg::Type::NUM, RPCArg::Optional::NO, "The output number"},
+                                },
+                            },
+                        },
+                    },
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "In the order of the request",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR_HEX, "txid", "The transaction id of the output"},
+                            {RPCResult::Type::NUM, "vout", "The output number"},
+                            {RPCResult::Type::BOOL, "spent", "Whether the output has been spent on the active chain"},
+                            {RPCResult::Type::STR_HEX, "spending_txid", /* optional */ true, "The transaction of the input that spent it"},
+                            {RPCResult::Type::NUM, "vin", /* optional */ true, "The position of the input in the transaction"},
+                            {RPCResult::Type::NUM, "height", /* optional */ true, "The height of the block of the spend"},
+                            {RPCResult::Type::STR_HEX, "blockhash", /* optional */ true, "The hash of the block of the spend"},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("findspends", "'[{\"txid\":\"mytxid\",\"vout\":0}]'") +
+                    HelpExampleRpc("findspends", "[{\"txid\":\"mytxid\",\"vout\":0}]")
+                }
+            }.Check(request);
+
+    if (!g_spent_index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index is not enabled. Use -spentindex.");
+    }
+
+    const UniValue& params = request.params[0].get_array();
+    if (params.size() > MAX_FIND_SPENDS_RESULTS) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %u outpoints can be looked up at once", MAX_FIND_SPENDS_RESULTS));
+    }
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(params.size());
+    for (size_t i = 0; i < params.size(); i++) {
+        const UniValue& param = params[i].get_obj();
+        RPCTypeCheckObj(param, {
+            {"txid", UniValueType(UniValue::VSTR)},
+            {"vout", UniValueType(UniValue::VNUM)},
+        });
+        const int vout = find_value(param, "vout").get_int();
+        if (vout < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, vout must be positive");
+        }
+        outpoints.emplace_back(ParseHashO(param, "txid"), vout);
+    }
+
+    if (!g_spent_index->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "The spent index is still in the process of being built.");
+    }
+    std::vector<Optional<SpentLocation>> locations;
+    g_spent_index->FindSpends(outpoints, locations);
+
+    UniValue ret(UniValue::VARR);
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", outpoints[i].hash.GetHex());
+        entry.pushKV("vout", (int32_t)outpoints[i].n);
+        entry.pushKV("spent", (bool)locations[i]);
+        if (locations[i]) {
+            entry.pushKV("spending_txid", locations[i]->txid.GetHex());
+            entry.pushKV("vin", (uint64_t)locations[i]->nInput);
+            entry.pushKV("height", locations[i]->nHeight);
+            entry.pushKV("blockhash", locations[i]->hashBlock.GetHex());
+        }
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
+static UniValue getdbstats(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"getdbstats",
+        "\nReturns read, cache, bloom filter and compaction statistics of the open LevelDB databases.\n",
+        {},
+        RPCResult{
+            RPCResult::Type::ARR, "", "",
+            {
+                {RPCResult::Type::OBJ, "", "",
+                {
+                    {RPCResult::Type::STR, "name", "the database, e.g. chainstate, or index for the block index"},
+                    {RPCResult::Type::NUM, "reads", "the number of reads since startup"},
+                    {RPCResult::Type::NUM, "bytes_read", "the size of the values read"},
+                    {RPCResult::Type::NUM, "bytes_written", "the size of the batches written"},
+                    {RPCResult::Type::NUM, "memory_usage", "the memory used by the block cache and write buffers, in bytes"},
+                    {RPCResult::Type::OBJ, "block_cache", "",
+                    {
+                        {RPCResult::Type::NUM, "size", "the capacity, in bytes"},
+                        {RPCResult::Type::NUM, "usage", "the bytes in use"},
+                        {RPCResult::Type::NUM, "hits", "lookups that found the block"},
+                        {RPCResult::Type::NUM, "misses", "lookups that had to read the block"},
+                        {RPCResult::Type::NUM, "hit_rate", "hits out of all lookups"},
+                    }},
+                    {RPCResult::Type::OBJ, "bloom_filter", "",
+                    {
+                        {RPCResult::Type::NUM, "checks", "keys checked against the filter of a table"},
+                        {RPCResult::Type::NUM, "useful", "checks that ruled the table out"},
+                    }},
+                    {RPCResult::Type::ARR, "levels", "the levels that hold files or have been compacted into",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::NUM, "level", "the level"},
+                            {RPCResult::Type::NUM, "files", "the number of files"},
+                            {RPCResult::Type::NUM, "size_mb", "the size of the files, in MiB"},
+                            {RPCResult::Type::NUM, "compaction_time", "the time spent compacting into the level, in seconds"},
+                            {RPCResult::Type::NUM, "compaction_read_mb", "the MiB read by those compactions"},
+                            {RPCResult::Type::NUM, "compaction_write_mb", "the MiB written by those compactions"},
+                        }},
+                    }},
+                }},
+            }
+        },
+        RPCExamples{
+            HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        },
+    }.Check(request);
+
+    UniValue ret(UniValue::VARR);
+    for (const DBStats& stats : GetAllDBStats()) {
+        UniValue db(UniValue::VOBJ);
+        db.pushKV("name", stats.name);
+        db.pushKV("reads", stats.reads);
+        db.pushKV("bytes_read", stats.bytes_read);
+        db.pushKV("bytes_written", stats.bytes_written);
+        db.pushKV("memory_usage", (uint64_t)stats.memory_usage);
+
+        UniValue cache(UniValue::VOBJ);
+        cache.pushKV("size", stats.cache_size);
+        cache.pushKV("usage", stats.cache_usage);
+        cache.pushKV("hits", stats.cache_hits);
+        cache.pushKV("misses", stats.cache_misses);
+        const uint64_t lookups = stats.cache_hits + stats.cache_misses;
+        cache.pushKV("hit_rate", lookups ? (double)stats.cache_hits / lookups : 0.0);
+        db.pushKV("block_cache", cache);
+
+        UniValue bloom(UniValue::VOBJ);
+        bloom.pushKV("checks", stats.bloom_checks);
+        bloom.pushKV("useful", stats.bloom_useful);
+        db.pushKV("bloom_filter", bloom);
+
+        UniValue levels(UniValue::VARR);
+        for (const DBStats::Level& level : stats.levels) {
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("level", level.level);
+            entry.pushKV("files", level.files);
+            entry.pushKV("size_mb", level.size_mb);
+            entry.pushKV("compaction_time", level.compaction_seconds);
+            entry.pushKV("compaction_read_mb", level.compaction_read_mb);
+            entry.pushKV("compaction_write_mb", level.compaction_write_mb);
+            levels.push_back(entry);
+        }
+        db.pushKV("levels", levels);
+        ret.push_back(db);
+    }
+    return ret;
+}
+
+static UniValue CacheStatsToJSON(const CuckooCache::cache_stats& stats)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("hits", stats.hits);
+    ret.pushKV("misses", stats.misses);
+    const uint64_t lookups = stats.hits + stats.misses;
+    ret.pushKV("hit_rate", lookups ? (double)stats.hits / lookups : 0.0);
+    ret.pushKV("inserts", stats.inserts);
+    ret.pushKV("evictions", stats.evictions);
+    ret.pushKV("maxsize", (int64_t)stats.max_elements);
+    return ret;
+}
+
+static UniValue getcachestats(const JSONRPCRequest& request)
+{
+    const std::vector<RPCResult> cache_fields{
+        {RPCResult::Type::NUM, "hits", "lookups that found the entry"},
+        {RPCResult::Type::NUM, "misses", "lookups that did not"},
+        {RPCResult::Type::NUM, "hit_rate", "hits out of all lookups"},
+        {RPCResult::Type::NUM, "inserts", "entries added, including the ones restored from validationcache.dat"},
+        {RPCResult::Type::NUM, "evictions", "entries given up to make room for newer ones"},
+        {RPCResult::Type::NUM, "maxsize", "the number of entries the cache can hold"},
+    };
+    RPCHelpMan{"getcachestats",
+        "\nReturns usage statistics of the signature, script execution and shielded proof caches since startup.\n"
+        "The first two are sized with -maxsigcachesize, the last with -maxproofcachesize.\n",
+        {},
+        RPCResult{
+            RPCResult::Type::OBJ, "", "",
+            {
+                {RPCResult::Type::OBJ, "signatures", "the cache of valid signatures", cache_fields},
+                {RPCResult::Type::OBJ, "scripts", "the cache of transactions whose scripts all passed", cache_fields},
+                {RPCResult::Type::OBJ, "proofs", "the cache of valid shielded proofs", cache_fields},
+            }
+        },
+        RPCExamples{
+            HelpExampleCli("getcachestats", "")
+            + HelpExampleRpc("getcachestats", "")
+        },
+    }.Check(request);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("signatures", CacheStatsToJSON(GetSignatureCacheStats()));
+    ret.pushKV("scripts", CacheStatsToJSON(GetScriptExecutionCacheStats()));
+    ret.pushKV("proofs", CacheStatsToJSON(GetProofCacheStats()));
+    return ret;
+}
+
 /**
  * Serialize the UTXO set to a file for loading elsewhere.
  *
@@ -2249,7 +3370,7 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
 {
     RPCHelpMan{
         "dumptxoutset",
-        "\nWrite the serialized UTXO set to disk.\n",
+        "\nWrite the serialized UTXO set, with the Sapling nullifiers and anchors, to disk.\n",
         {
             {"path",
                 RPCArg::Type::STR,
@@ -2261,6 +3382,9 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
             RPCResult::Type::OBJ, "", "",
                 {
                     {RPCResult::Type::NUM, "coins_written", "the number of coins written in the snapshot"},
+                    {RPCResult::Type::NUM, "nullifiers_written", "the number of Sapling nullifiers written in the snapshot"},
+                    {RPCResult::Type::NUM, "anchors_written", "the number of Sapling anchors written in the snapshot"},
+                    {RPCResult::Type::STR_HEX, "shielded_hash", "the hash of the Sapling nullifiers and anchors of the snapshot, which -assumeutxo pins next to the MuHash3072 of its coins"},
                     {RPCResult::Type::STR_HEX, "base_hash", "the hash of the base of the snapshot"},
                     {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
                     {RPCResult::Type::STR, "path", "the absolute path that the snapshot was written to"},
@@ -2285,18 +3409,21 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
 
     FILE* file{fsbridge::fopen(temppath, "wb")};
     CAutoFile afile{file, SER_DISK, CLIENT_VERSION};
-    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors;
+    std::unique_ptr<CCoinsViewDBShieldedCursor> nullifier_cursor;
+    std::unique_ptr<CCoinsViewDBShieldedCursor> anchor_cursor;
     CCoinsStats stats;
     CBlockIndex* tip;
+    uint256 sapling_anchor;
 
     {
         // We need to lock cs_main to ensure that the coinsdb isn't written to
         // between (i) flushing coins cache to disk (coinsdb), (ii) getting stats
-        // based upon the coinsdb, and (iii) constructing a cursor to the
+        // based upon the coinsdb, and (iii) constructing the cursors to the
         // coinsdb for use below this block.
         //
         // Cursors returned by leveldb iterate over snapshots, so the contents
-        // of the pcursor will not be affected by simultaneous writes during
+        // of the cursors will not be affected by simultaneous writes during
         // use below this block.
         //
         // See discussion here:
@@ -2310,43 +3437,110 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
         }
 
-        pcursor = std::unique_ptr<CCoinsViewCursor>(::ChainstateActive().CoinsDB().Cursor());
+        for (const auto& range : SplitCoinsKeyspace()) {
+            cursors.emplace_back(::ChainstateActive().CoinsDB().Cursor(range.first, range.second));
+        }
+        nullifier_cursor = ::ChainstateActive().CoinsDB().NullifierCursor();
+        anchor_cursor = ::ChainstateActive().CoinsDB().SaplingAnchorCursor();
+        sapling_anchor = ::ChainstateActive().CoinsDB().GetBestAnchor();
         tip = LookupBlockIndex(stats.hashBlock);
         CHECK_NONFATAL(tip);
     }
 
     SnapshotMetadata metadata{tip->GetBlockHash(), stats.coins_count, tip->nChainTx};
+    metadata.m_sapling_anchor = sapling_anchor;
 
-    afile << metadata;
-
-    COutPoint key;
-    Coin coin;
-    unsigned int iter{0};
+    uint256 shielded_hash;
+    if (!HashShieldedState(*nullifier_cursor, *anchor_cursor, sapling_anchor, shielded_hash)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read Sapling state");
+    }
 
-    while (pcursor->Valid()) {
-        if (iter % 5000 == 0 && !IsRPCRunning()) {
+    WriteUTXOSnapshot(afile, metadata, cursors, *nullifier_cursor, *anchor_cursor, [] {
+        if (!IsRPCRunning()) {
             throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
         }
-        ++iter;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            afile << key;
-            afile << coin;
-        }
-
-        pcursor->Next();
-    }
+    });
 
     afile.fclose();
     fs::rename(temppath, path);
 
     UniValue result(UniValue::VOBJ);
     result.pushKV("coins_written", stats.coins_count);
+    result.pushKV("nullifiers_written", metadata.m_nullifiers_count);
+    result.pushKV("anchors_written", metadata.m_anchors_count);
+    result.pushKV("shielded_hash", shielded_hash.GetHex());
     result.pushKV("base_hash", tip->GetBlockHash().ToString());
     result.pushKV("base_height", tip->nHeight);
     result.pushKV("path", path.string());
     return result;
 }
 
+/**
+ * Load a UTXO set written by dumptxoutset, and validate it in the background.
+ *
+ * @see ActivateSnapshot
+ */
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    RPCHelpMan{
+        "loadtxoutset",
+        "\nLoad a UTXO set written by dumptxoutset, and go on from the base of the snapshot with it at once. The blocks up to\n"
+        "the base are downloaded and validated in the background, and the UTXO set they arrive at has to be that of the\n"
+        "snapshot, or the node shuts down and drops the snapshot on restart.\n"
+        "Only the snapshots pinned in the chain parameters, by their base block, the MuHash3072 of their coins and the hash of\n"
+        "their Sapling nullifiers and anchors, are accepted.\n"
+        "The header of the base has to be known, and the chain must not have reached its height yet. Cannot be used in prune\n"
+        "mode, with -chainhistory or with indexes. Wallets do not see the transactions of the blocks under the base.\n",
+        {
+            {"path",
+                RPCArg::Type::STR,
+                RPCArg::Optional::NO,
+                /* default_val */ "",
+                "path to the snapshot file. If relative, will be prefixed by datadir."},
+        },
+        RPCResult{
+            RPCResult::Type::OBJ, "", "",
+                {
+                    {RPCResult::Type::NUM, "coins_loaded", "the number of coins loaded from the snapshot"},
+                    {RPCResult::Type::STR_HEX, "base_hash", "the hash of the base of the snapshot"},
+                    {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                    {RPCResult::Type::STR_HEX, "txoutset_hash", "the MuHash3072 of the loaded coins, as gettxoutsetinfo with hash_type muhash gives it"},
+                    {RPCResult::Type::STR_HEX, "shielded_hash", "the hash of the loaded Sapling nullifiers and anchors, as dumptxoutset gives it"},
+                    {RPCResult::Type::STR, "path", "the absolute path that the snapshot was read from"},
+                }
+        },
+        RPCExamples{
+            HelpExampleCli("loadtxoutset", "utxo.dat")
+        }
+    }.Check(request);
+
+    // Indexes are built from the blocks of the active chain, which lacks those under the base.
+    bool indexes = g_txindex || g_compact_block_index || g_nullifier_index || g_address_index || g_spent_index || g_coin_stats_index || g_block_stats_index;
+    ForEachBlockFilterIndex([&indexes](BlockFilterIndex&) { indexes = true; });
+    if (indexes) {
+        throw JSONRPCError(RPC_MISC_ERROR, "UTXO snapshots cannot be loaded with indexes enabled");
+    }
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    SnapshotMetadata metadata;
+    uint256 muhash;
+    uint256 shielded_hash;
+    std::string error;
+    if (!ActivateSnapshot(path, Params(), metadata, muhash, shielded_hash, error)) {
+        throw JSONRPCError(RPC_MISC_ERROR, error);
+    }
+    const int base_height = WITH_LOCK(cs_main, return LookupBlockIndex(metadata.m_base_blockhash)->nHeight);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("coins_loaded", metadata.m_coins_count);
+    result.pushKV("base_hash", metadata.m_base_blockhash.GetHex());
+    result.pushKV("base_height", base_height);
+    result.pushKV("txoutset_hash", muhash.GetHex());
+    result.pushKV("shielded_hash", shielded_hash.GetHex());
+    result.pushKV("path", path.string());
+    return result;
+}
+
 void RegisterBlockchainRPCCommands(CRPCTable &t)
 {
 // clang-format off
@@ -2355,7 +3549,9 @@ static const CRPCCommand commands[] =
   //  --------------------- ------------------------  -----------------------  ----------
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
+    { "blockchain",         "getchainhistory",        &getchainhistory,        {"index"} },
     { "blockchain",         "getblockstats",          &getblockstats,          {"hash_or_height", "stats"} },
+    { "blockchain",         "getblockstatsrange",     &getblockstatsrange,     {"start_height", "end_height", "stats"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
     { "blockchain",         "getblockcount",          &getblockcount,          {} },
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
@@ -2367,9 +3563,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose", "mempool_sequence"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type", "hash_or_height"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
@@ -2377,6 +3573,17 @@ static const CRPCCommand commands[] =
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
     { "blockchain",         "scantxoutset",           &scantxoutset,           {"action", "scanobjects"} },
     { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash", "filtertype"} },
+    { "blockchain",         "getcompactblocks",       &getcompactblocks,       {"height", "count", "verbose"} },
+    { "blockchain",         "findnullifiers",         &findnullifiers,         {"nullifiers"} },
+    { "blockchain",         "findnotecommitments",    &findnotecommitments,    {"cmus"} },
+    { "blockchain",         "getaddressdeltas",       &getaddressdeltas,       {"addresses", "start", "end"} },
+    { "blockchain",         "getaddressbalance",      &getaddressbalance,      {"addresses"} },
+    { "blockchain",         "getaddressutxos",        &getaddressutxos,        {"addresses"} },
+    { "blockchain",         "findspends",             &findspends,             {"outpoints"} },
+    { "blockchain",         "getdbstats",             &getdbstats,             {} },
+    { "blockchain",         "getcachestats",          &getcachestats,          {} },
+    { "blockchain",         "getvalidationqueueinfo", &getvalidationqueueinfo, {} },
+    { "blockchain",         "getvalidationstats",     &getvalidationstats,     {} },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        {"blockhash"} },
@@ -2386,6 +3593,7 @@ static const CRPCCommand commands[] =
     { "hidden",             "waitforblockheight",     &waitforblockheight,     {"height","timeout"} },
     { "hidden",             "syncwithvalidationinterfacequeue", &syncwithvalidationinterfacequeue, {} },
     { "hidden",             "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "hidden",             "loadtxoutset",           &loadtxoutset,           {"path"} },
 };
 // clang-format on
 
@@ -6,8 +6,10 @@
 #define BITCOIN_RPC_BLOCKCHAIN_H
 
 #include <amount.h>
+#include <node/blockstats.h>
 #include <sync.h>
 
+#include <memory>
 #include <stdint.h>
 #include <vector>
 
@@ -15,12 +17,12 @@ extern RecursiveMutex cs_main;
 
 class CBlock;
 class CBlockIndex;
+class CCompactShieldedBlock;
 class CTxMemPool;
 class UniValue;
+struct BlockJSON;
 struct NodeContext;
 
-static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
-
 /**
  * Get the difficulty of the net wrt to the given block index.
  *
@@ -35,17 +37,23 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 /** Block description to JSON */
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails = false) LOCKS_EXCLUDED(cs_main);
 
+/** The parts of the block description that the block cache keeps */
+std::shared_ptr<const BlockJSON> blockToJSONParts(const CBlock& block, const CBlockIndex* blockindex, bool txDetails) LOCKS_EXCLUDED(cs_main);
+
+/** Block description to JSON from its parts, completed with where the block is relative to tip */
+UniValue blockPartsToJSON(const BlockJSON& parts, const CBlockIndex* tip, const CBlockIndex* blockindex) LOCKS_EXCLUDED(cs_main);
+
 /** Mempool information to JSON */
 UniValue MempoolInfoToJSON(const CTxMemPool& pool);
 
 /** Mempool to JSON */
-UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false);
+UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false, bool include_mempool_sequence = false);
 
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex) LOCKS_EXCLUDED(cs_main);
 
-/** Used by getblockstats to get feerates at different percentiles by weight  */
-void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
+/** Compact shielded block to JSON */
+UniValue compactShieldedBlockToJSON(const CCompactShieldedBlock& block);
 
 //! Pointer to node state that needs to be declared as a global to be accessible
 //! RPC methods. Due to limitations of the RPC framework, there's currently no
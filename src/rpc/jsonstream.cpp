@@ -0,0 +1,95 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/jsonstream.h>
+
+#include <univalue.h>
+
+#include <assert.h>
+
+JSONStreamWriter::JSONStreamWriter(Sink sink, size_t chunk_size) : m_sink(std::move(sink)), m_chunk_size(chunk_size)
+{
+}
+
+void JSONStreamWriter::Write(const std::string& text)
+{
+    m_buffer += text;
+    if (m_buffer.size() >= m_chunk_size) Flush();
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (m_buffer.empty()) return;
+    m_sink(m_buffer);
+    m_buffer.clear();
+}
+
+void JSONStreamWriter::Separate()
+{
+    m_started = true;
+    if (m_after_key) {
+        m_after_key = false;
+        return;
+    }
+    if (!m_empty.empty()) {
+        if (!m_empty.back()) Write(",");
+        m_empty.back() = false;
+    }
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    Separate();
+    Write("{");
+    m_empty.push_back(true);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!m_empty.empty() && !m_after_key);
+    m_empty.pop_back();
+    Write("}");
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    Separate();
+    Write("[");
+    m_empty.push_back(true);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!m_empty.empty() && !m_after_key);
+    m_empty.pop_back();
+    Write("]");
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!m_after_key);
+    Separate();
+    Write(UniValue(key).write() + ":");
+    m_after_key = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    Separate();
+    Write(value.write());
+}
+
+void JSONStreamWriter::Fields(const UniValue& object)
+{
+    const std::vector<std::string>& keys = object.getKeys();
+    const std::vector<UniValue>& values = object.getValues();
+    for (size_t i = 0; i < keys.size(); i++) {
+        KV(keys[i], values[i]);
+    }
+}
+
+void JSONStreamWriter::Raw(const std::string& text)
+{
+    Write(text);
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_RPC_JSONSTREAM_H
+#define LITECOINZ_RPC_JSONSTREAM_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class UniValue;
+
+/** Output is passed on in chunks of about this size */
+static const size_t JSON_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/**
+ * Writes a JSON document piece by piece, passing the text on to a sink in
+ * chunks, so that a large result never has to exist as a whole UniValue
+ * tree or string. Values can still be written as UniValue subtrees.
+ * The output is the same as UniValue::write() without indentation.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string& chunk)> Sink;
+
+    explicit JSONStreamWriter(Sink sink, size_t chunk_size = JSON_STREAM_CHUNK_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    /** Write the key of the next value of the current object */
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+    void KV(const std::string& key, const UniValue& value) { Key(key); Value(value); }
+    /** Write every key and value of an object as part of the current object */
+    void Fields(const UniValue& object);
+
+    /** Append text outside of the document, such as the envelope around it */
+    void Raw(const std::string& text);
+
+    /** Whether any part of the document was written */
+    bool Started() const { return m_started; }
+
+    /** Pass what is buffered on to the sink */
+    void Flush();
+
+private:
+    Sink m_sink;
+    const size_t m_chunk_size;
+    std::string m_buffer;
+    //! For each open object or array, whether it has no element yet
+    std::vector<bool> m_empty;
+    bool m_after_key{false};
+    bool m_started{false};
+
+    /** Write the separator a new element needs */
+    void Separate();
+    void Write(const std::string& text);
+};
+
+#endif // LITECOINZ_RPC_JSONSTREAM_H
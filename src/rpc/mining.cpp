@@ -11,6 +11,7 @@
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <crypto/equihash.h>
+#include <equihash_solver.h>
 #include <key_io.h>
 #include <miner.h>
 #include <net.h>
@@ -30,13 +31,16 @@
 #include <util/strencodings.h>
 #include <util/string.h>
 #include <util/system.h>
+#include <util/time.h>
 #include <validation.h>
 #include <validationinterface.h>
 #include <versionbitsinfo.h>
 #include <warnings.h>
 
+#include <atomic>
 #include <memory>
 #include <stdint.h>
+#include <thread>
 
 /**
  * Return average network hashes per second based on the last 'lookup' blocks,
@@ -44,17 +48,18 @@
  * If 'height' is nonnegative, compute the estimate at the time when a given block was found.
  */
 static UniValue GetNetworkHashPS(int lookup, int height) {
-    CBlockIndex *pb = ::ChainActive().Tip();
+    const CBlockIndex* tip = ::ChainActive().TipSnapshot();
+    const CBlockIndex* pb = tip;
 
-    if (height >= 0 && height < ::ChainActive().Height())
-        pb = ::ChainActive()[height];
+    if (tip && height >= 0 && height < tip->nHeight)
+        pb = tip->GetAncestor(height);
 
     if (pb == nullptr || !pb->nHeight)
         return 0;
 
     // If lookup is -1, then use difficulty averaging window.
     if (lookup <= 0) {
-        if (::ChainActive().Height() < Params().GetConsensus().nLwmaForkHeight)
+        if (tip->nHeight < Params().GetConsensus().nLwmaForkHeight)
             lookup = Params().GetConsensus().nDigishieldAveragingWindow;
         else
             lookup = Params().GetConsensus().nLwmaAveragingWindow;
@@ -64,7 +69,7 @@ static UniValue GetNetworkHashPS(int lookup, int height) {
     if (lookup > pb->nHeight)
         lookup = pb->nHeight;
 
-    CBlockIndex *pb0 = pb;
+    const CBlockIndex* pb0 = pb;
     int64_t minTime = pb0->GetBlockTime();
     int64_t maxTime = minTime;
     for (int i = 0; i < lookup; i++) {
@@ -102,10 +107,87 @@ static UniValue getnetworkhashps(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
     return GetNetworkHashPS(!request.params[0].isNull() ? request.params[0].get_int() : 120, !request.params[1].isNull() ? request.params[1].get_int() : -1);
 }
 
+/** Equihash solver runs made by generateBlocks and the time they took, for getmininginfo */
+static std::atomic<uint64_t> g_solver_runs{0};
+static std::atomic<int64_t> g_solver_time_micros{0};
+
+/**
+ * Try the nonces following pblock->nNonce, at most nTries of them, on
+ * nThreads threads. Each thread takes the next untried nonce and runs the
+ * solver on its own copy of the BLAKE2b midstate. The first solution that
+ * meets the target cancels the other threads through the solver's cancel
+ * callback and is stored in pblock.
+ *
+ * @return the number of nonces tried
+ */
+static uint64_t SolveBlock(CBlock* pblock, unsigned int n, unsigned int k, const eh_HashState& eh_state,
+                           const EquihashSolver& solver, uint64_t nTries, int nThreads, bool& fFound)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    const CBlockHeader start = pblock->GetBlockHeader();
+    const arith_uint256 start_nonce = UintToArith256(start.nNonce);
+
+    std::atomic<uint64_t> next_try{0};
+    std::atomic<bool> found{false};
+    CBlockHeader result;
+
+    auto worker = [&]() {
+        CBlockHeader header = start;
+        while (!found && !ShutdownRequested()) {
+            uint64_t i = next_try++;
+            if (i >= nTries) break;
+
+            // Yes, there is a chance every nonce could fail to satisfy the -regtest
+            // target -- 1 in 2^(2^256). That ain't gonna happen
+            header.nNonce = ArithToUint256(start_nonce + i + 1);
+
+            // H(I||V||...
+            eh_HashState curr_state = eh_state;
+            crypto_generichash_blake2b_update(&curr_state, header.nNonce.begin(), header.nNonce.size());
+
+            // (x_1, x_2, ...) = A(I, V, n, k)
+            std::function<bool(std::vector<unsigned char>)> validBlock =
+                    [&](std::vector<unsigned char> soln) {
+                header.nSolution = soln;
+                if (!CheckProofOfWork(header.GetHash(), header.nBits, consensusParams)) return false;
+                bool expected = false;
+                if (found.compare_exchange_strong(expected, true)) result = header;
+                return true;
+            };
+            std::function<bool(EhSolverCancelCheck)> cancelled = [&found](EhSolverCancelCheck pos) {
+                return found || ShutdownRequested();
+            };
+            try {
+                solver.Solve(n, k, curr_state, validBlock, cancelled);
+            } catch (const EhSolverCancelledException&) {
+                break;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nThreads; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    uint64_t nTried = std::min<uint64_t>(next_try, nTries);
+    fFound = found;
+    if (fFound) {
+        pblock->nNonce = result.nNonce;
+        pblock->nSolution = result.nSolution;
+    } else {
+        pblock->nNonce = ArithToUint256(start_nonce + nTried);
+    }
+    return nTried;
+}
+
 static UniValue generateBlocks(const CTxMemPool& mempool, const CScript& coinbase_script, int nGenerate, uint64_t nMaxTries)
 {
     static const int nInnerLoopCount = 0xFFFF;
@@ -124,6 +206,17 @@ static UniValue generateBlocks(const CTxMemPool& mempool, const CScript& coinbas
     unsigned int n;
     unsigned int k;
 
+    int nThreads = gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS);
+    if (nThreads <= 0)
+        nThreads = std::max(1, GetNumCores());
+
+    // The nonce search is already spread over nThreads, so each run of the
+    // solver gets a single thread.
+    const std::string solver_name = gArgs.GetArg("-equihashsolver", DEFAULT_EQUIHASH_SOLVER);
+    std::unique_ptr<EquihashSolver> solver = MakeEquihashSolver(solver_name, 1);
+    if (!solver)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("Unknown Equihash solver '%s'", solver_name));
+
     while (nHeight < nHeightEnd && !ShutdownRequested())
     {
         n = Params().GetConsensus().EquihashN(nHeight + 1);
@@ -149,33 +242,22 @@ static UniValue generateBlocks(const CTxMemPool& mempool, const CScript& coinbas
         // H(I||...
         crypto_generichash_blake2b_update(&eh_state, (unsigned char*)&ss[0], ss.size());
 
-        while (nMaxTries > 0 &&
-               ((int)pblock->nNonce.GetUint64(0) & nInnerLoopMask) < nInnerLoopCount) {
-            // Yes, there is a chance every nonce could fail to satisfy the -regtest
-            // target -- 1 in 2^(2^256). That ain't gonna happen
-            pblock->nNonce = ArithToUint256(UintToArith256(pblock->nNonce) + 1);
-
-            // H(I||V||...
-            crypto_generichash_blake2b_state curr_state;
-            curr_state = eh_state;
-            crypto_generichash_blake2b_update(&curr_state, pblock->nNonce.begin(), pblock->nNonce.size());
+        uint64_t nTries = std::min<uint64_t>(nMaxTries, nInnerLoopCount - ((int)pblock->nNonce.GetUint64(0) & nInnerLoopMask));
+        bool found = false;
+        int64_t nStart = GetTimeMicros();
+        uint64_t nTried = SolveBlock(pblock, n, k, eh_state, *solver, nTries, nThreads, found);
+        g_solver_runs += nTried;
+        g_solver_time_micros += GetTimeMicros() - nStart;
+        nMaxTries -= nTried;
 
-            // (x_1, x_2, ...) = A(I, V, n, k)
-            std::function<bool(std::vector<unsigned char>)> validBlock =
-                    [&pblock](std::vector<unsigned char> soln) {
-                pblock->nSolution = soln;
-                return CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus());
-            };
-            bool found = EhBasicSolveUncancellable(n, k, curr_state, validBlock);
-            --nMaxTries;
-            if (found) {
-                break;
-            }
-        }
-        if (nMaxTries == 0 || ShutdownRequested()) {
+        if (ShutdownRequested()) {
             break;
         }
-        if (((int)pblock->nNonce.GetUint64(0) & nInnerLoopMask) == nInnerLoopCount) {
+        if (!found) {
+            if (nMaxTries == 0) {
+                break;
+            }
+            // The nonces of this template are used up, start on a new one.
             continue;
         }
         std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
@@ -287,6 +369,7 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM, "currentblocktx", /* optional */ true, "The number of block transactions of the last assembled block (only present if a block was ever assembled)"},
                         {RPCResult::Type::NUM, "difficulty", "The current difficulty"},
                         {RPCResult::Type::NUM, "networkhashps", "The network hashes per second"},
+                        {RPCResult::Type::NUM, "localsolps", "The average number of Equihash solver runs per second while generating blocks"},
                         {RPCResult::Type::NUM, "pooledtx", "The size of the mempool"},
                         {RPCResult::Type::STR, "chain", "current network name (main, test, regtest)"},
                         {RPCResult::Type::STR, "warnings", "any network and blockchain warnings"},
@@ -297,15 +380,21 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
     const CTxMemPool& mempool = EnsureMemPool();
+    const CBlockIndex* tip = ::ChainActive().TipSnapshot();
 
     UniValue obj(UniValue::VOBJ);
-    obj.pushKV("blocks",           (int)::ChainActive().Height());
-    if (BlockAssembler::m_last_block_weight) obj.pushKV("currentblockweight", *BlockAssembler::m_last_block_weight);
-    if (BlockAssembler::m_last_block_num_txs) obj.pushKV("currentblocktx", *BlockAssembler::m_last_block_num_txs);
-    obj.pushKV("difficulty",       (double)GetDifficulty(::ChainActive().Tip()));
+    obj.pushKV("blocks",           tip->nHeight);
+    {
+        // The stats of the last block template are written under cs_main
+        LOCK(cs_main);
+        if (BlockAssembler::m_last_block_weight) obj.pushKV("currentblockweight", *BlockAssembler::m_last_block_weight);
+        if (BlockAssembler::m_last_block_num_txs) obj.pushKV("currentblocktx", *BlockAssembler::m_last_block_num_txs);
+    }
+    obj.pushKV("difficulty",       (double)GetDifficulty(tip));
     obj.pushKV("networkhashps",    getnetworkhashps(request));
+    const int64_t solver_time_micros = g_solver_time_micros;
+    obj.pushKV("localsolps",       solver_time_micros > 0 ? g_solver_runs * 1000000.0 / solver_time_micros : 0.0);
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
     obj.pushKV("warnings",         GetWarnings(false));
@@ -601,7 +690,19 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    if (pindexPrev != ::ChainActive().Tip() ||
+    CBlockIndex* const tip = ::ChainActive().Tip();
+    unsigned int nTransactionsUpdatedCached = 0;
+    std::shared_ptr<const CBlockTemplate> cached = g_rpc_node->template_cache ? g_rpc_node->template_cache->Get(tip, nTransactionsUpdatedCached) : nullptr;
+    if (cached && (pindexPrev != tip || nTransactionsUpdatedCached > nTransactionsUpdatedLast))
+    {
+        // Take the template kept up to date in the background, it is newer
+        // than the one built by the last call
+        pblocktemplate = MakeUnique<CBlockTemplate>(*cached);
+        nTransactionsUpdatedLast = nTransactionsUpdatedCached;
+        nStart = GetTime();
+        pindexPrev = tip;
+    }
+    else if (pindexPrev != tip ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
@@ -847,7 +948,7 @@ static UniValue submitblock(const JSONRPCRequest& request)
 
     bool new_block;
     auto sc = std::make_shared<submitblock_StateCatcher>(block.GetHash());
-    RegisterSharedValidationInterface(sc);
+    RegisterSharedValidationInterface(sc, "submitblock");
     bool accepted = ProcessNewBlock(Params(), blockptr, /* fForceProcessing */ true, /* fNewBlock */ &new_block);
     UnregisterSharedValidationInterface(sc);
     if (!new_block && accepted) {
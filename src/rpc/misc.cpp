@@ -3,19 +3,25 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chain.h>
+#include <checkqueue.h>
 #include <httpserver.h>
 #include <key_io.h>
 #include <node/context.h>
 #include <outputtype.h>
+#include <rpc/blockcache.h>
 #include <rpc/blockchain.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <scheduler.h>
 #include <script/descriptor.h>
+#include <support/hugepages.h>
+#include <sync.h>
 #include <util/check.h>
 #include <util/message.h> // For MessageSign(), MessageVerify()
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <validation.h>
 
 #include <stdint.h>
 #include <tuple>
@@ -229,13 +235,13 @@ UniValue deriveaddresses(const JSONRPCRequest& request)
 
     UniValue addresses(UniValue::VARR);
 
-    for (int i = range_begin; i <= range_end; ++i) {
-        FlatSigningProvider provider;
-        std::vector<CScript> scripts;
-        if (!desc->Expand(i, key_provider, scripts, provider)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys"));
-        }
+    std::vector<std::vector<CScript>> range_scripts;
+    std::vector<FlatSigningProvider> providers;
+    if (!ExpandRange(*desc, range_begin, range_end, key_provider, range_scripts, providers)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys"));
+    }
 
+    for (const std::vector<CScript>& scripts : range_scripts) {
         for (const CScript &script : scripts) {
             CTxDestination dest;
             if (!ExtractDestination(script, dest)) {
@@ -398,6 +404,31 @@ static UniValue mockscheduler(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue RPCBlockIndexMemoryInfo()
+{
+    const BlockSolutionStats stats = GetBlockSolutionStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("solutions_on_disk", stats.trimmed);
+    obj.pushKV("solution_bytes_saved", stats.trimmed_bytes);
+    obj.pushKV("cache_entries", stats.cache_entries);
+    obj.pushKV("cache_hits", stats.cache_hits);
+    obj.pushKV("cache_misses", stats.cache_misses);
+    return obj;
+}
+
+static UniValue RPCBlockCacheMemoryInfo()
+{
+    BlockCache::Stats stats{};
+    if (g_rpc_node && g_rpc_node->block_cache) stats = g_rpc_node->block_cache->GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("entries", (uint64_t)stats.entries);
+    obj.pushKV("usage", (uint64_t)stats.usage);
+    obj.pushKV("max_usage", (uint64_t)stats.max_usage);
+    obj.pushKV("hits", stats.hits);
+    obj.pushKV("misses", stats.misses);
+    return obj;
+}
+
 static UniValue RPCLockedMemoryInfo()
 {
     LockedPool::Stats stats = LockedPoolManager::Instance().stats();
@@ -408,6 +439,19 @@ static UniValue RPCLockedMemoryInfo()
     obj.pushKV("locked", uint64_t(stats.locked));
     obj.pushKV("chunks_used", uint64_t(stats.chunks_used));
     obj.pushKV("chunks_free", uint64_t(stats.chunks_free));
+    obj.pushKV("chunks_cached", uint64_t(stats.chunks_cached));
+    obj.pushKV("largest_free", uint64_t(stats.largest_free));
+    return obj;
+}
+
+static UniValue RPCHugePageMemoryInfo()
+{
+    const HugePageArena::Stats stats = HugePageArena::Instance().GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("enabled", HugePageArena::Instance().IsEnabled());
+    obj.pushKV("used", uint64_t(stats.used));
+    obj.pushKV("hugetlb", uint64_t(stats.hugetlb));
+    obj.pushKV("transparent", uint64_t(stats.transparent));
     return obj;
 }
 
@@ -454,6 +498,31 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
                                 {RPCResult::Type::NUM, "locked", "Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk."},
                                 {RPCResult::Type::NUM, "chunks_used", "Number allocated chunks"},
                                 {RPCResult::Type::NUM, "chunks_free", "Number unused chunks"},
+                                {RPCResult::Type::NUM, "chunks_cached", "Number of the unused chunks kept for reuse by size rather than merged"},
+                                {RPCResult::Type::NUM, "largest_free", "Size of the largest unused chunk. Far below free, the locked memory is fragmented"},
+                            }},
+                            {RPCResult::Type::OBJ, "blockindex", "Information about the Equihash solutions of the block index, which are kept on disk",
+                            {
+                                {RPCResult::Type::NUM, "solutions_on_disk", "Number of block indexes whose solution is only on disk"},
+                                {RPCResult::Type::NUM, "solution_bytes_saved", "Bytes of memory those solutions took up before they were dropped"},
+                                {RPCResult::Type::NUM, "cache_entries", "Number of solutions in the cache of ones recently read back"},
+                                {RPCResult::Type::NUM, "cache_hits", "Number of solution reads answered from the cache"},
+                                {RPCResult::Type::NUM, "cache_misses", "Number of solution reads from disk"},
+                            }},
+                            {RPCResult::Type::OBJ, "blockcache", "Information about the cache of blocks served by getblock and REST (see -rpcblockcache)",
+                            {
+                                {RPCResult::Type::NUM, "entries", "Number of serialized blocks and block JSONs in the cache"},
+                                {RPCResult::Type::NUM, "usage", "Approximate number of bytes they take up"},
+                                {RPCResult::Type::NUM, "max_usage", "Number of bytes the cache is bounded by, 0 if it is disabled"},
+                                {RPCResult::Type::NUM, "hits", "Number of requests answered from the cache"},
+                                {RPCResult::Type::NUM, "misses", "Number of requests for which the block was read from disk"},
+                            }},
+                            {RPCResult::Type::OBJ, "hugepages", "Information about the huge pages backing the coins cache and the Equihash solver (see -hugepages)",
+                            {
+                                {RPCResult::Type::BOOL, "enabled", "Whether -hugepages is in effect"},
+                                {RPCResult::Type::NUM, "used", "Number of bytes used"},
+                                {RPCResult::Type::NUM, "hugetlb", "Number of bytes mapped from the huge pages the system reserved"},
+                                {RPCResult::Type::NUM, "transparent", "Number of bytes mapped and advised to be backed by transparent huge pages, which the kernel does as it can"},
                             }},
                         }
                     },
@@ -471,6 +540,9 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        obj.pushKV("blockindex", RPCBlockIndexMemoryInfo());
+        obj.pushKV("blockcache", RPCBlockCacheMemoryInfo());
+        obj.pushKV("hugepages", RPCHugePageMemoryInfo());
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -483,6 +555,133 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     }
 }
 
+static UniValue getlockstats(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getlockstats",
+                "Returns how often the locks taken at each site in the code were acquired and contended since startup,\n"
+                "and how long was spent waiting for them, most waited for first. Only sites that were used are listed.\n"
+                "Hold times are only measured with -lockholdtimes.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::ARR, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR, "lock", "the lock as named at the site, e.g. cs_main"},
+                            {RPCResult::Type::STR, "site", "file and line of the site"},
+                            {RPCResult::Type::NUM, "acquisitions", "times the lock was taken"},
+                            {RPCResult::Type::NUM, "contended", "times it had to be waited for"},
+                            {RPCResult::Type::NUM, "wait_us", "total time spent waiting for it, in microseconds"},
+                            {RPCResult::Type::NUM, "hold_us", "total time it was held, in microseconds"},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getlockstats", "")
+            + HelpExampleRpc("getlockstats", "")
+                },
+            }.Check(request);
+
+    std::vector<LockSiteStats> stats = GetLockStats();
+    std::sort(stats.begin(), stats.end(), [](const LockSiteStats& a, const LockSiteStats& b) { return a.wait_ns > b.wait_ns; });
+    UniValue ret(UniValue::VARR);
+    for (const LockSiteStats& site : stats) {
+        if (site.acquisitions == 0) continue;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("lock", site.name);
+        obj.pushKV("site", strprintf("%s:%d", site.file, site.line));
+        obj.pushKV("acquisitions", site.acquisitions);
+        obj.pushKV("contended", site.contentions);
+        obj.pushKV("wait_us", site.wait_ns / 1000);
+        obj.pushKV("hold_us", site.hold_ns / 1000);
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+static UniValue getschedulerinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getschedulerinfo",
+                "Returns the state of the task scheduler and how late and how long its tasks ran since startup.\n"
+                "Set the number of threads running them with -schedulerthreads.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "threads", "the threads running tasks"},
+                        {RPCResult::Type::NUM, "queued", "the tasks waiting for their time or for a thread"},
+                        {RPCResult::Type::NUM, "tasks_run", "the tasks run so far"},
+                        {RPCResult::Type::NUM, "avg_delay_us", "how long after its time a task started on average, in microseconds"},
+                        {RPCResult::Type::NUM, "max_delay_us", "the longest a task started after its time, in microseconds"},
+                        {RPCResult::Type::NUM, "avg_runtime_us", "how long a task ran on average, in microseconds"},
+                        {RPCResult::Type::NUM, "max_runtime_us", "the longest a task ran, in microseconds"},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getschedulerinfo", "")
+            + HelpExampleRpc("getschedulerinfo", "")
+                },
+            }.Check(request);
+
+    if (!g_rpc_node || !g_rpc_node->scheduler) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Scheduler not found");
+    }
+    const CScheduler::Stats stats = g_rpc_node->scheduler->GetStats();
+    std::chrono::system_clock::time_point first, last;
+    const size_t queued = g_rpc_node->scheduler->getQueueInfo(first, last);
+    const int64_t tasks = std::max<int64_t>(stats.tasks_run, 1);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("threads", stats.threads);
+    ret.pushKV("queued", (uint64_t)queued);
+    ret.pushKV("tasks_run", stats.tasks_run);
+    ret.pushKV("avg_delay_us", stats.total_delay.count() / tasks);
+    ret.pushKV("max_delay_us", stats.max_delay.count());
+    ret.pushKV("avg_runtime_us", stats.total_runtime.count() / tasks);
+    ret.pushKV("max_runtime_us", stats.max_runtime.count());
+    return ret;
+}
+
+static UniValue getcheckqueueinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getcheckqueueinfo",
+                "Returns how much the block verification thread pools were used since startup.\n"
+                "The script and shielded proof pools are sized with -par and -proofthreads.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ_DYN, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "pool", "the pool, by the name of its threads",
+                        {
+                            {RPCResult::Type::NUM, "threads", "the worker threads of the pool, not counting the thread adding the checks"},
+                            {RPCResult::Type::NUM, "checks", "the checks run so far"},
+                            {RPCResult::Type::NUM, "worker_busy_us", "the time the worker threads spent running checks, in microseconds"},
+                            {RPCResult::Type::NUM, "master_busy_us", "the time the thread adding the checks spent running them, in microseconds"},
+                            {RPCResult::Type::NUM, "utilization", "the share of the time since startup the worker threads spent running checks"},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getcheckqueueinfo", "")
+            + HelpExampleRpc("getcheckqueueinfo", "")
+                },
+            }.Check(request);
+
+    const int64_t uptime_us = std::max<int64_t>(GetTimeMicros() - GetStartupTime() * 1000000, 1);
+    UniValue ret(UniValue::VOBJ);
+    for (const auto& pool : GetCheckQueueStats()) {
+        const CheckQueueStats& stats = pool.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("threads", stats.threads);
+        obj.pushKV("checks", stats.checks);
+        obj.pushKV("worker_busy_us", stats.worker_busy_us);
+        obj.pushKV("master_busy_us", stats.master_busy_us);
+        obj.pushKV("utilization", stats.threads > 0 ? (double)stats.worker_busy_us / ((double)uptime_us * stats.threads) : 0.0);
+        ret.pushKV(pool.first, obj);
+    }
+    return ret;
+}
+
 static void EnableOrDisableLogCategories(UniValue cats, bool enable) {
     cats = cats.get_array();
     for (unsigned int i = 0; i < cats.size(); ++i) {
@@ -596,6 +795,9 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
+    { "control",            "getlockstats",           &getlockstats,           {} },
+    { "control",            "getschedulerinfo",       &getschedulerinfo,       {} },
+    { "control",            "getcheckqueueinfo",      &getcheckqueueinfo,      {} },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
     { "util",               "validateaddress",        &validateaddress,        {"address"} },
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys","address_type"} },
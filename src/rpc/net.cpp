@@ -116,6 +116,14 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                             {
                                 {RPCResult::Type::NUM, "n", "The heights of blocks we're currently asking from this peer"},
                             }},
+                            {RPCResult::Type::OBJ, "compact_blocks", "The compact blocks we tried to reconstruct from this peer",
+                            {
+                                {RPCResult::Type::NUM, "received", "The number of compact blocks"},
+                                {RPCResult::Type::NUM, "reconstructed", "The number of those rebuilt without a getblocktxn round trip"},
+                                {RPCResult::Type::NUM, "hit_rate", "reconstructed out of received"},
+                                {RPCResult::Type::NUM, "txn", "The number of transactions in those blocks"},
+                                {RPCResult::Type::NUM, "txn_missing", "The number of those that were neither prefilled nor in our mempool or extra pool"},
+                            }},
                             {RPCResult::Type::BOOL, "whitelisted", "Whether the peer is whitelisted"},
                             {RPCResult::Type::NUM, "minfeefilter", "The minimum fee rate for transactions this peer accepts"},
                             {RPCResult::Type::OBJ_DYN, "bytessent_per_msg", "",
@@ -195,6 +203,13 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            UniValue cmpctblocks(UniValue::VOBJ);
+            cmpctblocks.pushKV("received", statestats.m_cmpctblocks_received);
+            cmpctblocks.pushKV("reconstructed", statestats.m_cmpctblocks_reconstructed);
+            cmpctblocks.pushKV("hit_rate", statestats.m_cmpctblocks_received ? (double)statestats.m_cmpctblocks_reconstructed / statestats.m_cmpctblocks_received : 0.0);
+            cmpctblocks.pushKV("txn", statestats.m_cmpctblock_txn);
+            cmpctblocks.pushKV("txn_missing", statestats.m_cmpctblock_txn_missing);
+            obj.pushKV("compact_blocks", cmpctblocks);
         }
         obj.pushKV("whitelisted", stats.m_legacyWhitelisted);
         UniValue permissions(UniValue::VARR);
@@ -7,9 +7,11 @@
 #include <coins.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <index/spentindex.h>
 #include <index/txindex.h>
 #include <key_io.h>
 #include <merkleblock.h>
+#include <net_processing.h>
 #include <node/coin.h>
 #include <node/context.h>
 #include <node/psbt.h>
@@ -70,6 +72,32 @@ static void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue&
                 entry.pushKV("confirmations", 0);
         }
     }
+
+    // With -spentindex, tell which input spent each output.
+    if (g_spent_index && g_spent_index->BlockUntilSyncedToCurrentChain()) {
+        std::vector<COutPoint> outpoints;
+        outpoints.reserve(tx.vout.size());
+        for (uint32_t i = 0; i < tx.vout.size(); i++) {
+            outpoints.emplace_back(tx.GetHash(), i);
+        }
+        std::vector<Optional<SpentLocation>> locations;
+        g_spent_index->FindSpends(outpoints, locations);
+
+        const UniValue& vout = find_value(entry, "vout");
+        UniValue annotated(UniValue::VARR);
+        for (size_t i = 0; i < vout.size(); i++) {
+            UniValue out = vout[i];
+            if (locations[i]) {
+                UniValue spent(UniValue::VOBJ);
+                spent.pushKV("txid", locations[i]->txid.GetHex());
+                spent.pushKV("vin", (uint64_t)locations[i]->nInput);
+                spent.pushKV("height", locations[i]->nHeight);
+                out.pushKV("spentby", spent);
+            }
+            annotated.push_back(out);
+        }
+        entry.pushKV("vout", annotated);
+    }
 }
 
 static UniValue getrawtransaction(const JSONRPCRequest& request)
@@ -144,6 +172,12 @@ static UniValue getrawtransaction(const JSONRPCRequest& request)
                                              {RPCResult::Type::STR, "address", "litecoinz address"},
                                          }},
                                      }},
+                                     {RPCResult::Type::OBJ, "spentby", /* optional */ true, "The input that spent the output on the active chain (only with -spentindex)",
+                                     {
+                                         {RPCResult::Type::STR_HEX, "txid", "The transaction id"},
+                                         {RPCResult::Type::NUM, "vin", "The position of the input"},
+                                         {RPCResult::Type::NUM, "height", "The height of the block"},
+                                     }},
                                  }},
                              }},
                              {RPCResult::Type::STR_HEX, "blockhash", "the block hash"},
@@ -950,6 +984,118 @@ static UniValue testmempoolaccept(const JSONRPCRequest& request)
     return result;
 }
 
+static UniValue submitpackage(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"submitpackage",
+                "\nSubmit a package of raw transactions (serialized, hex-encoded) to the local node and network.\n"
+                "\nEach transaction may spend outputs of the ones before it. The package is accepted to the mempool\n"
+                "as a whole, so that a child can pay the fees of a parent that would not be accepted on its own.\n"
+                "Either none of the transactions are accepted, or all of them are.\n"
+                "\nSee sendrawtransaction call.\n",
+                {
+                    {"package", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions, parents before children.\n"
+            "                                        At most " + ToString(MAX_PACKAGE_COUNT) + " transactions.",
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                        },
+                    {"maxfeerate", RPCArg::Type::AMOUNT, /* default */ FormatMoney(DEFAULT_MAX_RAW_TX_FEE_RATE.GetFeePerK()),
+                        "Reject transactions whose fee rate is higher than the specified value, expressed in " + CURRENCY_UNIT +
+                            "/kB.\nSet to 0 to accept any fee rate.\n"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::BOOL, "allowed", "If the mempool accepted the package"},
+                        {RPCResult::Type::STR, "reject-reason", "Rejection string (only present when 'allowed' is false)"},
+                        {RPCResult::Type::ARR, "tx-results", "The result for each raw transaction in the input array",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR_HEX, "txid", "The transaction hash in hex"},
+                                {RPCResult::Type::BOOL, "allowed", "If the transaction is in the mempool"},
+                                {RPCResult::Type::STR, "reject-reason", "Rejection string (only present when the transaction was rejected)"},
+                            }},
+                        }},
+                    }
+                },
+                RPCExamples{
+            "\nSubmit a parent and a child spending it (signed hex)\n"
+            + HelpExampleCli("submitpackage", R"('["signedparenthex", "signedchildhex"]')") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("submitpackage", "[\"signedparenthex\", \"signedchildhex\"]")
+                },
+    }.Check(request);
+
+    RPCTypeCheck(request.params, {
+        UniValue::VARR,
+        UniValueType(), // NUM, checked later
+    });
+
+    const UniValue& raw_txs = request.params[0].get_array();
+    if (raw_txs.size() == 0 || raw_txs.size() > MAX_PACKAGE_COUNT) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Array must contain between 1 and %u raw transactions", MAX_PACKAGE_COUNT));
+    }
+
+    std::vector<CTransactionRef> package;
+    for (size_t i = 0; i < raw_txs.size(); i++) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, raw_txs[i].get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u. Make sure the tx has at least one input.", i));
+        }
+        package.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    const CFeeRate max_raw_tx_fee_rate = request.params[1].isNull() ? DEFAULT_MAX_RAW_TX_FEE_RATE : CFeeRate(AmountFromValue(request.params[1]));
+
+    CTxMemPool& mempool = EnsureMemPool();
+    if (!g_rpc_node->connman) {
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    TxValidationState package_state;
+    std::vector<TxValidationState> tx_states;
+    bool accepted;
+    {
+        LOCK(cs_main);
+        accepted = AcceptPackageToMemoryPool(mempool, package_state, tx_states, package, max_raw_tx_fee_rate);
+    }
+
+    UniValue tx_results(UniValue::VARR);
+    std::vector<uint256> relay;
+    for (size_t i = 0; i < package.size(); i++) {
+        const uint256& txid = package[i]->GetHash();
+        UniValue tx_result(UniValue::VOBJ);
+        tx_result.pushKV("txid", txid.GetHex());
+        const bool tx_accepted = accepted || (tx_states[i].IsValid() && mempool.exists(txid));
+        tx_result.pushKV("allowed", tx_accepted);
+        if (!tx_states[i].IsValid()) {
+            if (tx_states[i].GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
+                tx_result.pushKV("reject-reason", "missing-inputs");
+            } else {
+                tx_result.pushKV("reject-reason", tx_states[i].GetRejectReason());
+            }
+        }
+        if (tx_accepted) relay.push_back(txid);
+        tx_results.push_back(std::move(tx_result));
+    }
+
+    // Make sure the wallet has been notified of the transactions before
+    // returning, as sendrawtransaction does.
+    SyncWithValidationInterfaceQueue();
+    for (const uint256& txid : relay) {
+        RelayTransaction(txid, *g_rpc_node->connman);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("allowed", accepted);
+    if (!accepted) {
+        result.pushKV("reject-reason", package_state.GetRejectReason());
+    }
+    result.pushKV("tx-results", std::move(tx_results));
+    return result;
+}
+
 static std::string WriteHDKeypath(std::vector<uint32_t>& keypath)
 {
     std::string keypath_str = "m";
@@ -1831,6 +1977,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "combinerawtransaction",        &combinerawtransaction,     {"txs"} },
     { "rawtransactions",    "signrawtransactionwithkey",    &signrawtransactionwithkey, {"hexstring","privkeys","prevtxs","sighashtype"} },
     { "rawtransactions",    "testmempoolaccept",            &testmempoolaccept,         {"rawtxs","allowhighfees|maxfeerate"} },
+    { "rawtransactions",    "submitpackage",                &submitpackage,             {"package","maxfeerate"} },
     { "rawtransactions",    "decodepsbt",                   &decodepsbt,                {"psbt"} },
     { "rawtransactions",    "combinepsbt",                  &combinepsbt,               {"txs"} },
     { "rawtransactions",    "finalizepsbt",                 &finalizepsbt,              {"psbt", "extract"} },
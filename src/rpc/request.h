@@ -24,6 +24,8 @@ void DeleteAuthCookie();
 /** Parse JSON-RPC batch reply into a vector */
 std::vector<UniValue> JSONRPCProcessBatchReply(const UniValue &in, size_t num);
 
+class JSONStreamWriter;
+
 class JSONRPCRequest
 {
 public:
@@ -34,6 +36,10 @@ public:
     std::string URI;
     std::string authUser;
     std::string peerAddr;
+    /** Where a handler may write a large result as it produces it, instead of
+     * returning it, or nullptr. A handler that starts writing returns NullUniValue.
+     */
+    JSONStreamWriter* stream{nullptr};
 
     JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
     void parse(const UniValue& valRequest);
@@ -5,17 +5,24 @@
 
 #include <rpc/server.h>
 
+#include <logging/timer.h>
 #include <rpc/util.h>
 #include <shutdown.h>
 #include <sync.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 
 #include <boost/signals2/signal.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory> // for unique_ptr
+#include <set>
+#include <thread>
 #include <unordered_map>
 
 static RecursiveMutex cs_rpcWarmup;
@@ -39,21 +46,134 @@ struct RPCServerInfo
 {
     Mutex mutex;
     std::list<RPCCommandExecutionInfo> active_commands GUARDED_BY(mutex);
+    //! Only registered methods are added, so the map stays small.
+    std::map<std::string, RPCMethodStats> method_stats GUARDED_BY(mutex);
 };
 
 static RPCServerInfo g_rpc_server_info;
 
+/** Threads that help run the calls of a batch that may run at the same time, see -rpcbatchthreads */
+class RPCBatchPool
+{
+private:
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()>> m_tasks GUARDED_BY(m_mutex);
+    bool m_running GUARDED_BY(m_mutex){false};
+    std::vector<std::thread> m_threads;
+
+    void Run()
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                while (m_running && m_tasks.empty())
+                    m_cond.wait(lock);
+                if (!m_running)
+                    break;
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    void Start(int threads)
+    {
+        WITH_LOCK(m_mutex, m_running = true);
+        for (int i = 0; i < threads; i++) {
+            m_threads.emplace_back([this, i] {
+                util::ThreadRename(strprintf("rpcbatch.%i", i));
+                Run();
+            });
+        }
+    }
+
+    void Stop()
+    {
+        {
+            LOCK(m_mutex);
+            m_running = false;
+            m_cond.notify_all();
+        }
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+        m_threads.clear();
+        WITH_LOCK(m_mutex, m_tasks.clear());
+    }
+
+    bool HasThreads() const { return !m_threads.empty(); }
+
+    /**
+     * Call fn(i) for each i in [0, n) on the pool threads and the calling
+     * thread, returning once all calls are done. The calling thread keeps
+     * taking calls itself, so this finishes even if the pool is busy.
+     */
+    void ParallelFor(size_t n, const std::function<void(size_t)>& fn)
+    {
+        struct State {
+            std::atomic<size_t> next{0};
+            Mutex mutex;
+            std::condition_variable cond;
+            size_t done GUARDED_BY(mutex){0};
+        };
+        // Helpers that start after the last call only find nothing left to do
+        std::shared_ptr<State> state = std::make_shared<State>();
+        auto work = [state, n, fn] {
+            size_t count = 0;
+            for (size_t i = state->next++; i < n; i = state->next++) {
+                fn(i);
+                count++;
+            }
+            if (count > 0) {
+                LOCK(state->mutex);
+                state->done += count;
+                state->cond.notify_all();
+            }
+        };
+        {
+            LOCK(m_mutex);
+            for (size_t i = 0; i + 1 < n && i < m_threads.size(); i++) {
+                m_tasks.emplace_back(work);
+            }
+            m_cond.notify_all();
+        }
+        work();
+        WAIT_LOCK(state->mutex, lock);
+        while (state->done < n)
+            state->cond.wait(lock);
+    }
+};
+static RPCBatchPool g_rpc_batch_pool;
+
 struct RPCCommandExecution
 {
     std::list<RPCCommandExecutionInfo>::iterator it;
+    //! Set when the call returns rather than throws
+    bool succeeded{false};
     explicit RPCCommandExecution(const std::string& method)
     {
         LOCK(g_rpc_server_info.mutex);
         it = g_rpc_server_info.active_commands.insert(g_rpc_server_info.active_commands.end(), {method, GetTimeMicros()});
+        RPCMethodStats& stats = g_rpc_server_info.method_stats[method];
+        ++stats.calls;
+        ++stats.in_flight;
     }
     ~RPCCommandExecution()
     {
+        const int64_t duration = GetTimeMicros() - it->start;
         LOCK(g_rpc_server_info.mutex);
+        RPCMethodStats& stats = g_rpc_server_info.method_stats[it->method];
+        --stats.in_flight;
+        if (!succeeded) ++stats.errors;
+        stats.total_us += duration;
+        stats.max_us = std::max(stats.max_us, duration);
+        size_t bucket = 0;
+        while (bucket < BCLog::METRIC_SCOPE_BOUNDS.size() && duration > BCLog::METRIC_SCOPE_BOUNDS[bucket]) ++bucket;
+        ++stats.histogram[bucket];
         g_rpc_server_info.active_commands.erase(it);
     }
 };
@@ -210,6 +330,21 @@ static UniValue getrpcinfo(const JSONRPCRequest& request)
                             }},
                         }},
                         {RPCResult::Type::STR, "logpath", "The complete file path to the debug log"},
+                        {RPCResult::Type::ARR, "bucket_bounds_ms", "Upper bounds of the histogram buckets, in milliseconds; a last bucket holds longer calls",
+                            {{RPCResult::Type::NUM, "", ""}}},
+                        {RPCResult::Type::OBJ_DYN, "methods", "The methods called since startup",
+                        {
+                            {RPCResult::Type::OBJ, "method", "",
+                            {
+                                {RPCResult::Type::NUM, "calls", "The number of calls"},
+                                {RPCResult::Type::NUM, "errors", "The number of calls that returned an error"},
+                                {RPCResult::Type::NUM, "in_flight", "The number of calls running now"},
+                                {RPCResult::Type::NUM, "mean_ms", "The mean duration of finished calls, in milliseconds"},
+                                {RPCResult::Type::NUM, "max_ms", "The longest duration, in milliseconds"},
+                                {RPCResult::Type::ARR, "histogram", "The number of finished calls in each bucket",
+                                    {{RPCResult::Type::NUM, "", ""}}},
+                            }},
+                        }},
                     }
                 },
                 RPCExamples{
@@ -233,6 +368,31 @@ static UniValue getrpcinfo(const JSONRPCRequest& request)
     UniValue log_path(UniValue::VSTR, path);
     result.pushKV("logpath", log_path);
 
+    UniValue bounds(UniValue::VARR);
+    for (int64_t bound : BCLog::METRIC_SCOPE_BOUNDS) {
+        bounds.push_back(bound / 1e3);
+    }
+    result.pushKV("bucket_bounds_ms", bounds);
+
+    UniValue methods(UniValue::VOBJ);
+    for (const auto& method : g_rpc_server_info.method_stats) {
+        const RPCMethodStats& stats = method.second;
+        const uint64_t finished = stats.calls - stats.in_flight;
+        UniValue histogram(UniValue::VARR);
+        for (uint64_t count : stats.histogram) {
+            histogram.push_back(count);
+        }
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("calls", stats.calls);
+        entry.pushKV("errors", stats.errors);
+        entry.pushKV("in_flight", stats.in_flight);
+        entry.pushKV("mean_ms", finished == 0 ? 0 : stats.total_us / 1e3 / finished);
+        entry.pushKV("max_ms", stats.max_us / 1e3);
+        entry.pushKV("histogram", histogram);
+        methods.pushKV(method.first, entry);
+    }
+    result.pushKV("methods", methods);
+
     return result;
 }
 
@@ -286,6 +446,11 @@ void StartRPC()
 {
     LogPrint(BCLog::RPC, "Starting RPC\n");
     g_rpc_running = true;
+    const int batch_threads = std::max((long)gArgs.GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 0L);
+    if (batch_threads > 0) {
+        LogPrint(BCLog::RPC, "Starting %d RPC batch threads\n", batch_threads);
+        g_rpc_batch_pool.Start(batch_threads);
+    }
     g_rpcSignals.Started();
 }
 
@@ -300,6 +465,7 @@ void StopRPC()
 {
     LogPrint(BCLog::RPC, "Stopping RPC\n");
     WITH_LOCK(g_deadline_timers_mutex, deadlineTimers.clear());
+    g_rpc_batch_pool.Stop();
     DeleteAuthCookie();
     g_rpcSignals.Stopped();
 }
@@ -360,11 +526,46 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
     return rpc_result;
 }
 
+/** Methods that only read, so that their calls in a batch may run at the same time */
+static const std::set<std::string> PARALLEL_BATCH_METHODS{"getblock", "getrawtransaction", "gettxout"};
+
+static bool IsParallelBatchCall(const UniValue& req)
+{
+    if (!req.isObject()) return false;
+    const UniValue& method = find_value(req.get_obj(), "method");
+    return method.isStr() && PARALLEL_BATCH_METHODS.count(method.get_str());
+}
+
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
 {
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    if (!g_rpc_batch_pool.HasThreads()) {
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
+            ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+
+        return ret.write() + "\n";
+    }
+
+    // Calls that may write, and the calls after them, keep their order
+    std::vector<UniValue> results(vReq.size());
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        size_t end = reqIdx;
+        while (end < vReq.size() && IsParallelBatchCall(vReq[end])) end++;
+        if (end - reqIdx > 1) {
+            const size_t first = reqIdx;
+            g_rpc_batch_pool.ParallelFor(end - first, [&jreq, &vReq, &results, first](size_t i) {
+                results[first + i] = JSONRPCExecOne(jreq, vReq[first + i]);
+            });
+            reqIdx = end;
+        } else {
+            end = std::max(end, reqIdx + 1);
+            for (; reqIdx < end; reqIdx++)
+                results[reqIdx] = JSONRPCExecOne(jreq, vReq[reqIdx]);
+        }
+    }
+    for (const UniValue& result : results)
+        ret.push_back(result);
 
     return ret.write() + "\n";
 }
@@ -431,6 +632,7 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
     // Find method
     auto it = mapCommands.find(request.strMethod);
     if (it != mapCommands.end()) {
+        METRIC_SCOPE_NAMED("rpc/" + request.strMethod);
         UniValue result;
         for (const auto& command : it->second) {
             if (ExecuteCommand(*command, request, result, &command == &it->second.back())) {
@@ -446,12 +648,15 @@ static bool ExecuteCommand(const CRPCCommand& command, const JSONRPCRequest& req
     try
     {
         RPCCommandExecution execution(request.strMethod);
+        bool handled;
         // Execute, convert arguments to array if necessary
         if (request.params.isObject()) {
-            return command.actor(transformNamedArguments(request, command.argNames), result, last_handler);
+            handled = command.actor(transformNamedArguments(request, command.argNames), result, last_handler);
         } else {
-            return command.actor(request, result, last_handler);
+            handled = command.actor(request, result, last_handler);
         }
+        execution.succeeded = true;
+        return handled;
     }
     catch (const std::exception& e)
     {
@@ -459,6 +664,12 @@ static bool ExecuteCommand(const CRPCCommand& command, const JSONRPCRequest& req
     }
 }
 
+std::map<std::string, RPCMethodStats> GetRPCMethodStats()
+{
+    LOCK(g_rpc_server_info.mutex);
+    return g_rpc_server_info.method_stats;
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
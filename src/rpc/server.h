@@ -7,8 +7,10 @@
 #define BITCOIN_RPC_SERVER_H
 
 #include <amount.h>
+#include <logging/timer.h>
 #include <rpc/request.h>
 
+#include <array>
 #include <map>
 #include <stdint.h>
 #include <string>
@@ -17,6 +19,8 @@
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+/** Default for -rpcbatchthreads: batches run one call after another */
+static const int DEFAULT_RPC_BATCH_THREADS = 0;
 
 class CRPCCommand;
 
@@ -162,9 +166,29 @@ extern CRPCTable tableRPC;
 void StartRPC();
 void InterruptRPC();
 void StopRPC();
+/** Execute the calls of a batch. With -rpcbatchthreads, consecutive calls
+ * that only read (getblock, getrawtransaction, gettxout) run at the same
+ * time; the results are in the order of the calls either way.
+ */
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
 
+/** Calls of one RPC method since startup */
+struct RPCMethodStats {
+    uint64_t calls{0};
+    //! Calls that ended in an error
+    uint64_t errors{0};
+    //! Calls running now
+    uint64_t in_flight{0};
+    uint64_t total_us{0};
+    int64_t max_us{0};
+    //! Finished calls per BCLog::METRIC_SCOPE_BOUNDS bucket, and a last one above them
+    std::array<uint64_t, BCLog::METRIC_SCOPE_BOUNDS.size() + 1> histogram{};
+};
+
+/** Stats of each method that has been called */
+std::map<std::string, RPCMethodStats> GetRPCMethodStats();
+
 #endif // BITCOIN_RPC_SERVER_H
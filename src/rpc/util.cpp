@@ -810,13 +810,19 @@ std::vector<CScript> EvalDescriptorStringOrObject(const UniValue& scanobject, Fl
         range.first = 0;
         range.second = 0;
     }
+    std::vector<std::vector<CScript>> scripts;
+    std::vector<FlatSigningProvider> providers;
+    if (!ExpandRange(*desc, range.first, range.second, provider, scripts, providers)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys: '%s'", desc_str));
+    }
     std::vector<CScript> ret;
-    for (int i = range.first; i <= range.second; ++i) {
-        std::vector<CScript> scripts;
-        if (!desc->Expand(i, provider, scripts, provider)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys: '%s'", desc_str));
-        }
-        std::move(scripts.begin(), scripts.end(), std::back_inserter(ret));
+    for (size_t i = 0; i < scripts.size(); ++i) {
+        std::move(scripts[i].begin(), scripts[i].end(), std::back_inserter(ret));
+        // Merge() would copy provider for each position.
+        provider.scripts.insert(providers[i].scripts.begin(), providers[i].scripts.end());
+        provider.pubkeys.insert(providers[i].pubkeys.begin(), providers[i].pubkeys.end());
+        provider.origins.insert(providers[i].origins.begin(), providers[i].origins.end());
+        provider.keys.insert(providers[i].keys.begin(), providers[i].keys.end());
     }
     return ret;
 }
@@ -833,6 +839,8 @@ UniValue GetServicesNames(ServiceFlags services)
         servicesNames.push_back("BLOOM");
     if (services & NODE_WITNESS)
         servicesNames.push_back("WITNESS");
+    if (services & NODE_COMPACT_FILTERS)
+        servicesNames.push_back("COMPACT_FILTERS");
     if (services & NODE_NETWORK_LIMITED)
         servicesNames.push_back("NETWORK_LIMITED");
 
@@ -72,6 +72,17 @@ extern "C" {
         unsigned char *result
     );
 
+    /// Computes `n` merkle tree hashes for the same depth, as
+    /// librustzcash_merkle_hash does for a single pair. `input` holds
+    /// the `n` pairs as consecutive 64-byte `a || b` values, and the
+    /// 32-byte results are written consecutively to `result`.
+    void librustzcash_merkle_hash_batch(
+        size_t depth,
+        const unsigned char *input,
+        size_t n,
+        unsigned char *result
+    );
+
     /// Computes the signature for each Spend description, given the key
     /// `ask`, the re-randomization `ar`, the 32-byte sighash `sighash`,
     /// and an output `result` buffer of 64-bytes for the signature.
@@ -215,6 +226,23 @@ extern "C" {
         unsigned char *result
     );
 
+    /// Compute [sk] [8] P for every pair of `n_p`
+    /// 32-byte points P and `n_sk` 32-byte Fs,
+    /// decompressing each point only once. The
+    /// result for the i-th point and the j-th
+    /// scalar is written to the 32 bytes at
+    /// `result + (i * n_sk + j) * 32`, and
+    /// `valid[i * n_sk + j]` is false if either
+    /// was invalid.
+    void librustzcash_sapling_ka_agree_batch(
+        const unsigned char *p,
+        size_t n_p,
+        const unsigned char *sk,
+        size_t n_sk,
+        unsigned char *result,
+        bool *valid
+    );
+
     /// Compute g_d = GH(diversifier) and returns
     /// false if the diversifier is invalid.
     /// Computes [esk] g_d and writes the result
@@ -273,6 +273,41 @@ pub extern "C" fn librustzcash_merkle_hash(
     tmp.write_le(&mut result[..]).expect("length is 32 bytes");
 }
 
+/// Computes `n` merkle tree hashes for the same depth. The `depth` parameter
+/// should not be larger than 62.
+///
+/// `input` must be of length `n * 64` and hold the pairs to hash as `a || b`,
+/// where `a` and `b` must each be scalars of BLS12-381.
+///
+/// The results are placed in `result`, which must be of length `n * 32`, in the
+/// order of the pairs.
+#[no_mangle]
+pub extern "C" fn librustzcash_merkle_hash_batch(
+    depth: size_t,
+    input: *const c_uchar,
+    n: size_t,
+    result: *mut c_uchar,
+) {
+    if n == 0 {
+        return;
+    }
+
+    // Should be okay, because caller is responsible for ensuring
+    // the pointers are valid pointers to n * 64 and n * 32 bytes
+    let input = unsafe { slice::from_raw_parts(input, n * 64) };
+    let result = unsafe { slice::from_raw_parts_mut(result, n * 32) };
+
+    for (pair, out) in input.chunks(64).zip(result.chunks_mut(32)) {
+        let mut a_repr = FrRepr::default();
+        a_repr.read_le(&pair[..32]).expect("length is 32 bytes");
+        let mut b_repr = FrRepr::default();
+        b_repr.read_le(&pair[32..]).expect("length is 32 bytes");
+
+        let tmp = merkle_hash(depth, &a_repr, &b_repr);
+        tmp.write_le(&mut out[..]).expect("length is 32 bytes");
+    }
+}
+
 #[no_mangle] // ToScalar
 pub extern "C" fn librustzcash_to_scalar(input: *const [c_uchar; 64], result: *mut [c_uchar; 32]) {
     // Should be okay, because caller is responsible for ensuring
@@ -532,6 +567,71 @@ pub extern "C" fn librustzcash_sapling_ka_agree(
     true
 }
 
+/// Computes \[sk\] \[8\] P for every pair of `n_p` points P and `n_sk` scalars
+/// sk, as librustzcash_sapling_ka_agree does for a single pair. Each point is
+/// decompressed and multiplied by the cofactor only once.
+///
+/// `p` must be of length `n_p * 32` and `sk` of length `n_sk * 32`. The result
+/// for the i-th point and the j-th scalar is written to the 32 bytes at
+/// `result[(i * n_sk + j) * 32]`, and `valid[i * n_sk + j]` is set to whether
+/// both were valid; `result` and `valid` must have room for `n_p * n_sk`
+/// entries.
+#[no_mangle]
+pub extern "C" fn librustzcash_sapling_ka_agree_batch(
+    p: *const c_uchar,
+    n_p: size_t,
+    sk: *const c_uchar,
+    n_sk: size_t,
+    result: *mut c_uchar,
+    valid: *mut bool,
+) {
+    if n_p == 0 || n_sk == 0 {
+        return;
+    }
+
+    // Should be okay, because caller is responsible for ensuring
+    // the pointers are valid pointers to the sizes above
+    let p = unsafe { slice::from_raw_parts(p, n_p * 32) };
+    let sk = unsafe { slice::from_raw_parts(sk, n_sk * 32) };
+    let result = unsafe { slice::from_raw_parts_mut(result, n_p * n_sk * 32) };
+    let valid = unsafe { slice::from_raw_parts_mut(valid, n_p * n_sk) };
+
+    // Deserialize the scalars once for all points
+    let sk: Vec<Option<Fs>> = sk
+        .chunks(32)
+        .map(|s| {
+            let mut repr = FsRepr::default();
+            repr.read_le(s).expect("length is 32 bytes");
+            Fs::from_repr(repr).ok()
+        })
+        .collect();
+
+    for (i, p) in p.chunks(32).enumerate() {
+        let row = &mut valid[i * n_sk..(i + 1) * n_sk];
+        let p = match edwards::Point::<Bls12, Unknown>::read(p, &JUBJUB) {
+            Ok(p) => p.mul_by_cofactor(&JUBJUB),
+            Err(_) => {
+                for v in row.iter_mut() {
+                    *v = false;
+                }
+                continue;
+            }
+        };
+
+        for (j, sk) in sk.iter().enumerate() {
+            row[j] = match sk {
+                Some(sk) => {
+                    let ka = p.mul(*sk, &JUBJUB);
+                    let out = &mut result[(i * n_sk + j) * 32..(i * n_sk + j + 1) * 32];
+                    ka.write(out).expect("length is not 32 bytes");
+                    true
+                }
+                None => false,
+            };
+        }
+    }
+}
+
 /// Compute g_d = GH(diversifier) and returns false if the diversifier is
 /// invalid. Computes \[esk\] g_d and writes the result to the 32-byte `result`
 /// buffer. Returns false if `esk` is not a valid scalar.
@@ -6,6 +6,7 @@
 
 #include <random.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <utility>
 
@@ -53,15 +54,24 @@ void CScheduler::serviceQueue()
             if (shouldStop() || taskQueue.empty())
                 continue;
 
+            const std::chrono::system_clock::time_point due = taskQueue.begin()->first;
             Function f = taskQueue.begin()->second;
             taskQueue.erase(taskQueue.begin());
 
+            const auto delay = std::max(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now() - due), std::chrono::microseconds{0});
+            const auto start = std::chrono::steady_clock::now();
             {
                 // Unlock before calling f, so it can reschedule itself or another task
                 // without deadlocking:
                 REVERSE_LOCK(lock);
                 f();
             }
+            const auto runtime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            ++m_stats.tasks_run;
+            m_stats.total_delay += delay;
+            m_stats.max_delay = std::max(m_stats.max_delay, delay);
+            m_stats.total_runtime += runtime;
+            m_stats.max_runtime = std::max(m_stats.max_runtime, runtime);
         } catch (...) {
             --nThreadsServicingQueue;
             throw;
@@ -142,6 +152,14 @@ bool CScheduler::AreThreadsServicingQueue() const {
     return nThreadsServicingQueue;
 }
 
+CScheduler::Stats CScheduler::GetStats() const
+{
+    LOCK(newTaskMutex);
+    Stats stats = m_stats;
+    stats.threads = nThreadsServicingQueue;
+    return stats;
+}
+
 
 void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
     {
@@ -17,6 +17,10 @@
 
 #include <sync.h>
 
+/** Default for -schedulerthreads */
+static const int DEFAULT_SCHEDULER_THREADS = 1;
+/** Maximum number of threads servicing the scheduler's queue */
+static const int MAX_SCHEDULER_THREADS = 8;
 //
 // Simple class for background tasks that should be run
 // periodically or once "after a while"
@@ -86,11 +90,25 @@ public:
     // Returns true if there are threads actively running in serviceQueue()
     bool AreThreadsServicingQueue() const;
 
+    /** Timings of the tasks run so far */
+    struct Stats {
+        uint64_t tasks_run{0};
+        //! How long after their time tasks started, summed and the worst
+        std::chrono::microseconds total_delay{0};
+        std::chrono::microseconds max_delay{0};
+        //! How long tasks ran, summed and the longest
+        std::chrono::microseconds total_runtime{0};
+        std::chrono::microseconds max_runtime{0};
+        int threads{0};
+    };
+    Stats GetStats() const;
+
 private:
     mutable Mutex newTaskMutex;
     std::condition_variable newTaskScheduled;
     std::multimap<std::chrono::system_clock::time_point, Function> taskQueue GUARDED_BY(newTaskMutex);
     int nThreadsServicingQueue GUARDED_BY(newTaskMutex){0};
+    Stats m_stats GUARDED_BY(newTaskMutex);
     bool stopRequested GUARDED_BY(newTaskMutex){false};
     bool stopWhenEmpty GUARDED_BY(newTaskMutex){false};
     bool shouldStop() const EXCLUSIVE_LOCKS_REQUIRED(newTaskMutex) { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
@@ -10,6 +10,12 @@
 #include <script/interpreter.h>
 #include <version.h>
 
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+
 namespace {
 
 /** A class that deserializes a single CTransaction one time. */
@@ -101,6 +107,60 @@ static int verify_script(const unsigned char *scriptPubKey, unsigned int scriptP
     }
 }
 
+int bitcoinconsensus_verify_script_batch(const bitcoinconsensus_spent_output *spentOutputs, unsigned int spentOutputsLen,
+                                    const unsigned char *txTo        , unsigned int txToLen,
+                                    unsigned int flags, unsigned int nThreads, int *results, bitcoinconsensus_error* err)
+{
+    if (!verify_flags(flags)) {
+        return set_error(err, bitcoinconsensus_ERR_INVALID_FLAGS);
+    }
+    try {
+        TxInputStream stream(SER_NETWORK, PROTOCOL_VERSION, txTo, txToLen);
+        const CTransaction tx(deserialize, stream);
+        if (GetSerializeSize(tx, PROTOCOL_VERSION) != txToLen)
+            return set_error(err, bitcoinconsensus_ERR_TX_SIZE_MISMATCH);
+        if (spentOutputsLen != tx.vin.size() || (spentOutputsLen > 0 && spentOutputs == nullptr))
+            return set_error(err, bitcoinconsensus_ERR_SPENT_OUTPUTS_MISMATCH);
+
+        // Regardless of the verification result, the tx did not error.
+        set_error(err, bitcoinconsensus_ERR_OK);
+
+        const PrecomputedTransactionData txdata(tx);
+        std::atomic<unsigned int> next{0};
+        std::atomic<bool> all_ok{true};
+        // Each thread takes the next input until there are none left, or
+        // one failed and the caller only wants to know whether all passed.
+        auto verify = [&] {
+            unsigned int nIn;
+            while ((results || all_ok) && (nIn = next++) < spentOutputsLen) {
+                const bitcoinconsensus_spent_output& spent = spentOutputs[nIn];
+                const bool ok = VerifyScript(tx.vin[nIn].scriptSig, CScript(spent.scriptPubKey, spent.scriptPubKey + spent.scriptPubKeyLen), &tx.vin[nIn].scriptWitness, flags, TransactionSignatureChecker(&tx, nIn, spent.value, txdata), nullptr);
+                if (results) results[nIn] = ok;
+                if (!ok) all_ok = false;
+            }
+        };
+
+        if (nThreads == 0) nThreads = std::max(1U, std::thread::hardware_concurrency());
+        nThreads = std::min(nThreads, spentOutputsLen);
+        std::vector<std::thread> threads;
+        // The calling thread verifies too; if no more threads can be
+        // started, those there are do the work.
+        try {
+            for (unsigned int i = 1; i < nThreads; ++i) {
+                threads.emplace_back(verify);
+            }
+        } catch (const std::system_error&) {
+        }
+        verify();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        return all_ok;
+    } catch (const std::exception&) {
+        return set_error(err, bitcoinconsensus_ERR_TX_DESERIALIZE); // Error deserializing
+    }
+}
+
 int bitcoinconsensus_verify_script_with_amount(const unsigned char *scriptPubKey, unsigned int scriptPubKeyLen, int64_t amount,
                                     const unsigned char *txTo        , unsigned int txToLen,
                                     unsigned int nIn, unsigned int flags, bitcoinconsensus_error* err)
@@ -33,7 +33,7 @@
 extern "C" {
 #endif
 
-#define BITCOINCONSENSUS_API_VER 1
+#define BITCOINCONSENSUS_API_VER 2
 
 typedef enum bitcoinconsensus_error_t
 {
@@ -43,8 +43,17 @@ typedef enum bitcoinconsensus_error_t
     bitcoinconsensus_ERR_TX_DESERIALIZE,
     bitcoinconsensus_ERR_AMOUNT_REQUIRED,
     bitcoinconsensus_ERR_INVALID_FLAGS,
+    bitcoinconsensus_ERR_SPENT_OUTPUTS_MISMATCH,
 } bitcoinconsensus_error;
 
+/** A previous output spent by an input of a transaction */
+typedef struct
+{
+    const unsigned char *scriptPubKey;
+    unsigned int scriptPubKeyLen;
+    int64_t value;
+} bitcoinconsensus_spent_output;
+
 /** Script verification flags */
 enum
 {
@@ -72,6 +81,18 @@ EXPORT_SYMBOL int bitcoinconsensus_verify_script_with_amount(const unsigned char
                                     const unsigned char *txTo        , unsigned int txToLen,
                                     unsigned int nIn, unsigned int flags, bitcoinconsensus_error* err);
 
+/// Returns 1 if every input of the serialized transaction pointed to by txTo
+/// correctly spends the output of the same index in spentOutputs under the
+/// additional constraints specified by flags. The transaction is deserialized
+/// and its signature hashes are prepared once, and the inputs are verified on
+/// up to nThreads threads (0 = one per core). spentOutputsLen must be the
+/// number of inputs. If not nullptr, results gets 1 or 0 for each input;
+/// without it verification stops at the first input that fails.
+/// If not nullptr, err will contain an error/success code for the operation
+EXPORT_SYMBOL int bitcoinconsensus_verify_script_batch(const bitcoinconsensus_spent_output *spentOutputs, unsigned int spentOutputsLen,
+                                    const unsigned char *txTo        , unsigned int txToLen,
+                                    unsigned int flags, unsigned int nThreads, int *results, bitcoinconsensus_error* err);
+
 EXPORT_SYMBOL unsigned int bitcoinconsensus_version();
 
 #ifdef __cplusplus
@@ -16,8 +16,11 @@
 #include <util/strencodings.h>
 #include <util/vector.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -1099,6 +1102,44 @@ std::unique_ptr<Descriptor> InferDescriptor(const CScript& script, const Signing
     return InferScript(script, ParseScriptContext::TOP, provider);
 }
 
+bool ExpandRange(const Descriptor& desc, int range_begin, int range_end, const SigningProvider& provider, std::vector<std::vector<CScript>>& output_scripts, std::vector<FlatSigningProvider>& out)
+{
+    output_scripts.clear();
+    out.clear();
+    if (range_end < range_begin) return true;
+    const size_t count = (size_t)range_end - range_begin + 1;
+    output_scripts.resize(count);
+    out.resize(count);
+
+    // Besides filling the cache, this sets the xpubs the key providers keep,
+    // so that expanding from the cache only reads them, from any thread.
+    DescriptorCache cache;
+    if (!desc.Expand(range_begin, provider, output_scripts[0], out[0], &cache)) return false;
+
+    // Positions the cache cannot expand, which need private keys
+    std::vector<char> uncached(count, 0);
+    std::atomic<size_t> next{1};
+    auto expand_cached = [&] {
+        for (size_t i = next++; i < count; i = next++) {
+            if (!desc.ExpandFromCache(range_begin + i, cache, output_scripts[i], out[i])) uncached[i] = 1;
+        }
+    };
+    // Deriving a key takes a few dozen microseconds; threads only pay off for larger ranges.
+    const size_t threads = std::min<size_t>(std::max(1, std::min(GetNumCores(), MAX_EXPAND_RANGE_THREADS)), count / 256 + 1);
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) workers.emplace_back(expand_cached);
+    expand_cached();
+    for (std::thread& worker : workers) worker.join();
+
+    for (size_t i = 1; i < count; ++i) {
+        if (!uncached[i]) continue;
+        output_scripts[i].clear();
+        out[i] = FlatSigningProvider();
+        if (!desc.Expand(range_begin + i, provider, output_scripts[i], out[i])) return false;
+    }
+    return true;
+}
+
 void DescriptorCache::CacheParentExtPubKey(uint32_t key_exp_pos, const CExtPubKey& xpub)
 {
     m_parent_xpubs[key_exp_pos] = xpub;
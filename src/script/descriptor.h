@@ -155,4 +155,19 @@ std::string GetDescriptorChecksum(const std::string& descriptor);
  */
 std::unique_ptr<Descriptor> InferDescriptor(const CScript& script, const SigningProvider& provider);
 
+/** Maximum number of threads ExpandRange derives positions on */
+static const int MAX_EXPAND_RANGE_THREADS = 8;
+
+/** Expand `desc` at every position from `range_begin` to `range_end` included.
+ *
+ * The result is that of calling Expand at each position, with the output of
+ * `range_begin + i` in `output_scripts[i]` and `out[i]`. The first position
+ * is expanded in full, and the others from the parent xpubs that caches, on
+ * up to MAX_EXPAND_RANGE_THREADS threads for large ranges. Positions with
+ * hardened ranged derivation are expanded in full, one after the other.
+ *
+ * Returns false if any position cannot be expanded.
+ */
+bool ExpandRange(const Descriptor& desc, int range_begin, int range_end, const SigningProvider& provider, std::vector<std::vector<CScript>>& output_scripts, std::vector<FlatSigningProvider>& out);
+
 #endif // BITCOIN_SCRIPT_DESCRIPTOR_H
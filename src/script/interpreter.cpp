@@ -10,6 +10,7 @@
 #include <crypto/sha256.h>
 #include <pubkey.h>
 #include <script/script.h>
+#include <streams.h>
 #include <uint256.h>
 
 typedef std::vector<unsigned char> valtype;
@@ -1246,6 +1247,15 @@ public:
     }
 };
 
+/** The size of a prevout, an empty script and an nSequence */
+constexpr size_t BLANK_INPUT_SIZE = 36 + 1 + 4;
+
+/** Whether nHashType commits to all inputs and outputs, which is the case the caches are for */
+bool IsSighashAll(int nHashType)
+{
+    return !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE;
+}
+
 template <class T>
 uint256 GetPrevoutHash(const T& txTo)
 {
@@ -1276,21 +1286,135 @@ uint256 GetOutputsHash(const T& txTo)
     return ss.GetHash();
 }
 
+const unsigned char ZCASH_PREVOUTS_HASH_PERSONALIZATION[crypto_generichash_blake2b_PERSONALBYTES] =
+    {'Z','c','a','s','h','P','r','e','v','o','u','t','H','a','s','h'};
+const unsigned char ZCASH_SEQUENCE_HASH_PERSONALIZATION[crypto_generichash_blake2b_PERSONALBYTES] =
+    {'Z','c','a','s','h','S','e','q','u','e','n','c','H','a','s','h'};
+const unsigned char ZCASH_OUTPUTS_HASH_PERSONALIZATION[crypto_generichash_blake2b_PERSONALBYTES] =
+    {'Z','c','a','s','h','O','u','t','p','u','t','s','H','a','s','h'};
+const unsigned char ZCASH_JOINSPLITS_HASH_PERSONALIZATION[crypto_generichash_blake2b_PERSONALBYTES] =
+    {'Z','c','a','s','h','J','S','p','l','i','t','s','H','a','s','h'};
+const unsigned char ZCASH_SHIELDED_SPENDS_HASH_PERSONALIZATION[crypto_generichash_blake2b_PERSONALBYTES] =
+    {'Z','c','a','s','h','S','S','p','e','n','d','s','H','a','s','h'};
+const unsigned char ZCASH_SHIELDED_OUTPUTS_HASH_PERSONALIZATION[crypto_generichash_blake2b_PERSONALBYTES] =
+    {'Z','c','a','s','h','S','O','u','t','p','u','t','H','a','s','h'};
+
+template <class T>
+uint256 GetShieldedPrevoutHash(const T& txTo)
+{
+    CBLAKE2bWriter ss(SER_GETHASH, 0, ZCASH_PREVOUTS_HASH_PERSONALIZATION);
+    for (const auto& txin : txTo.vin) {
+        ss << txin.prevout;
+    }
+    return ss.GetHash();
+}
+
+template <class T>
+uint256 GetShieldedSequenceHash(const T& txTo)
+{
+    CBLAKE2bWriter ss(SER_GETHASH, 0, ZCASH_SEQUENCE_HASH_PERSONALIZATION);
+    for (const auto& txin : txTo.vin) {
+        ss << txin.nSequence;
+    }
+    return ss.GetHash();
+}
+
+template <class T>
+uint256 GetShieldedOutputsHash(const T& txTo)
+{
+    CBLAKE2bWriter ss(SER_GETHASH, 0, ZCASH_OUTPUTS_HASH_PERSONALIZATION);
+    for (const auto& txout : txTo.vout) {
+        ss << txout;
+    }
+    return ss.GetHash();
+}
+
+template <class T>
+uint256 GetJoinSplitsHash(const T& txTo)
+{
+    // JSDescription serialization depends on the transaction header
+    CBLAKE2bWriter ss(SER_GETHASH, static_cast<int>(txTo.GetHeader()), ZCASH_JOINSPLITS_HASH_PERSONALIZATION);
+    for (const auto& jsdesc : txTo.vJoinSplit) {
+        ss << jsdesc;
+    }
+    ss << txTo.joinSplitPubKey;
+    return ss.GetHash();
+}
+
+template <class T>
+uint256 GetShieldedSpendsHash(const T& txTo)
+{
+    CBLAKE2bWriter ss(SER_GETHASH, 0, ZCASH_SHIELDED_SPENDS_HASH_PERSONALIZATION);
+    for (const auto& spend : txTo.vShieldedSpend) {
+        // The spendAuthSig is not committed to, as it signs this hash
+        ss << spend.cv;
+        ss << spend.anchor;
+        ss << spend.nullifier;
+        ss << spend.rk;
+        ss << spend.zkproof;
+    }
+    return ss.GetHash();
+}
+
+template <class T>
+uint256 GetShieldedOutputsDescHash(const T& txTo)
+{
+    CBLAKE2bWriter ss(SER_GETHASH, 0, ZCASH_SHIELDED_OUTPUTS_HASH_PERSONALIZATION);
+    for (const auto& output : txTo.vShieldedOutput) {
+        ss << output;
+    }
+    return ss.GetHash();
+}
+
 } // namespace
 
 template <class T>
-PrecomputedTransactionData::PrecomputedTransactionData(const T& txTo)
+void PrecomputedTransactionData::Init(const T& txTo, bool force)
 {
     // Cache is calculated only for transactions with witness
-    if (txTo.HasWitness()) {
+    if (force || txTo.HasWitness()) {
         hashPrevouts = GetPrevoutHash(txTo);
         hashSequence = GetSequenceHash(txTo);
         hashOutputs = GetOutputsHash(txTo);
+        m_witness_all_prefix << txTo.nVersion << hashPrevouts << hashSequence;
         ready = true;
     }
+
+    // Every legacy SIGHASH_ALL signature hash covers the whole transaction, which is
+    // quadratic in the inputs. Only the signed input differs between them, so serialize
+    // the rest once and keep the hasher midstate before each input.
+    size_t legacy_inputs = 0;
+    for (const auto& txin : txTo.vin) {
+        if (txin.scriptWitness.IsNull()) ++legacy_inputs;
+    }
+    if (legacy_inputs >= 2) {
+        // An out of range nIn blanks every input
+        const CScript empty;
+        CVectorWriter s(SER_GETHASH, 0, m_legacy_all, 0);
+        s << CTransactionSignatureSerializer<T>(txTo, empty, txTo.vin.size(), SIGHASH_ALL);
+        m_legacy_all_inputs_pos = GetSizeOfCompactSize(txTo.vin.size()) + sizeof(txTo.nVersion);
+
+        CHashWriter ss(SER_GETHASH, 0);
+        ss.write((const char*)m_legacy_all.data(), m_legacy_all_inputs_pos);
+        m_legacy_all_prefix.reserve(txTo.vin.size());
+        for (size_t i = 0; i < txTo.vin.size(); ++i) {
+            m_legacy_all_prefix.push_back(ss);
+            ss.write((const char*)m_legacy_all.data() + m_legacy_all_inputs_pos + BLANK_INPUT_SIZE * i, BLANK_INPUT_SIZE);
+        }
+        m_legacy_ready = true;
+    }
+    m_initialized = true;
+}
+
+template <class T>
+PrecomputedTransactionData::PrecomputedTransactionData(const T& txTo)
+{
+    Init(txTo);
 }
 
 // explicit instantiation
+template void PrecomputedTransactionData::Init(const CTransaction& txTo, bool force);
+template void PrecomputedTransactionData::Init(const CMutableTransaction& txTo, bool force);
 template PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo);
 template PrecomputedTransactionData::PrecomputedTransactionData(const CMutableTransaction& txTo);
 
@@ -1304,6 +1428,7 @@ uint256 SignatureHash(const CScript& scriptCode, const T& txTo, unsigned int nIn
         uint256 hashSequence;
         uint256 hashOutputs;
         const bool cacheready = cache && cache->ready;
+        const bool use_prefix = cacheready && IsSighashAll(nHashType);
 
         if (!(nHashType & SIGHASH_ANYONECANPAY)) {
             hashPrevouts = cacheready ? cache->hashPrevouts : GetPrevoutHash(txTo);
@@ -1322,12 +1447,14 @@ uint256 SignatureHash(const CScript& scriptCode, const T& txTo, unsigned int nIn
             hashOutputs = ss.GetHash();
         }
 
-        CHashWriter ss(SER_GETHASH, 0);
-        // Version
-        ss << txTo.nVersion;
-        // Input prevouts/nSequence (none/all, depending on flags)
-        ss << hashPrevouts;
-        ss << hashSequence;
+        CHashWriter ss(use_prefix ? cache->m_witness_all_prefix : CHashWriter(SER_GETHASH, 0));
+        if (!use_prefix) {
+            // Version
+            ss << txTo.nVersion;
+            // Input prevouts/nSequence (none/all, depending on flags)
+            ss << hashPrevouts;
+            ss << hashSequence;
+        }
         // The input being signed (replacing the scriptSig with scriptCode + amount)
         // The prevout may already be contained in hashPrevout, and the nSequence
         // may already be contain in hashSequence.
@@ -1356,12 +1483,86 @@ uint256 SignatureHash(const CScript& scriptCode, const T& txTo, unsigned int nIn
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer<T> txTmp(txTo, scriptCode, nIn, nHashType);
 
+    if (cache && cache->m_legacy_ready && IsSighashAll(nHashType)) {
+        // Resume from before the signed input, then hash the cached rest of the transaction
+        CHashWriter ss(cache->m_legacy_all_prefix[nIn]);
+        txTmp.SerializeInput(ss, nIn);
+        const size_t rest = cache->m_legacy_all_inputs_pos + BLANK_INPUT_SIZE * (nIn + 1);
+        ss.write((const char*)cache->m_legacy_all.data() + rest, cache->m_legacy_all.size() - rest);
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
     return ss.GetHash();
 }
 
+template <class T>
+uint256 ShieldedSignatureHash(const T& txTo, uint32_t consensusBranchId)
+{
+    uint256 hashPrevouts;
+    uint256 hashSequence;
+    uint256 hashOutputs;
+    uint256 hashJoinSplits;
+    uint256 hashShieldedSpends;
+    uint256 hashShieldedOutputs;
+
+    if (!txTo.vin.empty()) {
+        hashPrevouts = GetShieldedPrevoutHash(txTo);
+        hashSequence = GetShieldedSequenceHash(txTo);
+    }
+    if (!txTo.vout.empty()) {
+        hashOutputs = GetShieldedOutputsHash(txTo);
+    }
+    if (!txTo.vJoinSplit.empty()) {
+        hashJoinSplits = GetJoinSplitsHash(txTo);
+    }
+    if (!txTo.vShieldedSpend.empty()) {
+        hashShieldedSpends = GetShieldedSpendsHash(txTo);
+    }
+    if (!txTo.vShieldedOutput.empty()) {
+        hashShieldedOutputs = GetShieldedOutputsDescHash(txTo);
+    }
+
+    // The personalization commits to the consensus branch
+    unsigned char personalization[crypto_generichash_blake2b_PERSONALBYTES] = {};
+    memcpy(personalization, "ZcashSigHash", 12);
+    WriteLE32(personalization + 12, consensusBranchId);
+
+    CBLAKE2bWriter ss(SER_GETHASH, 0, personalization);
+    // Header
+    ss << txTo.GetHeader();
+    // Version group ID
+    ss << txTo.nVersionGroupId;
+    // Input prevouts/nSequence
+    ss << hashPrevouts;
+    ss << hashSequence;
+    // Outputs
+    ss << hashOutputs;
+    // JoinSplits
+    ss << hashJoinSplits;
+    // Spend descriptions
+    ss << hashShieldedSpends;
+    // Output descriptions
+    ss << hashShieldedOutputs;
+    // Locktime
+    ss << txTo.nLockTime;
+    // Expiry height
+    ss << txTo.nExpiryHeight;
+    // Sapling value balance
+    ss << txTo.valueBalance;
+    // Sighash type
+    ss << (int)SIGHASH_ALL;
+
+    return ss.GetHash();
+}
+
+// explicit instantiation
+template uint256 ShieldedSignatureHash(const CTransaction& txTo, uint32_t consensusBranchId);
+template uint256 ShieldedSignatureHash(const CMutableTransaction& txTo, uint32_t consensusBranchId);
+
 template <class T>
 bool GenericTransactionSignatureChecker<T>::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
@@ -1478,6 +1679,63 @@ bool GenericTransactionSignatureChecker<T>::CheckSequence(const CScriptNum& nSeq
 template class GenericTransactionSignatureChecker<CTransaction>;
 template class GenericTransactionSignatureChecker<CMutableTransaction>;
 
+namespace {
+
+/** Whether scriptPubKey is exactly DUP HASH160 <20 bytes> EQUALVERIFY CHECKSIG */
+bool IsPayToPubKeyHash(const CScript& scriptPubKey)
+{
+    return scriptPubKey.size() == 25 && scriptPubKey[0] == OP_DUP && scriptPubKey[1] == OP_HASH160 && scriptPubKey[2] == 20 &&
+           scriptPubKey[23] == OP_EQUALVERIFY && scriptPubKey[24] == OP_CHECKSIG;
+}
+
+/**
+ * Run DUP HASH160 <keyhash> EQUALVERIFY CHECKSIG on a stack of vchSig and
+ * vchPubKey, without the interpreter. Returns true if it leaves true on top of
+ * the stack. Otherwise EvalScript has to run the script, and gives its error.
+ */
+bool CheckPubKeyHash(const valtype& vchSig, const valtype& vchPubKey, const unsigned char* keyhash, const CScript& scriptCode, unsigned int flags, SigVersion sigversion, const BaseSignatureChecker& checker)
+{
+    uint160 hash;
+    CHash160().Write(vchPubKey.data(), vchPubKey.size()).Finalize(hash.begin());
+    if (memcmp(hash.begin(), keyhash, 20)) return false;
+    // A 20-byte signature could be found and deleted from scriptCode, as the key hash
+    if (sigversion == SigVersion::BASE && vchSig.size() == 20) return false;
+    if (!CheckSignatureEncoding(vchSig, flags, nullptr) || !CheckPubKeyEncoding(vchPubKey, flags, sigversion, nullptr)) return false;
+    return checker.CheckSig(vchSig, vchPubKey, scriptCode, sigversion);
+}
+
+/**
+ * Fast path of VerifyScript for a P2PKH output spent by a scriptSig of two
+ * pushes. Returns true if the spend is valid; otherwise VerifyScript has to
+ * run the scripts, which gives the exact error of an invalid spend.
+ */
+bool VerifyPayToPubKeyHash(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness& witness, unsigned int flags, const BaseSignatureChecker& checker)
+{
+    if (!IsPayToPubKeyHash(scriptPubKey)) return false;
+    // VerifyScript rejects a witness it does not use
+    if ((flags & SCRIPT_VERIFY_WITNESS) && !witness.IsNull()) return false;
+
+    // The scriptSig must be exactly two pushes that EvalScript accepts
+    const bool fRequireMinimal = (flags & SCRIPT_VERIFY_MINIMALDATA) != 0;
+    CScript::const_iterator pc = scriptSig.begin();
+    opcodetype opcode;
+    valtype vchSig, vchPubKey;
+    if (!scriptSig.GetOp(pc, opcode, vchSig) || opcode > OP_PUSHDATA4 || vchSig.size() > MAX_SCRIPT_ELEMENT_SIZE ||
+        (fRequireMinimal && !CheckMinimalPush(vchSig, opcode))) {
+        return false;
+    }
+    if (!scriptSig.GetOp(pc, opcode, vchPubKey) || opcode > OP_PUSHDATA4 || vchPubKey.size() > MAX_SCRIPT_ELEMENT_SIZE ||
+        (fRequireMinimal && !CheckMinimalPush(vchPubKey, opcode))) {
+        return false;
+    }
+    if (pc != scriptSig.end()) return false;
+
+    // This leaves a single true on the stack, so CLEANSTACK holds as well
+    return CheckPubKeyHash(vchSig, vchPubKey, scriptPubKey.data() + 3, scriptPubKey, flags, SigVersion::BASE, checker);
+}
+
+} // namespace
+
 static bool ExecuteWitnessScript(const Span<const valtype>& stack_span, const CScript& scriptPubKey, unsigned int flags, SigVersion sigversion, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     std::vector<valtype> stack{stack_span.begin(), stack_span.end()};
@@ -1521,6 +1779,11 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
                 return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_MISMATCH); // 2 items in witness
             }
             scriptPubKey << OP_DUP << OP_HASH160 << program << OP_EQUALVERIFY << OP_CHECKSIG;
+            // The common case needs no interpreter, which still runs for anything else
+            if (stack[0].size() <= MAX_SCRIPT_ELEMENT_SIZE && stack[1].size() <= MAX_SCRIPT_ELEMENT_SIZE &&
+                CheckPubKeyHash(stack[0], stack[1], program.data(), scriptPubKey, flags, SigVersion::WITNESS_V0, checker)) {
+                return true;
+            }
             return ExecuteWitnessScript(stack, scriptPubKey, flags, SigVersion::WITNESS_V0, checker, serror);
         } else {
             return set_error(serror, SCRIPT_ERR_WITNESS_PROGRAM_WRONG_LENGTH);
@@ -1545,6 +1808,10 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const C
 
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
 
+    if (VerifyPayToPubKeyHash(scriptSig, scriptPubKey, *witness, flags, checker)) {
+        return set_success(serror);
+    }
+
     if ((flags & SCRIPT_VERIFY_SIGPUSHONLY) != 0 && !scriptSig.IsPushOnly()) {
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include <hash.h>
 #include <script/script_error.h>
 #include <primitives/transaction.h>
 
@@ -122,6 +123,25 @@ struct PrecomputedTransactionData
 {
     uint256 hashPrevouts, hashSequence, hashOutputs;
     bool ready = false;
+    //! Whether Init has run, ready is only set for transactions with witness
+    bool m_initialized = false;
+    //! The witness v0 SIGHASH_ALL hasher after nVersion, hashPrevouts and hashSequence, set when ready
+    CHashWriter m_witness_all_prefix{SER_GETHASH, 0};
+
+    //! Whether the legacy SIGHASH_ALL cache below is set, only done for transactions with several non-witness inputs
+    bool m_legacy_ready = false;
+    //! The legacy SIGHASH_ALL serialization with every input blanked, of which the signed input is the only change
+    std::vector<unsigned char> m_legacy_all;
+    //! The position of the first input in m_legacy_all
+    size_t m_legacy_all_inputs_pos = 0;
+    //! For each input, the hasher after the part of m_legacy_all before it
+    std::vector<CHashWriter> m_legacy_all_prefix;
+
+    PrecomputedTransactionData() = default;
+
+    /** Compute the caches for tx. With force, the witness ones are computed even though tx has no witness yet, as for signing it. */
+    template <class T>
+    void Init(const T& tx, bool force = false);
 
     template <class T>
     explicit PrecomputedTransactionData(const T& tx);
@@ -140,6 +160,14 @@ static constexpr size_t WITNESS_V0_KEYHASH_SIZE = 20;
 template <class T>
 uint256 SignatureHash(const CScript& scriptCode, const T& txTo, unsigned int nIn, int nHashType, const CAmount& amount, SigVersion sigversion, const PrecomputedTransactionData* cache = nullptr);
 
+/**
+ * Compute the ZIP 243 signature hash of a transaction as a whole (not for any
+ * particular input), with SIGHASH_ALL. This is the message signed by every
+ * Sapling spendAuthSig and by the bindingSig.
+ */
+template <class T>
+uint256 ShieldedSignatureHash(const T& txTo, uint32_t consensusBranchId);
+
 class BaseSignatureChecker
 {
 public:
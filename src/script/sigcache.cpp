@@ -11,7 +11,6 @@
 #include <util/system.h>
 
 #include <cuckoocache.h>
-#include <boost/thread.hpp>
 
 namespace {
 /**
@@ -24,9 +23,8 @@ class CSignatureCache
 private:
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    typedef CuckooCache::sharded_cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
-    boost::shared_mutex cs_sigcache;
 
 public:
     CSignatureCache()
@@ -43,19 +41,44 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
         return setValid.contains(entry, erase);
     }
 
     void Set(uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
         setValid.insert(entry);
     }
+
+    void Set(std::vector<uint256>& entries)
+    {
+        for (uint256& entry : entries) {
+            setValid.insert(entry);
+        }
+    }
+
+    void Save(uint256& nonce_out, std::vector<uint256>& entries)
+    {
+        nonce_out = nonce;
+        setValid.collect(entries);
+    }
+
+    // Only before the cache is used, as the nonce is read without a lock
+    void Restore(const uint256& nonce_in, const std::vector<uint256>& entries)
+    {
+        nonce = nonce_in;
+        for (const uint256& entry : entries) {
+            setValid.insert(entry);
+        }
+    }
     uint32_t setup_bytes(size_t n)
     {
         return setValid.setup_bytes(n);
     }
+
+    CuckooCache::cache_stats GetStats()
+    {
+        return setValid.stats();
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -79,15 +102,58 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& entries)
+{
+    signatureCache.Save(nonce, entries);
+}
+
+void LoadSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& entries)
+{
+    signatureCache.Restore(nonce, entries);
+}
+
+CuckooCache::cache_stats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
     if (signatureCache.Get(entry, !store))
         return true;
+    if (m_batch) {
+        m_batch->Add(m_check, vchSig, pubkey, sighash, entry, store);
+        return true;
+    }
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
     if (store)
         signatureCache.Set(entry);
     return true;
 }
+
+void CSignatureBatch::Add(size_t check, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, const uint256& entry, bool store)
+{
+    m_signatures.push_back(SignatureBatchEntry{pubkey, sighash, vchSig});
+    m_checks.push_back(check);
+    m_entries.push_back(entry);
+    m_store.push_back(store);
+}
+
+std::vector<size_t> CSignatureBatch::Verify()
+{
+    VerifySignatureBatch(m_signatures);
+    std::vector<size_t> invalid;
+    std::vector<uint256> valid_entries;
+    for (size_t i = 0; i < m_signatures.size(); i++) {
+        if (!m_signatures[i].valid) {
+            invalid.push_back(m_checks[i]);
+        } else if (m_store[i]) {
+            valid_entries.push_back(m_entries[i]);
+        }
+    }
+    signatureCache.Set(valid_entries);
+    return invalid;
+}
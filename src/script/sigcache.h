@@ -6,6 +6,8 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include <cuckoocache.h>
+#include <pubkey.h>
 #include <script/interpreter.h>
 
 #include <vector>
@@ -17,8 +19,6 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
-class CPubKey;
-
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
  * blinding in the set hash computation.
@@ -40,17 +40,52 @@ public:
     }
 };
 
+/**
+ * Signatures that were not in the cache, collected from a batch of script
+ * checks that ran with them assumed valid, to be verified together.
+ */
+class CSignatureBatch
+{
+private:
+    std::vector<SignatureBatchEntry> m_signatures;
+    //! For each signature, the check it comes from, its cache entry, and whether to store that
+    std::vector<size_t> m_checks;
+    std::vector<uint256> m_entries;
+    std::vector<bool> m_store;
+
+public:
+    void Add(size_t check, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, const uint256& entry, bool store);
+    size_t Size() const { return m_signatures.size(); }
+
+    /**
+     * Verify the signatures, and add the valid ones to the cache at once where
+     * requested. Returns the checks with an invalid signature, whose results
+     * are not known.
+     */
+    std::vector<size_t> Verify();
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
+    //! If set, where signatures that are not cached go instead of being verified, and the check they are added for
+    CSignatureBatch* m_batch;
+    size_t m_check;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn) {}
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn, CSignatureBatch* batch = nullptr, size_t check = 0) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn), m_batch(batch), m_check(check) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
 };
 
 void InitSignatureCache();
 
+/** The nonce and the entries of the signature cache, to save it */
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& entries);
+/** Restore the signature cache saved with GetSignatureCacheEntries, before it is used */
+void LoadSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& entries);
+
+CuckooCache::cache_stats GetSignatureCacheStats();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -723,7 +723,9 @@ template<typename Stream, typename T> void Unserialize(Stream& is, boost::option
  * array
  */
 template<typename Stream, typename T, std::size_t N> void Serialize(Stream& os, const std::array<T, N>& item);
+template<typename Stream, std::size_t N> void Serialize(Stream& os, const std::array<unsigned char, N>& item);
 template<typename Stream, typename T, std::size_t N> void Unserialize(Stream& is, std::array<T, N>& item);
+template<typename Stream, std::size_t N> void Unserialize(Stream& is, std::array<unsigned char, N>& item);
 
 /**
  * pair
@@ -980,6 +982,13 @@ void Serialize(Stream& os, const std::array<T, N>& item)
     }
 }
 
+template<typename Stream, std::size_t N>
+void Serialize(Stream& os, const std::array<unsigned char, N>& item)
+{
+    // Byte arrays (ciphertexts, proofs, signatures) are written in one go, not a byte at a time
+    os.write((const char*)item.data(), N);
+}
+
 template<typename Stream, typename T, std::size_t N>
 void Unserialize(Stream& is, std::array<T, N>& item)
 {
@@ -988,6 +997,12 @@ void Unserialize(Stream& is, std::array<T, N>& item)
     }
 }
 
+template<typename Stream, std::size_t N>
+void Unserialize(Stream& is, std::array<unsigned char, N>& item)
+{
+    is.read((char*)item.data(), N);
+}
+
 
 
 /**
@@ -1132,9 +1147,12 @@ class CSizeComputer
 protected:
     size_t nSize;
 
+    const int nType;
     const int nVersion;
 public:
-    explicit CSizeComputer(int nVersionIn) : nSize(0), nVersion(nVersionIn) {}
+    explicit CSizeComputer(int nVersionIn) : nSize(0), nType(0), nVersion(nVersionIn) {}
+    /** For objects whose serialization depends on the type, as sent or stored */
+    CSizeComputer(int nTypeIn, int nVersionIn) : nSize(0), nType(nTypeIn), nVersion(nVersionIn) {}
 
     void write(const char *psz, size_t _nSize)
     {
@@ -1158,6 +1176,7 @@ public:
         return nSize;
     }
 
+    int GetType() const { return nType; }
     int GetVersion() const { return nVersion; }
 };
 
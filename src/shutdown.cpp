@@ -5,10 +5,18 @@
 
 #include <shutdown.h>
 
+#include <logging.h>
+#include <sync.h>
+#include <util/time.h>
+
 #include <atomic>
 
 static std::atomic<bool> fRequestShutdown(false);
 
+static Mutex g_shutdown_phase_mutex;
+static std::string g_shutdown_phase GUARDED_BY(g_shutdown_phase_mutex);
+static int64_t g_shutdown_start GUARDED_BY(g_shutdown_phase_mutex){0};
+
 void StartShutdown()
 {
     fRequestShutdown = true;
@@ -21,3 +29,18 @@ bool ShutdownRequested()
 {
     return fRequestShutdown;
 }
+
+void SetShutdownPhase(const std::string& phase)
+{
+    LOCK(g_shutdown_phase_mutex);
+    const int64_t now = GetTimeMillis();
+    if (g_shutdown_phase.empty()) g_shutdown_start = now;
+    g_shutdown_phase = phase;
+    LogPrintf("Shutdown: %s (%dms)\n", phase, now - g_shutdown_start);
+}
+
+std::string GetShutdownPhase()
+{
+    LOCK(g_shutdown_phase_mutex);
+    return g_shutdown_phase;
+}
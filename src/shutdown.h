@@ -6,8 +6,15 @@
 #ifndef BITCOIN_SHUTDOWN_H
 #define BITCOIN_SHUTDOWN_H
 
+#include <string>
+
 void StartShutdown();
 void AbortShutdown();
 bool ShutdownRequested();
 
+/** Log the step Shutdown() is at, with the time since the first one. */
+void SetShutdownPhase(const std::string& phase);
+/** The step Shutdown() is at, or an empty string if it has not started. */
+std::string GetShutdownPhase();
+
 #endif
@@ -0,0 +1,575 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <stratum.h>
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <crypto/common.h>
+#include <key_io.h>
+#include <logging.h>
+#include <miner.h>
+#include <netbase.h>
+#include <node/context.h>
+#include <pow.h>
+#include <random.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <support/events.h>
+#include <timedata.h>
+#include <txmempool.h>
+#include <ui_interface.h>
+#include <util/strencodings.h>
+#include <util/system.h>
+#include <util/translation.h>
+#include <validation.h>
+#include <validationinterface.h>
+#include <version.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+#include <thread>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+
+//! Longest line a client may send, which leaves room for the largest Equihash solution
+static const size_t MAX_STRATUM_LINE_LENGTH = 16 * 1024;
+//! Most clients served at once
+static const size_t MAX_STRATUM_CLIENTS = 1024;
+//! Most jobs on the current tip shares are accepted for
+static const size_t MAX_STRATUM_JOBS = 16;
+//! How long a new job waits after a mempool change, so bursts of transactions are coalesced
+static const struct timeval STRATUM_MEMPOOL_DELAY = {1, 0};
+
+static_assert(STRATUM_NONCE1_SIZE == 4, "NONCE_1 is written as a 32-bit counter");
+
+/** Error codes of ZIP 301 */
+enum StratumError {
+    STRATUM_ERROR_OTHER = 20,
+    STRATUM_ERROR_JOB_NOT_FOUND = 21,
+    STRATUM_ERROR_DUPLICATE_SHARE = 22,
+    STRATUM_ERROR_LOW_DIFFICULTY = 23,
+    STRATUM_ERROR_UNAUTHORIZED = 24,
+    STRATUM_ERROR_NOT_SUBSCRIBED = 25,
+};
+
+template <typename T>
+static std::string SerializeHex(const T& obj)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << obj;
+    return HexStr(ss.begin(), ss.end());
+}
+
+UniValue StratumNotifyParams(const std::string& job_id, const CBlockHeader& header, bool clean_jobs)
+{
+    // The fields are encoded as they are serialized in the header.
+    UniValue params(UniValue::VARR);
+    params.push_back(job_id);
+    params.push_back(SerializeHex(header.nVersion));
+    params.push_back(SerializeHex(header.hashPrevBlock));
+    params.push_back(SerializeHex(header.hashMerkleRoot));
+    params.push_back(SerializeHex(header.hashSaplingRoot));
+    params.push_back(SerializeHex(header.nTime));
+    params.push_back(SerializeHex(header.nBits));
+    params.push_back(clean_jobs);
+    return params;
+}
+
+bool StratumShareHeader(CBlockHeader& header, const std::vector<unsigned char>& nonce1, const std::string& time_hex,
+                        const std::string& nonce2_hex, const std::string& solution_hex)
+{
+    if (time_hex.size() != 8 || !IsHex(time_hex)) return false;
+    if (!IsHex(nonce2_hex) || nonce1.size() + nonce2_hex.size() / 2 != header.nNonce.size()) return false;
+    if (!IsHex(solution_hex)) return false;
+
+    header.nTime = ReadLE32(ParseHex(time_hex).data());
+
+    std::vector<unsigned char> nonce(nonce1);
+    const std::vector<unsigned char> nonce2 = ParseHex(nonce2_hex);
+    nonce.insert(nonce.end(), nonce2.begin(), nonce2.end());
+    std::copy(nonce.begin(), nonce.end(), header.nNonce.begin());
+
+    CDataStream ss(ParseHex(solution_hex), SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        ss >> header.nSolution;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return ss.empty();
+}
+
+namespace {
+
+/** A block template sent to the clients with mining.notify. */
+struct StratumJob {
+    std::string id;
+    //! The block, whose header lacks the nonce and the solution
+    std::shared_ptr<const CBlock> block;
+    //! The height of the block, which the Equihash parameters depend on
+    int height;
+    //! The hashes of the shares submitted for the job
+    std::set<uint256> shares;
+};
+
+struct StratumClient {
+    struct bufferevent* bev{nullptr};
+    std::string address;
+    std::string worker;
+    std::vector<unsigned char> nonce1;
+    bool subscribed{false};
+    bool authorized{false};
+    //! The share target asked for with mining.suggest_target, or zero to use the target of the block
+    arith_uint256 suggested_target;
+    //! The share target last sent with mining.set_target
+    arith_uint256 target;
+};
+
+/**
+ * Serves jobs to Stratum clients on its own libevent loop, and turns shares
+ * that meet the target of the block into blocks without going through
+ * submitblock. A new job is built as soon as the tip changes, and shortly
+ * after the mempool does. The clients and jobs are only touched on the event
+ * loop thread.
+ */
+class StratumServer final : public CValidationInterface
+{
+private:
+    const CTxMemPool& m_mempool;
+    const CChainParams& m_chainparams;
+    const CScript m_coinbase_script;
+
+    raii_event_base m_base;
+    //! Builds a new job on the event loop, when activated or when its timeout expires
+    raii_event m_update_event;
+    std::vector<struct evconnlistener*> m_listeners;
+    std::thread m_thread;
+
+    std::map<struct bufferevent*, StratumClient> m_clients;
+    std::deque<StratumJob> m_jobs;
+    uint32_t m_next_job_id{0};
+    uint32_t m_next_nonce1;
+    unsigned int m_extra_nonce{0};
+
+    //! The number of subscribed clients, also read by the validation interface callbacks
+    std::atomic<int> m_subscribed{0};
+    //! Whether the timeout of m_update_event is pending
+    std::atomic<bool> m_update_scheduled{false};
+
+    static void accept_cb(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx);
+    static void read_cb(struct bufferevent* bev, void* ctx);
+    static void event_cb(struct bufferevent* bev, short what, void* ctx);
+    static void update_cb(evutil_socket_t fd, short what, void* ctx);
+
+    /** Close the connection of client, which is gone afterwards. */
+    void Disconnect(StratumClient& client);
+    void Send(StratumClient& client, const UniValue& msg);
+    void Reply(StratumClient& client, const UniValue& id, const UniValue& result);
+    void ReplyError(StratumClient& client, const UniValue& id, int code, const std::string& message);
+    /** Send job to client, preceded by its share target if that changed. */
+    void SendJob(StratumClient& client, const StratumJob& job, bool clean_jobs);
+    /** Handle a line sent by client. Returns false if it should be disconnected. */
+    bool ProcessLine(StratumClient& client, const std::string& line);
+    void Submit(StratumClient& client, const UniValue& id, const UniValue& params);
+    void UpdateJob();
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override;
+
+public:
+    StratumServer(const CTxMemPool& mempool, const CChainParams& chainparams, const CScript& coinbase_script);
+    ~StratumServer();
+
+    bool Bind(const std::string& host, uint16_t port);
+    void Start();
+    void Interrupt();
+    void Stop();
+};
+
+StratumServer::StratumServer(const CTxMemPool& mempool, const CChainParams& chainparams, const CScript& coinbase_script)
+    : m_mempool(mempool), m_chainparams(chainparams), m_coinbase_script(coinbase_script),
+      m_base(obtain_event_base()), m_update_event(obtain_event(m_base.get(), -1, 0, update_cb, this)),
+      m_next_nonce1(GetRand(std::numeric_limits<uint32_t>::max())) {}
+
+StratumServer::~StratumServer()
+{
+    for (auto& entry : m_clients) {
+        bufferevent_free(entry.first);
+    }
+    for (struct evconnlistener* listener : m_listeners) {
+        evconnlistener_free(listener);
+    }
+}
+
+bool StratumServer::Bind(const std::string& host, uint16_t port)
+{
+    CService addr;
+    if (!Lookup(host, addr, port, false)) return false;
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addr.GetSockAddr((struct sockaddr*)&sockaddr, &len)) return false;
+    struct evconnlistener* listener = evconnlistener_new_bind(m_base.get(), accept_cb, this,
+        LEV_OPT_REUSEABLE | LEV_OPT_CLOSE_ON_EXEC | LEV_OPT_CLOSE_ON_FREE, -1, (struct sockaddr*)&sockaddr, len);
+    if (!listener) return false;
+    m_listeners.push_back(listener);
+    LogPrintf("Stratum server listening on %s\n", addr.ToString());
+    return true;
+}
+
+void StratumServer::Start()
+{
+    m_thread = std::thread(&TraceThread<std::function<void()>>, "stratum", std::function<void()>([this] {
+        event_base_dispatch(m_base.get());
+    }));
+}
+
+void StratumServer::Interrupt()
+{
+    event_base_once(m_base.get(), -1, EV_TIMEOUT, [](evutil_socket_t, short, void* base) {
+        event_base_loopbreak(static_cast<struct event_base*>(base));
+    }, m_base.get(), nullptr);
+}
+
+void StratumServer::Stop()
+{
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void StratumServer::accept_cb(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx)
+{
+    StratumServer* self = static_cast<StratumServer*>(ctx);
+    CService addr_from;
+    addr_from.SetSockAddr(addr);
+    if (self->m_clients.size() >= MAX_STRATUM_CLIENTS) {
+        LogPrint(BCLog::STRATUM, "stratum: too many clients, refusing connection from %s\n", addr_from.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+    struct bufferevent* bev = bufferevent_socket_new(self->m_base.get(), fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+
+    StratumClient& client = self->m_clients[bev];
+    client.bev = bev;
+    client.address = addr_from.ToString();
+    client.nonce1.resize(STRATUM_NONCE1_SIZE);
+    WriteLE32(client.nonce1.data(), self->m_next_nonce1++);
+    bufferevent_setcb(bev, read_cb, nullptr, event_cb, self);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+    LogPrint(BCLog::STRATUM, "stratum: accepted connection from %s\n", client.address);
+}
+
+void StratumServer::read_cb(struct bufferevent* bev, void* ctx)
+{
+    StratumServer* self = static_cast<StratumServer*>(ctx);
+    auto it = self->m_clients.find(bev);
+    if (it == self->m_clients.end()) return;
+    StratumClient& client = it->second;
+
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t n_read_out = 0;
+    char* line;
+    while ((line = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF)) != nullptr) {
+        const std::string s(line, n_read_out);
+        free(line);
+        if (s.size() > MAX_STRATUM_LINE_LENGTH || !self->ProcessLine(client, s)) {
+            self->Disconnect(client);
+            return;
+        }
+    }
+    if (evbuffer_get_length(input) > MAX_STRATUM_LINE_LENGTH) {
+        LogPrint(BCLog::STRATUM, "stratum: line from %s too long, disconnecting\n", client.address);
+        self->Disconnect(client);
+    }
+}
+
+void StratumServer::event_cb(struct bufferevent* bev, short what, void* ctx)
+{
+    StratumServer* self = static_cast<StratumServer*>(ctx);
+    if (!(what & (BEV_EVENT_EOF | BEV_EVENT_ERROR))) return;
+    auto it = self->m_clients.find(bev);
+    if (it == self->m_clients.end()) return;
+    LogPrint(BCLog::STRATUM, "stratum: %s disconnected\n", it->second.address);
+    self->Disconnect(it->second);
+}
+
+void StratumServer::update_cb(evutil_socket_t fd, short what, void* ctx)
+{
+    static_cast<StratumServer*>(ctx)->UpdateJob();
+}
+
+void StratumServer::Disconnect(StratumClient& client)
+{
+    if (client.subscribed) --m_subscribed;
+    struct bufferevent* bev = client.bev;
+    m_clients.erase(bev);
+    bufferevent_free(bev);
+}
+
+void StratumServer::Send(StratumClient& client, const UniValue& msg)
+{
+    const std::string line = msg.write() + "\n";
+    bufferevent_write(client.bev, line.data(), line.size());
+}
+
+void StratumServer::Reply(StratumClient& client, const UniValue& id, const UniValue& result)
+{
+    UniValue reply(UniValue::VOBJ);
+    reply.pushKV("id", id);
+    reply.pushKV("result", result);
+    reply.pushKV("error", NullUniValue);
+    Send(client, reply);
+}
+
+void StratumServer::ReplyError(StratumClient& client, const UniValue& id, int code, const std::string& message)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back(code);
+    error.push_back(message);
+    error.push_back(NullUniValue);
+    UniValue reply(UniValue::VOBJ);
+    reply.pushKV("id", id);
+    reply.pushKV("result", NullUniValue);
+    reply.pushKV("error", error);
+    Send(client, reply);
+}
+
+void StratumServer::SendJob(StratumClient& client, const StratumJob& job, bool clean_jobs)
+{
+    arith_uint256 target = client.suggested_target;
+    if (target == 0) target.SetCompact(job.block->nBits);
+    if (target != client.target) {
+        client.target = target;
+        UniValue params(UniValue::VARR);
+        params.push_back(ArithToUint256(target).GetHex());
+        UniValue msg(UniValue::VOBJ);
+        msg.pushKV("id", NullUniValue);
+        msg.pushKV("method", "mining.set_target");
+        msg.pushKV("params", params);
+        Send(client, msg);
+    }
+
+    UniValue msg(UniValue::VOBJ);
+    msg.pushKV("id", NullUniValue);
+    msg.pushKV("method", "mining.notify");
+    msg.pushKV("params", StratumNotifyParams(job.id, *job.block, clean_jobs));
+    Send(client, msg);
+}
+
+bool StratumServer::ProcessLine(StratumClient& client, const std::string& line)
+{
+    if (line.empty()) return true;
+
+    UniValue msg;
+    if (!msg.read(line) || !msg.isObject()) {
+        LogPrint(BCLog::STRATUM, "stratum: malformed message from %s, disconnecting\n", client.address);
+        return false;
+    }
+    const UniValue& id = find_value(msg, "id");
+    const UniValue& method = find_value(msg, "method");
+    const UniValue& params = find_value(msg, "params");
+    if (!method.isStr() || !params.isArray()) {
+        ReplyError(client, id, STRATUM_ERROR_OTHER, "Malformed request");
+        return true;
+    }
+
+    const std::string& name = method.get_str();
+    if (name == "mining.subscribe") {
+        if (!client.subscribed) {
+            client.subscribed = true;
+            ++m_subscribed;
+        }
+        UniValue result(UniValue::VARR);
+        result.push_back(NullUniValue); // sessions cannot be resumed
+        result.push_back(HexStr(client.nonce1));
+        Reply(client, id, result);
+        if (m_jobs.empty()) {
+            event_active(m_update_event.get(), EV_TIMEOUT, 0);
+        } else {
+            SendJob(client, m_jobs.back(), true);
+        }
+    } else if (name == "mining.authorize") {
+        // Any worker may submit shares: they only ever pay to -stratumaddress.
+        client.authorized = true;
+        client.worker = params.size() > 0 && params[0].isStr() ? SanitizeString(params[0].get_str()) : "";
+        LogPrint(BCLog::STRATUM, "stratum: %s authorized as %s\n", client.address, client.worker);
+        Reply(client, id, true);
+    } else if (name == "mining.suggest_target") {
+        if (params.size() < 1 || !params[0].isStr() || params[0].get_str().size() != 64 || !IsHex(params[0].get_str())) {
+            ReplyError(client, id, STRATUM_ERROR_OTHER, "Malformed target");
+            return true;
+        }
+        const arith_uint256 pow_limit = UintToArith256(m_chainparams.GetConsensus().powLimit);
+        client.suggested_target = std::min(UintToArith256(uint256S(params[0].get_str())), pow_limit);
+        Reply(client, id, true);
+        if (client.subscribed && !m_jobs.empty()) SendJob(client, m_jobs.back(), false);
+    } else if (name == "mining.submit") {
+        Submit(client, id, params);
+    } else {
+        ReplyError(client, id, STRATUM_ERROR_OTHER, "Method not found");
+    }
+    return true;
+}
+
+void StratumServer::Submit(StratumClient& client, const UniValue& id, const UniValue& params)
+{
+    if (!client.subscribed) return ReplyError(client, id, STRATUM_ERROR_NOT_SUBSCRIBED, "Not subscribed");
+    if (!client.authorized) return ReplyError(client, id, STRATUM_ERROR_UNAUTHORIZED, "Unauthorized worker");
+    if (params.size() < 5 || !params[1].isStr() || !params[2].isStr() || !params[3].isStr() || !params[4].isStr()) {
+        return ReplyError(client, id, STRATUM_ERROR_OTHER, "Malformed share");
+    }
+
+    const std::string& job_id = params[1].get_str();
+    auto job = std::find_if(m_jobs.begin(), m_jobs.end(), [&](const StratumJob& j) { return j.id == job_id; });
+    if (job == m_jobs.end()) return ReplyError(client, id, STRATUM_ERROR_JOB_NOT_FOUND, "Job not found");
+
+    CBlockHeader header = job->block->GetBlockHeader();
+    if (!StratumShareHeader(header, client.nonce1, params[2].get_str(), params[3].get_str(), params[4].get_str())) {
+        return ReplyError(client, id, STRATUM_ERROR_OTHER, "Malformed share");
+    }
+    if (header.nTime < job->block->nTime || header.GetBlockTime() > GetAdjustedTime() + MAX_FUTURE_BLOCK_TIME) {
+        return ReplyError(client, id, STRATUM_ERROR_OTHER, "Time out of range");
+    }
+
+    // Check the cheap hash against the share target before the solution.
+    const uint256 hash = header.GetHash();
+    if (job->shares.count(hash)) return ReplyError(client, id, STRATUM_ERROR_DUPLICATE_SHARE, "Duplicate share");
+    if (UintToArith256(hash) > client.target) return ReplyError(client, id, STRATUM_ERROR_LOW_DIFFICULTY, "Low difficulty share");
+    const Consensus::Params& consensus = m_chainparams.GetConsensus();
+    if (!CheckEquihashSolution(&header, job->height, consensus)) {
+        return ReplyError(client, id, STRATUM_ERROR_OTHER, "Invalid solution");
+    }
+    job->shares.insert(hash);
+    Reply(client, id, true);
+
+    if (!CheckProofOfWork(hash, header.nBits, consensus)) return;
+
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>(*job->block);
+    block->nTime = header.nTime;
+    block->nNonce = header.nNonce;
+    block->nSolution = header.nSolution;
+    // The template passed CheckBlock without the new header.
+    block->fChecked = false;
+    LogPrintf("stratum: %s (%s) found block %s at height %d\n", client.worker, client.address, hash.ToString(), job->height);
+    bool new_block;
+    if (!ProcessNewBlock(m_chainparams, block, /* fForceProcessing */ true, &new_block)) {
+        LogPrintf("stratum: block %s was not accepted\n", hash.ToString());
+    }
+}
+
+void StratumServer::UpdateJob()
+{
+    m_update_scheduled = false;
+    if (m_subscribed == 0 || ::ChainstateActive().IsInitialBlockDownload()) return;
+
+    std::unique_ptr<CBlockTemplate> block_template;
+    try {
+        block_template = BlockAssembler(m_mempool, m_chainparams).CreateNewBlock(m_coinbase_script);
+    } catch (const std::exception& e) {
+        LogPrintf("stratum: failed to create a block template: %s\n", e.what());
+        return;
+    }
+    if (!block_template) return;
+
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>(block_template->block);
+    int height;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* tip = ::ChainActive().Tip();
+        // The tip moved while the block was assembled, which brings another update.
+        if (block->hashPrevBlock != tip->GetBlockHash()) return;
+        IncrementExtraNonce(block.get(), tip, m_extra_nonce);
+        height = tip->nHeight + 1;
+    }
+
+    // A job on a new tip makes the others stale.
+    const bool clean_jobs = m_jobs.empty() || m_jobs.back().block->hashPrevBlock != block->hashPrevBlock;
+    if (clean_jobs) m_jobs.clear();
+    while (m_jobs.size() >= MAX_STRATUM_JOBS) m_jobs.pop_front();
+    StratumJob job;
+    job.id = strprintf("%x", ++m_next_job_id);
+    job.block = std::move(block);
+    job.height = height;
+    m_jobs.push_back(std::move(job));
+    LogPrint(BCLog::STRATUM, "stratum: new job %s at height %d with %u transactions\n",
+             m_jobs.back().id, height, m_jobs.back().block->vtx.size());
+
+    for (auto& entry : m_clients) {
+        if (entry.second.subscribed) SendJob(entry.second, m_jobs.back(), clean_jobs);
+    }
+}
+
+void StratumServer::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload || m_subscribed == 0) return;
+    event_active(m_update_event.get(), EV_TIMEOUT, 0);
+}
+
+void StratumServer::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence)
+{
+    if (m_subscribed == 0 || m_update_scheduled.exchange(true)) return;
+    event_add(m_update_event.get(), &STRATUM_MEMPOOL_DELAY);
+}
+
+} // namespace
+
+static std::unique_ptr<StratumServer> g_stratum_server;
+
+bool StartStratumServer(NodeContext& node)
+{
+    if (!gArgs.GetBoolArg("-stratum", DEFAULT_STRATUM)) return true;
+
+    const std::string address = gArgs.GetArg("-stratumaddress", "");
+    const CTxDestination dest = DecodeDestination(address);
+    if (!IsValidDestination(dest)) {
+        return InitError(strprintf(_("Invalid -stratumaddress: '%s'").translated, address));
+    }
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    g_stratum_server = MakeUnique<StratumServer>(*node.mempool, Params(), GetScriptForDestination(dest));
+
+    std::vector<std::string> binds = gArgs.GetArgs("-stratumbind");
+    if (binds.empty()) binds.push_back("127.0.0.1");
+    for (const std::string& bind : binds) {
+        int port = gArgs.GetArg("-stratumport", DEFAULT_STRATUM_PORT);
+        std::string host;
+        SplitHostPort(bind, port, host);
+        if (!g_stratum_server->Bind(host, port)) {
+            g_stratum_server.reset();
+            return InitError(strprintf(_("Unable to bind the Stratum server to %s").translated, bind));
+        }
+    }
+
+    RegisterValidationInterface(g_stratum_server.get(), "stratum");
+    g_stratum_server->Start();
+    return true;
+}
+
+void InterruptStratumServer()
+{
+    if (g_stratum_server) g_stratum_server->Interrupt();
+}
+
+void StopStratumServer()
+{
+    if (!g_stratum_server) return;
+    UnregisterValidationInterface(g_stratum_server.get());
+    g_stratum_server->Stop();
+    g_stratum_server.reset();
+}
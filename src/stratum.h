@@ -0,0 +1,46 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Stratum server for Equihash mining pools and miners (ZIP 301).
+ */
+#ifndef LITECOINZ_STRATUM_H
+#define LITECOINZ_STRATUM_H
+
+#include <univalue.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlockHeader;
+struct NodeContext;
+
+//! Default for -stratum
+static const bool DEFAULT_STRATUM = false;
+//! Default for -stratumport
+static const uint16_t DEFAULT_STRATUM_PORT = 3333;
+//! Size of the part of the nonce the server assigns to each client (NONCE_1)
+static const size_t STRATUM_NONCE1_SIZE = 4;
+
+/** Start the Stratum server if -stratum is set. Returns false on a configuration or bind error. */
+bool StartStratumServer(NodeContext& node);
+/** Stop the event loop of the Stratum server; no more shares are accepted. */
+void InterruptStratumServer();
+/** Stop the Stratum server. The validation interface callbacks must not be running any more. */
+void StopStratumServer();
+
+/** The params of a mining.notify for a job with the given header. */
+UniValue StratumNotifyParams(const std::string& job_id, const CBlockHeader& header, bool clean_jobs);
+
+/**
+ * Complete header with the time, nonce and solution of a mining.submit, in
+ * the hex encoding of ZIP 301: nonce1 followed by nonce2 makes up the whole
+ * nonce, and the solution has its length prefix. Returns false if they are
+ * malformed.
+ */
+bool StratumShareHeader(CBlockHeader& header, const std::vector<unsigned char>& nonce1, const std::string& time_hex,
+                        const std::string& nonce2_hex, const std::string& solution_hex);
+
+#endif // LITECOINZ_STRATUM_H
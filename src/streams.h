@@ -193,6 +193,62 @@ public:
     }
 };
 
+/** Minimal stream for reading from an existing byte span, without copying it
+ * into a stream buffer first.
+ */
+class SpanReader
+{
+private:
+    const int m_type;
+    const int m_version;
+    Span<const unsigned char> m_data;
+
+public:
+
+    /**
+     * @param[in]  type Serialization Type
+     * @param[in]  version Serialization Version (including any flags)
+     * @param[in]  data Referenced bytes to read from; they must outlive the reader
+     */
+    SpanReader(int type, int version, Span<const unsigned char> data)
+        : m_type(type), m_version(version), m_data(data) {}
+
+    template<typename T>
+    SpanReader& operator>>(T&& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    size_t size() const { return m_data.size(); }
+    bool empty() const { return m_data.size() == 0; }
+
+    void read(char* dst, size_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+
+        if (n > size()) {
+            throw std::ios_base::failure("SpanReader::read(): end of data");
+        }
+        memcpy(dst, m_data.data(), n);
+        m_data = m_data.subspan(n);
+    }
+
+    void ignore(size_t n)
+    {
+        if (n > size()) {
+            throw std::ios_base::failure("SpanReader::ignore(): end of data");
+        }
+        m_data = m_data.subspan(n);
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -301,6 +357,9 @@ public:
     value_type* data()                               { return vch.data() + nReadPos; }
     const value_type* data() const                   { return vch.data() + nReadPos; }
 
+    /** Exchange the underlying buffer, e.g. to reuse its capacity. Reading starts at the front of the new one. */
+    void SwapBuffer(vector_type& other)              { vch.swap(other); nReadPos = 0; }
+
     void insert(iterator it, std::vector<char>::const_iterator first, std::vector<char>::const_iterator last)
     {
         if (last == first) return;
@@ -531,6 +590,30 @@ public:
         }
         return data;
     }
+
+    /** Read bits up to and including the first 0, and return how many 1s came before it.
+     * This is the unary code Read(1) would take a call per bit for.
+     */
+    uint64_t ReadUnary() {
+        uint64_t ones = 0;
+        while (true) {
+            if (m_offset == 8) {
+                m_istream >> m_buffer;
+                m_offset = 0;
+            }
+            // The unread bits, at the top
+            uint8_t bits = static_cast<uint8_t>(m_buffer << m_offset);
+            while (m_offset < 8 && (bits & 0x80)) {
+                bits <<= 1;
+                ++m_offset;
+                ++ones;
+            }
+            if (m_offset < 8) {
+                ++m_offset;
+                return ones;
+            }
+        }
+    }
 };
 
 template <typename OStream>
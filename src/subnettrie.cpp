@@ -0,0 +1,152 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <subnettrie.h>
+
+#include <algorithm>
+#include <vector>
+
+static inline int Bit(const SubNetTrie::Key& key, int n)
+{
+    return (key[n / 8] >> (7 - n % 8)) & 1;
+}
+
+/** The number of leading bits a and b have in common, up to max */
+static int CommonBits(const SubNetTrie::Key& a, const SubNetTrie::Key& b, int max)
+{
+    int n = 0;
+    while (n < max && a[n / 8] == b[n / 8]) n += 8;
+    while (n < max && Bit(a, n) == Bit(b, n)) n++;
+    return std::min(n, max);
+}
+
+/** Clear the bits of key past length */
+static SubNetTrie::Key Truncate(const SubNetTrie::Key& key, int length)
+{
+    SubNetTrie::Key truncated{};
+    std::copy(key.begin(), key.begin() + length / 8, truncated.begin());
+    if (length % 8) truncated[length / 8] = key[length / 8] & (0xff << (8 - length % 8));
+    return truncated;
+}
+
+static SubNetTrie::Key ToKey(const CNetAddr& addr)
+{
+    const std::vector<unsigned char> bytes = addr.GetAddrBytes();
+    SubNetTrie::Key key{};
+    std::copy(bytes.begin(), bytes.begin() + std::min(bytes.size(), key.size()), key.begin());
+    return key;
+}
+
+void SubNetTrie::Insert(const CSubNet& sub_net, int64_t ban_until)
+{
+    if (!sub_net.IsValid()) return;
+    const int length = sub_net.GetPrefixLength();
+    if (length < 0) {
+        m_other[sub_net] = ban_until;
+        return;
+    }
+    const Key key = ToKey(sub_net.GetNetworkAddress());
+
+    std::unique_ptr<Node>* slot = &m_root;
+    while (true) {
+        Node* node = slot->get();
+        if (!node) {
+            slot->reset(new Node());
+            (*slot)->key = key;
+            (*slot)->length = length;
+            (*slot)->has_value = true;
+            (*slot)->value = ban_until;
+            m_size++;
+            return;
+        }
+        const int common = CommonBits(node->key, key, std::min(node->length, length));
+        if (common == node->length) {
+            if (length == node->length) {
+                if (!node->has_value) m_size++;
+                node->has_value = true;
+                node->value = ban_until;
+                return;
+            }
+            slot = &node->child[Bit(key, node->length)];
+            continue;
+        }
+        // The subnet leaves the path of the node before its end: split it there
+        std::unique_ptr<Node> split(new Node());
+        split->key = Truncate(key, common);
+        split->length = common;
+        const int old_side = Bit(node->key, common);
+        split->child[old_side] = std::move(*slot);
+        if (common == length) {
+            split->has_value = true;
+            split->value = ban_until;
+        } else {
+            std::unique_ptr<Node> leaf(new Node());
+            leaf->key = key;
+            leaf->length = length;
+            leaf->has_value = true;
+            leaf->value = ban_until;
+            split->child[1 - old_side] = std::move(leaf);
+        }
+        *slot = std::move(split);
+        m_size++;
+        return;
+    }
+}
+
+bool SubNetTrie::Erase(std::unique_ptr<Node>& slot, const Key& key, int length)
+{
+    Node* node = slot.get();
+    if (!node || length < node->length || CommonBits(node->key, key, node->length) < node->length) return false;
+    if (length == node->length) {
+        if (!node->has_value) return false;
+        node->has_value = false;
+        node->value = 0;
+    } else if (!Erase(node->child[Bit(key, node->length)], key, length)) {
+        return false;
+    }
+    // Keep the trie compressed: a node without a value needs two children
+    if (!node->has_value) {
+        if (!node->child[0] && !node->child[1]) {
+            slot.reset();
+        } else if (!node->child[0] || !node->child[1]) {
+            std::unique_ptr<Node> child = std::move(node->child[node->child[0] ? 0 : 1]);
+            slot = std::move(child);
+        }
+    }
+    return true;
+}
+
+bool SubNetTrie::Erase(const CSubNet& sub_net)
+{
+    if (!sub_net.IsValid()) return false;
+    const int length = sub_net.GetPrefixLength();
+    if (length < 0) return m_other.erase(sub_net) > 0;
+    if (!Erase(m_root, ToKey(sub_net.GetNetworkAddress()), length)) return false;
+    m_size--;
+    return true;
+}
+
+void SubNetTrie::Clear()
+{
+    m_root.reset();
+    m_size = 0;
+    m_other.clear();
+}
+
+int64_t SubNetTrie::Match(const CNetAddr& addr) const
+{
+    if (!addr.IsValid()) return 0;
+    const Key key = ToKey(addr);
+    int64_t ban_until = 0;
+    const Node* node = m_root.get();
+    while (node && CommonBits(node->key, key, node->length) == node->length) {
+        if (node->has_value) ban_until = std::max(ban_until, node->value);
+        if (node->length == 128) break;
+        node = node->child[Bit(key, node->length)].get();
+    }
+    for (const auto& entry : m_other) {
+        if (entry.first.Match(addr)) ban_until = std::max(ban_until, entry.second);
+    }
+    return ban_until;
+}
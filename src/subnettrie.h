@@ -0,0 +1,60 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_SUBNETTRIE_H
+#define LITECOINZ_SUBNETTRIE_H
+
+#include <netaddress.h>
+
+#include <array>
+#include <map>
+#include <memory>
+#include <stdint.h>
+
+/**
+ * Ban times of subnets, indexed by their prefix in a path compressed binary
+ * trie over the 128 bits of the address, so that finding the subnets an
+ * address is in walks at most 128 bits however many subnets there are.
+ * IPv4 and Tor addresses are already mapped into these 128 bits. Subnets
+ * whose netmask is not a prefix cannot be found this way, and are checked
+ * one by one; setban only creates those when given an explicit netmask.
+ */
+class SubNetTrie
+{
+public:
+    typedef std::array<uint8_t, 16> Key;
+
+    /** Set the ban time of a subnet, replacing the one it had. Invalid subnets are ignored. */
+    void Insert(const CSubNet& sub_net, int64_t ban_until);
+
+    /** Remove a subnet. Returns false when it was not there. */
+    bool Erase(const CSubNet& sub_net);
+
+    void Clear();
+
+    /** The number of subnets */
+    size_t Size() const { return m_size + m_other.size(); }
+
+    /** The latest ban time of the subnets addr is in, or 0 when there is none. */
+    int64_t Match(const CNetAddr& addr) const;
+
+private:
+    struct Node {
+        //! The prefix of the node, with the bits past length cleared
+        Key key;
+        int length;
+        bool has_value{false};
+        int64_t value{0};
+        std::unique_ptr<Node> child[2];
+    };
+
+    std::unique_ptr<Node> m_root;
+    size_t m_size{0};
+    //! Subnets whose netmask is not a prefix
+    std::map<CSubNet, int64_t> m_other;
+
+    static bool Erase(std::unique_ptr<Node>& slot, const Key& key, int length);
+};
+
+#endif // LITECOINZ_SUBNETTRIE_H
@@ -0,0 +1,54 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_HUGEPAGE_H
+#define BITCOIN_SUPPORT_ALLOCATORS_HUGEPAGE_H
+
+#include <support/hugepages.h>
+
+#include <memory>
+#include <new>
+
+//
+// Allocator that puts large arrays in the HugePageArena once it is enabled,
+// and everything else where std::allocator would.
+//
+template <typename T>
+struct hugepage_allocator : public std::allocator<T> {
+    typedef std::allocator<T> base;
+    typedef typename base::size_type size_type;
+    typedef typename base::difference_type difference_type;
+    typedef typename base::pointer pointer;
+    typedef typename base::const_pointer const_pointer;
+    typedef typename base::reference reference;
+    typedef typename base::const_reference const_reference;
+    typedef typename base::value_type value_type;
+    hugepage_allocator() noexcept {}
+    hugepage_allocator(const hugepage_allocator& a) noexcept : base(a) {}
+    template <typename U>
+    hugepage_allocator(const hugepage_allocator<U>& a) noexcept : base(a)
+    {
+    }
+    ~hugepage_allocator() noexcept {}
+    template <typename _Other>
+    struct rebind {
+        typedef hugepage_allocator<_Other> other;
+    };
+
+    T* allocate(std::size_t n, const void* hint = 0)
+    {
+        void* allocation = HugePageArena::Instance().Allocate(sizeof(T) * n);
+        if (!allocation) return base::allocate(n, hint);
+        return static_cast<T*>(allocation);
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (!HugePageArena::Instance().Free(p, sizeof(T) * n)) {
+            base::deallocate(p, n);
+        }
+    }
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_HUGEPAGE_H
@@ -0,0 +1,128 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <support/hugepages.h>
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#ifndef WIN32
+#include <sys/mman.h> // for mmap
+#endif
+
+#include <assert.h>
+
+//! Allocations are rounded up to a multiple of this, which bounds the number of block sizes
+static const size_t BLOCK_ALIGN = 4096;
+
+HugePageArena& HugePageArena::Instance()
+{
+    // Leaked, as the coins cache may be freed after static destructors ran.
+    static HugePageArena* g_arena{new HugePageArena()};
+    return *g_arena;
+}
+
+bool HugePageArena::Enable()
+{
+#ifdef WIN32
+    return false;
+#else
+    m_enabled = true;
+    return true;
+#endif
+}
+
+void* HugePageArena::Map(size_t size)
+{
+#ifdef WIN32
+    (void)size;
+    return nullptr;
+#else
+#ifdef MAP_HUGETLB
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        m_mappings.emplace(uintptr_t(p), std::make_pair(size, true));
+        m_stats.hugetlb += size;
+        return p;
+    }
+#endif
+    // Transparent huge pages need the range to be aligned, so map a page
+    // more and cut off what is outside.
+    void* raw = mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return nullptr;
+    const uintptr_t begin = (uintptr_t(raw) + HUGE_PAGE_SIZE - 1) & ~(uintptr_t(HUGE_PAGE_SIZE) - 1);
+    if (begin > uintptr_t(raw)) munmap(raw, begin - uintptr_t(raw));
+    const uintptr_t end = uintptr_t(raw) + size + HUGE_PAGE_SIZE;
+    if (end > begin + size) munmap((void*)(begin + size), end - begin - size);
+#ifdef MADV_HUGEPAGE
+    madvise((void*)begin, size, MADV_HUGEPAGE);
+#endif
+    m_mappings.emplace(begin, std::make_pair(size, false));
+    m_stats.transparent += size;
+    return (void*)begin;
+#endif
+}
+
+std::map<uintptr_t, std::pair<size_t, bool>>::iterator HugePageArena::Find(void* p)
+{
+    auto it = m_mappings.upper_bound(uintptr_t(p));
+    if (it == m_mappings.begin()) return m_mappings.end();
+    --it;
+    if (uintptr_t(p) >= it->first + it->second.first) return m_mappings.end();
+    return it;
+}
+
+void* HugePageArena::Allocate(size_t size)
+{
+    if (!m_enabled || size < MIN_ALLOC) return nullptr;
+    size = (size + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (size >= HUGE_PAGE_SIZE / 2) {
+        void* p = Map((size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+        if (p != nullptr) m_stats.used += size;
+        return p;
+    }
+    std::vector<void*>& blocks = m_free_blocks[size];
+    if (blocks.empty()) {
+        unsigned char* page = static_cast<unsigned char*>(Map(HUGE_PAGE_SIZE));
+        if (page == nullptr) return nullptr;
+        // Hand out the first block first
+        for (size_t offset = (HUGE_PAGE_SIZE / size - 1) * size; ; offset -= size) {
+            blocks.push_back(page + offset);
+            if (offset == 0) break;
+        }
+    }
+    void* p = blocks.back();
+    blocks.pop_back();
+    m_stats.used += size;
+    return p;
+}
+
+bool HugePageArena::Free(void* p, size_t size)
+{
+    if (!m_enabled || p == nullptr || size < MIN_ALLOC) return false;
+    size = (size + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = Find(p);
+    if (it == m_mappings.end()) return false;
+    m_stats.used -= size;
+    if (size < HUGE_PAGE_SIZE / 2) {
+        m_free_blocks[size].push_back(p);
+        return true;
+    }
+    assert(it->first == uintptr_t(p));
+#ifndef WIN32
+    munmap(p, it->second.first);
+#endif
+    (it->second.second ? m_stats.hugetlb : m_stats.transparent) -= it->second.first;
+    m_mappings.erase(it);
+    return true;
+}
+
+HugePageArena::Stats HugePageArena::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_HUGEPAGES_H
+#define BITCOIN_SUPPORT_HUGEPAGES_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//! Default for -hugepages
+static const bool DEFAULT_HUGE_PAGES = false;
+
+/**
+ * Memory backed by huge pages, for the large arrays of the coins cache and
+ * the Equihash solver, whose random accesses miss the TLB a lot with 4 KiB
+ * pages.
+ *
+ * Pages of HUGE_PAGE_SIZE are mapped with MAP_HUGETLB when the system has
+ * huge pages reserved, and otherwise with madvise(MADV_HUGEPAGE) for the
+ * kernel to back them with transparent huge pages. Allocations below
+ * HUGE_PAGE_SIZE / 2 are carved out of such pages, and their blocks are kept
+ * for allocations of the same size rather than unmapped; larger allocations
+ * get mappings of their own.
+ *
+ * Allocations below MIN_ALLOC, and all of them until Enable is called, are
+ * refused, and callers fall back to the default allocator.
+ */
+class HugePageArena
+{
+public:
+    static const size_t HUGE_PAGE_SIZE = size_t{2} << 20;
+    static const size_t MIN_ALLOC = size_t{64} << 10;
+
+    struct Stats {
+        //! Bytes handed out
+        size_t used;
+        //! Bytes mapped from the reserved huge pages
+        size_t hugetlb;
+        //! Bytes mapped and advised to be backed by transparent huge pages
+        size_t transparent;
+    };
+
+    static HugePageArena& Instance();
+
+    /** Start serving allocations. Returns false if the platform can't map huge pages. */
+    bool Enable();
+    bool IsEnabled() const { return m_enabled; }
+
+    /** size bytes, page aligned, or nullptr if the default allocator is to be used. */
+    void* Allocate(size_t size);
+    /** Release what Allocate returned for size. Returns false if p is not from the arena. */
+    bool Free(void* p, size_t size);
+
+    Stats GetStats() const;
+
+private:
+    std::atomic<bool> m_enabled{false};
+
+    mutable std::mutex m_mutex;
+    //! The free blocks of each block size
+    std::map<size_t, std::vector<void*>> m_free_blocks;
+    //! The mappings by start address, with their size and whether they are from reserved huge pages
+    std::map<uintptr_t, std::pair<size_t, bool>> m_mappings;
+    Stats m_stats{0, 0, 0};
+
+    //! Map size bytes, a multiple of HUGE_PAGE_SIZE, with m_mutex held
+    void* Map(size_t size);
+    //! The mapping p is in, or m_mappings.end(), with m_mutex held
+    std::map<uintptr_t, std::pair<size_t, bool>>::iterator Find(void* p);
+};
+
+#endif // BITCOIN_SUPPORT_HUGEPAGES_H
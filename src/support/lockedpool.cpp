@@ -44,6 +44,7 @@ static inline size_t align_up(size_t x, size_t align)
 // Implementation: Arena
 
 Arena::Arena(void *base_in, size_t size_in, size_t alignment_in):
+    chunks_cached(MAX_CACHED_CHUNK_SIZE / alignment_in + 1),
     base(static_cast<char*>(base_in)), end(static_cast<char*>(base_in) + size_in), alignment(alignment_in)
 {
     // Start with one free chunk that covers the entire arena
@@ -65,13 +66,29 @@ void* Arena::alloc(size_t size)
     if (size == 0)
         return nullptr;
 
+    // Reuse a cached chunk of exactly this size if there is one
+    if (size <= MAX_CACHED_CHUNK_SIZE) {
+        std::vector<char*>& cached = chunks_cached[size / alignment];
+        if (!cached.empty()) {
+            char* chunk = cached.back();
+            cached.pop_back();
+            chunks_used.emplace(chunk, size);
+            return reinterpret_cast<void*>(chunk);
+        }
+    }
+
     // Pick a large enough free-chunk. Returns an iterator pointing to the first element that is not less than key.
     // This allocation strategy is best-fit. According to "Dynamic Storage Allocation: A Survey and Critical Review",
     // Wilson et. al. 1995, http://www.scs.stanford.edu/14wi-cs140/sched/readings/wilson.pdf, best-fit and first-fit
     // policies seem to work well in practice.
     auto size_ptr_it = size_to_free_chunk.lower_bound(size);
-    if (size_ptr_it == size_to_free_chunk.end())
-        return nullptr;
+    if (size_ptr_it == size_to_free_chunk.end()) {
+        // Merged back, the cached chunks may make room
+        release_cached();
+        size_ptr_it = size_to_free_chunk.lower_bound(size);
+        if (size_ptr_it == size_to_free_chunk.end())
+            return nullptr;
+    }
 
     // Create the used-chunk, taking its space from the end of the free-chunk
     const size_t size_remaining = size_ptr_it->first - size;
@@ -106,6 +123,22 @@ void Arena::free(void *ptr)
     std::pair<char*, size_t> freed = *i;
     chunks_used.erase(i);
 
+    // Keep small chunks for the next allocation of their size
+    if (freed.second <= MAX_CACHED_CHUNK_SIZE) {
+        std::vector<char*>& cached = chunks_cached[freed.second / alignment];
+        if (cached.size() < MAX_CACHED_CHUNKS) {
+            cached.push_back(freed.first);
+            return;
+        }
+    }
+
+    release(freed.first, freed.second);
+}
+
+void Arena::release(char* chunk, size_t size)
+{
+    std::pair<char*, size_t> freed(chunk, size);
+
     // coalesce freed with previous chunk
     auto prev = chunks_free_end.find(freed.first);
     if (prev != chunks_free_end.end()) {
@@ -129,13 +162,32 @@ void Arena::free(void *ptr)
     chunks_free_end[freed.first + freed.second] = it;
 }
 
+void Arena::release_cached()
+{
+    for (size_t i = 0; i < chunks_cached.size(); ++i) {
+        for (char* chunk : chunks_cached[i]) {
+            release(chunk, i * alignment);
+        }
+        chunks_cached[i].clear();
+    }
+}
+
 Arena::Stats Arena::stats() const
 {
-    Arena::Stats r{ 0, 0, 0, chunks_used.size(), chunks_free.size() };
+    Arena::Stats r{ 0, 0, 0, chunks_used.size(), chunks_free.size(), 0, 0 };
     for (const auto& chunk: chunks_used)
         r.used += chunk.second;
     for (const auto& chunk: chunks_free)
         r.free += chunk.second->first;
+    if (!size_to_free_chunk.empty())
+        r.largest_free = size_to_free_chunk.rbegin()->first;
+    for (size_t i = 0; i < chunks_cached.size(); ++i) {
+        if (chunks_cached[i].empty()) continue;
+        r.chunks_cached += chunks_cached[i].size();
+        r.free += chunks_cached[i].size() * i * alignment;
+        r.largest_free = std::max(r.largest_free, i * alignment);
+    }
+    r.chunks_free += r.chunks_cached;
     r.total = r.used + r.free;
     return r;
 }
@@ -155,6 +207,10 @@ void Arena::walk() const
     for (const auto& chunk: chunks_free)
         printchunk(chunk.first, chunk.second->first, false);
     std::cout << std::endl;
+    for (size_t i = 0; i < chunks_cached.size(); ++i)
+        for (char* chunk: chunks_cached[i])
+            printchunk(chunk, i * alignment, false);
+    std::cout << std::endl;
 }
 #endif
 
@@ -330,7 +386,7 @@ void LockedPool::free(void *ptr)
 LockedPool::Stats LockedPool::stats() const
 {
     std::lock_guard<std::mutex> lock(mutex);
-    LockedPool::Stats r{0, 0, 0, cumulative_bytes_locked, 0, 0};
+    LockedPool::Stats r{0, 0, 0, cumulative_bytes_locked, 0, 0, 0, 0};
     for (const auto &arena: arenas) {
         Arena::Stats i = arena.stats();
         r.used += i.used;
@@ -338,6 +394,8 @@ LockedPool::Stats LockedPool::stats() const
         r.total += i.total;
         r.chunks_used += i.chunks_used;
         r.chunks_free += i.chunks_free;
+        r.chunks_cached += i.chunks_cached;
+        r.largest_free = std::max(r.largest_free, i.largest_free);
     }
     return r;
 }
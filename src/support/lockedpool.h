@@ -11,6 +11,7 @@
 #include <mutex>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 /**
  * OS-dependent allocation and deallocation of locked/pinned memory pages.
@@ -62,8 +63,17 @@ public:
         size_t total;
         size_t chunks_used;
         size_t chunks_free;
+        size_t chunks_cached; //!< free chunks held for reuse, part of chunks_free
+        size_t largest_free;  //!< largest free chunk, an allocation beyond it needs a new arena
     };
 
+    /** Free chunks up to this size are kept on a free list per size for
+     * reuse, rather than merged back, as keys come in a few small sizes.
+     */
+    static const size_t MAX_CACHED_CHUNK_SIZE = 96;
+    /** Bounds the chunks each free list holds on to */
+    static const size_t MAX_CACHED_CHUNKS = 256;
+
     /** Allocate size bytes from this arena.
      * Returns pointer on success, or 0 if memory is full or
      * the application tried to allocate 0 bytes.
@@ -102,6 +112,15 @@ private:
     /** Map from begin of used chunk to its size */
     std::unordered_map<char*, size_t> chunks_used;
 
+    /** Free chunks of each multiple of alignment up to MAX_CACHED_CHUNK_SIZE,
+     * not in the maps of free chunks above */
+    std::vector<std::vector<char*>> chunks_cached;
+
+    /** Return a free chunk to the maps of free chunks, merging it with its neighbours */
+    void release(char* chunk, size_t size);
+    /** Release all cached chunks */
+    void release_cached();
+
     /** Base address of arena */
     char* base;
     /** End address of arena */
@@ -150,6 +169,8 @@ public:
         size_t locked;
         size_t chunks_used;
         size_t chunks_free;
+        size_t chunks_cached;
+        size_t largest_free;
     };
 
     /** Create a new LockedPool. This takes ownership of the MemoryPageLocker,
@@ -28,6 +28,45 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+std::atomic<bool> g_lock_hold_times{false};
+
+namespace {
+struct LockSiteRegistry {
+    std::mutex mutex;
+    std::vector<const LockSite*> sites;
+};
+
+LockSiteRegistry& GetLockSiteRegistry()
+{
+    // Never destroyed, as lock sites may still be used during shutdown
+    static LockSiteRegistry* registry = new LockSiteRegistry();
+    return *registry;
+}
+} // namespace
+
+LockSite::LockSite(const char* nameIn, const char* fileIn, int lineIn) : name(nameIn), file(fileIn), line(lineIn)
+{
+    LockSiteRegistry& registry = GetLockSiteRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.sites.push_back(this);
+}
+
+std::vector<LockSiteStats> GetLockStats()
+{
+    LockSiteRegistry& registry = GetLockSiteRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<LockSiteStats> stats;
+    stats.reserve(registry.sites.size());
+    for (const LockSite* site : registry.sites) {
+        stats.push_back({site->name, site->file, site->line,
+            site->acquisitions.load(std::memory_order_relaxed),
+            site->contentions.load(std::memory_order_relaxed),
+            site->wait_ns.load(std::memory_order_relaxed),
+            site->hold_ns.load(std::memory_order_relaxed)});
+    }
+    return stats;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -9,10 +9,13 @@
 #include <threadsafety.h>
 #include <util/macros.h>
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 ////////////////////////////////////////////////
 //                                            //
@@ -116,22 +119,76 @@ typedef AnnotatedMixin<std::mutex> Mutex;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Counters for the locks taken at one LOCK, LOCK2, TRY_LOCK or WAIT_LOCK site.
+ * Each site has one, registered on its first use, and updates it with relaxed
+ * atomics. Waiting is only timed when the lock was contended, holding only
+ * while g_lock_hold_times is set, as it takes the time at every acquisition.
+ */
+struct LockSite {
+    const char* const name;
+    const char* const file;
+    const int line;
+
+    std::atomic<uint64_t> acquisitions{0};
+    std::atomic<uint64_t> contentions{0};
+    std::atomic<uint64_t> wait_ns{0};
+    std::atomic<uint64_t> hold_ns{0};
+
+    LockSite(const char* nameIn, const char* fileIn, int lineIn);
+};
+
+/** Whether to measure how long locks are held, set by -lockholdtimes. */
+extern std::atomic<bool> g_lock_hold_times;
+
+struct LockSiteStats {
+    std::string name;
+    std::string file;
+    int line;
+    uint64_t acquisitions;
+    uint64_t contentions;
+    uint64_t wait_ns;
+    uint64_t hold_ns;
+};
+
+/** Get the counters of all lock sites used so far. */
+std::vector<LockSiteStats> GetLockStats();
+
 /** Wrapper around std::unique_lock style lock for Mutex. */
 template <typename Mutex, typename Base = typename Mutex::UniqueLock>
 class SCOPED_LOCKABLE UniqueLock : public Base
 {
 private:
+    LockSite* m_site = nullptr;
+    std::chrono::steady_clock::time_point m_locked_at;
+
+    static uint64_t ElapsedNanos(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    void Locked()
+    {
+        if (!m_site) return;
+        m_site->acquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (g_lock_hold_times.load(std::memory_order_relaxed)) m_locked_at = std::chrono::steady_clock::now();
+    }
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()));
-#ifdef DEBUG_LOCKCONTENTION
         if (!Base::try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
+            const auto wait_start = std::chrono::steady_clock::now();
             Base::lock();
-#ifdef DEBUG_LOCKCONTENTION
+            if (m_site) {
+                m_site->contentions.fetch_add(1, std::memory_order_relaxed);
+                m_site->wait_ns.fetch_add(ElapsedNanos(wait_start), std::memory_order_relaxed);
+            }
         }
-#endif
+        Locked();
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -140,11 +197,13 @@ private:
         Base::try_lock();
         if (!Base::owns_lock())
             LeaveCritical();
+        else
+            Locked();
         return Base::owns_lock();
     }
 
 public:
-    UniqueLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : Base(mutexIn, std::defer_lock)
+    UniqueLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false, LockSite* site = nullptr) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : Base(mutexIn, std::defer_lock), m_site(site)
     {
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
@@ -152,7 +211,7 @@ public:
             Enter(pszName, pszFile, nLine);
     }
 
-    UniqueLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn)
+    UniqueLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false, LockSite* site = nullptr) EXCLUSIVE_LOCK_FUNCTION(pmutexIn) : m_site(site)
     {
         if (!pmutexIn) return;
 
@@ -165,8 +224,14 @@ public:
 
     ~UniqueLock() UNLOCK_FUNCTION()
     {
-        if (Base::owns_lock())
+        if (Base::owns_lock()) {
+            // The hold time runs to the end of the scope, including any time
+            // spent waiting on a condition variable with the lock given up
+            if (m_site && m_locked_at != std::chrono::steady_clock::time_point()) {
+                m_site->hold_ns.fetch_add(ElapsedNanos(m_locked_at), std::memory_order_relaxed);
+            }
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -215,12 +280,23 @@ public:
 template<typename MutexArg>
 using DebugLock = UniqueLock<typename std::remove_reference<typename std::remove_pointer<MutexArg>::type>::type>;
 
-#define LOCK(cs) DebugLock<decltype(cs)> PASTE2(criticalblock, __COUNTER__)(cs, #cs, __FILE__, __LINE__)
-#define LOCK2(cs1, cs2)                                               \
-    DebugLock<decltype(cs1)> criticalblock1(cs1, #cs1, __FILE__, __LINE__); \
-    DebugLock<decltype(cs2)> criticalblock2(cs2, #cs2, __FILE__, __LINE__);
-#define TRY_LOCK(cs, name) DebugLock<decltype(cs)> name(cs, #cs, __FILE__, __LINE__, true)
-#define WAIT_LOCK(cs, name) DebugLock<decltype(cs)> name(cs, #cs, __FILE__, __LINE__)
+#define LOCK_SITE(cs, site) static LockSite site(#cs, __FILE__, __LINE__)
+#define LOCK_AT(cs, n)                    \
+    LOCK_SITE(cs, PASTE2(lock_site, n)); \
+    DebugLock<decltype(cs)> PASTE2(criticalblock, n)(cs, #cs, __FILE__, __LINE__, false, &PASTE2(lock_site, n))
+
+#define LOCK(cs) LOCK_AT(cs, __COUNTER__)
+#define LOCK2(cs1, cs2)                                                                                        \
+    LOCK_SITE(cs1, lock_site_criticalblock1);                                                                  \
+    LOCK_SITE(cs2, lock_site_criticalblock2);                                                                  \
+    DebugLock<decltype(cs1)> criticalblock1(cs1, #cs1, __FILE__, __LINE__, false, &lock_site_criticalblock1); \
+    DebugLock<decltype(cs2)> criticalblock2(cs2, #cs2, __FILE__, __LINE__, false, &lock_site_criticalblock2);
+#define TRY_LOCK(cs, name)                    \
+    LOCK_SITE(cs, PASTE2(lock_site_, name)); \
+    DebugLock<decltype(cs)> name(cs, #cs, __FILE__, __LINE__, true, &PASTE2(lock_site_, name))
+#define WAIT_LOCK(cs, name)                   \
+    LOCK_SITE(cs, PASTE2(lock_site_, name)); \
+    DebugLock<decltype(cs)> name(cs, #cs, __FILE__, __LINE__, false, &PASTE2(lock_site_, name))
 
 #define ENTER_CRITICAL_SECTION(cs)                            \
     {                                                         \
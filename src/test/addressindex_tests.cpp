@@ -0,0 +1,242 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/addressindex.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+/** Wait for the index to catch up with the active chain. */
+void WaitForSync(const AddressIndex& index)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+}
+
+/** Spend the output of a coinbase of the test chain to script. */
+CMutableTransaction SpendCoinbase(const TestChain100Setup& setup, const CTransactionRef& coinbase, const CScript& script)
+{
+    const CScript& p2pk_script = coinbase->vout[0].scriptPubKey;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbase->GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = script;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(p2pk_script, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(setup.coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    return spend;
+}
+
+/** Check that the spend of the first coinbase to script is not in the index. */
+void CheckSpendDisconnected(const AddressIndex& index, const TestChain100Setup& setup, const CScript& script)
+{
+    const CScript& p2pk_script = setup.m_coinbase_txns[0]->vout[0].scriptPubKey;
+    std::vector<AddressDelta> deltas;
+    BOOST_CHECK(index.FindDeltas(script, 0, std::numeric_limits<int>::max(), deltas));
+    BOOST_CHECK(deltas.empty());
+    std::vector<std::pair<COutPoint, Coin>> unspent;
+    BOOST_CHECK(index.FindUnspent(script, unspent));
+    BOOST_CHECK(unspent.empty());
+
+    BOOST_CHECK(index.FindDeltas(p2pk_script, 0, std::numeric_limits<int>::max(), deltas));
+    BOOST_CHECK_EQUAL(deltas.size(), setup.m_coinbase_txns.size());
+    for (const AddressDelta& delta : deltas) BOOST_CHECK(!delta.fSpending);
+    BOOST_CHECK(index.FindUnspent(p2pk_script, unspent));
+    BOOST_REQUIRE_EQUAL(unspent.size(), setup.m_coinbase_txns.size());
+    BOOST_CHECK(std::any_of(unspent.begin(), unspent.end(), [&](const std::pair<COutPoint, Coin>& coin) {
+        return coin.first == COutPoint(setup.m_coinbase_txns[0]->GetHash(), 0);
+    }));
+}
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(address_index_initial_sync, TestChain100Setup)
+{
+    AddressIndex index(1 << 20, true);
+
+    // BlockUntilSyncedToCurrentChain should return false before the index is started.
+    BOOST_CHECK(!index.BlockUntilSyncedToCurrentChain());
+
+    index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // Every coinbase of the test chain pays the same script.
+    const CScript& p2pk_script = m_coinbase_txns[0]->vout[0].scriptPubKey;
+    std::vector<AddressDelta> deltas;
+    BOOST_CHECK(index.FindDeltas(p2pk_script, 0, ::ChainActive().Height(), deltas));
+    BOOST_REQUIRE_EQUAL(deltas.size(), m_coinbase_txns.size());
+    for (size_t i = 0; i < deltas.size(); i++) {
+        BOOST_CHECK_EQUAL(deltas[i].nHeight, (int)i + 1);
+        BOOST_CHECK(deltas[i].txid == m_coinbase_txns[i]->GetHash());
+        BOOST_CHECK(!deltas[i].fSpending);
+        BOOST_CHECK_EQUAL(deltas[i].nAmount, m_coinbase_txns[i]->vout[0].nValue);
+    }
+    std::vector<std::pair<COutPoint, Coin>> unspent;
+    BOOST_CHECK(index.FindUnspent(p2pk_script, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), m_coinbase_txns.size());
+
+    // New blocks are indexed, and ranges select them by height.
+    CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    for (int i = 0; i < 10; i++) {
+        std::vector<CMutableTransaction> no_txns;
+        CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+        BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+    }
+    const int tip_height = ::ChainActive().Height();
+    deltas.clear();
+    BOOST_CHECK(index.FindDeltas(coinbase_script_pub_key, tip_height - 2, tip_height, deltas));
+    BOOST_REQUIRE_EQUAL(deltas.size(), 3U);
+    BOOST_CHECK_EQUAL(deltas[0].nHeight, tip_height - 2);
+    BOOST_CHECK_EQUAL(deltas[2].nHeight, tip_height);
+    unspent.clear();
+    BOOST_CHECK(index.FindUnspent(coinbase_script_pub_key, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 10U);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    index.Stop();
+
+    // index job may be scheduled, so stop scheduler before destructing
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_FIXTURE_TEST_CASE(address_index_lookup_and_reorg, TestChain100Setup)
+{
+    AddressIndex index(1 << 20, true);
+    index.Start();
+    WaitForSync(index);
+
+    // The outputs of the genesis block cannot be spent, so they are not indexed.
+    const CTransactionRef& genesis_coinbase = Params().GenesisBlock().vtx[0];
+    std::vector<AddressDelta> deltas;
+    BOOST_CHECK(index.FindDeltas(genesis_coinbase->vout[0].scriptPubKey, 0, 0, deltas));
+    BOOST_CHECK(deltas.empty());
+    std::vector<std::pair<COutPoint, Coin>> unspent;
+    BOOST_CHECK(index.FindUnspent(genesis_coinbase->vout[0].scriptPubKey, unspent));
+    BOOST_CHECK(unspent.empty());
+
+    // Spend the first coinbase to another script.
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript script = GetScriptForDestination(PKHash(key.GetPubKey()));
+    const CMutableTransaction spend = SpendCoinbase(*this, m_coinbase_txns[0], script);
+    const CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    const CBlock block = CreateAndProcessBlock({spend}, coinbase_script_pub_key);
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()) == block.GetHash());
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+
+    const CScript& p2pk_script = m_coinbase_txns[0]->vout[0].scriptPubKey;
+    deltas.clear();
+    BOOST_CHECK(index.FindDeltas(p2pk_script, 101, 101, deltas));
+    BOOST_REQUIRE_EQUAL(deltas.size(), 1U);
+    BOOST_CHECK(deltas[0].txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(deltas[0].nIndex, 0U);
+    BOOST_CHECK(deltas[0].fSpending);
+    BOOST_CHECK_EQUAL(deltas[0].nAmount, -m_coinbase_txns[0]->vout[0].nValue);
+    BOOST_CHECK(index.FindUnspent(p2pk_script, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), m_coinbase_txns.size() - 1);
+
+    deltas.clear();
+    unspent.clear();
+    BOOST_CHECK(index.FindDeltas(script, 0, std::numeric_limits<int>::max(), deltas));
+    BOOST_REQUIRE_EQUAL(deltas.size(), 1U);
+    BOOST_CHECK_EQUAL(deltas[0].nHeight, 101);
+    BOOST_CHECK(!deltas[0].fSpending);
+    BOOST_CHECK_EQUAL(deltas[0].nAmount, 11*CENT);
+    BOOST_CHECK(index.FindUnspent(script, unspent));
+    BOOST_REQUIRE_EQUAL(unspent.size(), 1U);
+    BOOST_CHECK(unspent[0].first == COutPoint(spend.GetHash(), 0));
+    BOOST_CHECK_EQUAL(unspent[0].second.nHeight, 101U);
+
+    // Reorganize the block out of the chain. The index rewinds to the fork
+    // point when it connects the first block of the new chain.
+    {
+        CBlockIndex* pindex = WITH_LOCK(cs_main, return LookupBlockIndex(block.GetHash()));
+        BlockValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), pindex));
+    }
+    for (int i = 0; i < 2; i++) {
+        CreateAndProcessBlock({}, coinbase_script_pub_key);
+    }
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+    CheckSpendDisconnected(index, *this, script);
+
+    index.Stop();
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_FIXTURE_TEST_CASE(address_index_reorg_while_stopped, TestChain100Setup)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript script = GetScriptForDestination(PKHash(key.GetPubKey()));
+    const CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    CBlock block;
+    {
+        AddressIndex index(1 << 20, false, true);
+        index.Start();
+        WaitForSync(index);
+        block = CreateAndProcessBlock({SpendCoinbase(*this, m_coinbase_txns[0], script)}, coinbase_script_pub_key);
+        BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+        std::vector<std::pair<COutPoint, Coin>> unspent;
+        BOOST_CHECK(index.FindUnspent(script, unspent));
+        BOOST_CHECK_EQUAL(unspent.size(), 1U);
+        index.Stop();
+    }
+
+    // The block of the spend is reorganized out while the index is stopped.
+    {
+        CBlockIndex* pindex = WITH_LOCK(cs_main, return LookupBlockIndex(block.GetHash()));
+        BlockValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), pindex));
+    }
+    for (int i = 0; i < 2; i++) {
+        CreateAndProcessBlock({}, coinbase_script_pub_key);
+    }
+
+    // The index disconnects the stale block before it syncs the new chain.
+    AddressIndex index(1 << 20, false, false);
+    index.Start();
+    WaitForSync(index);
+    CheckSpendDisconnected(index, *this, script);
+
+    index.Stop();
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -713,6 +713,45 @@ BOOST_AUTO_TEST_CASE(caddrinfo_get_new_bucket)
 
 }
 
+BOOST_AUTO_TEST_CASE(decoded_asmap)
+{
+    std::vector<bool> asmap = FromBytes(asmap_raw, sizeof(asmap_raw) * 8);
+    std::unique_ptr<const DecodedAsmap> decoded = DecodedAsmap::Decode(asmap);
+    BOOST_REQUIRE(decoded);
+    BOOST_CHECK(decoded->Size() > 1);
+
+    std::vector<CNetAddr> addrs;
+    for (int i = 0; i < 1000; i++) {
+        addrs.push_back(ResolveIP(strprintf("%d.%d.%d.%d", InsecureRandRange(256), InsecureRandRange(256), InsecureRandRange(256), InsecureRandRange(256))));
+    }
+    addrs.push_back(ResolveIP("2001:db8::1"));
+    std::vector<uint32_t> mapped;
+    for (const CNetAddr& addr : addrs) {
+        mapped.push_back(addr.GetMappedAS(asmap));
+    }
+
+    // Lookups in the decoded table give what the bytecode gives
+    BOOST_CHECK(UseDecodedAsmap(asmap));
+    for (size_t i = 0; i < addrs.size(); i++) {
+        BOOST_CHECK_EQUAL(addrs[i].GetMappedAS(asmap), mapped[i]);
+    }
+    ReleaseDecodedAsmap(asmap);
+
+    // A truncated asmap is still interpreted the same way
+    asmap.resize(asmap.size() / 2);
+    decoded = DecodedAsmap::Decode(asmap);
+    BOOST_REQUIRE(decoded);
+    mapped.clear();
+    for (const CNetAddr& addr : addrs) {
+        mapped.push_back(addr.GetMappedAS(asmap));
+    }
+    BOOST_CHECK(UseDecodedAsmap(asmap));
+    for (size_t i = 0; i < addrs.size(); i++) {
+        BOOST_CHECK_EQUAL(addrs[i].GetMappedAS(asmap), mapped[i]);
+    }
+    ReleaseDecodedAsmap(asmap);
+}
+
 BOOST_AUTO_TEST_CASE(addrman_serialization)
 {
     std::vector<bool> asmap1 = FromBytes(asmap_raw, sizeof(asmap_raw) * 8);
@@ -780,6 +819,44 @@ BOOST_AUTO_TEST_CASE(addrman_serialization)
 }
 
 
+BOOST_AUTO_TEST_CASE(addrman_performance)
+{
+    CAddrManTest addrman;
+    CNetAddr source = ResolveIP("252.2.2.2");
+    CService fast = ResolveService("250.1.1.1", 29333);
+    CService slow = ResolveService("250.2.2.2", 29333);
+    BOOST_CHECK(addrman.Add(CAddress(fast, NODE_NONE), source));
+    BOOST_CHECK(addrman.Add(CAddress(slow, NODE_NONE), source));
+    addrman.Good(CAddress(slow, NODE_NONE));
+
+    // Unmeasured addresses keep their chance
+    BOOST_CHECK_EQUAL(addrman.Find(fast)->GetPerformanceFactor(), 1.0);
+
+    addrman.SetPerformance(fast, ADDRMAN_REFERENCE_PING_USEC / 10, 0);
+    addrman.SetPerformance(fast, 0, ADDRMAN_REFERENCE_BLOCK_USEC / 10);
+    addrman.SetPerformance(slow, ADDRMAN_REFERENCE_PING_USEC * 10, ADDRMAN_REFERENCE_BLOCK_USEC);
+    // A measurement on another port is someone else's
+    addrman.SetPerformance(ResolveService("250.2.2.2", 9999), 1, 1);
+
+    // The factor is bounded for each measurement
+    BOOST_CHECK_EQUAL(addrman.Find(fast)->GetPerformanceFactor(), ADDRMAN_MAX_PERFORMANCE_FACTOR * ADDRMAN_MAX_PERFORMANCE_FACTOR);
+    BOOST_CHECK_EQUAL(addrman.Find(slow)->GetPerformanceFactor(), 1 / ADDRMAN_MAX_PERFORMANCE_FACTOR);
+    BOOST_CHECK_EQUAL(addrman.GetBlockDownloadTime(slow), ADDRMAN_REFERENCE_BLOCK_USEC);
+
+    // Later measurements move the average
+    addrman.SetPerformance(slow, 0, ADDRMAN_REFERENCE_BLOCK_USEC * 9);
+    BOOST_CHECK_EQUAL(addrman.GetBlockDownloadTime(slow), 2 * ADDRMAN_REFERENCE_BLOCK_USEC);
+
+    // The measurements of new and tried entries are kept in peers.dat
+    CAddrManTest addrman2;
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << addrman;
+    stream >> addrman2;
+    BOOST_CHECK_EQUAL(addrman2.GetBlockDownloadTime(fast), ADDRMAN_REFERENCE_BLOCK_USEC / 10);
+    BOOST_CHECK_EQUAL(addrman2.GetBlockDownloadTime(slow), 2 * ADDRMAN_REFERENCE_BLOCK_USEC);
+    BOOST_CHECK_EQUAL(addrman2.Find(fast)->GetPerformanceFactor(), ADDRMAN_MAX_PERFORMANCE_FACTOR * ADDRMAN_MAX_PERFORMANCE_FACTOR);
+}
+
 BOOST_AUTO_TEST_CASE(addrman_selecttriedcollision)
 {
     CAddrManTest addrman;
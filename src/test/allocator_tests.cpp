@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <support/hugepages.h>
 #include <util/memory.h>
 #include <util/system.h>
 
@@ -128,6 +129,39 @@ BOOST_AUTO_TEST_CASE(arena_tests)
     BOOST_CHECK(b.stats().free == synth_size);
 }
 
+BOOST_AUTO_TEST_CASE(arena_cached_chunks)
+{
+    void *synth_base = reinterpret_cast<void*>(0x08000000);
+    const size_t synth_size = 1024*1024;
+    Arena b(synth_base, synth_size, 16);
+
+    // Small chunks are kept for their size when freed
+    void *a0 = b.alloc(32);
+    void *a1 = b.alloc(64);
+    b.free(a0);
+    b.free(a1);
+    BOOST_CHECK_EQUAL(b.stats().used, 0U);
+    BOOST_CHECK_EQUAL(b.stats().free, synth_size);
+    BOOST_CHECK_EQUAL(b.stats().chunks_cached, 2U);
+    BOOST_CHECK_EQUAL(b.stats().chunks_free, 3U);
+    BOOST_CHECK_EQUAL(b.stats().largest_free, synth_size - 96);
+    BOOST_CHECK_THROW(b.free(a0), std::runtime_error);
+
+    BOOST_CHECK(b.alloc(64) == a1);
+    BOOST_CHECK(b.alloc(30) == a0);
+    BOOST_CHECK_EQUAL(b.stats().chunks_cached, 0U);
+    b.free(a0);
+    b.free(a1);
+
+    // They are merged back when nothing else is large enough
+    void *all = b.alloc(synth_size);
+    BOOST_CHECK(all == synth_base);
+    b.free(all);
+    BOOST_CHECK_EQUAL(b.stats().chunks_cached, 0U);
+    BOOST_CHECK_EQUAL(b.stats().chunks_free, 1U);
+    BOOST_CHECK_EQUAL(b.stats().largest_free, synth_size);
+}
+
 /** Mock LockedPageAllocator for testing */
 class TestLockedPageAllocator: public LockedPageAllocator
 {
@@ -233,4 +267,43 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(hugepage_arena_tests)
+{
+    HugePageArena arena;
+    // Nothing is served before it is enabled
+    BOOST_CHECK(arena.Allocate(HugePageArena::MIN_ALLOC) == nullptr);
+    if (!arena.Enable()) return;
+    BOOST_CHECK(arena.Allocate(HugePageArena::MIN_ALLOC - 1) == nullptr);
+
+    // Blocks of a size share a page, which is kept when they are freed
+    void* a = arena.Allocate(100000);
+    void* b = arena.Allocate(100000);
+    BOOST_REQUIRE(a != nullptr && b != nullptr);
+    BOOST_CHECK(a != b);
+    memset(a, 0xab, 100000);
+    memset(b, 0xcd, 100000);
+    BOOST_CHECK_EQUAL(static_cast<unsigned char*>(a)[99999], 0xab);
+    HugePageArena::Stats stats = arena.GetStats();
+    BOOST_CHECK_EQUAL(stats.used, 2 * 102400U);
+    BOOST_CHECK_EQUAL(stats.hugetlb + stats.transparent, HugePageArena::HUGE_PAGE_SIZE);
+    BOOST_CHECK(arena.Free(b, 100000));
+    BOOST_CHECK(arena.Allocate(100000) == b);
+
+    // Large allocations are mapped and unmapped on their own
+    void* c = arena.Allocate(3 * HugePageArena::HUGE_PAGE_SIZE / 2);
+    BOOST_REQUIRE(c != nullptr);
+    stats = arena.GetStats();
+    BOOST_CHECK_EQUAL(stats.hugetlb + stats.transparent, 3 * HugePageArena::HUGE_PAGE_SIZE);
+    BOOST_CHECK(arena.Free(c, 3 * HugePageArena::HUGE_PAGE_SIZE / 2));
+    stats = arena.GetStats();
+    BOOST_CHECK_EQUAL(stats.hugetlb + stats.transparent, HugePageArena::HUGE_PAGE_SIZE);
+
+    // Memory from elsewhere is not taken
+    std::vector<unsigned char> other(HugePageArena::MIN_ALLOC);
+    BOOST_CHECK(!arena.Free(other.data(), other.size()));
+    BOOST_CHECK(arena.Free(a, 100000));
+    BOOST_CHECK(arena.Free(b, 100000));
+    BOOST_CHECK_EQUAL(arena.GetStats().used, 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,69 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <test/util/setup_common.h>
+#include <util/asyncread.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(asyncread_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(read_files)
+{
+    const fs::path path = GetDataDir() / "asyncread";
+    std::vector<unsigned char> contents(1 << 20);
+    for (size_t i = 0; i < contents.size(); ++i) {
+        contents[i] = i * 7;
+    }
+    FILE* file = fsbridge::fopen(path, "w+b");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(contents.data(), 1, contents.size(), file), contents.size());
+    BOOST_REQUIRE_EQUAL(fflush(file), 0);
+
+    // More reads than the queue holds, at scattered offsets, come back whole.
+    const size_t n_reads = ASYNC_READ_QUEUE_DEPTH * 3;
+    std::vector<std::vector<unsigned char>> buffers(n_reads, std::vector<unsigned char>(3000));
+    std::vector<FileRead> reads;
+    for (size_t i = 0; i < n_reads; ++i) {
+        reads.emplace_back(file, (i * 3331) % (contents.size() - 3000), buffers[i].data(), buffers[i].size());
+    }
+    BOOST_CHECK(ReadFiles(reads));
+    for (size_t i = 0; i < n_reads; ++i) {
+        BOOST_CHECK(reads[i].ok);
+        BOOST_CHECK(std::equal(buffers[i].begin(), buffers[i].end(), contents.begin() + reads[i].offset));
+    }
+
+    // A read past the end of the file fails without failing the others.
+    std::vector<unsigned char> tail(5000);
+    reads.resize(2, FileRead(nullptr, 0, nullptr, 0));
+    reads[1] = FileRead(file, contents.size() - 1000, tail.data(), tail.size());
+    BOOST_CHECK(!ReadFiles(reads));
+    BOOST_CHECK(reads[0].ok);
+    BOOST_CHECK(!reads[1].ok);
+
+    fclose(file);
+}
+
+BOOST_FIXTURE_TEST_CASE(read_blocks_from_disk, TestChain100Setup)
+{
+    std::vector<const CBlockIndex*> pindexes;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex = ::ChainActive().Tip(); pindex; pindex = pindex->pprev) {
+            if (pindex->nHeight % 3 == 0) pindexes.push_back(pindex);
+        }
+    }
+
+    std::vector<std::shared_ptr<CBlock>> blocks;
+    BOOST_CHECK(ReadBlocksFromDisk(blocks, pindexes, Params().GetConsensus()));
+    BOOST_REQUIRE_EQUAL(blocks.size(), pindexes.size());
+    for (size_t i = 0; i < pindexes.size(); ++i) {
+        BOOST_REQUIRE(blocks[i]);
+        BOOST_CHECK(blocks[i]->GetHash() == pindexes[i]->GetBlockHash());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -95,4 +95,27 @@ BOOST_AUTO_TEST_CASE(base58_random_encode_decode)
     }
 }
 
+BOOST_AUTO_TEST_CASE(base58_batch)
+{
+    std::vector<std::vector<unsigned char>> inputs;
+    for (int n = 0; n < 100; ++n) {
+        inputs.push_back(g_insecure_rand_ctx.randbytes(InsecureRandRange(80)));
+    }
+    std::vector<std::string> encoded = EncodeBase58CheckBatch(inputs);
+    BOOST_REQUIRE_EQUAL(encoded.size(), inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        BOOST_CHECK_EQUAL(encoded[i], EncodeBase58Check(inputs[i]));
+    }
+
+    // Buffers are reused, and failures leave theirs empty.
+    std::vector<std::vector<unsigned char>> decoded(3, std::vector<unsigned char>(10, 0xff));
+    BOOST_CHECK(DecodeBase58CheckBatch(encoded, decoded, 80));
+    BOOST_CHECK(decoded == inputs);
+    encoded[1] += "z";
+    BOOST_CHECK(!DecodeBase58CheckBatch(encoded, decoded, 80));
+    BOOST_CHECK(decoded[0] == inputs[0]);
+    BOOST_CHECK(decoded[1].empty());
+    BOOST_CHECK(decoded[2] == inputs[2]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -51,6 +51,26 @@ BOOST_AUTO_TEST_CASE(bip173_testvectors_invalid)
     for (const std::string& str : CASES) {
         auto ret = bech32::Decode(str);
         BOOST_CHECK(ret.first.empty());
+        std::string hrp = "x";
+        std::vector<uint8_t> values(1);
+        BOOST_CHECK(!bech32::Decode(str, hrp, values));
+        BOOST_CHECK(hrp.empty() && values.empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(reuse_buffers)
+{
+    std::string out;
+    std::string hrp;
+    std::vector<uint8_t> values;
+    for (int n = 0; n < 100; ++n) {
+        std::vector<uint8_t> data(InsecureRandRange(60));
+        for (uint8_t& v : data) v = InsecureRandBits(5);
+        bech32::Encode("bc", MakeSpan(data), out);
+        BOOST_CHECK_EQUAL(out, bech32::Encode("bc", data));
+        BOOST_CHECK(bech32::Decode(out, hrp, values));
+        BOOST_CHECK_EQUAL(hrp, "bc");
+        BOOST_CHECK(values == data);
     }
 }
 
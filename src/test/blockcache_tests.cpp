@@ -0,0 +1,83 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <rpc/blockcache.h>
+#include <rpc/blockchain.h>
+#include <test/util/setup_common.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    const std::string data(1000, 'a');
+    BlockCache cache(3500);
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 4; ++i) {
+        hashes.push_back(InsecureRand256());
+    }
+
+    BOOST_CHECK(!cache.GetSerialized(hashes[0]));
+    cache.PutSerialized(hashes[0], std::make_shared<const std::string>(data));
+    cache.PutSerialized(hashes[1], std::make_shared<const std::string>(data));
+    cache.PutSerialized(hashes[2], std::make_shared<const std::string>(data));
+    BOOST_CHECK(cache.GetSerialized(hashes[0]));
+
+    // The entry of hashes[1] is the least recently used one now
+    cache.PutSerialized(hashes[3], std::make_shared<const std::string>(data));
+    BOOST_CHECK(!cache.GetSerialized(hashes[1]));
+    BOOST_CHECK(cache.GetSerialized(hashes[0]));
+    BOOST_CHECK(cache.GetSerialized(hashes[2]));
+    BOOST_CHECK(cache.GetSerialized(hashes[3]));
+
+    // Entries are kept per format
+    BOOST_CHECK(!cache.GetJSON(hashes[0], false));
+    cache.PutJSON(hashes[0], false, std::make_shared<const BlockJSON>());
+    BOOST_CHECK(cache.GetJSON(hashes[0], false));
+    BOOST_CHECK(!cache.GetJSON(hashes[0], true));
+
+    cache.Erase(hashes[0]);
+    BOOST_CHECK(!cache.GetSerialized(hashes[0]));
+    BOOST_CHECK(!cache.GetJSON(hashes[0], false));
+
+    // An entry larger than the cache is not kept
+    cache.PutSerialized(hashes[1], std::make_shared<const std::string>(std::string(4000, 'b')));
+    BOOST_CHECK(!cache.GetSerialized(hashes[1]));
+
+    const BlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.hits, 5U);
+    BOOST_CHECK_EQUAL(stats.misses, 7U);
+    BOOST_CHECK(stats.usage <= stats.max_usage);
+    BOOST_CHECK_EQUAL(stats.max_usage, 3500U);
+}
+
+BOOST_FIXTURE_TEST_CASE(blockcache_json_parts, TestChain100Setup)
+{
+    const CBlockIndex* tip;
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        tip = ::ChainActive().Tip();
+        pindex = ::ChainActive()[50];
+    }
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    const std::shared_ptr<const BlockJSON> parts = blockToJSONParts(block, pindex, true);
+
+    // The chain dependent fields are filled in for the tip they are served at
+    const UniValue json = blockPartsToJSON(*parts, tip, pindex);
+    BOOST_CHECK_EQUAL(json.write(), blockToJSON(block, tip, pindex, true).write());
+    BOOST_CHECK_EQUAL(find_value(json, "confirmations").get_int(), tip->nHeight - 50 + 1);
+    BOOST_CHECK_EQUAL(find_value(json, "nextblockhash").get_str(), tip->GetAncestor(51)->GetBlockHash().GetHex());
+
+    const UniValue at_tip = blockPartsToJSON(*parts, pindex, pindex);
+    BOOST_CHECK_EQUAL(find_value(at_tip, "confirmations").get_int(), 1);
+    BOOST_CHECK(!at_tip.exists("nextblockhash"));
+    BOOST_CHECK_EQUAL(at_tip.getKeys().back(), "previousblockhash");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -324,6 +324,46 @@ BOOST_AUTO_TEST_CASE(SufficientPreforwardRTTest)
     BOOST_CHECK_EQUAL(pool.mapTx.find(txhash)->GetSharedTx().use_count(), SHARED_TX_OFFSET - 1); // -1 because of block
 }
 
+BOOST_AUTO_TEST_CASE(ShieldedPrefillTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        CMutableTransaction tx(*block.vtx[i]);
+        tx.fOverwintered = true;
+        tx.nVersion = SAPLING_TX_VERSION;
+        tx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+        tx.vShieldedOutput.resize(1);
+        block.vtx[i] = MakeTransactionRef(tx);
+    }
+
+    LOCK2(cs_main, pool.cs);
+    pool.addUnchecked(entry.FromTx(block.vtx[2]));
+
+    // Without a mempool only the coinbase is prefilled
+    BOOST_CHECK_EQUAL(TestHeaderAndShortIDs(CBlockHeaderAndShortTxIDs(block, true)).prefilledtxn.size(), 1U);
+
+    // The shielded transaction that is not in the mempool is prefilled
+    CBlockHeaderAndShortTxIDs shortIDs(block, true, &pool);
+    TestHeaderAndShortIDs test(shortIDs);
+    BOOST_CHECK_EQUAL(test.prefilledtxn.size(), 2U);
+    BOOST_CHECK_EQUAL(test.prefilledtxn[1].index, 0U);
+    BOOST_CHECK_EQUAL(test.shorttxids.size(), 1U);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    stream >> shortIDs2;
+
+    CTxMemPool empty_pool;
+    PartiallyDownloadedBlock partialBlock(&empty_pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK( partialBlock.IsTxAvailable(0));
+    BOOST_CHECK( partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(2));
+}
+
 BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
 {
     CTxMemPool pool;
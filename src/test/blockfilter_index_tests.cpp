@@ -305,6 +305,72 @@ BOOST_FIXTURE_TEST_CASE(blockfilter_index_initial_sync, BuildChainTestingSetup)
     filter_index.Stop();
 }
 
+BOOST_FIXTURE_TEST_CASE(blockfilter_index_cache, BuildChainTestingSetup)
+{
+    BlockFilterIndex filter_index(BlockFilterType::BASIC, 1 << 20, true);
+    filter_index.Start();
+
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    LOCK(cs_main);
+    const CBlockIndex* tip = ::ChainActive().Tip();
+
+    std::vector<BlockFilter> expected_filters;
+    for (const CBlockIndex* block_index = ::ChainActive().Genesis();
+         block_index != nullptr;
+         block_index = ::ChainActive().Next(block_index)) {
+        BlockFilter expected_filter;
+        BOOST_REQUIRE(ComputeFilter(BlockFilterType::BASIC, block_index, expected_filter));
+        expected_filters.push_back(expected_filter);
+    }
+
+    // The filters written while syncing are cached, so the first pass is
+    // served from the cache as well as the second one.
+    for (int pass = 0; pass < 2; pass++) {
+        uint256 last_header;
+        for (const CBlockIndex* block_index = ::ChainActive().Genesis();
+             block_index != nullptr;
+             block_index = ::ChainActive().Next(block_index)) {
+            CheckFilterLookups(filter_index, block_index, last_header);
+        }
+
+        // A range read moves its filters to the front of the cache as it goes,
+        // which must not change their order.
+        std::vector<BlockFilter> filters;
+        BOOST_CHECK(filter_index.LookupFilterRange(0, tip, filters));
+        BOOST_REQUIRE_EQUAL(filters.size(), expected_filters.size());
+        for (size_t i = 0; i < filters.size(); i++) {
+            BOOST_CHECK_EQUAL(filters[i].GetBlockHash(), expected_filters[i].GetBlockHash());
+            BOOST_CHECK_EQUAL(filters[i].GetHash(), expected_filters[i].GetHash());
+        }
+
+        // Overlapping ranges are read partly from the cache.
+        const CBlockIndex* middle = tip->GetAncestor(tip->nHeight / 2);
+        BOOST_CHECK(filter_index.LookupFilterRange(middle->nHeight - 10, middle, filters));
+        BOOST_REQUIRE_EQUAL(filters.size(), 11U);
+        for (size_t i = 0; i < filters.size(); i++) {
+            BOOST_CHECK_EQUAL(filters[i].GetHash(), expected_filters[middle->nHeight - 10 + i].GetHash());
+        }
+    }
+
+    // The genesis block is the only checkpoint of this chain, and its header
+    // is kept once it has been looked up.
+    const uint256 genesis_header = expected_filters[0].ComputeHeader(uint256());
+    for (int pass = 0; pass < 2; pass++) {
+        uint256 filter_header;
+        BOOST_CHECK(filter_index.LookupFilterHeader(::ChainActive().Genesis(), filter_header));
+        BOOST_CHECK_EQUAL(filter_header, genesis_header);
+    }
+
+    filter_index.Interrupt();
+    filter_index.Stop();
+}
+
 BOOST_FIXTURE_TEST_CASE(blockfilter_index_init_destroy, BasicTestingSetup)
 {
     BlockFilterIndex* filter_index;
@@ -39,6 +39,65 @@ BOOST_AUTO_TEST_CASE(gcsfilter_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(gcsfilter_matchany_large_set)
+{
+    GCSFilter::ElementSet included_elements, queries;
+    for (int i = 0; i < 10; ++i) {
+        GCSFilter::Element element(32);
+        element[0] = i;
+        included_elements.insert(std::move(element));
+    }
+    // Far more queries than filter elements, with false positives at M = 16
+    for (int i = 0; i < 1000; ++i) {
+        GCSFilter::Element element(32);
+        element[1] = i & 0xff;
+        element[2] = i >> 8;
+        queries.insert(std::move(element));
+    }
+
+    GCSFilter filter({0, 0, 4, 16}, included_elements);
+    for (size_t size = 1; size <= queries.size(); size *= 2) {
+        GCSFilter::ElementSet subset(queries.begin(), std::next(queries.begin(), size));
+        bool any_match = false;
+        for (const auto& element : subset) {
+            any_match |= filter.Match(element);
+        }
+        BOOST_CHECK_EQUAL(filter.MatchAny(subset), any_match);
+    }
+    queries.insert(*included_elements.begin());
+    BOOST_CHECK(filter.MatchAny(queries));
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_cache_decoded)
+{
+    // Enough elements to be sorted with SortHashes
+    GCSFilter::ElementSet included_elements, queries;
+    for (int i = 0; i < 2000; ++i) {
+        GCSFilter::Element element(32);
+        element[0] = i & 0xff;
+        element[1] = i >> 8;
+        included_elements.insert(element);
+        element[2] = 1;
+        queries.insert(std::move(element));
+    }
+
+    GCSFilter filter({0, 0, 10, 1 << 10}, included_elements);
+    // Decoding checks the deltas were encoded in order.
+    GCSFilter decoded(filter.GetParams(), filter.GetEncoded());
+    decoded.CacheDecoded();
+    const GCSFilter copy(decoded);
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+        BOOST_CHECK(copy.Match(element));
+    }
+    for (size_t size = 1; size <= queries.size(); size *= 2) {
+        GCSFilter::ElementSet subset(queries.begin(), std::next(queries.begin(), size));
+        BOOST_CHECK_EQUAL(copy.MatchAny(subset), filter.MatchAny(subset));
+    }
+    queries.insert(*included_elements.begin());
+    BOOST_CHECK(copy.MatchAny(queries));
+}
+
 BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
 {
     GCSFilter filter;
@@ -179,14 +238,59 @@ BOOST_AUTO_TEST_CASE(blockfilters_json_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(shielded_blockfilter_test)
+{
+    const uint256 spent_nullifier = InsecureRand256();
+    const uint256 output_cm = InsecureRand256();
+    const uint256 sprout_nullifier = InsecureRand256();
+    const uint256 sprout_commitment = InsecureRand256();
+
+    CMutableTransaction tx;
+    tx.vShieldedSpend.emplace_back();
+    tx.vShieldedSpend.back().nullifier = spent_nullifier;
+    tx.vShieldedOutput.emplace_back();
+    tx.vShieldedOutput.back().cm = output_cm;
+    tx.vJoinSplit.emplace_back();
+    tx.vJoinSplit.back().nullifiers[0] = sprout_nullifier;
+    tx.vJoinSplit.back().commitments[0] = sprout_commitment;
+
+    CScript script = CScript() << OP_1;
+    tx.vout.emplace_back(100, script);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    CBlockUndo block_undo;
+
+    BlockFilter block_filter(BlockFilterType::SHIELDED, block, block_undo);
+    const GCSFilter& filter = block_filter.GetFilter();
+    for (const uint256& element : {spent_nullifier, output_cm, sprout_nullifier, sprout_commitment}) {
+        BOOST_CHECK(filter.Match(GCSFilter::Element(element.begin(), element.end())));
+    }
+    const uint256 other = InsecureRand256();
+    BOOST_CHECK(!filter.Match(GCSFilter::Element(other.begin(), other.end())));
+    // The transparent scripts are left to the basic filter.
+    BOOST_CHECK(!filter.Match(GCSFilter::Element(script.begin(), script.end())));
+
+    // The filter serializes with its type like any other.
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block_filter;
+    BlockFilter block_filter2;
+    stream >> block_filter2;
+    BOOST_CHECK_EQUAL(block_filter2.GetFilterType(), BlockFilterType::SHIELDED);
+    BOOST_CHECK(block_filter2.GetEncodedFilter() == block_filter.GetEncodedFilter());
+}
+
 BOOST_AUTO_TEST_CASE(blockfilter_type_names)
 {
     BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::BASIC), "basic");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::SHIELDED), "shielded");
     BOOST_CHECK_EQUAL(BlockFilterTypeName(static_cast<BlockFilterType>(255)), "");
 
     BlockFilterType filter_type;
     BOOST_CHECK(BlockFilterTypeByName("basic", filter_type));
     BOOST_CHECK_EQUAL(filter_type, BlockFilterType::BASIC);
+    BOOST_CHECK(BlockFilterTypeByName("shielded", filter_type));
+    BOOST_CHECK_EQUAL(filter_type, BlockFilterType::SHIELDED);
 
     BOOST_CHECK(!BlockFilterTypeByName("unknown", filter_type));
 }
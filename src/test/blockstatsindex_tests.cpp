@@ -0,0 +1,106 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/blockstatsindex.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <undo.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockstatsindex_tests)
+
+//! Check the index has the stats computed from the block and undo data of pindex
+static void CheckAgainstBlock(const BlockStatsIndex& index, const CBlockIndex* pindex)
+{
+    CBlock block;
+    CBlockUndo block_undo;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    BOOST_REQUIRE(UndoReadFromDisk(block_undo, pindex));
+    const CBlockStats computed = ComputeBlockStats(block, block_undo);
+
+    CBlockStats indexed;
+    BOOST_REQUIRE(index.LookUpStats(pindex, indexed));
+    BOOST_CHECK_EQUAL(indexed.txs, computed.txs);
+    BOOST_CHECK_EQUAL(indexed.ins, computed.ins);
+    BOOST_CHECK_EQUAL(indexed.outs, computed.outs);
+    BOOST_CHECK_EQUAL(indexed.total_fee, computed.total_fee);
+    BOOST_CHECK_EQUAL(indexed.median_fee, computed.median_fee);
+    BOOST_CHECK_EQUAL(indexed.total_size, computed.total_size);
+    BOOST_CHECK_EQUAL(indexed.utxo_size_inc, computed.utxo_size_inc);
+    BOOST_CHECK_EQUAL(indexed.feerate_percentiles[2], computed.feerate_percentiles[2]);
+    BOOST_CHECK_EQUAL(indexed.sapling_value_delta, computed.sapling_value_delta);
+}
+
+BOOST_FIXTURE_TEST_CASE(blockstatsindex_initial_sync, TestChain100Setup)
+{
+    BlockStatsIndex index(1 << 20, true);
+
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    CBlockStats stats;
+
+    // Nothing is indexed before the index is started.
+    BOOST_CHECK(!index.LookUpStats(tip, stats));
+    BOOST_CHECK(!index.BlockUntilSyncedToCurrentChain());
+
+    index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // The genesis block has only its coinbase.
+    const CBlockIndex* genesis = WITH_LOCK(cs_main, return ::ChainActive().Genesis());
+    BOOST_REQUIRE(index.LookUpStats(genesis, stats));
+    BOOST_CHECK_EQUAL(stats.txs, 1);
+    BOOST_CHECK_EQUAL(stats.ins, 0);
+    BOOST_CHECK_EQUAL(stats.total_fee, 0);
+
+    CheckAgainstBlock(index, tip);
+
+    // A new block with a fee paying spend of a coinbase is indexed as it is connected.
+    CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    const CAmount fee = 10000;
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = m_coinbase_txns[0]->vout[0].nValue - fee;
+    spend.vout[0].scriptPubKey = coinbase_script_pub_key;
+    std::vector<unsigned char> sig;
+    const uint256 sighash = SignatureHash(m_coinbase_txns[0]->vout[0].scriptPubKey, spend, 0, SIGHASH_ALL, m_coinbase_txns[0]->vout[0].nValue, SigVersion::BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(sighash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+    CreateAndProcessBlock({spend}, coinbase_script_pub_key);
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+
+    tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BOOST_REQUIRE(index.LookUpStats(tip, stats));
+    BOOST_CHECK_EQUAL(stats.txs, 2);
+    BOOST_CHECK_EQUAL(stats.ins, 1);
+    BOOST_CHECK_EQUAL(stats.total_fee, fee);
+    BOOST_CHECK_EQUAL(stats.min_fee, fee);
+    BOOST_CHECK_EQUAL(stats.max_fee, fee);
+    CheckAgainstBlock(index, tip);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    index.Stop();
+
+    // index job may be scheduled, so stop scheduler before destructing
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -444,6 +444,41 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_update_none)
     BOOST_CHECK(!filter.contains(COutPoint(uint256S("0x005d7aeb6e7a8705c970119187b22b9c03553b0b6ecddd48253b53f8c84feabe"), 0)));
 }
 
+BOOST_AUTO_TEST_CASE(merkle_block_filterable)
+{
+    // Building from the prepared block must match, and update the filter, the same
+    CBlock block = getBlock13b8a();
+    const CFilterableBlock filterable(block);
+    BOOST_CHECK(filterable.hash == block.GetHash());
+    BOOST_CHECK(filterable.vLevels.back().at(0) == block.hashMerkleRoot);
+
+    std::vector<std::vector<unsigned char>> vElements;
+    for (const CBloomTxElements& elements : filterable.vTxElements) {
+        vElements.push_back(elements.vHash);
+        for (const auto& data : elements.vOutputData) vElements.insert(vElements.end(), data.begin(), data.end());
+        for (const auto& data : elements.vInputData) vElements.insert(vElements.end(), data.begin(), data.end());
+        vElements.insert(vElements.end(), elements.vPrevouts.begin(), elements.vPrevouts.end());
+    }
+
+    for (unsigned char nFlags : {BLOOM_UPDATE_NONE, BLOOM_UPDATE_ALL, BLOOM_UPDATE_P2PUBKEY_ONLY}) {
+        for (int i = 0; i < 20; i++) {
+            CBloomFilter filter1(10, 0.000001, InsecureRand32(), nFlags);
+            for (int j = InsecureRandRange(3); j >= 0; j--) {
+                filter1.insert(vElements[InsecureRandRange(vElements.size())]);
+            }
+            CBloomFilter filter2 = filter1;
+            CMerkleBlock merkleBlock1(block, filter1);
+            CMerkleBlock merkleBlock2(filterable, filter2);
+
+            CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION), ss2(SER_NETWORK, PROTOCOL_VERSION);
+            ss1 << merkleBlock1 << filter1;
+            ss2 << merkleBlock2 << filter2;
+            BOOST_CHECK(ss1.str() == ss2.str());
+            BOOST_CHECK(merkleBlock1.vMatchedTxn == merkleBlock2.vMatchedTxn);
+        }
+    }
+}
+
 static std::vector<unsigned char> RandomData()
 {
     uint256 r = InsecureRand256();
@@ -522,4 +557,45 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(nullifier_filter)
+{
+    // An empty filter sends every lookup to the database.
+    CNullifierFilter empty;
+    BOOST_CHECK(empty.contains(InsecureRand256()));
+    BOOST_CHECK(!empty.IsFull());
+
+    CNullifierFilter filter(1000);
+    std::vector<uint256> nullifiers;
+    for (int i = 0; i < 1000; i++) {
+        nullifiers.push_back(InsecureRand256());
+        filter.insert(nullifiers.back());
+    }
+    BOOST_CHECK_EQUAL(filter.GetElements(), 1000U);
+    BOOST_CHECK(!filter.IsFull());
+    for (const uint256& nullifier : nullifiers) {
+        BOOST_CHECK(filter.contains(nullifier));
+    }
+
+    // Sized for 1%, so expect about 100 of 10000 unknown nullifiers to hit.
+    unsigned int nHits = 0;
+    for (int i = 0; i < 10000; i++) {
+        if (filter.contains(InsecureRand256())) ++nHits;
+    }
+    BOOST_CHECK(nHits < 200);
+    BOOST_CHECK(filter.GetFalsePositiveRate() < 0.02);
+
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << filter;
+    CNullifierFilter read;
+    stream >> read;
+    BOOST_CHECK_EQUAL(read.GetElements(), filter.GetElements());
+    BOOST_CHECK_EQUAL(read.GetSize(), filter.GetSize());
+    for (const uint256& nullifier : nullifiers) {
+        BOOST_CHECK(read.contains(nullifier));
+    }
+
+    filter.insert(InsecureRand256());
+    BOOST_CHECK(filter.IsFull());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,163 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainhistory.h>
+#include <test/util/setup_common.h>
+#include <uint256.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(chainhistory_tests, BasicTestingSetup)
+
+namespace {
+
+struct TestChain {
+    std::vector<uint256> hashes;
+    std::vector<CBlockIndex> blocks;
+
+    explicit TestChain(int count) : hashes(count), blocks(count)
+    {
+        for (int i = 0; i < count; ++i) {
+            hashes[i] = InsecureRand256();
+            blocks[i].phashBlock = &hashes[i];
+            blocks[i].nHeight = i + 1;
+            blocks[i].nTime = 1600000000 + i * 150;
+            blocks[i].nBits = 0x200f0f0f;
+            blocks[i].hashFinalSaplingRoot = InsecureRand256();
+        }
+    }
+
+    HistoryNode Leaf(int i) const { return NewHistoryLeaf(blocks[i], i % 3); }
+};
+
+//! Stands in for the block tree database
+struct TestStore {
+    HistoryState state;
+    std::map<HistoryIndex, HistoryNode> nodes;
+
+    void Write(ChainHistory& history)
+    {
+        HistoryChanges changes;
+        if (!history.GetChanges(changes)) return;
+        for (const auto& node : changes.nodes) nodes[node.first] = *node.second;
+        for (HistoryIndex index = changes.erase_begin; index < changes.erase_end; ++index) nodes.erase(index);
+        state = changes.state;
+        history.MarkWritten();
+    }
+
+    void Load(ChainHistory& history) const
+    {
+        BOOST_CHECK(history.Load(state, [this](HistoryIndex index, HistoryNode& node) {
+            auto it = nodes.find(index);
+            if (it == nodes.end()) return false;
+            node = it->second;
+            return true;
+        }, true));
+    }
+};
+
+size_t CountBits(uint64_t n)
+{
+    size_t bits = 0;
+    for (; n != 0; n &= n - 1) ++bits;
+    return bits;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(history_length)
+{
+    BOOST_CHECK_EQUAL(HistoryLength(0), 0U);
+    BOOST_CHECK_EQUAL(HistoryLength(1), 1U);
+    BOOST_CHECK_EQUAL(HistoryLength(2), 3U);
+    BOOST_CHECK_EQUAL(HistoryLength(3), 4U);
+    BOOST_CHECK_EQUAL(HistoryLength(4), 7U);
+    BOOST_CHECK_EQUAL(HistoryLength(5), 8U);
+    BOOST_CHECK_EQUAL(HistoryLength(8), 15U);
+}
+
+BOOST_AUTO_TEST_CASE(push_pop_truncate)
+{
+    const int count = 40;
+    const TestChain chain(count);
+    TestStore store;
+    ChainHistory history;
+    store.Load(history);
+
+    // The root after each leaf, and the peaks (one per set bit of the leaf count)
+    std::vector<uint256> roots;
+    for (int i = 0; i < count; ++i) {
+        BOOST_CHECK(history.Push(chain.Leaf(i)));
+        BOOST_CHECK_EQUAL(history.Leaves(), uint64_t(i + 1));
+        BOOST_CHECK(history.TipHash() == chain.hashes[i]);
+        BOOST_CHECK_EQUAL(history.Peaks().size(), CountBits(i + 1));
+        BOOST_CHECK(std::find(roots.begin(), roots.end(), history.Root()) == roots.end());
+        roots.push_back(history.Root());
+        // Write some of the way, so that later changes build on nodes read back.
+        if (i % 7 == 3) store.Write(history);
+    }
+
+    // Removing the leaves one by one goes back through the same roots.
+    for (int i = count - 1; i > 0; --i) {
+        BOOST_CHECK(history.Pop());
+        BOOST_CHECK(history.Root() == roots[i - 1]);
+        BOOST_CHECK(history.TipHash() == chain.hashes[i - 1]);
+    }
+    BOOST_CHECK(history.Pop());
+    BOOST_CHECK_EQUAL(history.Leaves(), 0U);
+    BOOST_CHECK(history.TipHash().IsNull());
+    BOOST_CHECK(!history.Pop());
+
+    // Appending again, after a write, then truncating a reloaded tree.
+    for (int i = 0; i < count; ++i) BOOST_CHECK(history.Push(chain.Leaf(i)));
+    BOOST_CHECK(history.Root() == roots.back());
+    store.Write(history);
+    BOOST_CHECK_EQUAL(store.nodes.size(), (size_t)HistoryLength(count));
+
+    ChainHistory reloaded;
+    store.Load(reloaded);
+    BOOST_CHECK(reloaded.Root() == roots.back());
+    BOOST_CHECK(reloaded.Truncate(21));
+    BOOST_CHECK(reloaded.Root() == roots[20]);
+    BOOST_CHECK(reloaded.Truncate(1));
+    BOOST_CHECK(reloaded.Root() == roots[0]);
+    store.Write(reloaded);
+    BOOST_CHECK_EQUAL(store.nodes.size(), 1U);
+    BOOST_CHECK_EQUAL(store.state.leaves, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(rewind)
+{
+    const TestChain chain(12);
+    TestStore store;
+    ChainHistory history;
+    store.Load(history);
+    for (int i = 0; i < 5; ++i) BOOST_CHECK(history.Push(chain.Leaf(i)));
+    store.Write(history);
+
+    const HistoryState checkpoint = history.Checkpoint();
+    for (int i = 5; i < 12; ++i) BOOST_CHECK(history.Push(chain.Leaf(i)));
+    history.Rewind(checkpoint);
+    BOOST_CHECK_EQUAL(history.Leaves(), 5U);
+    BOOST_CHECK(history.Root() == checkpoint.root);
+    BOOST_CHECK(history.TipHash() == chain.hashes[4]);
+
+    // Nothing is left to write after rewinding to what was written.
+    HistoryChanges changes;
+    BOOST_CHECK(!history.GetChanges(changes));
+
+    // A disabled tree ignores leaves.
+    ChainHistory disabled;
+    BOOST_CHECK(disabled.Load(HistoryState(), HistoryNodeReader(), false));
+    BOOST_CHECK(disabled.Push(chain.Leaf(0)));
+    BOOST_CHECK_EQUAL(disabled.Leaves(), 0U);
+    BOOST_CHECK(!disabled.GetChanges(changes));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -144,11 +144,11 @@ typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
 /** This test case checks that the CCheckQueue works properly
  * with each specified size_t Checks pushed.
  */
-static void Correct_Queue_range(std::vector<size_t> range)
+static void Correct_Queue_range(std::vector<size_t> range, int threads = SCRIPT_CHECK_THREADS)
 {
     auto small_queue = MakeUnique<Correct_Queue>(QUEUE_BATCH_SIZE);
     boost::thread_group tg;
-    for (auto x = 0; x < SCRIPT_CHECK_THREADS; ++x) {
+    for (auto x = 0; x < threads; ++x) {
        tg.create_thread([&]{small_queue->Thread();});
     }
     // Make vChecks here to save on malloc (this test can be slow...)
@@ -195,6 +195,13 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Max)
     range.push_back(100000);
     Correct_Queue_range(range);
 }
+/** Test that checks are correct with more threads than the queue has deques
+ */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_ManyThreads)
+{
+    std::vector<size_t> range{0, 1, 2, 31, 1000, 100000};
+    Correct_Queue_range(range, 2 * CHECKQUEUE_DEQUES);
+}
 /** Test that random numbers of checks are correct
  */
 BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Random)
@@ -378,6 +385,37 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_FrozenCleanup)
     BOOST_REQUIRE(!fails);
 }
 
+/** Test that the checks run are counted, and by the master when there are no workers */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Stats)
+{
+    auto queue = MakeUnique<Correct_Queue>(QUEUE_BATCH_SIZE);
+    std::vector<FakeCheckCheckCompletion> vChecks(1000);
+    {
+        CCheckQueueControl<FakeCheckCheckCompletion> control(queue.get());
+        control.Add(vChecks);
+        BOOST_REQUIRE(control.Wait());
+    }
+    CheckQueueStats stats = queue->GetStats();
+    BOOST_CHECK_EQUAL(stats.threads, 0);
+    BOOST_CHECK_EQUAL(stats.checks, 1000U);
+    BOOST_CHECK_EQUAL(stats.worker_busy_us, 0);
+
+    boost::thread_group tg;
+    for (auto x = 0; x < SCRIPT_CHECK_THREADS; ++x) {
+       tg.create_thread([&]{queue->Thread();});
+    }
+    vChecks.resize(5000);
+    {
+        CCheckQueueControl<FakeCheckCheckCompletion> control(queue.get());
+        control.Add(vChecks);
+        BOOST_REQUIRE(control.Wait());
+    }
+    stats = queue->GetStats();
+    BOOST_CHECK_EQUAL(stats.checks, 6000U);
+    BOOST_CHECK(stats.threads <= SCRIPT_CHECK_THREADS);
+    tg.interrupt_all();
+    tg.join_all();
+}
 
 /** Test that CCheckQueueControl is threadsafe */
 BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Locks)
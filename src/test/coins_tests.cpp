@@ -8,6 +8,7 @@
 #include <script/standard.h>
 #include <streams.h>
 #include <test/util/setup_common.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
@@ -34,7 +35,10 @@ bool operator==(const Coin &a, const Coin &b) {
 class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
+    uint256 hashBestSaplingAnchor_;
     std::map<COutPoint, Coin> map_;
+    std::map<uint256, SaplingMerkleTree> map_sapling_anchors_;
+    std::map<uint256, uint32_t> map_sapling_nullifiers_;
 
 public:
     NODISCARD bool GetCoin(const COutPoint& outpoint, Coin& coin) const override
@@ -51,9 +55,38 @@ public:
         return true;
     }
 
+    bool GetNullifier(const uint256& nullifier, uint32_t& nHeight) const override
+    {
+        std::map<uint256, uint32_t>::const_iterator it = map_sapling_nullifiers_.find(nullifier);
+        if (it == map_sapling_nullifiers_.end()) {
+            return false;
+        }
+        nHeight = it->second;
+        return true;
+    }
+
+    bool GetSaplingAnchorAt(const uint256& rt, SaplingMerkleTree& tree) const override
+    {
+        if (rt == SaplingMerkleTree::empty_root()) {
+            tree = SaplingMerkleTree();
+            return true;
+        }
+        std::map<uint256, SaplingMerkleTree>::const_iterator it = map_sapling_anchors_.find(rt);
+        if (it == map_sapling_anchors_.end()) {
+            return false;
+        }
+        tree = it->second;
+        return true;
+    }
+
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    uint256 GetBestAnchor() const override { return hashBestSaplingAnchor_; }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock,
+                    CNullifiersMap& mapSaplingNullifiers,
+                    CAnchorsSaplingMap& mapSaplingAnchors, const uint256& hashSaplingAnchor,
+                    bool erase) override
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -64,12 +97,40 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            if (erase) {
+                mapCoins.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+        for (const CNullifiersMap::value_type& entry : mapSaplingNullifiers) {
+            if (entry.second.flags & CNullifiersCacheEntry::DIRTY) {
+                if (entry.second.entered) {
+                    map_sapling_nullifiers_[entry.first] = entry.second.nHeight;
+                } else {
+                    map_sapling_nullifiers_.erase(entry.first);
+                }
+            }
+        }
+        if (erase) mapSaplingNullifiers.clear();
+        for (CAnchorsSaplingMap::iterator it = mapSaplingAnchors.begin(); it != mapSaplingAnchors.end(); it = erase ? mapSaplingAnchors.erase(it) : std::next(it)) {
+            if (it->second.flags & CAnchorsSaplingCacheEntry::DIRTY) {
+                if (it->second.entered) {
+                    map_sapling_anchors_[it->first] = it->second.tree;
+                } else {
+                    map_sapling_anchors_.erase(it->first);
+                }
+            }
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
+        if (!hashSaplingAnchor.IsNull())
+            hashBestSaplingAnchor_ = hashSaplingAnchor;
         return true;
     }
+
+    size_t SaplingAnchorCount() const { return map_sapling_anchors_.size(); }
+    size_t SaplingNullifierCount() const { return map_sapling_nullifiers_.size(); }
 };
 
 class CCoinsViewCacheTest : public CCoinsViewCache
@@ -87,6 +148,7 @@ public:
             ++count;
         }
         BOOST_CHECK_EQUAL(GetCacheSize(), count);
+        ret += cacheSaplingNullifiers.DynamicMemoryUsage() + memusage::DynamicUsage(cacheSaplingAnchors) + cachedSaplingAnchorsUsage;
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
 
@@ -593,8 +655,10 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
     CCoinsMap map;
+    CNullifiersMap nullifiers;
+    CAnchorsSaplingMap anchors;
     InsertCoinsMapEntry(map, value, flags);
-    BOOST_CHECK(view.BatchWrite(map, {}));
+    BOOST_CHECK(view.BatchWrite(map, {}, nullifiers, anchors, {}, true));
 }
 
 class SingleEntryCacheTest
@@ -624,6 +688,17 @@ static void CheckAccessCoin(CAmount base_value, CAmount cache_value, CAmount exp
     BOOST_CHECK_EQUAL(result_flags, expected_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_template_scripts)
+{
+    // Cached coins paying to the common templates need no memory beyond
+    // their cache entry.
+    const uint160 hash = uint160(std::vector<unsigned char>(20, 0x42));
+    for (const CTxDestination& dest : {CTxDestination(PKHash(hash)), CTxDestination(ScriptHash(hash)), CTxDestination(WitnessV0KeyHash(hash))}) {
+        Coin coin(CTxOut(1000, GetScriptForDestination(dest)), 1, false);
+        BOOST_CHECK_EQUAL(coin.DynamicMemoryUsage(), 0U);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(ccoins_access)
 {
     /* Check AccessCoin behavior, requesting a coin from a cache view layered on
@@ -861,4 +936,263 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_sapling_anchors)
+{
+    CCoinsViewTest base;
+    SaplingMerkleTree tree;
+    const uint256 empty_root = tree.root();
+    BOOST_CHECK(empty_root == SaplingMerkleTree::empty_root());
+
+    SaplingMerkleTree tree1 = tree;
+    tree1.append(uint256S("01"));
+    SaplingMerkleTree tree2 = tree1;
+    tree2.append(uint256S("02"));
+
+    // Anchors pushed and popped within one cache never reach the base.
+    {
+        CCoinsViewCacheTest cache(&base);
+        cache.PushSaplingAnchor(tree);
+        BOOST_CHECK(cache.GetBestAnchor() == empty_root);
+        cache.PushSaplingAnchor(tree1);
+        cache.PushSaplingAnchor(tree2);
+        BOOST_CHECK(cache.GetBestAnchor() == tree2.root());
+        cache.PopSaplingAnchor(tree1.root());
+        cache.PopSaplingAnchor(empty_root);
+        SaplingMerkleTree found;
+        BOOST_CHECK(!cache.GetSaplingAnchorAt(tree1.root(), found));
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(base.SaplingAnchorCount(), 0U);
+        BOOST_CHECK(base.GetBestAnchor() == empty_root);
+    }
+
+    // Flushed anchors stay reachable, and popping them erases them from the base.
+    {
+        CCoinsViewCacheTest cache(&base);
+        cache.PushSaplingAnchor(tree1);
+        cache.PushSaplingAnchor(tree1); // A block without Sapling outputs.
+        cache.PushSaplingAnchor(tree2);
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(base.SaplingAnchorCount(), 2U);
+        BOOST_CHECK(base.GetBestAnchor() == tree2.root());
+
+        CCoinsViewCacheTest child(&cache);
+        SaplingMerkleTree found;
+        BOOST_CHECK(child.GetSaplingAnchorAt(child.GetBestAnchor(), found));
+        BOOST_CHECK(found.root() == tree2.root());
+        child.PopSaplingAnchor(tree1.root());
+        BOOST_CHECK(!child.GetSaplingAnchorAt(tree2.root(), found));
+        BOOST_CHECK(child.Flush());
+        BOOST_CHECK(!cache.GetSaplingAnchorAt(tree2.root(), found));
+        BOOST_CHECK(cache.GetSaplingAnchorAt(tree1.root(), found));
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(base.SaplingAnchorCount(), 1U);
+        BOOST_CHECK(base.GetBestAnchor() == tree1.root());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_nullifiers_map)
+{
+    // Compare against std::map, with few enough keys that removals have to
+    // move entries back over the holes they leave.
+    std::vector<uint256> keys;
+    for (int i = 0; i < 100; i++) {
+        keys.push_back(InsecureRand256());
+    }
+    CNullifiersMap map;
+    std::map<uint256, uint32_t> expected;
+    for (int i = 0; i < 20000; i++) {
+        const uint256& key = keys[InsecureRandRange(keys.size())];
+        if (InsecureRandBool()) {
+            CNullifiersCacheEntry* entry = map.emplace(key).first;
+            entry->nHeight = i;
+            expected[key] = i;
+        } else {
+            map.erase(key);
+            expected.erase(key);
+        }
+        const uint256& probe = keys[InsecureRandRange(keys.size())];
+        const CNullifiersCacheEntry* found = map.find(probe);
+        BOOST_CHECK_EQUAL(found != nullptr, expected.count(probe) == 1);
+        if (found) {
+            BOOST_CHECK_EQUAL(found->nHeight, expected[probe]);
+        }
+    }
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    size_t count = 0;
+    for (const CNullifiersMap::value_type& entry : map) {
+        BOOST_CHECK_EQUAL(entry.second.nHeight, expected[entry.first]);
+        count++;
+    }
+    BOOST_CHECK_EQUAL(count, expected.size());
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(keys[0]) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sapling_nullifiers)
+{
+    CCoinsViewTest base;
+    const uint256 nf1 = InsecureRand256();
+    const uint256 nf2 = InsecureRand256();
+    uint32_t nHeight;
+
+    // Spending and unspending within one cache leaves nothing to flush.
+    {
+        CCoinsViewCacheTest cache(&base);
+        cache.AddNullifier(nf1, 10);
+        BOOST_CHECK(cache.GetNullifier(nf1, nHeight));
+        BOOST_CHECK_EQUAL(nHeight, 10U);
+        BOOST_CHECK(cache.RemoveNullifier(nf1));
+        BOOST_CHECK(!cache.HaveNullifier(nf1));
+        BOOST_CHECK(!cache.RemoveNullifier(nf2));
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(base.SaplingNullifierCount(), 0U);
+    }
+
+    // Flushed nullifiers reach the base, and unspending them erases them there.
+    {
+        CCoinsViewCacheTest cache(&base);
+        cache.AddNullifier(nf1, 10);
+        cache.AddNullifier(nf2, 11);
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(base.SaplingNullifierCount(), 2U);
+        BOOST_CHECK(base.GetNullifier(nf2, nHeight));
+        BOOST_CHECK_EQUAL(nHeight, 11U);
+
+        CCoinsViewCacheTest child(&cache);
+        BOOST_CHECK(child.HaveNullifier(nf1));
+        BOOST_CHECK(child.RemoveNullifier(nf1));
+        BOOST_CHECK(!child.HaveNullifier(nf1));
+        BOOST_CHECK(cache.HaveNullifier(nf1));
+        BOOST_CHECK(child.Flush());
+        BOOST_CHECK(!cache.HaveNullifier(nf1));
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK_EQUAL(base.SaplingNullifierCount(), 1U);
+        BOOST_CHECK(!base.HaveNullifier(nf1));
+        BOOST_CHECK(base.HaveNullifier(nf2));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_flush_and_evict)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    std::vector<COutPoint> outpoints;
+    for (uint32_t i = 0; i < 1000; i++) {
+        outpoints.emplace_back(InsecureRand256(), i);
+        cache.AddCoin(outpoints.back(), Coin(CTxOut(1000, CScript() << OP_TRUE), 1, false), false);
+    }
+    cache.SpendCoin(outpoints[0]);
+
+    // Blocks connected on top of the cache use the last 100 coins.
+    for (int block = 0; block < 5; block++) {
+        CCoinsViewCacheTest child(&cache);
+        for (size_t i = 900; i < outpoints.size(); i++) {
+            BOOST_CHECK(child.HaveCoin(outpoints[i]));
+        }
+        BOOST_CHECK(child.Flush());
+    }
+
+    const size_t target = cache.DynamicMemoryUsage() / 2;
+    BOOST_CHECK(cache.FlushAndEvict(target));
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= target);
+    cache.SelfTest();
+
+    // Everything reached the base, and what is still cached is clean.
+    BOOST_CHECK(!base.HaveCoin(outpoints[0]));
+    for (size_t i = 1; i < outpoints.size(); i++) {
+        BOOST_CHECK(base.HaveCoin(outpoints[i]));
+    }
+    BOOST_CHECK(cache.GetCacheSize() < outpoints.size() - 1);
+    for (const auto& entry : cache.map()) {
+        BOOST_CHECK_EQUAL(entry.second.flags, 0);
+        BOOST_CHECK(!entry.second.coin.IsSpent());
+    }
+    // The coins in use were kept, and evicted ones are read from the base.
+    for (size_t i = 900; i < outpoints.size(); i++) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+    }
+    BOOST_CHECK(cache.HaveCoin(outpoints[1]));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_add_fetched)
+{
+    CCoinsViewTest base;
+    const COutPoint outpoint(InsecureRand256(), 0);
+    const uint256 nf = InsecureRand256();
+    uint32_t nHeight;
+    {
+        CCoinsViewCacheTest cache(&base);
+        cache.AddCoin(outpoint, Coin(CTxOut(1000, CScript() << OP_TRUE), 5, false), false);
+        cache.AddNullifier(nf, 5);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // Fetched entries are served from the cache and are not written back.
+    CCoinsViewCacheTest cache(&base);
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(outpoint, coin));
+    cache.AddFetchedCoin(outpoint, std::move(coin));
+    cache.AddFetchedNullifier(nf, 5);
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK_EQUAL(cache.AccessCoin(outpoint).nHeight, 5U);
+    BOOST_CHECK(cache.GetNullifier(nf, nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 5U);
+    cache.SelfTest();
+
+    // An entry already in the cache is kept.
+    cache.SpendCoin(outpoint);
+    Coin stale;
+    BOOST_CHECK(base.GetCoin(outpoint, stale));
+    cache.AddFetchedCoin(outpoint, std::move(stale));
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK(cache.RemoveNullifier(nf));
+    cache.AddFetchedNullifier(nf, 5);
+    BOOST_CHECK(!cache.HaveNullifier(nf));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_background_write)
+{
+    CCoinsViewDB db(GetDataDir() / "background_write", 1 << 20, true, false);
+    db.SetBackgroundWrites(true);
+    const COutPoint outpoint(InsecureRand256(), 0);
+    const COutPoint spent(InsecureRand256(), 1);
+    const uint256 nf = InsecureRand256();
+    const uint256 block = InsecureRand256();
+    {
+        CCoinsViewCache cache(&db);
+        cache.AddCoin(spent, Coin(CTxOut(1000, CScript() << OP_TRUE), 1, false), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.SyncBackgroundWrite());
+    BOOST_CHECK_EQUAL(db.PendingWriteUsage(), 0U);
+
+    CCoinsViewCache cache(&db);
+    cache.AddCoin(outpoint, Coin(CTxOut(2000, CScript() << OP_TRUE), 7, false), false);
+    BOOST_CHECK(cache.SpendCoin(spent));
+    cache.AddNullifier(nf, 7);
+    cache.SetBestBlock(block);
+    BOOST_CHECK(cache.Flush());
+
+    // Reads see the changes both while they are written and after.
+    for (int round = 0; round < 2; round++) {
+        uint32_t nHeight = 0;
+        BOOST_CHECK(db.HaveCoin(outpoint));
+        BOOST_CHECK(!db.HaveCoin(spent));
+        BOOST_CHECK(db.GetNullifier(nf, nHeight));
+        BOOST_CHECK_EQUAL(nHeight, 7U);
+        BOOST_CHECK(db.GetBestBlock() == block);
+        BOOST_CHECK(db.SyncBackgroundWrite());
+    }
+    BOOST_CHECK_EQUAL(db.PendingWriteUsage(), 0U);
+
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    BOOST_CHECK(cursor->GetBestBlock() == block);
+    COutPoint key;
+    BOOST_CHECK(cursor->Valid() && cursor->GetKey(key) && key == outpoint);
+    cursor->Next();
+    BOOST_CHECK(!cursor->Valid());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
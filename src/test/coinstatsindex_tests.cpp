@@ -0,0 +1,96 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/coinstatsindex.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+//! Check the index has the stats of a scan of the coins database at its tip
+static void CheckAgainstScan(const CoinStatsIndex& index)
+{
+    ::ChainstateActive().ForceFlushStateToDisk();
+    CCoinsStats scanned;
+    BOOST_REQUIRE(GetUTXOStats(&::ChainstateActive().CoinsDB(), scanned, CoinStatsHashType::MUHASH));
+
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    CCoinsStats indexed;
+    BOOST_REQUIRE(index.LookUpStats(tip, indexed));
+    BOOST_CHECK(indexed.muhash == scanned.muhash);
+    BOOST_CHECK_EQUAL(indexed.nTransactionOutputs, scanned.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(indexed.nBogoSize, scanned.nBogoSize);
+    BOOST_CHECK_EQUAL(indexed.nTotalAmount, scanned.nTotalAmount);
+}
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
+{
+    CoinStatsIndex index(1 << 20, true);
+
+    const CBlockIndex* block_index = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    CCoinsStats coin_stats;
+
+    // Nothing is indexed before the index is started.
+    BOOST_CHECK(!index.LookUpStats(block_index, coin_stats));
+    BOOST_CHECK(!index.BlockUntilSyncedToCurrentChain());
+
+    index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // The genesis block adds nothing to the UTXO set.
+    const CBlockIndex* genesis = WITH_LOCK(cs_main, return ::ChainActive().Genesis());
+    BOOST_REQUIRE(index.LookUpStats(genesis, coin_stats));
+    uint256 empty;
+    MuHash3072().Finalize(empty);
+    BOOST_CHECK(coin_stats.muhash == empty);
+    BOOST_CHECK_EQUAL(coin_stats.nTransactionOutputs, 0U);
+
+    CheckAgainstScan(index);
+
+    // New blocks, one of which spends a coinbase, keep the index in sync.
+    CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    for (int i = 0; i < 10; i++) {
+        std::vector<CMutableTransaction> no_txns;
+        CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+        BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+    }
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = m_coinbase_txns[0]->vout[0].nValue - 10000;
+    spend.vout[0].scriptPubKey = coinbase_script_pub_key;
+    std::vector<unsigned char> sig;
+    const uint256 sighash = SignatureHash(m_coinbase_txns[0]->vout[0].scriptPubKey, spend, 0, SIGHASH_ALL, m_coinbase_txns[0]->vout[0].nValue, SigVersion::BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(sighash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+    CreateAndProcessBlock({spend}, coinbase_script_pub_key);
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+
+    CheckAgainstScan(index);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    index.Stop();
+
+    // index job may be scheduled, so stop scheduler before destructing
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,124 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/compactshieldedblockindex.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(compactshieldedblockindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(compact_block_contents, BasicTestingSetup)
+{
+    CMutableTransaction transparent;
+    transparent.vin.resize(1);
+    transparent.vout.resize(1);
+
+    CMutableTransaction shielded;
+    shielded.vin.resize(1);
+    SpendDescription spend;
+    spend.nullifier = InsecureRand256();
+    shielded.vShieldedSpend.push_back(spend);
+    for (int i = 0; i < 2; i++) {
+        OutputDescription output;
+        output.cm = InsecureRand256();
+        output.ephemeralKey = InsecureRand256();
+        for (unsigned char& c : output.encCiphertext) c = InsecureRandBits(8);
+        shielded.vShieldedOutput.push_back(output);
+    }
+
+    CBlock block;
+    block.hashPrevBlock = InsecureRand256();
+    block.nTime = 1234567;
+    block.vtx.push_back(MakeTransactionRef(transparent));
+    block.vtx.push_back(MakeTransactionRef(shielded));
+
+    CCompactShieldedBlock compact(block, 42);
+    BOOST_CHECK_EQUAL(compact.nHeight, 42);
+    BOOST_CHECK(compact.hash == block.GetHash());
+    BOOST_CHECK(compact.hashPrevBlock == block.hashPrevBlock);
+    BOOST_CHECK_EQUAL(compact.nTime, block.nTime);
+
+    // Only the shielded transaction is kept.
+    BOOST_REQUIRE_EQUAL(compact.vtx.size(), 1U);
+    const CCompactShieldedTx& ctx = compact.vtx[0];
+    BOOST_CHECK_EQUAL(ctx.index, 1U);
+    BOOST_CHECK(ctx.hash == block.vtx[1]->GetHash());
+    BOOST_REQUIRE_EQUAL(ctx.spends.size(), 1U);
+    BOOST_CHECK(ctx.spends[0].nullifier == spend.nullifier);
+    BOOST_REQUIRE_EQUAL(ctx.outputs.size(), 2U);
+    for (int i = 0; i < 2; i++) {
+        const OutputDescription& output = shielded.vShieldedOutput[i];
+        BOOST_CHECK(ctx.outputs[i].cmu == output.cm);
+        BOOST_CHECK(ctx.outputs[i].epk == output.ephemeralKey);
+        BOOST_CHECK(std::equal(ctx.outputs[i].ciphertext.begin(), ctx.outputs[i].ciphertext.end(), output.encCiphertext.begin()));
+    }
+
+    // Serialization roundtrip
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << compact;
+    CCompactShieldedBlock read;
+    ss >> read;
+    BOOST_CHECK(read.hash == compact.hash);
+    BOOST_REQUIRE_EQUAL(read.vtx.size(), 1U);
+    BOOST_CHECK(read.vtx[0].outputs[1].ciphertext == compact.vtx[0].outputs[1].ciphertext);
+}
+
+BOOST_FIXTURE_TEST_CASE(compact_block_index_initial_sync, TestChain100Setup)
+{
+    CompactShieldedBlockIndex index(1 << 20, true);
+
+    // BlockUntilSyncedToCurrentChain should return false before the index is started.
+    BOOST_CHECK(!index.BlockUntilSyncedToCurrentChain());
+
+    index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    std::vector<CCompactShieldedBlock> blocks;
+    BOOST_REQUIRE(index.LookupBlockRange(0, tip, blocks));
+    BOOST_REQUIRE_EQUAL(blocks.size(), (size_t)tip->nHeight + 1);
+    for (const CBlockIndex* pindex = tip; pindex; pindex = pindex->pprev) {
+        const CCompactShieldedBlock& block = blocks[pindex->nHeight];
+        BOOST_CHECK_EQUAL(block.nHeight, pindex->nHeight);
+        BOOST_CHECK(block.hash == pindex->GetBlockHash());
+        BOOST_CHECK(block.vtx.empty());
+    }
+
+    // New blocks make it into the index.
+    for (int i = 0; i < 10; i++) {
+        CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+        std::vector<CMutableTransaction> no_txns;
+        const CBlock& block = CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+
+        BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+        const CBlockIndex* block_index = WITH_LOCK(cs_main, return LookupBlockIndex(block.GetHash()));
+        CCompactShieldedBlock compact;
+        BOOST_REQUIRE(index.LookupBlock(block_index, compact));
+        BOOST_CHECK(compact.hash == block.GetHash());
+    }
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    index.Stop();
+
+    // index job may be scheduled, so stop scheduler before destructing
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
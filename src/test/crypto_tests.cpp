@@ -3,12 +3,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <crypto/aes.h>
+#include <crypto/blake2b.h>
 #include <crypto/chacha20.h>
 #include <crypto/chacha_poly_aead.h>
 #include <crypto/poly1305.h>
 #include <crypto/hkdf_sha256_32.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -57,6 +59,28 @@ static void TestSHA256(const std::string &in, const std::string &hexout) { TestV
 static void TestSHA512(const std::string &in, const std::string &hexout) { TestVector(CSHA512(), in, ParseHex(hexout));}
 static void TestRIPEMD160(const std::string &in, const std::string &hexout) { TestVector(CRIPEMD160(), in, ParseHex(hexout));}
 
+static void TestBLAKE2b(const std::string &in, size_t outlen, const std::string &personal, const std::string &hexout) {
+    BOOST_REQUIRE(personal.empty() || personal.size() == CBLAKE2b::PERSONAL_SIZE);
+    const CBLAKE2b h(outlen, personal.empty() ? nullptr : (const unsigned char*)personal.data());
+    const std::vector<unsigned char> out = ParseHex(hexout);
+    std::vector<unsigned char> hash(outlen);
+    BOOST_CHECK(out.size() == h.OutputSize());
+    CBLAKE2b(h).Write((const unsigned char*)in.data(), in.size()).Finalize(hash.data());
+    BOOST_CHECK(hash == out);
+    for (int i=0; i<32; i++) {
+        // Test that writing the string broken up in random pieces works.
+        CBLAKE2b hasher(h);
+        size_t pos = 0;
+        while (pos < in.size()) {
+            size_t len = InsecureRandRange((in.size() - pos + 1) / 2 + 1);
+            hasher.Write((const unsigned char*)&in[pos], len);
+            pos += len;
+        }
+        hasher.Finalize(hash.data());
+        BOOST_CHECK(hash == out);
+    }
+}
+
 static void TestHMACSHA256(const std::string &hexkey, const std::string &hexin, const std::string &hexout) {
     std::vector<unsigned char> key = ParseHex(hexkey);
     TestVector(CHMAC_SHA256(key.data(), key.size()), ParseHex(hexin), ParseHex(hexout));
@@ -750,4 +774,142 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blake2b_testvectors)
+{
+    TestBLAKE2b("", 64, "",
+                "786a02f742015903c6c6fd852552d272912f4740e15847618a86e217f71f5419d25e1031afee585313896444934eb04b903a685b1448b755d56f701afe9be2ce");
+    TestBLAKE2b("abc", 64, "",
+                "ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d17d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923");
+    std::string bytes;
+    for (int i = 0; i < 256; ++i) bytes += (char)i;
+    TestBLAKE2b(bytes, 32, "",
+                "39a7eb9fedc19aabc83425c6755dd90e6f9d0c804964a1f4aaeea3b9fb599835");
+    TestBLAKE2b("abc", 50, std::string("ZcashPoW\xc8\0\0\0\x09\0\0\0", 16),
+                "52e907446f88b0d5e63e3b2ed93b9cf178cff963d9b89e2a01fe2e42f247b0a58f8f40ccd4471fdadee85d6ab7e69be29285");
+}
+
+BOOST_AUTO_TEST_CASE(blake2b_multi)
+{
+    static const unsigned char personal[CBLAKE2b::PERSONAL_SIZE] = {'Z', 'c', 'a', 's', 'h', 'P', 'o', 'W', 200, 0, 0, 0, 9, 0, 0, 0};
+    for (int count = 0; count <= 40; count += 1 + count / 4) {
+        // Prefixes and inputs around the block boundaries, with and without a personalisation
+        const std::vector<unsigned char> prefix = g_insecure_rand_ctx.randbytes(InsecureRandRange(300));
+        const size_t len = InsecureRandBool() ? 4 : InsecureRandRange(200);
+        const size_t outlen = 1 + InsecureRandRange(CBLAKE2b::MAX_OUTPUT_SIZE);
+        CBLAKE2b base(outlen, InsecureRandBool() ? personal : nullptr);
+        base.Write(prefix.data(), prefix.size());
+        const std::vector<unsigned char> in = g_insecure_rand_ctx.randbytes(len * count);
+        std::vector<unsigned char> out1(outlen * count), out2(outlen * count);
+        for (int i = 0; i < count; ++i) {
+            CBLAKE2b(base).Write(in.data() + len * i, len).Finalize(out1.data() + outlen * i);
+        }
+        BLAKE2bMulti(base, in.data(), len, count, out2.data());
+        BOOST_CHECK(out1 == out2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256d_multi)
+{
+    for (int count = 0; count <= 40; count += 1 + count / 4) {
+        std::vector<std::vector<unsigned char>> in(count);
+        std::vector<const unsigned char*> inputs;
+        std::vector<size_t> lengths;
+        for (std::vector<unsigned char>& msg : in) {
+            // Lengths around the one and two block padding boundaries, and longer ones
+            msg = g_insecure_rand_ctx.randbytes(InsecureRandBool() ? 50 + InsecureRandRange(20) : InsecureRandRange(1000));
+            inputs.push_back(msg.data());
+            lengths.push_back(msg.size());
+        }
+        std::vector<unsigned char> out1(32 * count), out2(32 * count);
+        for (int i = 0; i < count; ++i) {
+            CHash256().Write(in[i].data(), in[i].size()).Finalize(out1.data() + 32 * i);
+        }
+        SHA256DMulti(out2.data(), inputs.data(), lengths.data(), count);
+        BOOST_CHECK(out1 == out2);
+    }
+}
+
+static MuHash3072 FromInt(unsigned char i) {
+    unsigned char tmp[32] = {i, 0};
+    return MuHash3072(MakeSpan(tmp));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    uint256 out;
+
+    // The empty set, and {0} * {1} / {2}
+    MuHash3072().Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("dd5ad2a105c2d29495f577245c357409002329b9f4d6182c0af3dc2f462555c8"));
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    acc.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    // The hash does not depend on the order elements are inserted and removed in.
+    for (int iter = 0; iter < 10; ++iter) {
+        uint256 res;
+        int table[4];
+        for (int i = 0; i < 4; ++i) {
+            table[i] = g_insecure_rand_ctx.randbits(3);
+        }
+        for (int order = 0; order < 4; ++order) {
+            MuHash3072 acc;
+            for (int i = 0; i < 4; ++i) {
+                int t = table[i ^ order];
+                if (t & 4) {
+                    acc /= FromInt(t & 3);
+                } else {
+                    acc *= FromInt(t & 3);
+                }
+            }
+            acc.Finalize(out);
+            if (order == 0) {
+                res = out;
+            } else {
+                BOOST_CHECK(res == out);
+            }
+        }
+
+        MuHash3072 x = FromInt(g_insecure_rand_ctx.randbits(4)); // x=X
+        MuHash3072 y = FromInt(g_insecure_rand_ctx.randbits(4)); // x=X, y=Y
+        MuHash3072 z;                                            // x=X, y=Y, z=1
+        z *= x;                                                  // x=X, y=Y, z=X
+        z *= y;                                                  // x=X, y=Y, z=X*Y
+        y *= x;                                                  // x=X, y=Y*X, z=X*Y
+        z /= y;                                                  // x=X, y=Y*X, z=1
+        z.Finalize(out);
+        MuHash3072().Finalize(res);
+        BOOST_CHECK(out == res);
+    }
+
+    // Insert and Remove are multiplication and division by singletons.
+    const unsigned char data[] = {1, 2, 3, 4};
+    MuHash3072 inserted;
+    inserted.Insert(MakeSpan(data));
+    MuHash3072 multiplied;
+    multiplied *= MuHash3072(MakeSpan(data));
+    uint256 out2;
+    inserted.Finalize(out);
+    multiplied.Finalize(out2);
+    BOOST_CHECK(out == out2);
+    inserted.Remove(MakeSpan(data));
+    inserted.Finalize(out);
+    MuHash3072().Finalize(out2);
+    BOOST_CHECK(out == out2);
+
+    // The state survives a round trip through serialization, before and after Finalize.
+    MuHash3072 serchk = FromInt(1);
+    serchk /= FromInt(2);
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << serchk;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 deserchk;
+    ss >> deserchk;
+    serchk.Finalize(out);
+    deserchk.Finalize(out2);
+    BOOST_CHECK(out == out2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
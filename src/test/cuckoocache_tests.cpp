@@ -8,6 +8,7 @@
 #include <random.h>
 #include <thread>
 #include <deque>
+#include <algorithm>
 
 /** Test Suite for CuckooCache
  *
@@ -42,6 +43,29 @@ BOOST_AUTO_TEST_CASE(test_cuckoocache_no_fakes)
     }
 };
 
+/* Test that collect returns the inserted elements, without the erased ones.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_collect)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes;
+    for (int x = 0; x < 1000; ++x) {
+        hashes.push_back(InsecureRand256());
+        cc.insert(hashes.back());
+    }
+    for (int x = 0; x < 500; ++x) {
+        BOOST_CHECK(cc.contains(hashes[x], true));
+    }
+    std::vector<uint256> collected;
+    cc.collect(collected);
+    std::sort(collected.begin(), collected.end());
+    std::vector<uint256> kept(hashes.begin() + 500, hashes.end());
+    std::sort(kept.begin(), kept.end());
+    BOOST_CHECK(collected == kept);
+}
+
 /** This helper returns the hit rate when megabytes*load worth of entries are
  * inserted into a megabytes sized cache
  */
@@ -112,6 +136,53 @@ BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate_ok)
     }
 }
 
+/** The segments of a sharded cache must hold as much as one table of their total size */
+BOOST_AUTO_TEST_CASE(cuckoocache_sharded_hit_rate_ok)
+{
+    double HitRateThresh = 0.98;
+    size_t megabytes = 4;
+    for (double load = 0.1; load < 2; load *= 2) {
+        double hits = test_cache<CuckooCache::sharded_cache<uint256, SignatureCacheHasher>>(megabytes, load);
+        BOOST_CHECK(normalize_hit_rate(hits, load) > HitRateThresh);
+    }
+}
+
+/* Test the counters of a sharded cache. */
+BOOST_AUTO_TEST_CASE(cuckoocache_sharded_stats)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::sharded_cache<uint256, SignatureCacheHasher> cc{};
+    const uint32_t max_elements = cc.setup_bytes(1 << 20);
+    BOOST_CHECK_EQUAL(max_elements, (1 << 20) / sizeof(uint256));
+    std::vector<uint256> hashes;
+    for (int x = 0; x < 1000; ++x) {
+        hashes.push_back(InsecureRand256());
+        cc.insert(hashes.back());
+    }
+    for (int x = 0; x < 1000; ++x) {
+        BOOST_CHECK(cc.contains(hashes[x], false));
+        BOOST_CHECK(!cc.contains(InsecureRand256(), false));
+    }
+    std::vector<uint256> collected;
+    cc.collect(collected);
+    BOOST_CHECK_EQUAL(collected.size(), 1000U);
+
+    CuckooCache::cache_stats stats = cc.stats();
+    BOOST_CHECK_EQUAL(stats.hits, 1000U);
+    BOOST_CHECK_EQUAL(stats.misses, 1000U);
+    BOOST_CHECK_EQUAL(stats.inserts, 1000U);
+    BOOST_CHECK_EQUAL(stats.evictions, 0U);
+    BOOST_CHECK_EQUAL(stats.max_elements, max_elements);
+
+    // Twice as many elements as fit have to push some out
+    for (uint32_t x = 0; x < 2 * max_elements; ++x) {
+        cc.insert(InsecureRand256());
+    }
+    stats = cc.stats();
+    BOOST_CHECK_EQUAL(stats.inserts, 1000U + 2 * max_elements);
+    BOOST_CHECK(stats.evictions > 0);
+}
+
 
 /** This helper checks that erased elements are preferentially inserted onto and
  * that the hit rate of "fresher" keys is reasonable*/
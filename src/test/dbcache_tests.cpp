@@ -0,0 +1,98 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/dbcache.h>
+#include <test/util/setup_common.h>
+#include <txdb.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(dbcache_tests, BasicTestingSetup)
+
+static void WriteFile(const fs::path& path, const std::string& contents)
+{
+    fsbridge::ofstream file(path);
+    file << contents;
+}
+
+BOOST_AUTO_TEST_CASE(parse_memory_files)
+{
+    double pressure;
+    BOOST_CHECK(ParseMemoryPressure("some avg10=12.50 avg60=3.00 avg300=1.00 total=1234\nfull avg10=2.00 avg60=0.00 avg300=0.00 total=12\n", pressure));
+    BOOST_CHECK_EQUAL(pressure, 12.5);
+    BOOST_CHECK(!ParseMemoryPressure("full avg10=2.00 avg60=0.00 avg300=0.00 total=12\n", pressure));
+    BOOST_CHECK(!ParseMemoryPressure("", pressure));
+
+    int64_t value;
+    BOOST_CHECK(ParseMemoryStat("active_file 10\ninactive_file 20\n", "inactive_file", value));
+    BOOST_CHECK_EQUAL(value, 20);
+    BOOST_CHECK(ParseMemoryStat("MemTotal:       16384 kB\nMemAvailable:    8192 kB\n", "MemAvailable:", value));
+    BOOST_CHECK_EQUAL(value, 8192);
+    // A key is a whole field, not the start of one.
+    BOOST_CHECK(!ParseMemoryStat("inactive_file_extra 5\n", "inactive_file", value));
+}
+
+BOOST_AUTO_TEST_CASE(read_cgroup_status)
+{
+    const int64_t limit = 64 << 20;
+
+    const fs::path v2 = GetDataDir() / "cgroup_v2";
+    fs::create_directories(v2);
+    WriteFile(v2 / "memory.max", strprintf("%d\n", limit));
+    WriteFile(v2 / "memory.current", strprintf("%d\n", 48 << 20));
+    WriteFile(v2 / "memory.stat", strprintf("anon %d\ninactive_file %d\n", 32 << 20, 16 << 20));
+    WriteFile(v2 / "memory.pressure", "some avg10=0.25 avg60=0.00 avg300=0.00 total=1\n");
+    MemoryStatus status;
+    BOOST_REQUIRE(ReadMemoryStatus(status, v2));
+    BOOST_CHECK_EQUAL(status.limit, limit);
+    BOOST_CHECK_EQUAL(status.usage, 32 << 20);
+    BOOST_CHECK_EQUAL(status.pressure, 0.25);
+
+    const fs::path v1 = GetDataDir() / "cgroup_v1";
+    fs::create_directories(v1 / "memory");
+    WriteFile(v1 / "memory" / "memory.limit_in_bytes", strprintf("%d\n", limit));
+    WriteFile(v1 / "memory" / "memory.usage_in_bytes", strprintf("%d\n", 40 << 20));
+    WriteFile(v1 / "memory" / "memory.stat", strprintf("cache 1\ntotal_inactive_file %d\n", 8 << 20));
+    BOOST_REQUIRE(ReadMemoryStatus(status, v1));
+    BOOST_CHECK_EQUAL(status.limit, limit);
+    BOOST_CHECK_EQUAL(status.usage, 32 << 20);
+}
+
+BOOST_AUTO_TEST_CASE(adjust_coin_cache_usage)
+{
+    const size_t MiB = 1 << 20;
+    MemoryStatus status;
+    status.limit = 1000 * MiB;
+    status.usage = 250 * MiB;
+    status.pressure = 0;
+
+    // During the initial block download, a full cache grows into half of
+    // what is left of three quarters of the limit.
+    BOOST_CHECK_EQUAL(AdjustCoinCacheUsage(status, 100 * MiB, 100 * MiB, 100 * MiB, true), 350 * MiB);
+    // The part of the limit the cache does not use yet counts as used.
+    BOOST_CHECK_EQUAL(AdjustCoinCacheUsage(status, 600 * MiB, 100 * MiB, 100 * MiB, true), 600 * MiB);
+    // It stays put when the memory is neither free nor short.
+    status.pressure = 5;
+    BOOST_CHECK_EQUAL(AdjustCoinCacheUsage(status, 100 * MiB, 100 * MiB, 100 * MiB, true), 100 * MiB);
+
+    // Under pressure, or close to the limit, it shrinks by a quarter, but not
+    // below the minimum database cache.
+    status.pressure = DBCACHE_PRESSURE_HIGH;
+    BOOST_CHECK_EQUAL(AdjustCoinCacheUsage(status, 400 * MiB, 400 * MiB, 100 * MiB, true), 300 * MiB);
+    BOOST_CHECK_EQUAL(AdjustCoinCacheUsage(status, 4 * MiB, 4 * MiB, 100 * MiB, true), size_t(nMinDbCache) * MiB);
+    status.pressure = -1;
+    status.usage = 950 * MiB;
+    BOOST_CHECK_EQUAL(AdjustCoinCacheUsage(status, 400 * MiB, 400 * MiB, 100 * MiB, false), 300 * MiB);
+
+    // Once synced, it goes back to the starting size, and grows back up to it.
+    status.usage = 250 * MiB;
+    BOOST_CHECK_EQUAL(AdjustCoinCacheUsage(status, 400 * MiB, 400 * MiB, 100 * MiB, false), 100 * MiB);
+    BOOST_CHECK_EQUAL(AdjustCoinCacheUsage(status, 50 * MiB, 50 * MiB, 100 * MiB, false), 100 * MiB);
+
+    // Nothing changes without a limit to go by.
+    status.limit = 0;
+    BOOST_CHECK_EQUAL(AdjustCoinCacheUsage(status, 100 * MiB, 100 * MiB, 100 * MiB, true), 100 * MiB);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
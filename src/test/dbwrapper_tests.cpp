@@ -42,6 +42,40 @@ BOOST_AUTO_TEST_CASE(dbwrapper)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_stats)
+{
+    fs::path ph = GetDataDir() / "dbwrapper_stats";
+    CDBWrapper dbw(ph, (1 << 20), true, false, false);
+    for (uint32_t i = 0; i < 1000; i++) {
+        BOOST_CHECK(dbw.Write(std::make_pair('k', i), InsecureRand256()));
+    }
+    // Move everything out of the memtable, so that reads go through the
+    // bloom filters and the block cache.
+    dbw.CompactRange(std::make_pair('k', uint32_t(0)), std::make_pair('k', uint32_t(1000)));
+
+    const DBStats before = dbw.GetStats();
+    uint256 res;
+    for (int round = 0; round < 2; round++) {
+        for (uint32_t i = 0; i < 1000; i += 10) {
+            BOOST_CHECK(dbw.Read(std::make_pair('k', i), res));
+            BOOST_CHECK(!dbw.Read(std::make_pair('k', i + 1000000), res));
+        }
+    }
+
+    DBStats stats = dbw.GetStats();
+    BOOST_CHECK_EQUAL(stats.name, "dbwrapper_stats");
+    BOOST_CHECK_EQUAL(stats.reads - before.reads, 400U);
+    BOOST_CHECK_EQUAL(stats.bytes_read - before.bytes_read, 200U * 32);
+    BOOST_CHECK(stats.bytes_written > 1000U * 32);
+    BOOST_CHECK(stats.cache_hits > 0 && stats.cache_misses > 0);
+    BOOST_CHECK(stats.bloom_useful > 0 && stats.bloom_useful <= stats.bloom_checks);
+    BOOST_CHECK(!stats.levels.empty());
+
+    bool found = false;
+    for (const DBStats& all : GetAllDBStats()) found |= all.name == "dbwrapper_stats";
+    BOOST_CHECK(found);
+}
+
 BOOST_AUTO_TEST_CASE(dbwrapper_basic_data)
 {
     // Perform tests both obfuscated and non-obfuscated.
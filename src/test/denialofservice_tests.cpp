@@ -12,6 +12,7 @@
 #include <script/signingprovider.h>
 #include <script/standard.h>
 #include <serialize.h>
+#include <txmempool.h>
 #include <util/memory.h>
 #include <util/string.h>
 #include <util/system.h>
@@ -20,7 +21,9 @@
 
 #include <test/util/setup_common.h>
 
+#include <limits>
 #include <stdint.h>
+#include <unordered_map>
 
 #include <boost/test/unit_test.hpp>
 
@@ -44,15 +47,18 @@ struct CConnmanTest : public CConnman {
 // Tests these internal-to-net_processing.cpp methods:
 extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t max_orphan_bytes);
 extern void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="");
+extern bool ProcessOrphanPackage(CConnman* connman, CTxMemPool& mempool, std::set<uint256>& orphan_work_set);
 
 struct COrphanTx {
     CTransactionRef tx;
     NodeId fromPeer;
     int64_t nTimeExpire;
+    size_t list_pos;
+    unsigned int tx_size;
 };
-extern std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
+extern std::unordered_map<uint256, COrphanTx, SaltedTxidHasher> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 
 static CService ip(uint32_t i)
 {
@@ -352,11 +358,8 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
 
 static CTransactionRef RandomOrphan()
 {
-    std::map<uint256, COrphanTx>::iterator it;
     LOCK2(cs_main, g_cs_orphans);
-    it = mapOrphanTransactions.lower_bound(InsecureRand256());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
+    auto it = std::next(mapOrphanTransactions.begin(), InsecureRandRange(mapOrphanTransactions.size()));
     return it->second.tx;
 }
 
@@ -433,12 +436,65 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     }
 
     // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
+    const size_t no_size_limit = std::numeric_limits<size_t>::max();
+    LimitOrphanTxSize(40, no_size_limit);
     BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
+    LimitOrphanTxSize(10, no_size_limit);
     BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
+
+    // ... which also keeps the orphans within the size limit:
+    size_t orphan_bytes = 0;
+    for (const auto& orphan : mapOrphanTransactions) {
+        BOOST_CHECK_EQUAL(orphan.second.tx_size, orphan.second.tx->GetTotalSize());
+        orphan_bytes += orphan.second.tx_size;
+    }
+    LimitOrphanTxSize(10, orphan_bytes - 1);
+    BOOST_CHECK(mapOrphanTransactions.size() < 10);
+    size_t limited_bytes = 0;
+    for (const auto& orphan : mapOrphanTransactions) {
+        limited_bytes += orphan.second.tx_size;
+    }
+    BOOST_CHECK(limited_bytes < orphan_bytes);
+
+    LimitOrphanTxSize(0, no_size_limit);
     BOOST_CHECK(mapOrphanTransactions.empty());
 }
 
+BOOST_AUTO_TEST_CASE(DoS_orphan_package_missing_output)
+{
+    // An orphan with one output, and an orphan spending it and an output it
+    // does not have
+    CMutableTransaction parent;
+    parent.vin.resize(1);
+    parent.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    parent.vout.resize(1);
+    parent.vout[0].nValue = 1*CENT;
+    parent.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    const CTransactionRef parent_tx = MakeTransactionRef(parent);
+
+    CMutableTransaction child;
+    child.vin.resize(2);
+    child.vin[0].prevout = COutPoint(parent_tx->GetHash(), 0);
+    child.vin[1].prevout = COutPoint(parent_tx->GetHash(), 5);
+    child.vout.resize(1);
+    child.vout[0].nValue = 1*CENT;
+    child.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    const CTransactionRef child_tx = MakeTransactionRef(child);
+
+    LOCK2(cs_main, g_cs_orphans);
+    BOOST_CHECK(AddOrphanTx(parent_tx, 0));
+    BOOST_CHECK(AddOrphanTx(child_tx, 0));
+
+    // The package cannot be ordered, so it is left to be processed one
+    // orphan at a time.
+    std::set<uint256> orphan_work_set{parent_tx->GetHash()};
+    BOOST_CHECK(!ProcessOrphanPackage(m_node.connman.get(), *m_node.mempool, orphan_work_set));
+    BOOST_CHECK(orphan_work_set == std::set<uint256>{parent_tx->GetHash()});
+    BOOST_CHECK(mapOrphanTransactions.count(parent_tx->GetHash()));
+    BOOST_CHECK(mapOrphanTransactions.count(child_tx->GetHash()));
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+
+    LimitOrphanTxSize(0, std::numeric_limits<size_t>::max());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
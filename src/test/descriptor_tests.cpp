@@ -363,4 +363,50 @@ BOOST_AUTO_TEST_CASE(descriptor_test)
     CheckUnparsable("", "raw(Ü)#00000000", "Invalid characters in payload"); // Invalid chars
 }
 
+BOOST_AUTO_TEST_CASE(expand_range)
+{
+    // Unhardened ranged derivation, on threads; hardened, from private keys
+    // one position after the other; and the two mixed in one descriptor.
+    const std::vector<std::pair<std::string, int>> descs{
+        {"wsh(multi(1,xpub661MyMwAqRbcFW31YEwpkMuc5THy2PSt5bDMsktWQcFF8syAmRUapSCGu8ED9W6oDMSgv6Zz8idoc4a6mr8BDzTJY47LJhkJ8UB7WEGuduB/1/*,xpub69H7F5d8KSRgmmdJg2KhpAK8SR3DjMwAdkxj3ZuxV27CprR9LgpeyGmXUbC6wb7ERfvrnKZjXoUmmDznezpbZb7ap6r1D3tgFxHmwMkQTPH/1/2/*))", 1000},
+        {"sh(wpkh(xprv9s21ZrQH143K3QTDL4LXw2F7HEK3wJUD2nW2nRk4stbPy6cq3jPPqjiChkVvvNKmPGJxWUtg6LnF5kejMRNNU3TGtRBeJgk33yuGBxrMPHi/10/20/30/40/*'))", 20},
+        {"wsh(multi(1,xprv9s21ZrQH143K3QTDL4LXw2F7HEK3wJUD2nW2nRk4stbPy6cq3jPPqjiChkVvvNKmPGJxWUtg6LnF5kejMRNNU3TGtRBeJgk33yuGBxrMPHi/10/*',xpub69H7F5d8KSRgmmdJg2KhpAK8SR3DjMwAdkxj3ZuxV27CprR9LgpeyGmXUbC6wb7ERfvrnKZjXoUmmDznezpbZb7ap6r1D3tgFxHmwMkQTPH/*))", 20},
+    };
+    for (const auto& desc_range : descs) {
+        FlatSigningProvider keys;
+        std::string error;
+        const auto desc = Parse(desc_range.first, keys, error);
+        BOOST_REQUIRE_MESSAGE(desc, error);
+        // Parse again for the expected results, as expanding caches xpubs in the descriptor.
+        FlatSigningProvider keys_serial;
+        const auto desc_serial = Parse(desc_range.first, keys_serial, error);
+        BOOST_REQUIRE(desc_serial);
+
+        std::vector<std::vector<CScript>> scripts;
+        std::vector<FlatSigningProvider> out;
+        BOOST_REQUIRE(ExpandRange(*desc, 5, 5 + desc_range.second - 1, keys, scripts, out));
+        BOOST_REQUIRE_EQUAL(scripts.size(), (size_t)desc_range.second);
+        BOOST_REQUIRE_EQUAL(out.size(), (size_t)desc_range.second);
+        for (int i = 0; i < desc_range.second; ++i) {
+            std::vector<CScript> expected;
+            FlatSigningProvider expected_out;
+            BOOST_REQUIRE(desc_serial->Expand(5 + i, keys_serial, expected, expected_out));
+            BOOST_CHECK(scripts[i] == expected);
+            BOOST_CHECK(out[i].scripts == expected_out.scripts);
+            BOOST_CHECK_EQUAL(out[i].origins.size(), expected_out.origins.size());
+        }
+    }
+
+    // Hardened positions cannot be derived without the private keys.
+    FlatSigningProvider keys;
+    std::string error;
+    const auto desc = Parse("wpkh(xpub661MyMwAqRbcFtXgS5sYJABqqG9YLmC4Q1Rdap9gSE8NqtwybGhePY2gZ29ESFjqJoCu1Rupje8YtGqsefD265TMg7usUDFdp6W1EGMcet8/*')", keys, error);
+    BOOST_REQUIRE(desc);
+    std::vector<std::vector<CScript>> scripts;
+    std::vector<FlatSigningProvider> out;
+    BOOST_CHECK(!ExpandRange(*desc, 0, 10, keys, scripts, out));
+    BOOST_CHECK(ExpandRange(*desc, 1, 0, keys, scripts, out));
+    BOOST_CHECK(scripts.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,73 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <equihash_solver.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(equihash_solver_tests, BasicTestingSetup)
+
+static eh_HashState TestState(unsigned int n, unsigned int k, uint32_t nonce)
+{
+    eh_HashState state;
+    EhInitialiseState(n, k, state);
+    crypto_generichash_blake2b_update(&state, (const unsigned char*) &nonce, sizeof(nonce));
+    return state;
+}
+
+BOOST_AUTO_TEST_CASE(solver_names)
+{
+    BOOST_CHECK(MakeEquihashSolver(DEFAULT_EQUIHASH_SOLVER));
+    for (const std::string name : {"basic", "optimised", "bucket"}) {
+        std::unique_ptr<EquihashSolver> solver = MakeEquihashSolver(name);
+        BOOST_REQUIRE(solver);
+        BOOST_CHECK_EQUAL(solver->GetName(), name);
+    }
+    BOOST_CHECK(!MakeEquihashSolver("unknown"));
+}
+
+BOOST_AUTO_TEST_CASE(bucket_solutions_are_valid)
+{
+    for (int threads : {1, 3}) {
+        std::unique_ptr<EquihashSolver> solver = MakeEquihashSolver("bucket", threads);
+        size_t found = 0;
+        for (uint32_t nonce = 0; nonce < 8; nonce++) {
+            const eh_HashState state = TestState(48, 5, nonce);
+            std::set<std::vector<unsigned char>> solutions;
+            BOOST_CHECK(!solver->Solve(48, 5, state, [&](std::vector<unsigned char> soln) {
+                BOOST_CHECK(Eh48_5.BasicIsValidSolution(state, soln));
+                BOOST_CHECK(solutions.insert(soln).second);
+                return false;
+            }, [](EhSolverCancelCheck pos) { return false; }));
+            found += solutions.size();
+        }
+        BOOST_CHECK(found > 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bucket_stops_and_cancels)
+{
+    std::unique_ptr<EquihashSolver> solver = MakeEquihashSolver("bucket", 2);
+    for (uint32_t nonce = 0; nonce < 16; nonce++) {
+        const eh_HashState state = TestState(48, 5, nonce);
+        int calls = 0;
+        bool found = solver->Solve(48, 5, state, [&calls](std::vector<unsigned char> soln) {
+            calls++;
+            return true;
+        }, [](EhSolverCancelCheck pos) { return false; });
+        BOOST_CHECK_EQUAL(found, calls > 0);
+        BOOST_CHECK(calls <= 1);
+    }
+
+    const eh_HashState state = TestState(48, 5, 0);
+    BOOST_CHECK_THROW(solver->Solve(48, 5, state, [](std::vector<unsigned char> soln) { return false; },
+                                    [](EhSolverCancelCheck pos) { return pos == ListSorting; }),
+                      EhSolverCancelledException);
+    BOOST_CHECK_THROW(solver->Solve(50, 5, state, [](std::vector<unsigned char> soln) { return false; },
+                                    [](EhSolverCancelCheck pos) { return false; }),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -123,4 +123,49 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1);
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(flatfile_map_cache)
+{
+    const auto data_dir = GetDataDir();
+    FlatFileSeq seq(data_dir, "a", 100);
+    FlatFileMapCache maps(1);
+
+    std::string line1("first line");
+    std::string line2("second line");
+    size_t pos2 = GetSerializeSize(line1, CLIENT_VERSION);
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file << line1;
+    }
+
+    // Files that do not exist or are too short are not mapped.
+    BOOST_CHECK(!maps.Get(seq, FlatFilePos(1, 0), 0));
+    BOOST_CHECK(!maps.Get(seq, FlatFilePos(0, pos2), 1));
+
+    std::shared_ptr<const MappedFile> map1 = maps.Get(seq, FlatFilePos(0, 0), pos2);
+    BOOST_REQUIRE(map1);
+    std::string text;
+    SpanReader(SER_DISK, CLIENT_VERSION, map1->Data()) >> text;
+    BOOST_CHECK_EQUAL(text, line1);
+    BOOST_CHECK(maps.Get(seq, FlatFilePos(0, 0), pos2) == map1);
+
+    // A file that has grown is mapped again, and the old map stays usable.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, pos2)), SER_DISK, CLIENT_VERSION);
+        file << line2;
+    }
+    std::shared_ptr<const MappedFile> map2 = maps.Get(seq, FlatFilePos(0, pos2), GetSerializeSize(line2, CLIENT_VERSION));
+    BOOST_REQUIRE(map2);
+    BOOST_CHECK(map2 != map1);
+    SpanReader(SER_DISK, CLIENT_VERSION, map2->Data().subspan(pos2)) >> text;
+    BOOST_CHECK_EQUAL(text, line2);
+    SpanReader(SER_DISK, CLIENT_VERSION, map1->Data()) >> text;
+    BOOST_CHECK_EQUAL(text, line1);
+
+    // Invalidated maps are not handed out again.
+    maps.Invalidate(0);
+    BOOST_CHECK(maps.Get(seq, FlatFilePos(0, 0), 0) != map2);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
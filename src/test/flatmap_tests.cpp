@@ -0,0 +1,122 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <flatmap.h>
+#include <memusage.h>
+
+#include <test/util/setup_common.h>
+
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flatmap_tests, BasicTestingSetup)
+
+namespace {
+struct IntHasher {
+    // Few distinct hash bits, so that probe sequences collide a lot.
+    size_t operator()(uint32_t x) const noexcept { return x * 0x9E3779B9U; }
+};
+} // namespace
+
+BOOST_AUTO_TEST_CASE(flatmap_random)
+{
+    for (int round = 0; round < 20; round++) {
+        flatmap<uint32_t, std::string, IntHasher> map;
+        std::map<uint32_t, std::string> real;
+        const uint32_t range = 1 + InsecureRandRange(2000);
+        for (int op = 0; op < 5000; op++) {
+            const uint32_t key = InsecureRandRange(range);
+            switch (InsecureRandRange(6)) {
+            case 0:
+            case 1: {
+                auto inserted = map.emplace(key, std::to_string(op));
+                auto real_inserted = real.emplace(key, std::to_string(op));
+                BOOST_CHECK_EQUAL(inserted.second, real_inserted.second);
+                BOOST_CHECK_EQUAL(inserted.first->second, real_inserted.first->second);
+                break;
+            }
+            case 2:
+                BOOST_CHECK_EQUAL(map.erase(key), real.erase(key));
+                break;
+            case 3:
+                map[key] += "x";
+                real[key] += "x";
+                break;
+            case 4: {
+                auto it = map.find(key);
+                auto real_it = real.find(key);
+                BOOST_CHECK_EQUAL(it == map.end(), real_it == real.end());
+                if (it != map.end()) BOOST_CHECK_EQUAL(it->second, real_it->second);
+                break;
+            }
+            case 5:
+                // Erase while walking the map, the way BatchWrite does.
+                if (InsecureRandRange(100) == 0) {
+                    for (auto it = map.begin(); it != map.end();) {
+                        if (it->first % 2) {
+                            real.erase(it->first);
+                            it = map.erase(it);
+                        } else {
+                            ++it;
+                        }
+                    }
+                }
+                break;
+            }
+            BOOST_CHECK_EQUAL(map.size(), real.size());
+        }
+        size_t count = 0;
+        for (const auto& entry : map) {
+            BOOST_CHECK_EQUAL(entry.second, real.at(entry.first));
+            count++;
+        }
+        BOOST_CHECK_EQUAL(count, real.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_references)
+{
+    // Entries do not move when the table grows or other entries are erased.
+    flatmap<uint32_t, uint32_t, IntHasher> map;
+    uint32_t& first = map[0];
+    first = 42;
+    for (uint32_t i = 1; i < 10000; i++) map[i] = i;
+    for (uint32_t i = 1; i < 10000; i += 2) map.erase(i);
+    BOOST_CHECK_EQUAL(&first, &map.find(0)->second);
+    BOOST_CHECK_EQUAL(first, 42U);
+    BOOST_CHECK_EQUAL(map.size(), 5000U);
+}
+
+BOOST_AUTO_TEST_CASE(flatmap_memory)
+{
+    CCoinsMap map;
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        map.emplace(std::piecewise_construct, std::forward_as_tuple(InsecureRand256(), i), std::tuple<>());
+    }
+    const size_t usage = memusage::DynamicUsage(map);
+    // Entries live in pool arrays rather than one allocation each, so a filled
+    // map needs less than an unordered_map node per entry.
+    BOOST_CHECK(usage > 1000 * sizeof(CCoinsMap::value_type));
+    BOOST_CHECK(usage < 1000 * memusage::MallocUsage(sizeof(memusage::unordered_node<CCoinsMap::value_type>)));
+
+    // Erased entries are reused rather than allocated anew.
+    std::vector<COutPoint> keys;
+    for (const auto& entry : map) keys.push_back(entry.first);
+    for (const COutPoint& key : keys) map.erase(key);
+    BOOST_CHECK(map.empty());
+    for (uint32_t i = 0; i < 1000; i++) {
+        map.emplace(std::piecewise_construct, std::forward_as_tuple(InsecureRand256(), i), std::tuple<>());
+    }
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), usage);
+
+    map.clear();
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -51,6 +51,8 @@ void test_one_input(const std::vector<uint8_t>& buffer)
             BlockStatus::BLOCK_FAILED_CHILD,
             BlockStatus::BLOCK_FAILED_MASK,
             BlockStatus::BLOCK_OPT_SAPLING,
+            BlockStatus::BLOCK_HAVE_SAPLING_ROOT,
+            BlockStatus::BLOCK_HAVE_SHIELDED_COUNTS,
         });
         if (block_status & ~BLOCK_VALID_MASK) {
             continue;
@@ -4,14 +4,61 @@
 
 #include <test/fuzz/fuzz.h>
 
+#include <crypto/sha256.h>
+#include <fs.h>
 #include <test/util/setup_common.h>
+#include <util/strencodings.h>
 
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <unistd.h>
 #include <vector>
 
 const std::function<void(const std::string&)> G_TEST_LOG_FUN{};
 
+//! FUZZ_SLOW_INPUT_MS: inputs that take longer than this are reported, 0 to not time inputs
+static int64_t g_slow_input_us = 0;
+//! FUZZ_SLOW_INPUT_DIR: where slow inputs are saved, in a directory named after the target
+static fs::path g_slow_input_dir;
+
+static void InitSlowInputs(const char* argv0)
+{
+    const char* budget = std::getenv("FUZZ_SLOW_INPUT_MS");
+    if (budget == nullptr) return;
+    g_slow_input_us = std::atoll(budget) * 1000;
+    const char* dir = std::getenv("FUZZ_SLOW_INPUT_DIR");
+    if (g_slow_input_us > 0 && dir != nullptr && argv0 != nullptr) {
+        g_slow_input_dir = fs::path(dir) / fs::path(argv0).filename();
+        fs::create_directories(g_slow_input_dir);
+    }
+}
+
+static void RunOneInput(const std::vector<uint8_t>& input)
+{
+    if (g_slow_input_us <= 0) {
+        test_one_input(input);
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    test_one_input(input);
+    const int64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    if (elapsed_us < g_slow_input_us) return;
+
+    // Named by content, like the coverage corpus, so a slow input found
+    // again overwrites its earlier copy.
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(input.data(), input.size()).Finalize(hash);
+    const std::string name = HexStr(hash, hash + sizeof(hash));
+    fprintf(stderr, "SLOW INPUT: %s, %u bytes, %.3fms\n", name.c_str(), (unsigned int)input.size(), elapsed_us / 1000.0);
+    if (g_slow_input_dir.empty()) return;
+    FILE* file = fsbridge::fopen(g_slow_input_dir / name, "wb");
+    if (file == nullptr) return;
+    if (!input.empty()) fwrite(input.data(), 1, input.size(), file);
+    fclose(file);
+}
+
 #if defined(__AFL_COMPILER)
 static bool read_stdin(std::vector<uint8_t>& data)
 {
@@ -35,13 +82,14 @@ __attribute__((weak)) void initialize()
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 {
     const std::vector<uint8_t> input(data, data + size);
-    test_one_input(input);
+    RunOneInput(input);
     return 0;
 }
 
 // This function is used by libFuzzer
 extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
 {
+    InitSlowInputs(*argc > 0 ? (*argv)[0] : nullptr);
     initialize();
     return 0;
 }
@@ -50,6 +98,7 @@ extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
 #if defined(__AFL_COMPILER)
 int main(int argc, char** argv)
 {
+    InitSlowInputs(argc > 0 ? argv[0] : nullptr);
     initialize();
 #ifdef __AFL_INIT
     // Enable AFL deferred forkserver mode. Requires compilation using
@@ -65,14 +114,14 @@ int main(int argc, char** argv)
         if (!read_stdin(buffer)) {
             continue;
         }
-        test_one_input(buffer);
+        RunOneInput(buffer);
     }
 #else
     std::vector<uint8_t> buffer;
     if (!read_stdin(buffer)) {
         return 0;
     }
-    test_one_input(buffer);
+    RunOneInput(buffer);
 #endif
     return 0;
 }
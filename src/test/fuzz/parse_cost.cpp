@@ -0,0 +1,64 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Targets for finding inputs that are slow to parse rather than ones that
+// crash: run them with FUZZ_SLOW_INPUT_MS (see doc/fuzzing.md), and the
+// bench runner replays what they save with -fuzzcorpus. Unlike the
+// *_deserialize targets, the stream version is fixed, so that the fuzzer
+// spends its bytes on the payload, shielded fields included.
+
+#include <base58.h>
+#include <bech32.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <version.h>
+
+#include <test/fuzz/fuzz.h>
+
+#include <univalue.h>
+
+#include <ios>
+#include <string>
+#include <vector>
+
+void test_one_input(const std::vector<uint8_t>& buffer)
+{
+#if PARSE_COST_BLOCK
+    CDataStream ds(buffer, SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    try {
+        ds >> block;
+    } catch (const std::ios_base::failure&) {
+    }
+#elif PARSE_COST_TRANSACTION
+    CDataStream ds(buffer, SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        const CTransaction tx(deserialize, ds);
+        (void)tx.GetHash();
+    } catch (const std::ios_base::failure&) {
+    }
+#elif PARSE_COST_EQUIHASH
+    CDataStream ds(buffer, SER_NETWORK, PROTOCOL_VERSION);
+    CBlockHeader header;
+    try {
+        ds >> header;
+    } catch (const std::ios_base::failure&) {
+        return;
+    }
+    (void)CheckEquihashSolution(&header);
+#elif PARSE_COST_UNIVALUE
+    UniValue value;
+    (void)value.read(std::string(buffer.begin(), buffer.end()));
+#elif PARSE_COST_BASE58CHECK
+    // The largest max_ret_len key_io decodes with
+    std::vector<unsigned char> decoded;
+    (void)DecodeBase58Check(std::string(buffer.begin(), buffer.end()), decoded, 78);
+#elif PARSE_COST_BECH32
+    (void)bech32::Decode(std::string(buffer.begin(), buffer.end()));
+#else
+#error Need at least one parse cost fuzz target to compile
+#endif
+}
@@ -145,6 +145,21 @@ BOOST_AUTO_TEST_CASE(siphash)
         BOOST_CHECK_EQUAL(SipHashUint256(k1, k2, x), sip256.Finalize());
         BOOST_CHECK_EQUAL(SipHashUint256Extra(k1, k2, x, n), sip288.Finalize());
     }
+
+    // Check consistency between SipHashUint256 and SipHashUint256Multi, for counts with and without a remainder.
+    std::vector<uint256> vals;
+    std::vector<uint64_t> multi;
+    for (size_t count = 0; count <= 20; ++count) {
+        uint64_t k1 = ctx.rand64();
+        uint64_t k2 = ctx.rand64();
+        vals.resize(count);
+        for (uint256& val : vals) val = InsecureRand256();
+        multi.assign(count, 0);
+        SipHashUint256Multi(k1, k2, vals.data(), count, multi.data());
+        for (size_t i = 0; i < count; ++i) {
+            BOOST_CHECK_EQUAL(multi[i], SipHashUint256(k1, k2, vals[i]));
+        }
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
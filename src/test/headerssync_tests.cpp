@@ -0,0 +1,279 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparamsbase.h>
+#include <consensus/consensus.h>
+#include <headerssync.h>
+#include <pow.h>
+#include <validation.h>
+#include <test/util/setup_common.h>
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(headerssync_tests, BasicTestingSetup)
+
+/** A chain of linked headers, with checkpoints every interval headers */
+static std::vector<CBlockHeader> MakeChain(size_t length, int interval, MapCheckpoints& checkpoints)
+{
+    std::vector<CBlockHeader> chain(length);
+    for (size_t i = 0; i < length; i++) {
+        chain[i].nTime = i;
+        chain[i].nNonce = InsecureRand256();
+        if (i > 0) chain[i].hashPrevBlock = chain[i - 1].GetHash();
+        if (i % interval == 0) checkpoints[i] = chain[i].GetHash();
+    }
+    return chain;
+}
+
+static std::vector<CBlockHeader> Slice(const std::vector<CBlockHeader>& chain, int first, int last)
+{
+    return std::vector<CBlockHeader>(chain.begin() + first, chain.begin() + last + 1);
+}
+
+BOOST_AUTO_TEST_CASE(ranges_connect_in_order)
+{
+    MapCheckpoints checkpoints;
+    const std::vector<CBlockHeader> chain = MakeChain(31, 10, checkpoints);
+    // Headers up to height 5 are known, so ranges start at the checkpoint at 10
+    HeadersRangeSync sync(checkpoints, 5);
+    const std::chrono::microseconds now{1000};
+    uint256 locator, stop;
+
+    // A peer that does not have a range gets none
+    BOOST_CHECK(!sync.Assign(1, 15, now, locator, stop));
+    BOOST_CHECK(sync.Assign(1, 30, now, locator, stop));
+    BOOST_CHECK(locator == chain[10].GetHash() && stop == chain[20].GetHash());
+    BOOST_CHECK(sync.Assign(2, 30, now, locator, stop));
+    BOOST_CHECK(locator == chain[20].GetHash() && stop == chain[30].GetHash());
+    BOOST_CHECK(!sync.Assign(3, 30, now, locator, stop));
+    BOOST_CHECK_EQUAL(sync.Downloading(), 2U);
+
+    // Headers that do not follow the range are not taken
+    BOOST_CHECK(sync.ReceiveHeaders(1, Slice(chain, 1, 5), now, locator, stop) == HeadersRangeSync::Result::UNEXPECTED);
+
+    // The second range completes first, and waits for the first one
+    BOOST_CHECK(sync.ReceiveHeaders(2, Slice(chain, 21, 30), now, locator, stop) == HeadersRangeSync::Result::COMPLETE);
+    BOOST_CHECK(sync.Next() == nullptr);
+    BOOST_CHECK(sync.ReceiveHeaders(1, Slice(chain, 11, 20), now, locator, stop) == HeadersRangeSync::Result::COMPLETE);
+    BOOST_CHECK_EQUAL(sync.Downloading(), 0U);
+
+    NodeId from;
+    BOOST_REQUIRE(sync.Next() != nullptr);
+    BOOST_CHECK(sync.Next()->start_hash == chain[10].GetHash());
+    std::vector<CBlockHeader> headers = sync.TakeNext(from);
+    BOOST_CHECK_EQUAL(from, 1);
+    BOOST_CHECK_EQUAL(headers.size(), 10U);
+    BOOST_CHECK(headers.back().GetHash() == chain[20].GetHash());
+    BOOST_REQUIRE(sync.Next() != nullptr);
+    headers = sync.TakeNext(from);
+    BOOST_CHECK_EQUAL(from, 2);
+    BOOST_CHECK(headers.front().hashPrevBlock == chain[20].GetHash());
+    BOOST_CHECK(sync.Done());
+}
+
+BOOST_AUTO_TEST_CASE(invalid_and_released_ranges)
+{
+    MapCheckpoints checkpoints;
+    const std::vector<CBlockHeader> chain = MakeChain(21, 10, checkpoints);
+    MapCheckpoints other_checkpoints;
+    const std::vector<CBlockHeader> other = MakeChain(21, 10, other_checkpoints);
+    HeadersRangeSync sync(checkpoints, 0);
+    const std::chrono::microseconds now{1000};
+    uint256 locator, stop;
+
+    // Headers that do not end at the checkpoint give up the range
+    BOOST_CHECK(sync.Assign(1, 20, now, locator, stop));
+    std::vector<CBlockHeader> headers = Slice(chain, 1, 9);
+    headers.push_back(other[10]);
+    headers.back().hashPrevBlock = chain[9].GetHash();
+    BOOST_CHECK(sync.ReceiveHeaders(1, headers, now, locator, stop) == HeadersRangeSync::Result::INVALID);
+    BOOST_CHECK(!sync.IsDownloading(1));
+
+    // As do non-continuous ones
+    BOOST_CHECK(sync.Assign(2, 20, now, locator, stop));
+    headers = Slice(chain, 1, 10);
+    headers[4] = other[5];
+    BOOST_CHECK(sync.ReceiveHeaders(2, headers, now, locator, stop) == HeadersRangeSync::Result::INVALID);
+
+    // A peer stopping short of the checkpoint does not have the range
+    BOOST_CHECK(sync.Assign(3, 20, now, locator, stop));
+    BOOST_CHECK(sync.ReceiveHeaders(3, Slice(chain, 1, 4), now, locator, stop) == HeadersRangeSync::Result::EMPTY);
+
+    // A stalled peer is found, and its range goes to the next peer
+    BOOST_CHECK(sync.Assign(4, 20, now, locator, stop));
+    BOOST_CHECK(!sync.HasStalled(4, now));
+    BOOST_CHECK(sync.HasStalled(4, now + std::chrono::seconds{1}));
+    sync.Release(4);
+    BOOST_CHECK(sync.Assign(5, 20, now, locator, stop));
+    BOOST_CHECK(locator == chain[0].GetHash());
+
+    // Ranges the normal sync went past are dropped
+    sync.Prune(15);
+    BOOST_CHECK(!sync.Done());
+    sync.Prune(20);
+    BOOST_CHECK(sync.Done());
+}
+
+BOOST_AUTO_TEST_CASE(long_range_and_buffer_limit)
+{
+    MapCheckpoints checkpoints;
+    const int interval = MAX_HEADERS_RESULTS + 500;
+    const std::vector<CBlockHeader> chain = MakeChain(interval + 1, interval, checkpoints);
+    // Checkpoints far apart: the ranges after the first do not fit in the buffer
+    checkpoints[interval + MAX_HEADERS_SYNC_BUFFERED] = uint256();
+    HeadersRangeSync sync(checkpoints, 0);
+    const std::chrono::microseconds now{1000};
+    uint256 locator, stop;
+
+    BOOST_CHECK(sync.Assign(1, std::numeric_limits<int>::max(), now, locator, stop));
+    BOOST_CHECK(!sync.Assign(2, std::numeric_limits<int>::max(), now, locator, stop));
+
+    // A range longer than a headers message is asked for in several
+    BOOST_CHECK(sync.ReceiveHeaders(1, Slice(chain, 1, MAX_HEADERS_RESULTS), now, locator, stop) == HeadersRangeSync::Result::MORE);
+    BOOST_CHECK(locator == chain[MAX_HEADERS_RESULTS].GetHash());
+    BOOST_CHECK(stop == chain[interval].GetHash());
+    BOOST_CHECK(sync.ReceiveHeaders(1, Slice(chain, MAX_HEADERS_RESULTS + 1, interval), now, locator, stop) == HeadersRangeSync::Result::COMPLETE);
+}
+
+/** A chain of headers with valid proof of work at the lowest difficulty, following prev */
+static std::vector<CBlockHeader> MakePoWChain(const uint256& prev, size_t length, const Consensus::Params& params)
+{
+    std::vector<CBlockHeader> chain(length);
+    for (size_t i = 0; i < length; i++) {
+        chain[i].nVersion = MIN_BLOCK_VERSION;
+        chain[i].hashPrevBlock = i > 0 ? chain[i - 1].GetHash() : prev;
+        chain[i].nBits = UintToArith256(params.powLimit).GetCompact();
+        chain[i].nNonce = InsecureRand256();
+        while (!CheckProofOfWork(chain[i].GetHash(), chain[i].nBits, params)) {
+            chain[i].nNonce = ArithToUint256(UintToArith256(chain[i].nNonce) + 1);
+        }
+    }
+    return chain;
+}
+
+BOOST_AUTO_TEST_CASE(presync_redownload)
+{
+    const std::unique_ptr<const CChainParams> chainparams = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = chainparams->GetConsensus();
+    const uint256 start_hash = InsecureRand256();
+    CBlockIndex start;
+    start.phashBlock = &start_hash;
+    start.nBits = UintToArith256(params.powLimit).GetCompact();
+    const CBlockLocator start_locator(std::vector<uint256>{start_hash});
+
+    const size_t length = 3 * MAX_HEADERS_RESULTS + 1000;
+    const std::vector<CBlockHeader> chain = MakePoWChain(start_hash, length, params);
+    const arith_uint256 minimum_work = CalculateHeadersWork(chain);
+    BOOST_CHECK(CalculateHeadersWork(Slice(chain, 0, 9)) == minimum_work * 10 / length);
+    const int64_t now = length;
+
+    HeadersPresync sync(params, &start, start_locator, minimum_work, now);
+    BOOST_CHECK(sync.IsContinuation(Slice(chain, 0, 0)));
+    BOOST_CHECK(!sync.IsContinuation(Slice(chain, 1, 1)));
+
+    // Nothing is released while the work is not reached
+    for (size_t i = 0; i < length; i += MAX_HEADERS_RESULTS) {
+        const std::vector<CBlockHeader> headers = Slice(chain, i, std::min(i + MAX_HEADERS_RESULTS, length) - 1);
+        BOOST_CHECK(sync.IsContinuation(headers));
+        const HeadersPresync::Result result = sync.ProcessHeaders(headers, headers.size() == MAX_HEADERS_RESULTS);
+        BOOST_CHECK(result.success && result.request_more && result.headers.empty());
+        BOOST_CHECK(sync.NextLocator().vHave.front() == (i + MAX_HEADERS_RESULTS < length ? headers.back().GetHash() : start_hash));
+    }
+    BOOST_CHECK(sync.GetPhase() == HeadersPresync::Phase::REDOWNLOAD);
+    BOOST_CHECK_EQUAL(sync.PresyncHeight(), (int)length);
+
+    // The headers downloaded again are held back until enough after them matched
+    std::vector<CBlockHeader> released;
+    for (size_t i = 0; i < length; i += MAX_HEADERS_RESULTS) {
+        const std::vector<CBlockHeader> headers = Slice(chain, i, std::min(i + MAX_HEADERS_RESULTS, length) - 1);
+        BOOST_CHECK(sync.IsContinuation(headers));
+        const HeadersPresync::Result result = sync.ProcessHeaders(headers, headers.size() == MAX_HEADERS_RESULTS);
+        BOOST_CHECK(result.success);
+        released.insert(released.end(), result.headers.begin(), result.headers.end());
+        const size_t received = std::min(i + MAX_HEADERS_RESULTS, length);
+        if (received < length) {
+            BOOST_CHECK(result.request_more);
+            BOOST_CHECK_EQUAL(released.size(), received > HEADERS_REDOWNLOAD_BUFFER_SIZE ? received - HEADERS_REDOWNLOAD_BUFFER_SIZE : 0);
+        }
+    }
+    // Once the work is reached again, all of them are
+    BOOST_CHECK(sync.GetPhase() == HeadersPresync::Phase::FINAL);
+    BOOST_REQUIRE_EQUAL(released.size(), length);
+    BOOST_CHECK(released.back().GetHash() == chain.back().GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(presync_failures)
+{
+    const std::unique_ptr<const CChainParams> chainparams = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = chainparams->GetConsensus();
+    const uint256 start_hash = InsecureRand256();
+    CBlockIndex start;
+    start.phashBlock = &start_hash;
+    start.nBits = UintToArith256(params.powLimit).GetCompact();
+    const CBlockLocator start_locator(std::vector<uint256>{start_hash});
+
+    const size_t length = 4 * MAX_HEADERS_RESULTS;
+    const std::vector<CBlockHeader> chain = MakePoWChain(start_hash, length, params);
+    const arith_uint256 minimum_work = CalculateHeadersWork(chain);
+    const int64_t now = length;
+
+    // A chain that ends without the work
+    {
+        HeadersPresync sync(params, &start, start_locator, minimum_work, now);
+        BOOST_CHECK(sync.ProcessHeaders(Slice(chain, 0, MAX_HEADERS_RESULTS - 1), true).success);
+        BOOST_CHECK(!sync.ProcessHeaders(Slice(chain, MAX_HEADERS_RESULTS, MAX_HEADERS_RESULTS + 9), false).success);
+        BOOST_CHECK(sync.GetPhase() == HeadersPresync::Phase::FINAL);
+        BOOST_CHECK(!sync.IsContinuation(Slice(chain, MAX_HEADERS_RESULTS + 10, MAX_HEADERS_RESULTS + 10)));
+    }
+
+    // A header without its proof of work
+    {
+        HeadersPresync sync(params, &start, start_locator, minimum_work, now);
+        std::vector<CBlockHeader> headers = Slice(chain, 0, 9);
+        headers.back().nBits = UintToArith256(params.powLimit).GetCompact() + 1;
+        BOOST_CHECK(!sync.ProcessHeaders(headers, true).success);
+    }
+
+    // Headers easier than the difficulty the chain before them requires
+    {
+        CBlockIndex harder_start;
+        harder_start.phashBlock = &start_hash;
+        harder_start.nBits = arith_uint256(UintToArith256(params.powLimit) >> 1).GetCompact();
+        HeadersPresync sync(params, &harder_start, start_locator, minimum_work, now);
+        BOOST_CHECK(!sync.ProcessHeaders(Slice(chain, 0, 9), true).success);
+        BOOST_CHECK(sync.GetPhase() == HeadersPresync::Phase::FINAL);
+    }
+
+    // A chain longer than time allows
+    {
+        HeadersPresync sync(params, &start, start_locator, minimum_work, -MAX_FUTURE_BLOCK_TIME);
+        HeadersPresync::Result result;
+        for (size_t i = 0; i < length && result.success; i += MAX_HEADERS_RESULTS) {
+            result = sync.ProcessHeaders(Slice(chain, i, i + MAX_HEADERS_RESULTS - 1), true);
+        }
+        BOOST_CHECK(!result.success);
+    }
+
+    // Other headers when they are downloaded again
+    {
+        HeadersPresync sync(params, &start, start_locator, minimum_work, now);
+        for (size_t i = 0; i < length; i += MAX_HEADERS_RESULTS) {
+            BOOST_CHECK(sync.ProcessHeaders(Slice(chain, i, i + MAX_HEADERS_RESULTS - 1), true).success);
+        }
+        BOOST_CHECK(sync.GetPhase() == HeadersPresync::Phase::REDOWNLOAD);
+        const std::vector<CBlockHeader> other = MakePoWChain(start_hash, length, params);
+        HeadersPresync::Result result;
+        // Caught unless all of the commitments happen to match
+        for (size_t i = 0; i < length && result.success; i += MAX_HEADERS_RESULTS) {
+            result = sync.ProcessHeaders(Slice(other, i, i + MAX_HEADERS_RESULTS - 1), true);
+        }
+        BOOST_CHECK(!result.success);
+        BOOST_CHECK(sync.GetPhase() == HeadersPresync::Phase::FINAL);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,146 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/util/setup_common.h>
+#include <zcash/IncrementalMerkleTree.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace libzcash;
+
+namespace {
+template <typename Hash>
+Hash RandomLeaf()
+{
+    uint256 leaf = InsecureRand256();
+    // Below the BLS12-381 scalar field modulus, like a Sapling note commitment
+    *(leaf.end() - 1) &= 0x3f;
+    return Hash(leaf);
+}
+
+/** Split max_size leaves into batches of up to max_batch, including empty ones. */
+std::vector<size_t> RandomBatchSizes(size_t max_batch, size_t max_size)
+{
+    std::vector<size_t> sizes;
+    for (size_t size = 0; size < max_size; size += sizes.back()) {
+        sizes.push_back(InsecureRandRange(std::min(max_batch, max_size - size) + 1));
+    }
+    return sizes;
+}
+
+/**
+ * Append batches of the given sizes to a tree one leaf at a time and to
+ * another one with append_batch, witnessing the last leaf of some batches in
+ * both, and check that the trees and witnesses stay the same.
+ */
+template <typename Tree, typename Witness, typename Hash>
+void CheckAppendBatch(const std::vector<size_t>& batch_sizes)
+{
+    Tree tree, batched;
+    std::vector<Witness> witnesses, batched_witnesses;
+    for (size_t batch_size : batch_sizes) {
+        std::vector<Hash> objs;
+        for (size_t i = 0; i < batch_size; i++) {
+            objs.push_back(RandomLeaf<Hash>());
+        }
+
+        for (const Hash& obj : objs) {
+            tree.append(obj);
+            for (Witness& witness : witnesses) {
+                witness.append(obj);
+            }
+        }
+        std::vector<Witness*> batched_witness_ptrs;
+        for (Witness& witness : batched_witnesses) {
+            batched_witness_ptrs.push_back(&witness);
+        }
+        if (batched_witness_ptrs.empty() && InsecureRandBool()) {
+            batched.append_batch(objs);
+        } else {
+            Witness::append_batch(batched, objs, batched_witness_ptrs);
+        }
+
+        BOOST_CHECK(batched == tree);
+        BOOST_CHECK_EQUAL(batched.size(), tree.size());
+        BOOST_CHECK(batched.root() == tree.root());
+        if (tree.size() > 0) {
+            BOOST_CHECK(batched.last() == tree.last());
+        }
+        for (size_t i = 0; i < witnesses.size(); i++) {
+            BOOST_CHECK_EQUAL(batched_witnesses[i].position(), witnesses[i].position());
+            BOOST_CHECK(batched_witnesses[i].element() == witnesses[i].element());
+            BOOST_CHECK(batched_witnesses[i].root() == tree.root());
+            BOOST_CHECK(witnesses[i].root() == tree.root());
+            const MerklePath path = witnesses[i].path();
+            const MerklePath batched_path = batched_witnesses[i].path();
+            BOOST_CHECK(batched_path.authentication_path == path.authentication_path);
+            BOOST_CHECK(batched_path.index == path.index);
+        }
+
+        if (tree.size() > 0 && InsecureRandBool()) {
+            witnesses.push_back(tree.witness());
+            batched_witnesses.push_back(batched.witness());
+        }
+    }
+}
+
+template <typename Tree, typename Hash>
+void CheckAppendBatchFull()
+{
+    Tree tree;
+    std::vector<Hash> objs;
+    for (int i = 0; i < (1 << INCREMENTAL_MERKLE_TREE_DEPTH_TESTING) - 1; i++) {
+        objs.push_back(RandomLeaf<Hash>());
+    }
+    tree.append_batch(objs);
+
+    // A batch that does not fit is rejected without changing the tree.
+    const Tree before = tree;
+    BOOST_CHECK_THROW(tree.append_batch({RandomLeaf<Hash>(), RandomLeaf<Hash>()}), std::runtime_error);
+    BOOST_CHECK(tree == before);
+
+    tree.append_batch({RandomLeaf<Hash>()});
+    BOOST_CHECK_EQUAL(tree.size(), 1U << INCREMENTAL_MERKLE_TREE_DEPTH_TESTING);
+    BOOST_CHECK_THROW(tree.append_batch({RandomLeaf<Hash>()}), std::runtime_error);
+    BOOST_CHECK_THROW(tree.append(RandomLeaf<Hash>()), std::runtime_error);
+    // An empty batch still fits.
+    tree.append_batch({});
+    BOOST_CHECK_EQUAL(tree.size(), 1U << INCREMENTAL_MERKLE_TREE_DEPTH_TESTING);
+}
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(incrementalmerkletree_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(append_batch_subtree_boundaries)
+{
+    // The tree reaches the sizes 7, 9, 15, 33, 64, 65, 129 and 132, so that
+    // batches start and end just before, on and after subtree boundaries.
+    const std::vector<size_t> batch_sizes{7, 2, 6, 18, 31, 1, 64, 0, 3};
+    CheckAppendBatch<SaplingMerkleTree, SaplingWitness, PedersenHash>(batch_sizes);
+    CheckAppendBatch<SproutMerkleTree, SproutWitness, SHA256Compress>(batch_sizes);
+}
+
+BOOST_AUTO_TEST_CASE(append_batch_random)
+{
+    for (int i = 0; i < 20; i++) {
+        // Small batches and single ones that fill the whole tree
+        const size_t max_batch = i % 2 == 0 ? 5 : 1 << INCREMENTAL_MERKLE_TREE_DEPTH_TESTING;
+        const std::vector<size_t> batch_sizes = RandomBatchSizes(max_batch, 1 << INCREMENTAL_MERKLE_TREE_DEPTH_TESTING);
+        CheckAppendBatch<SaplingTestingMerkleTree, SaplingTestingWitness, PedersenHash>(batch_sizes);
+        CheckAppendBatch<SproutTestingMerkleTree, SproutTestingWitness, SHA256Compress>(batch_sizes);
+    }
+    for (int i = 0; i < 4; i++) {
+        const std::vector<size_t> batch_sizes = RandomBatchSizes(40, 200);
+        CheckAppendBatch<SaplingMerkleTree, SaplingWitness, PedersenHash>(batch_sizes);
+        CheckAppendBatch<SproutMerkleTree, SproutWitness, SHA256Compress>(batch_sizes);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(append_batch_full)
+{
+    CheckAppendBatchFull<SaplingTestingMerkleTree, PedersenHash>();
+    CheckAppendBatchFull<SproutTestingMerkleTree, SHA256Compress>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,7 +6,11 @@
 #include <logging/timer.h>
 #include <test/util/setup_common.h>
 
+#include <atomic>
 #include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 
@@ -33,4 +37,119 @@ BOOST_AUTO_TEST_CASE(logging_timer)
     SetMockTime(0);
 }
 
+static BCLog::MetricScopeStats FindMetricScope(const std::string& name)
+{
+    for (const BCLog::MetricScopeStats& stats : BCLog::GetMetricScopeStats()) {
+        if (stats.name == name) return stats;
+    }
+    return BCLog::MetricScopeStats{};
+}
+
+BOOST_AUTO_TEST_CASE(metric_scope)
+{
+    BOOST_CHECK_EQUAL(BCLog::MetricScopeId("logging_tests/a"), BCLog::MetricScopeId("logging_tests/a"));
+    BOOST_CHECK(BCLog::MetricScopeId("logging_tests/a") != BCLog::MetricScopeId("logging_tests/b"));
+
+    for (int i = 0; i < 3; ++i) {
+        METRIC_SCOPE("logging_tests/a");
+    }
+    // What a thread recorded is still counted after it exits.
+    std::thread([] {
+        METRIC_SCOPE_NAMED(std::string("logging_tests/") + "a");
+    }).join();
+    {
+        METRIC_SCOPE("logging_tests/b");
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    const BCLog::MetricScopeStats a = FindMetricScope("logging_tests/a");
+    BOOST_CHECK_EQUAL(a.count, 4U);
+    uint64_t in_buckets = 0;
+    for (uint64_t n : a.histogram) in_buckets += n;
+    BOOST_CHECK_EQUAL(in_buckets, 4U);
+
+    const BCLog::MetricScopeStats b = FindMetricScope("logging_tests/b");
+    BOOST_CHECK_EQUAL(b.count, 1U);
+    BOOST_CHECK(b.total_us >= 2000);
+    // 2ms is above the 1ms bound and within the 2.5ms one, or later ones on a slow machine.
+    BOOST_CHECK_EQUAL(b.histogram[0] + b.histogram[1] + b.histogram[2], 0U);
+
+    BOOST_CHECK_EQUAL(FindMetricScope("logging_tests/unused").count, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(logging_async)
+{
+    // Callbacks run on the writer thread, but under the logger lock, and
+    // StopAsync joins that thread before the lines are read.
+    std::vector<std::string> lines;
+    std::atomic<bool> hold{false};
+    auto callback = LogInstance().PushBackCallback([&](const std::string& s) {
+        while (hold) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        lines.push_back(s);
+    });
+
+    LogInstance().StartAsync(1024);
+    for (int i = 0; i < 100; ++i) {
+        LogPrintf("async message %d\n", i);
+    }
+    LogInstance().StopAsync();
+    BOOST_CHECK_EQUAL(LogInstance().GetDropStats().queue_full, 0U);
+    std::vector<std::string> expected;
+    for (const std::string& line : lines) {
+        if (line.find("async message ") != std::string::npos) expected.push_back(line);
+    }
+    BOOST_REQUIRE_EQUAL(expected.size(), 100U);
+    for (int i = 0; i < 100; ++i) {
+        BOOST_CHECK(expected[i].find(strprintf("async message %d\n", i)) != std::string::npos);
+    }
+
+    // With the writer stuck on the first message, all but two of the rest
+    // find the queue full.
+    lines.clear();
+    LogInstance().StartAsync(2);
+    hold = true;
+    LogPrintf("held message\n");
+    for (int i = 0; i < 10; ++i) {
+        LogPrintf("queued message %d\n", i);
+    }
+    const uint64_t dropped = LogInstance().GetDropStats().queue_full;
+    BOOST_CHECK(dropped >= 8 && dropped <= 9);
+    hold = false;
+    LogInstance().StopAsync();
+    int written = 0;
+    bool reported = false;
+    for (const std::string& line : lines) {
+        if (line.find("queued message ") != std::string::npos || line.find("held message") != std::string::npos) ++written;
+        if (line.find(strprintf("Dropped %u log messages", dropped)) != std::string::npos) reported = true;
+    }
+    BOOST_CHECK_EQUAL(written + dropped, 11U);
+    BOOST_CHECK(reported);
+
+    LogInstance().DeleteCallback(callback);
+}
+
+BOOST_AUTO_TEST_CASE(logging_rate_limit)
+{
+    const uint32_t categories = LogInstance().GetCategoryMask();
+    LogInstance().EnableCategory(BCLog::NET);
+    const uint64_t limited_before = LogInstance().GetDropStats().rate_limited;
+    LogInstance().m_rate_limit = 5;
+
+    int evaluated = 0;
+    for (int i = 0; i < 20; ++i) {
+        LogPrint(BCLog::NET, "rate limited message %d\n", ++evaluated);
+    }
+    // The messages span at most two one-second windows.
+    BOOST_CHECK(evaluated >= 5 && evaluated <= 10);
+    BOOST_CHECK_EQUAL(LogInstance().GetDropStats().rate_limited - limited_before, 20U - evaluated);
+    // Uncategorized messages are never limited.
+    BOOST_CHECK(LogWithinRateLimit(BCLog::NONE));
+
+    LogInstance().m_rate_limit = 0;
+    for (int i = 0; i < 20; ++i) {
+        BOOST_CHECK(LogWithinRateLimit(BCLog::NET));
+    }
+    if (!(categories & BCLog::NET)) LogInstance().DisableCategory(BCLog::NET);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <consensus/validation.h>
+#include <script/interpreter.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+struct MempoolPersistSetup : public TestChain100Setup {
+    std::vector<CTransactionRef> m_txs;
+    const uint256 m_unknown_hash{InsecureRand256()};
+
+    MempoolPersistSetup()
+    {
+        // Two transactions in the mempool, one of them prioritised, and a
+        // prioritisation of a transaction that is not
+        LOCK(cs_main);
+        for (int i = 0; i < 2; i++) {
+            CMutableTransaction tx;
+            tx.nVersion = 1;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(m_coinbase_txns[i]->GetHash(), 0);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = m_coinbase_txns[i]->vout[0].nValue - 10000;
+            tx.vout[0].scriptPubKey = m_coinbase_txns[i]->vout[0].scriptPubKey;
+
+            std::vector<unsigned char> vchSig;
+            uint256 hash = SignatureHash(m_coinbase_txns[i]->vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+            BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+            vchSig.push_back((unsigned char)SIGHASH_ALL);
+            tx.vin[0].scriptSig << vchSig;
+            m_txs.push_back(MakeTransactionRef(tx));
+
+            TxValidationState state;
+            BOOST_REQUIRE(AcceptToMemoryPool(*m_node.mempool, state, m_txs.back(), nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */));
+        }
+        m_node.mempool->PrioritiseTransaction(m_txs[0]->GetHash(), 1000);
+        m_node.mempool->PrioritiseTransaction(m_unknown_hash, 2000);
+    }
+
+    // Forget the transactions and prioritisations, as after a restart
+    void ClearMempool()
+    {
+        m_node.mempool->clear();
+        m_node.mempool->ClearPrioritisation(m_txs[0]->GetHash());
+        m_node.mempool->ClearPrioritisation(m_unknown_hash);
+    }
+
+    CAmount Delta(const uint256& hash) const
+    {
+        CAmount delta = 0;
+        m_node.mempool->ApplyDelta(hash, delta);
+        return delta;
+    }
+
+    void CheckLoaded(bool with_deltas)
+    {
+        for (const CTransactionRef& tx : m_txs) {
+            BOOST_CHECK(m_node.mempool->exists(tx->GetHash()));
+        }
+        BOOST_CHECK_EQUAL(m_node.mempool->size(), m_txs.size());
+        BOOST_CHECK_EQUAL(Delta(m_txs[0]->GetHash()), with_deltas ? 1000 : 0);
+        BOOST_CHECK_EQUAL(Delta(m_txs[1]->GetHash()), 0);
+        BOOST_CHECK_EQUAL(Delta(m_unknown_hash), with_deltas ? 2000 : 0);
+    }
+};
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(mempool_persist_tests, MempoolPersistSetup)
+
+BOOST_AUTO_TEST_CASE(mempool_persist_roundtrip)
+{
+    BOOST_REQUIRE(DumpMempool(*m_node.mempool));
+    ClearMempool();
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+
+    BOOST_CHECK(LoadMempool(*m_node.mempool));
+    CheckLoaded(/* with_deltas */ true);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_persist_checksum_mismatch)
+{
+    BOOST_REQUIRE(DumpMempool(*m_node.mempool));
+    ClearMempool();
+
+    // Flip a bit of the checksum at the end of the file
+    FILE* file = fsbridge::fopen(GetDataDir() / "mempool.dat", "r+b");
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fseek(file, -1, SEEK_END), 0);
+    const int last = fgetc(file);
+    BOOST_REQUIRE(last != EOF);
+    BOOST_REQUIRE_EQUAL(fseek(file, -1, SEEK_END), 0);
+    BOOST_REQUIRE(fputc(last ^ 1, file) != EOF);
+    fclose(file);
+
+    // The transactions are validated like any other and still loaded, none
+    // of the prioritisations are.
+    BOOST_CHECK(!LoadMempool(*m_node.mempool));
+    CheckLoaded(/* with_deltas */ false);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_persist_read_v1)
+{
+    // Version 1 files have no checksum
+    {
+        CAutoFile file(fsbridge::fopen(GetDataDir() / "mempool.dat", "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        file << uint64_t{1};
+        file << uint64_t{m_txs.size()};
+        for (const CTransactionRef& tx : m_txs) {
+            file << *tx;
+            file << int64_t{GetTime()};
+            file << int64_t{tx == m_txs[0] ? 1000 : 0};
+        }
+        file << std::map<uint256, CAmount>{{m_unknown_hash, 2000}};
+    }
+    ClearMempool();
+
+    BOOST_CHECK(LoadMempool(*m_node.mempool));
+    CheckLoaded(/* with_deltas */ true);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
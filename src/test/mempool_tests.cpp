@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <core_memusage.h>
 #include <policy/policy.h>
 #include <txmempool.h>
 #include <util/system.h>
@@ -108,6 +109,203 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     BOOST_CHECK_EQUAL(testPool.size(), 0U);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolUsageTest)
+{
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 33000LL;
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 11000LL;
+
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+    BOOST_CHECK_EQUAL(testPool.GetMemoryUsage().Total(), 0U);
+
+    testPool.addUnchecked(entry.FromTx(txParent));
+    testPool.addUnchecked(entry.FromTx(txChild));
+    const MemPoolUsage usage = testPool.GetMemoryUsage();
+    BOOST_CHECK_EQUAL(usage.Total(), testPool.DynamicMemoryUsage());
+    BOOST_CHECK_EQUAL(usage.transactions, RecursiveDynamicUsage(MakeTransactionRef(txParent)) + RecursiveDynamicUsage(MakeTransactionRef(txChild)));
+    BOOST_CHECK(usage.entries > 0);
+    BOOST_CHECK(usage.links > 0);
+    BOOST_CHECK(usage.spends > 0);
+
+    testPool.removeRecursive(CTransaction(txParent), REMOVAL_REASON_DUMMY);
+    BOOST_CHECK_EQUAL(testPool.GetMemoryUsage().transactions, 0U);
+    BOOST_CHECK_EQUAL(testPool.GetMemoryUsage().links, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    TestMemPoolEntryHelper entry;
+    // A parent signalling replaceability, its child and grandchild
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vin[0].nSequence = 0;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 33000LL;
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 22000LL;
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout = COutPoint(txChild.GetHash(), 0);
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 11000LL;
+
+    CTxMemPool testPool;
+    std::shared_ptr<const MempoolSnapshot> empty = testPool.GetSnapshot();
+    BOOST_CHECK(empty->entries.empty());
+    // An unchanged mempool hands out the same snapshot.
+    BOOST_CHECK(testPool.GetSnapshot() == empty);
+
+    {
+        LOCK2(cs_main, testPool.cs);
+        testPool.addUnchecked(entry.Fee(1000LL).FromTx(txParent));
+        testPool.addUnchecked(entry.Fee(2000LL).FromTx(txChild));
+        testPool.addUnchecked(entry.Fee(3000LL).FromTx(txGrandChild));
+    }
+    std::shared_ptr<const MempoolSnapshot> snapshot = testPool.GetSnapshot();
+    BOOST_CHECK(snapshot != empty);
+    BOOST_CHECK(empty->entries.empty());
+    BOOST_CHECK_EQUAL(snapshot->entries.size(), 3U);
+    BOOST_CHECK_EQUAL(snapshot->total_tx_size, testPool.GetTotalTxSize());
+    BOOST_CHECK_EQUAL(snapshot->usage.Total(), testPool.DynamicMemoryUsage());
+    // Parents come first.
+    BOOST_CHECK(snapshot->entries[0].tx->GetHash() == txParent.GetHash());
+    BOOST_CHECK(snapshot->entries[2].tx->GetHash() == txGrandChild.GetHash());
+
+    const MempoolSnapshot::Entry* child = snapshot->Find(txChild.GetHash());
+    BOOST_REQUIRE(child);
+    BOOST_CHECK_EQUAL(child->fee, 2000LL);
+    BOOST_CHECK_EQUAL(child->count_with_ancestors, 2U);
+    BOOST_CHECK_EQUAL(child->mod_fees_with_descendants, 5000LL);
+    BOOST_CHECK(child->bip125_replaceable);
+    BOOST_CHECK_EQUAL(child->parents.size(), 1U);
+    BOOST_CHECK_EQUAL(child->children.size(), 1U);
+    BOOST_CHECK(!snapshot->Find(GetRandHash()));
+
+    const MempoolSnapshot::Entry* parent = snapshot->Find(txParent.GetHash());
+    BOOST_REQUIRE(parent);
+    BOOST_CHECK(snapshot->Ancestors(*parent).empty());
+    std::vector<const MempoolSnapshot::Entry*> descendants = snapshot->Descendants(*parent);
+    BOOST_REQUIRE_EQUAL(descendants.size(), 2U);
+    BOOST_CHECK(descendants[0] == child);
+    BOOST_CHECK(descendants[1]->tx->GetHash() == txGrandChild.GetHash());
+    BOOST_CHECK_EQUAL(snapshot->Ancestors(*descendants[1]).size(), 2U);
+
+    // Prioritising a transaction changes its modified fees, and so the snapshot.
+    testPool.PrioritiseTransaction(txChild.GetHash(), 500LL);
+    std::shared_ptr<const MempoolSnapshot> prioritised = testPool.GetSnapshot();
+    BOOST_CHECK(prioritised != snapshot);
+    BOOST_CHECK_EQUAL(prioritised->Find(txChild.GetHash())->modified_fee, 2500LL);
+    BOOST_CHECK_EQUAL(snapshot->Find(txChild.GetHash())->modified_fee, 2000LL);
+
+    {
+        LOCK(testPool.cs);
+        testPool.removeRecursive(CTransaction(txParent), REMOVAL_REASON_DUMMY);
+    }
+    BOOST_CHECK(testPool.GetSnapshot()->entries.empty());
+    BOOST_CHECK_EQUAL(prioritised->entries.size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolNullifierConflictTest)
+{
+    TestMemPoolEntryHelper entry;
+    const uint256 nullifier = InsecureRand256();
+
+    // Two transactions spending the same Sapling note
+    CMutableTransaction txSpend[2];
+    for (int i = 0; i < 2; i++)
+    {
+        txSpend[i].fOverwintered = true;
+        txSpend[i].nVersion = SAPLING_TX_VERSION;
+        txSpend[i].nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+        txSpend[i].vShieldedSpend.resize(1);
+        txSpend[i].vShieldedSpend[0].nullifier = nullifier;
+        txSpend[i].vout.resize(1);
+        txSpend[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txSpend[i].vout[0].nValue = 10000LL * (i + 1);
+    }
+    BOOST_CHECK(txSpend[0].GetHash() != txSpend[1].GetHash());
+
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+
+    testPool.addUnchecked(entry.FromTx(txSpend[0]));
+    BOOST_CHECK(testPool.HasSaplingNullifier(nullifier));
+    BOOST_CHECK(!testPool.HasSaplingNullifier(InsecureRand256()));
+
+    // A block with the other spend evicts the pool one as a conflict
+    std::vector<CTransactionRef> block{MakeTransactionRef(txSpend[1])};
+    testPool.removeForBlock(block, 1);
+    BOOST_CHECK_EQUAL(testPool.size(), 0U);
+    BOOST_CHECK(!testPool.HasSaplingNullifier(nullifier));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolExpiryHeightTest)
+{
+    TestMemPoolEntryHelper entry;
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+
+    // Transactions expiring after heights 10 and 20, and one that never expires
+    const uint32_t expiry[3] = {10, 20, 0};
+    CMutableTransaction tx[3];
+    for (int i = 0; i < 3; i++)
+    {
+        tx[i].fOverwintered = true;
+        tx[i].nVersion = SAPLING_TX_VERSION;
+        tx[i].nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+        tx[i].nExpiryHeight = expiry[i];
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout.hash = InsecureRand256();
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10000LL;
+        testPool.addUnchecked(entry.FromTx(tx[i]));
+    }
+    // A child of the first transaction goes with it
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(tx[0].GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9000LL;
+    testPool.addUnchecked(entry.FromTx(txChild));
+    BOOST_CHECK_EQUAL(testPool.size(), 4U);
+
+    const std::vector<CTransactionRef> empty_block;
+    testPool.removeForBlock(empty_block, 9);
+    BOOST_CHECK_EQUAL(testPool.size(), 4U);
+    testPool.removeForBlock(empty_block, 10);
+    BOOST_CHECK_EQUAL(testPool.size(), 2U);
+    BOOST_CHECK(!testPool.exists(tx[0].GetHash()));
+    BOOST_CHECK(!testPool.exists(txChild.GetHash()));
+    testPool.removeForBlock(empty_block, 30);
+    BOOST_CHECK_EQUAL(testPool.size(), 1U);
+    BOOST_CHECK(testPool.exists(tx[2].GetHash()));
+}
+
 template<typename name>
 static void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
 {
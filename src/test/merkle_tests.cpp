@@ -231,6 +231,12 @@ BOOST_AUTO_TEST_CASE(merkle_test)
             BOOST_CHECK((newRoot == uint256()) == (ntx == 0));
             BOOST_CHECK(oldMutated == newMutated);
             BOOST_CHECK(newMutated == !!mutate);
+            // Computing the witness root along gives the same roots.
+            bool bothMutated = false;
+            uint256 witnessRoot;
+            BOOST_CHECK(BlockMerkleRoots(block, witnessRoot, &bothMutated) == newRoot);
+            BOOST_CHECK(bothMutated == newMutated);
+            if (ntx > 0) BOOST_CHECK(witnessRoot == BlockWitnessMerkleRoot(block));
             // If no mutation was done (once for every ntx value), try up to 16 branches.
             if (mutate == 0) {
                 for (int loop = 0; loop < std::min(ntx, 16); loop++) {
@@ -349,4 +355,46 @@ BOOST_AUTO_TEST_CASE(merkle_test_BlockWitness)
 
     BOOST_CHECK_EQUAL(merkleRootofHashes, blockWitness);
 }
+BOOST_AUTO_TEST_CASE(merkle_test_large_block)
+{
+    // Levels this large are hashed on several threads
+    for (int ntx : {2 * (int)MERKLE_PAIRS_PER_THREAD, 10000, 16384, 20001}) {
+        CBlock block;
+        block.vtx.resize(ntx);
+        for (int j = 0; j < ntx; j++) {
+            CMutableTransaction mtx;
+            mtx.nLockTime = j;
+            mtx.vin.resize(1);
+            mtx.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(1, j & 0xff));
+            block.vtx[j] = MakeTransactionRef(std::move(mtx));
+        }
+        bool mutated = true;
+        std::vector<uint256> merkleTree;
+        uint256 oldRoot = BlockBuildMerkleTree(block, &mutated, merkleTree);
+        BOOST_CHECK(!mutated);
+
+        std::vector<uint256> witnessLeaves(ntx);
+        for (int j = 1; j < ntx; j++) witnessLeaves[j] = block.vtx[j]->GetWitnessHash();
+        uint256 oldWitnessRoot;
+        MerkleComputation(witnessLeaves, &oldWitnessRoot, nullptr, -1, nullptr);
+
+        mutated = true;
+        uint256 witnessRoot;
+        BOOST_CHECK(BlockMerkleRoots(block, witnessRoot, &mutated) == oldRoot);
+        BOOST_CHECK(!mutated);
+        BOOST_CHECK(witnessRoot == oldWitnessRoot);
+        BOOST_CHECK(witnessRoot != oldRoot);
+        BOOST_CHECK(BlockMerkleRoot(block) == oldRoot);
+        BOOST_CHECK(BlockWitnessMerkleRoot(block) == oldWitnessRoot);
+
+        // Duplicating the last transactions is still found
+        const int duplicate = 1 << ctz(ntx);
+        if (duplicate < ntx) {
+            for (int j = 0; j < duplicate; j++) block.vtx.push_back(block.vtx[ntx - duplicate + j]);
+            BOOST_CHECK(BlockMerkleRoots(block, witnessRoot, &mutated) == oldRoot);
+            BOOST_CHECK(mutated);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
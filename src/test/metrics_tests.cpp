@@ -0,0 +1,62 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <metrics.h>
+#include <protocol.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+BOOST_FIXTURE_TEST_SUITE(metrics_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(labeled_counter)
+{
+    LabeledCounter counter({"a", "b", "other"});
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&counter] {
+            for (int i = 0; i < 1000; i++) {
+                counter.Add("a", 1);
+                counter.Add("unknown", 2);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    counter.Add("b", 5);
+    counter.Add("other", 1);
+
+    const std::vector<std::pair<std::string, uint64_t>> counts = counter.Get();
+    BOOST_REQUIRE_EQUAL(counts.size(), 3U);
+    BOOST_CHECK_EQUAL(counts[0].first, "a");
+    BOOST_CHECK_EQUAL(counts[0].second, 4000U);
+    BOOST_CHECK_EQUAL(counts[1].second, 5U);
+    BOOST_CHECK_EQUAL(counts[2].first, "other");
+    BOOST_CHECK_EQUAL(counts[2].second, 8001U);
+}
+
+BOOST_AUTO_TEST_CASE(metrics_text)
+{
+    NetBytesSentPerMsgType().Add(NetMsgType::PING, 32);
+    const std::string text = GetMetricsText();
+    BOOST_CHECK(text.find("# TYPE litecoinz_net_sent_bytes_total counter\n") != std::string::npos);
+    BOOST_CHECK(text.find("litecoinz_net_sent_bytes_total{type=\"ping\"} ") != std::string::npos);
+    BOOST_CHECK(text.find("litecoinz_validation_seconds_bucket{phase=\"connect_block\",le=\"+Inf\"} ") != std::string::npos);
+    BOOST_CHECK(text.find("litecoinz_validation_seconds_count{phase=\"equihash\"} ") != std::string::npos);
+    BOOST_CHECK(text.find("# TYPE litecoinz_lock_acquisitions_total counter\n") != std::string::npos);
+    // Every line is a comment or a sample with a value
+    size_t start = 0;
+    while (start < text.size()) {
+        const size_t end = text.find('\n', start);
+        BOOST_REQUIRE(end != std::string::npos);
+        const std::string line = text.substr(start, end - start);
+        BOOST_CHECK(line[0] == '#' || line.find(' ') != std::string::npos);
+        start = end + 1;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
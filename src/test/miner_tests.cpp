@@ -10,6 +10,7 @@
 #include <crypto/equihash.h>
 #include <miner.h>
 #include <policy/policy.h>
+#include <scheduler.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -609,4 +610,25 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_FIXTURE_TEST_CASE(BlockTemplateCache_tip, TestChain100Setup)
+{
+    // The scheduler is never serviced, so the cache is only updated here
+    CScheduler scheduler;
+    BlockTemplateCache cache(*m_node.mempool, Params(), scheduler);
+
+    unsigned int transactions_updated;
+    BOOST_CHECK(!cache.Get(WITH_LOCK(cs_main, return ::ChainActive().Tip()), transactions_updated));
+
+    cache.Update();
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    std::shared_ptr<const CBlockTemplate> block_template = cache.Get(tip, transactions_updated);
+    BOOST_REQUIRE(block_template);
+    BOOST_CHECK(block_template->block.hashPrevBlock == tip->GetBlockHash());
+    BOOST_CHECK_EQUAL(transactions_updated, m_node.mempool->GetTransactionsUpdated());
+
+    // A template on a tip that is no longer the active one is not handed out
+    CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    BOOST_CHECK(!cache.Get(WITH_LOCK(cs_main, return ::ChainActive().Tip()), transactions_updated));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include <addrdb.h>
 #include <addrman.h>
+#include <arith_uint256.h>
 #include <clientversion.h>
 #include <test/util/setup_common.h>
 #include <string>
@@ -167,6 +168,43 @@ BOOST_AUTO_TEST_CASE(caddrdb_read_corrupted)
     BOOST_CHECK(addrman2.size() == 0);
 }
 
+BOOST_AUTO_TEST_CASE(caddrdb_banlist_file_roundtrip)
+{
+    CAddrMan addrman;
+    CService addr, source;
+    BOOST_CHECK(Lookup("250.7.1.1", addr, 29333, false));
+    BOOST_CHECK(Lookup("252.5.1.1", source, 29333, false));
+    BOOST_CHECK(addrman.Add(CAddress(addr, NODE_NONE), source));
+
+    // The files are written and read back whole
+    CAddrDB adb;
+    BOOST_CHECK(adb.Write(addrman));
+    CAddrMan addrman2;
+    BOOST_CHECK(adb.Read(addrman2));
+    BOOST_CHECK_EQUAL(addrman2.size(), 1U);
+
+    banmap_t bans;
+    for (int i = 0; i < 1000; i++) {
+        CNetAddr ip;
+        BOOST_CHECK(LookupHost(strprintf("10.%d.%d.1", i / 256, i % 256), ip, false));
+        bans[CSubNet(ip)] = CBanEntry(i);
+    }
+    CBanDB bandb(GetDataDir() / "banlist.dat");
+    BOOST_CHECK(bandb.Write(bans));
+    banmap_t bans2;
+    BOOST_CHECK(bandb.Read(bans2));
+    BOOST_CHECK_EQUAL(bans2.size(), bans.size());
+    BOOST_CHECK_EQUAL(bans2.begin()->second.nCreateTime, bans.begin()->second.nCreateTime);
+
+    // A corrupted file fails the checksum
+    FILE* file = fsbridge::fopen(GetDataDir() / "banlist.dat", "r+b");
+    BOOST_REQUIRE(file != nullptr);
+    fseek(file, 10, SEEK_SET);
+    fputc(0xff, file);
+    fclose(file);
+    BOOST_CHECK(!bandb.Read(bans2));
+}
+
 BOOST_AUTO_TEST_CASE(cnode_simple_test)
 {
     SOCKET hSocket = INVALID_SOCKET;
@@ -319,4 +357,62 @@ BOOST_AUTO_TEST_CASE(PoissonNextSend)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(shared_payload_header)
+{
+    const std::vector<unsigned char> payload{1, 2, 3, 4, 5};
+    V1TransportSerializer serializer;
+
+    CSerializedNetMsg owned;
+    owned.command = "ping";
+    owned.data = payload;
+    std::vector<unsigned char> owned_header;
+    serializer.prepareForTransport(owned, owned_header);
+
+    CSerializedNetMsg shared("ping", std::make_shared<const CSharedNetPayload>(std::vector<unsigned char>(payload)));
+    BOOST_CHECK_EQUAL(shared.PayloadSize(), payload.size());
+    std::vector<unsigned char> shared_header;
+    serializer.prepareForTransport(shared, shared_header);
+
+    BOOST_CHECK(owned_header == shared_header);
+
+    CSendBuffer buffer(shared.shared_payload);
+    BOOST_CHECK_EQUAL(buffer.size(), payload.size());
+    BOOST_CHECK(buffer.data() == shared.shared_payload->data.data());
+}
+
+static int ReadBlockMessage(const CBlock& block)
+{
+    CDataStream payload(SER_NETWORK, PROTOCOL_VERSION);
+    payload << block;
+    CDataStream message(SER_NETWORK, PROTOCOL_VERSION);
+    message << CMessageHeader(Params().MessageStart(), NetMsgType::BLOCK, payload.size());
+    message.write(payload.data(), payload.size());
+
+    V1TransportDeserializer deserializer(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    const char* pch = message.data();
+    unsigned int nBytes = message.size();
+    while (nBytes > 0 && !deserializer.Complete()) {
+        // feed the message in small pieces, as it would arrive
+        int handled = deserializer.Read(pch, std::min(nBytes, 100u));
+        if (handled < 0) return handled;
+        pch += handled;
+        nBytes -= handled;
+    }
+    return deserializer.Complete() ? 1 : 0;
+}
+
+BOOST_AUTO_TEST_CASE(block_message_header_check)
+{
+    CBlock block = Params().GenesisBlock();
+    BOOST_CHECK_EQUAL(ReadBlockMessage(block), 1);
+
+    // the solution no longer matches the header
+    block.nNonce = ArithToUint256(UintToArith256(block.nNonce) + 1);
+    BOOST_CHECK_EQUAL(ReadBlockMessage(block), -1);
+
+    block = Params().GenesisBlock();
+    block.nSolution.resize(block.nSolution.size() - 1);
+    BOOST_CHECK_EQUAL(ReadBlockMessage(block), -1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,77 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/util/setup_common.h>
+#include <util/notify.h>
+#include <util/system.h>
+
+#include <boost/test/unit_test.hpp>
+
+#ifndef WIN32
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+BOOST_FIXTURE_TEST_SUITE(notify_tests, BasicTestingSetup)
+
+#ifndef WIN32
+//! Connect to the notification socket at path
+static int ConnectNotifySocket(const fs::path& path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.string().c_str(), sizeof(addr.sun_path) - 1);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    BOOST_REQUIRE(fd >= 0);
+    BOOST_REQUIRE_EQUAL(connect(fd, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    return fd;
+}
+
+//! Read what the node wrote to fd so far, up to size bytes
+static std::string ReadNotifications(int fd, size_t size)
+{
+    std::string received;
+    char buf[256];
+    while (received.size() < size) {
+        const ssize_t n = read(fd, buf, std::min(sizeof(buf), size - received.size()));
+        if (n <= 0) break;
+        received.append(buf, n);
+    }
+    return received;
+}
+
+BOOST_AUTO_TEST_CASE(notify_socket)
+{
+    // The data directory may be too deep for the length of a socket address.
+    const fs::path path = fs::temp_directory_path() / strprintf("notify_tests_%08x.sock", InsecureRand32());
+    std::string error;
+    BOOST_REQUIRE(StartNotifications(0, path, error));
+
+    // Nothing is connected yet.
+    SendNotification("block 00");
+
+    const int first = ConnectNotifySocket(path);
+    SendNotification("block 01");
+    const int second = ConnectNotifySocket(path);
+    SendNotification("wallet 02 test");
+
+    BOOST_CHECK_EQUAL(ReadNotifications(first, 24), "block 01\nwallet 02 test\n");
+    BOOST_CHECK_EQUAL(ReadNotifications(second, 15), "wallet 02 test\n");
+
+    StopNotifications();
+    BOOST_CHECK(!fs::exists(path));
+    close(first);
+    close(second);
+
+    // A path that does not fit a socket address is refused.
+    BOOST_CHECK(!StartNotifications(0, fs::temp_directory_path() / std::string(200, 'x'), error));
+    BOOST_CHECK(!error.empty());
+    StopNotifications();
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,190 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/nullifierindex.h>
+#include <proofcache.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+/** Wait for the index to catch up with the active chain. */
+void WaitForSync(const NullifierIndex& index)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+}
+
+/**
+ * Mine a block with the Sapling transaction tx. Its proofs are made up, so
+ * they are marked as valid in the proof cache for ConnectBlock to skip them.
+ */
+CBlock CreateAndProcessShieldedBlock(TestChain100Setup& setup, const CMutableTransaction& tx)
+{
+    const int height = WITH_LOCK(cs_main, return ::ChainActive().Height() + 1);
+    ProofCacheAdd(CTransaction(tx).GetHash(), ShieldedProofType::SAPLING, Params().GetConsensus().BranchId(height));
+    CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(setup.coinbaseKey.GetPubKey()));
+    return setup.CreateAndProcessBlock({tx}, coinbase_script_pub_key);
+}
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(nullifierindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(nullifier_location_serialization, BasicTestingSetup)
+{
+    NullifierLocation location;
+    location.nHeight = 123456;
+    location.hashBlock = InsecureRand256();
+    location.txid = InsecureRand256();
+    location.nSpend = 7;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << location;
+    NullifierLocation read;
+    ss >> read;
+    BOOST_CHECK_EQUAL(read.nHeight, location.nHeight);
+    BOOST_CHECK(read.hashBlock == location.hashBlock);
+    BOOST_CHECK(read.txid == location.txid);
+    BOOST_CHECK_EQUAL(read.nSpend, location.nSpend);
+    BOOST_CHECK(ss.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(nullifier_index_initial_sync, TestChain100Setup)
+{
+    NullifierIndex index(1 << 20, true);
+
+    // BlockUntilSyncedToCurrentChain should return false before the index is started.
+    BOOST_CHECK(!index.BlockUntilSyncedToCurrentChain());
+
+    index.Start();
+
+    // Allow the index to catch up with the block index.
+    WaitForSync(index);
+
+    // The test chain has no shielded transactions, so nothing is found.
+    const std::vector<uint256> hashes{InsecureRand256(), InsecureRand256()};
+    std::vector<Optional<NullifierLocation>> nullifiers;
+    index.FindNullifiers(hashes, nullifiers);
+    BOOST_REQUIRE_EQUAL(nullifiers.size(), hashes.size());
+    for (const auto& location : nullifiers) BOOST_CHECK(!location);
+    std::vector<Optional<CommitmentLocation>> commitments;
+    index.FindCommitments(hashes, commitments);
+    BOOST_REQUIRE_EQUAL(commitments.size(), hashes.size());
+    for (const auto& location : commitments) BOOST_CHECK(!location);
+
+    // New blocks keep the index in sync.
+    for (int i = 0; i < 10; i++) {
+        CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+        std::vector<CMutableTransaction> no_txns;
+        CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+        BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+    }
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    index.Stop();
+
+    // index job may be scheduled, so stop scheduler before destructing
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_FIXTURE_TEST_CASE(nullifier_index_lookup_and_reorg, TestChain100Setup)
+{
+    NullifierIndex index(1 << 20, true);
+    index.Start();
+    WaitForSync(index);
+
+    // A transaction spending a note anchored to the empty tree, which is the
+    // one at the end of every block of the test chain, and creating two notes
+    CMutableTransaction mtx;
+    mtx.fOverwintered = true;
+    mtx.nVersion = SAPLING_TX_VERSION;
+    mtx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    SpendDescription spend;
+    spend.anchor = SaplingMerkleTree::empty_root();
+    spend.nullifier = InsecureRand256();
+    mtx.vShieldedSpend.push_back(spend);
+    for (int i = 0; i < 2; i++) {
+        OutputDescription output;
+        output.cm = InsecureRand256();
+        mtx.vShieldedOutput.push_back(output);
+    }
+    const uint256 txid = CTransaction(mtx).GetHash();
+    const std::vector<uint256> nullifiers{spend.nullifier};
+    const std::vector<uint256> cmus{mtx.vShieldedOutput[0].cm, mtx.vShieldedOutput[1].cm};
+
+    const CBlock block = CreateAndProcessShieldedBlock(*this, mtx);
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()) == block.GetHash());
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+
+    std::vector<Optional<NullifierLocation>> nullifier_locations;
+    std::vector<Optional<CommitmentLocation>> commitment_locations;
+    index.FindNullifiers(nullifiers, nullifier_locations);
+    BOOST_REQUIRE(nullifier_locations[0]);
+    BOOST_CHECK_EQUAL(nullifier_locations[0]->nHeight, 101);
+    BOOST_CHECK(nullifier_locations[0]->hashBlock == block.GetHash());
+    BOOST_CHECK(nullifier_locations[0]->txid == txid);
+    BOOST_CHECK_EQUAL(nullifier_locations[0]->nSpend, 0U);
+    index.FindCommitments(cmus, commitment_locations);
+    for (size_t i = 0; i < cmus.size(); i++) {
+        BOOST_REQUIRE(commitment_locations[i]);
+        BOOST_CHECK_EQUAL(commitment_locations[i]->nHeight, 101);
+        BOOST_CHECK(commitment_locations[i]->hashBlock == block.GetHash());
+        BOOST_CHECK_EQUAL(commitment_locations[i]->nPosition, i);
+    }
+
+    // Reorganize the block out of the chain. The index rewinds to the fork
+    // point when it connects the first block of the new chain.
+    {
+        CBlockIndex* pindex = WITH_LOCK(cs_main, return LookupBlockIndex(block.GetHash()));
+        BlockValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, Params(), pindex));
+    }
+    CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    for (int i = 0; i < 2; i++) {
+        CreateAndProcessBlock({}, coinbase_script_pub_key);
+    }
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+    index.FindNullifiers(nullifiers, nullifier_locations);
+    BOOST_CHECK(!nullifier_locations[0]);
+    index.FindCommitments(cmus, commitment_locations);
+    for (const auto& location : commitment_locations) BOOST_CHECK(!location);
+
+    // The same transaction is valid again on the new chain. Its notes are
+    // again the first ones of the tree, as the tree size was rewound too.
+    const CBlock reorg_block = CreateAndProcessShieldedBlock(*this, mtx);
+    BOOST_REQUIRE(WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()) == reorg_block.GetHash());
+    BOOST_REQUIRE(index.BlockUntilSyncedToCurrentChain());
+    index.FindNullifiers(nullifiers, nullifier_locations);
+    BOOST_REQUIRE(nullifier_locations[0]);
+    BOOST_CHECK_EQUAL(nullifier_locations[0]->nHeight, 103);
+    BOOST_CHECK(nullifier_locations[0]->hashBlock == reorg_block.GetHash());
+    BOOST_CHECK(nullifier_locations[0]->txid == txid);
+    index.FindCommitments(cmus, commitment_locations);
+    for (size_t i = 0; i < cmus.size(); i++) {
+        BOOST_REQUIRE(commitment_locations[i]);
+        BOOST_CHECK_EQUAL(commitment_locations[i]->nHeight, 103);
+        BOOST_CHECK(commitment_locations[i]->hashBlock == reorg_block.GetHash());
+        BOOST_CHECK_EQUAL(commitment_locations[i]->nPosition, i);
+    }
+
+    index.Stop();
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -73,6 +73,13 @@ BOOST_AUTO_TEST_CASE(pmt_test1)
             CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
             ss << pmt1;
 
+            // building from the levels of the tree gives the same tree
+            const std::vector<std::vector<uint256>> vLevels = CPartialMerkleTree::CalcLevels(vTxid);
+            BOOST_CHECK(vLevels.back().size() == 1 && vLevels.back()[0] == merkleRoot1);
+            CDataStream ssLevels(SER_NETWORK, PROTOCOL_VERSION);
+            ssLevels << CPartialMerkleTree(vLevels, vMatch);
+            BOOST_CHECK(ssLevels.str() == ss.str());
+
             // verify CPartialMerkleTree's size guarantees
             unsigned int n = std::min<unsigned int>(nTx, 1 + vMatchTxid1.size()*nHeight);
             BOOST_CHECK(ss.size() <= 10 + (258*n+7)/8);
@@ -4,7 +4,9 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <crypto/equihash.h>
 #include <pow.h>
+#include <streams.h>
 #include <test/util/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
@@ -159,4 +161,51 @@ BOOST_AUTO_TEST_CASE(LwmaCalculateNextWorkRequired_test)
     BOOST_CHECK_EQUAL(bits, 0x1d010084);
 }
 
+BOOST_AUTO_TEST_CASE(CheckEquihashSolution_test_height)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    CBlockHeader header = chainParams->GenesisBlock().GetBlockHeader();
+
+    BOOST_CHECK(CheckEquihashSolution(&header));
+    BOOST_CHECK(CheckEquihashSolution(&header, 0, params));
+    // A 200/9 solution is not acceptable once the chain switched to 144/5
+    BOOST_CHECK(!CheckEquihashSolution(&header, params.nEquihashForkHeight, params));
+
+    header.nNonce = ArithToUint256(UintToArith256(header.nNonce) + 1);
+    BOOST_CHECK(!CheckEquihashSolution(&header));
+    BOOST_CHECK(!CheckEquihashSolution(&header, 0, params));
+}
+
+BOOST_AUTO_TEST_CASE(FixedIsValidSolution_matches_basic)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const CBlockHeader header = chainParams->GenesisBlock().GetBlockHeader();
+
+    eh_HashState state;
+    Eh200_9.InitialiseState(state);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CEquihashInput{header} << header.nNonce;
+    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+    CBLAKE2b batch_state;
+    Eh200_9.InitialiseState(batch_state);
+    batch_state.Write((unsigned char*)&ss[0], ss.size());
+
+    std::vector<unsigned char> soln = header.nSolution;
+    BOOST_CHECK(Eh200_9.BasicIsValidSolution(state, soln));
+    BOOST_CHECK(Eh200_9.FixedIsValidSolution(state, soln));
+    BOOST_CHECK(Eh200_9.FixedIsValidSolution(batch_state, soln));
+
+    for (int i = 0; i < 200; i++) {
+        std::vector<unsigned char> mutated = soln;
+        mutated[InsecureRandRange(mutated.size())] ^= 1 << InsecureRandRange(8);
+        BOOST_CHECK_EQUAL(Eh200_9.BasicIsValidSolution(state, mutated), Eh200_9.FixedIsValidSolution(state, mutated));
+        BOOST_CHECK_EQUAL(Eh200_9.BasicIsValidSolution(state, mutated), Eh200_9.FixedIsValidSolution(batch_state, mutated));
+    }
+
+    soln.pop_back();
+    BOOST_CHECK(!Eh200_9.FixedIsValidSolution(state, soln));
+    BOOST_CHECK(!Eh200_9.FixedIsValidSolution(batch_state, soln));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,34 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <proofcache.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(proofcache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(proofcache_lookup)
+{
+    const uint256 txid = InsecureRand256();
+    const ProofCacheStats before = GetProofCacheStats();
+    BOOST_CHECK(before.max_elements > 0);
+
+    BOOST_CHECK(!ProofCacheContains(txid, ShieldedProofType::SPROUT, 0, false));
+    ProofCacheAdd(txid, ShieldedProofType::SPROUT, 0);
+    BOOST_CHECK(ProofCacheContains(txid, ShieldedProofType::SPROUT, 0, false));
+
+    // Entries are specific to the proof type and index
+    BOOST_CHECK(!ProofCacheContains(txid, ShieldedProofType::SPROUT, 1, false));
+    BOOST_CHECK(!ProofCacheContains(txid, ShieldedProofType::SAPLING, 0, false));
+
+    // An erasing lookup still reports the hit
+    BOOST_CHECK(ProofCacheContains(txid, ShieldedProofType::SPROUT, 0, true));
+
+    const ProofCacheStats after = GetProofCacheStats();
+    BOOST_CHECK_EQUAL(after.hits - before.hits, 2U);
+    BOOST_CHECK_EQUAL(after.misses - before.misses, 3U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
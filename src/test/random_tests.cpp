@@ -10,6 +10,8 @@
 
 #include <random>
 #include <algorithm>
+#include <set>
+#include <thread>
 
 BOOST_FIXTURE_TEST_SUITE(random_tests, BasicTestingSetup)
 
@@ -62,6 +64,41 @@ BOOST_AUTO_TEST_CASE(fastrandom_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(thread_random_context)
+{
+    // With the mock, the thread context gives what GetRand does
+    g_mock_deterministic_tests = true;
+    for (int i = 10; i > 0; --i) {
+        BOOST_CHECK_EQUAL(GetFastRand(std::numeric_limits<uint64_t>::max()), uint64_t{10393729187455219830U});
+    }
+    g_mock_deterministic_tests = false;
+    const uint64_t first = GetFastRand(std::numeric_limits<uint64_t>::max());
+    BOOST_CHECK(first != uint64_t{10393729187455219830U});
+    BOOST_CHECK(GetFastRand(std::numeric_limits<uint64_t>::max()) != first);
+
+    // Keep drawing across reseeds
+    std::set<uint64_t> values;
+    for (unsigned int i = 0; i < 2 * THREAD_RANDOM_RESEED_USES + 1; ++i) {
+        const uint64_t value = GetFastRand(std::numeric_limits<uint64_t>::max());
+        BOOST_CHECK(value != first);
+        values.insert(value);
+        BOOST_CHECK(GetFastRandMicros(std::chrono::seconds{1}) < std::chrono::seconds{1});
+    }
+    BOOST_CHECK_EQUAL(values.size(), 2 * THREAD_RANDOM_RESEED_USES + 1);
+
+    // Each thread has a context of its own
+    const FastRandomContext* here = &GetThreadRandomContext();
+    const FastRandomContext* there = nullptr;
+    uint64_t value_there = 0;
+    std::thread thread([&] {
+        there = &GetThreadRandomContext();
+        value_there = GetFastRand(std::numeric_limits<uint64_t>::max());
+    });
+    thread.join();
+    BOOST_CHECK(there != here);
+    BOOST_CHECK(values.count(value_there) == 0);
+}
+
 BOOST_AUTO_TEST_CASE(fastrandom_randbits)
 {
     FastRandomContext ctx1;
@@ -9,8 +9,11 @@
 #include <core_io.h>
 #include <interfaces/chain.h>
 #include <node/context.h>
+#include <rpc/jsonstream.h>
 #include <test/util/setup_common.h>
+#include <util/system.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/test/unit_test.hpp>
@@ -312,6 +315,97 @@ BOOST_AUTO_TEST_CASE(rpc_ban)
     BOOST_CHECK_EQUAL(adr.get_str(), "2001:4d48:ac57:400:cacf:e9ff:fe1d:9c63/128");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_batch_parallel)
+{
+    if (RPCIsInWarmup(nullptr)) SetRPCWarmupFinished();
+    const std::string genesis = ::ChainActive().Genesis()->GetBlockHash().GetHex();
+    UniValue batch(UniValue::VARR);
+    for (int i = 0; i < 20; i++) {
+        batch.push_back(JSONRPCRequestObj("getblock", ParseNonRFCJSONValue("[\"" + genesis + "\", " + ToString(i % 3) + "]"), i));
+        batch.push_back(JSONRPCRequestObj("gettxout", ParseNonRFCJSONValue("[\"" + genesis + "\", " + ToString(i) + "]"), i));
+        if (i % 5 == 0) batch.push_back(JSONRPCRequestObj("getblockcount", NullUniValue, i));
+    }
+    // An error does not stop the other calls
+    batch.push_back(JSONRPCRequestObj("getblock", ParseNonRFCJSONValue("[\"00\"]"), 20));
+    batch.push_back(JSONRPCRequestObj("getblock", ParseNonRFCJSONValue("[\"" + genesis + "\"]"), 21));
+
+    JSONRPCRequest jreq;
+    const std::string serial = JSONRPCExecBatch(jreq, batch);
+    gArgs.ForceSetArg("-rpcbatchthreads", "3");
+    StartRPC();
+    const std::string parallel = JSONRPCExecBatch(jreq, batch);
+    StopRPC();
+    gArgs.ForceSetArg("-rpcbatchthreads", "0");
+    BOOST_CHECK_EQUAL(serial, parallel);
+
+    UniValue results;
+    BOOST_REQUIRE(results.read(parallel));
+    BOOST_CHECK_EQUAL(results.size(), batch.size());
+    BOOST_CHECK(!find_value(results[results.size() - 2], "error").isNull());
+    BOOST_CHECK(find_value(results[results.size() - 1], "error").isNull());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_stream)
+{
+    UniValue inner(UniValue::VOBJ);
+    inner.pushKV("a\"b", 1);
+    inner.pushKV("list", ParseNonRFCJSONValue("[1, \"two\", null, {}]"));
+    UniValue expected(UniValue::VOBJ);
+    expected.pushKV("first", "value");
+    expected.pushKV("array", ParseNonRFCJSONValue("[]"));
+    expected.pushKV("inner", inner);
+    expected.pushKV("more", ParseNonRFCJSONValue("[[], {\"x\": true}, 3.5]"));
+
+    // Small chunks, to check they are passed on in one piece each
+    std::string output;
+    size_t chunks = 0;
+    JSONStreamWriter stream([&](const std::string& chunk) { output += chunk; chunks++; }, 8);
+    BOOST_CHECK(!stream.Started());
+    stream.Raw("<");
+    stream.BeginObject();
+    BOOST_CHECK(stream.Started());
+    stream.KV("first", "value");
+    stream.Key("array");
+    stream.BeginArray();
+    stream.EndArray();
+    stream.Key("inner");
+    stream.BeginObject();
+    stream.Fields(inner);
+    stream.EndObject();
+    stream.Key("more");
+    stream.BeginArray();
+    stream.BeginArray();
+    stream.EndArray();
+    stream.Value(ParseNonRFCJSONValue("{\"x\": true}"));
+    stream.Value(3.5);
+    stream.EndArray();
+    stream.EndObject();
+    stream.Raw(">");
+    stream.Flush();
+    BOOST_CHECK_EQUAL(output, "<" + expected.write() + ">");
+    BOOST_CHECK(chunks > 1);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_getblock_stream)
+{
+    if (RPCIsInWarmup(nullptr)) SetRPCWarmupFinished();
+    const std::string genesis = ::ChainActive().Genesis()->GetBlockHash().GetHex();
+    for (int verbosity = 1; verbosity <= 2; verbosity++) {
+        JSONRPCRequest request;
+        request.strMethod = "getblock";
+        request.params = ParseNonRFCJSONValue("[\"" + genesis + "\", " + ToString(verbosity) + "]");
+        const std::string expected = tableRPC.execute(request).write();
+
+        std::string output;
+        JSONStreamWriter stream([&](const std::string& chunk) { output += chunk; });
+        request.stream = &stream;
+        BOOST_CHECK(tableRPC.execute(request).isNull());
+        stream.Flush();
+        BOOST_CHECK(stream.Started());
+        BOOST_CHECK_EQUAL(output, expected);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
 {
     UniValue result;
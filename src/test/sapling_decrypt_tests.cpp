@@ -0,0 +1,168 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <test/util/setup_common.h>
+#include <zcash/Note.hpp>
+#include <zcash/NoteEncryption.hpp>
+#include <zcash/address/sapling.hpp>
+
+#include <librustzcash.h>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace libzcash;
+
+namespace {
+struct TrialOutput {
+    SaplingEncCiphertext ciphertext;
+    uint256 epk;
+    uint256 cmu;
+};
+
+TrialOutput MakeOutput(const SaplingPaymentAddress& address, uint64_t value)
+{
+    SaplingNote note(address, value);
+    SaplingNotePlaintext plaintext(note, {{0xF6}});
+    auto enc = plaintext.encrypt(note.pk_d);
+    BOOST_REQUIRE(enc);
+    return {enc->first, enc->second.get_epk(), note.cm().get()};
+}
+
+/** Random bytes that do not encode a Jubjub point */
+uint256 InvalidPoint(const uint256& ivk)
+{
+    uint256 point, dhsecret;
+    do {
+        point = InsecureRand256();
+    } while (librustzcash_sapling_ka_agree(point.begin(), ivk.begin(), dhsecret.begin()));
+    return point;
+}
+
+/** A scalar above the Jubjub scalar field modulus */
+uint256 InvalidScalar()
+{
+    uint256 scalar;
+    memset(scalar.begin(), 0xff, scalar.size());
+    return scalar;
+}
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(sapling_decrypt_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(key_agree_batch_matches_single)
+{
+    std::vector<uint256> ivks;
+    for (int i = 0; i < 3; i++) {
+        ivks.push_back(SaplingSpendingKey::random().full_viewing_key().in_viewing_key());
+    }
+    ivks.insert(ivks.begin() + 1, InvalidScalar());
+
+    const SaplingPaymentAddress address = SaplingSpendingKey::random().default_address();
+    std::vector<uint256> epks;
+    for (int i = 0; i < 4; i++) {
+        epks.push_back(MakeOutput(address, 1000 + i).epk);
+    }
+    // Invalid points first, last and in the middle
+    epks.insert(epks.begin(), InvalidPoint(ivks[0]));
+    epks.insert(epks.begin() + 3, InvalidPoint(ivks[0]));
+    epks.push_back(InvalidPoint(ivks[0]));
+
+    const std::vector<Optional<uint256>> secrets = SaplingKeyAgreeBatch(epks, ivks);
+    BOOST_REQUIRE_EQUAL(secrets.size(), epks.size() * ivks.size());
+    size_t valid = 0;
+    for (size_t i = 0; i < epks.size(); i++) {
+        for (size_t j = 0; j < ivks.size(); j++) {
+            uint256 dhsecret;
+            const bool ok = librustzcash_sapling_ka_agree(epks[i].begin(), ivks[j].begin(), dhsecret.begin());
+            const Optional<uint256>& secret = secrets[i * ivks.size() + j];
+            BOOST_CHECK_EQUAL(bool(secret), ok);
+            if (ok && secret) {
+                BOOST_CHECK(*secret == dhsecret);
+                valid++;
+            }
+        }
+    }
+    // Only the pairs of valid points and valid scalars agree.
+    BOOST_CHECK_EQUAL(valid, 4U * 3U);
+
+    BOOST_CHECK(SaplingKeyAgreeBatch({}, ivks).empty());
+    BOOST_CHECK(SaplingKeyAgreeBatch(epks, {}).empty());
+}
+
+BOOST_AUTO_TEST_CASE(trial_decrypt_batch_matches_single)
+{
+    std::vector<SaplingIncomingViewingKey> ivks;
+    std::vector<SaplingPaymentAddress> addresses;
+    for (int i = 0; i < 3; i++) {
+        SaplingSpendingKey sk = SaplingSpendingKey::random();
+        ivks.push_back(sk.full_viewing_key().in_viewing_key());
+        addresses.push_back(sk.default_address());
+    }
+    ivks.insert(ivks.begin() + 1, InvalidScalar());
+    const SaplingPaymentAddress other = SaplingSpendingKey::random().default_address();
+
+    // Notes to each of the keys and to none of them, some of them twice, with
+    // outputs that cannot be decrypted mixed in.
+    std::vector<TrialOutput> outputs;
+    for (int i = 0; i < 30; i++) {
+        switch (i % 6) {
+        case 0:
+            outputs.push_back(MakeOutput(other, i));
+            break;
+        case 1: {
+            TrialOutput output = MakeOutput(addresses[i % 3], i);
+            output.epk = InvalidPoint(ivks[0]);
+            outputs.push_back(output);
+            break;
+        }
+        case 2: {
+            TrialOutput output = MakeOutput(addresses[i % 3], i);
+            output.ciphertext[InsecureRandRange(output.ciphertext.size())] ^= 1;
+            outputs.push_back(output);
+            break;
+        }
+        case 3: {
+            // Decrypts, but to a note with another commitment
+            TrialOutput output = MakeOutput(addresses[i % 3], i);
+            output.cmu = MakeOutput(addresses[i % 3], i).cmu;
+            outputs.push_back(output);
+            break;
+        }
+        default:
+            outputs.push_back(MakeOutput(addresses[i % 3], i));
+        }
+    }
+    std::vector<SaplingTrialOutput> refs;
+    for (const TrialOutput& output : outputs) {
+        refs.push_back({&output.ciphertext, &output.epk, &output.cmu});
+    }
+
+    std::vector<SaplingTrialDecryption> expected;
+    for (size_t i = 0; i < outputs.size(); i++) {
+        for (size_t j = 0; j < ivks.size(); j++) {
+            auto pt = SaplingNotePlaintext::decrypt(outputs[i].ciphertext, ivks[j], outputs[i].epk, outputs[i].cmu);
+            if (pt) expected.push_back({i, j, *pt});
+        }
+    }
+    BOOST_REQUIRE_EQUAL(expected.size(), 10U);
+
+    // One thread, more threads than outputs, and one per core
+    for (int threads : {1, 4, 64, 0}) {
+        const std::vector<SaplingTrialDecryption> found = TrialDecryptSaplingOutputs(refs, ivks, threads);
+        BOOST_REQUIRE_EQUAL(found.size(), expected.size());
+        for (size_t k = 0; k < expected.size(); k++) {
+            BOOST_CHECK_EQUAL(found[k].output, expected[k].output);
+            BOOST_CHECK_EQUAL(found[k].ivk, expected[k].ivk);
+            BOOST_CHECK_EQUAL(found[k].plaintext.value(), expected[k].plaintext.value());
+            BOOST_CHECK(found[k].plaintext.d == expected[k].plaintext.d);
+            BOOST_CHECK(found[k].plaintext.rcm == expected[k].plaintext.rcm);
+            BOOST_CHECK(found[k].plaintext.memo() == expected[k].plaintext.memo());
+        }
+    }
+
+    BOOST_CHECK(TrialDecryptSaplingOutputs({}, ivks).empty());
+    BOOST_CHECK(TrialDecryptSaplingOutputs(refs, {}).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
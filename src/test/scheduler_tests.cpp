@@ -160,6 +160,28 @@ BOOST_AUTO_TEST_CASE(singlethreadedscheduler_ordered)
     BOOST_CHECK_EQUAL(counter2, 100);
 }
 
+BOOST_AUTO_TEST_CASE(task_stats)
+{
+    CScheduler scheduler;
+    const std::chrono::milliseconds long_task{300};
+
+    // With a second thread, a long task does not delay the next one
+    scheduler.scheduleFromNow([&] { UninterruptibleSleep(long_task); }, std::chrono::milliseconds{0});
+    scheduler.scheduleFromNow([] {}, std::chrono::milliseconds{10});
+    scheduler.stop(true);
+    std::thread thread1([&] { scheduler.serviceQueue(); });
+    std::thread thread2([&] { scheduler.serviceQueue(); });
+    thread1.join();
+    thread2.join();
+
+    const CScheduler::Stats stats = scheduler.GetStats();
+    BOOST_CHECK_EQUAL(stats.tasks_run, 2U);
+    BOOST_CHECK_EQUAL(stats.threads, 0);
+    BOOST_CHECK(stats.max_runtime >= long_task);
+    BOOST_CHECK(stats.total_runtime >= stats.max_runtime);
+    BOOST_CHECK(stats.max_delay < long_task);
+}
+
 BOOST_AUTO_TEST_CASE(mockforward)
 {
     CScheduler scheduler;
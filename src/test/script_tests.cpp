@@ -1153,6 +1153,92 @@ BOOST_AUTO_TEST_CASE(script_CHECKMULTISIG23)
     BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_INVALID_STACK_OPERATION, ScriptErrorString(err));
 }
 
+BOOST_AUTO_TEST_CASE(script_pubkeyhash_fast_path)
+{
+    // VerifyScript spends these without the interpreter, and must fail them exactly as the interpreter does
+    ScriptError err;
+    CKey key, other;
+    key.MakeNewKey(true);
+    other.MakeNewKey(true);
+    const unsigned int witness_flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS;
+    const unsigned int strict_flags = witness_flags | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_MINIMALDATA |
+                                      SCRIPT_VERIFY_NULLFAIL | SCRIPT_VERIFY_CLEANSTACK | SCRIPT_VERIFY_WITNESS_PUBKEYTYPE;
+
+    const CScript p2pkh = GetScriptForDestination(PKHash(key.GetPubKey()));
+    const CTransaction txFrom{BuildCreditingTransaction(p2pkh)};
+    CMutableTransaction txTo = BuildSpendingTransaction(CScript(), CScriptWitness(), txFrom);
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(SignatureHash(p2pkh, txTo, 0, SIGHASH_ALL, 0, SigVersion::BASE), vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    const std::vector<unsigned char> vchPubKey = ToByteVector(key.GetPubKey());
+    MutableTransactionSignatureChecker checker(&txTo, 0, txFrom.vout[0].nValue);
+
+    CScript scriptSig = CScript() << vchSig << vchPubKey;
+    for (unsigned int flags : {0U, gFlags, strict_flags}) {
+        BOOST_CHECK(VerifyScript(scriptSig, p2pkh, nullptr, flags, checker, &err));
+        BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+    }
+
+    scriptSig = CScript() << vchSig << ToByteVector(other.GetPubKey());
+    BOOST_CHECK(!VerifyScript(scriptSig, p2pkh, nullptr, strict_flags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_EQUALVERIFY, ScriptErrorString(err));
+
+    // A push that is not minimal is only an error with MINIMALDATA
+    scriptSig = CScript() << vchSig;
+    scriptSig.push_back(OP_PUSHDATA1);
+    scriptSig.push_back((unsigned char)vchPubKey.size());
+    scriptSig.insert(scriptSig.end(), vchPubKey.begin(), vchPubKey.end());
+    BOOST_CHECK(VerifyScript(scriptSig, p2pkh, nullptr, gFlags, checker, &err));
+    BOOST_CHECK(!VerifyScript(scriptSig, p2pkh, nullptr, strict_flags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_MINIMALDATA, ScriptErrorString(err));
+
+    // So is anything left on the stack with CLEANSTACK
+    scriptSig = CScript() << OP_1 << vchSig << vchPubKey;
+    BOOST_CHECK(VerifyScript(scriptSig, p2pkh, nullptr, gFlags, checker, &err));
+    BOOST_CHECK(!VerifyScript(scriptSig, p2pkh, nullptr, strict_flags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_CLEANSTACK, ScriptErrorString(err));
+
+    scriptSig = CScript() << vchSig << vchPubKey;
+    CScriptWitness witness;
+    witness.stack.push_back(vchSig);
+    BOOST_CHECK(!VerifyScript(scriptSig, p2pkh, &witness, strict_flags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_WITNESS_UNEXPECTED, ScriptErrorString(err));
+
+    std::vector<unsigned char> vchBadSig(vchSig);
+    vchBadSig[vchBadSig.size() - 10] ^= 1;
+    scriptSig = CScript() << vchBadSig << vchPubKey;
+    BOOST_CHECK(!VerifyScript(scriptSig, p2pkh, nullptr, gFlags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_EVAL_FALSE, ScriptErrorString(err));
+    BOOST_CHECK(!VerifyScript(scriptSig, p2pkh, nullptr, strict_flags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_SIG_NULLFAIL, ScriptErrorString(err));
+    vchBadSig = vchSig;
+    vchBadSig[0] = 0x31;
+    scriptSig = CScript() << vchBadSig << vchPubKey;
+    BOOST_CHECK(!VerifyScript(scriptSig, p2pkh, nullptr, strict_flags, checker, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_SIG_DER, ScriptErrorString(err));
+
+    // The same for a P2WPKH output, whose signature commits to the amount
+    const CScript p2wpkh = GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey().GetID()));
+    const CTransaction txFromWitness{BuildCreditingTransaction(p2wpkh, 1)};
+    CMutableTransaction txToWitness = BuildSpendingTransaction(CScript(), CScriptWitness(), txFromWitness);
+    vchSig.clear();
+    BOOST_CHECK(key.Sign(SignatureHash(p2pkh, txToWitness, 0, SIGHASH_ALL, 1, SigVersion::WITNESS_V0), vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    witness.stack = {vchSig, vchPubKey};
+    BOOST_CHECK(VerifyScript(CScript(), p2wpkh, &witness, strict_flags, MutableTransactionSignatureChecker(&txToWitness, 0, 1), &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+    BOOST_CHECK(!VerifyScript(CScript(), p2wpkh, &witness, witness_flags, MutableTransactionSignatureChecker(&txToWitness, 0, 2), &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_EVAL_FALSE, ScriptErrorString(err));
+    BOOST_CHECK(!VerifyScript(CScript(), p2wpkh, &witness, strict_flags, MutableTransactionSignatureChecker(&txToWitness, 0, 2), &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_SIG_NULLFAIL, ScriptErrorString(err));
+    witness.stack = {vchSig, ToByteVector(other.GetPubKey())};
+    BOOST_CHECK(!VerifyScript(CScript(), p2wpkh, &witness, strict_flags, MutableTransactionSignatureChecker(&txToWitness, 0, 1), &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_EQUALVERIFY, ScriptErrorString(err));
+    witness.stack = {vchSig, ToByteVector(key.GetPubKey()), vchPubKey};
+    BOOST_CHECK(!VerifyScript(CScript(), p2wpkh, &witness, strict_flags, MutableTransactionSignatureChecker(&txToWitness, 0, 1), &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_WITNESS_PROGRAM_MISMATCH, ScriptErrorString(err));
+}
+
 /* Wrapper around ProduceSignature to combine two scriptsigs */
 SignatureData CombineSignatures(const CTxOut& txout, const CMutableTransaction& tx, const SignatureData& scriptSig1, const SignatureData& scriptSig2)
 {
@@ -1628,5 +1714,51 @@ BOOST_AUTO_TEST_CASE(bitcoinconsensus_verify_script_invalid_flags)
     BOOST_CHECK_EQUAL(err, bitcoinconsensus_ERR_INVALID_FLAGS);
 }
 
+/* Test bitcoinconsensus_verify_script_batch returns the result of each input */
+BOOST_AUTO_TEST_CASE(bitcoinconsensus_verify_script_batch_results)
+{
+    unsigned int libconsensus_flags = bitcoinconsensus_SCRIPT_FLAGS_VERIFY_P2SH;
+
+    CScript scriptTrue = CScript() << OP_1;
+    CScript scriptFalse = CScript() << OP_0;
+    CTransaction creditTx = BuildCreditingTransaction(scriptTrue, 1);
+    CMutableTransaction spendTx = BuildSpendingTransaction(CScript(), CScriptWitness(), creditTx);
+    spendTx.vin.resize(20, spendTx.vin[0]);
+
+    std::vector<bitcoinconsensus_spent_output> spentOutputs(spendTx.vin.size());
+    for (size_t i = 0; i < spentOutputs.size(); ++i) {
+        const CScript& script = i % 7 == 3 ? scriptFalse : scriptTrue;
+        spentOutputs[i] = {script.data(), (unsigned int)script.size(), 1};
+    }
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << spendTx;
+
+    for (unsigned int threads : {0, 1, 4}) {
+        std::vector<int> results(spentOutputs.size(), -1);
+        bitcoinconsensus_error err;
+        int result = bitcoinconsensus_verify_script_batch(spentOutputs.data(), spentOutputs.size(), (const unsigned char*)&stream[0], stream.size(), libconsensus_flags, threads, results.data(), &err);
+        BOOST_CHECK_EQUAL(result, 0);
+        BOOST_CHECK_EQUAL(err, bitcoinconsensus_ERR_OK);
+        for (size_t i = 0; i < results.size(); ++i) {
+            BOOST_CHECK_EQUAL(results[i], i % 7 == 3 ? 0 : 1);
+        }
+        result = bitcoinconsensus_verify_script_batch(spentOutputs.data(), spentOutputs.size(), (const unsigned char*)&stream[0], stream.size(), libconsensus_flags, threads, nullptr, &err);
+        BOOST_CHECK_EQUAL(result, 0);
+    }
+
+    for (size_t i = 0; i < spentOutputs.size(); ++i) {
+        spentOutputs[i] = {scriptTrue.data(), (unsigned int)scriptTrue.size(), 1};
+    }
+    bitcoinconsensus_error err;
+    int result = bitcoinconsensus_verify_script_batch(spentOutputs.data(), spentOutputs.size(), (const unsigned char*)&stream[0], stream.size(), libconsensus_flags, 4, nullptr, &err);
+    BOOST_CHECK_EQUAL(result, 1);
+    BOOST_CHECK_EQUAL(err, bitcoinconsensus_ERR_OK);
+
+    result = bitcoinconsensus_verify_script_batch(spentOutputs.data(), spentOutputs.size() - 1, (const unsigned char*)&stream[0], stream.size(), libconsensus_flags, 4, nullptr, &err);
+    BOOST_CHECK_EQUAL(result, 0);
+    BOOST_CHECK_EQUAL(err, bitcoinconsensus_ERR_SPENT_OUTPUTS_MISMATCH);
+}
+
 #endif
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include <serialize.h>
 #include <streams.h>
 #include <hash.h>
+#include <protocol.h>
 #include <test/util/setup_common.h>
 #include <util/strencodings.h>
 
@@ -267,6 +268,45 @@ BOOST_AUTO_TEST_CASE(vector_bool)
     BOOST_CHECK(SerializeHash(vec1) == SerializeHash(vec2));
 }
 
+BOOST_AUTO_TEST_CASE(array_bytes)
+{
+    // Byte arrays are written at once, but must encode like any other array: each element, without a length
+    std::array<unsigned char, 5> bytes{{1, 2, 3, 4, 5}};
+    std::array<uint16_t, 5> shorts{{1, 2, 3, 4, 5}};
+    std::array<std::array<unsigned char, 2>, 2> nested{{{{6, 7}}, {{8, 9}}}};
+    CDataStream ss(SER_DISK, 0);
+    ss << bytes << nested;
+    BOOST_CHECK_EQUAL(HexStr(ss.begin(), ss.end()), "010203040506070809");
+    ss.clear();
+    ss << shorts;
+    BOOST_CHECK_EQUAL(HexStr(ss.begin(), ss.end()), "01000200030004000500");
+
+    std::array<unsigned char, 5> bytes2;
+    std::array<std::array<unsigned char, 2>, 2> nested2;
+    ss.clear();
+    ss << bytes << nested;
+    ss >> bytes2 >> nested2;
+    BOOST_CHECK(bytes2 == bytes);
+    BOOST_CHECK(nested2 == nested);
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK_THROW(ss >> bytes2, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(size_computer_type)
+{
+    // CAddress writes a version and its time only on disk
+    CAddress addr(CService(CNetAddr(), 9333), NODE_NETWORK);
+    for (int nType : {SER_DISK, SER_NETWORK}) {
+        CDataStream ss(nType, PROTOCOL_VERSION);
+        ss << addr;
+        CSizeComputer size(nType, PROTOCOL_VERSION);
+        size << addr;
+        BOOST_CHECK_EQUAL(size.size(), ss.size());
+    }
+    BOOST_CHECK_EQUAL(CSizeComputer(SER_DISK, PROTOCOL_VERSION).GetType(), SER_DISK);
+    BOOST_CHECK_EQUAL(CSizeComputer(PROTOCOL_VERSION).GetType(), 0);
+}
+
 BOOST_AUTO_TEST_CASE(noncanonical)
 {
     // Write some non-canonical CompactSize encodings, and
@@ -2,9 +2,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chainparams.h>
 #include <consensus/tx_check.h>
 #include <consensus/validation.h>
 #include <test/data/sighash.json.h>
+#include <test/data/zip243_sighash.json.h>
 #include <hash.h>
 #include <script/interpreter.h>
 #include <script/script.h>
@@ -158,6 +160,30 @@ BOOST_AUTO_TEST_CASE(sighash_test)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(sighash_cached)
+{
+    for (int i=0; i<2000; i++) {
+        int nHashType = InsecureRand32();
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        if (InsecureRandBool()) {
+            // Witness data on one input keeps the legacy cache for the others
+            txTo.vin[InsecureRandRange(txTo.vin.size())].scriptWitness.stack.push_back({1});
+        }
+        CScript scriptCode;
+        RandomScript(scriptCode);
+        const CAmount amount = InsecureRandRange(100000000);
+        const CTransaction tx(txTo);
+        const PrecomputedTransactionData txdata(tx);
+        BOOST_CHECK(txdata.ready == tx.HasWitness());
+
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, 0, SigVersion::BASE, &txdata) == SignatureHashOld(scriptCode, tx, nIn, nHashType));
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, amount, SigVersion::WITNESS_V0, &txdata) == SignatureHash(scriptCode, tx, nIn, nHashType, amount, SigVersion::WITNESS_V0));
+        }
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
@@ -205,4 +231,45 @@ BOOST_AUTO_TEST_CASE(sighash_from_data)
         BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
     }
 }
+
+// Goal: check that ShieldedSignatureHash follows ZIP 243 for the given branch
+BOOST_AUTO_TEST_CASE(shielded_sighash_from_data)
+{
+    UniValue tests = read_json(std::string(json_tests::zip243_sighash, json_tests::zip243_sighash + sizeof(json_tests::zip243_sighash)));
+
+    for (unsigned int idx = 0; idx < tests.size(); idx++) {
+        UniValue test = tests[idx];
+        std::string strTest = test.write();
+        if (test.size() < 3) {
+            if (test.size() != 1) BOOST_ERROR("Bad test: " << strTest);
+            continue; // comment
+        }
+
+        CMutableTransaction tx;
+        uint32_t consensusBranchId;
+        std::string sigHashHex;
+        try {
+            CDataStream stream(ParseHex(test[0].get_str()), SER_NETWORK, PROTOCOL_VERSION);
+            stream >> tx;
+            consensusBranchId = test[1].get_int64();
+            sigHashHex = test[2].get_str();
+        } catch (...) {
+            BOOST_ERROR("Bad test, couldn't deserialize data: " << strTest);
+            continue;
+        }
+
+        const uint256 sh = ShieldedSignatureHash(tx, consensusBranchId);
+        BOOST_CHECK_MESSAGE(HexStr(sh.begin(), sh.end()) == sigHashHex, strTest);
+        BOOST_CHECK(ShieldedSignatureHash(CTransaction(tx), consensusBranchId) == sh);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(shielded_sighash_branch_by_height)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    BOOST_CHECK_EQUAL(params.BranchId(params.SaplingHeight), SAPLING_BRANCH_ID);
+    if (params.SaplingHeight > 0) {
+        BOOST_CHECK_EQUAL(params.BranchId(params.SaplingHeight - 1), SPROUT_BRANCH_ID);
+    }
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -72,7 +72,7 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
 
     // Build a CChain for the main branch.
     CChain chain;
-    chain.SetTip(&vBlocksMain.back());
+    WITH_LOCK(cs_main, chain.SetTip(&vBlocksMain.back()));
 
     // Test 100 random starting points for locators.
     for (int n=0; n<100; n++) {
@@ -98,6 +98,85 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+static const CBlockIndex* NaiveLastCommonAncestor(const CBlockIndex* pa, const CBlockIndex* pb)
+{
+    while (pa->nHeight > pb->nHeight) pa = pa->pprev;
+    while (pb->nHeight > pa->nHeight) pb = pb->pprev;
+    while (pa != pb && pa && pb) {
+        pa = pa->pprev;
+        pb = pb->pprev;
+    }
+    return pa;
+}
+
+BOOST_AUTO_TEST_CASE(findfork_test)
+{
+    // A main chain 10000 blocks long, with branches off it at every 1000th block
+    std::vector<CBlockIndex> vBlocks(20000);
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        if (i < 10000) {
+            vBlocks[i].nHeight = i;
+            vBlocks[i].pprev = i ? &vBlocks[i - 1] : nullptr;
+        } else if (i % 1000 == 0) {
+            vBlocks[i].pprev = &vBlocks[i - 10000];
+            vBlocks[i].nHeight = vBlocks[i].pprev->nHeight + 1;
+        } else {
+            vBlocks[i].pprev = &vBlocks[i - 1];
+            vBlocks[i].nHeight = vBlocks[i].pprev->nHeight + 1;
+        }
+        vBlocks[i].BuildSkip();
+    }
+
+    CChain chain;
+    WITH_LOCK(cs_main, chain.SetTip(&vBlocks[9999]));
+    for (int n = 0; n < 1000; n++) {
+        const CBlockIndex* pa = &vBlocks[InsecureRandRange(vBlocks.size())];
+        const CBlockIndex* pb = &vBlocks[InsecureRandRange(vBlocks.size())];
+        BOOST_CHECK(chain.FindFork(pa) == NaiveLastCommonAncestor(pa, chain.Tip()));
+        BOOST_CHECK(LastCommonAncestor(pa, pb) == NaiveLastCommonAncestor(pa, pb));
+    }
+
+    // Chains with no block in common
+    CBlockIndex other;
+    BOOST_CHECK(LastCommonAncestor(&vBlocks[15000], &other) == nullptr);
+    BOOST_CHECK(chain.FindFork(&other) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(tip_snapshot_test)
+{
+    std::vector<uint256> hashes(100);
+    std::vector<CBlockIndex> blocks(100);
+    for (unsigned int i = 0; i < blocks.size(); i++) {
+        hashes[i] = ArithToUint256(i);
+        blocks[i].nHeight = i;
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].phashBlock = &hashes[i];
+        blocks[i].BuildSkip();
+    }
+
+    LOCK(cs_main);
+    CChain chain;
+    BOOST_CHECK(chain.TipSnapshot() == nullptr);
+    chain.SetTip(&blocks.back());
+    BOOST_CHECK(chain.TipSnapshot() == chain.Tip());
+    chain.SetTip(&blocks[41]);
+    BOOST_CHECK(chain.TipSnapshot() == &blocks[41]);
+    BOOST_CHECK(chain.TipSnapshot()->GetAncestor(17) == chain[17]);
+
+    // A deferred snapshot stays at the tip it had until it is published again.
+    {
+        DeferredTipSnapshot defer_tip_snapshot(chain);
+        chain.SetTip(&blocks[30]);
+        chain.SetTip(&blocks[60]);
+        BOOST_CHECK(chain.Tip() == &blocks[60]);
+        BOOST_CHECK(chain.TipSnapshot() == &blocks[41]);
+    }
+    BOOST_CHECK(chain.TipSnapshot() == &blocks[60]);
+
+    chain.SetTip(nullptr);
+    BOOST_CHECK(chain.TipSnapshot() == nullptr);
+}
+
 BOOST_AUTO_TEST_CASE(findearliestatleast_test)
 {
     std::vector<uint256> vHashMain(100000);
@@ -128,7 +207,7 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_test)
 
     // Build a CChain for the main branch.
     CChain chain;
-    chain.SetTip(&vBlocksMain.back());
+    WITH_LOCK(cs_main, chain.SetTip(&vBlocksMain.back()));
 
     // Verify that FindEarliestAtLeast is correct.
     for (unsigned int i=0; i<10000; ++i) {
@@ -155,7 +234,7 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_edge_test)
     }
 
     CChain chain;
-    chain.SetTip(&blocks.back());
+    WITH_LOCK(cs_main, chain.SetTip(&blocks.back()));
 
     BOOST_CHECK_EQUAL(chain.FindEarliestAtLeast(50, 0)->nHeight, 0);
     BOOST_CHECK_EQUAL(chain.FindEarliestAtLeast(100, 0)->nHeight, 0);
@@ -0,0 +1,72 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <primitives/block.h>
+#include <streams.h>
+#include <stratum.h>
+#include <test/util/setup_common.h>
+#include <util/strencodings.h>
+#include <version.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stratum_tests, BasicTestingSetup)
+
+static CBlockHeader MakeHeader()
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = uint256S("00000000000000000000000000000000000000000000000000000000000000aa");
+    header.hashMerkleRoot = uint256S("bb00000000000000000000000000000000000000000000000000000000000000");
+    header.hashSaplingRoot = uint256S("0101010101010101010101010101010101010101010101010101010101010101");
+    header.nTime = 0x5f000001;
+    header.nBits = 0x1f07ffff;
+    return header;
+}
+
+BOOST_AUTO_TEST_CASE(notify_params)
+{
+    const CBlockHeader header = MakeHeader();
+    const UniValue params = StratumNotifyParams("1a", header, true);
+    BOOST_REQUIRE_EQUAL(params.size(), 8U);
+    BOOST_CHECK_EQUAL(params[0].get_str(), "1a");
+    // Every field is in the byte order of the serialized header.
+    BOOST_CHECK_EQUAL(params[1].get_str(), "04000000");
+    BOOST_CHECK_EQUAL(params[2].get_str(), "aa00000000000000000000000000000000000000000000000000000000000000");
+    BOOST_CHECK_EQUAL(params[3].get_str(), "00000000000000000000000000000000000000000000000000000000000000bb");
+    BOOST_CHECK_EQUAL(params[4].get_str(), "0101010101010101010101010101010101010101010101010101010101010101");
+    BOOST_CHECK_EQUAL(params[5].get_str(), "0100005f");
+    BOOST_CHECK_EQUAL(params[6].get_str(), "ffff071f");
+    BOOST_CHECK(params[7].get_bool());
+}
+
+BOOST_AUTO_TEST_CASE(share_header)
+{
+    const std::vector<unsigned char> nonce1{0x01, 0x02, 0x03, 0x04};
+    const std::string nonce2 = "05060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f20";
+    const std::vector<unsigned char> solution(100, 0x5a);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << solution;
+    const std::string solution_hex = HexStr(ss.begin(), ss.end());
+
+    CBlockHeader header = MakeHeader();
+    BOOST_REQUIRE(StratumShareHeader(header, nonce1, "0200005f", nonce2, solution_hex));
+    BOOST_CHECK_EQUAL(header.nTime, 0x5f000002U);
+    BOOST_CHECK_EQUAL(HexStr(header.nNonce.begin(), header.nNonce.end()), "01020304" + nonce2);
+    BOOST_CHECK(header.nSolution == solution);
+    // The fields of the job are left alone.
+    BOOST_CHECK_EQUAL(header.nBits, 0x1f07ffffU);
+    BOOST_CHECK(header.hashPrevBlock == MakeHeader().hashPrevBlock);
+
+    // Malformed times, nonces and solutions are rejected.
+    CBlockHeader bad = MakeHeader();
+    BOOST_CHECK(!StratumShareHeader(bad, nonce1, "0200005", nonce2, solution_hex));
+    BOOST_CHECK(!StratumShareHeader(bad, nonce1, "0200005g", nonce2, solution_hex));
+    BOOST_CHECK(!StratumShareHeader(bad, nonce1, "0200005f", nonce2 + "21", solution_hex));
+    BOOST_CHECK(!StratumShareHeader(bad, nonce1, "0200005f", nonce2.substr(2), solution_hex));
+    BOOST_CHECK(!StratumShareHeader(bad, nonce1, "0200005f", nonce2, solution_hex.substr(2)));
+    BOOST_CHECK(!StratumShareHeader(bad, nonce1, "0200005f", nonce2, solution_hex + "00"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,107 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <netbase.h>
+#include <subnettrie.h>
+#include <test/util/setup_common.h>
+#include <tinyformat.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(subnettrie_tests, BasicTestingSetup)
+
+static CNetAddr ResolveIP(const std::string& ip)
+{
+    CNetAddr addr;
+    LookupHost(ip, addr, false);
+    return addr;
+}
+
+static CSubNet ResolveSubNet(const std::string& subnet)
+{
+    CSubNet ret;
+    LookupSubNet(subnet, ret);
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(subnettrie_match)
+{
+    SubNetTrie trie;
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("1.2.3.4")), 0);
+
+    trie.Insert(ResolveSubNet("1.2.0.0/16"), 100);
+    trie.Insert(ResolveSubNet("1.2.3.4"), 200);
+    trie.Insert(ResolveSubNet("1.3.0.0/16"), 300);
+    trie.Insert(ResolveSubNet("2001:db8::/32"), 400);
+    // A netmask that is not a prefix
+    trie.Insert(ResolveSubNet("5.0.0.5/255.0.0.255"), 500);
+    BOOST_CHECK_EQUAL(trie.Size(), 5U);
+
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("1.2.3.4")), 200);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("1.2.3.5")), 100);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("1.3.255.255")), 300);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("1.4.0.0")), 0);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("2001:db8:1::1")), 400);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("2001:db9::1")), 0);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("5.1.2.5")), 500);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("5.1.2.6")), 0);
+    // IPv4 subnets do not match IPv6 addresses
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("::1.2.3.4")), 0);
+
+    // Replacing a ban time
+    trie.Insert(ResolveSubNet("1.2.0.0/16"), 50);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("1.2.3.5")), 50);
+    BOOST_CHECK_EQUAL(trie.Size(), 5U);
+
+    BOOST_CHECK(trie.Erase(ResolveSubNet("1.2.3.4")));
+    BOOST_CHECK(!trie.Erase(ResolveSubNet("1.2.3.4")));
+    BOOST_CHECK(!trie.Erase(ResolveSubNet("1.0.0.0/8")));
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("1.2.3.4")), 50);
+    BOOST_CHECK(trie.Erase(ResolveSubNet("1.2.0.0/16")));
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("1.2.3.4")), 0);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("1.3.0.1")), 300);
+    BOOST_CHECK(trie.Erase(ResolveSubNet("5.0.0.5/255.0.0.255")));
+    BOOST_CHECK_EQUAL(trie.Size(), 2U);
+
+    // A subnet covering everything
+    trie.Insert(ResolveSubNet("::/0"), 600);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("8.8.8.8")), 600);
+    trie.Clear();
+    BOOST_CHECK_EQUAL(trie.Size(), 0U);
+    BOOST_CHECK_EQUAL(trie.Match(ResolveIP("8.8.8.8")), 0);
+}
+
+BOOST_AUTO_TEST_CASE(subnettrie_matches_linear_scan)
+{
+    // Subnets packed into 10.0.0.0/16, so that many of them overlap
+    SubNetTrie trie;
+    std::map<CSubNet, int64_t> subnets;
+    for (int i = 0; i < 500; i++) {
+        const CSubNet sub_net = ResolveSubNet(strprintf("10.0.%d.%d/%d", InsecureRandRange(256), InsecureRandRange(256), 16 + InsecureRandRange(17)));
+        const int64_t ban_until = 1 + InsecureRandRange(1000);
+        trie.Insert(sub_net, ban_until);
+        subnets[sub_net] = ban_until;
+        if (InsecureRandRange(4) == 0) {
+            const auto it = std::next(subnets.begin(), InsecureRandRange(subnets.size()));
+            BOOST_CHECK(trie.Erase(it->first));
+            subnets.erase(it);
+        }
+    }
+    BOOST_CHECK_EQUAL(trie.Size(), subnets.size());
+
+    for (int i = 0; i < 2000; i++) {
+        const CNetAddr addr = ResolveIP(strprintf("10.0.%d.%d", InsecureRandRange(256), InsecureRandRange(256)));
+        int64_t expected = 0;
+        for (const auto& entry : subnets) {
+            if (entry.first.Match(addr)) expected = std::max(expected, entry.second);
+        }
+        BOOST_CHECK_EQUAL(trie.Match(addr), expected);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,8 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <thread>
+
 namespace {
 template <typename MutexType>
 void TestPotentialDeadLockDetected(MutexType& mutex1, MutexType& mutex2)
@@ -49,4 +51,54 @@ BOOST_AUTO_TEST_CASE(potential_deadlock_detected)
     #endif
 }
 
+static Mutex g_stats_mutex;
+
+static void LockStatsMutex(int sleep_ms)
+{
+    LOCK(g_stats_mutex);
+    if (sleep_ms) std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
+}
+
+static LockSiteStats GetStatsMutexSite()
+{
+    for (const LockSiteStats& site : GetLockStats()) {
+        if (site.name == "g_stats_mutex") return site;
+    }
+    BOOST_ERROR("lock site not found");
+    return {};
+}
+
+BOOST_AUTO_TEST_CASE(lock_stats)
+{
+    LockStatsMutex(0);
+    LockStatsMutex(0);
+    LockSiteStats site = GetStatsMutexSite();
+    BOOST_CHECK_EQUAL(site.acquisitions, 2U);
+    BOOST_CHECK_EQUAL(site.contentions, 0U);
+    BOOST_CHECK_EQUAL(site.hold_ns, 0U);
+    BOOST_CHECK(site.file.find("sync_tests.cpp") != std::string::npos);
+
+    // Contended while another thread holds it
+    std::atomic<bool> started{false};
+    g_stats_mutex.lock();
+    std::thread thread([&] {
+        started = true;
+        LockStatsMutex(0);
+    });
+    while (!started) std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    g_stats_mutex.unlock();
+    thread.join();
+    site = GetStatsMutexSite();
+    BOOST_CHECK_EQUAL(site.acquisitions, 3U);
+    BOOST_CHECK_EQUAL(site.contentions, 1U);
+    BOOST_CHECK_GT(site.wait_ns, 0U);
+
+    g_lock_hold_times = true;
+    LockStatsMutex(10);
+    g_lock_hold_times = false;
+    site = GetStatsMutexSite();
+    BOOST_CHECK_GE(site.hold_ns, 10U * 1000 * 1000);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -11,6 +11,7 @@
 #include <consensus/tx_check.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <core_memusage.h>
 #include <key.h>
 #include <validation.h>
 #include <policy/policy.h>
@@ -281,6 +282,70 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(CTransaction(tx), state) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(duplicate_inputs_and_nullifiers)
+{
+    // Enough of each that the duplicate checks do not fit on the stack
+    CMutableTransaction tx;
+    tx.fOverwintered = true;
+    tx.nVersion = SAPLING_TX_VERSION;
+    tx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    const uint256 txid = InsecureRand256();
+    for (uint32_t i = 0; i < 40; i++) {
+        tx.vin.push_back(CTxIn(COutPoint(i % 2 ? txid : InsecureRand256(), i)));
+        SpendDescription spend;
+        spend.nullifier = InsecureRand256();
+        tx.vShieldedSpend.push_back(spend);
+    }
+    TxValidationState state;
+    BOOST_CHECK(CheckTransaction(CTransaction(tx), state));
+
+    CMutableTransaction dup(tx);
+    dup.vin.push_back(dup.vin[17]);
+    BOOST_CHECK(!CheckTransaction(CTransaction(dup), state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-inputs-duplicate");
+
+    state = TxValidationState();
+    dup = tx;
+    dup.vShieldedSpend[3].nullifier = dup.vShieldedSpend[35].nullifier;
+    BOOST_CHECK(!CheckTransaction(CTransaction(dup), state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-spend-description-nullifiers-duplicate");
+
+    // Duplicate inputs are reported first
+    state = TxValidationState();
+    dup.vin.push_back(dup.vin[0]);
+    BOOST_CHECK(!CheckTransaction(CTransaction(dup), state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-inputs-duplicate");
+}
+
+BOOST_AUTO_TEST_CASE(shielded_transaction_copy)
+{
+    CMutableTransaction mtx;
+    mtx.fOverwintered = true;
+    mtx.nVersion = SAPLING_TX_VERSION;
+    mtx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    mtx.vShieldedSpend.resize(2);
+    mtx.vShieldedOutput.resize(1);
+    mtx.bindingSig[0] = 1;
+
+    const CMutableTransaction& cmtx = mtx;
+    const CTransaction copied(cmtx);
+    BOOST_CHECK(copied.bindingSig == mtx.bindingSig);
+    BOOST_CHECK_EQUAL(copied.vShieldedSpend.size(), 2U);
+    BOOST_CHECK(copied.GetHash() == mtx.GetHash());
+
+    const uint256 hash = mtx.GetHash();
+    const CTransaction moved(std::move(mtx));
+    BOOST_CHECK(moved.bindingSig == copied.bindingSig);
+    BOOST_CHECK_EQUAL(moved.vShieldedOutput.size(), 1U);
+    BOOST_CHECK(moved.GetHash() == hash);
+
+    // The descriptions are part of the memory the transaction uses
+    BOOST_CHECK_GE(RecursiveDynamicUsage(moved), 2 * sizeof(SpendDescription) + sizeof(OutputDescription));
+}
+
 BOOST_AUTO_TEST_CASE(test_Get)
 {
     FillableSigningProvider keystore;
@@ -851,4 +916,33 @@ BOOST_AUTO_TEST_CASE(test_IsStandard)
     fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 }
 
+BOOST_AUTO_TEST_CASE(make_transaction_refs)
+{
+    std::vector<CMutableTransaction> txs(20);
+    std::vector<uint256> txids, wtxids;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        CMutableTransaction& mtx = txs[i];
+        mtx.vin.resize(1 + i % 3);
+        for (CTxIn& in : mtx.vin) {
+            in.prevout = COutPoint(InsecureRand256(), i);
+            in.scriptSig = CScript() << std::vector<unsigned char>(InsecureRandRange(200), 1);
+            // Some transactions have a witness, so their wtxid differs
+            if (i % 4 == 0) in.scriptWitness.stack.push_back(std::vector<unsigned char>(10, 2));
+        }
+        mtx.vout.resize(1 + i % 5);
+        const CTransaction tx(mtx);
+        txids.push_back(tx.GetHash());
+        wtxids.push_back(tx.GetWitnessHash());
+    }
+
+    const std::vector<CTransactionRef> vtx = MakeTransactionRefs(std::move(txs));
+    BOOST_REQUIRE_EQUAL(vtx.size(), txids.size());
+    for (size_t i = 0; i < vtx.size(); ++i) {
+        BOOST_CHECK(vtx[i]->GetHash() == txids[i]);
+        BOOST_CHECK(vtx[i]->GetWitnessHash() == wtxids[i]);
+        BOOST_CHECK_EQUAL(vtx[i]->vin.size(), 1 + i % 3);
+    }
+    BOOST_CHECK(MakeTransactionRefs({}).empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
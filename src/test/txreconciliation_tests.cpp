@@ -0,0 +1,101 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <streams.h>
+#include <txreconciliation.h>
+#include <version.h>
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sketch_decode)
+{
+    TxReconSketch a(300);
+    TxReconSketch b(a.Cells());
+    std::vector<uint32_t> only_a, only_b;
+    for (int i = 0; i < 100; i++) {
+        const uint32_t id = InsecureRand32();
+        a.Add(id);
+        b.Add(id);
+    }
+    for (int i = 0; i < 5; i++) {
+        only_a.push_back(InsecureRand32());
+        a.Add(only_a.back());
+        only_b.push_back(InsecureRand32());
+        b.Add(only_b.back());
+    }
+
+    a -= b;
+    std::vector<uint32_t> positive, negative;
+    BOOST_CHECK(a.Decode(positive, negative));
+    std::sort(only_a.begin(), only_a.end());
+    std::sort(only_b.begin(), only_b.end());
+    std::sort(positive.begin(), positive.end());
+    std::sort(negative.begin(), negative.end());
+    BOOST_CHECK(positive == only_a);
+    BOOST_CHECK(negative == only_b);
+
+    // A difference far beyond the capacity does not decode
+    TxReconSketch small(12);
+    for (int i = 0; i < 100; i++) {
+        small.Add(InsecureRand32());
+    }
+    BOOST_CHECK(!small.Decode(positive, negative));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_round)
+{
+    const uint64_t salt1 = InsecureRandBits(64), salt2 = InsecureRandBits(64);
+    TxReconciliationState initiator(true, salt1, salt2);
+    TxReconciliationState responder(false, salt2, salt1);
+
+    std::vector<uint256> shared, initiator_only, responder_only;
+    for (int i = 0; i < 50; i++) {
+        shared.push_back(InsecureRand256());
+        BOOST_CHECK_EQUAL(initiator.GetShortID(shared.back()), responder.GetShortID(shared.back()));
+        initiator.m_local_set.insert(shared.back());
+        responder.m_local_set.insert(shared.back());
+    }
+    for (int i = 0; i < 3; i++) {
+        initiator_only.push_back(InsecureRand256());
+        initiator.m_local_set.insert(initiator_only.back());
+        responder_only.push_back(InsecureRand256());
+        responder.m_local_set.insert(responder_only.back());
+    }
+
+    initiator.m_q = 2;
+    initiator.Snapshot();
+    BOOST_CHECK(initiator.m_local_set.empty());
+    responder.Snapshot();
+    TxReconSketch sketch = responder.SnapshotSketch(EstimateSketchCells(responder.m_snapshot.size(), initiator.m_snapshot.size(), initiator.m_q));
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << sketch;
+    TxReconSketch received;
+    stream >> received;
+    BOOST_CHECK_EQUAL(received.Cells(), sketch.Cells());
+
+    std::vector<uint256> announce;
+    std::vector<uint32_t> request;
+    BOOST_CHECK(initiator.ProcessSketch(received, announce, request));
+    BOOST_CHECK(initiator.m_snapshot.empty());
+    std::sort(announce.begin(), announce.end());
+    std::sort(initiator_only.begin(), initiator_only.end());
+    BOOST_CHECK(announce == initiator_only);
+
+    std::vector<uint256> requested = responder.TakeRequested(request);
+    std::sort(requested.begin(), requested.end());
+    std::sort(responder_only.begin(), responder_only.end());
+    BOOST_CHECK(requested == responder_only);
+    BOOST_CHECK(responder.m_snapshot.empty());
+
+    // Both sets were the same size, so all of the difference counts towards q
+    BOOST_CHECK_CLOSE(initiator.m_q, 6.0 / 53, 0.001);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include <validation.h>
 #include <consensus/validation.h>
 #include <primitives/transaction.h>
+#include <script/interpreter.h>
 #include <script/script.h>
 #include <test/util/setup_common.h>
 
@@ -52,4 +53,155 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK(state.GetResult() == TxValidationResult::TX_CONSENSUS);
 }
 
+/**
+ * Ensure that the mempool won't accept transactions that expire with the
+ * next block.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_expired, TestChain100Setup)
+{
+    CMutableTransaction tx;
+    tx.fOverwintered = true;
+    tx.nVersion = SAPLING_TX_VERSION;
+    tx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1 * CENT;
+    tx.vout[0].scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    LOCK(cs_main);
+    const unsigned int next_height = ::ChainActive().Height() + 1;
+    for (unsigned int expiry : {next_height - 1, next_height}) {
+        tx.nExpiryHeight = expiry;
+        TxValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(*m_node.mempool, state, MakeTransactionRef(tx), nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "tx-expired");
+        BOOST_CHECK(state.GetResult() == TxValidationResult::TX_MEMPOOL_POLICY);
+    }
+
+    // Expiring later, or not at all, it gets past the check
+    for (unsigned int expiry : {next_height + 1, 0U}) {
+        tx.nExpiryHeight = expiry;
+        TxValidationState state;
+        AcceptToMemoryPool(*m_node.mempool, state, MakeTransactionRef(tx), nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */);
+        BOOST_CHECK(state.GetRejectReason() != "tx-expired");
+    }
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+}
+
+/**
+ * Ensure that a child can pay for a parent below the minimum relay fee when
+ * they are submitted as a package.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_accept_package, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    const auto Spend = [&](const CTransactionRef& prev, CAmount value) -> CTransactionRef {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(prev->GetHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = value;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(prev->vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        return MakeTransactionRef(tx);
+    };
+
+    // The parent pays no fee at all, the child enough for both.
+    const CTransactionRef parent = Spend(m_coinbase_txns[0], m_coinbase_txns[0]->vout[0].nValue);
+    const CTransactionRef child = Spend(parent, parent->vout[0].nValue - 1 * CENT);
+
+    LOCK(cs_main);
+
+    TxValidationState state;
+    BOOST_CHECK(!AcceptToMemoryPool(*m_node.mempool, state, parent, nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "min relay fee not met");
+
+    TxValidationState package_state;
+    std::vector<TxValidationState> tx_states;
+    BOOST_CHECK(!AcceptPackageToMemoryPool(*m_node.mempool, package_state, tx_states, {child, parent}, CFeeRate(0)));
+    BOOST_CHECK_EQUAL(package_state.GetRejectReason(), "package-not-sorted");
+    BOOST_CHECK(!AcceptPackageToMemoryPool(*m_node.mempool, package_state, tx_states, {parent, parent}, CFeeRate(0)));
+    BOOST_CHECK_EQUAL(package_state.GetRejectReason(), "package-contains-duplicates");
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+
+    package_state = TxValidationState();
+    BOOST_CHECK(AcceptPackageToMemoryPool(*m_node.mempool, package_state, tx_states, {parent, child}, CFeeRate(0)));
+    BOOST_CHECK_EQUAL(tx_states.size(), 2U);
+    BOOST_CHECK(m_node.mempool->exists(parent->GetHash()));
+    BOOST_CHECK(m_node.mempool->exists(child->GetHash()));
+
+    // Resubmitting the package skips the transactions already accepted.
+    BOOST_CHECK(AcceptPackageToMemoryPool(*m_node.mempool, package_state, tx_states, {parent, child}, CFeeRate(0)));
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 2U);
+}
+
+/**
+ * Ensure that a package whose last transaction fails is not added in part,
+ * after the transactions before it have passed all of their checks.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_package_partway, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CKey other_key;
+    other_key.MakeNewKey(true);
+
+    const auto Spend = [&](const CTransactionRef& prev, CAmount value, const CKey& key) -> CTransactionRef {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(prev->GetHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = value;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(prev->vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        return MakeTransactionRef(tx);
+    };
+
+    // The parent and the child are valid and pay their own fees, the
+    // grandchild is signed with the wrong key.
+    const CTransactionRef parent = Spend(m_coinbase_txns[0], m_coinbase_txns[0]->vout[0].nValue - 1 * CENT, coinbaseKey);
+    const CTransactionRef child = Spend(parent, parent->vout[0].nValue - 1 * CENT, coinbaseKey);
+    const CTransactionRef grandchild = Spend(child, child->vout[0].nValue - 1 * CENT, other_key);
+
+    LOCK(cs_main);
+
+    for (bool test_accept : {true, false}) {
+        TxValidationState package_state;
+        std::vector<TxValidationState> tx_states;
+        BOOST_CHECK(!AcceptPackageToMemoryPool(*m_node.mempool, package_state, tx_states, {parent, child, grandchild}, CFeeRate(0), test_accept));
+        BOOST_CHECK_EQUAL(package_state.GetRejectReason(), "package-tx-invalid");
+        BOOST_REQUIRE_EQUAL(tx_states.size(), 3U);
+        BOOST_CHECK(tx_states[0].IsValid());
+        BOOST_CHECK(tx_states[1].IsValid());
+        BOOST_CHECK(tx_states[2].IsInvalid());
+
+        // Neither the transactions before the failing one nor their outputs
+        // were added.
+        BOOST_CHECK_EQUAL(m_node.mempool->size(), 0U);
+        BOOST_CHECK(!m_node.mempool->exists(parent->GetHash()));
+        BOOST_CHECK(!m_node.mempool->exists(child->GetHash()));
+        BOOST_CHECK(!m_node.mempool->isSpent(COutPoint(m_coinbase_txns[0]->GetHash(), 0)));
+    }
+
+    // The valid part of the package is still accepted afterwards.
+    TxValidationState package_state;
+    std::vector<TxValidationState> tx_states;
+    BOOST_CHECK(AcceptPackageToMemoryPool(*m_node.mempool, package_state, tx_states, {parent, child}, CFeeRate(0)));
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 2U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include <txmempool.h>
 #include <script/standard.h>
 #include <script/sign.h>
+#include <script/sigcache.h>
 #include <script/signingprovider.h>
 #include <test/util/setup_common.h>
 
@@ -135,6 +136,11 @@ static void ValidateCheckInputsForAllFlags(const CTransaction &tx, uint32_t fail
             std::vector<CScriptCheck> scriptchecks;
             BOOST_CHECK(CheckInputScripts(tx, state, &::ChainstateActive().CoinsTip(), test_flags, true, add_to_cache, txdata, &scriptchecks));
             BOOST_CHECK(scriptchecks.empty());
+
+            // A cache hit does not need the transaction to be hashed
+            PrecomputedTransactionData txdata_lazy;
+            BOOST_CHECK(CheckInputScripts(tx, state, &::ChainstateActive().CoinsTip(), test_flags, true, add_to_cache, txdata_lazy, nullptr));
+            BOOST_CHECK(!txdata_lazy.m_initialized);
         } else {
             // Check that we get script executions to check, if the transaction
             // was invalid, or we didn't add to cache.
@@ -371,4 +377,107 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(script_check_batch, BasicTestingSetup)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript p2pk = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    // Only spendable with an invalid signature, which must not be assumed valid
+    const CScript p2pk_not = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG << OP_NOT;
+    const std::vector<CTxOut> spent = {CTxOut(1, p2pk), CTxOut(1, p2pk), CTxOut(1, p2pk_not)};
+
+    CMutableTransaction mtx;
+    mtx.nVersion = 1;
+    for (uint32_t i = 0; i < spent.size(); i++) {
+        mtx.vin.emplace_back(COutPoint(InsecureRand256(), i));
+    }
+    mtx.vout.emplace_back(3, p2pk);
+    std::vector<std::vector<unsigned char>> sigs(spent.size());
+    for (unsigned int i = 0; i < spent.size(); i++) {
+        BOOST_CHECK(key.Sign(SignatureHash(spent[i].scriptPubKey, mtx, i, SIGHASH_ALL, 0, SigVersion::BASE), sigs[i]));
+        sigs[i].push_back(SIGHASH_ALL);
+    }
+    mtx.vin[0].scriptSig = CScript() << sigs[0];
+    mtx.vin[1].scriptSig = CScript() << sigs[1];
+    // Another input's signature is invalid for this one
+    mtx.vin[2].scriptSig = CScript() << sigs[0];
+
+    const auto run_batch = [&](const CTransaction& tx) {
+        PrecomputedTransactionData txdata(tx);
+        std::vector<CScriptCheck> checks;
+        for (unsigned int i = 0; i < spent.size(); i++) {
+            checks.emplace_back(spent[i], tx, i, SCRIPT_VERIFY_P2SH, false, &txdata);
+        }
+        return RunCheckBatch(checks);
+    };
+    BOOST_CHECK(run_batch(CTransaction(mtx)));
+
+    // An invalid signature of a P2PK input fails the batch
+    mtx.vin[1].scriptSig = CScript() << sigs[0];
+    BOOST_CHECK(!run_batch(CTransaction(mtx)));
+
+    // As does a valid signature of the input that needs an invalid one
+    mtx.vin[1].scriptSig = CScript() << sigs[1];
+    mtx.vin[2].scriptSig = CScript() << sigs[2];
+    BOOST_CHECK(!run_batch(CTransaction(mtx)));
+}
+
+BOOST_FIXTURE_TEST_CASE(validation_caches_persist, TestChain100Setup)
+{
+    // Cache the signatures of a transaction and its script execution
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend_tx;
+    spend_tx.nVersion = 1;
+    spend_tx.vin.resize(1);
+    spend_tx.vin[0].prevout.hash = m_coinbase_txns[0]->GetHash();
+    spend_tx.vin[0].prevout.n = 0;
+    spend_tx.vout.resize(1);
+    spend_tx.vout[0].nValue = 11*CENT;
+    spend_tx.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend_tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend_tx.vin[0].scriptSig << vchSig;
+    const CTransaction tx(spend_tx);
+
+    LOCK(cs_main);
+    TxValidationState state;
+    PrecomputedTransactionData txdata(tx);
+    BOOST_CHECK(CheckInputScripts(tx, state, &::ChainstateActive().CoinsTip(), SCRIPT_VERIFY_P2SH, true, true, txdata, nullptr));
+
+    uint256 nonce;
+    std::vector<uint256> entries;
+    GetSignatureCacheEntries(nonce, entries);
+    BOOST_CHECK(!entries.empty());
+    BOOST_CHECK(DumpValidationCaches());
+
+    // The entries are found again under a different nonce once loaded
+    LoadSignatureCacheEntries(GetRandHash(), {});
+    BOOST_CHECK(LoadValidationCaches());
+    uint256 loaded_nonce;
+    std::vector<uint256> loaded_entries;
+    GetSignatureCacheEntries(loaded_nonce, loaded_entries);
+    BOOST_CHECK(loaded_nonce == nonce);
+    for (const uint256& entry : entries) {
+        BOOST_CHECK(std::find(loaded_entries.begin(), loaded_entries.end(), entry) != loaded_entries.end());
+    }
+    // The script execution cache hits, so there is nothing to check
+    std::vector<CScriptCheck> scriptchecks;
+    BOOST_CHECK(CheckInputScripts(tx, state, &::ChainstateActive().CoinsTip(), SCRIPT_VERIFY_P2SH, true, true, txdata, &scriptchecks));
+    BOOST_CHECK(scriptchecks.empty());
+
+    // A corrupted file is not loaded
+    {
+        FILE* file = fsbridge::fopen(GetDataDir() / "validationcache.dat", "r+b");
+        BOOST_REQUIRE(file);
+        fseek(file, 20, SEEK_SET);
+        const int c = fgetc(file);
+        fseek(file, 20, SEEK_SET);
+        fputc(c ^ 1, file);
+        fclose(file);
+    }
+    BOOST_CHECK(!LoadValidationCaches());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,14 +9,17 @@
 #include <consensus/consensus.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
+#include <crypto/blake2b.h>
 #include <crypto/equihash.h>
 #include <crypto/sha256.h>
+#include <crypto/siphash.h>
 #include <init.h>
 #include <miner.h>
 #include <net.h>
 #include <net_processing.h>
 #include <noui.h>
 #include <pow.h>
+#include <proofcache.h>
 #include <rpc/blockchain.h>
 #include <rpc/register.h>
 #include <rpc/server.h>
@@ -77,11 +80,15 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     InitLogging();
     LogInstance().StartLogging();
     SHA256AutoDetect();
+    BLAKE2bAutoDetect();
+    SipHashAutoDetect();
+    EquihashAutoDetect();
     ECC_Start();
     SetupEnvironment();
     SetupNetworking();
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitProofCache();
     fCheckBlockIndex = true;
     static bool noui_connected = false;
     if (!noui_connected) {
@@ -128,10 +135,14 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         throw std::runtime_error(strprintf("ActivateBestChain failed. (%s)", state.ToString()));
     }
 
-    // Start script-checking threads. Set g_parallel_script_checks to true so they are used.
+    // Start script- and proof-checking threads. Set g_parallel_script_checks to true so they are used.
     constexpr int script_check_threads = 2;
     for (int i = 0; i < script_check_threads; ++i) {
         threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
+        threadGroup.create_thread([i]() { return ThreadProofCheck(i); });
+        threadGroup.create_thread([i]() { return ThreadHeaderCheck(i); });
+        threadGroup.create_thread([i]() { return ThreadCoinsPrefetch(i); });
+        threadGroup.create_thread([i]() { return ThreadTxCheck(i); });
     }
     g_parallel_script_checks = true;
 
@@ -71,4 +71,25 @@ BOOST_AUTO_TEST_CASE(util_threadnames_test_rename_threaded)
 
 }
 
+BOOST_AUTO_TEST_CASE(util_threadnames_test_pools)
+{
+    BOOST_CHECK_EQUAL(util::ThreadPoolName("scriptch.3"), "scriptch");
+    BOOST_CHECK_EQUAL(util::ThreadPoolName("net.12"), "net");
+    BOOST_CHECK_EQUAL(util::ThreadPoolName("net"), "net");
+    BOOST_CHECK_EQUAL(util::ThreadPoolName("net."), "net.");
+    BOOST_CHECK_EQUAL(util::ThreadPoolName("a.b"), "a.b");
+
+    std::vector<int> cpus;
+    BOOST_CHECK(util::ParseCpuList("0-3,8", cpus));
+    BOOST_CHECK(cpus == std::vector<int>({0, 1, 2, 3, 8}));
+    BOOST_CHECK(util::ParseCpuList("5", cpus));
+    BOOST_CHECK(cpus == std::vector<int>({5}));
+    BOOST_CHECK(!util::ParseCpuList("", cpus));
+    BOOST_CHECK(!util::ParseCpuList("3-1", cpus));
+    BOOST_CHECK(!util::ParseCpuList("0,,1", cpus));
+    BOOST_CHECK(!util::ParseCpuList("-1", cpus));
+    BOOST_CHECK(!util::ParseCpuList("0-", cpus));
+    BOOST_CHECK(!util::ParseCpuList("1024", cpus));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
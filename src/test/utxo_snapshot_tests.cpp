@@ -0,0 +1,210 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <fs.h>
+#include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <txdb.h>
+#include <util/system.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(utxo_snapshot_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(utxo_snapshot_roundtrip)
+{
+    CCoinsViewDB from(GetDataDir() / "snapshot_from", 1 << 20, true, false);
+    std::vector<COutPoint> outpoints;
+    std::vector<uint256> nullifiers;
+    SaplingMerkleTree tree;
+    const uint256 block = InsecureRand256();
+    {
+        CCoinsViewCache cache(&from);
+        for (uint32_t i = 0; i < 300; i++) {
+            outpoints.emplace_back(InsecureRand256(), i);
+            cache.AddCoin(outpoints.back(), Coin(CTxOut(i, CScript() << OP_TRUE), i, i % 2), false);
+            nullifiers.push_back(InsecureRand256());
+            cache.AddNullifier(nullifiers.back(), i);
+            tree.append(InsecureRand256());
+            cache.PushSaplingAnchor(tree);
+        }
+        cache.SetBestBlock(block);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    const fs::path path = GetDataDir() / "snapshot.dat";
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata metadata{from.GetBestBlock(), outpoints.size(), 1};
+        metadata.m_sapling_anchor = from.GetBestAnchor();
+        // Coins are read in uneven ranges, and written in order.
+        std::vector<std::unique_ptr<CCoinsViewCursor>> coins;
+        coins.emplace_back(from.Cursor(0, 0x0f));
+        coins.emplace_back(from.Cursor(0x10, 0x7f));
+        coins.emplace_back(from.Cursor(0x80, 0xff));
+        WriteUTXOSnapshot(file, metadata, coins, *from.NullifierCursor(), *from.SaplingAnchorCursor(), [] {});
+        BOOST_CHECK_EQUAL(metadata.m_nullifiers_count, nullifiers.size());
+        BOOST_CHECK_EQUAL(metadata.m_anchors_count, 300U);
+    }
+
+    // The ranges together hold every coin, in key order.
+    {
+        std::unique_ptr<CCoinsViewCursor> all(from.Cursor());
+        std::unique_ptr<CCoinsViewCursor> high(from.Cursor(0x80, 0xff));
+        size_t count = 0;
+        size_t high_count = 0;
+        COutPoint key;
+        for (; all->Valid(); all->Next()) count++;
+        for (; high->Valid(); high->Next()) {
+            BOOST_CHECK(high->GetKey(key) && *key.hash.begin() >= 0x80);
+            high_count++;
+        }
+        BOOST_CHECK_EQUAL(count, outpoints.size());
+        BOOST_CHECK(high_count > 0 && high_count < count);
+    }
+
+    CCoinsViewDB to(GetDataDir() / "snapshot_to", 1 << 20, true, false);
+    std::string error;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata metadata;
+        BOOST_CHECK(LoadUTXOSnapshot(file, to, metadata, error));
+        BOOST_CHECK(error.empty());
+        BOOST_CHECK(metadata.m_base_blockhash == block);
+    }
+    BOOST_CHECK(to.GetBestBlock() == block);
+    BOOST_CHECK(to.GetBestAnchor() == tree.root());
+    BOOST_CHECK(to.GetHeadBlocks().empty());
+    for (uint32_t i = 0; i < outpoints.size(); i++) {
+        Coin coin;
+        BOOST_CHECK(to.GetCoin(outpoints[i], coin));
+        BOOST_CHECK_EQUAL(coin.out.nValue, i);
+        BOOST_CHECK_EQUAL(coin.nHeight, i);
+        BOOST_CHECK_EQUAL(coin.IsCoinBase(), i % 2 == 1);
+        uint32_t nHeight;
+        BOOST_CHECK(to.GetNullifier(nullifiers[i], nHeight));
+        BOOST_CHECK_EQUAL(nHeight, i);
+    }
+    SaplingMerkleTree loaded;
+    BOOST_CHECK(to.GetSaplingAnchorAt(tree.root(), loaded));
+    BOOST_CHECK(loaded.root() == tree.root());
+
+    // The Sapling state hashes the same, until it changes.
+    uint256 from_hash, to_hash;
+    BOOST_CHECK(HashShieldedState(*from.NullifierCursor(), *from.SaplingAnchorCursor(), from.GetBestAnchor(), from_hash));
+    BOOST_CHECK(HashShieldedState(*to.NullifierCursor(), *to.SaplingAnchorCursor(), to.GetBestAnchor(), to_hash));
+    BOOST_CHECK(from_hash == to_hash);
+    {
+        CCoinsViewCache cache(&to);
+        cache.AddNullifier(InsecureRand256(), 0);
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(HashShieldedState(*to.NullifierCursor(), *to.SaplingAnchorCursor(), to.GetBestAnchor(), to_hash));
+    BOOST_CHECK(from_hash != to_hash);
+
+    // Only an empty database takes a snapshot.
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata metadata;
+        BOOST_CHECK(!LoadUTXOSnapshot(file, to, metadata, error));
+        BOOST_CHECK_EQUAL(error, "Coins database is not empty");
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(utxo_snapshot_activation, TestChain100Setup)
+{
+    const CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    for (int i = 0; i < 10; i++) {
+        CreateAndProcessBlock({}, coinbase_script_pub_key);
+    }
+
+    // Write a snapshot at the tip, as dumptxoutset does.
+    const fs::path path = GetDataDir() / "snapshot.dat";
+    CCoinsStats stats;
+    uint256 shielded_hash;
+    CBlockIndex* base;
+    {
+        LOCK(cs_main);
+        ::ChainstateActive().ForceFlushStateToDisk();
+        CCoinsViewDB& db = ::ChainstateActive().CoinsDB();
+        BOOST_REQUIRE(GetUTXOStats(&db, stats, CoinStatsHashType::MUHASH));
+        BOOST_REQUIRE(HashShieldedState(*db.NullifierCursor(), *db.SaplingAnchorCursor(), db.GetBestAnchor(), shielded_hash));
+        base = ::ChainActive().Tip();
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata metadata{base->GetBlockHash(), stats.coins_count, base->nChainTx};
+        metadata.m_sapling_anchor = db.GetBestAnchor();
+        std::vector<std::unique_ptr<CCoinsViewCursor>> coins;
+        coins.emplace_back(db.Cursor());
+        WriteUTXOSnapshot(file, metadata, coins, *db.NullifierCursor(), *db.SaplingAnchorCursor(), [] {});
+    }
+
+    SnapshotMetadata metadata;
+    uint256 muhash, loaded_shielded_hash;
+    std::string error;
+    BOOST_CHECK(!ActivateSnapshot(path, Params(), metadata, muhash, loaded_shielded_hash, error));
+    BOOST_CHECK_EQUAL(error, "The active chain is not below the base block of the snapshot");
+
+    // Go back to before the last ten blocks, which stay valid and on disk.
+    CBlockIndex* fork = WITH_LOCK(cs_main, return ::ChainActive()[101]);
+    BlockValidationState state;
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), fork));
+    WITH_LOCK(cs_main, ResetBlockFailureFlags(fork));
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return ::ChainActive().Height()), 100);
+
+    // Snapshots that the chain parameters do not pin are refused.
+    BOOST_CHECK(!ActivateSnapshot(path, Params(), metadata, muhash, loaded_shielded_hash, error));
+    BOOST_CHECK(error.find("is not among the UTXO snapshots of the chain parameters") != std::string::npos);
+    const std::string assumeutxo = strprintf("%d:%s:%s:%s:%u", base->nHeight, base->GetBlockHash().GetHex(), stats.muhash.GetHex(), shielded_hash.GetHex(), base->nChainTx);
+    gArgs.ForceSetArg("-assumeutxo", strprintf("%d:%s:%s:%s:%u", base->nHeight, base->GetBlockHash().GetHex(), UINT256_ONE().GetHex(), shielded_hash.GetHex(), base->nChainTx));
+    const std::unique_ptr<const CChainParams> wrong_params = CreateChainParams(CBaseChainParams::REGTEST);
+    BOOST_CHECK(!ActivateSnapshot(path, *wrong_params, metadata, muhash, loaded_shielded_hash, error));
+    BOOST_CHECK(error.find("not to the MuHash3072 of the chain parameters") != std::string::npos);
+    gArgs.ForceSetArg("-assumeutxo", strprintf("%d:%s:%s:%s:%u", base->nHeight, base->GetBlockHash().GetHex(), stats.muhash.GetHex(), UINT256_ONE().GetHex(), base->nChainTx));
+    const std::unique_ptr<const CChainParams> wrong_shielded_params = CreateChainParams(CBaseChainParams::REGTEST);
+    BOOST_CHECK(!ActivateSnapshot(path, *wrong_shielded_params, metadata, muhash, loaded_shielded_hash, error));
+    BOOST_CHECK(error.find("not to the shielded hash of the chain parameters") != std::string::npos);
+    gArgs.ForceSetArg("-assumeutxo", assumeutxo);
+    const std::unique_ptr<const CChainParams> params = CreateChainParams(CBaseChainParams::REGTEST);
+
+    // The chain goes on from the base at once.
+    BOOST_REQUIRE(ActivateSnapshot(path, *params, metadata, muhash, loaded_shielded_hash, error));
+    BOOST_CHECK(muhash == stats.muhash);
+    BOOST_CHECK(loaded_shielded_hash == shielded_hash);
+    BOOST_CHECK_EQUAL(metadata.m_coins_count, stats.coins_count);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(::ChainActive().Tip() == base);
+        BOOST_CHECK(GetSnapshotBaseBlock() == base);
+    }
+    BOOST_CHECK(!ActivateSnapshot(path, *params, metadata, muhash, loaded_shielded_hash, error));
+    BOOST_CHECK_EQUAL(error, "The active chainstate was loaded from a UTXO snapshot already");
+
+    // The background chainstate connects the ten blocks and arrives at the
+    // UTXO set of the snapshot.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (WITH_LOCK(cs_main, return g_background_chainstate != nullptr)) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+    StopSnapshotValidation();
+
+    SnapshotRecord snapshot;
+    BOOST_REQUIRE(pblocktree->ReadSnapshot(snapshot));
+    BOOST_CHECK(snapshot.m_state == SnapshotRecord::VALID);
+    BOOST_CHECK(snapshot.m_muhash == muhash);
+    BOOST_CHECK(snapshot.m_shielded_hash == shielded_hash);
+    BOOST_CHECK(snapshot.m_metadata.m_base_blockhash == base->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
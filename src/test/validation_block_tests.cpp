@@ -12,6 +12,7 @@
 #include <pow.h>
 #include <random.h>
 #include <script/standard.h>
+#include <shutdown.h>
 #include <test/util/setup_common.h>
 #include <util/time.h>
 #include <validation.h>
@@ -28,6 +29,7 @@ struct MinerTestingSetup : public RegTestingSetup {
     std::shared_ptr<const CBlock> BadBlock(const uint256& prev_hash);
     std::shared_ptr<CBlock> FinalizeBlock(std::shared_ptr<CBlock> pblock);
     void BuildChain(const uint256& root, int height, const unsigned int invalid_rate, const unsigned int branch_rate, const unsigned int max_size, std::vector<std::shared_ptr<const CBlock>>& blocks);
+    void ProcessGroup(const std::vector<std::shared_ptr<const CBlock>>& blocks);
 };
 } // namespace validation_block_tests
 
@@ -186,6 +188,22 @@ void MinerTestingSetup::BuildChain(const uint256& root, int height, const unsign
     }
 }
 
+// Process the blocks of a chain so that they are all connected in one step:
+// the first one last, once the others are stored.
+void MinerTestingSetup::ProcessGroup(const std::vector<std::shared_ptr<const CBlock>>& blocks)
+{
+    bool ignored;
+    BlockValidationState state;
+    std::vector<CBlockHeader> headers;
+    std::transform(blocks.begin(), blocks.end(), std::back_inserter(headers), [](std::shared_ptr<const CBlock> b) { return b->GetBlockHeader(); });
+    BOOST_REQUIRE(ProcessNewBlockHeaders(headers, state, Params()));
+
+    for (size_t i = 1; i < blocks.size(); ++i) {
+        BOOST_REQUIRE(ProcessNewBlock(Params(), blocks[i], true, &ignored));
+    }
+    BOOST_REQUIRE(ProcessNewBlock(Params(), blocks.front(), true, &ignored));
+}
+
 BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
 {
     // build a large-ish chain that's likely to have some forks
@@ -378,4 +396,125 @@ BOOST_AUTO_TEST_CASE(mempool_locks_reorg)
         rpc_thread.join();
     }
 }
+
+BOOST_AUTO_TEST_CASE(pipelined_connect_invalid_block)
+{
+    bool ignored;
+    BOOST_REQUIRE(ProcessNewBlock(Params(), std::make_shared<CBlock>(Params().GenesisBlock()), true, &ignored));
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(::ChainstateActive().LoadChainHistory(Params(), true));
+        BOOST_REQUIRE(::ChainstateActive().IsInitialBlockDownload());
+        BOOST_CHECK_EQUAL(::ChainstateActive().PipelineFailedHeight(), -1);
+    }
+
+    // A group of blocks of which the fourth is invalid, in ConnectBlock only
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    uint256 prev_hash = Params().GenesisBlock().GetHash();
+    for (unsigned int i = 0; i < MAX_PIPELINED_BLOCKS; ++i) {
+        blocks.push_back(i == 3 ? BadBlock(prev_hash) : GoodBlock(prev_hash));
+        prev_hash = blocks.back()->GetHash();
+    }
+    ProcessGroup(blocks);
+
+    // The group failed as a whole and was connected again one block at a
+    // time, up to the invalid one.
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(::ChainActive().Tip()->GetBlockHash(), blocks[2]->GetHash());
+    const CBlockIndex* pindex_bad = LookupBlockIndex(blocks[3]->GetHash());
+    BOOST_REQUIRE(pindex_bad);
+    BOOST_CHECK(pindex_bad->nStatus & BLOCK_FAILED_VALID);
+    BOOST_CHECK_EQUAL(::ChainstateActive().PipelineFailedHeight(), (int)MAX_PIPELINED_BLOCKS);
+
+    // The leaves of the failed group are gone, those of the blocks connected
+    // after it appended once.
+    const ChainHistory& history = ::ChainstateActive().m_history;
+    BOOST_CHECK_EQUAL(history.Leaves(), 3U);
+    BOOST_CHECK_EQUAL(history.TipHash(), blocks[2]->GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(pipelined_connect_reorg)
+{
+    bool ignored;
+    auto ProcessBlock = [&ignored](std::shared_ptr<const CBlock> block) -> bool {
+        return ProcessNewBlock(Params(), block, /* fForceProcessing */ true, /* fNewBlock */ &ignored);
+    };
+    BOOST_REQUIRE(ProcessBlock(std::make_shared<CBlock>(Params().GenesisBlock())));
+    WITH_LOCK(cs_main, BOOST_REQUIRE(::ChainstateActive().LoadChainHistory(Params(), true)));
+
+    // Mature the coinbases of the first two blocks, one block at a time
+    std::vector<std::shared_ptr<const CBlock>> mined;
+    mined.push_back(GoodBlock(Params().GenesisBlock().GetHash()));
+    BOOST_REQUIRE(ProcessBlock(mined.back()));
+    for (int i = 0; i < COINBASE_MATURITY; ++i) {
+        mined.push_back(GoodBlock(mined.back()->GetHash()));
+        BOOST_REQUIRE(ProcessBlock(mined.back()));
+    }
+    const uint256 split_hash{mined.back()->GetHash()};
+
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < 2; ++i) {
+        CMutableTransaction mtx;
+        mtx.vin.push_back(CTxIn{COutPoint{mined[i]->vtx[0]->GetHash(), 1}, CScript{}});
+        mtx.vin[0].scriptWitness.stack.push_back(V_OP_TRUE);
+        mtx.vout.push_back(mined[i]->vtx[0]->vout[1]);
+        mtx.vout[0].nValue -= 1000;
+        txs.push_back(MakeTransactionRef(mtx));
+    }
+
+    // The active chain confirms both transactions
+    auto block_a = Block(split_hash);
+    block_a->vtx.insert(block_a->vtx.end(), txs.begin(), txs.end());
+    BOOST_REQUIRE(ProcessBlock(FinalizeBlock(block_a)));
+    BOOST_CHECK_EQUAL(::ChainActive().Tip()->GetBlockHash(), block_a->GetHash());
+
+    // A longer fork confirms one of them in its first block and has an
+    // invalid third block
+    std::vector<std::shared_ptr<const CBlock>> fork;
+    auto block_b = Block(split_hash);
+    block_b->vtx.push_back(txs[0]);
+    fork.push_back(FinalizeBlock(block_b));
+    for (unsigned int i = 1; i < MAX_PIPELINED_BLOCKS; ++i) {
+        fork.push_back(i == 2 ? BadBlock(fork.back()->GetHash()) : GoodBlock(fork.back()->GetHash()));
+    }
+    ProcessGroup(fork);
+
+    // The fork is connected up to the invalid block, and the transaction
+    // only the disconnected block confirmed is back in the mempool.
+    LOCK2(cs_main, m_node.mempool->cs);
+    BOOST_CHECK_EQUAL(::ChainActive().Tip()->GetBlockHash(), fork[1]->GetHash());
+    BOOST_CHECK(LookupBlockIndex(fork[2]->GetHash())->nStatus & BLOCK_FAILED_VALID);
+    BOOST_CHECK_EQUAL(::ChainstateActive().PipelineFailedHeight(), ::ChainActive().Height() + (int)MAX_PIPELINED_BLOCKS - 2);
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 1U);
+    BOOST_CHECK(m_node.mempool->exists(txs[1]->GetHash()));
+    BOOST_CHECK(!m_node.mempool->exists(txs[0]->GetHash()));
+
+    const ChainHistory& history = ::ChainstateActive().m_history;
+    BOOST_CHECK_EQUAL(history.Leaves(), (uint64_t)::ChainActive().Height());
+    BOOST_CHECK_EQUAL(history.TipHash(), fork[1]->GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(pipelined_connect_stopatheight)
+{
+    bool ignored;
+    BOOST_REQUIRE(ProcessNewBlock(Params(), std::make_shared<CBlock>(Params().GenesisBlock()), true, &ignored));
+
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    uint256 prev_hash = Params().GenesisBlock().GetHash();
+    for (unsigned int i = 0; i < MAX_PIPELINED_BLOCKS; ++i) {
+        blocks.push_back(GoodBlock(prev_hash));
+        prev_hash = blocks.back()->GetHash();
+    }
+
+    // The group ends at the stop height, where the node shuts down
+    gArgs.ForceSetArg("-stopatheight", "3");
+    ProcessGroup(blocks);
+    BOOST_CHECK(ShutdownRequested());
+    AbortShutdown();
+    gArgs.ForceSetArg("-stopatheight", "0");
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(::ChainActive().Tip()->GetBlockHash(), blocks[2]->GetHash());
+    BOOST_CHECK_EQUAL(::ChainstateActive().PipelineFailedHeight(), -1);
+}
 BOOST_AUTO_TEST_SUITE_END()
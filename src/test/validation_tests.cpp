@@ -3,7 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <consensus/consensus.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
 #include <net.h>
+#include <txdb.h>
+#include <util/memory.h>
 #include <validation.h>
 
 #include <test/util/setup_common.h>
@@ -74,4 +79,155 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+BOOST_AUTO_TEST_CASE(lookup_block_index_shared)
+{
+    const uint256 genesis = Params().GenesisBlock().GetHash();
+    const CBlockIndex* pindex = LookupBlockIndexShared(genesis);
+    BOOST_CHECK(pindex == WITH_LOCK(cs_main, return LookupBlockIndex(genesis)));
+    BOOST_CHECK(pindex == ::ChainActive().TipSnapshot());
+    BOOST_CHECK(LookupBlockIndexShared(uint256S("01")) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(block_solution_trimming)
+{
+    const CBlockHeader genesis = Params().GenesisBlock().GetBlockHeader();
+    CBlockIndex* pindex = WITH_LOCK(cs_main, return LookupBlockIndex(genesis.GetHash()));
+    BOOST_REQUIRE(pindex);
+
+    // Once the index is written, only the block tree DB holds the solution.
+    ::ChainstateActive().ForceFlushStateToDisk();
+    const BlockSolutionStats before = GetBlockSolutionStats();
+    BOOST_CHECK(before.trimmed >= 1);
+    BOOST_CHECK(pindex->GetSolution() == genesis.nSolution);
+    BOOST_CHECK(pindex->GetBlockHeader().GetHash() == genesis.GetHash());
+    const BlockSolutionStats after = GetBlockSolutionStats();
+    BOOST_CHECK_EQUAL(after.cache_hits + after.cache_misses, before.cache_hits + before.cache_misses + 2);
+    BOOST_CHECK(after.cache_entries >= 1);
+
+    // Writing a trimmed index again keeps its solution.
+    int last_file = 0;
+    BOOST_CHECK(pblocktree->ReadLastBlockFile(last_file));
+    BOOST_CHECK(pblocktree->WriteBatchSync({}, last_file, {pindex}));
+    std::vector<unsigned char> solution;
+    BOOST_CHECK(pblocktree->ReadBlockSolution(genesis.GetHash(), solution));
+    BOOST_CHECK(solution == genesis.nSolution);
+}
+
+BOOST_FIXTURE_TEST_CASE(load_block_index_guts, TestChain100Setup)
+{
+    ::ChainstateActive().ForceFlushStateToDisk();
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+
+    // Load into a separate map, hashing every header, then trusting all but the tip
+    for (const uint256& trusted : {uint256(), tip->pprev->GetBlockHash()}) {
+        std::map<uint256, std::unique_ptr<CBlockIndex>> loaded;
+        auto insert = [&loaded](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull()) return nullptr;
+            auto it = loaded.emplace(hash, nullptr).first;
+            if (!it->second) {
+                it->second = MakeUnique<CBlockIndex>();
+                it->second->phashBlock = &it->first;
+            }
+            return it->second.get();
+        };
+        BOOST_REQUIRE(pblocktree->LoadBlockIndexGuts(Params().GetConsensus(), insert, trusted));
+        BOOST_CHECK_EQUAL(loaded.size(), (size_t)tip->nHeight + 1);
+
+        // Every entry is linked to its parent, down to the genesis block
+        const CBlockIndex* pindex = loaded.at(tip->GetBlockHash()).get();
+        for (int height = tip->nHeight; height >= 0; --height) {
+            BOOST_REQUIRE(pindex);
+            BOOST_CHECK_EQUAL(pindex->nHeight, height);
+            pindex = pindex->pprev;
+        }
+        BOOST_CHECK(pindex == nullptr);
+    }
+}
+
+static std::string CheckBlockResult(const CBlock& block, const std::vector<bool>* tx_checked = nullptr)
+{
+    BlockValidationState state;
+    if (CheckBlock(block, state, Params().GetConsensus(), false, true, tx_checked)) return "";
+    return state.GetRejectReason() + " " + state.GetDebugMessage();
+}
+
+BOOST_AUTO_TEST_CASE(check_block_transactions)
+{
+    // Enough transactions to be checked on the worker threads
+    const size_t count = 4 * MIN_PARALLEL_TX_CHECKS;
+    CBlock block;
+    for (size_t i = 0; i < count; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        if (i == 0) {
+            mtx.vin[0].scriptSig = CScript() << OP_1 << OP_1;
+        } else {
+            mtx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        }
+        mtx.vout.emplace_back(1, CScript() << OP_CHECKSIG << OP_CHECKSIG);
+        block.vtx.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK_EQUAL(CheckBlockResult(block), "");
+
+    // The first of two invalid transactions is the one reported, whether the
+    // transactions are checked in parallel or not
+    CMutableTransaction duplicate_inputs(*block.vtx[count / 2]);
+    duplicate_inputs.vin.push_back(duplicate_inputs.vin[0]);
+    block.vtx[count / 2] = MakeTransactionRef(duplicate_inputs);
+    CMutableTransaction negative_output(*block.vtx[count - 1]);
+    negative_output.vout[0].nValue = -1;
+    block.vtx[count - 1] = MakeTransactionRef(negative_output);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    const std::string first = "bad-txns-inputs-duplicate Transaction check failed (tx hash " + block.vtx[count / 2]->GetHash().ToString() + ") ";
+    BOOST_CHECK_EQUAL(CheckBlockResult(block), first);
+    g_parallel_script_checks = false;
+    BOOST_CHECK_EQUAL(CheckBlockResult(block), first);
+    g_parallel_script_checks = true;
+
+    // Transactions known to have passed CheckTransaction are not checked again
+    std::vector<bool> tx_checked(count, false);
+    tx_checked[count / 2] = true;
+    const std::string second = "bad-txns-vout-negative Transaction check failed (tx hash " + block.vtx[count - 1]->GetHash().ToString() + ") ";
+    BOOST_CHECK_EQUAL(CheckBlockResult(block, &tx_checked), second);
+    tx_checked[count - 1] = true;
+    BOOST_CHECK_EQUAL(CheckBlockResult(block, &tx_checked), "");
+
+    // The legacy sigops are counted in either case
+    CMutableTransaction sigops(*block.vtx[1]);
+    sigops.vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(1) << OP_CHECKMULTISIG;
+    for (size_t i = 0; i < MAX_BLOCK_SIGOPS_COST / WITNESS_SCALE_FACTOR / MAX_PUBKEYS_PER_MULTISIG; i++) {
+        sigops.vout.push_back(sigops.vout[0]);
+    }
+    block.vtx[1] = MakeTransactionRef(sigops);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK_EQUAL(CheckBlockResult(block, &tx_checked), "bad-blk-sigops out-of-bounds SigOpCount");
+    g_parallel_script_checks = false;
+    BOOST_CHECK_EQUAL(CheckBlockResult(block, &tx_checked), "bad-blk-sigops out-of-bounds SigOpCount");
+    g_parallel_script_checks = true;
+}
+
+BOOST_AUTO_TEST_CASE(validation_timing_stats)
+{
+    const ValidationTimingStats before = GetValidationTimingStats(ValidationPhase::EQUIHASH);
+    for (size_t i = 0; i < VALIDATION_TIMING_RECENT + 1; i++) {
+        RecordValidationTime(ValidationPhase::EQUIHASH, 100);
+    }
+    RecordValidationTime(ValidationPhase::EQUIHASH, 101);
+    RecordValidationTime(ValidationPhase::EQUIHASH, VALIDATION_TIMING_BOUNDS.back() + 1);
+
+    const ValidationTimingStats stats = GetValidationTimingStats(ValidationPhase::EQUIHASH);
+    BOOST_CHECK_EQUAL(stats.count, before.count + VALIDATION_TIMING_RECENT + 3);
+    BOOST_CHECK_EQUAL(stats.total_us, before.total_us + 100 * (VALIDATION_TIMING_RECENT + 1) + 101 + VALIDATION_TIMING_BOUNDS.back() + 1);
+    // A timing equal to a bound is counted in that bound's bucket
+    BOOST_CHECK_EQUAL(stats.histogram[0], before.histogram[0] + VALIDATION_TIMING_RECENT + 1);
+    BOOST_CHECK_EQUAL(stats.histogram[1], before.histogram[1] + 1);
+    BOOST_CHECK_EQUAL(stats.histogram.back(), before.histogram.back() + 1);
+    BOOST_CHECK_EQUAL(stats.recent_us.size(), VALIDATION_TIMING_RECENT);
+    BOOST_CHECK_EQUAL(stats.recent_us.back(), VALIDATION_TIMING_BOUNDS.back() + 1);
+    BOOST_CHECK_EQUAL(stats.recent_us[stats.recent_us.size() - 2], 101);
+    BOOST_CHECK_EQUAL(std::string(ValidationPhaseName(ValidationPhase::PROOFS)), "proof_verification");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
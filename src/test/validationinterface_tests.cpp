@@ -8,8 +8,11 @@
 #include <scheduler.h>
 #include <test/util/setup_common.h>
 #include <util/check.h>
+#include <validation.h>
 #include <validationinterface.h>
 
+#include <future>
+
 BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, TestingSetup)
 
 struct TestSubscriberNoop final : public CValidationInterface {
@@ -91,4 +94,100 @@ BOOST_AUTO_TEST_CASE(unregister_all_during_call)
     BOOST_CHECK(destroyed);
 }
 
+class TestTipInterface final : public CValidationInterface
+{
+public:
+    explicit TestTipInterface(std::function<void()> on_tip) : m_on_tip(std::move(on_tip)) {}
+    void UpdatedBlockTip(const CBlockIndex*, const CBlockIndex*, bool) override { m_on_tip(); }
+    std::function<void()> m_on_tip;
+};
+
+BOOST_AUTO_TEST_CASE(unregister_waits_for_running_callback)
+{
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    std::promise<void> entered;
+    std::future<void> in_call = entered.get_future();
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<bool> done{false};
+    TestTipInterface blocked([&] {
+        entered.set_value();
+        released.wait();
+        done = true;
+    });
+    RegisterValidationInterface(&blocked, "blocked");
+    GetMainSignals().UpdatedBlockTip(tip, nullptr, false);
+    in_call.wait();
+
+    // The subscriber may be destroyed once it is unregistered, so that waits for the callback.
+    std::future<void> unregistered = std::async(std::launch::async, [&] { UnregisterValidationInterface(&blocked); });
+    BOOST_CHECK(unregistered.wait_for(std::chrono::milliseconds{50}) == std::future_status::timeout);
+    release.set_value();
+    unregistered.wait();
+    BOOST_CHECK(done);
+
+    // A subscriber unregistering itself in a callback does not wait for itself.
+    TestTipInterface self(nullptr);
+    self.m_on_tip = [&self] { UnregisterValidationInterface(&self); };
+    RegisterValidationInterface(&self, "self");
+    GetMainSignals().UpdatedBlockTip(tip, nullptr, false);
+    SyncWithValidationInterfaceQueue();
+    for (const ValidationQueueInfo& info : GetMainSignals().GetQueueInfo()) {
+        BOOST_CHECK(info.name != "self");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(subscriber_queues)
+{
+    // Run the callbacks on threads of their own instead of the scheduler thread
+    SyncWithValidationInterfaceQueue();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+    GetMainSignals().RegisterBackgroundSignalScheduler(*m_node.scheduler, 2);
+
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<int> slow_calls{0};
+    std::atomic<int> fast_calls{0};
+    auto slow = std::make_shared<TestTipInterface>([&] { released.wait(); ++slow_calls; });
+    auto fast = std::make_shared<TestTipInterface>([&] { ++fast_calls; });
+    RegisterSharedValidationInterface(slow, "slow");
+    RegisterSharedValidationInterface(fast, "fast");
+
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    for (int i = 0; i < 3; i++) {
+        GetMainSignals().UpdatedBlockTip(tip, nullptr, false);
+    }
+
+    // The fast subscriber catches up while the slow one is stuck on its first callback
+    SyncWithValidationInterfaceQueue(*fast);
+    BOOST_CHECK_EQUAL(fast_calls.load(), 3);
+    BOOST_CHECK_EQUAL(slow_calls.load(), 0);
+    // The slow subscriber is within this bound already
+    LimitValidationInterfaceQueue(3);
+
+    std::vector<ValidationQueueInfo> info = GetMainSignals().GetQueueInfo();
+    BOOST_REQUIRE_EQUAL(info.size(), 2U);
+    BOOST_CHECK_EQUAL(info[0].name, "slow");
+    BOOST_CHECK(info[0].pending >= 2);
+    BOOST_CHECK_EQUAL(info[0].callbacks_run, 0U);
+    BOOST_CHECK_EQUAL(info[1].name, "fast");
+    BOOST_CHECK_EQUAL(info[1].pending, 0U);
+    BOOST_CHECK_EQUAL(info[1].callbacks_run, 3U);
+    BOOST_CHECK(GetMainSignals().CallbacksPending() >= 2);
+
+    // A function queued now follows the callbacks of every subscriber
+    std::promise<void> called;
+    std::future<void> call = called.get_future();
+    CallFunctionInValidationInterfaceQueue([&] { called.set_value(); });
+    BOOST_CHECK(call.wait_for(std::chrono::milliseconds{50}) == std::future_status::timeout);
+    release.set_value();
+    call.wait();
+    BOOST_CHECK_EQUAL(slow_calls.load(), 3);
+
+    UnregisterAllValidationInterfaces();
+    GetMainSignals().FlushBackgroundCallbacks();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+    GetMainSignals().RegisterBackgroundSignalScheduler(*m_node.scheduler);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -11,6 +11,7 @@
 #include <util/system.h>
 #include <crypto/hmac_sha256.h>
 
+#include <algorithm>
 #include <vector>
 #include <deque>
 #include <set>
@@ -415,6 +416,8 @@ public:
 
     /** Get name of file to store private key in */
     fs::path GetPrivateKeyFile();
+    /** Get name of file to store the service ID of a kept onion in */
+    fs::path GetServiceIdFile();
 
     /** Reconnect, after getting disconnected */
     void Reconnect();
@@ -424,6 +427,8 @@ private:
     TorControlConnection conn;
     std::string private_key;
     std::string service_id;
+    /** Whether the onion is detached from the control connection, see -torkeeponion */
+    bool keep_onion;
     bool reconnect;
     struct event *reconnect_ev;
     float reconnect_timeout;
@@ -433,6 +438,9 @@ private:
     /** ClientNonce for SAFECOOKIE auth */
     std::vector<uint8_t> clientNonce;
 
+    /** Advertise the service of service_id */
+    void AdvertiseService();
+
     /** Callback for ADD_ONION result */
     void add_onion_cb(TorControlConnection& conn, const TorControlReply& reply);
     /** Callback for AUTHENTICATE result */
@@ -452,7 +460,7 @@ private:
 
 TorController::TorController(struct event_base* _base, const std::string& _target):
     base(_base),
-    target(_target), conn(base), reconnect(true), reconnect_ev(0),
+    target(_target), conn(base), keep_onion(gArgs.GetBoolArg("-torkeeponion", DEFAULT_TOR_KEEP_ONION)), reconnect(true), reconnect_ev(0),
     reconnect_timeout(RECONNECT_TIMEOUT_START)
 {
     reconnect_ev = event_new(base, -1, 0, reconnect_cb, this);
@@ -468,6 +476,9 @@ TorController::TorController(struct event_base* _base, const std::string& _targe
     if (pkf.first) {
         LogPrint(BCLog::TOR, "tor: Reading cached private key from %s\n", GetPrivateKeyFile().string());
         private_key = pkf.second;
+        // A kept onion may still be up, in which case Tor does not tell its ID again
+        std::pair<bool,std::string> sif = ReadBinaryFile(GetServiceIdFile());
+        if (keep_onion && sif.first) service_id = sif.second;
     }
 }
 
@@ -501,15 +512,22 @@ void TorController::add_onion_cb(TorControlConnection& _conn, const TorControlRe
             }
             return;
         }
-        service = LookupNumeric(std::string(service_id+".onion"), Params().GetDefaultPort());
-        LogPrintf("tor: Got service ID %s, advertising service %s\n", service_id, service.ToString());
         if (WriteBinaryFile(GetPrivateKeyFile(), private_key)) {
             LogPrint(BCLog::TOR, "tor: Cached service private key to %s\n", GetPrivateKeyFile().string());
         } else {
             LogPrintf("tor: Error writing service private key to %s\n", GetPrivateKeyFile().string());
         }
-        AddLocal(service, LOCAL_MANUAL);
+        if (keep_onion && !WriteBinaryFile(GetServiceIdFile(), service_id)) {
+            LogPrintf("tor: Error writing service ID to %s\n", GetServiceIdFile().string());
+        }
+        AdvertiseService();
         // ... onion requested - keep connection open
+    } else if (reply.code == 550 && keep_onion && !service_id.empty() &&
+               std::any_of(reply.lines.begin(), reply.lines.end(), [](const std::string& s) { return s.find("collision") != std::string::npos; })) {
+        // The service of our key is still up from an earlier connection,
+        // as it was detached, and its descriptor is likely still published.
+        LogPrint(BCLog::TOR, "tor: Service %s is still up\n", service_id);
+        AdvertiseService();
     } else if (reply.code == 510) { // 510 Unrecognized command
         LogPrintf("tor: Add onion failed with unrecognized command (You probably need to upgrade Tor)\n");
     } else {
@@ -517,6 +535,13 @@ void TorController::add_onion_cb(TorControlConnection& _conn, const TorControlRe
     }
 }
 
+void TorController::AdvertiseService()
+{
+    service = LookupNumeric(std::string(service_id+".onion"), Params().GetDefaultPort());
+    LogPrintf("tor: Got service ID %s, advertising service %s\n", service_id, service.ToString());
+    AddLocal(service, LOCAL_MANUAL);
+}
+
 void TorController::auth_cb(TorControlConnection& _conn, const TorControlReply& reply)
 {
     if (reply.code == 250) {
@@ -536,7 +561,9 @@ void TorController::auth_cb(TorControlConnection& _conn, const TorControlReply&
             private_key = "NEW:RSA1024"; // Explicitly request RSA1024 - see issue #9214
         // Request hidden service, redirect port.
         // Note that the 'virtual' port is always the default port to avoid decloaking nodes using other ports.
-        _conn.Command(strprintf("ADD_ONION %s Port=%i,127.0.0.1:%i", private_key, Params().GetDefaultPort(), GetListenPort()),
+        // A detached service outlives the control connection, so that it is
+        // reachable as soon as we are back after reconnecting or restarting.
+        _conn.Command(strprintf("ADD_ONION %s%s Port=%i,127.0.0.1:%i", private_key, keep_onion ? " Flags=Detach" : "", Params().GetDefaultPort(), GetListenPort()),
             std::bind(&TorController::add_onion_cb, this, std::placeholders::_1, std::placeholders::_2));
     } else {
         LogPrintf("tor: Authentication failed\n");
@@ -721,6 +748,11 @@ fs::path TorController::GetPrivateKeyFile()
     return GetDataDir() / "onion_private_key";
 }
 
+fs::path TorController::GetServiceIdFile()
+{
+    return GetDataDir() / "onion_service_id";
+}
+
 void TorController::reconnect_cb(evutil_socket_t fd, short what, void *arg)
 {
     TorController *self = static_cast<TorController*>(arg);
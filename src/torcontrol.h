@@ -11,6 +11,8 @@
 
 extern const std::string DEFAULT_TOR_CONTROL;
 static const bool DEFAULT_LISTEN_ONION = true;
+//! Default for -torkeeponion
+static const bool DEFAULT_TOR_KEEP_ONION = false;
 
 void StartTorControl();
 void InterruptTorControl();
@@ -5,31 +5,43 @@
 
 #include <txdb.h>
 
+#include <memusage.h>
+#include <node/utxo_snapshot.h>
 #include <pow.h>
 #include <random.h>
 #include <shutdown.h>
 #include <ui_interface.h>
 #include <uint256.h>
+#include <util/memory.h>
 #include <util/system.h>
 #include <util/translation.h>
 #include <util/vector.h>
+#include <warnings.h>
 
+#include <algorithm>
+#include <functional>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
-static const char DB_NOTE = 'N';
-static const char DB_NOTES = 'n';
+static const char DB_SAPLING_NULLIFIER = 'S';
+static const char DB_NULLIFIER_FILTER = 'U';
+static const char DB_SAPLING_ANCHOR = 'Z';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
+static const char DB_BEST_SAPLING_ANCHOR = 'z';
 static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_HISTORY_NODE = 'M';
+static const char DB_HISTORY_STATE = 'm';
+static const char DB_SNAPSHOT = 'A';
 
 namespace {
 
@@ -53,53 +65,151 @@ struct CoinEntry {
     }
 };
 
-struct NoteEntry {
-    uint256 nullifier;
-    char key;
-    explicit NoteEntry(const uint256 nullifierIn) : nullifier(nullifierIn), key(DB_NOTE)  {}
+}
 
-    template<typename Stream>
-    void Serialize(Stream &s) const {
-        s << key;
-        s << nullifier;
-    }
+//! Nullifiers a freshly built filter has room for at least
+static const uint64_t MIN_NULLIFIER_FILTER_CAPACITY = 100000;
 
-    template<typename Stream>
-    void Unserialize(Stream& s) {
-        s >> key;
-        s >> nullifier;
+//! LevelDB tuning of the coins database, from -dbblockcache and -dbbloombits
+static DBTuning GetCoinsDBTuning()
+{
+    DBTuning tuning;
+    tuning.block_cache_percent = std::max<int64_t>(10, std::min<int64_t>(90, gArgs.GetArg("-dbblockcache", tuning.block_cache_percent)));
+    tuning.bloom_bits = std::max<int64_t>(0, std::min<int64_t>(30, gArgs.GetArg("-dbbloombits", tuning.bloom_bits)));
+    return tuning;
+}
+
+CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe) : db(ldb_path, nCacheSize, fMemory, fWipe, true, GetCoinsDBTuning())
+{
+    // The filter is stored with the best block it was written at, and is
+    // only trusted if that is still the best block.
+    std::pair<uint256, CNullifierFilter> stored;
+    if (!db.Read(DB_NULLIFIER_FILTER, stored) || stored.first.IsNull() || stored.first != GetBestBlock()) {
+        RebuildNullifierFilter();
+    } else {
+        m_nullifier_filter = std::move(stored.second);
     }
-};
+}
 
+void CCoinsViewDB::RebuildNullifierFilter()
+{
+    std::vector<uint256> nullifiers;
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    std::pair<char, uint256> key;
+    for (pcursor->Seek(DB_SAPLING_NULLIFIER); pcursor->Valid(); pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.first != DB_SAPLING_NULLIFIER) break;
+        nullifiers.push_back(key.second);
+    }
+    m_nullifier_filter = CNullifierFilter(std::max<uint64_t>(MIN_NULLIFIER_FILTER_CAPACITY, 2 * nullifiers.size()));
+    for (const uint256& nullifier : nullifiers) {
+        m_nullifier_filter.insert(nullifier);
+    }
+    LogPrint(BCLog::COINDB, "Built nullifier filter for %u of %u nullifiers\n", (unsigned int)nullifiers.size(), (unsigned int)m_nullifier_filter.GetCapacity());
 }
 
-CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe) : db(ldb_path, nCacheSize, fMemory, fWipe, true)
+CCoinsViewDB::~CCoinsViewDB()
 {
+    {
+        LOCK(m_pending_mutex);
+        m_stop_writer = true;
+    }
+    m_pending_cv.notify_all();
+    if (m_thread_write.joinable()) m_thread_write.join();
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        LOCK(m_pending_mutex);
+        if (m_pending) {
+            CCoinsMap::const_iterator it = m_pending->coins.find(outpoint);
+            if (it != m_pending->coins.end()) {
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
-bool CCoinsViewDB::GetNote(const uint256 &nullifier, Note &note) const {
-    return db.Read(NoteEntry(nullifier), note);
+bool CCoinsViewDB::GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const {
+    {
+        LOCK(m_pending_mutex);
+        if (m_pending) {
+            const CNullifiersCacheEntry* entry = m_pending->nullifiers.find(nullifier);
+            if (entry) {
+                nHeight = entry->nHeight;
+                return entry->entered;
+            }
+        }
+    }
+    if (!m_nullifier_filter.contains(nullifier)) return false;
+    return db.Read(std::make_pair(DB_SAPLING_NULLIFIER, nullifier), nHeight);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    {
+        LOCK(m_pending_mutex);
+        if (m_pending) {
+            CCoinsMap::const_iterator it = m_pending->coins.find(outpoint);
+            if (it != m_pending->coins.end()) return !it->second.coin.IsSpent();
+        }
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
-bool CCoinsViewDB::HaveNote(const uint256 &nullifier) const {
-    return db.Exists(NoteEntry(nullifier));
+bool CCoinsViewDB::HaveNullifier(const uint256 &nullifier) const {
+    {
+        LOCK(m_pending_mutex);
+        if (m_pending) {
+            const CNullifiersCacheEntry* entry = m_pending->nullifiers.find(nullifier);
+            if (entry) return entry->entered;
+        }
+    }
+    if (!m_nullifier_filter.contains(nullifier)) return false;
+    return db.Exists(std::make_pair(DB_SAPLING_NULLIFIER, nullifier));
+}
+
+bool CCoinsViewDB::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const {
+    if (rt == SaplingMerkleTree::empty_root()) {
+        tree = SaplingMerkleTree();
+        return true;
+    }
+    {
+        LOCK(m_pending_mutex);
+        if (m_pending) {
+            CAnchorsSaplingMap::const_iterator it = m_pending->anchors.find(rt);
+            if (it != m_pending->anchors.end()) {
+                if (!it->second.entered) return false;
+                tree = it->second.tree;
+                return true;
+            }
+        }
+    }
+    return db.Read(std::make_pair(DB_SAPLING_ANCHOR, rt), tree);
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    {
+        LOCK(m_pending_mutex);
+        if (m_pending) return m_pending->hashBlock;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
     return hashBestChain;
 }
 
+uint256 CCoinsViewDB::GetBestAnchor() const {
+    {
+        LOCK(m_pending_mutex);
+        if (m_pending && !m_pending->hashSaplingAnchor.IsNull()) return m_pending->hashSaplingAnchor;
+    }
+    uint256 hashBestAnchor;
+    if (!db.Read(DB_BEST_SAPLING_ANCHOR, hashBestAnchor))
+        return uint256();
+    return hashBestAnchor;
+}
+
 std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     std::vector<uint256> vhashHeadBlocks;
     if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
@@ -108,7 +218,124 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, CNullifiersMap &mapSaplingNullifiers, CAnchorsSaplingMap &mapSaplingAnchors, const uint256 &hashSaplingAnchor, bool erase) {
+    // Writes are applied in order, each on top of the one before.
+    if (!SyncBackgroundWrite()) return false;
+
+    // The filter is only updated here, so that the background writer and
+    // the readers never see it change under them.
+    for (const CNullifiersMap::value_type& entry : mapSaplingNullifiers) {
+        if ((entry.second.flags & CNullifiersCacheEntry::DIRTY) && entry.second.entered) {
+            m_nullifier_filter.insert(entry.first);
+        }
+    }
+    // A full filter is rebuilt from db, which needs the write to be done.
+    if (!m_background_writes || m_nullifier_filter.IsFull()) {
+        return WriteCoins(mapCoins, hashBlock, mapSaplingNullifiers, mapSaplingAnchors, hashSaplingAnchor, erase);
+    }
+
+    std::unique_ptr<PendingWrite> pending = MakeUnique<PendingWrite>();
+    pending->hashBlock = hashBlock;
+    pending->hashSaplingAnchor = hashSaplingAnchor;
+    size_t coins_usage = 0;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) continue;
+        CCoinsCacheEntry& entry = pending->coins[it->first];
+        if (erase) {
+            entry.coin = std::move(it->second.coin);
+        } else {
+            entry.coin = it->second.coin;
+        }
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        coins_usage += entry.coin.DynamicMemoryUsage();
+    }
+    for (const CNullifiersMap::value_type& entry : mapSaplingNullifiers) {
+        if (entry.second.flags & CNullifiersCacheEntry::DIRTY) *pending->nullifiers.emplace(entry.first).first = entry.second;
+    }
+    if (erase) mapSaplingNullifiers.clear();
+    for (CAnchorsSaplingMap::iterator it = mapSaplingAnchors.begin(); it != mapSaplingAnchors.end(); it = erase ? mapSaplingAnchors.erase(it) : std::next(it)) {
+        if (it->second.flags & CAnchorsSaplingCacheEntry::DIRTY) pending->anchors.insert(*it);
+    }
+    pending->usage = coins_usage + memusage::DynamicUsage(pending->coins) +
+        pending->nullifiers.DynamicMemoryUsage() + memusage::DynamicUsage(pending->anchors);
+    LogPrint(BCLog::COINDB, "Handing %u changed transaction outputs to the background writer\n", (unsigned int)pending->coins.size());
+
+    {
+        LOCK(m_pending_mutex);
+        m_pending = std::move(pending);
+        if (!m_thread_write.joinable()) {
+            m_thread_write = std::thread(&TraceThread<std::function<void()>>, "dbwrite", std::bind(&CCoinsViewDB::ThreadWrite, this));
+        }
+    }
+    m_pending_cv.notify_all();
+    return true;
+}
+
+void CCoinsViewDB::ThreadWrite()
+{
+    while (true) {
+        PendingWrite* pending;
+        {
+            WAIT_LOCK(m_pending_mutex, lock);
+            m_pending_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_pending_mutex) { return (m_pending && !m_background_write_failed) || m_stop_writer; });
+            // Finish the write in progress before stopping.
+            if (!m_pending || m_background_write_failed) return;
+            pending = m_pending.get();
+        }
+
+        // Only this thread releases m_pending, and BatchWrite waits for that
+        // before handing over the next write, so it can be used unlocked.
+        bool ret;
+        try {
+            ret = WriteCoins(pending->coins, pending->hashBlock, pending->nullifiers, pending->anchors, pending->hashSaplingAnchor, false);
+        } catch (const std::runtime_error& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+            ret = false;
+        }
+        if (!ret) {
+            // The changes are not in db, so keep them readable until shutdown.
+            {
+                LOCK(m_pending_mutex);
+                m_background_write_failed = true;
+            }
+            m_pending_cv.notify_all();
+            const std::string strMessage = "Failed to write to coin database";
+            SetMiscWarning(strMessage);
+            LogPrintf("*** %s\n", strMessage);
+            uiInterface.ThreadSafeMessageBox(_("Error: A fatal internal error occurred, see debug.log for details").translated, "", CClientUIInterface::MSG_ERROR | CClientUIInterface::MSG_NOPREFIX);
+            StartShutdown();
+            return;
+        }
+
+        std::unique_ptr<PendingWrite> done;
+        {
+            LOCK(m_pending_mutex);
+            done = std::move(m_pending);
+        }
+        m_pending_cv.notify_all();
+    }
+}
+
+bool CCoinsViewDB::SyncBackgroundWrite() const
+{
+    WAIT_LOCK(m_pending_mutex, lock);
+    m_pending_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_pending_mutex) { return !m_pending || m_background_write_failed; });
+    return !m_background_write_failed;
+}
+
+size_t CCoinsViewDB::PendingWriteUsage() const
+{
+    LOCK(m_pending_mutex);
+    return m_pending ? m_pending->usage : 0;
+}
+
+bool CCoinsViewDB::BackgroundWritePending() const
+{
+    LOCK(m_pending_mutex);
+    return m_pending != nullptr;
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, CNullifiersMap &mapSaplingNullifiers, CAnchorsSaplingMap &mapSaplingAnchors, const uint256 &hashSaplingAnchor, bool erase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -116,7 +343,9 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
     assert(!hashBlock.IsNull());
 
-    uint256 old_tip = GetBestBlock();
+    // Read from db, as GetBestBlock already reports a background write.
+    uint256 old_tip;
+    db.Read(DB_BEST_BLOCK, old_tip);
     if (old_tip.IsNull()) {
         // We may be in the middle of replaying.
         std::vector<uint256> old_heads = GetHeadBlocks();
@@ -144,7 +373,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
         count++;
         CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (erase) mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -159,12 +388,45 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
     }
 
+    // The Sapling nullifiers and anchors go out with the final batch, together
+    // with the best anchor that refers to them, so that an interrupted write
+    // leaves the tree of the old best anchor in place for ReplayBlocks.
+    for (const CNullifiersMap::value_type& entry : mapSaplingNullifiers) {
+        if (entry.second.flags & CNullifiersCacheEntry::DIRTY) {
+            if (entry.second.entered)
+                batch.Write(std::make_pair(DB_SAPLING_NULLIFIER, entry.first), entry.second.nHeight);
+            else
+                batch.Erase(std::make_pair(DB_SAPLING_NULLIFIER, entry.first));
+        }
+    }
+    if (erase) mapSaplingNullifiers.clear();
+    for (CAnchorsSaplingMap::iterator it = mapSaplingAnchors.begin(); it != mapSaplingAnchors.end(); it = erase ? mapSaplingAnchors.erase(it) : std::next(it)) {
+        if (it->second.flags & CAnchorsSaplingCacheEntry::DIRTY) {
+            if (it->second.entered)
+                batch.Write(std::make_pair(DB_SAPLING_ANCHOR, it->first), it->second.tree);
+            else
+                batch.Erase(std::make_pair(DB_SAPLING_ANCHOR, it->first));
+        }
+    }
+    if (!hashSaplingAnchor.IsNull()) {
+        batch.Write(DB_BEST_SAPLING_ANCHOR, hashSaplingAnchor);
+    }
+
     // In the last batch, mark the database as consistent with hashBlock again.
     batch.Erase(DB_HEAD_BLOCKS);
     batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (!m_nullifier_filter.IsFull()) {
+        batch.Write(DB_NULLIFIER_FILTER, std::make_pair(hashBlock, m_nullifier_filter));
+    }
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
+    if (ret && m_nullifier_filter.IsFull()) {
+        // Grow the filter now that all nullifiers are in db. Until it is
+        // written, a restart rebuilds it as well.
+        RebuildNullifierFilter();
+        ret = db.Write(DB_NULLIFIER_FILTER, std::make_pair(hashBlock, m_nullifier_filter));
+    }
     LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return ret;
 }
@@ -172,7 +434,8 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1)) +
-           db.EstimateSize(DB_NOTE, (char)(DB_NOTE+1));
+           db.EstimateSize(DB_SAPLING_NULLIFIER, (char)(DB_SAPLING_NULLIFIER+1)) +
+           db.EstimateSize(DB_SAPLING_ANCHOR, (char)(DB_SAPLING_ANCHOR+1));
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -199,19 +462,22 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
+    return Cursor(0, 0xff);
+}
+
+CCoinsViewCursor *CCoinsViewDB::Cursor(uint8_t first, uint8_t last) const
+{
+    // The cursor walks db only.
+    SyncBackgroundWrite();
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock(), last);
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COIN);
+    uint256 start;
+    *start.begin() = first;
+    i->pcursor->Seek(std::make_pair(DB_COIN, start));
     // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
-    } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
-    }
+    i->ReadKey();
     return i;
 }
 
@@ -243,15 +509,116 @@ bool CCoinsViewDBCursor::Valid() const
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
+    ReadKey();
+}
+
+void CCoinsViewDBCursor::ReadKey()
+{
     CoinEntry entry(&keyTmp.second);
-    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
+    if (!pcursor->Valid() || !pcursor->GetKey(entry) || *keyTmp.second.hash.begin() > last) {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
     } else {
         keyTmp.first = entry.key;
     }
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+std::unique_ptr<CCoinsViewDBShieldedCursor> CCoinsViewDB::NullifierCursor() const
+{
+    SyncBackgroundWrite();
+    return std::unique_ptr<CCoinsViewDBShieldedCursor>(new CCoinsViewDBShieldedCursor(const_cast<CDBWrapper&>(db).NewIterator(), DB_SAPLING_NULLIFIER));
+}
+
+std::unique_ptr<CCoinsViewDBShieldedCursor> CCoinsViewDB::SaplingAnchorCursor() const
+{
+    SyncBackgroundWrite();
+    return std::unique_ptr<CCoinsViewDBShieldedCursor>(new CCoinsViewDBShieldedCursor(const_cast<CDBWrapper&>(db).NewIterator(), DB_SAPLING_ANCHOR));
+}
+
+void CCoinsViewDBShieldedCursor::Rewind()
+{
+    m_cursor->Seek(m_prefix);
+    ReadKey();
+}
+
+void CCoinsViewDBShieldedCursor::Next()
+{
+    m_cursor->Next();
+    ReadKey();
+}
+
+void CCoinsViewDBShieldedCursor::ReadKey()
+{
+    if (!m_cursor->Valid() || !m_cursor->GetKey(m_key)) {
+        m_key.first = 0; // Make sure Valid() returns false
+    }
+}
+
+bool CCoinsViewDB::BeginSnapshotLoad(const uint256& hashBlock)
+{
+    if (!SyncBackgroundWrite()) return false;
+    if (!GetBestBlock().IsNull() || !GetHeadBlocks().empty()) return false;
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_COIN);
+    std::pair<char, COutPoint> key;
+    if (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_COIN) return false;
+
+    // An empty old tip makes ReplayBlocks start over from genesis.
+    return db.Write(DB_HEAD_BLOCKS, Vector(hashBlock, uint256()), true);
+}
+
+bool CCoinsViewDB::WriteSnapshotChunk(const std::vector<std::pair<COutPoint, Coin>>& coins,
+                                      const std::vector<std::pair<uint256, uint32_t>>& nullifiers,
+                                      const std::vector<std::pair<uint256, SaplingMerkleTree>>& anchors)
+{
+    CDBBatch batch(db);
+    const size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    auto write = [&](bool last) {
+        if (!last && batch.SizeEstimate() <= batch_size) return true;
+        bool ret = db.WriteBatch(batch);
+        batch.Clear();
+        return ret;
+    };
+    for (const auto& coin : coins) {
+        batch.Write(CoinEntry(&coin.first), coin.second);
+        if (!write(false)) return false;
+    }
+    for (const auto& nullifier : nullifiers) {
+        batch.Write(std::make_pair(DB_SAPLING_NULLIFIER, nullifier.first), nullifier.second);
+        if (!write(false)) return false;
+    }
+    for (const auto& anchor : anchors) {
+        batch.Write(std::make_pair(DB_SAPLING_ANCHOR, anchor.first), anchor.second);
+        if (!write(false)) return false;
+    }
+    return write(true);
+}
+
+bool CCoinsViewDB::FinishSnapshotLoad(const uint256& hashBlock, const uint256& hashSaplingAnchor)
+{
+    // The nullifiers were written around the filter.
+    RebuildNullifierFilter();
+    CDBBatch batch(db);
+    if (!hashSaplingAnchor.IsNull()) {
+        batch.Write(DB_BEST_SAPLING_ANCHOR, hashSaplingAnchor);
+    }
+    batch.Erase(DB_HEAD_BLOCKS);
+    batch.Write(DB_BEST_BLOCK, hashBlock);
+    batch.Write(DB_NULLIFIER_FILTER, std::make_pair(hashBlock, m_nullifier_filter));
+    return db.WriteBatch(batch, true);
+}
+
+static void WriteHistoryChanges(CDBBatch& batch, const HistoryChanges& history)
+{
+    for (const auto& node : history.nodes) {
+        batch.Write(std::make_pair(DB_HISTORY_NODE, node.first), MakeSpan(*node.second));
+    }
+    for (HistoryIndex index = history.erase_begin; index < history.erase_end; ++index) {
+        batch.Erase(std::make_pair(DB_HISTORY_NODE, index));
+    }
+    batch.Write(DB_HISTORY_STATE, history.state);
+}
+
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo, const HistoryChanges* history) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
@@ -260,9 +627,25 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    if (history) WriteHistoryChanges(batch, *history);
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::WriteHistory(const HistoryChanges& history) {
+    CDBBatch batch(*this);
+    WriteHistoryChanges(batch, history);
+    return WriteBatch(batch, true);
+}
+
+bool CBlockTreeDB::ReadHistoryState(HistoryState& state) {
+    return Read(DB_HISTORY_STATE, state);
+}
+
+bool CBlockTreeDB::ReadHistoryNode(HistoryIndex index, HistoryNode& node) {
+    Span<unsigned char> span = MakeSpan(node);
+    return Read(std::make_pair(DB_HISTORY_NODE, index), span);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -275,57 +658,146 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+bool CBlockTreeDB::WriteSnapshot(const SnapshotRecord& snapshot)
+{
+    return Write(DB_SNAPSHOT, snapshot, true);
+}
+
+bool CBlockTreeDB::ReadSnapshot(SnapshotRecord& snapshot)
 {
+    return Read(DB_SNAPSHOT, snapshot);
+}
+
+bool CBlockTreeDB::EraseSnapshot()
+{
+    return Erase(DB_SNAPSHOT, true);
+}
+
+bool CBlockTreeDB::ReadBlockSolution(const uint256& hash, std::vector<unsigned char>& solution)
+{
+    CDiskBlockIndex diskindex;
+    if (!Read(std::make_pair(DB_BLOCK_INDEX, hash), diskindex)) return false;
+    solution = std::move(diskindex.Solution());
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, const uint256& hash_trusted)
+{
+    // Entries up to the height of hash_trusted are taken as keyed, without
+    // hashing their headers again.
+    int trusted_height = -1;
+    if (!hash_trusted.IsNull()) {
+        CDiskBlockIndex trusted;
+        if (Read(std::make_pair(DB_BLOCK_INDEX, hash_trusted), trusted)) trusted_height = trusted.nHeight;
+    }
+
+    struct PendingIndex {
+        uint256 hash;
+        std::vector<unsigned char> value;
+        CDiskBlockIndex diskindex;
+        bool decoded{false};
+        bool consistent{false};
+    };
+    // Decoding and hashing the headers is most of the work, so each batch of
+    // entries is spread over threads, and then inserted in DB order.
+    auto decode = [trusted_height](std::vector<PendingIndex>& batch, size_t first, size_t step) {
+        for (size_t i = first; i < batch.size(); i += step) {
+            PendingIndex& entry = batch[i];
+            try {
+                SpanReader(SER_DISK, CLIENT_VERSION, Span<const unsigned char>(entry.value.data(), entry.value.size())) >> entry.diskindex;
+            } catch (const std::exception&) {
+                continue;
+            }
+            entry.decoded = true;
+            entry.consistent = entry.diskindex.nHeight <= trusted_height || entry.diskindex.GetBlockHash() == entry.hash;
+            std::vector<unsigned char>().swap(entry.value);
+        }
+    };
+    const size_t threads_max = std::max(1, std::min(GetNumCores(), MAX_LOAD_BLOCK_INDEX_THREADS));
+
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
     // Load m_block_index
-    while (pcursor->Valid()) {
+    std::vector<std::pair<CBlockIndex*, uint256>> prevs;
+    std::vector<PendingIndex> batch;
+    bool done = false;
+    while (!done) {
         boost::this_thread::interruption_point();
         if (ShutdownRequested()) return false;
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev           = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight         = diskindex.nHeight;
-                pindexNew->nFile           = diskindex.nFile;
-                pindexNew->nDataPos        = diskindex.nDataPos;
-                pindexNew->nUndoPos        = diskindex.nUndoPos;
-                pindexNew->nVersion        = diskindex.nVersion;
-                pindexNew->hashMerkleRoot  = diskindex.hashMerkleRoot;
-                pindexNew->hashSaplingRoot = diskindex.hashSaplingRoot;
-                pindexNew->nTime           = diskindex.nTime;
-                pindexNew->nBits           = diskindex.nBits;
-                pindexNew->nNonce          = diskindex.nNonce;
-                pindexNew->nArrivalTime    = diskindex.nArrivalTime;
-                pindexNew->nSolution       = diskindex.nSolution;
-                pindexNew->nStatus         = diskindex.nStatus;
-                pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
-                pindexNew->nTx             = diskindex.nTx;
-                pindexNew->nSproutValue    = diskindex.nSproutValue;
-                pindexNew->nSaplingValue   = diskindex.nSaplingValue;
-
-                // Consistency checks
-                auto header = pindexNew->GetBlockHeader();
-                if (header.GetHash() != pindexNew->GetBlockHash())
-                    return error("%s: block header inconsistency detected: on-disk = %s, in-memory = %s",
-                       __func__, diskindex.ToString(), pindexNew->ToString());
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
+        batch.clear();
+        while (batch.size() < LOAD_BLOCK_INDEX_BATCH) {
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+                done = true;
+                break;
             }
-        } else {
-            break;
+            batch.emplace_back();
+            batch.back().hash = key.second;
+            pcursor->GetValueBytes(batch.back().value);
+            pcursor->Next();
+        }
+        if (batch.empty()) break;
+
+        const size_t step = std::min(threads_max, batch.size());
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < step; t++) {
+            threads.emplace_back(decode, std::ref(batch), t, step);
         }
+        decode(batch, 0, step);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        for (PendingIndex& entry : batch) {
+            if (!entry.decoded) return error("%s: failed to read value", __func__);
+            const CDiskBlockIndex& diskindex = entry.diskindex;
+
+            // Consistency checks
+            if (!entry.consistent)
+                return error("%s: block header inconsistency detected: on-disk = %s, key = %s",
+                   __func__, diskindex.ToString(), entry.hash.ToString());
+
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(entry.hash);
+            pindexNew->nHeight         = diskindex.nHeight;
+            pindexNew->nFile           = diskindex.nFile;
+            pindexNew->nDataPos        = diskindex.nDataPos;
+            pindexNew->nUndoPos        = diskindex.nUndoPos;
+            pindexNew->nVersion        = diskindex.nVersion;
+            pindexNew->hashMerkleRoot  = diskindex.hashMerkleRoot;
+            pindexNew->hashSaplingRoot = diskindex.hashSaplingRoot;
+            pindexNew->nTime           = diskindex.nTime;
+            pindexNew->nBits           = diskindex.nBits;
+            pindexNew->nNonce          = diskindex.nNonce;
+            pindexNew->nArrivalTime    = diskindex.nArrivalTime;
+            pindexNew->SetSolution(std::move(entry.diskindex.Solution()));
+            pindexNew->nStatus         = diskindex.nStatus;
+            pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
+            pindexNew->nTx             = diskindex.nTx;
+            pindexNew->nSproutValue    = diskindex.nSproutValue;
+            pindexNew->nSaplingValue   = diskindex.nSaplingValue;
+            pindexNew->hashFinalSaplingRoot = diskindex.hashFinalSaplingRoot;
+            pindexNew->nSproutNotes       = diskindex.nSproutNotes;
+            pindexNew->nSproutNullifiers  = diskindex.nSproutNullifiers;
+            pindexNew->nSaplingNotes      = diskindex.nSaplingNotes;
+            pindexNew->nSaplingNullifiers = diskindex.nSaplingNullifiers;
+
+            if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
+                return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
+
+            // Only serving headers needs the solution, and it is in the DB.
+            pindexNew->TrimSolution();
+
+            prevs.emplace_back(pindexNew, diskindex.hashPrev);
+        }
+    }
+
+    // Every entry is in now, so linking creates no placeholder for a parent
+    // that comes later in the DB.
+    for (const std::pair<CBlockIndex*, uint256>& prev : prevs) {
+        prev.first->pprev = insertBlockIndex(prev.second);
     }
 
     return true;
@@ -6,18 +6,25 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include <bloom.h>
+#include <chainhistory.h>
 #include <coins.h>
 #include <dbwrapper.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 
+#include <condition_variable>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
+class CCoinsViewDBShieldedCursor;
+class SnapshotRecord;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -36,32 +43,122 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to all block filter index caches combined in MiB.
 static const int64_t max_filter_index_cache = 1024;
+//! Max memory allocated to the compact shielded block index cache in MiB.
+static const int64_t max_compact_block_index_cache = 256;
+//! Max memory allocated to the nullifier index cache in MiB.
+static const int64_t max_nullifier_index_cache = 512;
+//! Max memory allocated to the address index cache in MiB.
+static const int64_t max_address_index_cache = 1024;
+//! Max memory allocated to the spent index cache in MiB.
+static const int64_t max_spent_index_cache = 512;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -dbasyncflush default
+static const bool DEFAULT_DB_ASYNC_FLUSH = true;
+//! Threads decoding the block index at startup
+static const int MAX_LOAD_BLOCK_INDEX_THREADS = 16;
+//! Block index entries read from the DB before they are decoded together
+static const size_t LOAD_BLOCK_INDEX_BATCH = 8192;
 
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! All spent Sapling nullifiers, checked before reading one from db
+    CNullifierFilter m_nullifier_filter;
+
+    //! Build m_nullifier_filter from the nullifiers in db, with room to grow.
+    void RebuildNullifierFilter();
+
+    //! Changes handed to the background writer, only the dirty entries.
+    struct PendingWrite {
+        CCoinsMap coins;
+        CNullifiersMap nullifiers;
+        CAnchorsSaplingMap anchors;
+        uint256 hashBlock;
+        uint256 hashSaplingAnchor;
+        size_t usage = 0;
+    };
+
+    //! Whether BatchWrite hands the changes to the background writer.
+    bool m_background_writes = false;
+    mutable Mutex m_pending_mutex;
+    mutable std::condition_variable m_pending_cv;
+    //! The write in progress. Until it is in db, reads are served from it, also after it failed.
+    std::unique_ptr<PendingWrite> m_pending GUARDED_BY(m_pending_mutex);
+    //! Whether a background write failed. The database is not written to again.
+    bool m_background_write_failed GUARDED_BY(m_pending_mutex) = false;
+    bool m_stop_writer GUARDED_BY(m_pending_mutex) = false;
+    std::thread m_thread_write;
+
+    //! Write the dirty entries of the given maps to db.
+    bool WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    CNullifiersMap &mapSaplingNullifiers,
+                    CAnchorsSaplingMap &mapSaplingAnchors, const uint256 &hashSaplingAnchor,
+                    bool erase);
+    //! Write the pending changes handed over by BatchWrite, one at a time.
+    void ThreadWrite();
 public:
     /**
      * @param[in] ldb_path    Location in the filesystem where leveldb data will be stored.
      */
     explicit CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe);
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
-    bool GetNote(const uint256 &nullifier, Note &note) const override;
+    bool GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
-    bool HaveNote(const uint256 &nullifier) const override;
+    bool HaveNullifier(const uint256 &nullifier) const override;
+    bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const override;
     uint256 GetBestBlock() const override;
+    uint256 GetBestAnchor() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    CNullifiersMap &mapSaplingNullifiers,
+                    CAnchorsSaplingMap &mapSaplingAnchors, const uint256 &hashSaplingAnchor,
+                    bool erase) override;
     CCoinsViewCursor *Cursor() const override;
+    //! Cursor over the coins whose txid, in key order, starts with a byte in
+    //! [first, last]. Cursors created together see the same state of db.
+    CCoinsViewCursor *Cursor(uint8_t first, uint8_t last) const;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    const CNullifierFilter& GetNullifierFilter() const { return m_nullifier_filter; }
+
+    /**
+     * Let BatchWrite return once the changes are taken over, and write them
+     * to db on a background thread. Reads keep seeing the changes meanwhile,
+     * and the next BatchWrite waits for the write in progress.
+     */
+    void SetBackgroundWrites(bool enable) { m_background_writes = enable; }
+    //! Wait until the background write in progress is in db. Returns false if any failed.
+    bool SyncBackgroundWrite() const;
+    //! Memory held by the background write in progress.
+    size_t PendingWriteUsage() const;
+    //! Whether a background write is in progress, or failed.
+    bool BackgroundWritePending() const;
+
+    //! Cursors over the Sapling nullifiers and anchors. Like Cursor(), they
+    //! see db as it is when they are created.
+    std::unique_ptr<CCoinsViewDBShieldedCursor> NullifierCursor() const;
+    std::unique_ptr<CCoinsViewDBShieldedCursor> SaplingAnchorCursor() const;
+
+    /**
+     * Load a UTXO snapshot into this empty database, bypassing any cache.
+     * BeginSnapshotLoad marks db as in transition to hashBlock, so that an
+     * interrupted load is not taken for a complete one. It fails if db is not
+     * empty. The entries are then written with WriteSnapshotChunk, fastest in
+     * key order, and FinishSnapshotLoad marks db as consistent with hashBlock.
+     */
+    bool BeginSnapshotLoad(const uint256& hashBlock);
+    bool WriteSnapshotChunk(const std::vector<std::pair<COutPoint, Coin>>& coins,
+                            const std::vector<std::pair<uint256, uint32_t>>& nullifiers,
+                            const std::vector<std::pair<uint256, SaplingMerkleTree>>& anchors);
+    bool FinishSnapshotLoad(const uint256& hashBlock, const uint256& hashSaplingAnchor);
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -78,10 +175,40 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, uint8_t lastIn):
+        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), last(lastIn) {}
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
+    //! Last first txid byte of the range
+    const uint8_t last;
+
+    //! Cache the key at pcursor, or invalidate it past the range.
+    void ReadKey();
+
+    friend class CCoinsViewDB;
+};
+
+/** Cursor over the Sapling nullifiers or anchors of a CCoinsViewDB */
+class CCoinsViewDBShieldedCursor
+{
+public:
+    bool Valid() const { return m_key.first == m_prefix; }
+    void Next();
+    //! The nullifier, or the root of the anchor.
+    const uint256& GetKey() const { return m_key.second; }
+    //! The height of the nullifier, or the tree of the anchor.
+    template <typename T>
+    bool GetValue(T& value) const { return m_cursor->GetValue(value); }
+    //! Go back to the first entry.
+    void Rewind();
+
+private:
+    CCoinsViewDBShieldedCursor(CDBIterator* cursor, char prefix) : m_cursor(cursor), m_prefix(prefix) { Rewind(); }
+    void ReadKey();
+
+    std::unique_ptr<CDBIterator> m_cursor;
+    const char m_prefix;
+    std::pair<char, uint256> m_key;
 
     friend class CCoinsViewDB;
 };
@@ -92,14 +219,31 @@ class CBlockTreeDB : public CDBWrapper
 public:
     explicit CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    /** Write block file information and block index entries, and the chain history changes if history is not nullptr, atomically */
+    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo, const HistoryChanges* history = nullptr);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &info);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindexing);
     void ReadReindexing(bool &fReindexing);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    //! The UTXO snapshot the active chainstate was loaded from, if any
+    bool WriteSnapshot(const SnapshotRecord& snapshot);
+    bool ReadSnapshot(SnapshotRecord& snapshot);
+    bool EraseSnapshot();
+    //! Read the Equihash solution of a block index written earlier
+    bool ReadBlockSolution(const uint256& hash, std::vector<unsigned char>& solution);
+    //! Write the chain history changes alone
+    bool WriteHistory(const HistoryChanges& history);
+    bool ReadHistoryState(HistoryState& state);
+    bool ReadHistoryNode(HistoryIndex index, HistoryNode& node);
+    /**
+     * Load every block index entry through insertBlockIndex. Entries are
+     * decoded and have their header hash checked against their key on up to
+     * MAX_LOAD_BLOCK_INDEX_THREADS threads; those no higher than hash_trusted,
+     * when it is not null, are not hashed again.
+     */
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, const uint256& hash_trusted = uint256());
 };
 
 #endif // BITCOIN_TXDB_H
@@ -14,16 +14,18 @@
 #include <policy/fees.h>
 #include <policy/settings.h>
 #include <reverse_iterator.h>
+#include <util/rbf.h>
 #include <util/system.h>
 #include <util/moneystr.h>
 #include <util/time.h>
+#include <util/trace.h>
 #include <validationinterface.h>
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp)
-    : tx(_tx), nFee(_nFee), nTxWeight(GetTransactionWeight(*tx)), nUsageSize(RecursiveDynamicUsage(tx)), nTime(_nTime), entryHeight(_entryHeight),
-    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp), m_epoch(0)
+    : tx(_tx), nFee(_nFee), nTime(_nTime), lockPoints(lp), nTxWeight(GetTransactionWeight(*tx)), nUsageSize(RecursiveDynamicUsage(tx)),
+    entryHeight(_entryHeight), sigOpCost(_sigOpsCost), spendsCoinbase(_spendsCoinbase), m_epoch(0)
 {
     nCountWithDescendants = 1;
     nSizeWithDescendants = GetTxSize();
@@ -59,28 +61,33 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
-
-    while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        for (txiter childEntry : setChildren) {
-            cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
-            if (cacheIt != cachedDescendants.end()) {
-                // We've already calculated this one, just add the entries for this set
-                // but don't traverse again.
-                for (txiter cacheEntry : cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+    std::vector<txiter> stageEntries, setAllDescendants;
+    {
+        const auto epoch = GetFreshEpoch();
+        for (txiter childEntry : GetMemPoolChildren(updateIt)) {
+            if (!visited(childEntry)) stageEntries.push_back(childEntry);
+        }
+
+        while (!stageEntries.empty()) {
+            const txiter cit = stageEntries.back();
+            stageEntries.pop_back();
+            setAllDescendants.push_back(cit);
+            const setEntries &setChildren = GetMemPoolChildren(cit);
+            for (txiter childEntry : setChildren) {
+                cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
+                if (cacheIt != cachedDescendants.end()) {
+                    // We've already calculated this one, just add the entries for this set
+                    // but don't traverse again.
+                    for (txiter cacheEntry : cacheIt->second) {
+                        if (!visited(cacheEntry)) setAllDescendants.push_back(cacheEntry);
+                    }
+                } else if (!visited(childEntry)) {
+                    // Schedule for later processing
+                    stageEntries.push_back(childEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
-                // Schedule for later processing
-                stageEntries.insert(childEntry);
             }
         }
-    }
+    } // release epoch guard, each descendant is in setAllDescendants once
     // setAllDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
@@ -147,12 +154,18 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         } // release epoch guard for UpdateForDescendants
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
     }
+    // Snapshots taken since the transactions were added lack their descendants
+    ++nTransactionsUpdated;
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
-    setEntries parentHashes;
+    AssertLockHeld(cs);
+    // parentHashes holds the ancestors found but not walked yet, the epoch
+    // marks those already found so that no ancestor is staged twice.
+    std::vector<txiter> parentHashes;
     const CTransaction &tx = entry.GetTx();
+    const auto epoch = GetFreshEpoch();
 
     if (fSearchForParents) {
         // Get parents of this transaction that are in the mempool
@@ -160,8 +173,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             Optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
-            if (piter) {
-                parentHashes.insert(*piter);
+            if (piter && !visited(*piter)) {
+                parentHashes.push_back(*piter);
                 if (parentHashes.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -172,16 +185,18 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (txiter piter : GetMemPoolParents(it)) {
+            if (!visited(piter)) parentHashes.push_back(piter);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+        txiter stageit = parentHashes.back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+        parentHashes.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -198,8 +213,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
         for (txiter phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!visited(phash)) {
+                parentHashes.push_back(phash);
             }
             if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -312,7 +327,7 @@ void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFe
     assert(int64_t(nSizeWithDescendants) > 0);
     nModFeesWithDescendants += modifyFee;
     nCountWithDescendants += modifyCount;
-    assert(int64_t(nCountWithDescendants) > 0);
+    assert(int32_t(nCountWithDescendants) > 0);
 }
 
 void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int64_t modifySigOps)
@@ -321,7 +336,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     assert(int64_t(nSizeWithAncestors) > 0);
     nModFeesWithAncestors += modifyFee;
     nCountWithAncestors += modifyCount;
-    assert(int64_t(nCountWithAncestors) > 0);
+    assert(int32_t(nCountWithAncestors) > 0);
     nSigOpCostWithAncestors += modifySigOps;
     assert(int(nSigOpCostWithAncestors) >= 0);
 }
@@ -343,6 +358,18 @@ bool CTxMemPool::isSpent(const COutPoint& outpoint) const
     return mapNextTx.count(outpoint);
 }
 
+bool CTxMemPool::HasSaplingNullifier(const uint256& nullifier) const
+{
+    LOCK(cs);
+    return mapSaplingNullifiers.count(nullifier);
+}
+
+bool CTxMemPool::HasSproutNullifier(const uint256& nullifier) const
+{
+    LOCK(cs);
+    return mapSproutNullifiers.count(nullifier);
+}
+
 unsigned int CTxMemPool::GetTransactionsUpdated() const
 {
     return nTransactionsUpdated;
@@ -374,6 +401,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     // (When we update the entry for in-mempool parents, memory usage will be
     // further updated.)
     cachedInnerUsage += entry.DynamicMemoryUsage();
+    cachedTxUsage += entry.DynamicMemoryUsage();
 
     const CTransaction& tx = newit->GetTx();
     std::set<uint256> setParentTransactions;
@@ -381,6 +409,14 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
         mapNextTx.insert(std::make_pair(&tx.vin[i].prevout, &tx));
         setParentTransactions.insert(tx.vin[i].prevout.hash);
     }
+    for (const SpendDescription& spend : tx.vShieldedSpend) {
+        mapSaplingNullifiers.emplace(spend.nullifier, newit);
+    }
+    for (const JSDescription& joinsplit : tx.vJoinSplit) {
+        for (const uint256& nullifier : joinsplit.nullifiers) {
+            mapSproutNullifiers.emplace(nullifier, newit);
+        }
+    }
     // Don't bother worrying about child transactions of this one.
     // Normal case of a new transaction arriving is that there can't be any
     // children, because such children would be orphans.
@@ -401,21 +437,41 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
+
+    TRACE4(mempool, added,
+           tx.GetHash().begin(),
+           entry.GetTxSize(),
+           entry.GetFee(),
+           mapTx.size());
 }
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
+    TRACE4(mempool, removed,
+           it->GetTx().GetHash().begin(),
+           (int)reason,
+           it->GetTxSize(),
+           it->GetFee());
+
+    // The sequence goes up for every removal, even those not reported below
+    const uint64_t mempool_sequence = GetAndIncrementSequence();
+
     if (reason != MemPoolRemovalReason::BLOCK) {
         // Notify clients that a transaction has been removed from the mempool
         // for any reason except being included in a block. Clients interested
         // in transactions included in blocks can subscribe to the BlockConnected
         // notification.
-        GetMainSignals().TransactionRemovedFromMempool(it->GetSharedTx(), reason);
+        GetMainSignals().TransactionRemovedFromMempool(it->GetSharedTx(), reason, mempool_sequence);
     }
 
     const uint256 hash = it->GetTx().GetHash();
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
+    for (const SpendDescription& spend : it->GetTx().vShieldedSpend)
+        mapSaplingNullifiers.erase(spend.nullifier);
+    for (const JSDescription& joinsplit : it->GetTx().vJoinSplit)
+        for (const uint256& nullifier : joinsplit.nullifiers)
+            mapSproutNullifiers.erase(nullifier);
 
     if (vTxHashes.size() > 1) {
         vTxHashes[it->vTxHashesIdx] = std::move(vTxHashes.back());
@@ -428,6 +484,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
+    cachedTxUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
     mapLinks.erase(it);
     mapTx.erase(it);
@@ -546,6 +603,48 @@ void CTxMemPool::removeConflicts(const CTransaction &tx)
             }
         }
     }
+    // Likewise for transactions spending the same Sapling or Sprout notes
+    for (const SpendDescription &spend : tx.vShieldedSpend) {
+        auto it = mapSaplingNullifiers.find(spend.nullifier);
+        if (it != mapSaplingNullifiers.end()) {
+            const CTransaction &txConflict = it->second->GetTx();
+            if (txConflict != tx)
+            {
+                ClearPrioritisation(txConflict.GetHash());
+                removeRecursive(txConflict, MemPoolRemovalReason::CONFLICT);
+            }
+        }
+    }
+    for (const JSDescription &joinsplit : tx.vJoinSplit) {
+        for (const uint256 &nullifier : joinsplit.nullifiers) {
+            auto it = mapSproutNullifiers.find(nullifier);
+            if (it != mapSproutNullifiers.end()) {
+                const CTransaction &txConflict = it->second->GetTx();
+                if (txConflict != tx)
+                {
+                    ClearPrioritisation(txConflict.GetHash());
+                    removeRecursive(txConflict, MemPoolRemovalReason::CONFLICT);
+                }
+            }
+        }
+    }
+}
+
+void CTxMemPool::removeWithAnchor(const uint256& anchor)
+{
+    AssertLockHeld(cs);
+    std::vector<CTransactionRef> transactionsToRemove;
+    for (const CTxMemPoolEntry& entry : mapTx) {
+        for (const SpendDescription& spend : entry.GetTx().vShieldedSpend) {
+            if (spend.anchor == anchor) {
+                transactionsToRemove.push_back(entry.GetSharedTx());
+                break;
+            }
+        }
+    }
+    for (const CTransactionRef& tx : transactionsToRemove) {
+        removeRecursive(*tx, MemPoolRemovalReason::REORG);
+    }
 }
 
 /**
@@ -576,6 +675,7 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
         removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
     }
+    RemoveExpired(nBlockHeight);
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = true;
 }
@@ -585,8 +685,11 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapSaplingNullifiers.clear();
+    mapSproutNullifiers.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
+    cachedTxUsage = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
@@ -614,13 +717,14 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     if (nCheckFrequency == 0)
         return;
 
-    if (GetRand(std::numeric_limits<uint32_t>::max()) >= nCheckFrequency)
+    if (GetFastRand(std::numeric_limits<uint32_t>::max()) >= nCheckFrequency)
         return;
 
     LogPrint(BCLog::MEMPOOL, "Checking mempool with %u transactions and %u inputs\n", (unsigned int)mapTx.size(), (unsigned int)mapNextTx.size());
 
     uint64_t checkTotal = 0;
     uint64_t innerUsage = 0;
+    uint64_t txUsage = 0;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
     const int64_t spendheight = GetSpendHeight(mempoolDuplicate);
@@ -630,6 +734,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         unsigned int i = 0;
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
+        txUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
         txlinksMap::const_iterator linksiter = mapLinks.find(it);
         assert(linksiter != mapLinks.end());
@@ -655,6 +760,18 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second == &tx);
             i++;
         }
+        for (const SpendDescription& spend : tx.vShieldedSpend) {
+            auto it4 = mapSaplingNullifiers.find(spend.nullifier);
+            assert(it4 != mapSaplingNullifiers.end());
+            assert(it4->second == it);
+        }
+        for (const JSDescription& joinsplit : tx.vJoinSplit) {
+            for (const uint256& nullifier : joinsplit.nullifiers) {
+                auto it5 = mapSproutNullifiers.find(nullifier);
+                assert(it5 != mapSproutNullifiers.end());
+                assert(it5->second == it);
+            }
+        }
         assert(setParentCheck == GetMemPoolParents(it));
         // Verify ancestor state is correct.
         setEntries setAncestors;
@@ -722,6 +839,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+    assert(txUsage == cachedTxUsage);
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb)
@@ -800,6 +918,92 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::shared_ptr<const MempoolSnapshot> CTxMemPool::GetSnapshot() const
+{
+    {
+        LOCK(m_snapshot_mutex);
+        if (m_snapshot && m_snapshot->transactions_updated == nTransactionsUpdated) return m_snapshot;
+    }
+
+    auto snapshot = std::make_shared<MempoolSnapshot>();
+    {
+        LOCK(cs);
+        snapshot->transactions_updated = nTransactionsUpdated;
+        snapshot->sequence = GetSequence();
+        snapshot->total_tx_size = totalTxSize;
+        snapshot->usage = GetMemoryUsage();
+
+        auto iters = GetSortedDepthAndScore();
+        snapshot->entries.reserve(iters.size());
+        snapshot->index.reserve(iters.size());
+        for (const auto& it : iters) {
+            MempoolSnapshot::Entry entry{it->GetSharedTx(), it->GetFee(), it->GetModifiedFee(), it->GetTxSize(), static_cast<size_t>(it->GetTxWeight()),
+                                         it->GetTime(), it->GetHeight(),
+                                         it->GetCountWithDescendants(), it->GetSizeWithDescendants(), it->GetModFeesWithDescendants(),
+                                         it->GetCountWithAncestors(), it->GetSizeWithAncestors(), it->GetModFeesWithAncestors(),
+                                         {}, {}, SignalsOptInRBF(it->GetTx())};
+            for (txiter parent : GetMemPoolParents(it)) {
+                entry.parents.push_back(parent->GetTx().GetHash());
+                // The parents come first, so whether they are replaceable is known already
+                auto parent_pos = snapshot->index.find(entry.parents.back());
+                if (parent_pos != snapshot->index.end()) {
+                    entry.bip125_replaceable |= snapshot->entries[parent_pos->second].bip125_replaceable;
+                }
+            }
+            for (txiter child : GetMemPoolChildren(it)) {
+                entry.children.push_back(child->GetTx().GetHash());
+            }
+            snapshot->index.emplace(it->GetTx().GetHash(), snapshot->entries.size());
+            snapshot->entries.push_back(std::move(entry));
+        }
+    }
+
+    LOCK(m_snapshot_mutex);
+    m_snapshot = snapshot;
+    return snapshot;
+}
+
+const MempoolSnapshot::Entry* MempoolSnapshot::Find(const uint256& txid) const
+{
+    auto it = index.find(txid);
+    return it == index.end() ? nullptr : &entries[it->second];
+}
+
+std::vector<const MempoolSnapshot::Entry*> MempoolSnapshot::Ancestors(const Entry& entry) const
+{
+    return Relatives(entry, &Entry::parents);
+}
+
+std::vector<const MempoolSnapshot::Entry*> MempoolSnapshot::Descendants(const Entry& entry) const
+{
+    return Relatives(entry, &Entry::children);
+}
+
+std::vector<const MempoolSnapshot::Entry*> MempoolSnapshot::Relatives(const Entry& entry, std::vector<uint256> Entry::*links) const
+{
+    std::set<size_t> found;
+    std::vector<size_t> stage;
+    auto visit = [&](const Entry& e) {
+        for (const uint256& txid : e.*links) {
+            const size_t pos = index.at(txid);
+            if (found.insert(pos).second) stage.push_back(pos);
+        }
+    };
+    visit(entry);
+    while (!stage.empty()) {
+        const size_t pos = stage.back();
+        stage.pop_back();
+        visit(entries[pos]);
+    }
+
+    std::vector<const Entry*> ret;
+    ret.reserve(found.size());
+    for (size_t pos : found) {
+        ret.push_back(&entries[pos]);
+    }
+    return ret;
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -913,26 +1117,30 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return base->GetCoin(outpoint, coin);
 }
 
-bool CCoinsViewMemPool::GetNote(const uint256 &nullifier, Note &note) const {
-    // If an entry in the mempool exists, always return that one, as it's guaranteed to never
-    // conflict with the underlying cache, and it cannot have pruned entries (as it contains full)
-    // transactions. First checking the underlying cache risks returning a pruned entry instead.
-//    CTransactionRef ptx = mempool.get(outpoint.hash);
-//    if (ptx) {
-//        if (outpoint.n < ptx->vout.size()) {
-//            coin = Coin(ptx->vout[outpoint.n], MEMPOOL_HEIGHT, false);
-//            return true;
-//        } else {
-//            return false;
-//        }
-//    }
-    return base->GetNote(nullifier, note);
+bool CCoinsViewMemPool::GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const {
+    // A nullifier spent by a mempool transaction can not be spent again.
+    if (mempool.HasSaplingNullifier(nullifier)) {
+        nHeight = MEMPOOL_HEIGHT;
+        return true;
+    }
+    return base->GetNullifier(nullifier, nHeight);
 }
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
+    return GetMemoryUsage().Total();
+}
+
+MemPoolUsage CTxMemPool::GetMemoryUsage() const {
     LOCK(cs);
+    MemPoolUsage usage;
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    usage.entries = memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size();
+    usage.transactions = cachedTxUsage;
+    usage.links = memusage::DynamicUsage(mapLinks) + cachedInnerUsage - cachedTxUsage;
+    usage.spends = memusage::DynamicUsage(mapNextTx);
+    usage.nullifiers = memusage::DynamicUsage(mapSaplingNullifiers) + memusage::DynamicUsage(mapSproutNullifiers);
+    usage.other = memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes);
+    return usage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -960,6 +1168,28 @@ int CTxMemPool::Expire(std::chrono::seconds time)
     return stage.size();
 }
 
+int CTxMemPool::RemoveExpired(unsigned int nBlockHeight)
+{
+    AssertLockHeld(cs);
+    // Transactions expiring at nBlockHeight or before sort first, so only
+    // those are visited.
+    indexed_transaction_set::index<expiry_height>::type::iterator it = mapTx.get<expiry_height>().begin();
+    setEntries toremove;
+    while (it != mapTx.get<expiry_height>().end() && mempoolentry_expiry_height()(*it) <= nBlockHeight) {
+        toremove.insert(mapTx.project<0>(it));
+        it++;
+    }
+    setEntries stage;
+    for (txiter removeit : toremove) {
+        CalculateDescendants(removeit, stage);
+    }
+    RemoveStaged(stage, false, MemPoolRemovalReason::EXPIRY);
+    if (!stage.empty()) {
+        LogPrint(BCLog::MEMPOOL, "Removed %u transactions expiring at height %u or earlier\n", stage.size(), nBlockHeight);
+    }
+    return stage.size();
+}
+
 void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, bool validFeeEstimate)
 {
     setEntries setAncestors;
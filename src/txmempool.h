@@ -7,9 +7,12 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <atomic>
+#include <chrono>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -59,6 +62,9 @@ struct LockPoints
  * (nCountWithDescendants, nSizeWithDescendants, and nModFeesWithDescendants) for
  * all ancestors of the newly added transaction.
  *
+ * The members are ordered by size, and those bounded by the size of a block
+ * or of the mempool are 32 bits wide, as every entry costs its size in
+ * -maxmempool.
  */
 
 class CTxMemPoolEntry
@@ -66,28 +72,29 @@ class CTxMemPoolEntry
 private:
     const CTransactionRef tx;
     const CAmount nFee;             //!< Cached to avoid expensive parent-transaction lookups
-    const size_t nTxWeight;         //!< ... and avoid recomputing tx weight (also used for GetTxSize())
-    const size_t nUsageSize;        //!< ... and total memory usage
     const int64_t nTime;            //!< Local time when entering the mempool
-    const unsigned int entryHeight; //!< Chain height when entering the mempool
-    const bool spendsCoinbase;      //!< keep track of transactions that spend a coinbase
-    const int64_t sigOpCost;        //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
     // descendants as well.
-    uint64_t nCountWithDescendants;  //!< number of descendant transactions
-    uint64_t nSizeWithDescendants;   //!< ... and size
+    uint64_t nSizeWithDescendants;   //!< size of descendant transactions
     CAmount nModFeesWithDescendants; //!< ... and total fees (all including us)
 
     // Analogous statistics for ancestor transactions
-    uint64_t nCountWithAncestors;
     uint64_t nSizeWithAncestors;
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
 
+    const uint32_t nTxWeight;       //!< Cached to avoid recomputing tx weight (also used for GetTxSize())
+    const uint32_t nUsageSize;      //!< ... and total memory usage
+    const uint32_t entryHeight;     //!< Chain height when entering the mempool
+    const int32_t sigOpCost;        //!< Total sigop cost
+    uint32_t nCountWithDescendants;  //!< number of descendant transactions
+    uint32_t nCountWithAncestors;    //!< number of ancestor transactions
+    const bool spendsCoinbase;      //!< keep track of transactions that spend a coinbase
+
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _entryHeight,
@@ -127,7 +134,7 @@ public:
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
-    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint32_t vTxHashesIdx; //!< Index in mempool's vTxHashes
     mutable uint64_t m_epoch; //!< epoch when last touched, useful for graph algorithms
 };
 
@@ -315,9 +322,25 @@ public:
 };
 
 // Multi_index tag names
+/** \class mempoolentry_expiry_height
+ *
+ *  The height after which an Overwinter transaction can no longer be mined,
+ *  with transactions that never expire sorted last.
+ */
+struct mempoolentry_expiry_height
+{
+    typedef uint32_t result_type;
+    result_type operator() (const CTxMemPoolEntry &entry) const
+    {
+        const uint32_t nExpiryHeight = entry.GetTx().nExpiryHeight;
+        return nExpiryHeight ? nExpiryHeight : std::numeric_limits<uint32_t>::max();
+    }
+};
+
 struct descendant_score {};
 struct entry_time {};
 struct ancestor_score {};
+struct expiry_height {};
 
 class CBlockPolicyEstimator;
 
@@ -354,6 +377,18 @@ enum class MemPoolRemovalReason {
     REPLACED,    //!< Removed for replacement
 };
 
+/** The memory usage of the mempool, by what it is used for, in bytes. */
+struct MemPoolUsage {
+    size_t entries{0};      //!< The entries and the nodes of their indexes
+    size_t transactions{0}; //!< The transactions of the entries
+    size_t links{0};        //!< The parent and child links of the entries
+    size_t spends{0};       //!< The map of spent outpoints
+    size_t nullifiers{0};   //!< The maps of revealed Sprout and Sapling nullifiers
+    size_t other{0};        //!< The fee deltas and the witness hashes for compact blocks
+
+    size_t Total() const { return entries + transactions + links + spends + nullifiers + other; }
+};
+
 class SaltedTxidHasher
 {
 private:
@@ -368,6 +403,57 @@ public:
     }
 };
 
+/**
+ * An immutable copy of the mempool entries and the links between them, as of
+ * one state of the mempool. CTxMemPool::GetSnapshot() shares it between all
+ * readers until the mempool changes, so that RPCs can walk it and build their
+ * replies without holding the mempool lock.
+ */
+struct MempoolSnapshot
+{
+    struct Entry {
+        CTransactionRef tx;
+        CAmount fee;
+        CAmount modified_fee;
+        size_t vsize;
+        size_t weight;
+        std::chrono::seconds time;
+        unsigned int height;
+        uint64_t count_with_descendants;
+        uint64_t size_with_descendants;
+        CAmount mod_fees_with_descendants;
+        uint64_t count_with_ancestors;
+        uint64_t size_with_ancestors;
+        CAmount mod_fees_with_ancestors;
+        //! The txids of the in-mempool parents and children
+        std::vector<uint256> parents;
+        std::vector<uint256> children;
+        //! Whether the transaction or one of its in-mempool ancestors signals BIP 125 replaceability
+        bool bip125_replaceable;
+    };
+
+    //! The GetTransactionsUpdated() of the mempool the snapshot was taken of
+    unsigned int transactions_updated{0};
+    //! The mempool sequence number at the time of the snapshot
+    uint64_t sequence{0};
+    //! The entries, parents before children as in CTxMemPool::queryHashes()
+    std::vector<Entry> entries;
+    //! The position of each entry by txid
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> index;
+    uint64_t total_tx_size{0};
+    MemPoolUsage usage;
+
+    /** The entry of txid, or nullptr if it was not in the mempool. */
+    const Entry* Find(const uint256& txid) const;
+    /** The in-mempool ancestors of entry, not including itself, in the order of entries. */
+    std::vector<const Entry*> Ancestors(const Entry& entry) const;
+    /** The in-mempool descendants of entry, not including itself, in the order of entries. */
+    std::vector<const Entry*> Descendants(const Entry& entry) const;
+
+private:
+    std::vector<const Entry*> Relatives(const Entry& entry, std::vector<uint256> Entry::*links) const;
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -449,6 +535,7 @@ private:
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    uint64_t cachedTxUsage;    //!< ... of which the transactions, the rest being the links
 
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
@@ -456,10 +543,19 @@ private:
     mutable uint64_t m_epoch;
     mutable bool m_has_epoch_guard;
 
+    // In-memory counter for external mempool tracking purposes.
+    // This number is incremented once every time a transaction
+    // is added or removed from the mempool for any reason.
+    mutable uint64_t m_sequence_number{1};
+
     void trackPackageRemoved(const CFeeRate& rate) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     bool m_is_loaded GUARDED_BY(cs){false};
 
+    mutable Mutex m_snapshot_mutex;
+    //! The last snapshot handed out, reused until nTransactionsUpdated moves on
+    mutable std::shared_ptr<const MempoolSnapshot> m_snapshot GUARDED_BY(m_snapshot_mutex);
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -486,6 +582,11 @@ public:
                 boost::multi_index::tag<ancestor_score>,
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
+            >,
+            // sorted by expiry height
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<expiry_height>,
+                mempoolentry_expiry_height
             >
         >
     > indexed_transaction_set;
@@ -551,6 +652,9 @@ private:
 
 public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
+    /** The entries spending each Sapling and Sprout nullifier, for conflict checks in constant time. */
+    std::unordered_map<uint256, txiter, SaltedTxidHasher> mapSaplingNullifiers GUARDED_BY(cs);
+    std::unordered_map<uint256, txiter, SaltedTxidHasher> mapSproutNullifiers GUARDED_BY(cs);
     std::map<uint256, CAmount> mapDeltas;
 
     /** Create a new CTxMemPool.
@@ -577,6 +681,8 @@ public:
     void addUnchecked(const CTxMemPoolEntry& entry, setEntries& setAncestors, bool validFeeEstimate = true) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
 
     void removeRecursive(const CTransaction& tx, MemPoolRemovalReason reason) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Remove the transactions that spend Sapling notes anchored to the tree whose root is anchor. */
+    void removeWithAnchor(const uint256& anchor) EXCLUSIVE_LOCKS_REQUIRED(cs);
     void removeForReorg(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight, int flags) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
     void removeConflicts(const CTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(cs);
     void removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight) EXCLUSIVE_LOCKS_REQUIRED(cs);
@@ -586,7 +692,19 @@ public:
     bool CompareDepthAndScore(const uint256& hasha, const uint256& hashb);
     void queryHashes(std::vector<uint256>& vtxid) const;
     bool isSpent(const COutPoint& outpoint) const;
+    /** Whether a transaction in the pool spends the Sapling nullifier. */
+    bool HasSaplingNullifier(const uint256& nullifier) const;
+    /** Whether a transaction in the pool spends the Sprout nullifier. */
+    bool HasSproutNullifier(const uint256& nullifier) const;
     unsigned int GetTransactionsUpdated() const;
+
+    uint64_t GetAndIncrementSequence() const EXCLUSIVE_LOCKS_REQUIRED(cs) {
+        return m_sequence_number++;
+    }
+
+    uint64_t GetSequence() const EXCLUSIVE_LOCKS_REQUIRED(cs) {
+        return m_sequence_number;
+    }
     void AddTransactionsUpdated(unsigned int n);
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
@@ -662,6 +780,9 @@ public:
     /** Expire all transaction (and their dependencies) in the mempool older than time. Return the number of removed transactions. */
     int Expire(std::chrono::seconds time) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** Remove the transactions (and their dependencies) that can no longer be mined after the block at nBlockHeight. Return the number of removed transactions. */
+    int RemoveExpired(unsigned int nBlockHeight) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     /**
      * Calculate the ancestor and descendant count for the given transaction.
      * The counts include the transaction itself.
@@ -696,7 +817,15 @@ public:
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
 
+    /**
+     * A snapshot of the current state of the mempool. Unless the mempool has
+     * changed since the last one was taken, that one is returned without
+     * taking the mempool lock; otherwise the entries are copied under it.
+     */
+    std::shared_ptr<const MempoolSnapshot> GetSnapshot() const LOCKS_EXCLUDED(m_snapshot_mutex);
+
     size_t DynamicMemoryUsage() const;
+    MemPoolUsage GetMemoryUsage() const;
 
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
@@ -806,7 +935,7 @@ protected:
 public:
     CCoinsViewMemPool(CCoinsView* baseIn, const CTxMemPool& mempoolIn);
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
-    bool GetNote(const uint256 &nullifier, Note &note) const override;
+    bool GetNullifier(const uint256 &nullifier, uint32_t &nHeight) const override;
 };
 
 /**
@@ -0,0 +1,211 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <crypto/siphash.h>
+#include <hash.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+
+/** A 32 bit finalizer; short ids are already uniform, so it only needs to decorrelate the parts. */
+static inline uint32_t Mix(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
+
+/** The checksum that tells a cell holding a single id from one holding several */
+static inline uint32_t CheckHash(uint32_t id)
+{
+    return Mix(id ^ 0x5bd1e995);
+}
+
+static inline bool IsPure(const TxReconSketch::Cell& cell)
+{
+    return (cell.count == 1 || cell.count == -1) && cell.hash_sum == CheckHash(cell.id_sum);
+}
+
+size_t TxReconSketch::CellIndex(uint32_t id, unsigned int part) const
+{
+    const uint64_t part_size = m_cells.size() / 3;
+    return part * part_size + ((uint64_t{Mix(id + (part + 1) * 0x9e3779b9)} * part_size) >> 32);
+}
+
+void TxReconSketch::Toggle(size_t index, uint32_t id, int32_t count)
+{
+    Cell& cell = m_cells[index];
+    cell.count += count;
+    cell.id_sum ^= id;
+    cell.hash_sum ^= CheckHash(id);
+}
+
+void TxReconSketch::Add(uint32_t id)
+{
+    assert(!m_cells.empty() && m_cells.size() % 3 == 0);
+    for (unsigned int part = 0; part < 3; part++) {
+        Toggle(CellIndex(id, part), id, 1);
+    }
+}
+
+TxReconSketch& TxReconSketch::operator-=(const TxReconSketch& other)
+{
+    assert(m_cells.size() == other.m_cells.size());
+    for (size_t i = 0; i < m_cells.size(); i++) {
+        m_cells[i].count -= other.m_cells[i].count;
+        m_cells[i].id_sum ^= other.m_cells[i].id_sum;
+        m_cells[i].hash_sum ^= other.m_cells[i].hash_sum;
+    }
+    return *this;
+}
+
+bool TxReconSketch::Decode(std::vector<uint32_t>& positive, std::vector<uint32_t>& negative) const
+{
+    positive.clear();
+    negative.clear();
+    if (!IsWellFormed()) return false;
+
+    // Peel off the cells that hold a single id, which may leave other cells
+    // holding a single id, until none is left.
+    TxReconSketch sketch(*this);
+    std::vector<size_t> pure;
+    for (size_t i = 0; i < sketch.m_cells.size(); i++) {
+        if (IsPure(sketch.m_cells[i])) pure.push_back(i);
+    }
+    while (!pure.empty()) {
+        const Cell cell = sketch.m_cells[pure.back()];
+        pure.pop_back();
+        if (!IsPure(cell)) continue;
+        (cell.count > 0 ? positive : negative).push_back(cell.id_sum);
+        // A bogus sketch cannot make this loop forever
+        if (positive.size() + negative.size() > sketch.m_cells.size()) return false;
+        for (unsigned int part = 0; part < 3; part++) {
+            const size_t index = sketch.CellIndex(cell.id_sum, part);
+            sketch.Toggle(index, cell.id_sum, -cell.count);
+            if (IsPure(sketch.m_cells[index])) pure.push_back(index);
+        }
+    }
+    for (const Cell& cell : sketch.m_cells) {
+        if (cell.count != 0 || cell.id_sum != 0 || cell.hash_sum != 0) return false;
+    }
+    return true;
+}
+
+size_t EstimateSketchCells(size_t local_size, size_t remote_size, double q)
+{
+    if (local_size == 0 && remote_size == 0) return 0;
+    const size_t difference = std::max(local_size, remote_size) - std::min(local_size, remote_size);
+    const double expected = difference + q * std::min(local_size, remote_size) + 1;
+    // Decoding needs somewhat more cells than ids, but small sketches mostly
+    // fail on two ids that share a cell in all three parts, which extra cells
+    // make unlikely: a failure costs announcing the whole round with INV.
+    const size_t cells = 3 * static_cast<size_t>(std::ceil((2 * expected + 30) / 3));
+    return std::min(cells, MAX_SKETCH_CELLS);
+}
+
+TxReconciliationState::TxReconciliationState(bool initiator, uint64_t local_salt, uint64_t remote_salt) :
+    m_initiator(initiator)
+{
+    // Both sides derive the same keys, and neither picks them alone.
+    CHashWriter hasher(SER_GETHASH, 0);
+    hasher << std::string("LitecoinZ tx reconciliation") << std::min(local_salt, remote_salt) << std::max(local_salt, remote_salt);
+    const uint256 keys = hasher.GetHash();
+    m_k0 = keys.GetUint64(0);
+    m_k1 = keys.GetUint64(1);
+}
+
+uint32_t TxReconciliationState::GetShortID(const uint256& txid) const
+{
+    return SipHashUint256(m_k0, m_k1, txid) & 0xffffffff;
+}
+
+void TxReconciliationState::Snapshot()
+{
+    for (auto it = m_local_set.begin(); it != m_local_set.end();) {
+        // Leave a transaction whose short id collides for the next round
+        if (m_snapshot.emplace(GetShortID(*it), *it).second) {
+            it = m_local_set.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::vector<uint256> TxReconciliationState::TakeSnapshot()
+{
+    std::vector<uint256> txids;
+    txids.reserve(m_snapshot.size());
+    for (const auto& entry : m_snapshot) {
+        txids.push_back(entry.second);
+    }
+    m_snapshot.clear();
+    return txids;
+}
+
+TxReconSketch TxReconciliationState::SnapshotSketch(size_t cells) const
+{
+    TxReconSketch sketch(cells);
+    if (cells == 0) return sketch;
+    for (const auto& entry : m_snapshot) {
+        sketch.Add(entry.first);
+    }
+    return sketch;
+}
+
+bool TxReconciliationState::ProcessSketch(const TxReconSketch& remote, std::vector<uint256>& announce, std::vector<uint32_t>& request)
+{
+    announce.clear();
+    request.clear();
+    if (!remote.IsWellFormed()) return false;
+    if (remote.Cells() == 0) {
+        // The peer had nothing to reconcile and was told we had nothing either
+        if (!m_snapshot.empty()) return false;
+        return true;
+    }
+
+    TxReconSketch sketch = SnapshotSketch(remote.Cells());
+    sketch -= remote;
+    std::vector<uint32_t> local_only;
+    if (!sketch.Decode(local_only, request)) {
+        request.clear();
+        return false;
+    }
+    for (const uint32_t id : local_only) {
+        const auto it = m_snapshot.find(id);
+        // Decoding an id we never added means the sketch was not what it seemed
+        if (it == m_snapshot.end()) {
+            request.clear();
+            announce.clear();
+            return false;
+        }
+        announce.push_back(it->second);
+    }
+
+    const size_t local_size = m_snapshot.size();
+    const size_t remote_size = local_size - local_only.size() + request.size();
+    const size_t smaller = std::min(local_size, remote_size);
+    if (smaller > 0) {
+        const size_t difference = std::max(local_size, remote_size) - smaller;
+        m_q = std::max(0.0, std::min(2.0, double(local_only.size() + request.size() - difference) / smaller));
+    }
+    m_snapshot.clear();
+    return true;
+}
+
+std::vector<uint256> TxReconciliationState::TakeRequested(const std::vector<uint32_t>& request)
+{
+    std::vector<uint256> txids;
+    for (const uint32_t id : request) {
+        const auto it = m_snapshot.find(id);
+        if (it != m_snapshot.end()) txids.push_back(it->second);
+    }
+    m_snapshot.clear();
+    return txids;
+}
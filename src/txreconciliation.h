@@ -0,0 +1,135 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_TXRECONCILIATION_H
+#define LITECOINZ_TXRECONCILIATION_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+/** Default for -txreconciliation */
+static const bool DEFAULT_TXRECONCILIATION = false;
+/** The version of transaction set reconciliation announced in SENDRECON */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Upper bound on the cells of a sketch, and so on the transactions a round can find missing */
+static const size_t MAX_SKETCH_CELLS = 3000;
+/** Beyond this many pending transactions a peer is announced to with INV again */
+static const size_t MAX_RECONCILIATION_SET_SIZE = 2 * MAX_SKETCH_CELLS;
+/** The initial estimate of the share of the smaller set that the larger one lacks */
+static const double DEFAULT_RECONCILIATION_Q = 0.25;
+/** q is sent as a 16 bit fixed point number with this scale */
+static const double RECONCILIATION_Q_SCALE = 16384;
+
+/**
+ * A sketch of a set of 32 bit short transaction ids: an invertible Bloom
+ * lookup table, in which each id is added to one cell of each of three equal
+ * parts. Subtracting the sketch of another set leaves the sketch of the
+ * symmetric difference, which decodes when it has somewhat fewer ids than
+ * a part has cells. Both sketches need the same number of cells.
+ */
+class TxReconSketch
+{
+public:
+    struct Cell {
+        int32_t count{0};
+        uint32_t id_sum{0};
+        uint32_t hash_sum{0};
+
+        SERIALIZE_METHODS(Cell, obj) { READWRITE(obj.count, obj.id_sum, obj.hash_sum); }
+    };
+
+    explicit TxReconSketch(size_t cells = 0) : m_cells(cells) {}
+
+    size_t Cells() const { return m_cells.size(); }
+
+    /** Whether the number of cells is one a peer may send */
+    bool IsWellFormed() const { return m_cells.size() % 3 == 0 && m_cells.size() <= MAX_SKETCH_CELLS; }
+
+    void Add(uint32_t id);
+
+    /** Subtract a sketch of the same number of cells. */
+    TxReconSketch& operator-=(const TxReconSketch& other);
+
+    /**
+     * Decode the ids added to this sketch but not subtracted (positive) and
+     * the ids subtracted but not added (negative). Returns false when the
+     * difference is too large for the sketch.
+     */
+    bool Decode(std::vector<uint32_t>& positive, std::vector<uint32_t>& negative) const;
+
+    SERIALIZE_METHODS(TxReconSketch, obj) { READWRITE(obj.m_cells); }
+
+private:
+    std::vector<Cell> m_cells;
+
+    size_t CellIndex(uint32_t id, unsigned int part) const;
+    void Toggle(size_t index, uint32_t id, int32_t count);
+};
+
+/**
+ * The number of cells of a sketch for a round between sets of local_size and
+ * remote_size transactions, expecting a q share of the smaller set to be
+ * missing from the larger one on top of their difference in size.
+ */
+size_t EstimateSketchCells(size_t local_size, size_t remote_size, double q);
+
+/**
+ * Reconciliation state of a peer that negotiated it with SENDRECON. Instead
+ * of announcing each transaction with INV, both sides collect the
+ * transactions for the peer in m_local_set. Every so often the side that
+ * made the connection (the initiator) asks for a sketch of the other side's
+ * set, subtracts a sketch of its own and announces what the peer lacks,
+ * while asking the peer to announce what it lacks itself.
+ */
+class TxReconciliationState
+{
+private:
+    //! SipHash keys derived from the salts of both sides
+    uint64_t m_k0, m_k1;
+
+public:
+    TxReconciliationState(bool initiator, uint64_t local_salt, uint64_t remote_salt);
+
+    const bool m_initiator;
+    //! Transactions to reconcile in the next round
+    std::set<uint256> m_local_set;
+    //! Transactions of the round in progress, by short id
+    std::map<uint32_t, uint256> m_snapshot;
+    //! When the initiator sent the request of the round in progress, or 0 between rounds
+    std::chrono::microseconds m_request_time{0};
+    //! When the initiator starts the next round
+    std::chrono::microseconds m_next_request{0};
+    //! The estimate of the set difference that sizes sketches
+    double m_q{DEFAULT_RECONCILIATION_Q};
+
+    uint32_t GetShortID(const uint256& txid) const;
+
+    /** Start a round: move the pending transactions into m_snapshot. */
+    void Snapshot();
+
+    /** End a round without reconciling, returning the transactions of the snapshot to announce. */
+    std::vector<uint256> TakeSnapshot();
+
+    TxReconSketch SnapshotSketch(size_t cells) const;
+
+    /**
+     * Initiator: reconcile the snapshot with the sketch of the peer's set and
+     * end the round. On success, announce holds the transactions the peer
+     * lacks and request the short ids of those it has to announce to us, and
+     * m_q is updated from the difference found. Returns false when the
+     * sketch could not be decoded; the snapshot is still kept then.
+     */
+    bool ProcessSketch(const TxReconSketch& remote, std::vector<uint256>& announce, std::vector<uint32_t>& request);
+
+    /** Responder: end the round, returning the transactions of the snapshot with the requested short ids. */
+    std::vector<uint256> TakeRequested(const std::vector<uint32_t>& request);
+};
+
+#endif // LITECOINZ_TXRECONCILIATION_H
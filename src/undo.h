@@ -49,7 +49,12 @@ struct TxInUndoFormatter
     }
 };
 
-/** Undo information for a CTransaction */
+/** Undo information for a CTransaction
+ *
+ * Sapling spends need none: disconnecting one only removes its nullifier,
+ * which the transaction itself carries, and the note commitment tree goes
+ * back to the root recorded in the previous block index.
+ */
 class CTxUndo
 {
 public:
@@ -2,9 +2,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-#include <vector>
-#include <assert.h>
+#include <util/asmap.h>
+
 #include <crypto/common.h>
+#include <sync.h>
+
+#include <algorithm>
+#include <assert.h>
 
 namespace {
 
@@ -62,10 +66,189 @@ uint32_t DecodeJump(std::vector<bool>::const_iterator& bitpos, const std::vector
     return DecodeBits(bitpos, endpos, 17, JUMP_BIT_SIZES);
 }
 
+/** The 128 bits of an address, most significant first */
+struct Bits128 {
+    uint64_t hi{0};
+    uint64_t lo{0};
+
+    void Set(int n) { (n < 64 ? hi : lo) |= uint64_t{1} << (63 - n % 64); }
+};
+
+/**
+ * Runs the bytecode like Interpret(), but for all addresses at once: both
+ * sides of a jump are followed, and each instruction that returns an ASN
+ * adds the range of the addresses that reach it.
+ */
+class AsmapDecoder
+{
+public:
+    AsmapDecoder(const std::vector<bool>& asmap, std::vector<DecodedAsmap::Range>& ranges) : m_asmap(asmap), m_ranges(ranges) {}
+
+    bool Run()
+    {
+        Walk(m_asmap.begin(), 0, Bits128(), 0);
+        return !m_overflow;
+    }
+
+private:
+    const std::vector<bool>& m_asmap;
+    std::vector<DecodedAsmap::Range>& m_ranges;
+    bool m_overflow{false};
+
+    void Add(const Bits128& prefix, uint32_t asn)
+    {
+        if (m_ranges.size() >= DecodedAsmap::MAX_RANGES) {
+            m_overflow = true;
+            return;
+        }
+        m_ranges.push_back({prefix.hi, prefix.lo, asn});
+    }
+
+    void Walk(std::vector<bool>::const_iterator pos, int depth, Bits128 prefix, uint32_t default_asn)
+    {
+        const std::vector<bool>::const_iterator endpos = m_asmap.end();
+        while (pos != endpos && !m_overflow) {
+            const uint32_t opcode = DecodeType(pos, endpos);
+            if (opcode == 0) {
+                Add(prefix, DecodeASN(pos, endpos));
+                return;
+            } else if (opcode == 1) {
+                const uint32_t jump = DecodeJump(pos, endpos);
+                if (depth == 128) break;
+                Bits128 one = prefix;
+                one.Set(depth);
+                if (jump >= endpos - pos) {
+                    Add(one, 0);
+                } else {
+                    Walk(pos + jump, depth + 1, one, default_asn);
+                }
+                depth++;
+            } else if (opcode == 2) {
+                const uint32_t match = DecodeMatch(pos, endpos);
+                const uint32_t matchlen = CountBits(match) - 1;
+                for (uint32_t bit = 0; bit < matchlen; bit++) {
+                    if (depth == 128) break;
+                    // The addresses with the other bit here get the default ASN
+                    Bits128 other = prefix;
+                    if ((match >> (matchlen - 1 - bit)) & 1) {
+                        prefix.Set(depth);
+                    } else {
+                        other.Set(depth);
+                    }
+                    Add(other, default_asn);
+                    depth++;
+                }
+            } else if (opcode == 3) {
+                default_asn = DecodeASN(pos, endpos);
+            } else {
+                break;
+            }
+        }
+        Add(prefix, 0);
+    }
+};
+
+std::vector<bool> ToBits(uint64_t hi, uint64_t lo)
+{
+    std::vector<bool> ip(128);
+    for (int i = 0; i < 64; i++) {
+        ip[i] = (hi >> (63 - i)) & 1;
+        ip[64 + i] = (lo >> (63 - i)) & 1;
+    }
+    return ip;
+}
+
+Mutex g_decoded_asmap_mutex;
+//! The asmap UseDecodedAsmap() was given, and its table
+const std::vector<bool>* g_decoded_asmap_source GUARDED_BY(g_decoded_asmap_mutex) = nullptr;
+std::shared_ptr<const DecodedAsmap> g_decoded_asmap GUARDED_BY(g_decoded_asmap_mutex);
+
+std::shared_ptr<const DecodedAsmap> FindDecodedAsmap(const std::vector<bool>& asmap)
+{
+    LOCK(g_decoded_asmap_mutex);
+    if (g_decoded_asmap_source != &asmap) return nullptr;
+    return g_decoded_asmap;
+}
+
+}
+
+std::unique_ptr<const DecodedAsmap> DecodedAsmap::Decode(const std::vector<bool>& asmap)
+{
+    std::unique_ptr<DecodedAsmap> decoded(new DecodedAsmap());
+    std::vector<Range>& ranges = decoded->m_ranges;
+    if (!AsmapDecoder(asmap, ranges).Run()) return nullptr;
+
+    // The prefixes of the instructions that return partition the addresses,
+    // so each range ends where the next one starts.
+    std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) {
+        return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+    });
+    if (ranges.empty() || ranges[0].hi != 0 || ranges[0].lo != 0) return nullptr;
+    std::vector<Range> merged;
+    for (const Range& range : ranges) {
+        if (!merged.empty() && merged.back().asn == range.asn) continue;
+        merged.push_back(range);
+    }
+    ranges.swap(merged);
+    ranges.shrink_to_fit();
+
+    // The bytecode stays the reference: the table has to agree with it at
+    // the first and the last address of every range.
+    for (size_t i = 0; i < ranges.size(); i++) {
+        uint64_t last_hi = ~uint64_t{0}, last_lo = ~uint64_t{0};
+        if (i + 1 < ranges.size()) {
+            last_hi = ranges[i + 1].hi - (ranges[i + 1].lo == 0 ? 1 : 0);
+            last_lo = ranges[i + 1].lo - 1;
+        }
+        if (Interpret(asmap, ToBits(ranges[i].hi, ranges[i].lo)) != ranges[i].asn ||
+            Interpret(asmap, ToBits(last_hi, last_lo)) != ranges[i].asn) {
+            return nullptr;
+        }
+    }
+    return std::move(decoded);
+}
+
+uint32_t DecodedAsmap::Lookup(uint64_t hi, uint64_t lo) const
+{
+    auto it = std::upper_bound(m_ranges.begin(), m_ranges.end(), std::make_pair(hi, lo), [](const std::pair<uint64_t, uint64_t>& ip, const Range& range) {
+        return ip.first < range.hi || (ip.first == range.hi && ip.second < range.lo);
+    });
+    assert(it != m_ranges.begin());
+    return std::prev(it)->asn;
+}
+
+bool UseDecodedAsmap(const std::vector<bool>& asmap)
+{
+    // Validating must not use the table of a previous asmap at the same address
+    ReleaseDecodedAsmap(asmap);
+    std::shared_ptr<const DecodedAsmap> decoded = DecodedAsmap::Decode(asmap);
+    LOCK(g_decoded_asmap_mutex);
+    g_decoded_asmap_source = decoded ? &asmap : nullptr;
+    g_decoded_asmap = std::move(decoded);
+    return g_decoded_asmap != nullptr;
+}
+
+void ReleaseDecodedAsmap(const std::vector<bool>& asmap)
+{
+    LOCK(g_decoded_asmap_mutex);
+    if (g_decoded_asmap_source != &asmap) return;
+    g_decoded_asmap_source = nullptr;
+    g_decoded_asmap.reset();
 }
 
 uint32_t Interpret(const std::vector<bool> &asmap, const std::vector<bool> &ip)
 {
+    if (ip.size() == 128) {
+        const std::shared_ptr<const DecodedAsmap> decoded = FindDecodedAsmap(asmap);
+        if (decoded) {
+            Bits128 bits;
+            for (int i = 0; i < 128; i++) {
+                if (ip[i]) bits.Set(i);
+            }
+            return decoded->Lookup(bits.hi, bits.lo);
+        }
+    }
+
     std::vector<bool>::const_iterator pos = asmap.begin();
     const std::vector<bool>::const_iterator endpos = asmap.end();
     uint8_t bits = ip.size();
@@ -5,6 +5,52 @@
 #ifndef BITCOIN_UTIL_ASMAP_H
 #define BITCOIN_UTIL_ASMAP_H
 
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
 uint32_t Interpret(const std::vector<bool> &asmap, const std::vector<bool> &ip);
 
+/**
+ * An asmap decoded into the ranges of 128 bit addresses it maps to the same
+ * ASN, sorted, so that a lookup is a binary search instead of running the
+ * bytecode bit by bit.
+ */
+class DecodedAsmap
+{
+public:
+    struct Range {
+        //! The first address of the range
+        uint64_t hi;
+        uint64_t lo;
+        uint32_t asn;
+    };
+
+    /**
+     * Decode asmap. Returns nullptr when it maps more ranges than
+     * MAX_RANGES, or when the table does not agree with Interpret() at the
+     * bounds of every range.
+     */
+    static std::unique_ptr<const DecodedAsmap> Decode(const std::vector<bool>& asmap);
+
+    static const size_t MAX_RANGES = 1 << 22;
+
+    uint32_t Lookup(uint64_t hi, uint64_t lo) const;
+
+    size_t Size() const { return m_ranges.size(); }
+
+private:
+    std::vector<Range> m_ranges;
+};
+
+/**
+ * Have Interpret() look addresses up in asmap in a decoded table. asmap must
+ * then stay unmodified at the same address until ReleaseDecodedAsmap().
+ * Returns false when asmap could not be decoded; Interpret() still works
+ * then, running the bytecode.
+ */
+bool UseDecodedAsmap(const std::vector<bool>& asmap);
+
+void ReleaseDecodedAsmap(const std::vector<bool>& asmap);
+
 #endif // BITCOIN_UTIL_ASMAP_H
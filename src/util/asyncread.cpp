@@ -0,0 +1,256 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <util/asyncread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#ifndef WIN32
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define USE_IO_URING 1
+#endif
+
+namespace {
+
+//! Read all the bytes of a single read, without moving the file position where it can be helped
+bool ReadFully(FileRead& read)
+{
+#ifdef WIN32
+    read.ok = _fseeki64(read.file, read.offset, SEEK_SET) == 0 &&
+              fread(read.data, 1, read.size, read.file) == read.size;
+#else
+    const int fd = fileno(read.file);
+    size_t done = 0;
+    while (done < read.size) {
+        const ssize_t n = pread(fd, read.data + done, read.size - done, read.offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    read.ok = done == read.size;
+#endif
+    return read.ok;
+}
+
+#ifdef USE_IO_URING
+
+/**
+ * The submission and completion rings of an io_uring, set up with the bare
+ * system calls. The ring is only used by the thread that made it.
+ */
+class IoRing
+{
+private:
+    int m_fd;
+    unsigned int m_entries{0};
+
+    void* m_sq_ring{MAP_FAILED};
+    size_t m_sq_ring_size{0};
+    void* m_cq_ring{MAP_FAILED};
+    size_t m_cq_ring_size{0};
+    io_uring_sqe* m_sqes{static_cast<io_uring_sqe*>(MAP_FAILED)};
+    size_t m_sqes_size{0};
+
+    unsigned int* m_sq_tail;
+    unsigned int* m_sq_mask;
+    unsigned int* m_sq_array;
+    unsigned int* m_cq_head;
+    unsigned int* m_cq_tail;
+    unsigned int* m_cq_mask;
+    io_uring_cqe* m_cqes;
+
+public:
+    explicit IoRing(unsigned int entries)
+    {
+        io_uring_params params{};
+        m_fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (m_fd < 0) return;
+        m_entries = params.sq_entries;
+
+        m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        m_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+        if (m_sq_ring == MAP_FAILED || m_cq_ring == MAP_FAILED || m_sqes == MAP_FAILED) {
+            m_entries = 0;
+            return;
+        }
+
+        unsigned char* sq = static_cast<unsigned char*>(m_sq_ring);
+        m_sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+        m_sq_mask = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+        unsigned char* cq = static_cast<unsigned char*>(m_cq_ring);
+        m_cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+        m_cq_mask = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~IoRing()
+    {
+        if (m_sqes != MAP_FAILED) munmap(m_sqes, m_sqes_size);
+        if (m_cq_ring != MAP_FAILED) munmap(m_cq_ring, m_cq_ring_size);
+        if (m_sq_ring != MAP_FAILED) munmap(m_sq_ring, m_sq_ring_size);
+        if (m_fd >= 0) close(m_fd);
+    }
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    bool IsValid() const { return m_entries > 0; }
+
+    /** Do all of reads, or return false if the ring fails, leaving the rest
+     *  of them to the caller. Reads the kernel cut short are resubmitted for
+     *  what is left of them. */
+    bool Read(std::vector<FileRead>& reads)
+    {
+        struct Pending {
+            iovec iov;
+            size_t done;
+        };
+        std::vector<Pending> pending(reads.size());
+        std::vector<size_t> queue;
+        queue.reserve(reads.size());
+        for (size_t i = 0; i < reads.size(); ++i) {
+            reads[i].ok = false;
+            pending[i].done = 0;
+            if (reads[i].size == 0) {
+                reads[i].ok = true;
+            } else {
+                queue.push_back(i);
+            }
+        }
+
+        size_t in_flight = 0;
+        while (!queue.empty() || in_flight > 0) {
+            // Fill the submission ring with as many of the waiting reads as it holds.
+            unsigned int to_submit = 0;
+            unsigned int tail = *m_sq_tail;
+            while (!queue.empty() && in_flight < m_entries) {
+                const size_t i = queue.back();
+                queue.pop_back();
+                FileRead& read = reads[i];
+                Pending& p = pending[i];
+                p.iov.iov_base = read.data + p.done;
+                p.iov.iov_len = read.size - p.done;
+
+                const unsigned int index = tail & *m_sq_mask;
+                io_uring_sqe* sqe = &m_sqes[index];
+                std::fill(reinterpret_cast<unsigned char*>(sqe), reinterpret_cast<unsigned char*>(sqe + 1), 0);
+                sqe->opcode = IORING_OP_READV;
+                sqe->fd = fileno(read.file);
+                sqe->off = read.offset + p.done;
+                sqe->addr = reinterpret_cast<uint64_t>(&p.iov);
+                sqe->len = 1;
+                sqe->user_data = i;
+                m_sq_array[index] = index;
+                ++tail;
+                ++to_submit;
+                ++in_flight;
+            }
+            __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+            // Hand them to the kernel and wait for at least one to complete.
+            while (true) {
+                const int ret = syscall(__NR_io_uring_enter, m_fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                if (ret >= 0) {
+                    to_submit -= std::min<unsigned int>(to_submit, ret);
+                    if (to_submit == 0) break;
+                } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    return false;
+                }
+            }
+
+            unsigned int head = *m_cq_head;
+            const unsigned int cq_tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != cq_tail; ++head) {
+                const io_uring_cqe& cqe = m_cqes[head & *m_cq_mask];
+                const size_t i = cqe.user_data;
+                --in_flight;
+                if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                    queue.push_back(i);
+                } else if (cqe.res > 0) {
+                    pending[i].done += cqe.res;
+                    if (pending[i].done < reads[i].size) {
+                        queue.push_back(i);
+                    } else {
+                        reads[i].ok = true;
+                    }
+                }
+                // Errors and the end of the file leave the read failed.
+            }
+            __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+        }
+        return true;
+    }
+};
+
+//! Cleared when the kernel turns io_uring down, so that threads stop asking
+std::atomic<bool> g_io_uring_usable{true};
+
+IoRing* ThreadRing()
+{
+    static thread_local std::unique_ptr<IoRing> ring;
+    if (!ring && g_io_uring_usable) {
+        ring.reset(new IoRing(ASYNC_READ_QUEUE_DEPTH));
+        if (!ring->IsValid()) {
+            // ENOSYS before Linux 5.1, EPERM under seccomp filters of containers.
+            g_io_uring_usable = false;
+        }
+    }
+    return ring && ring->IsValid() ? ring.get() : nullptr;
+}
+
+#endif // USE_IO_URING
+
+} // namespace
+
+bool AsyncReadsAvailable()
+{
+#ifdef USE_IO_URING
+    return ThreadRing() != nullptr;
+#else
+    return false;
+#endif
+}
+
+bool ReadFiles(std::vector<FileRead>& reads)
+{
+    bool ok = true;
+#ifdef USE_IO_URING
+    // A single read gains nothing from the ring.
+    if (reads.size() > 1) {
+        if (IoRing* ring = ThreadRing()) {
+            if (ring->Read(reads)) {
+                for (const FileRead& read : reads) ok &= read.ok;
+                return ok;
+            }
+        }
+    }
+#endif
+    for (FileRead& read : reads) {
+        ok &= ReadFully(read);
+    }
+    return ok;
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_UTIL_ASYNCREAD_H
+#define LITECOINZ_UTIL_ASYNCREAD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+//! Most reads ReadFiles keeps in flight at once on a thread
+static constexpr unsigned int ASYNC_READ_QUEUE_DEPTH = 64;
+
+/** A read of size bytes at offset of file into data. */
+struct FileRead {
+    FILE* file;
+    uint64_t offset;
+    unsigned char* data;
+    size_t size;
+    //! Set by ReadFiles: whether all size bytes were read
+    bool ok{false};
+
+    FileRead(FILE* file_in, uint64_t offset_in, unsigned char* data_in, size_t size_in)
+        : file(file_in), offset(offset_in), data(data_in), size(size_in) {}
+};
+
+/**
+ * Do all of reads, in no particular order. On Linux they go to an io_uring of
+ * the calling thread, which keeps up to ASYNC_READ_QUEUE_DEPTH of them in
+ * flight, so that a batch of random reads costs about one round trip to the
+ * disk; elsewhere, or where the kernel refuses io_uring, they are done one
+ * after the other. The position of the files is left alone.
+ *
+ * @returns true if every read got all of its bytes
+ */
+bool ReadFiles(std::vector<FileRead>& reads);
+
+/** Whether ReadFiles uses io_uring on this thread. */
+bool AsyncReadsAvailable();
+
+#endif // LITECOINZ_UTIL_ASYNCREAD_H
@@ -0,0 +1,231 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <util/notify.h>
+
+#include <logging.h>
+#include <sync.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/** The commands waiting for the notification threads. */
+struct NotifyQueue {
+    Mutex mutex;
+    std::condition_variable cond;
+    //! The commands with their keys, oldest first
+    std::deque<std::pair<std::string, std::string>> commands GUARDED_BY(mutex);
+    //! The keys of the commands running
+    std::set<std::string> running GUARDED_BY(mutex);
+    //! Whether commands were dropped since the queue was last below MAX_NOTIFY_QUEUE
+    bool dropping GUARDED_BY(mutex){false};
+    bool stop GUARDED_BY(mutex){false};
+};
+
+/** The listening notification socket and its clients. */
+struct NotifySocket {
+    int listen_fd{-1};
+    std::vector<int> clients;
+    fs::path path;
+};
+
+Mutex g_notify_mutex;
+//! Shared with the threads, which may outlive StopNotifications() while a command finishes
+std::shared_ptr<NotifyQueue> g_notify_queue GUARDED_BY(g_notify_mutex);
+NotifySocket g_notify_socket GUARDED_BY(g_notify_mutex);
+
+#if HAVE_SYSTEM
+void RunCommands(std::shared_ptr<NotifyQueue> queue)
+{
+    WAIT_LOCK(queue->mutex, lock);
+    while (!queue->stop) {
+        auto next = std::find_if(queue->commands.begin(), queue->commands.end(), [&](const std::pair<std::string, std::string>& command) {
+            return command.second.empty() || !queue->running.count(command.second);
+        });
+        if (next == queue->commands.end()) {
+            queue->cond.wait(lock);
+            continue;
+        }
+        const std::pair<std::string, std::string> command = std::move(*next);
+        queue->commands.erase(next);
+        if (!command.second.empty()) queue->running.insert(command.second);
+        {
+            REVERSE_LOCK(lock);
+            runCommand(command.first);
+        }
+        if (!command.second.empty()) queue->running.erase(command.second);
+        // Another command of the key can run now
+        queue->cond.notify_all();
+    }
+}
+#endif
+
+#ifndef WIN32
+void CloseNotifySocket(NotifySocket& notify_socket)
+{
+    for (int fd : notify_socket.clients) {
+        close(fd);
+    }
+    notify_socket.clients.clear();
+    if (notify_socket.listen_fd >= 0) {
+        close(notify_socket.listen_fd);
+        notify_socket.listen_fd = -1;
+        unlink(notify_socket.path.string().c_str());
+    }
+}
+
+bool OpenNotifySocket(NotifySocket& notify_socket, const fs::path& path, std::string& error)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.string().size() >= sizeof(addr.sun_path)) {
+        error = strprintf("Notification socket path %s is too long", path.string());
+        return false;
+    }
+    strncpy(addr.sun_path, path.string().c_str(), sizeof(addr.sun_path) - 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        error = strprintf("Cannot create notification socket: %s", strerror(errno));
+        return false;
+    }
+    // A socket left behind by a node that did not shut down cleanly
+    unlink(addr.sun_path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) == -1) {
+        error = strprintf("Cannot listen on notification socket %s: %s", path.string(), strerror(errno));
+        close(fd);
+        return false;
+    }
+    notify_socket.listen_fd = fd;
+    notify_socket.path = path;
+    return true;
+}
+#endif
+
+} // namespace
+
+bool StartNotifications(int threads, const fs::path& socket_path, std::string& error)
+{
+    LOCK(g_notify_mutex);
+    if (!socket_path.empty()) {
+#ifndef WIN32
+        if (!OpenNotifySocket(g_notify_socket, socket_path, error)) return false;
+        LogPrintf("Notification socket listening on %s\n", socket_path.string());
+#else
+        error = "Notification sockets are not supported on this platform";
+        return false;
+#endif
+    }
+
+    g_notify_queue = std::make_shared<NotifyQueue>();
+#if HAVE_SYSTEM
+    for (int i = 0; i < threads; ++i) {
+        std::shared_ptr<NotifyQueue> queue = g_notify_queue;
+        std::thread(&TraceThread<std::function<void()>>, "notify", std::function<void()>([queue] {
+            RunCommands(queue);
+        })).detach();
+    }
+#endif
+    return true;
+}
+
+void StopNotifications()
+{
+    LOCK(g_notify_mutex);
+    if (g_notify_queue) {
+        LOCK(g_notify_queue->mutex);
+        g_notify_queue->stop = true;
+        g_notify_queue->commands.clear();
+        g_notify_queue->cond.notify_all();
+    }
+    g_notify_queue.reset();
+#ifndef WIN32
+    CloseNotifySocket(g_notify_socket);
+#endif
+}
+
+void QueueNotifyCommand(const std::string& command, const std::string& key)
+{
+#if HAVE_SYSTEM
+    std::shared_ptr<NotifyQueue> queue = WITH_LOCK(g_notify_mutex, return g_notify_queue);
+    if (!queue) return;
+
+    LOCK(queue->mutex);
+    for (std::pair<std::string, std::string>& waiting : queue->commands) {
+        if (key.empty() ? waiting.second.empty() && waiting.first == command : waiting.second == key) {
+            waiting.first = command;
+            return;
+        }
+    }
+    if (queue->commands.size() >= MAX_NOTIFY_QUEUE) {
+        if (!queue->dropping) {
+            LogPrintf("Notification command queue is full, dropping commands until it drains\n");
+            queue->dropping = true;
+        }
+        return;
+    }
+    queue->dropping = false;
+    queue->commands.emplace_back(command, key);
+    queue->cond.notify_one();
+#endif
+}
+
+void SendNotification(const std::string& line)
+{
+#ifndef WIN32
+    LOCK(g_notify_mutex);
+    if (g_notify_socket.listen_fd < 0) return;
+
+    // Clients are accepted as notifications go out, as they only ever read.
+    int fd;
+    while ((fd = accept(g_notify_socket.listen_fd, nullptr, nullptr)) >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        g_notify_socket.clients.push_back(fd);
+    }
+
+    const std::string message = line + "\n";
+    auto it = g_notify_socket.clients.begin();
+    while (it != g_notify_socket.clients.end()) {
+#ifdef MSG_NOSIGNAL
+        const ssize_t sent = send(*it, message.data(), message.size(), MSG_NOSIGNAL);
+#else
+        const ssize_t sent = send(*it, message.data(), message.size(), 0);
+#endif
+        if (sent == (ssize_t)message.size()) {
+            ++it;
+            continue;
+        }
+        // A partly written line cannot be completed later without blocking,
+        // so the client is dropped rather than sent a corrupt stream.
+        LogPrint(BCLog::NET, "Disconnecting notification socket client: %s\n", sent < 0 ? strerror(errno) : "too slow");
+        close(*it);
+        it = g_notify_socket.clients.erase(it);
+    }
+#endif
+}
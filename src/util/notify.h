@@ -0,0 +1,44 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_UTIL_NOTIFY_H
+#define LITECOINZ_UTIL_NOTIFY_H
+
+#include <fs.h>
+
+#include <stddef.h>
+#include <string>
+
+//! Default for -notifythreads
+static const int DEFAULT_NOTIFY_THREADS = 2;
+//! Maximum for -notifythreads
+static const int MAX_NOTIFY_THREADS = 16;
+//! Most notification commands waiting to run; further ones are dropped
+static const size_t MAX_NOTIFY_QUEUE = 1000;
+
+/**
+ * Start the threads that run the commands of -blocknotify, -walletnotify and
+ * -alertnotify and, if socket_path is not empty, listen for clients of the
+ * notification socket there. Returns false with error set if the socket
+ * cannot be set up.
+ */
+bool StartNotifications(int threads, const fs::path& socket_path, std::string& error);
+/** Stop running queued commands and close the notification socket. Commands still running are left to finish. */
+void StopNotifications();
+
+/**
+ * Run command on a notification thread. A command with a key replaces the
+ * one of that key still waiting, and no two commands of a key run at the same
+ * time, so of a burst of them only the first and the last are run. Commands
+ * without one are run once each, unless the same one is still waiting.
+ */
+void QueueNotifyCommand(const std::string& command, const std::string& key = "");
+
+/**
+ * Write line, with a newline appended, to the clients connected to the
+ * notification socket. Clients that do not keep up are disconnected.
+ */
+void SendNotification(const std::string& line);
+
+#endif // LITECOINZ_UTIL_NOTIFY_H
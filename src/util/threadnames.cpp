@@ -6,6 +6,8 @@
 #include <config/bitcoin-config.h>
 #endif
 
+#include <map>
+#include <mutex>
 #include <thread>
 
 #if (defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__DragonFly__))
@@ -13,8 +15,18 @@
 #include <pthread_np.h>
 #endif
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h> // For cpu_set_t
+#endif
+
 #include <util/threadnames.h>
 
+#include <util/strencodings.h>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+
 #ifdef HAVE_SYS_PRCTL_H
 #include <sys/prctl.h> // For prctl, PR_SET_NAME, PR_GET_NAME
 #endif
@@ -54,9 +66,42 @@ const std::string& util::ThreadGetInternalName() { return empty_string; }
 static void SetInternalName(std::string name) { }
 #endif
 
+#if defined(__linux__)
+#define HAVE_THREAD_AFFINITY 1
+#endif
+
+//! CPU_SETSIZE of glibc
+static const int MAX_AFFINITY_CPUS = 1024;
+
+//! The CPUs of the pools set with ThreadSetPoolAffinity
+static std::mutex g_pool_affinity_mutex;
+static std::map<std::string, std::vector<int>> g_pool_affinity; // GUARDED_BY(g_pool_affinity_mutex)
+
+//! Pin the calling thread to the CPUs of its pool, if it has any. Memory
+//! the thread touches first then lands on their NUMA node.
+static void SetThreadAffinity(const std::string& name)
+{
+#if defined(HAVE_THREAD_AFFINITY)
+    std::vector<int> cpus;
+    {
+        std::lock_guard<std::mutex> lock(g_pool_affinity_mutex);
+        auto it = g_pool_affinity.find(util::ThreadPoolName(name));
+        if (it == g_pool_affinity.end()) return;
+        cpus = it->second;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+    ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#else
+    (void)name;
+#endif
+}
+
 void util::ThreadRename(std::string&& name)
 {
     SetThreadName(("b-" + name).c_str());
+    SetThreadAffinity(name);
     SetInternalName(std::move(name));
 }
 
@@ -64,3 +109,41 @@ void util::ThreadSetInternalName(std::string&& name)
 {
     SetInternalName(std::move(name));
 }
+
+bool util::ParseCpuList(const std::string& str, std::vector<int>& cpus)
+{
+    cpus.clear();
+    std::vector<std::string> ranges;
+    boost::split(ranges, str, boost::is_any_of(","));
+    for (const std::string& range : ranges) {
+        const size_t dash = range.find('-');
+        int32_t first, last;
+        if (!ParseInt32(range.substr(0, dash), &first)) return false;
+        last = first;
+        if (dash != std::string::npos && !ParseInt32(range.substr(dash + 1), &last)) return false;
+        if (first < 0 || last < first || last >= MAX_AFFINITY_CPUS) return false;
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return !cpus.empty();
+}
+
+std::string util::ThreadPoolName(const std::string& name)
+{
+    const size_t dot = name.rfind('.');
+    if (dot == std::string::npos || dot + 1 == name.size()) return name;
+    for (size_t i = dot + 1; i < name.size(); ++i) {
+        if (!IsDigit(name[i])) return name;
+    }
+    return name.substr(0, dot);
+}
+
+bool util::ThreadSetPoolAffinity(const std::string& pool, const std::vector<int>& cpus)
+{
+#if defined(HAVE_THREAD_AFFINITY)
+    std::lock_guard<std::mutex> lock(g_pool_affinity_mutex);
+    g_pool_affinity[pool] = cpus;
+    return true;
+#else
+    return false;
+#endif
+}
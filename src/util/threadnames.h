@@ -6,6 +6,7 @@
 #define BITCOIN_UTIL_THREADNAMES_H
 
 #include <string>
+#include <vector>
 
 namespace util {
 //! Rename a thread both in terms of an internal (in-memory) name as well
@@ -21,6 +22,16 @@ void ThreadSetInternalName(std::string&&);
 //! logging.
 const std::string& ThreadGetInternalName();
 
+//! Parse a list of CPUs like "0-3,8", as -threadaffinity takes them.
+bool ParseCpuList(const std::string& str, std::vector<int>& cpus);
+
+//! The pool of a thread name: the name without its ".<n>" worker number.
+std::string ThreadPoolName(const std::string& name);
+
+//! Pin the threads of pool that are renamed from now on to cpus. Returns
+//! false if the platform does not support setting thread affinity.
+bool ThreadSetPoolAffinity(const std::string& pool, const std::vector<int>& cpus);
+
 } // namespace util
 
 #endif // BITCOIN_UTIL_THREADNAMES_H
@@ -9,6 +9,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <checkqueue.h>
+#include <crypto/common.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_check.h>
@@ -20,17 +21,22 @@
 #include <index/txindex.h>
 #include <logging.h>
 #include <logging/timer.h>
+#include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
 #include <pow.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
+#include <proof_verifier.h>
+#include <proofcache.h>
 #include <random.h>
 #include <reverse_iterator.h>
 #include <script/script.h>
 #include <script/sigcache.h>
 #include <shutdown.h>
+#include <threadinterrupt.h>
 #include <timedata.h>
 #include <tinyformat.h>
 #include <txdb.h>
@@ -38,15 +44,20 @@
 #include <ui_interface.h>
 #include <uint256.h>
 #include <undo.h>
+#include <util/asyncread.h>
 #include <util/moneystr.h>
+#include <util/notify.h>
 #include <util/rbf.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/trace.h>
 #include <util/translation.h>
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <deque>
 #include <string>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -92,6 +103,11 @@ CChain& ChainActive() {
     return g_chainstate->m_chain;
 }
 
+std::unique_ptr<CChainState> g_background_chainstate;
+
+//! The directory of the coins database of a chainstate loaded from a UTXO snapshot
+static const char* const SNAPSHOT_CHAINSTATE_DIR = "chainstate_snapshot";
+
 /**
  * Mutex to guard access to validation specific variables, such as reading
  * or changing the chainstate.
@@ -115,6 +131,7 @@ bool fHavePruned = false;
 bool fPruneMode = false;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
+bool fTrustBlockIndex = DEFAULT_TRUST_BLOCK_INDEX;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -123,6 +140,9 @@ int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 uint256 hashAssumeValid;
 arith_uint256 nMinimumChainWork;
 
+//! The UTXO snapshot the active chainstate was loaded from, while it is being validated and until the next start
+static std::unique_ptr<SnapshotRecord> g_active_snapshot GUARDED_BY(cs_main);
+
 CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
 
 CBlockPolicyEstimator feeEstimator;
@@ -155,6 +175,13 @@ CBlockIndex* LookupBlockIndex(const uint256& hash)
     return it == g_blockman.m_block_index.end() ? nullptr : it->second;
 }
 
+const CBlockIndex* LookupBlockIndexShared(const uint256& hash)
+{
+    boost::shared_lock<boost::shared_mutex> lock(g_blockman.m_block_index_mutex);
+    BlockMap::const_iterator it = g_blockman.m_block_index.find(hash);
+    return it == g_blockman.m_block_index.end() ? nullptr : it->second;
+}
+
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
 {
     AssertLockHeld(cs_main);
@@ -180,10 +207,16 @@ std::unique_ptr<CBlockTreeDB> pblocktree;
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
+static bool CheckShieldedProofs(const CTransaction& tx, uint32_t consensusBranchId, TxValidationState& state, bool cacheStore, std::vector<CShieldedProofCheck>* pvChecks);
+static bool CheckPackageInputsInParallel(const std::vector<CTransactionRef>& txns, const CCoinsViewCache& inputs, uint32_t consensusBranchId, std::vector<PrecomputedTransactionData>& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+static void AcceptReorgTransactionsToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& txns, std::vector<bool>& accepted) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs);
 static FILE* OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
 
+//! Maps of the most recently read block files. Not used where the address space is small.
+static FlatFileMapCache g_block_file_maps(sizeof(void*) >= 8 ? MAX_MAPPED_BLOCK_FILES : 0);
+
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
     AssertLockHeld(cs_main);
@@ -234,7 +267,7 @@ bool TestLockPointValidity(const LockPoints* lp)
     return true;
 }
 
-bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp, bool useExistingLockPoints)
+bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp, bool useExistingLockPoints, const CCoinsView* coins_view)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(pool.cs);
@@ -261,12 +294,13 @@ bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flag
     else {
         // CoinsTip() contains the UTXO set for ::ChainActive().Tip()
         CCoinsViewMemPool viewMemPool(&::ChainstateActive().CoinsTip(), pool);
+        const CCoinsView& view = coins_view ? *coins_view : viewMemPool;
         std::vector<int> prevheights;
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
             Coin coin;
-            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
+            if (!view.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
             if (coin.nHeight == MEMPOOL_HEIGHT) {
@@ -358,20 +392,20 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
     // Iterate disconnectpool in reverse, so that we add transactions
     // back to the mempool starting with the earliest transaction that had
     // been previously seen in a block.
-    auto it = disconnectpool.queuedTx.get<insertion_order>().rbegin();
-    while (it != disconnectpool.queuedTx.get<insertion_order>().rend()) {
-        // ignore validation errors in resurrected transactions
-        TxValidationState stateDummy;
-        if (!fAddToMempool || (*it)->IsCoinBase() ||
-            !AcceptToMemoryPool(mempool, stateDummy, *it,
-                                nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */)) {
+    const std::vector<CTransactionRef> txns(disconnectpool.queuedTx.get<insertion_order>().rbegin(),
+                                            disconnectpool.queuedTx.get<insertion_order>().rend());
+    std::vector<bool> accepted(txns.size(), false);
+    if (fAddToMempool && !txns.empty()) {
+        AcceptReorgTransactionsToMemoryPool(mempool, txns, accepted);
+    }
+    for (size_t i = 0; i < txns.size(); i++) {
+        if (!accepted[i]) {
             // If the transaction doesn't make it in to the mempool, remove any
             // transactions that depend on it (which would now be orphans).
-            mempool.removeRecursive(**it, MemPoolRemovalReason::REORG);
-        } else if (mempool.exists((*it)->GetHash())) {
-            vHashUpdate.push_back((*it)->GetHash());
+            mempool.removeRecursive(*txns[i], MemPoolRemovalReason::REORG);
+        } else {
+            vHashUpdate.push_back(txns[i]->GetHash());
         }
-        ++it;
     }
     disconnectpool.queuedTx.clear();
     // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
@@ -388,9 +422,10 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
 }
 
 // Used to avoid mempool polluting consensus critical paths if CCoinsViewMempool
-// were somehow broken and returning the wrong scriptPubKeys
+// were somehow broken and returning the wrong scriptPubKeys. Inputs may also
+// come from the not yet added transactions of package_txns.
 static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationState& state, const CCoinsViewCache& view, const CTxMemPool& pool,
-                 unsigned int flags, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+                 unsigned int flags, PrecomputedTransactionData& txdata, const std::map<uint256, CTransactionRef>* package_txns = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     AssertLockHeld(cs_main);
 
     // pool.cs should be locked already, but go ahead and re-take the lock here
@@ -408,7 +443,11 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationS
         if (coin.IsSpent()) return false;
 
         // Check equivalence for available inputs.
-        const CTransactionRef& txFrom = pool.get(txin.prevout.hash);
+        CTransactionRef txFrom = pool.get(txin.prevout.hash);
+        if (!txFrom && package_txns) {
+            const auto it = package_txns->find(txin.prevout.hash);
+            if (it != package_txns->end()) txFrom = it->second;
+        }
         if (txFrom) {
             assert(txFrom->GetHash() == txin.prevout.hash);
             assert(txFrom->vout.size() > txin.prevout.n);
@@ -453,11 +492,27 @@ public:
          */
         std::vector<COutPoint>& m_coins_to_uncache;
         const bool m_test_accept;
+        /*
+         * Whether the transaction is part of a package, whose feerate and
+         * mempool limits are checked as a whole by AcceptPackage().
+         */
+        const bool m_package;
     };
 
     // Single transaction acceptance
     bool AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    // Package acceptance. args.m_state receives the reason the package was
+    // rejected, tx_states the state of each of its transactions; the absurd
+    // fee of each transaction follows from max_fee_rate.
+    bool AcceptPackage(const std::vector<CTransactionRef>& package, ATMPArgs& args, std::vector<TxValidationState>& tx_states, const CFeeRate& max_fee_rate) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    // Re-acceptance of the transactions of disconnected blocks, in the order
+    // they were in the chain. Unlike a package, each transaction is accepted
+    // or rejected on its own, and those spending a rejected one are rejected
+    // too; accepted receives which made it in.
+    void AcceptReorgTransactions(const std::vector<CTransactionRef>& txns, const CChainParams& chainparams, std::vector<bool>& accepted) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
@@ -490,8 +545,8 @@ private:
     // Re-run the script checks, using consensus flags, and try to cache the
     // result in the scriptcache. This should be done after
     // PolicyScriptChecks(). This requires that all inputs either be in our
-    // utxo set or in the mempool.
-    bool ConsensusScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData &txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    // utxo set, in the mempool or among package_txns.
+    bool ConsensusScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData &txdata, const std::map<uint256, CTransactionRef>* package_txns = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Try to add the transaction to the mempool, removing any conflicts first.
     // Returns true if the transaction is in the mempool after any size
@@ -575,6 +630,11 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     if (!CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
         return state.Invalid(TxValidationResult::TX_PREMATURE_SPEND, "non-final");
 
+    // Nor transactions that CTxMemPool::RemoveExpired() would evict with the
+    // next block.
+    if (tx.nExpiryHeight != 0 && tx.nExpiryHeight <= (unsigned int)::ChainActive().Height() + 1)
+        return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "tx-expired");
+
     // is it already in the memory pool?
     if (m_pool.exists(hash)) {
         return state.Invalid(TxValidationResult::TX_CONFLICT, "txn-already-in-mempool");
@@ -585,6 +645,11 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     {
         const CTransaction* ptxConflicting = m_pool.GetConflictTx(txin.prevout);
         if (ptxConflicting) {
+            // Replacements are evaluated one transaction at a time, so
+            // packages may not replace anything.
+            if (args.m_package) {
+                return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-mempool-conflict");
+            }
             if (!setConflicts.count(ptxConflicting->GetHash()))
             {
                 // Allow opt-out of transaction replacement by setting
@@ -643,6 +708,24 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         }
     }
 
+    // Load the Sapling nullifiers and anchors the transaction depends on, so
+    // that CheckTxInputs can see them once the backend is switched to dummy.
+    for (const SpendDescription& spend : tx.vShieldedSpend) {
+        if (m_pool.HasSaplingNullifier(spend.nullifier)) {
+            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-mempool-conflict");
+        }
+        m_view.HaveNullifier(spend.nullifier);
+        SaplingMerkleTree tree;
+        m_view.GetSaplingAnchorAt(spend.anchor, tree);
+    }
+    for (const JSDescription& joinsplit : tx.vJoinSplit) {
+        for (const uint256& nullifier : joinsplit.nullifiers) {
+            if (m_pool.HasSproutNullifier(nullifier)) {
+                return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "txn-mempool-conflict");
+            }
+        }
+    }
+
     // Bring the best block into scope
     m_view.GetBestBlock();
 
@@ -655,8 +738,9 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     // block; we don't want our mempool filled up with transactions that can't
     // be mined yet.
     // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
-    // CoinsViewCache instead of create its own
-    if (!CheckSequenceLocks(m_pool, tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+    // CoinsViewCache instead of create its own. The inputs of a package
+    // transaction may be outputs of the ones before it, which only m_view has.
+    if (!CheckSequenceLocks(m_pool, tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp, false, args.m_package ? &m_view : nullptr))
         return state.Invalid(TxValidationResult::TX_PREMATURE_SPEND, "non-BIP68-final");
 
     CAmount nFees = 0;
@@ -699,8 +783,8 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
                 strprintf("%d", nSigOpsCost));
 
     // No transactions are allowed below minRelayTxFee except from disconnected
-    // blocks
-    if (!bypass_limits && !CheckFeeRate(nSize, nModifiedFees, state)) return false;
+    // blocks. The transactions of a package only need to meet it together.
+    if (!bypass_limits && !args.m_package && !CheckFeeRate(nSize, nModifiedFees, state)) return false;
 
     if (nAbsurdFee && nFees > nAbsurdFee)
         return state.Invalid(TxValidationResult::TX_NOT_STANDARD,
@@ -922,10 +1006,18 @@ bool MemPoolAccept::PolicyScriptChecks(ATMPArgs& args, Workspace& ws, Precompute
         return false; // state filled in by CheckInputScripts
     }
 
+    // Verify the shielded proofs after the scripts, as they are even more
+    // expensive, and cache the results so that ConnectBlock does not have
+    // to verify them again.
+    const uint32_t consensusBranchId = args.m_chainparams.GetConsensus().BranchId(::ChainActive().Height() + 1);
+    if (!CheckShieldedProofs(tx, consensusBranchId, state, true, nullptr)) {
+        return false; // state filled in by CheckShieldedProofs
+    }
+
     return true;
 }
 
-bool MemPoolAccept::ConsensusScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata)
+bool MemPoolAccept::ConsensusScriptChecks(ATMPArgs& args, Workspace& ws, PrecomputedTransactionData& txdata, const std::map<uint256, CTransactionRef>* package_txns)
 {
     const CTransaction& tx = *ws.m_ptx;
     const uint256& hash = ws.m_hash;
@@ -949,7 +1041,7 @@ bool MemPoolAccept::ConsensusScriptChecks(ATMPArgs& args, Workspace& ws, Precomp
     // invalid blocks (using TestBlockValidity), however allowing such
     // transactions into the mempool can be exploited as a DoS attack.
     unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(::ChainActive().Tip(), chainparams.GetConsensus());
-    if (!CheckInputsFromMempoolAndCache(tx, state, m_view, m_pool, currentBlockScriptVerifyFlags, txdata)) {
+    if (!CheckInputsFromMempoolAndCache(tx, state, m_view, m_pool, currentBlockScriptVerifyFlags, txdata, package_txns)) {
         return error("%s: BUG! PLEASE REPORT THIS! CheckInputScripts failed against latest-block but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), state.ToString());
     }
@@ -990,13 +1082,24 @@ bool MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
     // - it's not being re-added during a reorg which bypasses typical mempool fee limits
     // - the node is not behind
     // - the transaction is not dependent on any other transactions in the mempool
-    bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation() && m_pool.HasNoInputsOf(tx);
+    // - it is not part of a package, whose feerate does not tell how soon it confirms on its own
+    bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && !args.m_package && IsCurrentForFeeEstimation() && m_pool.HasNoInputsOf(tx);
+
+    // The ancestors found by PreChecks() miss the transactions of the package
+    // added before this one. The package limits have been checked already.
+    if (args.m_package) {
+        std::string dummy_err_string;
+        setAncestors.clear();
+        m_pool.CalculateMemPoolAncestors(*entry, setAncestors, std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint64_t>::max(),
+                                         std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint64_t>::max(), dummy_err_string);
+    }
 
     // Store transaction in memory
     m_pool.addUnchecked(*entry, setAncestors, validForFeeEstimation);
 
-    // trim mempool and check if tx was trimmed
-    if (!bypass_limits) {
+    // trim mempool and check if tx was trimmed, a package is trimmed once all
+    // of it is in
+    if (!bypass_limits && !args.m_package) {
         LimitMempoolSize(m_pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, std::chrono::hours{gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
         if (!m_pool.exists(hash))
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
@@ -1028,11 +1131,254 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
 
     if (!Finalize(args, workspace)) return false;
 
-    GetMainSignals().TransactionAddedToMempool(ptx);
+    GetMainSignals().TransactionAddedToMempool(ptx, m_pool.GetAndIncrementSequence());
+
+    return true;
+}
+
+bool MemPoolAccept::AcceptPackage(const std::vector<CTransactionRef>& package, ATMPArgs& args, std::vector<TxValidationState>& tx_states, const CFeeRate& max_fee_rate)
+{
+    AssertLockHeld(cs_main);
+    TxValidationState& package_state = args.m_state;
+
+    if (package.empty() || package.size() > MAX_PACKAGE_COUNT) {
+        return package_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "package-too-many-transactions");
+    }
+
+    // Each transaction may only spend outputs of the ones before it, and no
+    // two may spend the same output or reveal the same nullifier.
+    std::map<uint256, size_t> positions;
+    std::set<COutPoint> spent_outpoints;
+    std::set<uint256> sprout_nullifiers, sapling_nullifiers;
+    for (size_t i = 0; i < package.size(); i++) {
+        if (!positions.emplace(package[i]->GetHash(), i).second) {
+            return package_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "package-contains-duplicates");
+        }
+    }
+    for (size_t i = 0; i < package.size(); i++) {
+        const CTransaction& tx = *package[i];
+        for (const CTxIn& txin : tx.vin) {
+            const auto it = positions.find(txin.prevout.hash);
+            if (it != positions.end() && it->second >= i) {
+                return package_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "package-not-sorted");
+            }
+            if (!spent_outpoints.insert(txin.prevout).second) {
+                return package_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "conflict-in-package");
+            }
+        }
+        for (const JSDescription& joinsplit : tx.vJoinSplit) {
+            for (const uint256& nullifier : joinsplit.nullifiers) {
+                if (!sprout_nullifiers.insert(nullifier).second) {
+                    return package_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "conflict-in-package");
+                }
+            }
+        }
+        for (const SpendDescription& spend : tx.vShieldedSpend) {
+            if (!sapling_nullifiers.insert(spend.nullifier).second) {
+                return package_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "conflict-in-package");
+            }
+        }
+    }
+
+    LOCK(m_pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+
+    // The transactions left to accept, their positions in the package and
+    // their absurd fees, which ATMPArgs refers to.
+    std::vector<CTransactionRef> txns;
+    std::vector<size_t> indexes;
+    std::vector<CAmount> absurd_fees;
+    for (size_t i = 0; i < package.size(); i++) {
+        if (m_pool.exists(package[i]->GetHash())) continue;
+        txns.push_back(package[i]);
+        indexes.push_back(i);
+        absurd_fees.push_back(max_fee_rate.GetFee(GetVirtualTransactionSize(*package[i])));
+    }
+    if (txns.empty()) return true;
+
+    std::vector<Workspace> workspaces;
+    workspaces.reserve(txns.size());
+    for (const CTransactionRef& ptx : txns) {
+        workspaces.emplace_back(ptx);
+    }
+    auto tx_args = [&](size_t i) -> ATMPArgs {
+        return ATMPArgs{args.m_chainparams, tx_states[indexes[i]], args.m_accept_time, args.m_replaced_transactions,
+                        args.m_bypass_limits, absurd_fees[i], args.m_coins_to_uncache, args.m_test_accept, /* package */ true};
+    };
+    auto reject_tx = [&](size_t i) -> bool {
+        const TxValidationState& state = tx_states[indexes[i]];
+        return package_state.Invalid(state.GetResult(), "package-tx-invalid",
+                                     strprintf("%s: %s", txns[i]->GetHash().ToString(), state.ToString()));
+    };
+
+    // Run the policy checks of each transaction in order, making its outputs
+    // available to the ones after it.
+    size_t package_size = 0;
+    CAmount package_fees = 0;
+    CTxMemPool::setEntries package_ancestors;
+    for (size_t i = 0; i < txns.size(); i++) {
+        ATMPArgs tx_args_i = tx_args(i);
+        if (!PreChecks(tx_args_i, workspaces[i])) return reject_tx(i);
+        package_size += workspaces[i].m_entry->GetTxSize();
+        package_fees += workspaces[i].m_modified_fees;
+        package_ancestors.insert(workspaces[i].m_ancestors.begin(), workspaces[i].m_ancestors.end());
+        AddCoins(m_view, *txns[i], MEMPOOL_HEIGHT);
+    }
+
+    // Check the limits as if the package were a single transaction: every
+    // in-mempool ancestor of one of its transactions counts as an ancestor
+    // of all of them, and all of them count as its descendants.
+    size_t ancestors_size = package_size;
+    for (CTxMemPool::txiter ancestor : package_ancestors) {
+        ancestors_size += ancestor->GetTxSize();
+        if (ancestor->GetCountWithDescendants() + txns.size() > m_limit_descendants ||
+                ancestor->GetSizeWithDescendants() + package_size > m_limit_descendant_size) {
+            return package_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "package-mempool-limits",
+                                         strprintf("too many descendants for tx %s", ancestor->GetTx().GetHash().ToString()));
+        }
+    }
+    if (package_ancestors.size() + txns.size() > m_limit_ancestors || ancestors_size > m_limit_ancestor_size ||
+            txns.size() > m_limit_descendants || package_size > m_limit_descendant_size) {
+        return package_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "package-mempool-limits",
+                                     strprintf("%u transactions of %u bytes with %u in-mempool ancestors", txns.size(), package_size, package_ancestors.size()));
+    }
+
+    if (!args.m_bypass_limits && !CheckFeeRate(package_size, package_fees, package_state)) return false;
+
+    // Verify the scripts and proofs of all transactions at once on the script
+    // check threads. Should any fail, check them one by one to find out which
+    // and why.
+    std::vector<PrecomputedTransactionData> txdata(txns.size());
+    const uint32_t consensusBranchId = args.m_chainparams.GetConsensus().BranchId(::ChainActive().Height() + 1);
+    if (!g_parallel_script_checks || !CheckPackageInputsInParallel(txns, m_view, consensusBranchId, txdata)) {
+        for (size_t i = 0; i < txns.size(); i++) {
+            ATMPArgs tx_args_i = tx_args(i);
+            if (!PolicyScriptChecks(tx_args_i, workspaces[i], txdata[i])) return reject_tx(i);
+        }
+    }
+
+    // Run the consensus checks of all transactions before adding any, so
+    // that the package is either accepted as a whole or not at all. The
+    // inputs of each may come from the ones before it. The signatures are in
+    // the signature cache by now.
+    std::map<uint256, CTransactionRef> package_txns;
+    for (const CTransactionRef& ptx : txns) {
+        package_txns.emplace(ptx->GetHash(), ptx);
+    }
+    for (size_t i = 0; i < txns.size(); i++) {
+        ATMPArgs tx_args_i = tx_args(i);
+        if (!ConsensusScriptChecks(tx_args_i, workspaces[i], txdata[i], &package_txns)) return reject_tx(i);
+    }
+
+    if (args.m_test_accept) return true;
+
+    // Adding a package transaction does not fail, its limits were checked
+    // for the package as a whole.
+    for (size_t i = 0; i < txns.size(); i++) {
+        ATMPArgs tx_args_i = tx_args(i);
+        if (!Finalize(tx_args_i, workspaces[i])) return reject_tx(i);
+    }
+
+    // trim mempool and check if any of the package was trimmed
+    bool all_accepted = true;
+    if (!args.m_bypass_limits) {
+        LimitMempoolSize(m_pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, std::chrono::hours{gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
+        for (size_t i = 0; i < txns.size(); i++) {
+            if (!m_pool.exists(txns[i]->GetHash())) {
+                tx_states[indexes[i]].Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
+                all_accepted = false;
+            }
+        }
+    }
+    for (const CTransactionRef& ptx : txns) {
+        if (m_pool.exists(ptx->GetHash())) GetMainSignals().TransactionAddedToMempool(ptx, m_pool.GetAndIncrementSequence());
+    }
 
+    if (!all_accepted) {
+        return package_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
+    }
     return true;
 }
 
+void MemPoolAccept::AcceptReorgTransactions(const std::vector<CTransactionRef>& txns, const CChainParams& chainparams, std::vector<bool>& accepted)
+{
+    AssertLockHeld(cs_main);
+    LOCK(m_pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+    accepted.assign(txns.size(), false);
+
+    // Validation errors of resurrected transactions are ignored. The inputs
+    // they fetch into the coins cache are not uncached either: they were
+    // outputs of the active chain until the disconnect.
+    std::vector<TxValidationState> states(txns.size());
+    std::vector<COutPoint> coins_to_uncache;
+    const CAmount no_absurd_fee = 0;
+    const int64_t accept_time = GetTime();
+    auto tx_args = [&](size_t i) -> ATMPArgs {
+        return ATMPArgs{chainparams, states[i], accept_time, nullptr /* plTxnReplaced */,
+                        true /* bypass_limits */, no_absurd_fee, coins_to_uncache, false /* test_accept */, /* package */ true};
+    };
+
+    // Run the policy checks of each transaction in order, making its outputs
+    // available to the ones after it in the shared coins view, so that every
+    // input is only fetched once. As in a package, the transactions may not
+    // replace those in the mempool.
+    std::vector<size_t> indexes;
+    std::vector<CTransactionRef> checked_txns;
+    std::vector<Workspace> workspaces;
+    workspaces.reserve(txns.size());
+    for (size_t i = 0; i < txns.size(); i++) {
+        if (txns[i]->IsCoinBase()) continue;
+        workspaces.emplace_back(txns[i]);
+        ATMPArgs args = tx_args(i);
+        if (!PreChecks(args, workspaces.back())) {
+            workspaces.pop_back();
+            continue;
+        }
+        AddCoins(m_view, *txns[i], MEMPOOL_HEIGHT);
+        indexes.push_back(i);
+        checked_txns.push_back(txns[i]);
+    }
+    if (checked_txns.empty()) return;
+
+    // Verify the scripts and proofs of all of them at once on the script
+    // check threads, which also leaves the signatures and proofs in the
+    // caches for the checks against the tip's flags and for the blocks the
+    // transactions are mined in again. Should any fail, check them one by one
+    // to find out which.
+    std::vector<PrecomputedTransactionData> txdata(checked_txns.size());
+    std::vector<bool> scripts_valid(checked_txns.size(), true);
+    const uint32_t consensusBranchId = chainparams.GetConsensus().BranchId(::ChainActive().Height() + 1);
+    if (!g_parallel_script_checks || !CheckPackageInputsInParallel(checked_txns, m_view, consensusBranchId, txdata)) {
+        for (size_t i = 0; i < checked_txns.size(); i++) {
+            ATMPArgs args = tx_args(indexes[i]);
+            scripts_valid[i] = PolicyScriptChecks(args, workspaces[i], txdata[i]);
+        }
+    }
+
+    // Add the transactions in order. The ancestors of each are only known
+    // once those before it are in, so its mempool limits are checked here.
+    std::set<uint256> rejected;
+    for (size_t i = 0; i < checked_txns.size(); i++) {
+        const CTransaction& tx = *checked_txns[i];
+        bool valid = scripts_valid[i];
+        for (const CTxIn& txin : tx.vin) {
+            if (rejected.count(txin.prevout.hash)) valid = false;
+        }
+        if (valid) {
+            std::string err_string;
+            CTxMemPool::setEntries ancestors;
+            valid = m_pool.CalculateMemPoolAncestors(*workspaces[i].m_entry, ancestors, m_limit_ancestors, m_limit_ancestor_size,
+                                                     m_limit_descendants, m_limit_descendant_size, err_string);
+        }
+        ATMPArgs args = tx_args(indexes[i]);
+        if (!valid || !ConsensusScriptChecks(args, workspaces[i], txdata[i]) || !Finalize(args, workspaces[i])) {
+            rejected.insert(tx.GetHash());
+            continue;
+        }
+        accepted[indexes[i]] = true;
+        GetMainSignals().TransactionAddedToMempool(checked_txns[i], m_pool.GetAndIncrementSequence());
+    }
+}
+
 } // anon namespace
 
 /** (try to) add transaction to memory pool with a specified acceptance time **/
@@ -1041,7 +1387,7 @@ static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPo
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     std::vector<COutPoint> coins_to_uncache;
-    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept };
+    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept, /* package */ false };
     bool res = MemPoolAccept(pool).AcceptSingleTransaction(tx, args);
     if (!res) {
         // Remove coins that were not present in the coins cache before calling ATMPW;
@@ -1062,10 +1408,55 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept)
 {
+    METRIC_SCOPE("AcceptToMemoryPool");
     const CChainParams& chainparams = Params();
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
 }
 
+bool PreCheckTransaction(const CTransaction& tx, TxValidationState& state)
+{
+    if (!CheckTransaction(tx, state)) return false;
+    // A coinbase is rejected by AcceptToMemoryPool() before its proofs matter
+    if (tx.IsCoinBase()) return true;
+    // Without cs_main the proofs are checked for the epoch of the next block
+    // as of a recent tip. Should it change, AcceptToMemoryPool finds no
+    // cached result for its epoch and checks them again.
+    const CBlockIndex* tip = ::ChainActive().TipSnapshot();
+    const uint32_t consensusBranchId = Params().GetConsensus().BranchId(tip ? tip->nHeight + 1 : 0);
+    return CheckShieldedProofs(tx, consensusBranchId, state, true, nullptr);
+}
+
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, TxValidationState& package_state, std::vector<TxValidationState>& tx_states,
+                               const std::vector<CTransactionRef>& package, const CFeeRate& max_fee_rate, bool test_accept)
+{
+    AssertLockHeld(cs_main);
+    const CChainParams& chainparams = Params();
+    tx_states.assign(package.size(), TxValidationState());
+    std::vector<COutPoint> coins_to_uncache;
+    const CAmount no_absurd_fee = 0; // Set for each transaction from max_fee_rate
+    MemPoolAccept::ATMPArgs args { chainparams, package_state, GetTime(), nullptr /* plTxnReplaced */, false /* bypass_limits */, no_absurd_fee, coins_to_uncache, test_accept, /* package */ true };
+    bool res = MemPoolAccept(pool).AcceptPackage(package, args, tx_states, max_fee_rate);
+    if (!res) {
+        // Remove coins that were not present in the coins cache before, as
+        // AcceptToMemoryPoolWithTime() does.
+        for (const COutPoint& hashTx : coins_to_uncache)
+            ::ChainstateActive().CoinsTip().UncacheCoin(hashTx);
+    }
+    BlockValidationState state_dummy;
+    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy, FlushStateMode::PERIODIC);
+    return res;
+}
+
+/** Re-add the transactions of disconnected blocks to the mempool, see MemPoolAccept::AcceptReorgTransactions(). */
+static void AcceptReorgTransactionsToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& txns, std::vector<bool>& accepted)
+{
+    METRIC_SCOPE("AcceptReorgTransactionsToMemoryPool");
+    const CChainParams& chainparams = Params();
+    MemPoolAccept(pool).AcceptReorgTransactions(txns, chainparams, accepted);
+    BlockValidationState state_dummy;
+    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy, FlushStateMode::PERIODIC);
+}
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
@@ -1121,44 +1512,135 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
     unsigned int nSize = GetSerializeSize(block, fileout.GetVersion());
     fileout << messageStart << nSize;
 
-    // Write block
+    // Write block, serialized into a buffer of its size first so that it
+    // goes to the file in one write rather than one per field
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    std::vector<unsigned char> data;
+    data.reserve(nSize);
+    CVectorWriter(SER_DISK, fileout.GetVersion(), data, 0, block);
+    assert(data.size() == nSize);
+    fileout.write((const char*)data.data(), data.size());
 
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams)
+/**
+ * Read the records at positions, each of which follows an 8 byte header of
+ * the network magic and the record size, and is followed by trailer more
+ * bytes, in two batches of reads: the headers first, and then the records
+ * with their trailers. A record that cannot be read is left empty.
+ */
+static void ReadFlatFileRecords(FILE* (*open_file)(const FlatFilePos&, bool), const std::vector<FlatFilePos>& positions,
+                                size_t trailer, std::vector<std::vector<unsigned char>>& records)
 {
-    block.SetNull();
-
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    records.assign(positions.size(), {});
+    std::map<int, FILE*> files;
+    std::vector<size_t> indexes;
+    std::vector<std::array<unsigned char, 8>> headers(positions.size());
+    std::vector<FileRead> reads;
+    for (size_t i = 0; i < positions.size(); ++i) {
+        FILE*& file = files[positions[i].nFile];
+        if (!file) file = open_file(positions[i], true);
+        if (!file || positions[i].nPos < headers[i].size()) continue;
+        indexes.push_back(i);
+        reads.emplace_back(file, positions[i].nPos - headers[i].size(), headers[i].data(), headers[i].size());
+    }
+    ReadFiles(reads);
 
-    // Read block
-    try {
-        filein >> block;
+    std::vector<size_t> read_indexes;
+    std::vector<FileRead> record_reads;
+    for (size_t k = 0; k < reads.size(); ++k) {
+        const size_t i = indexes[k];
+        const unsigned int size = ReadLE32(headers[i].data() + CMessageHeader::MESSAGE_START_SIZE);
+        if (!reads[k].ok || size > MAX_SIZE) continue;
+        records[i].resize(size + trailer);
+        read_indexes.push_back(i);
+        record_reads.emplace_back(reads[k].file, positions[i].nPos, records[i].data(), records[i].size());
     }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    ReadFiles(record_reads);
+    for (size_t k = 0; k < record_reads.size(); ++k) {
+        if (!record_reads[k].ok) records[read_indexes[k]].clear();
+    }
+
+    for (const auto& file : files) {
+        if (file.second) fclose(file.second);
     }
+}
 
+static bool CheckBlockFromDisk(const CBlock& block, const FlatFilePos& pos, int nHeight, const Consensus::Params& consensusParams)
+{
     // Check the header
     if (!CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
     // Check Equihash solution
-    if (!CheckEquihashSolution(&block))
+    if (nHeight < 0 ? !CheckEquihashSolution(&block) : !CheckEquihashSolution(&block, nHeight, consensusParams))
         return error("ReadBlockFromDisk: Errors in block header at %s (bad Equihash solution)", pos.ToString());
 
     return true;
 }
 
+/**
+ * Map the block file record at pos, the 8 byte meta header before it included, and set
+ * record to the block data. Returns nullptr when the file cannot be mapped or the map
+ * does not hold the whole record, in which case the caller reads the file instead.
+ */
+static std::shared_ptr<const MappedFile> MapBlockRecord(const FlatFilePos& pos, Span<const unsigned char>& record)
+{
+    if (pos.nPos < 8) return nullptr;
+    FlatFilePos hpos = pos;
+    hpos.nPos -= 8;
+    std::shared_ptr<const MappedFile> map = g_block_file_maps.Get(BlockFileSeq(), hpos, 8);
+    if (!map) return nullptr;
+    const unsigned int blk_size = ReadLE32(map->Data().data() + hpos.nPos + CMessageHeader::MESSAGE_START_SIZE);
+    if (blk_size > MAX_SIZE) return nullptr;
+    if ((size_t)map->Data().size() < (size_t)pos.nPos + blk_size) {
+        // Mapped before the record was complete: map the file again for its full length
+        map = g_block_file_maps.Get(BlockFileSeq(), hpos, 8 + (size_t)blk_size);
+        if (!map) return nullptr;
+    }
+    record = map->Data().subspan(pos.nPos, blk_size);
+    return map;
+}
+
+/** nHeight < 0 selects the Equihash parameters from the solution size. */
+static bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, int nHeight, const Consensus::Params& consensusParams)
+{
+    block.SetNull();
+
+    // Read block, from the map of the file when it holds the whole record
+    Span<const unsigned char> record;
+    if (std::shared_ptr<const MappedFile> map = MapBlockRecord(pos, record)) {
+        try {
+            SpanReader(SER_DISK, CLIENT_VERSION, record) >> block;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+        try {
+            filein >> block;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    }
+
+    return CheckBlockFromDisk(block, pos, nHeight, consensusParams);
+}
+
+bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams)
+{
+    return ReadBlockFromDisk(block, pos, -1, consensusParams);
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
     FlatFilePos blockPos;
@@ -1167,7 +1649,7 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
         blockPos = pindex->GetBlockPos();
     }
 
-    if (!ReadBlockFromDisk(block, blockPos, consensusParams))
+    if (!ReadBlockFromDisk(block, blockPos, pindex->nHeight, consensusParams))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
@@ -1175,10 +1657,81 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadBlocksFromDisk(std::vector<std::shared_ptr<CBlock>>& blocks, const std::vector<const CBlockIndex*>& pindexes, const Consensus::Params& consensusParams)
+{
+    std::vector<FlatFilePos> positions(pindexes.size());
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < pindexes.size(); ++i) {
+            positions[i] = pindexes[i]->GetBlockPos();
+        }
+    }
+
+    // Blocks in files that can be mapped are read from the map; the others
+    // are read all together.
+    blocks.assign(pindexes.size(), nullptr);
+    std::vector<size_t> indexes;
+    std::vector<FlatFilePos> unmapped;
+    for (size_t i = 0; i < pindexes.size(); ++i) {
+        Span<const unsigned char> record;
+        if (!MapBlockRecord(positions[i], record)) {
+            indexes.push_back(i);
+            unmapped.push_back(positions[i]);
+            continue;
+        }
+        auto block = std::make_shared<CBlock>();
+        if (ReadBlockFromDisk(*block, positions[i], pindexes[i]->nHeight, consensusParams)) {
+            blocks[i] = std::move(block);
+        }
+    }
+
+    std::vector<std::vector<unsigned char>> records;
+    ReadFlatFileRecords(OpenBlockFile, unmapped, 0, records);
+    for (size_t k = 0; k < records.size(); ++k) {
+        const size_t i = indexes[k];
+        if (records[k].empty()) {
+            error("%s: Read from block file failed for %s", __func__, positions[i].ToString());
+            continue;
+        }
+        auto block = std::make_shared<CBlock>();
+        try {
+            SpanReader(SER_DISK, CLIENT_VERSION, MakeSpan(records[k])) >> *block;
+        } catch (const std::exception& e) {
+            error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), positions[i].ToString());
+            continue;
+        }
+        if (CheckBlockFromDisk(*block, positions[i], pindexes[i]->nHeight, consensusParams)) {
+            blocks[i] = std::move(block);
+        }
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (blocks[i] && blocks[i]->GetHash() != pindexes[i]->GetBlockHash()) {
+            error("%s: GetHash() doesn't match index for %s at %s", __func__, pindexes[i]->ToString(), positions[i].ToString());
+            blocks[i] = nullptr;
+        }
+        ok &= blocks[i] != nullptr;
+    }
+    return ok;
+}
+
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
     FlatFilePos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
+    Span<const unsigned char> record;
+    if (std::shared_ptr<const MappedFile> map = MapBlockRecord(pos, record)) {
+        const unsigned char* blk_start = map->Data().data() + hpos.nPos;
+        if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+            return error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
+                    HexStr(blk_start, blk_start + CMessageHeader::MESSAGE_START_SIZE),
+                    HexStr(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE));
+        }
+        block.assign(record.begin(), record.end());
+        return true;
+    }
+
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull()) {
         return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
@@ -1305,6 +1858,7 @@ BlockMap& BlockIndex()
 static void AlertNotify(const std::string& strMessage)
 {
     uiInterface.NotifyAlertChanged();
+    SendNotification("alert " + SanitizeString(strMessage));
 #if HAVE_SYSTEM
     std::string strCmd = gArgs.GetArg("-alertnotify", "");
     if (strCmd.empty()) return;
@@ -1317,8 +1871,7 @@ static void AlertNotify(const std::string& strMessage)
     safeStatus = singleQuote+safeStatus+singleQuote;
     boost::replace_all(strCmd, "%s", safeStatus);
 
-    std::thread t(runCommand, strCmd);
-    t.detach(); // thread runs free
+    QueueNotifyCommand(strCmd);
 #endif
 }
 
@@ -1441,6 +1994,8 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
     }
     // add outputs
     AddCoins(inputs, tx, nHeight);
+    // mark Sapling nullifiers spent
+    UpdateNullifiers(inputs, tx, nHeight, true);
 }
 
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
@@ -1455,6 +2010,99 @@ bool CScriptCheck::operator()() {
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
 }
 
+bool CScriptCheck::operator()(CSignatureBatch& batch, size_t index) {
+    const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+    const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
+    return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata, &batch, index), &error);
+}
+
+bool RunCheckBatch(std::vector<CScriptCheck>& checks)
+{
+    // Run the scripts with the signatures assumed valid, then verify the
+    // signatures together. A script may behave differently with an invalid
+    // signature, so the checks whose signatures were not all valid, and those
+    // that failed after assuming some, are run again on their own.
+    CSignatureBatch batch;
+    std::vector<bool> rerun(checks.size(), false);
+    for (size_t i = 0; i < checks.size(); i++) {
+        const size_t assumed = batch.Size();
+        if (!checks[i](batch, i)) {
+            if (batch.Size() == assumed) return false;
+            rerun[i] = true;
+        }
+    }
+    for (size_t i : batch.Verify()) {
+        rerun[i] = true;
+    }
+    for (size_t i = 0; i < checks.size(); i++) {
+        if (rerun[i] && !checks[i]()) return false;
+    }
+    return true;
+}
+
+//! Time spent in shielded proof verification, summed over the threads doing it
+static std::atomic<int64_t> g_proof_verify_us{0};
+
+bool CShieldedProofCheck::operator()() {
+    const ShieldedProofType type = nJoinSplit >= 0 ? ShieldedProofType::SPROUT : ShieldedProofType::SAPLING;
+    const uint32_t index = nJoinSplit >= 0 ? nJoinSplit : consensusBranchId;
+    if (ProofCacheContains(ptxTo->GetHash(), type, index, !cacheStore))
+        return true;
+
+    TRACE3(validation, proof_verify_start, ptxTo->GetHash().begin(), (int)type, index);
+    const int64_t nTimeStart = GetTimeMicros();
+    ProofVerifier verifier = ProofVerifier::Strict();
+    bool fValid;
+    if (nJoinSplit >= 0) {
+        fValid = verifier.VerifySprout(ptxTo->vJoinSplit[nJoinSplit], ptxTo->joinSplitPubKey);
+    } else {
+        fValid = verifier.VerifySapling(*ptxTo, sighash);
+    }
+    const int64_t nTimeVerify = GetTimeMicros() - nTimeStart;
+    g_proof_verify_us += nTimeVerify;
+    TRACE5(validation, proof_verify_end, ptxTo->GetHash().begin(), (int)type, index, fValid, nTimeVerify);
+    if (fValid && cacheStore)
+        ProofCacheAdd(ptxTo->GetHash(), type, index);
+    return fValid;
+}
+
+/**
+ * Check the JoinSplit and Sapling proofs of a transaction.
+ *
+ * If pvChecks is not nullptr, proof checks are pushed onto it instead of being performed inline.
+ * Proofs found in the proof cache are not verified again, nor queued.
+ *
+ * Setting cacheStore to false will remove matched elements from the proof cache.
+ */
+static bool CheckShieldedProofs(const CTransaction& tx, uint32_t consensusBranchId, TxValidationState& state, bool cacheStore, std::vector<CShieldedProofCheck>* pvChecks)
+{
+    for (unsigned int i = 0; i < tx.vJoinSplit.size(); i++) {
+        if (ProofCacheContains(tx.GetHash(), ShieldedProofType::SPROUT, i, !cacheStore)) continue;
+        CShieldedProofCheck check(tx, i, uint256(), consensusBranchId, cacheStore);
+        if (pvChecks) {
+            pvChecks->push_back(CShieldedProofCheck());
+            check.swap(pvChecks->back());
+        } else if (!check()) {
+            return state.Invalid(TxValidationResult::TX_CONSENSUS, "bad-txns-joinsplit-verification-failed");
+        }
+    }
+
+    // Look the Sapling bundle up before computing its signature hash, which
+    // hashes the whole transaction.
+    if ((!tx.vShieldedSpend.empty() || !tx.vShieldedOutput.empty()) &&
+        !ProofCacheContains(tx.GetHash(), ShieldedProofType::SAPLING, consensusBranchId, !cacheStore)) {
+        CShieldedProofCheck check(tx, -1, ShieldedSignatureHash(tx, consensusBranchId), consensusBranchId, cacheStore);
+        if (pvChecks) {
+            pvChecks->push_back(CShieldedProofCheck());
+            check.swap(pvChecks->back());
+        } else if (!check()) {
+            return state.Invalid(TxValidationResult::TX_CONSENSUS, "bad-txns-sapling-verification-failed");
+        }
+    }
+
+    return true;
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -1463,7 +2111,7 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 }
 
 
-static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+static CuckooCache::sharded_cache<uint256, SignatureCacheHasher> scriptExecutionCache;
 static uint256 scriptExecutionCacheNonce(GetRandHash());
 
 void InitScriptExecutionCache() {
@@ -1475,6 +2123,11 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+CuckooCache::cache_stats GetScriptExecutionCacheStats()
+{
+    return scriptExecutionCache.stats();
+}
+
 /**
  * Check whether all of this transaction's input scripts succeed.
  *
@@ -1512,11 +2165,16 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const C
     // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
     static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
     CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
-    AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
     if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
         return true;
     }
 
+    // Only hash the transaction for the signature checks once they are known
+    // to be needed, ConnectBlock leaves it to us.
+    if (!txdata.m_initialized) {
+        txdata.Init(tx);
+    }
+
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
         const COutPoint &prevout = tx.vin[i].prevout;
         const Coin& coin = inputs.AccessCoin(prevout);
@@ -1604,27 +2262,29 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
         return error("%s: no undo data available", __func__);
     }
 
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
+    // Read the undo data with its checksum, in two reads rather than one per field
+    std::vector<std::vector<unsigned char>> records;
+    ReadFlatFileRecords(OpenUndoFile, {pos}, sizeof(uint256), records);
+    if (records[0].empty())
+        return error("%s: Read from undo file failed for %s", __func__, pos.ToString());
+    Span<const unsigned char> data = MakeSpan(records[0]);
+    Span<const unsigned char> undo_data = data.first(data.size() - sizeof(uint256));
+
+    // Verify checksum, which is of the serialized data as it is on disk, since
+    // reserializing may lose data
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << pindex->pprev->GetBlockHash();
+    hasher.write((const char*)undo_data.data(), undo_data.size());
+    if (uint256(std::vector<unsigned char>(data.end() - sizeof(uint256), data.end())) != hasher.GetHash())
+        return error("%s: Checksum mismatch", __func__);
 
-    // Read block
-    uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
     try {
-        verifier << pindex->pprev->GetBlockHash();
-        verifier >> blockundo;
-        filein >> hashChecksum;
+        SpanReader(SER_DISK, CLIENT_VERSION, undo_data) >> blockundo;
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
 
-    // Verify checksum
-    if (hashChecksum != verifier.GetHash())
-        return error("%s: Checksum mismatch", __func__);
-
     return true;
 }
 
@@ -1682,9 +2342,15 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
+/** The height of the block of the first leaf of the chain history; the genesis block is never connected with ConnectBlock. */
+static int FirstHistoryHeight(const Consensus::Params& params)
+{
+    return std::max(1, params.SaplingHeight);
+}
+
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  When FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, ChainHistory* history)
 {
     bool fClean = true;
 
@@ -1718,6 +2384,9 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
             }
         }
 
+        // unspend Sapling nullifiers
+        UpdateNullifiers(view, tx, pindex->nHeight, false);
+
         // restore inputs
         if (i > 0) { // not coinbases
             CTxUndo &txundo = blockUndo.vtxundo[i-1];
@@ -1735,9 +2404,24 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         }
     }
 
+    // move best anchor pointer back to the tree at the end of the previous block
+    if (!(pindex->pprev->nStatus & BLOCK_HAVE_SAPLING_ROOT)) {
+        error("DisconnectBlock(): Sapling note commitment tree root of the previous block is unknown");
+        return DISCONNECT_FAILED;
+    }
+    view.PopSaplingAnchor(pindex->pprev->hashFinalSaplingRoot);
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
+    // An unclean disconnect is not applied, so the leaf stays.
+    if (fClean && history && history->IsEnabled() && pindex->nHeight >= FirstHistoryHeight(Params().GetConsensus())) {
+        if (history->TipHash() != pindex->GetBlockHash() || !history->Pop()) {
+            error("DisconnectBlock(): chain history does not end with the block");
+            return DISCONNECT_FAILED;
+        }
+    }
+
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
@@ -1748,6 +2432,9 @@ void static FlushBlockFile(bool fFinalize = false)
     FlatFilePos block_pos_old(nLastBlockFile, vinfoBlockFile[nLastBlockFile].nSize);
     FlatFilePos undo_pos_old(nLastBlockFile, vinfoBlockFile[nLastBlockFile].nUndoSize);
 
+    // Truncating the file would leave its map reaching past the end.
+    if (fFinalize) g_block_file_maps.Invalidate(nLastBlockFile);
+
     bool status = true;
     status &= BlockFileSeq().Flush(block_pos_old, fFinalize);
     status &= UndoFileSeq().Flush(undo_pos_old, fFinalize);
@@ -1784,36 +2471,212 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
-VersionBitsCache versionbitscache GUARDED_BY(cs_main);
-
-int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
-{
-    LOCK(cs_main);
-    int32_t nVersion = VERSIONBITS_TOP_BITS;
-
-    for (int i = 0; i < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; i++) {
-        ThresholdState state = VersionBitsState(pindexPrev, params, static_cast<Consensus::DeploymentPos>(i), versionbitscache);
-        if (state == ThresholdState::LOCKED_IN || state == ThresholdState::STARTED) {
-            nVersion |= VersionBitsMask(params, static_cast<Consensus::DeploymentPos>(i));
-        }
-    }
+// Each proof check is expensive, so hand them out to workers one at a time.
+static CCheckQueue<CShieldedProofCheck> proofcheckqueue(1);
 
-    return nVersion;
+void ThreadProofCheck(int worker_num) {
+    util::ThreadRename(strprintf("proofch.%i", worker_num));
+    proofcheckqueue.Thread();
 }
 
 /**
- * Threshold condition checker that triggers when unknown versionbits are seen on the network.
+ * The check queue controls that the script and proof checks of a group of
+ * blocks are added to, waited for once after ConnectBlock ran for all of
+ * them. The queued checks point into txdata and into the blocks, which must
+ * outlive the controls.
  */
-class WarningBitsConditionChecker : public AbstractThresholdConditionChecker
+struct DeferredBlockChecks {
+    CCheckQueueControl<CScriptCheck> control{&scriptcheckqueue};
+    CCheckQueueControl<CShieldedProofCheck> proof_control{&proofcheckqueue};
+    //! The PrecomputedTransactionData of each block; a deque, so that adding one does not move the others
+    std::deque<std::vector<PrecomputedTransactionData>> txdata;
+};
+
+/**
+ * Verify the scripts, using our policy flags, and the shielded proofs of a
+ * package of mempool transactions on the script check threads, caching the
+ * signatures and proofs. Returns false if any check failed, without telling
+ * which.
+ */
+static bool CheckPackageInputsInParallel(const std::vector<CTransactionRef>& txns, const CCoinsViewCache& inputs, uint32_t consensusBranchId, std::vector<PrecomputedTransactionData>& txdata)
 {
-private:
-    int bit;
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    CCheckQueueControl<CShieldedProofCheck> proof_control(&proofcheckqueue);
+    for (size_t i = 0; i < txns.size(); i++) {
+        // Checks that are only queued cannot fail here
+        TxValidationState state_dummy;
+        std::vector<CScriptCheck> checks;
+        std::vector<CShieldedProofCheck> proof_checks;
+        CheckInputScripts(*txns[i], state_dummy, inputs, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, txdata[i], &checks);
+        CheckShieldedProofs(*txns[i], consensusBranchId, state_dummy, true, &proof_checks);
+        control.Add(checks);
+        proof_control.Add(proof_checks);
+    }
+    const bool scripts_valid = control.Wait();
+    return proof_control.Wait() && scripts_valid;
+}
 
-public:
-    explicit WarningBitsConditionChecker(int bitIn) : bit(bitIn) {}
+static CCheckQueue<CHeaderCheck> headercheckqueue(16);
 
-    int64_t BeginTime(const Consensus::Params& params) const override { return 0; }
-    int64_t EndTime(const Consensus::Params& params) const override { return std::numeric_limits<int64_t>::max(); }
+void ThreadHeaderCheck(int worker_num) {
+    util::ThreadRename(strprintf("headch.%i", worker_num));
+    headercheckqueue.Thread();
+}
+
+// Each read may wait on the disk, so hand them out in small batches.
+static CCheckQueue<CCoinsPrefetch> prefetchqueue(4);
+
+static CCheckQueue<CTxCheck> txcheckqueue(16);
+
+void ThreadTxCheck(int worker_num) {
+    util::ThreadRename(strprintf("txcheck.%i", worker_num));
+    txcheckqueue.Thread();
+}
+
+void ThreadCoinsPrefetch(int worker_num) {
+    util::ThreadRename(strprintf("prefetch.%i", worker_num));
+    prefetchqueue.Thread();
+}
+
+std::vector<std::pair<std::string, CheckQueueStats>> GetCheckQueueStats()
+{
+    return {
+        {"scriptch", scriptcheckqueue.GetStats()},
+        {"proofch", proofcheckqueue.GetStats()},
+        {"headch", headercheckqueue.GetStats()},
+        {"prefetch", prefetchqueue.GetStats()},
+        {"txcheck", txcheckqueue.GetStats()},
+    };
+}
+
+bool CCoinsPrefetch::operator()() {
+    if (poutpoint) {
+        *pfFound = pview->GetCoin(*poutpoint, *pcoin);
+    } else {
+        *pfFound = pview->GetNullifier(*pnullifier, *pnHeight);
+    }
+    // A failed read is not an error here; ConnectBlock finds out itself.
+    return true;
+}
+
+/**
+ * Read outpoints and nullifiers from db on the prefetch threads, and add the
+ * ones found to cache. db must be the view cache is ultimately backed by.
+ */
+static void PrefetchCoins(const std::vector<COutPoint>& outpoints, const std::vector<uint256>& nullifiers, CCoinsViewCache& cache, const CCoinsView& db)
+{
+    if (outpoints.size() + nullifiers.size() < 2) return;
+
+    std::vector<Coin> coins(outpoints.size());
+    std::vector<uint32_t> heights(nullifiers.size());
+    std::vector<char> found(outpoints.size() + nullifiers.size(), 0);
+    {
+        CCheckQueueControl<CCoinsPrefetch> control(&prefetchqueue);
+        std::vector<CCoinsPrefetch> vReads;
+        vReads.reserve(found.size());
+        for (size_t i = 0; i < outpoints.size(); i++) {
+            vReads.emplace_back(db, outpoints[i], coins[i], &found[i]);
+        }
+        for (size_t i = 0; i < nullifiers.size(); i++) {
+            vReads.emplace_back(db, nullifiers[i], heights[i], &found[outpoints.size() + i]);
+        }
+        control.Add(vReads);
+        control.Wait();
+    }
+
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        if (found[i]) cache.AddFetchedCoin(outpoints[i], std::move(coins[i]));
+    }
+    for (size_t i = 0; i < nullifiers.size(); i++) {
+        if (found[outpoints.size() + i]) cache.AddFetchedNullifier(nullifiers[i], heights[i]);
+    }
+}
+
+/**
+ * Read the coins spent and the nullifiers revealed by block that cache does
+ * not hold yet from db on the prefetch threads, and add them to cache, so
+ * that ConnectBlock does not wait on one database read after the other.
+ */
+static void PrefetchBlockInputs(const CBlock& block, CCoinsViewCache& cache, const CCoinsView& db)
+{
+    if (!g_parallel_script_checks) return;
+
+    std::set<uint256> block_txids;
+    for (const auto& tx : block.vtx) {
+        block_txids.insert(tx->GetHash());
+    }
+    std::vector<COutPoint> outpoints;
+    std::vector<uint256> nullifiers;
+    for (const auto& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn& txin : tx->vin) {
+                // Outputs created within the block are not in the database yet.
+                if (block_txids.count(txin.prevout.hash) || cache.HaveCoinInCache(txin.prevout)) continue;
+                outpoints.push_back(txin.prevout);
+            }
+        }
+        for (const SpendDescription& spend : tx->vShieldedSpend) {
+            nullifiers.push_back(spend.nullifier);
+        }
+    }
+    PrefetchCoins(outpoints, nullifiers, cache, db);
+}
+
+/**
+ * The DisconnectBlock counterpart of PrefetchBlockInputs: read the coins
+ * created and the nullifiers revealed by block, which DisconnectBlock spends
+ * and removes again, so that it does not read them one after the other.
+ */
+static void PrefetchBlockOutputs(const CBlock& block, CCoinsViewCache& cache, const CCoinsView& db)
+{
+    if (!g_parallel_script_checks) return;
+
+    std::vector<COutPoint> outpoints;
+    std::vector<uint256> nullifiers;
+    for (const auto& tx : block.vtx) {
+        const uint256& txid = tx->GetHash();
+        for (size_t o = 0; o < tx->vout.size(); o++) {
+            const COutPoint out(txid, o);
+            if (tx->vout[o].scriptPubKey.IsUnspendable() || cache.HaveCoinInCache(out)) continue;
+            outpoints.push_back(out);
+        }
+        for (const SpendDescription& spend : tx->vShieldedSpend) {
+            nullifiers.push_back(spend.nullifier);
+        }
+    }
+    PrefetchCoins(outpoints, nullifiers, cache, db);
+}
+
+VersionBitsCache versionbitscache GUARDED_BY(cs_main);
+
+int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
+{
+    LOCK(cs_main);
+    int32_t nVersion = VERSIONBITS_TOP_BITS;
+
+    for (int i = 0; i < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; i++) {
+        ThresholdState state = VersionBitsState(pindexPrev, params, static_cast<Consensus::DeploymentPos>(i), versionbitscache);
+        if (state == ThresholdState::LOCKED_IN || state == ThresholdState::STARTED) {
+            nVersion |= VersionBitsMask(params, static_cast<Consensus::DeploymentPos>(i));
+        }
+    }
+
+    return nVersion;
+}
+
+/**
+ * Threshold condition checker that triggers when unknown versionbits are seen on the network.
+ */
+class WarningBitsConditionChecker : public AbstractThresholdConditionChecker
+{
+private:
+    int bit;
+
+public:
+    explicit WarningBitsConditionChecker(int bitIn) : bit(bitIn) {}
+
+    int64_t BeginTime(const Consensus::Params& params) const override { return 0; }
+    int64_t EndTime(const Consensus::Params& params) const override { return std::numeric_limits<int64_t>::max(); }
     int Period(const Consensus::Params& params) const override { return params.nMinerConfirmationWindow; }
     int Threshold(const Consensus::Params& params) const override { return params.nRuleChangeActivationThreshold; }
 
@@ -1883,6 +2746,65 @@ static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consens
 
 
 
+namespace {
+struct ValidationTimings {
+    ValidationTimingStats stats;
+    std::deque<int64_t> recent_us;
+};
+
+Mutex g_validation_timings_mutex;
+std::array<ValidationTimings, size_t(ValidationPhase::COUNT)> g_validation_timings GUARDED_BY(g_validation_timings_mutex);
+} // namespace
+
+const char* ValidationPhaseName(ValidationPhase phase)
+{
+    switch (phase) {
+    case ValidationPhase::EQUIHASH: return "equihash";
+    case ValidationPhase::READ_FROM_DISK: return "read_from_disk";
+    case ValidationPhase::PREFETCH: return "prefetch";
+    case ValidationPhase::SANITY_CHECKS: return "sanity_checks";
+    case ValidationPhase::FORK_CHECKS: return "fork_checks";
+    case ValidationPhase::CONNECT_TXS: return "connect_transactions";
+    case ValidationPhase::NOTE_COMMITMENTS: return "note_commitments";
+    case ValidationPhase::PROOFS: return "proof_verification";
+    case ValidationPhase::VERIFY: return "verify";
+    case ValidationPhase::INDEX: return "index_writing";
+    case ValidationPhase::CALLBACKS: return "callbacks";
+    case ValidationPhase::CONNECT_TOTAL: return "connect_total";
+    case ValidationPhase::FLUSH: return "flush";
+    case ValidationPhase::CHAINSTATE: return "write_chainstate";
+    case ValidationPhase::POSTCONNECT: return "postconnect";
+    case ValidationPhase::CONNECT_BLOCK: return "connect_block";
+    case ValidationPhase::COUNT: break;
+    }
+    assert(false);
+}
+
+void RecordValidationTime(ValidationPhase phase, int64_t us)
+{
+    assert(phase < ValidationPhase::COUNT);
+    const size_t bucket = std::upper_bound(VALIDATION_TIMING_BOUNDS.begin(), VALIDATION_TIMING_BOUNDS.end(), us - 1) - VALIDATION_TIMING_BOUNDS.begin();
+    LOCK(g_validation_timings_mutex);
+    ValidationTimings& timings = g_validation_timings[size_t(phase)];
+    timings.stats.count++;
+    timings.stats.total_us += us;
+    timings.stats.histogram[bucket]++;
+    timings.recent_us.push_back(us);
+    if (timings.recent_us.size() > VALIDATION_TIMING_RECENT) {
+        timings.recent_us.pop_front();
+    }
+}
+
+ValidationTimingStats GetValidationTimingStats(ValidationPhase phase)
+{
+    assert(phase < ValidationPhase::COUNT);
+    LOCK(g_validation_timings_mutex);
+    const ValidationTimings& timings = g_validation_timings[size_t(phase)];
+    ValidationTimingStats stats = timings.stats;
+    stats.recent_us.assign(timings.recent_us.begin(), timings.recent_us.end());
+    return stats;
+}
+
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
@@ -1895,11 +2817,23 @@ static int64_t nBlocksTotal = 0;
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
+/** Record root as the Sapling note commitment tree root at the end of pindex. */
+static void SetFinalSaplingRoot(CBlockIndex* pindex, const uint256& root) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!(pindex->nStatus & BLOCK_HAVE_SAPLING_ROOT) || pindex->hashFinalSaplingRoot != root) {
+        pindex->hashFinalSaplingRoot = root;
+        pindex->nStatus |= BLOCK_HAVE_SAPLING_ROOT;
+        setDirtyBlockIndex.insert(pindex);
+    }
+}
+
 bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck,
+                  DeferredBlockChecks* deferred, ChainHistory* history)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
+    assert(!deferred || (g_parallel_script_checks && !fJustCheck));
     assert(*pindex->phashBlock == block.GetHash());
     int64_t nTimeStart = GetTimeMicros();
 
@@ -1935,8 +2869,11 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     // Special case for the genesis block, skipping connection of its transactions
     // (its coinbase is unspendable)
     if (block.GetHash() == chainparams.GetConsensus().hashGenesisBlock) {
-        if (!fJustCheck)
+        if (!fJustCheck) {
             view.SetBestBlock(pindex->GetBlockHash());
+            view.PushSaplingAnchor(SaplingMerkleTree());
+            SetFinalSaplingRoot(pindex, view.GetBestAnchor());
+        }
         return true;
     }
 
@@ -1953,9 +2890,10 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
                 pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
                 pindexBestHeader->nChainWork >= nMinimumChainWork) {
                 // This block is a member of the assumed verified chain and an ancestor of the best header.
-                // Script verification is skipped when connecting blocks under the
+                // Script and shielded proof verification are skipped when connecting blocks under the
                 // assumevalid block. Assuming the assumevalid block is valid this
                 // is safe because block merkle hashes are still computed and checked,
+                // and nullifiers and note commitment trees are still tracked and checked,
                 // Of course, if an assumed valid block is invalid due to false scriptSigs
                 // this optimization would allow an invalid chain to be accepted.
                 // The equivalent time check discourages hash power from extorting the network via DOS attack
@@ -1972,6 +2910,7 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     }
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
+    RecordValidationTime(ValidationPhase::SANITY_CHECKS, nTime1 - nTimeStart);
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime1 - nTimeStart), nTimeCheck * MICRO, nTimeCheck * MILLI / nBlocksTotal);
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
@@ -2069,19 +3008,49 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     unsigned int flags = GetBlockScriptFlags(pindex, chainparams.GetConsensus());
 
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
+    RecordValidationTime(ValidationPhase::FORK_CHECKS, nTime2 - nTime1);
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && g_parallel_script_checks ? &scriptcheckqueue : nullptr);
+    CCheckQueueControl<CScriptCheck> block_control(fScriptChecks && g_parallel_script_checks && !deferred ? &scriptcheckqueue : nullptr);
+    CCheckQueueControl<CShieldedProofCheck> block_proof_control(fScriptChecks && g_parallel_script_checks && !deferred ? &proofcheckqueue : nullptr);
+    // Deferred checks may still run when this returns, failed or not.
+    CCheckQueueControl<CScriptCheck>& control = deferred ? deferred->control : block_control;
+    CCheckQueueControl<CShieldedProofCheck>& proof_control = deferred ? deferred->proof_control : block_proof_control;
+
+    // Without worker threads, shielded proofs are queued per block and
+    // checked in one pass once all transactions have been connected. Below
+    // the assumevalid block (fScriptChecks false) no proof is checked at all.
+    ProofVerifier verifier = fScriptChecks ? ProofVerifier::Strict() : ProofVerifier::Disabled();
+
+    const int64_t nProofTimeStart = g_proof_verify_us;
+
+    // The Sapling note commitment tree at the end of the previous block, and
+    // the commitments this block adds to it.
+    int64_t nTimeNotes = GetTimeMicros();
+    SaplingMerkleTree sapling_tree;
+    if (!view.GetSaplingAnchorAt(view.GetBestAnchor(), sapling_tree)) {
+        return AbortNode(state, "Sapling note commitment tree of the previous block not found in the chainstate");
+    }
+    std::vector<libzcash::PedersenHash> sapling_commitments;
+    nTimeNotes = GetTimeMicros() - nTimeNotes;
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<PrecomputedTransactionData> txdata;
+    std::vector<PrecomputedTransactionData> block_txdata;
+    if (deferred) deferred->txdata.emplace_back();
+    std::vector<PrecomputedTransactionData>& txdata = deferred ? deferred->txdata.back() : block_txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    // Handed to the check queues one transaction at a time. The queues take
+    // the checks by swapping, so reusing the vectors keeps their memory for
+    // the next transaction instead of allocating it again.
+    std::vector<CScriptCheck> vChecks;
+    std::vector<CShieldedProofCheck> vProofChecks;
+    const uint32_t consensusBranchId = chainparams.GetConsensus().BranchId(pindex->nHeight);
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
@@ -2128,10 +3097,13 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
             return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-blk-sigops");
         }
 
-        txdata.emplace_back(tx);
+        // Left uninitialized: CheckInputScripts only hashes the transaction
+        // when its scripts are not in the script execution cache, as is the
+        // case for transactions accepted to the mempool.
+        txdata.emplace_back();
         if (!tx.IsCoinBase())
         {
-            std::vector<CScriptCheck> vChecks;
+            vChecks.clear();
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
             TxValidationState tx_state;
             if (fScriptChecks && !CheckInputScripts(tx, tx_state, view, flags, fCacheResults, fCacheResults, txdata[i], g_parallel_script_checks ? &vChecks : nullptr)) {
@@ -2144,13 +3116,41 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
             control.Add(vChecks);
         }
 
+        if (fScriptChecks && g_parallel_script_checks) {
+            vProofChecks.clear();
+            TxValidationState tx_state;
+            CheckShieldedProofs(tx, consensusBranchId, tx_state, fJustCheck, &vProofChecks);
+            proof_control.Add(vProofChecks);
+        } else if (fScriptChecks) {
+            for (unsigned int js = 0; js < tx.vJoinSplit.size(); js++) {
+                CShieldedProofCheck check(tx, js, uint256(), consensusBranchId, fJustCheck);
+                if (!check()) {
+                    LogPrintf("ERROR: %s: JoinSplit proof verification failed for %s\n", __func__, tx.GetHash().ToString());
+                    return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-txns-joinsplit-verification-failed");
+                }
+            }
+            if ((!tx.vShieldedSpend.empty() || !tx.vShieldedOutput.empty()) &&
+                !ProofCacheContains(tx.GetHash(), ShieldedProofType::SAPLING, consensusBranchId, !fJustCheck)) {
+                verifier.QueueSapling(block.vtx[i], ShieldedSignatureHash(tx, consensusBranchId));
+            }
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+
+        for (const OutputDescription& output : tx.vShieldedOutput) {
+            sapling_commitments.push_back(output.cm);
+        }
     }
+    int64_t nTimeAppend = GetTimeMicros();
+    sapling_tree.append_batch(sapling_commitments);
+    view.PushSaplingAnchor(sapling_tree);
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
+    RecordValidationTime(ValidationPhase::CONNECT_TXS, nTime3 - nTime2);
+    RecordValidationTime(ValidationPhase::NOTE_COMMITMENTS, nTimeNotes + nTime3 - nTimeAppend);
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
 
     CAmount blockReward = nFees + GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
@@ -2159,11 +3159,25 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
         return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-cb-amount");
     }
 
-    if (!control.Wait()) {
+    const int64_t nTimeBatch = GetTimeMicros();
+    const bool batch_valid = verifier.VerifySaplingBatch();
+    g_proof_verify_us += GetTimeMicros() - nTimeBatch;
+    if (!batch_valid) {
+        LogPrintf("ERROR: %s: Sapling proof verification failed\n", __func__);
+        return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-txns-sapling-verification-failed");
+    }
+
+    if (!block_control.Wait()) {
         LogPrintf("ERROR: %s: CheckQueue failed\n", __func__);
         return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "block-validation-failed");
     }
+    if (!block_proof_control.Wait()) {
+        LogPrintf("ERROR: %s: shielded proof CheckQueue failed\n", __func__);
+        return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-txns-shielded-verification-failed");
+    }
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
+    RecordValidationTime(ValidationPhase::VERIFY, nTime4 - nTime2);
+    RecordValidationTime(ValidationPhase::PROOFS, g_proof_verify_us - nProofTimeStart);
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
 
     if (fJustCheck)
@@ -2172,7 +3186,9 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     if (!WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
         return false;
 
-    if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+    SetFinalSaplingRoot(pindex, view.GetBestAnchor());
+
+    if (!deferred && !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
     }
@@ -2181,10 +3197,30 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
+    const int history_height = FirstHistoryHeight(chainparams.GetConsensus());
+    if (history && history->IsEnabled() && pindex->nHeight >= history_height) {
+        const uint256 expected_tip = pindex->nHeight == history_height ? uint256() : pindex->pprev->GetBlockHash();
+        if (history->TipHash() != expected_tip) {
+            return AbortNode(state, "Chain history does not end with the previous block");
+        }
+        if (!history->Push(NewHistoryLeaf(*pindex, CountSaplingTransactions(block)))) {
+            return AbortNode(state, "Failed to append to the chain history");
+        }
+    }
+
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
+    RecordValidationTime(ValidationPhase::INDEX, nTime5 - nTime4);
     LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime5 - nTime4), nTimeIndex * MICRO, nTimeIndex * MILLI / nBlocksTotal);
 
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
+    TRACE6(validation, block_connected,
+           pindex->phashBlock->begin(),
+           pindex->nHeight,
+           block.vtx.size(),
+           nInputs,
+           nSigOpsCost,
+           nTime6 - nTimeStart);
+    RecordValidationTime(ValidationPhase::CALLBACKS, nTime6 - nTime5);
     LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime6 - nTime5), nTimeCallbacks * MICRO, nTimeCallbacks * MILLI / nBlocksTotal);
 
     return true;
@@ -2204,7 +3240,8 @@ CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(
     size_t max_mempool_size_bytes)
 {
     int64_t nMempoolUsage = tx_pool.DynamicMemoryUsage();
-    int64_t cacheSize = CoinsTip().DynamicMemoryUsage();
+    // A flush in progress still holds the changes it writes.
+    int64_t cacheSize = CoinsTip().DynamicMemoryUsage() + CoinsDB().PendingWriteUsage();
     int64_t nTotalSpace =
         max_coins_cache_size_bytes + std::max<int64_t>(max_mempool_size_bytes - nMempoolUsage, 0);
 
@@ -2228,6 +3265,7 @@ bool CChainState::FlushStateToDisk(
     FlushStateMode mode,
     int nManualPruneHeight)
 {
+    METRIC_SCOPE("FlushStateToDisk");
     LOCK(cs_main);
     assert(this->CanFlushToDisk());
     static int64_t nLastWrite = 0;
@@ -2305,20 +3343,29 @@ bool CChainState::FlushStateToDisk(
                     setDirtyFileInfo.erase(it++);
                 }
                 std::vector<const CBlockIndex*> vBlocks;
+                std::vector<CBlockIndex*> vWritten;
                 vBlocks.reserve(setDirtyBlockIndex.size());
+                vWritten.reserve(setDirtyBlockIndex.size());
                 for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
                     vBlocks.push_back(*it);
+                    vWritten.push_back(*it);
                     setDirtyBlockIndex.erase(it++);
                 }
-                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
+                // The chain history goes with the block index it is checked against on startup.
+                HistoryChanges history;
+                const bool history_changed = m_history.GetChanges(history);
+                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks, history_changed ? &history : nullptr)) {
                     return AbortNode(state, "Failed to write to block index database");
                 }
+                if (history_changed) m_history.MarkWritten();
+                // The solutions are in the DB now, and only serving headers needs them.
+                for (CBlockIndex* pindex : vWritten) {
+                    pindex->TrimSolution();
+                }
             }
-            // Finally remove any pruned files
+            // Finally remove any pruned files, once the coins are on disk (see below)
             if (fFlushForPrune) {
-                LOG_TIME_MILLIS("unlink pruned files", BCLog::BENCH);
-
-                UnlinkPrunedFiles(setFilesToPrune);
+                m_files_to_unlink.insert(setFilesToPrune.begin(), setFilesToPrune.end());
             }
             nLastWrite = nNow;
         }
@@ -2336,15 +3383,54 @@ bool CChainState::FlushStateToDisk(
                 return AbortNode(state, "Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
+            // Unless everything is to be written out, keep the recently used
+            // coins cached, so that connecting the next blocks does not stall
+            // until the cache is warm again.
+            const int64_t keep_percent = std::max<int64_t>(0, std::min<int64_t>(100, gArgs.GetArg("-dbflushkeep", DEFAULT_DB_FLUSH_KEEP)));
+            bool flushed;
+            if (mode != FlushStateMode::ALWAYS && keep_percent > 0) {
+                flushed = CoinsTip().FlushAndEvict(nCoinCacheUsage / 100 * keep_percent);
+            } else {
+                flushed = CoinsTip().Flush();
+            }
+            // The coins database may finish the write in the background,
+            // unless everything has to be on disk when we return.
+            if (flushed && mode == FlushStateMode::ALWAYS) {
+                flushed = CoinsDB().SyncBackgroundWrite();
+            }
+            TRACE5(utxocache, flush,
+                   GetTimeMicros() - nNow,
+                   (int)mode,
+                   coins_count,
+                   coins_mem_usage,
+                   fFlushForPrune);
+            if (!flushed)
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
             full_flush_completed = true;
         }
     }
-    if (full_flush_completed) {
-        // Update best block in wallet (so we can detect restored wallets).
-        GetMainSignals().ChainStateFlushed(m_chain.GetLocator());
+    // The background chainstate of a UTXO snapshot is not what the wallets and indexes follow.
+    if (full_flush_completed && this == g_chainstate.get()) {
+        m_flushed_locator = m_chain.GetLocator();
+    }
+    // A coins database that was not flushed up to the pruned blocks could not
+    // be caught up after a crash, and the wallets and indexes must not commit
+    // to a tip the coins database may lose. With a background write, this
+    // happens at a later flush, which is called for every block.
+    if ((!m_files_to_unlink.empty() || m_flushed_locator) && !CoinsDB().BackgroundWritePending()) {
+        if (!CoinsDB().SyncBackgroundWrite()) {
+            return AbortNode(state, "Failed to write to coin database");
+        }
+        if (!m_files_to_unlink.empty()) {
+            QueueUnlinkPrunedFiles(m_files_to_unlink);
+            m_files_to_unlink.clear();
+        }
+        if (m_flushed_locator) {
+            // Update best block in wallet (so we can detect restored wallets).
+            GetMainSignals().ChainStateFlushed(*m_flushed_locator);
+            m_flushed_locator = nullopt;
+        }
     }
     } catch (const std::runtime_error& e) {
         return AbortNode(state, std::string("System error while flushing: ") + e.what());
@@ -2458,10 +3544,12 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
         return error("DisconnectTip(): Failed to read block");
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
+    uint256 saplingAnchorBeforeDisconnect = CoinsTip().GetBestAnchor();
+    PrefetchBlockOutputs(block, CoinsTip(), CoinsDB());
     {
         CCoinsViewCache view(&CoinsTip());
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
+        if (DisconnectBlock(block, pindexDelete, view, &m_history) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
@@ -2471,6 +3559,12 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
     if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
         return false;
 
+    // Transactions anchored to the tree of the disconnected block are no
+    // longer valid.
+    if (saplingAnchorBeforeDisconnect != CoinsTip().GetBestAnchor()) {
+        mempool.removeWithAnchor(saplingAnchorBeforeDisconnect);
+    }
+
     if (disconnectpool) {
         // Save transactions to re-add to mempool at end of reorg
         for (auto it = block.vtx.rbegin(); it != block.vtx.rend(); ++it) {
@@ -2494,6 +3588,7 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2562,11 +3657,17 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     const CBlock& blockConnecting = *pthisBlock;
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
+    RecordValidationTime(ValidationPhase::READ_FROM_DISK, nTime2 - nTime1);
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    PrefetchBlockInputs(blockConnecting, CoinsTip(), CoinsDB());
+    int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+    RecordValidationTime(ValidationPhase::PREFETCH, nTimePrefetched - nTime2);
+    LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTimePrefetched - nTime2) * MILLI, nTimePrefetch * MICRO);
+    nTime2 = nTimePrefetched;
     {
         CCoinsViewCache view(&CoinsTip());
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams, false, nullptr, &m_history);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2574,17 +3675,20 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
             return error("%s: ConnectBlock %s failed, %s", __func__, pindexNew->GetBlockHash().ToString(), state.ToString());
         }
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
+        RecordValidationTime(ValidationPhase::CONNECT_TOTAL, nTime3 - nTime2);
         assert(nBlocksTotal > 0);
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
         bool flushed = view.Flush();
         assert(flushed);
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
+    RecordValidationTime(ValidationPhase::FLUSH, nTime4 - nTime3);
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
         return false;
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
+    RecordValidationTime(ValidationPhase::CHAINSTATE, nTime5 - nTime4);
     LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
     // Remove conflicting transactions from the mempool.;
     mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
@@ -2594,6 +3698,8 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     UpdateTip(pindexNew, chainparams);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
+    RecordValidationTime(ValidationPhase::POSTCONNECT, nTime6 - nTime5);
+    RecordValidationTime(ValidationPhase::CONNECT_BLOCK, nTime6 - nTime1);
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
 
@@ -2601,6 +3707,111 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     return true;
 }
 
+/**
+ * Connect the blocks of pindexes, the first a child of the tip and each
+ * following one a child of the one before, as ConnectTip would one after the
+ * other, but optimistically: they are connected on a single coins view, the
+ * script and proof checks of each block run on the check threads while the
+ * blocks after it are connected, and they are all waited for at the end.
+ * pblock, if not nullptr, is the block of pindexMostWork.
+ *
+ * If any block is invalid, none is connected and fRetrySerially is set, for
+ * the caller to connect them again with ConnectTip, which finds and marks
+ * the invalid one. The undo data written for the blocks before it is what
+ * ConnectTip writes again.
+ *
+ * Returns false without setting fRetrySerially on a system error.
+ */
+bool CChainState::ConnectTipsPipelined(BlockValidationState& state, const CChainParams& chainparams, const std::vector<CBlockIndex*>& pindexes, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool, bool& fRetrySerially)
+{
+    assert(!pindexes.empty() && pindexes.front()->pprev == m_chain.Tip());
+    fRetrySerially = false;
+    // Read blocks from disk. They must outlive the checks queued for them.
+    int64_t nTime1 = GetTimeMicros();
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    blocks.reserve(pindexes.size());
+    for (CBlockIndex* pindex : pindexes) {
+        if (pindex == pindexMostWork && pblock) {
+            blocks.push_back(pblock);
+            continue;
+        }
+        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockNew, pindex, chainparams.GetConsensus()))
+            return AbortNode(state, "Failed to read block");
+        blocks.push_back(std::move(pblockNew));
+    }
+    int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
+    RecordValidationTime(ValidationPhase::READ_FROM_DISK, nTime2 - nTime1);
+    int64_t nTime3;
+    LogPrint(BCLog::BENCH, "  - Load %u blocks from disk: %.2fms [%.2fs]\n", (unsigned)blocks.size(), (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    {
+        CCoinsViewCache view(&CoinsTip());
+        const HistoryState history_checkpoint = m_history.Checkpoint();
+        bool rv = true;
+        {
+            DeferredBlockChecks deferred;
+            for (size_t i = 0; i < blocks.size() && rv; ++i) {
+                PrefetchBlockInputs(*blocks[i], CoinsTip(), CoinsDB());
+                rv = ConnectBlock(*blocks[i], state, pindexes[i], view, chainparams, false, &deferred, &m_history);
+            }
+            const bool scripts_valid = deferred.control.Wait();
+            const bool proofs_valid = deferred.proof_control.Wait();
+            if (rv && !(scripts_valid && proofs_valid)) {
+                state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "block-validation-failed");
+                rv = false;
+            }
+        }
+        if (!rv) {
+            // The view is discarded, and so are the leaves appended along with it.
+            m_history.Rewind(history_checkpoint);
+            if (!state.IsInvalid()) return false;
+            LogPrint(BCLog::VALIDATION, "%s: blocks %d to %d failed optimistic connection (%s), connecting them one at a time\n",
+                __func__, pindexes.front()->nHeight, pindexes.back()->nHeight, state.ToString());
+            state = BlockValidationState();
+            fRetrySerially = true;
+            return false;
+        }
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            GetMainSignals().BlockChecked(*blocks[i], state);
+            if (!pindexes[i]->IsValid(BLOCK_VALID_SCRIPTS)) {
+                pindexes[i]->RaiseValidity(BLOCK_VALID_SCRIPTS);
+                setDirtyBlockIndex.insert(pindexes[i]);
+            }
+        }
+        nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
+        RecordValidationTime(ValidationPhase::CONNECT_TOTAL, nTime3 - nTime2);
+        assert(nBlocksTotal > 0);
+        LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
+        bool flushed = view.Flush();
+        assert(flushed);
+    }
+    int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
+    RecordValidationTime(ValidationPhase::FLUSH, nTime4 - nTime3);
+    LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
+    // Write the chain state to disk, if necessary.
+    if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
+        return false;
+    int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
+    RecordValidationTime(ValidationPhase::CHAINSTATE, nTime5 - nTime4);
+    LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        // Remove conflicting transactions from the mempool.
+        mempool.removeForBlock(blocks[i]->vtx, pindexes[i]->nHeight);
+        disconnectpool.removeForBlock(blocks[i]->vtx);
+        // Update m_chain & related variables.
+        m_chain.SetTip(pindexes[i]);
+        UpdateTip(pindexes[i], chainparams);
+        connectTrace.BlockConnected(pindexes[i], std::move(blocks[i]));
+    }
+
+    int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
+    RecordValidationTime(ValidationPhase::POSTCONNECT, nTime6 - nTime5);
+    RecordValidationTime(ValidationPhase::CONNECT_BLOCK, nTime6 - nTime1);
+    LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
+    LogPrint(BCLog::BENCH, "- Connect %u blocks: %.2fms [%.2fs (%.2fms/blk)]\n", (unsigned)pindexes.size(), (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
+    return true;
+}
+
 /**
  * Return the tip of the chain with the most work in it, that isn't
  * known to be invalid (it's however far from certain to be valid).
@@ -2684,6 +3895,7 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
 
     const CBlockIndex *pindexOldTip = m_chain.Tip();
     const CBlockIndex *pindexFork = m_chain.FindFork(pindexMostWork);
+    const int nStopAtHeight = gArgs.GetArg("-stopatheight", DEFAULT_STOPATHEIGHT);
 
     // Disconnect active blocks which are no longer in the best chain.
     bool fBlocksDisconnected = false;
@@ -2720,8 +3932,41 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
         }
         nHeight = nTargetHeight;
 
-        // Connect new blocks.
-        for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
+        // Connect new blocks. During initial block download, with script
+        // check threads, up to MAX_PIPELINED_BLOCKS of them at a time, but
+        // not past -stopatheight, which is only checked between steps.
+        size_t nRemaining = vpindexToConnect.size();
+        while (nRemaining > 0) {
+            CBlockIndex *pindexConnect = vpindexToConnect[nRemaining - 1];
+            size_t nGroup = std::min<size_t>(nRemaining, MAX_PIPELINED_BLOCKS);
+            if (nStopAtHeight && pindexConnect->nHeight <= nStopAtHeight) {
+                nGroup = std::min<size_t>(nGroup, nStopAtHeight - pindexConnect->nHeight + 1);
+            }
+            if (nGroup > 1 && g_parallel_script_checks && pindexConnect->nHeight > m_pipeline_failed_height && IsInitialBlockDownload()) {
+                std::vector<CBlockIndex*> group;
+                group.reserve(nGroup);
+                for (size_t i = 0; i < nGroup; ++i) {
+                    group.push_back(vpindexToConnect[nRemaining - 1 - i]);
+                }
+                bool fRetrySerially;
+                if (ConnectTipsPipelined(state, chainparams, group, pindexMostWork, pblock, connectTrace, disconnectpool, fRetrySerially)) {
+                    nRemaining -= nGroup;
+                    PruneBlockIndexCandidates();
+                    if (!pindexOldTip || m_chain.Tip()->nChainWork > pindexOldTip->nChainWork) {
+                        // We're in a better position than we were. Return temporarily to release the lock.
+                        fContinue = false;
+                        break;
+                    }
+                    continue;
+                }
+                if (!fRetrySerially) {
+                    // A system error occurred, as below.
+                    UpdateMempoolForReorg(disconnectpool, false);
+                    return false;
+                }
+                m_pipeline_failed_height = group.back()->nHeight;
+            }
+            nRemaining--;
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
@@ -2788,13 +4033,8 @@ static bool NotifyHeaderTip() LOCKS_EXCLUDED(cs_main) {
     return fNotify;
 }
 
-static void LimitValidationInterfaceQueue() LOCKS_EXCLUDED(cs_main) {
-    AssertLockNotHeld(cs_main);
-
-    if (GetMainSignals().CallbacksPending() > 10) {
-        SyncWithValidationInterfaceQueue();
-    }
-}
+/** Callbacks a subscriber may have waiting before validation waits for it to catch up */
+static const size_t MAX_VALIDATION_CALLBACKS_PENDING = 10;
 
 bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock) {
     // Note that while we're often called here from ProcessNewBlock, this is
@@ -2802,6 +4042,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
     // us in the middle of ProcessNewBlock - do not assume pblock is set
     // sanely for performance or correctness!
     AssertLockNotHeld(cs_main);
+    METRIC_SCOPE("ActivateBestChain");
 
     // ABC maintains a fair degree of expensive-to-calculate internal state
     // because this function periodically releases cs_main so that it does not lock up other threads for too long
@@ -2821,7 +4062,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
         // Note that if a validationinterface callback ends up calling
         // ActivateBestChain this may lead to a deadlock! We should
         // probably have a DEBUG_LOCKORDER test for this in the future.
-        LimitValidationInterfaceQueue();
+        LimitValidationInterfaceQueue(MAX_VALIDATION_CALLBACKS_PENDING);
 
         {
             LOCK2(cs_main, ::mempool.cs); // Lock transaction pool for at least as long as it takes for connectTrace to be consumed
@@ -2843,7 +4084,14 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
                 bool fInvalidFound = false;
                 std::shared_ptr<const CBlock> nullBlockPtr;
-                if (!ActivateBestChainStep(state, chainparams, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : nullBlockPtr, fInvalidFound, connectTrace)) {
+                // Readers without cs_main see the tip each step ends at, not
+                // the blocks disconnected on the way there.
+                bool step_ok;
+                {
+                    DeferredTipSnapshot defer_tip_snapshot(m_chain);
+                    step_ok = ActivateBestChainStep(state, chainparams, pindexMostWork, pblock && pblock->GetHash() == pindexMostWork->GetBlockHash() ? pblock : nullBlockPtr, fInvalidFound, connectTrace);
+                }
+                if (!step_ok) {
                     // A system error occurred
                     return false;
                 }
@@ -2975,7 +4223,7 @@ bool CChainState::InvalidateBlock(BlockValidationState& state, const CChainParam
         if (ShutdownRequested()) break;
 
         // Make sure the queue of validation callbacks doesn't grow unboundedly.
-        LimitValidationInterfaceQueue();
+        LimitValidationInterfaceQueue(MAX_VALIDATION_CALLBACKS_PENDING);
 
         LOCK(cs_main);
         LOCK(::mempool.cs); // Lock for as long as disconnectpool is in scope to make sure UpdateMempoolForReorg is called after DisconnectTip without unlocking in between
@@ -3121,22 +4369,27 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = m_block_index_arena.Allocate();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
-    BlockMap::iterator miPrev = m_block_index.find(block.hashPrevBlock);
-    if (miPrev != m_block_index.end())
     {
-        pindexNew->pprev = (*miPrev).second;
-        pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
-        pindexNew->BuildSkip();
+        // Readers without cs_main must not see the entry before it is linked
+        boost::unique_lock<boost::shared_mutex> lock(m_block_index_mutex);
+        BlockMap::iterator mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
+        pindexNew->phashBlock = &((*mi).first);
+        BlockMap::iterator miPrev = m_block_index.find(block.hashPrevBlock);
+        if (miPrev != m_block_index.end())
+        {
+            pindexNew->pprev = (*miPrev).second;
+            pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
+            pindexNew->BuildSkip();
+        }
+        pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
+        pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     }
-    pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
-    pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindexNew->nChainWork)
         pindexBestHeader = pindexNew;
@@ -3146,6 +4399,70 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
     return pindexNew;
 }
 
+/** Record the change in each shielded value pool and the notes and nullifiers of block. */
+static void SetShieldedPoolStats(CBlockIndex* pindex, const CBlock& block)
+{
+    CAmount sproutValue = 0;
+    CAmount saplingValue = 0;
+    uint32_t sproutNotes = 0, sproutNullifiers = 0, saplingNotes = 0, saplingNullifiers = 0;
+    for (const auto& tx : block.vtx) {
+        for (const JSDescription& js : tx->vJoinSplit) {
+            sproutValue += js.vpub_old - js.vpub_new;
+            sproutNotes += js.commitments.size();
+            sproutNullifiers += js.nullifiers.size();
+        }
+        // valueBalance is the value leaving the Sapling pool.
+        saplingValue -= tx->valueBalance;
+        saplingNotes += tx->vShieldedOutput.size();
+        saplingNullifiers += tx->vShieldedSpend.size();
+    }
+    pindex->nSproutValue = sproutValue;
+    pindex->nSaplingValue = saplingValue;
+    pindex->nSproutNotes = sproutNotes;
+    pindex->nSproutNullifiers = sproutNullifiers;
+    pindex->nSaplingNotes = saplingNotes;
+    pindex->nSaplingNullifiers = saplingNullifiers;
+    pindex->nStatus |= BLOCK_HAVE_SHIELDED_COUNTS;
+}
+
+/** Set the chain totals of the shielded pools of pindex from those of its parent. */
+static void SetChainShieldedPoolTotals(CBlockIndex* pindex)
+{
+    const CBlockIndex* pprev = pindex->pprev;
+    auto add = [](const Optional<uint64_t>& prev, bool have, uint32_t n) -> Optional<uint64_t> {
+        if (!have || !prev) return nullopt;
+        return *prev + n;
+    };
+    // nSaplingValue is stored by older versions too, but only set for blocks
+    // with the counts, so like those it makes a total only if all the blocks
+    // up to here have them.
+    const bool have = pindex->nStatus & BLOCK_HAVE_SHIELDED_COUNTS;
+    if (pprev == nullptr) {
+        pindex->nChainSproutValue = pindex->nSproutValue;
+        pindex->nChainSaplingValue = have ? Optional<CAmount>(pindex->nSaplingValue) : nullopt;
+        const Optional<uint64_t> zero{uint64_t{0}};
+        pindex->nChainSproutNotes = add(zero, have, pindex->nSproutNotes);
+        pindex->nChainSproutNullifiers = add(zero, have, pindex->nSproutNullifiers);
+        pindex->nChainSaplingNotes = add(zero, have, pindex->nSaplingNotes);
+        pindex->nChainSaplingNullifiers = add(zero, have, pindex->nSaplingNullifiers);
+        return;
+    }
+    if (pprev->nChainSproutValue && pindex->nSproutValue) {
+        pindex->nChainSproutValue = *pprev->nChainSproutValue + *pindex->nSproutValue;
+    } else {
+        pindex->nChainSproutValue = nullopt;
+    }
+    if (pprev->nChainSaplingValue && have) {
+        pindex->nChainSaplingValue = *pprev->nChainSaplingValue + pindex->nSaplingValue;
+    } else {
+        pindex->nChainSaplingValue = nullopt;
+    }
+    pindex->nChainSproutNotes = add(pprev->nChainSproutNotes, have, pindex->nSproutNotes);
+    pindex->nChainSproutNullifiers = add(pprev->nChainSproutNullifiers, have, pindex->nSproutNullifiers);
+    pindex->nChainSaplingNotes = add(pprev->nChainSaplingNotes, have, pindex->nSaplingNotes);
+    pindex->nChainSaplingNullifiers = add(pprev->nChainSaplingNullifiers, have, pindex->nSaplingNullifiers);
+}
+
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pindexNew, const FlatFilePos& pos, const Consensus::Params& consensusParams)
 {
@@ -3155,6 +4472,7 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
     pindexNew->nDataPos = pos.nPos;
     pindexNew->nUndoPos = 0;
     pindexNew->nStatus |= BLOCK_HAVE_DATA;
+    SetShieldedPoolStats(pindexNew, block);
     if (IsWitnessEnabled(pindexNew->pprev, consensusParams)) {
         pindexNew->nStatus |= BLOCK_OPT_SAPLING;
     }
@@ -3171,6 +4489,7 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
             CBlockIndex *pindex = queue.front();
             queue.pop_front();
             pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+            SetChainShieldedPoolTotals(pindex);
             {
                 LOCK(cs_nBlockSequenceId);
                 pindex->nSequenceId = nBlockSequenceId++;
@@ -3191,6 +4510,11 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
         if (pindexNew->pprev && pindexNew->pprev->IsValid(BLOCK_VALID_TREE)) {
             m_blockman.m_blocks_unlinked.insert(std::make_pair(pindexNew->pprev, pindexNew));
         }
+        // The base of a UTXO snapshot being validated keeps the transaction
+        // count of the snapshot until the blocks under it are linked.
+        if (g_background_chainstate && pindexNew == GetSnapshotBaseBlock()) {
+            pindexNew->nChainTx = g_active_snapshot->m_metadata.m_nchaintx;
+        }
     }
 }
 
@@ -3282,7 +4606,10 @@ static bool CheckBlockHeader(const CBlockHeader& block, BlockValidationState& st
             return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "invalid-solution-size",
                                  strprintf("Equihash solution has invalid size: have %d, need [%d, %d]", nSolSize, oldSize, newSize));
 
-        if (!CheckEquihashSolution(&block))
+        const int64_t nTimeStart = GetTimeMicros();
+        const bool valid_solution = CheckEquihashSolution(&block);
+        RecordValidationTime(ValidationPhase::EQUIHASH, GetTimeMicros() - nTimeStart);
+        if (!valid_solution)
             return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "invalid-solution", "invalid equihash solution");
     }
 
@@ -3293,7 +4620,24 @@ static bool CheckBlockHeader(const CBlockHeader& block, BlockValidationState& st
     return true;
 }
 
-bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
+bool CHeaderCheck::operator()() {
+    BlockValidationState state;
+    *pfValid = CheckBlockHeader(*pheader, state, *pparams);
+    // Never abort the batch: a failed header is checked again by the caller
+    return true;
+}
+
+bool CTxCheck::operator()() {
+    if (!*pfValid) {
+        TxValidationState state;
+        *pfValid = CheckTransaction(*ptx, state);
+    }
+    *pnSigOps = GetLegacySigOpCount(*ptx);
+    // Never abort the batch: a failed transaction is checked again by the caller
+    return true;
+}
+
+bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, const std::vector<bool>* tx_checked)
 {
     // These are checks that are independent of context.
 
@@ -3308,7 +4652,14 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
-        uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
+        uint256 hashMerkleRoot2;
+        // Blocks that commit to their witnesses compute the witness root as
+        // well, which ContextualCheckBlock takes once the block is checked.
+        if (GetWitnessCommitmentIndex(block) != -1) {
+            hashMerkleRoot2 = BlockMerkleRoots(block, block.hashWitnessMerkleRoot, &mutated);
+        } else {
+            hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
+        }
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.Invalid(BlockValidationResult::BLOCK_MUTATED, "bad-txnmrklroot", "hashMerkleRoot mismatch");
 
@@ -3338,7 +4689,29 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
 
     // Check transactions
     // Must check for duplicate inputs (see CVE-2018-17144)
-    for (const auto& tx : block.vtx) {
+    // Those of a large block are checked on the worker threads first. The
+    // ones that failed are checked again in order, so that state tells the
+    // first failure as when checking serially.
+    std::vector<char> vTxValid(block.vtx.size(), 0);
+    if (tx_checked) {
+        assert(tx_checked->size() == block.vtx.size());
+        for (size_t i = 0; i < block.vtx.size(); i++) vTxValid[i] = (*tx_checked)[i];
+    }
+    std::vector<unsigned int> vSigOps;
+    if (g_parallel_script_checks && block.vtx.size() >= MIN_PARALLEL_TX_CHECKS) {
+        vSigOps.resize(block.vtx.size());
+        CCheckQueueControl<CTxCheck> control(&txcheckqueue);
+        std::vector<CTxCheck> vChecks;
+        vChecks.reserve(block.vtx.size());
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            vChecks.emplace_back(*block.vtx[i], &vTxValid[i], &vSigOps[i]);
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        if (vTxValid[i]) continue;
+        const CTransactionRef& tx = block.vtx[i];
         TxValidationState tx_state;
         if (!CheckTransaction(*tx, tx_state)) {
             // CheckBlock() does context-free validation checks. The only
@@ -3349,9 +4722,9 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
         }
     }
     unsigned int nSigOps = 0;
-    for (const auto& tx : block.vtx)
+    for (size_t i = 0; i < block.vtx.size(); i++)
     {
-        nSigOps += GetLegacySigOpCount(*tx);
+        nSigOps += vSigOps.empty() ? GetLegacySigOpCount(*block.vtx[i]) : vSigOps[i];
     }
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-blk-sigops", "out-of-bounds SigOpCount");
@@ -3543,7 +4916,7 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
         int commitpos = GetWitnessCommitmentIndex(block);
         if (commitpos != -1) {
             bool malleated = false;
-            uint256 hashWitness = BlockWitnessMerkleRoot(block, &malleated);
+            uint256 hashWitness = block.fChecked && !block.hashWitnessMerkleRoot.IsNull() ? block.hashWitnessMerkleRoot : BlockWitnessMerkleRoot(block, &malleated);
             // The malleation check is ignored; as the transaction tree itself
             // already does not permit it, it is impossible to trigger in the
             // witness tree.
@@ -3580,7 +4953,7 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
     return true;
 }
 
-bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3600,7 +4973,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), state.ToString());
 
         // Get prev block index
@@ -3669,11 +5042,34 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, BlockValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    // Verify the proof of work of the whole batch on the worker threads
+    // before taking cs_main. Headers that fail here are checked again
+    // below, so that state reports the first failure in order. Headers we
+    // already have are skipped, AcceptBlockHeader does not check them again.
+    std::vector<char> vPowValid(headers.size(), 0);
+    if (g_parallel_script_checks && headers.size() > 1) {
+        std::vector<CHeaderCheck> vChecks;
+        vChecks.reserve(headers.size());
+        {
+            LOCK(cs_main);
+            for (size_t i = 0; i < headers.size(); i++) {
+                if (LookupBlockIndex(headers[i].GetHash())) continue;
+                vChecks.emplace_back(headers[i], chainparams.GetConsensus(), &vPowValid[i]);
+            }
+        }
+        if (!vChecks.empty()) {
+            CCheckQueueControl<CHeaderCheck> control(&headercheckqueue);
+            control.Add(vChecks);
+            control.Wait();
+        }
+    }
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex);
+            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex, !vPowValid[i]);
             ::ChainstateActive().CheckBlockIndex(chainparams.GetConsensus());
 
             if (!accepted) {
@@ -3722,7 +5118,8 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, Block
     CBlockIndex *pindexDummy = nullptr;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex);
+    // A block that passed CheckBlock already had its proof of work verified.
+    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex, !block.fChecked);
     CheckBlockIndex(chainparams.GetConsensus());
 
     if (!accepted_header)
@@ -3909,33 +5306,129 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         FlatFilePos pos(*it, 0);
+        g_block_file_maps.Invalidate(*it);
         fs::remove(BlockFileSeq().FileName(pos));
         fs::remove(UndoFileSeq().FileName(pos));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
     }
 }
 
-/* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
-static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
+namespace {
+/**
+ * Unlinks pruned block and undo files on a thread of its own, so that
+ * FlushStateToDisk does not hold cs_main while the file system frees them.
+ */
+class PrunedFileUnlinker
 {
-    assert(fPruneMode && nManualPruneHeight > 0);
+private:
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    std::set<int> m_files GUARDED_BY(m_mutex);
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::thread m_thread;
 
-    LOCK2(cs_main, cs_LastBlockFile);
-    if (::ChainActive().Tip() == nullptr)
-        return;
+    void Run()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (true) {
+            m_cv.wait(lock, [this]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || !m_files.empty(); });
+            if (m_files.empty()) return;
+            std::set<int> files;
+            files.swap(m_files);
+            REVERSE_LOCK(lock);
+            for (const int file : files) {
+                FlatFilePos pos(file, 0);
+                fs::remove(BlockFileSeq().FileName(pos));
+                fs::remove(UndoFileSeq().FileName(pos));
+                LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, file);
+            }
+        }
+    }
 
-    // last block to prune is the lesser of (user-specified height, MIN_BLOCKS_TO_KEEP from the tip)
-    unsigned int nLastBlockWeCanPrune = std::min((unsigned)nManualPruneHeight, ::ChainActive().Tip()->nHeight - MIN_BLOCKS_TO_KEEP);
-    int count=0;
-    for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
-        if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
-            continue;
-        PruneOneBlockFile(fileNumber);
-        setFilesToPrune.insert(fileNumber);
-        count++;
+public:
+    ~PrunedFileUnlinker() { Stop(); }
+
+    void Add(const std::set<int>& files)
+    {
+        LOCK(m_mutex);
+        if (!m_thread.joinable()) {
+            m_thread = std::thread(&TraceThread<std::function<void()>>, "prune", std::bind(&PrunedFileUnlinker::Run, this));
+        }
+        m_files.insert(files.begin(), files.end());
+        m_cv.notify_one();
     }
-    LogPrintf("Prune (Manual): prune_height=%d removed %d blk/rev pairs\n", nLastBlockWeCanPrune, count);
-}
+
+    void Stop()
+    {
+        {
+            LOCK(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        if (m_thread.joinable()) m_thread.join();
+        LOCK(m_mutex);
+        m_stop = false;
+    }
+};
+
+PrunedFileUnlinker g_pruned_file_unlinker;
+
+Mutex g_prune_locks_mutex;
+std::map<std::string, int> g_prune_locks GUARDED_BY(g_prune_locks_mutex);
+
+/** The highest block that may be pruned for the prune locks, or max if there are none */
+unsigned int PruneLockHeight(unsigned int max)
+{
+    LOCK(g_prune_locks_mutex);
+    for (const std::pair<const std::string, int>& lock : g_prune_locks) {
+        if (lock.second < 0) return 0;
+        max = std::min(max, (unsigned int)lock.second);
+    }
+    return max;
+}
+} // namespace
+
+void QueueUnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+{
+    for (const int file : setFilesToPrune) {
+        g_block_file_maps.Invalidate(file);
+    }
+    g_pruned_file_unlinker.Add(setFilesToPrune);
+}
+
+void StopUnlinkingPrunedFiles()
+{
+    g_pruned_file_unlinker.Stop();
+}
+
+void SetPruneLock(const std::string& name, int height)
+{
+    LOCK(g_prune_locks_mutex);
+    g_prune_locks[name] = height;
+}
+
+/* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
+static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
+{
+    assert(fPruneMode && nManualPruneHeight > 0);
+
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (::ChainActive().Tip() == nullptr)
+        return;
+
+    // last block to prune is the lesser of (user-specified height, MIN_BLOCKS_TO_KEEP from the tip)
+    unsigned int nLastBlockWeCanPrune = std::min((unsigned)nManualPruneHeight, ::ChainActive().Tip()->nHeight - MIN_BLOCKS_TO_KEEP);
+    nLastBlockWeCanPrune = PruneLockHeight(nLastBlockWeCanPrune);
+    int count=0;
+    for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
+        if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+            continue;
+        PruneOneBlockFile(fileNumber);
+        setFilesToPrune.insert(fileNumber);
+        count++;
+    }
+    LogPrintf("Prune (Manual): prune_height=%d removed %d blk/rev pairs\n", nLastBlockWeCanPrune, count);
+}
 
 /* This function is called from the RPC code for pruneblockchain */
 void PruneBlockFilesManual(int nManualPruneHeight)
@@ -3973,7 +5466,7 @@ static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfte
         return;
     }
 
-    unsigned int nLastBlockWeCanPrune = ::ChainActive().Tip()->nHeight - MIN_BLOCKS_TO_KEEP;
+    unsigned int nLastBlockWeCanPrune = PruneLockHeight(::ChainActive().Tip()->nHeight - MIN_BLOCKS_TO_KEEP);
     uint64_t nCurrentUsage = CalculateCurrentUsage();
     // We don't check to prune until after we've allocated new space for files
     // So we should leave a buffer under our target to account for another allocation
@@ -4056,7 +5549,8 @@ CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = m_block_index_arena.Allocate();
+    boost::unique_lock<boost::shared_mutex> lock(m_block_index_mutex);
     mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -4068,7 +5562,7 @@ bool BlockManager::LoadBlockIndex(
     CBlockTreeDB& blocktree,
     std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }, fTrustBlockIndex ? hashAssumeValid : uint256()))
         return false;
 
     // Calculate nChainWork
@@ -4080,6 +5574,28 @@ bool BlockManager::LoadBlockIndex(
         vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
     }
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
+    // The entries were allocated in DB (hash) order. Move them to a new arena
+    // in height order, so that walking a chain touches neighbouring memory.
+    // No skip pointers are built yet, so pskip of a moved-from entry can
+    // point to where it went.
+    {
+        boost::unique_lock<boost::shared_mutex> lock(m_block_index_mutex);
+        CBlockIndexArena sorted;
+        for (std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
+            CBlockIndex* pindex = sorted.Allocate();
+            *pindex = std::move(*item.second);
+            item.second->pskip = pindex;
+            item.second = pindex;
+        }
+        for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
+            if (item.second->pprev) item.second->pprev = item.second->pprev->pskip;
+        }
+        for (BlockMap::value_type& entry : m_block_index) {
+            entry.second = entry.second->pskip;
+        }
+        std::swap(m_block_index_arena, sorted);
+    }
     for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
     {
         if (ShutdownRequested()) return false;
@@ -4092,14 +5608,23 @@ bool BlockManager::LoadBlockIndex(
             if (pindex->pprev) {
                 if (pindex->pprev->HaveTxsDownloaded()) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+                    SetChainShieldedPoolTotals(pindex);
                 } else {
                     pindex->nChainTx = 0;
                     m_blocks_unlinked.insert(std::make_pair(pindex->pprev, pindex));
                 }
             } else {
                 pindex->nChainTx = pindex->nTx;
+                SetChainShieldedPoolTotals(pindex);
             }
         }
+        // Until the blocks under it are there, the base of the UTXO snapshot
+        // being validated counts the transactions the snapshot says lead up
+        // to it, so that the blocks after it can be connected.
+        if (!pindex->HaveTxsDownloaded() && g_active_snapshot && g_active_snapshot->m_state == SnapshotRecord::PENDING &&
+            pindex->GetBlockHash() == g_active_snapshot->m_metadata.m_base_blockhash) {
+            pindex->nChainTx = g_active_snapshot->m_metadata.m_nchaintx;
+        }
         if (!(pindex->nStatus & BLOCK_FAILED_MASK) && pindex->pprev && (pindex->pprev->nStatus & BLOCK_FAILED_MASK)) {
             pindex->nStatus |= BLOCK_FAILED_CHILD;
             setDirtyBlockIndex.insert(pindex);
@@ -4122,15 +5647,18 @@ void BlockManager::Unload() {
     m_failed_blocks.clear();
     m_blocks_unlinked.clear();
 
-    for (const BlockMap::value_type& entry : m_block_index) {
-        delete entry.second;
-    }
-
+    boost::unique_lock<boost::shared_mutex> lock(m_block_index_mutex);
     m_block_index.clear();
+    m_block_index_arena.Clear();
 }
 
 bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
+    SnapshotRecord snapshot;
+    if (pblocktree->ReadSnapshot(snapshot)) {
+        g_active_snapshot = MakeUnique<SnapshotRecord>(snapshot);
+    }
+
     if (!g_blockman.LoadBlockIndex(
             chainparams.GetConsensus(), *pblocktree, ::ChainstateActive().setBlockIndexCandidates))
         return false;
@@ -4211,6 +5739,73 @@ bool CChainState::LoadChainTip(const CChainParams& chainparams)
     return true;
 }
 
+bool CChainState::LoadChainHistory(const CChainParams& chainparams, bool enabled)
+{
+    AssertLockHeld(cs_main);
+    HistoryState history_state;
+    if (!pblocktree->ReadHistoryState(history_state)) history_state = HistoryState();
+    CBlockTreeDB* db = pblocktree.get();
+    if (!m_history.Load(history_state, [db](HistoryIndex index, HistoryNode& node) { return db->ReadHistoryNode(index, node); }, enabled)) {
+        return error("%s: failed to read the chain history", __func__);
+    }
+    if (!enabled) return true;
+    const int first_height = FirstHistoryHeight(chainparams.GetConsensus());
+
+    // Remove the leaves of the blocks that are not in m_chain (any more), all
+    // of them if the block of the last leaf is not known.
+    if (m_history.Leaves() > 0) {
+        const CBlockIndex* last = LookupBlockIndex(m_history.TipHash());
+        const CBlockIndex* fork = last ? m_chain.FindFork(last) : nullptr;
+        uint64_t keep = fork && fork->nHeight >= first_height ? fork->nHeight - first_height + 1 : 0;
+        if (!last || m_history.Leaves() != uint64_t(last->nHeight - first_height + 1)) keep = 0;
+        if (keep < m_history.Leaves()) {
+            LogPrintf("Removing %u chain history leaves of blocks not in the active chain\n", m_history.Leaves() - keep);
+            if (!m_history.Truncate(keep)) {
+                return error("%s: failed to remove chain history leaves", __func__);
+            }
+        }
+    }
+
+    // Then append those of the blocks after the last leaf, written as they
+    // go so that an interrupted load goes on from there next time.
+    const CBlockIndex* tip = m_chain.Tip();
+    const int from = first_height + m_history.Leaves();
+    if (tip && from <= tip->nHeight) {
+        LogPrintf("Appending chain history leaves of blocks %d to %d\n", from, tip->nHeight);
+    }
+    for (int height = from; tip && height <= tip->nHeight; ++height) {
+        const CBlockIndex* pindex = m_chain[height];
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !(pindex->nStatus & BLOCK_HAVE_SAPLING_ROOT)) {
+            return error("%s: block %d is pruned, which -chainhistory needs to build the tree from", __func__, height);
+        }
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus())) {
+            return error("%s: failed to read block %d", __func__, height);
+        }
+        if (!m_history.Push(NewHistoryLeaf(*pindex, CountSaplingTransactions(block)))) {
+            return error("%s: failed to append the leaf of block %d", __func__, height);
+        }
+        const bool last = height == tip->nHeight;
+        if (last || height % 10000 == 0 || ShutdownRequested()) {
+            HistoryChanges changes;
+            if (m_history.GetChanges(changes)) {
+                if (!pblocktree->WriteHistory(changes)) {
+                    return error("%s: failed to write the chain history", __func__);
+                }
+                m_history.MarkWritten();
+            }
+            if (!last) LogPrintf("Chain history appended up to block %d\n", height);
+            if (ShutdownRequested()) return false;
+        }
+    }
+    if (m_history.Leaves() > 0) {
+        LogPrintf("Loaded chain history: leaves=%u root=%s\n", m_history.Leaves(), m_history.Root().ToString());
+    }
+
+    // Leaves removed above are written with the block index.
+    return true;
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks...").translated, 0, false);
@@ -4330,6 +5925,15 @@ bool CChainState::RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& i
         return error("ReplayBlock(): ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
     }
 
+    // Without a best anchor the interrupted flush was the first one, so the
+    // tree starts out empty.
+    SaplingMerkleTree sapling_tree;
+    const uint256 hashSaplingAnchor = inputs.GetBestAnchor();
+    if (!hashSaplingAnchor.IsNull() && !inputs.GetSaplingAnchorAt(hashSaplingAnchor, sapling_tree)) {
+        return error("ReplayBlock(): Sapling note commitment tree %s not found", hashSaplingAnchor.ToString());
+    }
+
+    std::vector<libzcash::PedersenHash> sapling_commitments;
     for (const CTransactionRef& tx : block.vtx) {
         if (!tx->IsCoinBase()) {
             for (const CTxIn &txin : tx->vin) {
@@ -4338,7 +5942,14 @@ bool CChainState::RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& i
         }
         // Pass check = true as every addition may be an overwrite.
         AddCoins(inputs, *tx, pindex->nHeight, true);
+        UpdateNullifiers(inputs, *tx, pindex->nHeight, true);
+
+        for (const OutputDescription& output : tx->vShieldedOutput) {
+            sapling_commitments.push_back(output.cm);
+        }
     }
+    sapling_tree.append_batch(sapling_commitments);
+    inputs.PushSaplingAnchor(sapling_tree);
     return true;
 }
 
@@ -4372,6 +5983,9 @@ bool CChainState::ReplayBlocks(const CChainParams& params)
         pindexOld = m_blockman.m_block_index[hashHeads[1]];
         pindexFork = LastCommonAncestor(pindexOld, pindexNew);
         assert(pindexFork != nullptr);
+        if (db.GetBestAnchor().IsNull()) {
+            return error("ReplayBlocks(): chainstate has no Sapling note commitment tree");
+        }
     }
 
     // Rollback along the old branch.
@@ -4515,7 +6129,7 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
             tip = tip->pprev;
         }
         // Make sure the queue of validation callbacks doesn't grow unboundedly.
-        LimitValidationInterfaceQueue();
+        LimitValidationInterfaceQueue(MAX_VALIDATION_CALLBACKS_PENDING);
 
         // Occasionally flush state to disk.
         if (!FlushStateToDisk(params, state, FlushStateMode::PERIODIC)) {
@@ -4583,6 +6197,8 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
     fHavePruned = false;
+    g_active_snapshot.reset();
+    g_background_chainstate.reset();
 
     ::ChainstateActive().UnloadBlockIndex();
 }
@@ -4639,6 +6255,185 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return ::ChainstateActive().LoadGenesisBlock(chainparams);
 }
 
+namespace {
+
+/** A block read by LoadExternalBlockFile, on its way through the pipeline. */
+struct ExternalBlock {
+    std::shared_ptr<CBlock> block;
+    FlatFilePos pos;
+    uint256 hash;
+    bool checked{false};
+};
+
+/**
+ * Pipeline behind LoadExternalBlockFile. A reader thread scans the file for
+ * block framing and deserializes the blocks, worker threads hash them and run
+ * the context-free CheckBlock (Equihash solution, merkle root, transactions),
+ * and the caller takes them back in file order to hand them to validation.
+ *
+ * Workers only warm up CBlock::fChecked: a block that fails is checked again
+ * by AcceptBlock, under cs_main, which reports and records the failure.
+ */
+class ExternalBlockPipeline
+{
+private:
+    //! Blocks read ahead of the one the caller is waiting for
+    static constexpr size_t MAX_QUEUED_BLOCKS = 64;
+    static constexpr int MAX_CHECK_THREADS = 8;
+
+    const CChainParams& m_chainparams;
+
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    //! Blocks in file order, checked or not
+    std::deque<std::shared_ptr<ExternalBlock>> m_queue GUARDED_BY(m_mutex);
+    //! Index in m_queue of the first block no worker has taken yet
+    size_t m_next_check GUARDED_BY(m_mutex){0};
+    bool m_eof GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    //! Set by the reader on a system error while reading the file
+    std::string m_error GUARDED_BY(m_mutex);
+
+    std::thread m_reader;
+    std::vector<std::thread> m_workers;
+
+    void ThreadRead(FILE* fileIn, const FlatFilePos* dbp)
+    {
+        try {
+            // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+            CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+            uint64_t nRewind = blkdat.GetPos();
+            while (!blkdat.eof()) {
+                {
+                    WAIT_LOCK(m_mutex, lock);
+                    m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || m_queue.size() < MAX_QUEUED_BLOCKS; });
+                    if (m_stop) break;
+                }
+
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(m_chainparams.MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> buf;
+                    if (memcmp(buf, m_chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    break;
+                }
+                try {
+                    // read block
+                    auto entry = std::make_shared<ExternalBlock>();
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    if (dbp) {
+                        entry->pos = *dbp;
+                        entry->pos.nPos = nBlockPos;
+                    }
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    blkdat.SetPos(nBlockPos);
+                    entry->block = std::make_shared<CBlock>();
+                    blkdat >> *entry->block;
+                    nRewind = blkdat.GetPos();
+
+                    LOCK(m_mutex);
+                    m_queue.push_back(std::move(entry));
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                    continue;
+                }
+                m_cv.notify_all();
+            }
+        } catch (const std::runtime_error& e) {
+            LOCK(m_mutex);
+            m_error = e.what();
+        }
+        {
+            LOCK(m_mutex);
+            m_eof = true;
+        }
+        m_cv.notify_all();
+    }
+
+    void ThreadCheck()
+    {
+        while (true) {
+            std::shared_ptr<ExternalBlock> entry;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || m_eof || m_next_check < m_queue.size(); });
+                if (m_stop || m_next_check == m_queue.size()) return;
+                entry = m_queue[m_next_check++];
+            }
+
+            entry->hash = entry->block->GetHash();
+            BlockValidationState state;
+            CheckBlock(*entry->block, state, m_chainparams.GetConsensus());
+
+            {
+                LOCK(m_mutex);
+                entry->checked = true;
+            }
+            m_cv.notify_all();
+        }
+    }
+
+public:
+    ExternalBlockPipeline(const CChainParams& chainparams, FILE* fileIn, const FlatFilePos* dbp)
+        : m_chainparams(chainparams)
+    {
+        const int workers = std::max(1, std::min(GetNumCores() - 1, MAX_CHECK_THREADS));
+        m_reader = std::thread(&TraceThread<std::function<void()>>, "loadblkrd", std::function<void()>(std::bind(&ExternalBlockPipeline::ThreadRead, this, fileIn, dbp)));
+        for (int i = 0; i < workers; i++) {
+            m_workers.emplace_back(&TraceThread<std::function<void()>>, "loadblkchk", std::function<void()>(std::bind(&ExternalBlockPipeline::ThreadCheck, this)));
+        }
+    }
+
+    ~ExternalBlockPipeline()
+    {
+        {
+            LOCK(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_reader.join();
+        for (std::thread& worker : m_workers) worker.join();
+    }
+
+    /** Take the next checked block in file order; nullptr once the file is done. */
+    std::shared_ptr<ExternalBlock> Next()
+    {
+        std::shared_ptr<ExternalBlock> entry;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return (m_eof && m_queue.empty()) || (!m_queue.empty() && m_queue.front()->checked); });
+            if (m_queue.empty()) return nullptr;
+            entry = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_next_check--;
+        }
+        m_cv.notify_all();
+        return entry;
+    }
+
+    /** The system error that ended the read, if any. */
+    std::string GetError()
+    {
+        LOCK(m_mutex);
+        return m_error;
+    }
+};
+
+} // namespace
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -4647,45 +6442,15 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        ExternalBlockPipeline pipeline(chainparams, fileIn, dbp);
+        while (std::shared_ptr<ExternalBlock> entry = pipeline.Next()) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
+            std::shared_ptr<CBlock> pblock = entry->block;
+            const CBlock& block = *pblock;
+            const uint256& hash = entry->hash;
+            FlatFilePos* pos = dbp ? &entry->pos : nullptr;
             try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                uint256 hash = block.GetHash();
                 {
                     LOCK(cs_main);
                     // detect out of order blocks, and store them for later
@@ -4693,7 +6458,7 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
                         LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
                                 block.hashPrevBlock.ToString());
                         if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, entry->pos));
                         continue;
                     }
 
@@ -4701,7 +6466,7 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
                     CBlockIndex* pindex = LookupBlockIndex(hash);
                     if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
                       BlockValidationState state;
-                      if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
+                      if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, pos, nullptr)) {
                           nLoaded++;
                       }
                       if (state.IsError()) {
@@ -4753,6 +6518,8 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
         }
+        const std::string error = pipeline.GetError();
+        if (!error.empty()) throw std::runtime_error(error);
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
@@ -4769,6 +6536,12 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 
     LOCK(cs_main);
 
+    // The chain loaded from a UTXO snapshot lacks the data of the blocks
+    // under its base, which most of the checks below rely on.
+    if (g_active_snapshot) {
+        return;
+    }
+
     // During a reindex, we read the genesis block and call CheckBlockIndex before ActivateBestChain,
     // so we have the genesis block in m_blockman.m_block_index but no active chain. (A few of the
     // tests when iterating the block tree require that m_chain has been initialized.)
@@ -4975,7 +6748,19 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(::ChainActive().Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! mempool.dat without the checksum, still loaded
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_CHECKSUM = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+/** The number of transactions LoadMempool accepts per cs_main acquisition */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 100;
+
+namespace {
+struct MempoolDumpEntry {
+    CTransactionRef tx;
+    int64_t nTime;
+    int64_t nFeeDelta;
+};
+} // namespace
 
 bool LoadMempool(CTxMemPool& pool)
 {
@@ -4994,30 +6779,64 @@ bool LoadMempool(CTxMemPool& pool)
     int64_t already_there = 0;
     int64_t nNow = GetTime();
 
+    // Nothing is applied before the whole file is read and, for versions
+    // with one, its checksum verified. The transactions are validated like
+    // any other, so those of a damaged file are still loaded, only the
+    // prioritisations are not trusted then.
+    std::vector<MempoolDumpEntry> entries;
+    std::map<uint256, CAmount> mapDeltas;
+    bool trusted = true;
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NO_CHECKSUM) {
             return false;
         }
+        // Everything after the version is covered by the checksum at the end
+        CHashVerifier<CAutoFile> verifier(&file);
         uint64_t num;
-        file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
+        verifier >> num;
+        while (num) {
+            MempoolDumpEntry entry;
+            verifier >> entry.tx;
+            verifier >> entry.nTime;
+            verifier >> entry.nFeeDelta;
+            entries.push_back(std::move(entry));
+            --num;
+        }
+        verifier >> mapDeltas;
+
+        if (version == MEMPOOL_DUMP_VERSION) {
+            uint256 checksum;
+            file >> checksum;
+            if (checksum != verifier.GetHash()) {
+                LogPrintf("Mempool file checksum mismatch, prioritisations not loaded. Continuing anyway.\n");
+                trusted = false;
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        trusted = false;
+    }
+
+    if (trusted) {
+        for (const MempoolDumpEntry& entry : entries) {
+            CAmount amountdelta = entry.nFeeDelta;
             if (amountdelta) {
-                pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                pool.PrioritiseTransaction(entry.tx->GetHash(), amountdelta);
             }
+        }
+    }
+
+    // Accept them in batches, so that block and peer processing get cs_main
+    // in between.
+    for (size_t start = 0; start < entries.size(); start += MEMPOOL_LOAD_BATCH_SIZE) {
+        LOCK(cs_main);
+        for (size_t i = start; i < std::min(start + MEMPOOL_LOAD_BATCH_SIZE, entries.size()); ++i) {
+            const MempoolDumpEntry& entry = entries[i];
             TxValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nTime,
+            if (entry.nTime + nExpiryTimeout > nNow) {
+                AcceptToMemoryPoolWithTime(chainparams, pool, state, entry.tx, entry.nTime,
                                            nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
                                            false /* test_accept */);
                 if (state.IsValid()) {
@@ -5027,7 +6846,7 @@ bool LoadMempool(CTxMemPool& pool)
                     // wallet(s) having loaded it while we were processing
                     // mempool transactions; consider these as valid, instead of
                     // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
+                    if (pool.exists(entry.tx->GetHash())) {
                         ++already_there;
                     } else {
                         ++failed;
@@ -5036,22 +6855,19 @@ bool LoadMempool(CTxMemPool& pool)
             } else {
                 ++expired;
             }
-            if (ShutdownRequested())
-                return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
+        if (ShutdownRequested())
+            return false;
+    }
 
+    if (trusted) {
         for (const auto& i : mapDeltas) {
             pool.PrioritiseTransaction(i.first, i.second);
         }
-    } catch (const std::exception& e) {
-        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
-        return false;
     }
 
     LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
-    return true;
+    return trusted;
 }
 
 bool DumpMempool(const CTxMemPool& pool)
@@ -5069,6 +6885,7 @@ bool DumpMempool(const CTxMemPool& pool)
         for (const auto &i : pool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
+        // Sorted by ancestor count, so that parents are loaded before their children
         vinfo = pool.infoAll();
     }
 
@@ -5085,15 +6902,27 @@ bool DumpMempool(const CTxMemPool& pool)
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
 
-        file << (uint64_t)vinfo.size();
+        // Each entry is serialized once, for both the file and the checksum
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        CDataStream stream(SER_DISK, CLIENT_VERSION);
+        auto write_stream = [&] {
+            hasher.write(stream.data(), stream.size());
+            file.write(stream.data(), stream.size());
+            stream.clear();
+        };
+
+        stream << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << int64_t{count_seconds(i.m_time)};
-            file << int64_t{i.nFeeDelta};
+            stream << *(i.tx);
+            stream << int64_t{count_seconds(i.m_time)};
+            stream << int64_t{i.nFeeDelta};
+            write_stream();
             mapDeltas.erase(i.tx->GetHash());
         }
 
-        file << mapDeltas;
+        stream << mapDeltas;
+        write_stream();
+        file << hasher.GetHash();
         if (!FileCommit(file.Get()))
             throw std::runtime_error("FileCommit failed");
         file.fclose();
@@ -5107,6 +6936,487 @@ bool DumpMempool(const CTxMemPool& pool)
     return true;
 }
 
+static const uint64_t VALIDATION_CACHE_DUMP_VERSION = 1;
+
+namespace {
+template <typename Stream>
+void ReadCacheEntries(Stream& s, std::vector<uint256>& entries)
+{
+    uint64_t num;
+    s >> num;
+    entries.reserve(std::min<uint64_t>(num, 1 << 20));
+    while (num--) {
+        uint256 entry;
+        s >> entry;
+        entries.push_back(entry);
+    }
+}
+
+template <typename Stream>
+void WriteCacheEntries(Stream& s, const std::vector<uint256>& entries)
+{
+    s << (uint64_t)entries.size();
+    for (const uint256& entry : entries) {
+        s << entry;
+    }
+}
+} // namespace
+
+bool LoadValidationCaches()
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "validationcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open validation cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    try {
+        uint64_t version;
+        int client_version;
+        file >> version >> client_version;
+        // The entries only hold under the validation rules of the version that saved them
+        if (version != VALIDATION_CACHE_DUMP_VERSION || client_version != CLIENT_VERSION) {
+            return false;
+        }
+        CHashVerifier<CAutoFile> verifier(&file);
+        uint256 sig_nonce, script_nonce;
+        std::vector<uint256> sig_entries, script_entries;
+        verifier >> sig_nonce;
+        ReadCacheEntries(verifier, sig_entries);
+        verifier >> script_nonce;
+        ReadCacheEntries(verifier, script_entries);
+        uint256 checksum;
+        file >> checksum;
+        if (checksum != verifier.GetHash()) {
+            LogPrintf("Validation cache file checksum mismatch, not loaded. Continuing anyway.\n");
+            return false;
+        }
+
+        LoadSignatureCacheEntries(sig_nonce, sig_entries);
+        LOCK(cs_main);
+        scriptExecutionCacheNonce = script_nonce;
+        for (const uint256& entry : script_entries) {
+            scriptExecutionCache.insert(entry);
+        }
+        LogPrintf("Imported validation caches from disk: %u signatures, %u transactions\n", sig_entries.size(), script_entries.size());
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize validation cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool DumpValidationCaches()
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 sig_nonce, script_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    GetSignatureCacheEntries(sig_nonce, sig_entries);
+    {
+        LOCK(cs_main);
+        script_nonce = scriptExecutionCacheNonce;
+        scriptExecutionCache.collect(script_entries);
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "validationcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << VALIDATION_CACHE_DUMP_VERSION << CLIENT_VERSION;
+
+        CDataStream stream(SER_DISK, CLIENT_VERSION);
+        stream << sig_nonce;
+        WriteCacheEntries(stream, sig_entries);
+        stream << script_nonce;
+        WriteCacheEntries(stream, script_entries);
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        hasher.write(stream.data(), stream.size());
+        file.write(stream.data(), stream.size());
+        file << hasher.GetHash();
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "validationcache.dat.new", GetDataDir() / "validationcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped validation caches: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump validation caches: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+CBlockIndex* GetSnapshotBaseBlock()
+{
+    AssertLockHeld(cs_main);
+    return g_active_snapshot ? LookupBlockIndex(g_active_snapshot->m_metadata.m_base_blockhash) : nullptr;
+}
+
+bool ActivateSnapshot(const fs::path& path, const CChainParams& chainparams, SnapshotMetadata& metadata, uint256& muhash, uint256& shielded_hash, std::string& error)
+{
+    // The metadata is checked before the coins are loaded, which takes a while.
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            error = "Unable to open snapshot file";
+            return false;
+        }
+        try {
+            file >> metadata;
+        } catch (const std::exception& e) {
+            error = strprintf("Unable to read snapshot: %s", e.what());
+            return false;
+        }
+    }
+    auto check_base = [&]() EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+        if (g_active_snapshot) {
+            error = "The active chainstate was loaded from a UTXO snapshot already";
+            return false;
+        }
+        if (fPruneMode || ::ChainstateActive().m_history.IsEnabled()) {
+            error = "UTXO snapshots cannot be loaded with -prune or -chainhistory";
+            return false;
+        }
+        const CBlockIndex* base = LookupBlockIndex(metadata.m_base_blockhash);
+        if (!base) {
+            error = strprintf("The header of the base block %s of the snapshot is not known", metadata.m_base_blockhash.ToString());
+            return false;
+        }
+        if (base->nStatus & BLOCK_FAILED_MASK) {
+            error = "The base block of the snapshot is invalid";
+            return false;
+        }
+        if (!::ChainActive().Tip() || ::ChainActive().Height() >= base->nHeight) {
+            error = "The active chain is not below the base block of the snapshot";
+            return false;
+        }
+        // Only the snapshots pinned in the chain parameters are accepted.
+        const auto assumeutxo = chainparams.Assumeutxo().find(base->nHeight);
+        if (assumeutxo == chainparams.Assumeutxo().end() || assumeutxo->second.blockhash != base->GetBlockHash()) {
+            error = strprintf("The snapshot at %s (%d) is not among the UTXO snapshots of the chain parameters", base->GetBlockHash().ToString(), base->nHeight);
+            return false;
+        }
+        if (assumeutxo->second.nChainTx != metadata.m_nchaintx) {
+            error = strprintf("The snapshot counts %u transactions up to its base instead of %u", metadata.m_nchaintx, assumeutxo->second.nChainTx);
+            return false;
+        }
+        return true;
+    };
+    if (!WITH_LOCK(cs_main, return check_base())) return false;
+
+    // The coins go straight into the database of the new chainstate.
+    std::unique_ptr<CChainState> snapshot_chainstate = MakeUnique<CChainState>();
+    snapshot_chainstate->InitCoinsDB(nMaxCoinsDBCache << 20, /* in_memory */ false, /* should_wipe */ true, SNAPSHOT_CHAINSTATE_DIR);
+    auto fail = [&]() {
+        snapshot_chainstate.reset();
+        fs::remove_all(GetDataDir() / SNAPSHOT_CHAINSTATE_DIR);
+        return false;
+    };
+    CCoinsViewDB* db = WITH_LOCK(cs_main, return &snapshot_chainstate->CoinsDB());
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull() || !LoadUTXOSnapshot(file, *db, metadata, error)) {
+            if (error.empty()) error = "Unable to open snapshot file";
+            return fail();
+        }
+    }
+    CCoinsStats stats;
+    if (!GetUTXOStats(db, stats, CoinStatsHashType::MUHASH)) {
+        error = "Unable to hash the loaded UTXO set";
+        return fail();
+    }
+    if (stats.coins_count != metadata.m_coins_count) {
+        error = strprintf("The snapshot holds %u coins instead of %u", stats.coins_count, metadata.m_coins_count);
+        return fail();
+    }
+    const int base_height = WITH_LOCK(cs_main, return LookupBlockIndex(metadata.m_base_blockhash)->nHeight);
+    const AssumeutxoData& assumeutxo = chainparams.Assumeutxo().at(base_height);
+    if (stats.muhash != assumeutxo.muhash) {
+        error = strprintf("The coins of the snapshot hash to %s, not to the MuHash3072 of the chain parameters", stats.muhash.ToString());
+        return fail();
+    }
+    muhash = stats.muhash;
+    // The nullifiers and anchors are what shielded spends are checked against.
+    if (!HashShieldedState(*db->NullifierCursor(), *db->SaplingAnchorCursor(), db->GetBestAnchor(), shielded_hash)) {
+        error = "Unable to hash the loaded Sapling state";
+        return fail();
+    }
+    if (shielded_hash != assumeutxo.shielded_hash) {
+        error = strprintf("The Sapling nullifiers and anchors of the snapshot hash to %s, not to the shielded hash of the chain parameters", shielded_hash.ToString());
+        return fail();
+    }
+
+    CBlockIndex* base;
+    CBlockIndex* old_tip;
+    {
+        LOCK(cs_main);
+        // The chain may have moved on while the coins were loaded.
+        if (!check_base()) return fail();
+        base = LookupBlockIndex(metadata.m_base_blockhash);
+
+        // The chainstate that is to validate the snapshot starts from where it is on disk.
+        ::ChainstateActive().ForceFlushStateToDisk();
+
+        SnapshotRecord snapshot;
+        snapshot.m_metadata = metadata;
+        snapshot.m_muhash = muhash;
+        snapshot.m_shielded_hash = shielded_hash;
+        if (!pblocktree->WriteSnapshot(snapshot)) {
+            error = "Failed to write to block index database";
+            return fail();
+        }
+        g_active_snapshot = MakeUnique<SnapshotRecord>(snapshot);
+
+        snapshot_chainstate->InitCoinsCache();
+        snapshot_chainstate->m_chain.SetTip(base);
+        snapshot_chainstate->setBlockIndexCandidates = ::ChainstateActive().setBlockIndexCandidates;
+        ::ChainstateActive().setBlockIndexCandidates.clear();
+
+        // Until the blocks under it are there, the base counts the transactions
+        // the snapshot says lead up to it, and the blocks after it that arrived
+        // already are linked to it.
+        if (!base->HaveTxsDownloaded()) {
+            base->nChainTx = metadata.m_nchaintx;
+            std::deque<CBlockIndex*> queue{base};
+            while (!queue.empty()) {
+                CBlockIndex* pindex = queue.front();
+                queue.pop_front();
+                if (pindex != base) {
+                    pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+                    SetChainShieldedPoolTotals(pindex);
+                }
+                snapshot_chainstate->setBlockIndexCandidates.insert(pindex);
+                auto range = g_blockman.m_blocks_unlinked.equal_range(pindex);
+                while (range.first != range.second) {
+                    queue.push_back(range.first->second);
+                    range.first = g_blockman.m_blocks_unlinked.erase(range.first);
+                }
+            }
+        } else {
+            snapshot_chainstate->setBlockIndexCandidates.insert(base);
+        }
+        snapshot_chainstate->PruneBlockIndexCandidates();
+
+        old_tip = ::ChainActive().Tip();
+        g_background_chainstate = std::move(g_chainstate);
+        g_chainstate = std::move(snapshot_chainstate);
+        {
+            // The transactions were checked against the UTXO set of the old tip.
+            LOCK(::mempool.cs);
+            ::mempool.clear();
+        }
+        LogPrintf("Activated the UTXO snapshot at %s (%d): %u coins, muhash %s, shielded hash %s\n", base->GetBlockHash().ToString(),
+                  base->nHeight, metadata.m_coins_count, muhash.ToString(), shielded_hash.ToString());
+        UpdateTip(base, chainparams);
+    }
+
+    const bool initial_download = ::ChainstateActive().IsInitialBlockDownload();
+    GetMainSignals().UpdatedBlockTip(base, LastCommonAncestor(old_tip, base), initial_download);
+    uiInterface.NotifyBlockTip(initial_download, base);
+
+    StartSnapshotValidation(chainparams);
+    return true;
+}
+
+bool CleanUpSnapshotChainstate(bool wipe)
+{
+    LOCK(cs_main);
+    SnapshotRecord snapshot;
+    const bool found = pblocktree->ReadSnapshot(snapshot);
+    if (found && snapshot.m_state == SnapshotRecord::PENDING && !wipe) return true;
+
+    const fs::path snapshot_path = GetDataDir() / SNAPSHOT_CHAINSTATE_DIR;
+    try {
+        if (fs::exists(snapshot_path)) {
+            if (found && snapshot.m_state == SnapshotRecord::VALID && !wipe) {
+                LogPrintf("The UTXO snapshot at %s was validated: its chainstate replaces the one that validated it\n",
+                          snapshot.m_metadata.m_base_blockhash.ToString());
+                fs::remove_all(GetDataDir() / "chainstate");
+                fs::rename(snapshot_path, GetDataDir() / "chainstate");
+            } else {
+                LogPrintf("Removing the chainstate loaded from a UTXO snapshot\n");
+                fs::remove_all(snapshot_path);
+            }
+        }
+    } catch (const fs::filesystem_error& e) {
+        return error("%s: %s", __func__, fsbridge::get_filesystem_error_message(e));
+    }
+    return !found || pblocktree->EraseSnapshot();
+}
+
+bool LoadSnapshotChainstate(const CChainParams& chainparams, std::string& error)
+{
+    AssertLockHeld(cs_main);
+    if (!g_active_snapshot) return true;
+    assert(g_active_snapshot->m_state == SnapshotRecord::PENDING);
+
+    if (!GetSnapshotBaseBlock() || !::ChainActive().Tip()) {
+        error = "The UTXO snapshot chainstate has no base block, or the chainstate validating it has no chain";
+        return false;
+    }
+    std::unique_ptr<CChainState> snapshot_chainstate = MakeUnique<CChainState>();
+    snapshot_chainstate->InitCoinsDB(nMaxCoinsDBCache << 20, /* in_memory */ false, /* should_wipe */ false, SNAPSHOT_CHAINSTATE_DIR);
+    snapshot_chainstate->InitCoinsCache();
+    snapshot_chainstate->setBlockIndexCandidates = ::ChainstateActive().setBlockIndexCandidates;
+    snapshot_chainstate->setBlockIndexCandidates.insert(GetSnapshotBaseBlock());
+    if (!snapshot_chainstate->LoadChainTip(chainparams)) {
+        error = "Error loading the UTXO snapshot chainstate";
+        return false;
+    }
+    ::ChainstateActive().setBlockIndexCandidates.clear();
+
+    LogPrintf("The UTXO snapshot at %s is validated in the background, which is at height %d\n",
+              g_active_snapshot->m_metadata.m_base_blockhash.ToString(), ::ChainActive().Height());
+    g_background_chainstate = std::move(g_chainstate);
+    g_chainstate = std::move(snapshot_chainstate);
+    return true;
+}
+
+static std::thread g_snapshot_validation_thread;
+static CThreadInterrupt g_snapshot_validation_interrupt;
+
+/**
+ * Connect the blocks under the base of the UTXO snapshot to the background
+ * chainstate as they arrive, at low priority and taking cs_main one block at
+ * a time, and check its UTXO set at the base against the snapshot. A fork the
+ * background chainstate was left on is disconnected first.
+ */
+static void ThreadValidateSnapshot(const CChainParams& chainparams)
+{
+    ScheduleBatchPriority();
+    // Most of the coins cache is the active chainstate's. The background one
+    // gets a quarter as much on top, which it writes out when it is full.
+    const size_t cache_budget = nCoinCacheUsage / 4;
+
+    while (!g_snapshot_validation_interrupt) {
+        CBlockIndex* pindex;
+        bool connect;
+        FlatFilePos pos;
+        {
+            LOCK(cs_main);
+            CBlockIndex* base = GetSnapshotBaseBlock();
+            CBlockIndex* tip = g_background_chainstate->m_chain.Tip();
+            if (tip == base) break;
+            connect = base->GetAncestor(tip->nHeight) == tip;
+            pindex = connect ? base->GetAncestor(tip->nHeight + 1) : tip;
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                pindex = nullptr;
+            } else {
+                pos = pindex->GetBlockPos();
+            }
+        }
+        if (!pindex) {
+            g_snapshot_validation_interrupt.sleep_for(std::chrono::milliseconds(200));
+            continue;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pos, chainparams.GetConsensus()) || block.GetHash() != pindex->GetBlockHash()) {
+            AbortNode(strprintf("Failed to read block %s for the background chainstate", pindex->GetBlockHash().ToString()));
+            return;
+        }
+
+        LOCK(cs_main);
+        CChainState& chainstate = *g_background_chainstate;
+        CCoinsViewCache view(&chainstate.CoinsTip());
+        if (connect) {
+            BlockValidationState state;
+            if (!chainstate.ConnectBlock(block, state, pindex, view, chainparams)) {
+                LogPrintf("ERROR: %s: block %s under the UTXO snapshot base failed to connect: %s\n", __func__,
+                          pindex->GetBlockHash().ToString(), state.ToString());
+                if (state.IsInvalid()) {
+                    pindex->nStatus |= BLOCK_FAILED_VALID;
+                    setDirtyBlockIndex.insert(pindex);
+                    g_active_snapshot->m_state = SnapshotRecord::INVALID;
+                    pblocktree->WriteSnapshot(*g_active_snapshot);
+                    AbortNode("The chain under the base of the UTXO snapshot is invalid, so the snapshot is dropped; restart to go on from the fully validated chainstate");
+                } else {
+                    AbortNode(strprintf("Failed to connect block %s to the background chainstate: %s", pindex->GetBlockHash().ToString(), state.ToString()));
+                }
+                return;
+            }
+        } else if (chainstate.DisconnectBlock(block, pindex, view) != DISCONNECT_OK) {
+            AbortNode(strprintf("Failed to disconnect block %s from the background chainstate", pindex->GetBlockHash().ToString()));
+            return;
+        }
+        bool flushed = view.Flush();
+        assert(flushed);
+        chainstate.m_chain.SetTip(connect ? pindex : pindex->pprev);
+        if (chainstate.CoinsTip().DynamicMemoryUsage() > cache_budget) {
+            chainstate.ForceFlushStateToDisk();
+        }
+    }
+    if (g_snapshot_validation_interrupt) return;
+
+    // The background chainstate reached the base: its coins have to be those of the snapshot.
+    CCoinsViewDB* db;
+    SnapshotRecord snapshot;
+    {
+        LOCK(cs_main);
+        g_background_chainstate->ForceFlushStateToDisk();
+        db = &g_background_chainstate->CoinsDB();
+        snapshot = *g_active_snapshot;
+    }
+    LogPrintf("The background chainstate reached the base of the UTXO snapshot, hashing its UTXO set\n");
+    CCoinsStats stats;
+    if (!GetUTXOStats(db, stats, CoinStatsHashType::MUHASH)) {
+        AbortNode("Unable to hash the UTXO set of the background chainstate");
+        return;
+    }
+    uint256 shielded_hash;
+    if (!HashShieldedState(*db->NullifierCursor(), *db->SaplingAnchorCursor(), db->GetBestAnchor(), shielded_hash)) {
+        AbortNode("Unable to hash the Sapling state of the background chainstate");
+        return;
+    }
+    const bool valid = stats.muhash == snapshot.m_muhash && stats.coins_count == snapshot.m_metadata.m_coins_count &&
+                       shielded_hash == snapshot.m_shielded_hash;
+
+    LOCK(cs_main);
+    g_active_snapshot->m_state = valid ? SnapshotRecord::VALID : SnapshotRecord::INVALID;
+    if (!pblocktree->WriteSnapshot(*g_active_snapshot)) {
+        AbortNode("Failed to write to block index database");
+        return;
+    }
+    if (!valid) {
+        LogPrintf("ERROR: %s: the UTXO set at the snapshot base has %u coins, muhash %s and shielded hash %s, the snapshot %u coins, muhash %s and shielded hash %s\n", __func__,
+                  stats.coins_count, stats.muhash.ToString(), shielded_hash.ToString(),
+                  snapshot.m_metadata.m_coins_count, snapshot.m_muhash.ToString(), snapshot.m_shielded_hash.ToString());
+        AbortNode("The UTXO snapshot does not match the chain, so it is dropped; restart to go on from the fully validated chainstate");
+        return;
+    }
+    LogPrintf("The UTXO snapshot at %s was validated\n", snapshot.m_metadata.m_base_blockhash.ToString());
+    g_background_chainstate->ResetCoinsViews();
+    g_background_chainstate.reset();
+}
+
+void StartSnapshotValidation(const CChainParams& chainparams)
+{
+    if (WITH_LOCK(cs_main, return !g_background_chainstate)) return;
+    assert(!g_snapshot_validation_thread.joinable());
+    g_snapshot_validation_interrupt.reset();
+    g_snapshot_validation_thread = std::thread(&TraceThread<std::function<void()>>, "snapshotval",
+        std::function<void()>(std::bind(ThreadValidateSnapshot, std::cref(chainparams))));
+}
+
+void InterruptSnapshotValidation()
+{
+    g_snapshot_validation_interrupt();
+}
+
+void StopSnapshotValidation()
+{
+    if (g_snapshot_validation_thread.joinable()) {
+        g_snapshot_validation_thread.join();
+    }
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
@@ -5131,10 +7441,8 @@ class CMainCleanup
 public:
     CMainCleanup() {}
     ~CMainCleanup() {
-        // block headers
-        BlockMap::iterator it1 = g_blockman.m_block_index.begin();
-        for (; it1 != g_blockman.m_block_index.end(); it1++)
-            delete (*it1).second;
+        // block headers, which are owned by m_block_index_arena and freed
+        // along with it
         g_blockman.m_block_index.clear();
     }
 };
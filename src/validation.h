@@ -11,9 +11,12 @@
 #endif
 
 #include <amount.h>
+#include <chainhistory.h>
 #include <coins.h>
 #include <crypto/common.h> // for ReadLE64
+#include <cuckoocache.h>
 #include <fs.h>
+#include <optional.h>
 #include <policy/feerate.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
 #include <script/script_error.h>
@@ -23,14 +26,18 @@
 #include <versionbits.h>
 #include <serialize.h>
 
+#include <array>
 #include <atomic>
 #include <map>
 #include <memory>
 #include <set>
 #include <stdint.h>
+#include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+
 class CChainState;
 class BlockValidationState;
 class CBlockIndex;
@@ -42,12 +49,16 @@ class CConnman;
 class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
+class SnapshotMetadata;
 class TxValidationState;
 struct ChainTxData;
+struct CheckQueueStats;
 
+struct DeferredBlockChecks;
 struct DisconnectedBlockTransactions;
 struct PrecomputedTransactionData;
 struct LockPoints;
+class CSignatureBatch;
 
 /** Default for -minrelaytxfee, minimum relay fee for transactions */
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 1000;
@@ -75,11 +86,17 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** The number of block files kept memory mapped for reading blocks */
+static const unsigned int MAX_MAPPED_BLOCK_FILES = 16;
 
 /** Maximum number of dedicated script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 15;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -proofthreads default (number of shielded proof checking threads, 0 = as many as -par) */
+static const int DEFAULT_PROOFCHECK_THREADS = 0;
+/** Blocks with at least this many transactions have them checked by CheckBlock on the worker threads */
+static const size_t MIN_PARALLEL_TX_CHECKS = 32;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -101,6 +118,8 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** -dbflushkeep default: percentage of -dbcache still filled with coins after writing them to disk */
+static const int DEFAULT_DB_FLUSH_KEEP = 75;
 /** Block download timeout base, expressed in millionths of the block interval (i.e. 10 min) */
 static const int64_t BLOCK_DOWNLOAD_TIMEOUT_BASE = 1000000;
 /** Additional block download timeout per parallel downloading peer (i.e. 5 min) */
@@ -125,6 +144,12 @@ static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 /** Maximum number of unconnecting headers announcements before DoS score */
 static const int MAX_UNCONNECTING_HEADERS = 10;
 
+/** Default for -trustblockindex */
+static const bool DEFAULT_TRUST_BLOCK_INDEX = false;
+
+/** Maximum number of blocks connected together during initial block download, waiting once for all their script and proof checks */
+static const unsigned int MAX_PIPELINED_BLOCKS = 8;
+
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
 
@@ -151,6 +176,8 @@ extern std::atomic_bool fReindex;
 extern bool g_parallel_script_checks;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
+/** Whether to take the block index entries up to hashAssumeValid as written, without hashing their headers at startup */
+extern bool fTrustBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
@@ -242,6 +269,16 @@ bool LoadBlockIndex(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Run an instance of the shielded proof checking thread */
+void ThreadProofCheck(int worker_num);
+/** Run an instance of the header checking thread */
+void ThreadHeaderCheck(int worker_num);
+/** Run an instance of the coins prefetching thread */
+void ThreadCoinsPrefetch(int worker_num);
+/** Run an instance of the block transaction checking thread */
+void ThreadTxCheck(int worker_num);
+/** The usage of the verification thread pools, by the names of their threads */
+std::vector<std::pair<std::string, CheckQueueStats>> GetCheckQueueStats();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, const CBlockIndex* const blockIndex = nullptr);
 /**
@@ -269,6 +306,18 @@ void PruneOneBlockFile(const int fileNumber) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
  */
 void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 
+/** Unlink the specified files on a background thread. Readers stop using them right away. */
+void QueueUnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
+
+/** Unlink the files queued so far and stop the background thread, until more are queued. */
+void StopUnlinkingPrunedFiles();
+
+/**
+ * Keep the blocks above height from being pruned, for name (an index that
+ * still has to read them). A negative height keeps all blocks.
+ */
+void SetPruneLock(const std::string& name, int height);
+
 /** Prune block files up to a given height */
 void PruneBlockFilesManual(int nManualPruneHeight);
 
@@ -278,6 +327,36 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * Run the checks of a transaction that need neither the chain nor the mempool:
+ * CheckTransaction() and the verification of its shielded proofs, which are
+ * added to the proof cache so that AcceptToMemoryPool() does not verify them
+ * again. Takes no locks, so that the proofs of transactions received from
+ * peers can be verified off the message handler thread.
+ */
+bool PreCheckTransaction(const CTransaction& tx, TxValidationState& state);
+
+/** The maximum number of transactions in a package passed to AcceptPackageToMemoryPool. */
+static const unsigned int MAX_PACKAGE_COUNT = 25;
+
+/**
+ * (try to) add a package of transactions, each spending outputs of the chain,
+ * the mempool or the transactions before it, to memory pool as a whole. The
+ * package is checked against the mempool limits and the minimum feerates
+ * together, so that a child can pay for a parent which would not be accepted
+ * on its own. Transactions already in the mempool are skipped.
+ *
+ * Every check of every transaction, including the one against the current
+ * block's script flags, is run before any of them is added. So either none
+ * is added, with the reason in package_state and, when it is due to a single
+ * transaction, in its entry of tx_states, or all are, save those trimmed
+ * again by the mempool size limit and marked as such. Transactions whose fee
+ * rate is higher than max_fee_rate are rejected (if 0, accept any fee rate).
+ * With test_accept the same checks are run and nothing is added.
+ */
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, TxValidationState& package_state, std::vector<TxValidationState>& tx_states,
+                               const std::vector<CTransactionRef>& package, const CFeeRate& max_fee_rate, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
 
@@ -315,10 +394,11 @@ bool TestLockPointValidity(const LockPoints* lp) EXCLUSIVE_LOCKS_REQUIRED(cs_mai
  * of the block needed for calculation or skips the calculation and uses the LockPoints
  * passed in for evaluation.
  * The LockPoints should not be considered valid if CheckSequenceLocks returns false.
+ * The inputs are looked up in coins_view if given, instead of the mempool and the UTXO set.
  *
  * See consensus/consensus.h for flag definitions.
  */
-bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false, const CCoinsView* coins_view = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /**
  * Closure representing one script verification
@@ -341,6 +421,8 @@ public:
         m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
+    /** Check with the signatures that are not cached added to batch for check index, and assumed valid */
+    bool operator()(CSignatureBatch& batch, size_t index);
 
     void swap(CScriptCheck &check) {
         std::swap(ptxTo, check.ptxTo);
@@ -355,22 +437,200 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Run a batch of script checks from the check queue, verifying together the
+ * signatures that are not cached.
+ */
+bool RunCheckBatch(std::vector<CScriptCheck>& checks);
+
+/**
+ * Closure representing one shielded proof verification: either a single
+ * JoinSplit, or all Spend and Output descriptions of a Sapling transaction
+ * together with its binding signature.
+ * The Ed25519 joinSplitSig of a transaction is not checked here, nor anywhere
+ * else in validation, so there are no JoinSplit signatures to batch.
+ * Note that this stores references to the transaction
+ */
+class CShieldedProofCheck
+{
+private:
+    const CTransaction *ptxTo;
+    //! Index of the JoinSplit to check, or -1 for the Sapling descriptions
+    int nJoinSplit;
+    //! Shielded signature hash of ptxTo, only used for Sapling checks
+    uint256 sighash;
+    //! The branch sighash commits to, which the cached result of a Sapling check is kept under
+    uint32_t consensusBranchId;
+    bool cacheStore;
+
+public:
+    CShieldedProofCheck(): ptxTo(nullptr), nJoinSplit(-1), consensusBranchId(0), cacheStore(false) {}
+    CShieldedProofCheck(const CTransaction& txToIn, int nJoinSplitIn, const uint256& sighashIn, uint32_t consensusBranchIdIn, bool cacheIn) :
+        ptxTo(&txToIn), nJoinSplit(nJoinSplitIn), sighash(sighashIn), consensusBranchId(consensusBranchIdIn), cacheStore(cacheIn) { }
+
+    bool operator()();
+
+    void swap(CShieldedProofCheck &check) {
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nJoinSplit, check.nJoinSplit);
+        std::swap(sighash, check.sighash);
+        std::swap(consensusBranchId, check.consensusBranchId);
+        std::swap(cacheStore, check.cacheStore);
+    }
+};
+
+/**
+ * Closure representing the context-free checks of one block header, of which
+ * the Equihash solution is by far the most expensive part.
+ * The outcome is also written to *pfValid, so that the caller can tell which
+ * headers of a batch passed.
+ */
+class CHeaderCheck
+{
+private:
+    const CBlockHeader *pheader;
+    const Consensus::Params *pparams;
+    char *pfValid;
+
+public:
+    CHeaderCheck(): pheader(nullptr), pparams(nullptr), pfValid(nullptr) {}
+    CHeaderCheck(const CBlockHeader& headerIn, const Consensus::Params& paramsIn, char* pfValidIn) :
+        pheader(&headerIn), pparams(&paramsIn), pfValid(pfValidIn) { }
+
+    bool operator()();
+
+    void swap(CHeaderCheck &check) {
+        std::swap(pheader, check.pheader);
+        std::swap(pparams, check.pparams);
+        std::swap(pfValid, check.pfValid);
+    }
+};
+
+/**
+ * Closure running the context-free checks of a transaction of a block, so
+ * that those of a large block run on the worker threads. CheckTransaction is
+ * only run if *pfValid is not set already, and sets it; *pnSigOps is the
+ * legacy sigop count.
+ */
+class CTxCheck
+{
+private:
+    const CTransaction *ptx;
+    char *pfValid;
+    unsigned int *pnSigOps;
+
+public:
+    CTxCheck(): ptx(nullptr), pfValid(nullptr), pnSigOps(nullptr) {}
+    CTxCheck(const CTransaction& txIn, char* pfValidIn, unsigned int* pnSigOpsIn) :
+        ptx(&txIn), pfValid(pfValidIn), pnSigOps(pnSigOpsIn) { }
+
+    bool operator()();
+
+    void swap(CTxCheck &check) {
+        std::swap(ptx, check.ptx);
+        std::swap(pfValid, check.pfValid);
+        std::swap(pnSigOps, check.pnSigOps);
+    }
+};
+
+/**
+ * Closure reading one coin or one Sapling nullifier from the coins database,
+ * so that the reads of a block can be issued concurrently. The result goes to
+ * *pcoin or *pnHeight, and *pfFound says whether there was one.
+ */
+class CCoinsPrefetch
+{
+private:
+    const CCoinsView *pview;
+    const COutPoint *poutpoint;
+    const uint256 *pnullifier;
+    Coin *pcoin;
+    uint32_t *pnHeight;
+    char *pfFound;
+
+public:
+    CCoinsPrefetch(): pview(nullptr), poutpoint(nullptr), pnullifier(nullptr), pcoin(nullptr), pnHeight(nullptr), pfFound(nullptr) {}
+    CCoinsPrefetch(const CCoinsView& viewIn, const COutPoint& outpointIn, Coin& coinOut, char* pfFoundIn) :
+        pview(&viewIn), poutpoint(&outpointIn), pnullifier(nullptr), pcoin(&coinOut), pnHeight(nullptr), pfFound(pfFoundIn) { }
+    CCoinsPrefetch(const CCoinsView& viewIn, const uint256& nullifierIn, uint32_t& nHeightOut, char* pfFoundIn) :
+        pview(&viewIn), poutpoint(nullptr), pnullifier(&nullifierIn), pcoin(nullptr), pnHeight(&nHeightOut), pfFound(pfFoundIn) { }
+
+    bool operator()();
+
+    void swap(CCoinsPrefetch &check) {
+        std::swap(pview, check.pview);
+        std::swap(poutpoint, check.poutpoint);
+        std::swap(pnullifier, check.pnullifier);
+        std::swap(pcoin, check.pcoin);
+        std::swap(pnHeight, check.pnHeight);
+        std::swap(pfFound, check.pfFound);
+    }
+};
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+CuckooCache::cache_stats GetScriptExecutionCacheStats();
+
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the blocks of pindexes at once, the ones that are not in mapped block files with ReadFiles. Blocks that cannot be read are left null. */
+bool ReadBlocksFromDisk(std::vector<std::shared_ptr<CBlock>>& blocks, const std::vector<const CBlockIndex*>& pindexes, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
+/** Steps of block validation that are timed for getvalidationstats, in the order they run. */
+enum class ValidationPhase {
+    EQUIHASH,           //!< Equihash solution check in CheckBlockHeader
+    READ_FROM_DISK,     //!< ConnectTip: load the block from disk
+    PREFETCH,           //!< ConnectTip: prefetch the block's inputs
+    SANITY_CHECKS,      //!< ConnectBlock: checks before connecting transactions
+    FORK_CHECKS,        //!< ConnectBlock: BIP30 and script flags
+    CONNECT_TXS,        //!< ConnectBlock: input checks and coins updates
+    NOTE_COMMITMENTS,   //!< ConnectBlock: Sapling note commitment tree update
+    PROOFS,             //!< ConnectBlock: Sprout and Sapling proof verification, summed over threads
+    VERIFY,             //!< ConnectBlock: until scripts and proofs are verified
+    INDEX,              //!< ConnectBlock: undo data and block index writing
+    CALLBACKS,          //!< ConnectBlock: the rest
+    CONNECT_TOTAL,      //!< ConnectTip: ConnectBlock as a whole
+    FLUSH,              //!< ConnectTip: flush the block's coins to the cache
+    CHAINSTATE,         //!< ConnectTip: write the chainstate to disk, if needed
+    POSTCONNECT,        //!< ConnectTip: mempool and tip updates
+    CONNECT_BLOCK,      //!< ConnectTip as a whole
+    COUNT
+};
+
+const char* ValidationPhaseName(ValidationPhase phase);
+
+/** Upper bounds, in microseconds, of the timing histogram buckets. A last bucket holds longer times. */
+static constexpr std::array<int64_t, 12> VALIDATION_TIMING_BOUNDS{{100, 250, 1000, 2500, 10000, 25000, 100000, 250000, 1000000, 2500000, 10000000, 25000000}};
+/** Number of most recent timings kept per phase */
+static const size_t VALIDATION_TIMING_RECENT = 100;
+
+struct ValidationTimingStats {
+    uint64_t count{0};
+    int64_t total_us{0};
+    std::array<uint64_t, VALIDATION_TIMING_BOUNDS.size() + 1> histogram{{}};
+    std::vector<int64_t> recent_us; //!< Oldest first
+};
+
+/** Add a timing of one run of phase. */
+void RecordValidationTime(ValidationPhase phase, int64_t us);
+ValidationTimingStats GetValidationTimingStats(ValidationPhase phase);
+
 /** Functions for validating blocks and updating the block tree */
 
-/** Context-independent validity checks */
-bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+/**
+ * Context-independent validity checks. A block that passes them with
+ * fCheckPOW and fCheckMerkleRoot gets block.fChecked set, and is not checked
+ * again. CheckTransaction is skipped for the transactions at the positions
+ * set in tx_checked, which passed it already, e.g. on mempool acceptance.
+ */
+bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true, const std::vector<bool>* tx_checked = nullptr);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block) */
 bool TestBlockValidity(BlockValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -400,6 +660,12 @@ public:
 };
 
 CBlockIndex* LookupBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/**
+ * Find the block index entry of a hash without cs_main, for readers such as
+ * RPCs. Only the fields that do not change once an entry is added, like the
+ * header, height, pprev and chain work, may be read from it without cs_main.
+ */
+const CBlockIndex* LookupBlockIndexShared(const uint256& hash);
 
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -436,6 +702,13 @@ struct CBlockIndexWorkComparator
 class BlockManager {
 public:
     BlockMap m_block_index GUARDED_BY(cs_main);
+    /** Owns the entries of m_block_index, in height order for those loaded at startup */
+    CBlockIndexArena m_block_index_arena GUARDED_BY(cs_main);
+    /**
+     * Taken exclusively, with cs_main, where m_block_index changes, and
+     * shared by readers that do not hold cs_main, see LookupBlockIndexShared().
+     */
+    mutable boost::shared_mutex m_block_index_mutex;
 
     /** In order to efficiently track invalidity of headers, we keep the set of
       * blocks which we tried to connect and found to be invalid here (ie which
@@ -487,12 +760,15 @@ public:
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to m_block_index.
+     * fCheckPOW may only be false if the proof of work of the header was already
+     * verified (see CHeaderCheck).
      */
     bool AcceptBlockHeader(
         const CBlockHeader& block,
         BlockValidationState& state,
         const CChainParams& chainparams,
-        CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+        CBlockIndex** ppindex,
+        bool fCheckPOW = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /**
@@ -620,6 +896,15 @@ public:
     //! @see CChain, CBlockIndex.
     CChain m_chain;
 
+    //! The ZIP 221 history tree of m_chain, maintained with -chainhistory.
+    ChainHistory m_history GUARDED_BY(::cs_main);
+
+    //! The block files pruned, and the locator to signal ChainStateFlushed
+    //! with, at a flush whose coins may still be written in the background.
+    //! Both wait until the coins are on disk.
+    std::set<int> m_files_to_unlink GUARDED_BY(::cs_main);
+    Optional<CBlockLocator> m_flushed_locator GUARDED_BY(::cs_main);
+
     /**
      * The set of all CBlockIndex entries with BLOCK_VALID_TRANSACTIONS (for itself and all ancestors) and
      * as good as our current tip or better. Entries may be failed, though, and pruning nodes may be
@@ -696,9 +981,17 @@ public:
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const FlatFilePos* dbp, bool* fNewBlock) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block (dis)connection on a given view:
-    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
+    //! With history, the leaf of the block is removed from it too.
+    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, ChainHistory* history = nullptr);
+    /**
+     * With deferred, the script and proof checks are handed to its check
+     * queue controls and not waited for, and pindex is not raised to
+     * BLOCK_VALID_SCRIPTS; see ConnectTipsPipelined. With history, the leaf
+     * of the block is appended to it.
+     */
     bool ConnectBlock(const CBlock& block, BlockValidationState& state, CBlockIndex* pindex,
-                      CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+                      CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false,
+                      DeferredBlockChecks* deferred = nullptr, ChainHistory* history = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Apply the effects of a block disconnection on the UTXO set.
     bool DisconnectTip(BlockValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions* disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
@@ -730,6 +1023,13 @@ public:
     /** Update the chain tip based on database information, i.e. CoinsTip()'s best block. */
     bool LoadChainTip(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Load m_history from the block tree database and, if enabled, bring it
+     * to m_chain: leaves of blocks no longer in it are removed, and those of
+     * the blocks after the last leaf appended from the block files.
+     */
+    bool LoadChainHistory(const CChainParams& chainparams, bool enabled) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     //! Dictates whether we need to flush the cache to disk or not.
     //!
     //! @return the state of the size of the coins cache.
@@ -741,9 +1041,16 @@ public:
         size_t max_coins_cache_size_bytes,
         size_t max_mempool_size_bytes) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
+    //! Height of the last block of the pipelined group that failed last, -1 if none did
+    int PipelineFailedHeight() const EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return m_pipeline_failed_height; }
+
 private:
     bool ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
     bool ConnectTip(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
+    bool ConnectTipsPipelined(BlockValidationState& state, const CChainParams& chainparams, const std::vector<CBlockIndex*>& pindexes, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool, bool& fRetrySerially) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
+
+    //! Height of the last block of a pipelined group that failed; the blocks up to it are connected one at a time
+    int m_pipeline_failed_height{-1};
 
     void InvalidBlockFound(CBlockIndex *pindex, const BlockValidationState &state) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     CBlockIndex* FindMostWorkChain() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -782,6 +1089,49 @@ BlockMap& BlockIndex();
 // directly, e.g. init.cpp.
 extern std::unique_ptr<CChainState> g_chainstate;
 
+/**
+ * While the active chainstate was loaded from a UTXO snapshot, the fully
+ * validated chainstate that connects the blocks up to the base of the
+ * snapshot in the background, to check the snapshot against. Not what
+ * ::ChainstateActive() returns, and null otherwise. (protected by cs_main)
+ */
+extern std::unique_ptr<CChainState> g_background_chainstate;
+
+/** The base block of the UTXO snapshot the active chainstate was loaded from, if it was */
+CBlockIndex* GetSnapshotBaseBlock() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/**
+ * Load the UTXO snapshot at path into a new chainstate, which becomes the
+ * active one at the base of the snapshot, and start validating the snapshot
+ * with the chainstate it replaces. The header of the base has to be known,
+ * and the active chain must not have reached its height. metadata is that
+ * of the snapshot, muhash the MuHash3072 of its coins and shielded_hash the
+ * HashShieldedState of its nullifiers and anchors, both of which have to match
+ * the chain parameters and which the background chainstate has to arrive at.
+ * Sets error if it fails.
+ */
+bool ActivateSnapshot(const fs::path& path, const CChainParams& chainparams, SnapshotMetadata& metadata, uint256& muhash, uint256& shielded_hash, std::string& error) LOCKS_EXCLUDED(cs_main);
+
+/**
+ * Before the block index is loaded, finish with the UTXO snapshot chainstate
+ * of an earlier run whose validation completed: if the snapshot was valid,
+ * it replaces the chainstate that validated it, and otherwise it is removed.
+ * So is one still being validated if wipe is set.
+ */
+bool CleanUpSnapshotChainstate(bool wipe);
+
+/**
+ * If the active chainstate was loaded from a UTXO snapshot that is still
+ * being validated, open the chainstate of the snapshot and make it the
+ * active one, with the chainstate loaded before as g_background_chainstate.
+ */
+bool LoadSnapshotChainstate(const CChainParams& chainparams, std::string& error) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/** Start, interrupt and stop the thread that validates the UTXO snapshot with g_background_chainstate */
+void StartSnapshotValidation(const CChainParams& chainparams);
+void InterruptSnapshotValidation();
+void StopSnapshotValidation();
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern std::unique_ptr<CBlockTreeDB> pblocktree;
 
@@ -808,6 +1158,12 @@ bool DumpMempool(const CTxMemPool& pool);
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool);
 
+/** Dump the signature and script execution caches to disk, with their nonces. */
+bool DumpValidationCaches();
+
+/** Load the signature and script execution caches from disk, before they are used. */
+bool LoadValidationCaches();
+
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
@@ -11,87 +11,349 @@
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <scheduler.h>
+#include <util/memory.h>
+#include <util/system.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <future>
-#include <unordered_map>
+#include <thread>
 #include <utility>
 
-//! The MainSignalsInstance manages a list of shared_ptr<CValidationInterface>
-//! callbacks.
+namespace {
+/**
+ * The callbacks of one subscriber, run in order and one at a time. Each run
+ * is a task of the scheduler, so the queues of different subscribers run in
+ * parallel when the scheduler has several threads.
+ */
+class SubscriberQueue : public std::enable_shared_from_this<SubscriberQueue>
+{
+private:
+    CScheduler* const m_scheduler;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()>> m_pending GUARDED_BY(m_mutex);
+    bool m_running GUARDED_BY(m_mutex){false};
+    std::thread::id m_running_thread GUARDED_BY(m_mutex);
+    size_t m_peak_pending GUARDED_BY(m_mutex){0};
+    uint64_t m_callbacks_run GUARDED_BY(m_mutex){0};
+    std::chrono::microseconds m_run_time GUARDED_BY(m_mutex){0};
+
+    void MaybeScheduleProcess()
+    {
+        {
+            LOCK(m_mutex);
+            if (m_running || m_pending.empty()) return;
+        }
+        // The queue goes away with its subscriber, dropping the callbacks
+        // left, which no longer run once it is unregistered anyway.
+        std::weak_ptr<SubscriberQueue> weak_queue = shared_from_this();
+        m_scheduler->schedule([weak_queue] {
+            if (auto queue = weak_queue.lock()) queue->Process();
+        }, std::chrono::system_clock::now());
+    }
+
+public:
+    //! Null for the queue of the functions that follow all subscribers
+    const std::shared_ptr<CValidationInterface> m_callbacks;
+    const std::string m_name;
+    std::atomic<bool> m_registered{true};
+
+    SubscriberQueue(CScheduler* scheduler, std::shared_ptr<CValidationInterface> callbacks, std::string name)
+        : m_scheduler(scheduler), m_callbacks(std::move(callbacks)), m_name(std::move(name)) {}
+
+    void Add(std::function<void()> func)
+    {
+        {
+            LOCK(m_mutex);
+            m_pending.emplace_back(std::move(func));
+            m_peak_pending = std::max(m_peak_pending, m_pending.size());
+        }
+        MaybeScheduleProcess();
+    }
+
+    //! Run the next callback
+    void Process()
+    {
+        std::function<void()> callback;
+        {
+            LOCK(m_mutex);
+            if (m_running || m_pending.empty()) return;
+            m_running = true;
+            m_running_thread = std::this_thread::get_id();
+            callback = std::move(m_pending.front());
+            m_pending.pop_front();
+        }
+
+        // RAII the accounting and calling MaybeScheduleProcess to ensure
+        // both happen even if callback() throws.
+        struct RAIICallbackRunning {
+            SubscriberQueue* queue;
+            const std::chrono::steady_clock::time_point start{std::chrono::steady_clock::now()};
+            explicit RAIICallbackRunning(SubscriberQueue* _queue) : queue(_queue) {}
+            ~RAIICallbackRunning() {
+                {
+                    LOCK(queue->m_mutex);
+                    queue->m_running = false;
+                    queue->m_callbacks_run++;
+                    queue->m_run_time += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                }
+                queue->m_cond.notify_all();
+                queue->MaybeScheduleProcess();
+            }
+        } raiicallbackrunning(this);
+
+        callback();
+    }
+
+    //! Run all callbacks on the calling thread, once the scheduler has no threads left
+    void Empty()
+    {
+        while (true) {
+            Process();
+            LOCK(m_mutex);
+            if (m_pending.empty()) break;
+        }
+    }
+
+    //! Wait until at most max_pending callbacks are left
+    void Wait(size_t max_pending)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_pending.size() <= max_pending; });
+    }
+
+    //! Wait until no callback is running, unless it is the calling thread that runs it
+    void WaitIdle()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        if (m_running && m_running_thread == std::this_thread::get_id()) return;
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return !m_running; });
+    }
+
+    size_t Pending()
+    {
+        LOCK(m_mutex);
+        return m_pending.size();
+    }
+
+    ValidationQueueInfo GetInfo()
+    {
+        LOCK(m_mutex);
+        return ValidationQueueInfo{m_name, m_pending.size(), m_peak_pending, m_callbacks_run, m_run_time};
+    }
+};
+
+/**
+ * Passed to the queues of all subscribers by CallFunctionInValidationInterfaceQueue:
+ * once every subscriber has run or dropped its copy, the function follows.
+ */
+struct QueueBarrier {
+    std::shared_ptr<SubscriberQueue> m_queue;
+    std::function<void()> m_func;
+
+    QueueBarrier(std::shared_ptr<SubscriberQueue> queue, std::function<void()> func)
+        : m_queue(std::move(queue)), m_func(std::move(func)) {}
+    ~QueueBarrier() { m_queue->Add(std::move(m_func)); }
+};
+
+/**
+ * Ends a wait on a queue when the callback holding it runs or is dropped
+ * with its queue, whichever comes first.
+ */
+struct SyncGuard {
+    std::promise<void> m_promise;
+
+    ~SyncGuard() { m_promise.set_value(); }
+};
+} // namespace
+
+//! The MainSignalsInstance manages the callback queues of the registered
+//! CValidationInterface subscribers.
 //!
-//! A std::unordered_map is used to track what callbacks are currently
-//! registered, and a std::list is to used to store the callbacks that are
-//! currently registered as well as any callbacks that are just unregistered
-//! and about to be deleted when they are done executing.
+//! Every subscriber has a queue of its own, so that a slow subscriber only
+//! delays its own callbacks. A queue holds a shared_ptr to its subscriber,
+//! and is kept alive by the callbacks running on it, so a subscriber is only
+//! released once it is unregistered and none of its callbacks are running.
 struct MainSignalsInstance {
 private:
+    //! The threads running the callbacks, if they have threads of their own
+    std::unique_ptr<CScheduler> m_callback_scheduler;
+    std::vector<std::thread> m_threads;
+    CScheduler* const m_scheduler;
+
     Mutex m_mutex;
-    //! List entries consist of a callback pointer and reference count. The
-    //! count is equal to the number of current executions of that entry, plus 1
-    //! if it's registered. It cannot be 0 because that would imply it is
-    //! unregistered and also not being executed (so shouldn't exist).
-    struct ListEntry { std::shared_ptr<CValidationInterface> callbacks; int count = 1; };
-    std::list<ListEntry> m_list GUARDED_BY(m_mutex);
-    std::unordered_map<CValidationInterface*, std::list<ListEntry>::iterator> m_map GUARDED_BY(m_mutex);
+    //! In the order the subscribers registered
+    std::vector<std::shared_ptr<SubscriberQueue>> m_queues GUARDED_BY(m_mutex);
+    //! The functions of CallFunctionInValidationInterfaceQueue
+    const std::shared_ptr<SubscriberQueue> m_functions;
+
+    std::shared_ptr<SubscriberQueue> Find(const CValidationInterface* callbacks)
+    {
+        LOCK(m_mutex);
+        for (const auto& queue : m_queues) {
+            if (queue->m_callbacks.get() == callbacks) return queue;
+        }
+        return nullptr;
+    }
+
+    std::vector<std::shared_ptr<SubscriberQueue>> Queues()
+    {
+        LOCK(m_mutex);
+        return m_queues;
+    }
 
 public:
-    // We are not allowed to assume the scheduler only runs in one thread,
-    // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
-    SingleThreadedSchedulerClient m_schedulerClient;
+    MainSignalsInstance(CScheduler* pscheduler, int callback_threads)
+        : m_callback_scheduler(callback_threads > 0 ? MakeUnique<CScheduler>() : nullptr),
+          m_scheduler(m_callback_scheduler ? m_callback_scheduler.get() : pscheduler),
+          m_functions(std::make_shared<SubscriberQueue>(m_scheduler, nullptr, ""))
+    {
+        for (int i = 0; i < callback_threads; i++) {
+            m_threads.emplace_back(&TraceThread<std::function<void()>>, "callbacks", [this] { m_callback_scheduler->serviceQueue(); });
+        }
+    }
+
+    ~MainSignalsInstance() { StopThreads(); }
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    void StopThreads()
+    {
+        if (!m_callback_scheduler) return;
+        m_callback_scheduler->stop();
+        for (std::thread& thread : m_threads) {
+            if (thread.joinable()) thread.join();
+        }
+    }
 
-    void Register(std::shared_ptr<CValidationInterface> callbacks)
+    void Register(std::shared_ptr<CValidationInterface> callbacks, const std::string& name)
     {
         LOCK(m_mutex);
-        auto inserted = m_map.emplace(callbacks.get(), m_list.end());
-        if (inserted.second) inserted.first->second = m_list.emplace(m_list.end());
-        inserted.first->second->callbacks = std::move(callbacks);
+        for (const auto& queue : m_queues) {
+            if (queue->m_callbacks == callbacks) return;
+        }
+        m_queues.push_back(std::make_shared<SubscriberQueue>(m_scheduler, std::move(callbacks), name));
     }
 
+    //! Unregister the subscriber, and wait for a callback of it that is
+    //! running, so that the caller may destroy it afterwards. The callbacks
+    //! may register and unregister subscribers, so m_mutex is not held.
     void Unregister(CValidationInterface* callbacks)
     {
-        LOCK(m_mutex);
-        auto it = m_map.find(callbacks);
-        if (it != m_map.end()) {
-            if (!--it->second->count) m_list.erase(it->second);
-            m_map.erase(it);
+        std::shared_ptr<SubscriberQueue> removed;
+        {
+            LOCK(m_mutex);
+            auto it = std::find_if(m_queues.begin(), m_queues.end(), [callbacks](const std::shared_ptr<SubscriberQueue>& queue) { return queue->m_callbacks.get() == callbacks; });
+            if (it == m_queues.end()) return;
+            removed = *it;
+            removed->m_registered = false;
+            m_queues.erase(it);
         }
+        removed->WaitIdle();
     }
 
-    //! Clear unregisters every previously registered callback, erasing every
-    //! map entry. After this call, the list may still contain callbacks that
-    //! are currently executing, but it will be cleared when they are done
-    //! executing.
+    //! Clear unregisters every previously registered callback, and waits for
+    //! those that are running, like Unregister.
     void Clear()
     {
-        LOCK(m_mutex);
-        for (const auto& entry : m_map) {
-            if (!--entry.second->count) m_list.erase(entry.second);
+        std::vector<std::shared_ptr<SubscriberQueue>> removed;
+        {
+            LOCK(m_mutex);
+            for (const auto& queue : m_queues) {
+                queue->m_registered = false;
+            }
+            removed.swap(m_queues);
+        }
+        for (const auto& queue : removed) {
+            queue->WaitIdle();
         }
-        m_map.clear();
     }
 
+    //! Call f for every registered subscriber on the calling thread
     template<typename F> void Iterate(F&& f)
     {
-        WAIT_LOCK(m_mutex, lock);
-        for (auto it = m_list.begin(); it != m_list.end();) {
-            ++it->count;
-            {
-                REVERSE_LOCK(lock);
-                f(*it->callbacks);
-            }
-            it = --it->count ? std::next(it) : m_list.erase(it);
+        for (const auto& queue : Queues()) {
+            if (queue->m_registered) f(*queue->m_callbacks);
+        }
+    }
+
+    //! Queue event for every registered subscriber
+    void Enqueue(std::function<void(CValidationInterface&)> event)
+    {
+        auto shared_event = std::make_shared<const std::function<void(CValidationInterface&)>>(std::move(event));
+        LOCK(m_mutex);
+        for (const auto& queue : m_queues) {
+            SubscriberQueue* const subscriber = queue.get();
+            subscriber->Add([subscriber, shared_event] {
+                if (subscriber->m_registered) (*shared_event)(*subscriber->m_callbacks);
+            });
+        }
+    }
+
+    void CallFunction(std::function<void()> func)
+    {
+        // Holding m_mutex orders the barrier after the events already queued
+        // for every subscriber. The last copy to go adds func to m_functions.
+        auto barrier = std::make_shared<QueueBarrier>(m_functions, std::move(func));
+        LOCK(m_mutex);
+        for (const auto& queue : m_queues) {
+            queue->Add([barrier] {});
         }
     }
+
+    void Sync(const CValidationInterface& callbacks)
+    {
+        const std::shared_ptr<SubscriberQueue> queue = Find(&callbacks);
+        if (!queue) return;
+        auto guard = std::make_shared<SyncGuard>();
+        std::future<void> done = guard->m_promise.get_future();
+        queue->Add([guard] {});
+        guard.reset();
+        done.wait();
+    }
+
+    void Limit(size_t max_pending)
+    {
+        for (const auto& queue : Queues()) {
+            queue->Wait(max_pending);
+        }
+    }
+
+    void Flush()
+    {
+        StopThreads();
+        for (const auto& queue : Queues()) {
+            queue->Empty();
+        }
+        m_functions->Empty();
+    }
+
+    size_t CallbacksPending()
+    {
+        size_t pending = m_functions->Pending();
+        for (const auto& queue : Queues()) {
+            pending += queue->Pending();
+        }
+        return pending;
+    }
+
+    std::vector<ValidationQueueInfo> GetQueueInfo()
+    {
+        std::vector<ValidationQueueInfo> info;
+        for (const auto& queue : Queues()) {
+            info.push_back(queue->GetInfo());
+        }
+        return info;
+    }
 };
 
 static CMainSignals g_signals;
 
-void CMainSignals::RegisterBackgroundSignalScheduler(CScheduler& scheduler) {
+void CMainSignals::RegisterBackgroundSignalScheduler(CScheduler& scheduler, int callback_threads) {
     assert(!m_internals);
-    m_internals.reset(new MainSignalsInstance(&scheduler));
+    m_internals.reset(new MainSignalsInstance(&scheduler, callback_threads));
 }
 
 void CMainSignals::UnregisterBackgroundSignalScheduler() {
@@ -100,13 +362,18 @@ void CMainSignals::UnregisterBackgroundSignalScheduler() {
 
 void CMainSignals::FlushBackgroundCallbacks() {
     if (m_internals) {
-        m_internals->m_schedulerClient.EmptyQueue();
+        m_internals->Flush();
     }
 }
 
 size_t CMainSignals::CallbacksPending() {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    return m_internals->CallbacksPending();
+}
+
+std::vector<ValidationQueueInfo> CMainSignals::GetQueueInfo() {
+    if (!m_internals) return {};
+    return m_internals->GetQueueInfo();
 }
 
 CMainSignals& GetMainSignals()
@@ -114,17 +381,17 @@ CMainSignals& GetMainSignals()
     return g_signals;
 }
 
-void RegisterSharedValidationInterface(std::shared_ptr<CValidationInterface> pwalletIn) {
+void RegisterSharedValidationInterface(std::shared_ptr<CValidationInterface> pwalletIn, const std::string& name) {
     // Each connection captures pwalletIn to ensure that each callback is
     // executed before pwalletIn is destroyed. For more details see #18338.
-    g_signals.m_internals->Register(std::move(pwalletIn));
+    g_signals.m_internals->Register(std::move(pwalletIn), name);
 }
 
-void RegisterValidationInterface(CValidationInterface* callbacks)
+void RegisterValidationInterface(CValidationInterface* callbacks, const std::string& name)
 {
     // Create a shared_ptr with a no-op deleter - CValidationInterface lifecycle
     // is managed by the caller.
-    RegisterSharedValidationInterface({callbacks, [](CValidationInterface*){}});
+    RegisterSharedValidationInterface({callbacks, [](CValidationInterface*){}}, name);
 }
 
 void UnregisterSharedValidationInterface(std::shared_ptr<CValidationInterface> callbacks)
@@ -146,31 +413,41 @@ void UnregisterAllValidationInterfaces() {
 }
 
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func) {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    g_signals.m_internals->CallFunction(std::move(func));
 }
 
 void SyncWithValidationInterfaceQueue() {
     AssertLockNotHeld(cs_main);
     // Block until the validation queue drains
-    std::promise<void> promise;
-    CallFunctionInValidationInterfaceQueue([&promise] {
-        promise.set_value();
-    });
-    promise.get_future().wait();
+    auto guard = std::make_shared<SyncGuard>();
+    std::future<void> done = guard->m_promise.get_future();
+    CallFunctionInValidationInterfaceQueue([guard] {});
+    guard.reset();
+    done.wait();
+}
+
+void SyncWithValidationInterfaceQueue(const CValidationInterface& subscriber) {
+    AssertLockNotHeld(cs_main);
+    g_signals.m_internals->Sync(subscriber);
+}
+
+void LimitValidationInterfaceQueue(size_t max_pending) {
+    AssertLockNotHeld(cs_main);
+    g_signals.m_internals->Limit(max_pending);
 }
 
 // Use a macro instead of a function for conditional logging to prevent
 // evaluating arguments when logging is not enabled.
 //
 // NOTE: The lambda captures all local variables by value.
-#define ENQUEUE_AND_LOG_EVENT(event, fmt, name, ...)           \
-    do {                                                       \
-        auto local_name = (name);                              \
-        LOG_EVENT("Enqueuing " fmt, local_name, __VA_ARGS__);  \
-        m_internals->m_schedulerClient.AddToProcessQueue([=] { \
-            LOG_EVENT(fmt, local_name, __VA_ARGS__);           \
-            event();                                           \
-        });                                                    \
+#define ENQUEUE_AND_LOG_EVENT(event, fmt, name, ...)                \
+    do {                                                            \
+        auto local_name = (name);                                   \
+        LOG_EVENT("Enqueuing " fmt, local_name, __VA_ARGS__);       \
+        m_internals->Enqueue([=](CValidationInterface& callbacks) { \
+            LOG_EVENT(fmt, local_name, __VA_ARGS__);                \
+            event(callbacks);                                       \
+        });                                                         \
     } while (0)
 
 #define LOG_EVENT(fmt, ...) \
@@ -181,8 +458,8 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
     // the chain actually updates. One way to ensure this is for the caller to invoke this signal
     // in the same critical section where the chain is updated
 
-    auto event = [pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload); });
+    auto event = [pindexNew, pindexFork, fInitialDownload](CValidationInterface& callbacks) {
+        callbacks.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: new block hash=%s fork block hash=%s (in IBD=%s)", __func__,
                           pindexNew->GetBlockHash().ToString(),
@@ -190,18 +467,18 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
                           fInitialDownload);
 }
 
-void CMainSignals::TransactionAddedToMempool(const CTransactionRef& tx) {
-    auto event = [tx, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.TransactionAddedToMempool(tx); });
+void CMainSignals::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) {
+    auto event = [tx, mempool_sequence](CValidationInterface& callbacks) {
+        callbacks.TransactionAddedToMempool(tx, mempool_sequence);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: txid=%s wtxid=%s", __func__,
                           tx->GetHash().ToString(),
                           tx->GetWitnessHash().ToString());
 }
 
-void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) {
-    auto event = [tx, reason, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.TransactionRemovedFromMempool(tx, reason); });
+void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) {
+    auto event = [tx, reason, mempool_sequence](CValidationInterface& callbacks) {
+        callbacks.TransactionRemovedFromMempool(tx, reason, mempool_sequence);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: txid=%s wtxid=%s", __func__,
                           tx->GetHash().ToString(),
@@ -209,8 +486,8 @@ void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef& tx, MemP
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex) {
-    auto event = [pblock, pindex, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.BlockConnected(pblock, pindex); });
+    auto event = [pblock, pindex](CValidationInterface& callbacks) {
+        callbacks.BlockConnected(pblock, pindex);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s block height=%d", __func__,
                           pblock->GetHash().ToString(),
@@ -219,8 +496,8 @@ void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, c
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
 {
-    auto event = [pblock, pindex, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.BlockDisconnected(pblock, pindex); });
+    auto event = [pblock, pindex](CValidationInterface& callbacks) {
+        callbacks.BlockDisconnected(pblock, pindex);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s block height=%d", __func__,
                           pblock->GetHash().ToString(),
@@ -228,8 +505,8 @@ void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock
 }
 
 void CMainSignals::ChainStateFlushed(const CBlockLocator &locator) {
-    auto event = [locator, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.ChainStateFlushed(locator); });
+    auto event = [locator](CValidationInterface& callbacks) {
+        callbacks.ChainStateFlushed(locator);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s", __func__,
                           locator.IsNull() ? "null" : locator.vHave.front().ToString());
@@ -9,8 +9,11 @@
 #include <primitives/transaction.h> // CTransaction(Ref)
 #include <sync.h>
 
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 extern RecursiveMutex cs_main;
 class BlockValidationState;
@@ -23,20 +26,31 @@ class uint256;
 class CScheduler;
 enum class MemPoolRemovalReason;
 
+/** Default for -callbackthreads */
+static const int DEFAULT_CALLBACK_THREADS = 4;
+/** Maximum number of validation callback threads */
+static const int MAX_CALLBACK_THREADS = 16;
+
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister a wallet from core */
+/**
+ * Register a wallet to receive updates from core. The name identifies its
+ * callback queue in getvalidationqueueinfo.
+ */
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& name = "");
+/**
+ * Unregister a wallet from core. Waits for a callback of it that is running
+ * on another thread, so that it may be destroyed afterwards.
+ */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister all wallets from core */
+/** Unregister all wallets from core, waiting for their running callbacks like UnregisterValidationInterface */
 void UnregisterAllValidationInterfaces();
 
 // Alternate registration functions that release a shared_ptr after the last
-// notification is sent. These are useful for race-free cleanup, since
-// unregistration is nonblocking and can return before the last notification is
-// processed.
-void RegisterSharedValidationInterface(std::shared_ptr<CValidationInterface> callbacks);
+// notification is sent. These are useful for race-free cleanup, since the
+// subscriber is also kept alive by the synchronous notifications that are
+// still being delivered to it when it is unregistered.
+void RegisterSharedValidationInterface(std::shared_ptr<CValidationInterface> callbacks, const std::string& name = "");
 void UnregisterSharedValidationInterface(std::shared_ptr<CValidationInterface> callbacks);
 
 /**
@@ -59,6 +73,18 @@ void CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
  *     promise.get_future().wait();
  */
 void SyncWithValidationInterfaceQueue() LOCKS_EXCLUDED(cs_main);
+/**
+ * Wait only for the callbacks generated prior to now for one subscriber,
+ * which the other subscribers, however far behind, do not hold up. Returns
+ * at once if the subscriber is not registered.
+ */
+void SyncWithValidationInterfaceQueue(const CValidationInterface& subscriber) LOCKS_EXCLUDED(cs_main);
+/**
+ * Wait until no subscriber has more than max_pending callbacks left to run,
+ * which bounds how far validation gets ahead of its slowest subscriber
+ * without draining the queues of the others.
+ */
+void LimitValidationInterfaceQueue(size_t max_pending) LOCKS_EXCLUDED(cs_main);
 
 /**
  * Implement this to subscribe to events generated in validation
@@ -73,7 +99,8 @@ void SyncWithValidationInterfaceQueue() LOCKS_EXCLUDED(cs_main);
  * UpdatedBlockTip() callback may depend on an operation performed in
  * the BlockConnected() callback without worrying about explicit
  * synchronization. No ordering should be assumed across
- * ValidationInterface() subscribers.
+ * ValidationInterface() subscribers: each has a queue of its own, and the
+ * queues of different subscribers run in parallel.
  */
 class CValidationInterface {
 protected:
@@ -94,10 +121,12 @@ protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {}
     /**
      * Notifies listeners of a transaction having been added to mempool.
+     * mempool_sequence is the value of the mempool sequence for the addition,
+     * see CTxMemPool::GetAndIncrementSequence.
      *
      * Called on a background thread.
      */
-    virtual void TransactionAddedToMempool(const CTransactionRef& tx) {}
+    virtual void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) {}
     /**
      * Notifies listeners of a transaction leaving mempool.
      *
@@ -128,9 +157,11 @@ protected:
      * - BlockConnected(A)
      * - BlockConnected(B)
      *
+     * mempool_sequence is the value of the mempool sequence for the removal.
+     *
      * Called on a background thread.
      */
-    virtual void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) {}
+    virtual void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) {}
     /**
      * Notifies listeners of a block being connected.
      * Provides a vector of transactions evicted from the mempool as a result.
@@ -175,30 +206,52 @@ protected:
     friend class CMainSignals;
 };
 
+/** The state of the callback queue of one subscriber */
+struct ValidationQueueInfo {
+    std::string name;
+    //! Callbacks waiting to run
+    size_t pending;
+    //! The most callbacks that were waiting at once
+    size_t peak_pending;
+    //! Callbacks run so far
+    uint64_t callbacks_run;
+    //! Time spent running them
+    std::chrono::microseconds run_time;
+};
+
 struct MainSignalsInstance;
 class CMainSignals {
 private:
     std::unique_ptr<MainSignalsInstance> m_internals;
 
-    friend void ::RegisterSharedValidationInterface(std::shared_ptr<CValidationInterface>);
+    friend void ::RegisterSharedValidationInterface(std::shared_ptr<CValidationInterface>, const std::string&);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
     friend void ::CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+    friend void ::SyncWithValidationInterfaceQueue(const CValidationInterface&);
+    friend void ::LimitValidationInterfaceQueue(size_t);
 
 public:
-    /** Register a CScheduler to give callbacks which should run in the background (may only be called once) */
-    void RegisterBackgroundSignalScheduler(CScheduler& scheduler);
+    /**
+     * Register a CScheduler to give callbacks which should run in the background (may only be called once).
+     * With callback_threads > 0 the callbacks run on that many threads of their own instead of the
+     * CScheduler's, so that a slow subscriber does not hold up the scheduler's other tasks.
+     */
+    void RegisterBackgroundSignalScheduler(CScheduler& scheduler, int callback_threads = 0);
     /** Unregister a CScheduler to give callbacks which should run in the background - these callbacks will now be dropped! */
     void UnregisterBackgroundSignalScheduler();
-    /** Call any remaining callbacks on the calling thread */
+    /** Stop the callback threads, if any, and call any remaining callbacks on the calling thread */
     void FlushBackgroundCallbacks();
 
+    /** The number of callbacks waiting to run, over all subscribers */
     size_t CallbacksPending();
+    /** The queues of the registered subscribers, in the order they registered */
+    std::vector<ValidationQueueInfo> GetQueueInfo();
 
 
     void UpdatedBlockTip(const CBlockIndex *, const CBlockIndex *, bool fInitialDownload);
-    void TransactionAddedToMempool(const CTransactionRef&);
-    void TransactionRemovedFromMempool(const CTransactionRef&, MemPoolRemovalReason);
+    void TransactionAddedToMempool(const CTransactionRef&, uint64_t mempool_sequence);
+    void TransactionRemovedFromMempool(const CTransactionRef&, MemPoolRemovalReason, uint64_t mempool_sequence);
     void BlockConnected(const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex);
     void BlockDisconnected(const std::shared_ptr<const CBlock> &, const CBlockIndex* pindex);
     void ChainStateFlushed(const CBlockLocator &);
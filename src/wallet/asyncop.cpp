@@ -0,0 +1,183 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/asyncop.h>
+
+#include <random.h>
+#include <rpc/protocol.h>
+#include <rpc/request.h>
+#include <uint256.h>
+#include <util/system.h>
+#include <util/time.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <functional>
+
+std::unique_ptr<AsyncOperationQueue> g_async_queue;
+
+std::string AsyncOpStateString(AsyncOpState state)
+{
+    switch (state) {
+    case AsyncOpState::QUEUED: return "queued";
+    case AsyncOpState::EXECUTING: return "executing";
+    case AsyncOpState::CANCELLED: return "cancelled";
+    case AsyncOpState::FAILED: return "failed";
+    case AsyncOpState::SUCCESS: return "success";
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+AsyncOperation::AsyncOperation(std::string method, std::string wallet_name) :
+    m_id("opid-" + GetRandHash().GetHex().substr(0, 32)),
+    m_method(std::move(method)),
+    m_wallet_name(std::move(wallet_name)),
+    m_creation_time(GetTime())
+{
+}
+
+AsyncOpState AsyncOperation::GetState() const
+{
+    LOCK(m_mutex);
+    return m_state;
+}
+
+bool AsyncOperation::IsFinished() const
+{
+    const AsyncOpState state = GetState();
+    return state != AsyncOpState::QUEUED && state != AsyncOpState::EXECUTING;
+}
+
+bool AsyncOperation::Cancel()
+{
+    LOCK(m_mutex);
+    if (m_state != AsyncOpState::QUEUED) return false;
+    m_state = AsyncOpState::CANCELLED;
+    return true;
+}
+
+void AsyncOperation::Execute()
+{
+    {
+        LOCK(m_mutex);
+        if (m_state != AsyncOpState::QUEUED) return;
+        m_state = AsyncOpState::EXECUTING;
+        m_start_micros = GetTimeMicros();
+    }
+
+    UniValue result;
+    UniValue error;
+    try {
+        result = Run();
+    } catch (const UniValue& obj_error) {
+        error = obj_error;
+    } catch (const std::exception& e) {
+        error = JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+
+    LOCK(m_mutex);
+    m_end_micros = GetTimeMicros();
+    if (error.isNull()) {
+        m_state = AsyncOpState::SUCCESS;
+        m_result = std::move(result);
+    } else {
+        m_state = AsyncOpState::FAILED;
+        m_error = std::move(error);
+    }
+}
+
+UniValue AsyncOperation::GetStatus() const
+{
+    UniValue status(UniValue::VOBJ);
+    status.pushKV("id", m_id);
+    status.pushKV("method", m_method);
+    status.pushKV("creation_time", m_creation_time);
+
+    LOCK(m_mutex);
+    status.pushKV("status", AsyncOpStateString(m_state));
+    if (m_state == AsyncOpState::SUCCESS) {
+        status.pushKV("result", m_result);
+    } else if (m_state == AsyncOpState::FAILED) {
+        status.pushKV("error", m_error);
+    }
+    if (m_end_micros != 0) {
+        status.pushKV("execution_secs", (m_end_micros - m_start_micros) / 1e6);
+    }
+    return status;
+}
+
+AsyncOperationQueue::AsyncOperationQueue(int threads)
+{
+    for (int i = 0; i < threads; ++i) {
+        m_threads.emplace_back(&TraceThread<std::function<void()>>, "asyncop", std::bind(&AsyncOperationQueue::ThreadWork, this));
+    }
+}
+
+AsyncOperationQueue::~AsyncOperationQueue()
+{
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+        for (const std::shared_ptr<AsyncOperation>& op : m_queue) {
+            op->Cancel();
+        }
+        m_queue.clear();
+    }
+    m_cond.notify_all();
+    for (std::thread& thread : m_threads) thread.join();
+}
+
+void AsyncOperationQueue::Add(std::shared_ptr<AsyncOperation> op)
+{
+    {
+        LOCK(m_mutex);
+        m_operations.push_back(op);
+        m_queue.push_back(std::move(op));
+    }
+    m_cond.notify_one();
+}
+
+std::shared_ptr<AsyncOperation> AsyncOperationQueue::Get(const std::string& id) const
+{
+    LOCK(m_mutex);
+    for (const std::shared_ptr<AsyncOperation>& op : m_operations) {
+        if (op->GetId() == id) return op;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<AsyncOperation> AsyncOperationQueue::PopFinished(const std::string& id)
+{
+    LOCK(m_mutex);
+    auto it = std::find_if(m_operations.begin(), m_operations.end(), [&id](const std::shared_ptr<AsyncOperation>& op) { return op->GetId() == id; });
+    if (it == m_operations.end() || !(*it)->IsFinished()) return nullptr;
+    std::shared_ptr<AsyncOperation> op = std::move(*it);
+    m_operations.erase(it);
+    return op;
+}
+
+std::vector<std::shared_ptr<AsyncOperation>> AsyncOperationQueue::List(const std::string& wallet_name) const
+{
+    std::vector<std::shared_ptr<AsyncOperation>> ops;
+    LOCK(m_mutex);
+    for (const std::shared_ptr<AsyncOperation>& op : m_operations) {
+        if (op->GetWalletName() == wallet_name) ops.push_back(op);
+    }
+    return ops;
+}
+
+void AsyncOperationQueue::ThreadWork()
+{
+    while (true) {
+        std::shared_ptr<AsyncOperation> op;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || !m_queue.empty(); });
+            if (m_stop) return;
+            op = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        op->Execute();
+    }
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_WALLET_ASYNCOP_H
+#define LITECOINZ_WALLET_ASYNCOP_H
+
+#include <sync.h>
+#include <univalue.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Default for -walletasyncthreads */
+static const int DEFAULT_WALLET_ASYNC_THREADS = 1;
+static const int MAX_WALLET_ASYNC_THREADS = 16;
+
+enum class AsyncOpState {
+    QUEUED,
+    EXECUTING,
+    CANCELLED,
+    FAILED,
+    SUCCESS,
+};
+
+std::string AsyncOpStateString(AsyncOpState state);
+
+/**
+ * A wallet RPC call that takes too long to answer in the RPC thread, such as
+ * one creating zero-knowledge proofs. The call returns the id of the
+ * operation, which runs on a worker thread of an AsyncOperationQueue, and
+ * its result is polled for with the id.
+ */
+class AsyncOperation
+{
+public:
+    AsyncOperation(std::string method, std::string wallet_name);
+    virtual ~AsyncOperation() = default;
+
+    const std::string& GetId() const { return m_id; }
+    const std::string& GetWalletName() const { return m_wallet_name; }
+    AsyncOpState GetState() const;
+    bool IsFinished() const;
+
+    /** Cancel the operation if it has not started. */
+    bool Cancel();
+
+    /** Run the operation unless it was cancelled, recording its result or error. */
+    void Execute();
+
+    /** The id, state, method and timings, with the result or error once finished */
+    UniValue GetStatus() const;
+
+protected:
+    /** The work of the operation, which throws a JSONRPCError or an exception on failure */
+    virtual UniValue Run() = 0;
+
+private:
+    const std::string m_id;
+    const std::string m_method;
+    const std::string m_wallet_name;
+    const int64_t m_creation_time;
+
+    mutable Mutex m_mutex;
+    AsyncOpState m_state GUARDED_BY(m_mutex){AsyncOpState::QUEUED};
+    UniValue m_result GUARDED_BY(m_mutex);
+    UniValue m_error GUARDED_BY(m_mutex);
+    int64_t m_start_micros GUARDED_BY(m_mutex){0};
+    int64_t m_end_micros GUARDED_BY(m_mutex){0};
+};
+
+/** Runs AsyncOperations in the order they are added, on a pool of worker threads. */
+class AsyncOperationQueue
+{
+public:
+    explicit AsyncOperationQueue(int threads);
+    /** Cancels the queued operations and waits for the running ones. */
+    ~AsyncOperationQueue();
+
+    void Add(std::shared_ptr<AsyncOperation> op);
+    std::shared_ptr<AsyncOperation> Get(const std::string& id) const;
+    /** Forget an operation, returning it if it was finished; unfinished ones are kept. */
+    std::shared_ptr<AsyncOperation> PopFinished(const std::string& id);
+    /** The operations of a wallet, in the order they were added */
+    std::vector<std::shared_ptr<AsyncOperation>> List(const std::string& wallet_name) const;
+
+private:
+    mutable Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::shared_ptr<AsyncOperation>> m_queue GUARDED_BY(m_mutex);
+    //! All operations not popped yet, running or not
+    std::vector<std::shared_ptr<AsyncOperation>> m_operations GUARDED_BY(m_mutex);
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::vector<std::thread> m_threads;
+
+    void ThreadWork();
+};
+
+/** The queue of wallet operations, set from StartWallets until StopWallets */
+extern std::unique_ptr<AsyncOperationQueue> g_async_queue;
+
+#endif // LITECOINZ_WALLET_ASYNCOP_H
@@ -7,6 +7,7 @@
 #include <optional.h>
 #include <util/system.h>
 #include <util/moneystr.h>
+#include <util/time.h>
 
 // Descending order comparator
 struct {
@@ -16,6 +17,21 @@ struct {
     }
 } descending;
 
+/** The time after which the search of a pool of this many groups gives up, or 0 for none */
+static int64_t SearchDeadline(size_t pool_size)
+{
+    if (pool_size <= LARGE_UTXO_POOL) return 0;
+    return GetTimeMicros() + LARGE_UTXO_POOL_SEARCH_MICROS;
+}
+
+void SortOutputGroups(std::vector<OutputGroup>& groups)
+{
+    Shuffle(groups.begin(), groups.end(), FastRandomContext());
+    std::stable_sort(groups.begin(), groups.end(), [](const OutputGroup& a, const OutputGroup& b) {
+        return a.m_value > b.m_value;
+    });
+}
+
 /*
  * This is the Branch and Bound Coin Selection algorithm designed by Murch. It searches for an input
  * set that can pay for the spending target and does not exceed the spending target by more than the
@@ -26,7 +42,8 @@ struct {
  * While the selection has not reached the target range, more UTXOs are included. When a selection's
  * value exceeds the target range, the complete subtree deriving from this selection can be omitted.
  * At that point, the last included UTXO is deselected and the corresponding omission branch explored
- * instead. The search ends after the complete tree has been searched or after a limited number of tries.
+ * instead. The search ends after the complete tree has been searched or after a limited number of tries,
+ * or for pools of more than LARGE_UTXO_POOL groups, after a limited time.
  *
  * The search continues to search for better solutions after one solution has been found. The best
  * solution is chosen by minimizing the waste metric. The waste metric is defined as the cost to
@@ -45,8 +62,8 @@ struct {
  * https://murch.one/wp-content/uploads/2016/11/erhardt2016coinselection.pdf
  *
  * @param const std::vector<CInputCoin>& utxo_pool The set of UTXOs that we are choosing from.
- *        These UTXOs will be sorted in descending order by effective value and the CInputCoins'
- *        values are their effective values.
+ *        These UTXOs will be sorted in descending order by effective value, unless they already are,
+ *        and the CInputCoins' values are their effective values.
  * @param const CAmount& target_value This is the value that we want to select. It is the lower
  *        bound of the range.
  * @param const CAmount& cost_of_change This is the cost of creating and spending a change output.
@@ -81,8 +98,11 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
         return false;
     }
 
-    // Sort the utxo_pool
-    std::sort(utxo_pool.begin(), utxo_pool.end(), descending);
+    // Sort the utxo_pool, which pools sorted once for several selections already are
+    if (!std::is_sorted(utxo_pool.begin(), utxo_pool.end(), descending)) {
+        std::sort(utxo_pool.begin(), utxo_pool.end(), descending);
+    }
+    const int64_t deadline = SearchDeadline(utxo_pool.size());
 
     CAmount curr_waste = 0;
     std::vector<bool> best_selection;
@@ -90,6 +110,8 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
 
     // Depth First search loop for choosing the UTXOs
     for (size_t i = 0; i < TOTAL_TRIES; ++i) {
+        if (deadline != 0 && i % 1000 == 0 && GetTimeMicros() > deadline) break;
+
         // Conditions for starting a backtrack
         bool backtrack = false;
         if (curr_value + curr_available_value < actual_target ||                // Cannot possibly reach target with the amount remaining in the curr_available_value.
@@ -167,7 +189,7 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
 }
 
 static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const CAmount& nTotalLower, const CAmount& nTargetValue,
-                                  std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
+                                  std::vector<char>& vfBest, CAmount& nBest, int64_t deadline, int iterations = 1000)
 {
     std::vector<char> vfIncluded;
 
@@ -178,6 +200,7 @@ static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const
 
     for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
     {
+        if (deadline != 0 && GetTimeMicros() > deadline) break;
         vfIncluded.assign(groups.size(), false);
         CAmount nTotal = 0;
         bool fReachedTarget = false;
@@ -212,29 +235,35 @@ static void ApproximateBestSubset(const std::vector<OutputGroup>& groups, const
     }
 }
 
-bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet)
+bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, bool presorted)
 {
     setCoinsRet.clear();
     nValueRet = 0;
 
-    // List of values less than target
-    Optional<OutputGroup> lowest_larger;
-    std::vector<OutputGroup> applicable_groups;
-    CAmount nTotalLower = 0;
+    if (!presorted) SortOutputGroups(groups);
 
-    Shuffle(groups.begin(), groups.end(), FastRandomContext());
+    // The groups worth less than the target plus MIN_CHANGE come last, and
+    // the smallest of the others just before them
+    auto first_lower = std::partition_point(groups.begin(), groups.end(), [&](const OutputGroup& group) {
+        return group.m_value >= nTargetValue + MIN_CHANGE;
+    });
+    Optional<OutputGroup> lowest_larger;
+    if (first_lower != groups.begin()) lowest_larger = *std::prev(first_lower);
+    auto exact = std::partition_point(first_lower, groups.end(), [&](const OutputGroup& group) {
+        return group.m_value > nTargetValue;
+    });
+    if (exact != groups.end() && exact->m_value == nTargetValue) {
+        util::insert(setCoinsRet, exact->m_outputs);
+        nValueRet += exact->m_value;
+        return true;
+    }
 
-    for (const OutputGroup& group : groups) {
-        if (group.m_value == nTargetValue) {
-            util::insert(setCoinsRet, group.m_outputs);
-            nValueRet += group.m_value;
-            return true;
-        } else if (group.m_value < nTargetValue + MIN_CHANGE) {
-            applicable_groups.push_back(group);
-            nTotalLower += group.m_value;
-        } else if (!lowest_larger || group.m_value < lowest_larger->m_value) {
-            lowest_larger = group;
-        }
+    // List of values less than target, still in descending order
+    groups.erase(groups.begin(), first_lower);
+    const std::vector<OutputGroup>& applicable_groups = groups;
+    CAmount nTotalLower = 0;
+    for (const OutputGroup& group : applicable_groups) {
+        nTotalLower += group.m_value;
     }
 
     if (nTotalLower == nTargetValue) {
@@ -253,13 +282,13 @@ bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& group
     }
 
     // Solve subset sum by stochastic approximation
-    std::sort(applicable_groups.begin(), applicable_groups.end(), descending);
     std::vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestSubset(applicable_groups, nTotalLower, nTargetValue, vfBest, nBest);
+    const int64_t deadline = SearchDeadline(applicable_groups.size());
+    ApproximateBestSubset(applicable_groups, nTotalLower, nTargetValue, vfBest, nBest, deadline);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE) {
-        ApproximateBestSubset(applicable_groups, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
+        ApproximateBestSubset(applicable_groups, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest, deadline);
     }
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
@@ -13,6 +13,10 @@
 static constexpr CAmount MIN_CHANGE{COIN / 100};
 //! final minimum change amount after paying for fees
 static const CAmount MIN_FINAL_CHANGE = MIN_CHANGE/2;
+//! pools of more groups than this are searched for a limited time
+static const size_t LARGE_UTXO_POOL = 100000;
+//! how long the search of a large pool may take, in microseconds
+static const int64_t LARGE_UTXO_POOL_SEARCH_MICROS = 250 * 1000;
 
 class CInputCoin {
 public:
@@ -93,9 +97,16 @@ struct OutputGroup
     bool EligibleForSpending(const CoinEligibilityFilter& eligibility_filter) const;
 };
 
+/**
+ * Sort groups by descending value, equal groups in random order. A pool
+ * sorted once can be filtered and selected from several times, passing
+ * presorted to KnapsackSolver.
+ */
+void SortOutputGroups(std::vector<OutputGroup>& groups);
+
 bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_value, const CAmount& cost_of_change, std::set<CInputCoin>& out_set, CAmount& value_ret, CAmount not_input_fees);
 
 // Original coin selection algorithm as a fallback
-bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet);
+bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, bool presorted = false);
 
 #endif // BITCOIN_WALLET_COINSELECTION_H
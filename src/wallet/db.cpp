@@ -8,7 +8,10 @@
 #include <util/strencodings.h>
 #include <util/translation.h>
 
+#include <atomic>
 #include <stdint.h>
+#include <system_error>
+#include <thread>
 
 #ifndef WIN32
 #include <sys/stat.h>
@@ -16,6 +19,9 @@
 
 #include <boost/thread.hpp>
 
+//! Threads running the record filter of BerkeleyBatch::Recover, at most
+static const int MAX_RECOVER_THREADS = 4;
+
 namespace {
 
 //! Make sure database has a unique fileid within the environment. If it
@@ -371,16 +377,39 @@ bool BerkeleyBatch::Recover(const fs::path& file_path, void *callbackDataIn, boo
         return false;
     }
 
+    // Run the filter over all records first, on several threads, so that
+    // decoding them is not serialised behind the writes.
+    std::vector<char> keep(salvagedData.size(), 1);
+    if (recoverKVcallback) {
+        std::atomic<size_t> next{0};
+        auto filter = [&] {
+            for (size_t i = next++; i < salvagedData.size(); i = next++) {
+                CDataStream ssKey(salvagedData[i].first, SER_DISK, CLIENT_VERSION);
+                CDataStream ssValue(salvagedData[i].second, SER_DISK, CLIENT_VERSION);
+                keep[i] = (*recoverKVcallback)(callbackDataIn, ssKey, ssValue);
+            }
+        };
+        std::vector<std::thread> workers;
+        const int threads = std::max(1, std::min(GetNumCores(), MAX_RECOVER_THREADS));
+        for (int i = 1; i < threads; ++i) {
+            try {
+                workers.emplace_back(filter);
+            } catch (const std::system_error&) {
+                // The threads already started and this one do the work
+                break;
+            }
+        }
+        filter();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
     DbTxn* ptxn = env->TxnBegin();
-    for (BerkeleyEnvironment::KeyValPair& row : salvagedData)
+    for (size_t i = 0; i < salvagedData.size(); ++i)
     {
-        if (recoverKVcallback)
-        {
-            CDataStream ssKey(row.first, SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(row.second, SER_DISK, CLIENT_VERSION);
-            if (!(*recoverKVcallback)(callbackDataIn, ssKey, ssValue))
-                continue;
-        }
+        if (!keep[i]) continue;
+        BerkeleyEnvironment::KeyValPair& row = salvagedData[i];
         Dbt datKey(&row.first[0], row.first.size());
         Dbt datValue(&row.second[0], row.second.size());
         int ret2 = pdbCopy->put(ptxn, &datKey, &datValue, DB_NOOVERWRITE);
@@ -603,7 +632,14 @@ void BerkeleyBatch::Flush()
         nMinutes = 1;
 
     if (env) { // env is nullptr for dummy databases (i.e. in tests). Don't actually flush if env is nullptr so we don't segfault
-        env->dbenv->txn_checkpoint(nMinutes ? gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024 : 0, nMinutes, 0);
+        if (!fReadOnly) {
+            // The committed writes are durable once in the log, which recovery
+            // replays on open. Their pages go to the database file with the
+            // checkpoint once -dblogsize of log piled up, or in PeriodicFlush,
+            // rather than every page touched being written after each batch.
+            env->dbenv->log_flush(nullptr);
+        }
+        env->dbenv->txn_checkpoint(gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024, nMinutes, 0);
     }
 }
 
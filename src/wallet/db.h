@@ -236,6 +236,7 @@ public:
 
     void Flush();
     void Close();
+    /** Salvage file_path into a new file, keeping the records recoverKVcallback accepts. The callback may run on several threads at once. */
     static bool Recover(const fs::path& file_path, void *callbackDataIn, bool (*recoverKVcallback)(void* callbackData, CDataStream ssKey, CDataStream ssValue), std::string& out_backup_filename);
 
     /* flush the wallet passively (TRY_LOCK)
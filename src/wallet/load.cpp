@@ -10,8 +10,11 @@
 #include <util/string.h>
 #include <util/system.h>
 #include <util/translation.h>
+#include <wallet/asyncop.h>
 #include <wallet/wallet.h>
 
+#include <algorithm>
+
 bool VerifyWallets(interfaces::Chain& chain, const std::vector<std::string>& wallet_files)
 {
     if (gArgs.IsArgSet("-walletdir")) {
@@ -91,6 +94,9 @@ void StartWallets(CScheduler& scheduler)
         pwallet->postInitProcess();
     }
 
+    const int async_threads = std::max(1, std::min<int>(gArgs.GetArg("-walletasyncthreads", DEFAULT_WALLET_ASYNC_THREADS), MAX_WALLET_ASYNC_THREADS));
+    g_async_queue = MakeUnique<AsyncOperationQueue>(async_threads);
+
     // Schedule periodic wallet flushes and tx rebroadcasts
     scheduler.scheduleEvery(MaybeCompactWalletDB, std::chrono::milliseconds{500});
     scheduler.scheduleEvery(MaybeResendWalletTxs, std::chrono::milliseconds{1000});
@@ -105,6 +111,8 @@ void FlushWallets()
 
 void StopWallets()
 {
+    // Operations still queued are cancelled, running ones are waited for
+    g_async_queue.reset();
     for (const std::shared_ptr<CWallet>& pwallet : GetWallets()) {
         pwallet->Flush(true);
     }
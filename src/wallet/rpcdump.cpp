@@ -1116,10 +1116,21 @@ static UniValue ProcessImportDescriptor(ImportData& import_data, std::map<CKeyID
     const UniValue& priv_keys = data.exists("keys") ? data["keys"].get_array() : UniValue();
 
     // Expand all descriptors to get public keys and scripts, and private keys if available.
+    std::vector<std::vector<CScript>> range_scripts;
+    std::vector<FlatSigningProvider> range_keys;
+    if (!ExpandRange(*parsed_desc, range_start, range_end, keys, range_scripts, range_keys)) {
+        // Expand() gives nothing at positions it fails at, as before.
+        range_scripts.resize(range_end - range_start + 1);
+        range_keys.resize(range_end - range_start + 1);
+        for (int i = range_start; i <= range_end; ++i) {
+            range_scripts[i - range_start].clear();
+            range_keys[i - range_start] = FlatSigningProvider();
+            parsed_desc->Expand(i, keys, range_scripts[i - range_start], range_keys[i - range_start]);
+        }
+    }
     for (int i = range_start; i <= range_end; ++i) {
-        FlatSigningProvider out_keys;
-        std::vector<CScript> scripts_temp;
-        parsed_desc->Expand(i, keys, scripts_temp, out_keys);
+        FlatSigningProvider& out_keys = range_keys[i - range_start];
+        const std::vector<CScript>& scripts_temp = range_scripts[i - range_start];
         std::copy(scripts_temp.begin(), scripts_temp.end(), std::inserter(script_pub_keys, script_pub_keys.end()));
         for (const auto& key_pair : out_keys.pubkeys) {
             ordered_pubkeys.push_back(key_pair.first);
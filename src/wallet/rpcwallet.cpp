@@ -25,6 +25,7 @@
 #include <util/system.h>
 #include <util/url.h>
 #include <util/vector.h>
+#include <wallet/asyncop.h>
 #include <wallet/coincontrol.h>
 #include <wallet/feebumper.h>
 #include <wallet/rpcwallet.h>
@@ -234,6 +235,37 @@ static UniValue getnewaddress(const JSONRPCRequest& request)
     return EncodeDestination(dest);
 }
 
+static UniValue z_getnewaddress(const JSONRPCRequest& request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CWallet* const pwallet = wallet.get();
+
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+            RPCHelpMan{"z_getnewaddress",
+                "\nReturns a new Sapling address for receiving payments.\n"
+                "The key of the address is derived from the HD seed, and notes to it are found from the current block on.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::STR, "address", "The new Sapling address"
+                },
+                RPCExamples{
+                    HelpExampleCli("z_getnewaddress", "")
+            + HelpExampleRpc("z_getnewaddress", "")
+                },
+            }.Check(request);
+
+    std::string error;
+    const Optional<libzcash::SaplingPaymentAddress> address = pwallet->GenerateNewSaplingAddress(error);
+    if (!address) {
+        throw JSONRPCError(RPC_WALLET_ERROR, error);
+    }
+
+    return EncodePaymentAddress(*address);
+}
+
 static UniValue getrawchangeaddress(const JSONRPCRequest& request)
 {
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
@@ -767,6 +799,189 @@ static UniValue getbalance(const JSONRPCRequest& request)
     return ValueFromAmount(bal.m_mine_trusted + (include_watchonly ? bal.m_watchonly_trusted : 0));
 }
 
+static UniValue z_getbalance(const JSONRPCRequest& request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    const CWallet* const pwallet = wallet.get();
+
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+            RPCHelpMan{"z_getbalance",
+                "\nReturns the value of the unspent Sapling notes of the wallet, or of one of its Sapling addresses.\n",
+                {
+                    {"address", RPCArg::Type::STR, /* default */ "\"*\"", "The Sapling address, or \"*\" for all of them."},
+                    {"minconf", RPCArg::Type::NUM, /* default */ "1", "Only include notes confirmed at least this many times."},
+                },
+                RPCResult{
+                    RPCResult::Type::STR_AMOUNT, "amount", "The total amount in " + CURRENCY_UNIT + " received by the Sapling addresses."
+                },
+                RPCExamples{
+            "\nThe Sapling balance of the wallet with 1 or more confirmations\n"
+            + HelpExampleCli("z_getbalance", "") +
+            "\nThe balance of one address at least 6 blocks confirmed\n"
+            + HelpExampleCli("z_getbalance", "\"zs1...\" 6") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("z_getbalance", "\"zs1...\", 6")
+                },
+            }.Check(request);
+
+    pwallet->BlockUntilSyncedToCurrentChain();
+
+    LOCK(pwallet->cs_wallet);
+
+    Optional<libzcash::SaplingPaymentAddress> address;
+    if (!request.params[0].isNull() && request.params[0].get_str() != "*") {
+        address = DecodeSaplingPaymentAddress(request.params[0].get_str());
+        if (!address) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Sapling address");
+        }
+        if (!pwallet->m_sapling.HaveAddress(*address)) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "Sapling address does not belong to this wallet");
+        }
+    }
+
+    int min_depth = 1;
+    if (!request.params[1].isNull()) {
+        min_depth = request.params[1].get_int();
+    }
+
+    return ValueFromAmount(pwallet->m_sapling.GetBalance(min_depth, address));
+}
+
+/** The operations of the wallet, or those of them with one of the ids given */
+static std::vector<std::shared_ptr<AsyncOperation>> ListOperations(const CWallet& wallet, const UniValue& ids)
+{
+    if (!g_async_queue) return {};
+    std::vector<std::shared_ptr<AsyncOperation>> ops = g_async_queue->List(wallet.GetName());
+    if (ids.isNull()) return ops;
+
+    std::set<std::string> wanted;
+    for (const UniValue& id : ids.get_array().getValues()) {
+        wanted.insert(id.get_str());
+    }
+    ops.erase(std::remove_if(ops.begin(), ops.end(), [&wanted](const std::shared_ptr<AsyncOperation>& op) { return !wanted.count(op->GetId()); }), ops.end());
+    return ops;
+}
+
+static const RPCResult ASYNC_OPERATION_STATUS{
+    RPCResult::Type::ARR, "", "",
+    {
+        {RPCResult::Type::OBJ, "", "",
+        {
+            {RPCResult::Type::STR, "id", "The operation id"},
+            {RPCResult::Type::STR, "method", "The RPC method that started the operation"},
+            {RPCResult::Type::NUM_TIME, "creation_time", "The " + UNIX_EPOCH_TIME + " the operation was started at"},
+            {RPCResult::Type::STR, "status", "One of \"queued\", \"executing\", \"cancelled\", \"failed\" and \"success\""},
+            {RPCResult::Type::ELISION, "", "On success, the result of the method; on failure, its error"},
+            {RPCResult::Type::NUM, "execution_secs", /* optional */ true, "How long the operation ran, once finished"},
+        }},
+    }
+};
+
+static UniValue z_getoperationstatus(const JSONRPCRequest& request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    const CWallet* const pwallet = wallet.get();
+
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+            RPCHelpMan{"z_getoperationstatus",
+                "\nReturns the status of the lengthy operations of the wallet, which keep running after the call that started them returned.\n",
+                {
+                    {"operationids", RPCArg::Type::ARR, RPCArg::Optional::OMITTED_NAMED_ARG, "The operations to return, all of them if not given.",
+                        {
+                            {"operationid", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "An operation id"},
+                        },
+                    },
+                },
+                ASYNC_OPERATION_STATUS,
+                RPCExamples{
+                    HelpExampleCli("z_getoperationstatus", "")
+            + HelpExampleCli("z_getoperationstatus", "'[\"operationid\", ...]'")
+            + HelpExampleRpc("z_getoperationstatus", "")
+                },
+            }.Check(request);
+
+    UniValue result(UniValue::VARR);
+    for (const std::shared_ptr<AsyncOperation>& op : ListOperations(*pwallet, request.params[0])) {
+        result.push_back(op->GetStatus());
+    }
+    return result;
+}
+
+static UniValue z_getoperationresult(const JSONRPCRequest& request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    const CWallet* const pwallet = wallet.get();
+
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+            RPCHelpMan{"z_getoperationresult",
+                "\nReturns the status of the finished operations of the wallet, and forgets them.\n"
+                "Operations still queued or running are left out, and kept.\n",
+                {
+                    {"operationids", RPCArg::Type::ARR, RPCArg::Optional::OMITTED_NAMED_ARG, "The operations to return, all of them if not given.",
+                        {
+                            {"operationid", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "An operation id"},
+                        },
+                    },
+                },
+                ASYNC_OPERATION_STATUS,
+                RPCExamples{
+                    HelpExampleCli("z_getoperationresult", "")
+            + HelpExampleCli("z_getoperationresult", "'[\"operationid\", ...]'")
+            + HelpExampleRpc("z_getoperationresult", "")
+                },
+            }.Check(request);
+
+    UniValue result(UniValue::VARR);
+    for (const std::shared_ptr<AsyncOperation>& op : ListOperations(*pwallet, request.params[0])) {
+        if (g_async_queue->PopFinished(op->GetId())) result.push_back(op->GetStatus());
+    }
+    return result;
+}
+
+static UniValue z_listoperationids(const JSONRPCRequest& request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    const CWallet* const pwallet = wallet.get();
+
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+            RPCHelpMan{"z_listoperationids",
+                "\nReturns the ids of the operations of the wallet.\n",
+                {
+                    {"status", RPCArg::Type::STR, RPCArg::Optional::OMITTED_NAMED_ARG, "Only return the operations with this status."},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "",
+                    {
+                        {RPCResult::Type::STR, "operationid", "An operation id"},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("z_listoperationids", "")
+            + HelpExampleCli("z_listoperationids", "\"success\"")
+            + HelpExampleRpc("z_listoperationids", "")
+                },
+            }.Check(request);
+
+    UniValue result(UniValue::VARR);
+    for (const std::shared_ptr<AsyncOperation>& op : ListOperations(*pwallet, NullUniValue)) {
+        if (!request.params[0].isNull() && AsyncOpStateString(op->GetState()) != request.params[0].get_str()) continue;
+        result.push_back(op->GetId());
+    }
+    return result;
+}
+
 static UniValue getunconfirmedbalance(const JSONRPCRequest &request)
 {
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
@@ -4324,6 +4539,11 @@ static const CRPCCommand commands[] =
     { "wallet",             "walletpassphrase",                 &walletpassphrase,              {"passphrase","timeout"} },
     { "wallet",             "walletpassphrasechange",           &walletpassphrasechange,        {"oldpassphrase","newpassphrase"} },
     { "wallet",             "walletprocesspsbt",                &walletprocesspsbt,             {"psbt","sign","sighashtype","bip32derivs"} },
+    { "wallet",             "z_getbalance",                     &z_getbalance,                  {"address","minconf"} },
+    { "wallet",             "z_getnewaddress",                  &z_getnewaddress,               {} },
+    { "wallet",             "z_getoperationresult",             &z_getoperationresult,          {"operationids"} },
+    { "wallet",             "z_getoperationstatus",             &z_getoperationstatus,          {"operationids"} },
+    { "wallet",             "z_listoperationids",               &z_listoperationids,            {"status"} },
 };
 // clang-format on
 
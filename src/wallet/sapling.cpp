@@ -0,0 +1,159 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/sapling.h>
+
+#include <assert.h>
+
+Optional<libzcash::SaplingPaymentAddress> SaplingNoteData::Address() const
+{
+    return ivk.address(plaintext.d);
+}
+
+void SaplingWallet::LoadKey(const libzcash::SaplingExtendedFullViewingKey& xfvk)
+{
+    m_keys.emplace(xfvk.fvk.in_viewing_key(), xfvk);
+}
+
+bool SaplingWallet::HaveAddress(const libzcash::SaplingPaymentAddress& address) const
+{
+    for (const auto& entry : m_keys) {
+        const Optional<libzcash::SaplingPaymentAddress> key_address = entry.first.address(address.d);
+        if (key_address && *key_address == address) return true;
+    }
+    return false;
+}
+
+void SaplingWallet::Reset(const uint256& block_hash, int height, const SaplingMerkleTree& tree)
+{
+    m_best_block = block_hash;
+    m_best_height = height;
+    m_tree = tree;
+    m_notes.clear();
+    m_nullifiers.clear();
+    m_undo.clear();
+}
+
+void SaplingWallet::ConnectBlock(const CBlock& block, int height)
+{
+    assert(block.hashPrevBlock == m_best_block && height == m_best_height + 1);
+
+    std::vector<libzcash::SaplingTrialOutput> outputs;
+    std::vector<COutPoint> outpoints;
+    std::vector<libzcash::PedersenHash> commitments;
+    for (const CTransactionRef& tx : block.vtx) {
+        for (size_t i = 0; i < tx->vShieldedOutput.size(); i++) {
+            const OutputDescription& output = tx->vShieldedOutput[i];
+            outputs.push_back({&output.encCiphertext, &output.ephemeralKey, &output.cm});
+            outpoints.emplace_back(tx->GetHash(), i);
+            commitments.emplace_back(output.cm);
+        }
+    }
+
+    BlockUndo undo;
+    undo.block_hash = block.GetHash();
+    std::vector<SaplingWitness*> witnesses;
+    if (!commitments.empty()) {
+        undo.commitments = true;
+        undo.tree = m_tree;
+        for (auto& entry : m_notes) {
+            if (entry.second.spent_height != -1) continue;
+            undo.witnesses.emplace(entry.first, entry.second.witness);
+            witnesses.push_back(&entry.second.witness);
+        }
+    }
+
+    std::vector<libzcash::SaplingIncomingViewingKey> ivks;
+    ivks.reserve(m_keys.size());
+    for (const auto& entry : m_keys) {
+        ivks.push_back(entry.first);
+    }
+    const std::vector<libzcash::SaplingTrialDecryption> found = outputs.empty() ? std::vector<libzcash::SaplingTrialDecryption>() : libzcash::TrialDecryptSaplingOutputs(outputs, ivks);
+
+    // Advance the tree and the witnesses up to each note found, which then
+    // gets the witness of its own commitment.
+    size_t appended = 0;
+    for (const libzcash::SaplingTrialDecryption& decryption : found) {
+        // An output decrypted by a second key is the same note
+        if (decryption.output < appended) continue;
+        const libzcash::SaplingIncomingViewingKey& ivk = ivks[decryption.ivk];
+        const Optional<libzcash::SaplingNote> note = decryption.plaintext.note(ivk);
+        if (!note) continue;
+
+        SaplingWitness::append_batch(m_tree, std::vector<libzcash::PedersenHash>(commitments.begin() + appended, commitments.begin() + decryption.output + 1), witnesses);
+        appended = decryption.output + 1;
+
+        SaplingNoteData data;
+        data.ivk = ivk;
+        data.plaintext = decryption.plaintext;
+        data.height = height;
+        data.witness = m_tree.witness();
+        data.position = data.witness.position();
+        const Optional<uint256> nullifier = note->nullifier(m_keys.at(ivk).fvk, data.position);
+        if (!nullifier) continue;
+        data.nullifier = *nullifier;
+
+        auto inserted = m_notes.emplace(outpoints[decryption.output], std::move(data));
+        if (!inserted.second) continue;
+        m_nullifiers.emplace(inserted.first->second.nullifier, inserted.first->first);
+        witnesses.push_back(&inserted.first->second.witness);
+    }
+    if (appended < commitments.size()) {
+        SaplingWitness::append_batch(m_tree, std::vector<libzcash::PedersenHash>(commitments.begin() + appended, commitments.end()), witnesses);
+    }
+
+    for (const CTransactionRef& tx : block.vtx) {
+        for (const SpendDescription& spend : tx->vShieldedSpend) {
+            const auto it = m_nullifiers.find(spend.nullifier);
+            if (it == m_nullifiers.end()) continue;
+            SaplingNoteData& data = m_notes.at(it->second);
+            if (data.spent_height == -1) data.spent_height = height;
+        }
+    }
+
+    m_best_block = undo.block_hash;
+    m_best_height = height;
+    m_undo.push_back(std::move(undo));
+    if (m_undo.size() > SAPLING_WALLET_UNDO_BLOCKS) m_undo.pop_front();
+}
+
+bool SaplingWallet::DisconnectBlock(const CBlock& block)
+{
+    if (m_undo.empty() || m_undo.back().block_hash != block.GetHash()) return false;
+    const BlockUndo& undo = m_undo.back();
+
+    for (auto it = m_notes.begin(); it != m_notes.end();) {
+        if (it->second.height == m_best_height) {
+            m_nullifiers.erase(it->second.nullifier);
+            it = m_notes.erase(it);
+            continue;
+        }
+        if (it->second.spent_height == m_best_height) it->second.spent_height = -1;
+        ++it;
+    }
+    if (undo.commitments) {
+        m_tree = undo.tree;
+        for (const auto& entry : undo.witnesses) {
+            const auto it = m_notes.find(entry.first);
+            if (it != m_notes.end()) it->second.witness = entry.second;
+        }
+    }
+
+    m_best_block = block.hashPrevBlock;
+    m_best_height--;
+    m_undo.pop_back();
+    return true;
+}
+
+CAmount SaplingWallet::GetBalance(int min_depth, const Optional<libzcash::SaplingPaymentAddress>& address) const
+{
+    CAmount balance = 0;
+    for (const auto& entry : m_notes) {
+        const SaplingNoteData& data = entry.second;
+        if (data.spent_height != -1 || m_best_height - data.height + 1 < min_depth) continue;
+        if (address && data.Address() != address) continue;
+        balance += data.plaintext.value();
+    }
+    return balance;
+}
@@ -0,0 +1,133 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LITECOINZ_WALLET_SAPLING_H
+#define LITECOINZ_WALLET_SAPLING_H
+
+#include <amount.h>
+#include <optional.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <uint256.h>
+#include <zcash/IncrementalMerkleTree.hpp>
+#include <zcash/Note.hpp>
+#include <zcash/address/zip32.h>
+
+#include <deque>
+#include <map>
+
+/** Blocks the Sapling notes of a wallet can be rolled back by, keeping the witnesses from before each */
+static const unsigned int SAPLING_WALLET_UNDO_BLOCKS = 100;
+
+/** A Sapling note received by the wallet */
+struct SaplingNoteData {
+    //! The viewing key that decrypted the note
+    libzcash::SaplingIncomingViewingKey ivk;
+    libzcash::SaplingNotePlaintext plaintext;
+    //! The block the note was created in
+    int height{-1};
+    //! The position of its commitment in the note commitment tree
+    uint64_t position{0};
+    uint256 nullifier;
+    //! The block that spent the note, or -1 while it is unspent
+    int spent_height{-1};
+    //! The witness of the note as of the last block scanned, kept up to date while unspent
+    SaplingWitness witness;
+
+    Optional<libzcash::SaplingPaymentAddress> Address() const;
+
+    SERIALIZE_METHODS(SaplingNoteData, obj) { READWRITE(obj.ivk, obj.plaintext, obj.height, obj.position, obj.nullifier, obj.spent_height, obj.witness); }
+};
+
+/**
+ * The Sapling side of a wallet: its viewing keys and the notes they received.
+ * Blocks are scanned in chain order from the one tracking started at. The
+ * outputs of a block are trial-decrypted with all the keys on several
+ * threads at once, and the witnesses of the unspent notes are advanced over
+ * the note commitments of the block in one pass. Notes are identified by
+ * the transaction and the index of its Sapling output.
+ */
+class SaplingWallet
+{
+public:
+    bool HasKeys() const { return !m_keys.empty(); }
+    void LoadKey(const libzcash::SaplingExtendedFullViewingKey& xfvk);
+    /** Whether the address is one of the addresses of a key */
+    bool HaveAddress(const libzcash::SaplingPaymentAddress& address) const;
+
+    //! The last block scanned, or null before tracking starts
+    const uint256& BestBlock() const { return m_best_block; }
+    int BestHeight() const { return m_best_height; }
+
+    /** Start tracking at the end of a block with the given note commitment tree, forgetting any notes. */
+    void Reset(const uint256& block_hash, int height, const SaplingMerkleTree& tree);
+
+    /** Scan the block following BestBlock(). */
+    void ConnectBlock(const CBlock& block, int height);
+
+    /**
+     * Roll back BestBlock(). Returns false, changing nothing, when it is not
+     * the given block or is more than SAPLING_WALLET_UNDO_BLOCKS down.
+     */
+    bool DisconnectBlock(const CBlock& block);
+
+    /** The value of the unspent notes at least min_depth blocks deep, to one address or to any */
+    CAmount GetBalance(int min_depth, const Optional<libzcash::SaplingPaymentAddress>& address = nullopt) const;
+
+    const std::map<COutPoint, SaplingNoteData>& Notes() const { return m_notes; }
+
+    //! The ZIP 32 account the next key is derived at
+    uint32_t m_next_account{0};
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << m_next_account << m_best_block << m_best_height << m_tree << m_notes;
+        WriteCompactSize(s, m_undo.size());
+        for (const BlockUndo& undo : m_undo) {
+            s << undo;
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s >> m_next_account >> m_best_block >> m_best_height >> m_tree >> m_notes;
+        const uint64_t undo_size = ReadCompactSize(s);
+        if (undo_size > SAPLING_WALLET_UNDO_BLOCKS) throw std::ios_base::failure("Sapling undo data too large");
+        m_undo.resize(undo_size);
+        for (BlockUndo& undo : m_undo) {
+            s >> undo;
+        }
+        m_nullifiers.clear();
+        for (const auto& entry : m_notes) {
+            m_nullifiers.emplace(entry.second.nullifier, entry.first);
+        }
+    }
+
+private:
+    /** What ConnectBlock changed, for DisconnectBlock to put back */
+    struct BlockUndo {
+        uint256 block_hash;
+        //! Whether the block had note commitments, without which the tree and the witnesses stayed the same
+        bool commitments{false};
+        SaplingMerkleTree tree;
+        std::map<COutPoint, SaplingWitness> witnesses;
+
+        SERIALIZE_METHODS(BlockUndo, obj) { READWRITE(obj.block_hash, obj.commitments, obj.tree, obj.witnesses); }
+    };
+
+    std::map<libzcash::SaplingIncomingViewingKey, libzcash::SaplingExtendedFullViewingKey> m_keys;
+    uint256 m_best_block;
+    int m_best_height{-1};
+    //! The note commitment tree at the end of m_best_block
+    SaplingMerkleTree m_tree;
+    std::map<COutPoint, SaplingNoteData> m_notes;
+    std::map<uint256, COutPoint> m_nullifiers;
+    //! The last blocks scanned, from the lowest
+    std::deque<BlockUndo> m_undo;
+};
+
+#endif // LITECOINZ_WALLET_SAPLING_H
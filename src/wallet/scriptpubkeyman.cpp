@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <crypto/siphash.h>
 #include <key_io.h>
 #include <outputtype.h>
 #include <script/descriptor.h>
@@ -12,6 +13,10 @@
 #include <util/translation.h>
 #include <wallet/scriptpubkeyman.h>
 
+#include <atomic>
+#include <system_error>
+#include <thread>
+
 bool LegacyScriptPubKeyMan::GetNewDestination(const OutputType type, CTxDestination& dest, std::string& error)
 {
     LOCK(cs_KeyStore);
@@ -195,10 +200,46 @@ IsMineResult IsMineInner(const LegacyScriptPubKeyMan& keystore, const CScript& s
     return ret;
 }
 
+//! The scriptPubKeys paying to a key that IsMine may match
+void InsertKeyScriptPubKeys(std::set<CScript>& spks, const CPubKey& pubkey)
+{
+    spks.insert(GetScriptForRawPubKey(pubkey));
+    spks.insert(GetScriptForDestination(PKHash(pubkey)));
+    const CScript witness_program = GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID()));
+    spks.insert(witness_program);
+    spks.insert(GetScriptForDestination(ScriptHash(witness_program)));
+}
+
+//! The scriptPubKeys IsMine may match through a script
+void InsertScriptScriptPubKeys(std::set<CScript>& spks, const CScript& script)
+{
+    // Witness programs are stored as scripts too, so they are matched themselves
+    spks.insert(script);
+    spks.insert(GetScriptForDestination(ScriptHash(script)));
+    spks.insert(GetScriptForDestination(WitnessV0ScriptHash(script)));
+}
+
 } // namespace
 
+uint64_t LegacyScriptPubKeyMan::ScriptPubKeyHash(const CScript& script) const
+{
+    return CSipHasher(m_spk_hash_k0, m_spk_hash_k1).Write(script.data(), script.size()).Finalize();
+}
+
+void LegacyScriptPubKeyMan::AddScriptPubKeyHashes(const std::set<CScript>& spks)
+{
+    AssertLockHeld(cs_KeyStore);
+    for (const CScript& script : spks) {
+        m_spk_hashes.insert(ScriptPubKeyHash(script));
+    }
+}
+
 isminetype LegacyScriptPubKeyMan::IsMine(const CScript& script) const
 {
+    {
+        LOCK(cs_KeyStore);
+        if (!m_spk_hashes.count(ScriptPubKeyHash(script))) return ISMINE_NO;
+    }
     switch (IsMineInner(*this, script, IsMineSigVersion::TOP)) {
     case IsMineResult::INVALID:
     case IsMineResult::NO:
@@ -546,15 +587,12 @@ TransactionError LegacyScriptPubKeyMan::FillPSBT(PartiallySignedTransaction& psb
             if (txin.prevout.n >= input.non_witness_utxo->vout.size()) {
                 return TransactionError::MISSING_INPUTS;
             }
-        } else if (input.witness_utxo.IsNull()) {
-            // There's no UTXO so we can just skip this now
-            continue;
         }
-        SignatureData sigdata;
-        input.FillSignatureData(sigdata);
-        SignPSBTInput(HidingSigningProvider(this, !sign, !bip32derivs), psbtx, i, sighash_type);
     }
 
+    // Inputs without a UTXO are left as they are.
+    SignPSBTInputs(HidingSigningProvider(this, !sign, !bip32derivs), psbtx, sighash_type);
+
     // Fill in the bip32 keypaths and redeemscripts for the outputs so that hardware wallets can identify change
     for (unsigned int i = 0; i < psbtx.tx->vout.size(); ++i) {
         UpdatePSBTOutput(HidingSigningProvider(this, true, !bip32derivs), psbtx, i);
@@ -617,7 +655,7 @@ bool LegacyScriptPubKeyMan::AddKeyPubKey(const CKey& secret, const CPubKey &pubk
     return LegacyScriptPubKeyMan::AddKeyPubKeyWithDB(batch, secret, pubkey);
 }
 
-bool LegacyScriptPubKeyMan::AddKeyPubKeyWithDB(WalletBatch& batch, const CKey& secret, const CPubKey& pubkey)
+bool LegacyScriptPubKeyMan::AddKeyPubKeyWithDB(WalletBatch& batch, const CKey& secret, const CPubKey& pubkey, const std::vector<unsigned char>* crypted_secret)
 {
     AssertLockHeld(cs_KeyStore);
 
@@ -631,7 +669,7 @@ bool LegacyScriptPubKeyMan::AddKeyPubKeyWithDB(WalletBatch& batch, const CKey& s
     if (needsDB) {
         encrypted_batch = &batch;
     }
-    if (!AddKeyPubKeyInner(secret, pubkey)) {
+    if (!AddKeyPubKeyInner(secret, pubkey, crypted_secret)) {
         if (needsDB) encrypted_batch = nullptr;
         return false;
     }
@@ -641,11 +679,11 @@ bool LegacyScriptPubKeyMan::AddKeyPubKeyWithDB(WalletBatch& batch, const CKey& s
     CScript script;
     script = GetScriptForDestination(PKHash(pubkey));
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(batch, script);
     }
     script = GetScriptForRawPubKey(pubkey);
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(batch, script);
     }
 
     if (!m_storage.HasEncryptionKeys()) {
@@ -669,7 +707,12 @@ bool LegacyScriptPubKeyMan::LoadCScript(const CScript& redeemScript)
         return true;
     }
 
-    return FillableSigningProvider::AddCScript(redeemScript);
+    if (!FillableSigningProvider::AddCScript(redeemScript)) return false;
+    LOCK(cs_KeyStore);
+    std::set<CScript> spks;
+    InsertScriptScriptPubKeys(spks, redeemScript);
+    AddScriptPubKeyHashes(spks);
+    return true;
 }
 
 void LegacyScriptPubKeyMan::LoadKeyMetadata(const CKeyID& keyID, const CKeyMetadata& meta)
@@ -686,17 +729,23 @@ void LegacyScriptPubKeyMan::LoadScriptMetadata(const CScriptID& script_id, const
     m_script_metadata[script_id] = meta;
 }
 
-bool LegacyScriptPubKeyMan::AddKeyPubKeyInner(const CKey& key, const CPubKey &pubkey)
+bool LegacyScriptPubKeyMan::AddKeyPubKeyInner(const CKey& key, const CPubKey &pubkey, const std::vector<unsigned char>* crypted_secret)
 {
     LOCK(cs_KeyStore);
     if (!m_storage.HasEncryptionKeys()) {
-        return FillableSigningProvider::AddKeyPubKey(key, pubkey);
+        if (!FillableSigningProvider::AddKeyPubKey(key, pubkey)) return false;
+        std::set<CScript> spks;
+        InsertKeyScriptPubKeys(spks, pubkey);
+        AddScriptPubKeyHashes(spks);
+        return true;
     }
 
     if (m_storage.IsLocked()) {
         return false;
     }
 
+    if (crypted_secret) return AddCryptedKey(pubkey, *crypted_secret);
+
     std::vector<unsigned char> vchCryptedSecret;
     CKeyingMaterial vchSecret(key.begin(), key.end());
     if (!EncryptSecret(m_storage.GetEncryptionKey(), vchSecret, pubkey.GetHash(), vchCryptedSecret)) {
@@ -721,6 +770,9 @@ bool LegacyScriptPubKeyMan::AddCryptedKeyInner(const CPubKey &vchPubKey, const s
 
     mapCryptedKeys[vchPubKey.GetID()] = make_pair(vchPubKey, vchCryptedSecret);
     ImplicitlyLearnRelatedKeyScripts(vchPubKey);
+    std::set<CScript> spks;
+    InsertKeyScriptPubKeys(spks, vchPubKey);
+    AddScriptPubKeyHashes(spks);
     return true;
 }
 
@@ -762,6 +814,12 @@ static bool ExtractPubKey(const CScript &dest, CPubKey& pubKeyOut)
 }
 
 bool LegacyScriptPubKeyMan::RemoveWatchOnly(const CScript &dest)
+{
+    WalletBatch batch(m_storage.GetDatabase());
+    return RemoveWatchOnlyWithDB(batch, dest);
+}
+
+bool LegacyScriptPubKeyMan::RemoveWatchOnlyWithDB(WalletBatch& batch, const CScript& dest)
 {
     {
         LOCK(cs_KeyStore);
@@ -776,7 +834,7 @@ bool LegacyScriptPubKeyMan::RemoveWatchOnly(const CScript &dest)
 
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
-    if (!WalletBatch(m_storage.GetDatabase()).EraseWatchOnly(dest))
+    if (!batch.EraseWatchOnly(dest))
         return false;
 
     return true;
@@ -791,11 +849,15 @@ bool LegacyScriptPubKeyMan::AddWatchOnlyInMem(const CScript &dest)
 {
     LOCK(cs_KeyStore);
     setWatchOnly.insert(dest);
+    std::set<CScript> spks{dest};
     CPubKey pubKey;
     if (ExtractPubKey(dest, pubKey)) {
         mapWatchKeys[pubKey.GetID()] = pubKey;
         ImplicitlyLearnRelatedKeyScripts(pubKey);
+        // The related scripts may make outputs to the key watch-only too
+        InsertKeyScriptPubKeys(spks, pubKey);
     }
+    AddScriptPubKeyHashes(spks);
     return true;
 }
 
@@ -1010,6 +1072,86 @@ void LegacyScriptPubKeyMan::DeriveNewChildKey(WalletBatch &batch, CKeyMetadata&
         throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
 }
 
+/** Keys TopUp derives per thread at least, below which starting one costs more than it saves */
+static const int64_t KEYS_PER_DERIVE_THREAD = 64;
+static const int MAX_DERIVE_THREADS = 8;
+
+std::vector<LegacyScriptPubKeyMan::DerivedKey> LegacyScriptPubKeyMan::DeriveNewChildKeys(WalletBatch& batch, int64_t count, bool internal)
+{
+    // the same keypath scheme as DeriveNewChildKey, m/0'/0'/k or m/0'/1'/k
+    CKey seed;
+    if (!GetKey(hdChain.seed_id, seed))
+        throw std::runtime_error(std::string(__func__) + ": seed not found");
+    CExtKey masterKey;
+    CExtKey accountKey;
+    CExtKey chainChildKey;
+    masterKey.SetSeed(seed.begin(), seed.size());
+    masterKey.Derive(accountKey, BIP32_HARDENED_KEY_LIMIT);
+    assert(internal ? m_storage.CanSupportFeature(FEATURE_HD_SPLIT) : true);
+    accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT+(internal ? 1 : 0));
+    const CKeyID master_id = masterKey.key.GetPubKey().GetID();
+
+    const bool encrypt = m_storage.HasEncryptionKeys();
+    const int64_t creation_time = GetTime();
+    uint32_t& counter = internal ? hdChain.nInternalChainCounter : hdChain.nExternalChainCounter;
+    std::vector<DerivedKey> keys;
+    while ((int64_t)keys.size() < count) {
+        // Each index derives on its own, and computing the public key and
+        // encrypting the secret is most of the work
+        std::vector<DerivedKey> derived(count - keys.size());
+        const uint32_t first_index = counter;
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        auto derive = [&] {
+            for (size_t i = next++; i < derived.size(); i = next++) {
+                DerivedKey& key = derived[i];
+                const uint32_t index = first_index + i;
+                CExtKey childKey;
+                chainChildKey.Derive(childKey, index | BIP32_HARDENED_KEY_LIMIT);
+                key.secret = childKey.key;
+                key.pubkey = key.secret.GetPubKey();
+                key.metadata = CKeyMetadata(creation_time);
+                key.metadata.hdKeypath = "m/0'/" + std::string(internal ? "1" : "0") + "'/" + ToString(index) + "'";
+                key.metadata.key_origin.path.push_back(0 | BIP32_HARDENED_KEY_LIMIT);
+                key.metadata.key_origin.path.push_back((internal ? 1 : 0) | BIP32_HARDENED_KEY_LIMIT);
+                key.metadata.key_origin.path.push_back(index | BIP32_HARDENED_KEY_LIMIT);
+                key.metadata.hd_seed_id = hdChain.seed_id;
+                std::copy(master_id.begin(), master_id.begin() + 4, key.metadata.key_origin.fingerprint);
+                key.metadata.has_key_origin = true;
+                if (encrypt) {
+                    CKeyingMaterial secret(key.secret.begin(), key.secret.end());
+                    if (!EncryptSecret(m_storage.GetEncryptionKey(), secret, key.pubkey.GetHash(), key.crypted_secret)) failed = true;
+                }
+            }
+        };
+        const int threads = std::max<int64_t>(1, std::min<int64_t>({(int64_t)derived.size() / KEYS_PER_DERIVE_THREAD, GetNumCores(), MAX_DERIVE_THREADS}));
+        std::vector<std::thread> workers;
+        for (int i = 1; i < threads; ++i) {
+            try {
+                workers.emplace_back(derive);
+            } catch (const std::system_error&) {
+                // The threads already started and this one do the work
+                break;
+            }
+        }
+        derive();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        if (failed) throw std::runtime_error(std::string(__func__) + ": encrypting key failed");
+
+        // skip keys already known to the wallet, and derive more in their place
+        counter += derived.size();
+        for (DerivedKey& key : derived) {
+            if (!HaveKey(key.pubkey.GetID())) keys.push_back(std::move(key));
+        }
+    }
+    // update the chain model in the database
+    if (!batch.WriteHDChain(hdChain))
+        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+    return keys;
+}
+
 void LegacyScriptPubKeyMan::LoadKeyPool(int64_t nIndex, const CKeyPool &keypool)
 {
     LOCK(cs_KeyStore);
@@ -1154,18 +1296,45 @@ bool LegacyScriptPubKeyMan::TopUp(unsigned int kpSize)
             // don't create extra internal keys
             missingInternal = 0;
         }
-        bool internal = false;
-        WalletBatch batch(m_storage.GetDatabase());
-        for (int64_t i = missingInternal + missingExternal; i--;)
-        {
-            if (i < missingInternal) {
-                internal = true;
-            }
-
-            CPubKey pubkey(GenerateNewKey(batch, internal));
-            AddKeypoolPubkeyWithDB(pubkey, internal, batch);
-        }
         if (missingInternal + missingExternal > 0) {
+            // Written from the batch only, as another batch would wait for the
+            // transaction to end
+            if (m_storage.CanSupportFeature(FEATURE_COMPRPUBKEY)) {
+                m_storage.SetMinVersion(FEATURE_COMPRPUBKEY);
+            }
+            WalletBatch batch(m_storage.GetDatabase());
+            // A dummy database has no transactions, and takes the writes one by one
+            const bool txn = batch.TxnBegin();
+            if (IsHDEnabled()) {
+                assert(!m_storage.IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS));
+                assert(!m_storage.IsWalletFlagSet(WALLET_FLAG_BLANK_WALLET));
+                for (const bool internal : {false, true}) {
+                    const int64_t missing = internal ? missingInternal : missingExternal;
+                    if (missing == 0) continue;
+                    for (const DerivedKey& key : DeriveNewChildKeys(batch, missing, internal)) {
+                        mapKeyMetadata[key.pubkey.GetID()] = key.metadata;
+                        UpdateTimeFirstKey(key.metadata.nCreateTime);
+                        if (!AddKeyPubKeyWithDB(batch, key.secret, key.pubkey, key.crypted_secret.empty() ? nullptr : &key.crypted_secret)) {
+                            throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+                        }
+                        AddKeypoolPubkeyWithDB(key.pubkey, internal, batch);
+                    }
+                }
+            } else {
+                bool internal = false;
+                for (int64_t i = missingInternal + missingExternal; i--;)
+                {
+                    if (i < missingInternal) {
+                        internal = true;
+                    }
+
+                    CPubKey pubkey(GenerateNewKey(batch, internal));
+                    AddKeypoolPubkeyWithDB(pubkey, internal, batch);
+                }
+            }
+            if (txn && !batch.TxnCommit()) {
+                throw std::runtime_error(std::string(__func__) + ": committing the keypool transaction failed");
+            }
             WalletLogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size() + set_pre_split_keypool.size(), setInternalKeyPool.size());
         }
     }
@@ -1371,6 +1540,12 @@ bool LegacyScriptPubKeyMan::AddCScriptWithDB(WalletBatch& batch, const CScript&
 {
     if (!FillableSigningProvider::AddCScript(redeemScript))
         return false;
+    {
+        LOCK(cs_KeyStore);
+        std::set<CScript> spks;
+        InsertScriptScriptPubKeys(spks, redeemScript);
+        AddScriptPubKeyHashes(spks);
+    }
     if (batch.WriteCScript(Hash160(redeemScript), redeemScript)) {
         m_storage.UnsetBlankWalletFlag(batch);
         return true;
@@ -1492,3 +1667,33 @@ std::set<CKeyID> LegacyScriptPubKeyMan::GetKeys() const
     }
     return set_address;
 }
+
+std::set<CScript> LegacyScriptPubKeyMan::GetScriptPubKeys(int64_t& keypool_index) const
+{
+    LOCK(cs_KeyStore);
+    std::set<CScript> spks;
+    for (const CKeyID& keyid : GetKeys()) {
+        CPubKey pubkey;
+        if (GetPubKey(keyid, pubkey)) InsertKeyScriptPubKeys(spks, pubkey);
+    }
+    for (const auto& entry : mapScripts) {
+        InsertScriptScriptPubKeys(spks, entry.second);
+    }
+    spks.insert(setWatchOnly.begin(), setWatchOnly.end());
+    keypool_index = m_max_keypool_index;
+    return spks;
+}
+
+std::set<CScript> LegacyScriptPubKeyMan::GetNewKeyPoolScriptPubKeys(int64_t& keypool_index) const
+{
+    LOCK(cs_KeyStore);
+    std::set<CScript> spks;
+    if (m_max_keypool_index <= keypool_index) return spks;
+    for (const auto& entry : m_pool_key_to_index) {
+        if (entry.second <= keypool_index) continue;
+        CPubKey pubkey;
+        if (GetPubKey(entry.first, pubkey)) InsertKeyScriptPubKeys(spks, pubkey);
+    }
+    keypool_index = m_max_keypool_index;
+    return spks;
+}
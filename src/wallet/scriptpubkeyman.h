@@ -6,6 +6,7 @@
 #define BITCOIN_WALLET_SCRIPTPUBKEYMAN_H
 
 #include <psbt.h>
+#include <random.h>
 #include <script/signingprovider.h>
 #include <script/standard.h>
 #include <util/error.h>
@@ -15,6 +16,9 @@
 #include <wallet/walletdb.h>
 #include <wallet/walletutil.h>
 
+#include <limits>
+#include <unordered_set>
+
 #include <boost/signals2/signal.hpp>
 
 enum class OutputType;
@@ -254,7 +258,8 @@ private:
 
     int64_t nTimeFirstKey GUARDED_BY(cs_KeyStore) = 0;
 
-    bool AddKeyPubKeyInner(const CKey& key, const CPubKey &pubkey);
+    //! Adds a key to the store; crypted_secret, if given, is the secret already encrypted with the wallet key
+    bool AddKeyPubKeyInner(const CKey& key, const CPubKey &pubkey, const std::vector<unsigned char>* crypted_secret = nullptr);
     bool AddCryptedKeyInner(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret);
 
     /**
@@ -273,7 +278,8 @@ private:
     bool AddWatchOnlyWithDB(WalletBatch &batch, const CScript& dest, int64_t create_time) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
 
     //! Adds a key to the store, and saves it to disk.
-    bool AddKeyPubKeyWithDB(WalletBatch &batch,const CKey& key, const CPubKey &pubkey) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
+    bool AddKeyPubKeyWithDB(WalletBatch &batch,const CKey& key, const CPubKey &pubkey, const std::vector<unsigned char>* crypted_secret = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
+    bool RemoveWatchOnlyWithDB(WalletBatch& batch, const CScript& dest);
 
     void AddKeypoolPubkeyWithDB(const CPubKey& pubkey, const bool internal, WalletBatch& batch);
 
@@ -289,6 +295,17 @@ private:
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(WalletBatch& batch, CKeyMetadata& metadata, CKey& secret, bool internal = false) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
 
+    /** A key from DeriveNewChildKeys */
+    struct DerivedKey {
+        CKey secret;
+        CPubKey pubkey;
+        CKeyMetadata metadata;
+        //! The secret encrypted with the wallet key, if the wallet is encrypted
+        std::vector<unsigned char> crypted_secret;
+    };
+    /* HD derive count new child keys on one chain on several threads, encrypting them there too */
+    std::vector<DerivedKey> DeriveNewChildKeys(WalletBatch& batch, int64_t count, bool internal) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
+
     std::set<int64_t> setInternalKeyPool GUARDED_BY(cs_KeyStore);
     std::set<int64_t> setExternalKeyPool GUARDED_BY(cs_KeyStore);
     std::set<int64_t> set_pre_split_keypool GUARDED_BY(cs_KeyStore);
@@ -297,6 +314,19 @@ private:
     // Tracks keypool indexes to CKeyIDs of keys that have been taken out of the keypool but may be returned to it
     std::map<int64_t, CKeyID> m_index_to_reserved_key;
 
+    /**
+     * Salted hashes of the scriptPubKeys of every key (the keypool included),
+     * script and watch-only script, so that IsMine rejects most outputs that
+     * are not the wallet's with a single lookup. Nothing is removed, so it
+     * may hold more than IsMine matches, but never less.
+     */
+    std::unordered_set<uint64_t> m_spk_hashes GUARDED_BY(cs_KeyStore);
+    const uint64_t m_spk_hash_k0{GetRand(std::numeric_limits<uint64_t>::max())};
+    const uint64_t m_spk_hash_k1{GetRand(std::numeric_limits<uint64_t>::max())};
+
+    uint64_t ScriptPubKeyHash(const CScript& script) const;
+    void AddScriptPubKeyHashes(const std::set<CScript>& spks) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
+
     //! Fetches a key from the keypool
     bool GetKeyFromPool(CPubKey &key, const OutputType type, bool internal = false);
 
@@ -459,6 +489,18 @@ public:
     const std::map<CKeyID, int64_t>& GetAllReserveKeys() const { return m_pool_key_to_index; }
 
     std::set<CKeyID> GetKeys() const override;
+
+    /**
+     * The scriptPubKeys of the keys, scripts and watch-only scripts, which
+     * include all the scriptPubKeys IsMine can match. Sets keypool_index to
+     * the index of the last keypool key.
+     */
+    std::set<CScript> GetScriptPubKeys(int64_t& keypool_index) const;
+    /**
+     * The scriptPubKeys of the keypool keys after keypool_index, which is
+     * then set to the index of the last one, to follow the keys TopUp adds.
+     */
+    std::set<CScript> GetNewKeyPoolScriptPubKeys(int64_t& keypool_index) const;
 };
 
 /** Wraps a LegacyScriptPubKeyMan so that it can be returned in a new unique_ptr. Does not provide privkeys */
@@ -0,0 +1,97 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/protocol.h>
+#include <rpc/request.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+#include <wallet/asyncop.h>
+
+#include <future>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(asyncop_tests, BasicTestingSetup)
+
+/** Waits to be released, then returns its value or fails */
+class TestOperation : public AsyncOperation
+{
+public:
+    explicit TestOperation(int value, std::string wallet_name = "") : AsyncOperation("test", std::move(wallet_name)), m_value(value), m_release(m_promise.get_future().share()) {}
+
+    void Release() { m_promise.set_value(); }
+
+protected:
+    UniValue Run() override
+    {
+        m_release.wait();
+        if (m_value < 0) throw JSONRPCError(RPC_INVALID_PARAMETER, "negative");
+        return m_value;
+    }
+
+private:
+    const int m_value;
+    std::promise<void> m_promise;
+    std::shared_future<void> m_release;
+};
+
+static void WaitFinished(const AsyncOperation& op)
+{
+    while (!op.IsFinished()) UninterruptibleSleep(std::chrono::milliseconds{1});
+}
+
+BOOST_AUTO_TEST_CASE(operations_run_in_order)
+{
+    AsyncOperationQueue queue(1);
+    auto first = std::make_shared<TestOperation>(1);
+    auto second = std::make_shared<TestOperation>(-1);
+    auto third = std::make_shared<TestOperation>(3, "other");
+    queue.Add(first);
+    queue.Add(second);
+    queue.Add(third);
+    BOOST_CHECK(first->GetId() != second->GetId());
+    BOOST_CHECK(queue.Get(second->GetId()) == second);
+    BOOST_CHECK_EQUAL(queue.List("").size(), 2U);
+    BOOST_CHECK_EQUAL(queue.List("other").size(), 1U);
+
+    // The one worker is busy with the first operation, so the others wait
+    while (first->GetState() != AsyncOpState::EXECUTING) UninterruptibleSleep(std::chrono::milliseconds{1});
+    BOOST_CHECK(second->GetState() == AsyncOpState::QUEUED);
+    BOOST_CHECK(!first->Cancel());
+    BOOST_CHECK(queue.PopFinished(first->GetId()) == nullptr);
+    BOOST_CHECK(third->Cancel());
+
+    first->Release();
+    second->Release();
+    WaitFinished(*second);
+    BOOST_CHECK(first->GetState() == AsyncOpState::SUCCESS);
+    BOOST_CHECK_EQUAL(first->GetStatus()["result"].get_int(), 1);
+    BOOST_CHECK(second->GetState() == AsyncOpState::FAILED);
+    BOOST_CHECK_EQUAL(second->GetStatus()["error"]["code"].get_int(), RPC_INVALID_PARAMETER);
+    BOOST_CHECK(third->GetState() == AsyncOpState::CANCELLED);
+
+    // Finished operations are forgotten once their result is taken
+    BOOST_CHECK(queue.PopFinished(first->GetId()) == first);
+    BOOST_CHECK(queue.Get(first->GetId()) == nullptr);
+    BOOST_CHECK_EQUAL(queue.List("").size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(stopping_cancels_queued_operations)
+{
+    auto running = std::make_shared<TestOperation>(1);
+    auto queued = std::make_shared<TestOperation>(2);
+    {
+        AsyncOperationQueue queue(1);
+        queue.Add(running);
+        queue.Add(queued);
+        while (running->GetState() != AsyncOpState::EXECUTING) UninterruptibleSleep(std::chrono::milliseconds{1});
+        std::thread release([running] { UninterruptibleSleep(std::chrono::milliseconds{10}); running->Release(); });
+        release.detach();
+    }
+    BOOST_CHECK(running->GetState() == AsyncOpState::SUCCESS);
+    BOOST_CHECK(queued->GetState() == AsyncOpState::CANCELLED);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -417,4 +417,42 @@ BOOST_AUTO_TEST_CASE(ismine_standard)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ismine_follows_changes)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    NodeContext node;
+    std::unique_ptr<interfaces::Chain> chain = interfaces::MakeChain(node);
+    CWallet keystore(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    keystore.SetupLegacyScriptPubKeyMan();
+    LegacyScriptPubKeyMan* spk_man = keystore.GetLegacyScriptPubKeyMan();
+    LOCK(spk_man->cs_KeyStore);
+
+    // Outputs rejected before a key is added are accepted after
+    const CScript p2pkh = GetScriptForDestination(PKHash(key.GetPubKey()));
+    const CScript p2sh_p2wpkh = GetScriptForDestination(ScriptHash(GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey().GetID()))));
+    const CScript multisig = GetScriptForMultisig(1, {key.GetPubKey()});
+    const CScript p2wsh = GetScriptForDestination(WitnessV0ScriptHash(multisig));
+    BOOST_CHECK_EQUAL(spk_man->IsMine(p2pkh), ISMINE_NO);
+    BOOST_CHECK_EQUAL(spk_man->IsMine(p2sh_p2wpkh), ISMINE_NO);
+    BOOST_CHECK(spk_man->AddKey(key));
+    BOOST_CHECK_EQUAL(spk_man->IsMine(p2pkh), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(spk_man->IsMine(p2sh_p2wpkh), ISMINE_SPENDABLE);
+
+    // As are outputs to scripts added later
+    BOOST_CHECK_EQUAL(spk_man->IsMine(p2wsh), ISMINE_NO);
+    BOOST_CHECK(spk_man->AddCScript(multisig));
+    BOOST_CHECK(spk_man->AddCScript(p2wsh));
+    BOOST_CHECK_EQUAL(spk_man->IsMine(p2wsh), ISMINE_SPENDABLE);
+
+    // Watch-only scripts still stop matching once removed
+    CScript watched;
+    watched << OP_9 << OP_ADD << OP_11 << OP_EQUAL;
+    BOOST_CHECK(spk_man->AddWatchOnly(watched, 1));
+    BOOST_CHECK_EQUAL(spk_man->IsMine(watched), ISMINE_WATCH_ONLY);
+    // Erasing fails on the dummy database, after the script is removed
+    spk_man->RemoveWatchOnly(watched);
+    BOOST_CHECK_EQUAL(spk_man->IsMine(watched), ISMINE_NO);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
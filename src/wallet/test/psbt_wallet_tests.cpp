@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <key_io.h>
+#include <psbt.h>
+#include <script/interpreter.h>
 #include <util/bip32.h>
 #include <util/strencodings.h>
 #include <wallet/wallet.h>
@@ -76,6 +78,67 @@ BOOST_AUTO_TEST_CASE(psbt_updater_test)
     BOOST_CHECK(spk_man->FillPSBT(psbtx, SIGHASH_ALL, true, true) != TransactionError::OK);
 }
 
+BOOST_AUTO_TEST_CASE(psbt_sign_inputs)
+{
+    // Enough inputs of both kinds to be signed on several threads
+    FlatSigningProvider provider;
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    provider.keys.emplace(pubkey.GetID(), key);
+    provider.pubkeys.emplace(pubkey.GetID(), pubkey);
+
+    CMutableTransaction prev;
+    for (int i = 0; i < 300; ++i) {
+        const CTxDestination dest = i % 2 ? CTxDestination(WitnessV0KeyHash(pubkey.GetID())) : CTxDestination(PKHash(pubkey));
+        prev.vout.emplace_back(1000 + i, GetScriptForDestination(dest));
+    }
+    const CTransactionRef prev_tx = MakeTransactionRef(prev);
+
+    CMutableTransaction mtx;
+    for (uint32_t i = 0; i < prev.vout.size(); ++i) {
+        mtx.vin.emplace_back(COutPoint(prev_tx->GetHash(), i));
+    }
+    mtx.vout.emplace_back(100000, GetScriptForDestination(PKHash(pubkey)));
+    PartiallySignedTransaction psbtx(mtx);
+    for (PSBTInput& input : psbtx.inputs) {
+        input.non_witness_utxo = prev_tx;
+    }
+
+    // Signatures are deterministic, so signing each input on its own gives the same PSBT.
+    PartiallySignedTransaction serial(psbtx);
+    for (unsigned int i = 0; i < mtx.vin.size(); ++i) {
+        BOOST_CHECK(SignPSBTInput(provider, serial, i));
+    }
+    std::vector<bool> complete;
+    BOOST_CHECK(SignPSBTInputs(provider, psbtx, SIGHASH_ALL, &complete));
+    BOOST_CHECK(complete == std::vector<bool>(mtx.vin.size(), true));
+    CDataStream ss_serial(SER_NETWORK, PROTOCOL_VERSION);
+    ss_serial << serial;
+    CDataStream ss_parallel(SER_NETWORK, PROTOCOL_VERSION);
+    ss_parallel << psbtx;
+    BOOST_CHECK(ss_serial.str() == ss_parallel.str());
+
+    // Decoding base64 as it is read gives the same PSBT back.
+    const std::string base64 = EncodeBase64(ss_parallel.str());
+    PartiallySignedTransaction decoded;
+    std::string error;
+    BOOST_CHECK(DecodeBase64PSBT(decoded, base64, error));
+    CDataStream ss_decoded(SER_NETWORK, PROTOCOL_VERSION);
+    ss_decoded << decoded;
+    BOOST_CHECK(ss_decoded.str() == ss_parallel.str());
+    BOOST_CHECK(!DecodeBase64PSBT(decoded, base64 + "=", error));
+    BOOST_CHECK_EQUAL(error, "invalid base64");
+    BOOST_CHECK(!DecodeBase64PSBT(decoded, base64.substr(0, base64.size() - 4), error));
+
+    CMutableTransaction result;
+    BOOST_REQUIRE(FinalizeAndExtractPSBT(psbtx, result));
+    for (unsigned int i = 0; i < result.vin.size(); ++i) {
+        const CTxOut& utxo = prev.vout[i];
+        BOOST_CHECK(VerifyScript(result.vin[i].scriptSig, utxo.scriptPubKey, &result.vin[i].scriptWitness, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS, MutableTransactionSignatureChecker(&result, i, utxo.nValue)));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(parse_hd_keypath)
 {
     std::vector<uint32_t> keypath;
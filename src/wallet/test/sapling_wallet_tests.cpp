@@ -0,0 +1,120 @@
+// Copyright (c) 2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <clientversion.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <wallet/sapling.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sapling_wallet_tests, BasicTestingSetup)
+
+/** A Sapling transaction with one output of the given value to each address */
+static CTransactionRef MakeNoteTx(const std::vector<libzcash::SaplingPaymentAddress>& addresses, CAmount value, const std::vector<uint256>& spent = {})
+{
+    CMutableTransaction mtx;
+    mtx.fOverwintered = true;
+    mtx.nVersion = SAPLING_TX_VERSION;
+    mtx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    for (const libzcash::SaplingPaymentAddress& address : addresses) {
+        libzcash::SaplingNote note(address, value);
+        libzcash::SaplingNotePlaintext plaintext(note, {{0xF6}});
+        auto enc = plaintext.encrypt(note.pk_d);
+        BOOST_REQUIRE(enc);
+        OutputDescription output;
+        output.cm = note.cm().get();
+        output.ephemeralKey = enc->second.get_epk();
+        output.encCiphertext = enc->first;
+        mtx.vShieldedOutput.push_back(output);
+    }
+    for (const uint256& nullifier : spent) {
+        SpendDescription spend;
+        spend.nullifier = nullifier;
+        mtx.vShieldedSpend.push_back(spend);
+    }
+    return MakeTransactionRef(std::move(mtx));
+}
+
+static CBlock MakeBlock(const uint256& prev, const std::vector<CTransactionRef>& txs)
+{
+    CBlock block;
+    block.hashPrevBlock = prev;
+    block.nNonce = InsecureRand256();
+    block.vtx = txs;
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(notes_witnesses_and_rollback)
+{
+    const libzcash::SaplingExtendedFullViewingKey xfvk = libzcash::SaplingExtendedSpendingKey::Master(HDSeed::Random()).ToXFVK();
+    const libzcash::SaplingPaymentAddress mine = xfvk.DefaultAddress();
+    const libzcash::SaplingPaymentAddress other = libzcash::SaplingSpendingKey::random().default_address();
+
+    SaplingWallet sapling;
+    sapling.LoadKey(xfvk);
+    BOOST_CHECK(sapling.HaveAddress(mine));
+    BOOST_CHECK(!sapling.HaveAddress(other));
+    sapling.Reset(uint256(), -1, SaplingMerkleTree());
+
+    // Block 0: one note to the wallet among others
+    const CBlock block0 = MakeBlock(uint256(), {MakeNoteTx({other, mine, other}, 5000)});
+    sapling.ConnectBlock(block0, 0);
+    BOOST_CHECK_EQUAL(sapling.Notes().size(), 1U);
+    BOOST_CHECK_EQUAL(sapling.GetBalance(1), 5000);
+    BOOST_CHECK_EQUAL(sapling.GetBalance(2), 0);
+    BOOST_CHECK_EQUAL(sapling.GetBalance(1, other), 0);
+    const SaplingNoteData first = sapling.Notes().begin()->second;
+    BOOST_CHECK(sapling.Notes().begin()->first == COutPoint(block0.vtx[0]->GetHash(), 1));
+    BOOST_CHECK_EQUAL(first.position, 1U);
+
+    // Block 1: one more note, and the witness of the first follows the tree
+    const CBlock block1 = MakeBlock(block0.GetHash(), {MakeNoteTx({other}, 1000), MakeNoteTx({mine, other}, 2000)});
+    sapling.ConnectBlock(block1, 1);
+    BOOST_CHECK_EQUAL(sapling.GetBalance(1), 7000);
+    BOOST_CHECK_EQUAL(sapling.GetBalance(2), 5000);
+    SaplingMerkleTree tree;
+    for (const CBlock* block : {&block0, &block1}) {
+        for (const CTransactionRef& tx : block->vtx) {
+            for (const OutputDescription& output : tx->vShieldedOutput) {
+                tree.append(output.cm);
+            }
+        }
+    }
+    for (const auto& entry : sapling.Notes()) {
+        BOOST_CHECK(entry.second.witness.root() == tree.root());
+    }
+
+    // Block 2 spends the first note
+    const CBlock block2 = MakeBlock(block1.GetHash(), {MakeNoteTx({}, 0, {first.nullifier})});
+    sapling.ConnectBlock(block2, 2);
+    BOOST_CHECK_EQUAL(sapling.GetBalance(1), 2000);
+    BOOST_CHECK_EQUAL(sapling.Notes().at(COutPoint(block0.vtx[0]->GetHash(), 1)).spent_height, 2);
+
+    // The state survives a round trip
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << sapling;
+    SaplingWallet loaded;
+    stream >> loaded;
+    loaded.LoadKey(xfvk);
+    BOOST_CHECK(loaded.BestBlock() == block2.GetHash());
+    BOOST_CHECK_EQUAL(loaded.GetBalance(1), 2000);
+
+    // Rolling back only takes the best block, and undoes the spend and then the note
+    BOOST_CHECK(!loaded.DisconnectBlock(block1));
+    BOOST_CHECK(loaded.DisconnectBlock(block2));
+    BOOST_CHECK_EQUAL(loaded.GetBalance(1), 7000);
+    BOOST_CHECK(loaded.DisconnectBlock(block1));
+    BOOST_CHECK_EQUAL(loaded.Notes().size(), 1U);
+    BOOST_CHECK(loaded.Notes().begin()->second.witness.root() == first.witness.root());
+    BOOST_CHECK_EQUAL(loaded.BestHeight(), 0);
+
+    // And the block connects again on top
+    loaded.ConnectBlock(block1, 1);
+    for (const auto& entry : loaded.Notes()) {
+        BOOST_CHECK(entry.second.witness.root() == tree.root());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
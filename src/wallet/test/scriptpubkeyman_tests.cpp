@@ -40,4 +40,42 @@ BOOST_AUTO_TEST_CASE(CanProvide)
     BOOST_CHECK(keyman.CanProvide(p2sh_script, data));
 }
 
+// Test that LegacyScriptPubKeyMan::TopUp derives the keypool keys, on several
+// threads, at the same paths as one key at a time.
+BOOST_AUTO_TEST_CASE(TopUpDerivesHDKeysInOrder)
+{
+    NodeContext node;
+    std::unique_ptr<interfaces::Chain> chain = interfaces::MakeChain(node);
+    CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    wallet.SetMinVersion(FEATURE_LATEST);
+    LegacyScriptPubKeyMan& keyman = *wallet.GetOrCreateLegacyScriptPubKeyMan();
+    const CPubKey seed_pubkey = keyman.GenerateNewSeed();
+    keyman.SetHDSeed(seed_pubkey);
+
+    BOOST_REQUIRE(keyman.TopUp(300));
+    BOOST_CHECK_EQUAL(keyman.GetHDChain().nExternalChainCounter, 300U);
+    BOOST_CHECK_EQUAL(keyman.GetHDChain().nInternalChainCounter, 300U);
+    BOOST_CHECK_EQUAL(keyman.KeypoolCountExternalKeys(), 300U);
+
+    const uint32_t hardened = 0x80000000;
+    CKey seed;
+    BOOST_REQUIRE(keyman.GetKey(seed_pubkey.GetID(), seed));
+    CExtKey master, account;
+    master.SetSeed(seed.begin(), seed.size());
+    master.Derive(account, hardened);
+    for (const uint32_t chain_index : {0U, 1U}) {
+        CExtKey chain_key;
+        account.Derive(chain_key, chain_index | hardened);
+        for (const uint32_t index : {0U, 63U, 64U, 299U}) {
+            CExtKey child;
+            chain_key.Derive(child, index | hardened);
+            const CKeyID id = child.key.GetPubKey().GetID();
+            BOOST_CHECK(keyman.HaveKey(id));
+            KeyOriginInfo info;
+            BOOST_REQUIRE(keyman.GetKeyOrigin(id, info));
+            BOOST_CHECK(info.path == std::vector<uint32_t>({hardened, chain_index | hardened, index | hardened}));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
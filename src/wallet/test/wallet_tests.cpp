@@ -289,6 +289,9 @@ BOOST_FIXTURE_TEST_CASE(coin_mark_dirty_immature_credit, TestChain100Setup)
     BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(), 50*COIN);
 }
 
+//! Owns the block index entries AddTx() adds, as the block index only frees its own
+static CBlockIndexArena g_added_block_indexes;
+
 static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64_t blockTime)
 {
     CMutableTransaction tx;
@@ -298,7 +301,7 @@ static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64
     if (blockTime > 0) {
         auto locked_chain = wallet.chain().lock();
         LockAssertion lock(::cs_main);
-        auto inserted = ::BlockIndex().emplace(GetRandHash(), new CBlockIndex);
+        auto inserted = ::BlockIndex().emplace(GetRandHash(), g_added_block_indexes.Allocate());
         assert(inserted.second);
         const uint256& hash = inserted.first->first;
         block = inserted.first->second;
@@ -574,6 +577,63 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2U);
 }
 
+BOOST_FIXTURE_TEST_CASE(balance_totals, ListCoinsTestingSetup)
+{
+    // The running totals agree with counting all transactions again
+    auto check_balance = [&]() -> CWallet::Balance {
+        const CWallet::Balance running = wallet->GetBalance();
+        wallet->MarkDirty();
+        const CWallet::Balance recounted = wallet->GetBalance();
+        BOOST_CHECK_EQUAL(running.m_mine_trusted, recounted.m_mine_trusted);
+        BOOST_CHECK_EQUAL(running.m_mine_untrusted_pending, recounted.m_mine_untrusted_pending);
+        BOOST_CHECK_EQUAL(running.m_mine_immature, recounted.m_mine_immature);
+        return running;
+    };
+    BOOST_CHECK_EQUAL(check_balance().m_mine_trusted, 50 * COIN);
+
+    // Spending the coin takes it out of the totals, and its change is counted once confirmed
+    const CWalletTx& wtx = AddTx(CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false /* subtract fee */});
+    {
+        // AddTx confirms the transaction without the wallet noticing
+        LOCK(wallet->cs_wallet);
+        wallet->MarkBalanceDirty(wtx.GetHash());
+    }
+    const CAmount change = check_balance().m_mine_trusted;
+    BOOST_CHECK(change < 49 * COIN && change > 48 * COIN);
+
+    // Transactions are not counted beyond one confirmation by the totals
+    BOOST_CHECK_EQUAL(wallet->GetBalance(/* min_depth */ 2).m_mine_trusted, 0);
+    BOOST_CHECK_EQUAL(wallet->GetBalance(/* min_depth */ 1).m_mine_trusted, change);
+}
+
+BOOST_FIXTURE_TEST_CASE(available_coins_index, ListCoinsTestingSetup)
+{
+    // The coins found through the kept up index agree with building it again
+    auto check_coins = [&]() -> size_t {
+        auto locked_chain = m_chain->lock();
+        LOCK(wallet->cs_wallet);
+        std::vector<COutput> indexed, all;
+        wallet->AvailableCoins(*locked_chain, indexed);
+        wallet->MarkDirty();
+        wallet->AvailableCoins(*locked_chain, all);
+        BOOST_CHECK_EQUAL(indexed.size(), all.size());
+        for (size_t i = 0; i < std::min(indexed.size(), all.size()); ++i) {
+            BOOST_CHECK(indexed[i].tx->GetHash() == all[i].tx->GetHash() && indexed[i].i == all[i].i);
+        }
+        return indexed.size();
+    };
+    BOOST_CHECK_EQUAL(check_coins(), 1U);
+
+    // The spent coin leaves the index, the change and a coinbase that matured are found
+    const CWalletTx& wtx = AddTx(CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false /* subtract fee */});
+    {
+        // AddTx confirms the transaction without the wallet noticing
+        LOCK(wallet->cs_wallet);
+        wallet->MarkBalanceDirty(wtx.GetHash());
+    }
+    BOOST_CHECK_EQUAL(check_coins(), 2U);
+}
+
 BOOST_FIXTURE_TEST_CASE(wallet_disableprivkeys, TestChain100Setup)
 {
     NodeContext node;
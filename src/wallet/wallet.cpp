@@ -26,6 +26,7 @@
 #include <util/error.h>
 #include <util/fees.h>
 #include <util/moneystr.h>
+#include <util/notify.h>
 #include <util/rbf.h>
 #include <util/translation.h>
 #include <wallet/coincontrol.h>
@@ -33,6 +34,8 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <condition_variable>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -45,6 +48,8 @@ const std::map<uint64_t,std::string> WALLET_FLAG_CAVEATS{
 };
 
 static const size_t OUTPUT_GROUP_MAX_ENTRIES = 10;
+//! Threads reading blocks ahead of a rescan, at most
+static const int MAX_RESCAN_THREADS = 4;
 
 static RecursiveMutex cs_wallets;
 static std::vector<std::shared_ptr<CWallet>> vpwallets GUARDED_BY(cs_wallets);
@@ -369,6 +374,8 @@ void CWallet::chainStateFlushed(const CBlockLocator& loc)
 {
     WalletBatch batch(*database);
     batch.WriteBestBlock(loc);
+    LOCK(cs_wallet);
+    if (m_sapling.HasKeys()) batch.WriteSaplingState(m_sapling);
 }
 
 void CWallet::SetMinVersion(enum WalletFeature nVersion, WalletBatch* batch_in, bool fExplicit)
@@ -702,9 +709,16 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        m_running_totals_valid = false;
     }
 }
 
+void CWallet::MarkBalanceDirty(const uint256& hash) const
+{
+    LOCK(m_balance_dirty_mutex);
+    m_balance_dirty.insert(hash);
+}
+
 bool CWallet::MarkReplaced(const uint256& originalHash, const uint256& newHash)
 {
     LOCK(cs_wallet);
@@ -875,10 +889,10 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         // https://github.com/bitcoin/bitcoin/pull/13339#issuecomment-461288094
         boost::replace_all(strCmd, "%w", ShellEscape(GetName()));
 #endif
-        std::thread t(runCommand, strCmd);
-        t.detach(); // thread runs free
+        QueueNotifyCommand(strCmd);
     }
 #endif
+    SendNotification("wallet " + wtxIn.GetHash().GetHex() + " " + GetName());
 
     return true;
 }
@@ -1170,6 +1184,7 @@ void CWallet::blockConnected(const CBlock& block, int height)
         SyncTransaction(block.vtx[index], {CWalletTx::Status::CONFIRMED, height, block_hash, (int)index});
         transactionRemovedFromMempool(block.vtx[index], MemPoolRemovalReason::BLOCK);
     }
+    SyncSaplingBlock(*locked_chain, block, height);
 }
 
 void CWallet::blockDisconnected(const CBlock& block, int height)
@@ -1186,6 +1201,30 @@ void CWallet::blockDisconnected(const CBlock& block, int height)
     for (const CTransactionRef& ptx : block.vtx) {
         SyncTransaction(ptx, {CWalletTx::Status::UNCONFIRMED, /* block height */ 0, /* block hash */ {}, /* index */ 0});
     }
+    // A block deeper than the Sapling undo data is scanned again from the
+    // fork once the next block connects
+    if (m_sapling.HasKeys() && !m_sapling.DisconnectBlock(block) && m_sapling.BestBlock() == block.GetHash()) {
+        WalletLogPrintf("Could not roll Sapling notes back from block %s\n", block.GetHash().ToString());
+    }
+}
+
+void CWallet::SyncSaplingBlock(interfaces::Chain::Lock& locked_chain, const CBlock& block, int height)
+{
+    if (!m_sapling.HasKeys()) return;
+    if (block.hashPrevBlock != m_sapling.BestBlock()) {
+        const Optional<int> best_height = locked_chain.getBlockHeight(m_sapling.BestBlock());
+        if (best_height && *best_height >= height) return;
+
+        // The notes were tracked on a chain that is not active anymore
+        SaplingMerkleTree tree;
+        if (!chain().getSaplingTree(block.hashPrevBlock, tree)) {
+            WalletLogPrintf("Could not find the Sapling note commitment tree before block %s\n", block.GetHash().ToString());
+            return;
+        }
+        WalletLogPrintf("Sapling notes reset at height %d, older notes are forgotten\n", height - 1);
+        m_sapling.Reset(block.hashPrevBlock, height - 1, tree);
+    }
+    m_sapling.ConnectBlock(block, height);
 }
 
 void CWallet::updatedBlockTip()
@@ -1659,6 +1698,185 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+namespace {
+/**
+ * Reads the blocks of a rescan ahead of it on worker threads. If scripts are
+ * matched, the workers also find the transactions of each block with an
+ * output paying one of the wallet's scriptPubKeys, so that only those and
+ * the ones spending from the wallet need to be synced under cs_wallet, and
+ * with block filters they skip the blocks whose filter matches none of the
+ * scriptPubKeys without reading them.
+ *
+ * The scriptPubKeys grow as the rescan tops up the keypool. Each addition is
+ * a set of its own, and the blocks prefetched before it are checked against
+ * the sets they missed when they are taken.
+ */
+class RescanPrefetcher
+{
+public:
+    struct Block {
+        uint256 hash;
+        //! Whether the block was read; it was not if its filter matches none of the scriptPubKeys
+        bool read{false};
+        //! Whether the block was read from disk
+        bool found{false};
+        CBlock block;
+        //! For each transaction, whether one of its outputs pays one of the scriptPubKeys
+        std::vector<bool> pays_wallet;
+        //! The number of script sets the block was checked against
+        size_t sets_checked{0};
+    };
+
+    RescanPrefetcher(interfaces::Chain& chain, bool match_scripts, bool use_filters, GCSFilter::ElementSet scripts, int start_height, int threads) :
+        m_chain(chain), m_match_scripts(match_scripts), m_use_filters(use_filters), m_window(4 * threads),
+        m_next_height(start_height), m_taken_height(start_height)
+    {
+        m_scripts.push_back(std::make_shared<const GCSFilter::ElementSet>(std::move(scripts)));
+        for (int i = 0; i < threads; ++i) {
+            m_threads.emplace_back(&TraceThread<std::function<void()>>, "rescan", std::bind(&RescanPrefetcher::ThreadPrefetch, this));
+        }
+    }
+
+    ~RescanPrefetcher()
+    {
+        {
+            LOCK(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        for (std::thread& thread : m_threads) thread.join();
+    }
+
+    /** Add scriptPubKeys the blocks taken from now on are checked against too. */
+    void AddScripts(GCSFilter::ElementSet scripts)
+    {
+        LOCK(m_mutex);
+        m_scripts.push_back(std::make_shared<const GCSFilter::ElementSet>(std::move(scripts)));
+    }
+
+    /** Take the block at height, reading it here if it was not prefetched or the chain changed since. */
+    Block Take(int height, const uint256& hash)
+    {
+        Block block;
+        ScriptSets sets;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_taken_height = height;
+            m_blocks.erase(m_blocks.begin(), m_blocks.lower_bound(height));
+            m_cond.notify_all();
+            m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_blocks.count(height) || (m_end && height >= m_next_height); });
+            auto it = m_blocks.find(height);
+            if (it != m_blocks.end()) {
+                block = std::move(it->second);
+                m_blocks.erase(it);
+            }
+            sets = m_scripts;
+        }
+        if (block.hash != hash) {
+            block = Block();
+            block.hash = hash;
+        }
+        Check(block, sets);
+        return block;
+    }
+
+private:
+    //! Sets are never changed once added, so the workers use them without the lock
+    using ScriptSets = std::vector<std::shared_ptr<const GCSFilter::ElementSet>>;
+
+    interfaces::Chain& m_chain;
+    const bool m_match_scripts;
+    const bool m_use_filters;
+    //! How far ahead of the block taken last the workers read
+    const int m_window;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    ScriptSets m_scripts GUARDED_BY(m_mutex);
+    int m_next_height GUARDED_BY(m_mutex);
+    int m_taken_height GUARDED_BY(m_mutex);
+    //! Set once a worker found the chain to end before its height
+    bool m_end GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::map<int, Block> m_blocks GUARDED_BY(m_mutex);
+    std::vector<std::thread> m_threads;
+
+    void ThreadPrefetch()
+    {
+        while (true) {
+            int height;
+            ScriptSets sets;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || (!m_end && m_next_height <= m_taken_height + m_window); });
+                if (m_stop) return;
+                height = m_next_height++;
+                sets = m_scripts;
+            }
+            Block block;
+            {
+                auto locked_chain = m_chain.lock();
+                Optional<int> tip_height = locked_chain->getHeight();
+                if (tip_height && *tip_height >= height) block.hash = locked_chain->getBlockHash(height);
+            }
+            if (!block.hash.IsNull()) Check(block, sets);
+            {
+                LOCK(m_mutex);
+                if (block.hash.IsNull()) m_end = true;
+                if (height >= m_taken_height) m_blocks.emplace(height, std::move(block));
+            }
+            m_cond.notify_all();
+        }
+    }
+
+    /** Check the block against the sets it was not checked against yet, reading it if needed. */
+    void Check(Block& block, const ScriptSets& sets) const
+    {
+        if (block.sets_checked == sets.size()) return;
+        if (!block.read) {
+            // An unread block matched none of the sets it was checked against
+            bool skip = m_use_filters;
+            for (size_t i = block.sets_checked; skip && i < sets.size(); ++i) {
+                Optional<bool> match = m_chain.blockFilterMatchesAny(BlockFilterType::BASIC, block.hash, *sets[i]);
+                // The filter index may not have reached the block yet
+                skip = match && !*match;
+            }
+            if (skip) {
+                block.sets_checked = sets.size();
+                return;
+            }
+            block.read = true;
+            block.found = m_chain.findBlock(block.hash, &block.block) && !block.block.IsNull();
+            block.pays_wallet.assign(block.block.vtx.size(), !m_match_scripts);
+            block.sets_checked = 0;
+        }
+        if (m_match_scripts) {
+            for (size_t i = block.sets_checked; i < sets.size(); ++i) {
+                for (size_t pos = 0; pos < block.block.vtx.size(); ++pos) {
+                    if (block.pays_wallet[pos]) continue;
+                    for (const CTxOut& txout : block.block.vtx[pos]->vout) {
+                        if (sets[i]->count(GCSFilter::Element(txout.scriptPubKey.begin(), txout.scriptPubKey.end()))) {
+                            block.pays_wallet[pos] = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        block.sets_checked = sets.size();
+    }
+};
+
+GCSFilter::ElementSet ToElementSet(const std::set<CScript>& scripts)
+{
+    GCSFilter::ElementSet elements;
+    for (const CScript& script : scripts) {
+        elements.emplace(script.begin(), script.end());
+    }
+    return elements;
+}
+} // namespace
+
 /**
  * Scan the block chain (starting in start_block) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1709,6 +1927,31 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
         progress_end = chain().guessVerificationProgress(stop_block.IsNull() ? tip_hash : stop_block);
     }
     double progress_current = progress_begin;
+
+    // Outputs are matched against the scriptPubKeys of the legacy
+    // ScriptPubKeyMan on the prefetch threads, rather than with IsMine
+    // under cs_wallet, when it is the only one.
+    LegacyScriptPubKeyMan* spk_man = GetLegacyScriptPubKeyMan();
+    const bool match_scripts = spk_man && m_spk_managers.size() == 1;
+    // Sapling notes are found in the shielded outputs, which filters do not cover
+    const bool use_filters = match_scripts && chain().hasBlockFilterIndex(BlockFilterType::BASIC) && !WITH_LOCK(cs_wallet, return m_sapling.HasKeys());
+    int64_t keypool_index = 0;
+    std::unique_ptr<RescanPrefetcher> prefetcher;
+    if (block_height) {
+        GCSFilter::ElementSet scripts;
+        if (match_scripts) scripts = ToElementSet(spk_man->GetScriptPubKeys(keypool_index));
+        const int threads = std::max(1, std::min(GetNumCores() - 1, MAX_RESCAN_THREADS));
+        prefetcher = MakeUnique<RescanPrefetcher>(chain(), match_scripts, use_filters, std::move(scripts), *block_height, threads);
+    }
+    int blocks_skipped = 0;
+    // Transactions paying none of the scriptPubKeys still need syncing when
+    // they are in the wallet already or spend from it
+    auto spends_from_wallet = [this](const CTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) {
+        return mapWallet.count(tx.GetHash()) || std::any_of(tx.vin.begin(), tx.vin.end(), [this](const CTxIn& txin) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) {
+            return mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout);
+        });
+    };
+
     while (block_height && !fAbortRescan && !chain().shutdownRequested()) {
         m_scanning_progress = (progress_current - progress_begin) / (progress_end - progress_begin);
         if (*block_height % 100 == 0 && progress_end - progress_begin > 0.0) {
@@ -1719,8 +1962,10 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
             WalletLogPrintf("Still rescanning. At block %d. Progress=%f\n", *block_height, progress_current);
         }
 
-        CBlock block;
-        if (chain().findBlock(block_hash, &block) && !block.IsNull()) {
+        RescanPrefetcher::Block fetched = prefetcher->Take(*block_height, block_hash);
+        if (!fetched.read || fetched.found) {
+            const CBlock& block = fetched.block;
+            bool synced = false;
             auto locked_chain = chain().lock();
             LOCK(cs_wallet);
             if (!locked_chain->getBlockHeight(block_hash)) {
@@ -1732,12 +1977,23 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
                 result.status = ScanResult::FAILURE;
                 break;
             }
+            // A block skipped by its filter has no transactions to sync
+            if (!fetched.read) ++blocks_skipped;
             for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
+                if (!fetched.pays_wallet[posInBlock] && !spends_from_wallet(*block.vtx[posInBlock])) continue;
                 SyncTransaction(block.vtx[posInBlock], {CWalletTx::Status::CONFIRMED, *block_height, block_hash, (int)posInBlock}, fUpdate);
+                synced = true;
             }
+            if (fetched.read) SyncSaplingBlock(*locked_chain, block, *block_height);
             // scan succeeded, record block as most recent successfully scanned
             result.last_scanned_block = block_hash;
             result.last_scanned_height = *block_height;
+            // Syncing may have topped up the keypool, whose new keys the
+            // rest of the blocks are matched against as well
+            if (synced && match_scripts) {
+                GCSFilter::ElementSet added = ToElementSet(spk_man->GetNewKeyPoolScriptPubKeys(keypool_index));
+                if (!added.empty()) prefetcher->AddScripts(std::move(added));
+            }
         } else {
             // could not scan block, keep scanning but record this block as the most recent failure
             result.last_failed_block = block_hash;
@@ -1778,6 +2034,9 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
     } else {
         WalletLogPrintf("Rescan completed in %15dms\n", GetTimeMillis() - start_time);
     }
+    if (blocks_skipped > 0) {
+        WalletLogPrintf("Rescan skipped %d blocks matching none of the wallet's scripts by their filter\n", blocks_skipped);
+    }
     return result;
 }
 
@@ -1900,6 +2159,17 @@ CAmount CWalletTx::GetImmatureCredit(bool fUseCache) const
     return 0;
 }
 
+void CWalletTx::MarkDirty()
+{
+    m_amounts[DEBIT].Reset();
+    m_amounts[CREDIT].Reset();
+    m_amounts[IMMATURE_CREDIT].Reset();
+    m_amounts[AVAILABLE_CREDIT].Reset();
+    fChangeCached = false;
+    m_is_cache_empty = true;
+    if (pwallet && tx) pwallet->MarkBalanceDirty(GetHash());
+}
+
 CAmount CWalletTx::GetAvailableCredit(bool fUseCache, const isminefilter& filter) const
 {
     if (pwallet == nullptr)
@@ -2071,6 +2341,86 @@ void MaybeResendWalletTxs()
  */
 
 
+void CWallet::SettleBalance(interfaces::Chain::Lock& locked_chain, const CWalletTx& wtx) const
+{
+    if (wtx.m_balance_settled) {
+        m_settled_credit -= wtx.m_settled_credit;
+        wtx.m_balance_settled = false;
+    }
+    // Confirmed transactions are trusted without looking at their parents
+    std::set<uint256> trusted_parents;
+    if (wtx.GetDepthInMainChain() < 1 || wtx.IsImmatureCoinBase() || !wtx.IsTrusted(locked_chain, trusted_parents)) {
+        m_unsettled_txs.insert(wtx.GetHash());
+        return;
+    }
+    wtx.m_settled_credit.mine = wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE);
+    wtx.m_settled_credit.mine_used = wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE | ISMINE_USED);
+    wtx.m_settled_credit.watchonly = wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_WATCH_ONLY);
+    wtx.m_settled_credit.watchonly_used = wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_WATCH_ONLY | ISMINE_USED);
+    m_settled_credit += wtx.m_settled_credit;
+    wtx.m_balance_settled = true;
+    m_unsettled_txs.erase(wtx.GetHash());
+}
+
+void CWallet::IndexCoins(const CWalletTx& wtx) const
+{
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) == ISMINE_NO) continue;
+        // Spends by unconfirmed transactions may go away without the spender being synced
+        const auto range = mapTxSpends.equal_range(COutPoint(hash, i));
+        const bool spent = std::any_of(range.first, range.second, [this](const std::pair<const COutPoint, uint256>& spend) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) {
+            auto it = mapWallet.find(spend.second);
+            return it != mapWallet.end() && it->second.isConfirmed();
+        });
+        if (!spent) {
+            m_txs_with_coins.insert(hash);
+            return;
+        }
+    }
+    m_txs_with_coins.erase(hash);
+}
+
+void CWallet::UpdateRunningTotals(interfaces::Chain::Lock& locked_chain) const
+{
+    std::set<uint256> dirty;
+    {
+        LOCK(m_balance_dirty_mutex);
+        dirty.swap(m_balance_dirty);
+    }
+    if (!m_running_totals_valid) {
+        m_settled_credit = SettledCredit();
+        m_unsettled_txs.clear();
+        m_txs_with_coins.clear();
+        for (const auto& entry : mapWallet) {
+            entry.second.m_balance_settled = false;
+            SettleBalance(locked_chain, entry.second);
+            IndexCoins(entry.second);
+        }
+        m_running_totals_valid = true;
+        return;
+    }
+    for (const uint256& hash : dirty) {
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            SettleBalance(locked_chain, it->second);
+            IndexCoins(it->second);
+        } else {
+            m_txs_with_coins.erase(hash);
+        }
+    }
+    // Coinbases mature without being marked dirty
+    const std::vector<uint256> unsettled(m_unsettled_txs.begin(), m_unsettled_txs.end());
+    for (const uint256& hash : unsettled) {
+        auto it = mapWallet.find(hash);
+        if (it == mapWallet.end()) {
+            m_unsettled_txs.erase(hash);
+        } else if (it->second.IsCoinBase()) {
+            SettleBalance(locked_chain, it->second);
+        }
+    }
+}
+
 CWallet::Balance CWallet::GetBalance(const int min_depth, bool avoid_reuse) const
 {
     Balance ret;
@@ -2079,9 +2429,7 @@ CWallet::Balance CWallet::GetBalance(const int min_depth, bool avoid_reuse) cons
         auto locked_chain = chain().lock();
         LOCK(cs_wallet);
         std::set<uint256> trusted_parents;
-        for (const auto& entry : mapWallet)
-        {
-            const CWalletTx& wtx = entry.second;
+        auto add_tx = [&](const CWalletTx& wtx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) {
             const bool is_trusted{wtx.IsTrusted(*locked_chain, trusted_parents)};
             const int tx_depth{wtx.GetDepthInMainChain()};
             const CAmount tx_credit_mine{wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE | reuse_filter)};
@@ -2096,6 +2444,19 @@ CWallet::Balance CWallet::GetBalance(const int min_depth, bool avoid_reuse) cons
             }
             ret.m_mine_immature += wtx.GetImmatureCredit();
             ret.m_watchonly_immature += wtx.GetImmatureWatchOnlyCredit();
+        };
+        if (min_depth > 1) {
+            // The running totals do not tell how deep settled transactions are
+            for (const auto& entry : mapWallet) {
+                add_tx(entry.second);
+            }
+        } else {
+            UpdateRunningTotals(*locked_chain);
+            ret.m_mine_trusted = avoid_reuse ? m_settled_credit.mine : m_settled_credit.mine_used;
+            ret.m_watchonly_trusted = avoid_reuse ? m_settled_credit.watchonly : m_settled_credit.watchonly_used;
+            for (const uint256& hash : m_unsettled_txs) {
+                add_tx(mapWallet.at(hash));
+            }
         }
     }
     return ret;
@@ -2129,11 +2490,12 @@ void CWallet::AvailableCoins(interfaces::Chain::Lock& locked_chain, std::vector<
     const int min_depth = {coinControl ? coinControl->m_min_depth : DEFAULT_MIN_DEPTH};
     const int max_depth = {coinControl ? coinControl->m_max_depth : DEFAULT_MAX_DEPTH};
 
+    // Every output that is the wallet's and unspent is in one of these
+    UpdateRunningTotals(locked_chain);
     std::set<uint256> trusted_parents;
-    for (const auto& entry : mapWallet)
+    for (const uint256& wtxid : m_txs_with_coins)
     {
-        const uint256& wtxid = entry.first;
-        const CWalletTx& wtx = entry.second;
+        const CWalletTx& wtx = mapWallet.at(wtxid);
 
         if (!locked_chain.checkFinalTx(*wtx.tx)) {
             continue;
@@ -2196,10 +2558,10 @@ void CWallet::AvailableCoins(interfaces::Chain::Lock& locked_chain, std::vector<
             if (wtx.tx->vout[i].nValue < nMinimumAmount || wtx.tx->vout[i].nValue > nMaximumAmount)
                 continue;
 
-            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(wtxid, i)))
                 continue;
 
-            if (IsLockedCoin(entry.first, i))
+            if (IsLockedCoin(wtxid, i))
                 continue;
 
             if (IsSpent(wtxid, i))
@@ -2297,8 +2659,8 @@ const CTxOut& CWallet::FindNonChangeParentOutput(const CTransaction& tx, int out
     return ptx->vout[n];
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, std::vector<OutputGroup> groups,
-                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used) const
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, const std::vector<OutputGroup>& groups,
+                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used, bool presorted) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
@@ -2315,9 +2677,10 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibil
         CAmount cost_of_change = GetDiscardRate(*this).GetFee(coin_selection_params.change_spend_size) + coin_selection_params.effective_fee.GetFee(coin_selection_params.change_output_size);
 
         // Filter by the min conf specs and add to utxo_pool and calculate effective value
-        for (OutputGroup& group : groups) {
-            if (!group.EligibleForSpending(eligibility_filter)) continue;
+        for (const OutputGroup& eligible_group : groups) {
+            if (!eligible_group.EligibleForSpending(eligibility_filter)) continue;
 
+            OutputGroup group(eligible_group);
             group.fee = 0;
             group.long_term_fee = 0;
             group.effective_value = 0;
@@ -2338,7 +2701,7 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibil
                     it = group.Discard(coin);
                 }
             }
-            if (group.effective_value > 0) utxo_pool.push_back(group);
+            if (group.effective_value > 0) utxo_pool.push_back(std::move(group));
         }
         // Calculate the fees for things that aren't inputs
         CAmount not_input_fees = coin_selection_params.effective_fee.GetFee(coin_selection_params.tx_noinputs_size);
@@ -2351,7 +2714,7 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibil
             utxo_pool.push_back(group);
         }
         bnb_used = false;
-        return KnapsackSolver(nTargetValue, utxo_pool, setCoinsRet, nValueRet);
+        return KnapsackSolver(nTargetValue, utxo_pool, setCoinsRet, nValueRet, presorted);
     }
 }
 
@@ -2428,6 +2791,8 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
         Shuffle(vCoins.begin(), vCoins.end(), FastRandomContext());
     }
     std::vector<OutputGroup> groups = GroupOutputs(vCoins, !coin_control.m_avoid_partial_spends);
+    // Sort once for all the eligibility filters below, which keep the order
+    SortOutputGroups(groups);
 
     unsigned int limit_ancestor_count;
     unsigned int limit_descendant_count;
@@ -2437,13 +2802,13 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
     bool fRejectLongChains = gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
     bool res = value_to_select <= 0 ||
-        SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(1, 6, 0), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used) ||
-        SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(1, 1, 0), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used) ||
-        (m_spend_zero_conf_change && SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(0, 1, 2), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used)) ||
-        (m_spend_zero_conf_change && SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(0, 1, std::min((size_t)4, max_ancestors/3), std::min((size_t)4, max_descendants/3)), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used)) ||
-        (m_spend_zero_conf_change && SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(0, 1, max_ancestors/2, max_descendants/2), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used)) ||
-        (m_spend_zero_conf_change && SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(0, 1, max_ancestors-1, max_descendants-1), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used)) ||
-        (m_spend_zero_conf_change && !fRejectLongChains && SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(0, 1, std::numeric_limits<uint64_t>::max()), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used));
+        SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(1, 6, 0), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used, /* presorted */ true) ||
+        SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(1, 1, 0), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used, /* presorted */ true) ||
+        (m_spend_zero_conf_change && SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(0, 1, 2), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used, /* presorted */ true)) ||
+        (m_spend_zero_conf_change && SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(0, 1, std::min((size_t)4, max_ancestors/3), std::min((size_t)4, max_descendants/3)), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used, /* presorted */ true)) ||
+        (m_spend_zero_conf_change && SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(0, 1, max_ancestors/2, max_descendants/2), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used, /* presorted */ true)) ||
+        (m_spend_zero_conf_change && SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(0, 1, max_ancestors-1, max_descendants-1), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used, /* presorted */ true)) ||
+        (m_spend_zero_conf_change && !fRejectLongChains && SelectCoinsMinConf(value_to_select, CoinEligibilityFilter(0, 1, std::numeric_limits<uint64_t>::max()), groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used, /* presorted */ true));
 
     // because SelectCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
     util::insert(setCoinsRet, setPresetCoins);
@@ -3331,6 +3696,56 @@ bool CWallet::GetNewDestination(const OutputType type, const std::string label,
     return result;
 }
 
+Optional<libzcash::SaplingPaymentAddress> CWallet::GenerateNewSaplingAddress(std::string& error)
+{
+    auto locked_chain = chain().lock();
+    LOCK(cs_wallet);
+    error.clear();
+
+    LegacyScriptPubKeyMan* spk_man = GetLegacyScriptPubKeyMan();
+    if (!spk_man || !spk_man->IsHDEnabled() || IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS)) {
+        error = "Error: Sapling keys are derived from the HD seed, which this wallet does not have";
+        return nullopt;
+    }
+    if (IsLocked()) {
+        error = "Error: Please enter the wallet passphrase with walletpassphrase first.";
+        return nullopt;
+    }
+    CKey seed_key;
+    if (!spk_man->GetKey(spk_man->GetHDChain().seed_id, seed_key)) {
+        error = "Error: HD seed not found";
+        return nullopt;
+    }
+    RawHDSeed raw_seed(seed_key.begin(), seed_key.end());
+    const HDSeed seed(raw_seed);
+
+    // m/32'/coin_type'/account'
+    const libzcash::SaplingExtendedSpendingKey account = libzcash::SaplingExtendedSpendingKey::Master(seed)
+        .Derive(32 | ZIP32_HARDENED_KEY_LIMIT)
+        .Derive(Params().BIP44CoinType() | ZIP32_HARDENED_KEY_LIMIT)
+        .Derive(m_sapling.m_next_account | ZIP32_HARDENED_KEY_LIMIT);
+    const libzcash::SaplingExtendedFullViewingKey xfvk = account.ToXFVK();
+
+    if (!m_sapling.HasKeys()) {
+        // No note can be to a key that did not exist, so scanning starts here
+        SaplingMerkleTree tree;
+        if (!m_last_block_processed.IsNull() && !chain().getSaplingTree(m_last_block_processed, tree)) {
+            error = "Error: Sapling note commitment tree not found";
+            return nullopt;
+        }
+        m_sapling.Reset(m_last_block_processed, m_last_block_processed_height, tree);
+    }
+    m_sapling.LoadKey(xfvk);
+    m_sapling.m_next_account++;
+
+    WalletBatch batch(*database);
+    if (!batch.WriteSaplingKey(xfvk) || !batch.WriteSaplingState(m_sapling)) {
+        error = "Error: Failed to write the Sapling key to the wallet";
+        return nullopt;
+    }
+    return xfvk.DefaultAddress();
+}
+
 bool CWallet::GetNewChangeDestination(const OutputType type, CTxDestination& dest, std::string& error)
 {
     LOCK(cs_wallet);
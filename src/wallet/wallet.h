@@ -21,6 +21,7 @@
 #include <validationinterface.h>
 #include <wallet/coinselection.h>
 #include <wallet/crypter.h>
+#include <wallet/sapling.h>
 #include <wallet/scriptpubkeyman.h>
 #include <wallet/walletdb.h>
 #include <wallet/walletutil.h>
@@ -258,6 +259,31 @@ public:
 //Get the marginal bytes of spending the specified output
 int CalculateMaximumSignedInputSize(const CTxOut& txout, const CWallet* pwallet, bool use_max_sig = false);
 
+/** The available credit of a settled transaction, as CWallet::GetBalance counts it */
+struct SettledCredit {
+    CAmount mine{0};           //!< ISMINE_SPENDABLE, without reused addresses
+    CAmount mine_used{0};      //!< ISMINE_SPENDABLE | ISMINE_USED
+    CAmount watchonly{0};      //!< ISMINE_WATCH_ONLY, without reused addresses
+    CAmount watchonly_used{0}; //!< ISMINE_WATCH_ONLY | ISMINE_USED
+
+    SettledCredit& operator+=(const SettledCredit& other)
+    {
+        mine += other.mine;
+        mine_used += other.mine_used;
+        watchonly += other.watchonly;
+        watchonly_used += other.watchonly_used;
+        return *this;
+    }
+    SettledCredit& operator-=(const SettledCredit& other)
+    {
+        mine -= other.mine;
+        mine_used -= other.mine_used;
+        watchonly -= other.watchonly;
+        watchonly_used -= other.watchonly_used;
+        return *this;
+    }
+};
+
 /**
  * A transaction with a bunch of additional info that only the owner cares about.
  * It includes any unrecorded transactions needed to link it back to the block chain.
@@ -335,6 +361,9 @@ public:
     mutable bool fChangeCached;
     mutable bool fInMempool;
     mutable CAmount nChangeCached;
+    //! Whether the running balance totals of the wallet include m_settled_credit
+    mutable bool m_balance_settled{false};
+    mutable SettledCredit m_settled_credit;
 
     CWalletTx(const CWallet* pwalletIn, CTransactionRef arg)
         : tx(std::move(arg))
@@ -451,15 +480,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        m_amounts[DEBIT].Reset();
-        m_amounts[CREDIT].Reset();
-        m_amounts[IMMATURE_CREDIT].Reset();
-        m_amounts[AVAILABLE_CREDIT].Reset();
-        fChangeCached = false;
-        m_is_cache_empty = true;
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -679,8 +700,41 @@ private:
      * Should be called with non-zero block_hash and posInBlock if this is for a transaction that is included in a block. */
     void SyncTransaction(const CTransactionRef& tx, CWalletTx::Confirmation confirm, bool update_tx = true) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
+    /* Scan a block of the active chain for Sapling notes, unless the Sapling
+     * side is past it already. Used by BlockConnected/ScanForWalletTransactions. */
+    void SyncSaplingBlock(interfaces::Chain::Lock& locked_chain, const CBlock& block, int height) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
     std::atomic<uint64_t> m_wallet_flags{0};
 
+    /**
+     * Running balance totals. A transaction that is confirmed, mature and
+     * trusted is settled: its credit only changes when it is marked dirty,
+     * so GetBalance keeps the credit of all settled transactions summed up
+     * in m_settled_credit, and only goes through the other ones. Transactions
+     * marked dirty are collected in m_balance_dirty and counted again by the
+     * next GetBalance, which also settles transactions that matured.
+     */
+    mutable Mutex m_balance_dirty_mutex;
+    mutable std::set<uint256> m_balance_dirty GUARDED_BY(m_balance_dirty_mutex);
+    //! Unset to count all transactions again, by CWallet::MarkDirty and until first used
+    mutable bool m_running_totals_valid GUARDED_BY(cs_wallet){false};
+    mutable SettledCredit m_settled_credit GUARDED_BY(cs_wallet);
+    mutable std::set<uint256> m_unsettled_txs GUARDED_BY(cs_wallet);
+    /**
+     * The transactions with an output that is the wallet's and not spent by
+     * a confirmed transaction, which AvailableCoins goes through instead of
+     * all of mapWallet. Whether an output is spent only changes when the
+     * transaction is marked dirty, so it is kept up to date with the totals.
+     */
+    mutable std::set<uint256> m_txs_with_coins GUARDED_BY(cs_wallet);
+
+    /** Bring the running totals and m_txs_with_coins up to date. */
+    void UpdateRunningTotals(interfaces::Chain::Lock& locked_chain) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /** Move a transaction in or out of m_settled_credit. */
+    void SettleBalance(interfaces::Chain::Lock& locked_chain, const CWalletTx& wtx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /** Add a transaction to m_txs_with_coins or remove it. */
+    void IndexCoins(const CWalletTx& wtx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
     bool SetAddressBookWithDB(WalletBatch& batch, const CTxDestination& address, const std::string& strName, const std::string& strPurpose);
 
     //! Unsets a wallet flag and saves it to disk
@@ -789,6 +843,9 @@ public:
 
     std::set<COutPoint> setLockedCoins GUARDED_BY(cs_wallet);
 
+    //! The Sapling viewing keys of the wallet and the notes they received
+    SaplingWallet m_sapling GUARDED_BY(cs_wallet);
+
     /** Registered interfaces::Chain::Notifications handler. */
     std::unique_ptr<interfaces::Handler> m_chain_notifications_handler;
 
@@ -821,8 +878,8 @@ public:
      * completion the coin set and corresponding actual target value is
      * assembled
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, std::vector<OutputGroup> groups,
-        std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, const std::vector<OutputGroup>& groups,
+        std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used, bool presorted = false) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
@@ -886,6 +943,8 @@ public:
     DBErrors ReorderTransactions();
 
     void MarkDirty();
+    /** Have GetBalance count the transaction again, as its credit may have changed. */
+    void MarkBalanceDirty(const uint256& hash) const;
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
     void LoadToWallet(CWalletTx& wtxIn) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void transactionAddedToMempool(const CTransactionRef& tx) override;
@@ -1025,6 +1084,12 @@ public:
     bool GetNewDestination(const OutputType type, const std::string label, CTxDestination& dest, std::string& error);
     bool GetNewChangeDestination(const OutputType type, CTxDestination& dest, std::string& error);
 
+    /**
+     * Derive the Sapling key of the next ZIP 32 account from the HD seed and
+     * return its default address. Notes are tracked from the current block on.
+     */
+    Optional<libzcash::SaplingPaymentAddress> GenerateNewSaplingAddress(std::string& error);
+
     isminetype IsMine(const CTxDestination& dest) const;
     isminetype IsMine(const CScript& script) const;
     isminetype IsMine(const CTxIn& txin) const;
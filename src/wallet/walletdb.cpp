@@ -16,6 +16,8 @@
 
 #include <atomic>
 #include <string>
+#include <system_error>
+#include <thread>
 
 #include <boost/thread.hpp>
 
@@ -38,6 +40,8 @@ const std::string OLD_KEY{"wkey"};
 const std::string ORDERPOSNEXT{"orderposnext"};
 const std::string POOL{"pool"};
 const std::string PURPOSE{"purpose"};
+const std::string SAPLING_KEY{"sapxfvk"};
+const std::string SAPLING_STATE{"sapstate"};
 const std::string SETTINGS{"settings"};
 const std::string TX{"tx"};
 const std::string VERSION{"version"};
@@ -194,32 +198,46 @@ public:
     }
 };
 
-static bool
-ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
-             CWalletScanState &wss, std::string& strType, std::string& strErr) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
+/** Records LoadWallet reads, decodes and loads at a time */
+static const size_t WALLET_LOAD_BATCH = 4096;
+/** Threads decoding records in LoadWallet, at most */
+static const int MAX_WALLET_LOAD_THREADS = 4;
+
+/**
+ * The part of a record that takes long to decode and needs no wallet, which
+ * LoadWallet decodes for a batch of records on several threads before
+ * loading the records in order.
+ */
+struct DecodedRecord {
+    bool ok{false};
+    std::string strErr;
+    //! DBKeys::TX
+    CWalletTx wtx{nullptr /* pwallet */, MakeTransactionRef()};
+    bool upgraded{false};
+    //! DBKeys::KEY and DBKeys::KEYMETA
+    CPubKey pubkey;
+    CKeyID key_id;
+    CKey key;
+    CKeyMetadata meta;
+};
+
+static bool IsDecodedType(const std::string& strType)
 {
+    return strType == DBKeys::TX || strType == DBKeys::KEY || strType == DBKeys::KEYMETA;
+}
+
+/** Decode a record of a type IsDecodedType accepts, whose type was already read from ssKey. */
+static void DecodeRecord(const std::string& strType, CDataStream& ssKey, CDataStream& ssValue, DecodedRecord& decoded)
+{
+    decoded.ok = false;
     try {
-        // Unserialize
-        // Taking advantage of the fact that pair serialization
-        // is just the two items serialized one after the other
-        ssKey >> strType;
-        if (strType == DBKeys::NAME) {
-            std::string strAddress;
-            ssKey >> strAddress;
-            std::string label;
-            ssValue >> label;
-            pwallet->m_address_book[DecodeDestination(strAddress)].SetLabel(label);
-        } else if (strType == DBKeys::PURPOSE) {
-            std::string strAddress;
-            ssKey >> strAddress;
-            ssValue >> pwallet->m_address_book[DecodeDestination(strAddress)].purpose;
-        } else if (strType == DBKeys::TX) {
+        if (strType == DBKeys::TX) {
             uint256 hash;
             ssKey >> hash;
-            CWalletTx wtx(nullptr /* pwallet */, MakeTransactionRef());
+            CWalletTx& wtx = decoded.wtx;
             ssValue >> wtx;
             if (wtx.GetHash() != hash)
-                return false;
+                return;
 
             // Undo serialize changes in 31600
             if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
@@ -230,44 +248,28 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
                     char fUnused;
                     std::string unused_string;
                     ssValue >> fTmp >> fUnused >> unused_string;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d %s",
+                    decoded.strErr = strprintf("LoadWallet() upgrading tx ver=%d %d %s",
                                        wtx.fTimeReceivedIsTxTime, fTmp, hash.ToString());
                     wtx.fTimeReceivedIsTxTime = fTmp;
                 }
                 else
                 {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+                    decoded.strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
                     wtx.fTimeReceivedIsTxTime = 0;
                 }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->LoadToWallet(wtx);
-        } else if (strType == DBKeys::WATCHS) {
-            wss.nWatchKeys++;
-            CScript script;
-            ssKey >> script;
-            char fYes;
-            ssValue >> fYes;
-            if (fYes == '1') {
-                pwallet->GetOrCreateLegacyScriptPubKeyMan()->LoadWatchOnly(script);
+                decoded.upgraded = true;
             }
         } else if (strType == DBKeys::KEY) {
-            CPubKey vchPubKey;
+            CPubKey& vchPubKey = decoded.pubkey;
             ssKey >> vchPubKey;
             if (!vchPubKey.IsValid())
             {
-                strErr = "Error reading wallet database: CPubKey corrupt";
-                return false;
+                decoded.strErr = "Error reading wallet database: CPubKey corrupt";
+                return;
             }
-            CKey key;
             CPrivKey pkey;
             uint256 hash;
 
-            wss.nKeys++;
             ssValue >> pkey;
 
             // Old wallets store keys as DBKeys::KEY [pubkey] => [privkey]
@@ -293,19 +295,96 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
 
                 if (Hash(vchKey.begin(), vchKey.end()) != hash)
                 {
-                    strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
-                    return false;
+                    decoded.strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
+                    return;
                 }
 
                 fSkipCheck = true;
             }
 
-            if (!key.Load(pkey, vchPubKey, fSkipCheck))
+            if (!decoded.key.Load(pkey, vchPubKey, fSkipCheck))
             {
-                strErr = "Error reading wallet database: CPrivKey corrupt";
-                return false;
+                decoded.strErr = "Error reading wallet database: CPrivKey corrupt";
+                return;
+            }
+        } else if (strType == DBKeys::KEYMETA) {
+            ssKey >> decoded.pubkey;
+            ssValue >> decoded.meta;
+            decoded.key_id = decoded.pubkey.GetID();
+        } else {
+            return;
+        }
+        decoded.ok = true;
+    } catch (const std::exception& e) {
+        if (decoded.strErr.empty()) {
+            decoded.strErr = e.what();
+        }
+    } catch (...) {
+        if (decoded.strErr.empty()) {
+            decoded.strErr = "Caught unknown exception in ReadKeyValue";
+        }
+    }
+}
+
+/**
+ * Load a record into the wallet. When decoded is given, the type of the
+ * record is in strType and the rest was decoded by DecodeRecord.
+ */
+static bool
+ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
+             CWalletScanState &wss, std::string& strType, std::string& strErr, DecodedRecord* decoded = nullptr) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
+{
+    try {
+        // Unserialize
+        // Taking advantage of the fact that pair serialization
+        // is just the two items serialized one after the other
+        std::unique_ptr<DecodedRecord> local_decoded;
+        if (!decoded) {
+            ssKey >> strType;
+            if (IsDecodedType(strType)) {
+                local_decoded = MakeUnique<DecodedRecord>();
+                DecodeRecord(strType, ssKey, ssValue, *local_decoded);
+                decoded = local_decoded.get();
             }
-            if (!pwallet->GetOrCreateLegacyScriptPubKeyMan()->LoadKey(key, vchPubKey))
+        }
+        if (strType == DBKeys::KEY) {
+            wss.nKeys++;
+        }
+        if (decoded) {
+            strErr = decoded->strErr;
+            if (!decoded->ok) return false;
+        }
+
+        if (strType == DBKeys::NAME) {
+            std::string strAddress;
+            ssKey >> strAddress;
+            std::string label;
+            ssValue >> label;
+            pwallet->m_address_book[DecodeDestination(strAddress)].SetLabel(label);
+        } else if (strType == DBKeys::PURPOSE) {
+            std::string strAddress;
+            ssKey >> strAddress;
+            ssValue >> pwallet->m_address_book[DecodeDestination(strAddress)].purpose;
+        } else if (strType == DBKeys::TX) {
+            CWalletTx& wtx = decoded->wtx;
+            if (decoded->upgraded)
+                wss.vWalletUpgrade.push_back(wtx.GetHash());
+
+            if (wtx.nOrderPos == -1)
+                wss.fAnyUnordered = true;
+
+            pwallet->LoadToWallet(wtx);
+        } else if (strType == DBKeys::WATCHS) {
+            wss.nWatchKeys++;
+            CScript script;
+            ssKey >> script;
+            char fYes;
+            ssValue >> fYes;
+            if (fYes == '1') {
+                pwallet->GetOrCreateLegacyScriptPubKeyMan()->LoadWatchOnly(script);
+            }
+        } else if (strType == DBKeys::KEY) {
+            if (!pwallet->GetOrCreateLegacyScriptPubKeyMan()->LoadKey(decoded->key, decoded->pubkey))
             {
                 strErr = "Error reading wallet database: LegacyScriptPubKeyMan::LoadKey failed";
                 return false;
@@ -343,12 +422,8 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             }
             wss.fIsEncrypted = true;
         } else if (strType == DBKeys::KEYMETA) {
-            CPubKey vchPubKey;
-            ssKey >> vchPubKey;
-            CKeyMetadata keyMeta;
-            ssValue >> keyMeta;
             wss.nKeyMeta++;
-            pwallet->GetOrCreateLegacyScriptPubKeyMan()->LoadKeyMetadata(vchPubKey.GetID(), keyMeta);
+            pwallet->GetOrCreateLegacyScriptPubKeyMan()->LoadKeyMetadata(decoded->key_id, decoded->meta);
         } else if (strType == DBKeys::WATCHMETA) {
             CScript script;
             ssKey >> script;
@@ -394,6 +469,18 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             CHDChain chain;
             ssValue >> chain;
             pwallet->GetOrCreateLegacyScriptPubKeyMan()->SetHDChain(chain, true);
+        } else if (strType == DBKeys::SAPLING_KEY) {
+            libzcash::SaplingIncomingViewingKey ivk;
+            ssKey >> ivk;
+            libzcash::SaplingExtendedFullViewingKey xfvk;
+            ssValue >> xfvk;
+            if (xfvk.fvk.in_viewing_key() != ivk) {
+                strErr = "Error reading wallet database: Sapling viewing key corrupt";
+                return false;
+            }
+            pwallet->m_sapling.LoadKey(xfvk);
+        } else if (strType == DBKeys::SAPLING_STATE) {
+            ssValue >> pwallet->m_sapling;
         } else if (strType == DBKeys::FLAGS) {
             uint64_t flags;
             ssValue >> flags;
@@ -423,6 +510,43 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
     return true;
 }
 
+/** A record LoadWallet read, with its decoded part if it has one */
+struct WalletRecord {
+    CDataStream ssKey{SER_DISK, CLIENT_VERSION};
+    CDataStream ssValue{SER_DISK, CLIENT_VERSION};
+    std::string strType;
+    std::unique_ptr<DecodedRecord> decoded;
+};
+
+/** Decode the records of a batch that have a decoded part, on up to threads threads. */
+static void DecodeRecords(std::vector<WalletRecord>& records, int threads)
+{
+    std::atomic<size_t> next{0};
+    auto decode = [&records, &next] {
+        for (size_t i = next++; i < records.size(); i = next++) {
+            WalletRecord& record = records[i];
+            if (!record.decoded) continue;
+            // The type was read from a copy of the key already
+            std::string strType;
+            record.ssKey >> strType;
+            DecodeRecord(strType, record.ssKey, record.ssValue, *record.decoded);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+        try {
+            workers.emplace_back(decode);
+        } catch (const std::system_error&) {
+            // The threads already started and this one do the work
+            break;
+        }
+    }
+    decode();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
 bool WalletBatch::IsKeyType(const std::string& strType)
 {
     return (strType == DBKeys::KEY ||
@@ -452,41 +576,70 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
             return DBErrors::CORRUPT;
         }
 
-        while (true)
+        // The records are read and loaded in batches, in between which the
+        // transactions and keys of a batch are decoded on several threads.
+        const int threads = std::max(1, std::min(GetNumCores(), MAX_WALLET_LOAD_THREADS));
+        std::vector<WalletRecord> records;
+        records.reserve(WALLET_LOAD_BATCH);
+        bool fEnd = false;
+        while (!fEnd)
         {
-            // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = m_batch.ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND)
-                break;
-            else if (ret != 0)
+            records.clear();
+            while (records.size() < WALLET_LOAD_BATCH)
             {
-                pwallet->WalletLogPrintf("Error reading next record from wallet database\n");
-                return DBErrors::CORRUPT;
+                // Read next record
+                records.emplace_back();
+                WalletRecord& record = records.back();
+                int ret = m_batch.ReadAtCursor(pcursor, record.ssKey, record.ssValue);
+                if (ret == DB_NOTFOUND) {
+                    records.pop_back();
+                    fEnd = true;
+                    break;
+                }
+                else if (ret != 0)
+                {
+                    pwallet->WalletLogPrintf("Error reading next record from wallet database\n");
+                    return DBErrors::CORRUPT;
+                }
+
+                try {
+                    CDataStream ssType(record.ssKey);
+                    ssType >> record.strType;
+                } catch (...) {
+                    // ReadKeyValue reports the corrupt record
+                    record.strType.clear();
+                }
+                if (IsDecodedType(record.strType)) {
+                    record.decoded = MakeUnique<DecodedRecord>();
+                }
             }
+            DecodeRecords(records, threads);
 
-            // Try to be tolerant of single corrupt records:
-            std::string strType, strErr;
-            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
+            for (WalletRecord& record : records)
             {
-                // losing keys is considered a catastrophic error, anything else
-                // we assume the user can live with:
-                if (IsKeyType(strType) || strType == DBKeys::DEFAULTKEY) {
-                    result = DBErrors::CORRUPT;
-                } else if (strType == DBKeys::FLAGS) {
-                    // reading the wallet flags can only fail if unknown flags are present
-                    result = DBErrors::TOO_NEW;
-                } else {
-                    // Leave other errors alone, if we try to fix them we might make things worse.
-                    fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
-                    if (strType == DBKeys::TX)
-                        // Rescan if there is a bad transaction record:
-                        gArgs.SoftSetBoolArg("-rescan", true);
+                // Try to be tolerant of single corrupt records:
+                std::string& strType = record.strType;
+                std::string strErr;
+                if (!ReadKeyValue(pwallet, record.ssKey, record.ssValue, wss, strType, strErr, record.decoded.get()))
+                {
+                    // losing keys is considered a catastrophic error, anything else
+                    // we assume the user can live with:
+                    if (IsKeyType(strType) || strType == DBKeys::DEFAULTKEY) {
+                        result = DBErrors::CORRUPT;
+                    } else if (strType == DBKeys::FLAGS) {
+                        // reading the wallet flags can only fail if unknown flags are present
+                        result = DBErrors::TOO_NEW;
+                    } else {
+                        // Leave other errors alone, if we try to fix them we might make things worse.
+                        fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
+                        if (strType == DBKeys::TX)
+                            // Rescan if there is a bad transaction record:
+                            gArgs.SoftSetBoolArg("-rescan", true);
+                    }
                 }
+                if (!strErr.empty())
+                    pwallet->WalletLogPrintf("%s\n", strErr);
             }
-            if (!strErr.empty())
-                pwallet->WalletLogPrintf("%s\n", strErr);
         }
         pcursor->close();
     }
@@ -712,11 +865,26 @@ bool WalletBatch::RecoverKeysOnlyFilter(void *callbackData, CDataStream ssKey, C
     CWalletScanState dummyWss;
     std::string strType, strErr;
     bool fReadOK;
+    // Recover calls this on several threads: check keys before taking the
+    // lock, as LoadWallet does.
+    std::unique_ptr<DecodedRecord> decoded;
+    try {
+        CDataStream ssType(ssKey);
+        ssType >> strType;
+    } catch (...) {
+        // ReadKeyValue reports the corrupt record
+        strType.clear();
+    }
+    if (IsDecodedType(strType)) {
+        decoded = MakeUnique<DecodedRecord>();
+        ssKey >> strType;
+        DecodeRecord(strType, ssKey, ssValue, *decoded);
+    }
     {
         // Required in LoadKeyMetadata():
         LOCK(dummyWallet->cs_wallet);
         fReadOK = ReadKeyValue(dummyWallet, ssKey, ssValue,
-                               dummyWss, strType, strErr);
+                               dummyWss, strType, strErr, decoded.get());
     }
     if (!IsKeyType(strType) && strType != DBKeys::HDCHAIN) {
         return false;
@@ -756,6 +924,16 @@ bool WalletBatch::WriteHDChain(const CHDChain& chain)
     return WriteIC(DBKeys::HDCHAIN, chain);
 }
 
+bool WalletBatch::WriteSaplingKey(const libzcash::SaplingExtendedFullViewingKey& xfvk)
+{
+    return WriteIC(std::make_pair(DBKeys::SAPLING_KEY, xfvk.fvk.in_viewing_key()), xfvk);
+}
+
+bool WalletBatch::WriteSaplingState(const SaplingWallet& sapling)
+{
+    return WriteIC(DBKeys::SAPLING_STATE, sapling);
+}
+
 bool WalletBatch::WriteWalletFlags(const uint64_t flags)
 {
     return WriteIC(DBKeys::FLAGS, flags);
@@ -35,9 +35,14 @@ class CMasterKey;
 class CScript;
 class CWallet;
 class CWalletTx;
+class SaplingWallet;
 class uint160;
 class uint256;
 
+namespace libzcash {
+struct SaplingExtendedFullViewingKey;
+} // namespace libzcash
+
 /** Backend-agnostic database type. */
 using WalletDatabase = BerkeleyDatabase;
 
@@ -71,6 +76,8 @@ extern const std::string OLD_KEY;
 extern const std::string ORDERPOSNEXT;
 extern const std::string POOL;
 extern const std::string PURPOSE;
+extern const std::string SAPLING_KEY;
+extern const std::string SAPLING_STATE;
 extern const std::string SETTINGS;
 extern const std::string TX;
 extern const std::string VERSION;
@@ -265,6 +272,10 @@ public:
     //! write the hdchain model (external chain child index counter)
     bool WriteHDChain(const CHDChain& chain);
 
+    //! write a Sapling viewing key, and the Sapling notes and scan progress
+    bool WriteSaplingKey(const libzcash::SaplingExtendedFullViewingKey& xfvk);
+    bool WriteSaplingState(const SaplingWallet& sapling);
+
     bool WriteWalletFlags(const uint64_t flags);
     //! Begin a new transaction
     bool TxnBegin();
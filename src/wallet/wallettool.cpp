@@ -2,11 +2,15 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chainparams.h>
 #include <fs.h>
 #include <util/system.h>
 #include <wallet/wallet.h>
+#include <wallet/wallettool.h>
 #include <wallet/walletutil.h>
 
+#include <set>
+
 namespace WalletTool {
 
 // The standard wallet deleter function blocks on the validation interface
@@ -102,6 +106,99 @@ static void WalletShowInfo(CWallet* wallet_instance)
     tfm::format(std::cout, "Address Book: %zu\n", wallet_instance->m_address_book.size());
 }
 
+/**
+ * Remove the transactions of a wallet that no longer matter to it, then
+ * rewrite the file with only the remaining records, packed in key order.
+ *
+ * A transaction is removed when it is at least depth blocks old and either
+ * conflicted, or confirmed with every output of the wallet spent by a
+ * confirmed transaction. Without a chain the depth is measured in time,
+ * back from the newest confirmed transaction of the wallet. Transactions
+ * with shielded parts are kept for the Sapling note state, as is any
+ * transaction spending a kept one so that its outputs stay spent.
+ */
+static bool CompactWallet(CWallet* wallet_instance, int64_t depth)
+{
+    std::vector<uint256> removed;
+    {
+        LOCK(wallet_instance->cs_wallet);
+        const std::map<uint256, CWalletTx>& txs = wallet_instance->mapWallet;
+        int64_t newest = 0;
+        std::set<COutPoint> spent;
+        for (const auto& entry : txs) {
+            if (!entry.second.isConfirmed()) continue;
+            newest = std::max<int64_t>(newest, entry.second.nTimeSmart);
+            for (const CTxIn& txin : entry.second.tx->vin) {
+                spent.insert(txin.prevout);
+            }
+        }
+        const int64_t cutoff = newest - depth * Params().GetConsensus().nPowTargetSpacing;
+
+        std::set<uint256> remove;
+        for (const auto& entry : txs) {
+            const CWalletTx& wtx = entry.second;
+            if (wtx.nTimeSmart > cutoff) continue;
+            if (!wtx.tx->vShieldedSpend.empty() || !wtx.tx->vShieldedOutput.empty()) continue;
+            bool settled = wtx.isConflicted();
+            if (wtx.isConfirmed()) {
+                settled = true;
+                for (unsigned int i = 0; i < wtx.tx->vout.size() && settled; ++i) {
+                    settled = wallet_instance->IsMine(wtx.tx->vout[i]) == ISMINE_NO || spent.count(COutPoint(entry.first, i));
+                }
+            }
+            if (settled) remove.insert(entry.first);
+        }
+        // Conflicted transactions spend nothing, the others must only spend removed ones
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto it = remove.begin(); it != remove.end();) {
+                const CWalletTx& wtx = txs.at(*it);
+                bool keep = false;
+                if (wtx.isConfirmed()) {
+                    for (const CTxIn& txin : wtx.tx->vin) {
+                        if (txs.count(txin.prevout.hash) && !remove.count(txin.prevout.hash)) {
+                            keep = true;
+                            break;
+                        }
+                    }
+                }
+                if (keep) {
+                    it = remove.erase(it);
+                    changed = true;
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        std::vector<uint256> hashes(remove.begin(), remove.end());
+        if (wallet_instance->ZapSelectTx(hashes, removed) != DBErrors::LOAD_OK) {
+            tfm::format(std::cerr, "Error removing transactions from the wallet\n");
+            return false;
+        }
+    }
+    tfm::format(std::cout, "Removed %u transactions\n", removed.size());
+    if (!wallet_instance->GetDBHandle().Rewrite()) {
+        tfm::format(std::cerr, "Error rewriting the wallet file\n");
+        return false;
+    }
+    return true;
+}
+
+/** Recover the keys of a wallet file, as -salvagewallet does, with the records decoded on several threads. */
+static bool SalvageWallet(const fs::path& path)
+{
+    CWallet dummy_wallet(nullptr /* chain */, WalletLocation(), WalletDatabase::CreateDummy());
+    std::string backup_filename;
+    if (!WalletBatch::Recover(path, (void*)&dummy_wallet, WalletBatch::RecoverKeysOnlyFilter, backup_filename)) {
+        tfm::format(std::cerr, "Error salvaging the wallet, the original file is %s\n", backup_filename);
+        return false;
+    }
+    tfm::format(std::cout, "Salvaged the keys of the wallet, the original file is %s. Start with -rescan to recover its transactions.\n", backup_filename);
+    return true;
+}
+
 bool ExecuteWalletToolFunc(const std::string& command, const std::string& name)
 {
     fs::path path = fs::absolute(name, GetWalletDir());
@@ -126,6 +223,21 @@ bool ExecuteWalletToolFunc(const std::string& command, const std::string& name)
         if (!wallet_instance) return false;
         WalletShowInfo(wallet_instance.get());
         wallet_instance->Flush(true);
+    } else if (command == "compact" || command == "salvage") {
+        if (!fs::exists(path)) {
+            tfm::format(std::cerr, "Error: no wallet file at %s\n", name);
+            return false;
+        }
+        std::string error;
+        if (!WalletBatch::VerifyEnvironment(path, error)) {
+            tfm::format(std::cerr, "Error loading %s. Is wallet being used by other process?\n", name);
+            return false;
+        }
+        if (command == "salvage") return SalvageWallet(path);
+        std::shared_ptr<CWallet> wallet_instance = LoadWallet(name, path);
+        if (!wallet_instance) return false;
+        if (!CompactWallet(wallet_instance.get(), std::max<int64_t>(0, gArgs.GetArg("-compactdepth", DEFAULT_COMPACT_DEPTH)))) return false;
+        WalletShowInfo(wallet_instance.get());
     } else {
         tfm::format(std::cerr, "Invalid command: %s\n", command);
         return false;
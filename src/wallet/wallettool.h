@@ -9,9 +9,9 @@
 
 namespace WalletTool {
 
-std::shared_ptr<CWallet> CreateWallet(const std::string& name, const fs::path& path);
-std::shared_ptr<CWallet> LoadWallet(const std::string& name, const fs::path& path);
-void WalletShowInfo(CWallet* wallet_instance);
+//! Default for -compactdepth
+static const int DEFAULT_COMPACT_DEPTH = 1000;
+
 bool ExecuteWalletToolFunc(const std::string& command, const std::string& file);
 
 } // namespace WalletTool
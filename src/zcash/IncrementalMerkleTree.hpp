@@ -65,17 +65,14 @@ public:
     Hash empty_root(size_t depth) const {
         return Hash::EmptyRoot(depth);
     }
-    template <size_t D, typename H>
-    friend bool operator==(const EmptyMerkleRoots<D, H>& a,
-                           const EmptyMerkleRoots<D, H>& b);
-private:
-    std::array<Hash, Depth+1> empty_roots;
 };
 
+// The roots come from the constant tables behind Hash::EmptyRoot(), so all
+// instances are equal.
 template<size_t Depth, typename Hash>
 bool operator==(const EmptyMerkleRoots<Depth, Hash>& a,
                 const EmptyMerkleRoots<Depth, Hash>& b) {
-    return a.empty_roots == b.empty_roots;
+    return true;
 }
 
 template<size_t Depth, typename Hash>
@@ -100,6 +97,9 @@ public:
     size_t size() const;
 
     void append(Hash obj);
+    // Same as calling append() for each element in turn, but the hashes of
+    // each level of the new subtree are computed together.
+    void append_batch(const std::vector<Hash>& objs);
     Hash root() const {
         return root(Depth, std::deque<Hash>());
     }
@@ -129,6 +129,13 @@ public:
                            const IncrementalMerkleTree<D, H>& b);
 
 private:
+    // Subtree roots computed while appending a batch, by level: nodes[d][i]
+    // is the root of the subtree at depth d with index first[d] + i.
+    struct BatchNodes {
+        std::vector<uint64_t> first;
+        std::vector<std::vector<Hash>> nodes;
+    };
+
     static EmptyMerkleRoots<Depth, Hash> emptyroots;
     Optional<Hash> left;
     Optional<Hash> right;
@@ -140,6 +147,7 @@ private:
     bool is_complete(size_t depth = Depth) const;
     size_t next_depth(size_t skip) const;
     void wfcheck() const;
+    void append_batch(const std::vector<Hash>& objs, BatchNodes* computed);
 };
 
 template<size_t Depth, typename Hash>
@@ -179,6 +187,14 @@ public:
 
     void append(Hash obj);
 
+    // Appends objs to tree and to every witness in witnesses, which must all
+    // be witnesses into tree at its current size. Same as calling append()
+    // for each element on the tree and each witness, but the new subtree
+    // roots are computed once and shared, so a witness costs no hashing.
+    static void append_batch(IncrementalMerkleTree<Depth, Hash>& tree,
+                             const std::vector<Hash>& objs,
+                             const std::vector<IncrementalWitness*>& witnesses);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -222,6 +238,11 @@ public:
         const SHA256Compress& b,
         size_t depth
     );
+    // Combines nodes[2i] and nodes[2i+1] for every i.
+    static std::vector<SHA256Compress> combine_batch(
+        const std::vector<SHA256Compress>& nodes,
+        size_t depth
+    );
 
     static SHA256Compress uncommitted() {
         return SHA256Compress();
@@ -239,6 +260,11 @@ public:
         const PedersenHash& b,
         size_t depth
     );
+    // Combines nodes[2i] and nodes[2i+1] for every i.
+    static std::vector<PedersenHash> combine_batch(
+        const std::vector<PedersenHash>& nodes,
+        size_t depth
+    );
 
     static PedersenHash uncommitted();
     static PedersenHash EmptyRoot(size_t);
@@ -15,6 +15,10 @@
 #include <zcash/util.h>
 #include <librustzcash.h>
 
+#include <algorithm>
+#include <exception>
+#include <thread>
+
 using namespace libzcash;
 
 SproutNote::SproutNote() {
@@ -194,23 +198,19 @@ Optional<SaplingOutgoingPlaintext> SaplingOutgoingPlaintext::decrypt(
     }
 }
 
-Optional<SaplingNotePlaintext> SaplingNotePlaintext::decrypt(
-    const SaplingEncCiphertext &ciphertext,
+// Deserializes a decrypted plaintext and checks that it is a note to ivk
+// with note commitment cmu.
+static Optional<SaplingNotePlaintext> ParseSaplingEncPlaintext(
+    const SaplingEncPlaintext &pt,
     const uint256 &ivk,
-    const uint256 &epk,
     const uint256 &cmu
 )
 {
-    auto pt = AttemptSaplingEncDecryption(ciphertext, ivk, epk);
-    if (!pt) {
-        return nullopt;
-    }
-
     // Deserialize from the plaintext
     SaplingNotePlaintext ret;
     try {
         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-        ss << pt.get();
+        ss << pt;
         ss >> ret;
         assert(ss.size() == 0);
     } catch (...) {
@@ -241,6 +241,20 @@ Optional<SaplingNotePlaintext> SaplingNotePlaintext::decrypt(
     return ret;
 }
 
+Optional<SaplingNotePlaintext> SaplingNotePlaintext::decrypt(
+    const SaplingEncCiphertext &ciphertext,
+    const uint256 &ivk,
+    const uint256 &epk,
+    const uint256 &cmu
+)
+{
+    auto pt = AttemptSaplingEncDecryption(ciphertext, ivk, epk);
+    if (!pt) {
+        return nullopt;
+    }
+    return ParseSaplingEncPlaintext(pt.get(), ivk, cmu);
+}
+
 Optional<SaplingNotePlaintext> SaplingNotePlaintext::decrypt(
     const SaplingEncCiphertext &ciphertext,
     const uint256 &epk,
@@ -325,3 +339,63 @@ SaplingOutCiphertext SaplingOutgoingPlaintext::encrypt(
 
     return enc.encrypt_to_ourselves(ovk, cv, cm, pt);
 }
+
+std::vector<SaplingTrialDecryption> libzcash::TrialDecryptSaplingOutputs(
+    const std::vector<SaplingTrialOutput>& outputs,
+    const std::vector<SaplingIncomingViewingKey>& ivks,
+    int nThreads)
+{
+    // Each thread gets a contiguous range of outputs, so concatenating the
+    // results in thread order keeps them sorted.
+    if (nThreads <= 0) {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    nThreads = (int)std::min<size_t>(nThreads, std::max<size_t>(outputs.size(), 1));
+    const std::vector<uint256> ivk_list(ivks.begin(), ivks.end());
+
+    std::vector<std::vector<SaplingTrialDecryption>> found(nThreads);
+    std::vector<std::exception_ptr> errors(nThreads);
+    auto work = [&](int t) {
+        try {
+            const size_t begin = outputs.size() * t / nThreads;
+            const size_t end = outputs.size() * (t + 1) / nThreads;
+            // One key agreement call for the whole range
+            std::vector<uint256> epks;
+            for (size_t i = begin; i < end; i++) {
+                epks.push_back(*outputs[i].epk);
+            }
+            const std::vector<Optional<uint256>> secrets = SaplingKeyAgreeBatch(epks, ivk_list);
+            for (size_t i = begin; i < end; i++) {
+                const SaplingTrialOutput& output = outputs[i];
+                for (size_t j = 0; j < ivks.size(); j++) {
+                    const Optional<uint256>& dhsecret = secrets[(i - begin) * ivks.size() + j];
+                    if (!dhsecret) continue;
+                    auto enc = AttemptSaplingEncDecryptionWithSecret(*output.ciphertext, dhsecret.get(), *output.epk);
+                    if (!enc) continue;
+                    auto pt = ParseSaplingEncPlaintext(enc.get(), ivks[j], *output.cmu);
+                    if (pt) {
+                        found[t].push_back({i, j, pt.get()});
+                    }
+                }
+            }
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nThreads; t++) {
+        threads.emplace_back(work, t);
+    }
+    work(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<SaplingTrialDecryption> ret;
+    for (int t = 0; t < nThreads; t++) {
+        if (errors[t]) std::rethrow_exception(errors[t]);
+        ret.insert(ret.end(), found[t].begin(), found[t].end());
+    }
+    return ret;
+}
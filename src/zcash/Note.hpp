@@ -13,6 +13,7 @@
 #include <zcash/NoteEncryption.hpp>
 
 #include <array>
+#include <vector>
 
 namespace libzcash {
 
@@ -205,6 +206,35 @@ public:
     ) const;
 };
 
+//! The parts of a Sapling output needed to trial-decrypt it. The pointers
+//! must stay valid for the duration of the call.
+struct SaplingTrialOutput {
+    const SaplingEncCiphertext* ciphertext;
+    const uint256* epk;
+    const uint256* cmu;
+};
+
+//! A note found by TrialDecryptSaplingOutputs
+struct SaplingTrialDecryption {
+    //! Index of the output in the list that was searched
+    size_t output;
+    //! Index of the incoming viewing key that decrypted it
+    size_t ivk;
+    SaplingNotePlaintext plaintext;
+};
+
+/**
+ * Trial-decrypt every output with every incoming viewing key, as
+ * SaplingNotePlaintext::decrypt does for one pair, spreading the outputs over
+ * up to nThreads threads (0 means one per core). Each thread does the key
+ * agreement of all its pairs in one SaplingKeyAgreeBatch call. Returns the
+ * pairs that decrypted, ordered by output and then by key.
+ */
+std::vector<SaplingTrialDecryption> TrialDecryptSaplingOutputs(
+    const std::vector<SaplingTrialOutput>& outputs,
+    const std::vector<SaplingIncomingViewingKey>& ivks,
+    int nThreads = 0
+);
 
 }
 
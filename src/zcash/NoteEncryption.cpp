@@ -5,6 +5,7 @@
 
 #include <zcash/NoteEncryption.hpp>
 
+#include <memory>
 #include <stdexcept>
 
 #include <optional.h>
@@ -172,6 +173,15 @@ Optional<SaplingEncPlaintext> AttemptSaplingEncDecryption(
         return nullopt;
     }
 
+    return AttemptSaplingEncDecryptionWithSecret(ciphertext, dhsecret, epk);
+}
+
+Optional<SaplingEncPlaintext> AttemptSaplingEncDecryptionWithSecret(
+    const SaplingEncCiphertext &ciphertext,
+    const uint256 &dhsecret,
+    const uint256 &epk
+)
+{
     // Construct the symmetric key
     unsigned char K[NOTEENCRYPTION_CIPHER_KEYSIZE];
     KDF_Sapling(K, dhsecret, epk);
@@ -195,6 +205,28 @@ Optional<SaplingEncPlaintext> AttemptSaplingEncDecryption(
     return plaintext;
 }
 
+std::vector<Optional<uint256>> SaplingKeyAgreeBatch(
+    const std::vector<uint256> &epks,
+    const std::vector<uint256> &ivks
+)
+{
+    const size_t n = epks.size() * ivks.size();
+    std::vector<unsigned char> epk_bytes, ivk_bytes, result(n * 32);
+    for (const uint256& epk : epks) epk_bytes.insert(epk_bytes.end(), epk.begin(), epk.end());
+    for (const uint256& ivk : ivks) ivk_bytes.insert(ivk_bytes.end(), ivk.begin(), ivk.end());
+    std::unique_ptr<bool[]> valid(new bool[n]);
+
+    librustzcash_sapling_ka_agree_batch(epk_bytes.data(), epks.size(), ivk_bytes.data(), ivks.size(), result.data(), valid.get());
+
+    std::vector<Optional<uint256>> ret(n);
+    for (size_t i = 0; i < n; i++) {
+        if (valid[i]) {
+            ret[i] = uint256(std::vector<unsigned char>(result.begin() + i * 32, result.begin() + (i + 1) * 32));
+        }
+    }
+    return ret;
+}
+
 Optional<SaplingEncPlaintext> AttemptSaplingEncDecryption (
     const SaplingEncCiphertext &ciphertext,
     const uint256 &epk,
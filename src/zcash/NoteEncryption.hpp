@@ -19,6 +19,7 @@ https://github.com/zcash/zips/blob/master/protocol/protocol.pdf
 #include <zcash/Address.hpp>
 
 #include <array>
+#include <vector>
 
 namespace libzcash {
 
@@ -79,6 +80,24 @@ Optional<SaplingEncPlaintext> AttemptSaplingEncDecryption(
     const uint256 &epk
 );
 
+// Attempts to decrypt a Sapling note given the shared secret of its epk and
+// the recipient's ivk. This will not check that the contents of the
+// ciphertext are correct.
+Optional<SaplingEncPlaintext> AttemptSaplingEncDecryptionWithSecret(
+    const SaplingEncCiphertext &ciphertext,
+    const uint256 &dhsecret,
+    const uint256 &epk
+);
+
+// Computes the Sapling key agreement of every epk with every ivk in one call
+// into librustzcash, decompressing each epk only once. Entry
+// i * ivks.size() + j is the shared secret of epks[i] and ivks[j], or nullopt
+// if either of them is invalid.
+std::vector<Optional<uint256>> SaplingKeyAgreeBatch(
+    const std::vector<uint256> &epks,
+    const std::vector<uint256> &ivks
+);
+
 // Attempts to decrypt a Sapling note using outgoing plaintext.
 // This will not check that the contents of the ciphertext are correct.
 Optional<SaplingEncPlaintext> AttemptSaplingEncDecryption (
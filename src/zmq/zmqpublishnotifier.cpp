@@ -4,60 +4,237 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <optional.h>
 #include <streams.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
 #include <util/system.h>
 #include <rpc/server.h>
 
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
 static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_SEQUENCE  = "sequence";
+
+typedef std::shared_ptr<const std::vector<unsigned char>> ZMQData;
 
-// Internal function to send multipart message
-static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
+// Internal function to send a message part, consuming msg
+static int zmq_send_part(void *sock, zmq_msg_t& msg, int flags)
 {
-    va_list args;
-    va_start(args, size);
+    // Publish sockets drop messages rather than block, this makes sure of it
+    int rc = zmq_msg_send(&msg, sock, flags | ZMQ_DONTWAIT);
+    if (rc == -1)
+    {
+        zmqError("Unable to send ZMQ msg");
+        zmq_msg_close(&msg);
+        return -1;
+    }
 
-    while (1)
+    zmq_msg_close(&msg);
+    return 0;
+}
+
+// Internal function to send a copy of data as a message part
+static int zmq_send_copy(void *sock, const void* data, size_t size, int flags)
+{
+    zmq_msg_t msg;
+
+    int rc = zmq_msg_init_size(&msg, size);
+    if (rc != 0)
     {
-        zmq_msg_t msg;
+        zmqError("Unable to initialize ZMQ msg");
+        return -1;
+    }
 
-        int rc = zmq_msg_init_size(&msg, size);
-        if (rc != 0)
-        {
-            zmqError("Unable to initialize ZMQ msg");
-            va_end(args);
-            return -1;
-        }
+    if (size > 0)
+        memcpy(zmq_msg_data(&msg), data, size);
+
+    return zmq_send_part(sock, msg, flags);
+}
+
+static void zmq_free_shared(void * /*data*/, void *hint)
+{
+    delete static_cast<ZMQData*>(hint);
+}
+
+// Internal function to send shared data as a message part without copying
+// it; zmq holds a reference until the part is sent
+static int zmq_send_shared(void *sock, const ZMQData& data, int flags)
+{
+    if (data->empty())
+        return zmq_send_copy(sock, nullptr, 0, flags);
+
+    ZMQData* ref = new ZMQData(data);
+    zmq_msg_t msg;
+
+    int rc = zmq_msg_init_data(&msg, const_cast<unsigned char*>(data->data()), data->size(), zmq_free_shared, ref);
+    if (rc != 0)
+    {
+        zmqError("Unable to initialize ZMQ msg");
+        delete ref;
+        return -1;
+    }
+
+    return zmq_send_part(sock, msg, flags);
+}
+
+namespace {
 
-        void *buf = zmq_msg_data(&msg);
-        memcpy(buf, data, size);
+/** A message queued for the publisher thread */
+struct ZMQMessage
+{
+    void *socket;
+    const char *command;
+    //! The data, which may be shared with other notifiers of the same event
+    ZMQData data;
+    //! Without data, the block to read from disk and publish
+    const CBlockIndex *block;
+    uint32_t sequence;
+};
+
+/**
+ * Sends the messages of all publish notifiers from one thread, so that the
+ * validation interface callbacks only queue them and a slow subscriber or
+ * reading a block from disk does not hold up the callbacks of others. zmq
+ * sockets are not thread safe and the notifiers of an address share theirs,
+ * so all sends happen on this thread, in the order they were queued.
+ */
+class CZMQPublisher
+{
+public:
+    void Start();
+    void Stop();
+    //! Returns false when the queue is full or the publisher stopped, dropping the message
+    bool Enqueue(ZMQMessage&& message);
+
+private:
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<ZMQMessage> m_queue GUARDED_BY(m_mutex);
+    bool m_running GUARDED_BY(m_mutex) {false};
+    std::thread m_thread;
+
+    //! The block read last, kept for the other notifiers publishing it
+    const CBlockIndex *m_last_block {nullptr};
+    ZMQData m_last_block_data;
+
+    void ThreadPublish();
+    ZMQData ReadBlock(const CBlockIndex *pindex);
+    void Send(const ZMQMessage& message);
+};
+
+void CZMQPublisher::Start()
+{
+    {
+        LOCK(m_mutex);
+        m_running = true;
+    }
+    m_thread = std::thread(&TraceThread<std::function<void()>>, "zmqpub", std::bind(&CZMQPublisher::ThreadPublish, this));
+}
 
-        data = va_arg(args, const void*);
+void CZMQPublisher::Stop()
+{
+    {
+        LOCK(m_mutex);
+        m_running = false;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+    m_last_block = nullptr;
+    m_last_block_data.reset();
+}
 
-        rc = zmq_msg_send(&msg, sock, data ? ZMQ_SNDMORE : 0);
-        if (rc == -1)
+bool CZMQPublisher::Enqueue(ZMQMessage&& message)
+{
+    {
+        LOCK(m_mutex);
+        if (!m_running || m_queue.size() >= ZMQ_PUBLISH_QUEUE_SIZE) return false;
+        m_queue.push_back(std::move(message));
+    }
+    m_cond.notify_one();
+    return true;
+}
+
+void CZMQPublisher::ThreadPublish()
+{
+    while (true) {
+        // Take everything queued at once, sending it without the lock
+        std::deque<ZMQMessage> batch;
         {
-            zmqError("Unable to send ZMQ msg");
-            zmq_msg_close(&msg);
-            va_end(args);
-            return -1;
+            WAIT_LOCK(m_mutex, lock);
+            while (m_running && m_queue.empty())
+                m_cond.wait(lock);
+            // Once stopped, what is still queued is sent first
+            if (m_queue.empty()) break;
+            batch.swap(m_queue);
         }
+        for (const ZMQMessage& message : batch) {
+            Send(message);
+        }
+    }
+}
 
-        zmq_msg_close(&msg);
+ZMQData CZMQPublisher::ReadBlock(const CBlockIndex *pindex)
+{
+    if (pindex == m_last_block) return m_last_block_data;
 
-        if (!data)
-            break;
+    auto data = std::make_shared<std::vector<unsigned char>>();
+    if (RPCSerializationFlags() == 0) {
+        // The block as it is stored, without decoding and encoding it again
+        if (!ReadRawBlockFromDisk(*data, pindex, Params().MessageStart())) {
+            zmqError("Can't read block from disk");
+            return nullptr;
+        }
+    } else {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            zmqError("Can't read block from disk");
+            return nullptr;
+        }
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), *data, 0, block);
+    }
 
-        size = va_arg(args, size_t);
+    m_last_block = pindex;
+    m_last_block_data = data;
+    return m_last_block_data;
+}
+
+void CZMQPublisher::Send(const ZMQMessage& message)
+{
+    ZMQData data = message.data;
+    if (!data) {
+        data = ReadBlock(message.block);
+        // Subscribers see the missing message from the sequence number
+        if (!data) return;
     }
-    va_end(args);
-    return 0;
+
+    /* send three parts, command & data & a LE 4byte sequence number */
+    unsigned char msgseq[sizeof(uint32_t)];
+    WriteLE32(&msgseq[0], message.sequence);
+    if (zmq_send_copy(message.socket, message.command, strlen(message.command), ZMQ_SNDMORE) != 0) return;
+    if (zmq_send_shared(message.socket, data, ZMQ_SNDMORE) != 0) return;
+    zmq_send_copy(message.socket, msgseq, sizeof(msgseq), 0);
+}
+
+CZMQPublisher g_zmq_publisher;
+
+} // namespace
+
+void StartZMQPublisher()
+{
+    g_zmq_publisher.Start();
+}
+
+void StopZMQPublisher()
+{
+    g_zmq_publisher.Stop();
 }
 
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
@@ -142,17 +319,31 @@ void CZMQAbstractPublishNotifier::Shutdown()
 }
 
 bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+{
+    const unsigned char *begin = static_cast<const unsigned char*>(data);
+    return SendMessage(command, std::make_shared<const std::vector<unsigned char>>(begin, begin + size));
+}
+
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, std::shared_ptr<const std::vector<unsigned char>> data)
 {
     assert(psocket);
 
-    /* send three parts, command & data & a LE 4byte sequence number */
-    unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), nullptr);
-    if (rc == -1)
-        return false;
+    if (!g_zmq_publisher.Enqueue({psocket, command, std::move(data), nullptr, nSequence}))
+        LogPrint(BCLog::ZMQ, "zmq: Dropped %s message %d, the publisher queue is full\n", command, nSequence);
+
+    /* increment memory only sequence number after queueing, dropped or not */
+    nSequence++;
+
+    return true;
+}
+
+bool CZMQAbstractPublishNotifier::SendBlock(const char *command, const CBlockIndex *pindex)
+{
+    assert(psocket);
+
+    if (!g_zmq_publisher.Enqueue({psocket, command, nullptr, pindex, nSequence}))
+        LogPrint(BCLog::ZMQ, "zmq: Dropped %s message %d, the publisher queue is full\n", command, nSequence);
 
-    /* increment memory only sequence number after sending */
     nSequence++;
 
     return true;
@@ -182,28 +373,55 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
+    return SendBlock(MSG_RAWBLOCK, pindex);
+}
+
+bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
+    auto data = std::make_shared<std::vector<unsigned char>>();
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), *data, 0, transaction);
+    return SendMessage(MSG_RAWTX, std::move(data));
+}
 
-        ss << block;
+// Helper function to send a 'sequence' topic message with the following structure:
+//    <32-byte hash> | <1-byte label> | <8-byte LE sequence> (optional)
+static bool SendSequenceMsg(CZMQAbstractPublishNotifier& notifier, const uint256& hash, char label, Optional<uint64_t> sequence = nullopt)
+{
+    unsigned char data[sizeof(hash) + sizeof(label) + sizeof(uint64_t)];
+    for (unsigned int i = 0; i < sizeof(hash); ++i) {
+        data[sizeof(hash) - 1 - i] = hash.begin()[i];
     }
+    data[sizeof(hash)] = label;
+    if (sequence) WriteLE64(data + sizeof(hash) + sizeof(label), *sequence);
+    return notifier.SendMessage(MSG_SEQUENCE, data, sequence ? sizeof(data) : sizeof(hash) + sizeof(label));
+}
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const CBlockIndex *pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block connect %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Block (C)onnect */ 'C');
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const CBlockIndex *pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block disconnect %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Block (D)isconnect */ 'D');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence)
 {
     uint256 hash = transaction.GetHash();
-    LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    LogPrint(BCLog::ZMQ, "zmq: Publish hashtx mempool acceptance %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Mempool (A)cceptance */ 'A', mempool_sequence);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &transaction, uint64_t mempool_sequence)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish hashtx mempool removal %s\n", hash.GetHex());
+    return SendSequenceMsg(*this, hash, /* Mempool (R)emoval */ 'R', mempool_sequence);
 }
@@ -7,8 +7,19 @@
 
 #include <zmq/zmqabstractnotifier.h>
 
+#include <memory>
+#include <vector>
+
 class CBlockIndex;
 
+//! Messages queued for the publisher thread, at most; beyond that new ones are dropped
+static const size_t ZMQ_PUBLISH_QUEUE_SIZE = 10000;
+
+/** Start the thread that sends the messages of all publish notifiers. */
+void StartZMQPublisher();
+/** Send the messages still queued and stop the thread, before closing the sockets. */
+void StopZMQPublisher();
+
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
@@ -16,13 +27,19 @@ private:
 
 public:
 
-    /* send zmq multipart message
+    /* queue zmq multipart message for the publisher thread
        parts:
           * command
           * data
           * message sequence number
+       A message dropped because the queue is full still takes its
+       sequence number, so that subscribers see the gap.
     */
     bool SendMessage(const char *command, const void* data, size_t size);
+    bool SendMessage(const char *command, std::shared_ptr<const std::vector<unsigned char>> data);
+    /* queue a message with the serialized block, which the publisher
+       thread reads from disk once for all notifiers publishing it */
+    bool SendBlock(const char *command, const CBlockIndex *pindex);
 
     bool Initialize(void *pcontext) override;
     void Shutdown() override;
@@ -52,4 +69,13 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnect(const CBlockIndex *pindex) override;
+    bool NotifyBlockDisconnect(const CBlockIndex *pindex) override;
+    bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence) override;
+    bool NotifyTransactionRemoval(const CTransaction &transaction, uint64_t mempool_sequence) override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
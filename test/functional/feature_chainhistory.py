@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The LitecoinZ Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the ZIP 221 chain history tree kept with -chainhistory.
+
+- the tree is built from the blocks on disk when enabled on startup
+- a leaf is appended for each connected block and removed for each disconnected one
+- the tree catches up with blocks connected while disabled
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error
+
+
+def history_length(leaves):
+    return 2 * leaves - bin(leaves).count('1')
+
+
+class ChainHistoryTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [['-chainhistory'], []]
+
+    def check_history(self, node):
+        history = node.getchainhistory()
+        # Sapling is active from the start on regtest, so every block but the genesis block has a leaf.
+        leaves = node.getblockcount()
+        assert_equal(history['leaves'], leaves)
+        assert_equal(history['length'], history_length(leaves))
+        assert_equal(history['tip'], node.getbestblockhash())
+        assert_equal(len(history['peaks']), bin(leaves).count('1'))
+        return history
+
+    def run_test(self):
+        node = self.nodes[0]
+        address = node.get_deterministic_priv_key().address
+
+        self.log.info("The tree was built from the blocks on disk")
+        self.check_history(node)
+        assert_raises_rpc_error(-1, "restart with -chainhistory", self.nodes[1].getchainhistory)
+
+        self.log.info("Nodes can be fetched by position")
+        length = node.getchainhistory()['length']
+        assert_equal(len(node.getchainhistory(0)), 2 * 171)
+        # The first 32 bytes of the first leaf are the hash of block 1, in serialization order.
+        assert_equal(node.getchainhistory(0)[:64], bytes.fromhex(node.getblockhash(1))[::-1].hex())
+        assert_raises_rpc_error(-8, "out of range", node.getchainhistory, length)
+        assert_raises_rpc_error(-8, "out of range", node.getchainhistory, -1)
+
+        self.log.info("Leaves follow connected and disconnected blocks")
+        node.generatetoaddress(10, address)
+        root = self.check_history(node)['root']
+        node.invalidateblock(node.getblockhash(205))
+        self.check_history(node)
+        node.reconsiderblock(node.getblockhash(205))
+        assert_equal(self.check_history(node)['root'], root)
+
+        self.log.info("The tree is written with the block index")
+        self.restart_node(0)
+        assert_equal(self.check_history(node)['root'], root)
+
+        self.log.info("The tree catches up with blocks connected while disabled")
+        self.restart_node(0, extra_args=['-chainhistory=0'])
+        assert_raises_rpc_error(-1, "restart with -chainhistory", node.getchainhistory)
+        node.generatetoaddress(5, address)
+        node.invalidateblock(node.getblockhash(214))
+        node.generatetoaddress(3, address)
+        self.restart_node(0)
+        self.check_history(node)
+        assert_equal(node.getblockcount(), 216)
+
+
+if __name__ == '__main__':
+    ChainHistoryTest().main()
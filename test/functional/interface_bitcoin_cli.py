@@ -3,6 +3,8 @@
 # Distributed under the MIT software license, see the accompanying
 # file COPYING or http://www.opensource.org/licenses/mit-license.php.
 """Test litecoinz-cli"""
+import json
+
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import assert_equal, assert_raises_process_error, get_auth_cookie
 
@@ -42,6 +44,14 @@ class TestBitcoinCli(BitcoinTestFramework):
         assert_equal(["foo", "bar"], self.nodes[0].cli('-rpcuser=%s' % user, '-stdin', '-stdinrpcpass', input=password + "\nfoo\nbar").echo())
         assert_raises_process_error(1, "Incorrect rpcuser or rpcpassword", self.nodes[0].cli('-rpcuser=%s' % user, '-stdin', '-stdinrpcpass', input="foo").echo)
 
+        self.log.info("Test -batch")
+        replies = [json.loads(line) for line in self.nodes[0].cli('-batch', '-batchsize=2', input="getblockcount\nechojson 1 [2]\n\necho foo\n").send_cli().splitlines()]
+        assert_equal([reply['id'] for reply in replies], [0, 1, 0])
+        assert_equal(replies[0]['result'], self.nodes[0].getblockcount())
+        assert_equal(replies[1]['result'], [1, [2]])
+        assert_equal(replies[2]['result'], ["foo"])
+        assert_raises_process_error(1, "-batch reads all commands from standard input", self.nodes[0].cli('-batch').echo)
+
         self.log.info("Test connecting to a non-existing server")
         assert_raises_process_error(1, "Could not connect to the server", self.nodes[0].cli('-rpcport=1').echo)
 
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The LitecoinZ Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the /metrics endpoint."""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+import http.client
+import urllib.parse
+
+class MetricsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [['-metrics'], []]
+        self.supports_cli = False
+
+    def get_metrics(self, node):
+        url = urllib.parse.urlparse(node.url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', '/metrics')
+        response = conn.getresponse()
+        body = response.read().decode('utf-8')
+        conn.close()
+        return response.status, response.getheader('Content-Type'), body
+
+    def run_test(self):
+        self.log.info("Check that /metrics is served without authentication")
+        self.nodes[0].generatetoaddress(2, self.nodes[0].get_deterministic_priv_key().address)
+        self.sync_all()
+        status, content_type, body = self.get_metrics(self.nodes[0])
+        assert_equal(status, 200)
+        assert content_type.startswith('text/plain; version=0.0.4')
+
+        samples = {}
+        for line in body.splitlines():
+            if line.startswith('#'):
+                continue
+            name, value = line.rsplit(' ', 1)
+            samples[name] = float(value)
+
+        assert_equal(samples['litecoinz_blocks'], self.nodes[0].getblockcount())
+        assert samples['litecoinz_net_sent_bytes_total{type="ping"}'] >= 0
+        assert samples['litecoinz_net_received_bytes_total{type="version"}'] > 0
+        assert_equal(samples['litecoinz_peers{direction="outbound"}'] + samples['litecoinz_peers{direction="inbound"}'], len(self.nodes[0].getpeerinfo()))
+        assert_equal(samples['litecoinz_mempool_transactions'], self.nodes[0].getmempoolinfo()['size'])
+        assert samples['litecoinz_validation_seconds_count{phase="connect_block"}'] >= 2
+        assert_equal(samples['litecoinz_validation_seconds_bucket{phase="connect_block",le="+Inf"}'],
+                     samples['litecoinz_validation_seconds_count{phase="connect_block"}'])
+        assert samples['litecoinz_rpc_calls_total{method="generatetoaddress"}'] >= 1
+        assert_equal(samples['litecoinz_rpc_in_flight{method="generatetoaddress"}'], 0)
+        assert_equal(samples['litecoinz_rpc_seconds_count{method="generatetoaddress"}'],
+                     samples['litecoinz_rpc_calls_total{method="generatetoaddress"}'])
+
+        self.log.info("Check that /metrics is off by default")
+        status, _, _ = self.get_metrics(self.nodes[1])
+        assert_equal(status, 404)
+
+if __name__ == '__main__':
+    MetricsTest().main()
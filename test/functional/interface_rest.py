@@ -281,6 +281,27 @@ class RESTTest (BitcoinTestFramework):
         json_obj = self.test_rest_request("/headers/5/{}".format(bb_hash))
         assert_equal(len(json_obj), 5)  # now we should have 5 header objects
 
+        self.log.info("Test the block and header range URIs")
+        start = json_obj[0]['height']
+        headers_bytes = self.test_rest_request("/headers/5/{}".format(bb_hash), req_type=ReqType.BIN, ret_type=RetType.BYTES)
+        assert_equal(self.test_rest_request("/headers/{}/5".format(start), req_type=ReqType.BIN, ret_type=RetType.BYTES), headers_bytes)
+        # The range ends at the tip
+        tip_height = self.nodes[0].getblockcount()
+        headers_bytes = self.test_rest_request("/headers/{}/1000".format(start), req_type=ReqType.BIN, ret_type=RetType.BYTES)
+        assert_equal(len(headers_bytes), (tip_height - start + 1) * BLOCK_HEADER_SIZE)
+
+        blocks_bytes = b''.join(self.test_rest_request("/block/{}".format(header['hash']), req_type=ReqType.BIN, ret_type=RetType.BYTES) for header in json_obj)
+        assert_equal(self.test_rest_request("/blocks/{}/5".format(start), req_type=ReqType.BIN, ret_type=RetType.BYTES), blocks_bytes)
+
+        resp = self.test_rest_request("/blocks/abc/5", req_type=ReqType.BIN, ret_type=RetType.OBJ, status=400)
+        assert_equal(resp.read().decode('utf-8').rstrip(), "Invalid height: abc")
+        resp = self.test_rest_request("/blocks/{}/0".format(start), req_type=ReqType.BIN, ret_type=RetType.OBJ, status=400)
+        assert_equal(resp.read().decode('utf-8').rstrip(), "Count out of range: 0")
+        resp = self.test_rest_request("/blocks/{}/5".format(tip_height + 1), req_type=ReqType.BIN, ret_type=RetType.OBJ, status=404)
+        assert_equal(resp.read().decode('utf-8').rstrip(), "Block height out of range")
+        self.test_rest_request("/blocks/{}/5".format(start), ret_type=RetType.OBJ, status=404)
+        self.test_rest_request("/headers/{}/5".format(start), ret_type=RetType.OBJ, status=404)
+
         self.log.info("Test tx inclusion in the /mempool and /block URIs")
 
         # Make 3 tx and mine them on node 1
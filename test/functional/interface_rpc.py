@@ -7,7 +7,7 @@
 import os
 from test_framework.authproxy import JSONRPCException
 from test_framework.test_framework import BitcoinTestFramework
-from test_framework.util import assert_equal, assert_greater_than_or_equal
+from test_framework.util import assert_equal, assert_greater_than_or_equal, assert_raises_rpc_error
 
 def expect_http_status(expected_http_status, expected_rpc_code,
                        fcn, *args):
@@ -35,6 +35,23 @@ class RPCInterfaceTest(BitcoinTestFramework):
         assert_greater_than_or_equal(command['duration'], 0)
         assert_equal(info['logpath'], os.path.join(self.nodes[0].datadir, self.chain, 'debug.log'))
 
+        self.log.info("Testing getrpcinfo method stats...")
+        empty = {'calls': 0, 'errors': 0}
+        before = info['methods']
+        self.nodes[0].getblockcount()
+        assert_raises_rpc_error(-8, "Block height out of range", self.nodes[0].getblockhash, 42)
+        methods = self.nodes[0].getrpcinfo()['methods']
+        count = methods['getblockcount']
+        assert_equal(count['calls'], before.get('getblockcount', empty)['calls'] + 1)
+        assert_equal(count['errors'], before.get('getblockcount', empty)['errors'])
+        assert_equal(count['in_flight'], 0)
+        assert_equal(sum(count['histogram']), count['calls'])
+        assert_equal(len(count['histogram']), len(info['bucket_bounds_ms']) + 1)
+        hash_stats = methods['getblockhash']
+        assert_equal(hash_stats['errors'], before.get('getblockhash', empty)['errors'] + 1)
+        # The getrpcinfo call being answered is in flight.
+        assert_equal(methods['getrpcinfo']['in_flight'], 1)
+
     def test_batch_request(self):
         self.log.info("Testing basic JSON-RPC batch request...")
 
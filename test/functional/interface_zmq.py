@@ -48,6 +48,7 @@ class ZMQTest (BitcoinTestFramework):
         try:
             self.test_basic()
             self.test_reorg()
+            self.test_sequence()
         finally:
             # Destroy the ZMQ context.
             self.log.debug("Destroying ZMQ context")
@@ -156,5 +157,39 @@ class ZMQTest (BitcoinTestFramework):
         # Should receive nodes[1] tip
         assert_equal(self.nodes[1].getbestblockhash(), hashblock.receive().hex())
 
+    def test_sequence(self):
+        import zmq
+        address = 'tcp://127.0.0.1:28334'
+        socket = self.ctx.socket(zmq.SUB)
+        socket.set(zmq.RCVTIMEO, 60000)
+        seq = ZMQSubscriber(socket, b'sequence')
+
+        self.restart_node(0, ['-zmqpub%s=%s' % (seq.topic.decode(), address)])
+        connect_nodes(self.nodes[0], 1)
+        socket.connect(address)
+        # Relax so that the subscriber is ready before publishing zmq messages
+        sleep(0.2)
+
+        self.log.info("Test the sequence notifications of a connected and a disconnected block")
+        best_hash = self.nodes[0].generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+        body = seq.receive()
+        assert_equal((body[:32].hex(), body[32:]), (best_hash, b'C'))
+        self.nodes[0].invalidateblock(best_hash)
+        body = seq.receive()
+        assert_equal((body[:32].hex(), body[32:]), (best_hash, b'D'))
+        self.nodes[0].reconsiderblock(best_hash)
+        body = seq.receive()
+        assert_equal((body[:32].hex(), body[32:]), (best_hash, b'C'))
+
+        if self.is_wallet_compiled():
+            self.log.info("Test the sequence notification of a transaction added to the mempool")
+            mempool_sequence = self.nodes[0].getrawmempool(False, True)["mempool_sequence"]
+            payment_txid = self.nodes[1].sendtoaddress(self.nodes[0].getnewaddress(), 1.0)
+            self.sync_all()
+            body = seq.receive()
+            assert_equal((body[:32].hex(), body[32:33]), (payment_txid, b'A'))
+            assert_equal(struct.unpack('<Q', body[33:])[0], mempool_sequence)
+            assert_equal(self.nodes[0].getrawmempool(False, True), {"txids": [payment_txid], "mempool_sequence": mempool_sequence + 1})
+
 if __name__ == '__main__':
     ZMQTest().main()
@@ -61,8 +61,10 @@ class BlockchainTest(BitcoinTestFramework):
         self._test_getblockheader()
         self._test_getdifficulty()
         self._test_getnetworkhashps()
+        self._test_getvalidationqueueinfo()
         self._test_stopatheight()
         self._test_waitforblockheight()
+        self._test_getvalidationstats()
         assert self.nodes[0].verifychain(4, 0)
 
     def mine_chain(self):
@@ -89,11 +91,20 @@ class BlockchainTest(BitcoinTestFramework):
             'pruned',
             'size_on_disk',
             'softforks',
+            'valuePools',
             'verificationprogress',
             'warnings',
         ]
         res = self.nodes[0].getblockchaininfo()
 
+        # no shielded transactions in the test chain
+        assert_equal([pool['id'] for pool in res['valuePools']], ['sprout', 'sapling'])
+        for pool in res['valuePools']:
+            assert_equal(pool['monitored'], True)
+            assert_equal(pool['chainValueZat'], 0)
+            assert_equal(pool['notes'], 0)
+            assert_equal(pool['nullifiers'], 0)
+
         # result should have these additional pruning keys if manual pruning is enabled
         assert_equal(sorted(res.keys()), sorted(['pruneheight', 'automatic_pruning'] + keys))
 
@@ -241,6 +252,28 @@ class BlockchainTest(BitcoinTestFramework):
         del res['disk_size'], res3['disk_size']
         assert_equal(res, res3)
 
+        self.log.info("Test hash_type option for gettxoutsetinfo()")
+        # hash_serialized_2 is the default.
+        res4 = node.gettxoutsetinfo(hash_type='hash_serialized_2')
+        del res4['disk_size']
+        assert_equal(res, res4)
+
+        # hash_type none returns no UTXO set hash.
+        res5 = node.gettxoutsetinfo(hash_type='none')
+        assert 'hash_serialized_2' not in res5
+        assert 'muhash' not in res5
+
+        # hash_type muhash returns the multiset hash instead.
+        res6 = node.gettxoutsetinfo(hash_type='muhash')
+        assert 'hash_serialized_2' not in res6
+        assert_equal(len(res6['muhash']), 64)
+        assert res['hash_serialized_2'] != res6['muhash']
+        for r in [res, res2, res3, res4]:
+            assert 'muhash' not in r
+
+        assert_raises_rpc_error(-8, "foohash is not a valid hash_type", node.gettxoutsetinfo, "foohash")
+        assert_raises_rpc_error(-8, "Querying specific block heights requires -coinstatsindex", node.gettxoutsetinfo, "muhash", 100)
+
     def _test_getblockheader(self):
         node = self.nodes[0]
 
@@ -280,6 +313,16 @@ class BlockchainTest(BitcoinTestFramework):
         # This should be 2 hashes every 10 minutes or 1/300
         assert abs(hashes_per_second * 300 - 1) < 0.0001
 
+    def _test_getvalidationqueueinfo(self):
+        self.nodes[0].syncwithvalidationinterfacequeue()
+        queues = {queue['name']: queue for queue in self.nodes[0].getvalidationqueueinfo()}
+        assert 'net' in queues
+        for queue in queues.values():
+            assert_equal(queue['pending'], 0)
+            assert_greater_than_or_equal(queue['peak_pending'], 0)
+            assert_greater_than_or_equal(queue['callbacks'], 0)
+            assert_greater_than_or_equal(queue['run_time'], 0)
+
     def _test_stopatheight(self):
         assert_equal(self.nodes[0].getblockcount(), 200)
         self.nodes[0].generatetoaddress(6, self.nodes[0].get_deterministic_priv_key().address)
@@ -333,6 +376,24 @@ class BlockchainTest(BitcoinTestFramework):
         assert_waitforheight(current_height)
         assert_waitforheight(current_height + 1)
 
+    def _test_getvalidationstats(self):
+        self.log.info("Test getvalidationstats")
+        node = self.nodes[0]
+        before = node.getvalidationstats()
+        node.generatetoaddress(1, node.get_deterministic_priv_key().address)
+        stats = node.getvalidationstats()
+        bounds = stats['bucket_bounds_ms']
+        assert_equal(bounds, sorted(bounds))
+        for name in ['equihash', 'proof_verification', 'note_commitments', 'connect_block']:
+            assert name in stats['phases']
+        for name, phase in stats['phases'].items():
+            assert_equal(len(phase['histogram']), len(bounds) + 1)
+            assert_equal(sum(phase['histogram']), phase['count'])
+            assert_equal(phase['recent']['count'], min(phase['count'], 100))
+            assert_greater_than_or_equal(phase['recent']['max_ms'], phase['recent']['p90_ms'])
+        for name in ['connect_block', 'connect_total', 'write_chainstate']:
+            assert_equal(stats['phases'][name]['count'], before['phases'][name]['count'] + 1)
+
 
 if __name__ == '__main__':
     BlockchainTest().main()
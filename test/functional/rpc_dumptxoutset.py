@@ -4,11 +4,97 @@
 # file COPYING or http://www.opensource.org/licenses/mit-license.php.
 """Test the generation of UTXO snapshots using `dumptxoutset`.
 """
+from test_framework.messages import deser_compact_size, deser_uint256
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import assert_equal, assert_raises_rpc_error
 
 import hashlib
+from io import BytesIO
 from pathlib import Path
+import struct
+
+
+def deser_varint(f):
+    """Read a VARINT as written by serialize.h."""
+    n = 0
+    while True:
+        b = f.read(1)[0]
+        n = (n << 7) | (b & 0x7f)
+        if b & 0x80:
+            n += 1
+        else:
+            return n
+
+
+def decompress_amount(x):
+    """Inverse of CompressAmount() in compressor.cpp."""
+    if x == 0:
+        return 0
+    x -= 1
+    e = x % 10
+    x //= 10
+    if e < 9:
+        d = (x % 9) + 1
+        x //= 9
+        n = x * 10 + d
+    else:
+        n = x + 1
+    return n * 10 ** e
+
+
+def deser_compressed_script(f):
+    """Read a script compressed by ScriptCompression, returning it as hex."""
+    size = deser_varint(f)
+    if size == 0:
+        return '76a914' + f.read(20).hex() + '88ac'
+    if size == 1:
+        return 'a914' + f.read(20).hex() + '87'
+    if size in (2, 3):
+        return '21' + bytes([size]).hex() + f.read(32).hex() + 'ac'
+    assert size >= 6, "uncompressed public keys are not expected in this chain"
+    return f.read(size - 6).hex()
+
+
+def deser_optional_hash(f):
+    return deser_uint256(f) if f.read(1)[0] else None
+
+
+class Snapshot:
+    """A UTXO snapshot as written by WriteUTXOSnapshot(): metadata, coins,
+    Sapling nullifiers and Sapling anchors."""
+    def __init__(self, data):
+        f = BytesIO(data)
+        self.base_blockhash = deser_uint256(f)
+        self.coins_count, = struct.unpack("<Q", f.read(8))
+        self.nchaintx, = struct.unpack("<I", f.read(4))
+        self.sapling_anchor = deser_uint256(f)
+        self.nullifiers_count, self.anchors_count = struct.unpack("<QQ", f.read(16))
+
+        self.coins = []
+        for _ in range(self.coins_count):
+            txid = deser_uint256(f)
+            n, = struct.unpack("<I", f.read(4))
+            code = deser_varint(f)
+            value = decompress_amount(deser_varint(f))
+            script = deser_compressed_script(f)
+            self.coins.append((txid, n, code >> 1, code & 1, value, script))
+
+        self.nullifiers = []
+        for _ in range(self.nullifiers_count):
+            nullifier = deser_uint256(f)
+            height, = struct.unpack("<I", f.read(4))
+            self.nullifiers.append((nullifier, height))
+
+        self.anchors = []
+        for _ in range(self.anchors_count):
+            anchor = deser_uint256(f)
+            # SaplingMerkleTree: left, right and the parents, each optional
+            left = deser_optional_hash(f)
+            right = deser_optional_hash(f)
+            parents = [deser_optional_hash(f) for _ in range(deser_compact_size(f))]
+            self.anchors.append((anchor, left, right, parents))
+
+        assert_equal(f.read(), b'')
 
 
 class DumptxoutsetTest(BitcoinTestFramework):
@@ -30,6 +116,7 @@ class DumptxoutsetTest(BitcoinTestFramework):
         assert expected_path.is_file()
 
         assert_equal(out['coins_written'], 100)
+        assert_equal(out['nullifiers_written'], 0)
         assert_equal(out['base_height'], 100)
         assert_equal(out['path'], str(expected_path))
         # Blockhash should be deterministic based on mocked time.
@@ -38,10 +125,33 @@ class DumptxoutsetTest(BitcoinTestFramework):
             '6fd417acba2a8738b06fee43330c50d58e6a725046c3d843c8dd7e51d46d1ed6')
 
         with open(str(expected_path), 'rb') as f:
-            digest = hashlib.sha256(f.read()).hexdigest()
-            # UTXO snapshot hash should be deterministic based on mocked time.
-            assert_equal(
-                digest, 'be032e5f248264ba08e11099ac09dbd001f6f87ffc68bf0f87043d8146d50664')
+            data = f.read()
+
+        # Every field of the snapshot matches the chain, and nothing follows
+        # the anchors.
+        snapshot = Snapshot(data)
+        assert_equal(snapshot.base_blockhash, int(out['base_hash'], 16))
+        assert_equal(snapshot.coins_count, 100)
+        assert_equal(snapshot.nchaintx, node.getchaintxstats(blockhash=out['base_hash'])['txcount'])
+        assert_equal(snapshot.nullifiers_count, out['nullifiers_written'])
+        assert_equal(snapshot.anchors_count, out['anchors_written'])
+        assert_equal(snapshot.nullifiers, [])
+
+        coinbase_txids = {int(node.getblock(node.getblockhash(height))['tx'][0], 16): height for height in range(1, 101)}
+        assert_equal(sorted(coin[0] for coin in snapshot.coins), sorted(coinbase_txids))
+        for txid, n, height, coinbase, value, script in snapshot.coins:
+            utxo = node.gettxout('{:064x}'.format(txid), n)
+            assert_equal(height, coinbase_txids[txid])
+            assert_equal(coinbase, 1)
+            assert_equal(value, int(round(utxo['value'] * 10 ** 8)))
+            assert_equal(script, utxo['scriptPubKey']['hex'])
+
+        # The snapshot is deterministic: a second dump of the same chain is
+        # the same file, whatever threads the coins were read on.
+        out2 = node.dumptxoutset('txoutset2.dat')
+        assert_equal(out2['shielded_hash'], out['shielded_hash'])
+        with open(out2['path'], 'rb') as f:
+            assert_equal(hashlib.sha256(f.read()).hexdigest(), hashlib.sha256(data).hexdigest())
 
         # Specifying a path to an existing file will fail.
         assert_raises_rpc_error(
@@ -10,7 +10,7 @@ from test_framework.util import (
     connect_nodes, disconnect_nodes, sync_blocks
     )
 
-FILTER_TYPES = ["basic"]
+FILTER_TYPES = ["basic", "shielded"]
 
 class GetBlockFilterTest(BitcoinTestFramework):
     def set_test_params(self):
@@ -160,6 +160,23 @@ class GetblockstatsTest(BitcoinTestFramework):
         assert_raises_rpc_error(-1, 'getblockstats hash_or_height ( stats )', self.nodes[0].getblockstats, '00', 1, 2)
         assert_raises_rpc_error(-1, 'getblockstats hash_or_height ( stats )', self.nodes[0].getblockstats)
 
+        self.log.info('Test getblockstatsrange')
+        end_height = self.start_height + self.max_stat_pos
+        assert_equal(self.nodes[0].getblockstatsrange(self.start_height, end_height), self.expected_stats)
+        assert_equal(self.nodes[0].getblockstatsrange(self.start_height, end_height, ['height']),
+                      [{'height': self.start_height + i} for i in range(self.max_stat_pos + 1)])
+        assert_raises_rpc_error(-8, 'Target block height %d after current tip %d' % (end_height + 1, end_height),
+                                self.nodes[0].getblockstatsrange, self.start_height, end_height + 1)
+        assert_raises_rpc_error(-8, 'Invalid range %d to %d' % (end_height, self.start_height),
+                                self.nodes[0].getblockstatsrange, end_height, self.start_height)
+
+        # Blocks the index has not reached yet are read from disk, with the same results.
+        self.log.info('Test the statistics read from -blockstatsindex')
+        self.restart_node(0, extra_args=['-blockstatsindex'])
+        assert_equal(self.nodes[0].getblockstatsrange(self.start_height, end_height), self.expected_stats)
+        for i in range(self.max_stat_pos + 1):
+            assert_equal(self.nodes[0].getblockstats(hash_or_height=self.start_height + i), self.expected_stats[i])
+
 
 if __name__ == '__main__':
     GetblockstatsTest().main()
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The LitecoinZ Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test loading UTXO snapshots with `loadtxoutset`.
+
+- Node 0 mines a chain and writes a snapshot at its tip.
+- Node 1 has only the headers, loads the snapshot and is at the base at once,
+  once the snapshot is pinned with -assumeutxo.
+- Once connected, node 1 follows node 0 from the base, and downloads and
+  validates the blocks under it in the background.
+- After a restart, the chainstate of the snapshot is the only one left.
+"""
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+    wait_until,
+)
+
+
+class LoadTxOutSetTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+
+    def setup_network(self):
+        self.setup_nodes()
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        node0.generate(110)
+        dump = node0.dumptxoutset('txoutset.dat')
+        base_hash = dump['base_hash']
+
+        self.log.info("The snapshot is refused without the header of its base")
+        assert_raises_rpc_error(-1, 'is not known', node1.loadtxoutset, dump['path'])
+
+        for height in range(1, 111):
+            node1.submitheader(node0.getblockheader(node0.getblockhash(height), False))
+
+        self.log.info("The snapshot is refused unless the chain parameters pin it")
+        assert_raises_rpc_error(-1, 'is not among the UTXO snapshots', node1.loadtxoutset, dump['path'])
+        muhash = node0.gettxoutsetinfo('muhash')['muhash']
+        shielded_hash = dump['shielded_hash']
+        nchaintx = node0.getchaintxstats()['txcount']
+        self.restart_node(1, extra_args=['-assumeutxo=110:{}:{}:{}:{}'.format(base_hash, '00' * 32, shielded_hash, nchaintx)])
+        node1 = self.nodes[1]
+        assert_raises_rpc_error(-1, 'not to the MuHash3072', node1.loadtxoutset, dump['path'])
+        self.restart_node(1, extra_args=['-assumeutxo=110:{}:{}:{}:{}'.format(base_hash, muhash, '00' * 32, nchaintx)])
+        node1 = self.nodes[1]
+        assert_raises_rpc_error(-1, 'not to the shielded hash', node1.loadtxoutset, dump['path'])
+        self.restart_node(1, extra_args=['-assumeutxo=110:{}:{}:{}:{}'.format(base_hash, muhash, shielded_hash, nchaintx)])
+        node1 = self.nodes[1]
+
+        self.log.info("Load the snapshot, and go on from its base")
+        loaded = node1.loadtxoutset(dump['path'])
+        assert_equal(loaded['base_hash'], base_hash)
+        assert_equal(loaded['base_height'], 110)
+        assert_equal(loaded['coins_loaded'], dump['coins_written'])
+        assert_equal(loaded['txoutset_hash'], muhash)
+        assert_equal(loaded['shielded_hash'], shielded_hash)
+        assert_equal(node1.getbestblockhash(), base_hash)
+        snapshot = node1.getblockchaininfo()['snapshot']
+        assert_equal(snapshot['base_hash'], base_hash)
+        assert_equal(snapshot['validated'], False)
+        assert_equal(snapshot['background_height'], 0)
+        assert_raises_rpc_error(-1, 'loaded from a UTXO snapshot already', node1.loadtxoutset, dump['path'])
+
+        self.log.info("Follow the chain from the base, and validate the blocks under it")
+        node0.generate(5)
+        connect_nodes(node0, 1)
+        self.sync_blocks()
+        wait_until(lambda: node1.getblockchaininfo()['snapshot']['validated'], timeout=60)
+        assert_equal(node1.gettxoutsetinfo('muhash')['muhash'], node0.gettxoutsetinfo('muhash')['muhash'])
+
+        self.log.info("The validated snapshot chainstate is the chainstate after a restart")
+        self.restart_node(1)
+        assert 'snapshot' not in self.nodes[1].getblockchaininfo()
+        assert_equal(self.nodes[1].getbestblockhash(), node0.getbestblockhash())
+        assert_equal(self.nodes[1].gettxoutsetinfo('muhash')['muhash'], node0.gettxoutsetinfo('muhash')['muhash'])
+
+
+if __name__ == '__main__':
+    LoadTxOutSetTest().main()
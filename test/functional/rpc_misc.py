@@ -42,6 +42,21 @@ class RpcMiscTest(BitcoinTestFramework):
         assert_greater_than(memory['chunks_free'], 0)
         assert_equal(memory['used'] + memory['free'], memory['total'])
 
+        # The solutions of the block indexes loaded at startup are on disk, and
+        # reading a header back goes through the cache
+        blockindex = node.getmemoryinfo()['blockindex']
+        assert_greater_than(blockindex['solutions_on_disk'], 0)
+        assert_greater_than(blockindex['solution_bytes_saved'], 0)
+        node.getblockheader(node.getblockhash(1))
+        reads = blockindex['cache_hits'] + blockindex['cache_misses']
+        blockindex = node.getmemoryinfo()['blockindex']
+        assert_greater_than(blockindex['cache_hits'] + blockindex['cache_misses'], reads)
+        assert_greater_than(blockindex['cache_entries'], 0)
+
+        hugepages = node.getmemoryinfo()['hugepages']
+        assert_equal(hugepages['enabled'], False)
+        assert_equal(hugepages['used'], 0)
+
         self.log.info("test mallocinfo")
         try:
             mallocinfo = node.getmemoryinfo(mode="mallocinfo")
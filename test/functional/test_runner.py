@@ -132,6 +132,7 @@ BASE_SCRIPTS = [
     'wallet_watchonly.py --usecli',
     'wallet_reorgsrestore.py',
     'interface_http.py',
+    'interface_metrics.py',
     'interface_rpc.py',
     'rpc_psbt.py',
     'rpc_users.py',
@@ -150,6 +151,7 @@ BASE_SCRIPTS = [
     'wallet_keypool.py',
     'p2p_mempool.py',
     'p2p_filter.py',
+    'p2p_blockfilters.py',
     'rpc_setban.py',
     'p2p_blocksonly.py',
     'mining_prioritisetransaction.py',
@@ -196,6 +198,7 @@ BASE_SCRIPTS = [
     'wallet_resendwallettransactions.py',
     'wallet_fallbackfee.py',
     'rpc_dumptxoutset.py',
+    'rpc_loadtxoutset.py',
     'feature_minchainwork.py',
     'rpc_estimatefee.py',
     'rpc_getblockstats.py',
@@ -205,6 +208,7 @@ BASE_SCRIPTS = [
     'wallet_coinbase_category.py',
     'feature_filelock.py',
     'feature_loadblock.py',
+    'feature_chainhistory.py',
     'p2p_dos_header_tree.py',
     'p2p_unrequested_blocks.py',
     'feature_includeconf.py',
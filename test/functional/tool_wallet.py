@@ -148,6 +148,20 @@ class ToolWalletTest(BitcoinTestFramework):
         assert_equal(shasum_before, shasum_after)
         self.log.debug('Wallet file shasum unchanged\n')
 
+    def test_tool_wallet_compact(self):
+        self.log.info('Calling wallet tool compact, testing that unspent transactions are kept')
+        out = textwrap.dedent('''\
+            Removed 0 transactions
+            Wallet info
+            ===========
+            Encrypted: no
+            HD (hd seed available): yes
+            Keypool Size: 2
+            Transactions: 1
+            Address Book: 3
+        ''')
+        self.assert_tool_output(out, '-wallet=wallet.dat', '-compactdepth=0', 'compact')
+
     def test_tool_wallet_create_on_existing_wallet(self):
         self.log.info('Calling wallet tool create on an existing wallet, testing output')
         shasum_before = self.wallet_shasum()
@@ -197,14 +211,27 @@ class ToolWalletTest(BitcoinTestFramework):
         assert_equal(shasum_after, shasum_before)
         self.log.debug('Wallet file shasum unchanged\n')
 
+    def test_tool_wallet_salvage(self):
+        self.log.info('Calling wallet tool salvage, testing that the keys are recovered')
+        p = self.bitcoin_wallet_process('-wallet=wallet.dat', 'salvage')
+        stdout, stderr = p.communicate()
+        assert_equal(stderr, '')
+        assert_equal(p.poll(), 0)
+        assert stdout.startswith('Salvaged the keys of the wallet')
+        self.start_node(0, ['-rescan'])
+        assert_equal(1, self.nodes[0].getwalletinfo()['txcount'])
+        self.stop_node(0)
+
     def run_test(self):
         self.wallet_path = os.path.join(self.nodes[0].datadir, self.chain, 'wallets', 'wallet.dat')
         self.test_invalid_tool_commands_and_args()
         # Warning: The following tests are order-dependent.
         self.test_tool_wallet_info()
         self.test_tool_wallet_info_after_transaction()
+        self.test_tool_wallet_compact()
         self.test_tool_wallet_create_on_existing_wallet()
         self.test_getwalletinfo_on_different_wallet()
+        self.test_tool_wallet_salvage()
 
 
 if __name__ == '__main__':
@@ -7,11 +7,13 @@
 import os
 import shutil
 
+from test_framework.authproxy import JSONRPCException
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import (
     assert_equal,
     connect_nodes,
-    assert_raises_rpc_error
+    assert_raises_rpc_error,
+    wait_until,
 )
 
 
@@ -25,6 +27,13 @@ class WalletHDTest(BitcoinTestFramework):
     def skip_test_if_missing_module(self):
         self.skip_if_no_wallet()
 
+    def filter_index_synced(self, node):
+        try:
+            node.getblockfilter(node.getbestblockhash())
+            return True
+        except JSONRPCException:
+            return False
+
     def run_test(self):
         # Make sure we use hd, keep masterkeyid
         masterkeyid = self.nodes[1].getwalletinfo()['hdseedid']
@@ -109,6 +118,19 @@ class WalletHDTest(BitcoinTestFramework):
         assert_equal(out['stop_height'], self.nodes[1].getblockcount())
         assert_equal(self.nodes[1].getbalance(), NUM_HD_ADDS + 1)
 
+        self.log.info("Rescan with the block filter index ...")
+        self.stop_node(1)
+        shutil.copyfile(os.path.join(self.nodes[1].datadir, "hd.bak"), os.path.join(self.nodes[1].datadir, self.chain, "wallets", "wallet.dat"))
+        self.start_node(1, extra_args=self.extra_args[1] + ['-blockfilterindex'])
+        # The keys found used are topped up while the rescan runs
+        assert_equal(self.nodes[1].getbalance(), NUM_HD_ADDS + 1)
+        wait_until(lambda: self.filter_index_synced(self.nodes[1]))
+        out = self.nodes[1].rescanblockchain()
+        assert_equal(out['stop_height'], self.nodes[1].getblockcount())
+        assert_equal(self.nodes[1].getbalance(), NUM_HD_ADDS + 1)
+        connect_nodes(self.nodes[0], 1)
+        self.sync_all()
+
         # send a tx and make sure its using the internal chain for the changeoutput
         txid = self.nodes[1].sendtoaddress(self.nodes[0].getnewaddress(), 1)
         outs = self.nodes[1].decoderawtransaction(self.nodes[1].gettransaction(txid)['hex'])['vout']